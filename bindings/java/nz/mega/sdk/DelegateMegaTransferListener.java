@@ -15,6 +15,8 @@
  */
 package nz.mega.sdk;
 
+import java.nio.ByteBuffer;
+
 import nz.mega.sdk.MegaApi;
 import nz.mega.sdk.MegaTransfer;
 
@@ -183,4 +185,33 @@ class DelegateMegaTransferListener extends MegaTransferListener {
         }
         return false;
     }
+
+    /**
+     * This function is called to lend the last read bytes of streaming downloads.
+     * <p>
+     * The buffer is passed as is to the listeners implementing MegaTransferBufferListenerInterface, and copied
+     * for the others. Do not use it after this functions returns.
+     *
+     * @param api
+     *          MegaApi object that started the transfer.
+     * @param transfer
+     *          Information about the transfer.
+     * @param buffer
+     *          Buffer with the last read bytes, lent until this function returns.
+     * @return
+     *          true to continue the transfer, false to cancel it.
+     * @see MegaTransferBufferListenerInterface#onTransferBuffer(MegaApiJava api, MegaTransfer transfer, ByteBuffer buffer)
+     * @see MegaTransferListener#onTransferBuffer(MegaApi api, MegaTransfer transfer, ByteBuffer buffer)
+     */
+    @Override
+    public boolean onTransferBuffer(MegaApi api, MegaTransfer transfer, ByteBuffer buffer) {
+        if (listener instanceof MegaTransferBufferListenerInterface) {
+            final MegaTransfer megaTransfer = transfer.copy();
+            return ((MegaTransferBufferListenerInterface) listener).onTransferBuffer(megaApi, megaTransfer, buffer);
+        }
+
+        byte[] bytes = new byte[buffer.remaining()];
+        buffer.get(bytes);
+        return onTransferData(api, transfer, bytes);
+    }
 }
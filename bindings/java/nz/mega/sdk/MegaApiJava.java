@@ -6763,6 +6763,21 @@ public class MegaApiJava {
         megaApi.startStreaming(node, startPos, size, createDelegateTransferListener(listener));
     }
 
+    /**
+     * Open a file in MEGA to read it at any position.
+     * <p>
+     * Unlike startStreaming(), the data is downloaded as it is read: see MegaReadStream.
+     * The functions of the stream block until the data is available, so don't call them from the
+     * callbacks of the SDK. Delete the stream before this object.
+     *
+     * @param node MegaNode of the file.
+     * @param bufferSize Bytes buffered ahead of the reads at most, 0 for the default (4 MB).
+     * @return The stream, or null if the node isn't a file.
+     */
+    public MegaReadStream createReadStream(MegaNode node, long bufferSize) {
+        return megaApi.createReadStream(node, bufferSize);
+    }
+
     /**
      * Cancel a transfer.
      * <p>
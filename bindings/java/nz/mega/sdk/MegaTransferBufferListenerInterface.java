@@ -0,0 +1,46 @@
+/*
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,\
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * @copyright Simplified (2-clause) BSD License.
+ * You should have received a copy of the license along with this
+ * program.
+ */
+package nz.mega.sdk;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Interface to receive information about transfers, and the data of streaming downloads without copying it.
+ * <p>
+ * A listener implementing it gets onTransferBuffer() instead of
+ * MegaTransferListenerInterface.onTransferData(MegaApiJava api, MegaTransfer transfer, byte[] buffer).
+ */
+public interface MegaTransferBufferListenerInterface extends MegaTransferListenerInterface {
+    /**
+     * This function is called to lend the last read bytes of streaming downloads.
+     * <p>
+     * The buffer is a direct ByteBuffer over the memory of the SDK, which reuses it once this function returns:
+     * copy what you need to keep before that, and do not use the buffer afterwards. The SDK retains the ownership
+     * of the transfer parameter.
+     * <p>
+     * This function is called on the thread of the SDK, not through MegaApiJava.runCallback().
+     *
+     * @param api
+     *          MegaApi object that started the transfer.
+     * @param transfer
+     *          Information about the transfer.
+     * @param buffer
+     *          Buffer with the last read bytes.
+     * @return
+     *          true to continue the transfer, false to cancel it.
+     */
+    public boolean onTransferBuffer(MegaApiJava api, MegaTransfer transfer, ByteBuffer buffer);
+}
@@ -271,8 +271,133 @@ extern "C" jint JNIEXPORT JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 %}
 #endif
 
+// the buffer lent by onTransferBuffer, without a copy: valid until the callback returns
+%typemap(jni) (char *data, size_t length) "jobject"
+%typemap(jtype) (char *data, size_t length) "java.nio.ByteBuffer"
+%typemap(jstype) (char *data, size_t length) "java.nio.ByteBuffer"
+%typemap(javain) (char *data, size_t length) "$javainput"
+%typemap(javadirectorin) (char *data, size_t length) "$jniinput"
+%typemap(in) (char *data, size_t length)
+%{
+    $1 = $input ? (char *)jenv->GetDirectBufferAddress($input) : NULL;
+    $2 = $1 ? (size_t)jenv->GetDirectBufferCapacity($input) : 0;
+%}
+%typemap(directorin, descriptor="Ljava/nio/ByteBuffer;") (char *data, size_t length)
+%{
+    $input = jenv->NewDirectByteBuffer($1, (jlong)$2);
+%}
+%typemap(directorargout) (char *data, size_t length)
+%{
+    jenv->DeleteLocalRef($input);
+%}
+
+// MegaReadStream::read writes into the byte array of the caller
+%typemap(jni) (char *output, size_t outputSize) "jbyteArray"
+%typemap(jtype) (char *output, size_t outputSize) "byte[]"
+%typemap(jstype) (char *output, size_t outputSize) "byte[]"
+%typemap(javain) (char *output, size_t outputSize) "$javainput"
+%typemap(in) (char *output, size_t outputSize)
+%{
+    $1 = $input ? (char *)jenv->GetByteArrayElements($input, NULL) : NULL;
+    $2 = $input ? (size_t)jenv->GetArrayLength($input) : 0;
+%}
+%typemap(argout) (char *output, size_t outputSize)
+%{
+    if ($input)
+    {
+        jenv->ReleaseByteArrayElements($input, (jbyte *)$1, 0);
+    }
+%}
+
+// the columns of a MegaNodeColumns or a MegaTransferColumns, copied into a Java array in one call each
+%define MEGA_COLUMN(CLASS, SIZE, CTYPE, GETTER, JNITYPE, JAVATYPE, NEWARRAY, SETREGION, JELEM)
+%typemap(jni) const CTYPE* mega::CLASS::GETTER "JNITYPE"
+%typemap(jtype) const CTYPE* mega::CLASS::GETTER "JAVATYPE"
+%typemap(jstype) const CTYPE* mega::CLASS::GETTER "JAVATYPE"
+%typemap(javaout) const CTYPE* mega::CLASS::GETTER { return $jnicall; }
+%typemap(out) const CTYPE* mega::CLASS::GETTER
+%{
+    {
+        jsize count = (jsize)arg1->SIZE();
+        $result = jenv->NEWARRAY(count);
+        if ($result && count)
+        {
+            jenv->SETREGION($result, 0, count, (const JELEM *)$1);
+        }
+    }
+%}
+%enddef
+
+MEGA_COLUMN(MegaNodeColumns, size, MegaHandle, getHandles, jlongArray, long[], NewLongArray, SetLongArrayRegion, jlong)
+MEGA_COLUMN(MegaNodeColumns, size, long long, getSizes, jlongArray, long[], NewLongArray, SetLongArrayRegion, jlong)
+MEGA_COLUMN(MegaNodeColumns, size, long long, getModificationTimes, jlongArray, long[], NewLongArray, SetLongArrayRegion, jlong)
+MEGA_COLUMN(MegaNodeColumns, size, int, getTypes, jintArray, int[], NewIntArray, SetIntArrayRegion, jint)
+MEGA_COLUMN(MegaNodeColumns, size, int, getFlags, jintArray, int[], NewIntArray, SetIntArrayRegion, jint)
+
+MEGA_COLUMN(MegaTransferColumns, size, int, getTags, jintArray, int[], NewIntArray, SetIntArrayRegion, jint)
+MEGA_COLUMN(MegaTransferColumns, size, int, getTypes, jintArray, int[], NewIntArray, SetIntArrayRegion, jint)
+MEGA_COLUMN(MegaTransferColumns, size, int, getStates, jintArray, int[], NewIntArray, SetIntArrayRegion, jint)
+MEGA_COLUMN(MegaTransferColumns, size, long long, getTransferredBytes, jlongArray, long[], NewLongArray, SetLongArrayRegion, jlong)
+MEGA_COLUMN(MegaTransferColumns, size, long long, getTotalBytes, jlongArray, long[], NewLongArray, SetLongArrayRegion, jlong)
+MEGA_COLUMN(MegaTransferColumns, size, long long, getSpeeds, jlongArray, long[], NewLongArray, SetLongArrayRegion, jlong)
+MEGA_COLUMN(MegaTransferColumns, size, unsigned long long, getPriorities, jlongArray, long[], NewLongArray, SetLongArrayRegion, jlong)
+MEGA_COLUMN(MegaTransferColumns, getNumFinished, int, getFinishedTags, jintArray, int[], NewIntArray, SetIntArrayRegion, jint)
+
+#endif
+
+#ifdef SWIGPYTHON
+// the buffer lent by onTransferBuffer, without a copy: a memoryview released when the callback returns
+%typemap(directorin) (char *data, size_t length)
+%{
+#if PY_VERSION_HEX >= 0x03030000
+    $input = PyMemoryView_FromMemory($1, (Py_ssize_t)$2, PyBUF_READ);
+#else
+    $input = PyBuffer_FromMemory($1, (Py_ssize_t)$2);
+#endif
+%}
+%typemap(directorargout) (char *data, size_t length)
+%{
+#if PY_VERSION_HEX >= 0x03030000
+    {
+        // fails if the callback kept an export of it, which then stays readable until the SDK reuses the memory
+        PyObject *released = PyObject_CallMethod($input, (char *)"release", NULL);
+        Py_XDECREF(released);
+        PyErr_Clear();
+    }
+#endif
+%}
+%typemap(in) (char *data, size_t length) (Py_buffer view)
+%{
+    if (PyObject_GetBuffer($input, &view, PyBUF_SIMPLE) != 0)
+    {
+        SWIG_fail;
+    }
+    $1 = (char *)view.buf;
+    $2 = (size_t)view.len;
+%}
+%typemap(freearg) (char *data, size_t length)
+%{
+    PyBuffer_Release(&view$argnum);
+%}
+
+// MegaReadStream::read writes into a writable buffer of the caller (a bytearray, a memoryview...)
+%typemap(in) (char *output, size_t outputSize) (Py_buffer view)
+%{
+    if (PyObject_GetBuffer($input, &view, PyBUF_WRITABLE) != 0)
+    {
+        SWIG_fail;
+    }
+    $1 = (char *)view.buf;
+    $2 = (size_t)view.len;
+%}
+%typemap(freearg) (char *output, size_t outputSize)
+%{
+    PyBuffer_Release(&view$argnum);
+%}
 #endif
 
+%newobject mega::MegaApi::createReadStream;
+
 %feature("director") mega::MegaGlobalListener;
 %feature("director") mega::MegaListener;
 %feature("director") mega::MegaTreeProcessor;
@@ -350,15 +475,20 @@ extern "C" jint JNIEXPORT JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 %ignore mega::MegaRequest::getListener;
 %ignore mega::MegaHashSignature;
 %ignore mega::SynchronousRequestListener;
+%ignore mega::MegaRequestContinuation;
+%ignore mega::MegaRequestOutcome;
 %ignore mega::SynchronousTransferListener;
 
 %newobject mega::MegaError::copy;
 %newobject mega::MegaRequest::copy;
 %newobject mega::MegaTransfer::copy;
 %newobject mega::MegaTransferList::copy;
+%newobject mega::MegaTransferBatch::copy;
+%newobject mega::MegaTransferBatch::createInstance;
 %newobject mega::MegaNode::copy;
 %newobject mega::MegaNodeList::copy;
 %newobject mega::MegaChildrenList::copy;
+%newobject mega::MegaNodeCursor::getPage;
 %newobject mega::MegaShare::copy;
 %newobject mega::MegaShareList::copy;
 %newobject mega::MegaUser::copy;
@@ -391,6 +521,9 @@ extern "C" jint JNIEXPORT JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 %newobject mega::MegaApi::getTransferByTag;
 %newobject mega::MegaApi::getChildTransfers;
 %newobject mega::MegaApi::getChildren;
+%newobject mega::MegaApi::getChildrenCursor;
+%newobject mega::MegaApi::getChildrenColumns;
+%newobject mega::MegaApi::getTransferColumns;
 %newobject mega::MegaApi::getChildNode;
 %newobject mega::MegaApi::getParentNode;
 %newobject mega::MegaApi::getNodePath;
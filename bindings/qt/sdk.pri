@@ -37,21 +37,30 @@ SOURCES += src/attrmap.cpp \
     src/command.cpp \
     src/commands.cpp \
     src/db.cpp \
+    src/asyncdbtable.cpp \
     src/gfx.cpp \
     src/file.cpp \
     src/fileattributefetch.cpp \
     src/filefingerprint.cpp \
+    src/fingerprintservice.cpp \
+    src/chunkindex.cpp \
     src/filesystem.cpp \
     src/http.cpp \
     src/json.cpp \
     src/megaclient.cpp \
     src/node.cpp \
+    src/nodestore.cpp \
+    src/nodenameindex.cpp \
+    src/trace.cpp \
+    src/nodesnapshot.cpp \
+    src/screcorder.cpp \
     src/pubkeyaction.cpp \
     src/request.cpp \
     src/serialize64.cpp \
     src/share.cpp \
     src/sharenodekeys.cpp \
     src/sync.cpp \
+    src/scanservice.cpp \
     src/transfer.cpp \
     src/transferslot.cpp \
     src/treeproc.cpp \
@@ -115,6 +124,14 @@ CONFIG(USE_POLL) {
     DEFINES += USE_POLL
 }
 
+CONFIG(USE_EPOLL) {
+    DEFINES += USE_EPOLL
+}
+
+CONFIG(USE_KQUEUE) {
+    DEFINES += USE_KQUEUE
+}
+
 CONFIG(USE_CONSOLE) {
     win32 {
 
@@ -449,22 +466,31 @@ HEADERS  += include/mega.h \
             include/mega/command.h \
             include/mega/console.h \
             include/mega/db.h \
+            include/mega/asyncdbtable.h \
             include/mega/gfx.h \
             include/mega/file.h \
             include/mega/fileattributefetch.h \
             include/mega/filefingerprint.h \
+            include/mega/fingerprintservice.h \
+            include/mega/chunkindex.h \
             include/mega/filesystem.h \
             include/mega/http.h \
             include/mega/json.h \
             include/mega/megaapp.h \
             include/mega/megaclient.h \
             include/mega/node.h \
+            include/mega/nodestore.h \
+            include/mega/nodenameindex.h \
+            include/mega/trace.h \
+            include/mega/nodesnapshot.h \
+            include/mega/screcorder.h \
             include/mega/pubkeyaction.h \
             include/mega/request.h \
             include/mega/serialize64.h \
             include/mega/share.h \
             include/mega/sharenodekeys.h \
             include/mega/sync.h \
+            include/mega/scanservice.h \
             include/mega/heartbeats.h \
             include/mega/transfer.h \
             include/mega/transferslot.h \
@@ -0,0 +1,86 @@
+#!/usr/bin/env python
+
+# Converts a binary trace written by the SDK (MegaApi::startTracing) into the Chrome trace
+# event format, to be opened in chrome://tracing or https://ui.perfetto.dev
+#
+# usage: trace2chrome.py <trace file> [<output json>]
+
+from __future__ import print_function
+
+import json, struct, sys
+
+MAGIC = b'MEGATRC1'
+
+# TraceRecord: timestamp, handle, size, duration, event, thread
+RECORD = struct.Struct('<QQQIHH')
+
+UNDEF = 0xFFFFFFFFFFFFFFFF
+
+# keep in step with TraceSubsystem and TraceEventId in include/mega/trace.h
+SUBSYSTEMS = ['http', 'transfer', 'gfx']
+EVENTS = {
+    0x0000: 'HTTP request',
+    0x0001: 'HTTP failure',
+    0x0100: 'Download chunk',
+    0x0101: 'Upload chunk',
+    0x0200: 'Thumbnail/preview job',
+}
+
+B64 = 'ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_'
+
+def handle_b64(h, size):
+    # same encoding as the SDK's Base64Str: little endian bytes, unpadded url-safe base64
+    data = struct.pack('<Q', h)[:size]
+    bits = ''.join(format(ord(data[i:i+1]), '08b') for i in range(len(data)))
+    bits += '0' * (-len(bits) % 6)
+    return ''.join(B64[int(bits[i:i+6], 2)] for i in range(0, len(bits), 6))
+
+def main():
+    if len(sys.argv) < 2:
+        print('usage: %s <trace file> [<output json>]' % sys.argv[0], file=sys.stderr)
+        return 1
+
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+
+    if data[:8] != MAGIC:
+        print('not a MEGA SDK trace', file=sys.stderr)
+        return 1
+
+    start, = struct.unpack_from('<Q', data, 8)
+    events = []
+    offset = 16
+    while offset + RECORD.size <= len(data):
+        timestamp, handle, size, duration, event, thread = RECORD.unpack_from(data, offset)
+        offset += RECORD.size
+
+        subsystem = event >> 8
+        args = {'size': size}
+        if handle != UNDEF and subsystem == 0:
+            # HTTP events carry the trace id of their transfer, as in MegaTransfer::getTraceId
+            args['traceid'] = '%016x' % handle
+        elif handle != UNDEF:
+            # node handles are 6 bytes, upload handles 8
+            args['handle'] = handle_b64(handle, 6 if handle >> 48 == 0 else 8)
+
+        events.append({
+            'name': EVENTS.get(event, 'event %d' % event),
+            'cat': SUBSYSTEMS[subsystem] if subsystem < len(SUBSYSTEMS) else str(subsystem),
+            'ph': 'X',
+            'ts': timestamp - duration,
+            'dur': duration,
+            'pid': 1,
+            'tid': thread,
+            'args': args,
+        })
+
+    output = {'traceEvents': events, 'otherData': {'startMicrosecondsSinceEpoch': start}}
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], 'w') as f:
+            json.dump(output, f)
+    else:
+        json.dump(output, sys.stdout)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
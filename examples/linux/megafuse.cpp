@@ -20,10 +20,11 @@
  */
 
 // This example implements the following operations: getattr, readdir,
-// open, read, mkdir, rmdir, unlink and rename.
+// open, read, release, mkdir, rmdir, unlink and rename.
 // File writes are NOT supported yet.
-// There isn't any caching nor the implementation does any prefetching
-// to improve read performance.
+// Paths are resolved through a cache of the nodes already looked up (with
+// their attributes), which the changes of the account invalidate. Open files
+// are read through a MegaReadStream, which buffers ahead of sequential reads.
 
 #define FUSE_USE_VERSION 30
 #include <fuse.h>
@@ -37,6 +38,8 @@
 #include <mutex>
 #include <condition_variable>
 #include <iostream>
+#include <map>
+#include <memory>
 
 using namespace mega;
 using namespace std;
@@ -183,14 +186,162 @@ class SynchronousTransferListenerFuse : public MegaTransferListener
 		mutex m;
 };
 
+// The nodes looked up by path, and those known not to exist, with their attributes.
+// A path is resolved from the closest folder already known, one child lookup per
+// missing component, rather than from the root by MegaApi::getNodeByPath.
+// The changes of the account (including ours) drop the entries of the nodes changed
+// and of everything below them, and all the negative ones.
+class NodeCache : public MegaGlobalListener
+{
+	public:
+		struct Entry
+		{
+			MegaHandle handle = INVALID_HANDLE;
+			bool isFile = false;
+			long long size = 0;
+			int64_t mtime = 0;
+		};
+
+		// false if the path doesn't exist
+		bool lookup(string path, Entry& entry)
+		{
+			// the root of the mount is the base path with a trailing slash
+			if (path.size() > 1 && path[path.size() - 1] == '/')
+			{
+				path.resize(path.size() - 1);
+			}
+
+			{
+				lock_guard<mutex> g(m);
+				auto it = entries.find(path);
+				if (it != entries.end())
+				{
+					entry = it->second;
+					return entry.handle != INVALID_HANDLE;
+				}
+			}
+
+			unique_ptr<MegaNode> node(resolve(path));
+			entry = node ? entryOf(node.get()) : Entry();
+			store(path, entry);
+			return node != nullptr;
+		}
+
+		// the node of a path, NULL if it doesn't exist. You take the ownership
+		MegaNode *getNode(const string& path)
+		{
+			Entry entry;
+			return lookup(path, entry) ? megaApi->getNodeByHandle(entry.handle) : NULL;
+		}
+
+		// for the children listed by readdir
+		void add(const string& path, MegaNode *node)
+		{
+			store(path, entryOf(node));
+		}
+
+		// after a change of ours, not to wait for its notification
+		void forget(const string& path)
+		{
+			lock_guard<mutex> g(m);
+			forgetLocked(path);
+		}
+
+		void onNodesUpdate(MegaApi*, MegaNodeList *nodes) override
+		{
+			lock_guard<mutex> g(m);
+			if (!nodes)
+			{
+				entries.clear();
+				return;
+			}
+
+			for (int i = 0; i < nodes->size(); i++)
+			{
+				MegaHandle h = nodes->get(i)->getHandle();
+				for (auto it = entries.begin(); it != entries.end(); )
+				{
+					if (it->second.handle == h)
+					{
+						string path = it->first;
+						++it;
+						forgetLocked(path);
+						it = entries.upper_bound(path);
+					}
+					else
+					{
+						++it;
+					}
+				}
+			}
+
+			for (auto it = entries.begin(); it != entries.end(); )
+			{
+				it = it->second.handle == INVALID_HANDLE ? entries.erase(it) : std::next(it);
+			}
+		}
+
+	private:
+		static Entry entryOf(MegaNode *n)
+		{
+			Entry entry;
+			entry.handle = n->getHandle();
+			entry.isFile = n->isFile();
+			entry.size = n->isFile() ? n->getSize() : 4096;
+			entry.mtime = n->isFile() ? n->getModificationTime() : n->getCreationTime();
+			return entry;
+		}
+
+		MegaNode *resolve(const string& path)
+		{
+			size_t index = path.find_last_of('/');
+			if (index == string::npos || path.size() <= 1)
+			{
+				return megaApi->getNodeByPath(path.size() ? path.c_str() : "/");
+			}
+
+			string parentPath = path.substr(0, index);
+			Entry parent;
+			if (!lookup(parentPath.size() ? parentPath : "/", parent) || parent.isFile)
+			{
+				return NULL;
+			}
+
+			unique_ptr<MegaNode> parentNode(megaApi->getNodeByHandle(parent.handle));
+			return parentNode ? megaApi->getChildNode(parentNode.get(), path.c_str() + index + 1) : NULL;
+		}
+
+		void store(const string& path, const Entry& entry)
+		{
+			lock_guard<mutex> g(m);
+			entries[path] = entry;
+		}
+
+		void forgetLocked(const string& path)
+		{
+			entries.erase(path);
+			string prefix = path + "/";
+			auto it = entries.lower_bound(prefix);
+			while (it != entries.end() && !it->first.compare(0, prefix.size(), prefix))
+			{
+				it = entries.erase(it);
+			}
+		}
+
+		mutex m;
+		map<string, Entry> entries;
+};
+
+NodeCache nodeCache;
+
 static int MEGAgetattr(const char *p, struct stat *stbuf)
 {
 	string path = megaBasePath + p;
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Getting attributes:");
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, path.c_str());
 
-	MegaNode *n = megaApi->getNodeByPath(path.c_str());
-	if (!n)
+	NodeCache::Entry entry;
+	if (!nodeCache.lookup(path, entry))
 	{
 		MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Node not found");
 		return -ENOENT;
@@ -198,12 +349,11 @@ static int MEGAgetattr(const char *p, struct stat *stbuf)
 	
 	stbuf->st_uid = getuid();
 	stbuf->st_gid = getgid();
-	stbuf->st_mode = n->isFile() ? S_IFREG | 0444 : S_IFDIR | 0755;
+	stbuf->st_mode = entry.isFile ? S_IFREG | 0444 : S_IFDIR | 0755;
 	stbuf->st_nlink = 1;
-	stbuf->st_size = n->isFile() ? n->getSize() : 4096;
-	stbuf->st_mtime = n->isFile() ? n->getModificationTime() : n->getCreationTime();
+	stbuf->st_size = entry.size;
+	stbuf->st_mtime = entry.mtime;
 		
-	delete n;
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Attributes read OK");
 	return 0;
 }
@@ -214,7 +364,7 @@ static int MEGAmkdir(const char *p, mode_t mode)
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Creating folder:");
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, path.c_str());
 	
-	MegaNode *n = megaApi->getNodeByPath(path.c_str());
+	MegaNode *n = nodeCache.getNode(path);
 	if (n)
 	{
 		MegaApi::log(MegaApi::LOG_LEVEL_WARNING, "Path already exists");
@@ -231,7 +381,7 @@ static int MEGAmkdir(const char *p, mode_t mode)
 	}
 	
 	spath.resize(index + 1);
-	n = megaApi->getNodeByPath(spath.c_str());
+	n = nodeCache.getNode(spath);
 	if (!n || n->isFile())
 	{
 		MegaApi::log(MegaApi::LOG_LEVEL_WARNING, "Parent folder not found");
@@ -244,6 +394,7 @@ static int MEGAmkdir(const char *p, mode_t mode)
 	megaApi->createFolder(path.c_str() + index + 1, n, &listener);
 	listener.wait();
 	delete n;
+	nodeCache.forget(path);
 	
 	if (listener.getError()->getErrorCode() != MegaError::API_OK)
 	{
@@ -261,7 +412,7 @@ static int MEGArmdir(const char *p)
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Deleting folder:");
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, path.c_str());
 	
-	MegaNode *n = megaApi->getNodeByPath(path.c_str());
+	MegaNode *n = nodeCache.getNode(path);
 	if (!n)
 	{
 		MegaApi::log(MegaApi::LOG_LEVEL_WARNING, "Folder not found");
@@ -286,6 +437,7 @@ static int MEGArmdir(const char *p)
 	megaApi->remove(n, &listener);
 	listener.wait();
 	delete n;
+	nodeCache.forget(path);
 	
 	if (listener.getError()->getErrorCode() != MegaError::API_OK)
 	{
@@ -304,7 +456,7 @@ static int MEGAunlink(const char *p)
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Deleting file:");
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, path.c_str());
 	
-	MegaNode *n = megaApi->getNodeByPath(path.c_str());
+	MegaNode *n = nodeCache.getNode(path);
 	if (!n)
 	{
 		MegaApi::log(MegaApi::LOG_LEVEL_WARNING, "File not found");
@@ -322,6 +474,7 @@ static int MEGAunlink(const char *p)
 	megaApi->remove(n, &listener);
 	listener.wait();
 	delete n;
+	nodeCache.forget(path);
 	
 	if (listener.getError()->getErrorCode() != MegaError::API_OK)
 	{
@@ -343,14 +496,14 @@ static int MEGArename(const char *f, const char *t)
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, from.c_str());
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, to.c_str());
 
-	MegaNode *source = megaApi->getNodeByPath(from.c_str());
+	MegaNode *source = nodeCache.getNode(from);
 	if (!source)
 	{
 		MegaApi::log(MegaApi::LOG_LEVEL_WARNING, "Source not found");
 		return -ENOENT;
 	}
 	
-	MegaNode *dest = megaApi->getNodeByPath(to.c_str());
+	MegaNode *dest = nodeCache.getNode(to);
 	if (dest)
 	{
 		if (dest->isFile())
@@ -367,6 +520,8 @@ static int MEGArename(const char *f, const char *t)
 			listener.wait();
 			delete source;
 			delete dest;
+			nodeCache.forget(from);
+			nodeCache.forget(to);
 			
 			if (listener.getError()->getErrorCode() != MegaError::API_OK)
 			{
@@ -390,7 +545,7 @@ static int MEGArename(const char *f, const char *t)
 	
 	string destname = destpath.c_str() + index + 1;
 	destpath.resize(index + 1);
-	dest = megaApi->getNodeByPath(destpath.c_str());
+	dest = nodeCache.getNode(destpath);
 	if (!dest)
 	{
 		delete source;
@@ -420,6 +575,8 @@ static int MEGArename(const char *f, const char *t)
 	megaApi->moveNode(source, dest, &listener);
 	listener.wait();
 	delete dest;
+	nodeCache.forget(from);
+	nodeCache.forget(to);
 	
 	if (listener.getError()->getErrorCode() != MegaError::API_OK)
 	{
@@ -456,7 +613,7 @@ static int MEGAreaddir(const char *p, void *buf, fuse_fill_dir_t filler,
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Listing folder:");
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, path.c_str());
 
-	MegaNode *node = megaApi->getNodeByPath(path.c_str());
+	MegaNode *node = nodeCache.getNode(path);
 	if (!node)
 	{
 		MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Folder not found");
@@ -466,10 +623,12 @@ static int MEGAreaddir(const char *p, void *buf, fuse_fill_dir_t filler,
 	filler(buf, ".", NULL, 0);
 	filler(buf, "..", NULL, 0);
 	MegaNodeList *children = megaApi->getChildren(node);
+	string prefix = path[path.size() - 1] == '/' ? path : path + "/";
 	for (int i=0; i<children->size(); i++)
 	{
 		MegaNode *n = children->get(i);
 		filler(buf, n->getName(), NULL, 0);
+		nodeCache.add(prefix + n->getName(), n);
 		MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, n->getName());
 	}
 	
@@ -480,55 +639,67 @@ static int MEGAreaddir(const char *p, void *buf, fuse_fill_dir_t filler,
 	return 0;
 }
 
-static int MEGAopen(const char *path, struct fuse_file_info *fi)
-{
-    return 0;
-}
+// the size of the buffer of the stream of each open file
+static const long long READ_BUFFER_SIZE = 8 * 1024 * 1024;
 
-static int MEGAread(const char *p, char *buf, size_t size, off_t offset,
-                      struct fuse_file_info *fi)
+static int MEGAopen(const char *p, struct fuse_file_info *fi)
 {
 	string path = megaBasePath + p;
-	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Reading file:");
+	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "Opening file:");
 	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, path.c_str());
-        	
-	MegaNode *node = megaApi->getNodeByPath(path.c_str());
+
+	if ((fi->flags & O_ACCMODE) != O_RDONLY)
+	{
+		return -EACCES;
+	}
+
+	MegaNode *node = nodeCache.getNode(path);
 	if (!node)
 	{
 		MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "File not found");
 		return -ENOENT;
-	}	
-	
-	if (offset >= node->getSize())
-	{
-		delete node;
-		return 0;
-	}
-	
-	if (offset + size > node->getSize())
-	{
-		size = node->getSize() - offset;
 	}
-	
-	SynchronousTransferListenerFuse listener;
-	megaApi->startStreaming(node, offset, size, &listener);
-	listener.wait();
+
+	MegaReadStream *stream = megaApi->createReadStream(node, READ_BUFFER_SIZE);
 	delete node;
-	if (listener.getError()->getErrorCode() != MegaError::API_OK)
+	if (!stream)
 	{
-		MegaApi::log(MegaApi::LOG_LEVEL_ERROR, "Transfer error");
-		return -EIO;
+		return -EISDIR;
 	}
-	
-	if (listener.getDataSize() != size)
+
+	fi->fh = (uint64_t)stream;
+	return 0;
+}
+
+static int MEGAread(const char *p, char *buf, size_t size, off_t offset,
+                      struct fuse_file_info *fi)
+{
+	MegaReadStream *stream = (MegaReadStream *)fi->fh;
+
+	// FUSE expects all the bytes asked for, unless the file ends before
+	size_t done = 0;
+	while (done < size)
 	{
-		MegaApi::log(MegaApi::LOG_LEVEL_ERROR, "Internal error");
-		return -EIO;
+		long long n = stream->read(offset + done, buf + done, size - done);
+		if (n < 0)
+		{
+			MegaApi::log(MegaApi::LOG_LEVEL_ERROR, "Transfer error");
+			return -EIO;
+		}
+		if (!n)
+		{
+			break;
+		}
+		done += size_t(n);
 	}
-	
-	memcpy(buf, listener.getData(), size);
-	MegaApi::log(MegaApi::LOG_LEVEL_DEBUG, "File read OK");
-    return size;
+	return int(done);
+}
+
+static int MEGArelease(const char *p, struct fuse_file_info *fi)
+{
+	delete (MegaReadStream *)fi->fh;
+	fi->fh = 0;
+	return 0;
 }
 
 int main(int argc, char *argv[])
@@ -615,6 +786,7 @@ int main(int argc, char *argv[])
 		delete baseNode;
 	}
 		
+	megaApi->addGlobalListener(&nodeCache);
 	MegaApi::log(MegaApi::LOG_LEVEL_INFO, "MEGA initialization complete!");	
 	megaApi->setLogLevel(MegaApi::LOG_LEVEL_WARNING);
 
@@ -624,6 +796,7 @@ int main(int argc, char *argv[])
     ops.readdir     = MEGAreaddir;
     ops.open        = MEGAopen;
     ops.read		= MEGAread;
+    ops.release		= MEGArelease;
     ops.mkdir		= MEGAmkdir;
     ops.rmdir		= MEGArmdir;
     ops.unlink		= MEGAunlink;
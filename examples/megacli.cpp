@@ -954,8 +954,12 @@ void DemoApp::unlink_result(handle, error e)
     }
 }
 
+static void benchFetchnodesResult(const Error& e);
+
 void DemoApp::fetchnodes_result(const Error& e)
 {
+    benchFetchnodesResult(e);
+
     if (e)
     {
         if (e == API_ENOENT && e.hasExtraInfo())
@@ -1784,7 +1788,7 @@ static void dumptree(Node* n, bool recurse, int depth, const char* title, ofstre
 
     if (n->type != FILENODE)
     {
-        for (node_list::iterator it = n->children.begin(); it != n->children.end(); it++)
+        for (NodeChildren::iterator it = n->children.begin(); it != n->children.end(); it++)
         {
             dumptree(*it, recurse, depth + 1, NULL, toFile);
         }
@@ -2487,6 +2491,376 @@ void exec_codeTimings(autocomplete::ACState& s)
 
 #endif
 
+void exec_screcord(autocomplete::ACState& s)
+{
+    if (s.extractflag("-stop"))
+    {
+        cout << "Responses recorded: " << client->stopScRecording() << endl;
+    }
+    else if (s.words.size() == 2)
+    {
+        client->startScRecording(LocalPath::fromPath(s.words[1].s, *client->fsaccess));
+        cout << "Recording from the next action packet response on. The file holds the account key." << endl;
+    }
+}
+
+// `bench`: performance probes against the account logged in, to measure an environment with a release build.
+// Each reports the throughput of the run and the percentiles of the latency of its items, and for the probes
+// that go through the engine's HTTP requests, the latency histogram of that endpoint (MegaClient::mLatency),
+// which is reset when the run starts.
+struct BenchRun
+{
+    string name;
+    int items = 0;
+    int done = 0;
+    int failed = 0;
+    m_off_t bytes = 0;
+    int endpoint = -1;      // MegaClient::LatencyEndpoint, -1 if none
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CodeCounter::Histogram latency;     // us, per item
+    CodeCounter::Histogram firstByte;   // us, per read of a download
+
+    // starts the next item of the runs that go one item at a time
+    std::function<void()> next;
+};
+
+static unique_ptr<BenchRun> gBench;
+
+static uint64_t benchElapsedUs(std::chrono::steady_clock::time_point since)
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count());
+}
+
+static void benchPercentiles(const char* what, const CodeCounter::Histogram& h)
+{
+    if (h.count())
+    {
+        cout << "  " << what << " (ms): p50 " << h.percentile(0.5) / 1000.0 << "  p90 " << h.percentile(0.9) / 1000.0
+             << "  p99 " << h.percentile(0.99) / 1000.0 << "  max " << h.max() / 1000.0 << endl;
+    }
+}
+
+static void benchReport()
+{
+    BenchRun& b = *gBench;
+    double seconds = double(benchElapsedUs(b.start)) / 1e6;
+
+    cout << "bench " << b.name << ": " << b.done << " done, " << b.failed << " failed in " << seconds << " s";
+    if (seconds > 0)
+    {
+        cout << ", " << double(b.done) / seconds << " /s";
+        if (b.bytes)
+        {
+            cout << ", " << double(b.bytes) / seconds / (1 << 20) << " MB/s";
+        }
+    }
+    cout << endl;
+
+    benchPercentiles("latency", b.latency);
+    benchPercentiles("time to first byte", b.firstByte);
+    if (b.endpoint >= 0)
+    {
+        cout << "  endpoint latency: " << client->mLatency[size_t(b.endpoint)].toJson() << endl;
+    }
+
+    gBench.reset();
+}
+
+static bool benchStart(const string& name, int items, int endpoint)
+{
+    if (gBench)
+    {
+        cout << "bench " << gBench->name << " is still running" << endl;
+        return false;
+    }
+
+    gBench.reset(new BenchRun);
+    gBench->name = name;
+    gBench->items = items;
+    gBench->endpoint = endpoint;
+    if (endpoint >= 0)
+    {
+        client->mLatency[size_t(endpoint)].reset();
+    }
+    return true;
+}
+
+static void benchItemDone(uint64_t us, m_off_t bytes, bool success)
+{
+    if (!gBench)
+    {
+        return;
+    }
+
+    if (success)
+    {
+        gBench->done++;
+        gBench->bytes += bytes;
+        gBench->latency.record(us);
+    }
+    else
+    {
+        gBench->failed++;
+    }
+
+    if (gBench->done + gBench->failed >= gBench->items)
+    {
+        benchReport();
+    }
+    else if (gBench->next)
+    {
+        gBench->next();
+    }
+}
+
+// a slice of a download, streamed without being written to disk
+struct BenchRead
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    m_off_t size;
+    m_off_t received = 0;
+};
+
+static std::set<BenchRead*> gBenchReads;
+
+// DemoApp::pread_data() and pread_failure() for the reads of `bench download`, false if appdata isn't one
+static bool benchPreadData(m_off_t len, void* appdata)
+{
+    auto read = static_cast<BenchRead*>(appdata);
+    if (!gBenchReads.count(read))
+    {
+        return false;
+    }
+
+    if (!read->received && gBench)
+    {
+        gBench->firstByte.record(benchElapsedUs(read->start));
+    }
+
+    read->received += len;
+    if (read->received >= read->size)
+    {
+        gBenchReads.erase(read);
+        benchItemDone(benchElapsedUs(read->start), read->size, true);
+        delete read;
+    }
+    return true;
+}
+
+static bool benchPreadFailure(void* appdata)
+{
+    auto read = static_cast<BenchRead*>(appdata);
+    if (!gBenchReads.count(read))
+    {
+        return false;
+    }
+
+    gBenchReads.erase(read);
+    benchItemDone(0, 0, false);
+    delete read;
+    return true;
+}
+
+// an upload of `bench upload`, to the Rubbish Bin, from a temporary file removed once done
+struct BenchFilePut : public AppFilePut
+{
+    using AppFilePut::AppFilePut;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    void completed(Transfer* t, LocalNode* l) override
+    {
+        benchItemDone(benchElapsedUs(start), size, true);
+        LocalPath temporary = localname;
+        AppFilePut::completed(t, l);
+        client->fsaccess->unlinklocal(temporary);
+    }
+
+    void terminated() override
+    {
+        benchItemDone(0, 0, false);
+        LocalPath temporary = localname;
+        AppFilePut::terminated();
+        client->fsaccess->unlinklocal(temporary);
+    }
+};
+
+static bool benchWriteRandomFile(LocalPath& path, m_off_t size)
+{
+    client->fsaccess->tmpnamelocal(path);
+
+    auto fa = client->fsaccess->newfileaccess();
+    if (!fa->fopen(path, false, true))
+    {
+        return false;
+    }
+
+    // distinct content every time, or the engine would copy the file uploaded by the previous run
+    string buffer(1 << 20, '\0');
+    for (m_off_t pos = 0; pos < size; pos += m_off_t(buffer.size()))
+    {
+        client->rng.genblock(reinterpret_cast<byte*>(&buffer[0]), buffer.size());
+        unsigned n = unsigned(std::min<m_off_t>(m_off_t(buffer.size()), size - pos));
+        if (!fa->fwrite(reinterpret_cast<const byte*>(buffer.data()), n, pos))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void benchFetchnodesResult(const Error& e)
+{
+    if (gBench && gBench->name == "fetchnodes")
+    {
+        benchItemDone(benchElapsedUs(gBench->start), 0, !e);
+        string stats;
+        client->fnstats.toJsonArray(&stats);
+        cout << "  fetchnodes stats: " << stats << endl;
+    }
+}
+
+void exec_bench(autocomplete::ACState& s)
+{
+    string param;
+    int n = s.extractflagparam("-n", param) ? std::max(1, atoi(param.c_str())) : 1;
+    const string& probe = s.words[1].s;
+
+    if (probe == "download")
+    {
+        Node* node = nodebypath(s.words[2].s.c_str());
+        if (!node || node->type != FILENODE || !node->size)
+        {
+            cout << s.words[2].s << ": not a file" << endl;
+            return;
+        }
+
+        // n reads of consecutive slices of the file at the same time
+        m_off_t slice = (node->size + n - 1) / n;
+        n = int((node->size + slice - 1) / slice);
+        if (benchStart("download", n, -1))
+        {
+            for (m_off_t pos = 0; pos < node->size; pos += slice)
+            {
+                auto read = new BenchRead;
+                read->size = std::min(slice, node->size - pos);
+                gBenchReads.insert(read);
+                client->pread(node, pos, read->size, read);
+            }
+        }
+    }
+    else if (probe == "upload")
+    {
+        m_off_t size = atoll(s.words[2].s.c_str());
+        Node* rubbish = client->nodebyhandle(client->rootnodes[RUBBISHNODE - ROOTNODE]);
+        if (size <= 0 || !rubbish)
+        {
+            cout << "Size must be positive, and an account logged in" << endl;
+            return;
+        }
+
+        // n uploads at the same time
+        if (benchStart("upload", n, MegaClient::LATENCY_PUT))
+        {
+            DBTableTransactionCommitter committer(client->tctable);
+            for (int i = 0; i < n; ++i)
+            {
+                LocalPath path;
+                if (!benchWriteRandomFile(path, size))
+                {
+                    cout << "Unable to write a temporary file" << endl;
+                    client->fsaccess->unlinklocal(path);
+                    benchItemDone(0, 0, false);
+                    continue;
+                }
+
+                auto f = new BenchFilePut(path, rubbish->nodeHandle(), "");
+                auto fa = client->fsaccess->newfileaccess();
+                if (fa->fopen(path, true, false))
+                {
+                    f->genfingerprint(fa.get());
+                }
+                f->appxfer_it = appxferq[PUT].insert(appxferq[PUT].end(), f);
+                client->startxfer(PUT, f, committer);
+            }
+        }
+    }
+    else if (probe == "search")
+    {
+        // n searches of the local node names, one after the other
+        if (benchStart("search", n, -1))
+        {
+            vector<handle> results;
+            for (int i = 0; i < n; ++i)
+            {
+                results.clear();
+                auto start = std::chrono::steady_clock::now();
+                client->nodeNames().find(s.words[2].s.c_str(), results);
+                benchItemDone(benchElapsedUs(start), 0, true);
+            }
+            cout << "  " << results.size() << " matches" << endl;
+        }
+    }
+    else if (probe == "fetchnodes")
+    {
+        // the whole tree from the API, as `reload nocache`
+        if (benchStart("fetchnodes", 1, MegaClient::LATENCY_CS))
+        {
+            cwd = NodeHandle();
+            client->cachedscsn = UNDEF;
+            client->fetchnodes(true);
+        }
+    }
+    else if (probe == "api")
+    {
+        // n commands, one after the other
+        const string command = s.words[2].s;
+        Node* node = s.words.size() > 3 ? nodebypath(s.words[3].s.c_str()) : nullptr;
+        if (command == "g" && (!node || node->type != FILENODE))
+        {
+            cout << "usage: bench api g <remotefile> [-n <count>]" << endl;
+            return;
+        }
+        if (command != "g" && command != "ug")
+        {
+            cout << "Commands available: ug (user data), g <remotefile> (download URL)" << endl;
+            return;
+        }
+
+        if (benchStart("api " + command, n, MegaClient::LATENCY_CS))
+        {
+            handle h = node ? node->nodehandle : UNDEF;
+            gBench->next = [command, h]()
+            {
+                auto start = std::chrono::steady_clock::now();
+                if (command == "ug")
+                {
+                    client->reqs.add(new CommandGetUserData(client, client->reqtag, [start](string*, string*, string*, error e)
+                    {
+                        benchItemDone(benchElapsedUs(start), 0, e == API_OK);
+                    }));
+                }
+                else if (Node* n = client->nodebyhandle(h))
+                {
+                    client->reqs.add(new CommandGetFile(client, reinterpret_cast<const byte*>(n->nodekey().data()), FILENODEKEYLENGTH, h, true,
+                                                        nullptr, nullptr, nullptr, false,
+                        [start](const Error& e, m_off_t, m_time_t, m_time_t, dstime, std::string*, std::string*, std::string*,
+                                const std::vector<std::string>&, const std::vector<std::string>&)
+                        {
+                            benchItemDone(benchElapsedUs(start), 0, e == API_OK);
+                            return true;
+                        }));
+                }
+                else
+                {
+                    benchItemDone(0, 0, false);
+                }
+            };
+            gBench->next();
+        }
+    }
+}
+
 #ifdef USE_FILESYSTEM
 fs::path pathFromLocalPath(const string& s, bool mustexist)
 {
@@ -3118,6 +3492,11 @@ autocomplete::ACN autocompleteSyntax()
                     text("remove"),
                     param("id")));
 
+    p->Add(exec_syncstats,
+           sequence(text("sync"),
+                    text("stats"),
+                    opt(param("id"))));
+
     p->Add(exec_syncxable,
            sequence(text("sync"),
                     either(sequence(either(text("disable"), text("fail")),
@@ -3230,6 +3609,13 @@ autocomplete::ACN autocompleteSyntax()
     p->Add(exec_sendDeferred, sequence(text("senddeferred"), opt(flag("-reset"))));
     p->Add(exec_codeTimings, sequence(text("codetimings"), opt(flag("-reset"))));
 #endif
+    p->Add(exec_screcord, sequence(text("screcord"), either(flag("-stop"), param("file"))));
+    p->Add(exec_bench, sequence(text("bench"), either(sequence(text("download"), remoteFSFile(client, &cwd)),
+                                                     sequence(text("upload"), param("bytes")),
+                                                     sequence(text("search"), param("text")),
+                                                     text("fetchnodes"),
+                                                     sequence(text("api"), either(text("ug"), sequence(text("g"), remoteFSFile(client, &cwd))))),
+                                opt(sequence(flag("-n"), param("count")))));
 
 #ifdef USE_FILESYSTEM
     p->Add(exec_treecompare, sequence(text("treecompare"), localFSPath(), remoteFSPath(client, &cwd)));
@@ -3263,6 +3649,8 @@ autocomplete::ACN autocompleteSyntax()
                     either(sequence(text("get"), localFSFolder()),
                            sequence(text("set"), localFSFolder(), opt(text("force"))))));
 
+    p->Add(exec_memstats, sequence(text("memstats")));
+
     return autocompleteTemplate = std::move(p);
 }
 
@@ -3297,7 +3685,7 @@ bool recursiveget(fs::path&& localpath, Node* n, bool folders, unsigned& queued)
                 return false;
             }
         }
-        for (node_list::iterator it = n->children.begin(); it != n->children.end(); it++)
+        for (NodeChildren::iterator it = n->children.begin(); it != n->children.end(); it++)
         {
             if (!recursiveget(std::move(newpath), *it, folders, queued))
             {
@@ -3318,7 +3706,7 @@ bool regexget(const string& expression, Node* n, unsigned& queued)
         if (n->type == FOLDERNODE || n->type == ROOTNODE)
         {
             DBTableTransactionCommitter committer(client->tctable);
-            for (node_list::iterator it = n->children.begin(); it != n->children.end(); it++)
+            for (NodeChildren::iterator it = n->children.begin(); it != n->children.end(); it++)
             {
                 if ((*it)->type == FILENODE)
                 {
@@ -4164,7 +4552,7 @@ void exec_get(autocomplete::ACState& s)
                 else
                 {
                     // ...or all files in the specified folder (non-recursive)
-                    for (node_list::iterator it = n->children.begin(); it != n->children.end(); it++)
+                    for (NodeChildren::iterator it = n->children.begin(); it != n->children.end(); it++)
                     {
                         if ((*it)->type == FILENODE)
                         {
@@ -4963,7 +5351,7 @@ void exec_getfa(autocomplete::ACState& s)
         }
         else
         {
-            for (node_list::iterator it = n->children.begin(); it != n->children.end(); it++)
+            for (NodeChildren::iterator it = n->children.begin(); it != n->children.end(); it++)
             {
                 if ((*it)->type == FILENODE && (*it)->hasfileattribute(type))
                 {
@@ -6639,7 +7027,7 @@ void exec_mediainfo(autocomplete::ACState& s)
             case ROOTNODE:
             case INCOMINGNODE:
             case RUBBISHNODE:
-                for (node_list::iterator m = n->children.begin(); m != n->children.end(); ++m)
+                for (NodeChildren::iterator m = n->children.begin(); m != n->children.end(); ++m)
                 {
                     if ((*m)->type == FILENODE && (*m)->hasfileattribute(fa_media))
                     {
@@ -7632,8 +8020,13 @@ void DemoApp::folderlinkinfo_result(error e, handle owner, handle /*ph*/, string
     publiclink.clear();
 }
 
-bool DemoApp::pread_data(byte* data, m_off_t len, m_off_t pos, m_off_t, m_off_t, void* /*appdata*/)
+bool DemoApp::pread_data(byte* data, m_off_t len, m_off_t pos, m_off_t, m_off_t, void* appdata)
 {
+    if (benchPreadData(len, appdata))
+    {
+        return true;
+    }
+
     // Improvement: is there a way to have different pread_data receivers for
     // different modes?
     if(more_node)  // are we paginating through a node?
@@ -7673,7 +8066,7 @@ bool DemoApp::pread_data(byte* data, m_off_t len, m_off_t pos, m_off_t, m_off_t,
     return true;
 }
 
-dstime DemoApp::pread_failure(const Error &e, int retry, void* /*appdata*/, dstime)
+dstime DemoApp::pread_failure(const Error &e, int retry, void* appdata, dstime)
 {
     if (retry < 5 && !(e == API_ETOOMANY && e.hasExtraInfo()))
     {
@@ -7683,6 +8076,10 @@ dstime DemoApp::pread_failure(const Error &e, int retry, void* /*appdata*/, dsti
     else
     {
         cout << "Too many failures (" << errorstring(e) << "), giving up" << endl;
+        if (benchPreadFailure(appdata))
+        {
+            return ~(dstime)0;
+        }
         if (pread_file)
         {
             delete pread_file;
@@ -8654,6 +9051,16 @@ void exec_banner(autocomplete::ACState& s)
     }
 }
 
+void exec_memstats(autocomplete::ACState& s)
+{
+    for (int tag = 0; tag < CodeCounter::MEM_NUM_TAGS; tag++)
+    {
+        const CodeCounter::Gauge& g = CodeCounter::memory[tag];
+        cout << std::setw(20) << std::left << CodeCounter::memoryTagName(CodeCounter::MemoryTag(tag))
+             << std::setw(14) << std::right << g.value << " bytes (peak " << g.peak << ")" << endl;
+    }
+}
+
 #ifdef ENABLE_SYNC
 
 void sync_completion(UnifiedSync* us, const SyncError&, error result)
@@ -9001,6 +9408,77 @@ void exec_syncremove(autocomplete::ACState& s)
     }
 }
 
+void exec_syncstats(autocomplete::ACState& s)
+{
+    // sync stats [id]
+    handle backupId = UNDEF;
+    if (s.words.size() > 2)
+    {
+        Base64::atob(s.words[2].s.c_str(), (byte*) &backupId, sizeof(handle));
+    }
+
+    bool found = false;
+
+    client->syncs.forEachUnifiedSync(
+      [&](UnifiedSync& us)
+      {
+          if (!us.mSync || (backupId != UNDEF && us.mConfig.mBackupId != backupId))
+          {
+              return;
+          }
+
+          found = true;
+          auto stats = us.mSync->stats();
+
+          cout << "Sync "
+               << toHandle(us.mConfig.mBackupId)
+               << ": "
+               << us.mConfig.mName
+               << "\n"
+               << "  Queued notifications: "
+               << stats.queued[DirNotify::DIREVENTS]
+               << " (delayed: "
+               << stats.queued[DirNotify::EXTRA]
+               << ", retrying: "
+               << stats.queued[DirNotify::RETRY]
+               << ")\n"
+               << "  Last full reconcile: ";
+
+          if (stats.lastFullReconcile)
+          {
+              cout << m_time() - stats.lastFullReconcile << " second(s) ago\n";
+          }
+          else
+          {
+              cout << "never\n";
+          }
+
+          cout << "  Scanned files: "
+               << stats.scannedFiles
+               << " ("
+               << stats.scannedFilesPerSecond
+               << " per second)\n"
+               << "  Pending: "
+               << stats.pendingUploadBytes
+               << " upload byte(s), "
+               << stats.pendingPutnodes
+               << " node(s) to create\n"
+               << "  Change to cloud latency: p50 "
+               << stats.latencyP50
+               << " ms, p99 "
+               << stats.latencyP99
+               << " ms ("
+               << stats.latencySamples
+               << " change(s))"
+               << endl;
+      });
+
+    if (!found)
+    {
+        cout << "No running syncs" << (backupId != UNDEF ? " with that id" : "") << endl;
+    }
+}
+
 void exec_syncxable(autocomplete::ACState& s)
 {
     // Are we logged in?
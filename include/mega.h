@@ -43,9 +43,12 @@
 #include "mega/console.h"
 #include "mega/fileattributefetch.h"
 #include "mega/filefingerprint.h"
+#include "mega/chunkindex.h"
+#include "mega/fingerprintservice.h"
 #include "mega/file.h"
 #include "mega/filesystem.h"
 #include "mega/db.h"
+#include "mega/asyncdbtable.h"
 #include "mega/json.h"
 #include "mega/pubkeyaction.h"
 #include "mega/request.h"
@@ -60,6 +63,12 @@
 #include "mega/waiter.h"
 
 #include "mega/node.h"
+#include "mega/nodestore.h"
+#include "mega/nodenameindex.h"
+#include "mega/trace.h"
+#include "mega/nodesnapshot.h"
+#include "mega/screcorder.h"
+#include "mega/scanservice.h"
 #include "mega/sync.h"
 #include "mega/transfer.h"
 #include "mega/transferslot.h"
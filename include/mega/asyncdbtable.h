@@ -0,0 +1,122 @@
+/**
+ * @file mega/asyncdbtable.h
+ * @brief Write-behind database table
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#ifndef MEGA_ASYNCDBTABLE_H
+#define MEGA_ASYNCDBTABLE_H 1
+
+#include "db.h"
+
+namespace mega {
+
+// Forwards the writes to another table from a dedicated thread, so the caller never waits for sqlite.
+// Records written but not stored yet are kept in memory and returned by get(), so reads see every write.
+// commit() only queues the commit: the transaction is committed once the writer thread gets to it.
+// rewind() and the node queries wait for the queue to drain first.
+// Write errors are reported by the next put()/del() call.
+class MEGA_API AsyncDbTable : public DbTable
+{
+public:
+    AsyncDbTable(PrnGen& rng, DbTablePtr table);
+    ~AsyncDbTable();
+
+    MEGA_DISABLE_COPY_MOVE(AsyncDbTable)
+
+    void rewind() override;
+    void rewindNonNodes() override;
+    bool next(uint32_t*, string*) override;
+    bool get(uint32_t, string*) override;
+    bool put(uint32_t, char*, unsigned) override;
+    bool putNode(uint32_t, const NodeRecordInfo&, char*, unsigned) override;
+    bool put(const DbRecordBatch&) override;
+    bool putNodes(const DbNodeRecordBatch&) override;
+    bool del(uint32_t) override;
+    void truncate() override;
+    void begin() override;
+    void commit() override;
+    void abort() override;
+    void remove() override;
+    bool inTransaction() const override;
+    size_t releaseMemory() override;
+
+    bool getNodeHandlesByFingerprint(const string&, m_off_t, handle_vector*) override;
+    bool getRecentFileHandles(m_time_t, handle_vector*) override;
+
+    // wait until every queued operation has been applied to the underlying table
+    void flush();
+
+    // number of queued operations not applied yet
+    size_t pending() const;
+
+private:
+    enum OpType { OP_PUT, OP_PUT_NODE, OP_PUT_BATCH, OP_PUT_NODES, OP_DEL, OP_TRUNCATE, OP_BEGIN, OP_COMMIT, OP_ABORT };
+
+    struct Op
+    {
+        OpType type;
+        uint32_t id;
+        uint64_t seq;
+        NodeRecordInfo info;
+        std::shared_ptr<const string> data;
+
+        // the records of OP_PUT_BATCH and OP_PUT_NODES, written with a single call
+        std::shared_ptr<const DbRecordBatch> batch;
+        std::shared_ptr<const DbNodeRecordBatch> nodeBatch;
+    };
+
+    // latest queued state of a record
+    struct OverlayEntry
+    {
+        uint64_t seq;
+        std::shared_ptr<const string> data;  // null if deleted
+    };
+
+    bool write(OpType, uint32_t id, const NodeRecordInfo*, const char* data, unsigned len);
+    void enqueue(Op&&);
+    bool apply(Op&);
+    void loop();
+
+    DbTablePtr mTable;
+
+    // protects everything below except mTable, which is only touched under mDbMutex
+    mutable std::mutex mMutex;
+    std::condition_variable mQueueCV;
+    std::condition_variable mIdleCV;
+    std::deque<Op> mQueue;
+    map<uint32_t, OverlayEntry> mOverlay;
+    uint64_t mSeq = 0;
+
+    // sequence number of a queued truncate(): until then, records absent from the overlay don't exist
+    uint64_t mTruncateSeq = 0;
+
+    // operations taken from the queue and being applied
+    size_t mApplying = 0;
+
+    bool mStop = false;
+    bool mFailed = false;
+    bool mInTransaction = false;
+
+    std::mutex mDbMutex;
+    std::thread mThread;
+};
+
+} // namespace
+
+#endif
@@ -27,19 +27,60 @@
 namespace mega {
 
 // maps attribute names to attribute values
-struct attr_map : map<nameid, string>
+// Kept as a vector sorted by name: nodes have a handful of attributes each, and a std::map
+// would cost a heap block per attribute on millions of nodes.
+// Unlike std::map, insertions and erasures invalidate iterators.
+struct MEGA_API attr_map
 {
+    typedef pair<nameid, string> value_type;
+    typedef vector<value_type>::iterator iterator;
+    typedef vector<value_type>::const_iterator const_iterator;
+    typedef vector<value_type>::size_type size_type;
+
     attr_map() {}
 
     attr_map(nameid key, string value)
     {
-        (*this)[key] = value;
+        (*this)[key] = std::move(value);
     }
 
     attr_map(map<nameid, string>&& m)
     {
-        m.swap(*this);
+        mItems.reserve(m.size());
+        for (auto& it : m)
+        {
+            mItems.emplace_back(it.first, std::move(it.second));
+        }
     }
+
+    iterator begin() { return mItems.begin(); }
+    iterator end() { return mItems.end(); }
+    const_iterator begin() const { return mItems.begin(); }
+    const_iterator end() const { return mItems.end(); }
+
+    iterator find(nameid key);
+    const_iterator find(nameid key) const;
+    size_type count(nameid key) const { return find(key) != end(); }
+
+    string& operator[](nameid key);
+
+    pair<iterator, bool> insert(value_type v);
+
+    size_type erase(nameid key);
+    iterator erase(iterator it) { return mItems.erase(it); }
+
+    size_type size() const { return mItems.size(); }
+    bool empty() const { return mItems.empty(); }
+    void clear() { mItems.clear(); }
+    void swap(attr_map& other) { mItems.swap(other.mItems); }
+
+    bool operator==(const attr_map& other) const { return mItems == other.mItems; }
+    bool operator!=(const attr_map& other) const { return mItems != other.mItems; }
+
+private:
+    iterator lowerBound(nameid key);
+
+    vector<value_type> mItems;
 };
 
 struct MEGA_API AttrMap
@@ -196,6 +196,18 @@ namespace autocomplete {
         bool addCompletions(ACState& s) override;
         std::ostream& describe(std::ostream& s) const override;
         bool match(ACState& s) const override;
+
+    private:
+        // the last folder listed, reused by the next keystrokes while its modification time stays the same
+        struct Entry
+        {
+            std::string path;
+            bool folder;
+            bool file;
+        };
+        std::string listedFolder;
+        long long listedTime = 0;
+        std::vector<Entry> listing;
     };
 
     struct MEGA_API MegaFS : public ACNode
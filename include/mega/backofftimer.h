@@ -22,9 +22,47 @@
 #ifndef MEGA_BACKOFF_TIMER_H
 #define MEGA_BACKOFF_TIMER_H 1
 
+#include <array>
+
 #include "types.h"
 
 namespace mega {
+
+// latencies of the responses from one kind of endpoint (log2 buckets of milliseconds) and how often its requests fail
+class MEGA_API LatencyHistogram
+{
+public:
+    // bucket i counts the responses that took less than 2^i ms, the last one the slower ones
+    static const int BUCKETS = 20;
+
+    void record(std::chrono::milliseconds latency);
+
+    // a request that failed or timed out, or was told to retry (-3)
+    void recordError();
+
+    // latency within which the given fraction of the responses arrived (ms, bucket precision), 0 if there are none yet
+    unsigned percentile(double fraction) const;
+
+    uint64_t responses() const { return mResponses; }
+    uint64_t errors() const { return mErrors; }
+
+    // fraction of the recent requests that failed, the latest weighing the most
+    double recentErrorRate() const { return mRecentErrorRate; }
+
+    const std::array<uint64_t, BUCKETS>& buckets() const { return mBuckets; }
+
+    // as JSON, for apps and logs
+    string toJson() const;
+
+    void reset();
+
+private:
+    std::array<uint64_t, BUCKETS> mBuckets = {};
+    uint64_t mResponses = 0;
+    uint64_t mErrors = 0;
+    double mRecentErrorRate = 0;
+};
+
 // generic timer facility with exponential backoff
 class MEGA_API BackoffTimer
 {
@@ -40,9 +78,16 @@ public:
     // trigger exponential backoff
     void backoff();
 
+    // exponential backoff adapted to the endpoint: never sooner than most of its responses take to arrive,
+    // and capped lower while most of its requests succeed (the failure is likely transient)
+    void backoff(const LatencyHistogram&);
+
     // set absolute backoff
     void backoff(dstime);
 
+    // backoff of at least the given delta or the usual latency of the endpoint, jittered so retries spread out
+    void backoff(dstime, const LatencyHistogram&);
+
     // set absolute trigger time
     void set(dstime);
 
@@ -67,19 +112,73 @@ public:
     BackoffTimer(PrnGen &rng);
 };
 
+// Hierarchical timer wheel: entries are kept in the level of the highest 6-bit digit where their time differs from
+// the wheel's current time, in the slot of that digit.  Inserting and removing are O(1), as is finding the next time
+// to wake up; advance() moves each entry down at most once per level, until it expires.
+class MEGA_API TimerWheel
+{
+public:
+    static const unsigned SLOTBITS = 6;
+    static const unsigned SLOTS = 1 << SLOTBITS;
+    static const unsigned LEVELS = (sizeof(dstime) * 8 + SLOTBITS - 1) / SLOTBITS;
+
+    // embedded in what is scheduled, see BackoffTimerTracked
+    class Entry
+    {
+        friend class TimerWheel;
+
+        static const unsigned char UNSCHEDULED = 0xFF;
+        static const unsigned char EXPIRED = LEVELS;
+
+        dstime mWhen = 0;
+        Entry* mPrev = nullptr;
+        Entry* mNext = nullptr;
+        unsigned char mLevel = UNSCHEDULED;
+        unsigned char mSlot = 0;
+
+    public:
+        dstime when() const { return mWhen; }
+        bool scheduled() const { return mLevel != UNSCHEDULED; }
+    };
+
+    void insert(Entry&, dstime when);
+    void remove(Entry&);
+
+    // expires the entries due at or before now (time does not go back)
+    void advance(dstime now);
+
+    // the entries expired by advance() and not removed since
+    void expired(vector<Entry*>&) const;
+
+    // soonest time of the entries not expired yet, NEVER if there are none.  Exact for those due within
+    // SLOTS ds, otherwise the start of their slot: waking up then lets advance() bring them closer.
+    dstime next() const;
+
+    size_t size() const { return mSize; }
+
+private:
+    Entry* mSlots[LEVELS][SLOTS] = {};
+    uint64_t mOccupied[LEVELS] = {};
+    Entry* mExpired = nullptr;
+    dstime mNow = 0;
+    size_t mSize = 0;
+
+    void link(Entry&, unsigned char level, unsigned char slot);
+    Entry* takeSlot(unsigned level, unsigned slot);
+};
+
 class MEGA_API BackoffTimerTracked;
 
 // This class keeps track of a group of BackoffTimerTracked, which register and deregister themselves.
-// Timers are in the multimap when they have non-0 non-NEVER timeouts set, giving us a much smaller group should we need to iterate it.
+// Timers are in the wheel when they have non-0 non-NEVER timeouts set, so the soonest one is found without
+// going through the group.
 class MEGA_API BackoffTimerGroupTracker
 {
-    std::multimap<dstime, BackoffTimerTracked*> timeouts;
+    TimerWheel timeouts;
 
 public:
-    typedef std::multimap<dstime, BackoffTimerTracked*>::iterator Iter;
-
-    inline Iter add(BackoffTimerTracked* bt);
-    inline void remove(Iter i) { timeouts.erase(i); }
+    inline void add(BackoffTimerTracked* bt);
+    inline void remove(BackoffTimerTracked* bt);
 
     // Find out the soonest (non-0 and non-NEVER) timeout in the group.
     // For transfers, it calls set(0) on any timed out timers, as the old code did.
@@ -89,12 +188,13 @@ public:
 
 // Just like a backoff timer, but is part of a group where we want to know the soonest (non-0) timeout in the group immediately
 // Also, the enable() function can be used to exclude timers when they are not relevant, while keeping the timer settings.
-class MEGA_API BackoffTimerTracked
+class MEGA_API BackoffTimerTracked : private TimerWheel::Entry
 {
+    friend class BackoffTimerGroupTracker;
+
     bool mIsEnabled;
     BackoffTimer bt;
     BackoffTimerGroupTracker& mTracker;
-    BackoffTimerGroupTracker::Iter mTrackerPos;
 
     void untrack();
     void track();
@@ -106,6 +206,7 @@ public:
     inline bool arm()               { untrack(); bool result = bt.arm();   track(); return result; }
     inline void backoff()           { untrack(); bt.backoff();             track(); }
     inline void backoff(dstime t)   { untrack(); bt.backoff(t);            track(); }
+    inline void backoff(dstime t, const LatencyHistogram& h) { untrack(); bt.backoff(t, h); track(); }
     inline void set(dstime t)       { untrack(); bt.set(t);                track(); }
     inline void update(dstime* t)   { untrack(); bt.update(t);             track(); }
     inline void reset()             { untrack(); bt.reset();               track(); }
@@ -118,17 +219,21 @@ public:
     inline bool enabled()           { return mIsEnabled; }
 };
 
-inline auto BackoffTimerGroupTracker::add(BackoffTimerTracked* bt) -> Iter
+inline void BackoffTimerGroupTracker::add(BackoffTimerTracked* bt)
 {
-    return timeouts.emplace(bt->nextset() ? bt->nextset() : NEVER, bt);
+    timeouts.insert(*bt, bt->nextset());
+}
+
+inline void BackoffTimerGroupTracker::remove(BackoffTimerTracked* bt)
+{
+    timeouts.remove(*bt);
 }
 
 inline void BackoffTimerTracked::untrack()
 {
-    if (mIsEnabled && bt.nextset() != 0 && bt.nextset() != NEVER)
+    if (scheduled())
     {
-        mTracker.remove(mTrackerPos);
-        mTrackerPos = BackoffTimerGroupTracker::Iter();
+        mTracker.remove(this);
     }
 }
 
@@ -136,7 +241,7 @@ inline void BackoffTimerTracked::track()
 {
     if (mIsEnabled && bt.nextset() != 0 && bt.nextset() != NEVER)
     {
-        mTrackerPos = mTracker.add(this);
+        mTracker.add(this);
     }
 }
 
@@ -38,11 +38,42 @@ public:
     static int atob(const string&, string&);
     static string atob(const string&);
     static int atob(const char*, byte*, int);   // deprecated
+    static int atob(const char*, size_t, byte*, int);   // the characters don't have to be NUL-terminated
+
+    // handles of 6 or 8 bytes, to and from their 8 or 11 characters without looping (a needs room for the NUL too).
+    // atohandle() fails if any of the characters isn't base64, the ones after them aren't looked at
+    static void handletoa(const byte* b, unsigned size, char* a);
+    static bool atohandle(const char* a, unsigned size, byte* b);
 
     static void itoa(int64_t, string *);
     static int64_t atoi(string *);
 };
 
+// Encodes and decodes the bulk of the data for Base64::btoa() and atob(), the ends being left to them.
+// An AVX2 version is used if the CPU supports it, and a NEON one where the build targets it (aarch64).
+struct MEGA_API Base64Kernels
+{
+    // encodes whole groups of 3 bytes of b[0, blen) to a: returns the bytes consumed
+    typedef size_t (*Encoder)(const byte* b, size_t blen, char* a);
+
+    // decodes whole groups of 4 characters of a[0, alen) to b[0, blen), stopping before the first group that has a
+    // character that isn't base64: returns the characters consumed
+    typedef size_t (*Decoder)(const char* a, size_t alen, byte* b, size_t blen);
+
+    struct Implementation
+    {
+        const char* name;
+        Encoder encode;
+        Decoder decode;
+    };
+
+    // the fastest implementation this CPU can run
+    static const Implementation& best();
+
+    // all implementations this CPU can run, the scalar one first (for tests and benchmarks)
+    static std::vector<Implementation> implementations();
+};
+
 template <unsigned BINARYSIZE>
 struct Base64Str
 {
@@ -51,11 +82,7 @@ struct Base64Str
     char chars[STRLEN + 1]; // sizeof(chars) can be larger due to alignment etc
     Base64Str(const byte* b)
     {
-        #ifndef NDEBUG
-        int n =
-        #endif
-        Base64::btoa(b, BINARYSIZE, chars);
-        assert(static_cast<size_t>(n + 1) == sizeof(chars));
+        encode(b);
     }
     Base64Str(const byte* b, int size)
     {
@@ -67,11 +94,7 @@ struct Base64Str
     }
     Base64Str(const handle& h)
     {
-        #ifndef NDEBUG
-        int n =
-        #endif
-        Base64::btoa((const byte*)&h, BINARYSIZE, chars);
-        assert(static_cast<size_t>(n + 1) == sizeof(chars));
+        encode((const byte*)&h);
     }
     operator const char* () const
     {
@@ -85,6 +108,22 @@ struct Base64Str
     {
         return STRLEN;
     }
+
+private:
+    void encode(const byte* b)
+    {
+        if (BINARYSIZE == 6 || BINARYSIZE == 8)
+        {
+            Base64::handletoa(b, BINARYSIZE, chars);
+            return;
+        }
+
+        #ifndef NDEBUG
+        int n =
+        #endif
+        Base64::btoa(b, BINARYSIZE, chars);
+        assert(static_cast<size_t>(n + 1) == sizeof(chars));
+    }
 };
 
 // lowercase base32 encoding
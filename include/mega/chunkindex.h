@@ -0,0 +1,67 @@
+/**
+ * @file mega/chunkindex.h
+ * @brief Content-defined chunks of a local file, to find what two versions have in common
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#ifndef MEGA_CHUNKINDEX_H
+#define MEGA_CHUNKINDEX_H 1
+
+#include "filefingerprint.h"
+#include "filesystem.h"
+
+namespace mega {
+
+// The chunks of a file, cut where a rolling hash of the last bytes read has a given pattern: a boundary depends only on
+// the bytes before it, so an insertion or a deletion changes the chunk it falls in, and the others just move.  The
+// chunks of two versions of a file are matched by the hash of their content to find the ranges they share.
+// Stored in the transfer cache for the content of an upload, keyed by its fingerprint.
+struct MEGA_API ChunkIndex : public Cacheable
+{
+    struct Chunk
+    {
+        m_off_t offset;
+        uint32_t size;
+        uint64_t hash;
+    };
+
+    // 1 MiB chunks on average, so a 20 GiB file has some 20000 of them
+    static const uint32_t MIN_CHUNK = 1 << 18;
+    static const uint32_t MAX_CHUNK = 1 << 22;
+
+    // the content described
+    FileFingerprint fingerprint;
+
+    vector<Chunk> chunks;
+
+    // reads the whole file, opened by the caller, unless cancelled() says otherwise on the way
+    bool compute(FileAccess&, const std::function<bool()>& cancelled);
+
+    // the ranges [first, second) of this content whose chunks are also somewhere in the other, merged when contiguous
+    vector<std::pair<m_off_t, m_off_t>> commonRanges(const ChunkIndex& other) const;
+
+    // key of the record of a content
+    static string key(const FileFingerprint&);
+
+    bool serialize(string*) override;
+    static unique_ptr<ChunkIndex> unserialize(const string&);
+};
+
+} // namespace
+
+#endif
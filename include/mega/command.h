@@ -57,6 +57,17 @@ public:
     // some commands are guaranteed to work if we query without specifying a SID (eg. gmf)
     bool suppressSID;
 
+    // read-only commands that no other command depends on (eg. g) can be sent in a parallel batch
+    bool orderIndependent = false;
+
+    // background commands the user isn't waiting for, and that no later command depends on (eg. pfa, sphb).  They
+    // go in batches of their own, sent when no other command is waiting, so interactive ones don't queue behind them
+    bool background = false;
+
+    // of the transfer or request this one is sent for, from the TraceScope when created.
+    // It is in scope again while the response is processed
+    TraceId traceId;
+
     void cmd(const char*);
     void notself(MegaClient*);
     virtual void cancel(void);
@@ -82,6 +93,10 @@ public:
     void openobject();
     void closeobject();
 
+    // size of the JSON so far, and room for what is still to come when that is known to be large
+    size_t size() const;
+    void reserve(size_t);
+
     enum Outcome {  CmdError,            // The reply was an error, already extracted from the JSON.  The error code may have been 0 (API_OK)
                     //CmdActionpacket,     // The reply was a cmdseq string, and we have processed the corresponding actionpackets
                     CmdArray,            // The reply was an array, and we have already entered it
@@ -142,6 +157,15 @@ public:
 
     virtual bool procresult(Result) = 0;
 
+    // how this command relates to an earlier one that is still waiting to be sent
+    enum Coalescing { COALESCE_NONE,      // unknown, the earlier one must stay as it is
+                      COALESCE_PASS,      // independent of it, earlier ones may still be replaced
+                      COALESCE_REPLACE }; // makes it redundant, it's dropped and gets this command's result
+    virtual Coalescing coalescing(const Command&) const { return COALESCE_NONE; }
+
+    // commands replaced by this one before being sent, owned
+    vector<Command*> coalesced;
+
     const char* getstring();
 
     Command();
@@ -383,6 +407,15 @@ private:
     CompletionErr mCompletionErr;
     CompletionBytes mCompletionBytes;
     CompletionTLV mCompletionTLV;
+
+    // sent by MegaClient::getua(), which joins the same retrievals to it (see MegaClient::mGetUAWaiters)
+    bool mJoinable;
+
+    // tags of the retrievals joined, reported the same result
+    vector<int> mWaiters;
+
+    // report a result to the app for this command and for each retrieval joined
+    void report(const std::function<void()>& f);
 };
 
 #ifdef DEBUG
@@ -447,6 +480,14 @@ public:
     CommandKeyCR(MegaClient*, node_vector*, node_vector*, const char*);
 };
 
+// a batch of the node keys of a new outgoing share, see MegaClient::sendsharekeys()
+class MEGA_API CommandPutShareKeys : public Command
+{
+    bool procresult(Result) override;
+public:
+    CommandPutShareKeys(MegaClient*, ShareNodeKeys&);
+};
+
 class MEGA_API CommandMoveNode : public Command
 {
 public:
@@ -462,6 +503,7 @@ private:
 
 public:
     bool procresult(Result) override;
+    Coalescing coalescing(const Command&) const override;
 
     CommandMoveNode(MegaClient*, Node*, Node*, syncdel_t, NodeHandle prevParent, Completion&& c);
 };
@@ -637,6 +679,7 @@ private:
     Completion completion;
 public:
     bool procresult(Result) override;
+    Coalescing coalescing(const Command&) const override;
 
     CommandSetAttr(MegaClient*, Node*, SymmCipher*, const char*, Completion&& c);
 };
@@ -650,6 +693,8 @@ class MEGA_API CommandSetShare : public Command
     string personal_representation;
     bool mWritable = false;
 
+    // node keys that didn't fit in the command, sent by the client once the share exists
+    handle_vector mRemainingKeys;
 
     std::function<void(Error, bool writable)> completion;
 
@@ -38,6 +38,9 @@
 #include <cryptopp/hmac.h>
 #include <cryptopp/pwdbased.h>
 
+#include <memory>
+#include <vector>
+
 namespace mega {
 
 /**
@@ -94,6 +97,31 @@ private:
     CryptoPP::GCM<CryptoPP::AES>::Encryption aesgcm_e;
     CryptoPP::GCM<CryptoPP::AES>::Decryption aesgcm_d;
 
+    // setkey() only keys the ECB modes: the others are keyed when first used, most keys never need them
+    enum
+    {
+        KEYED_CBC_E = 1 << 0,
+        KEYED_CBC_D = 1 << 1,
+        KEYED_CCM16_E = 1 << 2,
+        KEYED_CCM16_D = 1 << 3,
+        KEYED_CCM8_E = 1 << 4,
+        KEYED_CCM8_D = 1 << 5,
+        KEYED_GCM_E = 1 << 6,
+        KEYED_GCM_D = 1 << 7,
+    };
+    unsigned keyedmodes = 0;
+
+    template <typename Mode>
+    Mode& keyed(Mode& mode, unsigned flag)
+    {
+        if (!(keyedmodes & flag))
+        {
+            mode.SetKeyWithIV(key, KEYLENGTH, zeroiv);
+            keyedmodes |= flag;
+        }
+        return mode;
+    }
+
 public:
     static byte zeroiv[CryptoPP::AES::BLOCKSIZE];
 
@@ -320,6 +348,25 @@ public:
 
     void ctr_crypt(byte *, unsigned, m_off_t, ctr_iv, byte *, bool, bool initmac = true);
 
+    // a piece of a file for the batch ctr_crypt(), with the same meaning as the parameters above
+    struct CtrChunk
+    {
+        byte* data;
+        unsigned len;
+        m_off_t pos;
+        byte* mac;
+        bool initmac;
+    };
+
+    /**
+     * @brief ctr_crypt() several independent pieces of the same file at once.
+     *
+     * CBC-MAC is serial within a piece, but not across pieces: the next MAC block of every
+     * piece is encrypted in the same AES call, so that AES-NI / ARMv8 pipelines have several
+     * independent blocks to work on.  The CTR keystream is generated many blocks at a time.
+     */
+    void ctr_crypt(CtrChunk* chunks, size_t count, ctr_iv, bool encrypt);
+
     static void setint64(int64_t, byte*);
 
     static void xorblock(const byte*, byte*);
@@ -333,6 +380,36 @@ public:
     SymmCipher(const byte*);
 };
 
+/**
+ * @brief Ready SymmCiphers for the last few keys set.
+ *
+ * Setting a key computes the schedules of every mode, which costs far more than
+ * the few blocks usually processed with it, so a key that comes back soon (the
+ * same node, the chunks of the active transfers) finds its cipher ready.
+ */
+class MEGA_API SymmCipherCache
+{
+public:
+    static const size_t CAPACITY = 8;
+
+    /**
+     * @brief The cipher with the key, as SymmCipher::setkey() sets it.
+     *
+     * It stays valid until CAPACITY other keys have been requested.
+     */
+    SymmCipher* get(const byte* key, int type = 1);
+
+    // nullptr if the string is not a file or folder node key
+    SymmCipher* get(const std::string* key);
+
+    size_t hits = 0;
+    size_t misses = 0;
+
+private:
+    // most recently used first
+    std::vector<std::unique_ptr<SymmCipher>> mCiphers;
+};
+
 /**
  * @brief Asymmetric cryptography using RSA.
  */
@@ -28,6 +28,33 @@ namespace mega {
 // generic host transactional database access interface
 class DBTableTransactionCommitter;
 
+// fields of a node record that a database may keep in plain columns, for indexed lookups
+struct MEGA_API NodeRecordInfo
+{
+    handle h = UNDEF;
+    handle parent = UNDEF;
+    nodetype_t type = TYPE_UNKNOWN;
+    m_off_t size = 0;
+
+    // serialized crc and mtime (see FileFingerprint::serializefingerprint), files with a valid fingerprint only
+    string fingerprint;
+
+    m_time_t ctime = 0;
+    m_time_t mtime = 0;
+};
+
+// encrypted records buffered for a multi-row write
+typedef vector<pair<uint32_t, string>> DbRecordBatch;
+
+struct MEGA_API DbNodeRecord
+{
+    uint32_t id;
+    NodeRecordInfo info;
+    string data;
+};
+
+typedef vector<DbNodeRecord> DbNodeRecordBatch;
+
 class MEGA_API DbTable
 {
     static const int IDSPACING = 16;
@@ -45,18 +72,48 @@ public:
     // for a full sequential get: rewind to first record
     virtual void rewind() = 0;
 
+    // rewind for a sequential get of the records other than nodes
+    // (tables keeping node records along with the rest return those too)
+    virtual void rewindNonNodes() { rewind(); }
+
     // get next record in sequence
     virtual bool next(uint32_t*, string*) = 0;
     bool next(uint32_t*, string*, SymmCipher*);
 
     // get specific record by key
     virtual bool get(uint32_t, string*) = 0;
+    bool get(uint32_t, string*, SymmCipher*);
 
     // update or add specific record
     virtual bool put(uint32_t, char*, unsigned) = 0;
     bool put(uint32_t, string*);
     bool put(uint32_t, Cacheable *, SymmCipher*);
 
+    // update or add a node record, along with its indexable fields
+    // (tables without node columns just store the content)
+    virtual bool putNode(uint32_t index, const NodeRecordInfo&, char* data, unsigned len);
+    bool putNode(uint32_t, Node*, SymmCipher*);
+
+    // update or add many records at once (eg. when saving a whole account after fetchnodes)
+    virtual bool put(const DbRecordBatch&);
+    virtual bool putNodes(const DbNodeRecordBatch&);
+
+    // pad, encrypt and append a record to a batch.  Records failing to serialize are skipped
+    void serialize(uint32_t type, Cacheable*, SymmCipher*, DbRecordBatch&);
+    void serializeNode(uint32_t type, Node*, SymmCipher*, DbNodeRecordBatch&);
+
+    // the same for many records with their dbid assigned already, serialized and encrypted on the worker
+    // threads of the queue (the records must not change until it returns)
+    void serialize(const vector<Cacheable*>&, SymmCipher*, MegaClientAsyncQueue&, DbRecordBatch&);
+
+    // give a new record its dbid
+    void assignid(uint32_t type, Cacheable*);
+
+    // indexed lookups of node records, returning the node handles found
+    // false if the table can't answer them, and the caller has to look at every node instead
+    virtual bool getNodeHandlesByFingerprint(const string& fingerprint, m_off_t size, handle_vector*);
+    virtual bool getRecentFileHandles(m_time_t since, handle_vector*);
+
     // delete specific record
     virtual bool del(uint32_t) = 0;
 
@@ -78,11 +135,17 @@ public:
     // whether an unmatched begin() has been issued
     virtual bool inTransaction() const = 0;
 
+    // give back the memory of the page cache that can be read again from the file, returns the bytes released
+    virtual size_t releaseMemory() { return 0; }
+
     void checkCommitter(DBTableTransactionCommitter*);
 
     // autoincrement
     uint32_t nextid;
 
+    // where the time of the commits is counted, if anywhere
+    CodeCounter::ScopeStats* commitStats = nullptr;
+
     DbTable(PrnGen &rng, bool alwaysTransacted);
     virtual ~DbTable() { }
     DBTableTransactionCommitter *getTransactionCommitter() const;
@@ -156,12 +219,15 @@ enum DbOpenFlag
     // Recycle legacy database, if present.
     DB_OPEN_FLAG_RECYCLE = 0x1,
     // Operations should always be transacted.
-    DB_OPEN_FLAG_TRANSACTED = 0x2
+    DB_OPEN_FLAG_TRANSACTED = 0x2,
+    // A large store, read a lot (the state caches): memory mapped, with a larger page cache.
+    DB_OPEN_FLAG_LARGE = 0x4
 }; // DbOpenFlag
 
 struct MEGA_API DbAccess
 {
     static const int LEGACY_DB_VERSION;
+    static const int LAST_DB_VERSION_WITHOUT_NODES;
     static const int DB_VERSION;
 
     DbAccess();
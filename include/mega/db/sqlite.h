@@ -34,11 +34,46 @@ class MEGA_API SqliteDbTable : public DbTable
     string dbfile;
     FileSystemAccess *fsaccess;
 
+    // statements compiled once and reused for the lifetime of the table
+    enum Statement
+    {
+        STMT_GET,
+        STMT_PUT,
+        STMT_PUT_BATCH,
+        STMT_PUT_NODE,
+        STMT_PUT_NODE_BATCH,
+        STMT_DEL,
+        STMT_DEL_BATCH,
+        STMT_DEL_NODE,
+        STMT_NODES_BY_FINGERPRINT,
+        STMT_RECENT_FILES,
+        STMT_COUNT
+    };
+
+    sqlite3_stmt* mStatements[STMT_COUNT] = {};
+
+    sqlite3_stmt* statement(Statement, const char* sql);
+    void release(sqlite3_stmt*);
+    int step(sqlite3_stmt*, int bindResult);
+    void finalizeStatements();
+
+    bool getNodeHandles(sqlite3_stmt*, int, handle_vector*);
+
+    // whether pStmt also goes through the nodes table
+    bool mCursorNodes = true;
+    void rewind(bool nodes);
+
 public:
     void rewind();
+    void rewindNonNodes() override;
     bool next(uint32_t*, string*);
     bool get(uint32_t, string*);
     bool put(uint32_t, char*, unsigned);
+    bool put(const DbRecordBatch&) override;
+    bool putNode(uint32_t, const NodeRecordInfo&, char*, unsigned) override;
+    bool putNodes(const DbNodeRecordBatch&) override;
+    bool getNodeHandlesByFingerprint(const string&, m_off_t, handle_vector*) override;
+    bool getRecentFileHandles(m_time_t, handle_vector*) override;
     bool del(uint32_t);
     void truncate();
     void begin();
@@ -50,6 +85,7 @@ public:
     ~SqliteDbTable();
 
     bool inTransaction() const override;
+    size_t releaseMemory() override;
 
     LocalPath dbFile() const;
 };
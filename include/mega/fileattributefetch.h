@@ -36,26 +36,67 @@ struct MEGA_API FileAttributeFetchChannel
     handle fahref;
 
     BackoffTimer bt;
-    BackoffTimer timeout;
 
-    HttpReq req;
+    // POSTs in flight at once, each one with its own batch of attributes
+    static const int MAXREQS = 3;
+
+    // while another POST is in flight, fresh attributes wait until there are this many
+    static const size_t MINBATCH = 16;
+
+    struct Request
+    {
+        HttpReq req;
+        BackoffTimer timeout;
+        size_t inbytes = 0;
+
+        // attributes requested by this POST
+        vector<handle> fahs;
+
+        Request(PrnGen&);
+    };
+    vector<std::unique_ptr<Request>> requests;
+
+    // received attributes being decrypted by the worker threads, delivered in order
+    struct Decryption
+    {
+        handle nodehandle;
+        fatype type;
+        int tag;
+        string data;
+        bool decrypted = false;
+        std::atomic<bool> done{false};
+    };
+    std::deque<std::shared_ptr<Decryption>> decryptions;
+
+    bool gettingurl;
     dstime urltime;
     string posturl;
-    size_t inbytes;
 
     faf_map fafs[2];
     error e;
 
-    // dispatch new and retrying attributes by POSTing to existing URL
+    // dispatch fresh attributes by POSTing them to the existing URL on the idle requests
     void dispatch();
 
-    // parse fetch result and remove completed attributes from pending
+    // true if no more POSTs can be sent now
+    bool busy() const;
+
+    // parse the result of a request and remove completed attributes from pending
     void parse(int, bool);
 
-    // notify app of nodes that failed to receive their requested attribute
-    void failed();
+    // notify app of the attributes of a request that failed to be received
+    void failed(int);
+
+    // the download URL couldn't be obtained: fail the fresh attributes
+    void urlfailed(error);
+
+    // pass the decrypted attributes to the app
+    void deliver();
 
     FileAttributeFetchChannel(MegaClient*);
+
+private:
+    void failed(const vector<handle>&);
 };
 
 // pending individual attribute fetch
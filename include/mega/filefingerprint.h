@@ -63,6 +63,9 @@ struct MEGA_API FileFingerprint : public Cacheable
     bool serialize(string* d) override;
     static FileFingerprint* unserialize(string* d);
 
+    // reads a serialized fingerprint at ptr, and moves ptr past it
+    bool unserialize(const char*& ptr, const char* end);
+
     // convenience function for clear comparisons etc, referring to (this) base class
     const FileFingerprint& fingerprint() const { return *this; }
 };
@@ -137,6 +137,10 @@ public:
     void append(const LocalPath& additionalPath);
     void appendWithSeparator(const LocalPath& additionalPath, bool separatorAlways);
     void prependWithSeparator(const LocalPath& additionalPath);
+
+    // the same as clear() and then prependWithSeparator() of each name in turn, but sized once and
+    // written in place: the buffer is reused by callers that build many paths in the same LocalPath
+    void assignFromLeaf(const LocalPath* const* names, size_t count);
     LocalPath prependNewWithSeparator(const LocalPath& additionalPath) const;
     void trimNonDriveTrailingSeparator();
     bool findNextSeparator(size_t& separatorBytePos) const;
@@ -187,6 +191,77 @@ public:
     bool operator==(const LocalPath& p) const { return localpath == p.localpath; }
     bool operator!=(const LocalPath& p) const { return localpath != p.localpath; }
     bool operator<(const LocalPath& p) const { return localpath < p.localpath; }
+
+    size_t hash() const { return std::hash<decltype(localpath)>()(localpath); }
+};
+
+class PathComponentTable;
+
+struct MEGA_API PathComponent
+{
+    LocalPath name;
+    size_t hash = 0;
+    uint32_t refs = 0;
+    uint32_t index = 0;
+    PathComponentTable* table = nullptr;
+};
+
+// A reference to an interned path component, null by default.  It has the size of a pointer, and the
+// interface of a unique_ptr<const LocalPath> plus the hash of the component
+class MEGA_API InternedPath
+{
+public:
+    InternedPath() = default;
+    InternedPath(const InternedPath&);
+    InternedPath(InternedPath&& other) noexcept : mEntry(other.mEntry) { other.mEntry = nullptr; }
+    InternedPath& operator=(InternedPath other) { std::swap(mEntry, other.mEntry); return *this; }
+    ~InternedPath() { reset(); }
+
+    void reset();
+
+    explicit operator bool() const { return mEntry != nullptr; }
+    const LocalPath* get() const { return mEntry ? &mEntry->name : nullptr; }
+    const LocalPath& operator*() const { return mEntry->name; }
+    const LocalPath* operator->() const { return &mEntry->name; }
+
+    size_t hash() const { return mEntry->hash; }
+
+private:
+    friend class PathComponentTable;
+    explicit InternedPath(PathComponent* entry) : mEntry(entry) {}
+
+    PathComponent* mEntry = nullptr;
+};
+
+// Path components (names) kept once however many hold them, with their hash computed when they are added.
+// An entry goes once the last InternedPath to it does, and its slot is reused.  Used from the client's thread only.
+class MEGA_API PathComponentTable
+{
+public:
+    InternedPath intern(const LocalPath& name);
+
+    // distinct components held
+    size_t size() const { return mEntries.size() - mFree.size(); }
+
+    PathComponentTable() = default;
+    MEGA_DISABLE_COPY_MOVE(PathComponentTable)
+
+private:
+    friend class InternedPath;
+    void release(PathComponent& entry);
+
+    // slot of the index that refers to the entry, or the first free one
+    size_t findslot(size_t hash, const LocalPath* name, uint32_t index) const;
+    void rehash(size_t slots);
+
+    // entries don't move, InternedPaths point to them
+    std::deque<PathComponent> mEntries;
+    vector<uint32_t> mFree;
+
+    // open addressing by hash: entry index + 1, 0 for empty slots, TOMBSTONE for removed ones
+    static const uint32_t TOMBSTONE = ~uint32_t(0);
+    vector<uint32_t> mIndex;
+    size_t mTombstones = 0;
 };
 
 struct NameConflict {
@@ -324,6 +399,11 @@ struct MEGA_API FileAccess
     // absolute position read to byte buffer
     bool frawread(byte *, unsigned, m_off_t, bool caller_opened = false);
 
+    // reads of len bytes at each of the ascending positions, to consecutive len-byte slots of dst, from a file opened
+    // by the caller.  Those within SPARSE_READ_SPAN of the first of a run are made as a single read
+    static const unsigned SPARSE_READ_SPAN = 65536;
+    bool frawreadsparse(byte* dst, unsigned len, const m_off_t* positions, size_t count);
+
     // After a successful nonblocking fopen(), call openf() to really open the file (by localname)
     // (this is a lazy-type approach in case we don't actually need to open the file after finding out type/size/mtime).
     // If the size or mtime changed, it will fail.
@@ -338,6 +418,10 @@ struct MEGA_API FileAccess
     // Truncate a file.
     virtual bool ftruncate() = 0;
 
+    // Reserve the space of a file about to be written up to `size`, in as few extents as the filesystem can, without
+    // changing its size.  False where it isn't supported, for the file to grow with the writes instead.
+    virtual bool fpreallocate(m_off_t) { return false; }
+
     FileAccess(Waiter *waiter);
     virtual ~FileAccess();
 
@@ -400,25 +484,50 @@ struct Notification
     LocalPath path;
     LocalNode* localnode = nullptr;
 
+    // position in its NotificationDeque
+    uint64_t seq = 0;
+
     Notification() {}
     Notification(dstime ts, const LocalPath& p, LocalNode* ln)
         : timestamp(ts), path(p), localnode(ln)
         {}
 };
 
+// Repeated notifications of a path still queued are folded into the queued one (which keeps its place and takes the
+// newest timestamp) while it was first queued less than COALESCE_DS ago, so a burst of writes to the same files is checked
+// once. The window keeps a file that is written all the time from holding up the notifications queued after it.
+// Notifications below another one aren't dropped: the notification of a folder only checks that folder.
 struct NotificationDeque : ThreadSafeDeque<Notification>
 {
-    void replaceLocalNodePointers(LocalNode* check, LocalNode* newvalue)
+    static const dstime COALESCE_DS = 20;
+
+    bool popFront(Notification&);
+    void unpopFront(const Notification&);
+
+    // notifications received, and those folded into a queued one
+    void counts(uint64_t& raw, uint64_t& coalesced);
+
+    void replaceLocalNodePointers(LocalNode* check, LocalNode* newvalue);
+
+private:
+    void received(Notification&&) override;
+
+    typedef std::pair<LocalNode*, LocalPath> Key;
+
+    struct Queued
     {
-        std::lock_guard<std::mutex> g(m);
-        for (auto& n : mNotifications)
-        {
-            if (n.localnode == check)
-            {
-                n.localnode = newvalue;
-            }
-        }
-    }
+        uint64_t seq;
+        dstime queued;
+    };
+
+    // the newest queued notification of each path
+    std::map<Key, Queued> mIndex;
+
+    // seq of the front notification, the others follow in order
+    uint64_t mFrontSeq = 0;
+
+    uint64_t mRaw = 0;
+    uint64_t mCoalesced = 0;
 };
 
 #ifdef ENABLE_SYNC
@@ -467,6 +576,9 @@ public:
     // This should return false for any FAT filesystem.
     virtual bool fsstableids() const;
 
+    // kernel watches held for this sync (a recursive or filesystem-wide one counts once)
+    virtual size_t watchCount() const { return 0; }
+
     // ignore this (debris folder)
     LocalPath ignore;
 
@@ -512,6 +624,9 @@ struct MEGA_API FileSystemAccess : public EventTrigger
     const char *fstypetostring(FileSystemType type) const;
     virtual bool getlocalfstype(const LocalPath& path, FileSystemType& type) const = 0;
     FileSystemType getlocalfstype(const LocalPath& path) const;
+
+    // identifies the device (volume) holding the path, to limit the concurrent reads of each one
+    virtual bool getdeviceid(const LocalPath&, uint64_t&) const { return false; }
     void unescapefsincompatible(string*,FileSystemType) const;
 
     // convert MEGA path (UTF-8) to local format
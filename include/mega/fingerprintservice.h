@@ -0,0 +1,117 @@
+/**
+ * @file mega/fingerprintservice.h
+ * @brief Fingerprints local files on a pool of threads
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#ifndef MEGA_FINGERPRINTSERVICE_H
+#define MEGA_FINGERPRINTSERVICE_H 1
+
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+#include "chunkindex.h"
+#include "filefingerprint.h"
+#include "filesystem.h"
+#include "waiter.h"
+
+namespace mega {
+
+// Fingerprints local files on a pool of threads, each with a FileSystemAccess of its own, so the SDK
+// thread doesn't wait for the disk. Every device (volume) is read by a few threads at most, so a slow
+// disk doesn't take the whole pool and a spinning one isn't made to seek between many files.
+// Jobs are started in the order they were queued, the SDK thread is woken up as each one finishes.
+class MEGA_API FingerprintService
+{
+public:
+    class MEGA_API Job
+    {
+    public:
+        const LocalPath path;
+
+        // the whole file is read to index its chunks as well
+        const bool withChunks;
+
+        // the fields below are set once this is true
+        bool done() const { return mDone; }
+
+        // it couldn't be opened, or it's a file that couldn't be fingerprinted
+        bool failed = false;
+
+        nodetype_t type = TYPE_UNKNOWN;
+        handle fsid = UNDEF;
+        bool fsidvalid = false;
+        bool isSymlink = false;
+
+        // files only
+        FileFingerprint fingerprint;
+
+        // if withChunks, unless the file couldn't be read whole or it changed meanwhile
+        unique_ptr<ChunkIndex> chunks;
+
+        Job(const LocalPath& p, bool c) : path(p), withChunks(c) {}
+
+    private:
+        friend class FingerprintService;
+        std::atomic<bool> mDone{false};
+    };
+
+    // the job is dropped if nobody holds it any longer when its turn comes
+    // (if the service goes away first, the jobs not started are done and failed, and the ones indexing chunks stop)
+    std::shared_ptr<Job> queue(const LocalPath& path, bool withChunks = false);
+
+    size_t threads() const { return mThreads.size(); }
+
+    FingerprintService(Waiter&, unsigned threadCount, unsigned readsPerDevice);
+    ~FingerprintService();
+
+private:
+    struct Device
+    {
+        unsigned reading = 0;
+
+        // jobs waiting for one of the reads of this device to finish
+        std::deque<std::shared_ptr<Job>> waiting;
+    };
+
+    void loop();
+
+    // a job waiting for a device that can take another read (with the lock held)
+    bool takeWaiting(std::shared_ptr<Job>&, uint64_t& device);
+
+    // the job is shared with whoever holds it
+    void fingerprint(FileSystemAccess&, const std::shared_ptr<Job>&);
+
+    Waiter& mWaiter;
+    const unsigned mReadsPerDevice;
+    vector<std::thread> mThreads;
+
+    std::mutex mMutex;
+    std::condition_variable mWakeup;
+
+    // jobs whose device isn't known yet
+    std::deque<std::shared_ptr<Job>> mQueued;
+
+    std::map<uint64_t, Device> mDevices;
+    std::atomic<bool> mExit{false};
+};
+
+} // namespace
+
+#endif
@@ -22,7 +22,9 @@
 #ifndef GFX_H
 #define GFX_H 1
 
+#include <condition_variable>
 #include <mutex>
+#include <thread>
 
 #include "megawaiter.h"
 #include "mega/thread/posixthread.h"
@@ -35,6 +37,10 @@ class MEGA_API GfxJob
 public:
     GfxJob();
 
+    // uploads wait for their imagery before putnodes, restoring attributes of existing nodes does not
+    typedef enum { PRIORITY_HIGH, PRIORITY_LOW, NUM_PRIORITIES } priority_t;
+    priority_t priority = PRIORITY_HIGH;
+
     // locally encoded path of the image
     LocalPath localfilename;
 
@@ -54,28 +60,49 @@ public:
 class MEGA_API GfxJobQueue
 {
     protected:
-        std::deque<GfxJob *> jobs;
+        // one FIFO per priority, drained highest priority first
+        std::deque<GfxJob *> jobs[GfxJob::NUM_PRIORITIES];
         std::mutex mutex;
+        std::condition_variable cv;
+        bool closed = false;
 
     public:
+        // jobs waiting, of all priorities
+        CodeCounter::Gauge depth;
+
         GfxJobQueue();
         void push(GfxJob *job);
         GfxJob *pop();
+
+        // block until a job is available, NULL once the queue has been closed
+        GfxJob *waitpop();
+
+        // wake up all waiting threads and stop handing out jobs
+        void close();
 };
 
 // bitmap graphics processor
 class MEGA_API GfxProc
 {
-    bool finished;
-    WAIT_CLASS waiter;
+    // processing thread, with its own bitmap state unless it shares the one of its owner
+    struct Worker
+    {
+        GfxProc* owner;
+        std::unique_ptr<GfxProc> processor;
+        THREAD_CLASS thread;
+    };
+
     std::mutex mutex;
-    THREAD_CLASS thread;
+    std::vector<std::unique_ptr<Worker>> workers;
+    unsigned workercount;
+    bool isworker = false;
     bool threadstarted = false;
     SymmCipher mCheckEventsKey;
     GfxJobQueue requests;
     GfxJobQueue responses;
     static void *threadEntryPoint(void *param);
-    void loop();
+    void loop(GfxProc& processor);
+    void process(GfxJob* job);
 
     // read and store bitmap
     virtual bool readbitmap(FileAccess*, const LocalPath&, int) = 0;
@@ -93,9 +120,18 @@ protected:
     // list of supported extensions (NULL if no pre-filtering is needed)
     virtual const char* supportedformats();
 
+    // read and store bitmap, decoding at reduced resolution where the format allows it, as long as
+    // the longer side stays at least `longest` and the shorter side at least `shortest` pixels
+    // (the default decodes for the largest dimension, regardless of which ones are requested)
+    virtual bool readbitmapscaled(FileAccess*, const LocalPath&, int longest, int shortest);
+
     // list of supported video extensions (NULL if no pre-filtering is needed)
     virtual const char* supportedvideoformats();
 
+    // new processor with independent bitmap state for an additional worker thread
+    // (NULL if the implementation can't process several images at once)
+    virtual GfxProc* newworker();
+
 public:
     virtual int checkevents(Waiter*);
 
@@ -126,7 +162,15 @@ public:
     MegaClient* client;
     int w, h;
 
-    // start a thread that will do the processing
+    // jobs waiting for a worker
+    const CodeCounter::Gauge& queueDepth() const { return requests.depth; }
+
+    // number of threads processing queued jobs (set before starting them)
+    // savefa() keeps its own bitmap state, so it doesn't wait behind queued jobs
+    // unless the implementation can't provide workers
+    void setWorkerCount(unsigned count);
+
+    // start the threads that will do the processing
     void startProcessingThread();
 
     GfxProc();
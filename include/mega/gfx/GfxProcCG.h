@@ -39,6 +39,7 @@ private: // mega::GfxProc implementations
     bool readbitmap(mega::FileAccess*, const mega::LocalPath&, int);
     bool resizebitmap(int, int, mega::string*);
     void freebitmap();
+    mega::GfxProc* newworker();
 public:
     GfxProcCG();
     ~GfxProcCG();
@@ -28,6 +28,11 @@
 #include <mega/gfx.h>
 #include "mega/gfx/gfx_pdfium.h"
 
+#if defined(HAVE_FFMPEG) && !defined(_WIN32) && !defined(USE_IOS)
+// videos are decoded in a short-lived child process
+#define FFMPEG_OUT_OF_PROCESS 1
+#endif
+
 namespace mega {
 // bitmap graphics processor
 class MEGA_API GfxProcFreeImage : public GfxProc
@@ -47,6 +52,10 @@ protected:
     string sformats;
     const char* supportedformats();
 
+    GfxProc* newworker();
+
+    bool readbitmapscaled(FileAccess*, const LocalPath&, int longest, int shortest);
+
     bool readbitmapFreeimage(FileAccess*, const LocalPath&, int);
 
 #if defined(HAVE_FFMPEG)  || defined(HAVE_PDFIUM)
@@ -59,6 +68,15 @@ protected:
     bool readbitmapFfmpeg(FileAccess*, const LocalPath&, int);
 #endif
 
+#ifdef FFMPEG_OUT_OF_PROCESS
+    // a slow or corrupt video can't stall the worker thread nor grow the SDK process:
+    // the child is killed past these budgets and the frame comes back through shared memory
+    static const int VIDEO_TIME_BUDGET_MS = 30000;
+    static const size_t VIDEO_MEMORY_BUDGET = 512 * 1024 * 1024;
+
+    bool readbitmapFfmpegOutOfProcess(FileAccess*, const LocalPath&, int);
+#endif
+
 #ifdef HAVE_PDFIUM
     const char* supportedformatsPDF();
     bool isPdfFile(const string &ext);
@@ -81,6 +81,10 @@ protected:
     m_time_t mLastAction = -1;   //timestamps of the last action
     m_time_t mLastBeat = -1;     //timestamps of the last beat
 
+    // as sent in the last beat
+    int mLastBeatStatus = -1;
+    int8_t mLastBeatProgress = -1;
+
     void updateLastActionTime();
 };
 
@@ -168,6 +172,10 @@ public:
 private:
     static constexpr int MAX_HEARBEAT_SECS_DELAY = 60*30; // max time to wait before a heartbeat for unchanged backup
 
+    // while only the progress (or the queues) move, a heartbeat waits for this many points of progress, or this long
+    static constexpr int MIN_PROGRESS_HEARTBEAT_DELTA = 5;
+    static constexpr int MAX_PROGRESS_HEARTBEAT_SECS_DELAY = 60*5;
+
     mega::MegaClient *mClient = nullptr;
 
 #ifdef ENABLE_SYNC
@@ -27,6 +27,9 @@
 #include "waiter.h"
 #include "backofftimer.h"
 #include "utils.h"
+#include "trace.h"
+#include "proxy.h"
+#include "nodestore.h"
 
 #ifndef _WIN32
 #include <sys/types.h>
@@ -216,6 +219,86 @@ extern string g_APIURL_default;
 extern bool g_disablepkp_default;
 
 // generic host HTTP I/O interface
+// classes of transfer data, which share the bandwidth by their weights
+enum bwclass_t
+{
+    BWCLASS_STREAMING,      // direct reads (streaming playback)
+    BWCLASS_FOREGROUND,     // transfers of the app
+    BWCLASS_SYNC,           // of two-way and up/down syncs
+    BWCLASS_BACKUP,         // of backup syncs
+    BWCLASS_COUNT
+};
+
+// Hierarchical token buckets for the transfer data of one direction: a bucket for the limit of all the classes, filled
+// at that rate, and one for each class, filled at its share of the limit among the classes that want data.  A class
+// takes its own tokens first, and those the others don't hold in theirs after that, so it gets at least its share and
+// whatever is left over.  A class can also have a limit of its own.  The weight and limit of a class can depend on the
+// time of day.
+class MEGA_API BandwidthScheduler
+{
+public:
+    struct Policy
+    {
+        unsigned weight = 1;
+
+        // limit of the class, 0 for none
+        m_off_t maxbps = 0;
+
+        // minutes of the (local) day it applies from and until, wrapping around midnight if to < from
+        int fromMinute = 0;
+        int toMinute = 24 * 60;
+    };
+
+    // streaming 8, foreground 4, sync 2, backup 1, without limits of their own
+    BandwidthScheduler();
+
+    // bytes per second for all the classes together, 0 for no limit
+    void setlimit(m_off_t bps);
+    m_off_t limit() const { return mLimit; }
+
+    // the first added that applies at the time is used, the default policy of the class if none
+    void addpolicy(bwclass_t, const Policy&);
+    void clearpolicies();
+
+    // whether there is any limit at all
+    bool active() const;
+
+    // refills the buckets for the time elapsed (called from the network loop)
+    void tick(dstime now, int minuteOfDay);
+
+    // how many of the bytes wanted by a request of the class can go now (0: it has to wait)
+    m_off_t grant(bwclass_t, m_off_t wanted);
+
+    // for data that can't be split: whether it can go now, possibly overdrawing the buckets
+    bool admit(bwclass_t, m_off_t size);
+
+    // the class wanted data in this many ds, so its share is kept for it
+    static const dstime ACTIVE_DS = 10;
+
+private:
+    struct Class
+    {
+        Policy policy;
+        vector<Policy> policies;
+        m_off_t tokens = 0;
+        m_off_t capTokens = 0;
+        dstime lastWanted = 0;
+        bool wanted = false;
+    };
+
+    const Policy& policy(const Class&) const;
+    bool isactive(const Class&) const;
+    m_off_t available(bwclass_t) const;
+    void take(bwclass_t, m_off_t);
+
+    Class mClasses[BWCLASS_COUNT];
+    m_off_t mLimit = 0;
+    m_off_t mTokens = 0;
+    dstime mNow = 0;
+    dstime mLastTick = 0;
+    int mMinuteOfDay = 0;
+};
+
 struct MEGA_API HttpIO : public EventTrigger
 {
     // set whenever a network request completes successfully
@@ -279,9 +362,12 @@ struct MEGA_API HttpIO : public EventTrigger
     // set useragent (must be called exactly once)
     virtual void setuseragent(string*) = 0;
 
-    // get proxy settings from the system
+    // get proxy settings from the system, detected again once they are AUTOPROXY_TTL old
     virtual Proxy *getautoproxy();
 
+    // reuse of the detected proxy settings, as a PAC script or a WPAD lookup can take seconds (ds)
+    static const dstime AUTOPROXY_TTL = 3000;
+
     // get alternative DNS servers
     void getMEGADNSservers(string* dnsservers, bool getfromnetwork);
 
@@ -300,10 +386,37 @@ struct MEGA_API HttpIO : public EventTrigger
     // get max upload speed
     virtual m_off_t getmaxuploadspeed();
 
+    // sharing of the bandwidth by the transfer requests of each class, per direction (GET, PUT).  Their limits are the
+    // maximum speeds set above.  Enforced by the HttpIO implementations that can pause a request
+    BandwidthScheduler bandwidth[2];
+
     virtual bool cacheresolvedurls(const std::vector<string>&, std::vector<string>&&) { return false; }
 
+    // use HTTP/2 for HTTPS requests, multiplexed over one connection per server. False if not supported
+    virtual bool sethttp2(bool) { return false; }
+
+    // the resolved server addresses, to keep across restarts.  False if unchanged since the last export
+    virtual bool exportdnscache(string*) { return false; }
+
+    // addresses exported by a previous run, for the servers not resolved yet
+    virtual void importdnscache(const string&) { }
+
+    // the TLS sessions of the servers, to resume them after a restart.  False if there are none or it isn't supported
+    virtual bool exporttlssessions(string*) { return false; }
+
+    // sessions exported by a previous run, still valid ones only
+    virtual void importtlssessions(const string&) { }
+
     HttpIO();
     virtual ~HttpIO() { }
+
+protected:
+    // proxy settings of the system, as they are now
+    virtual Proxy *detectautoproxy();
+
+private:
+    Proxy mAutoProxy;
+    dstime mAutoProxyTime = NEVER;
 };
 
 // outgoing HTTP request
@@ -312,6 +425,9 @@ struct MEGA_API HttpReq
     std::atomic<reqstatus_t> status;
     m_off_t pos;
 
+    // of the transfer or request this one is made for, from the TraceScope when created
+    TraceId traceId;
+
     int httpstatus;
 
     httpmethod_t method;
@@ -336,12 +452,18 @@ struct MEGA_API HttpReq
     // if the out payload includes a fetch nodes command
     bool includesFetchingNodes = false;
 
+    // the response is consumed (and purged) while it is received, so don't reserve room for all of it
+    bool incremental = false;
+
     byte* buf;
     m_off_t buflen, bufpos, notifiedbufpos;
 
     // we assume that API responses are smaller than 4 GB
     m_off_t contentlength;
 
+    // bytes of the response body as received, before a Content-Encoding is undone (-1 if the HttpIO doesn't tell)
+    m_off_t wirebytes = -1;
+
     // time left related to a bandwidth overquota
     m_time_t timeleft;
 
@@ -358,6 +480,9 @@ struct MEGA_API HttpReq
     // identify different channels from different MegaClients etc in the log
     string logname;
 
+    // for the data of transfers, its share of the bandwidth
+    bwclass_t bwclass = BWCLASS_FOREGROUND;
+
     // set url and content type for subsequent requests
     void setreq(const char*, contenttype_t);
 
@@ -381,18 +506,20 @@ struct MEGA_API HttpReq
     struct http_buf_t
     {
         byte* datastart();
-        size_t datalen();
+        size_t datalen() const;
 
         size_t start;
         size_t end;
 
-        http_buf_t(byte* b, size_t s, size_t e);  // takes ownership of the byte*, which must have been allocated with new[]
+        // takes ownership of the byte*, which must have been allocated with new[] (`allocated` bytes, if not just `e`)
+        http_buf_t(byte* b, size_t s, size_t e, size_t allocated = 0);
         ~http_buf_t();
         void swap(http_buf_t& other);
-        bool isNull();
+        bool isNull() const;
 
     private:
         byte* buf;
+        size_t accounted;   // in CodeCounter::MEM_RAID_BUFFERS
     };
 
     // give up ownership of the buffer for client to use.  The caller is the new owner of the http_buf_t, and the HttpReq no longer has the buffer or any info about it.
@@ -416,12 +543,26 @@ struct MEGA_API HttpReq
     // timestamp of last data sent or received
     dstime lastdata;
 
+    // when the request was sent, for the latency histograms
+    std::chrono::steady_clock::time_point started;
+
+    // count the response (or the failure) in the histogram, once per request sent
+    void recordlatency(LatencyHistogram&, bool failed);
+
     // prevent raw data from being dumped in debug mode
     bool binary;
 
     HttpReq(bool = false);
     virtual ~HttpReq();
     void init();
+
+protected:
+    // update what is accounted in CodeCounter::MEM_HTTP_BUFFERS: the receive buffer, and the capacity of `in`
+    // as of the last time the request itself changed it
+    void accountmemory();
+
+private:
+    int64_t accountedmemory = 0;
 };
 
 struct MEGA_API GenericHttpReq : public HttpReq
@@ -465,8 +606,15 @@ public:
     // len must be < 2^31
     virtual byte* nextbuffer(unsigned datasize) = 0;
 
+    // whether the buffers handed out by nextbuffer() remain valid until encrypt() returns,
+    // so all chunks can be encrypted at once
+    virtual bool buffersPersist() const { return false; }
+
     bool encrypt(m_off_t pos, m_off_t npos, string& urlSuffix);
 
+    // the CRC of the data encrypted, from the pos given to encrypt(), for pieces encrypted apart to be combined
+    const byte* getcrc() const { return crc; }
+
 private:
     SymmCipher* key;
     chunkmac_map* macs;
@@ -481,6 +629,7 @@ class MEGA_API EncryptBufferByChunks : public EncryptByChunks
     byte *chunkstart;
 
     byte* nextbuffer(unsigned bufsize) override;
+    bool buffersPersist() const override;
 
 public:
     EncryptBufferByChunks(byte* b, SymmCipher* k, chunkmac_map* m, uint64_t iv);
@@ -506,6 +655,10 @@ struct MEGA_API HttpReqUL : public HttpReqXfer
     m_off_t transferred(MegaClient*);
 
     ~HttpReqUL() { }
+
+    // one per connection of each transfer: pooled
+    static void* operator new(size_t size) { return PooledAllocation<HttpReqUL>::allocate(size); }
+    static void operator delete(void* p, size_t size) { PooledAllocation<HttpReqUL>::deallocate(p, size); }
 };
 
 // file chunk download
@@ -518,6 +671,9 @@ struct MEGA_API HttpReqDL : public HttpReqXfer
 
     HttpReqDL();
     ~HttpReqDL() { }
+
+    static void* operator new(size_t size) { return PooledAllocation<HttpReqDL>::allocate(size); }
+    static void operator delete(void* p, size_t size) { PooledAllocation<HttpReqDL>::deallocate(p, size); }
 };
 
 // file attribute get
@@ -26,6 +26,22 @@
 
 namespace mega {
 
+// Finds where a JSON string ends. SSE2/NEON versions are used where the build targets them.
+// (AVX2 was slower than SSE2 on the mostly short strings of the API responses)
+struct MEGA_API JSONStringScanner
+{
+    // ptr is just after the opening quote, the data is NUL-terminated.
+    // Returns the closing quote (skipping escaped ones), or the terminating NUL if there is none.
+    typedef const char* (*Function)(const char* ptr);
+
+    // the fastest implementation this CPU can run
+    static const char* end(const char* ptr);
+    static const char* name();
+
+    // all implementations this CPU can run, the scalar one first (for tests and benchmarks)
+    static std::vector<std::pair<const char*, Function>> implementations();
+};
+
 // linear non-strict JSON scanner
 struct MEGA_API JSON
 {
@@ -79,6 +95,9 @@ struct MEGA_API JSON
     bool leaveobject();
 
     bool storeobject(string* = NULL);
+
+    // end of the object or array starting at begin, or NULL if it doesn't end before end (eg. not fully received yet)
+    static const char* objectend(const char* begin, const char* end);
     bool skipnullvalue();
 
     static void unescape(string*);
@@ -155,6 +174,9 @@ public:
     size_t size() const;
     void clear() { mJson.clear(); }
 
+    // for commands that know they are going to be large
+    void reserve(size_t n) { mJson.reserve(n); }
+
 protected:
     string escape(const char* data, size_t length) const;
 
@@ -163,6 +185,9 @@ private:
 
     int elements();
 
+    // base64 of the data, written straight into mJson
+    void appendB64(const byte*, int);
+
     string mJson;
     std::array<signed char, MAXDEPTH> mLevels;
     signed char mLevel;
@@ -92,11 +92,14 @@
 #include <array>
 #include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 // define MEGA_QT_LOGGING to support QString
@@ -136,6 +139,62 @@ public:
                      ) = 0;
 };
 
+/**
+ * @brief Logger that passes messages to another one from a background thread
+ *
+ * Each logging thread copies its messages into a ring buffer of its own, without taking any lock,
+ * and the background thread formats them into calls to the target logger.
+ * Messages that don't fit in the ring of their thread are dropped and counted, and the next
+ * message delivered for that thread is preceded by a warning with the number of messages lost.
+ * Messages larger than a whole ring are passed to the target synchronously.
+ *
+ * Messages are delivered in order for each thread, but not across threads.
+ */
+class AsyncLogger : public Logger
+{
+public:
+    static const size_t DEFAULT_RING_SIZE = 256 * 1024;
+
+    // ringSize is rounded up to a power of two
+    explicit AsyncLogger(Logger& target, size_t ringSize = DEFAULT_RING_SIZE);
+
+    // delivers the pending messages; no thread may be logging through this object anymore
+    ~AsyncLogger();
+
+    void log(const char *time, int loglevel, const char *source, const char *message
+#ifdef ENABLE_LOG_PERFORMANCE
+          , const char **directMessages = nullptr, size_t *directMessagesSizes = nullptr, unsigned numberMessages = 0
+#endif
+             ) override;
+
+    // wait until the messages logged before the call have been passed to the target
+    void flush();
+
+    // number of messages dropped so far because the ring of their thread was full
+    uint64_t droppedMessages() const;
+
+private:
+    struct Ring;
+
+    Logger& mTarget;
+    size_t mRingSize;
+    const unsigned mId;
+
+    std::mutex mMutex;
+    std::condition_variable mWakeup;
+    std::condition_variable mFlushed;
+    std::vector<std::shared_ptr<Ring>> mRings;
+    uint64_t mFlushRequests = 0;
+    uint64_t mFlushesDone = 0;
+    bool mStop = false;
+    std::atomic<uint64_t> mDropped{0};
+    std::thread mThread;
+
+    Ring& ring();
+    void drain(Ring& ring);
+    void loop();
+};
+
 typedef std::vector<std::ostream *> OutputStreams;
 
 const static size_t LOGGER_CHUNKS_SIZE = 1024;
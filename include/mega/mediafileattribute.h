@@ -25,6 +25,7 @@
 #include "types.h"
 #include "json.h"
 #include "filesystem.h"
+#include <atomic>
 #include <string>
 
 namespace mega {
@@ -116,6 +117,14 @@ struct MEGA_API MediaFileInfo
     unsigned Lookup(const std::string& name, std::map<std::string, unsigned>& data, unsigned notfoundvalue);
     byte LookupShortFormat(unsigned containerid, unsigned videocodecid, unsigned audiocodecid);
 
+    // Media properties of a file being uploaded, extracted on the worker threads while its data is sent
+    struct Extraction
+    {
+        MediaProperties vp;
+        std::atomic<bool> done{false};
+    };
+    std::map<UploadHandle, std::shared_ptr<Extraction>> uploadExtractions;
+
     // In case we don't have the MediaCodecs yet, remember the media attributes until we can add them to the file.
     struct queuedvp;
     std::vector< queuedvp > queuedForDownloadTranslation;
@@ -127,11 +136,21 @@ struct MEGA_API MediaFileInfo
     void onCodecMappingsReceipt(MegaClient* client, int codecListVersion);
     void ReadIdRecords(std::map<std::string, unsigned>&  data, JSON& json);
 
+    // start extracting the properties of a file to be uploaded (once its upload handle is assigned)
+    void startUploadExtraction(MegaClient* client, UploadHandle uploadHandle, const LocalPath& localpath, m_off_t size);
+
+    // take the properties extracted ahead of the upload's completion. Returns NULL if there is no extraction for it
+    std::shared_ptr<Extraction> takeUploadExtraction(UploadHandle uploadHandle);
+
+    // release completed uploads whose properties were still being extracted
+    void checkUploadExtractions(MegaClient* client);
+
     // get the cached media attributes for a file just before sending CommandPutNodes (for a newly uploaded file)
     void addUploadMediaFileAttributes(UploadHandle fh, std::string* s);
 
     // we figured out the properties, now attach them to a file.  Queues the action if we don't have the MediaCodecs yet.  Works for uploaded or downloaded files.
-    unsigned queueMediaPropertiesFileAttributesForUpload(MediaProperties& vp, uint32_t fakey[4], MegaClient* client, UploadHandle uploadHandle);
+    // If the properties are still being extracted, the attribute only becomes ready once the extraction finishes.
+    unsigned queueMediaPropertiesFileAttributesForUpload(MediaProperties& vp, uint32_t fakey[4], MegaClient* client, UploadHandle uploadHandle, std::shared_ptr<Extraction> extraction = nullptr);
     void sendOrQueueMediaPropertiesFileAttributesForExistingFile(MediaProperties& vp, uint32_t fakey[4], MegaClient* client, NodeHandle fileHandle);
 
     // Check if we should retry video property extraction, due to previous failure with older library
@@ -150,6 +169,9 @@ struct MediaFileInfo::queuedvp
 
     // the key to use for XXTEA encryption (which is not the same as the file data key)
     uint32_t fakey[4];
+
+    // set while vp is still being extracted on a worker thread
+    std::shared_ptr<Extraction> extraction;
 };
 #endif
 
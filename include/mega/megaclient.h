@@ -24,8 +24,14 @@
 
 #include "json.h"
 #include "db.h"
+#include "asyncdbtable.h"
+#include "nodestore.h"
+#include "nodenameindex.h"
+#include "nodesnapshot.h"
+#include "screcorder.h"
 #include "gfx.h"
 #include "filefingerprint.h"
+#include "fingerprintservice.h"
 #include "request.h"
 #include "transfer.h"
 #include "treeproc.h"
@@ -121,6 +127,25 @@ public:
      */
     int eOthersCount;
 
+    ///////////////
+    // Transport //
+    ///////////////
+
+    /**
+     * @brief Bytes of the response to the fetchnodes command
+     *
+     * From DB: 0
+     * From API: size of the JSON response
+     */
+    long long responseBytes;
+
+    /**
+     * @brief Bytes received for the response to the fetchnodes command
+     *
+     * Fewer than responseBytes when the response came compressed, -1 if the HttpIO doesn't tell
+     */
+    long long responseWireBytes;
+
     ////////////////////////////////////////////////////////////////////
     // Time elapsed until different steps since the startup time (ds) //
     ////////////////////////////////////////////////////////////////////
@@ -197,6 +222,10 @@ class SCSN
     // sc inconsistency: stop querying for action packets
     bool stopsc = false;
 
+    // action packets already applied on top of this scsn, by a response that didn't get to its own
+    // (eg. it was interrupted while being streamed) - a response for the same scsn starts with them
+    size_t packetsapplied = 0;
+
 public:
 
     bool setScsn(JSON*);
@@ -209,6 +238,9 @@ public:
     const char* text() const;
     handle getHandle() const;
 
+    void packetApplied() { ++packetsapplied; }
+    size_t packetsApplied() const { return packetsapplied; }
+
     friend std::ostream& operator<<(std::ostream& os, const SCSN& scsn);
 
     SCSN();
@@ -226,6 +258,9 @@ public:
     }
 
     bool mActionsPerformed;
+
+    // only visit the folders marked by LocalNode::setsyncdowndirty()
+    bool mDirtyOnly = false;
 }; // SyncdownContext
 
 class MEGA_API MegaClient
@@ -407,6 +442,9 @@ public:
     // open the SC database and get the SCSN from it
     void checkForResumeableSCDatabase();
 
+    // fetch state serialize from local cache
+    bool fetchsc(DbTable*);
+
     // set folder link: node, key. authKey is the authentication key to be able to write into the folder
     error folderaccess(const char*folderlink, const char* authKey);
 
@@ -451,6 +489,9 @@ public:
     // track the signature of a public key in the authring for a given user
     error trackSignature(attr_t signatureType, handle uh, const std::string &signature);
 
+    // EdDSA::verifyKey(), unless that signature of that key by that signing key verified before
+    bool verifykeysignature(const string& pubKey, const string& signature, const string& signingPubKey);
+
     // set the Ed25519 public key as verified for a given user in the authring (done by user manually by comparing hash of keys)
     error verifyCredentials(handle uh);
 
@@ -475,6 +516,12 @@ public:
     // convenience version of the above (frequently we are passing a NodeBase's attrstring)
     void makeattr(SymmCipher*, const std::unique_ptr<string>&, const char*, int = -1) const;
 
+    // encrypt the attribute json of each new node with its key (none if it has no key), on the worker threads
+    // from MAKEATTRS_PARALLEL_MIN nodes
+    void makeattrs(vector<NewNode>&, const vector<string>& attrjson);
+    static const size_t MAKEATTRS_PARALLEL_MIN = 2048;
+    static const size_t MAKEATTRS_BATCH = 512;
+
     // check node access level
     int checkaccess(Node*, accesslevel_t);
 
@@ -536,6 +583,35 @@ public:
     // number of parallel connections per transfer (PUT/GET)
     unsigned char connections[2];
 
+    // let non-raid transfers adapt their number of connections (up to MAX_NUM_CONNECTIONS) and request size to their throughput
+    bool mAdaptiveConnections = false;
+
+    // limit for the combined size of the requests in flight of a non-raid transfer, 0 for none
+    m_off_t mMaxTransferMemory = 0;
+
+    // transfer data held in memory by all the transfer slots
+    TransferBufferPool mTransferBufferPool;
+
+    // threads fingerprinting the files of uploads and new syncs (none: they are read on the SDK thread)
+    // changing them fails the jobs not started, their files are fingerprinted on the SDK thread instead
+    void setfingerprintthreads(unsigned threads, unsigned readsPerDevice);
+    FingerprintService* fingerprintService();
+    unsigned mFingerprintThreads = 4;
+    unsigned mFingerprintReadsPerDevice = 2;
+    unique_ptr<FingerprintService> mFingerprintService;
+
+    // uploads of files from this size (0: none) have the chunks of their content indexed by the fingerprint threads,
+    // and stored in the transfer cache once done.  The upload of the next version of the file logs the ranges it shares
+    // with the previous one: every version is encrypted with a key of its own, so they are uploaded whole anyway
+    void setchunkindexminsize(m_off_t);
+    m_off_t mChunkIndexMinSize = 0;
+
+    // ids of the chunk index records of tctable, by ChunkIndex::key() of their content
+    std::map<string, uint32_t> mChunkIndexDbids;
+
+    // stores the chunk index of a finished upload, in place of that of the version of the file it replaces
+    void chunkindexadd(Transfer*, DBTableTransactionCommitter&);
+
     // helpfer function for preparing a putnodes call for new node
     error putnodes_prepareOneFile(NewNode* newnode, Node* parentNode, const char *utf8Name, const std::string &binaryUploadToken,
                                   byte *theFileKey, char *megafingerprint, const char *fingerprintOriginal,
@@ -552,6 +628,22 @@ public:
     // send files/folders to user
     void putnodes(const char*, vector<NewNode>&&, int tag);
 
+    // add the node of a completed upload to the folder, along with others queued while the previous API request is in flight
+    void queueUploadPutnodes(NodeHandle, NewNode&&, int tag);
+
+#ifdef ENABLE_SYNC
+    // add the node of a completed sync upload to the folder, along with the others completing into any synced folder
+    // within SYNC_PUTNODES_WINDOW_DS (or while the previous API request is in flight)
+    void queueSyncUploadPutnodes(NodeHandle, NewNode&&, int tag);
+    static const dstime SYNC_PUTNODES_WINDOW_DS = 5;
+#endif
+
+    // send the queued upload nodes, a command per target folder
+    void sendUploadPutnodes();
+
+    // post the queued commands as the next cs request (no other may be in flight): false if there are none
+    bool postcs();
+
     // attach file attribute to upload or node handle
     void putfa(NodeOrUploadHandle, fatype, SymmCipher*, int tag, std::unique_ptr<string>);
 
@@ -574,6 +666,13 @@ public:
     // queue a user attribute retrieval (for non-contacts)
     void getua(const char* email_handle, const attr_t at = ATTR_UNKNOWN, const char *ph = NULL, int ctag = -1);
 
+    // retrievals of the same attribute of the same user (by the uid or email given) while one is in flight wait for
+    // its result instead of sending another: the tags of those waiting, reported the same result after the first
+    map<pair<string, attr_t>, vector<int>> mGetUAWaiters;
+
+    // whether a retrieval was joined to one in flight
+    bool coalescegetua(const string& uid, attr_t at, int tag);
+
     // retrieve the email address of a user
     void getUserEmail(const char *uid);
 
@@ -705,6 +804,18 @@ public:
     // close all open HTTP connections
     void disconnect();
 
+    // keep the addresses resolved for the servers in a file next to the databases,
+    // so a restart doesn't have to resolve them again before the first requests
+    void loaddnscache();
+    void savednscache();
+    dstime mNextDnsCacheSave = 0;
+    static const dstime DNS_CACHE_SAVE_INTERVAL_DS = 6000;
+
+    // the same for the TLS sessions of the servers, encrypted with the master key, so the first connections
+    // after a restart resume them instead of making full handshakes.  Saved along with the DNS cache
+    void loadtlssessions();
+    void savetlssessions();
+
     // close server-client HTTP connection
     void catchup();
     // abort lock request
@@ -956,6 +1067,22 @@ public:
     // minimum bytes per second for streaming (0 == no limit, -1 == use default)
     int minstreamingrate;
 
+    // cache of each file being streamed (0 == no cache), how much of it can be spilled to a file in
+    // streamingcachefolder (if any), and how much to read ahead of the app when it reads sequentially
+    size_t streamingcachesize = 16 * 1024 * 1024;
+    LocalPath streamingcachefolder;
+    m_off_t streamingcachespillsize = 0;
+    m_off_t streamingreadahead = 4 * 1024 * 1024;
+
+    // give memory back under pressure: TRIM_MODERATE halves the streaming caches and the user alerts,
+    // TRIM_CRITICAL empties the memory of the streaming caches and keeps the latest alerts only.  Both free the
+    // spare response buffers and the page cache of the local databases.  Returns the bytes released
+    enum { TRIM_MODERATE = 1, TRIM_CRITICAL = 2 };
+    size_t trimmemory(int level);
+
+    // user alerts kept by TRIM_CRITICAL, as many as a new session fetches
+    static const size_t TRIM_ALERTS_KEPT = 50;
+
     // root URL for chat stats
     static const string SFUSTATSURL;
 
@@ -1071,6 +1198,10 @@ private:
     // maximum number of concurrent transfers (uploads or downloads)
     static const unsigned MAXTRANSFERS;
 
+    // maximum number of connections of the active transfers, overall and to each storage host
+    static const unsigned MAXTOTALCONNECTIONS;
+    static const unsigned MAXHOSTCONNECTIONS;
+
     // maximum number of queued putfa before halting the upload queue
     static const int MAXQUEUEDFA;
 
@@ -1087,9 +1218,6 @@ private:
     // a TransferSlot chunk failed
     bool chunkfailed;
 
-    // fetch state serialize from local cache
-    bool fetchsc(DbTable*);
-
     // fetch statusTable from local cache
     bool fetchStatusTable(DbTable*);
 
@@ -1238,11 +1366,17 @@ public:
     // ourselves in cases where many clients get 500s for a while and then recover at the same time
     bool pendingcs_serverBusySent = false;
 
+    // batches of order-independent commands sent alongside pendingcs, by RequestDispatcher id
+    std::map<int, std::unique_ptr<HttpReq>> pendingparallelcs;
+
+    // send up to `n` cs requests at a time (1: only the ordered one)
+    void setmaxcsinflight(unsigned n);
+
     // pending HTTP requests
     pendinghttp_map pendinghttp;
 
     // record type indicator for sctable
-    enum { CACHEDSCSN, CACHEDNODE, CACHEDUSER, CACHEDLOCALNODE, CACHEDPCR, CACHEDTRANSFER, CACHEDFILE, CACHEDCHAT} sctablerectype;
+    enum { CACHEDSCSN, CACHEDNODE, CACHEDUSER, CACHEDLOCALNODE, CACHEDPCR, CACHEDTRANSFER, CACHEDFILE, CACHEDCHAT, CACHEDCHUNKINDEX, CACHEDKEYSIGNATURES} sctablerectype;
 
     // record type indicator for statusTable
     enum StatusTableRecType { CACHEDSTATUS };
@@ -1259,6 +1393,19 @@ public:
     void updatesc();
     void finalizesc(bool);
 
+    // The nodes changed since the last flushsc(), written to sctable once however many times they change meanwhile:
+    // when there are mScFlushThreshold of them, every mScFlushInterval, and always before a commit makes the SCSN
+    // durable.  Those removed meanwhile, for the node snapshot.
+    node_set scdirty;
+    handle_vector scremoved;
+    size_t mScFlushThreshold = 10000;
+    dstime mScFlushInterval = 600;
+    dstime mScLastFlush = 0;
+    bool flushsc();
+
+    // writes mVerifiedKeySignatures if changed, as the updates of the statecache go
+    bool putkeysignatures();
+
     // truncates status table
     void initStatusTable();
 
@@ -1271,8 +1418,39 @@ public:
     // Server-MegaClient request JSON and processing state flag ("processing a element")
     JSON jsonsc;
     bool insca;
+
+    // when the response being processed in jsonsc arrived
+    dstime jsonscreceived = 0;
     bool insca_notlast;
 
+    // process the action packets of the sc response in flight as they are received
+    bool mStreamActionPackets = true;
+
+    // PENDING: waiting for the start of the action packet array, DISABLED: processed once complete
+    enum ScStream { SCSTREAM_PENDING, SCSTREAM_PACKETS, SCSTREAM_DISABLED };
+    ScStream mScStream = SCSTREAM_DISABLED;
+
+    // while streaming, end of the action packets received in full
+    const char* mScStreamLimit = nullptr;
+
+    // bytes that must follow a streamed action packet, for the look-ahead of procsc()
+    static const size_t SC_STREAM_LOOKAHEAD = 64;
+
+    // packets at the start of the response in flight that were already applied, see SCSN::packetsApplied()
+    size_t mScSkipPackets = 0;
+
+    // run procsc() on the complete action packets of the sc response received so far and purge them from it
+    void streamsc(HttpReq* req);
+
+    // records the sc responses received, to replay them offline (see ScRecorder)
+    unique_ptr<ScRecorder> mScRecorder;
+
+    // start recording from the next sc response on.  The file will hold the account key
+    void startScRecording(const LocalPath& path);
+
+    // number of responses recorded
+    size_t stopScRecording();
+
     // no two interrelated client instances should ever have the same sessionid
     char sessionid[10];
 
@@ -1342,6 +1520,22 @@ public:
     // waiting for the completion of a putnodes
     pendingfiles_map pendingfiles;
 
+    // nodes of completed uploads and the tags of their files, by target folder
+    struct UploadPutnodes
+    {
+        vector<NewNode> nodes;
+        vector<int> tags;
+    };
+    map<NodeHandle, UploadPutnodes> mUploadPutnodes;
+
+    // those of sync uploads, and when their window closes (0: none queued)
+    map<NodeHandle, UploadPutnodes> mSyncUploadPutnodes;
+    dstime mSyncUploadPutnodesDs = 0;
+    bool syncUploadPutnodesDue() const { return mSyncUploadPutnodesDs && Waiter::ds >= mSyncUploadPutnodesDs; }
+
+    // the command of the first tag cleans up the transfer records and temporary files of all of them once it completes
+    void mergeputnodestags(const vector<int>& tags);
+
     // transfer tslots
     transferslot_list tslots;
 
@@ -1354,9 +1548,147 @@ public:
     // FileFingerprint to node mapping
     Fingerprints mFingerprints;
 
+    // file nodes by creation time, built by the first query of recent files
+    RecentFiles mRecentFiles;
+
+    // oldest creation time whose nodes are known to be loaded from the local cache, for the recent files
+    m_time_t mRecentFilesLoadedSince = std::numeric_limits<m_time_t>::max();
+
     // flag to skip removing nodes from mFingerprints when all nodes get deleted
     bool mOptimizePurgeNodes = false;
 
+    // when resuming from the local cache, only load nodes into memory on first use
+    bool mLazyNodeLoading = false;
+
+    // write the local databases (sctable, sync tables, tctable, statusTable) from background threads, one per table
+    bool mDbWriteBehind = false;
+
+    // only browsing public folder links, one after another or many clients per process: no local databases (the nodes
+    // aren't written anywhere, transfers and status aren't kept), and no index of the files by fingerprint
+    bool mLinkBrowser = false;
+
+    // open a local database, write-behind if enabled.  Each has a file and a connection of its own, so the commits of
+    // one don't wait for those of another.
+    DbTable* openStateCacheTable(const string& name, int flags = DB_OPEN_FLAG_LARGE);
+
+    // node records of the local cache that may not be in memory yet (lazy node loading only)
+    unique_ptr<CachedNodeIndex> mCachedNodeIndex;
+
+    // set while nodes are being loaded from the local cache, their counters are already accounted for
+    bool mLoadingCachedNodes = false;
+
+    // load the children of a node from the local cache
+    void loadCachedChildren(Node*);
+
+    // load a node (and its ancestors) from the local cache
+    Node* loadCachedNode(handle);
+    Node* loadCachedRecord(CachedNodeIndex::Record&, node_vector*);
+
+    // load every remaining node from the local cache, for operations that need the whole tree
+    void loadAllCachedNodes();
+
+    // with lazy node loading, drop the older versions of the files from memory once they are in the local cache,
+    // so that accounts with many versions don't keep them all after a fetchnodes: they come back on first use
+    void unloadCachedVersions();
+
+    // names of the file and folder nodes for searches, filled the first time they are needed
+    // (with all the nodes loaded) and kept up to date as names are decrypted or change
+    NodeNameIndex mNodeNames;
+    NodeNameIndex& nodeNames();
+    void indexnodename(Node*);
+
+    // file nodes by type for searches by type, filled the first time they are needed like the names
+    NodeTypeIndex mNodeTypes;
+    NodeTypeIndex& nodeTypes();
+    void indexnodetype(Node*);
+
+    // load the cached nodes a query by fingerprint or by creation time can match, using the indexes of the local cache
+    void loadCachedNodesByFingerprint(const FileFingerprint&);
+    void loadCachedRecentFiles(m_time_t since);
+
+    // with lazy node loading, keep a snapshot of the node record headers next to the local cache,
+    // so resuming a session doesn't have to read every node record to build mCachedNodeIndex
+    bool mKeepNodeSnapshot = false;
+    unique_ptr<NodeSnapshot> mNodeSnapshot;
+
+    // bring the snapshot to the current SCSN, once the local cache is, with the nodes written and removed since
+    void updatenodesnapshot(const node_vector& updated, const handle_vector& removed);
+
+    // changes appended to the snapshot before it is rewritten in full, on top of a quarter of its records
+    static const size_t NODE_SNAPSHOT_MIN_CHANGES = 10000;
+
+    // The settings that only pay off together for accounts of millions of nodes: lazy node loading, the older versions
+    // left in the local cache and the snapshot to resume sessions without reading every node record.  The indexes of
+    // the local cache, by name and by type, and the counters of the nodes are kept anyway.  Operations that need the
+    // whole tree load the rest of it first (see loadAllCachedNodes()).
+    // Only before the local cache is opened: false otherwise.  A local cache written without the mode has the headers
+    // of all its node records read on the first resume, and gets its snapshot with the next changes written to it.
+    bool setLargeAccountMode(bool enable);
+    bool largeAccountMode() const { return mLazyNodeLoading && mKeepNodeSnapshot; }
+
+    // parse the node array of a fetchnodes response while the rest of it is still downloading
+    bool mStreamFetchNodes = true;
+
+    // progress through the node array of the fetchnodes response in flight
+    struct FetchNodesStream
+    {
+        // DISABLED: the response doesn't start with the node array, it is processed once complete
+        enum State { PENDING, NODES, DONE, FAILED, DISABLED };
+        State state = PENDING;
+
+        // nodes received before their parents
+        node_vector dp;
+
+        bool started() const { return state == NODES || state == DONE || state == FAILED; }
+    };
+    unique_ptr<FetchNodesStream> mFetchNodesStream;
+
+    // read the complete node objects received so far and purge them from the response.
+    // Once the response is complete (final), whatever follows the node array is left in req->in for CommandFetchNodes.
+    void streamfetchnodes(HttpReq* req, bool final);
+
+    // reload the account (eg. after too many pending updates) keeping the previous tree until the new one has been
+    // received in full, then notify the app of the nodes that differ rather than of a whole new tree
+    bool mRefreshOnReload = true;
+
+    // the previous tree during such a reload: a digest per node, so the new one is compared without keeping both
+    struct TreeRefresh
+    {
+        struct Previous
+        {
+            size_t digest;
+            handle parenthandle;
+            nodetype_t type;
+        };
+        std::unordered_map<handle, Previous> previous;
+
+        // the node objects of the response, written to disk as they arrive while the previous tree is still in use
+        FileSystemAccess* fsaccess = nullptr;
+        unique_ptr<FileAccess> spool;
+        LocalPath spoolPath;
+        m_off_t spoolSize = 0;
+        string spoolBuffer;
+
+        // written and read in blocks of
+        static const size_t SPOOL_BLOCK = 1 << 20;
+
+        bool flushspool();
+        ~TreeRefresh();
+    };
+    unique_ptr<TreeRefresh> mTreeRefresh;
+
+    // what the app sees of a node: its type, size, times, owner, key, attributes, file attributes and shares
+    static size_t nodedigest(const Node&);
+
+    // start a reload of that kind, if the tree is all in memory
+    void beginrefresh();
+
+    // read the node objects spooled by streamfetchnodes(), once the previous tree has been purged
+    bool readspoolednodes();
+
+    // queue the nodes that are new, changed or gone since the reload started for notifypurge(), if it was one
+    bool endrefresh();
+
     // send updates to app when the storage size changes
     int64_t mNotifiedSumSize = 0;
 
@@ -1364,6 +1696,23 @@ public:
     handle_vector nodekeyrewrite;
     handle_vector sharekeyrewrite;
 
+    // node keys per command for a new outgoing share: those past the first batch follow the share, a batch at a time
+    static const size_t SHAREKEYS_BATCH = 10000;
+
+    struct PendingShareKeys
+    {
+        handle share;
+        handle_vector nodes;
+        size_t next;
+    };
+    std::deque<PendingShareKeys> pendingsharekeys;
+    bool sharekeysinflight = false;
+
+    void queuesharekeys(handle share, handle_vector&& nodes);
+
+    // sends the next batch of pendingsharekeys, unless one is on its way
+    void sendsharekeys();
+
     static const char* const EXPORTEDLINK;
 
     // default number of seconds to wait after a bandwidth overquota
@@ -1397,6 +1746,15 @@ public:
     // update transfer in the persistent cache
     void transfercacheadd(Transfer*, DBTableTransactionCommitter*);
 
+    // The progress of an active transfer, its chunks done, written with that of the others every
+    // TRANSFER_PROGRESS_DS rather than with each chunk: the record holds all the chunk MACs of the transfer.
+    // Progress not written yet is redone on resumption.
+    void transfercacheprogress(Transfer*);
+    void flushtransferprogress(DBTableTransactionCommitter&, bool force = false);
+    set<Transfer*> mTransferProgress;
+    dstime mNextTransferProgressDs = 0;
+    static const dstime TRANSFER_PROGRESS_DS = 10;
+
     // remove a transfer from the persistent cache
     void transfercachedel(Transfer*, DBTableTransactionCommitter* committer);
 
@@ -1425,6 +1783,9 @@ public:
     Node* nodeByHandle(NodeHandle) const;
     Node* nodeByPath(const char* path, Node* node = nullptr);
 
+    // the children found by nodeByPath() on the way, kept up to date by notifynode()
+    NodePathCache mPathCache;
+
     Node* nodebyhandle(handle) const;
     Node* nodebyfingerprint(FileFingerprint*);
 #ifdef ENABLE_SYNC
@@ -1468,6 +1829,10 @@ public:
     // minute of the last created folder in SyncDebris
     m_time_t syncdebrisminute;
 
+    // the //bin/SyncDebris/yyyy-mm-dd folder last located, and its name, so the bin isn't searched on every pass
+    NodeHandle syncdebrisday;
+    string syncdebrisdayname;
+
     // activity flag
     bool syncactivity;
 
@@ -1482,6 +1847,14 @@ public:
 
     bool syncuprequired;
 
+    // the pending syncdown() / syncup() only need to visit the dirty folders
+    // (all the changes requested since the last pass marked the folders they concern)
+    bool syncdowndirtyonly = false;
+    bool syncupdirtyonly = false;
+
+    // request a syncdown() pass of all the folders, or only of the dirty ones
+    void requestsyncdown(bool dirtyonly = false);
+
     // block local fs updates processing while locked ops are in progress
     bool syncfsopsfailed;
 
@@ -1521,12 +1894,25 @@ public:
     bool mSyncMonitorRetry;
     BackoffTimer mSyncMonitorTimer;
 
+    // threads listing the folders of new syncs (0: they are scanned on the SDK thread)
+    // a change applies to the scans started once no other one is running
+    unsigned mSyncScanThreads = 4;
+    unique_ptr<ScanService> mScanService;
+    unsigned mScanServiceThreads = 0;
+    ScanService& scanService();
+
+    // syncs resumed from the cache don't list the folders unchanged since they were last scanned
+    bool mSyncResumeScan = true;
+
     // vanished from a local synced folder
     localnode_set localsyncnotseen;
 
     // maps local fsid to corresponding LocalNode*
     handlelocalnode_map fsidnode;
 
+    // the path components that LocalNodes share (see InternedPath)
+    PathComponentTable pathcomponents;
+
     // local nodes that need to be added remotely
     localnode_vector synccreate;
 
@@ -1548,15 +1934,15 @@ public:
     void syncupdate();
 
     // create missing folders, copy/start uploading missing files
-    bool syncup(LocalNode* l, dstime* nds, size_t& parentPending);
-    bool syncup(LocalNode* l, dstime* nds);
+    bool syncup(LocalNode* l, dstime* nds, size_t& parentPending, bool dirtyonly);
+    bool syncup(LocalNode* l, dstime* nds, bool dirtyonly = false);
 
     // sync putnodes() completion
     void putnodes_sync_result(error, vector<NewNode>&);
 
     // start downloading/copy missing files, create missing directories
     bool syncdown(LocalNode*, LocalPath&, SyncdownContext& cxt);
-    bool syncdown(LocalNode*, LocalPath&);
+    bool syncdown(LocalNode*, LocalPath&, bool dirtyonly = false);
 
     // move nodes to //bin/SyncDebris/yyyy-mm-dd/ or unlink directly
     void movetosyncdebris(Node*, bool);
@@ -1569,6 +1955,9 @@ public:
     void execsyncunlink();
     node_set tounlink;
 
+    // the local trees are deleted bottom up: the nodes queued before their folder go along with it
+    void unqueuesyncdeletions(Node* folder);
+
     // commit all queueud deletions
     void execsyncdeletions();
 
@@ -1592,6 +1981,25 @@ public:
     // transfer queue dispatch/retry handling
     void dispatchTransfers();
 
+    // The temp URLs of the downloads next in the queue, requested ahead in the same batch so that they start moving
+    // data as soon as they get a slot.  The pending requests by id, as the transfers may go before the replies.
+    void prefetchTempUrls();
+    map<uint64_t, Transfer*> tempUrlPrefetches;
+    uint64_t nextTempUrlPrefetch = 0;
+    static const size_t TEMPURL_PREFETCH_AHEAD = 32;
+
+    // unused temp URLs requested ahead are dropped and requested again after 10 minutes
+    static const dstime TEMPURL_PREFETCH_VALIDITY = 6000;
+
+    // The local files last downloaded, by the key of their content (see ChunkIndex::key()).  With the synced files,
+    // the sources of new downloads of the same content, copied locally instead of fetched again.  Bounded: it starts
+    // over when full.
+    map<string, LocalPath> mDownloadedContent;
+    static const size_t MAX_DOWNLOADED_CONTENT = 4096;
+
+    // the download's temporary file made a copy of a local file with its content, checked by fingerprint
+    bool copyLocalDuplicate(Transfer*);
+
     void defer(direction_t, int td, int = 0);
     void freeq(direction_t);
 
@@ -1616,6 +2024,8 @@ public:
 
     // process object arrays by the API server
     int readnodes(JSON*, int, putsource_t, vector<NewNode>*, int, bool applykeys);
+    bool readnode(JSON*, int, putsource_t, vector<NewNode>*, int, bool applykeys, node_vector& dp);
+    void setorphanparents(node_vector& dp);
 
     void readok(JSON*);
     void readokelement(JSON*);
@@ -1707,6 +2117,13 @@ public:
     // true while authrings are being fetched
     bool mFetchingAuthrings;
 
+    // digests of the signatures of public keys that verified, with the keys and the signing key, kept in the
+    // statecache not to verify them again for every contact on each startup
+    std::set<string> mVerifiedKeySignatures;
+    bool mVerifiedKeySignaturesDirty = false;
+    static const size_t MAX_VERIFIED_KEY_SIGNATURES = 4096;
+    static const size_t KEY_SIGNATURE_DIGEST_LENGTH = 16;
+
     // actual state of keys
     bool fetchingkeys;
 
@@ -1731,6 +2148,18 @@ public:
     // send andy key rewrites prepared when keys were applied
     void sendkeyrewrites();
 
+    // below this many nodes, applykeys() doesn't bother with the worker threads
+    static const size_t PARALLEL_APPLYKEYS_MIN = 4096;
+
+    // below this many RSA-encrypted node keys, applykeys() doesn't bother with the worker threads either
+    static const size_t PARALLEL_APPLYKEYS_RSA_MIN = 16;
+
+    // nodes per worker thread task, an RSA-encrypted key counting as APPLYKEYS_RSA_WEIGHT of them
+    static const size_t APPLYKEYS_BATCH = 1024;
+    static const size_t APPLYKEYS_RSA_WEIGHT = 128;
+
+    void applykeysinparallel(node_vector&);
+
     // symmetric password challenge
     int checktsid(byte* sidbuf, unsigned len);
 
@@ -1760,6 +2189,9 @@ public:
     // builds the authentication URI to be sent in POST requests
     string getAuthURI(bool supressSID = false);
 
+    // URL of a cs request with the given id
+    string getcsurl(const char* id, size_t idlen, bool suppressSID);
+
     bool setlang(string *code);
 
     // sets the auth token to be used when logged into a folder link
@@ -1783,15 +2215,21 @@ public:
     // process node subtree
     void proctree(Node*, TreeProc*, bool skipinshares = false, bool skipversions = false);
 
+    // The same for a read-only processor, the subtrees on the worker threads from PROCTREE_PARALLEL_MIN nodes below.
+    // The nodes aren't processed in tree order. The tree must not change meanwhile: the caller holds the lock of the SDK exclusively.
+    void proctreeParallel(Node*, ParallelTreeProc*, bool skipinshares = false);
+    static const size_t PROCTREE_PARALLEL_MIN = 4096;
+    static const size_t PROCTREE_PARALLEL_JOBS = 32;
+
     // hash password
     error pw_key(const char*, byte*) const;
 
-    // returns a pointer to tmptransfercipher setting its key to the one provided
-    // tmptransfercipher key will change: to be used right away: this is not a dedicated SymmCipher for the transfer!
+    // returns a pointer to a cipher of tmptransferciphers with the key provided
+    // it will be reused for another key: to be used right away: this is not a dedicated SymmCipher for the transfer!
     SymmCipher *getRecycledTemporaryTransferCipher(const byte *key, int type = 1);
 
-    // returns a pointer to tmpnodecipher setting its key to the one provided
-    // tmpnodecipher key will change: to be used right away: this is not a dedicated SymmCipher for the node!
+    // returns a pointer to a cipher of tmpnodeciphers with the key provided
+    // it will be reused for another key: to be used right away: this is not a dedicated SymmCipher for the node!
     SymmCipher *getRecycledTemporaryNodeCipher(const string *key);
     SymmCipher *getRecycledTemporaryNodeCipher(const byte *key);
 
@@ -1902,14 +2340,56 @@ public:
         CodeCounter::ScopeStats dispatchTransfers = { "dispatchTransfers" };
         CodeCounter::ScopeStats csResponseProcessingTime = { "cs batch response processing" };
         CodeCounter::ScopeStats scProcessingTime = { "sc processing" };
-        uint64_t transferStarts = 0, transferFinishes = 0;
-        uint64_t transferTempErrors = 0, transferFails = 0;
-        uint64_t prepwaitImmediate = 0, prepwaitZero = 0, prepwaitHttpio = 0, prepwaitFsaccess = 0, nonzeroWait = 0;
+        CodeCounter::ScopeStats dbCommit = { "db commit" };
+        CodeCounter::ScopeStats syncProcscanq = { "Sync_procscanq" };
+        CodeCounter::ScopeStats syncCheckpath = { "Sync_checkpath" };   // per notification
+        CodeCounter::ScopeStats syncdown = { "MegaClient_syncdown" };
+        CodeCounter::ScopeStats syncup = { "MegaClient_syncup" };
+        std::atomic<uint64_t> transferStarts{0}, transferFinishes{0};
+        std::atomic<uint64_t> transferTempErrors{0}, transferFails{0};
+        std::atomic<uint64_t> prepwaitImmediate{0}, prepwaitZero{0}, prepwaitHttpio{0}, prepwaitFsaccess{0}, nonzeroWait{0};
+
+        // bytes of the transfer chunks completed, by direction
+        std::atomic<uint64_t> transferBytes[2] = {};
         CodeCounter::DurationSum csRequestWaitTime;
         CodeCounter::DurationSum transfersActiveTime;
+
+        // queue depths, sampled at the end of each exec()
+        CodeCounter::Gauge csQueuedBatches;
+        CodeCounter::Gauge transferSlots;
+        CodeCounter::Gauge queuedTransfers;
+        CodeCounter::Gauge pendingFileAttributes;
+        CodeCounter::Gauge downloadSpeed, uploadSpeed;
+        CodeCounter::Gauge nodes;
+        CodeCounter::Gauge syncQueuedNotifications;
+        CodeCounter::Gauge scLag;   // ms since the action packets being processed arrived
+
+        // breakdown of each exec(), those slower than the threshold are logged
+        enum ExecPhase { PHASE_PROCSC, PHASE_CSRESPONSE, PHASE_SYNCDOWN, PHASE_SYNCUP, PHASE_TRANSFERSLOTS, PHASE_DBCOMMIT, PHASE_NOTIFYPURGE, PHASE_APPCALLBACKS };
+        CodeCounter::LoopProfiler execPhases = { { "procsc", "csresponse", "syncdown", "syncup", "transferslots", "dbcommit", "notifypurge", "appcallbacks" },
+                                                 std::chrono::milliseconds(500) };
+
         std::string report(bool reset, HttpIO* httpio, Waiter* waiter, const RequestDispatcher& reqs);
+
+        // counters, timings, gauges of this struct and of the client's queues and pools as a JSON object,
+        // safe to call from any thread while the client exists (the values are not reset)
+        std::string toJson(const MegaClient& client) const;
+
+        // the same in the Prometheus text exposition format, for scrapers
+        std::string toPrometheus(const MegaClient& client) const;
+
+    private:
+        // the timed blocks, including those of the network layer
+        std::vector<const CodeCounter::ScopeStats*> scopes(const MegaClient& client) const;
     } performanceStats;
 
+    // latency and errors of the requests to each kind of endpoint, they adapt the cs and transfer retry backoff
+    enum LatencyEndpoint { LATENCY_CS, LATENCY_SC, LATENCY_GET, LATENCY_PUT, LATENCY_ENDPOINTS };
+    std::array<LatencyHistogram, LATENCY_ENDPOINTS> mLatency;
+
+    // the phases of the startup, from the creation of the MegaApi to the first fetchnodes result
+    CodeCounter::StartupProfile startupProfile;
+
     std::string getDeviceidHash();
 
     // generate a new drive id
@@ -1922,18 +2402,18 @@ public:
     // return API_OK if success, otherwise error code
     error writeDriveId(const char *pathToDrive, handle driveId);
 
-    MegaClient(MegaApp*, Waiter*, HttpIO*, FileSystemAccess*, DbAccess*, GfxProc*, const char*, const char*, unsigned workerThreadCount);
+    // workerPool: threads shared with other clients, instead of workerThreadCount of its own
+    MegaClient(MegaApp*, Waiter*, HttpIO*, FileSystemAccess*, DbAccess*, GfxProc*, const char*, const char*, unsigned workerThreadCount,
+               std::shared_ptr<MegaClientAsyncQueue::WorkerPool> workerPool = nullptr);
     ~MegaClient();
 
     void filenameAnomalyDetected(FilenameAnomalyType type, const string& localPath, const string& remotePath);
     unique_ptr<FilenameAnomalyReporter> mFilenameAnomalyReporter;
 
 private:
-    // Since it's quite expensive to create a SymmCipher, this are provided to use for quick operations - just set the key and use.
-    SymmCipher tmpnodecipher;
-
-    // Since it's quite expensive to create a SymmCipher, this is provided to use for quick operation - just set the key and use.
-    SymmCipher tmptransfercipher;
+    // Since it's quite expensive to create a SymmCipher and set its key, these keep them for the last keys used.
+    SymmCipherCache tmpnodeciphers;
+    SymmCipherCache tmptransferciphers;
 };
 } // namespace
 
@@ -23,21 +23,100 @@
 #ifndef MEGA_NODE_H
 #define MEGA_NODE_H 1
 
+#include <unordered_map>
+
 #include "filefingerprint.h"
 #include "file.h"
 #include "attrmap.h"
 
 namespace mega {
 
-struct LocalPathPtrCmp
+// Children of a LocalNode by name (or short name).
+// One vector in insertion order, holding the hash of each name, so lookups and the reconcile loops run
+// over contiguous memory.  Larger folders get an open addressing index of the vector as well.
+// As with std::map, adding or erasing a child doesn't invalidate the iterators: erased entries are left
+// as holes, which the iterators skip, and are only compacted away while no iterator exists.
+class MEGA_API LocalNodeChildren
 {
-    bool operator()(const LocalPath* a, const LocalPath* b) const
+public:
+    struct Entry
+    {
+        const LocalPath* first;
+
+        // null once erased
+        LocalNode* second;
+
+        size_t hash;
+    };
+
+    class iterator
     {
-        return *a < *b;
-    }
+        const LocalNodeChildren* mChildren = nullptr;
+        size_t mIndex = 0;
+
+        bool atEnd() const { return !mChildren || mIndex >= mChildren->mEntries.size(); }
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Entry value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const Entry* pointer;
+        typedef const Entry& reference;
+
+        iterator() = default;
+        iterator(const LocalNodeChildren* children, size_t index);
+        iterator(const iterator&);
+        iterator& operator=(const iterator&);
+        ~iterator();
+
+        reference operator*() const { return mChildren->mEntries[mIndex]; }
+        pointer operator->() const { return &mChildren->mEntries[mIndex]; }
+        iterator& operator++();
+        iterator operator++(int) { iterator i(*this); ++*this; return i; }
+
+        // entries added meanwhile are visited up to the end, like a map would when they sort after
+        bool operator==(const iterator& other) const { return atEnd() ? other.atEnd() : mIndex == other.mIndex; }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+    };
+
+    typedef iterator const_iterator;
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, SIZE_MAX); }
+    iterator find(const LocalPath* name) const;
+
+    size_t size() const { return mEntries.size() - mErased; }
+    bool empty() const { return !size(); }
+
+    // adds the child, or replaces the one of the same name
+    void set(const LocalPath* name, LocalNode* node);
+
+    size_t erase(const LocalPath* name);
+
+    LocalNodeChildren() = default;
+    MEGA_DISABLE_COPY_MOVE(LocalNodeChildren)
+
+private:
+    // up to this many entries, lookups just compare the hashes in turn
+    static const size_t INDEXTHRESHOLD = 16;
+
+    // mEntries.size() if not present
+    size_t findentry(const LocalPath* name, size_t hash) const;
+
+    void addindex(size_t entry);
+    void rebuildindex();
+    void compact();
+
+    vector<Entry> mEntries;
+    size_t mErased = 0;
+
+    // entry + 1 by hash, 0 for empty slots (may still refer to erased entries)
+    vector<uint32_t> mIndex;
+
+    mutable unsigned mIterators = 0;
 };
 
-typedef map<const LocalPath*, LocalNode*, LocalPathPtrCmp> localnode_map;
+typedef LocalNodeChildren localnode_map;
 typedef map<const string*, Node*, StringCmp> remotenode_map;
 
 struct MEGA_API NodeCore
@@ -96,14 +175,15 @@ struct MEGA_API PublicLink
     bool isExpired();
 };
 
-// Container storing FileFingerprint* (Node* in practice) ordered by fingerprint.
+// Index of the file nodes by fingerprint (size, mtime and crc).
+// A chained hash table whose chains run through the nodes themselves (Node::fingerprint_next/fingerprint_pprev),
+// so adding or removing a node needs no allocation, plus a count of the indexed files per size.
+// Which of several nodes with the same fingerprint nodebyfingerprint() returns is unspecified.
 struct Fingerprints
 {
-    // maps FileFingerprints to node
-    using fingerprint_set = std::multiset<FileFingerprint*, FileFingerprintCmp>;
-    using iterator = fingerprint_set::iterator;
+    Fingerprints() = default;
+    MEGA_DISABLE_COPY_MOVE(Fingerprints)
 
-    void newnode(Node* n);
     void add(Node* n);
     void remove(Node* n);
     void clear();
@@ -112,11 +192,212 @@ struct Fingerprints
     Node* nodebyfingerprint(FileFingerprint* fingerprint);
     node_vector *nodesbyfingerprint(FileFingerprint* fingerprint);
 
+    // whether any indexed file has exactly this size
+    bool hasSize(m_off_t size) const;
+
+    // number of indexed file nodes
+    size_t size() const { return mCount; }
+
 private:
-    fingerprint_set mFingerprints;
+    static size_t hashOf(const FileFingerprint& fp);
+    static size_t hashOf(m_off_t size);
+    Node** bucket(const FileFingerprint& fp);
+    void link(Node* n);
+    void rehash(size_t buckets);
+
+    // open-addressed (linear probing, backward-shift deletion), entries are empty when their count is 0
+    size_t probeSize(m_off_t size) const;
+    void addSize(m_off_t size);
+    void removeSize(m_off_t size);
+
+    vector<Node*> mBuckets;
+    size_t mCount = 0;
+
+    vector<pair<m_off_t, size_t>> mSizes;
+    size_t mDistinctSizes = 0;
+
     m_off_t mSumSizes = 0;
 };
 
+// The file nodes by creation time, newest first, for the recent files and actions.
+// Only kept once built (by MegaClient::getRecentNodes()), so that accounts that never ask for them don't pay for it.
+// From then on nodes are added and removed as they come and go, and moved when their creation time changes.
+class MEGA_API RecentFiles
+{
+public:
+    typedef std::set<std::pair<m_time_t, Node*>, std::greater<std::pair<m_time_t, Node*>>> set_type;
+
+    bool built() const { return mBuilt; }
+
+    // from now on add() and remove() apply: the caller adds the nodes already there
+    void build() { mBuilt = true; }
+
+    // no-ops until built, and for nodes other than files
+    void add(Node* n);
+    void remove(Node* n);
+
+    // forget the nodes and stop keeping them
+    void clear();
+
+    set_type::const_iterator begin() const { return mFiles.begin(); }
+    set_type::const_iterator end() const { return mFiles.end(); }
+    size_t size() const { return mFiles.size(); }
+
+private:
+    bool mBuilt = false;
+    set_type mFiles;
+};
+
+// Children of a Node.
+// An intrusive doubly linked list through the children's sibling links, so attaching a node to
+// its parent needs no allocation.  As with std::list, removing a node only invalidates iterators to it.
+// With lazy node loading (see MegaClient::mLazyNodeLoading) the children of a folder may still
+// be in the local cache only.  Any read access loads them first, so callers always see the full list.
+// push_back() and remove() don't trigger loading by themselves.
+// Big folders listed often may also keep the children sorted in some orders, see addSorted(), and
+// big folders searched by name an index by name, see byName().
+class MEGA_API NodeChildren
+{
+public:
+    typedef std::function<bool(Node*, Node*)> Comparator;
+
+private:
+    Node* mFirst = nullptr;
+    Node* mLast = nullptr;
+    Node* mOwner = nullptr;
+    uint32_t mSize = 0;
+    mutable bool mPending = false;
+
+    struct Sorted
+    {
+        Comparator less;
+        node_vector nodes;
+    };
+
+    // by order id, only allocated for the folders that have any
+    unique_ptr<map<int, Sorted>> mSorted;
+
+    // by hash of the display name, only allocated for big folders searched by name
+    unique_ptr<multimap<size_t, Node*>> mByName;
+
+    static size_t nameHash(const char* name);
+    void loadPending() const;
+
+public:
+    class iterator
+    {
+        Node* mNode = nullptr;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Node* value_type;
+        typedef ptrdiff_t difference_type;
+        typedef Node* const* pointer;
+        typedef Node* const& reference;
+
+        iterator() = default;
+        explicit iterator(Node* n) : mNode(n) {}
+
+        reference operator*() const { return mNode; }
+        iterator& operator++();
+        iterator operator++(int) { iterator i(*this); ++*this; return i; }
+
+        bool operator==(const iterator& other) const { return mNode == other.mNode; }
+        bool operator!=(const iterator& other) const { return mNode != other.mNode; }
+    };
+
+    typedef iterator const_iterator;
+    typedef Node* value_type;
+
+    explicit NodeChildren(Node* owner) : mOwner(owner) {}
+    MEGA_DISABLE_COPY_MOVE(NodeChildren)
+
+    void load() const { if (mPending) loadPending(); }
+
+    iterator begin() const { load(); return iterator(mFirst); }
+    iterator end() const { load(); return iterator(); }
+
+    size_t size() const { load(); return mSize; }
+    bool empty() const { load(); return !mSize; }
+
+    // whether there are any children, without loading them
+    bool any() const { return mPending || mSize; }
+    Node* front() const { load(); return mFirst; }
+    Node* back() const { load(); return mLast; }
+
+    void push_back(Node* n);
+    void remove(Node* n);
+
+    // the children are in the local cache and will be loaded on first access
+    void setPending() { mPending = true; }
+    bool pending() const { return mPending; }
+
+    // forget children that were never loaded (only when the owner is going away)
+    void discardPending() { mPending = false; }
+
+    // The children sorted by `less`, kept in order as children are added and removed from then on.
+    // The order must only depend on the attributes of the children: it is dropped when they change (see clearIndexes())
+    const node_vector& addSorted(int order, Comparator less);
+
+    // the children in an order added before, null if there isn't one
+    const node_vector* sorted(int order) const;
+
+    // Display names compared byte by byte, for the completion of paths.  The orders of MegaApi are all positive.
+    static const int ORDER_NAME_BYTES = -1;
+
+    // Folders with at least this many children are searched through an index by name, built on the first search
+    static const size_t NAME_INDEX_THRESHOLD = 256;
+
+    // The children whose display name is `name`, in no particular order, through the index by name.
+    // False for folders below NAME_INDEX_THRESHOLD: the caller goes through the children instead.
+    bool byName(const char* name, node_vector& matches);
+
+    // The orders and the index depend on the attributes of the children: call it before they change
+    void clearIndexes() { mSorted.reset(); mByName.reset(); }
+};
+
+// The children found by name while resolving paths, so that resolving the same deep paths again costs a hash lookup
+// per component instead of a search of each folder on the way.  Bounded: it starts over when full.
+// MegaClient::notifynode() drops the entry of a changed node, and that of the name it now has in its folder, for a new
+// folder to take precedence over a file of the same name as it does in MegaClient::childnodebyname().
+// Locked on its own: paths are resolved by the queries of MegaApi that share the lock of the SDK.
+class MEGA_API NodePathCache
+{
+public:
+    static const size_t MAX_ENTRIES = 1 << 16;
+
+    // the child of `parent` named `name` (normalized), undefined if not cached
+    NodeHandle find(NodeHandle parent, const string& name) const;
+
+    void add(NodeHandle parent, const string& name, NodeHandle child);
+
+    // `node` was added, renamed, moved or removed; it is now in `parent` as `name`
+    void invalidate(NodeHandle node, NodeHandle parent, const string& name);
+
+    void clear();
+    size_t size() const;
+
+private:
+    struct Key
+    {
+        NodeHandle parent;
+        string name;
+
+        bool operator==(const Key& other) const { return parent == other.parent && name == other.name; }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& k) const;
+    };
+
+    mutable std::mutex mMutex;
+
+    std::unordered_map<Key, NodeHandle, KeyHash> mChildren;
+
+    // the key of each child cached, a node being in one folder under one name
+    std::unordered_map<handle, Key> mKeys;
+};
 
 // filesystem node
 struct MEGA_API Node : public NodeCore, FileFingerprint
@@ -141,6 +422,13 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
     // try to resolve node key string
     bool applykey();
 
+    // locate the encrypted key to apply and the cipher it was encrypted with.
+    // false if the key is applied already or no suitable key is available yet.
+    bool keysource(const char** k, SymmCipher** sc);
+
+    // apply a node key decrypted elsewhere, along with the attributes it decrypts (null if that failed)
+    void setdecryptedkey(const byte* key, attr_map* decryptedattrs);
+
     // set up nodekey in a static SymmCipher
     SymmCipher* nodecipher();
 
@@ -169,9 +457,15 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
     int hasfileattribute(fatype) const;
     static int hasfileattribute(const string *fileattrstring, fatype);
 
+    // handle of a file attribute type in a node's attribute string, UNDEF if not present
+    static handle fileattributehandle(const string *fileattrstring, fatype);
+
     // decrypt node attribute string
     static byte* decryptattr(SymmCipher*, const char*, size_t);
 
+    // decrypt node attribute string and parse it into attrs (names normalized); safe to call from any thread
+    static bool decryptattrs(SymmCipher*, const string& attrstring, attr_map* attrs);
+
     // parse node attributes from an incoming buffer, this function must be called after call decryptattr
     static void parseattr(byte*, AttrMap&, m_off_t, m_time_t&, string&, string&, FileFingerprint&);
 
@@ -221,19 +515,35 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
 
     void faspec(string*);
 
+    // counts of the subtree, the node included
     NodeCounter subnodeCounts() const;
 
+    // counts of everything below the node: kept once computed (for nodes with children) and updated as nodes are
+    // attached to the subtree, moved out of it or deleted, so that asking again is O(1)
+    NodeCounter descendantCounts() const;
+
+    // would descendantCounts() just read them
+    bool descendantCountsKept() const { return mDescendantCounts || (!children.pending() && children.empty()); }
+
+    // add the counts of this subtree to those kept by its ancestors, or subtract them
+    void updateAncestorCounts(bool add);
+
     // parent
     Node* parent = nullptr;
 
     // children
-    node_list children;
+    NodeChildren children{this};
 
-    // own position in parent's children
-    node_list::iterator child_it;
+    // links of the chain in Fingerprints (only used for file nodes)
+    // fingerprint_pprev points at whatever points at this node, and is null while the node isn't indexed
+    Node* fingerprint_next = nullptr;
+    Node** fingerprint_pprev = nullptr;
 
-    // own position in fingerprint set (only valid for file nodes)
-    Fingerprints::iterator fingerprint_it;
+    // see descendantCounts()
+    mutable unique_ptr<NodeCounter> mDescendantCounts;
+
+    // slot of the name in MegaClient::mNodeNames (NodeNameIndex::NONE while it isn't indexed)
+    uint32_t nameslot = ~0u;
 
 #ifdef ENABLE_SYNC
     // related synced item or NULL
@@ -253,6 +563,9 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
     node_set::iterator tounlink_it;
 #endif
 
+    // location in MegaClient::scdirty
+    node_set::iterator scdirty_it;
+
     // source tag.  The tag of the request or transfer that last modified this node (available in MegaApi)
     int tag = 0;
 
@@ -268,14 +581,35 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
     bool serialize(string*) override;
     static Node* unserialize(MegaClient*, const string*, node_vector*);
 
+    // read just the handle, parent, type and size of a serialized node
+    static bool unserializeHeader(const string*, handle*, handle*, nodetype_t*, m_off_t*);
+
     Node(MegaClient*, vector<Node*>*, handle, handle, nodetype_t, m_off_t, handle, const char*, m_time_t);
     ~Node();
 
+    // Nodes are carved from slabs rather than allocated individually (see FixedSizeAllocator)
+    static void* operator new(size_t size);
+    static void operator delete(void* p, size_t size);
+
 #ifdef ENABLE_SYNC
     void detach(const bool recreate = false);
 #endif // ENABLE_SYNC
 
 private:
+    friend class NodeChildren;
+
+    // Records of the compact layout start with the handle, the type and COMPACT_RECORD, whose top bit is set: the
+    // first 8 bytes of the original layout are the size or minus the type, which never have it.  Both are read.
+    static const byte COMPACT_RECORD = 0x82;
+    static const byte COMPACT_EXPORTED = 1;
+    static const byte COMPACT_INSHARE = 2;
+    static bool isCompactRecord(const string& d) { return d.size() >= 8 && byte(d[7]) == COMPACT_RECORD; }
+    static Node* unserializeCompact(MegaClient*, const string*, node_vector*);
+
+    // links between the children of parent
+    Node* mPrevSibling = nullptr;
+    Node* mNextSibling = nullptr;
+
     // full folder/file key, symmetrically or asymmetrically encrypted
     // node crypto keys (raw or cooked -
     // cooked if size() == FOLDERNODEKEYLENGTH or FILEFOLDERNODEKEYLENGTH)
@@ -298,6 +632,12 @@ inline bool Node::keyApplied() const
     return nodekeydata.size() == size_t((type == FILENODE) ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH);
 }
 
+inline NodeChildren::iterator& NodeChildren::iterator::operator++()
+{
+    mNode = mNode->mNextSibling;
+    return *this;
+}
+
 
 #ifdef ENABLE_SYNC
 struct MEGA_API LocalNode : public File
@@ -321,12 +661,15 @@ struct MEGA_API LocalNode : public File
 
     // for botched filesystems with legacy secondary ("short") names
     // Filesystem notifications could arrive with long or short names, and we need to recognise which LocalNode corresponds.
-    std::unique_ptr<LocalPath> slocalname;   // null means either the entry has no shortname or it's the same as the (normal) longname
+    // (interned: identical short names are held once)
+    InternedPath slocalname;   // null means either the entry has no shortname or it's the same as the (normal) longname
     localnode_map schildren;
 
     // local filesystem node ID (inode...) for rename/move detection
     handle fsid = mega::UNDEF;
-    handlelocalnode_map::iterator fsid_it{};
+
+    // whether this node is that of its fsid in MegaClient::fsidnode
+    bool fsid_indexed = false;
 
     // related cloud node, if any
     crossref_ptr<Node, LocalNode> node;
@@ -340,6 +683,10 @@ struct MEGA_API LocalNode : public File
     // detection of deleted filesystem records
     int scanseqno = 0;
 
+    // folders: mtime when the entries last matched the children (0 if unknown)
+    // persisted, so that a restart can skip listing the folders unchanged since
+    m_time_t scanmtime = 0;
+
     // number of iterations since last seen
     int notseen = 0;
 
@@ -362,8 +709,18 @@ struct MEGA_API LocalNode : public File
 
         // set after the cloud node is created
         bool needsRescan : 1;
+
+        // this folder or something below needs another syncdown() / syncup() visit
+        // (also set on every ancestor, cleared as the folder is visited)
+        bool syncdowndirty : 1;
+        bool syncupdirty : 1;
     };
 
+    // mark the folder for the partial syncdown() / syncup() passes, up to the sync root
+    void setsyncdowndirty();
+    void setsyncupdirty();
+    void setsyncdirty() { setsyncdowndirty(); setsyncupdirty(); }
+
     // current subtree sync state: current and displayed
     treestate_t ts = TREESTATE_NONE;
     treestate_t dts = TREESTATE_NONE;
@@ -378,6 +735,9 @@ struct MEGA_API LocalNode : public File
     dstime nagleds = 0;
     void bumpnagleds();
 
+    // when the oldest local change not in the cloud yet was noticed (active syncs only, for Sync::stats())
+    dstime changeds = 0;
+
     // if delage > 0, own iterator inside MegaClient::localsyncnotseen
     localnode_set::iterator notseen_it{};
 
@@ -419,6 +779,15 @@ struct MEGA_API LocalNode : public File
     void detach(const bool recreate = false);
 
     void setSubtreeNeedsRescan(bool includeFiles);
+
+private:
+    // Records of the compact layout start with the parent's dbid, the type, mSyncable, the flags below and
+    // COMPACT_RECORD, whose top bit is set: the first 8 bytes of the original layout are the size or minus the
+    // type, which never have it.  Both are read.
+    static const byte COMPACT_RECORD = 0x82;
+    static const byte COMPACT_SHORTNAME = 1;
+    static const byte COMPACT_SCANMTIME = 2;
+    static LocalNode* unserializeCompact(Sync* sync, const string* d);
 };
 
 template <> inline NewNode*& crossref_other_ptr_ref<LocalNode, NewNode>(LocalNode* p) { return p->newnode.ptr; }
@@ -0,0 +1,100 @@
+/**
+ * @file mega/nodenameindex.h
+ * @brief Flat index of node names for substring searches, and index of the file nodes by type
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#ifndef MEGA_NODENAMEINDEX_H
+#define MEGA_NODENAMEINDEX_H 1
+
+#include <array>
+
+#include "types.h"
+
+namespace mega {
+
+// The names of the nodes, lowercased (ASCII, as strcasestr() compares them) and kept back to back in one buffer,
+// so a substring search scans contiguous memory instead of walking the node tree. A name that changes is appended
+// again and its old slot left empty, the buffer is compacted once half of it is empty.
+// The owner keeps the slot of each node (see Node::nameslot).
+class MEGA_API NodeNameIndex
+{
+public:
+    static const uint32_t NONE = ~0u;
+
+    // index the name of a node, returns its new slot (the previous one, if any, is released)
+    uint32_t set(uint32_t slot, handle h, const char* name);
+
+    void remove(uint32_t slot);
+
+    // the nodes whose name contains this string (case-insensitive), all of them if it's empty
+    void find(const char* substring, vector<handle>& results) const;
+
+    // drop the empty slots, if there are many; moved(handle, slot) is called for each node whose slot changed
+    void compact(std::function<void(handle, uint32_t)> moved);
+
+    size_t size() const { return mEntries.size() - mRemoved; }
+    void clear();
+
+    // has it been filled with the names of all the nodes
+    bool built = false;
+
+private:
+    struct Entry
+    {
+        handle h;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    // the names, each one followed by a '\0' so no match spans two of them
+    string mNames;
+
+    // in the order of their names in mNames, those removed have h == UNDEF
+    vector<Entry> mEntries;
+    size_t mRemoved = 0;
+    size_t mRemovedBytes = 0;
+};
+
+// The file nodes of each type of MegaApi::FILE_TYPE_* (photos, audio, videos and documents) as MegaClient::nodeIsPhoto()
+// and the like classify them, so a search by type without a name goes through the nodes of that type only.
+// Like the names, filled the first time it's needed and then kept up to date (see MegaClient::indexnodetype()).
+class MEGA_API NodeTypeIndex
+{
+public:
+    // the types are 1 (photo) to TYPES (document)
+    static const int TYPES = 4;
+
+    // the types of a node (bit t set for type t), it's removed from the others
+    void set(handle h, unsigned types);
+    void remove(handle h) { set(h, 0); }
+
+    const std::set<handle>& nodes(int type) const { return mNodes[type]; }
+
+    void clear();
+
+    // has it been filled with the types of all the nodes
+    bool built = false;
+
+private:
+    std::array<std::set<handle>, TYPES + 1> mNodes;
+};
+
+} // namespace
+
+#endif
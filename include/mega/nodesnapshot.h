@@ -0,0 +1,88 @@
+/**
+ * @file mega/nodesnapshot.h
+ * @brief Snapshot of the node records of the local cache
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#ifndef MEGA_NODESNAPSHOT_H
+#define MEGA_NODESNAPSHOT_H 1
+
+#include "filesystem.h"
+#include "nodestore.h"
+
+namespace mega {
+
+// Compact list of the node records of the local cache: what CachedNodeIndex needs, so a session
+// can be resumed with lazy node loading without reading (and decrypting) every node record.
+// Kept in a file next to the database, and only used if it is at the SCSN of the database.
+// The file holds a full list of records, followed by blocks of changes that each take it from
+// one SCSN to the next.  Blocks are length-prefixed: a torn write only loses the last one.
+// Only handles, sizes and types are stored, which the database keeps in plain columns too.
+class MEGA_API NodeSnapshot
+{
+public:
+    struct Record
+    {
+        handle h;
+        handle parent;
+        m_off_t size;
+        uint32_t dbid;
+        nodetype_t type;
+    };
+
+    NodeSnapshot(FileSystemAccess& fsAccess, const LocalPath& path);
+
+    MEGA_DISABLE_COPY_MOVE(NodeSnapshot)
+
+    // replace the file with these records, as of scsn
+    bool write(handle scsn, const vector<Record>& records);
+
+    // record the changes taking the file from its current SCSN to a new one
+    bool append(handle scsn, const vector<Record>& updated, const handle_vector& removed);
+
+    // add the records as of scsn to the index (not finalized).  False if the file doesn't have that state
+    bool read(handle scsn, CachedNodeIndex& index);
+
+    // delete the file
+    void remove();
+
+    // SCSN the file is at, UNDEF if it can't be appended to
+    handle scsn() const { return mScsn; }
+
+    // number of records of the last full list, and of the changes appended since
+    size_t records() const { return mRecords; }
+    size_t changes() const { return mChanges; }
+
+private:
+    bool store(const string& block, m_off_t offset, bool truncate);
+
+    FileSystemAccess& mFsAccess;
+    LocalPath mPath;
+
+    handle mScsn = UNDEF;
+
+    // where the next block of changes goes
+    m_off_t mEnd = 0;
+
+    size_t mRecords = 0;
+    size_t mChanges = 0;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,261 @@
+/**
+ * @file mega/nodestore.h
+ * @brief Hashed storage of the in-memory node tree
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#ifndef MEGA_NODESTORE_H
+#define MEGA_NODESTORE_H 1
+
+#include "types.h"
+
+namespace mega {
+
+// Hands out fixed-size blocks carved from large slabs.
+// Used for Node objects, which are allocated and freed by the million during fetchnodes/purgenodes, and for the
+// objects of the transfers that come and go all the time (see PooledAllocation).
+// All slabs are returned to the system once the last live block is released, but the first one if `keepOneSlab`.
+class MEGA_API FixedSizeAllocator
+{
+public:
+    // the bytes of the slabs are added to `account`, if any
+    FixedSizeAllocator(size_t objectSize, size_t objectsPerSlab, CodeCounter::Gauge* account = nullptr, bool keepOneSlab = false);
+    ~FixedSizeAllocator();
+
+    MEGA_DISABLE_COPY_MOVE(FixedSizeAllocator)
+
+    // where the slabs of every allocator come from, ::operator new/delete by default: an embedder may route them to
+    // its own arenas.  To be set before anything pooled is allocated
+    typedef void* (*AllocateFunction)(size_t size);
+    typedef void (*ReleaseFunction)(void* p, size_t size);
+    static void setSlabFunctions(AllocateFunction, ReleaseFunction);
+
+    void* allocate();
+    void deallocate(void* p);
+
+    // number of blocks currently handed out
+    size_t liveObjects() const;
+
+    // number of slabs currently held
+    size_t slabs() const;
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    void releaseSlabs(bool keepOne);
+
+    mutable std::mutex mMutex;
+    const size_t mObjectSize;
+    const size_t mObjectsPerSlab;
+    CodeCounter::Gauge* const mAccount;
+    const bool mKeepOneSlab;
+    vector<void*> mSlabs;
+    FreeBlock* mFreeList = nullptr;
+
+    // blocks of the most recent slab that have never been handed out
+    char* mBump = nullptr;
+    char* mBumpEnd = nullptr;
+
+    size_t mLive = 0;
+};
+
+// The objects of a class from a FixedSizeAllocator of their own, which keeps a slab of them between bursts.
+// The class declares
+//     static void* operator new(size_t size) { return PooledAllocation<T>::allocate(size); }
+//     static void operator delete(void* p, size_t size) { PooledAllocation<T>::deallocate(p, size); }
+// and anything derived from it with a different size goes to the general heap.
+template<class T, size_t ObjectsPerSlab = 64>
+struct PooledAllocation
+{
+    static FixedSizeAllocator& allocator()
+    {
+        // intentionally never destroyed, so objects outliving static destruction can still be freed
+        static FixedSizeAllocator* a = new FixedSizeAllocator(sizeof(T), ObjectsPerSlab, nullptr, true);
+        return *a;
+    }
+
+    static void* allocate(size_t size)
+    {
+        return size == sizeof(T) ? allocator().allocate() : ::operator new(size);
+    }
+
+    static void deallocate(void* p, size_t size)
+    {
+        if (size == sizeof(T))
+        {
+            allocator().deallocate(p);
+        }
+        else
+        {
+            ::operator delete(p);
+        }
+    }
+};
+
+// Maps node handles to Node pointers.
+// Open-addressed hash table (linear probing, backward-shift deletion) keyed on the 6-byte handle,
+// replacing the former std::map<NodeHandle, Node*>.
+// Iteration order is unspecified.  Iterators are invalidated by add() and erase().
+class MEGA_API NodeStore
+{
+public:
+    typedef std::pair<NodeHandle, Node*> value_type;
+
+    template<typename V>
+    class Iterator
+    {
+        V* mSlot = nullptr;
+        V* mEnd = nullptr;
+
+        void skipEmpty()
+        {
+            while (mSlot != mEnd && !mSlot->second)
+            {
+                ++mSlot;
+            }
+        }
+
+    public:
+        Iterator() = default;
+        Iterator(V* slot, V* end) : mSlot(slot), mEnd(end) { skipEmpty(); }
+
+        // allow iterator -> const_iterator
+        template<typename U>
+        Iterator(const Iterator<U>& other) : mSlot(other.slot()), mEnd(other.slotEnd()) {}
+
+        V& operator*() const { return *mSlot; }
+        V* operator->() const { return mSlot; }
+        Iterator& operator++() { ++mSlot; skipEmpty(); return *this; }
+        Iterator operator++(int) { Iterator i(*this); ++*this; return i; }
+
+        template<typename U>
+        bool operator==(const Iterator<U>& other) const { return mSlot == other.slot(); }
+        template<typename U>
+        bool operator!=(const Iterator<U>& other) const { return mSlot != other.slot(); }
+
+        V* slot() const { return mSlot; }
+        V* slotEnd() const { return mEnd; }
+    };
+
+    typedef Iterator<value_type> iterator;
+    typedef Iterator<const value_type> const_iterator;
+
+    NodeStore() = default;
+    ~NodeStore();
+    MEGA_DISABLE_COPY_MOVE(NodeStore)
+
+    // add or replace the node stored for this handle
+    void add(NodeHandle h, Node* n);
+
+    // returns the number of entries removed (0 or 1)
+    size_t erase(NodeHandle h);
+
+    iterator find(NodeHandle h);
+    const_iterator find(NodeHandle h) const;
+
+    size_t size() const { return mCount; }
+    bool empty() const { return !mCount; }
+
+    // drops all entries and releases the table
+    void clear();
+
+    // make room for at least n entries without rehashing
+    void reserve(size_t n);
+
+    iterator begin() { return iterator(slotsBegin(), slotsEnd()); }
+    iterator end() { return iterator(slotsEnd(), slotsEnd()); }
+    const_iterator begin() const { return const_iterator(slotsBegin(), slotsEnd()); }
+    const_iterator end() const { return const_iterator(slotsEnd(), slotsEnd()); }
+
+private:
+    // entries are empty when their Node* is null
+    vector<value_type> mSlots;
+    size_t mCount = 0;
+
+    static size_t hashOf(NodeHandle h);
+    size_t mask() const { return mSlots.size() - 1; }
+
+    // index of the slot holding h, or of the empty slot where it would go
+    size_t probe(NodeHandle h) const;
+
+    void rehash(size_t capacity);
+
+    value_type* slotsBegin() { return mSlots.empty() ? nullptr : &mSlots.front(); }
+    value_type* slotsEnd() { return slotsBegin() + mSlots.size(); }
+    const value_type* slotsBegin() const { return mSlots.empty() ? nullptr : &mSlots.front(); }
+    const value_type* slotsEnd() const { return slotsBegin() + mSlots.size(); }
+};
+
+// maps node handles to Node pointers
+typedef NodeStore node_map;
+
+// Where to find the node records of the local cache that have not been loaded into memory yet.
+// Built by MegaClient::fetchsc() when lazy node loading is enabled: only the record headers are
+// read at startup, and nodes are loaded by parent (or by handle, along with their ancestors) on first use.
+class MEGA_API CachedNodeIndex
+{
+public:
+    struct Record
+    {
+        handle h;
+        handle parent;
+        m_off_t size;
+        uint32_t dbid;
+        nodetype_t type;
+        bool loaded;
+    };
+
+    typedef vector<Record>::iterator iterator;
+
+    void add(handle h, handle parent, nodetype_t type, m_off_t size, uint32_t dbid);
+
+    // must be called once all records were added, before any lookup
+    void finalize();
+
+    Record* find(handle h);
+
+    // records of the children of a node
+    std::pair<iterator, iterator> children(handle parent);
+    bool hasChildren(handle parent) const;
+
+    // counts for everything below a node of the given type (not the node itself)
+    NodeCounter descendantCounts(handle h, nodetype_t type) const;
+
+    iterator begin() { return mByParent.begin(); }
+    iterator end() { return mByParent.end(); }
+
+    size_t size() const { return mByParent.size(); }
+    size_t loadedCount() const { return mLoaded; }
+    void markLoaded(Record& r);
+
+private:
+    // sorted by parent handle, so the children of a node are contiguous
+    vector<Record> mByParent;
+
+    // indices into mByParent, sorted by node handle
+    vector<uint32_t> mByHandle;
+
+    size_t mLoaded = 0;
+};
+
+} // namespace
+
+#endif
@@ -37,6 +37,7 @@
 
 #ifdef HAVE_AIO_RT
 #include <aio.h>
+#include <sys/uio.h>
 #endif
 
 #include "mega.h"
@@ -61,6 +62,8 @@ struct MEGA_API PosixDirAccess : public DirAccess
     virtual ~PosixDirAccess();
 };
 
+class PosixDirNotify;
+
 class MEGA_API PosixFileSystemAccess : public FileSystemAccess
 {
 public:
@@ -76,6 +79,29 @@ public:
     LocalNode* lastlocalnode;
     uint32_t lastcookie;
     string lastname;
+
+#ifdef HAVE_FANOTIFY
+    // filesystem-wide notifications, used instead of inotify for the syncs whose filesystem
+    // could be marked (needs Linux 5.9 and CAP_SYS_ADMIN): one mark per filesystem
+    // rather than one watch per folder
+    int fanotifyfd = -1;
+    bool fanotifytried = false;
+
+    // the folders of those syncs by filesystem id and file handle, as events report them
+    map<string, LocalNode*> fhnodes;
+
+    // the marked filesystems by device, with the number of syncs on them
+    struct FanotifyMark
+    {
+        LocalPath path;
+        unsigned syncs = 0;
+    };
+    map<dev_t, FanotifyMark> fanotifymarks;
+
+    bool fanotifyadd(PosixDirNotify&);
+    void fanotifyremove(dev_t);
+    bool fanotifyhandle(const LocalPath&, string& handle, int& mountid) const;
+#endif
 #endif
 
 #ifdef USE_IOS
@@ -93,6 +119,7 @@ public:
 #endif
 
     bool getlocalfstype(const LocalPath& path, FileSystemType& type) const override;
+    bool getdeviceid(const LocalPath& path, uint64_t& id) const override;
     bool issyncsupported(const LocalPath& localpathArg, bool& isnetwork, SyncError& syncError, SyncWarning& syncWarning);
 
     void tmpnamelocal(LocalPath&) const override;
@@ -140,7 +167,17 @@ struct MEGA_API PosixAsyncIOContext : public AsyncIOContext
     virtual void finish();
 
     struct aiocb *aiocb;
+
+#ifdef HAVE_IO_URING
+    // submitted to the io_uring instead of POSIX aio
+    bool mIoUring = false;
+    struct iovec mIov;
+#endif
 };
+
+#ifdef HAVE_IO_URING
+class PosixIoUring;
+#endif
 #endif
 
 class MEGA_API PosixFileAccess : public FileAccess
@@ -164,6 +201,7 @@ public:
     bool fwrite(const byte *, unsigned, m_off_t) override;
 
     bool ftruncate() override;
+    bool fpreallocate(m_off_t size) override;
 
     bool sysread(byte *, unsigned, m_off_t) override;
     bool sysstat(m_time_t*, m_off_t*) override;
@@ -184,6 +222,11 @@ public:
 protected:
     virtual AsyncIOContext* newasynccontext();
     static void asyncopfinished(union sigval sigev_value);
+
+#ifdef HAVE_IO_URING
+    // shared by all file accesses, null if io_uring isn't available
+    std::shared_ptr<PosixIoUring> mIoUring;
+#endif
 #endif
 
 private:
@@ -202,8 +245,26 @@ public:
 
     fsfp_t fsfingerprint() const override;
     bool fsstableids() const override;
+    size_t watchCount() const override;
+
+#ifdef USE_INOTIFY
+    // inotify watches held
+    size_t mWatches = 0;
+
+#ifdef HAVE_FANOTIFY
+    // the filesystem of this sync is marked for fanotify
+    bool mFanotify = false;
+    dev_t mFanotifyDevice = 0;
+    int mFanotifyMount = -1;
+    string mFanotifyFsid;
+
+    // the keys of the folders in fsaccess->fhnodes
+    map<LocalNode*, string> mHandles;
+#endif
+#endif
 
     PosixDirNotify(const LocalPath&, const LocalPath&, Sync* s);
+    ~PosixDirNotify();
 };
 #endif
 
@@ -91,6 +91,10 @@ protected:
     CURLM* curlm[3];
 
     CURLSH* curlsh;
+
+    // for the requests through a proxy, with the connections too: unlike those of the multi handles, they survive
+    // disconnect(), so the CONNECT tunnels to each server are reused instead of set up again after every reconnection
+    CURLSH* curlshproxy;
 #ifdef MEGA_USE_C_ARES
     ares_channel ares;
 #endif
@@ -108,6 +112,7 @@ protected:
     bool ipv6requestsenabled;
     std::queue<CurlHttpContext *> pendingrequests;
     std::map<string, CurlDNSEntry> dnscache;
+    bool dnscachechanged = false;
     int pkpErrors;
 
     void send_pending_requests();
@@ -193,6 +198,13 @@ protected:
     void closecurlevents(direction_t d);
     void processcurlevents(direction_t d);
     SockInfoMap curlsockets[3];
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    // kernel interest set (epoll / kqueue) of the cURL sockets of each channel, kept up to date
+    // from the socket callbacks: the waiter only watches its descriptor, and only ready sockets are processed
+    int socketnotifier[3];
+    static int opensocketnotifier();
+    void watchsocket(direction_t d, curl_socket_t s, int oldmode, int newmode);
+#endif
     m_time_t curltimeoutreset[3];
     bool arerequestspaused[3];
     int numconnections[3];
@@ -201,6 +213,10 @@ protected:
     m_off_t maxspeed[2];
     bool curlsocketsprocessed;
 
+    // HTTP/2 multiplexing for HTTPS requests
+    bool http2 = false;
+    void sethttp2options();
+
 public:
     void post(HttpReq*, const char* = 0, unsigned = 0) override;
     void cancel(HttpReq*) override;
@@ -233,6 +249,33 @@ public:
 
     bool cacheresolvedurls(const std::vector<string>& urls, std::vector<string>&& ips) override;
 
+    bool sethttp2(bool enable) override;
+
+    bool exportdnscache(string* data) override;
+    void importdnscache(const string& data) override;
+
+    // age after which exported addresses are not imported
+    static const m_time_t DNS_CACHE_IMPORT_TTL;
+
+    bool exporttlssessions(string* data) override;
+    void importtlssessions(const string& data) override;
+
+    // HTTP/2 streams in flight per connection, beyond that cURL opens another one
+    static const long HTTP2_MAX_STREAMS;
+
+    // completed requests, and the connections (TCP + TLS handshakes) cURL opened for them, per channel
+    uint64_t requestsDone[3] = {};
+    uint64_t connectionsOpened[3] = {};
+
+    // TLS handshakes of those connections per host, and the time they took
+    struct TlsHandshakes
+    {
+        uint64_t count = 0;
+        int64_t totalus = 0;
+        int64_t maxus = 0;
+    };
+    std::map<string, TlsHandshakes> tlshandshakes;
+
     CurlHttpIO();
     ~CurlHttpIO();
 
@@ -240,6 +283,15 @@ public:
     HANDLE mSocketsWaitEvent;
 #endif
 
+    // for MegaClient::PerformanceStats
+    const CodeCounter::ScopeStats& addeventsStats() const { return countCurlHttpIOAddevents; }
+    const CodeCounter::ScopeStats& addCurlEventsStats() const { return countAddCurlEventsCode; }
+    const CodeCounter::ScopeStats& processCurlEventsStats() const { return countProcessCurlEventsCode; }
+#ifdef MEGA_USE_C_ARES
+    const CodeCounter::ScopeStats& addAresEventsStats() const { return countAddAresEventsCode; }
+    const CodeCounter::ScopeStats& processAresEventsStats() const { return countProcessAresEventsCode; }
+#endif
+
 private:
     static int instanceCount;
 
@@ -274,6 +326,11 @@ struct MEGA_API CurlHttpContext
 #ifdef MEGA_USE_C_ARES
     int ares_pending;
 #endif
+
+    // both addresses of the host, for cURL to race (CURLOPT_RESOLVE)
+    struct curl_slist* resolve = nullptr;
+
+    ~CurlHttpContext() { curl_slist_free_all(resolve); }
 };
 
 struct MEGA_API CurlDNSEntry
@@ -109,6 +109,10 @@
 
 #ifdef USE_INOTIFY
     #include <sys/inotify.h>
+#ifdef HAVE_FANOTIFY
+    #include <sys/fanotify.h>
+    #include <sys/vfs.h>
+#endif
 #endif
 
 #include <sys/select.h>
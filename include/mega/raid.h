@@ -31,6 +31,21 @@ namespace mega {
     enum { RAIDSECTOR = 16 };
     enum { RAIDLINE = ((RAIDPARTS - 1)*RAIDSECTOR) };
 
+    // Interleaves full raid lines from the parts into file data: sector i of parts 1-5 makes raid line i.
+    // At most one of the data parts may be missing (null), it is then recovered by xoring the others with the parity (part 0).
+    // SSE2/NEON versions are used where the build targets them, and an AVX2 one if the CPU supports it.
+    struct MEGA_API RaidLineCombiner
+    {
+        typedef void (*Function)(byte* dest, const byte* const inputs[RAIDPARTS], size_t lines);
+
+        // the fastest implementation this CPU can run
+        static void combine(byte* dest, const byte* const inputs[RAIDPARTS], size_t lines);
+        static const char* name();
+
+        // all implementations this CPU can run, the scalar one first (for tests and benchmarks)
+        static std::vector<std::pair<const char*, Function>> implementations();
+    };
+
 
     // Holds the latest download data received.   Raid-aware.   Suitable for file transfers, or direct streaming.
     // For non-raid files, supplies the received buffer back to the same connection for writing to file (having decrypted and mac'd it),
@@ -58,6 +73,9 @@ namespace mega {
             // decrypt & mac
             bool finalize(bool parallel, m_off_t filesize, int64_t ctriv, SymmCipher *cipher, chunkmac_map* source_chunkmacs);
 
+            // one per piece downloaded: pooled, the buffers are not
+            static void* operator new(size_t size) { return PooledAllocation<FilePiece>::allocate(size); }
+            static void operator delete(void* p, size_t size) { PooledAllocation<FilePiece>::deallocate(p, size); }
         };
 
         // call this before starting a transfer. Extracts the vector content
@@ -114,6 +132,12 @@ namespace mega {
         // returns how far we are through the file on average, including uncombined data
         m_off_t progress() const;
 
+        // bytes of downloaded data held until it is combined or written
+        m_off_t bufferedBytes() const;
+
+        // whether the other parts wait for this one before their data can be combined (and released)
+        bool isRaidPartBehind(unsigned connectionNum) const;
+
         RaidBufferManager();
         ~RaidBufferManager();
 
@@ -176,7 +200,6 @@ namespace mega {
         // take raid input part buffers and combine to form the asyncoutputbuffers
         void combineRaidParts(unsigned connectionNum);
         FilePiece* combineRaidParts(size_t partslen, size_t bufflen, m_off_t filepos, FilePiece& prevleftoverchunk);
-        void recoverSectorFromParity(byte* dest, byte* inputbufs[], unsigned offset);
         void combineLastRaidLine(byte* dest, size_t nbytes);
         void rollInputBuffers(size_t dataToDiscard);
         virtual void bufferWriteCompletedAction(FilePiece& r);
@@ -190,6 +213,31 @@ namespace mega {
     };
 
 
+    // Budget for the transfer data that all the slots of a client hold in memory: downloaded data until
+    // it is decrypted, combined and written, and file data until it is uploaded.  Slots report what they
+    // hold, and don't start requests while the pool is used up (except those needed to make progress).
+    class MEGA_API TransferBufferPool
+    {
+    public:
+        // 0 for no limit
+        void setLimit(m_off_t limit) { mLimit = limit > 0 ? limit : 0; }
+        m_off_t limit() const { return mLimit; }
+
+        m_off_t used() const { return mUsed; }
+        bool exhausted() const { return mLimit && mUsed >= mLimit; }
+
+        // change in the bytes held by a slot
+        void adjust(m_off_t delta) { mUsed += delta; assert(mUsed >= 0); mUsage.set(mUsed); }
+
+        // bytes held, and the most held at once
+        const CodeCounter::Gauge& usage() const { return mUsage; }
+
+    private:
+        m_off_t mLimit = 0;
+        m_off_t mUsed = 0;
+        CodeCounter::Gauge mUsage;
+    };
+
     class MEGA_API TransferBufferManager : public RaidBufferManager
     {
     public:
@@ -200,7 +248,7 @@ namespace mega {
         m_off_t& transferPos(unsigned connectionNum) override;
 
         // Get the file position to upload/download to on the specified connection
-        std::pair<m_off_t, m_off_t> nextNPosForConnection(unsigned connectionNum, m_off_t maxDownloadRequestSize, unsigned connectionCount, bool& newBufferSupplied, bool& pauseConnectionForRaid, m_off_t uploadspeed);
+        std::pair<m_off_t, m_off_t> nextNPosForConnection(unsigned connectionNum, m_off_t maxRequestSize, unsigned connectionCount, bool& newBufferSupplied, bool& pauseConnectionForRaid, m_off_t uploadspeed);
 
         TransferBufferManager();
 
@@ -36,9 +36,15 @@ private:
     JSON json;
     size_t processindex = 0;
 
+    // how far back add() looks for a command the new one makes redundant
+    static const int MAX_COALESCE_SCAN = 100;
+
 public:
     void add(Command*);
 
+    // drop an earlier command the new one makes redundant (see Command::coalescing) and let the new one complete it
+    bool coalesce(Command*);
+
     size_t size() const;
 
     void get(string*, bool& suppressSID) const;
@@ -67,12 +73,29 @@ class MEGA_API RequestDispatcher
     // client-server request double-buffering, in batches of up to MAX_COMMANDS
     deque<Request> nextreqs;
 
+    // the same for the background commands, sent once nextreqs is empty: the other commands go ahead of them, but
+    // never the other way around
+    deque<Request> backgroundreqs;
+
     // flags for dealing with resetting everything from a command in progress
     bool processing = false;
     bool clearWhenSafe = false;
 
     static const int MAX_COMMANDS = 10000;
 
+    // order-independent commands waiting for a parallel batch, and the parallel batches in flight by id
+    Request parallelnext;
+    map<int, Request> parallelinflight;
+    int nextparallelid = 0;
+
+    // maximum number of cs requests in flight, the ordered one included
+    unsigned maxinflight = 1;
+
+    // the buffers of sent batches, reused for the next ones so large batches are not reallocated every time
+    vector<string> sparebuffers;
+    static const size_t MAX_SPARE_BUFFERS = 4;
+    void takebuffer(string*);
+
 public:
     RequestDispatcher();
 
@@ -81,6 +104,9 @@ public:
 
     bool cmdspending() const;
 
+    // batches waiting to be sent in order
+    size_t queuedbatches() const;
+
     /**
      * @brief get the set of commands to be sent to the server (could be a retry)
      * @param suppressSID
@@ -95,14 +121,34 @@ public:
 
     void clear();
 
+    // hand back the buffer of a batch whose response has been received
+    void recyclebuffer(string&&);
+
+    // free the buffers kept for the next responses, returns the bytes released
+    size_t trimbuffers();
+
+    // allow up to `n` cs requests in flight: the ordered one plus n - 1 batches of order-independent commands
+    void setmaxinflight(unsigned n);
+
+    // whether a parallel batch can be sent, given the number already in flight
+    bool parallelready() const;
+
+    // get a parallel batch to be sent, returns its id
+    int parallelrequest(string*, bool& suppressSID);
+
+    // the response of a parallel batch: processed as soon as it arrives, or sent again in the ordered queue
+    void parallelresponse(int id, string&& movestring, MegaClient*);
+    void parallelrequeue(int id);
+
 #ifdef MEGA_MEASURE_CODE
     Request deferredRequests;
     std::function<bool(Command*)> deferRequests;
     void sendDeferred();
-    uint64_t csRequestsSent = 0, csRequestsCompleted = 0;
-    uint64_t csBatchesSent = 0, csBatchesReceived = 0;
 #endif
 
+    std::atomic<uint64_t> csRequestsSent{0}, csRequestsCompleted{0};
+    std::atomic<uint64_t> csBatchesSent{0}, csBatchesReceived{0};
+
 };
 
 } // namespace
@@ -0,0 +1,143 @@
+/**
+ * @file mega/scanservice.h
+ * @brief Lists local folders on a pool of threads
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#ifndef MEGA_SCANSERVICE_H
+#define MEGA_SCANSERVICE_H 1
+
+#ifdef ENABLE_SYNC
+
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+#include "filesystem.h"
+#include "waiter.h"
+
+namespace mega {
+
+// Lists local folders on a pool of threads, each with a FileSystemAccess of its own. A listed folder comes
+// back as one batch of its entries, already opened, so the SDK thread only has to reconcile them with its
+// LocalNodes (files are read by the FingerprintService). The SDK thread decides which subfolders to walk next, once their
+// LocalNodes (and filesystem notifications) exist. Folders are queued on the threads in turn, and an idle
+// thread takes the oldest folder queued on a busy one.
+class MEGA_API ScanService
+{
+public:
+    // an entry of a listed folder
+    struct FSNode
+    {
+        LocalPath localname;
+        std::unique_ptr<LocalPath> shortname;
+        nodetype_t type = TYPE_UNKNOWN;
+        handle fsid = UNDEF;
+        bool fsidvalid = false;
+        bool isSymlink = false;
+
+        // it couldn't be opened (eg. it's locked)
+        bool failed = false;
+    };
+
+    struct Batch
+    {
+        // full path of the folder
+        LocalPath path;
+
+        // it couldn't be listed
+        bool failed = false;
+
+        vector<FSNode> entries;
+    };
+
+    // the folders of one tree, queued by scan() and collected by next()
+    class MEGA_API Walk : public std::enable_shared_from_this<Walk>
+    {
+    public:
+        // list this folder (its subfolders are only listed if they are passed to scan() as well)
+        void scan(const LocalPath& path);
+
+        // the next listed folder, if any
+        bool next(Batch&);
+
+        // nothing is queued, being listed or waiting to be collected
+        bool done();
+
+        // drop the folders not listed yet, eg. the sync is going away
+        void cancel();
+
+        Walk(ScanService&, bool followSymlinks);
+
+    private:
+        friend class ScanService;
+
+        ScanService& mService;
+        const bool mFollowSymlinks;
+        std::atomic<bool> mCancelled;
+
+        std::mutex mMutex;
+        std::deque<Batch> mBatches;
+        size_t mPending = 0;
+    };
+
+    std::shared_ptr<Walk> walk(bool followSymlinks);
+
+    size_t threads() const { return mRunning; }
+
+    ScanService(Waiter&, unsigned threadCount);
+    ~ScanService();
+
+private:
+    struct Task
+    {
+        std::shared_ptr<Walk> walk;
+        LocalPath path;
+    };
+
+    struct Worker
+    {
+        std::mutex mMutex;
+        std::deque<Task> mTasks;
+        std::thread mThread;
+    };
+
+    void queue(Task&&);
+
+    // the newest task of this worker, or the oldest one of another
+    bool take(size_t self, Task&);
+
+    void loop(size_t self);
+    void list(FileSystemAccess&, Task&);
+
+    Waiter& mWaiter;
+    vector<unique_ptr<Worker>> mWorkers;
+    std::atomic<size_t> mRunning{0};
+    size_t mNextWorker = 0;
+
+    // tasks queued on all the workers, the idle ones wait for it to be nonzero
+    std::mutex mIdleMutex;
+    std::condition_variable mIdle;
+    size_t mQueued = 0;
+    bool mExit = false;
+};
+
+} // namespace
+
+#endif
+#endif
@@ -0,0 +1,84 @@
+/**
+ * @file mega/screcorder.h
+ * @brief Recording of the action packets received, to replay them offline
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#ifndef MEGA_SCRECORDER_H
+#define MEGA_SCRECORDER_H 1
+
+#include "filesystem.h"
+
+namespace mega {
+
+// Writes the sc responses received to a file that tool_sc_replay feeds to an offline client.
+// The first response is preceded by what is needed to apply them: the account key, the user
+// handle, the SCSN and the cache records of the users, nodes and pending contact requests
+// (node keys included), so the file must be handled as a credential.  Lines, in this order:
+//
+//   mega-sc-recording 1
+//   me:<user handle>                                   (base64, as are the key and the records)
+//   k:<master key>
+//   sn:<scsn>
+//   u:<user record>, n:<node record>, p:<pcr record>   (one line each)
+//   sc:<response, as received>                         (one line each)
+//
+// A response that fails (or is interrupted while being streamed) is dropped: its retry has the
+// same packets.
+class MEGA_API ScRecorder
+{
+public:
+    ScRecorder(FileSystemAccess& fsAccess, const LocalPath& path);
+
+    MEGA_DISABLE_COPY_MOVE(ScRecorder)
+
+    static const char* const HEADER;
+
+    // a response starts, dropping the one that didn't end (it failed).  Called between responses, when
+    // the state of the client is that of its SCSN
+    void begin(MegaClient& client);
+
+    // the next bytes of the response
+    void append(const char* data, size_t size);
+
+    // the response was received in full: written to the file
+    void end();
+
+    bool failed() const { return mFailed; }
+    size_t responses() const { return mResponses; }
+
+private:
+    bool write(const string& data);
+    void writeState(MegaClient& client);
+
+    FileSystemAccess& mFsAccess;
+    LocalPath mPath;
+    unique_ptr<FileAccess> mFile;
+    m_off_t mEnd = 0;
+    bool mFailed = false;
+
+    // the response being received
+    bool mInResponse = false;
+    string mResponse;
+
+    size_t mResponses = 0;
+};
+
+} // namespace
+
+#endif
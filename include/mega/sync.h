@@ -23,6 +23,8 @@
 #define MEGA_SYNC_H 1
 
 #include "db.h"
+#include "fingerprintservice.h"
+#include "scanservice.h"
 
 #ifdef ENABLE_SYNC
 
@@ -213,6 +215,29 @@ private:
 using SyncCompletionFunction =
   std::function<void(UnifiedSync*, const SyncError&, error)>;
 
+// throughput and lag figures of a running sync, see Sync::stats()
+struct SyncStats
+{
+    // notifications waiting, by DirNotify queue
+    size_t queued[DirNotify::NUMQUEUES] = {};
+
+    // when syncdown() last went through the whole tree (0 if it didn't yet)
+    m_time_t lastFullReconcile = 0;
+
+    // files checked by the scans and notifications, and how many per second of that work
+    uint64_t scannedFiles = 0;
+    double scannedFilesPerSecond = 0;
+
+    // bytes of the uploads not sent yet, and local nodes waiting for their cloud node to be created
+    m_off_t pendingUploadBytes = 0;
+    size_t pendingPutnodes = 0;
+
+    // milliseconds from a local change being noticed to its cloud node existing, over the latest changes
+    size_t latencySamples = 0;
+    m_time_t latencyP50 = 0;
+    m_time_t latencyP99 = 0;
+};
+
 class MEGA_API Sync
 {
 public:
@@ -293,7 +318,22 @@ public:
 
     // scan items in specified path and add as children of the specified
     // LocalNode
-    bool scan(LocalPath*, FileAccess*);
+    // during the initial scan, the folder's scanmtime is updated after listing it
+    bool scan(LocalPath*, FileAccess*, LocalNode* folder = nullptr);
+
+    // checks the cached children of a folder unchanged since its last scan, instead of listing it
+    // (only while resuming from the cache)
+    bool resumescan(LocalNode* folder, LocalPath&, FileAccess*);
+
+    // initial scan of a sync without cached LocalNodes, its folders are listed on the scan threads
+    std::shared_ptr<ScanService::Walk> mWalk;
+
+    // files found by the walk, being fingerprinted
+    std::deque<std::shared_ptr<FingerprintService::Job>> mFingerprints;
+
+    // creates the LocalNodes of the folders listed and files fingerprinted so far, queues the subfolders
+    // returns false if the time slice ran out with results still waiting
+    bool procwalk();
 
     // rescan sequence number (incremented when a full rescan or a new
     // notification batch starts)
@@ -315,6 +355,18 @@ public:
     // get progress for heartbeats
     m_off_t getInflightProgress();
 
+    SyncStats stats();
+
+    // a local change made it to the cloud after this long
+    void addLatency(dstime);
+
+    // figures for stats()
+    m_time_t mLastFullReconcile = 0;
+    uint64_t mScannedFiles = 0;
+    std::chrono::steady_clock::duration mScanTime{};
+    vector<dstime> mLatencies;
+    size_t mNextLatency = 0;
+
     // original filesystem fingerprint
     fsfp_t fsfp = 0;
 
@@ -332,6 +384,9 @@ public:
     m_time_t updatedfilets = 0;
     m_time_t updatedfileinitialts = 0;
 
+    // filesystem notifications received when their counts were last logged
+    uint64_t mLoggedNotifications = 0;
+
     bool updateSyncRemoteLocation(Node* n, bool forceCallback);
 
     // flag to optimize destruction by skipping calls to treestate()
@@ -344,6 +399,7 @@ public:
 
     static const int SCANNING_DELAY_DS;
     static const int EXTRA_SCANNING_DELAY_DS;
+    static const int SCANNING_BUDGET_MS;
     static const int FILE_UPDATE_DELAY_DS;
     static const int FILE_UPDATE_MAX_DELAY_SECS;
     static const dstime RECENT_VERSION_INTERVAL_SECS;
@@ -397,6 +453,13 @@ public:
     // Whether any config data has changed and needs to be written to disk
     bool dirty() const;
 
+    // Changes are written some time after the first of them, for a burst of them (syncs
+    // flipping state as the network comes and goes) to be written at once.
+    static const dstime FLUSH_DELAY = 30;
+
+    // When the changes are due to be written, NEVER if there are none.
+    dstime flushDue() const;
+
     // Reads a database from disk.
     error read(const LocalPath& drivePath, SyncConfigVector& configs);
 
@@ -429,6 +492,9 @@ private:
         unsigned int slot = 0;
 
         bool dirty = false;
+
+        // What was last written, not to write it again when the changes cancel out.
+        string written;
     }; // DriveInfo
 
     using DriveInfoMap = map<LocalPath, DriveInfo, DrivePathComparator>;
@@ -448,6 +514,9 @@ private:
     // What drives are known to the store.
     DriveInfoMap mKnownDrives;
 
+    // When the first of the changes not yet written was made.
+    dstime mDirtySince = 0;
+
     // IO context used to read and write from disk.
     SyncConfigIOContext& mIOContext;
 }; // SyncConfigStore
@@ -553,6 +622,10 @@ struct Syncs
     void forEachUnifiedSync(std::function<void(UnifiedSync&)> f);
     void forEachRunningSync(std::function<void(Sync* s)>);
     bool forEachRunningSync_shortcircuit(std::function<bool(Sync* s)>);
+
+    // like forEachRunningSync_shortcircuit, starting each call one sync further, so a sync that stops
+    // the loop (or takes long) doesn't keep the ones after it waiting
+    bool forEachRunningSync_roundrobin(std::function<bool(Sync* s)>);
     void forEachRunningSyncContainingNode(Node* node, std::function<void(Sync* s)> f);
     void forEachSyncConfig(std::function<void(const SyncConfig&)>);
 
@@ -658,6 +731,9 @@ struct Syncs
     // Attempts to flush the internal configuration database to disk.
     bool syncConfigStoreFlush();
 
+    // When the changes to the configuration database are due to be flushed, NEVER if there are none.
+    dstime syncConfigStoreFlushDue();
+
     // Load internal sync configs from disk.
     error syncConfigStoreLoad(SyncConfigVector& configs);
 
@@ -683,6 +759,9 @@ private:
 
     vector<unique_ptr<UnifiedSync>> mSyncVec;
 
+    // where forEachRunningSync_roundrobin() starts next
+    size_t mNextRoundRobin = 0;
+
     // remove the Sync and its config (also unregister in API). The sync's Localnode cache is removed
     void removeSyncByIndex(size_t index);
 
@@ -23,6 +23,8 @@
 #define MEGA_TESTHOOKS_H 1
 
 #include "types.h"
+#include "http.h"
+#include <deque>
 #include <functional>
 
 
@@ -64,6 +66,45 @@ namespace mega {
     #define DEBUG_TEST_HOOK_RAIDBUFFERMANAGER_SETISRAID(x)
 #endif
 
+    // Deterministic stepping of a MegaClient, in any build: an HttpIO that never touches the network,
+    // answering each request from a function at the next doio().  Together with Waiter::manualclock,
+    // a test or benchmark calls exec() itself and every iteration does the same work on every run:
+    //
+    //     Waiter::manualclock = true;
+    //     ScriptedHttpIO httpio([](const HttpReq& req, const string& body, string& response) { response = "[0]"; return 200; });
+    //     MegaClient client(&app, nullptr, &httpio, ...);
+    //     client.exec(); Waiter::advanceds(1); ...
+    class MEGA_API ScriptedHttpIO : public HttpIO
+    {
+    public:
+        // fills the response to a request and returns its HTTP status, or 0 to leave it pending
+        using Responder = std::function<int(const HttpReq& req, const string& body, string& response)>;
+
+        explicit ScriptedHttpIO(Responder responder);
+
+        void post(HttpReq*, const char* = NULL, unsigned = 0) override;
+        void cancel(HttpReq*) override;
+        m_off_t postpos(void*) override;
+        bool doio() override;
+        void addevents(Waiter*, int) override { }
+        void setuseragent(string*) override { }
+
+        // requests waiting for an answer, and answered so far
+        size_t pending() const { return mPending.size(); }
+        size_t answered() const { return mAnswered; }
+
+    private:
+        struct Request
+        {
+            HttpReq* req;
+            string body;
+        };
+
+        Responder mResponder;
+        std::deque<Request> mPending;
+        size_t mAnswered = 0;
+    };
+
 
 } // namespace
 
@@ -0,0 +1,162 @@
+/**
+ * @file mega/trace.h
+ * @brief Compact binary trace of timed events
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#ifndef MEGA_TRACE_H
+#define MEGA_TRACE_H 1
+
+#include <array>
+#include <atomic>
+
+#include "types.h"
+
+namespace mega {
+
+// subsystems that can be traced and sampled independently
+enum TraceSubsystem
+{
+    TRACE_HTTP = 0,
+    TRACE_TRANSFER,
+    TRACE_GFX,
+    TRACE_NUM_SUBSYSTEMS
+};
+
+// the subsystem is the high byte of each event id (keep contrib/tools/trace2chrome.py in step)
+enum TraceEventId : uint16_t
+{
+    TRACE_HTTP_REQUEST = TRACE_HTTP << 8,           // handle: trace id of the transfer (see TraceId) or UNDEF, size: bytes sent and received
+    TRACE_HTTP_FAILURE,
+
+    TRACE_TRANSFER_DOWNLOAD_CHUNK = TRACE_TRANSFER << 8,  // handle: node, size: chunk
+    TRACE_TRANSFER_UPLOAD_CHUNK,                          // handle: upload handle, size: chunk
+
+    TRACE_GFX_JOB = TRACE_GFX << 8,                 // handle: node or upload handle, size: attributes
+};
+
+// one fixed-size record per event, after a header with TRACE_MAGIC and the start time
+// (microseconds since the epoch, 8 bytes), all of it in the native byte order
+struct TraceRecord
+{
+    uint64_t timestamp;     // microseconds since the start of the trace, at the end of the event
+    uint64_t handle;        // UNDEF if not related to a node or upload
+    uint64_t size;
+    uint32_t duration;      // microseconds
+    uint16_t event;
+    uint16_t thread;        // small id, in order of first event per thread
+};
+
+// Events are cheap to skip: a relaxed load of the mask while the subsystem is off.
+// Enabled ones are sampled per subsystem and buffered, to be written in batches.
+class MEGA_API Trace
+{
+public:
+    static const char TRACE_MAGIC[8];
+
+    // start writing events of the subsystems in the mask (bit per TraceSubsystem) to a new file
+    static bool start(const string& path, uint32_t subsystems);
+
+    // write the buffered events and close the file
+    static void stop();
+
+    static void setSubsystems(uint32_t subsystems);
+
+    // record one event out of every oneIn for the subsystem (1 to record them all)
+    static void setSampling(TraceSubsystem subsystem, unsigned oneIn);
+
+    static bool enabled(TraceSubsystem subsystem)
+    {
+        return mSubsystems.load(std::memory_order_relaxed) & (1u << subsystem);
+    }
+
+    // event ending now, started at `started`
+    static void record(TraceEventId event, handle h, uint64_t size, std::chrono::steady_clock::time_point started);
+
+private:
+    static std::atomic<uint32_t> mSubsystems;
+    static std::atomic<unsigned> mSampling[TRACE_NUM_SUBSYSTEMS];
+    static std::atomic<unsigned> mSampleCounters[TRACE_NUM_SUBSYSTEMS];
+};
+
+#define TRACE_EVENT(subsystem, event, h, size, started) \
+    if (!::mega::Trace::enabled(subsystem)) ;\
+    else \
+        ::mega::Trace::record(event, h, size, started)
+
+// Identifies the work done for one transfer or request across the objects that take part in it: the Transfer,
+// its TransferSlot and chunk HttpReqs, and the Commands sent on its behalf. 0 means none.
+// Objects take the id of the TraceScope in effect on their thread when they are created.
+typedef uint64_t TraceId;
+
+// random and never 0
+MEGA_API TraceId newTraceId();
+
+class MEGA_API TraceScope
+{
+public:
+    explicit TraceScope(TraceId id);
+    ~TraceScope();
+
+    MEGA_DISABLE_COPY_MOVE(TraceScope)
+
+    // id of the innermost scope on this thread, 0 outside all of them
+    static TraceId current();
+
+private:
+    TraceId mPrevious;
+};
+
+// the milestones of a transfer, in the order they are normally reached (keep MegaTransfer::STAGE_* in step)
+enum TraceStage
+{
+    STAGE_QUEUED = 0,
+    STAGE_SLOT_ACQUIRED,
+    STAGE_FIRST_BYTE,
+    STAGE_LAST_BYTE,
+    STAGE_MAC_VERIFIED,         // downloads only
+    STAGE_PUTNODES_SENT,        // uploads only
+    STAGE_PUTNODES_ACKED,       // uploads only
+    STAGE_CALLBACK,
+    STAGE_COUNT
+};
+
+// when each stage was reached, in microseconds since the epoch (0 if not yet)
+struct MEGA_API TraceStages
+{
+    std::array<int64_t, STAGE_COUNT> times = {};
+
+    // the first time only: retries don't move a stage that was reached already
+    void mark(TraceStage stage);
+
+    // every time: eg. the last byte moves with each chunk
+    void update(TraceStage stage);
+
+    // take the stages reached in `other` (eg. the engine's Transfer) that this one doesn't have
+    void merge(const TraceStages& other);
+
+    static const char* name(TraceStage stage);
+
+    // OTLP/JSON (OpenTelemetry): a root span named `rootName` from the first stage to the last one reached,
+    // with a child span from each stage reached to the next one
+    string toOtlpJson(TraceId id, const string& rootName) const;
+};
+
+} // namespace
+
+#endif
@@ -27,6 +27,7 @@
 #include "http.h"
 #include "command.h"
 #include "raid.h"
+#include "fingerprintservice.h"
 
 namespace mega {
 
@@ -80,8 +81,8 @@ struct MEGA_API Transfer : public FileFingerprint
     // file crypto key and shared cipher
     std::array<byte, SymmCipher::KEYLENGTH> transferkey;
 
-    // returns a pointer to MegaClient::tmptransfercipher setting its key to the transfer
-    // tmptransfercipher key will change: to be used right away: this is not a dedicated SymmCipher for this transfer!
+    // returns a pointer to a cipher of MegaClient::tmptransferciphers with the key of the transfer
+    // it will be reused for another key: to be used right away: this is not a dedicated SymmCipher for this transfer!
     SymmCipher *transfercipher();
 
     chunkmac_map chunkmacs;
@@ -127,6 +128,10 @@ struct MEGA_API Transfer : public FileFingerprint
     // downloads can have 6 for raid, 1 for non-raid.  Uploads always have 1
     std::vector<string> tempurls;
 
+    // downloads: the pending request of the temp URLs ahead of a slot, and when they arrived (not persisted)
+    uint64_t tempurlsprefetch = 0;
+    dstime tempurlsprefetched = 0;
+
     // context of the async fopen operation
     AsyncIOContext* asyncopencontext;
 
@@ -141,6 +146,13 @@ struct MEGA_API Transfer : public FileFingerprint
 
     bool skipserialization;
 
+    // follows the transfer through its slot, chunk requests and the putnodes of its files (not persisted)
+    TraceId traceId;
+    TraceStages stages;
+
+    // uploads of large files: the chunks of the local file, being indexed (not persisted)
+    std::shared_ptr<FingerprintService::Job> chunkIndexJob;
+
     Transfer(MegaClient*, direction_t);
     virtual ~Transfer();
 
@@ -153,6 +165,9 @@ struct MEGA_API Transfer : public FileFingerprint
     // examine a file on disk for video/audio attributes to attach to the file, on upload/download
     void addAnyMissingMediaFileAttributes(Node* node, LocalPath& localpath);
 
+    // the share of the bandwidth of its requests: that of a sync if it's for one
+    bwclass_t bandwidthclass() const;
+
     // whether the Transfer needs to remove itself from the list it's in (for quick shutdown we can skip)
     bool mOptimizedDelete = false;
 };
@@ -205,11 +220,21 @@ public:
 	                                               std::function<bool(direction_t)>& directionContinuefunction);
     Transfer *transferat(direction_t direction, unsigned int position);
 
+    // drops all the transfers of both directions
+    void clear();
+
     std::array<transfer_list, 2> transfers;
     MegaClient *client;
     uint64_t currentpriority;
 
 private:
+    // the transfers of each category (TransferCategory::index()) by priority, so that nexttransfers() goes
+    // through those of the categories that can take more, and stops as soon as none can
+    std::array<std::map<uint64_t, Transfer*>, 6> mByCategory;
+
+    void index(Transfer *transfer);
+    void unindex(Transfer *transfer);
+
     void prepareIncreasePriority(Transfer *transfer, transfer_list::iterator srcit, transfer_list::iterator dstit, DBTableTransactionCommitter& committer);
     void prepareDecreasePriority(Transfer *transfer, transfer_list::iterator it, transfer_list::iterator dstit);
     bool isReady(Transfer *transfer);
@@ -233,6 +258,9 @@ struct MEGA_API DirectReadSlot
     m_off_t speed;
     m_off_t meanSpeed;
 
+    // when the first request was sent, until its first byte arrives (0 otherwise), to measure the latency
+    dstime rttstart = 0;
+
     bool doio();
 
     DirectReadSlot(DirectRead*);
@@ -243,6 +271,70 @@ private:
     bool processAnyOutputPieces();
 };
 
+// Decrypted data of a file being streamed, shared by all the reads of its DirectReadNode, so that
+// overlapping or repeated reads (a player seeking back, two clients playing the same file) aren't
+// downloaded again. The data is kept in aligned blocks. When the memory limit is reached, the least
+// recently used ones are moved to a spill file (if there is one, up to its own limit) or dropped.
+class MEGA_API DirectReadCache
+{
+public:
+    static const m_off_t BLOCK_SIZE = 256 * 1024;
+
+    // maxMemory == 0 disables the cache. If spillPath isn't empty, the blocks evicted from memory go
+    // to that file (deleted with the cache), up to maxSpill bytes
+    void configure(m_off_t fileSize, size_t maxMemory, FileSystemAccess* fsaccess, const LocalPath& spillPath, m_off_t maxSpill);
+    bool configured() const { return mFileSize >= 0; }
+
+    // bytes that can be kept, in memory and spilled
+    m_off_t capacity() const { return mMaxMemory ? m_off_t(mMaxMemory) + mMaxSpill : 0; }
+
+    // decrypted data, as it is read: it fills the blocks it covers, from their start
+    void store(m_off_t pos, const byte* data, size_t len);
+
+    // the data cached from pos up to the end of its block, maxLen bytes at most
+    bool load(m_off_t pos, m_off_t maxLen, string& data);
+
+    // number of bytes cached from pos without a gap, up to maxLen
+    m_off_t cached(m_off_t pos, m_off_t maxLen) const;
+
+    size_t memoryUsed() const { return mMemoryUsed; }
+    m_off_t spillUsed() const { return mSpillUsed; }
+
+    // evict the least recently used blocks until keep bytes at most are left in memory, returns the bytes released
+    size_t trim(size_t keep);
+
+    ~DirectReadCache();
+
+private:
+    struct Block
+    {
+        // in memory, unless spilled.  Only the start of the block while it's being filled
+        string data;
+        bool complete = false;
+        bool spilled = false;
+        std::list<m_off_t>::iterator lru;
+    };
+
+    m_off_t blockEnd(m_off_t start) const;
+    void evict(size_t maxMemory);
+    bool spill(m_off_t start, Block&);
+
+    m_off_t mFileSize = -1;
+    size_t mMaxMemory = 0;
+    size_t mMemoryUsed = 0;
+    m_off_t mMaxSpill = 0;
+    m_off_t mSpillUsed = 0;
+
+    std::map<m_off_t, Block> mBlocks;
+
+    // the blocks in memory, least recently used first
+    std::list<m_off_t> mLru;
+
+    FileSystemAccess* mFsAccess = nullptr;
+    LocalPath mSpillPath;
+    std::unique_ptr<FileAccess> mSpill;
+};
+
 struct MEGA_API DirectRead
 {
     m_off_t count;
@@ -250,6 +342,9 @@ struct MEGA_API DirectRead
     m_off_t progress;
     m_off_t nextrequestpos;
 
+    // started by the DirectReadNode to fill its cache, not by the app
+    bool readahead = false;
+
     DirectReadBufferManager drbuf;
 
     DirectReadNode* drn;
@@ -291,6 +386,23 @@ struct MEGA_API DirectReadNode
 
     dr_list reads;
 
+    DirectReadCache cache;
+
+    // where the last read of the app stopped, to detect sequential reads
+    m_off_t lastreadend = -1;
+
+    // reads ahead in flight at once, so that the next one is requested while the previous one still transfers
+    static const unsigned MAX_READAHEADS = 2;
+
+    // playback time kept cached ahead of the app, on top of the time a request takes to start
+    static const dstime READAHEAD_LEAD_DS = 50;
+
+    // bytes delivered to the app, the playback bitrate in practice
+    SpeedController consumption;
+
+    // smoothed time to the first byte of the requests, 0 until measured
+    dstime rtt = 0;
+
     MegaClient* client;
 
     handledrn_map::iterator hdrn_it;
@@ -311,6 +423,25 @@ struct MEGA_API DirectReadNode
     // report failure to app and abort or retry all reads
     void retry(const Error &, dstime = 0);
 
+    // deliver what the cache has for a read about to be started.  False if that finished it (it's deleted)
+    bool servefromcache(DirectRead*);
+
+    // delete a read that is over, and read ahead of it if the app reads the file sequentially
+    void finishread(DirectRead*, m_off_t stoppedat);
+
+    // fill the cache from pos, up to readaheadwindow() bytes
+    void readahead(m_off_t pos);
+
+    // what to keep cached ahead of the app: the bitrate times the latency and READAHEAD_LEAD_DS,
+    // no less than the amount configured in the client and no more than what the cache can keep
+    m_off_t readaheadwindow();
+
+    // whether a read ahead in flight will deliver pos, so that a read starting there can wait for it
+    bool readaheadcovers(m_off_t pos) const;
+
+    // a request of one of the reads got its first byte after "elapsed"
+    void updatertt(dstime elapsed);
+
     DirectReadNode(MegaClient*, handle, bool, SymmCipher*, int64_t, const char*, const char*, const char*);
     ~DirectReadNode();
 };
@@ -46,6 +46,100 @@ public:
 
 class DBTableTransactionCommitter;
 
+// Decides how many of the connections of a transfer are given new requests, and how large those are.
+// With adaptation on, the count follows the throughput, much like TCP congestion control: a connection
+// is added and kept while that raises the throughput by MIN_GAIN_PERCENT; when it doesn't, dropping one
+// is tried, and kept while the throughput doesn't fall by as much.  Failed attempts back off
+// exponentially.  Requests are sized to a few seconds of data per connection.
+// In any case, the buffers of the requests in flight are kept under the memory limit, if there is one.
+class MEGA_API TransferConnectionControl
+{
+public:
+    // the throughput is evaluated over periods of this length (ds)
+    static const dstime PERIOD_DS;
+
+    // change in throughput for an extra connection to be worth it, or for one fewer to be acceptable
+    static const int MIN_GAIN_PERCENT;
+
+    // seconds of data per connection requests are sized to
+    static const int REQUEST_SECONDS;
+
+    static const m_off_t MIN_REQ_SIZE;
+
+    // maximum number of periods to wait before trying another change
+    static const unsigned MAX_HOLD_PERIODS;
+
+    // memoryLimit: maximum combined size of the requests in flight, 0 for none
+    void init(unsigned initialConnections, unsigned maxConnections, m_off_t maxRequestSize,
+              m_off_t memoryLimit, bool adaptive, dstime now);
+
+    void transferred(m_off_t bytes) { mPeriodBytes += bytes; }
+
+    // evaluate the period if it is over.  True if connections() or requestSize() changed
+    bool update(dstime now);
+
+    // connections to give new requests to, and their maximum size
+    unsigned connections() const { return mConnections; }
+    m_off_t requestSize() const { return mRequestSize; }
+
+private:
+    void applyMemoryLimit();
+
+    unsigned mConnections = 1;
+    unsigned mMaxConnections = 1;
+    m_off_t mRequestSize = 0;
+    m_off_t mMaxRequestSize = 0;
+    m_off_t mMemoryLimit = 0;
+    bool mAdaptive = false;
+
+    dstime mPeriodStart = 0;
+    m_off_t mPeriodBytes = 0;
+
+    // throughput (bytes per period) before the change being evaluated
+    m_off_t mBaseline = 0;
+
+    // change being evaluated: +1, -1 or 0
+    int mProbe = 0;
+
+    // direction of the next change
+    int mNextProbe = 1;
+
+    // periods to wait until the next change, and the wait after the next failed one
+    unsigned mHold = 1;
+    unsigned mHoldBackoff = 1;
+};
+
+// Admission of transfers to slots by the connections they open rather than by their number: a raid download takes
+// RAIDPARTS of them, one per storage server, a small file just one.  Keeps the total under a budget, and the
+// connections to each storage host under a limit of their own.
+class MEGA_API TransferConnectionBudget
+{
+public:
+    TransferConnectionBudget(unsigned maxConnections, unsigned maxHostConnections);
+
+    // the connections of an active slot, or those a transfer is expected to open (when its URLs aren't known yet,
+    // a large download is taken to be raid)
+    static unsigned connectionsof(const TransferSlot&);
+    static unsigned connectionsof(const Transfer&);
+
+    // urls: the temporary URLs, empty if unknown (the hosts are then not accounted for)
+    bool fits(unsigned connections, const vector<string>& urls) const;
+    void add(unsigned connections, const vector<string>& urls);
+
+    unsigned used() const { return mUsed; }
+
+    static string host(const string& url);
+
+private:
+    // the connections each URL gets: one each for raid, all of them otherwise
+    static unsigned perurl(unsigned connections, const vector<string>& urls);
+
+    unsigned mMaxConnections;
+    unsigned mMaxHostConnections;
+    unsigned mUsed = 0;
+    map<string, unsigned> mHosts;
+};
+
 // active transfer
 struct MEGA_API TransferSlot
 {
@@ -68,9 +162,22 @@ struct MEGA_API TransferSlot
     // max request size for downloads and uploads
     static const m_off_t MAX_REQ_SIZE;
 
+    // max request size for uploads, which are sized to the upload speed below that
+    static const m_off_t MAX_UPLOAD_REQ_SIZE;
+
     // maximum gap between chunks for uploads
     static const m_off_t MAX_GAP_SIZE;
 
+    // downloads from this size reserve the space of the file before writing it
+    static const m_off_t MIN_PREALLOCATE_SIZE;
+
+    // non-raid downloads: hedged requests per slot, and the completed requests whose speeds are considered
+    static const unsigned MAX_HEDGED_REQS;
+    static const size_t HEDGE_SPEED_HISTORY;
+
+    // uploads read ahead once reading the data of a request takes at least 1/READ_AHEAD_RATIO of the time to post it
+    static const unsigned READ_AHEAD_RATIO;
+
     m_off_t maxRequestSize;
 
     m_off_t progressreported;
@@ -99,6 +206,40 @@ struct MEGA_API TransferSlot
     vector<SpeedController> mReqSpeeds;
     SpeedController mTransferSpeed;
 
+    // how many of the connections get new requests, and their size
+    TransferConnectionControl mConnectionControl;
+
+    // bytes counted in the client's TransferBufferPool for this slot
+    m_off_t mPoolHeld = 0;
+    bool mPausedForMemory = false;
+
+    // non-raid downloads: a duplicate of a request that is slower than 90% of the recent ones, on another connection.
+    // Whichever of the two finishes first is used.
+    std::shared_ptr<HttpReqXfer> mHedgeReq;
+    int mHedgedConnection = -1;
+    m_off_t mHedgedPos = -1;
+    unsigned mHedgedReqs = 0;
+    std::deque<m_off_t> mRecentReqSpeeds;
+
+    // Uploads: the next request of each connection, read and encrypted on the worker threads while the connection posts
+    // its current one, and posted as soon as that one is done.  The reads go through a file of their own, kept open.
+    struct ReadAheadFile
+    {
+        std::mutex mutex;
+        unique_ptr<FileAccess> fa;
+
+        // time taken by the last read
+        std::atomic<unsigned> readMs{0};
+    };
+    std::shared_ptr<ReadAheadFile> mReadAheadFile;
+    vector<std::shared_ptr<HttpReqXfer>> mReadAhead;
+    vector<m_off_t> mReadAheadBytes;
+    vector<std::chrono::steady_clock::time_point> mReadStarted;
+
+    // moving averages of the time to read the data of a request, and to post it
+    unsigned mReadMs = 0;
+    unsigned mPostMs = 0;
+
     // only swap channels twice for speed issues, to prevent endless non-progress (counter is reset if we make overall progress, ie data reassembled)
     unsigned mRaidChannelSwapsForSlowness = 0;
 
@@ -142,10 +283,25 @@ struct MEGA_API TransferSlot
 
 private:
     void toggleport(HttpReqXfer* req);
+
+    // the storage server latencies of this direction
+    LatencyHistogram& latency();
+
+    // the worker priority of the chunk encryption and decryption: sync transfers give way to those of the app
+    MegaClientAsyncQueue::Priority workerPriority() const;
+
+    // report the transfer data this slot holds in memory to the client's pool
+    void updateBufferPool();
     bool checkDownloadTransferFinished(DBTableTransactionCommitter& committer, MegaClient* client);
     bool checkMetaMacWithMissingLateEntries();
     bool tryRaidRecoveryFromHttpGetError(unsigned i, bool incrementErrors);
 
+    // start, resolve or drop the hedged request of a non-raid download
+    void hedgeSlowRequest(MegaClient* client);
+
+    // start reading and encrypting the next request of an upload connection, if reading is slow enough to matter
+    void readAhead(MegaClient* client, int i);
+
     // returns true if connection haven't received data recently (set incrementErrors) or if slower than other connections (reset incrementErrors)
     bool testForSlowRaidConnection(unsigned connectionNum, bool& incrementErrors);
 };
@@ -37,6 +37,19 @@ public:
     virtual ~TreeProc() { }
 };
 
+// A processor that only reads the nodes and accumulates something from them, in any order, so the subtrees can be
+// given to the worker threads (see MegaClient::proctreeParallel()): each job works on a fork of its own, merged back
+// into the original at the end.
+class MEGA_API ParallelTreeProc : public TreeProc
+{
+public:
+    // an empty accumulator for one job
+    virtual std::unique_ptr<ParallelTreeProc> fork() const = 0;
+
+    // adds what a job accumulated
+    virtual void merge(const ParallelTreeProc&) = 0;
+};
+
 class MEGA_API TreeProcDel : public TreeProc
 {
 public:
@@ -56,12 +69,16 @@ public:
     unsigned nc = 0;
     bool allocated = false;
 
+    // attributes of nn, encrypted by makeattrs() once the tree has been processed
+    vector<string> attrjson;
+
     void allocnodes(void);
+    void makeattrs(MegaClient*);
 
     void proc(MegaClient*, Node*);
 };
 
-class MEGA_API TreeProcDU : public TreeProc
+class MEGA_API TreeProcDU : public ParallelTreeProc
 {
 public:
     m_off_t numbytes;
@@ -69,6 +86,8 @@ public:
     int numfolders;
 
     void proc(MegaClient*, Node*);
+    std::unique_ptr<ParallelTreeProc> fork() const override;
+    void merge(const ParallelTreeProc&) override;
     TreeProcDU();
 };
 
@@ -76,12 +95,17 @@ class MEGA_API TreeProcShareKeys : public TreeProc
 {
     ShareNodeKeys snk;
     Node* sn;
+    size_t limit;
+    size_t added = 0;
 
 public:
     void proc(MegaClient*, Node*);
     void get(Command*);
 
-    TreeProcShareKeys(Node* = NULL);
+    // the nodes past the limit, whose keys are left out
+    handle_vector remaining;
+
+    TreeProcShareKeys(Node* = NULL, size_t = SIZE_MAX);
 };
 
 class MEGA_API TreeProcForeignKeys : public TreeProc
@@ -77,6 +77,8 @@ typedef unsigned char byte;
 #include <string>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <unordered_map>
 
 namespace mega {
 
@@ -128,6 +130,7 @@ struct Node;
 struct NodeCore;
 class PubKeyAction;
 class Request;
+class ShareNodeKeys;
 struct Transfer;
 class TreeProc;
 class LocalTreeProc;
@@ -465,18 +468,16 @@ typedef enum { SYNCDEL_NONE, SYNCDEL_DELETED, SYNCDEL_INFLIGHT, SYNCDEL_BIN,
 
 typedef vector<LocalNode*> localnode_vector;
 
-typedef map<handle, LocalNode*> handlelocalnode_map;
+// by fsid: looked up for each entry scanned, to detect moves
+typedef std::unordered_map<handle, LocalNode*> handlelocalnode_map;
 
 typedef set<LocalNode*> localnode_set;
 
-typedef multimap<int32_t, LocalNode*> idlocalnode_map;
+// the nodes of a sync's state cache by the dbid of their parent, in the order read
+typedef std::unordered_map<int32_t, localnode_vector> idlocalnode_map;
 
 typedef set<Node*> node_set;
 
-// enumerates a node's children
-// FIXME: switch to forward_list once C++11 becomes more widely available
-typedef list<Node*> node_list;
-
 // undefined node handle
 const handle UNDEF = ~(handle)0;
 
@@ -558,9 +559,6 @@ typedef map<int, GenericHttpReq*> pendinghttp_map;
 // map an upload handle to the corresponding transfer
 typedef map<UploadHandle, Transfer*> uploadhandletransfer_map;
 
-// maps node handles to Node pointers
-typedef map<NodeHandle, Node*> node_map;
-
 struct NodeCounter
 {
     m_off_t storage = 0;
@@ -699,7 +697,38 @@ typedef enum { AES_MODE_UNKNOWN, AES_MODE_CCM, AES_MODE_GCM } encryptionmode_t;
 typedef enum { PRIV_UNKNOWN = -2, PRIV_RM = -1, PRIV_RO = 0, PRIV_STANDARD = 2, PRIV_MODERATOR = 3 } privilege_t;
 typedef pair<handle, privilege_t> userpriv_pair;
 typedef vector< userpriv_pair > userpriv_vector;
-typedef map <handle, set <handle> > attachments_map;
+
+// the users with access to an attached node, in a sorted vector: most nodes are attached for a few users only, and
+// accounts in thousands of chats would otherwise have a heap block per user and node
+class MEGA_API compact_handle_set
+{
+public:
+    typedef handle_vector::const_iterator const_iterator;
+    typedef const_iterator iterator;
+
+    // false if already there
+    bool insert(handle h);
+
+    // number of handles removed, 0 or 1
+    size_t erase(handle h);
+
+    const_iterator find(handle h) const;
+    size_t count(handle h) const { return find(h) != end(); }
+
+    const_iterator begin() const { return mHandles.begin(); }
+    const_iterator end() const { return mHandles.end(); }
+    size_t size() const { return mHandles.size(); }
+    bool empty() const { return mHandles.empty(); }
+    void reserve(size_t n) { mHandles.reserve(n); }
+
+    bool operator==(const compact_handle_set& other) const { return mHandles == other.mHandles; }
+    bool operator!=(const compact_handle_set& other) const { return mHandles != other.mHandles; }
+
+private:
+    handle_vector mHandles;
+};
+
+typedef map<handle, compact_handle_set> attachments_map;
 struct TextChat : public Cacheable
 {
     enum {
@@ -719,6 +748,9 @@ struct TextChat : public Cacheable
     bool publicchat;  // whether the chat is public or private
     bool meeting;     // chat is meeting room
 
+    // hash of the record last written to the local cache, not to write it again when unchanged
+    size_t dbhash = 0;
+
 private:        // use setter to modify these members
     byte flags;     // currently only used for "archive" flag at first bit
 
@@ -838,74 +870,112 @@ unique_ptr<T> make_unique(constructorArgs&&... args)
     return (unique_ptr<T>(new T(std::forward<constructorArgs>(args)...)));
 }
 
-//#define MEGA_MEASURE_CODE   // uncomment this to track time spent in major subsystems, and log it every 2 minutes, with extra control from megacli
+//#define MEGA_MEASURE_CODE   // uncomment this to log the time spent in major subsystems every 2 minutes, with extra control from megacli
 
 namespace CodeCounter
 {
-    // Some classes that allow us to easily measure the number of times a block of code is called, and the sum of the time it takes.
-    // Only enabled if MEGA_MEASURE_CODE is turned on.
-    // Usage generally doesn't need to be protected by the macro as the classes and methods will be empty when not enabled.
+    // Some classes that allow us to easily measure the number of times a block of code is called, the sum of the time it takes
+    // and how those times are distributed, and the level of queues and pools.
+    // They are cheap enough to be always on (relaxed atomics and two clock reads per timed block), so apps can sample them
+    // from any thread in release builds, see MegaApi::getPerformanceMetrics.  Each value is consistent on its own, but a
+    // snapshot may mix values from before and after a concurrent update.
 
     using namespace std::chrono;
 
+    // HDR-style histogram of durations in microseconds: exact below 2^SUB_BITS, then 2^SUB_BITS buckets per power of two,
+    // so a value is known within 1/2^SUB_BITS of itself, up to 2^MAX_BITS us (~19 hours; longer ones count in the last bucket)
+    class MEGA_API Histogram
+    {
+    public:
+        static const int SUB_BITS = 3;
+        static const int MAX_BITS = 36;
+        static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+        inline void record(uint64_t us)
+        {
+            mBuckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+            uint64_t max = mMax.load(std::memory_order_relaxed);
+            while (us > max && !mMax.compare_exchange_weak(max, us, std::memory_order_relaxed));
+        }
+
+        static int bucketOf(uint64_t us);
+
+        // smallest value counted in the bucket
+        static uint64_t lowerBound(int bucket);
+
+        uint64_t count() const;
+        uint64_t max() const { return mMax.load(std::memory_order_relaxed); }
+
+        // value that the given fraction of the recorded ones don't exceed (highest of its bucket), 0 if there are none yet
+        uint64_t percentile(double fraction) const;
+
+        // number of recorded values known not to exceed `us` (those of the buckets that end at or below it)
+        uint64_t countUpTo(uint64_t us) const;
+
+        // as JSON, with the lower bound and count of the non-empty buckets
+        string toJson() const;
+
+        void reset();
+
+    private:
+        std::atomic<uint64_t> mBuckets[BUCKETS] = {};
+        std::atomic<uint64_t> mMax{0};
+    };
+
     struct ScopeStats
     {
-#ifdef MEGA_MEASURE_CODE
-        uint64_t count = 0;
-        uint64_t starts = 0;
-        uint64_t finishes = 0;
-        high_resolution_clock::duration timeSpent{};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> starts{0};
+        std::atomic<uint64_t> finishes{0};
+        std::atomic<high_resolution_clock::rep> timeSpent{0};
+        Histogram durations;
         std::string name;
         ScopeStats(std::string s) : name(std::move(s)) {}
 
         inline string report(bool reset = false)
         {
-            string s = " " + name + ": " + std::to_string(count) + " " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(timeSpent).count());
+            string s = " " + name + ": " + std::to_string(count.load()) + " " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(high_resolution_clock::duration(timeSpent.load())).count());
             if (reset)
             {
                 count = 0;
-                starts -= finishes;
-                finishes = 0;
-                timeSpent = high_resolution_clock::duration{};
+                starts -= finishes.exchange(0);
+                timeSpent = 0;
+                durations.reset();
             }
             return s;
         }
-#else
-        ScopeStats(std::string s) {}
-#endif
+
+        // as JSON: count, blocks in progress, total time (ms) and the distribution of the durations (us)
+        string toJson() const;
     };
 
+    // total time that something was in progress, kept by a single thread
     struct DurationSum
     {
-#ifdef MEGA_MEASURE_CODE
-        high_resolution_clock::duration sum{ 0 };
+        std::atomic<high_resolution_clock::rep> sum{ 0 };
         high_resolution_clock::time_point deltaStart;
         bool started = false;
         inline void start(bool b = true) { if (b && !started) { deltaStart = high_resolution_clock::now(); started = true; }  }
-        inline void stop(bool b = true) { if (b && started) { sum += high_resolution_clock::now() - deltaStart; started = false; } }
+        inline void stop(bool b = true) { if (b && started) { sum.fetch_add((high_resolution_clock::now() - deltaStart).count(), std::memory_order_relaxed); started = false; } }
         inline bool inprogress() { return started; }
+        inline uint64_t milliseconds() const { return uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(high_resolution_clock::duration(sum.load(std::memory_order_relaxed))).count()); }
         inline string report(bool reset = false)
         {
-            string s = std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(sum).count());
-            if (reset) sum = high_resolution_clock::duration{ 0 };
+            string s = std::to_string(milliseconds());
+            if (reset) sum = 0;
             return s;
         }
-#else
-        inline void start(bool = true) {  }
-        inline void stop(bool = true) {  }
-#endif
     };
 
     struct ScopeTimer
     {
-#ifdef MEGA_MEASURE_CODE
         ScopeStats& scope;
         high_resolution_clock::time_point blockStart;
         bool done = false;
 
         ScopeTimer(ScopeStats& sm) : scope(sm), blockStart(high_resolution_clock::now())
         {
-            ++scope.starts;
+            scope.starts.fetch_add(1, std::memory_order_relaxed);
         }
         ~ScopeTimer()
         {
@@ -917,15 +987,188 @@ namespace CodeCounter
         }
         void complete()
         {
-            ++scope.count;
-            ++scope.finishes;
-            scope.timeSpent += timeSpent();
+            auto spent = timeSpent();
+            scope.count.fetch_add(1, std::memory_order_relaxed);
+            scope.finishes.fetch_add(1, std::memory_order_relaxed);
+            scope.timeSpent.fetch_add(spent.count(), std::memory_order_relaxed);
+            scope.durations.record(uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(spent).count()));
             done = true;
         }
-#else
-        ScopeTimer(ScopeStats& sm) {}
-        void complete() {}
-#endif
+    };
+
+    // current level of a queue or pool, and the highest it has been
+    struct Gauge
+    {
+        std::atomic<int64_t> value{0};
+        std::atomic<int64_t> peak{0};
+
+        inline void set(int64_t v)
+        {
+            value.store(v, std::memory_order_relaxed);
+            raisePeak(v);
+        }
+        inline void add(int64_t delta)
+        {
+            raisePeak(value.fetch_add(delta, std::memory_order_relaxed) + delta);
+        }
+        inline void raisePeak(int64_t v)
+        {
+            int64_t p = peak.load(std::memory_order_relaxed);
+            while (v > p && !peak.compare_exchange_weak(p, v, std::memory_order_relaxed));
+        }
+
+        // as JSON: {"value":,"peak":}
+        string toJson() const;
+    };
+
+    // Major owners of memory, whose bytes are accounted process-wide (for all the clients) as they allocate and release them.
+    // Some are estimates, see where each one is accounted.
+    enum MemoryTag
+    {
+        MEM_NODES,              // Node slabs and the handle table, not the strings and maps of each node
+        MEM_LOCALNODES,         // LocalNode objects
+        MEM_HTTP_BUFFERS,       // receive buffers of the HTTP requests, updated as data arrives
+        MEM_RAID_BUFFERS,       // transfer pieces waiting to be combined, decrypted or written
+        MEM_STREAMING_BUFFERS,  // data of the local HTTP/FTP servers waiting to be sent
+        MEM_STREAMING_CACHE,    // blocks of the DirectReadCaches kept in memory, not those spilled to disk
+        MEM_FILE_ATTRIBUTES,    // thumbnails and previews of the memory cache of each MegaApi
+        MEM_USER_ALERTS,
+        MEM_LOG_BUFFERS,        // rings of the asynchronous logger
+        MEM_NUM_TAGS
+    };
+
+    extern MEGA_API Gauge memory[MEM_NUM_TAGS];
+
+    inline void accountMemory(MemoryTag tag, int64_t delta)
+    {
+        if (delta)
+        {
+            memory[tag].add(delta);
+        }
+    }
+
+    MEGA_API const char* memoryTagName(MemoryTag tag);
+
+    // Breakdown of each iteration of a loop into phases. Phases are timed exclusively: entering one pauses the phase
+    // that was running, so nested phases don't count twice, and the time outside all of them is "other".
+    // Iterations and phases are timed by the loop's thread only; the history and totals can be read from any thread.
+    class MEGA_API LoopProfiler
+    {
+    public:
+        static const int MAX_PHASES = 8;
+        static const size_t HISTORY = 64;
+
+        struct Iteration
+        {
+            uint64_t started = 0;               // microseconds since the profiler was created
+            uint32_t total = 0;                 // microseconds, as for the phases
+            uint32_t phases[MAX_PHASES] = {};
+            uint32_t other() const;
+        };
+
+        LoopProfiler(std::vector<const char*> phaseNames, milliseconds slowThreshold);
+
+        void beginIteration();
+
+        // finish the iteration, return true if it took longer than the slow threshold (`finished` gets its breakdown)
+        bool endIteration(Iteration* finished = nullptr);
+
+        // times a phase while in scope, if an iteration is in progress
+        class Phase
+        {
+        public:
+            Phase(LoopProfiler& profiler, int phase);
+            ~Phase();
+
+        private:
+            LoopProfiler& mProfiler;
+            int mPrevious;
+            bool mActive;
+        };
+
+        void setSlowThreshold(milliseconds threshold);
+        uint64_t slowIterations() const { return mSlowIterations.load(std::memory_order_relaxed); }
+
+        // total microseconds spent in the phase over all the iterations, MAX_PHASES for "other"
+        uint64_t totalMicroseconds(int phase) const { return mTotals[phase].load(std::memory_order_relaxed); }
+
+        int phaseCount() const { return int(mNames.size()); }
+        const char* phaseName(int phase) const { return phase < phaseCount() ? mNames[size_t(phase)] : "other"; }
+
+        // "<total> ms: <phase> <ms> ms, ..." with the phases that took any time, slowest first
+        string describe(const Iteration& iteration) const;
+
+        // as JSON: slow threshold (ms), slow iterations, total us per phase, and the last iterations (oldest first)
+        string toJson() const;
+
+    private:
+        void charge(high_resolution_clock::time_point now);
+
+        const std::vector<const char*> mNames;
+        const high_resolution_clock::time_point mCreated;
+        std::atomic<int64_t> mSlowThreshold;    // microseconds
+
+        // of the iteration in progress
+        bool mInIteration = false;
+        int mCurrent = -1;
+        high_resolution_clock::time_point mIterationStart, mSince;
+        Iteration mIteration;
+
+        std::atomic<uint64_t> mTotals[MAX_PHASES + 1] = {};
+        std::atomic<uint64_t> mSlowIterations{0};
+
+        mutable std::mutex mHistoryMutex;
+        std::vector<Iteration> mHistory;
+        size_t mNext = 0;
+    };
+
+    // When each phase of a cold start began and how long it took, from the origin (the creation of the MegaApi).
+    // Only the first run of a phase is kept, so later logins and fetchnodes don't hide the startup.  Any thread.
+    class MEGA_API StartupProfile
+    {
+    public:
+        enum Phase { PHASE_API_INIT, PHASE_GFX_INIT, PHASE_CLIENT_INIT, PHASE_DB_OPEN, PHASE_FETCHSC, PHASE_USERDATA,
+                     PHASE_SYNC_RESUME, PHASE_FETCHNODES, PHASES };
+
+        StartupProfile();
+
+        void setOrigin(high_resolution_clock::time_point origin);
+
+        void record(Phase phase, high_resolution_clock::time_point begin, high_resolution_clock::time_point end);
+
+        // for phases that end elsewhere (fetchnodes, from the call to the result)
+        void begin(Phase phase);
+        void end(Phase phase);
+
+        // times a phase while in scope
+        class Scope
+        {
+        public:
+            Scope(StartupProfile& profile, Phase phase);
+            ~Scope();
+
+        private:
+            StartupProfile& mProfile;
+            Phase mPhase;
+            high_resolution_clock::time_point mBegin;
+        };
+
+        static const char* phaseName(int phase);
+
+        // {"<phase>":{"startms":<since the origin>,"ms":<duration>},...} with the phases that ran
+        string toJson() const;
+
+    private:
+        struct Timing
+        {
+            high_resolution_clock::time_point begin, end;
+            bool began = false;
+            bool ended = false;
+        };
+
+        mutable std::mutex mMutex;
+        high_resolution_clock::time_point mOrigin;
+        Timing mTimings[PHASES];
     };
 }
 
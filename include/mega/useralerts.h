@@ -241,9 +241,15 @@ private:
     unsigned int nextid;
 
 public:
+    // the most recent ones are kept, the oldest are dropped as new ones arrive beyond this
+    static const size_t MAXALERTS = 1000;
+
     typedef deque<UserAlert::Base*> Alerts;
     Alerts alerts;
 
+    // the same alerts by type, in the same order
+    map<nameid, Alerts> alertsByType;
+
     // collect new/updated alerts to notify the app with
     useralert_vector useralertnotify;
 
@@ -272,6 +278,12 @@ private:
 
     bool isUnwantedAlert(nameid type, int action);
 
+    // drops the oldest alert
+    void dropOldest();
+
+    // estimate of the memory of the alerts, in CodeCounter::MEM_USER_ALERTS (the subclasses add a few fields at most)
+    int64_t accountedmemory = 0;
+
 public:
 
     // This is a separate class to encapsulate some MegaClient functionality
@@ -304,6 +316,9 @@ public:
     // the API notified us another client updated the last acknowleged
     void onAcknowledgeReceived();
 
+    // drop the oldest ones until keep at most are left, returns the bytes released (estimated)
+    size_t trim(size_t keep);
+
     // re-init eg. on logout
     void clear();
 };
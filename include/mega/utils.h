@@ -22,6 +22,7 @@
 #ifndef MEGA_UTILS_H
 #define MEGA_UTILS_H 1
 
+#include <atomic>
 #include <type_traits>
 #include <condition_variable>
 #include <thread>
@@ -423,6 +424,10 @@ public:
         return utf8proc_toupper(c);
     }
 
+    // whether all the code units are below 0x80: such text is its own NFC form and case folds bytewise
+    static bool isAscii(const char* data, size_t size);
+    static bool isAscii(const wchar_t* data, size_t size);
+
     // Platform-independent case-insensitive comparison.
     static int icasecmp(const std::string& lhs,
                         const std::string& rhs,
@@ -465,17 +470,58 @@ int macOSmajorVersion();
 #endif
 
 // file chunk macs
+// The leading chunks that are finished are folded into the MAC of the file as it is computed, so a large transfer
+// keeps an entry only for the chunks past the first gap; the entries of the map start at foldedEnd().
 class chunkmac_map : public map<m_off_t, ChunkMAC>
 {
 public:
+    // the entries checkMetaMacWithMissingLateEntries() may leave out are never folded: the last 96 MB at least
+    static const m_off_t UNFOLDED_TAIL = 96 << 20;
+
     int64_t macsmac(SymmCipher *cipher);
     int64_t macsmac_gaps(SymmCipher *cipher, size_t g1, size_t g2, size_t g3, size_t g4);
+
+    // macsmac_gaps() for many gaps among the last entries: the entries before them are folded only once
+    class TailGaps
+    {
+    public:
+        // gaps can only start at or after entry `from`
+        TailGaps(chunkmac_map& macs, SymmCipher* cipher, size_t from);
+        int64_t macsmac_gaps(size_t g1, size_t g2, size_t g3, size_t g4);
+
+    private:
+        SymmCipher* mCipher;
+        size_t mFrom;
+        byte mPrefixMac[SymmCipher::BLOCKSIZE];
+        vector<const byte*> mTailMacs;
+    };
+
     void serialize(string& d) const;
     bool unserialize(const char*& ptr, const char* end);
     void calcprogress(m_off_t size, m_off_t& chunkpos, m_off_t& completedprogress, m_off_t* lastblockprogress = nullptr);
     m_off_t nextUnprocessedPosFrom(m_off_t pos);
     m_off_t expandUnprocessedPiece(m_off_t pos, m_off_t npos, m_off_t fileSize, m_off_t maxReqSize);
     void finishedUploadChunks(chunkmac_map& macs);
+
+    // the entries of a downloaded piece, but those of chunks already folded
+    void finishedDownloadPiece(const chunkmac_map& macs);
+
+    // fold the leading finished chunks, up to UNFOLDED_TAIL before the end of the file
+    void foldFinished(SymmCipher* cipher, m_off_t fileSize);
+
+    m_off_t foldedEnd() const { return mFoldedEnd; }
+
+    // the chunks so far, folded or not
+    size_t chunkCount() const { return mFoldedCount + size(); }
+
+    bool empty() const { return !mFoldedCount && map::empty(); }
+    void clear();
+    void swap(chunkmac_map& other);
+
+private:
+    byte mFoldedMac[SymmCipher::BLOCKSIZE] = {};
+    m_off_t mFoldedEnd = 0;
+    size_t mFoldedCount = 0;
 };
 
 struct CacheableWriter
@@ -498,6 +544,11 @@ struct CacheableWriter
     void serializedouble(double field);
     void serializechunkmacs(const chunkmac_map& m);
 
+    // compact layouts: 7 bits per byte, least significant first (1 byte below 128, 10 at most)
+    void serializevarint(uint64_t field);
+    void serializevarbytes(const char* data, size_t len);  // varint length, then the bytes
+    void serializevarbytes(const string& field) { serializevarbytes(field.data(), field.size()); }
+
     // Each class that might get extended should store expansion flags at the end
     // When adding new fields to an existing class, set the next expansion flag true to indicate they are present.
     // If you turn on the last flag, then you must also add another set of expansion flags (all false) after the new fields, for further expansion later.
@@ -525,6 +576,9 @@ struct CacheableReader
     bool unserializebool(bool& s);
     bool unserializechunkmacs(chunkmac_map& m);
 
+    bool unserializevarint(uint64_t& field);
+    bool unserializevarbytes(const char*& data, size_t& len);  // points into the record, which must outlive the use of data
+
     bool unserializeexpansionflags(unsigned char field[8], unsigned usedFlagCount);
 
     void eraseused(string& d); // must be the same string, unchanged
@@ -551,33 +605,163 @@ std::pair<bool, int64_t> generateMetaMac(SymmCipher &cipher, InputStreamAccess &
 // Maintains a small thread pool for executing independent operations such as encrypt/decrypt a block of data
 // The number of threads can be 0 (eg. for helper MegaApi that deals with public folder links) in which case something queued is
 // immediately executed synchronously on the caller's thread
+//
+// Each worker has its own queues, one per priority, so pushes and pops rarely contend: a job goes to the worker of its
+// affinity (jobs of the same transfer stay together) or to the next one in turn.  A worker takes the most urgent job
+// available, its own first and else one stolen from another worker.  Idle workers sleep, and only one is
+// woken per job.  The waiter is notified after urgent jobs, and for the others when a worker runs out of work or at
+// most every NOTIFY_INTERVAL, so a stream of completions doesn't wake the client for each one.
+//
+// The pool can be shared by the queues of many clients (one per account in a process), which then cost no threads of
+// their own: each job notifies the waiter of the queue it came from, and a queue waits for its own jobs only when
+// destroyed.
 struct MegaClientAsyncQueue
 {
+    enum Priority
+    {
+        PRIORITY_INTERACTIVE,   // something is waiting for it: the SDK thread, thumbnails on screen
+        PRIORITY_NORMAL,
+        PRIORITY_BACKGROUND,    // sync transfers, media attribute extraction
+        PRIORITIES
+    };
+
+    class WorkerPool;
+
     void push(std::function<void(SymmCipher&)> f, bool discardable);
+    void push(std::function<void(SymmCipher&)> f, bool discardable, Priority priority, uint64_t affinity = 0);
     void clearDiscardable();
 
+    // jobs waiting for a thread
+    const CodeCounter::Gauge& depth() const { return mDepth; }
+
+    // with a pool of its own
     MegaClientAsyncQueue(Waiter& w, unsigned threadCount);
+
+    // with a pool shared with other queues (its threads are used if it has any, else jobs run on the caller's thread)
+    MegaClientAsyncQueue(Waiter& w, std::shared_ptr<WorkerPool> pool);
+
     ~MegaClientAsyncQueue();
 
+    static std::shared_ptr<WorkerPool> newWorkerPool(unsigned threadCount);
+
 private:
+    static const std::chrono::milliseconds NOTIFY_INTERVAL;
+
     Waiter& mWaiter;
-    std::mutex mMutex;
-    std::condition_variable mConditionVariable;
+    std::shared_ptr<WorkerPool> mPool;
+
+    // steady_clock ticks of the last notification of the waiter
+    std::atomic<int64_t> mLastNotify{0};
+
+    // jobs pushed and not run yet, which the destructor waits for
+    int64_t mOutstanding = 0;
+    std::mutex mOutstandingMutex;
+    std::condition_variable mOutstandingCondition;
 
-    struct Entry
+    CodeCounter::Gauge mDepth;
+    SymmCipher mZeroThreadsCipher;
+
+    // after a job of this queue ran on a worker; moreQueued: other jobs of the pool are waiting
+    void completed(Priority, bool moreQueued);
+    void discarded(int64_t count);
+    void finished(int64_t count);
+};
+
+// Multiple-producer single-consumer queue, lock-free: producers push onto a list with a compare-and-swap, and the consumer
+// takes everything pushed so far with a single exchange (so there is no ABA problem), and puts it in order.
+template<class T>
+class MpscQueue
+{
+    struct Item
     {
-        bool discardable = false;
-        std::function<void(SymmCipher&)> f;
-        Entry(bool disc, std::function<void(SymmCipher&)>&& func)
-             : discardable(disc), f(func)
-        {}
+        T value;
+        Item* next;
     };
 
-    std::deque<Entry> mQueue;
-    std::vector<std::thread> mThreads;
-    SymmCipher mZeroThreadsCipher;
+    // the last one pushed
+    std::atomic<Item*> mHead{nullptr};
+
+    void pushChain(Item* first, Item* last)
+    {
+        first->next = mHead.load(std::memory_order_relaxed);
+        while (!mHead.compare_exchange_weak(first->next, last, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+public:
+    MpscQueue() = default;
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue()
+    {
+        Item* item = mHead.exchange(nullptr);
+        while (item)
+        {
+            Item* next = item->next;
+            delete item;
+            item = next;
+        }
+    }
+
+    void push(T value)
+    {
+        Item* item = new Item{std::move(value), nullptr};
+        pushChain(item, item);
+    }
+
+    // several at once, consecutive
+    template<class Iterator>
+    void push(Iterator begin, Iterator end)
+    {
+        Item* first = nullptr;
+        Item* last = nullptr;
+        for (; begin != end; ++begin)
+        {
+            Item* item = new Item{*begin, last};
+            if (!first)
+            {
+                first = item;
+            }
+            last = item;
+        }
 
-    void asyncThreadLoop();
+        if (last)
+        {
+            pushChain(first, last);
+        }
+    }
+
+    bool empty() const
+    {
+        return !mHead.load(std::memory_order_relaxed);
+    }
+
+    // appends everything pushed so far, in the order it was pushed (consumer only)
+    template<class Container>
+    size_t drainInto(Container& c)
+    {
+        // the list goes from the last pushed to the first
+        Item* reversed = nullptr;
+        Item* item = mHead.exchange(nullptr, std::memory_order_acquire);
+        while (item)
+        {
+            Item* next = item->next;
+            item->next = reversed;
+            reversed = item;
+            item = next;
+        }
+
+        size_t n = 0;
+        while (reversed)
+        {
+            Item* next = reversed->next;
+            c.push_back(std::move(reversed->value));
+            delete reversed;
+            reversed = next;
+            ++n;
+        }
+        return n;
+    }
 };
 
 template<class T>
@@ -587,15 +771,38 @@ struct ThreadSafeDeque
     // When we try to do that on the same thread, the processing of queued notifications is too slow so more notifications bulid up than
     // have been processed, so each time we get the outstanding ones from the buffer we gave to the OS, we need to give it an even
     // larger buffer to write into, otherwise it runs out of space before this thread is idle and can get the next batch from the buffer.
+    // Any thread can push, without a lock.  The rest is for the one thread taking them out, which moves all those pushed so far
+    // to its own deque at once when it looks at it.
 protected:
     std::deque<T> mNotifications;
-    std::mutex m;
+    MpscQueue<T> mIncoming;
+    vector<T> mReceiving;
+
+    void receive()
+    {
+        if (!mIncoming.empty())
+        {
+            mIncoming.drainInto(mReceiving);
+            for (auto& t : mReceiving)
+            {
+                received(std::move(t));
+            }
+            mReceiving.clear();
+        }
+    }
+
+    // one more pushed, in order
+    virtual void received(T&& t)
+    {
+        mNotifications.push_back(std::move(t));
+    }
 
 public:
+    virtual ~ThreadSafeDeque() = default;
 
     bool peekFront(T& t)
     {
-        std::lock_guard<std::mutex> g(m);
+        receive();
         if (!mNotifications.empty())
         {
             t = mNotifications.front();
@@ -606,7 +813,7 @@ public:
 
     bool popFront(T& t)
     {
-        std::lock_guard<std::mutex> g(m);
+        receive();
         if (!mNotifications.empty())
         {
             t = std::move(mNotifications.front());
@@ -618,30 +825,107 @@ public:
 
     void unpopFront(const T& t)
     {
-        std::lock_guard<std::mutex> g(m);
         mNotifications.push_front(t);
     }
 
     void pushBack(T&& t)
     {
-        std::lock_guard<std::mutex> g(m);
-        mNotifications.push_back(t);
+        mIncoming.push(std::move(t));
     }
 
     bool empty()
     {
-        std::lock_guard<std::mutex> g(m);
+        receive();
         return mNotifications.empty();
     }
 
     size_t size()
     {
-        std::lock_guard<std::mutex> g(m);
+        receive();
         return mNotifications.size();
     }
 
 };
 
+// Recursive timed mutex that can also be locked shared, by any number of threads at once (C++11 has no std::shared_mutex).
+// The thread holding it exclusively can lock it shared too (just one more level of recursion), but a thread holding it
+// only shared must not lock it exclusively: it would wait for itself.  Threads waiting for the exclusive lock go first.
+class MEGA_API SharedRecursiveMutex
+{
+public:
+    void lock();
+    bool try_lock();
+    void unlock();
+
+    template<class Rep, class Period>
+    bool try_lock_for(const std::chrono::duration<Rep, Period>& d)
+    {
+        return lockUntil(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(d));
+    }
+
+    void lock_shared();
+    void unlock_shared();
+
+    // If threads are waiting for the exclusive lock, lets one of them have it and then takes it back as this thread
+    // held it (the same mode and levels).  Only if this thread holds it just `levels` times, those its caller took:
+    // callers up the stack holding it too (eg. the SDK thread calling back, or an app between lockMutex() and
+    // unlockMutex()) must not see what it protects change.  Returns whether it was let go: anything read under it
+    // may have changed since, the pointers into what it protects may be dangling.
+    bool yieldToWriters(unsigned levels);
+
+private:
+    bool lockUntil(std::chrono::steady_clock::time_point deadline);
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+
+    // the thread holding it exclusively, and how many times
+    std::thread::id mOwner;
+    unsigned mOwnerCount = 0;
+    unsigned mOwnersWaiting = 0;
+
+    // times it was taken exclusively, for a yielding owner to know one of the others had it
+    uint64_t mOwnerships = 0;
+
+    // the threads holding it shared, and how many times
+    std::map<std::thread::id, unsigned> mReaders;
+};
+
+// Name, priority and CPUs of the threads of the SDK, by what they do.  Each thread applies the settings of its role to
+// itself as it starts, so they must be configured before the threads they are for are started.
+class MEGA_API ThreadRoles
+{
+public:
+    enum Role
+    {
+        SDK,        // the thread of each MegaApi, and the one delivering its callbacks
+        WORKER,     // crypto and hashing
+        GFX,        // thumbnails and previews
+        SERVER,     // the loops of the local HTTP/FTP servers
+        LOGGER,     // asynchronous logging and the performance logger
+        IO,         // completions of the asynchronous file IO, scans, local databases
+        ROLE_COUNT
+    };
+
+    // priority as a nice value, -20 (highest) to 19 (lowest), mapped to the nearest the platform has; cpus as a mask,
+    // bit n for CPU n, 0 for any (the threads keep the affinity of the process)
+    static void configure(Role, int priority, uint64_t cpus);
+
+    // names the calling thread ("mega-" and up to 10 characters, for the limits of some platforms), and sets the
+    // priority and CPUs of its role if configured
+    static void enter(Role, const char* name);
+
+private:
+    struct Settings
+    {
+        int priority = 0;
+        uint64_t cpus = 0;
+    };
+
+    static std::mutex sMutex;
+    static Settings sSettings[ROLE_COUNT];
+};
+
 template<typename CharT>
 struct UnicodeCodepointIteratorTraits;
 
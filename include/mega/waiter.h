@@ -48,6 +48,13 @@ struct MEGA_API Waiter
     // set ds to current time
     static void bumpds();
 
+    // while set, bumpds() leaves ds alone and time only moves with advanceds(), so that tests and
+    // benchmarks can step a MegaClient exec() by exec() on the same clock on every run
+    static bool manualclock;
+
+    // move the manual clock forward
+    static void advanceds(dstime);
+
     // wait ceiling
     dstime maxds;
 
@@ -38,6 +38,17 @@ struct MEGA_API WinDirAccess : public DirAccess
     WIN32_FIND_DATAW currentItemAttributes;
     friend class WinFileAccess;
 
+#ifndef WINDOWS_PHONE
+    // plain listings read the entries in bulk from the directory handle instead, many per call
+    static const size_t BULK_BUFFER_SIZE = 65536;
+    HANDLE hDirectory;
+    vector<LONGLONG> bulkbuffer;  // for the alignment of the entries
+    FILE_ID_BOTH_DIR_INFO* bulkentry = nullptr;
+
+    bool bulkopen(const std::wstring& name);
+    bool bulknext();
+#endif
+
 public:
     bool dopen(LocalPath*, FileAccess*, bool) override;
     bool dnext(LocalPath&, LocalPath&, bool, nodetype_t*) override;
@@ -55,6 +66,7 @@ public:
     std::unique_ptr<FileAccess> newfileaccess(bool followSymLinks = true) override;
 
     bool getlocalfstype(const LocalPath& path, FileSystemType& type) const override;
+    bool getdeviceid(const LocalPath& path, uint64_t& id) const override;
 
     DirAccess* newdiraccess() override;
 #ifdef ENABLE_SYNC
@@ -104,6 +116,35 @@ public:
 };
 
 #ifdef ENABLE_SYNC
+#ifndef WINDOWS_PHONE
+// NTFS change journal of the volume of a sync: tells which of its folders changed while the notifications were lost.
+// Read through the volume, so only available when the process can open it.
+class MEGA_API WinUsnJournal
+{
+public:
+    explicit WinUsnJournal(const std::wstring& root);
+    ~WinUsnJournal();
+
+    bool valid() const { return hVolume != INVALID_HANDLE_VALUE; }
+
+    // the position of the journal now (fails if it was recreated since the previous call)
+    bool position(LONGLONG& usn);
+
+    // the folders under the root, relative to it, with changes since the position; fails if the journal
+    // no longer covers it, or if it can't tell them better than a full scan
+    bool changes(LONGLONG from, vector<LocalPath>& folders);
+
+    static const size_t MAX_FOLDERS = 4096;
+
+private:
+    static const size_t BUFFER_SIZE = 65536;
+
+    HANDLE hVolume = INVALID_HANDLE_VALUE;
+    DWORDLONG mJournalId = 0;
+    std::wstring mRoot;
+};
+#endif
+
 struct MEGA_API WinDirNotify : public DirNotify
 {
 private:
@@ -124,6 +165,12 @@ private:
     DWORD dwBytes;
     OVERLAPPED overlapped;
 
+#ifndef WINDOWS_PHONE
+    // to recover the changes of a notification buffer overflow, from where the lost read was issued
+    std::unique_ptr<WinUsnJournal> mJournal;
+    LONGLONG mReadIssuedUsn = 0;
+#endif
+
     static VOID CALLBACK completion(DWORD dwErrorCode, DWORD dwBytes, LPOVERLAPPED lpOverlapped);
     void process(DWORD wNumberOfBytesTransfered);
     void readchanges();
@@ -143,6 +190,9 @@ public:
     fsfp_t fsfingerprint() const override;
     bool fsstableids() const override;
 
+    // ReadDirectoryChangesW watches the whole tree through the root folder
+    size_t watchCount() const override { return hDirectory != INVALID_HANDLE_VALUE; }
+
     WinDirNotify(const LocalPath&, const LocalPath&, WinFileSystemAccess* owner, Waiter* waiter, LocalNode* syncroot);
     ~WinDirNotify();
 };
@@ -174,6 +224,7 @@ public:
     bool fwrite(const byte *, unsigned, m_off_t);
 
     bool ftruncate() override;
+    bool fpreallocate(m_off_t size) override;
 
     bool sysread(byte *, unsigned, m_off_t) override;
     bool sysstat(m_time_t*, m_off_t*) override;
@@ -22,6 +22,9 @@
 #ifndef MEGAAPI_H
 #define MEGAAPI_H
 
+#include <functional>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 #include <inttypes.h>
@@ -71,14 +74,19 @@ class MegaScheduledCopy;
 class MegaSync;
 class MegaStringList;
 class MegaNodeList;
+class MegaNodeCursor;
+class MegaNodeColumns;
 class MegaUserList;
 class MegaUserAlertList;
 class MegaContactRequestList;
 class MegaShareList;
 class MegaTransferList;
+class MegaTransferColumns;
+class MegaTransferBatch;
 class MegaFolderInfo;
 class MegaTimeZoneDetails;
 class MegaPushNotificationSettings;
+class MegaReadStream;
 class MegaBackgroundMediaUpload;
 class MegaCancelToken;
 class MegaApi;
@@ -2536,6 +2544,148 @@ public:
     virtual MegaNodeList* getFileList();
 };
 
+/**
+ * @brief Lazy, paged list of nodes
+ *
+ * Unlike a MegaNodeList, a MegaNodeCursor doesn't copy the nodes when it's created: it keeps
+ * their handles, in the requested order, and a MegaNode is only created when it's accessed.
+ * That makes listing very large folders cheap when only a part of them is shown at once.
+ *
+ * The handles are those of the nodes when the cursor was created. If a node is removed later,
+ * MegaNodeCursor::get returns NULL for it and MegaNodeCursor::getPage skips it; the MegaNode
+ * objects reflect the node when they are first accessed.
+ *
+ * A MegaNodeCursor can't be used after the MegaApi that created it is deleted.
+ *
+ * @see MegaApi::getChildrenCursor
+ */
+class MegaNodeCursor
+{
+public:
+    virtual ~MegaNodeCursor();
+
+    /**
+     * @brief Returns the number of nodes in the cursor
+     * @return Number of nodes
+     */
+    virtual int size() const;
+
+    /**
+     * @brief Returns the handle of the node at the position i, without creating the MegaNode
+     * @param i Position of the node
+     * @return Handle of the node, or INVALID_HANDLE if the index is >= the size of the cursor
+     */
+    virtual MegaHandle getHandle(int i) const;
+
+    /**
+     * @brief Returns the MegaNode at the position i
+     *
+     * The MegaNode is created the first time it's accessed. The MegaNodeCursor retains its
+     * ownership: it will be only valid until the MegaNodeCursor is deleted.
+     *
+     * @param i Position of the node
+     * @return MegaNode at the position i, or NULL if the index is >= the size of the cursor
+     * or the node doesn't exist anymore
+     */
+    virtual MegaNode* get(int i);
+
+    /**
+     * @brief Returns the nodes from a position of the cursor
+     *
+     * The nodes that don't exist anymore are skipped.
+     *
+     * You take the ownership of the returned value
+     *
+     * @param offset Position of the first node
+     * @param limit Maximum number of positions to return
+     * @return List with the MegaNode objects of the page
+     */
+    virtual MegaNodeList* getPage(int offset, int limit);
+};
+
+/**
+ * @brief Snapshot of the fields of a list of nodes that list and grid views show, by column
+ *
+ * Each column is an array with one value per node, in the order the snapshot was taken in,
+ * so a view can read all the nodes it shows with a few calls instead of several per MegaNode.
+ * The values are those of the nodes when the snapshot was taken: it isn't updated afterwards.
+ *
+ * The arrays are owned by the MegaNodeColumns, and valid until it is deleted.
+ *
+ * @see MegaApi::getChildrenColumns
+ */
+class MegaNodeColumns
+{
+public:
+    enum
+    {
+        FLAG_THUMBNAIL = 0x01,      // the node has a thumbnail (MegaNode::hasThumbnail)
+        FLAG_PREVIEW = 0x02,        // the node has a preview (MegaNode::hasPreview)
+        FLAG_EXPORTED = 0x04,       // the node has a public link (MegaNode::isExported)
+        FLAG_TAKEN_DOWN = 0x08,     // the node has been taken down (MegaNode::isTakenDown)
+        FLAG_OUTSHARE = 0x10,       // the node is shared with other users, or pending to be (MegaNode::isOutShare, MegaApi::isPendingShare)
+        FLAG_FAVOURITE = 0x20,      // the node is a favourite (MegaNode::isFavourite)
+        FLAG_VERSIONS = 0x40,       // the file has previous versions (MegaApi::hasVersions)
+    };
+
+    virtual ~MegaNodeColumns();
+
+    /**
+     * @brief Returns the number of nodes, the length of every column
+     * @return Number of nodes
+     */
+    virtual int size() const;
+
+    /**
+     * @brief Returns the handles of the nodes
+     * @return Array of MegaNodeColumns::size handles
+     */
+    virtual const MegaHandle* getHandles() const;
+
+    /**
+     * @brief Returns the sizes of the nodes, as MegaNode::getSize
+     * @return Array of MegaNodeColumns::size sizes
+     */
+    virtual const long long* getSizes() const;
+
+    /**
+     * @brief Returns the modification times of the nodes, as MegaNode::getModificationTime
+     * @return Array of MegaNodeColumns::size timestamps (in seconds since the epoch)
+     */
+    virtual const long long* getModificationTimes() const;
+
+    /**
+     * @brief Returns the types of the nodes, as MegaNode::getType
+     * @return Array of MegaNodeColumns::size types
+     */
+    virtual const int* getTypes() const;
+
+    /**
+     * @brief Returns the flags of the nodes, combinations of the MegaNodeColumns::FLAG_* values
+     * @return Array of MegaNodeColumns::size flags
+     */
+    virtual const int* getFlags() const;
+
+    /**
+     * @brief Returns the names of the nodes
+     *
+     * The MegaNodeColumns retains the ownership of the list.
+     *
+     * @return List of MegaNodeColumns::size names
+     */
+    virtual MegaStringList* getNames() const;
+
+    /**
+     * @brief Returns the name of the node at the position i
+     *
+     * The MegaNodeColumns retains the ownership of the string.
+     *
+     * @param i Position of the node
+     * @return Name of the node, or NULL if the index is >= the size of the snapshot
+     */
+    virtual const char* getName(int i) const;
+};
+
 /**
  * @brief List of MegaUser objects
  *
@@ -2647,6 +2797,72 @@ class MegaTransferList
         virtual int size();
 };
 
+/**
+ * @brief Set of transfers to start at once
+ *
+ * Starting many transfers one by one means one call, one allocation in the queue of the
+ * SDK and one wake-up of its thread for each of them. Add them to a MegaTransferBatch
+ * instead, and start all of them with a single call to MegaApi::startTransfers.
+ *
+ * @see MegaApi::startTransfers
+ */
+class MegaTransferBatch
+{
+protected:
+    MegaTransferBatch();
+
+public:
+    /**
+     * @brief Creates an empty MegaTransferBatch
+     *
+     * You take the ownership of the returned value.
+     *
+     * @return An empty MegaTransferBatch
+     */
+    static MegaTransferBatch* createInstance();
+
+    virtual ~MegaTransferBatch();
+
+    virtual MegaTransferBatch* copy() const;
+
+    /**
+     * @brief Adds an upload to the batch
+     *
+     * The parameters are the same as in MegaApi::startUpload.
+     *
+     * @param localPath Local path of the file
+     * @param parent Node for the file in the MEGA account
+     * @param fileName Custom file name for the file in MEGA, or NULL to use the local one
+     * @param mtime Custom modification time for the file in MEGA (in seconds since the epoch), or -1 to use the local one
+     * @param appData Custom app data to save in the MegaTransfer object, or NULL
+     * @param isSourceTemporary Whether the local file has to be deleted once uploaded
+     * @param startFirst Whether the transfer goes to the front of the queue
+     */
+    virtual void addUpload(const char* localPath, MegaNode* parent, const char* fileName = NULL, int64_t mtime = -1,
+                           const char* appData = NULL, bool isSourceTemporary = false, bool startFirst = false);
+
+    /**
+     * @brief Adds a download to the batch
+     *
+     * The parameters are the same as in MegaApi::startDownload.
+     *
+     * @param node MegaNode that identifies the file or folder
+     * @param localPath Destination path for the file or folder
+     * If this path is a local folder, it must end with a '\' or '/' character and the file name
+     * in MEGA will be used to store a file inside that folder. If the path doesn't finish with
+     * one of these characters, the file will be downloaded to a file in that path.
+     * @param appData Custom app data to save in the MegaTransfer object, or NULL
+     * @param startFirst Whether the transfer goes to the front of the queue
+     */
+    virtual void addDownload(MegaNode* node, const char* localPath, const char* appData = NULL, bool startFirst = false);
+
+    /**
+     * @brief Returns the number of transfers in the batch
+     * @return Number of transfers in the batch
+     */
+    virtual int size() const;
+};
+
 /**
  * @brief List of MegaContactRequest objects
  *
@@ -3931,6 +4147,16 @@ class MegaRequest
          * @return MegaHandle list
          */
         virtual MegaHandleList* getMegaHandleList() const;
+
+        /**
+         * @brief Returns the trace id of the request
+         *
+         * The API commands sent by the SDK to process this request are tagged with this id,
+         * like those of transfers (see MegaTransfer::getTraceId).
+         *
+         * @return Trace id of the request
+         */
+        virtual unsigned long long getTraceId() const;
 };
 
 /**
@@ -4061,6 +4287,17 @@ class MegaTransfer
             MOVE_TYPE_BOTTOM
         };
 
+        enum {
+            STAGE_QUEUED = 0,
+            STAGE_SLOT_ACQUIRED,
+            STAGE_FIRST_BYTE,
+            STAGE_LAST_BYTE,
+            STAGE_MAC_VERIFIED,
+            STAGE_PUTNODES_SENT,
+            STAGE_PUTNODES_ACKED,
+            STAGE_CALLBACK
+        };
+
         virtual ~MegaTransfer();
 
         /**
@@ -4477,6 +4714,54 @@ class MegaTransfer
          * @return True if target folder was overriden (apps can check the final parent)
          */
         virtual bool getTargetOverride() const;
+
+        /**
+         * @brief Returns the trace id of the transfer
+         *
+         * The SDK tags the work done for a transfer with this id: the requests that carry its
+         * data (see the HTTP events of MegaApi::startTracing) and the API commands sent for it,
+         * such as the one that creates the node of an upload. It is also the trace id of
+         * MegaTransfer::getTraceSpans. It isn't kept when the transfer is resumed in a later session.
+         *
+         * @return Trace id of the transfer, 0 until the SDK starts to process it
+         */
+        virtual unsigned long long getTraceId() const;
+
+        /**
+         * @brief Returns when the transfer reached one of its stages
+         *
+         * Valid values for the stage are:
+         * - MegaTransfer::STAGE_QUEUED = 0: queued in the engine
+         * - MegaTransfer::STAGE_SLOT_ACQUIRED = 1: got a slot to start sending or receiving data
+         * - MegaTransfer::STAGE_FIRST_BYTE = 2: the first data was transferred
+         * - MegaTransfer::STAGE_LAST_BYTE = 3: the last chunk was completed
+         * - MegaTransfer::STAGE_MAC_VERIFIED = 4: the MAC of the download was verified
+         * - MegaTransfer::STAGE_PUTNODES_SENT = 5: the command that creates the node of the upload was queued
+         * - MegaTransfer::STAGE_PUTNODES_ACKED = 6: the API answered that command
+         * - MegaTransfer::STAGE_CALLBACK = 7: MegaTransferListener::onTransferFinish was called
+         *
+         * Retries don't move the stages reached already, except STAGE_LAST_BYTE.
+         *
+         * @param stage Stage of the transfer
+         * @return Microseconds since the epoch, 0 if the stage wasn't reached (or doesn't apply)
+         */
+        virtual int64_t getStageTime(int stage) const;
+
+        /**
+         * @brief Returns the stages of the transfer as OpenTelemetry spans
+         *
+         * The result is an OTLP/JSON ExportTraceServiceRequest, that can be posted to the
+         * /v1/traces endpoint of an OpenTelemetry collector: a root span for the transfer
+         * and a child span from each stage reached to the next one, named after the stage
+         * ("queued", "slot_acquired", "first_byte", "last_byte", "mac_verified", "putnodes_sent",
+         * "putnodes_acked" and "callback").
+         *
+         * You take the ownership of the returned value
+         * Use delete [] to free it.
+         *
+         * @return OTLP/JSON with the spans of the transfer
+         */
+        virtual char* getTraceSpans() const;
 };
 
 /**
@@ -5023,6 +5308,113 @@ public:
     virtual long long getNotificationNumber() const;
 };
 
+/**
+ * @brief Snapshot of the fields of the transfers that transfer views show, by column
+ *
+ * Each column is an array with one value per transfer, in the order of the transfer queue,
+ * so a view can read all the transfers it shows with a few calls instead of several per MegaTransfer.
+ * The values are those of the transfers when the snapshot was taken: it isn't updated afterwards.
+ *
+ * A snapshot can also take only the transfers that changed since a previous one: pass the
+ * MegaTransferColumns::getVersion of the previous snapshot to MegaApi::getTransferColumns,
+ * and the transfers that finished since then are in MegaTransferColumns::getFinishedTags.
+ *
+ * The arrays are owned by the MegaTransferColumns, and valid until it is deleted.
+ *
+ * @see MegaApi::getTransferColumns
+ */
+class MegaTransferColumns
+{
+public:
+    virtual ~MegaTransferColumns();
+
+    /**
+     * @brief Returns the number of transfers, the length of every column
+     * @return Number of transfers
+     */
+    virtual int size() const;
+
+    /**
+     * @brief Returns the tags of the transfers, as MegaTransfer::getTag
+     * @return Array of MegaTransferColumns::size tags
+     */
+    virtual const int* getTags() const;
+
+    /**
+     * @brief Returns the types of the transfers, as MegaTransfer::getType
+     * @return Array of MegaTransferColumns::size types
+     */
+    virtual const int* getTypes() const;
+
+    /**
+     * @brief Returns the states of the transfers, as MegaTransfer::getState
+     * @return Array of MegaTransferColumns::size states
+     */
+    virtual const int* getStates() const;
+
+    /**
+     * @brief Returns the transferred bytes of the transfers, as MegaTransfer::getTransferredBytes
+     * @return Array of MegaTransferColumns::size byte counts
+     */
+    virtual const long long* getTransferredBytes() const;
+
+    /**
+     * @brief Returns the total bytes of the transfers, as MegaTransfer::getTotalBytes
+     * @return Array of MegaTransferColumns::size byte counts
+     */
+    virtual const long long* getTotalBytes() const;
+
+    /**
+     * @brief Returns the speeds of the transfers, as MegaTransfer::getSpeed
+     * @return Array of MegaTransferColumns::size speeds (in bytes per second)
+     */
+    virtual const long long* getSpeeds() const;
+
+    /**
+     * @brief Returns the priorities of the transfers, as MegaTransfer::getPriority
+     * @return Array of MegaTransferColumns::size priorities
+     */
+    virtual const unsigned long long* getPriorities() const;
+
+    /**
+     * @brief Returns the number of transfers that finished since the version the snapshot was asked from
+     * @return Number of finished transfers, the length of MegaTransferColumns::getFinishedTags
+     */
+    virtual int getNumFinished() const;
+
+    /**
+     * @brief Returns the tags of the transfers that finished since the version the snapshot was asked from
+     *
+     * They are no longer in the transfer queue, so they aren't in the other columns.
+     *
+     * @return Array of MegaTransferColumns::getNumFinished tags
+     */
+    virtual const int* getFinishedTags() const;
+
+    /**
+     * @brief Returns whether the snapshot has all the changes since the version it was asked from
+     *
+     * The SDK remembers a limited number of finished transfers. If more than that finished since
+     * the version the snapshot was asked from, some of them are missing from
+     * MegaTransferColumns::getFinishedTags, and a full snapshot (from the version 0) is needed
+     * to know which transfers are still in the queue.
+     *
+     * @return True if no change since the requested version is missing
+     */
+    virtual bool isComplete() const;
+
+    /**
+     * @brief Returns the version of the transfers in the snapshot
+     *
+     * It's the notification number of the SDK when the snapshot was taken (see
+     * MegaTransfer::getNotificationNumber). Pass it to MegaApi::getTransferColumns to get
+     * the transfers that changed after this snapshot.
+     *
+     * @return Version of the snapshot
+     */
+    virtual long long getVersion() const;
+};
+
 
 /**
  * @brief Provides information about a contact request
@@ -5474,6 +5866,93 @@ class MegaSyncList
         virtual void addSync(MegaSync* sync);
 };
 
+/**
+ * @brief Throughput and lag figures of a running synchronization
+ *
+ * Objects of this class are immutable.
+ *
+ * @see MegaApi::getSyncStats
+ */
+class MegaSyncStats
+{
+    protected:
+        MegaSyncStats();
+
+    public:
+        virtual ~MegaSyncStats();
+
+        virtual MegaSyncStats *copy() const;
+
+        /**
+         * @brief Returns the identifier of the synchronization
+         * @return Backup id of the synchronization
+         */
+        virtual MegaHandle getBackupId() const;
+
+        /**
+         * @brief Returns the number of filesystem notifications waiting to be processed
+         * @return Notifications waiting, including the delayed ones of network folders
+         */
+        virtual long long getQueuedNotifications() const;
+
+        /**
+         * @brief Returns the number of notifications waiting to be retried
+         *
+         * Those are items that couldn't be checked because they were locked.
+         *
+         * @return Notifications waiting to be retried
+         */
+        virtual long long getRetryNotifications() const;
+
+        /**
+         * @brief Returns when the whole local tree was last reconciled with the remote one
+         * @return Timestamp (in seconds since the Epoch), 0 if it didn't happen yet
+         */
+        virtual long long getLastFullReconcile() const;
+
+        /**
+         * @brief Returns the number of files checked by scans and filesystem notifications
+         * @return Files checked since the synchronization started
+         */
+        virtual long long getScannedFiles() const;
+
+        /**
+         * @brief Returns how many files were checked per second spent checking them
+         * @return Files per second, 0 if no file was checked yet
+         */
+        virtual double getScannedFilesPerSecond() const;
+
+        /**
+         * @brief Returns the bytes of the uploads of the synchronization not sent yet
+         * @return Bytes pending
+         */
+        virtual long long getPendingUploadBytes() const;
+
+        /**
+         * @brief Returns the number of local items waiting for their remote node to be created
+         * @return Items waiting
+         */
+        virtual long long getPendingPutnodes() const;
+
+        /**
+         * @brief Returns the number of latency samples, see MegaSyncStats::getLatencyP50
+         * @return Local changes taken into account (the latest ones, up to 1024)
+         */
+        virtual long long getLatencySamples() const;
+
+        /**
+         * @brief Returns the median time from a local change being detected to its node existing in MEGA
+         * @return Milliseconds, 0 if no local change was uploaded yet
+         */
+        virtual long long getLatencyP50() const;
+
+        /**
+         * @brief Returns the 99th percentile of the time from a local change being detected to its node existing in MEGA
+         * @return Milliseconds, 0 if no local change was uploaded yet
+         */
+        virtual long long getLatencyP99() const;
+};
+
 
 
 #endif
@@ -6245,6 +6724,72 @@ public:
     virtual ~SynchronousRequestListener();
 };
 
+/**
+ * @brief The request and the error a request finished with, as kept by MegaRequestContinuation
+ */
+struct MegaRequestOutcome
+{
+    std::shared_ptr<MegaRequest> request;
+    std::shared_ptr<MegaError> error;
+};
+
+/**
+ * @brief A MegaRequestListener that continues with a function once the request finishes
+ *
+ * To chain the steps of an operation (create a folder, upload into it, share it) without
+ * nesting listeners or blocking a thread to wait for each step. Pass the listener returned by
+ * MegaRequestContinuation::then or MegaRequestContinuation::future to the request: it's deleted
+ * once the request finishes, and it must be used for a single request.
+ *
+ * By default the function runs in the callback of the SDK thread, where it can start the next
+ * request right away, but must not wait for anything. With an executor, the function is handed
+ * to it to be run wherever the executor decides (a thread pool, the event loop of the app).
+ *
+ * This class is only available in C++.
+ *
+ * @see SynchronousRequestListener
+ */
+class MegaRequestContinuation : public MegaRequestListener
+{
+public:
+    typedef std::function<void(MegaApi* api, MegaRequest* request, MegaError* error)> Function;
+
+    // runs the function it's given, now or later, on any thread
+    typedef std::function<void(std::function<void()>)> Executor;
+
+    /**
+     * @brief Get a listener that calls a function when the request finishes
+     *
+     * Without an executor, the function receives the objects of the SDK, valid until it returns.
+     * With one, it receives copies that are valid until it returns.
+     *
+     * @param function Function to call with the result of the request
+     * @param executor Function that runs the continuation, or empty to run it on the SDK thread
+     * @return Listener to pass to the request
+     */
+    static MegaRequestListener* then(Function function, Executor executor = Executor());
+
+    /**
+     * @brief Get a listener that makes a future ready when the request finishes
+     *
+     * The future holds copies of the MegaRequest and the MegaError of the result. Don't wait for
+     * it from the SDK thread (in the callbacks of other requests), since it's the one that makes
+     * it ready.
+     *
+     * @param result Future set by this function, ready once the request finishes
+     * @return Listener to pass to the request
+     */
+    static MegaRequestListener* future(std::future<MegaRequestOutcome>& result);
+
+    void onRequestFinish(MegaApi* api, MegaRequest* request, MegaError* error) override;
+
+private:
+    MegaRequestContinuation(Function function, Executor executor);
+
+    Function mFunction;
+    Executor mExecutor;
+};
+
 /**
  * @brief Interface to receive information about transfers
  *
@@ -6308,6 +6853,24 @@ class MegaTransferListener
          */
         virtual void onTransferUpdate(MegaApi *api, MegaTransfer *transfer);
 
+        /**
+         * @brief This function is called to inform about the progress of several transfers at once
+         *
+         * It's only called when the updates are batched, see MegaApi::setTransferUpdateBatching.
+         * Then the progress of the transfers that changed during the interval is delivered in a
+         * single call, with the latest state of each transfer, instead of one call to
+         * MegaTransferListener::onTransferUpdate per change.
+         *
+         * The default implementation calls MegaTransferListener::onTransferUpdate for each transfer in the list.
+         *
+         * The SDK retains the ownership of the transfers parameter.
+         * Don't use it after this functions returns.
+         *
+         * @param api MegaApi object that started the transfers
+         * @param transfers Information about the transfers
+         */
+        virtual void onTransfersUpdate(MegaApi *api, MegaTransferList *transfers);
+
         /**
          * @brief This function is called when there is a temporary error processing a transfer
          *
@@ -6350,6 +6913,26 @@ class MegaTransferListener
          * @see MegaApi::startStreaming
          */
         virtual bool onTransferData(MegaApi *api, MegaTransfer *transfer, char *buffer, size_t size);
+
+        /**
+         * @brief This function is called to lend the last read bytes of streaming downloads
+         *
+         * It is the one the SDK calls: its default implementation calls MegaTransferListener::onTransferData.
+         * In the bindings, the buffer is passed without copying it, as a direct java.nio.ByteBuffer in Java
+         * and as a memoryview in Python, while MegaTransferListener::onTransferData copies it.
+         *
+         * The buffer is only lent for the duration of the call: the SDK reuses its memory afterwards, so
+         * copy what you need to keep before returning. In Python, the memoryview is released on return.
+         *
+         * @param api MegaApi object that started the transfer
+         * @param transfer Information about the transfer
+         * @param data Buffer with the last read bytes
+         * @param length Size of the buffer
+         * @return true to continue the transfer, false to cancel it
+         *
+         * @see MegaApi::startStreaming
+         */
+        virtual bool onTransferBuffer(MegaApi *api, MegaTransfer *transfer, char *data, size_t length);
 };
 
 
@@ -6490,6 +7073,9 @@ class MegaGlobalListener
          * When the full account is reloaded or a large number of server notifications arrives at once, the
          * second parameter will be NULL.
          *
+         * A change of many nodes at once (such as the removal of a large folder) can be notified in several
+         * consecutive calls, each one with a part of the nodes.
+         *
          * The SDK retains the ownership of the MegaNodeList in the second parameter. The list and all the
          * MegaNode objects that it contains will be valid until this function returns. If you want to save the
          * list, use MegaNodeList::copy. If you want to save only some of the MegaNode objects, use MegaNode::copy
@@ -6838,6 +7424,24 @@ class MegaListener
          */
         virtual void onTransferUpdate(MegaApi *api, MegaTransfer *transfer);
 
+        /**
+         * @brief This function is called to inform about the progress of several transfers at once
+         *
+         * It's only called when the updates are batched, see MegaApi::setTransferUpdateBatching.
+         * Then the progress of the transfers that changed during the interval is delivered in a
+         * single call, with the latest state of each transfer, instead of one call to
+         * MegaListener::onTransferUpdate per change.
+         *
+         * The default implementation calls MegaListener::onTransferUpdate for each transfer in the list.
+         *
+         * The SDK retains the ownership of the transfers parameter.
+         * Don't use it after this functions returns.
+         *
+         * @param api MegaApi object that started the transfers
+         * @param transfers Information about the transfers
+         */
+        virtual void onTransfersUpdate(MegaApi *api, MegaTransferList *transfers);
+
         /**
          * @brief This function is called when there is a temporary error processing a transfer
          *
@@ -6889,6 +7493,9 @@ class MegaListener
          * When the full account is reloaded or a large number of server notifications arrives at once, the
          * second parameter will be NULL.
          *
+         * A change of many nodes at once (such as the removal of a large folder) can be notified in several
+         * consecutive calls, each one with a part of the nodes.
+         *
          * The SDK retains the ownership of the MegaNodeList in the second parameter. The list and all the
          * MegaNode objects that it contains will be valid until this function returns. If you want to save the
          * list, use MegaNodeList::copy. If you want to save only some of the MegaNode objects, use MegaNode::copy
@@ -7360,7 +7967,8 @@ public:
      * the 'adjustsizeonly' parameter, and iterating from the start of the file, specifying the approximate sizes of the portions.
      *
      * Encryption is done by reading small pieces of the file, encrypting them, and outputting to the new file,
-     * so that RAM usage is not excessive.
+     * so that RAM usage is not excessive. Large portions are encrypted in several parts at once, on the worker
+     * threads of the SDK, while the caller waits.
      *
      * You take ownership of the returned value.
      *
@@ -7466,6 +8074,61 @@ public:
     virtual ~MegaInputStream();
 };
 
+/**
+ * @brief Reads a file in MEGA at any position, as a local file would be read
+ *
+ * The data is downloaded as with MegaApi::startStreaming, and shares its cache (see MegaApi::setStreamingCache).
+ * The stream keeps a buffer of its own, filled ahead of the position of the last read while the reads are
+ * sequential, and never larger than the size given to MegaApi::createReadStream (plus the last piece
+ * received).  A read elsewhere drops the buffer and starts downloading from there.
+ *
+ * The functions of this class block until the data is available: don't call them from the callbacks
+ * of the SDK. A stream is used by one thread at a time.
+ *
+ * Use MegaApi::createReadStream to get an instance of this class. Delete it before the MegaApi.
+ */
+class MegaReadStream
+{
+protected:
+    MegaReadStream();
+
+public:
+    /**
+     * @brief Read data of the file
+     *
+     * @param offset Position of the first byte to read
+     * @param output Buffer where the data is written
+     * @param outputSize Size of the buffer: the maximum number of bytes read
+     * @param timeoutMs Milliseconds to wait for the data at most, -1 to wait as long as it takes
+     * @return The number of bytes read, less than outputSize if less were available, 0 at the end of the
+     * file, or a negative MegaError code:
+     * - MegaError::API_EARGS if the offset is negative
+     * - MegaError::API_EAGAIN if the data didn't arrive in time (the download goes on)
+     * - The error of the download if it failed
+     */
+    virtual long long read(long long offset, char *output, size_t outputSize, int timeoutMs = -1);
+
+    /**
+     * @brief Start downloading data that will be read soon
+     *
+     * It doesn't wait for the data. Use it for the next position of a read that isn't sequential
+     * (eg. a player about to seek). Only one range is fetched at a time: the buffer of the previous
+     * reads is dropped, unless it already covers the offset.
+     *
+     * @param offset Position of the first byte
+     * @param length Number of bytes, up to the size of the buffer of the stream
+     */
+    virtual void prefetch(long long offset, long long length);
+
+    /**
+     * @brief Get the size of the file
+     * @return Size of the file
+     */
+    virtual long long getSize();
+
+    virtual ~MegaReadStream();
+};
+
 class MegaApiImpl;
 
 /**
@@ -7569,6 +8232,12 @@ class MegaApi
             LOG_LEVEL_MAX
         };
 
+        enum {
+            TRACE_HTTP = 0x01,      // every HTTP request: bytes sent and received, duration
+            TRACE_TRANSFER = 0x02,  // every transfer chunk: node or upload handle, chunk size, duration
+            TRACE_GFX = 0x04        // every thumbnail/preview job: handle, attribute bytes, duration
+        };
+
         enum {
             ATTR_TYPE_THUMBNAIL = 0,
             ATTR_TYPE_PREVIEW = 1
@@ -7638,6 +8307,12 @@ class MegaApi
             TRANSFER_METHOD_AUTO_ALTERNATIVE = 4
         };
 
+        enum {
+            ASYNC_CALLBACKS_BLOCK = 0,
+            ASYNC_CALLBACKS_COALESCE = 1,
+            ASYNC_CALLBACKS_DROP = 2
+        };
+
         enum {
             PUSH_NOTIFICATION_ANDROID = 1,
             PUSH_NOTIFICATION_IOS_VOIP = 2,
@@ -7826,6 +8501,20 @@ class MegaApi
 #endif
         virtual ~MegaApi();
 
+        /**
+         * @brief Share worker threads between the MegaApi objects created from now on
+         *
+         * A process with many MegaApi objects (one per account, for example) otherwise has the worker threads
+         * of each of them. With this, the objects created afterwards use a single pool of threads for encryption
+         * and other operations, and the workerThreadCount passed to their constructor is ignored. The objects
+         * created before keep their own threads.
+         *
+         * The threads exit once this is called again and the objects using them are deleted.
+         *
+         * @param threadCount Number of threads of the shared pool, 0 to stop sharing
+         */
+        static void setSharedWorkerThreads(unsigned threadCount);
+
 
         /**
          * @brief Register a listener to receive all events (requests, transfers, global, synchronization)
@@ -9808,14 +10497,133 @@ class MegaApi
         static void setMaxPayloadLogSize(long long maxSize);
 
         /**
-         * @brief Enable log to console
-         *
-         * By default, log to console is false. Logging to console is serialized via a mutex to
-         * avoid interleaving by multiple threads, even in performance mode.
+         * @brief Enable log to console
+         *
+         * By default, log to console is false. Logging to console is serialized via a mutex to
+         * avoid interleaving by multiple threads, even in performance mode.
+         *
+         * @param enable True to show messages in console, false to skip them.
+         */
+        static void setLogToConsole(bool enable);
+
+        /**
+         * @brief Deliver logs to the MegaLogger objects from a background thread
+         *
+         * When enabled, the threads that log only copy each message into a buffer of their own,
+         * without taking any lock, and a background thread passes them to the MegaLogger objects
+         * and to the console. Messages are delivered in order for each thread, but not across threads.
+         *
+         * If a thread logs faster than the background thread delivers, messages that don't fit in
+         * its buffer are dropped, and a warning with the number of lost messages is delivered in
+         * their place. Messages larger than the whole buffer are still delivered from the thread
+         * that logs them.
+         *
+         * Disabling it waits until the pending messages have been delivered.
+         * By default, logs are delivered from the threads that generate them.
+         *
+         * @param enable True to deliver logs from a background thread, false to deliver them
+         * from the threads that generate them.
+         */
+        static void setLogAsynchronous(bool enable);
+
+        enum {
+            THREAD_ROLE_SDK = 0,
+            THREAD_ROLE_WORKER = 1,
+            THREAD_ROLE_GFX = 2,
+            THREAD_ROLE_SERVER = 3,
+            THREAD_ROLE_LOGGER = 4,
+            THREAD_ROLE_IO = 5
+        };
+
+        /**
+         * @brief Set the priority and the CPUs of the threads of the SDK that have a role
+         *
+         * For the threads of the SDK to compete less (or more) with the rest of the system. Each
+         * thread applies the settings of its role as it starts, so this has to be called before
+         * creating the MegaApi objects (or before enabling the features that start threads, like
+         * the local HTTP server or the asynchronous logs) for the settings to apply to them.
+         *
+         * The threads are also given names starting with "mega-", to tell them apart in debuggers
+         * and in the tools of the system.
+         *
+         * These are the roles:
+         * - MegaApi::THREAD_ROLE_SDK = 0: the thread of each MegaApi, and the one delivering callbacks
+         * - MegaApi::THREAD_ROLE_WORKER = 1: encryption and hashing of files
+         * - MegaApi::THREAD_ROLE_GFX = 2: thumbnails and previews
+         * - MegaApi::THREAD_ROLE_SERVER = 3: the local HTTP and FTP servers
+         * - MegaApi::THREAD_ROLE_LOGGER = 4: asynchronous logs and the performance logger
+         * - MegaApi::THREAD_ROLE_IO = 5: asynchronous file IO, folder scans and local databases
+         *
+         * The priority is a nice value, from -20 (highest) to 19 (lowest). It's per thread on Linux
+         * and Android. On macOS and iOS it's mapped to a QoS class, and on Windows to a thread
+         * priority. Raising it above 0 may need privileges that the app doesn't have.
+         *
+         * The CPUs are chosen on Linux, Android and Windows only, and ignored elsewhere.
+         *
+         * @param role Role of the threads to set up
+         * @param priority Nice value for the threads, 0 to leave them as they are
+         * @param cpuMask Bit n set for the threads to run on CPU n, 0 for any
+         */
+        static void setThreadSettings(int role, int priority, long long cpuMask);
+
+        /**
+         * @brief Set where the SDK takes the memory of its object pools from
+         *
+         * The objects that the SDK creates and destroys all the time (the nodes of the accounts,
+         * the requests and pieces of the transfers, the MegaTransfer objects of the callbacks)
+         * are carved from large blocks. This routes those blocks to the allocator of the app,
+         * for example an arena of its own. The rest of the memory of the SDK is not affected.
+         *
+         * This has to be called before creating any MegaApi object, and not again afterwards.
+         * Both functions are called from any thread.
+         *
+         * @param allocate Function returning a block of the size requested, suitably aligned for
+         * any object, or NULL to restore the default allocator
+         * @param release Function releasing a block returned by allocate, given its size too, or
+         * NULL to restore the default allocator
+         */
+        static void setPoolAllocator(void* (*allocate)(size_t size), void (*release)(void* block, size_t size));
+
+        /**
+         * @brief Start writing a binary trace of timed events to a file
+         *
+         * Each event is a fixed-size record with an event id, the time it ended, its duration
+         * and, where relevant, the handle of the node or upload (for HTTP events, the trace id of
+         * the transfer, see MegaTransfer::getTraceId) and the number of bytes involved.
+         * It is cheap enough to be left enabled where verbose logs would be too expensive.
+         * contrib/tools/trace2chrome.py converts a trace into the Chrome trace event format.
+         *
+         * A trace already in progress is stopped first. Every event of the enabled subsystems
+         * is recorded, unless sampling is configured with MegaApi::setTraceSampling.
+         *
+         * @param path Path of the trace file, it will be overwritten
+         * @param subsystems Bitmask of subsystems to trace:
+         * - MegaApi::TRACE_HTTP = 0x01
+         * - MegaApi::TRACE_TRANSFER = 0x02
+         * - MegaApi::TRACE_GFX = 0x04
+         * @return False if the file can't be created
+         */
+        static bool startTracing(const char* path, int subsystems);
+
+        /**
+         * @brief Change the subsystems traced by the trace in progress
+         *
+         * @param subsystems Bitmask of subsystems to trace (see MegaApi::startTracing), 0 to pause
+         */
+        static void setTracedSubsystems(int subsystems);
+
+        /**
+         * @brief Record only a sample of the events of some subsystems
          *
-         * @param enable True to show messages in console, false to skip them.
+         * @param subsystems Bitmask of subsystems to configure (see MegaApi::startTracing)
+         * @param oneIn One event out of every oneIn is recorded, 1 records them all
          */
-        static void setLogToConsole(bool enable);
+        static void setTraceSampling(int subsystems, int oneIn);
+
+        /**
+         * @brief Write the pending events and close the trace file
+         */
+        static void stopTracing();
 
         /**
          * @brief Add a MegaLogger implementation to receive SDK logs
@@ -10359,6 +11167,9 @@ class MegaApi
          * If the node doesn't have a thumbnail the request fails with the MegaError::API_ENOENT
          * error code
          *
+         * Thumbnails fetched before, even in previous sessions, are taken from a cache kept by the SDK
+         * in its base path. It's limited to 100 MB and emptied on logout.
+         *
          * The associated request type with this request is MegaRequest::TYPE_GET_ATTR_FILE
          * Valid data in the MegaRequest object received on callbacks:
          * - MegaRequest::getNodeHandle - Returns the handle of the node
@@ -10384,6 +11195,9 @@ class MegaApi
          * If the node doesn't have a preview the request fails with the MegaError::API_ENOENT
          * error code
          *
+         * Previews fetched before, even in previous sessions, are taken from a cache kept by the SDK
+         * in its base path. It's limited to 100 MB and emptied on logout.
+         *
          * The associated request type with this request is MegaRequest::TYPE_GET_ATTR_FILE
          * Valid data in the MegaRequest object received on callbacks:
          * - MegaRequest::getNodeHandle - Returns the handle of the node
@@ -11297,6 +12111,36 @@ class MegaApi
          */
         void fetchNodes(MegaRequestListener *listener = NULL);
 
+        /**
+         * @brief Enable or disable the mode for accounts of millions of nodes
+         *
+         * In this mode, resuming a session loads the nodes from the local cache as they are
+         * needed (the children of a folder when it's browsed, the ancestors of a node when it's
+         * looked up), instead of the whole tree at once. The older versions of the files are left
+         * in the local cache after fetchNodes too. A snapshot of the tree is kept next to the local
+         * cache, so the next resume doesn't have to read every node.
+         *
+         * The results of the functions of the SDK don't change. Those that need the whole tree
+         * (a search by name or by type, or the first list of recent files, for instance) load the
+         * rest of it the first time, and take longer that time.
+         *
+         * This has to be called before logging in or resuming a session (or after logging out).
+         * The mode is kept until this is called again. A local cache written without the mode can
+         * be used with it: the first resume reads the node headers once, and the snapshot is
+         * written from then on.
+         *
+         * @param enable True to enable the mode, false to disable it
+         * @return False if a session is open, and the mode was not changed
+         */
+        bool setLargeAccountMode(bool enable);
+
+        /**
+         * @brief Check if the mode for accounts of millions of nodes is enabled
+         *
+         * @return True if it is enabled (see MegaApi::setLargeAccountMode)
+         */
+        bool isLargeAccountMode();
+
         /**
          * @brief Get the sum of sizes of all the files stored in the MEGA cloud.
          *
@@ -12820,6 +13664,22 @@ class MegaApi
          */
         void startDownloadWithTopPriority(MegaNode* node, const char* localPath, const char *appData, MegaTransferListener *listener = NULL);
 
+        /**
+         * @brief Start several uploads and downloads at once
+         *
+         * The transfers are queued together: the SDK takes them in one go and starts them in
+         * big batches, each under a single database transaction. Each of them is a regular
+         * transfer: the callbacks are the same as if it had been started with
+         * MegaApi::startUpload or MegaApi::startDownload.
+         *
+         * The listener receives the callbacks of all the transfers of the batch, so it can track
+         * them as a whole (see also MegaApi::setTransferUpdateBatching).
+         *
+         * @param transfers Transfers to start. The SDK doesn't take the ownership of the object.
+         * @param listener MegaTransferListener to track the transfers
+         */
+        void startTransfers(MegaTransferBatch* transfers, MegaTransferListener *listener = NULL);
+
         /**
          * @brief Start an streaming download for a file in MEGA
          *
@@ -12857,6 +13717,112 @@ class MegaApi
          */
         void setStreamingMinimumRate(int bytesPerSecond);
 
+        /**
+         * @brief Set up the cache of the files being streamed
+         *
+         * The data of a file downloaded with startStreaming() is kept for a while, so that overlapping
+         * or repeated reads (eg. a player seeking back, or two clients of the HTTP proxy server playing
+         * the same file) are served from it instead of being downloaded again. When a file is being
+         * read sequentially, the SDK also reads ahead of the last position requested, so that the next
+         * request is served from the cache.
+         *
+         * The cache of a file is kept until a few minutes after its last read ends.
+         * By default, up to 16 MB are kept in memory for each file, and 4 MB are read ahead.
+         *
+         * @param memoryBytes Bytes kept in memory for each file. Use 0 to disable the cache.
+         * @param readAheadBytes Bytes to read ahead of a sequential read. Use 0 to disable it.
+         * @param spillFolder Folder where the data that doesn't fit in memory is written to, in a
+         * temporary file for each file being streamed. NULL to keep nothing on disk.
+         * @param spillBytes Bytes written to disk for each file, at most.
+         */
+        void setStreamingCache(long long memoryBytes, long long readAheadBytes, const char *spillFolder = NULL, long long spillBytes = 0);
+
+        /**
+         * @brief Open a file in MEGA to read it at any position
+         *
+         * Unlike MegaApi::startStreaming, the data is downloaded as it is read: see MegaReadStream.
+         *
+         * You take the ownership of the returned value. Delete it before this MegaApi.
+         *
+         * @param node MegaNode of the file
+         * @param bufferSize Bytes buffered ahead of the reads at most, 0 for the default (4 MB)
+         * @return The stream, or NULL if the node isn't a file
+         */
+        MegaReadStream* createReadStream(MegaNode* node, long long bufferSize = 0);
+
+        /**
+         * @brief Batch the progress updates of the transfers
+         *
+         * By default, every change in the progress of a transfer is notified to the listeners as
+         * soon as it happens. With many transfers in progress, that means a lot of callbacks.
+         *
+         * When batching is enabled, the updates are coalesced and delivered once per interval:
+         * MegaTransferListener::onTransfersUpdate and MegaListener::onTransfersUpdate receive the
+         * latest state of every transfer that changed during the interval, and the listener of
+         * each transfer receives a single MegaTransferListener::onTransferUpdate.
+         * The other callbacks (start, finish, temporary error, data) aren't batched.
+         *
+         * The SDK works with a resolution of tenths of a second, so the interval is rounded up to it.
+         *
+         * @param milliseconds Interval between the notifications. Use 0 to disable the batching.
+         */
+        void setTransferUpdateBatching(int milliseconds);
+
+        /**
+         * @brief Batch the notifications about changes in the nodes
+         *
+         * By default, MegaListener::onNodesUpdate and MegaGlobalListener::onNodesUpdate are called
+         * for every set of changes received from the server.
+         *
+         * When batching is enabled, the changes are accumulated and delivered once per interval.
+         * A node that changed several times during the interval is only included once, with its
+         * latest state, and MegaNode::getChanges returns all the changes it had during the interval.
+         *
+         * The SDK works with a resolution of tenths of a second, so the interval is rounded up to it.
+         *
+         * @param milliseconds Interval between the notifications. Use 0 to disable the batching.
+         */
+        void setNodeUpdateBatching(int milliseconds);
+
+        /**
+         * @brief Deliver the callbacks from a thread of their own
+         *
+         * By default, the callbacks are called from the thread of the SDK, so a listener that takes long
+         * to return delays the network, the transfers and the processing of the changes in the account.
+         *
+         * When asynchronous callbacks are enabled, the callbacks about transfers (except
+         * MegaTransferListener::onTransferData) and the global ones (onNodesUpdate, onUsersUpdate,
+         * onUserAlertsUpdate, onContactRequestsUpdate, onAccountUpdate, onReloadNeeded, onEvent and
+         * onChatsUpdate) are queued and delivered from another thread, in the same order. They receive
+         * copies of the objects, as the originals may have changed or be gone when they are delivered.
+         * The callbacks about requests, syncs and backups are still called from the thread of the SDK.
+         *
+         * The queue is bounded. When it's full, the thread of the SDK waits for room, up to one
+         * second (listeners can call the SDK from the callbacks, and it could be waiting for them).
+         * The backpressure policy decides what happens with the progress updates of the transfers:
+         * - MegaApi::ASYNC_CALLBACKS_BLOCK = 0
+         * They wait for room like the other callbacks.
+         *
+         * - MegaApi::ASYNC_CALLBACKS_COALESCE = 1
+         * While an update of a transfer is still in the queue, a newer one replaces it.
+         *
+         * - MegaApi::ASYNC_CALLBACKS_DROP = 2
+         * They are discarded when the queue is full.
+         *
+         * Once removeListener, removeGlobalListener or removeTransferListener returns, the listener won't
+         * receive the callbacks that were still queued, and it isn't in use, so it can be deleted. The
+         * exception are the calls from the callbacks that still run in the thread of the SDK (eg. in
+         * onRequestFinish): they don't wait for the listener to return from a callback in progress.
+         *
+         * The callbacks queued so far are delivered before this function returns. It can't be called
+         * from an asynchronous callback.
+         *
+         * @param enable True to deliver the callbacks from their own thread, false to go back to the default
+         * @param queueSize Maximum number of callbacks queued
+         * @param backpressure What to do with the progress updates of the transfers when the queue is full
+         */
+        void setAsyncCallbacks(bool enable, int queueSize = 1024, int backpressure = ASYNC_CALLBACKS_COALESCE);
+
         /**
          * @brief Cancel a transfer
          *
@@ -13314,6 +14280,48 @@ class MegaApi
          */
         bool setMaxUploadSpeed(long long bpslimit);
 
+        enum {
+            BANDWIDTH_CLASS_STREAMING = 0,
+            BANDWIDTH_CLASS_FOREGROUND = 1,
+            BANDWIDTH_CLASS_SYNC = 2,
+            BANDWIDTH_CLASS_BACKUP = 3
+        };
+
+        /**
+         * @brief Add a policy for the share of the bandwidth of a class of transfers
+         *
+         * The transfers are in classes: streaming (MegaApi::startStreaming), foreground
+         * (the transfers started by the app), sync (those of syncs) and backup (those of
+         * backup syncs). When the maximum download or upload speed is set, the classes
+         * with transfers in progress share it by their weights: a class gets at least its
+         * share, and whatever the others leave. By default the weights are 8, 4, 2 and 1,
+         * so streaming playback keeps most of the bandwidth while a backup runs. A class
+         * can have a maximum speed of its own, too, also when there is no overall limit.
+         *
+         * A policy applies from the minute of the (local) day fromMinute until toMinute,
+         * wrapping around midnight if toMinute < fromMinute, so a backup can have more
+         * bandwidth at night. The first policy added for a class that applies at a time
+         * is used, or the default if none.
+         *
+         * Currently, this method is only available using the cURL-based network layer.
+         *
+         * @param bandwidthClass MegaApi::BANDWIDTH_CLASS_STREAMING, BANDWIDTH_CLASS_FOREGROUND,
+         * BANDWIDTH_CLASS_SYNC or BANDWIDTH_CLASS_BACKUP
+         * @param weight Share of the class, at least 1
+         * @param maxDownloadSpeed Maximum download speed of the class, in bytes per second (<= 0 for none)
+         * @param maxUploadSpeed Maximum upload speed of the class, in bytes per second (<= 0 for none)
+         * @param fromMinute First minute of the day the policy applies, 0 to 1439
+         * @param toMinute Minute of the day the policy stops applying, 1 to 1440
+         * @return false if a parameter is invalid
+         */
+        bool addBandwidthPolicy(int bandwidthClass, int weight, long long maxDownloadSpeed, long long maxUploadSpeed,
+                                int fromMinute = 0, int toMinute = 24 * 60);
+
+        /**
+         * @brief Remove the policies added by MegaApi::addBandwidthPolicy
+         */
+        void clearBandwidthPolicies();
+
         /**
          * @brief Get the maximum download speed in bytes per second
          *
@@ -13332,6 +14340,259 @@ class MegaApi
          */
         int getMaxUploadSpeed();
 
+        /**
+         * @brief Adapt the number of connections of each transfer to its speed
+         *
+         * When enabled, transfers start with the number of connections set by MegaApi::setMaxConnections,
+         * then add connections while that makes them faster (up to 6), and drop them when they
+         * aren't needed. The size of the requests is adapted to the speed too.
+         * Cloudraid downloads always use one connection per part.
+         *
+         * The setting applies to the transfers started after the call. It's disabled by default.
+         *
+         * @param enable True to adapt the number of connections, false to keep it fixed
+         */
+        void setAdaptiveConnections(bool enable);
+
+        /**
+         * @brief Limit the memory used by the requests in flight of each transfer
+         *
+         * Smaller requests are made so that, together, those in flight for a transfer don't take
+         * more than this. Requests are at least 1 MB, so with a very low limit a transfer may use
+         * fewer connections than set by MegaApi::setMaxConnections.
+         * Cloudraid downloads are not limited.
+         *
+         * The setting applies to the transfers started after the call.
+         *
+         * @param bytes Maximum bytes per transfer. 0 (or a negative value) means no limit, the default
+         */
+        void setMaxTransferMemory(long long bytes);
+
+        /**
+         * @brief Limit the memory used by the buffers of all transfers together
+         *
+         * This covers the data of downloads until it's written to the file (including cloudraid
+         * parts waiting to be combined), and the data of uploads until it's sent.
+         * While the limit is reached, transfers don't start new requests until others release
+         * some memory. Each transfer can always have one request though, so the limit may be
+         * exceeded by about one request per transfer.
+         *
+         * The setting applies immediately.
+         *
+         * @param bytes Maximum bytes. 0 (or a negative value) means no limit, the default
+         */
+        void setTransferMemoryBudget(long long bytes);
+
+        /**
+         * @brief Use HTTP/2 for the requests to HTTPS servers
+         *
+         * Requests to the same server are then multiplexed over one connection (up to 32 at a time)
+         * instead of each needing its own, which saves the TCP and TLS handshakes of new connections.
+         * Transfers to storage servers over plain HTTP keep using HTTP/1.1.
+         *
+         * The setting applies to new requests. It's disabled by default.
+         *
+         * @param enable True to use HTTP/2, false to use HTTP/1.1
+         * @return False if the network layer doesn't support HTTP/2
+         */
+        bool setHttp2(bool enable);
+
+        /**
+         * @brief Send several batches of API requests at a time
+         *
+         * Requests that only read data and that no later request depends on (getting download
+         * URLs, public link details, thumbnail servers, transfer quota checks) then go in batches
+         * of their own, sent while the batch of the other requests is still in flight. The other
+         * requests keep being sent one batch at a time, in the order they were made.
+         *
+         * The setting applies to new requests. It's 1 (one batch at a time) by default.
+         *
+         * @param count Maximum number of batches in flight
+         */
+        void setMaxApiRequestsInFlight(unsigned count);
+
+        /**
+         * @brief Set the number of threads fingerprinting the files of uploads and new syncs
+         *
+         * Before an upload starts, and before a new sync creates the local node of a file, some
+         * parts of the file (or the whole file, if it's small) are read to fingerprint it. The
+         * SDK reads them on this number of threads, for the uploads waiting in the queue, so
+         * it doesn't wait for the disk meanwhile.
+         *
+         * Each device (drive or volume) is read by readsPerDevice threads at most, so a slow
+         * device doesn't delay the files of the others.
+         *
+         * Changing the setting makes the files being fingerprinted (and the ones waiting)
+         * to be read on the SDK thread. Set threads to 0 to always read them on the SDK thread.
+         * It's 4 threads, and 2 reads per device, by default.
+         *
+         * @param threads Number of fingerprint threads
+         * @param readsPerDevice Maximum number of files of a device read at the same time
+         */
+        void setFingerprintThreads(unsigned threads, unsigned readsPerDevice);
+
+        /**
+         * @brief Index the chunks of the files uploaded from this size
+         *
+         * The fingerprint threads read the whole file of such an upload, while it's being uploaded,
+         * and split it in chunks whose boundaries depend on their content, so an edit in the middle
+         * of the file changes the chunks around it only. The chunks of each upload are kept in the
+         * local cache of the transfers, keyed by its fingerprint, in place of those of the version it
+         * replaces. When the next version of the file is uploaded, the SDK logs how much of it is
+         * unchanged since that version, and in how many ranges.
+         *
+         * Every version of a file is encrypted with a key of its own, so the whole file is still
+         * uploaded. Uploads of sync folders aren't indexed. It's 0 (disabled) by default.
+         *
+         * @param minSize Minimum size of the files indexed, 0 for none
+         */
+        void setUploadChunkIndexMinSize(long long minSize);
+
+        /**
+         * @brief Make this MegaApi lighter, to browse public folder links only
+         *
+         * Meant for services that list the content of many folder links: one after another
+         * with the same MegaApi (MegaApi::loginToFolder, MegaApi::fetchNodes, then MegaApi::logout),
+         * or with several MegaApi objects in the same process (see MegaApi::setSharedWorkerThreads).
+         *
+         * In this mode no local database is opened: the nodes of the folder aren't written to a
+         * local cache (MegaApi::fetchNodes finishes as soon as they are received, and the next
+         * login to the same link fetches them again), and transfers and other status aren't kept
+         * between sessions. The files aren't indexed by fingerprint either, so
+         * MegaApi::getNodeByFingerprint and similar don't find them.
+         *
+         * Set it before MegaApi::loginToFolder, it's disabled by default.
+         *
+         * @param enable True to browse folder links only
+         */
+        void setLinkBrowserMode(bool enable);
+
+        enum {
+            LATENCY_API_CS = 0,
+            LATENCY_API_SC = 1,
+            LATENCY_STORAGE_GET = 2,
+            LATENCY_STORAGE_PUT = 3
+        };
+
+        /**
+         * @brief Get the latencies and errors of the requests to a kind of MEGA server
+         *
+         * The SDK keeps them since the MegaApi was created, and uses them to decide how long
+         * to wait before retrying API requests and transfer chunks.
+         *
+         * The result is a JSON object:
+         * - "responses" and "errors": number of responses received and of requests that failed
+         * (including timeouts and requests the server asked to retry)
+         * - "recenterrorrate": fraction of the recent requests that failed, from 0 to 1
+         * - "p50", "p90" and "p99": latency in milliseconds within which that percentage of
+         * the responses arrived (to a power of two)
+         * - "buckets": number of responses that took less than 1, 2, 4, ... milliseconds, the
+         * last one counting the slower ones
+         *
+         * Latencies of the server-client channel (MegaApi::LATENCY_API_SC) include the time the
+         * server holds the request until there is something new.
+         *
+         * You take the ownership of the returned value
+         * Use delete [] to free it.
+         *
+         * @param endpoint One of MegaApi::LATENCY_API_CS, MegaApi::LATENCY_API_SC,
+         * MegaApi::LATENCY_STORAGE_GET or MegaApi::LATENCY_STORAGE_PUT
+         * @return JSON with the statistics, or NULL if the endpoint is not valid
+         */
+        char* getLatencyHistogram(int endpoint);
+
+        /**
+         * @brief Get the performance metrics that the SDK keeps since the MegaApi was created
+         *
+         * They are always collected, at a negligible cost, so apps can sample them periodically
+         * in production. This call doesn't wait for the SDK thread. Values are never reset:
+         * compare two samples to get the rates in between.
+         *
+         * The result is a JSON object:
+         * - "timers": for each major part of the SDK loop and of the network layer, and for the
+         * database commits, an object with
+         * the number of runs ("count"), runs in progress ("inprogress"), total time in milliseconds
+         * ("ms") and the distribution of the durations in microseconds ("us"): "count", "p50",
+         * "p90", "p99" and "max", and "buckets" as [lower bound, count] pairs of the non-empty ones
+         * (each bucket spans 1/8 of the power of two it belongs to)
+         * - "durations": milliseconds spent waiting for API responses and with transfers active
+         * - "counters": API requests and batches sent and completed, transfer starts, finishes,
+         * temporary errors and failures, the reasons why the SDK loop didn't wait, and bytes
+         * downloaded and uploaded
+         * - "gauges": current ("value") and highest ("peak") number of API batches waiting to be
+         * sent, transfer slots, queued transfers, file attributes being uploaded, download and upload
+         * speed (bytes per second), nodes, filesystem notifications queued by the syncs, milliseconds
+         * since the action packets being processed arrived ("sclag"), jobs waiting for a worker
+         * thread and for the thumbnail and preview generator, and bytes held in memory by transfers
+         * - "memory": current and highest bytes held by the main owners of memory in the SDK: "nodes",
+         * "localnodes" (sync tree), "http_buffers", "raid_buffers" (transfer pieces), "streaming_buffers"
+         * (HTTP proxy server), "streaming_cache" (data of the files being streamed kept in memory),
+         * "file_attributes" (thumbnails and previews kept in memory), "user_alerts" and "log_buffers".
+         * These are estimates of the structures themselves: strings and maps hanging from them are not
+         * included. MegaApi::trimMemory releases part of them
+         * - "execphases": time (us) spent in each phase of the SDK loop ("procsc", "csresponse",
+         * "syncdown", "syncup", "transferslots", "dbcommit", "notifypurge", "appcallbacks" and "other"),
+         * in total and for each of the last iterations, and the number of iterations slower than
+         * "slowthresholdms". Slow iterations are also logged as warnings with their breakdown
+         *
+         * You take the ownership of the returned value
+         * Use delete [] to free it.
+         *
+         * @return JSON with the metrics
+         */
+        char* getPerformanceMetrics();
+
+        /**
+         * @brief Get the breakdown of the startup of this MegaApi
+         *
+         * Times the phases between the creation of the MegaApi and the first MegaRequestListener::onRequestFinish
+         * of a MegaRequest::TYPE_FETCH_NODES request, to tell where the time of a cold start goes. Only the
+         * first run of each phase is kept. This call doesn't wait for the SDK thread.
+         *
+         * The result is a JSON object with a member for each phase that has run, with when it started
+         * ("startms") in milliseconds since the MegaApi was created, and how long it took ("ms"):
+         * - "api_init": the constructor of the MegaApi, including the following two
+         * - "gfx_init": the start of the thumbnail and preview generator
+         * - "client_init": the creation of the SDK engine
+         * - "db_open": the opening of the local cache of the account
+         * - "fetchsc": the load of the nodes, users and contact requests from the local cache
+         * - "userdata": the request of the user data that completes a load from the local cache
+         * - "sync_resume": the resumption of the syncs
+         * - "fetchnodes": from the call to MegaApi::fetchNodes to its result
+         *
+         * You take the ownership of the returned value
+         * Use delete [] to free it.
+         *
+         * @return JSON with the startup phases
+         */
+        char* getStartupProfile();
+
+        enum {
+            TRIM_MEMORY_MODERATE = 1,
+            TRIM_MEMORY_CRITICAL = 2
+        };
+
+        /**
+         * @brief Release memory that the SDK keeps to go faster, when the system is short of it
+         *
+         * Meant to be called from the memory warnings of the platform (onTrimMemory on Android,
+         * didReceiveMemoryWarning on iOS). What is released is loaded or downloaded again when needed:
+         * - the data of the files being streamed kept in memory, the half least recently used with
+         * MegaApi::TRIM_MEMORY_MODERATE, all of it with MegaApi::TRIM_MEMORY_CRITICAL (the part
+         * spilled to disk stays, see MegaApi::setStreamingCache)
+         * - the thumbnails and previews kept in memory, the same way
+         * - the oldest half of the user alerts with MegaApi::TRIM_MEMORY_MODERATE, all but the latest
+         * 50 with MegaApi::TRIM_MEMORY_CRITICAL
+         * - the buffers kept for the responses of the API, and the page cache of the local databases
+         *
+         * This call waits for the SDK thread. The amount released by each owner is logged, and the
+         * "memory" gauges of MegaApi::getPerformanceMetrics reflect it.
+         *
+         * @param level MegaApi::TRIM_MEMORY_MODERATE or MegaApi::TRIM_MEMORY_CRITICAL
+         * @return Bytes released (an estimate)
+         */
+        long long trimMemory(int level);
+
         /**
          * @brief Return the current download speed
          * @return Download speed in bytes per second
@@ -13486,6 +14747,33 @@ class MegaApi
          */
         MegaTransferList *getTransfers(int type);
 
+        /**
+         * @brief Get a snapshot of the transfers of a specific type by columns, for transfer views
+         *
+         * The tags, states, transferred and total bytes, speeds and priorities of the transfers are
+         * taken at once, in the order of the transfer queue, without creating a MegaTransfer for each
+         * of them.
+         *
+         * With a version from MegaTransferColumns::getVersion, only the transfers that changed after
+         * that snapshot are taken, and the transfers that finished meanwhile are in
+         * MegaTransferColumns::getFinishedTags. The changes of a transfer count from the callback
+         * that reports them (see MegaTransfer::getNotificationNumber).
+         *
+         * The offset and the limit page the transfers taken, in the order of the queue.
+         *
+         * If the type isn't MegaTransfer::TYPE_DOWNLOAD or MegaTransfer::TYPE_UPLOAD
+         * the snapshot is empty.
+         *
+         * You take the ownership of the returned value
+         *
+         * @param type MegaTransfer::TYPE_DOWNLOAD or MegaTransfer::TYPE_UPLOAD
+         * @param since Version of a previous snapshot, or 0 for all the transfers
+         * @param offset Number of transfers to skip
+         * @param limit Maximum number of transfers to take, or 0 for all the rest
+         * @return Columns of the transfers
+         */
+        MegaTransferColumns *getTransferColumns(int type, long long since = 0, int offset = 0, int limit = 0);
+
         /**
          * @brief Get a list of transfers that belong to a folder transfer
          *
@@ -14099,6 +15387,36 @@ class MegaApi
          */
         void setExclusionUpperSizeLimit(long long limit);
 
+        /**
+         * @brief Set the number of threads listing the local folders of new syncs
+         *
+         * When a sync is added, its local folders are listed, and its files opened and fingerprinted,
+         * on this number of threads. The SDK thread only creates the local nodes from their results,
+         * which makes the initial scan of large folders, or of folders in network drives, much faster.
+         *
+         * Syncs resumed from the cache, and any changes detected later, are still scanned on the
+         * SDK thread. Set it to 0 to scan new syncs on the SDK thread too.
+         *
+         * The setting applies to the syncs added later. It's 4 by default.
+         *
+         * @param threads Number of scan threads
+         */
+        void setSyncScanThreads(unsigned threads);
+
+        /**
+         * @brief Enable or disable the resume scan of the syncs restored from the cache
+         *
+         * The local cache keeps the modification time of every synced folder at the moment its
+         * entries last matched the cached ones. After a restart, the folders whose modification
+         * time hasn't changed since then aren't listed again: only their cached entries are checked,
+         * which saves reading every folder of large syncs.
+         *
+         * This isn't used for filesystems without stable file IDs (eg. FAT). It's enabled by default.
+         *
+         * @param enable True to skip listing the unchanged folders, false to always list them
+         */
+        void setSyncResumeScan(bool enable);
+
         /**
          * @brief Move a local file to the local "Debris" folder
          *
@@ -14154,6 +15472,16 @@ class MegaApi
          */
         MegaSync *getSyncByBackupId(MegaHandle backupId);
 
+        /**
+         * @brief Get the throughput and lag figures of a running synchronization
+         *
+         * You take the ownership of the returned value
+         *
+         * @param backupId Identifier of the Sync (unique per user, provided by API)
+         * @return Figures of the synchronization, or NULL if it isn't running
+         */
+        MegaSyncStats *getSyncStats(MegaHandle backupId);
+
         /**
          * @brief getSyncByNode Get the synchronization associated with a node
          *
@@ -14561,6 +15889,26 @@ class MegaApi
          */
         MegaNodeList* getChildren(MegaNode *parent, int order = 1);
 
+        /**
+         * @brief Get a page of the children of a node
+         *
+         * It returns the same nodes as MegaApi::getChildren from the position offset, up to limit of them.
+         * For folders with many children, the children stay sorted in the common orders (from
+         * MegaApi::ORDER_DEFAULT_ASC to MegaApi::ORDER_MODIFICATION_DESC, and the alphabetical ones)
+         * once they are requested, so paging through them doesn't sort the folder each time.
+         *
+         * If the parent node doesn't exist or it isn't a folder, this function returns an empty list
+         *
+         * You take the ownership of the returned value
+         *
+         * @param parent Parent node
+         * @param order Order for the returned list, with the values MegaApi::getChildren takes
+         * @param offset Position of the first child to return
+         * @param limit Maximum number of children to return
+         * @return List with the child MegaNode objects of the page
+         */
+        MegaNodeList* getChildren(MegaNode *parent, int order, int offset, int limit);
+
         /**
          * @brief Get all children of a list of MegaNodes
          *
@@ -14627,6 +15975,39 @@ class MegaApi
          */
         MegaNodeList* getChildren(MegaNodeList *parentNodes, int order = 1);
 
+        /**
+         * @brief Get a lazy, paged list of the children of a node
+         *
+         * The children are sorted when the cursor is created, but the MegaNode objects are only
+         * created when they are accessed, so it is much cheaper than MegaApi::getChildren for
+         * folders with many children.
+         *
+         * If the parent node doesn't exist or it isn't a folder, the cursor is empty.
+         *
+         * You take the ownership of the returned value
+         *
+         * @param parent Parent node
+         * @param order Order of the children, with the values MegaApi::getChildren takes
+         * @return Cursor over the child nodes
+         */
+        MegaNodeCursor* getChildrenCursor(MegaNode *parent, int order = 1);
+
+        /**
+         * @brief Get a snapshot of the children of a node by columns, for list and grid views
+         *
+         * The handles, names, sizes, modification times, types and flags of all the children are
+         * taken at once, in the requested order, without creating a MegaNode for each of them.
+         *
+         * If the parent node doesn't exist or it isn't a folder, the snapshot is empty.
+         *
+         * You take the ownership of the returned value
+         *
+         * @param parent Parent node
+         * @param order Order of the children, with the values MegaApi::getChildren takes
+         * @return Columns of the child nodes
+         */
+        MegaNodeColumns* getChildrenColumns(MegaNode *parent, int order = 1);
+
         /**
          * @brief Get all versions of a file
          * @param node Node to check
@@ -14878,6 +16259,20 @@ class MegaApi
         */
         MegaUserAlertList* getUserAlerts();
 
+        /**
+        * @brief Get a page of the MegaUserAlerts for the logged in user
+        *
+        * It returns the same alerts as MegaApi::getUserAlerts from the position offset, up to limit of them,
+        * so that only those are built.  The SDK keeps the most recent 1000 alerts.
+        *
+        * You take the ownership of the returned value
+        *
+        * @param offset Position of the first alert to return
+        * @param limit Maximum number of alerts to return
+        * @return List of MegaUserAlert objects of the page
+        */
+        MegaUserAlertList* getUserAlerts(int offset, int limit);
+
         /**
          * @brief Get the number of unread user alerts for the logged in user
          *
@@ -17230,6 +18625,37 @@ class MegaApi
          */
         bool httpServerIsSubtitlesSupportEnabled();
 
+        /**
+         * @brief Enable/disable the /metrics route of the HTTP proxy server
+         *
+         * When enabled, GET /metrics returns the performance metrics of the SDK in the Prometheus
+         * text exposition format, so they can be scraped without app code: time spent in the main
+         * parts of the SDK loop and in database commits, API requests sent and waiting, lag of the
+         * action packets, transfers in flight and queued, bytes transferred and current speed per
+         * direction, jobs waiting for worker threads, queued sync notifications, the number of
+         * nodes, the memory held per owner and the time spent in each phase of the SDK loop. See MegaApi::getPerformanceMetrics for the same values as JSON.
+         *
+         * The route doesn't depend on the restricted mode. Nothing that identifies files or the
+         * account is exposed, but keep the server local (see MegaApi::httpServerStart) unless the
+         * network is trusted.
+         *
+         * This feature is disabled by default.
+         *
+         * @param enable True to serve /metrics, false to answer it like any unknown path
+         */
+        void httpServerEnableMetrics(bool enable);
+
+        /**
+         * @brief Check if the /metrics route of the HTTP proxy server is enabled
+         *
+         * See MegaApi::httpServerEnableMetrics.
+         *
+         * This feature is disabled by default.
+         *
+         * @return true if /metrics is served, otherwise false
+         */
+        bool httpServerIsMetricsEnabled();
+
         /**
          * @brief Add a listener to receive information about the HTTP proxy server
          *
@@ -17399,6 +18825,35 @@ class MegaApi
          */
         int httpServerGetMaxOutputSize();
 
+        /**
+         * @brief Set the number of threads used by the HTTP proxy server to serve clients
+         *
+         * By default, the HTTP proxy server handles all connections in a single thread. With
+         * many simultaneous clients, and specially with TLS enabled, that thread can become
+         * the bottleneck. With more than one thread, each one listens on the same port and
+         * the operating system spreads the incoming connections between them.
+         *
+         * This is only supported on Linux. On other platforms, and when the server is started
+         * in a port chosen by the system, a single thread is used.
+         *
+         * The new value will be taken into account the next time the HTTP proxy server is
+         * started. It's possible and effective to call this function before the server
+         * has been started.
+         *
+         * @param numThreads Number of threads, or a number <= 0 to use the internal default
+         * value (one thread)
+         */
+        void httpServerSetNumThreads(int numThreads);
+
+        /**
+         * @brief Get the number of threads used by the HTTP proxy server
+         *
+         * See MegaApi::httpServerSetNumThreads
+         *
+         * @return Number of threads used by the HTTP proxy server
+         */
+        int httpServerGetNumThreads();
+
         /**
          * @brief Start an FTP server in specified port
          *
@@ -23,7 +23,9 @@
 #define MEGAAPI_IMPL_H
 
 #include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <thread>
 
 #include "mega.h"
 #include "mega/gfx/external.h"
@@ -207,9 +209,13 @@ public:
     unsigned nc = 0;
     bool allocated = false;
 
+    // attributes of nn, encrypted by makeattrs() once the tree has been processed
+    vector<string> attrjson;
+
     MegaTreeProcCopy(MegaClient *client);
     bool processMegaNode(MegaNode* node) override;
     void allocnodes(void);
+    void makeattrs();
 
 protected:
     MegaClient *client;
@@ -227,6 +233,50 @@ class MegaSizeProcessor : public MegaTreeProcessor
         long long getTotalBytes();
 };
 
+// Creates local folders on a few threads, each with a FileSystemAccess of its own, so a folder download
+// with many subfolders doesn't keep the SDK thread waiting for the disk.
+// The SDK thread is woken up as each folder is done
+class LocalFolderCreator
+{
+public:
+    class Job
+    {
+    public:
+        const LocalPath path;
+
+        // set once this is true
+        bool done() const { return mDone; }
+
+        // API_EWRITE if it couldn't be created, API_EEXIST if there is a file there
+        error result = API_OK;
+
+        Job(const LocalPath& p) : path(p) {}
+
+    private:
+        friend class LocalFolderCreator;
+        std::atomic<bool> mDone{false};
+    };
+
+    // the job is dropped if nobody holds it any longer when its turn comes
+    // (if the creator goes away first, the jobs not started are done and failed)
+    std::shared_ptr<Job> queue(const LocalPath& path);
+
+    LocalFolderCreator(Waiter&, unsigned threadCount);
+    ~LocalFolderCreator();
+
+private:
+    void loop();
+    static void create(FileSystemAccess&, Job&);
+
+    Waiter& mWaiter;
+    vector<std::thread> mThreads;
+
+    std::mutex mMutex;
+    std::condition_variable mWakeup;
+    std::deque<std::shared_ptr<Job>> mQueued;
+    bool mExit = false;
+};
+
 class MegaRecursiveOperation
 {
 public:
@@ -248,7 +298,7 @@ protected:
     MegaErrorPrivate mLastError = { API_OK };
 };
 
-class MegaFolderUploadController : public MegaRequestListener, public MegaTransferListener, public MegaRecursiveOperation
+class MegaFolderUploadController : public MegaTransferListener, public MegaRecursiveOperation
 {
 public:
     MegaFolderUploadController(MegaApiImpl *megaApi, MegaTransferPrivate *transfer);
@@ -256,13 +306,35 @@ public:
     void cancel() override;
 
 protected:
-    void onFolderAvailable(MegaHandle handle);
+    // local folder of the upload, and the remote one it goes to
+    struct Folder
+    {
+        LocalPath localPath;
+        string name;
+        Folder* parent = nullptr;
+        handle remote = UNDEF;
+        handle tempHandle = UNDEF;  // in the putnodes batch that creates it
+        bool requested = false;
+        vector<unique_ptr<Folder>> subfolders;
+        vector<LocalPath> files;
+    };
+
+    // the whole local tree is scanned first, so that the missing remote folders are created in a few large
+    // putnodes batches, several levels at a time, instead of one request per folder
+    void scan(Folder& folder);
+    void onFolderAvailable(Folder& folder);
+    void createSubfolders(Folder& target);
+    void onSubfoldersCreated(Folder& target, const vector<Folder*>& folders, const Error& e, vector<NewNode>& nn);
     void checkCompletion();
 
-    std::list<LocalPath> pendingFolders;
+    unique_ptr<Folder> mRoot;
+    FileSystemType mFsType = FS_UNKNOWN;
+    int mPendingBatches = 0;
+
+    // the putnodes completions can outlive a cancelled controller
+    std::shared_ptr<bool> mAlive = std::make_shared<bool>(true);
 
 public:
-    void onRequestFinish(MegaApi* api, MegaRequest *request, MegaError *e) override;
     void onTransferStart(MegaApi *api, MegaTransfer *transfer) override;
     void onTransferUpdate(MegaApi *api, MegaTransfer *transfer) override;
     void onTransferFinish(MegaApi* api, MegaTransfer *transfer, MegaError *e) override;
@@ -355,6 +427,11 @@ protected:
     int recursive;
     int pendingTransfers;
     int pendingTags;
+
+    // the last complete backup: the files unchanged since are copied from it instead of being uploaded again
+    handle previousHandle = UNDEF;
+    int pendingCopies = 0;
+    std::shared_ptr<bool> mAlive = std::make_shared<bool>(true);
     // backup instance stats
     int64_t currentBKStartTime;
     int64_t updateTime;
@@ -369,6 +446,8 @@ protected:
 
     // internal methods
     void onFolderAvailable(MegaHandle handle);
+    Node* previousFolder(const LocalPath& localPath);
+    void copyUnchanged(MegaHandle parent, vector<NewNode>&& copies, vector<LocalPath>&& localPaths, FileSystemType fsType);
     bool checkCompletion();
     bool isBusy() const;
     int64_t getLastBackupTime();
@@ -419,10 +498,44 @@ public:
     void start(MegaNode *node) override;
     void cancel() override;
 
+    // the download is planned upfront: the whole tree is snapshotted, its folders created on the
+    // LocalFolderCreator threads and the files of each folder queued as soon as it exists.
+    // Called from the SDK loop until the plan is carried out
+    void continuePlan();
+
+    // files queued per call, so that a huge folder doesn't hold the SDK thread
+    static const size_t FILES_PER_BATCH = 1000;
+
 protected:
-    void downloadFolderNode(MegaNode *node, LocalPath& path, FileSystemType fsType);
+    struct PlannedFile
+    {
+        string path;
+        MegaHandle handle = INVALID_HANDLE;
+
+        // only for public and foreign nodes, which aren't in the node tree
+        unique_ptr<MegaNode> node;
+    };
+
+    struct PlannedFolder
+    {
+        LocalPath path;
+        vector<size_t> subfolders;
+        vector<PlannedFile> files;
+        shared_ptr<LocalFolderCreator::Job> creation;
+    };
+
+    // returns the index of the folder in mFolders
+    size_t planFolder(MegaNode *node, LocalPath& path, FileSystemType fsType);
+    void folderCreated(size_t folder);
     void checkCompletion();
 
+    vector<PlannedFolder> mFolders;
+
+    // folders being created, and the ones whose files are still to be queued
+    vector<size_t> mCreating;
+    std::deque<size_t> mReady;
+    size_t mNextFile = 0;   // of the first ready folder
+
 public:
     void onTransferStart(MegaApi *, MegaTransfer *t) override;
     void onTransferUpdate(MegaApi *, MegaTransfer *t) override;
@@ -507,6 +620,9 @@ class MegaNodePrivate : public MegaNode, public Cacheable
         MegaHandle getOwner() const override;
         const char* getDeviceId() const override;
 
+        // merges earlier changes, when several updates of the node are notified as one
+        void addChanges(int changes);
+
         static MegaNode *fromNode(Node *node);
         MegaNode *copy() override;
 
@@ -690,6 +806,10 @@ class MegaTransferPrivate : public MegaTransfer, public Cacheable
         MegaTransferPrivate(const MegaTransferPrivate *transfer);
         virtual ~MegaTransferPrivate();
 
+        // a copy for every update of every transfer: pooled
+        static void* operator new(size_t size) { return PooledAllocation<MegaTransferPrivate, 256>::allocate(size); }
+        static void operator delete(void* p, size_t size) { PooledAllocation<MegaTransferPrivate, 256>::deallocate(p, size); }
+
         MegaTransfer *copy() override;
 	    Transfer *getTransfer() const;
         void setTransfer(Transfer *transfer);
@@ -728,6 +848,10 @@ class MegaTransferPrivate : public MegaTransfer, public Cacheable
         void setListener(MegaTransferListener *listener);
         void setTargetOverride(bool targetOverride);
 
+        // take the trace id and the stages reached by the engine's Transfer
+        void setTrace(TraceId traceId, const TraceStages& stages);
+        void markStage(TraceStage stage);
+
         int getType() const override;
         const char * getTransferString() const override;
         const char* toString() const override;
@@ -775,6 +899,9 @@ class MegaTransferPrivate : public MegaTransfer, public Cacheable
         unsigned long long getPriority() const override;
         long long getNotificationNumber() const override;
         bool getTargetOverride() const override;
+        unsigned long long getTraceId() const override;
+        int64_t getStageTime(int stage) const override;
+        char* getTraceSpans() const override;
 
         bool serialize(string*) override;
         static MegaTransferPrivate* unserialize(string*);
@@ -789,6 +916,9 @@ class MegaTransferPrivate : public MegaTransfer, public Cacheable
 
         bool isRecursive() const { return recursiveOperation.get() != nullptr; }
 
+        // fingerprint of the file to upload, made while the transfer waits in the queue
+        std::shared_ptr<FingerprintService::Job> mFingerprint;
+
 protected:
         int type;
         int tag;
@@ -838,6 +968,8 @@ protected:
         const char* appData;
         unique_ptr<MegaRecursiveOperation> recursiveOperation;
         bool mTargetOverride;
+        TraceId mTraceId = 0;
+        TraceStages mStages;
 };
 
 class MegaTransferDataPrivate : public MegaTransferData
@@ -866,6 +998,38 @@ protected:
     vector<uint64_t> uploadPriorities;
 };
 
+class MegaTransferColumnsPrivate : public MegaTransferColumns
+{
+public:
+    int size() const override;
+    const int* getTags() const override;
+    const int* getTypes() const override;
+    const int* getStates() const override;
+    const long long* getTransferredBytes() const override;
+    const long long* getTotalBytes() const override;
+    const long long* getSpeeds() const override;
+    const unsigned long long* getPriorities() const override;
+    int getNumFinished() const override;
+    const int* getFinishedTags() const override;
+    bool isComplete() const override;
+    long long getVersion() const override;
+
+    void add(MegaTransferPrivate* transfer);
+
+    vector<int> mFinishedTags;
+    bool mComplete = true;
+    long long mVersion = 0;
+
+protected:
+    vector<int> mTags;
+    vector<int> mTypes;
+    vector<int> mStates;
+    vector<long long> mTransferredBytes;
+    vector<long long> mTotalBytes;
+    vector<long long> mSpeeds;
+    vector<unsigned long long> mPriorities;
+};
+
 class MegaFolderInfoPrivate : public MegaFolderInfo
 {
 public:
@@ -1088,6 +1252,29 @@ class MegaSyncListPrivate : public MegaSyncList
         int s;
 };
 
+class MegaSyncStatsPrivate : public MegaSyncStats
+{
+public:
+    MegaSyncStatsPrivate(handle backupId, const SyncStats& stats);
+
+    MegaSyncStats *copy() const override;
+    MegaHandle getBackupId() const override;
+    long long getQueuedNotifications() const override;
+    long long getRetryNotifications() const override;
+    long long getLastFullReconcile() const override;
+    long long getScannedFiles() const override;
+    double getScannedFilesPerSecond() const override;
+    long long getPendingUploadBytes() const override;
+    long long getPendingPutnodes() const override;
+    long long getLatencySamples() const override;
+    long long getLatencyP50() const override;
+    long long getLatencyP99() const override;
+
+private:
+    handle mBackupId;
+    SyncStats mStats;
+};
+
 #endif
 
 
@@ -1196,6 +1383,8 @@ class MegaRequestPrivate : public MegaRequest
         MegaBannerList* getMegaBannerList() const override;
         void setBanners(vector< tuple<int, string, string, string, string, string, string> >&& banners);
 
+        unsigned long long getTraceId() const override;
+
 protected:
         AccountDetails *accountDetails;
         MegaPricingPrivate *megaPricing;
@@ -1241,6 +1430,7 @@ protected:
         MegaBackgroundMediaUpload* backgroundMediaUpload;  // non-owned pointer
         unique_ptr<MegaStringList> mStringList;
         unique_ptr<MegaHandleList> mHandleList;
+        TraceId mTraceId = newTraceId();
 
     private:
         unique_ptr<MegaBannerListPrivate> mBannerList;
@@ -1674,6 +1864,7 @@ class MegaNodeListPrivate : public MegaNodeList
         MegaNodeListPrivate(node_vector& v);
         MegaNodeListPrivate(Node** newlist, int size);
         MegaNodeListPrivate(const MegaNodeListPrivate *nodeList, bool copyChildren = false);
+        MegaNodeListPrivate(vector<MegaNode*>&& nodes);   // takes the ownership of the nodes
         virtual ~MegaNodeListPrivate();
         MegaNodeList *copy() const override;
         MegaNode* get(int i) const override;
@@ -1704,6 +1895,45 @@ class MegaChildrenListsPrivate : public MegaChildrenLists
         unique_ptr<MegaNodeList> files;
 };
 
+class MegaNodeCursorPrivate : public MegaNodeCursor
+{
+    public:
+        MegaNodeCursorPrivate(MegaApiImpl* api, vector<handle>&& handles);
+        int size() const override;
+        MegaHandle getHandle(int i) const override;
+        MegaNode* get(int i) override;
+        MegaNodeList* getPage(int offset, int limit) override;
+
+    protected:
+        MegaApiImpl* mApi;
+        vector<handle> mHandles;
+
+        // created as they are accessed
+        vector<unique_ptr<MegaNode>> mNodes;
+};
+
+class MegaNodeColumnsPrivate : public MegaNodeColumns
+{
+    public:
+        explicit MegaNodeColumnsPrivate(const node_vector& nodes);
+        int size() const override;
+        const MegaHandle* getHandles() const override;
+        const long long* getSizes() const override;
+        const long long* getModificationTimes() const override;
+        const int* getTypes() const override;
+        const int* getFlags() const override;
+        MegaStringList* getNames() const override;
+        const char* getName(int i) const override;
+
+    protected:
+        vector<MegaHandle> mHandles;
+        vector<long long> mSizes;
+        vector<long long> mModificationTimes;
+        vector<int> mTypes;
+        vector<int> mFlags;
+        unique_ptr<MegaStringListPrivate> mNames;
+};
+
 class MegaUserListPrivate : public MegaUserList
 {
 	public:
@@ -1748,6 +1978,37 @@ class MegaTransferListPrivate : public MegaTransferList
 		int s;
 };
 
+class MegaTransferBatchPrivate : public MegaTransferBatch
+{
+public:
+    struct Entry
+    {
+        int type = MegaTransfer::TYPE_UPLOAD;
+        string localPath;
+        bool hasLocalPath = false;
+        MegaHandle parentHandle = INVALID_HANDLE;
+        string fileName;
+        bool hasFileName = false;
+        int64_t mtime = -1;
+        string appData;
+        bool hasAppData = false;
+        bool isSourceTemporary = false;
+        bool startFirst = false;
+        shared_ptr<MegaNode> node;   // downloads
+    };
+
+    MegaTransferBatch* copy() const override;
+    void addUpload(const char* localPath, MegaNode* parent, const char* fileName, int64_t mtime,
+                   const char* appData, bool isSourceTemporary, bool startFirst) override;
+    void addDownload(MegaNode* node, const char* localPath, const char* appData, bool startFirst) override;
+    int size() const override;
+
+    const vector<Entry>& entries() const { return mEntries; }
+
+private:
+    vector<Entry> mEntries;
+};
+
 class MegaContactRequestListPrivate : public MegaContactRequestList
 {
     public:
@@ -1837,6 +2098,54 @@ public:
     byte* nextbuffer(unsigned bufsize) override;
 };
 
+// The data of the stream is delivered by streaming transfers ("fetches") to a buffer shared with them, as a fetch
+// can outlive the stream: it is only told to stop by the return value of its next callback.
+class MegaReadStreamPrivate : public MegaReadStream
+{
+public:
+    static const m_off_t DEFAULT_BUFFER_SIZE = 4 * 1024 * 1024;
+
+    MegaReadStreamPrivate(MegaApiImpl* api, MegaNode* node, m_off_t bufferSize);
+    ~MegaReadStreamPrivate();
+
+    long long read(long long offset, char *output, size_t outputSize, int timeoutMs) override;
+    void prefetch(long long offset, long long length) override;
+    long long getSize() override;
+
+private:
+    struct Buffer
+    {
+        std::mutex mutex;
+        std::condition_variable delivered;
+
+        // the data buffered, from start
+        m_off_t start = 0;
+        string data;
+
+        // where the last read ended: the data before it can be dropped
+        m_off_t consumed = 0;
+
+        // the fetch that delivers to the end of data, up to fetchEnd. The others stop
+        unsigned generation = 0;
+        bool fetching = false;
+        m_off_t fetchEnd = 0;
+
+        int error = API_OK;
+        m_off_t maxSize = 0;
+
+        m_off_t end() const { return start + m_off_t(data.size()); }
+    };
+
+    class Fetch;
+
+    // (the lock is held) starts downloading length bytes from offset, after the data buffered if it is contiguous
+    void fetch(m_off_t offset, m_off_t length);
+
+    MegaApiImpl* api;
+    unique_ptr<MegaNode> node;
+    std::shared_ptr<Buffer> buffer;
+};
+
 class MegaBackgroundMediaUploadPrivate : public MegaBackgroundMediaUpload
 {
 public:
@@ -1858,6 +2167,13 @@ public:
 
     SymmCipher* nodecipher(MegaClient*);
 
+    // encryptFile() of a range in pieces of some ENCRYPT_PIECE bytes, on up to ENCRYPT_LANES worker threads at once,
+    // each with files of its own, so the reads and writes of some overlap the encryption of the others
+    static const m_off_t ENCRYPT_PIECE = 16 * 1024 * 1024;
+    static const unsigned ENCRYPT_LANES = 8;
+    bool encryptPieces(FileAccess* fain, FileAccess* faout, LocalPath& inputPath, LocalPath& outputPath,
+                       m_off_t startPos, m_off_t endPos, string& urlSuffix);
+
     MegaApiImpl* api;
     string url;
     chunkmac_map chunkmacs;
@@ -1934,12 +2250,13 @@ class SearchTreeProcessor : public TreeProcessor
         virtual bool processNode(Node* node);
         bool isValidTypeNode(Node *node);
         virtual ~SearchTreeProcessor() {}
-        vector<Node *> &getResults();
+        // those still there
+        node_vector getResults();
 
     protected:
         int mFileType;
         const char *mSearch;
-        vector<Node *> mResults;
+        vector<handle> mResults;
         MegaClient *mClient;
 };
 
@@ -1972,52 +2289,96 @@ class PendingOutShareProcessor : public TreeProcessor
         vector<handle> handles;
 };
 
-class SizeProcessor : public TreeProcessor
+class FavouriteProcessor : public TreeProcessor
 {
-    protected:
-        long long totalBytes;
+public:
+    FavouriteProcessor(int maxCount);
+    bool processNode(Node* node) override;
+    const vector<handle> &getHandles() const;
 
-    public:
-        SizeProcessor();
-        virtual bool processNode(Node* node);
-        long long getTotalBytes();
+private:
+    vector<handle> handles;
+    unsigned mMaxCount = 0;
 };
 
-class TreeProcFolderInfo : public TreeProc
+// Thread safe memory cache of decrypted file attributes (thumbnails, previews)
+// The least recently used ones are dropped when the size limit is reached
+class FileAttributeMemoryCache
 {
-    public:
-        TreeProcFolderInfo();
-        virtual void proc(MegaClient*, Node*);
-        virtual ~TreeProcFolderInfo() {}
-        MegaFolderInfo *getResult();
+public:
+    FileAttributeMemoryCache(size_t maxSize);
+    ~FileAttributeMemoryCache();
 
-    protected:
-        int numFiles;
-        int numFolders;
-        int numVersions;
-        long long currentSize;
-        long long versionsSize;
+    bool get(handle h, int type, string& data);
+    void put(handle h, int type, const char *data, size_t len);
+    void remove(handle h);
+    void clear();
+    size_t size();
+
+    // drop the least recently used ones until keep bytes at most are left, returns the bytes released
+    size_t trim(size_t keep);
+
+private:
+    typedef pair<handle, int> Key;
+    struct Entry
+    {
+        string data;
+        std::list<Key>::iterator lru;
+    };
+
+    map<Key, Entry> entries;
+    std::list<Key> mLru;
+    size_t mSize = 0;
+    size_t mMaxSize;
+    std::mutex mutex;
+
+    // with the mutex held
+    void evict(size_t maxSize);
 };
 
-class FavouriteProcessor : public TreeProcessor
+// File attributes (thumbnails, previews) kept in a folder, in files named by their file attribute handle
+// The least recently used ones are removed when the size limit is reached. Used from the SDK thread only
+class FileAttributeDiskCache
 {
 public:
-    FavouriteProcessor(int maxCount);
-    bool processNode(Node* node) override;
-    const vector<handle> &getHandles() const;
+    FileAttributeDiskCache(FileSystemAccess& fsaccess, const LocalPath& folder, m_off_t maxSize);
+
+    bool get(handle fah, string& data);
+    void put(handle fah, const char *data, size_t len);
+    void clear();
 
 private:
-    vector<handle> handles;
-    unsigned mMaxCount = 0;
+    struct Entry
+    {
+        m_off_t size;
+        std::list<handle>::iterator lru;
+    };
+
+    FileSystemAccess& fsaccess;
+    LocalPath folder;
+    m_off_t mMaxSize;
+    m_off_t mSize = 0;
+    bool loaded = false;
+    map<handle, Entry> entries;
+    std::list<handle> mLru;
+
+    LocalPath pathFor(handle fah) const;
+    void load();
+    void remove(map<handle, Entry>::iterator it);
 };
 
 //Thread safe request queue
 class RequestQueue
 {
     protected:
+        // apps push without locking; the requests are moved to the deque by the SDK thread as it looks at them
+        MpscQueue<MegaRequestPrivate *> incoming;
         std::deque<MegaRequestPrivate *> requests;
         std::mutex mutex;
 
+        // with the mutex held
+        void takeIncoming();
+
     public:
         RequestQueue();
         void push(MegaRequestPrivate *request);
@@ -2033,16 +2394,33 @@ class RequestQueue
 class TransferQueue
 {
     protected:
+        // apps push without locking; the transfers are moved to the deque by the SDK thread as it looks at them
+        MpscQueue<MegaTransferPrivate *> incoming;
         std::deque<MegaTransferPrivate *> transfers;
         std::mutex mutex;
-        int lastPushedTransferTag = 0;
+        std::atomic<int> lastPushedTransferTag{0};
+
+        // with the mutex held
+        void takeIncoming();
 
     public:
         TransferQueue();
         void push(MegaTransferPrivate *transfer);
+
+        // several at once, consecutive in the queue
+        void push(const std::vector<MegaTransferPrivate *>& batch);
         void push_front(MegaTransferPrivate *transfer);
         MegaTransferPrivate * pop();
 
+        /**
+         * @brief pops the first transfer that isn't waiting for its file to be fingerprinted
+         * @param fingerprints where the uploads passed on the way get their fingerprint started, if any
+         * @param fsaccess to convert their paths
+         * @param maxWaiting number of waiting transfers to look past
+         * @return the transfer, or NULL if there is none ready
+         */
+        MegaTransferPrivate *popReady(FingerprintService *fingerprints, const FileSystemAccess &fsaccess, size_t maxWaiting);
+
         /**
          * @brief pops and returns transfer up to the designated one
          * @param lastQueuedTransfer position of the last transfer to pop
@@ -2057,6 +2435,89 @@ class TransferQueue
 };
 
 
+// Delivers listener callbacks from a thread of its own, so a slow listener doesn't hold up the SDK thread
+// (see MegaApi::setAsyncCallbacks()).
+// Callbacks are only pushed with the SDK lock held, so there is a single producer at a time and they go
+// through a bounded lock-free ring. When it's full, the producer waits for room, but no longer than
+// MAX_BLOCK_MS: a listener waiting for the SDK lock would never make any. The callbacks that don't fit
+// then go to an overflow list, until the dispatcher catches up
+class MegaCallbackDispatcher
+{
+public:
+    using Callback = std::function<void()>;
+
+    // what to do with the progress callbacks when the queue is full (see MegaApi::ASYNC_CALLBACKS_BLOCK...)
+    enum { BLOCK = 0, COALESCE = 1, DROP = 2 };
+
+    static const int MAX_BLOCK_MS = 1000;
+
+    MegaCallbackDispatcher(size_t capacity, int backpressure);
+
+    // delivers the callbacks still queued before returning
+    ~MegaCallbackDispatcher();
+
+    void push(Callback&& callback);
+
+    // a progress callback, that can be coalesced or dropped depending on the backpressure policy.
+    // With COALESCE, a callback replaces the one with the same key (if not 0) that is still queued
+    void pushProgress(int key, Callback&& callback);
+
+    // no more progress callbacks for that key (eg. the transfer finished)
+    void endProgress(int key);
+
+    // for the callbacks to call a listener, unless it was removed after the callback was queued
+    void deliver(void* listener, const std::function<void()>& f);
+
+    // the listener was removed: callbacks queued so far won't reach it
+    void revoke(void* listener);
+
+    // wait until the listener isn't being called (unless this is the dispatcher thread)
+    void waitDelivered(void* listener);
+
+    bool isDispatcherThread() const;
+    size_t size() const;
+
+private:
+    struct Entry
+    {
+        uint64_t seq = 0;
+        Callback callback;
+    };
+
+    bool full() const;
+    void enqueue(Callback&& callback);
+    bool dequeue(Entry& entry);
+    void loop();
+
+    const int mBackpressure;
+
+    // ring: the producer moves mTail, the dispatcher mHead
+    vector<Entry> mRing;
+    std::atomic<size_t> mHead{0};
+    std::atomic<size_t> mTail{0};
+
+    mutable std::mutex mOverflowMutex;
+    std::deque<Entry> mOverflow;
+    std::atomic<bool> mOverflowing{false};
+
+    // latest progress callback of each key still queued (producer side)
+    map<int, shared_ptr<std::atomic<Callback*>>> mProgress;
+
+    std::atomic<uint64_t> mPushed{0};   // sequence number of the last callback queued
+    uint64_t mCurrentSeq = 0;           // the one being delivered
+
+    std::mutex mMutex;
+    std::condition_variable mWakeup;
+    std::condition_variable mDelivered;
+    std::atomic<bool> mSleeping{false};
+    bool mExit = false;
+    void* mInFlight = nullptr;
+    map<void*, uint64_t> mRevoked;      // removed listeners, with the last callback they mustn't get
+
+    std::thread mThread;
+};
+
+
 class MegaApiImpl : public MegaApp
 {
     public:
@@ -2191,11 +2652,19 @@ class MegaApiImpl : public MegaApp
         void verifyCredentials(MegaUser *user, MegaRequestListener *listener = NULL);
         void resetCredentials(MegaUser *user, MegaRequestListener *listener = NULL);
         char* getMyRSAPrivateKey();
+        static void setSharedWorkerThreads(unsigned threadCount);
         static void setLogLevel(int logLevel);
         static void setMaxPayloadLogSize(long long maxSize);
         static void addLoggerClass(MegaLogger *megaLogger);
         static void removeLoggerClass(MegaLogger *megaLogger);
         static void setLogToConsole(bool enable);
+        static void setLogAsynchronous(bool enable);
+        static void setThreadSettings(int role, int priority, long long cpuMask);
+        static void setPoolAllocator(void* (*allocate)(size_t), void (*release)(void*, size_t));
+        static bool startTracing(const char* path, int subsystems);
+        static void setTracedSubsystems(int subsystems);
+        static void setTraceSampling(int subsystems, int oneIn);
+        static void stopTracing();
         static void log(int logLevel, const char* message, const char *filename = NULL, int line = -1);
         void setLoggingName(const char* loggingName);
 #ifdef USE_ROTATIVEPERFORMANCELOGGER
@@ -2270,6 +2739,8 @@ class MegaApiImpl : public MegaApp
         void exportNode(MegaNode *node, int64_t expireTime, bool writable, MegaRequestListener *listener = NULL);
         void disableExport(MegaNode *node, MegaRequestListener *listener = NULL);
         void fetchNodes(MegaRequestListener *listener = NULL);
+        bool setLargeAccountMode(bool enable);
+        bool isLargeAccountMode();
         void getPricing(MegaRequestListener *listener = NULL);
         void getPaymentId(handle productHandle, handle lastPublicHandle, int lastPublicHandleType, int64_t lastAccessTimestamp, MegaRequestListener *listener = NULL);
         void upgradeAccount(MegaHandle productHandle, int paymentMethod, MegaRequestListener *listener = NULL);
@@ -2323,8 +2794,14 @@ class MegaApiImpl : public MegaApp
         void startUploadForSupport(const char *localPath, bool isSourceTemporary, FileSystemType fsType, MegaTransferListener *listener=NULL);
         void startDownload(MegaNode* node, const char* localPath, MegaTransferListener *listener = NULL);
         void startDownload(bool startFirst, MegaNode *node, const char* target, int folderTransferTag, const char *appData, MegaTransferListener *listener);
+        void startTransfers(MegaTransferBatch* transfers, MegaTransferListener *listener);
         void startStreaming(MegaNode* node, m_off_t startPos, m_off_t size, MegaTransferListener *listener);
         void setStreamingMinimumRate(int bytesPerSecond);
+        void setStreamingCache(long long memoryBytes, long long readAheadBytes, const char *spillFolder, long long spillBytes);
+        MegaReadStream* createReadStream(MegaNode* node, long long bufferSize);
+        void setTransferUpdateBatching(int milliseconds);
+        void setNodeUpdateBatching(int milliseconds);
+        void setAsyncCallbacks(bool enable, int queueSize, int backpressure);
         void retryTransfer(MegaTransfer *transfer, MegaTransferListener *listener = NULL);
         void cancelTransfer(MegaTransfer *transfer, MegaRequestListener *listener=NULL);
         void cancelTransferByTag(int transferTag, MegaRequestListener *listener = NULL);
@@ -2345,6 +2822,21 @@ class MegaApiImpl : public MegaApp
         bool setMaxUploadSpeed(m_off_t bpslimit);
         int getMaxDownloadSpeed();
         int getMaxUploadSpeed();
+        void setAdaptiveConnections(bool enable);
+        void setMaxTransferMemory(m_off_t bytes);
+        void setTransferMemoryBudget(m_off_t bytes);
+        bool setHttp2(bool enable);
+        void setMaxApiRequestsInFlight(unsigned count);
+        void setFingerprintThreads(unsigned threads, unsigned readsPerDevice);
+        void setUploadChunkIndexMinSize(long long minSize);
+        void setLinkBrowserMode(bool enable);
+        bool addBandwidthPolicy(int bandwidthClass, int weight, long long maxDownloadSpeed, long long maxUploadSpeed, int fromMinute, int toMinute);
+        void clearBandwidthPolicies();
+        char* getLatencyHistogram(int endpoint);
+        char* getPerformanceMetrics();
+        char* getStartupProfile();
+        string getPrometheusMetrics();
+        long long trimMemory(int level);
         int getCurrentDownloadSpeed();
         int getCurrentUploadSpeed();
         int getCurrentSpeed(int type);
@@ -2357,6 +2849,7 @@ class MegaApiImpl : public MegaApp
         MegaTransferList *getStreamingTransfers();
         MegaTransfer* getTransferByTag(int transferTag);
         MegaTransferList *getTransfers(int type);
+        MegaTransferColumns *getTransferColumns(int type, long long since, int offset, int limit);
         MegaTransferList *getChildTransfers(int transferTag);
         MegaTransferList *getTansfersByFolderTag(int folderTransferTag);
 
@@ -2386,8 +2879,11 @@ class MegaApiImpl : public MegaApp
         void setExcludedPaths(vector<string> *excludedPaths);
         void setExclusionLowerSizeLimit(long long limit);
         void setExclusionUpperSizeLimit(long long limit);
+        void setSyncScanThreads(unsigned threads);
+        void setSyncResumeScan(bool enable);
         bool moveToLocalDebris(const char *path);
         string getLocalPath(MegaNode *node);
+        string getSyncedLocalCopy(MegaNode *node);
         long long getNumLocalNodes();
         bool isSyncable(const char *path, long long size);
         bool isInsideSync(MegaNode *node);
@@ -2398,6 +2894,7 @@ class MegaApiImpl : public MegaApp
         bool isSyncing();
 
         MegaSync *getSyncByBackupId(mega::MegaHandle backupId);
+        MegaSyncStats *getSyncStats(mega::MegaHandle backupId);
         MegaSync *getSyncByNode(MegaNode *node);
         MegaSync *getSyncByPath(const char * localPath);
         char *getBlockedPath();
@@ -2430,7 +2927,13 @@ class MegaApiImpl : public MegaApp
 		int getNumChildFiles(MegaNode* parent);
         int getNumChildFolders(MegaNode* parent);
         MegaNodeList* getChildren(MegaNode *parent, int order);
+        MegaNodeList* getChildren(MegaNode *parent, int order, int offset, int limit);
         MegaNodeList* getChildren(MegaNodeList *parentNodes, int order);
+        MegaNodeCursor* getChildrenCursor(MegaNode *parent, int order);
+        MegaNodeColumns* getChildrenColumns(MegaNode *parent, int order);
+
+        // the MegaNode of each handle, NULL for those that don't exist (for the nodes of a MegaNodeCursor)
+        void getNodesByHandle(const handle* handles, size_t count, vector<MegaNode*>& nodes);
         MegaNodeList* getVersions(MegaNode *node);
         int getNumVersions(MegaNode *node);
         bool hasVersions(MegaNode *node);
@@ -2447,6 +2950,7 @@ class MegaApiImpl : public MegaApp
         MegaUserList* getContacts();
         MegaUser* getContact(const char* uid);
         MegaUserAlertList* getUserAlerts();
+        MegaUserAlertList* getUserAlerts(int offset, int limit);
         int getNumUnreadUserAlerts();
         MegaNodeList *getInShares(MegaUser* user, int order);
         MegaNodeList *getInShares(int order);
@@ -2623,6 +3127,13 @@ class MegaApiImpl : public MegaApp
         int httpServerGetMaxBufferSize();
         void httpServerSetMaxOutputSize(int outputSize);
         int httpServerGetMaxOutputSize();
+        void httpServerSetNumThreads(int numThreads);
+        int httpServerGetNumThreads();
+
+        // Appends the WebDAV PROPFIND entries of at most "limit" children of a folder, starting at "offset" in the
+        // default order. They are written straight from the node tree under a read lock, so a big folder can
+        // be listed in batches without copying its nodes. Returns the number of entries, or -1 if the folder is gone
+        int httpServerGetWebDavEntries(MegaHandle parent, const string& baseURL, bool offlineAttribute, int offset, int limit, string& entries);
 
         // permissions
         void httpServerEnableFileServer(bool enable);
@@ -2636,6 +3147,8 @@ class MegaApiImpl : public MegaApp
         void httpServerEnableOfflineAttribute(bool enable);
         void httpServerEnableSubtitlesSupport(bool enable);
         bool httpServerIsSubtitlesSupportEnabled();
+        void httpServerEnableMetrics(bool enable);
+        bool httpServerIsMetricsEnabled();
 
         void httpServerAddListener(MegaTransferListener *listener);
         void httpServerRemoveListener(MegaTransferListener *listener);
@@ -2767,6 +3280,19 @@ class MegaApiImpl : public MegaApp
         map<int, MegaTransferPrivate *> transferMap;
         map<int, MegaTransferPrivate *> folderTransferMap; //transferMap includes these, added for speedup
 
+        // the latest finished transfers, oldest first, for the snapshots of the changes since a version
+        struct FinishedTransfer
+        {
+            long long notificationNumber;
+            int tag;
+            int type;
+        };
+        deque<FinishedTransfer> finishedTransfers;
+        static const size_t MAX_FINISHED_TRANSFERS = 10000;
+
+        // the notification number of the latest finished transfer forgotten
+        long long forgottenFinishedTransfers = 0;
+
 
         MegaClient *getMegaClient();
         static FileFingerprint *getFileFingerprintInternal(const char *fingerprint);
@@ -2794,8 +3320,20 @@ protected:
         static void *threadEntryPoint(void *param);
         static ExternalLogger externalLogger;
 
+        // created on the first MegaApi::setLogAsynchronous(true) and kept, other threads may still be using it
+        static std::unique_ptr<AsyncLogger> asyncLogger;
+        static std::mutex asyncLoggerMutex;
+
+        // the worker threads of the clients created while MegaApi::setSharedWorkerThreads is in effect
+        static std::shared_ptr<MegaClientAsyncQueue::WorkerPool> sharedWorkerPool;
+        static std::mutex sharedWorkerPoolMutex;
+
         MegaTransferPrivate* getMegaTransferPrivate(int tag);
 
+        // the transfers to queue for startUpload() and startDownload()
+        MegaTransferPrivate* createUploadTransfer(bool startFirst, const char *localPath, MegaHandle parentHandle, const char *fileName, const char *targetUser, int64_t mtime, int folderTransferTag, bool isBackup, const char *appData, bool isSourceFileTemporary, bool forceNewUpload, FileSystemType fsType, MegaTransferListener *listener);
+        MegaTransferPrivate* createDownloadTransfer(bool startFirst, MegaNode *node, const char* localPath, int folderTransferTag, const char *appData, MegaTransferListener *listener);
+
         void fireOnRequestStart(MegaRequestPrivate *request);
         void fireOnRequestFinish(MegaRequestPrivate *request, unique_ptr<MegaErrorPrivate> e);
         void fireOnRequestUpdate(MegaRequestPrivate *request);
@@ -2829,6 +3367,18 @@ protected:
         void processTransferFailed(Transfer *tr, MegaTransferPrivate *transfer, const Error &e, dstime timeleft);
         void processTransferRemoved(Transfer *tr, MegaTransferPrivate *transfer, const Error &e);
 
+        // batched notifications (see setTransferUpdateBatching() and setNodeUpdateBatching())
+        void queueNodesUpdate(Node** n, int count);
+        void flushBatchedUpdates(bool force = false);
+        void fireOnTransfersUpdate(vector<MegaTransfer*>& transfers);
+
+        // asynchronous callbacks (see setAsyncCallbacks()): queue the call for the listeners registered now
+        void queueGlobalCallback(std::function<void(MegaGlobalListener*)> globalCall, std::function<void(MegaListener*)> call);
+        void queueTransferCallback(MegaTransferPrivate* transfer, bool progress, std::function<void(MegaTransferListener*, MegaTransfer*)> transferCall, std::function<void(MegaListener*, MegaTransfer*)> call);
+        // the SDK's own transfer listeners are called synchronously, not through the dispatcher
+        static bool isSdkTransferListener(MegaTransferListener* listener);
+        void revokeListener(void* listener);
+
         MegaApi *api;
         MegaThread thread;
         MegaClient *client;
@@ -2840,15 +3390,26 @@ protected:
         string basePath;
         bool nocache;
 
+        // file attributes fetched in memory, and the ones written to files too
+        static const size_t MAX_FILE_ATTRIBUTE_CACHE_SIZE = 33554432;
+        FileAttributeMemoryCache fileAttributeCache{MAX_FILE_ATTRIBUTE_CACHE_SIZE};
+
+        // file attributes fetched before, kept across sessions. Null without a base path
+        static const m_off_t MAX_FILE_ATTRIBUTE_DISK_CACHE_SIZE = 104857600;
+        std::unique_ptr<FileAttributeDiskCache> fileAttributeDiskCache;
+        void finishNodeAttributeRequest(MegaRequestPrivate *request, const char *data, size_t len);
+
 #ifdef HAVE_LIBUV
         MegaHTTPServer *httpServer;
         int httpServerMaxBufferSize;
         int httpServerMaxOutputSize;
+        int httpServerNumThreads;
         bool httpServerEnableFiles;
         bool httpServerEnableFolders;
         bool httpServerOfflineAttributeEnabled;
         int httpServerRestrictedMode;
         bool httpServerSubtitlesSupportEnabled;
+        bool httpServerMetricsEnabled;
         set<MegaTransferListener *> httpServerListeners;
 
         MegaFTPServer *ftpServer;
@@ -2877,6 +3438,30 @@ protected:
         long long totalDownloadBytes;
         long long totalUploadBytes;
         long long notificationNumber;
+
+        // nodes per onNodesUpdate() when they are not batched
+        static const int NODES_UPDATE_CHUNK = 10000;
+
+        // intervals of the batched notifications, in ds (0 = not batched), and the updates waiting for them
+        dstime transferUpdateBatchDs = 0;
+        dstime nodeUpdateBatchDs = 0;
+        set<int> pendingTransferUpdates;
+        dstime pendingTransferUpdatesDs = 0;
+        vector<unique_ptr<MegaNodePrivate>> pendingNodeUpdates;
+        map<MegaHandle, size_t> pendingNodeUpdatesIndex;
+        dstime pendingNodeUpdatesDs = 0;
+
+        // delivers the callbacks from its own thread, if enabled
+        shared_ptr<MegaCallbackDispatcher> callbackDispatcher;
+        std::thread::id sdkThreadId;
+
+        // folder downloads carrying out their plan, and the threads creating their folders (started on first use)
+        static const unsigned FOLDER_CREATION_THREADS = 4;
+        set<MegaFolderDownloadController*> plannedFolderDownloads;
+        unique_ptr<LocalFolderCreator> localFolderCreator;
+        LocalFolderCreator& getLocalFolderCreator();
+        void continueFolderDownloads();
+
         set<MegaRequestListener *> requestListeners;
         set<MegaTransferListener *> transferListeners;
         set<MegaScheduledCopyListener *> backupListeners;
@@ -2893,8 +3478,29 @@ protected:
         vector<string> excludedPaths;
         long long syncLowerSizeLimit;
         long long syncUpperSizeLimit;
-        std::recursive_timed_mutex sdkMutex;
-        using SdkMutexGuard = std::unique_lock<std::recursive_timed_mutex>;   // (equivalent to typedef)
+        SharedRecursiveMutex sdkMutex;
+        using SdkMutexGuard = std::unique_lock<SharedRecursiveMutex>;   // (equivalent to typedef)
+
+        // Shared lock of sdkMutex for the getters that only read the node tree, so they run in parallel with each other.
+        // It is exclusive instead while nodes are lazily loaded from the local cache, as looking them up may load them
+        class SdkReadGuard
+        {
+        public:
+            explicit SdkReadGuard(MegaApiImpl& api);
+            ~SdkReadGuard();
+
+            // for a query that is about to change something after all
+            void lockExclusive();
+
+        private:
+            SharedRecursiveMutex& mMutex;
+            bool mExclusive = false;
+        };
+
+        // the children of a folder as kept sorted, for the big ones (see NodeChildren::addSorted()), null if that order isn't kept.
+        // The folder is looked up, again if the exclusive lock has to be taken to add the order: parent is the latest one
+        const node_vector* sortedChildren(MegaHandle h, int order, SdkReadGuard& g, Node*& parent);
+
         std::atomic<bool> syncPathStateLockTimeout{ false };
         MegaTransferPrivate *currentTransfer;
         MegaRequestPrivate *activeRequest;
@@ -3200,8 +3806,19 @@ protected:
         Node* getNodeByFingerprintInternal(const char *fingerprint);
         Node *getNodeByFingerprintInternal(const char *fingerprint, Node *parent);
 
-        bool processTree(Node* node, TreeProcessor* processor, bool recursive = 1, MegaCancelToken* cancelToken = nullptr);
-        void getNodeAttribute(MegaNode* node, int type, const char *dstFilePath, MegaRequestListener *listener = NULL);
+        // The children before their parent, walked with a stack of handles rather than by recursion.  With `yield`, the
+        // threads waiting for the lock of the SDK may have it every PROCESS_TREE_SLICE_MS or so (see
+        // SharedRecursiveMutex::yieldToWriters()): neither the processor nor the callers may keep pointers into the tree then.
+        bool processTree(Node* node, TreeProcessor* processor, bool recursive = 1, MegaCancelToken* cancelToken = nullptr, bool yield = false);
+        static const unsigned PROCESS_TREE_SLICE_NODES = 1024;
+        static const unsigned PROCESS_TREE_SLICE_MS = 20;
+
+        // what processTree() with a SearchTreeProcessor finds below the nodes inScope() accepts, through the index of names or types
+        void searchNodeNames(const char* searchString, int type, MegaCancelToken* cancelToken, std::function<bool(Node*)> inScope, node_vector& result);
+        // whether the index searchNodeNames() uses for these is filled (the first search fills it, locked exclusively)
+        bool searchIndexBuilt(const char* searchString, int type);
+        void getNodeAttribute(MegaNode* node, int type, const char *dstFilePath, MegaRequestListener *listener = NULL, bool inMemory = false);
+        bool getCachedNodeAttribute(MegaHandle h, int type, string& data);
 		    void cancelGetNodeAttribute(MegaNode *node, int type, MegaRequestListener *listener = NULL);
         void setNodeAttribute(MegaNode* node, int type, const char *srcFilePath, MegaHandle attributehandle, MegaRequestListener *listener = NULL);
         void putNodeAttribute(MegaBackgroundMediaUpload* bu, int type, const char *srcFilePath, MegaRequestListener *listener = NULL);
@@ -3219,6 +3836,9 @@ protected:
         bool hasToForceUpload(const Node &node, const MegaTransferPrivate &transfer) const;
 
         friend class MegaBackgroundMediaUploadPrivate;
+        friend class MegaFolderDownloadController;
+        friend class MegaHTTPServer;
+        friend class MegaHTTPContext;
 
 private:
         void setCookieSettings_sendPendingRequests(MegaRequestPrivate* request);
@@ -3253,6 +3873,8 @@ public:
 };
 
 #ifdef HAVE_LIBUV
+// Data waiting to be written to a socket, kept in a chain of chunks: it's copied once when appended,
+// and the chunks are handed out as they are (several per write with nextBuffers()) until freeData()
 class StreamingBuffer
 {
 public:
@@ -3264,25 +3886,77 @@ public:
     unsigned int availableSpace();
     unsigned int availableCapacity();
     uv_buf_t nextBuffer();
+
+    // the data for the next write, outputSize() bytes at most. Returns the number of bytes
+    unsigned int nextBuffers(std::vector<uv_buf_t>& buffers);
     void freeData(unsigned int len);
     void setMaxBufferSize(unsigned int bufferSize);
     void setMaxOutputSize(unsigned int outputSize);
 
+    // the output size starts at the maximum set, and grows up to a quarter of the capacity
+    // while the socket takes the writes right away (it shrinks back when it doesn't)
+    unsigned int outputSize() const { return outputsize; }
+    void adaptOutputSize(bool writtenRightAway);
+
     static const unsigned int MAX_BUFFER_SIZE = 2097152;
     static const unsigned int MAX_OUTPUT_SIZE = 16384;
 
+    // chunks are allocated with this size at least, small appends share them
+    static const unsigned int MIN_CHUNK_SIZE = 65536;
+
 protected:
-    char *buffer;
+    struct Chunk
+    {
+        std::unique_ptr<char[]> data;
+        unsigned int capacity;
+        unsigned int len;
+    };
+
+    uv_buf_t takeBuffer(unsigned int maxLen);
+
+    // free all the chunks, and their accounting in CodeCounter::MEM_STREAMING_BUFFERS
+    void releaseChunks();
+
+    // chunks with data not freed yet, the first ones handed out already
+    std::deque<Chunk> chunks;
+    size_t outchunk;      // the chunk with the next data to hand out
+    unsigned int outpos;  // in that chunk
+    unsigned int freepos; // data freed in the first chunk
+
     unsigned int capacity;
     unsigned int size;
     unsigned int free;
-    unsigned int inpos;
-    unsigned int outpos;
     unsigned int maxBufferSize;
     unsigned int maxOutputSize;
+    unsigned int outputsize;
 };
 
 class MegaTCPServer;
+class MegaTCPContext;
+
+// One of the event loops of a MegaTCPServer. Each one runs on its own thread with its own
+// listening socket, and serves the connections accepted on that socket
+class MegaTCPLoop
+{
+public:
+    MegaTCPServer *tcpServer;
+    uv_loop_t uv_loop;
+    uv_tcp_t server;
+    uv_async_t exit_handle;
+    list<MegaTCPContext*> connections;
+    uv_sem_t semaphoreStartup;
+    uv_sem_t semaphoreEnd;
+    MegaThread thread;
+    bool listening;
+    bool closing;
+    int remainingcloseevents;
+
+    MegaTCPLoop(MegaTCPServer *tcpServer);
+
+    // joins the thread, so the loop must have been stopped
+    ~MegaTCPLoop();
+};
+
 class MegaTCPContext : public MegaTransferListener, public MegaRequestListener
 {
 public:
@@ -3291,6 +3965,7 @@ public:
 
     // Connection management
     MegaTCPServer *server;
+    MegaTCPLoop *loop;
     uv_tcp_t tcphandle;
     uv_async_t asynchandle;
     uv_mutex_t mutex;
@@ -3332,26 +4007,19 @@ protected:
     static void *threadEntryPoint(void *param);
     static http_parser_settings parsercfg;
 
-    uv_loop_t uv_loop;
-
     set<handle> allowedHandles;
     handle lastHandle;
-    list<MegaTCPContext*> connections;
-    uv_async_t exit_handle;
     MegaApiImpl *megaApi;
-    bool semaphoresdestroyed;
-    uv_sem_t semaphoreStartup;
-    uv_sem_t semaphoreEnd;
-    MegaThread *thread;
-    uv_tcp_t server;
+
+    // the kernel spreads the incoming connections across the loops (SO_REUSEPORT)
+    vector<unique_ptr<MegaTCPLoop>> loops;
+    int numThreads;
     int maxBufferSize;
     int maxOutputSize;
     int restrictedMode;
     bool localOnly;
     bool started;
     int port;
-    bool closing;
-    int remainingcloseevents;
 
 #ifdef ENABLE_EVT_TLS
     // TLS
@@ -3392,8 +4060,7 @@ protected:
     static void closeConnection(MegaTCPContext *tcpctx);
     static void closeTCPConnection(MegaTCPContext *tcpctx);
 
-    void run();
-    void initializeAndStartListening();
+    void run(MegaTCPLoop& loop);
 
     void answer(MegaTCPContext* tcpctx, const char *rsp, size_t rlen);
 
@@ -3424,6 +4091,11 @@ public:
     void setMaxOutputSize(int outputSize);
     int getMaxBufferSize();
     int getMaxOutputSize();
+
+    // number of event loops used from the next start(). Only effective where the kernel
+    // balances connections between sockets sharing a port, elsewhere a single loop is used
+    void setNumThreads(int threads);
+    int getNumThreads();
     void setRestrictedMode(int mode);
     int getRestrictedMode();
     bool isHandleAllowed(handle h);
@@ -3457,7 +4129,6 @@ public:
     bool pause;
 
     // Request information
-    bool range;
     m_off_t rangeStart;
     m_off_t rangeEnd;
     m_off_t rangeWritten;
@@ -3471,11 +4142,16 @@ public:
     std::string nodeprivauth;
     std::string nodechatauth;
     int resultCode;
+    int fileAttributeType; // thumbnail or preview requested (/thumb/<handle>, /preview/<handle>), -1 if none
 
 
     // WEBDAV related
     int depth;
+
+    // the header being received, in buffers reused for all of them
     std::string lastheader;
+    std::string headerValue;
+    bool headerValueStarted;
     std::string subpathrelative;
     const char *messageBody;
     size_t messageBodySize;
@@ -3488,6 +4164,15 @@ public:
     MegaHandle nodeToMove; //node to be moved after delete
     MegaHandle newParentNode; //parent node for moved after delete
 
+    // PROPFIND listing written a batch of children at a time, as the socket drains
+    MegaHandle propFindParent; // folder whose children are still being written, UNDEF if none
+    int propFindOffset;
+    std::string propFindURL;
+    std::string propFindPending; // entries that didn't fit in the buffer yet
+    std::string propFindCacheKey;
+    std::string propFindBody; // the whole body so far, to cache it once complete. Empty if too big
+    uint64_t propFindGeneration;
+
     uv_mutex_t mutex_responses;
     std::list<std::string> responses;
 
@@ -3506,6 +4191,18 @@ protected:
     bool folderServerEnabled;
     bool offlineAttribute;
     bool subtitlesSupportEnabled;
+    bool metricsEnabled;
+
+    // complete PROPFIND responses by request, dropped whenever nodes change
+    std::mutex propFindCacheMutex;
+    std::map<std::string, std::string> propFindCache;
+    size_t propFindCacheSize;
+    uint64_t propFindCacheGeneration;
+    static const size_t MAX_PROPFIND_CACHE_SIZE = 8388608;
+    static const size_t MAX_PROPFIND_CACHED_RESPONSE = 1048576;
+
+    // children written to the buffer at once for PROPFIND
+    static const int PROPFIND_BATCH_SIZE = 200;
 
     //virtual methods:
     virtual void processReceivedData(MegaTCPContext *ftpctx, ssize_t nread, const uv_buf_t * buf);
@@ -3523,10 +4220,11 @@ protected:
     static int onUrlReceived(http_parser* parser, const char* url, size_t length);
     static int onHeaderField(http_parser* parser, const char* at, size_t length);
     static int onHeaderValue(http_parser* parser, const char* at, size_t length);
+    static void processHeader(MegaHTTPContext* httpctx);
     static int onBody(http_parser* parser, const char* at, size_t length);
     static int onMessageComplete(http_parser* parser);
 
-    static void sendHeaders(MegaHTTPContext *httpctx, string *headers);
+    static void sendHeaders(MegaHTTPContext *httpctx, const string *headers);
     static void sendNextBytes(MegaHTTPContext *httpctx);
     static int streamNode(MegaHTTPContext *httpctx);
 
@@ -3536,7 +4234,8 @@ protected:
     static std::string getResponseForNode(MegaNode *node, MegaHTTPContext* httpctx);
 
     // WEBDAV related
-    static std::string getWebDavPropFindResponseForNode(std::string baseURL, std::string subnodepath, MegaNode *node, MegaHTTPContext* httpctx);
+    static void sendWebDavPropFindResponse(std::string baseURL, std::string subnodepath, MegaNode *node, MegaHTTPContext* httpctx);
+    static void continueWebDavPropFindResponse(MegaHTTPContext* httpctx);
     static std::string getWebDavProfFindNodeContents(MegaNode *node, std::string baseURL, bool offlineAttribute);
 
     static void returnHttpCodeBasedOnRequestError(MegaHTTPContext* httpctx, MegaError *e, bool synchronous = true);
@@ -3547,6 +4246,16 @@ public:
     static void returnHttpCodeAsyncBasedOnRequestError(MegaHTTPContext* httpctx, MegaError *e);
     static void returnHttpCodeAsync(MegaHTTPContext* httpctx, int errorCode, std::string errorMessage = string());
 
+    // thumbnails and previews, from memory or fetched without going through files
+    static void sendFileAttribute(MegaHTTPContext* httpctx, int method);
+    static void returnFileAttribute(MegaHTTPContext* httpctx, const std::string& data, bool synchronous = true);
+
+    // performance metrics for Prometheus (/metrics)
+    static void sendMetrics(MegaHTTPContext* httpctx, int method);
+
+    static void appendWebDavPropFindEntry(std::string& out, const std::string& url, const char *name, bool folder, int64_t size,
+                                          int64_t ctime, int64_t mtime, MegaHandle h, bool offlineAttribute);
+
     MegaHTTPServer(MegaApiImpl *megaApi, string basePath, bool useTLS = false, std::string certificatepath = std::string(), std::string keypath = std::string(), bool useIPv6 = false);
     virtual ~MegaHTTPServer();
     char *getWebDavLink(MegaNode *node);
@@ -3563,7 +4272,11 @@ public:
     bool isOfflineAttributeEnabled();
     bool isSubtitlesSupportEnabled();
     void enableSubtitlesSupport(bool enable);
+    bool isMetricsEnabled();
+    void enableMetrics(bool enable);
 
+    // called when nodes change
+    void clearPropFindCache();
 };
 
 class MegaFTPServer;
@@ -3712,6 +4425,11 @@ protected:
 
     void sendNextBytes(MegaFTPDataContext *ftpdatactx);
 
+    // serving of files that have an up to date copy in a local sync
+    static const size_t LOCAL_SENDFILE_CHUNK = 1048576;
+    static const size_t LOCAL_WRITE_CHUNK = 65536;
+    bool openLocalCopy(MegaFTPDataContext *ftpdatactx, MegaNode *node);
+    void sendLocalBytes(MegaFTPDataContext *ftpdatactx);
 
 public:
     MegaFTPContext *controlftpctx;
@@ -3757,6 +4475,10 @@ public:
     std::unique_ptr<FileAccess> tmpFileAccess;
     size_t tmpFileSize;
 
+    // synced copy of the node being downloaded (-1 if it is streamed from the cloud)
+    uv_file localFile;
+    std::unique_ptr<char[]> localBuffer;
+
     bool controlRespondedElsewhere;
     string controlResponseMessage;
     int controlResponseCode;
@@ -0,0 +1,453 @@
+/**
+ * @file asyncdbtable.cpp
+ * @brief Write-behind database table
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include "mega/asyncdbtable.h"
+#include "mega/logging.h"
+
+namespace mega {
+
+// operations the writer applies per lock of the underlying table
+static const size_t OPS_PER_ROUND = 256;
+
+AsyncDbTable::AsyncDbTable(PrnGen& rng, DbTablePtr table)
+    : DbTable(rng, false)
+    , mTable(std::move(table))
+{
+    assert(mTable);
+    mThread = std::thread([this]()
+    {
+        ThreadRoles::enter(ThreadRoles::IO, "mega-db");
+        loop();
+    });
+}
+
+AsyncDbTable::~AsyncDbTable()
+{
+    resetCommitter();
+
+    {
+        lock_guard<mutex> g(mMutex);
+        mStop = true;
+    }
+    mQueueCV.notify_one();
+
+    // the writer drains the queue before leaving
+    mThread.join();
+}
+
+void AsyncDbTable::rewind()
+{
+    flush();
+
+    lock_guard<mutex> g(mDbMutex);
+    mTable->rewind();
+}
+
+void AsyncDbTable::rewindNonNodes()
+{
+    flush();
+
+    lock_guard<mutex> g(mDbMutex);
+    mTable->rewindNonNodes();
+}
+
+bool AsyncDbTable::next(uint32_t* index, string* data)
+{
+    lock_guard<mutex> g(mDbMutex);
+    return mTable->next(index, data);
+}
+
+bool AsyncDbTable::get(uint32_t index, string* data)
+{
+    {
+        lock_guard<mutex> g(mMutex);
+
+        auto it = mOverlay.find(index);
+        if (it != mOverlay.end())
+        {
+            if (!it->second.data)
+            {
+                return false;
+            }
+
+            *data = *it->second.data;
+            return true;
+        }
+
+        if (mTruncateSeq)
+        {
+            return false;
+        }
+    }
+
+    // not queued: the writer won't touch this record while we read it
+    lock_guard<mutex> g(mDbMutex);
+    return mTable->get(index, data);
+}
+
+bool AsyncDbTable::put(uint32_t index, char* data, unsigned len)
+{
+    return write(OP_PUT, index, nullptr, data, len);
+}
+
+bool AsyncDbTable::putNode(uint32_t index, const NodeRecordInfo& info, char* data, unsigned len)
+{
+    return write(OP_PUT_NODE, index, &info, data, len);
+}
+
+bool AsyncDbTable::put(const DbRecordBatch& records)
+{
+    checkTransaction();
+
+    Op op;
+    op.type = OP_PUT_BATCH;
+    op.id = 0;
+    op.batch = std::make_shared<const DbRecordBatch>(records);
+
+    lock_guard<mutex> g(mMutex);
+
+    if (mFailed)
+    {
+        return false;
+    }
+
+    // (the overlay shares the data of the batch)
+    op.seq = ++mSeq;
+    for (const auto& r : *op.batch)
+    {
+        mOverlay[r.first] = OverlayEntry{op.seq, std::shared_ptr<const string>(op.batch, &r.second)};
+    }
+    enqueue(std::move(op));
+    return true;
+}
+
+bool AsyncDbTable::putNodes(const DbNodeRecordBatch& records)
+{
+    checkTransaction();
+
+    Op op;
+    op.type = OP_PUT_NODES;
+    op.id = 0;
+    op.nodeBatch = std::make_shared<const DbNodeRecordBatch>(records);
+
+    lock_guard<mutex> g(mMutex);
+
+    if (mFailed)
+    {
+        return false;
+    }
+
+    op.seq = ++mSeq;
+    for (const auto& r : *op.nodeBatch)
+    {
+        mOverlay[r.id] = OverlayEntry{op.seq, std::shared_ptr<const string>(op.nodeBatch, &r.data)};
+    }
+    enqueue(std::move(op));
+    return true;
+}
+
+bool AsyncDbTable::del(uint32_t index)
+{
+    return write(OP_DEL, index, nullptr, nullptr, 0);
+}
+
+bool AsyncDbTable::write(OpType type, uint32_t id, const NodeRecordInfo* info, const char* data, unsigned len)
+{
+    checkTransaction();
+
+    Op op;
+    op.type = type;
+    op.id = id;
+
+    if (info)
+    {
+        op.info = *info;
+    }
+
+    if (data)
+    {
+        op.data = std::make_shared<const string>(data, len);
+    }
+
+    lock_guard<mutex> g(mMutex);
+
+    if (mFailed)
+    {
+        return false;
+    }
+
+    op.seq = ++mSeq;
+    mOverlay[id] = OverlayEntry{op.seq, op.data};
+    enqueue(std::move(op));
+    return true;
+}
+
+void AsyncDbTable::truncate()
+{
+    checkTransaction();
+
+    lock_guard<mutex> g(mMutex);
+
+    Op op;
+    op.type = OP_TRUNCATE;
+    op.id = 0;
+    op.seq = ++mSeq;
+
+    mOverlay.clear();
+    mTruncateSeq = op.seq;
+    enqueue(std::move(op));
+}
+
+void AsyncDbTable::begin()
+{
+    lock_guard<mutex> g(mMutex);
+
+    Op op;
+    op.type = OP_BEGIN;
+    op.id = 0;
+    op.seq = ++mSeq;
+
+    mInTransaction = true;
+    enqueue(std::move(op));
+}
+
+void AsyncDbTable::commit()
+{
+    lock_guard<mutex> g(mMutex);
+
+    Op op;
+    op.type = OP_COMMIT;
+    op.id = 0;
+    op.seq = ++mSeq;
+
+    mInTransaction = false;
+    enqueue(std::move(op));
+}
+
+void AsyncDbTable::abort()
+{
+    {
+        lock_guard<mutex> g(mMutex);
+
+        Op op;
+        op.type = OP_ABORT;
+        op.id = 0;
+        op.seq = ++mSeq;
+
+        mInTransaction = false;
+        enqueue(std::move(op));
+    }
+
+    // queued records of the rolled back transaction must not be served afterwards
+    flush();
+}
+
+void AsyncDbTable::remove()
+{
+    {
+        // nothing queued is worth writing anymore
+        lock_guard<mutex> g(mMutex);
+        mQueue.clear();
+        mOverlay.clear();
+        mTruncateSeq = 0;
+        mInTransaction = false;
+    }
+
+    flush();
+
+    lock_guard<mutex> g(mDbMutex);
+    mTable->remove();
+}
+
+bool AsyncDbTable::inTransaction() const
+{
+    lock_guard<mutex> g(mMutex);
+    return mInTransaction;
+}
+
+size_t AsyncDbTable::releaseMemory()
+{
+    lock_guard<mutex> g(mDbMutex);
+    return mTable->releaseMemory();
+}
+
+bool AsyncDbTable::getNodeHandlesByFingerprint(const string& fingerprint, m_off_t size, handle_vector* handles)
+{
+    flush();
+
+    lock_guard<mutex> g(mDbMutex);
+    return mTable->getNodeHandlesByFingerprint(fingerprint, size, handles);
+}
+
+bool AsyncDbTable::getRecentFileHandles(m_time_t since, handle_vector* handles)
+{
+    flush();
+
+    lock_guard<mutex> g(mDbMutex);
+    return mTable->getRecentFileHandles(since, handles);
+}
+
+void AsyncDbTable::flush()
+{
+    std::unique_lock<mutex> g(mMutex);
+    mIdleCV.wait(g, [this]() { return mQueue.empty() && !mApplying; });
+}
+
+size_t AsyncDbTable::pending() const
+{
+    lock_guard<mutex> g(mMutex);
+    return mQueue.size() + mApplying;
+}
+
+// must be called with mMutex held
+void AsyncDbTable::enqueue(Op&& op)
+{
+    mQueue.push_back(std::move(op));
+    mQueueCV.notify_one();
+}
+
+// must be called with mDbMutex held
+bool AsyncDbTable::apply(Op& op)
+{
+    switch (op.type)
+    {
+        case OP_PUT:
+            return mTable->put(op.id, const_cast<char*>(op.data->data()), unsigned(op.data->size()));
+
+        case OP_PUT_NODE:
+            return mTable->putNode(op.id, op.info, const_cast<char*>(op.data->data()), unsigned(op.data->size()));
+
+        case OP_PUT_BATCH:
+            return mTable->put(*op.batch);
+
+        case OP_PUT_NODES:
+            return mTable->putNodes(*op.nodeBatch);
+
+        case OP_DEL:
+            return mTable->del(op.id);
+
+        case OP_TRUNCATE:
+            mTable->truncate();
+            return true;
+
+        case OP_BEGIN:
+            mTable->begin();
+            return true;
+
+        case OP_COMMIT:
+            mTable->commit();
+            return true;
+
+        case OP_ABORT:
+            mTable->abort();
+            return true;
+    }
+
+    return false;
+}
+
+void AsyncDbTable::loop()
+{
+    std::unique_lock<mutex> g(mMutex);
+
+    for (;;)
+    {
+        mQueueCV.wait(g, [this]() { return mStop || !mQueue.empty(); });
+
+        if (mQueue.empty())
+        {
+            return;
+        }
+
+        // take a limited number at a time, so reads of the underlying table don't wait for long
+        std::deque<Op> ops;
+        if (mQueue.size() <= OPS_PER_ROUND)
+        {
+            ops.swap(mQueue);
+        }
+        else
+        {
+            auto last = mQueue.begin() + OPS_PER_ROUND;
+            ops.assign(std::make_move_iterator(mQueue.begin()), std::make_move_iterator(last));
+            mQueue.erase(mQueue.begin(), last);
+        }
+        mApplying = ops.size();
+
+        g.unlock();
+
+        bool failed = false;
+        {
+            lock_guard<mutex> dg(mDbMutex);
+            for (Op& op : ops)
+            {
+                if (!apply(op))
+                {
+                    LOG_err << "Write-behind database operation failed: " << op.type << " " << op.id;
+                    failed = true;
+                }
+            }
+        }
+
+        g.lock();
+
+        // the table now has these records: stop serving them from memory unless they were written again since
+        auto applied = [this](uint32_t id, uint64_t seq)
+        {
+            auto it = mOverlay.find(id);
+            if (it != mOverlay.end() && it->second.seq == seq)
+            {
+                mOverlay.erase(it);
+            }
+        };
+
+        for (Op& op : ops)
+        {
+            if (op.type == OP_PUT || op.type == OP_PUT_NODE || op.type == OP_DEL)
+            {
+                applied(op.id, op.seq);
+            }
+            else if (op.type == OP_PUT_BATCH)
+            {
+                for (const auto& r : *op.batch)
+                {
+                    applied(r.first, op.seq);
+                }
+            }
+            else if (op.type == OP_PUT_NODES)
+            {
+                for (const auto& r : *op.nodeBatch)
+                {
+                    applied(r.id, op.seq);
+                }
+            }
+            else if (op.type == OP_TRUNCATE && mTruncateSeq == op.seq)
+            {
+                mTruncateSeq = 0;
+            }
+        }
+
+        mFailed = mFailed || failed;
+        mApplying = 0;
+        mIdleCV.notify_all();
+    }
+}
+
+} // namespace
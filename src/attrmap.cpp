@@ -22,6 +22,61 @@
 #include "mega/attrmap.h"
 
 namespace mega {
+
+attr_map::iterator attr_map::lowerBound(nameid key)
+{
+    return std::lower_bound(mItems.begin(), mItems.end(), key, [](const value_type& v, nameid k)
+    {
+        return v.first < k;
+    });
+}
+
+attr_map::iterator attr_map::find(nameid key)
+{
+    auto it = lowerBound(key);
+    return it != mItems.end() && it->first == key ? it : mItems.end();
+}
+
+attr_map::const_iterator attr_map::find(nameid key) const
+{
+    auto it = std::lower_bound(mItems.begin(), mItems.end(), key, [](const value_type& v, nameid k)
+    {
+        return v.first < k;
+    });
+    return it != mItems.end() && it->first == key ? it : mItems.end();
+}
+
+string& attr_map::operator[](nameid key)
+{
+    auto it = lowerBound(key);
+    if (it == mItems.end() || it->first != key)
+    {
+        it = mItems.emplace(it, key, string());
+    }
+    return it->second;
+}
+
+pair<attr_map::iterator, bool> attr_map::insert(value_type v)
+{
+    auto it = lowerBound(v.first);
+    if (it != mItems.end() && it->first == v.first)
+    {
+        return std::make_pair(it, false);
+    }
+    return std::make_pair(mItems.insert(it, std::move(v)), true);
+}
+
+attr_map::size_type attr_map::erase(nameid key)
+{
+    auto it = find(key);
+    if (it == mItems.end())
+    {
+        return 0;
+    }
+    mItems.erase(it);
+    return 1;
+}
+
 // approximate raw storage size of serialized AttrMap, not taking JSON escaping
 // or name length into account
 unsigned AttrMap::storagesize(int perrecord) const
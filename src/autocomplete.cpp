@@ -635,14 +635,29 @@ bool LocalFS::addCompletions(ACState& s)
             }
 #endif
 
-            if (fs::exists(searchPath) && fs::is_directory(searchPath))
+            std::error_code ec;
+            if (fs::is_directory(searchPath, ec))
             {
-                for (fs::directory_iterator iter(searchPath); iter != fs::directory_iterator(); ++iter)
+                // each keystroke completes in the same folder: list it again only when it changed
+                std::string folder = searchPath.u8string();
+                long long mtime = static_cast<long long>(fs::last_write_time(searchPath, ec).time_since_epoch().count());
+                if (ec || folder != listedFolder || mtime != listedTime)
                 {
-                    if ((reportFolders && fs::is_directory(iter->status())) ||
-                        (reportFiles && fs::is_regular_file(iter->status())))
+                    listing.clear();
+                    for (fs::directory_iterator iter(searchPath); iter != fs::directory_iterator(); ++iter)
                     {
-                        s.addPathCompletion(iter->path().u8string(), cp, fs::is_directory(iter->status()), sep, true);
+                        fs::file_status status = iter->status();
+                        listing.push_back(Entry{iter->path().u8string(), fs::is_directory(status), fs::is_regular_file(status)});
+                    }
+                    listedFolder = ec ? std::string() : folder;
+                    listedTime = mtime;
+                }
+
+                for (const Entry& e : listing)
+                {
+                    if ((reportFolders && e.folder) || (reportFiles && e.file))
+                    {
+                        s.addPathCompletion(std::string(e.path), cp, e.folder, sep, true);
                     }
                 }
             }
@@ -787,13 +802,29 @@ bool MegaFS::addCompletions(ACState& s)
                 }
                 else
                 {
+                    // through the index by name for big folders
                     Node* nodematch = NULL;
-                    for (Node* subnode : n->children)
+                    node_vector matches;
+                    if (n->children.byName(folderName.c_str(), matches))
                     {
-                        if (subnode->type == FOLDERNODE && subnode->displayname() == folderName)
+                        for (Node* subnode : matches)
                         {
-                            nodematch = subnode;
-                            break;
+                            if (subnode->type == FOLDERNODE)
+                            {
+                                nodematch = subnode;
+                                break;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        for (Node* subnode : n->children)
+                        {
+                            if (subnode->type == FOLDERNODE && subnode->displayname() == folderName)
+                            {
+                                nodematch = subnode;
+                                break;
+                            }
                         }
                     }
                     n = nodematch;
@@ -808,15 +839,41 @@ bool MegaFS::addCompletions(ACState& s)
             else
             {
                 // iterate specified folder
-                if (n)
+                auto add = [&](Node* subnode)
                 {
-                    for (Node* subnode : n->children)
+                    if ((reportFolders && subnode->type == FOLDERNODE) ||
+                        (reportFiles && subnode->type == FILENODE))
+                    {
+                        s.addPathCompletion(pathprefix + subnode->displayname(), "", subnode->type == FOLDERNODE, '/', false);
+                    }
+                };
+
+                if (n && n->children.size() >= NodeChildren::NAME_INDEX_THRESHOLD)
+                {
+                    // big folders keep their children sorted by name, so that each keystroke visits the matching ones only
+                    const node_vector* sorted = n->children.sorted(NodeChildren::ORDER_NAME_BYTES);
+                    if (!sorted)
                     {
-                        if ((reportFolders && subnode->type == FOLDERNODE) ||
-                            (reportFiles && subnode->type == FILENODE))
+                        sorted = &n->children.addSorted(NodeChildren::ORDER_NAME_BYTES, [](Node* a, Node* b)
                         {
-                            s.addPathCompletion(pathprefix + subnode->displayname(), "", subnode->type == FOLDERNODE, '/', false);
-                        }
+                            return strcmp(a->displayname(), b->displayname()) < 0;
+                        });
+                    }
+
+                    auto it = std::lower_bound(sorted->begin(), sorted->end(), leaf, [](Node* a, const std::string& name)
+                    {
+                        return strcmp(a->displayname(), name.c_str()) < 0;
+                    });
+                    for (; it != sorted->end() && !strncmp((*it)->displayname(), leaf.c_str(), leaf.size()); ++it)
+                    {
+                        add(*it);
+                    }
+                }
+                else if (n)
+                {
+                    for (Node* subnode : n->children)
+                    {
+                        add(subnode);
                     }
                 }
             }
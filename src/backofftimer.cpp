@@ -19,11 +19,79 @@
  * program.
  */
 
+#include <cmath>
+#include <sstream>
+
 #include "mega/waiter.h"
 #include "mega/backofftimer.h"
 #include "mega/logging.h"
 
 namespace mega {
+
+void LatencyHistogram::record(std::chrono::milliseconds latency)
+{
+    auto ms = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && ms >= (uint64_t(1) << bucket))
+    {
+        ++bucket;
+    }
+
+    ++mBuckets[bucket];
+    ++mResponses;
+    mRecentErrorRate -= mRecentErrorRate / 16;
+}
+
+void LatencyHistogram::recordError()
+{
+    ++mErrors;
+    mRecentErrorRate += (1 - mRecentErrorRate) / 16;
+}
+
+unsigned LatencyHistogram::percentile(double fraction) const
+{
+    if (!mResponses)
+    {
+        return 0;
+    }
+
+    auto wanted = static_cast<uint64_t>(std::ceil(fraction * double(mResponses)));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        seen += mBuckets[i];
+        if (seen >= wanted && seen)
+        {
+            return 1u << i;
+        }
+    }
+    return 1u << (BUCKETS - 1);
+}
+
+string LatencyHistogram::toJson() const
+{
+    std::ostringstream json;
+    json << "{\"responses\":" << mResponses
+         << ",\"errors\":" << mErrors
+         << ",\"recenterrorrate\":" << mRecentErrorRate
+         << ",\"p50\":" << percentile(0.5)
+         << ",\"p90\":" << percentile(0.9)
+         << ",\"p99\":" << percentile(0.99)
+         << ",\"buckets\":[";
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        json << (i ? "," : "") << mBuckets[i];
+    }
+    json << "]}";
+    return json.str();
+}
+
+void LatencyHistogram::reset()
+{
+    *this = LatencyHistogram();
+}
+
 // timer with capped exponential backoff
 BackoffTimer::BackoffTimer(PrnGen &rng)
     : rng(rng)
@@ -52,6 +120,31 @@ void BackoffTimer::backoff()
     delta = base + (dstime)((base / 2.0) * (rng.genuint32(RAND_MAX)/(float)RAND_MAX));
 }
 
+void BackoffTimer::backoff(const LatencyHistogram& latency)
+{
+    // 30 seconds while the endpoint is mostly answering, the usual 10 minutes when it's mostly failing
+    dstime cap = latency.recentErrorRate() < 0.5 ? 300 : 6000;
+    dstime usual = (latency.percentile(0.9) + 99) / 100;
+
+    next = Waiter::ds + std::max(std::min(delta, cap), usual);
+
+    base <<= 1;
+
+    if (base > cap)
+    {
+        base = cap;
+    }
+
+    delta = base + (dstime)((base / 2.0) * (rng.genuint32(RAND_MAX)/(float)RAND_MAX));
+}
+
+void BackoffTimer::backoff(dstime newdelta, const LatencyHistogram& latency)
+{
+    dstime usual = (latency.percentile(0.9) + 99) / 100;
+    newdelta = std::max(newdelta, usual);
+    backoff(newdelta + (dstime)((newdelta / 2.0) * (rng.genuint32(RAND_MAX)/(float)RAND_MAX)));
+}
+
 void BackoffTimer::backoff(dstime newdelta)
 {
     next = (newdelta == NEVER) ? NEVER : (Waiter::ds + newdelta);
@@ -137,89 +230,202 @@ TimerWithBackoff::TimerWithBackoff(PrnGen &rng, int tag)
 }
 
 
-void BackoffTimerGroupTracker::update(dstime* waituntil, bool transfers)
+namespace {
+
+// index of the lowest bit set in a non-zero word
+unsigned lowestBit(uint64_t word)
 {
-    // This function performs a similar action as calling BackoffTimer::update for all the timers in the group,
-    // which is to say, the `waituntil` parameter will be updated with the soonest time that we would need to
-    // wake up from any of the timers in this group, should any of them be in a back-off state.
-    // There are also some side-effects specfic to transfers which are preserved from the old system.
+    static const unsigned char debruijn[64] = {
+         0,  1,  2, 53,  3,  7, 54, 27,  4, 38, 41,  8, 34, 55, 48, 28,
+        62,  5, 39, 46, 44, 42, 22,  9, 24, 35, 59, 56, 49, 18, 29, 11,
+        63, 52,  6, 26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
+        51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12 };
+
+    return debruijn[((word & (~word + 1)) * 0x022FDD63CC95386DULL) >> 58];
+}
+
+} // namespace
+
+void TimerWheel::link(Entry& e, unsigned char level, unsigned char slot)
+{
+    Entry*& head = level == Entry::EXPIRED ? mExpired : mSlots[level][slot];
+    e.mLevel = level;
+    e.mSlot = slot;
+    e.mPrev = nullptr;
+    e.mNext = head;
+    if (head)
+    {
+        head->mPrev = &e;
+    }
+    head = &e;
+
+    if (level != Entry::EXPIRED)
+    {
+        mOccupied[level] |= uint64_t(1) << slot;
+    }
+}
+
+void TimerWheel::insert(Entry& e, dstime when)
+{
+    assert(!e.scheduled());
+    e.mWhen = when;
+    mSize++;
 
-    vector<BackoffTimerTracked*> v;
-    v.reserve(timeouts.size());
-
-    if (transfers)
-    {
-        // used to be:
-        //for (transfer_map::iterator it = transfers[d].begin(); it != transfers[d].end(); it++)
-        //{
-        //    if ((!it->second->slot || !it->second->slot->fa)
-        //     && it->second->bt.nextset())
-        //    {
-        //        it->second->bt.update(dsmin);
-        //        if (it->second->bt.armed())
-        //        {
-        //            // fire the timer only once but keeping it armed
-        //            it->second->bt.set(0);
-        //            LOG_debug << "Disabling armed transfer backoff";
-        //        }
-        //    }
-        //}
-
-        for (auto t : timeouts)
+    if (when <= mNow)
+    {
+        link(e, Entry::EXPIRED, 0);
+        return;
+    }
+
+    // the highest digit where it differs from now, which is greater than now's
+    unsigned level = LEVELS - 1;
+    while (level && !((when ^ mNow) >> (level * SLOTBITS)))
+    {
+        level--;
+    }
+    link(e, static_cast<unsigned char>(level), static_cast<unsigned char>((when >> (level * SLOTBITS)) & (SLOTS - 1)));
+}
+
+void TimerWheel::remove(Entry& e)
+{
+    assert(e.scheduled());
+
+    if (e.mPrev)
+    {
+        e.mPrev->mNext = e.mNext;
+    }
+    else if (e.mLevel == Entry::EXPIRED)
+    {
+        mExpired = e.mNext;
+    }
+    else if (!(mSlots[e.mLevel][e.mSlot] = e.mNext))
+    {
+        mOccupied[e.mLevel] &= ~(uint64_t(1) << e.mSlot);
+    }
+
+    if (e.mNext)
+    {
+        e.mNext->mPrev = e.mPrev;
+    }
+
+    e.mPrev = e.mNext = nullptr;
+    e.mLevel = Entry::UNSCHEDULED;
+    mSize--;
+}
+
+auto TimerWheel::takeSlot(unsigned level, unsigned slot) -> Entry*
+{
+    Entry* list = mSlots[level][slot];
+    mSlots[level][slot] = nullptr;
+    mOccupied[level] &= ~(uint64_t(1) << slot);
+    return list;
+}
+
+void TimerWheel::advance(dstime now)
+{
+    if (now <= mNow)
+    {
+        return;
+    }
+
+    // the highest digit that changes: below it everything is due, at it the slots up to now's digit
+    unsigned top = LEVELS - 1;
+    while (top && !((now ^ mNow) >> (top * SLOTBITS)))
+    {
+        top--;
+    }
+    unsigned digit = (now >> (top * SLOTBITS)) & (SLOTS - 1);
+
+    Entry* moving = nullptr;
+    for (unsigned level = 0; level <= top; level++)
+    {
+        while (mOccupied[level])
         {
-            // put the ones to work on in a vector, as working on them changes their position in the map
-            if (t.first <= Waiter::ds)
-            {
-                v.push_back(t.second);
-            }
-            else
+            unsigned slot = lowestBit(mOccupied[level]);
+            if (level == top && slot > digit)
             {
                 break;
             }
-        }
 
-        for (auto t : v)
-        {
-            t->update(waituntil);
-            if (t->armed())
+            Entry* list = takeSlot(level, slot);
+            while (list)
             {
-                // fire the timer only once but keeping it armed
-                t->set(0);
-                LOG_debug << "Disabling armed transfer backoff";
+                Entry* e = list;
+                list = list->mNext;
+                e->mNext = moving;
+                moving = e;
             }
         }
+    }
+
+    mNow = now;
 
+    // the slot of now's digit goes to the lower levels, the rest has expired
+    while (moving)
+    {
+        Entry* e = moving;
+        moving = moving->mNext;
+        e->mLevel = Entry::UNSCHEDULED;
+        mSize--;
+        insert(*e, e->mWhen);
     }
-    else
+}
+
+void TimerWheel::expired(vector<Entry*>& entries) const
+{
+    for (Entry* e = mExpired; e; e = e->mNext)
     {
-        // used to be:
-        //for (transferslot_list::iterator it = tslots.begin(); it != tslots.end(); it++)
-        //{
-        //    if (!(*it)->retrybt.armed())
-        //    {
-        //        (*it)->retrybt.update(&nds);
-        //    }
-        //}
+        entries.push_back(e);
+    }
+}
 
-        // put the ones to work on in a vector, as working on them changes their position in the map
-        for (auto t : timeouts)
+dstime TimerWheel::next() const
+{
+    for (unsigned level = 0; level < LEVELS; level++)
+    {
+        if (mOccupied[level])
         {
-            if (t.second->armed())
-            {
-                v.push_back(t.second);
-            }
-            if (t.first > Waiter::ds)
-            {
-                break;
-            }
+            // now's higher digits, then the slot's digit
+            unsigned shift = level * SLOTBITS;
+            uint64_t high = (uint64_t(mNow) >> (shift + SLOTBITS)) << (shift + SLOTBITS);
+            return static_cast<dstime>(high | (uint64_t(lowestBit(mOccupied[level])) << shift));
         }
+    }
+    return NEVER;
+}
+
+void BackoffTimerGroupTracker::update(dstime* waituntil, bool transfers)
+{
+    // This function performs a similar action as calling BackoffTimer::update for all the timers in the group,
+    // which is to say, the `waituntil` parameter will be updated with the soonest time that we would need to
+    // wake up from any of the timers in this group, should any of them be in a back-off state.
+    // There are also some side-effects specfic to transfers which are preserved from the old system.
+
+    // the ones to work on are copied, as working on them moves them in the wheel
+    timeouts.advance(Waiter::ds);
+    vector<TimerWheel::Entry*> v;
+    timeouts.expired(v);
+
+    for (TimerWheel::Entry* e : v)
+    {
+        BackoffTimerTracked* t = static_cast<BackoffTimerTracked*>(e);
+
+        // update may set next=1 so we can't just call the first one.
+        t->update(waituntil);
 
-        for (auto t : v)
+        if (transfers && t->armed())
         {
-            // update may set next=1 so we can't just call the first one.
-            t->update(waituntil);
+            // fire the timer only once but keeping it armed
+            t->set(0);
+            LOG_debug << "Disabling armed transfer backoff";
         }
+    }
 
+    // the ones still backing off
+    dstime soonest = timeouts.next();
+    if (soonest < *waituntil)
+    {
+        *waituntil = soonest;
     }
 }
 
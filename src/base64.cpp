@@ -22,88 +22,230 @@
 #include "mega/base64.h"
 #include "mega/utils.h"
 
+// AVX2 is not assumed by the build: those versions are compiled for it on their own and picked at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MEGA_BASE64_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#define MEGA_BASE64_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace mega {
-// modified base64 conversion (no trailing '=' and '-_' instead of '+/')
-unsigned char Base64::to64(byte c)
-{
-    c &= 63;
 
-    if (c < 26)
+namespace {
+
+const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// from64() of every byte value, constant so it's usable during static initialisation
+const byte from64Table[256] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255,  62, 255,  63,
+     52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255, 255, 255, 255,
+    255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+     15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255,  63,
+    255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+     41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+
+size_t base64EncodeScalar(const byte* b, size_t blen, char* a)
+{
+    size_t i = 0;
+    for (; i + 3 <= blen; i += 3, a += 4)
     {
-        return c + 'A';
+        unsigned v = unsigned(b[i]) << 16 | unsigned(b[i + 1]) << 8 | b[i + 2];
+        a[0] = alphabet[v >> 18];
+        a[1] = alphabet[(v >> 12) & 63];
+        a[2] = alphabet[(v >> 6) & 63];
+        a[3] = alphabet[v & 63];
     }
+    return i;
+}
 
-    if (c < 52)
+size_t base64DecodeScalar(const char* a, size_t alen, byte* b, size_t blen)
+{
+    size_t i = 0;
+    for (; i + 4 <= alen && i / 4 * 3 + 3 <= blen; i += 4, b += 3)
     {
-        return c - 26 + 'a';
-    }
+        unsigned c0 = from64Table[byte(a[i])], c1 = from64Table[byte(a[i + 1])];
+        unsigned c2 = from64Table[byte(a[i + 2])], c3 = from64Table[byte(a[i + 3])];
+        if ((c0 | c1 | c2 | c3) == 255)
+        {
+            break;
+        }
 
-    if (c < 62)
-    {
-        return c - 52 + '0';
+        unsigned v = c0 << 18 | c1 << 12 | c2 << 6 | c3;
+        b[0] = byte(v >> 16);
+        b[1] = byte(v >> 8);
+        b[2] = byte(v);
     }
+    return i;
+}
 
-    if (c == 62)
+#ifdef MEGA_BASE64_AVX2
+// 24 bytes to 32 characters per iteration: each lane gets 12 of the bytes, spread so that every 6 bits
+// land in a byte of their own, which is then mapped to its character by adding the offset of its range
+__attribute__((target("avx2")))
+size_t base64EncodeAVX2(const byte* b, size_t blen, char* a)
+{
+    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    // offset of each range: a-z, 0-9 (ten times), -, _, A-Z
+    const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0,
+                                             'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0);
+
+    // the second lane reads 4 bytes past the 24
+    size_t i = 0;
+    for (; i + 28 <= blen; i += 24, a += 32)
     {
-        return '-';
-    }
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))),
+                                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, spread);
+
+        __m256i high = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i low = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(high, low);
 
-    return '_';
+        // 52-63 to 1-12, 0-25 to 13, 26-51 to 0
+        __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a), _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range)));
+    }
+    return i;
 }
 
-unsigned char Base64::from64(byte c)
+// 32 characters to 24 bytes per iteration, both alphabets accepted.  Whether a character is valid depends on its
+// high nibble (+-/ digits, A-O, P-Z_, a-o, p-z or none) and its low nibble, whose lookups have a bit in common if
+// it isn't.  The value is the character plus an offset that depends on its high nibble, but for +-/ and _
+__attribute__((target("avx2")))
+size_t base64DecodeAVX2(const char* a, size_t alen, byte* b, size_t blen)
 {
-    if ((c >= 'A') && (c <= 'Z'))
+    const __m256i invalidLow = _mm256_setr_epi8(0x25, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21, 0x23, 0x3a, 0x3b, 0x3a, 0x3b, 0x32,
+                                                0x25, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21, 0x23, 0x3a, 0x3b, 0x3a, 0x3b, 0x32);
+    const __m256i invalidHigh = _mm256_setr_epi8(0x20, 0x20, 0x01, 0x02, 0x04, 0x08, 0x04, 0x10, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+                                                 0x20, 0x20, 0x01, 0x02, 0x04, 0x08, 0x04, 0x10, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20);
+    const __m256i offsetHigh = _mm256_setr_epi8(0, 0, 0, 52 - '0', -'A', -'A', 26 - 'a', 26 - 'a', 0, 0, 0, 0, 0, 0, 0, 0,
+                                                0, 0, 0, 52 - '0', -'A', -'A', 26 - 'a', 26 - 'a', 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i offsetSymbols = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 62 - '+', 0, 62 - '-', 0, 63 - '/',
+                                                   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 62 - '+', 0, 62 - '-', 0, 63 - '/');
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+    // each lane's 12 bytes are stored with 4 more after them
+    size_t i = 0;
+    for (; i + 32 <= alen && i / 4 * 3 + 28 <= blen; i += 32)
     {
-        return c - 'A';
-    }
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i high = _mm256_and_si256(_mm256_srli_epi32(c, 4), nibble);
+        __m256i low = _mm256_and_si256(c, nibble);
 
-    if ((c >= 'a') && (c <= 'z'))
-    {
-        return c - 'a' + 26;
-    }
+        __m256i invalid = _mm256_and_si256(_mm256_shuffle_epi8(invalidLow, low), _mm256_shuffle_epi8(invalidHigh, high));
+        if (!_mm256_testz_si256(invalid, invalid))
+        {
+            break;
+        }
 
-    if ((c >= '0') && (c <= '9'))
-    {
-        return c - '0' + 52;
-    }
+        __m256i offset = _mm256_shuffle_epi8(offsetHigh, high);
+        offset = _mm256_blendv_epi8(offset, _mm256_shuffle_epi8(offsetSymbols, low), _mm256_cmpeq_epi8(high, _mm256_set1_epi8(2)));
+        offset = _mm256_blendv_epi8(offset, _mm256_set1_epi8(63 - '_'), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+        __m256i values = _mm256_add_epi8(c, offset);
 
-    if (c == '-' || c == '+')
-    {
-        return 62;
-    }
+        // 4 values to 24 bits in each 32-bit word, then its 3 bytes in order
+        __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        merged = _mm256_shuffle_epi8(merged, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
 
-    if (c == '_' || c == '/')
-    {
-        return 63;
+        byte* out = b + i / 4 * 3;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(merged));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm256_extracti128_si256(merged, 1));
     }
-
-    return 255;
+    return i;
 }
+#endif
 
-
-int Base64::atob(const string &in, string &out)
+#ifdef MEGA_BASE64_NEON
+// 48 bytes to 64 characters per iteration, deinterleaved by the loads and interleaved back by the stores
+size_t base64EncodeNEON(const byte* b, size_t blen, char* a)
 {
-    out.resize(in.size() * 3 / 4 + 3);
-    out.resize(Base64::atob(in.data(), (byte *) out.data(), (int)out.size()));
+    const byte* table = reinterpret_cast<const byte*>(alphabet);
+    uint8x16x4_t lookup = {{ vld1q_u8(table), vld1q_u8(table + 16), vld1q_u8(table + 32), vld1q_u8(table + 48) }};
+    const uint8x16_t mask = vdupq_n_u8(63);
 
-    return (int)out.size();
+    size_t i = 0;
+    for (; i + 48 <= blen; i += 48, a += 64)
+    {
+        uint8x16x3_t in = vld3q_u8(b + i);
+        uint8x16x4_t out;
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+        out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+        out.val[3] = vandq_u8(in.val[2], mask);
+
+        for (int j = 0; j < 4; ++j)
+        {
+            out.val[j] = vqtbl4q_u8(lookup, out.val[j]);
+        }
+        vst4q_u8(reinterpret_cast<byte*>(a), out);
+    }
+    return i;
 }
 
-std::string Base64::atob(const std::string &in)
+// 64 characters to 48 bytes per iteration, with from64() of the ASCII characters in eight registers
+size_t base64DecodeNEON(const char* a, size_t alen, byte* b, size_t blen)
 {
-    string out;
-    out.resize(in.size() * 3 / 4 + 3);
-    out.resize(Base64::atob(in.data(), (byte *) out.data(), (int)out.size()));
+    uint8x16x4_t low = {{ vld1q_u8(from64Table), vld1q_u8(from64Table + 16), vld1q_u8(from64Table + 32), vld1q_u8(from64Table + 48) }};
+    uint8x16x4_t high = {{ vld1q_u8(from64Table + 64), vld1q_u8(from64Table + 80), vld1q_u8(from64Table + 96), vld1q_u8(from64Table + 112) }};
 
-    return out;
+    size_t i = 0;
+    for (; i + 64 <= alen && i / 4 * 3 + 48 <= blen; i += 64)
+    {
+        uint8x16x4_t in = vld4q_u8(reinterpret_cast<const byte*>(a + i));
+
+        // invalid characters are 255, and those past ASCII have their top bit set too
+        uint8x16_t invalid = vdupq_n_u8(0);
+        for (int j = 0; j < 4; ++j)
+        {
+            uint8x16_t v = vqtbx4q_u8(vqtbl4q_u8(low, in.val[j]), high, vsubq_u8(in.val[j], vdupq_n_u8(64)));
+            invalid = vorrq_u8(invalid, vorrq_u8(v, in.val[j]));
+            in.val[j] = v;
+        }
+        if (vmaxvq_u8(invalid) & 0x80)
+        {
+            break;
+        }
+
+        uint8x16x3_t out;
+        out.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2), vshrq_n_u8(in.val[1], 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4), vshrq_n_u8(in.val[2], 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+        vst3q_u8(b + i / 4 * 3, out);
+    }
+    return i;
 }
+#endif
 
-int Base64::atob(const char* a, byte* b, int blen)
+// the partial group the string ends with, if any, as atob() always decoded it: stops at the first character
+// that isn't base64 (or at alen)
+int base64DecodeTail(const char* a, size_t alen, byte* b, int blen)
 {
     byte c[4];
     int i;
     int p = 0;
+    size_t pos = 0;
 
     c[3] = 0;
 
@@ -111,7 +253,7 @@ int Base64::atob(const char* a, byte* b, int blen)
     {
         for (i = 0; i < 4; i++)
         {
-            if ((c[i] = from64(*a++)) == 255)
+            if (pos == alen || (c[i] = from64Table[static_cast<byte>(a[pos++])]) == 255)
             {
                 break;
             }
@@ -140,6 +282,139 @@ int Base64::atob(const char* a, byte* b, int blen)
     }
 }
 
+} // namespace
+
+std::vector<Base64Kernels::Implementation> Base64Kernels::implementations()
+{
+    std::vector<Implementation> result;
+    result.push_back({ "scalar", base64EncodeScalar, base64DecodeScalar });
+
+#ifdef MEGA_BASE64_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        result.push_back({ "avx2", base64EncodeAVX2, base64DecodeAVX2 });
+    }
+#endif
+
+#ifdef MEGA_BASE64_NEON
+    result.push_back({ "neon", base64EncodeNEON, base64DecodeNEON });
+#endif
+
+    return result;
+}
+
+const Base64Kernels::Implementation& Base64Kernels::best()
+{
+    static const Implementation fastest = implementations().back();
+    return fastest;
+}
+
+// modified base64 conversion (no trailing '=' and '-_' instead of '+/')
+unsigned char Base64::to64(byte c)
+{
+    return alphabet[c & 63];
+}
+
+unsigned char Base64::from64(byte c)
+{
+    return from64Table[c];
+}
+
+
+int Base64::atob(const string &in, string &out)
+{
+    out.resize(in.size() * 3 / 4 + 3);
+    out.resize(Base64::atob(in.data(), in.size(), (byte *) out.data(), (int)out.size()));
+
+    return (int)out.size();
+}
+
+std::string Base64::atob(const std::string &in)
+{
+    string out;
+    out.resize(in.size() * 3 / 4 + 3);
+    out.resize(Base64::atob(in.data(), in.size(), (byte *) out.data(), (int)out.size()));
+
+    return out;
+}
+
+int Base64::atob(const char* a, byte* b, int blen)
+{
+    // the length isn't known, so no reading ahead
+    return base64DecodeTail(a, std::numeric_limits<size_t>::max(), b, blen);
+}
+
+int Base64::atob(const char* a, size_t alen, byte* b, int blen)
+{
+    size_t consumed = blen > 0 ? Base64Kernels::best().decode(a, alen, b, size_t(blen)) : 0;
+    int p = int(consumed / 4 * 3);
+    return p + base64DecodeTail(a + consumed, alen - consumed, b + p, blen - p);
+}
+
+void Base64::handletoa(const byte* b, unsigned size, char* a)
+{
+    assert(size == 6 || size == 8);
+
+    // the bits of the handle in order, from the top
+    uint64_t v = 0;
+    for (unsigned i = 0; i < size; ++i)
+    {
+        v = v << 8 | b[i];
+    }
+
+    if (size == 8)
+    {
+        a[0] = alphabet[v >> 58];
+        a[1] = alphabet[(v >> 52) & 63];
+        a[2] = alphabet[(v >> 46) & 63];
+        a[3] = alphabet[(v >> 40) & 63];
+        a[4] = alphabet[(v >> 34) & 63];
+        a[5] = alphabet[(v >> 28) & 63];
+        a[6] = alphabet[(v >> 22) & 63];
+        a[7] = alphabet[(v >> 16) & 63];
+        a[8] = alphabet[(v >> 10) & 63];
+        a[9] = alphabet[(v >> 4) & 63];
+        a[10] = alphabet[(v << 2) & 63];
+        a[11] = 0;
+    }
+    else
+    {
+        a[0] = alphabet[v >> 42];
+        a[1] = alphabet[(v >> 36) & 63];
+        a[2] = alphabet[(v >> 30) & 63];
+        a[3] = alphabet[(v >> 24) & 63];
+        a[4] = alphabet[(v >> 18) & 63];
+        a[5] = alphabet[(v >> 12) & 63];
+        a[6] = alphabet[(v >> 6) & 63];
+        a[7] = alphabet[v & 63];
+        a[8] = 0;
+    }
+}
+
+bool Base64::atohandle(const char* a, unsigned size, byte* b)
+{
+    assert(size == 6 || size == 8);
+
+    // 8 characters make the 6 bytes, 11 the 8 bytes (the last one's 2 low bits are padding)
+    unsigned n = size == 8 ? 11 : 8;
+    uint64_t v = 0;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        byte c = from64Table[static_cast<byte>(a[i])];
+        if (c == 255)
+        {
+            return false;
+        }
+        v = i < 10 ? v << 6 | c : v << 4 | c >> 2;
+    }
+
+    for (unsigned i = size; i--; v >>= 8)
+    {
+        b[i] = byte(v);
+    }
+    return true;
+}
+
 void Base64::itoa(int64_t val, string *result)
 {
     byte c;
@@ -225,6 +500,14 @@ int Base64::btoa(const byte* b, int blen, char* a)
 {
     int p = 0;
 
+    if (blen > 0)
+    {
+        size_t consumed = Base64Kernels::best().encode(b, size_t(blen), a);
+        b += consumed;
+        blen -= int(consumed);
+        p = int(consumed / 3 * 4);
+    }
+
     for (;;)
     {
         if (blen <= 0)
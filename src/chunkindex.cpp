@@ -0,0 +1,224 @@
+/**
+ * @file chunkindex.cpp
+ * @brief Content-defined chunks of a local file, to find what two versions have in common
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <unordered_set>
+
+#include "mega/chunkindex.h"
+#include "mega/utils.h"
+
+namespace mega {
+
+namespace {
+
+const unsigned READ_SIZE = 1 << 20;
+
+// the rolling hash shifts a byte out every 64: only the last 64 bytes before a boundary decide it
+const uint32_t WINDOW = 64;
+
+// a boundary where the top 20 bits of the rolling hash are 0, some 1 MiB apart past MIN_CHUNK
+const uint64_t BOUNDARY_MASK = ~uint64_t(0) << 44;
+
+// the same table everywhere, for the chunks of a previous session to be comparable
+struct GearTable
+{
+    uint64_t values[256];
+
+    GearTable()
+    {
+        // splitmix64
+        uint64_t state = 0x6d656761;
+        for (auto& v : values)
+        {
+            uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            v = z ^ (z >> 31);
+        }
+    }
+};
+
+const GearTable gear;
+
+} // namespace
+
+bool ChunkIndex::compute(FileAccess& fa, const std::function<bool()>& cancelled)
+{
+    chunks.clear();
+
+    vector<byte> buffer(READ_SIZE);
+    HashSHA256 hash;
+    string digest;
+
+    m_off_t chunkStart = 0;
+    uint64_t rolling = 0;
+
+    auto cut = [&](m_off_t end)
+    {
+        hash.get(&digest);
+        chunks.push_back(Chunk{chunkStart, uint32_t(end - chunkStart), MemAccess::get<uint64_t>(digest.data())});
+        chunkStart = end;
+        rolling = 0;
+    };
+
+    for (m_off_t pos = 0; pos < fa.size; )
+    {
+        if (cancelled())
+        {
+            return false;
+        }
+
+        unsigned len = fa.size - pos < READ_SIZE ? unsigned(fa.size - pos) : READ_SIZE;
+        if (!fa.frawread(buffer.data(), len, pos, true))
+        {
+            return false;
+        }
+
+        unsigned hashed = 0;
+        for (unsigned i = 0; i < len; )
+        {
+            // the bytes before the window of the smallest chunk can't make a boundary
+            m_off_t windowStart = chunkStart + MIN_CHUNK - WINDOW;
+            if (pos + i < windowStart)
+            {
+                if (windowStart >= pos + len)
+                {
+                    break;
+                }
+                i = unsigned(windowStart - pos);
+            }
+
+            rolling = (rolling << 1) + gear.values[buffer[i++]];
+
+            m_off_t size = pos + i - chunkStart;
+            if ((size >= MIN_CHUNK && !(rolling & BOUNDARY_MASK)) || size >= MAX_CHUNK)
+            {
+                hash.add(buffer.data() + hashed, i - hashed);
+                hashed = i;
+                cut(pos + i);
+            }
+        }
+
+        hash.add(buffer.data() + hashed, len - hashed);
+        pos += len;
+    }
+
+    if (chunkStart < fa.size)
+    {
+        cut(fa.size);
+    }
+
+    return true;
+}
+
+vector<std::pair<m_off_t, m_off_t>> ChunkIndex::commonRanges(const ChunkIndex& other) const
+{
+    std::unordered_set<uint64_t> known;
+    for (auto& c : other.chunks)
+    {
+        known.insert(c.hash);
+    }
+
+    vector<std::pair<m_off_t, m_off_t>> ranges;
+    for (auto& c : chunks)
+    {
+        if (!known.count(c.hash))
+        {
+            continue;
+        }
+
+        if (!ranges.empty() && ranges.back().second == c.offset)
+        {
+            ranges.back().second += c.size;
+        }
+        else
+        {
+            ranges.emplace_back(c.offset, c.offset + c.size);
+        }
+    }
+    return ranges;
+}
+
+string ChunkIndex::key(const FileFingerprint& fp)
+{
+    string key;
+    FileFingerprint(fp).serialize(&key);
+    return key;
+}
+
+bool ChunkIndex::serialize(string* d)
+{
+    CacheableWriter w(*d);
+    w.serializestring(key(fingerprint));
+    w.serializevarint(chunks.size());
+
+    // the offsets follow from the sizes
+    for (auto& c : chunks)
+    {
+        w.serializevarint(c.size);
+        w.serializebinary((byte*)&c.hash, sizeof c.hash);
+    }
+
+    w.serializeexpansionflags();
+    return true;
+}
+
+unique_ptr<ChunkIndex> ChunkIndex::unserialize(const string& d)
+{
+    CacheableReader r(d);
+    unique_ptr<ChunkIndex> index(new ChunkIndex);
+
+    string fp;
+    uint64_t count;
+    unsigned char expansions[8];
+
+    if (!r.unserializestring(fp) || !r.unserializevarint(count))
+    {
+        return nullptr;
+    }
+
+    const char* ptr = fp.data();
+    if (!index->fingerprint.unserialize(ptr, ptr + fp.size()))
+    {
+        return nullptr;
+    }
+
+    m_off_t offset = 0;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        uint64_t chunkSize;
+        uint64_t hash;
+        if (!r.unserializevarint(chunkSize) || !r.unserializebinary((byte*)&hash, sizeof hash))
+        {
+            return nullptr;
+        }
+
+        index->chunks.push_back(Chunk{offset, uint32_t(chunkSize), hash});
+        offset += m_off_t(chunkSize);
+    }
+
+    if (!r.unserializeexpansionflags(expansions, 0))
+    {
+        return nullptr;
+    }
+    return index;
+}
+
+} // namespace
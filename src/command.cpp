@@ -33,10 +33,18 @@ Command::Command()
     tag = 0;
     batchSeparately = false;
     suppressSID = false;
+    traceId = TraceScope::current();
 }
 
 Command::~Command()
 {
+    for (Command* c : coalesced)
+    {
+        if (!c->persistent)
+        {
+            delete c;
+        }
+    }
 }
 
 void Command::cancel()
@@ -237,5 +245,15 @@ void Command::closeobject()
     jsonWriter.closeobject();
 }
 
+size_t Command::size() const
+{
+    return jsonWriter.size();
+}
+
+void Command::reserve(size_t n)
+{
+    jsonWriter.reserve(n);
+}
+
 } // namespace
 
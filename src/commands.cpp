@@ -150,6 +150,7 @@ CommandGetFA::CommandGetFA(MegaClient *client, int p, handle fahref)
     part = p;
 
     cmd("ufa");
+    orderIndependent = true;
     arg("fah", (byte*)&fahref, sizeof fahref);
 
     if (client->usehttps)
@@ -169,16 +170,7 @@ bool CommandGetFA::procresult(Result r)
     {
         if (it != client->fafcs.end())
         {
-            faf_map::iterator fafsit;
-            for (fafsit = it->second->fafs[0].begin(); fafsit != it->second->fafs[0].end(); )
-            {
-                // move from fresh to pending
-                it->second->fafs[1][fafsit->first] = fafsit->second;
-                it->second->fafs[0].erase(fafsit++);
-            }
-
-            it->second->e = r.errorOrOK();
-            it->second->req.status = REQ_FAILURE;
+            it->second->urlfailed(r.errorOrOK());
         }
 
         return true;
@@ -201,20 +193,12 @@ bool CommandGetFA::procresult(Result r)
                     {
                         JSON::copystring(&it->second->posturl, p);
                         it->second->urltime = Waiter::ds;
+                        it->second->gettingurl = false;
                         it->second->dispatch();
                     }
                     else
                     {
-                        faf_map::iterator fafsit;
-                        for (fafsit = it->second->fafs[0].begin(); fafsit != it->second->fafs[0].end(); )
-                        {
-                            // move from fresh to pending
-                            it->second->fafs[1][fafsit->first] = fafsit->second;
-                            it->second->fafs[0].erase(fafsit++);
-                        }
-
-                        it->second->e = API_EINTERNAL;
-                        it->second->req.status = REQ_FAILURE;
+                        it->second->urlfailed(API_EINTERNAL);
                     }
                 }
 
@@ -223,16 +207,10 @@ bool CommandGetFA::procresult(Result r)
             default:
                 if (!client->json.storeobject())
                 {
-                    faf_map::iterator fafsit;
-                    for (fafsit = it->second->fafs[0].begin(); fafsit != it->second->fafs[0].end(); )
+                    if (it != client->fafcs.end())
                     {
-                        // move from fresh to pending
-                        it->second->fafs[1][fafsit->first] = fafsit->second;
-                        it->second->fafs[0].erase(fafsit++);
+                        it->second->urlfailed(API_EINTERNAL);
                     }
-
-                    it->second->e = API_EINTERNAL;
-                    it->second->req.status = REQ_FAILURE;
                     return false;
                 }
         }
@@ -242,6 +220,7 @@ bool CommandGetFA::procresult(Result r)
 CommandAttachFA::CommandAttachFA(MegaClient *client, handle nh, fatype t, handle ah, int ctag)
 {
     cmd("pfa");
+    background = true;
     notself(client);
 
     arg("n", (byte*)&nh, MegaClient::NODEHANDLE);
@@ -260,6 +239,7 @@ CommandAttachFA::CommandAttachFA(MegaClient *client, handle nh, fatype t, handle
 CommandAttachFA::CommandAttachFA(MegaClient *client, handle nh, fatype t, const std::string& encryptedAttributes, int ctag)
 {
     cmd("pfa");
+    background = true;
     notself(client);
 
     arg("n", (byte*)&nh, MegaClient::NODEHANDLE);
@@ -507,6 +487,7 @@ CommandDirectRead::CommandDirectRead(MegaClient *client, DirectReadNode* cdrn)
     drn = cdrn;
 
     cmd("g");
+    orderIndependent = true;
     arg(drn->p ? "n" : "p", (byte*)&drn->h, MegaClient::NODEHANDLE);
     arg("g", 1); // server will provide download URL(s)/token(s) (if skipped, only information about the file)
     arg("v", 2);  // version 2: server can supply details for cloudraid files
@@ -654,6 +635,7 @@ CommandGetFile::CommandGetFile(MegaClient *client, const byte* key, size_t keySi
                                bool singleUrl, Cb &&completion)
 {
     cmd("g");
+    orderIndependent = true;
     arg(p ? "n" : "p", (byte*)&h, MegaClient::NODEHANDLE);
     arg("g", 1); // server will provide download URL(s)/token(s) (if skipped, only information about the file)
     if (!singleUrl)
@@ -946,6 +928,20 @@ bool CommandSetAttr::procresult(Result r)
     return r.wasErrorOrOK();
 }
 
+Command::Coalescing CommandSetAttr::coalescing(const Command& earlier) const
+{
+    // the attributes are sent whole, so the last ones for the node are all that's needed
+    if (auto c = dynamic_cast<const CommandSetAttr*>(&earlier))
+    {
+        if (c->h != h)
+        {
+            return COALESCE_PASS;
+        }
+        return syncop || c->syncop ? COALESCE_NONE : COALESCE_REPLACE;
+    }
+    return dynamic_cast<const CommandMoveNode*>(&earlier) ? COALESCE_PASS : COALESCE_NONE;
+}
+
 // (the result is not processed directly - we rely on the server-client
 // response)
 CommandPutNodes::CommandPutNodes(MegaClient* client, NodeHandle th,
@@ -981,6 +977,14 @@ CommandPutNodes::CommandPutNodes(MegaClient* client, NodeHandle th,
         arg("cauth", cauth);
     }
 
+    // the attributes and keys make up most of it: thousands of nodes would otherwise reallocate over and over
+    size_t estimate = size() + 16;
+    for (const NewNode& n : nn)
+    {
+        estimate += 128 + (n.attrstring ? n.attrstring->size() : 0) * 4 / 3 + n.nodekey.size() * 4 / 3;
+    }
+    reserve(estimate);
+
     beginarray("n");
 
     for (unsigned i = 0; i < nn.size(); i++)
@@ -1253,7 +1257,7 @@ bool CommandPutNodes::procresult(Result r)
                 // A node has been added by a regular (non sync) putnodes
                 // inside a synced folder, so force a syncdown to detect
                 // and sync the changes.
-                client->syncdownrequired = true;
+                client->requestsyncdown();
             }
         }
 #endif
@@ -1392,6 +1396,18 @@ bool CommandMoveNode::procresult(Result r)
     return r.wasErrorOrOK();
 }
 
+Command::Coalescing CommandMoveNode::coalescing(const Command& earlier) const
+{
+    // a move may depend on where other nodes are (eg. one moved into its own subtree),
+    // so only attribute changes in between are skipped
+    if (auto c = dynamic_cast<const CommandMoveNode*>(&earlier))
+    {
+        return c->h == h && syncdel == SYNCDEL_NONE && c->syncdel == SYNCDEL_NONE && !syncop && !c->syncop
+                ? COALESCE_REPLACE : COALESCE_NONE;
+    }
+    return dynamic_cast<const CommandSetAttr*>(&earlier) ? COALESCE_PASS : COALESCE_NONE;
+}
+
 CommandDelNode::CommandDelNode(MegaClient* client, NodeHandle th, bool keepversions, int cmdtag, std::function<void(NodeHandle, Error)>&& f)
     : mResultFunction(move(f))
 {
@@ -1963,9 +1979,11 @@ CommandSetShare::CommandSetShare(MegaClient* client, Node* n, User* u, accesslev
     if (newshare)
     {
         // the new share's nodekeys for this user: generate node list
-        TreeProcShareKeys tpsk(n);
+        // a large folder gets the rest of its keys in batches, after the share is created
+        TreeProcShareKeys tpsk(n, MegaClient::SHAREKEYS_BATCH);
         client->proctree(n, &tpsk);
         tpsk.get(this);
+        mRemainingKeys = move(tpsk.remaining);
     }
 }
 
@@ -2013,6 +2031,10 @@ bool CommandSetShare::procresult(Result r)
 {
     if (r.wasErrorOrOK())
     {
+        if (r.wasError(API_OK) && !mRemainingKeys.empty())
+        {
+            client->queuesharekeys(sh, move(mRemainingKeys));
+        }
         completion(r.errorOrOK(), mWritable);
         return true;
     }
@@ -2080,6 +2102,10 @@ bool CommandSetShare::procresult(Result r)
                 break;
 
             case EOO:
+                if (!mRemainingKeys.empty())
+                {
+                    client->queuesharekeys(sh, move(mRemainingKeys));
+                }
                 completion(API_OK, mWritable);
                 return true;
 
@@ -2164,6 +2190,7 @@ bool CommandSetPendingContact::procresult(Result r)
                 client->notifypcr(pcr);
 
                 // remove pending shares related to the deleted PCR
+                client->loadAllCachedNodes();
                 Node *n;
                 for (node_map::iterator it = client->nodes.begin(); it != client->nodes.end(); it++)
                 {
@@ -2920,20 +2947,21 @@ CommandGetUA::CommandGetUA(MegaClient* /*client*/, const char* uid, attr_t at, c
     this->uid = uid;
     this->at = at;
     this->ph = ph ? string(ph) : "";
+    mJoinable = !completionErr && !completionBytes && !compltionTLV && this->ph.empty();
 
     mCompletionErr = completionErr ? move(completionErr) :
         [this](error e) {
-            client->app->getua_result(e);
+            report([&]() { client->app->getua_result(e); });
         };
 
     mCompletionBytes = completionBytes ? move(completionBytes) :
         [this](byte* b, unsigned l, attr_t e) {
-            client->app->getua_result(b, l, e);
+            report([&]() { client->app->getua_result(b, l, e); });
         };
 
     mCompletionTLV = compltionTLV ? move(compltionTLV) :
         [this](TLVstore* t, attr_t e) {
-            client->app->getua_result(t, e);
+            report([&]() { client->app->getua_result(t, e); });
         };
 
     if (ph && ph[0])
@@ -2952,10 +2980,32 @@ CommandGetUA::CommandGetUA(MegaClient* /*client*/, const char* uid, attr_t at, c
     tag = ctag;
 }
 
+void CommandGetUA::report(const std::function<void()>& f)
+{
+    f();
+    for (int waiter : mWaiters)
+    {
+        client->restag = waiter;
+        f();
+    }
+    client->restag = tag;
+}
+
 bool CommandGetUA::procresult(Result r)
 {
     User *u = client->finduser(uid.c_str());
 
+    // those asking for it from now on need another retrieval
+    if (mJoinable)
+    {
+        auto it = client->mGetUAWaiters.find(std::make_pair(uid, at));
+        if (it != client->mGetUAWaiters.end())
+        {
+            mWaiters = std::move(it->second);
+            client->mGetUAWaiters.erase(it);
+        }
+    }
+
     if (r.wasErrorOrOK())
     {
         if (r.wasError(API_ENOENT) && u)
@@ -3340,6 +3390,7 @@ CommandNodeKeyUpdate::CommandNodeKeyUpdate(MegaClient* client, handle_vector* v)
     byte nodekey[FILENODEKEYLENGTH];
 
     cmd("k");
+    background = true;
     beginarray("nk");
 
     for (size_t i = v->size(); i--;)
@@ -3410,6 +3461,27 @@ CommandKeyCR::CommandKeyCR(MegaClient* /*client*/, node_vector* rshares, node_ve
     endarray();
 }
 
+CommandPutShareKeys::CommandPutShareKeys(MegaClient* client, ShareNodeKeys& snk)
+{
+    cmd("k");
+    snk.get(this);
+
+    tag = client->reqtag;
+}
+
+bool CommandPutShareKeys::procresult(Result r)
+{
+    // keys that didn't make it are requested by the server with a cr when needed
+    if (r.wasErrorOrOK() && r.errorOrOK() != API_OK)
+    {
+        LOG_warn << "Share node keys not sent: " << r.errorOrOK();
+    }
+
+    client->sharekeysinflight = false;
+    client->sendsharekeys();
+    return true;
+}
+
 // a == ACCESS_UNKNOWN: request public key for user handle and respond with
 // share key for sn
 // otherwise: request public key for user handle and continue share creation
@@ -3615,7 +3687,8 @@ bool CommandGetUserData::procresult(Result r)
 
     for (;;)
     {
-        string attributeName = client->json.getnameWithoutAdvance();
+        // the name as a string is only needed for the user attributes, not known by their nameid
+        const char* fieldname = client->json.pos;
         switch (client->json.getnameid())
         {
         case MAKENAMEID3('a', 'a', 'v'):    // account authentication version
@@ -4250,7 +4323,10 @@ bool CommandGetUserData::procresult(Result r)
             return true;
         }
         default:
-            switch (User::string2attr(attributeName.c_str()))
+        {
+            JSON attributeName;
+            attributeName.begin(fieldname);
+            switch (User::string2attr(attributeName.getnameWithoutAdvance().c_str()))
             {
                 case ATTR_FIRSTNAME:
                     parseUserAttribute(firstname, versionFirstname);
@@ -4275,6 +4351,7 @@ bool CommandGetUserData::procresult(Result r)
 
             break;
         }
+        }
     }
 }
 
@@ -4690,6 +4767,7 @@ bool CommandGetUserQuota::procresult(Result r)
 CommandQueryTransferQuota::CommandQueryTransferQuota(MegaClient* client, m_off_t size)
 {
     cmd("qbq");
+    orderIndependent = true;
     arg("s", size);
 
     tag = client->reqtag;
@@ -4933,6 +5011,7 @@ bool CommandSetPH::procresult(Result r)
 CommandGetPH::CommandGetPH(MegaClient* client, handle cph, const byte* ckey, int cop)
 {
     cmd("g");
+    orderIndependent = true;
     arg("p", (byte*)&cph, MegaClient::NODEHANDLE);
 
     ph = cph;
@@ -5440,15 +5519,44 @@ bool CommandFetchNodes::procresult(Result r)
     WAIT_CLASS::bumpds();
     client->fnstats.timeToLastByte = Waiter::ds - client->fnstats.startTime;
 
-    client->purgenodesusersabortsc(true);
+    // the node array may have been read while the response was downloading, on top of a purged tree
+    MegaClient::FetchNodesStream* stream = client->mFetchNodesStream.get();
+    bool streamed = !r.wasErrorOrOK() && stream && stream->started();
+
+    if (!streamed)
+    {
+        client->purgenodesusersabortsc(true);
+    }
 
     if (r.wasErrorOrOK())
     {
+        client->mTreeRefresh.reset();
         client->fetchingnodes = false;
         client->app->fetchnodes_result(r.errorOrOK());
         return true;
     }
 
+    if (streamed && stream->state != MegaClient::FetchNodesStream::DONE)
+    {
+        client->mTreeRefresh.reset();
+        client->fetchingnodes = false;
+        client->app->fetchnodes_result(API_EINTERNAL);
+        return false;
+    }
+
+    // on a reload the node array was spooled instead, and the previous tree kept until now
+    if (streamed && client->mTreeRefresh && client->mTreeRefresh->spool)
+    {
+        client->purgenodesusersabortsc(true);
+        if (!client->readspoolednodes())
+        {
+            client->mTreeRefresh.reset();
+            client->fetchingnodes = false;
+            client->app->fetchnodes_result(API_EINTERNAL);
+            return false;
+        }
+    }
+
     for (;;)
     {
         switch (client->json.getnameid())
@@ -5846,6 +5954,7 @@ bool CommandUserFeedbackStore::procresult(Result r)
 CommandSendEvent::CommandSendEvent(MegaClient *client, int type, const char *desc)
 {
     cmd("log");
+    background = true;
     arg("e", type);
     arg("m", desc);
 
@@ -8347,6 +8456,7 @@ CommandBackupPutHeartBeat::CommandBackupPutHeartBeat(MegaClient* client, handle
     : mCompletion(f)
 {
     cmd("sphb");
+    background = true;
 
     arg("id", (byte*)&backupId, MegaClient::BACKUPHANDLE);
     arg("s", status);
@@ -75,17 +75,7 @@ void SymmCipher::setkey(const byte* newkey, int type)
     aesecb_e.SetKey(key, KEYLENGTH);
     aesecb_d.SetKey(key, KEYLENGTH);
 
-    aescbc_e.SetKeyWithIV(key, KEYLENGTH, zeroiv);
-    aescbc_d.SetKeyWithIV(key, KEYLENGTH, zeroiv);
-
-    aesccm8_e.SetKeyWithIV(key, KEYLENGTH, zeroiv);
-    aesccm8_d.SetKeyWithIV(key, KEYLENGTH, zeroiv);
-
-    aesccm16_e.SetKeyWithIV(key, KEYLENGTH, zeroiv);
-    aesccm16_d.SetKeyWithIV(key, KEYLENGTH, zeroiv);
-
-    aesgcm_e.SetKeyWithIV(key, KEYLENGTH, zeroiv);
-    aesgcm_d.SetKeyWithIV(key, KEYLENGTH, zeroiv);
+    keyedmodes = 0;
 }
 
 bool SymmCipher::setkey(const string* key)
@@ -102,14 +92,14 @@ bool SymmCipher::setkey(const string* key)
 
 void SymmCipher::cbc_encrypt(byte* data, size_t len, const byte* iv)
 {
-    aescbc_e.Resynchronize(iv ? iv : zeroiv);
-    aescbc_e.ProcessData(data, data, len);
+    keyed(aescbc_e, KEYED_CBC_E).Resynchronize(iv ? iv : zeroiv);
+    keyed(aescbc_e, KEYED_CBC_E).ProcessData(data, data, len);
 }
 
 void SymmCipher::cbc_decrypt(byte* data, size_t len, const byte* iv)
 {
-    aescbc_d.Resynchronize(iv ? iv : zeroiv);
-    aescbc_d.ProcessData(data, data, len);
+    keyed(aescbc_d, KEYED_CBC_D).Resynchronize(iv ? iv : zeroiv);
+    keyed(aescbc_d, KEYED_CBC_D).ProcessData(data, data, len);
 }
 
 void SymmCipher::cbc_encrypt_pkcs_padding(const string *data, const byte *iv, string *result)
@@ -117,7 +107,7 @@ void SymmCipher::cbc_encrypt_pkcs_padding(const string *data, const byte *iv, st
     using Transformation = StreamTransformationFilter;
 
     // Update IV.
-    aescbc_e.Resynchronize(iv ? iv : zeroiv);
+    keyed(aescbc_e, KEYED_CBC_E).Resynchronize(iv ? iv : zeroiv);
 
     // Create sink.
     unique_ptr<StringSink> sink =
@@ -125,7 +115,7 @@ void SymmCipher::cbc_encrypt_pkcs_padding(const string *data, const byte *iv, st
 
     // Create transform.
     unique_ptr<Transformation> xfrm =
-      mega::make_unique<Transformation>(aescbc_e,
+      mega::make_unique<Transformation>(keyed(aescbc_e, KEYED_CBC_E),
                                         sink.get(),
                                         Transformation::PKCS_PADDING);
 
@@ -143,7 +133,7 @@ bool SymmCipher::cbc_decrypt_pkcs_padding(const std::string* data, const byte* i
         using Transformation = StreamTransformationFilter;
 
         // Update IV.
-        aescbc_d.Resynchronize(iv ? iv : zeroiv);
+        keyed(aescbc_d, KEYED_CBC_D).Resynchronize(iv ? iv : zeroiv);
 
         // Create sink.
         unique_ptr<StringSink> sink =
@@ -151,7 +141,7 @@ bool SymmCipher::cbc_decrypt_pkcs_padding(const std::string* data, const byte* i
         
         // Create transform.
         unique_ptr<Transformation> xfrm =
-          mega::make_unique<Transformation>(aescbc_d,
+          mega::make_unique<Transformation>(keyed(aescbc_d, KEYED_CBC_D),
                                             sink.get(),
                                             Transformation::PKCS_PADDING);
 
@@ -181,7 +171,7 @@ bool SymmCipher::cbc_decrypt_pkcs_padding(const byte* data,
         using Transformation = StreamTransformationFilter;
 
         // Update IV.
-        aescbc_d.Resynchronize(iv ? iv : zeroiv);
+        keyed(aescbc_d, KEYED_CBC_D).Resynchronize(iv ? iv : zeroiv);
 
         // Create sink.
         unique_ptr<StringSink> sink =
@@ -189,7 +179,7 @@ bool SymmCipher::cbc_decrypt_pkcs_padding(const byte* data,
         
         // Create transform.
         unique_ptr<Transformation> xfrm =
-          mega::make_unique<Transformation>(aescbc_d,
+          mega::make_unique<Transformation>(keyed(aescbc_d, KEYED_CBC_D),
                                             sink.get(),
                                             Transformation::PKCS_PADDING);
 
@@ -223,15 +213,15 @@ void SymmCipher::ccm_encrypt(const string *data, const byte *iv, unsigned ivlen,
 {
     if (taglen == 16)
     {
-        aesccm16_e.Resynchronize(iv, ivlen);
-        aesccm16_e.SpecifyDataLengths(0, data->size(), 0);
-        StringSource(*data, true, new AuthenticatedEncryptionFilter(aesccm16_e, new StringSink(*result)));
+        keyed(aesccm16_e, KEYED_CCM16_E).Resynchronize(iv, ivlen);
+        keyed(aesccm16_e, KEYED_CCM16_E).SpecifyDataLengths(0, data->size(), 0);
+        StringSource(*data, true, new AuthenticatedEncryptionFilter(keyed(aesccm16_e, KEYED_CCM16_E), new StringSink(*result)));
     }
     else if (taglen == 8)
     {
-        aesccm8_e.Resynchronize(iv, ivlen);
-        aesccm8_e.SpecifyDataLengths(0, data->size(), 0);
-        StringSource(*data, true, new AuthenticatedEncryptionFilter(aesccm8_e, new StringSink(*result)));
+        keyed(aesccm8_e, KEYED_CCM8_E).Resynchronize(iv, ivlen);
+        keyed(aesccm8_e, KEYED_CCM8_E).SpecifyDataLengths(0, data->size(), 0);
+        StringSource(*data, true, new AuthenticatedEncryptionFilter(keyed(aesccm8_e, KEYED_CCM8_E), new StringSink(*result)));
     }
 }
 
@@ -240,15 +230,15 @@ bool SymmCipher::ccm_decrypt(const string *data, const byte *iv, unsigned ivlen,
     try {
         if (taglen == 16)
         {
-            aesccm16_d.Resynchronize(iv, ivlen);
-            aesccm16_d.SpecifyDataLengths(0, data->size() - taglen, 0);
-            StringSource(*data, true, new AuthenticatedDecryptionFilter(aesccm16_d, new StringSink(*result)));
+            keyed(aesccm16_d, KEYED_CCM16_D).Resynchronize(iv, ivlen);
+            keyed(aesccm16_d, KEYED_CCM16_D).SpecifyDataLengths(0, data->size() - taglen, 0);
+            StringSource(*data, true, new AuthenticatedDecryptionFilter(keyed(aesccm16_d, KEYED_CCM16_D), new StringSink(*result)));
         }
         else if (taglen == 8)
         {
-            aesccm8_d.Resynchronize(iv, ivlen);
-            aesccm8_d.SpecifyDataLengths(0, data->size() - taglen, 0);
-            StringSource(*data, true, new AuthenticatedDecryptionFilter(aesccm8_d, new StringSink(*result)));
+            keyed(aesccm8_d, KEYED_CCM8_D).Resynchronize(iv, ivlen);
+            keyed(aesccm8_d, KEYED_CCM8_D).SpecifyDataLengths(0, data->size() - taglen, 0);
+            StringSource(*data, true, new AuthenticatedDecryptionFilter(keyed(aesccm8_d, KEYED_CCM8_D), new StringSink(*result)));
         }
     } catch (HashVerificationFilter::HashVerificationFailed e)
     {
@@ -275,8 +265,8 @@ bool SymmCipher::gcm_encrypt_aad(const unsigned char *data, size_t datasize, con
     try
     {
         // resynchronizes with the provided IV
-        aesgcm_e.Resynchronize(iv, static_cast<int>(ivlen));
-        AuthenticatedEncryptionFilter ef (aesgcm_e, new ArraySink(result, resultSize), false, static_cast<int>(taglen));
+        keyed(aesgcm_e, KEYED_GCM_E).Resynchronize(iv, static_cast<int>(ivlen));
+        AuthenticatedEncryptionFilter ef (keyed(aesgcm_e, KEYED_GCM_E), new ArraySink(result, resultSize), false, static_cast<int>(taglen));
 
         // add additionalData to channel for additional authenticated data
         ef.ChannelPut(AAD_CHANNEL, additionalData, additionalDatalen, true);
@@ -296,15 +286,15 @@ bool SymmCipher::gcm_encrypt_aad(const unsigned char *data, size_t datasize, con
 
 void SymmCipher::gcm_encrypt(const string *data, const byte *iv, unsigned ivlen, unsigned taglen, string *result)
 {
-    aesgcm_e.Resynchronize(iv, ivlen);
-    StringSource(*data, true, new AuthenticatedEncryptionFilter(aesgcm_e, new StringSink(*result), false, taglen));
+    keyed(aesgcm_e, KEYED_GCM_E).Resynchronize(iv, ivlen);
+    StringSource(*data, true, new AuthenticatedEncryptionFilter(keyed(aesgcm_e, KEYED_GCM_E), new StringSink(*result), false, taglen));
 }
 
 bool SymmCipher::gcm_decrypt(const string *data, const byte *iv, unsigned ivlen, unsigned taglen, string *result)
 {
-    aesgcm_d.Resynchronize(iv, ivlen);
+    keyed(aesgcm_d, KEYED_GCM_D).Resynchronize(iv, ivlen);
     try {
-        StringSource(*data, true, new AuthenticatedDecryptionFilter(aesgcm_d, new StringSink(*result), taglen));
+        StringSource(*data, true, new AuthenticatedDecryptionFilter(keyed(aesgcm_d, KEYED_GCM_D), new StringSink(*result), taglen));
     } catch (HashVerificationFilter::HashVerificationFailed e)
     {
         result->clear();
@@ -335,9 +325,9 @@ bool SymmCipher::gcm_decrypt_aad(const byte *data, unsigned datalen,
     try
     {
         // resynchronizes with provided IV
-        aesgcm_d.Resynchronize(iv, static_cast<int>(ivlen));
+        keyed(aesgcm_d, KEYED_GCM_D).Resynchronize(iv, static_cast<int>(ivlen));
         unsigned int flags = AuthenticatedDecryptionFilter::MAC_AT_BEGIN | AuthenticatedDecryptionFilter::THROW_EXCEPTION;
-        AuthenticatedDecryptionFilter df(aesgcm_d, nullptr, flags, static_cast<int>(taglen));
+        AuthenticatedDecryptionFilter df(keyed(aesgcm_d, KEYED_GCM_D), nullptr, flags, static_cast<int>(taglen));
 
         // add tag (GCM authentication tag) to DEFAULT_CHANNEL to check message hash or MAC
         df.ChannelPut(DEFAULT_CHANNEL, tag, taglen);
@@ -454,61 +444,194 @@ SymmCipher& SymmCipher::operator=(const SymmCipher& ref)
     return *this;
 }
 
+SymmCipher* SymmCipherCache::get(const byte* key, int type)
+{
+    byte effective[SymmCipher::KEYLENGTH];
+    memcpy(effective, key, sizeof effective);
+    if (!type)
+    {
+        SymmCipher::xorblock(key + SymmCipher::KEYLENGTH, effective);
+    }
+
+    auto it = std::find_if(mCiphers.begin(), mCiphers.end(), [&effective](const std::unique_ptr<SymmCipher>& c)
+    {
+        return !memcmp(c->key, effective, sizeof effective);
+    });
+
+    if (it != mCiphers.end())
+    {
+        hits++;
+    }
+    else
+    {
+        misses++;
+        if (mCiphers.size() < CAPACITY)
+        {
+            mCiphers.emplace_back(new SymmCipher);
+        }
+        it = mCiphers.end() - 1;
+        (*it)->setkey(effective);
+    }
+
+    std::rotate(mCiphers.begin(), it, it + 1);
+    return mCiphers.front().get();
+}
+
+SymmCipher* SymmCipherCache::get(const string* key)
+{
+    if (key->size() != FILENODEKEYLENGTH && key->size() != FOLDERNODEKEYLENGTH)
+    {
+        return nullptr;
+    }
+
+    return get((const byte*)key->data(), (key->size() == FOLDERNODEKEYLENGTH) ? FOLDERNODE : FILENODE);
+}
+
 // encryption: data must be NUL-padded to BLOCKSIZE
 // decryption: data must be padded to BLOCKSIZE
 // len must be < 2^31
 void SymmCipher::ctr_crypt(byte* data, unsigned len, m_off_t pos, ctr_iv ctriv, byte* mac, bool encrypt, bool initmac)
 {
-    assert(!(pos & (KEYLENGTH - 1)));
-
-    byte ctr[BLOCKSIZE], tmp[BLOCKSIZE];
+    CtrChunk chunk = { data, len, pos, mac, initmac };
+    ctr_crypt(&chunk, 1, ctriv, encrypt);
+}
 
-    MemAccess::set<int64_t>(ctr,ctriv);
-    setint64(pos / BLOCKSIZE, ctr + sizeof ctriv);
+// blocks of each piece processed at a time: keystream generated per AES call, and the span
+// MAC'd and en/decrypted before moving on, so that every piece streams through memory once
+static const unsigned CTR_BATCH_BLOCKS = 64;
 
-    if (mac && initmac)
+void SymmCipher::ctr_crypt(CtrChunk* chunks, size_t count, ctr_iv ctriv, bool encrypt)
+{
+    auto initctr = [ctriv](byte* ctr, m_off_t pos)
     {
-        memcpy(mac, ctr, sizeof ctriv);
-        memcpy(mac + sizeof ctriv, ctr, sizeof ctriv);
+        assert(!(pos & (KEYLENGTH - 1)));
+        MemAccess::set<int64_t>(ctr, ctriv);
+        setint64(pos / BLOCKSIZE, ctr + sizeof ctriv);
+    };
+
+    // pieces sorted by decreasing length, so those still going are always the first ones
+    vector<CtrChunk*> lanes, maclanes;
+    for (size_t i = 0; i < count; ++i)
+    {
+        lanes.push_back(&chunks[i]);
     }
 
-    while ((int)len > 0)
+    auto longer = [](const CtrChunk* a, const CtrChunk* b)
     {
-        if (encrypt)
+        return a->len > b->len;
+    };
+    std::stable_sort(lanes.begin(), lanes.end(), longer);
+
+    // counters of every piece, and the CBC-MACs of the plaintext of those with a mac
+    vector<byte> ctrs(lanes.size() * BLOCKSIZE);
+    vector<byte> macs;
+    for (size_t l = 0; l < lanes.size(); ++l)
+    {
+        initctr(&ctrs[l * BLOCKSIZE], lanes[l]->pos);
+
+        if (lanes[l]->mac)
         {
-            if(mac)
+            maclanes.push_back(lanes[l]);
+            macs.resize(macs.size() + BLOCKSIZE);
+            byte* m = &macs[macs.size() - BLOCKSIZE];
+
+            if (lanes[l]->initmac)
             {
-                xorblock(data, mac);
-                ecb_encrypt(mac);
+                memcpy(m, &ctrs[l * BLOCKSIZE], sizeof ctriv);
+                memcpy(m + sizeof ctriv, m, sizeof ctriv);
+            }
+            else
+            {
+                memcpy(m, lanes[l]->mac, BLOCKSIZE);
             }
-
-            ecb_encrypt(ctr, tmp);
-            xorblock(tmp, data);
         }
-        else
+    }
+
+    // CBC-MAC of the span [begin, end) of the pieces: the next MAC block of every piece is encrypted in the same call
+    size_t activemacs = maclanes.size();
+    auto mac = [&](unsigned begin, unsigned end)
+    {
+        for (unsigned offset = begin; offset < end && activemacs; offset += BLOCKSIZE)
         {
-            ecb_encrypt(ctr, tmp);
-            xorblock(tmp, data);
+            while (activemacs && maclanes[activemacs - 1]->len <= offset)
+            {
+                --activemacs;
+            }
 
-            if (mac)
+            for (size_t l = 0; l < activemacs; ++l)
             {
-                if (len >= (unsigned)BLOCKSIZE)
+                unsigned remaining = maclanes[l]->len - offset;
+
+                // encryption MACs the padded block, decryption only the bytes of the file
+                if (encrypt || remaining >= unsigned(BLOCKSIZE))
                 {
-                    xorblock(data, mac);
+                    xorblock(maclanes[l]->data + offset, &macs[l * BLOCKSIZE]);
                 }
                 else
                 {
-                    xorblock(data, mac, len);
+                    xorblock(maclanes[l]->data + offset, &macs[l * BLOCKSIZE], int(remaining));
                 }
+            }
 
-                ecb_encrypt(mac);
+            if (activemacs)
+            {
+                ecb_encrypt(macs.data(), nullptr, activemacs * BLOCKSIZE);
             }
         }
+    };
+
+    // CTR over the same span of one piece: the data is padded to BLOCKSIZE, so the last block is xored in full
+    byte keystream[CTR_BATCH_BLOCKS * BLOCKSIZE];
+    auto ctr_xor = [&](size_t l, unsigned begin, unsigned end)
+    {
+        byte* ctr = &ctrs[l * BLOCKSIZE];
+        unsigned n = (std::min(end, lanes[l]->len) - begin + BLOCKSIZE - 1) / BLOCKSIZE;
 
-        len -= BLOCKSIZE;
-        data += BLOCKSIZE;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            memcpy(keystream + i * BLOCKSIZE, ctr, BLOCKSIZE);
+            incblock(ctr);
+        }
+
+        ecb_encrypt(keystream, nullptr, n * BLOCKSIZE);
+
+        byte* data = lanes[l]->data + begin;
+        for (unsigned i = 0; i < n; ++i, data += BLOCKSIZE)
+        {
+            xorblock(keystream + i * BLOCKSIZE, data);
+        }
+    };
 
-        incblock(ctr);
+    size_t active = lanes.size();
+    for (unsigned begin = 0; active; begin += CTR_BATCH_BLOCKS * BLOCKSIZE)
+    {
+        while (active && lanes[active - 1]->len <= begin)
+        {
+            --active;
+        }
+
+        unsigned end = begin + CTR_BATCH_BLOCKS * BLOCKSIZE;
+
+        // MAC the plaintext: before encrypting it, after decrypting it
+        if (encrypt)
+        {
+            mac(begin, end);
+        }
+
+        for (size_t l = 0; l < active; ++l)
+        {
+            ctr_xor(l, begin, end);
+        }
+
+        if (!encrypt)
+        {
+            mac(begin, end);
+        }
+    }
+
+    for (size_t l = 0; l < maclanes.size(); ++l)
+    {
+        memcpy(maclanes[l]->mac, &macs[l * BLOCKSIZE], BLOCKSIZE);
     }
 }
 
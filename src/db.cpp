@@ -22,6 +22,7 @@
 #include "mega/db.h"
 #include "mega/utils.h"
 #include "mega/logging.h"
+#include "mega/node.h"
 
 namespace mega {
 DbTable::DbTable(PrnGen &rng, bool checkAlwaysTransacted)
@@ -38,25 +39,189 @@ bool DbTable::put(uint32_t index, string* data)
 
 // add or update record with padding and encryption
 bool DbTable::put(uint32_t type, Cacheable* record, SymmCipher* key)
+{
+    DbRecordBatch batch;
+    serialize(type, record, key, batch);
+
+    //Don't return false if there are errors in the serialization
+    //to let the SDK continue and save the rest of records
+    return batch.empty() || put(batch.front().first, &batch.front().second);
+}
+
+void DbTable::serialize(uint32_t type, Cacheable* record, SymmCipher* key, DbRecordBatch& batch)
 {
     string data;
 
     if (!record->serialize(&data))
     {
-        //Don't return false if there are errors in the serialization
-        //to let the SDK continue and save the rest of records
         LOG_warn << "Serialization failed: " << type;
-        return true;
+        return;
     }
 
     PaddedCBC::encrypt(rng, &data, key);
+    assignid(type, record);
+
+    batch.emplace_back(record->dbid, std::move(data));
+}
+
+void DbTable::serialize(const vector<Cacheable*>& records, SymmCipher* key, MegaClientAsyncQueue& queue, DbRecordBatch& batch)
+{
+    static const size_t SERIALIZE_BATCH = 256;
+
+    size_t first = batch.size();
+    batch.resize(first + records.size());
+
+    std::mutex m;
+    std::condition_variable cv;
+    size_t jobs = (records.size() + SERIALIZE_BATCH - 1) / SERIALIZE_BATCH;
+    size_t remaining = jobs;
+    std::atomic<bool> failed(false);
 
+    for (size_t j = 0; j < jobs; j++)
+    {
+        size_t begin = j * SERIALIZE_BATCH;
+        size_t end = std::min(records.size(), begin + SERIALIZE_BATCH);
+        DbRecordBatch::value_type* out = batch.data() + first;
+
+        queue.push([this, &records, key, begin, end, out, &failed, &m, &cv, &remaining](SymmCipher& sc)
+        {
+            sc.setkey(key->key);
+
+            for (size_t i = begin; i < end; i++)
+            {
+                assert(records[i]->dbid);
+                out[i].first = records[i]->dbid;
+
+                if (!records[i]->serialize(&out[i].second))
+                {
+                    out[i].first = 0;
+                    failed = true;
+                    continue;
+                }
+
+                // without an IV, the random generator isn't used
+                PaddedCBC::encrypt(rng, &out[i].second, &sc);
+            }
+
+            {
+                std::lock_guard<std::mutex> g(m);
+                --remaining;
+            }
+            cv.notify_all();
+        }, false, MegaClientAsyncQueue::PRIORITY_INTERACTIVE);   // this thread waits for it
+    }
+
+    {
+        std::unique_lock<std::mutex> g(m);
+        cv.wait(g, [&remaining]() { return !remaining; });
+    }
+
+    if (failed)
+    {
+        LOG_warn << "Serialization failed for some records";
+        batch.erase(std::remove_if(batch.begin() + first, batch.end(), [](const DbRecordBatch::value_type& r)
+        {
+            return !r.first;
+        }), batch.end());
+    }
+}
+
+void DbTable::assignid(uint32_t type, Cacheable* record)
+{
     if (!record->dbid)
     {
         record->dbid = (nextid += IDSPACING) | type;
     }
+}
+
+bool DbTable::putNode(uint32_t index, const NodeRecordInfo&, char* data, unsigned len)
+{
+    return put(index, data, len);
+}
+
+// add or update node record with padding and encryption
+bool DbTable::putNode(uint32_t type, Node* node, SymmCipher* key)
+{
+    DbNodeRecordBatch batch;
+    serializeNode(type, node, key, batch);
+
+    if (batch.empty())
+    {
+        return true;
+    }
+
+    DbNodeRecord& r = batch.front();
+    return putNode(r.id, r.info, (char*)r.data.data(), unsigned(r.data.size()));
+}
+
+void DbTable::serializeNode(uint32_t type, Node* node, SymmCipher* key, DbNodeRecordBatch& batch)
+{
+    string data;
+
+    if (!node->serialize(&data))
+    {
+        LOG_warn << "Serialization failed: " << type;
+        return;
+    }
+
+    PaddedCBC::encrypt(rng, &data, key);
+    assignid(type, node);
+
+    batch.emplace_back();
+    DbNodeRecord& r = batch.back();
+    r.id = node->dbid;
+    r.data = std::move(data);
+
+    NodeRecordInfo& info = r.info;
+    info.h = node->nodehandle;
+    info.parent = node->parent ? node->parent->nodehandle : node->parenthandle;
+    info.type = node->type;
+    info.ctime = node->ctime;
 
-    return put(record->dbid, &data);
+    if (node->type == FILENODE)
+    {
+        info.size = node->size;
+        info.mtime = node->mtime;
+
+        if (node->isvalid)
+        {
+            node->serializefingerprint(&info.fingerprint);
+        }
+    }
+}
+
+bool DbTable::put(const DbRecordBatch& batch)
+{
+    for (auto& r : batch)
+    {
+        if (!put(r.first, (char*)r.second.data(), unsigned(r.second.size())))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DbTable::putNodes(const DbNodeRecordBatch& batch)
+{
+    for (auto& r : batch)
+    {
+        if (!putNode(r.id, r.info, (char*)r.data.data(), unsigned(r.data.size())))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DbTable::getNodeHandlesByFingerprint(const string&, m_off_t, handle_vector*)
+{
+    return false;
+}
+
+bool DbTable::getRecentFileHandles(m_time_t, handle_vector*)
+{
+    return false;
 }
 
 // get next record, decrypt and unpad
@@ -80,6 +245,11 @@ bool DbTable::next(uint32_t* type, string* data, SymmCipher* key)
     return false;
 }
 
+bool DbTable::get(uint32_t index, string* data, SymmCipher* key)
+{
+    return get(index, data) && PaddedCBC::decrypt(data, key);
+}
+
 DBTableTransactionCommitter *DbTable::getTransactionCommitter() const
 {
     return mTransactionCommitter;
@@ -119,7 +289,8 @@ void DbTable::checkCommitter(DBTableTransactionCommitter*)
 }
 
 const int DbAccess::LEGACY_DB_VERSION = 11;
-const int DbAccess::DB_VERSION = DbAccess::LEGACY_DB_VERSION + 1;
+const int DbAccess::LAST_DB_VERSION_WITHOUT_NODES = DbAccess::LEGACY_DB_VERSION + 1;
+const int DbAccess::DB_VERSION = DbAccess::LAST_DB_VERSION_WITHOUT_NODES + 1;
 
 DbAccess::DbAccess()
 {
@@ -24,6 +24,29 @@
 #ifdef USE_SQLITE
 namespace mega {
 
+// move a database file and its WAL companions
+static bool renameDatabase(FileSystemAccess& fsAccess, LocalPath& source, LocalPath& target)
+{
+    if (!fsAccess.renamelocal(source, target, false))
+    {
+        return false;
+    }
+
+    auto suffix = LocalPath::fromPath("-shm", fsAccess);
+    auto from = source + suffix;
+    auto to = target + suffix;
+
+    fsAccess.renamelocal(from, to);
+
+    suffix = LocalPath::fromPath("-wal", fsAccess);
+    from = source + suffix;
+    to = target + suffix;
+
+    fsAccess.renamelocal(from, to);
+
+    return true;
+}
+
 SqliteDbAccess::SqliteDbAccess(const LocalPath& rootPath)
   : mRootPath(rootPath)
 {
@@ -77,20 +100,8 @@ SqliteDbTable* SqliteDbAccess::open(PrnGen &rng, FileSystemAccess& fsAccess, con
             {
                 LOG_debug << "Trying to recycle a legacy database.";
 
-                if (fsAccess.renamelocal(legacyPath, dbPath, false))
+                if (renameDatabase(fsAccess, legacyPath, dbPath))
                 {
-                    auto suffix = LocalPath::fromPath("-shm", fsAccess);
-                    auto from = legacyPath + suffix;
-                    auto to = dbPath + suffix;
-
-                    fsAccess.renamelocal(from, to);
-
-                    suffix = LocalPath::fromPath("-wal", fsAccess);
-                    from = legacyPath + suffix;
-                    to = dbPath + suffix;
-
-                    fsAccess.renamelocal(from, to);
-
                     LOG_debug << "Legacy database recycled.";
                 }
                 else
@@ -109,6 +120,25 @@ SqliteDbTable* SqliteDbAccess::open(PrnGen &rng, FileSystemAccess& fsAccess, con
 
     if (upgraded)
     {
+        // databases from before node records got their own table
+        auto outdatedPath = databasePath(fsAccess, name, LAST_DB_VERSION_WITHOUT_NODES);
+        auto fileAccess = fsAccess.newfileaccess();
+
+        if (fileAccess->fopen(outdatedPath))
+        {
+            // the generic records keep their format, so those can be carried over
+            if ((flags & DB_OPEN_FLAG_RECYCLE) && renameDatabase(fsAccess, outdatedPath, dbPath))
+            {
+                LOG_debug << "Recycled database without node table: " << outdatedPath.toPath(fsAccess);
+            }
+            else
+            {
+                // node records would be missing their indexed fields: reload from the servers instead
+                LOG_debug << "Deleting database without node table: " << outdatedPath.toPath(fsAccess);
+                fsAccess.unlinklocal(outdatedPath);
+            }
+        }
+
         LOG_debug << "Using an upgraded DB: " << dbPath.toPath(fsAccess);
         currentDbVersion = DB_VERSION;
     }
@@ -134,13 +164,41 @@ SqliteDbTable* SqliteDbAccess::open(PrnGen &rng, FileSystemAccess& fsAccess, con
         sqlite3_close(db);
         return nullptr;
     }
+
+    // with WAL, a commit is safe without a sync: a power loss can only lose the last ones
+    sqlite3_exec(db, "PRAGMA synchronous=NORMAL;", nullptr, nullptr, nullptr);
 #endif /* ! TARGET_OS_IPHONE */
 
+    // every store has a file and a connection of its own, tuned for its size
+    const char* tuning = (flags & DB_OPEN_FLAG_LARGE)
+        ? "PRAGMA mmap_size=268435456; PRAGMA cache_size=-16384;"
+        : "PRAGMA cache_size=-1024;";
+
+    if (sqlite3_exec(db, tuning, nullptr, nullptr, nullptr))
+    {
+        LOG_warn << "Unable to tune database: " << dbPathStr << ": " << sqlite3_errmsg(db);
+    }
+
+    // node records get plain copies of the fields that lookups filter on,
+    // the rest of their content stays encrypted like every other record
     const char* sql =
       "CREATE TABLE IF NOT EXISTS statecache ( "
       "    id INTEGER PRIMARY KEY ASC NOT NULL, "
       "    content BLOB NOT NULL "
-      ");";
+      ");"
+      "CREATE TABLE IF NOT EXISTS nodes ( "
+      "    id INTEGER PRIMARY KEY ASC NOT NULL, "
+      "    nodehandle INTEGER NOT NULL, "
+      "    parenthandle INTEGER NOT NULL, "
+      "    type INTEGER NOT NULL, "
+      "    size INTEGER NOT NULL, "
+      "    fingerprint BLOB, "
+      "    ctime INTEGER NOT NULL, "
+      "    mtime INTEGER NOT NULL, "
+      "    content BLOB NOT NULL "
+      ");"
+      "CREATE INDEX IF NOT EXISTS nodes_fingerprint ON nodes (fingerprint, size);"
+      "CREATE INDEX IF NOT EXISTS nodes_ctime ON nodes (type, ctime);";
 
     result = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
     if (result)
@@ -196,6 +254,7 @@ SqliteDbTable::~SqliteDbTable()
     }
 
     sqlite3_finalize(pStmt);
+    finalizeStatements();
 
     if (inTransaction())
     {
@@ -211,13 +270,62 @@ bool SqliteDbTable::inTransaction() const
     return sqlite3_get_autocommit(db) == 0;
 }
 
+size_t SqliteDbTable::releaseMemory()
+{
+    int before = 0, after = 0, highwater;
+    sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_USED, &before, &highwater, 0);
+    sqlite3_db_release_memory(db);
+    sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_USED, &after, &highwater, 0);
+    return before > after ? size_t(before - after) : 0;
+}
+
 LocalPath SqliteDbTable::dbFile() const
 {
     return LocalPath::fromPath(dbfile, *fsaccess);
 }
 
+// return the cached statement, compiling it on first use
+sqlite3_stmt* SqliteDbTable::statement(Statement s, const char* sql)
+{
+    sqlite3_stmt*& stmt = mStatements[s];
+
+    if (!stmt && sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK)
+    {
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+    }
+
+    return stmt;
+}
+
+// make a cached statement ready for its next use
+void SqliteDbTable::release(sqlite3_stmt* stmt)
+{
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+}
+
+void SqliteDbTable::finalizeStatements()
+{
+    for (auto& stmt : mStatements)
+    {
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+    }
+}
+
 // set cursor to first record
 void SqliteDbTable::rewind()
+{
+    rewind(true);
+}
+
+void SqliteDbTable::rewindNonNodes()
+{
+    rewind(false);
+}
+
+void SqliteDbTable::rewind(bool nodes)
 {
     if (!db)
     {
@@ -226,13 +334,21 @@ void SqliteDbTable::rewind()
 
     int result;
 
+    if (pStmt && mCursorNodes != nodes)
+    {
+        sqlite3_finalize(pStmt);
+        pStmt = NULL;
+    }
+
     if (pStmt)
     {
         result = sqlite3_reset(pStmt);
     }
     else
     {
-        result = sqlite3_prepare(db, "SELECT id, content FROM statecache", -1, &pStmt, NULL);
+        result = sqlite3_prepare(db, nodes ? "SELECT id, content FROM statecache UNION ALL SELECT id, content FROM nodes"
+                                           : "SELECT id, content FROM statecache", -1, &pStmt, NULL);
+        mCursorNodes = nodes;
     }
 
     if (result != SQLITE_OK)
@@ -290,11 +406,10 @@ bool SqliteDbTable::get(uint32_t index, string* data)
 
     checkTransaction();
 
-    sqlite3_stmt *stmt;
-    int rc;
+    int rc = SQLITE_ERROR;
 
-    rc = sqlite3_prepare(db, "SELECT content FROM statecache WHERE id = ?", -1, &stmt, NULL);
-    if (rc == SQLITE_OK)
+    sqlite3_stmt* stmt = statement(STMT_GET, "SELECT content FROM statecache WHERE id = ?1 UNION ALL SELECT content FROM nodes WHERE id = ?1");
+    if (stmt)
     {
         rc = sqlite3_bind_int(stmt, 1, index);
         if (rc == SQLITE_OK)
@@ -305,9 +420,9 @@ bool SqliteDbTable::get(uint32_t index, string* data)
                 data->assign((char*)sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0));
             }
         }
-    }
 
-    sqlite3_finalize(stmt);
+        release(stmt);
+    }
 
     if (rc != SQLITE_DONE && rc != SQLITE_ROW)
     {
@@ -319,6 +434,89 @@ bool SqliteDbTable::get(uint32_t index, string* data)
     return rc == SQLITE_ROW;
 }
 
+// number of records written by each of the multi-row statements
+static const int BATCH_ROWS = 64;
+
+// "INSERT ... VALUES (?, ?), (?, ?), ..." for the given number of rows
+static string insertStatement(const char* prefix, int columns, int rows)
+{
+    string row = "(?";
+    for (int i = 1; i < columns; i++)
+    {
+        row += ", ?";
+    }
+    row += ")";
+
+    string sql = prefix;
+    for (int i = 0; i < rows; i++)
+    {
+        sql += i ? ", " : " VALUES ";
+        sql += row;
+    }
+    return sql;
+}
+
+// "DELETE ... WHERE id IN (?, ?, ...)" for the given number of rows
+static string deleteStatement(const char* table, int rows)
+{
+    string sql = string("DELETE FROM ") + table + " WHERE id IN (?";
+    for (int i = 1; i < rows; i++)
+    {
+        sql += ", ?";
+    }
+    sql += ")";
+    return sql;
+}
+
+static const char* const PUT_PREFIX = "INSERT OR REPLACE INTO statecache (id, content)";
+static const int PUT_COLUMNS = 2;
+
+static const char* const PUT_NODE_PREFIX = "INSERT OR REPLACE INTO nodes (id, nodehandle, parenthandle, type, size, fingerprint, ctime, mtime, content)";
+static const int PUT_NODE_COLUMNS = 9;
+
+static int bindRecord(sqlite3_stmt* stmt, int column, uint32_t index, const char* data, unsigned len)
+{
+    int rc = sqlite3_bind_int(stmt, column + 1, index);
+    if (rc == SQLITE_OK)
+    {
+        rc = sqlite3_bind_blob(stmt, column + 2, data, len, SQLITE_STATIC);
+    }
+    return rc;
+}
+
+static int bindNodeRecord(sqlite3_stmt* stmt, int column, uint32_t index, const NodeRecordInfo& info, const char* data, unsigned len)
+{
+    int rc;
+
+    if ((rc = sqlite3_bind_int(stmt, column + 1, index)) == SQLITE_OK
+     && (rc = sqlite3_bind_int64(stmt, column + 2, sqlite3_int64(info.h))) == SQLITE_OK
+     && (rc = sqlite3_bind_int64(stmt, column + 3, sqlite3_int64(info.parent))) == SQLITE_OK
+     && (rc = sqlite3_bind_int(stmt, column + 4, info.type)) == SQLITE_OK
+     && (rc = sqlite3_bind_int64(stmt, column + 5, info.size)) == SQLITE_OK
+     && (rc = (info.fingerprint.empty()
+                    ? sqlite3_bind_null(stmt, column + 6)
+                    : sqlite3_bind_blob(stmt, column + 6, info.fingerprint.data(), int(info.fingerprint.size()), SQLITE_STATIC))) == SQLITE_OK
+     && (rc = sqlite3_bind_int64(stmt, column + 7, info.ctime)) == SQLITE_OK
+     && (rc = sqlite3_bind_int64(stmt, column + 8, info.mtime)) == SQLITE_OK)
+    {
+        rc = sqlite3_bind_blob(stmt, column + 9, data, len, SQLITE_STATIC);
+    }
+
+    return rc;
+}
+
+// run a bound write statement and make it ready for reuse
+int SqliteDbTable::step(sqlite3_stmt* stmt, int rc)
+{
+    if (rc == SQLITE_OK)
+    {
+        rc = sqlite3_step(stmt);
+    }
+
+    release(stmt);
+    return rc;
+}
+
 // add/update record by index
 bool SqliteDbTable::put(uint32_t index, char* data, unsigned len)
 {
@@ -329,38 +527,248 @@ bool SqliteDbTable::put(uint32_t index, char* data, unsigned len)
 
     checkTransaction();
 
-    sqlite3_stmt *stmt;
-    bool result = false;
+    int rc = SQLITE_ERROR;
 
-    int rc = sqlite3_prepare(db, "INSERT OR REPLACE INTO statecache (id, content) VALUES (?, ?)", -1, &stmt, NULL);
-    if (rc == SQLITE_OK)
+    static const string sql = insertStatement(PUT_PREFIX, PUT_COLUMNS, 1);
+    if (sqlite3_stmt* stmt = statement(STMT_PUT, sql.c_str()))
     {
-        rc = sqlite3_bind_int(stmt, 1, index);
-        if (rc == SQLITE_OK)
+        rc = step(stmt, bindRecord(stmt, 0, index, data, len));
+    }
+
+    if (rc != SQLITE_DONE)
+    {
+        string err = string(" Error: ") + (sqlite3_errmsg(db) ? sqlite3_errmsg(db) : std::to_string(rc));
+        LOG_err << "Unable to put record into database: " << dbfile << err;
+        assert(!"Unable to put record into database.");
+    }
+
+    return rc == SQLITE_DONE;
+}
+
+// add/update many records, BATCH_ROWS per statement
+bool SqliteDbTable::put(const DbRecordBatch& batch)
+{
+    if (!db)
+    {
+        return false;
+    }
+
+    checkTransaction();
+
+    static const string sql = insertStatement(PUT_PREFIX, PUT_COLUMNS, BATCH_ROWS);
+
+    size_t i = 0;
+    while (batch.size() - i >= size_t(BATCH_ROWS))
+    {
+        int rc = SQLITE_ERROR;
+
+        if (sqlite3_stmt* stmt = statement(STMT_PUT_BATCH, sql.c_str()))
         {
-            rc = sqlite3_bind_blob(stmt, 2, data, len, SQLITE_STATIC);
-            if (rc == SQLITE_OK)
+            rc = SQLITE_OK;
+            for (int row = 0; row < BATCH_ROWS && rc == SQLITE_OK; row++, i++)
             {
+                rc = bindRecord(stmt, row * PUT_COLUMNS, batch[i].first, batch[i].second.data(), unsigned(batch[i].second.size()));
+            }
+            rc = step(stmt, rc);
+        }
+
+        if (rc != SQLITE_DONE)
+        {
+            string err = string(" Error: ") + (sqlite3_errmsg(db) ? sqlite3_errmsg(db) : std::to_string(rc));
+            LOG_err << "Unable to put records into database: " << dbfile << err;
+            assert(!"Unable to put records into database.");
+            return false;
+        }
+    }
+
+    for (; i < batch.size(); i++)
+    {
+        if (!put(batch[i].first, (char*)batch[i].second.data(), unsigned(batch[i].second.size())))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
 
-                rc = sqlite3_step(stmt);
-                if (rc == SQLITE_DONE)
+// add/update node record by index
+bool SqliteDbTable::putNode(uint32_t index, const NodeRecordInfo& info, char* data, unsigned len)
+{
+    if (!db)
+    {
+        return false;
+    }
+
+    checkTransaction();
+
+    int rc = SQLITE_ERROR;
+
+    static const string sql = insertStatement(PUT_NODE_PREFIX, PUT_NODE_COLUMNS, 1);
+    if (sqlite3_stmt* stmt = statement(STMT_PUT_NODE, sql.c_str()))
+    {
+        rc = step(stmt, bindNodeRecord(stmt, 0, index, info, data, len));
+    }
+
+    // databases written before the nodes table keep their node records in statecache, until rewritten here
+    if (rc == SQLITE_DONE)
+    {
+        rc = SQLITE_ERROR;
+
+        if (sqlite3_stmt* stmt = statement(STMT_DEL, "DELETE FROM statecache WHERE id = ?"))
+        {
+            rc = step(stmt, sqlite3_bind_int(stmt, 1, index));
+        }
+    }
+
+    if (rc != SQLITE_DONE)
+    {
+        string err = string(" Error: ") + (sqlite3_errmsg(db) ? sqlite3_errmsg(db) : std::to_string(rc));
+        LOG_err << "Unable to put node record into database: " << dbfile << err;
+        assert(!"Unable to put node record into database.");
+    }
+
+    return rc == SQLITE_DONE;
+}
+
+// add/update many node records, BATCH_ROWS per statement
+bool SqliteDbTable::putNodes(const DbNodeRecordBatch& batch)
+{
+    if (!db)
+    {
+        return false;
+    }
+
+    checkTransaction();
+
+    static const string sql = insertStatement(PUT_NODE_PREFIX, PUT_NODE_COLUMNS, BATCH_ROWS);
+    static const string delSql = deleteStatement("statecache", BATCH_ROWS);
+
+    size_t i = 0;
+    while (batch.size() - i >= size_t(BATCH_ROWS))
+    {
+        int rc = SQLITE_ERROR;
+        size_t first = i;
+
+        if (sqlite3_stmt* stmt = statement(STMT_PUT_NODE_BATCH, sql.c_str()))
+        {
+            rc = SQLITE_OK;
+            for (int row = 0; row < BATCH_ROWS && rc == SQLITE_OK; row++, i++)
+            {
+                const DbNodeRecord& r = batch[i];
+                rc = bindNodeRecord(stmt, row * PUT_NODE_COLUMNS, r.id, r.info, r.data.data(), unsigned(r.data.size()));
+            }
+            rc = step(stmt, rc);
+        }
+
+        // (as in putNode())
+        if (rc == SQLITE_DONE)
+        {
+            rc = SQLITE_ERROR;
+
+            if (sqlite3_stmt* stmt = statement(STMT_DEL_BATCH, delSql.c_str()))
+            {
+                rc = SQLITE_OK;
+                for (int row = 0; row < BATCH_ROWS && rc == SQLITE_OK; row++)
                 {
-                    result = true;
+                    rc = sqlite3_bind_int(stmt, row + 1, batch[first + size_t(row)].id);
                 }
+                rc = step(stmt, rc);
             }
         }
+
+        if (rc != SQLITE_DONE)
+        {
+            string err = string(" Error: ") + (sqlite3_errmsg(db) ? sqlite3_errmsg(db) : std::to_string(rc));
+            LOG_err << "Unable to put node records into database: " << dbfile << err;
+            assert(!"Unable to put node records into database.");
+            return false;
+        }
+    }
+
+    for (; i < batch.size(); i++)
+    {
+        const DbNodeRecord& r = batch[i];
+        if (!putNode(r.id, r.info, (char*)r.data.data(), unsigned(r.data.size())))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// collect the node handles returned by a bound query
+bool SqliteDbTable::getNodeHandles(sqlite3_stmt* stmt, int rc, handle_vector* handles)
+{
+    if (rc == SQLITE_OK)
+    {
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            handles->push_back(handle(sqlite3_column_int64(stmt, 0)));
+        }
     }
 
-    sqlite3_finalize(stmt);
+    if (stmt)
+    {
+        release(stmt);
+    }
 
-    if (!result)
+    if (rc != SQLITE_DONE)
     {
         string err = string(" Error: ") + (sqlite3_errmsg(db) ? sqlite3_errmsg(db) : std::to_string(rc));
-        LOG_err << "Unable to put record into database: " << dbfile << err;
-        assert(!"Unable to put record into database.");
+        LOG_err << "Unable to query node records in database: " << dbfile << err;
+        assert(!"Unable to query node records in database.");
+        return false;
     }
 
-    return result;
+    return true;
+}
+
+bool SqliteDbTable::getNodeHandlesByFingerprint(const string& fingerprint, m_off_t size, handle_vector* handles)
+{
+    if (!db)
+    {
+        return false;
+    }
+
+    checkTransaction();
+
+    int rc = SQLITE_ERROR;
+
+    sqlite3_stmt* stmt = statement(STMT_NODES_BY_FINGERPRINT, "SELECT nodehandle FROM nodes WHERE fingerprint = ? AND size = ?");
+    if (stmt)
+    {
+        if ((rc = sqlite3_bind_blob(stmt, 1, fingerprint.data(), int(fingerprint.size()), SQLITE_STATIC)) == SQLITE_OK)
+        {
+            rc = sqlite3_bind_int64(stmt, 2, size);
+        }
+    }
+
+    return getNodeHandles(stmt, rc, handles);
+}
+
+bool SqliteDbTable::getRecentFileHandles(m_time_t since, handle_vector* handles)
+{
+    if (!db)
+    {
+        return false;
+    }
+
+    checkTransaction();
+
+    int rc = SQLITE_ERROR;
+
+    sqlite3_stmt* stmt = statement(STMT_RECENT_FILES, "SELECT nodehandle FROM nodes WHERE type = ? AND ctime >= ? ORDER BY ctime DESC");
+    if (stmt)
+    {
+        if ((rc = sqlite3_bind_int(stmt, 1, FILENODE)) == SQLITE_OK)
+        {
+            rc = sqlite3_bind_int64(stmt, 2, since);
+        }
+    }
+
+    return getNodeHandles(stmt, rc, handles);
 }
 
 // delete record by index
@@ -373,12 +781,25 @@ bool SqliteDbTable::del(uint32_t index)
 
     checkTransaction();
 
-    char buf[64];
+    // the record may be in either table
+    int rc = SQLITE_ERROR;
 
-    sprintf(buf, "DELETE FROM statecache WHERE id = %" PRIu32, index);
+    if (sqlite3_stmt* stmt = statement(STMT_DEL, "DELETE FROM statecache WHERE id = ?"))
+    {
+        rc = step(stmt, sqlite3_bind_int(stmt, 1, index));
+    }
 
-    int rc = sqlite3_exec(db, buf, 0, 0, nullptr);
-    if (rc != SQLITE_OK)
+    if (rc == SQLITE_DONE)
+    {
+        rc = SQLITE_ERROR;
+
+        if (sqlite3_stmt* stmt = statement(STMT_DEL_NODE, "DELETE FROM nodes WHERE id = ?"))
+        {
+            rc = step(stmt, sqlite3_bind_int(stmt, 1, index));
+        }
+    }
+
+    if (rc != SQLITE_DONE)
     {
         string err = string(" Error: ") + (sqlite3_errmsg(db) ? sqlite3_errmsg(db) : std::to_string(rc));
         LOG_err << "Unable to delete record from database: " << dbfile << err;
@@ -400,7 +821,7 @@ void SqliteDbTable::truncate()
 
     checkTransaction();
 
-    int rc = sqlite3_exec(db, "DELETE FROM statecache", 0, 0, NULL);
+    int rc = sqlite3_exec(db, "DELETE FROM statecache; DELETE FROM nodes", 0, 0, NULL);
     if (rc != API_OK)
     {
         string err = string(" Error: ") + (sqlite3_errmsg(db) ? sqlite3_errmsg(db) : std::to_string(rc));
@@ -437,6 +858,7 @@ void SqliteDbTable::commit()
 
     LOG_debug << "DB transaction COMMIT " << dbfile;
 
+    std::unique_ptr<CodeCounter::ScopeTimer> timer(commitStats ? new CodeCounter::ScopeTimer(*commitStats) : nullptr);
     int rc = sqlite3_exec(db, "COMMIT", 0, 0, NULL);
     if (rc != SQLITE_OK)
     {
@@ -473,6 +895,8 @@ void SqliteDbTable::remove()
     }
 
     sqlite3_finalize(pStmt);
+    pStmt = nullptr;
+    finalizeStatements();
 
     if (inTransaction())
     {
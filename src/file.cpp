@@ -360,7 +360,6 @@ void File::completed(Transfer* t, LocalNode* l)
                     }
                 }
 
-                t->client->syncadding++;
             }
 #endif
             if (!t->client->versions_disabled && ISUNDEF(newnode->ovhandle))
@@ -368,17 +367,18 @@ void File::completed(Transfer* t, LocalNode* l)
                 newnode->ovhandle = t->client->getovhandle(t->client->nodeByHandle(th), &name);
             }
 
-            t->client->reqs.add(new CommandPutNodes(t->client,
-                                                    th, NULL,
-                                                    move(newnodes),
-                                                    tag,
 #ifdef ENABLE_SYNC
-                                                    l ? PUTNODES_SYNC : PUTNODES_APP,
-#else
-                                                    PUTNODES_APP,
+            if (l)
+            {
+                // sent along with other sync uploads completing meanwhile
+                t->client->queueSyncUploadPutnodes(th, move(newnodes.front()), tag);
+            }
+            else
 #endif
-                                                    nullptr,
-                                                    nullptr));
+            {
+                // sent along with other uploads completing into the same folder
+                t->client->queueUploadPutnodes(th, move(newnodes.front()), tag);
+            }
         }
     }
 }
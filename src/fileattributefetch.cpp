@@ -25,14 +25,24 @@
 #include "mega/logging.h"
 
 namespace mega {
-FileAttributeFetchChannel::FileAttributeFetchChannel(MegaClient* client)
-    : client(client), bt(client->rng), timeout(client->rng)
+FileAttributeFetchChannel::Request::Request(PrnGen& rng)
+    : timeout(rng)
 {
     req.binary = true;
     req.status = REQ_READY;
+}
+
+FileAttributeFetchChannel::FileAttributeFetchChannel(MegaClient* client)
+    : client(client), bt(client->rng)
+{
+    for (int i = 0; i < MAXREQS; i++)
+    {
+        requests.emplace_back(new Request(client->rng));
+    }
+
+    gettingurl = false;
     urltime = 0;
     fahref = UNDEF;
-    inbytes = 0;
     e = API_EINTERNAL;
 }
 
@@ -45,53 +55,81 @@ FileAttributeFetch::FileAttributeFetch(handle h, string key, fatype t, int ctag)
     tag = ctag;
 }
 
-void FileAttributeFetchChannel::dispatch()
+bool FileAttributeFetchChannel::busy() const
 {
-    faf_map::iterator it;
-
-    // reserve space
-    req.outbuf.clear();
-    req.outbuf.reserve((fafs[0].size() + fafs[1].size()) * sizeof(handle));
+    if (gettingurl)
+    {
+        return true;
+    }
 
-    for (int i = 2; i--; )
+    for (auto& r : requests)
     {
-        for (it = fafs[i].begin(); it != fafs[i].end(); )
+        if (r->req.status != REQ_INFLIGHT)
         {
-            req.outbuf.append((char*)&it->first, sizeof(handle));
+            return false;
+        }
+    }
+    return true;
+}
 
-            if (!i)
-            {
-                // move from fresh to pending
-                fafs[1][it->first] = it->second;
-                fafs[0].erase(it++);
-            }
-            else
-            {
-                it++;
-            }
+void FileAttributeFetchChannel::dispatch()
+{
+    vector<Request*> idle;
+    bool inflight = false;
+    for (auto& r : requests)
+    {
+        if (r->req.status == REQ_INFLIGHT)
+        {
+            inflight = true;
+        }
+        else
+        {
+            idle.push_back(r.get());
         }
     }
 
-    if (req.outbuf.size())
+    for (size_t i = 0; i < idle.size() && fafs[0].size(); i++)
     {
-        LOG_debug << "Getting file attribute";
+        // requests arriving while a POST is in flight are gathered into bigger ones
+        if (inflight && fafs[0].size() < MINBATCH)
+        {
+            break;
+        }
+
+        // spread what there is over the idle requests, without making tiny batches
+        size_t remaining = idle.size() - i;
+        size_t minbatch = MINBATCH;
+        size_t count = std::max((fafs[0].size() + remaining - 1) / remaining, minbatch);
+
+        Request& r = *idle[i];
+        r.fahs.clear();
+        r.req.outbuf.clear();
+        r.req.outbuf.reserve(std::min(count, fafs[0].size()) * sizeof(handle));
+
+        for (faf_map::iterator it = fafs[0].begin(); it != fafs[0].end() && r.fahs.size() < count; )
+        {
+            r.req.outbuf.append((char*)&it->first, sizeof(handle));
+            r.fahs.push_back(it->first);
+
+            // move from fresh to pending
+            fafs[1][it->first] = it->second;
+            fafs[0].erase(it++);
+        }
+
+        LOG_debug << "Getting " << r.fahs.size() << " file attributes";
         e = API_EFAILED;
-        inbytes = 0;
-        req.in.clear();
-        req.posturl = posturl;
-        req.post(client);
+        r.inbytes = 0;
+        r.req.in.clear();
+        r.req.posturl = posturl;
+        r.req.post(client);
 
-        timeout.backoff(150);
-    }
-    else
-    {
-        timeout.reset();
-        req.status = REQ_PREPARED;
+        r.timeout.backoff(150);
+        inflight = true;
     }
 }
 
 // communicate received file attributes to the application
-void FileAttributeFetchChannel::parse(int /*fac*/, bool final)
+void FileAttributeFetchChannel::parse(int i, bool final)
 {
 #pragma pack(push,1)
     struct FaHeader
@@ -101,6 +139,7 @@ void FileAttributeFetchChannel::parse(int /*fac*/, bool final)
     };
 #pragma pack(pop)
 
+    HttpReq& req = requests[i]->req;
     const char* ptr = req.data();
     const char* endptr = ptr + req.size();
     faf_map::iterator it;
@@ -133,16 +172,26 @@ void FileAttributeFetchChannel::parse(int /*fac*/, bool final)
         // locate fetch request (could have been deleted by the application in the meantime)
         if (it != fafs[1].end())
         {
-            client->restag = it->second->tag;
-
             if (!(falen & (SymmCipher::BLOCKSIZE - 1)))
             {
-                SymmCipher *cipher = client->getRecycledTemporaryNodeCipher(&it->second->nodekey);
-                if (cipher)
+                // decrypted off the SDK thread, and passed to the app in deliver()
+                auto d = std::make_shared<Decryption>();
+                d->nodehandle = it->second->nodehandle;
+                d->type = it->second->type;
+                d->tag = it->second->tag;
+                d->data.assign(ptr, falen);
+                decryptions.push_back(d);
+
+                string nodekey = it->second->nodekey;
+                client->mAsyncQueue.push([d, nodekey](SymmCipher& sc)
                 {
-                    cipher->cbc_decrypt((byte*)ptr, falen);
-                    client->app->fa_complete(it->second->nodehandle, it->second->type, ptr, falen);
-                }
+                    if (sc.setkey(&nodekey))
+                    {
+                        sc.cbc_decrypt((byte*)&d->data[0], d->data.size());
+                        d->decrypted = true;
+                    }
+                    d->done = true;
+                }, false, MegaClientAsyncQueue::PRIORITY_INTERACTIVE);
 
                 delete it->second;
                 fafs[1].erase(it);
@@ -153,18 +202,65 @@ void FileAttributeFetchChannel::parse(int /*fac*/, bool final)
     }
 }
 
+void FileAttributeFetchChannel::deliver()
+{
+    while (decryptions.size() && decryptions.front()->done)
+    {
+        std::shared_ptr<Decryption> d = decryptions.front();
+        decryptions.pop_front();
+
+        if (d->decrypted)
+        {
+            client->restag = d->tag;
+            client->app->fa_complete(d->nodehandle, d->type, d->data.data(), uint32_t(d->data.size()));
+        }
+    }
+}
+
 // notify the application of the request failure and remove records no longer needed
-void FileAttributeFetchChannel::failed()
+void FileAttributeFetchChannel::failed(int i)
+{
+    failed(requests[i]->fahs);
+    requests[i]->fahs.clear();
+}
+
+void FileAttributeFetchChannel::urlfailed(error err)
+{
+    vector<handle> fahs;
+    for (faf_map::iterator it = fafs[0].begin(); it != fafs[0].end(); )
+    {
+        fahs.push_back(it->first);
+
+        // move from fresh to pending
+        fafs[1][it->first] = it->second;
+        fafs[0].erase(it++);
+    }
+
+    gettingurl = false;
+    e = err;
+    failed(fahs);
+    bt.backoff();
+    urltime = 0;
+}
+
+void FileAttributeFetchChannel::failed(const vector<handle>& fahs)
 {
-    for (faf_map::iterator it = fafs[1].begin(); it != fafs[1].end(); )
+    for (handle fah : fahs)
     {
+        // received or cancelled ones are no longer pending
+        faf_map::iterator it = fafs[1].find(fah);
+        if (it == fafs[1].end())
+        {
+            continue;
+        }
+
         client->restag = it->second->tag;
 
         if (client->app->fa_failed(it->second->nodehandle, it->second->type, it->second->retries, e))
         {
             // no retry desired
             delete it->second;
-            fafs[1].erase(it++);
+            fafs[1].erase(it);
         }
         else
         {
@@ -173,8 +269,7 @@ void FileAttributeFetchChannel::failed()
 
             // move from pending to fresh
             fafs[0][it->first] = it->second;
-            fafs[1].erase(it++);
-            req.status = REQ_PREPARED;
+            fafs[1].erase(it);
         }
     }
 }
@@ -78,30 +78,39 @@ bool FileFingerprint::serialize(string *d)
 FileFingerprint *FileFingerprint::unserialize(string *d)
 {
     const char* ptr = d->data();
-    const char* end = ptr + d->size();
+    FileFingerprint *fp = new FileFingerprint();
 
-    if (ptr + sizeof(m_off_t) + sizeof(m_time_t) + 4 * sizeof(int32_t) + sizeof(bool) > end)
+    if (!fp->unserialize(ptr, ptr + d->size()))
     {
-        LOG_err << "FileFingerprint unserialization failed - serialized string too short";
+        delete fp;
         return NULL;
     }
 
-    FileFingerprint *fp = new FileFingerprint();
+    d->erase(0, ptr - d->data());
+    return fp;
+}
+
+bool FileFingerprint::unserialize(const char*& ptr, const char* end)
+{
+    if (ptr + sizeof(m_off_t) + sizeof(m_time_t) + 4 * sizeof(int32_t) + sizeof(bool) > end)
+    {
+        LOG_err << "FileFingerprint unserialization failed - serialized string too short";
+        return false;
+    }
 
-    fp->size = MemAccess::get<m_off_t>(ptr);
+    size = MemAccess::get<m_off_t>(ptr);
     ptr += sizeof(m_off_t);
 
-    fp->mtime = MemAccess::get<m_time_t>(ptr);
+    mtime = MemAccess::get<m_time_t>(ptr);
     ptr += sizeof(m_time_t);
 
-    memcpy(fp->crc.data(), ptr, sizeof(fp->crc));
-    ptr += sizeof(fp->crc);
+    memcpy(crc.data(), ptr, sizeof(crc));
+    ptr += sizeof(crc);
 
-    fp->isvalid = MemAccess::get<bool>(ptr);
+    isvalid = MemAccess::get<bool>(ptr);
     ptr += sizeof(bool);
 
-    d->erase(0, ptr - d->data());
-    return fp;
+    return true;
 }
 
 FileFingerprint::FileFingerprint(const FileFingerprint& other)
@@ -188,26 +197,27 @@ bool FileFingerprint::genfingerprint(FileAccess* fa, bool ignoremtime)
     {
         // large file: sparse coverage, four sparse CRC32s
         HashCRC32 crc32;
-        byte block[4 * sizeof crc];
-        const unsigned blocks = MAXFULL / unsigned(sizeof block * crc.size());
+        const size_t blocksize = 4 * sizeof crc;
+        const unsigned blocks = MAXFULL / unsigned(blocksize * crc.size());
 
-        for (unsigned i = 0; i < crc.size(); i++)
+        // all the samples at once, so that the nearby ones are read together
+        m_off_t positions[MAXFULL / blocksize];
+        byte samples[MAXFULL];
+        for (unsigned k = 0; k < crc.size() * blocks; k++)
         {
-            for (unsigned j = 0; j < blocks; j++)
-            {
-                if (!fa->frawread(block, sizeof block,
-                                  (size - sizeof block)
-                                  * (i * blocks + j)
-                                  / (crc.size() * blocks - 1), true))
-                {
-                    size = -1;
-                    fa->closef();
-                    return true;
-                }
+            positions[k] = (size - blocksize) * k / (crc.size() * blocks - 1);
+        }
 
-                crc32.add(block, sizeof block);
-            }
+        if (!fa->frawreadsparse(samples, unsigned(blocksize), positions, crc.size() * blocks))
+        {
+            size = -1;
+            fa->closef();
+            return true;
+        }
 
+        for (unsigned i = 0; i < crc.size(); i++)
+        {
+            crc32.add(samples + i * blocks * blocksize, unsigned(blocks * blocksize));
             crc32.get((byte*)&crcval);
             newcrc[i] = htonl(crcval);
         }
@@ -168,38 +168,104 @@ int compareUtf(UnicodeCodepointIterator<CharT> first1, bool unescaping1,
     return 1;
 }
 
+inline uint32_t codeUnit(char c)
+{
+    return static_cast<unsigned char>(c);
+}
+
+inline uint32_t codeUnit(wchar_t c)
+{
+    return static_cast<uint32_t>(c);
+}
+
+inline uint32_t asciiUpper(uint32_t c)
+{
+    return c - 'a' < 26 ? c - ('a' - 'A') : c;
+}
+
+// The same result as the codepoint comparison below, computed on the code units, while both strings are ASCII
+// without escapes: most names are.  False as soon as that's not known, the result is then that of the full comparison
+template<typename CharT, typename CharU>
+bool compareAscii(const std::basic_string<CharT>& s1, bool unescaping1,
+                  const std::basic_string<CharU>& s2, bool unescaping2,
+                  bool caseInsensitive, int& result)
+{
+#ifdef _WIN32
+    // prefixes that skipPrefix() would drop
+    if ((!s1.empty() && s1[0] == '\\') || (!s2.empty() && s2[0] == '\\'))
+    {
+        return false;
+    }
+#endif // _WIN32
+
+    size_t length = std::min(s1.size(), s2.size());
+    for (size_t i = 0; i < length; ++i)
+    {
+        uint32_t c1 = codeUnit(s1[i]);
+        uint32_t c2 = codeUnit(s2[i]);
+
+        if ((c1 | c2) >= 0x80 || (unescaping1 && c1 == '%') || (unescaping2 && c2 == '%'))
+        {
+            return false;
+        }
+
+        if (c1 != c2)
+        {
+            if (caseInsensitive)
+            {
+                c1 = asciiUpper(c1);
+                c2 = asciiUpper(c2);
+            }
+
+            if (c1 != c2)
+            {
+                result = int(c1) - int(c2);
+                return true;
+            }
+        }
+    }
+
+    // whatever follows in the longer one, it is greater
+    result = s1.size() == s2.size() ? 0 : (s1.size() < s2.size() ? -1 : 1);
+    return true;
+}
+
+template<typename CharT, typename CharU>
+int compareUtf(const std::basic_string<CharT>& s1, bool unescaping1,
+               const std::basic_string<CharU>& s2, bool unescaping2,
+               bool caseInsensitive)
+{
+    int result;
+    if (compareAscii(s1, unescaping1, s2, unescaping2, caseInsensitive, result))
+    {
+        return result;
+    }
+
+    return compareUtf(unicodeCodepointIterator(s1), unescaping1,
+                      unicodeCodepointIterator(s2), unescaping2,
+                      caseInsensitive ? Utils::toUpper : identity);
+}
+
 } // detail
 
 int compareUtf(const string& s1, bool unescaping1, const string& s2, bool unescaping2, bool caseInsensitive)
 {
-    return detail::compareUtf(
-                unicodeCodepointIterator(s1), unescaping1,
-                unicodeCodepointIterator(s2), unescaping2,
-                caseInsensitive ? Utils::toUpper: detail::identity);
+    return detail::compareUtf(s1, unescaping1, s2, unescaping2, caseInsensitive);
 }
 
 int compareUtf(const string& s1, bool unescaping1, const LocalPath& s2, bool unescaping2, bool caseInsensitive)
 {
-    return detail::compareUtf(
-        unicodeCodepointIterator(s1), unescaping1,
-        unicodeCodepointIterator(s2.localpath), unescaping2,
-        caseInsensitive ? Utils::toUpper: detail::identity);
+    return detail::compareUtf(s1, unescaping1, s2.localpath, unescaping2, caseInsensitive);
 }
 
 int compareUtf(const LocalPath& s1, bool unescaping1, const string& s2, bool unescaping2, bool caseInsensitive)
 {
-    return detail::compareUtf(
-        unicodeCodepointIterator(s1.localpath), unescaping1,
-        unicodeCodepointIterator(s2), unescaping2,
-        caseInsensitive ? Utils::toUpper: detail::identity);
+    return detail::compareUtf(s1.localpath, unescaping1, s2, unescaping2, caseInsensitive);
 }
 
 int compareUtf(const LocalPath& s1, bool unescaping1, const LocalPath& s2, bool unescaping2, bool caseInsensitive)
 {
-    return detail::compareUtf(
-        unicodeCodepointIterator(s1.localpath), unescaping1,
-        unicodeCodepointIterator(s2.localpath), unescaping2,
-        caseInsensitive ? Utils::toUpper: detail::identity);
+    return detail::compareUtf(s1.localpath, unescaping1, s2.localpath, unescaping2, caseInsensitive);
 }
 
 bool isCaseInsensitive(const FileSystemType type)
@@ -448,6 +514,9 @@ void FileSystemAccess::normalize(string* filename)
 {
     if (!filename) return;
 
+    // ASCII is already NFC, NUL bytes included
+    if (Utils::isAscii(filename->data(), filename->size())) return;
+
     const char* cfilename = filename->c_str();
     size_t fnsize = filename->size();
     string result;
@@ -490,6 +559,88 @@ std::unique_ptr<LocalPath> FileSystemAccess::fsShortname(const LocalPath& localn
     return nullptr;
 }
 
+bool NotificationDeque::popFront(Notification& n)
+{
+    receive();
+    if (mNotifications.empty())
+    {
+        return false;
+    }
+
+    n = std::move(mNotifications.front());
+    mNotifications.pop_front();
+    ++mFrontSeq;
+
+    auto it = mIndex.find(Key(n.localnode, n.path));
+    if (it != mIndex.end() && it->second.seq == n.seq)
+    {
+        mIndex.erase(it);
+    }
+    return true;
+}
+
+void NotificationDeque::unpopFront(const Notification& n)
+{
+    // not indexed again: its window started when it was first queued
+    mNotifications.push_front(n);
+    mNotifications.front().seq = --mFrontSeq;
+}
+
+void NotificationDeque::received(Notification&& n)
+{
+    ++mRaw;
+
+    Key key(n.localnode, n.path);
+    auto it = mIndex.find(key);
+    if (it != mIndex.end())
+    {
+        uint64_t pos = it->second.seq - mFrontSeq;
+        if (pos < mNotifications.size() && Waiter::ds - it->second.queued < COALESCE_DS)
+        {
+            Notification& queued = mNotifications[size_t(pos)];
+            assert(queued.seq == it->second.seq);
+
+            if (!queued.timestamp || !n.timestamp)
+            {
+                queued.timestamp = 0;  // immediate
+            }
+            else
+            {
+                queued.timestamp = std::max(queued.timestamp, n.timestamp);
+            }
+
+            ++mCoalesced;
+            return;
+        }
+    }
+
+    n.seq = mFrontSeq + mNotifications.size();
+    mIndex[key] = Queued{ n.seq, Waiter::ds };
+    mNotifications.push_back(std::move(n));
+}
+
+void NotificationDeque::counts(uint64_t& raw, uint64_t& coalesced)
+{
+    receive();
+    raw = mRaw;
+    coalesced = mCoalesced;
+}
+
+void NotificationDeque::replaceLocalNodePointers(LocalNode* check, LocalNode* newvalue)
+{
+    receive();
+    for (auto& n : mNotifications)
+    {
+        if (n.localnode == check)
+        {
+            n.localnode = newvalue;
+
+            // keyed by the old pointer
+            mIndex.clear();
+        }
+    }
+}
+
 #ifdef ENABLE_SYNC
 
 // default DirNotify: no notification available
@@ -871,6 +1022,45 @@ bool FileAccess::frawread(byte* dst, unsigned len, m_off_t pos, bool caller_open
     return r;
 }
 
+bool FileAccess::frawreadsparse(byte* dst, unsigned len, const m_off_t* positions, size_t count)
+{
+    std::vector<byte> span;
+
+    for (size_t first = 0; first < count; )
+    {
+        size_t last = first;
+        while (last + 1 < count && positions[last + 1] + len - positions[first] <= SPARSE_READ_SPAN)
+        {
+            last++;
+        }
+
+        if (last == first)
+        {
+            if (!sysread(dst + first * len, len, positions[first]))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            span.resize(size_t(positions[last] + len - positions[first]));
+            if (!sysread(span.data(), unsigned(span.size()), positions[first]))
+            {
+                return false;
+            }
+
+            for (size_t i = first; i <= last; i++)
+            {
+                memcpy(dst + i * len, span.data() + (positions[i] - positions[first]), len);
+            }
+        }
+
+        first = last + 1;
+    }
+
+    return true;
+}
+
 AsyncIOContext::~AsyncIOContext()
 {
     finish();
@@ -1010,6 +1200,46 @@ void LocalPath::prependWithSeparator(const LocalPath& additionalPath)
     localpath.insert(0, additionalPath.localpath);
 }
 
+void LocalPath::assignFromLeaf(const LocalPath* const* names, size_t count)
+{
+    // prependWithSeparator() puts a separator after a name if what follows doesn't start with one, and the name doesn't end with one
+    auto separated = [](const LocalPath& name, bool followed, separator_t next)
+    {
+        return followed && next != localPathSeparator && !name.endsInSeparator();
+    };
+
+    size_t size = 0;
+    separator_t next = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (separated(*names[i], size > 0, next))
+        {
+            size++;
+            next = localPathSeparator;
+        }
+        size += names[i]->localpath.size();
+        next = names[i]->localpath.empty() ? next : names[i]->localpath.front();
+    }
+
+    localpath.resize(size);
+
+    size_t pos = size;
+    next = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (separated(*names[i], pos < size, next))
+        {
+            localpath[--pos] = localPathSeparator;
+            next = localPathSeparator;
+        }
+        const auto& name = names[i]->localpath;
+        pos -= name.size();
+        std::copy(name.begin(), name.end(), localpath.begin() + ptrdiff_t(pos));
+        next = name.empty() ? next : name.front();
+    }
+    assert(!pos);
+}
+
 LocalPath LocalPath::prependNewWithSeparator(const LocalPath& additionalPath) const
 {
     LocalPath lp = *this;
@@ -1285,5 +1515,125 @@ FilenameAnomalyType isFilenameAnomaly(const LocalNode& node)
 }
 #endif
 
+InternedPath::InternedPath(const InternedPath& other)
+    : mEntry(other.mEntry)
+{
+    if (mEntry)
+    {
+        mEntry->refs++;
+    }
+}
+
+void InternedPath::reset()
+{
+    if (mEntry)
+    {
+        mEntry->table->release(*mEntry);
+        mEntry = nullptr;
+    }
+}
+
+InternedPath PathComponentTable::intern(const LocalPath& name)
+{
+    // at most three quarters full, tombstones included
+    if ((size() + mTombstones + 1) * 4 > mIndex.size() * 3)
+    {
+        rehash(std::max<size_t>(16, mIndex.size() * ((size() + 1) * 2 > mIndex.size() ? 2 : 1)));
+    }
+
+    size_t hash = name.hash();
+    size_t slot = findslot(hash, &name, 0);
+    if (mIndex[slot] && mIndex[slot] != TOMBSTONE)
+    {
+        PathComponent& entry = mEntries[mIndex[slot] - 1];
+        entry.refs++;
+        return InternedPath(&entry);
+    }
+
+    uint32_t index;
+    if (mFree.empty())
+    {
+        index = uint32_t(mEntries.size());
+        mEntries.emplace_back();
+    }
+    else
+    {
+        index = mFree.back();
+        mFree.pop_back();
+    }
+
+    PathComponent& entry = mEntries[index];
+    entry.name = name;
+    entry.hash = hash;
+    entry.refs = 1;
+    entry.index = index;
+    entry.table = this;
+
+    if (mIndex[slot] == TOMBSTONE)
+    {
+        mTombstones--;
+    }
+    mIndex[slot] = index + 1;
+    return InternedPath(&entry);
+}
+
+void PathComponentTable::release(PathComponent& entry)
+{
+    assert(entry.refs);
+    if (--entry.refs)
+    {
+        return;
+    }
+
+    mIndex[findslot(entry.hash, nullptr, entry.index + 1)] = TOMBSTONE;
+    mTombstones++;
+
+    entry.name = LocalPath();
+    mFree.push_back(entry.index);
+}
+
+size_t PathComponentTable::findslot(size_t hash, const LocalPath* name, uint32_t index) const
+{
+    // by name when adding (the first tombstone is reused if it's not there), by index when removing
+    size_t mask = mIndex.size() - 1;
+    size_t reusable = mIndex.size();
+    for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+    {
+        uint32_t i = mIndex[slot];
+        if (!i)
+        {
+            return reusable < mIndex.size() ? reusable : slot;
+        }
+
+        if (i == TOMBSTONE)
+        {
+            reusable = reusable < mIndex.size() ? reusable : slot;
+        }
+        else if (name ? mEntries[i - 1].hash == hash && mEntries[i - 1].name == *name : i == index)
+        {
+            return slot;
+        }
+    }
+}
+
+void PathComponentTable::rehash(size_t slots)
+{
+    mIndex.assign(slots, 0);
+    mTombstones = 0;
+
+    for (auto& entry : mEntries)
+    {
+        if (entry.refs)
+        {
+            size_t slot = entry.hash & (slots - 1);
+            while (mIndex[slot])
+            {
+                slot = (slot + 1) & (slots - 1);
+            }
+            mIndex[slot] = entry.index + 1;
+        }
+    }
+}
+
 } // namespace
 
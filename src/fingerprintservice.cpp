@@ -0,0 +1,229 @@
+/**
+ * @file fingerprintservice.cpp
+ * @brief Fingerprints local files on a pool of threads
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include "mega/fingerprintservice.h"
+#include "mega/logging.h"
+#include "megafs.h"
+
+namespace mega {
+
+FingerprintService::FingerprintService(Waiter& waiter, unsigned threadCount, unsigned readsPerDevice)
+    : mWaiter(waiter)
+    , mReadsPerDevice(std::max(readsPerDevice, 1u))
+{
+    for (unsigned i = std::max(threadCount, 1u); i--; )
+    {
+        try
+        {
+            mThreads.emplace_back([this]()
+            {
+                ThreadRoles::enter(ThreadRoles::WORKER, "mega-hash");
+                loop();
+            });
+        }
+        catch (std::system_error& e)
+        {
+            LOG_err << "Failed to start fingerprint thread: " << e.what();
+            break;
+        }
+    }
+
+    LOG_debug << "Fingerprint threads running: " << mThreads.size();
+}
+
+FingerprintService::~FingerprintService()
+{
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        mExit = true;
+    }
+    mWakeup.notify_all();
+
+    for (auto& thread : mThreads)
+    {
+        thread.join();
+    }
+
+    // the holders of the jobs not started fingerprint them some other way
+    auto abandon = [](std::shared_ptr<Job>& job)
+    {
+        job->failed = true;
+        job->mDone = true;
+    };
+
+    std::for_each(mQueued.begin(), mQueued.end(), abandon);
+    for (auto& d : mDevices)
+    {
+        std::for_each(d.second.waiting.begin(), d.second.waiting.end(), abandon);
+    }
+}
+
+std::shared_ptr<FingerprintService::Job> FingerprintService::queue(const LocalPath& path, bool withChunks)
+{
+    auto job = std::make_shared<Job>(path, withChunks);
+
+    if (mThreads.empty())
+    {
+        LOG_err << "No fingerprint threads, file not fingerprinted: " << path.toPath();
+        job->failed = true;
+        job->mDone = true;
+        return job;
+    }
+
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        mQueued.push_back(job);
+    }
+    mWakeup.notify_one();
+
+    return job;
+}
+
+bool FingerprintService::takeWaiting(std::shared_ptr<Job>& job, uint64_t& device)
+{
+    for (auto& d : mDevices)
+    {
+        if (!d.second.waiting.empty() && d.second.reading < mReadsPerDevice)
+        {
+            job = std::move(d.second.waiting.front());
+            d.second.waiting.pop_front();
+            device = d.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FingerprintService::loop()
+{
+    FSACCESS_CLASS fsaccess;
+
+    std::unique_lock<std::mutex> g(mMutex);
+
+    for (;;)
+    {
+        std::shared_ptr<Job> job;
+        uint64_t device = 0;
+
+        if (mExit)
+        {
+            return;
+        }
+
+        if (!takeWaiting(job, device))
+        {
+            if (mQueued.empty())
+            {
+                mWakeup.wait(g);
+                continue;
+            }
+
+            job = std::move(mQueued.front());
+            mQueued.pop_front();
+
+            // nobody wants it any longer
+            if (job.use_count() == 1)
+            {
+                continue;
+            }
+
+            g.unlock();
+            fsaccess.getdeviceid(job->path, device);
+            g.lock();
+
+            Device& d = mDevices[device];
+            if (d.reading >= mReadsPerDevice)
+            {
+                d.waiting.push_back(std::move(job));
+                continue;
+            }
+        }
+
+        if (job.use_count() > 1)
+        {
+            mDevices[device].reading++;
+            g.unlock();
+
+            fingerprint(fsaccess, job);
+            job->mDone = true;
+            mWaiter.notify();
+
+            g.lock();
+            Device& d = mDevices[device];
+            d.reading--;
+
+            // another thread may be idle while this device had jobs waiting
+            if (!d.waiting.empty())
+            {
+                mWakeup.notify_one();
+            }
+            else if (!d.reading)
+            {
+                mDevices.erase(device);
+            }
+        }
+    }
+}
+
+void FingerprintService::fingerprint(FileSystemAccess& fsaccess, const std::shared_ptr<Job>& held)
+{
+    Job& job = *held;
+    auto fa = fsaccess.newfileaccess(false);
+    LocalPath path = job.path;
+
+    if (!fa->fopen(path, true, false))
+    {
+        job.failed = true;
+        return;
+    }
+
+    job.type = fa->type;
+    job.fsid = fa->fsid;
+    job.fsidvalid = fa->fsidvalid;
+    job.isSymlink = fa->mIsSymLink;
+
+    if (job.type == FILENODE)
+    {
+        job.fingerprint.genfingerprint(fa.get());
+        job.failed = !job.fingerprint.isvalid;
+
+        if (job.withChunks && !job.failed)
+        {
+            job.chunks.reset(new ChunkIndex);
+            job.chunks->fingerprint = job.fingerprint;
+
+            // reading a large file takes a while: stop if nobody wants it any longer
+            auto cancelled = [this, &held]() { return mExit || held.use_count() == 1; };
+
+            // and the chunks are of the content fingerprinted only if it didn't change meanwhile
+            auto after = fsaccess.newfileaccess(false);
+            FileFingerprint fingerprint = job.fingerprint;
+
+            if (!job.chunks->compute(*fa, cancelled) || !after->fopen(path, true, false) || fingerprint.genfingerprint(after.get()))
+            {
+                LOG_debug << "Chunks not indexed: " << job.path.toPath();
+                job.chunks.reset();
+            }
+        }
+    }
+}
+
+} // namespace
@@ -90,83 +90,102 @@ const char* GfxProc::supportedvideoformats()
     return NULL;
 }
 
+bool GfxProc::readbitmapscaled(FileAccess* fa, const LocalPath& localfilename, int, int)
+{
+    // (this assumes that the width of the largest dimension is max)
+    return readbitmap(fa, localfilename, dimensions[sizeof dimensions/sizeof dimensions[0]-1][0]);
+}
+
+GfxProc* GfxProc::newworker()
+{
+    return NULL;
+}
+
 void *GfxProc::threadEntryPoint(void *param)
 {
-    GfxProc* gfxProcessor = (GfxProc*)param;
-    gfxProcessor->loop();
+    Worker* worker = (Worker*)param;
+    ThreadRoles::enter(ThreadRoles::GFX, "mega-gfx");
+    worker->owner->loop(worker->processor ? *worker->processor : *worker->owner);
     return NULL;
 }
 
-void GfxProc::loop()
+void GfxProc::loop(GfxProc& processor)
 {
     GfxJob *job = NULL;
-    while (!finished)
+    while ((job = requests.waitpop()))
     {
-        waiter.init(NEVER);
-        waiter.wait();
-        while ((job = requests.pop()))
+        // the client is attached after the threads have been started
+        processor.client = client;
+        auto started = std::chrono::steady_clock::now();
+        processor.process(job);
+
+        if (Trace::enabled(TRACE_GFX))
         {
-            if (finished)
+            size_t size = 0;
+            for (string* image : job->images)
             {
-                delete job;
-                break;
+                size += image ? image->size() : 0;
             }
+            Trace::record(TRACE_GFX_JOB, job->h.isNodeHandle() ? job->h.nodeHandle().as8byte() : job->h.uploadHandle().h, size, started);
+        }
 
-            mutex.lock();
-            LOG_debug << "Processing media file: " << job->h;
+        responses.push(job);
+        client->waiter->notify();
+    }
+}
 
-            // (this assumes that the width of the largest dimension is max)
-            if (readbitmap(NULL, job->localfilename, dimensions[sizeof dimensions/sizeof dimensions[0]-1][0]))
-            {
-                for (unsigned i = 0; i < job->imagetypes.size(); i++)
-                {
-                    // successively downscale the original image
-                    string* jpeg = new string();
-                    int w = dimensions[job->imagetypes[i]][0];
-                    int h = dimensions[job->imagetypes[i]][1];
+void GfxProc::process(GfxJob* job)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    LOG_debug << "Processing media file: " << job->h;
 
-                    if (this->w < w && this->h < h)
-                    {
-                        LOG_debug << "Skipping upsizing of preview or thumbnail";
-                        w = this->w;
-                        h = this->h;
-                    }
+    // bounding box types need their longer side, square crops their shorter one
+    int longest = 0;
+    int shortest = 0;
+    for (fatype type : job->imagetypes)
+    {
+        if (dimensions[type][1])
+        {
+            longest = std::max(longest, std::max(dimensions[type][0], dimensions[type][1]));
+        }
+        else
+        {
+            shortest = std::max(shortest, dimensions[type][0]);
+        }
+    }
 
-                    if (!resizebitmap(w, h, jpeg))
-                    {
-                        delete jpeg;
-                        jpeg = NULL;
-                    }
-                    job->images.push_back(jpeg);
-                }
-                freebitmap();
-            }
-            else
+    // the bitmap is decoded once and successively downscaled by resizebitmap(), largest type first
+    if (readbitmapscaled(NULL, job->localfilename, longest, shortest))
+    {
+        for (unsigned i = 0; i < job->imagetypes.size(); i++)
+        {
+            // successively downscale the original image
+            string* jpeg = new string();
+            int w = dimensions[job->imagetypes[i]][0];
+            int h = dimensions[job->imagetypes[i]][1];
+
+            if (this->w < w && this->h < h)
             {
-                for (unsigned i = 0; i < job->imagetypes.size(); i++)
-                {
-                    job->images.push_back(NULL);
-                }
+                LOG_debug << "Skipping upsizing of preview or thumbnail";
+                w = this->w;
+                h = this->h;
             }
 
-            mutex.unlock();
-            responses.push(job);
-            client->waiter->notify();
+            if (!resizebitmap(w, h, jpeg))
+            {
+                delete jpeg;
+                jpeg = NULL;
+            }
+            job->images.push_back(jpeg);
         }
+        freebitmap();
     }
-
-    while ((job = requests.pop()))
-    {
-        delete job;
-    }
-
-    while ((job = responses.pop()))
+    else
     {
         for (unsigned i = 0; i < job->imagetypes.size(); i++)
         {
-            delete job->images[i];
+            job->images.push_back(NULL);
         }
-        delete job;
     }
 }
 
@@ -299,6 +318,7 @@ int GfxProc::gendimensionsputfa(FileAccess* /*fa*/, const LocalPath& localfilena
 
     GfxJob *job = new GfxJob();
     job->h = th;
+    job->priority = th.isNodeHandle() ? GfxJob::PRIORITY_LOW : GfxJob::PRIORITY_HIGH;
     memcpy(job->key, key->key, SymmCipher::KEYLENGTH);
     job->localfilename = localfilename;
     for (fatype i = sizeof dimensions/sizeof dimensions[0]; i--; )
@@ -319,7 +339,6 @@ int GfxProc::gendimensionsputfa(FileAccess* /*fa*/, const LocalPath& localfilena
     auto count = int(job->imagetypes.size());
 
     requests.push(job);
-    waiter.notify();
     return count;
 }
 
@@ -374,23 +393,70 @@ bool GfxProc::savefa(const LocalPath& localfilepath, int width, int height, Loca
 GfxProc::GfxProc()
 {
     client = NULL;
-    finished = false;
+    workercount = std::max(1u, std::min(4u, std::thread::hardware_concurrency() / 2));
+}
+
+void GfxProc::setWorkerCount(unsigned count)
+{
+    assert(!threadstarted);
+    workercount = std::max(1u, count);
 }
 
 void GfxProc::startProcessingThread()
 {
-    thread.start(threadEntryPoint, this);
+    for (unsigned i = 0; i < workercount; i++)
+    {
+        std::unique_ptr<Worker> worker(new Worker);
+        worker->owner = this;
+        worker->processor.reset(newworker());
+        if (!worker->processor && i)
+        {
+            // no independent bitmap state available, a single thread sharing ours it is
+            break;
+        }
+
+        if (worker->processor)
+        {
+            worker->processor->isworker = true;
+            worker->processor->client = client;
+        }
+
+        workers.push_back(std::move(worker));
+        workers.back()->thread.start(threadEntryPoint, workers.back().get());
+    }
+
+    LOG_debug << "Media file processing threads: " << workers.size();
     threadstarted = true;
 }
 
 GfxProc::~GfxProc()
 {
-    finished = true;
-    waiter.notify();
+    if (isworker)
+    {
+        return;
+    }
+
+    requests.close();
     assert(threadstarted);
-    if (threadstarted)
+    for (auto& worker : workers)
     {
-        thread.join();
+        worker->thread.join();
+    }
+    workers.clear();
+
+    GfxJob *job = NULL;
+    while ((job = requests.pop()))
+    {
+        delete job;
+    }
+
+    while ((job = responses.pop()))
+    {
+        for (unsigned i = 0; i < job->images.size(); i++)
+        {
+            delete job->images[i];
+        }
+        delete job;
     }
 }
 
@@ -402,22 +468,59 @@ GfxJobQueue::GfxJobQueue()
 void GfxJobQueue::push(GfxJob *job)
 {
     mutex.lock();
-    jobs.push_back(job);
+    jobs[job->priority].push_back(job);
+    depth.add(1);
     mutex.unlock();
+    cv.notify_one();
 }
 
 GfxJob *GfxJobQueue::pop()
 {
-    mutex.lock();
-    if (jobs.empty())
+    std::lock_guard<std::mutex> g(mutex);
+    for (auto& queue : jobs)
     {
-        mutex.unlock();
-        return NULL;
+        if (!queue.empty())
+        {
+            GfxJob *job = queue.front();
+            queue.pop_front();
+            depth.add(-1);
+            return job;
+        }
+    }
+    return NULL;
+}
+
+GfxJob *GfxJobQueue::waitpop()
+{
+    std::unique_lock<std::mutex> g(mutex);
+    for (;;)
+    {
+        if (closed)
+        {
+            return NULL;
+        }
+
+        for (auto& queue : jobs)
+        {
+            if (!queue.empty())
+            {
+                GfxJob *job = queue.front();
+                queue.pop_front();
+                depth.add(-1);
+                return job;
+            }
+        }
+
+        cv.wait(g);
     }
-    GfxJob *job = jobs.front();
-    jobs.pop_front();
+}
+
+void GfxJobQueue::close()
+{
+    mutex.lock();
+    closed = true;
     mutex.unlock();
-    return job;
+    cv.notify_all();
 }
 
 GfxJob::GfxJob()
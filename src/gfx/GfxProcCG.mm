@@ -33,6 +33,11 @@ using namespace mega;
 
 #ifndef USE_FREEIMAGE
 
+GfxProc* GfxProcCG::newworker()
+{
+    return new GfxProcCG();
+}
+
 GfxProcCG::GfxProcCG()
     : GfxProc()
     , imageSource(NULL)
@@ -34,6 +34,14 @@ typedef const wchar_t freeimage_filename_char_t;
 typedef const char freeimage_filename_char_t;
 #endif
 
+#ifdef FFMPEG_OUT_OF_PROCESS
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#endif
+
 #if FREEIMAGE_MAJOR_VERSION < 3 || FREEIMAGE_MINOR_VERSION < 13
 #define OLD_FREEIMAGE
 #endif
@@ -92,6 +100,11 @@ GfxProcFreeImage::~GfxProcFreeImage()
 #endif
 }
 
+GfxProc* GfxProcFreeImage::newworker()
+{
+    return new GfxProcFreeImage();
+}
+
 bool GfxProcFreeImage::readbitmapFreeimage(FileAccess*, const LocalPath& imagePath, int size)
 {
 
@@ -409,6 +422,165 @@ bool GfxProcFreeImage::readbitmapFfmpeg(FileAccess* fa, const LocalPath& imagePa
     return false;
 }
 
+#ifdef FFMPEG_OUT_OF_PROCESS
+bool GfxProcFreeImage::readbitmapFfmpegOutOfProcess(FileAccess* fa, const LocalPath& imagePath, int size)
+{
+    // the child leaves the frame here, scaled to fit size x size, as packed 24-bit rows after the dimensions
+    size_t length = 2 * sizeof(int32_t) + size_t(size) * size_t(size) * 3;
+    void* shared = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+    {
+        LOG_warn << "Unable to map shared memory for video processing: " << errno;
+        return false;
+    }
+    auto sharedGuard = makeScopeGuard([length](void* p) { munmap(p, length); }, shared);
+    int32_t* dims = static_cast<int32_t*>(shared);
+    BYTE* bits = reinterpret_cast<BYTE*>(dims + 2);
+    dims[0] = dims[1] = 0;
+
+#ifdef __linux__
+    // RLIMIT_AS also counts the address space inherited from us
+    size_t inherited = 0;
+    if (FILE* statm = fopen("/proc/self/statm", "r"))
+    {
+        unsigned long pages;
+        if (fscanf(statm, "%lu", &pages) == 1)
+        {
+            inherited = size_t(pages) * size_t(sysconf(_SC_PAGESIZE));
+        }
+        fclose(statm);
+    }
+#endif
+
+    // the child keeps the write end open until it exits; pipes and forks are serialized
+    // so that children of other workers don't inherit it and delay the end of file
+    static std::mutex forkMutex;
+    std::unique_lock<std::mutex> forkLock(forkMutex);
+
+    int fds[2];
+    if (pipe(fds))
+    {
+        LOG_warn << "Unable to create pipe for video processing: " << errno;
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        LOG_warn << "Unable to fork for video processing: " << errno;
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (!pid)
+    {
+        // only this thread exists in the child: stay away from locks other threads might have held
+        close(fds[0]);
+        SimpleLogger::setLogLevel(logFatal);
+
+#ifdef __linux__
+        if (inherited)
+        {
+            struct rlimit limit;
+            limit.rlim_cur = limit.rlim_max = rlim_t(inherited + VIDEO_MEMORY_BUDGET);
+            setrlimit(RLIMIT_AS, &limit);
+        }
+#endif
+
+        bool ok = false;
+        if (readbitmapFfmpeg(fa, imagePath, size))
+        {
+            int fw = w;
+            int fh = h;
+            if (fw > size || fh > size)
+            {
+                int rw = size;
+                int rh = size;
+                int px, py;
+                transform(fw, fh, rw, rh, px, py);
+            }
+
+            FIBITMAP* scaled = (fw == w && fh == h) ? dib : FreeImage_Rescale(dib, fw, fh, FILTER_BILINEAR);
+            if (scaled)
+            {
+                FreeImage_ConvertToRawBits(bits, scaled, fw * 3, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, TRUE);
+                dims[0] = fw;
+                dims[1] = fh;
+                ok = true;
+
+                if (scaled != dib)
+                {
+                    FreeImage_Unload(scaled);
+                }
+            }
+        }
+
+        _exit(ok ? 0 : 1);
+    }
+
+    close(fds[1]);
+    forkLock.unlock();
+
+    // wait for the child to exit (EOF on the pipe) within the time budget
+    struct pollfd pfd;
+    pfd.fd = fds[0];
+    pfd.events = POLLIN;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(VIDEO_TIME_BUDGET_MS);
+    bool finished = false;
+    for (;;)
+    {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0)
+        {
+            break;
+        }
+
+        int r = poll(&pfd, 1, int(remaining));
+        if (r < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        char c;
+        if (r <= 0 || read(fds[0], &c, 1) <= 0)
+        {
+            finished = r > 0;
+            break;
+        }
+    }
+    close(fds[0]);
+
+    if (!finished)
+    {
+        LOG_warn << "Video processing exceeded its time budget: " << imagePath.toPath(*client->fsaccess);
+        kill(pid, SIGKILL);
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+    if (!finished || !WIFEXITED(status) || WEXITSTATUS(status) || dims[0] <= 0 || dims[1] <= 0)
+    {
+        if (finished && WIFSIGNALED(status))
+        {
+            LOG_warn << "Video processing aborted by signal " << WTERMSIG(status) << ": " << imagePath.toPath(*client->fsaccess);
+        }
+        return false;
+    }
+
+    if (!(dib = FreeImage_ConvertFromRawBits(bits, dims[0], dims[1], dims[0] * 3, 24,
+                                             FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, TRUE)))
+    {
+        return false;
+    }
+
+    w = static_cast<int>(FreeImage_GetWidth(dib));
+    h = static_cast<int>(FreeImage_GetHeight(dib));
+    return w > 0 && h > 0;
+}
+#endif
+
 #endif
 
 #ifdef HAVE_PDFIUM
@@ -499,7 +671,11 @@ bool GfxProcFreeImage::readbitmap(FileAccess* fa, const LocalPath& localname, in
         if (isFfmpegFile(extension))
         {
             bitmapLoaded = true;
+#ifdef FFMPEG_OUT_OF_PROCESS
+            if (!readbitmapFfmpegOutOfProcess(fa, localname, size) )
+#else
             if (!readbitmapFfmpeg(fa, localname, size) )
+#endif
             {
                 return false;
             }
@@ -527,6 +703,49 @@ bool GfxProcFreeImage::readbitmap(FileAccess* fa, const LocalPath& localname, in
     return true;
 }
 
+bool GfxProcFreeImage::readbitmapscaled(FileAccess* fa, const LocalPath& localname, int longest, int shortest)
+{
+    int size = dimensions[sizeof dimensions/sizeof dimensions[0]-1][0];
+
+#if !defined(OLD_FREEIMAGE) && defined(FIF_LOAD_NOPIXELS)
+    string extension;
+    bool otherreader = false;
+    if (client->fsaccess->getextension(localname, extension))
+    {
+#ifdef HAVE_FFMPEG
+        otherreader = otherreader || isFfmpegFile(extension);
+#endif
+#ifdef HAVE_PDFIUM
+        otherreader = otherreader || isPdfFile(extension);
+#endif
+    }
+
+    // JPEGs are decoded with DCT scaling, which only honours a hint for the longer side:
+    // read the header alone to work out the hint that keeps square crops sharp
+    if (!otherreader && FreeImage_GetFileTypeX(localname.localpath.c_str()) == FIF_JPEG)
+    {
+        if (FIBITMAP* header = FreeImage_LoadX(FIF_JPEG, localname.localpath.c_str(), FIF_LOAD_NOPIXELS))
+        {
+            int iw = static_cast<int>(FreeImage_GetWidth(header));
+            int ih = static_cast<int>(FreeImage_GetHeight(header));
+            FreeImage_Unload(header);
+
+            if (iw > 0 && ih > 0)
+            {
+                int64_t longer = std::max(iw, ih);
+                int64_t shorter = std::min(iw, ih);
+                size = int(std::max<int64_t>(longest, (shortest * longer + shorter - 1) / shorter));
+            }
+        }
+    }
+#else
+    (void)longest;
+    (void)shortest;
+#endif
+
+    return readbitmap(fa, localname, size);
+}
+
 bool GfxProcFreeImage::resizebitmap(int rw, int rh, string* jpegout)
 {
     FIBITMAP* tdib;
@@ -594,6 +813,7 @@ void GfxProcFreeImage::freebitmap()
     if (dib != NULL)
     {
         FreeImage_Unload(dib);
+        dib = NULL;
     }
 }
 } // namespace
@@ -361,11 +361,11 @@ void BackupMonitor::beatBackupInfo(UnifiedSync& us)
 
     std::shared_ptr<HeartBeatSyncInfo> hbs = us.mNextHeartbeat;
 
+    m_time_t now = m_time(nullptr);
     if ( !hbs->mSending && (hbs->mModified
-         || m_time(nullptr) - hbs->lastBeat() > MAX_HEARBEAT_SECS_DELAY))
+         || now - hbs->lastBeat() > MAX_HEARBEAT_SECS_DELAY))
     {
         hbs->updateStatus(us);  //we asume this is costly: only do it when beating
-        hbs->setLastBeat(m_time(nullptr));
 
         m_off_t inflightProgress = 0;
         if (us.mSync)
@@ -375,6 +375,19 @@ void BackupMonitor::beatBackupInfo(UnifiedSync& us)
 
         int8_t progress = (hbs->progress(inflightProgress) < 0) ? -1 : static_cast<int8_t>(std::lround(hbs->progress(inflightProgress)*100.0));
 
+        // with many syncs transferring, small progress steps would otherwise cost a command per sync and beat
+        if (hbs->status() == hbs->mLastBeatStatus
+                && progress >= 0 && hbs->mLastBeatProgress >= 0
+                && std::abs(progress - hbs->mLastBeatProgress) < MIN_PROGRESS_HEARTBEAT_DELTA
+                && now - hbs->lastBeat() < MAX_PROGRESS_HEARTBEAT_SECS_DELAY)
+        {
+            return;     // still modified: it goes in a later beat
+        }
+
+        hbs->setLastBeat(now);
+        hbs->mLastBeatStatus = hbs->status();
+        hbs->mLastBeatProgress = progress;
+
         hbs->mSending = true;
         auto newCommand = new CommandBackupPutHeartBeat(mClient, us.mConfig.getBackupId(),  static_cast<uint8_t>(hbs->status()),
                           progress, hbs->mPendingUps, hbs->mPendingDowns,
@@ -144,6 +144,22 @@ void HttpIO::updateuploadspeed(m_off_t size)
 }
 
 Proxy *HttpIO::getautoproxy()
+{
+    if (mAutoProxyTime == NEVER || Waiter::ds - mAutoProxyTime >= AUTOPROXY_TTL)
+    {
+        unique_ptr<Proxy> proxy(detectautoproxy());
+        mAutoProxy = *proxy;
+        mAutoProxyTime = Waiter::ds;
+    }
+    else
+    {
+        LOG_debug << "Using the proxy settings detected " << (Waiter::ds - mAutoProxyTime) / 10 << " seconds ago";
+    }
+
+    return new Proxy(mAutoProxy);
+}
+
+Proxy *HttpIO::detectautoproxy()
 {
     Proxy* proxy = new Proxy();
     proxy->setProxyType(Proxy::NONE);
@@ -388,6 +404,170 @@ m_off_t HttpIO::getmaxuploadspeed()
     return 0;
 }
 
+BandwidthScheduler::BandwidthScheduler()
+{
+    mClasses[BWCLASS_STREAMING].policy.weight = 8;
+    mClasses[BWCLASS_FOREGROUND].policy.weight = 4;
+    mClasses[BWCLASS_SYNC].policy.weight = 2;
+    mClasses[BWCLASS_BACKUP].policy.weight = 1;
+}
+
+void BandwidthScheduler::setlimit(m_off_t bps)
+{
+    mLimit = bps > 0 ? bps : 0;
+    mTokens = std::min(mTokens, mLimit);
+}
+
+void BandwidthScheduler::addpolicy(bwclass_t c, const Policy& policy)
+{
+    mClasses[c].policies.push_back(policy);
+}
+
+void BandwidthScheduler::clearpolicies()
+{
+    for (auto& c : mClasses)
+    {
+        c.policies.clear();
+    }
+}
+
+const BandwidthScheduler::Policy& BandwidthScheduler::policy(const Class& c) const
+{
+    for (auto& p : c.policies)
+    {
+        bool applies = p.fromMinute <= p.toMinute ? mMinuteOfDay >= p.fromMinute && mMinuteOfDay < p.toMinute
+                                                  : mMinuteOfDay >= p.fromMinute || mMinuteOfDay < p.toMinute;
+        if (applies)
+        {
+            return p;
+        }
+    }
+    return c.policy;
+}
+
+bool BandwidthScheduler::isactive(const Class& c) const
+{
+    return c.wanted && mNow - c.lastWanted < ACTIVE_DS;
+}
+
+bool BandwidthScheduler::active() const
+{
+    if (mLimit)
+    {
+        return true;
+    }
+
+    for (auto& c : mClasses)
+    {
+        if (policy(c).maxbps)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BandwidthScheduler::tick(dstime now, int minuteOfDay)
+{
+    mNow = now;
+    mMinuteOfDay = minuteOfDay;
+
+    // up to a second of tokens: a pause doesn't turn into a burst
+    dstime elapsed = std::min<dstime>(now - mLastTick, 10);
+    mLastTick = now;
+    if (!elapsed)
+    {
+        return;
+    }
+
+    unsigned weights = 0;
+    for (auto& c : mClasses)
+    {
+        if (isactive(c))
+        {
+            weights += policy(c).weight;
+        }
+    }
+
+    mTokens = std::min(mTokens + mLimit * elapsed / 10, mLimit);
+
+    for (auto& c : mClasses)
+    {
+        const Policy& p = policy(c);
+
+        m_off_t rate = mLimit && weights && isactive(c) ? mLimit * p.weight / weights : 0;
+        if (p.maxbps && (!rate || rate > p.maxbps))
+        {
+            rate = p.maxbps;
+        }
+        c.tokens = std::min(c.tokens + rate * elapsed / 10, rate);
+        c.capTokens = std::min(c.capTokens + p.maxbps * elapsed / 10, p.maxbps);
+    }
+}
+
+m_off_t BandwidthScheduler::available(bwclass_t cls) const
+{
+    const Class& c = mClasses[cls];
+    m_off_t result = std::numeric_limits<m_off_t>::max();
+
+    if (mLimit)
+    {
+        // the class's own tokens, and those the other classes wanting data don't hold
+        m_off_t held = 0;
+        for (int i = 0; i < BWCLASS_COUNT; i++)
+        {
+            if (i != cls && isactive(mClasses[i]))
+            {
+                held += std::max<m_off_t>(mClasses[i].tokens, 0);
+            }
+        }
+
+        m_off_t own = std::max<m_off_t>(c.tokens, 0);
+        result = std::min(mTokens, own + std::max<m_off_t>(mTokens - own - held, 0));
+    }
+
+    if (policy(c).maxbps)
+    {
+        result = std::min(result, c.capTokens);
+    }
+    return std::max<m_off_t>(result, 0);
+}
+
+void BandwidthScheduler::take(bwclass_t cls, m_off_t size)
+{
+    Class& c = mClasses[cls];
+
+    // beyond its own tokens it borrowed from the others': the debt is the root bucket's (and its limit's)
+    c.tokens = std::max<m_off_t>(c.tokens - size, 0);
+    c.capTokens -= size;
+    mTokens -= size;
+}
+
+m_off_t BandwidthScheduler::grant(bwclass_t cls, m_off_t wanted)
+{
+    Class& c = mClasses[cls];
+    c.lastWanted = mNow;
+    c.wanted = true;
+
+    m_off_t result = std::min(wanted, available(cls));
+    take(cls, result);
+    return result;
+}
+
+bool BandwidthScheduler::admit(bwclass_t cls, m_off_t size)
+{
+    Class& c = mClasses[cls];
+    c.lastWanted = mNow;
+    c.wanted = true;
+
+    if (!available(cls))
+    {
+        return false;
+    }
+    take(cls, size);
+    return true;
+}
+
 void HttpReq::post(MegaClient* client, const char* data, unsigned len)
 {
     if (httpio)
@@ -402,15 +582,35 @@ void HttpReq::post(MegaClient* client, const char* data, unsigned len)
     outpos = 0;
     notifiedbufpos = 0;
     inpurge = 0;
+    wirebytes = -1;
     method = METHOD_POST;
     contentlength = -1;
     lastdata = Waiter::ds;
+    started = std::chrono::steady_clock::now();
 
     DEBUG_TEST_HOOK_HTTPREQ_POST(this)
 
     httpio->post(this, data, len);
 }
 
+void HttpReq::recordlatency(LatencyHistogram& histogram, bool failed)
+{
+    if (started == std::chrono::steady_clock::time_point())
+    {
+        return;
+    }
+
+    if (failed)
+    {
+        histogram.recordError();
+    }
+    else
+    {
+        histogram.record(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started));
+    }
+    started = std::chrono::steady_clock::time_point();
+}
+
 void HttpReq::get(MegaClient *client)
 {
     if (httpio)
@@ -425,9 +625,11 @@ void HttpReq::get(MegaClient *client)
     outpos = 0;
     notifiedbufpos = 0;
     inpurge = 0;
+    wirebytes = -1;
     method = METHOD_GET;
     contentlength = -1;
     lastdata = Waiter::ds;
+    started = std::chrono::steady_clock::now();
 
     httpio->post(this);
 }
@@ -446,6 +648,7 @@ void HttpReq::dns(MegaClient *client)
     outpos = 0;
     notifiedbufpos = 0;
     inpurge = 0;
+    wirebytes = -1;
     method = METHOD_NONE;
     contentlength = -1;
     lastdata = Waiter::ds;
@@ -465,6 +668,7 @@ void HttpReq::disconnect()
 
 HttpReq::HttpReq(bool b)
 {
+    traceId = TraceScope::current();
     binary = b;
     status = REQ_READY;
     buf = NULL;
@@ -489,12 +693,21 @@ HttpReq::~HttpReq()
     }
 
     delete[] buf;
+    CodeCounter::accountMemory(CodeCounter::MEM_HTTP_BUFFERS, -accountedmemory);
+}
+
+void HttpReq::accountmemory()
+{
+    int64_t bytes = int64_t(in.capacity()) + (buf ? int64_t(buflen) : 0);
+    CodeCounter::accountMemory(CodeCounter::MEM_HTTP_BUFFERS, bytes - accountedmemory);
+    accountedmemory = bytes;
 }
 
 void HttpReq::init()
 {
     httpstatus = 0;
     inpurge = 0;
+    wirebytes = -1;
     sslcheckfailed = false;
     bufpos = 0;
     notifiedbufpos = 0;
@@ -504,6 +717,7 @@ void HttpReq::init()
     outpos = 0;
     in.clear();
     contenttype.clear();
+    accountmemory();
 }
 
 void HttpReq::setreq(const char* u, contenttype_t t)
@@ -537,20 +751,23 @@ void HttpReq::put(void* data, unsigned len, bool purge)
         }
 
         in.append((char*)data, len);
+        accountmemory();
     }
 
     bufpos += len;
 }
 
 
-HttpReq::http_buf_t::http_buf_t(byte* b, size_t s, size_t e)
-    : start(s), end(e), buf(b)
+HttpReq::http_buf_t::http_buf_t(byte* b, size_t s, size_t e, size_t allocated)
+    : start(s), end(e), buf(b), accounted(b ? (allocated ? allocated : e) : 0)
 {
+    CodeCounter::accountMemory(CodeCounter::MEM_RAID_BUFFERS, int64_t(accounted));
 }
 
 HttpReq::http_buf_t::~http_buf_t()
 {
     delete[] buf;
+    CodeCounter::accountMemory(CodeCounter::MEM_RAID_BUFFERS, -int64_t(accounted));
 }
 
 void HttpReq::http_buf_t::swap(http_buf_t& other)
@@ -558,9 +775,10 @@ void HttpReq::http_buf_t::swap(http_buf_t& other)
     byte* tb = buf; buf = other.buf; other.buf = tb;
     size_t ts = start; start = other.start; other.start = ts;
     size_t te = end; end = other.end; other.end = te;
+    size_t ta = accounted; accounted = other.accounted; other.accounted = ta;
 }
 
-bool HttpReq::http_buf_t::isNull()
+bool HttpReq::http_buf_t::isNull() const
 {
     return buf == NULL;
 }
@@ -570,7 +788,7 @@ byte* HttpReq::http_buf_t::datastart()
     return buf + start;
 }
 
-size_t HttpReq::http_buf_t::datalen()
+size_t HttpReq::http_buf_t::datalen() const
 {
     return end - start;
 }
@@ -579,7 +797,7 @@ size_t HttpReq::http_buf_t::datalen()
 // give up ownership of the buffer for client to use.
 struct HttpReq::http_buf_t* HttpReq::release_buf()
 {
-    HttpReq::http_buf_t* result = new HttpReq::http_buf_t(buf, inpurge, (size_t)bufpos);
+    HttpReq::http_buf_t* result = new HttpReq::http_buf_t(buf, inpurge, (size_t)bufpos, buf ? size_t(buflen) : 0);
     buf = NULL;
     inpurge = 0;
     buflen = 0;
@@ -588,6 +806,7 @@ struct HttpReq::http_buf_t* HttpReq::release_buf()
     notifiedbufpos = 0;
     contentlength = -1;
     in.clear();
+    accountmemory();
     return result;
 }
 
@@ -611,9 +830,10 @@ void HttpReq::purge(size_t numbytes)
 // set total response size
 void HttpReq::setcontentlength(m_off_t len)
 {
-    if (!buf && type != REQ_BINARY)
+    if (!buf && type != REQ_BINARY && !incremental)
     {
         in.reserve(static_cast<size_t>(len));
+        accountmemory();
     }
 
     contentlength = len;
@@ -644,6 +864,7 @@ byte* HttpReq::reserveput(unsigned* len)
         if (bufpos + *len > (int) in.size())
         {
             in.resize(static_cast<size_t>(bufpos + *len));
+            accountmemory();
         }
 
         *len = static_cast<unsigned>(in.size() - bufpos);
@@ -699,6 +920,7 @@ void HttpReqDL::prepare(const char* tempurl, SymmCipher* /*key*/,
             buf = new byte[(size + SymmCipher::BLOCKSIZE - 1) & - SymmCipher::BLOCKSIZE];
         }
         buflen = size;
+        accountmemory();
     }
 }
 
@@ -759,23 +981,46 @@ bool EncryptByChunks::encrypt(m_off_t pos, m_off_t npos, string& urlSuffix)
     m_off_t finalpos = npos;
     m_off_t endpos = ChunkedHash::chunkceil(startpos, finalpos);
     m_off_t chunksize = endpos - startpos;
+
+    // with buffers that stay valid, all chunks are encrypted and mac'd together
+    vector<SymmCipher::CtrChunk> batch;
+
     while (chunksize)
     {
-        byte mac[SymmCipher::BLOCKSIZE] = { 0 };
         buf = nextbuffer(unsigned(chunksize));
         if (!buf) return false;
-        key->ctr_crypt(buf, unsigned(chunksize), startpos, ctriv, mac, 1);
-        memcpy((*macs)[startpos].mac, mac, sizeof mac);
-        (*macs)[startpos].finished = false;  // finished is only set true after confirmation of the chunk uploading.
-        LOG_debug << "Encrypted chunk: " << startpos << " - " << endpos << "   Size: " << chunksize;
 
-        updateCRC(buf, unsigned(chunksize), unsigned(startpos - pos));
+        ChunkMAC& chunkmac = (*macs)[startpos];
+        chunkmac.finished = false;  // finished is only set true after confirmation of the chunk uploading.
+
+        if (buffersPersist())
+        {
+            SymmCipher::CtrChunk c = { buf, unsigned(chunksize), startpos, chunkmac.mac, true };
+            batch.push_back(c);
+        }
+        else
+        {
+            key->ctr_crypt(buf, unsigned(chunksize), startpos, ctriv, chunkmac.mac, 1);
+            LOG_debug << "Encrypted chunk: " << startpos << " - " << endpos << "   Size: " << chunksize;
+            updateCRC(buf, unsigned(chunksize), unsigned(startpos - pos));
+        }
 
         startpos = endpos;
         endpos = ChunkedHash::chunkceil(startpos, finalpos);
         chunksize = endpos - startpos;
     }
     assert(endpos == finalpos);
+
+    if (!batch.empty())
+    {
+        key->ctr_crypt(batch.data(), batch.size(), ctriv, true);
+
+        for (auto& c : batch)
+        {
+            LOG_debug << "Encrypted chunk: " << c.pos << " - " << c.pos + c.len << "   Size: " << c.len;
+            updateCRC(c.data, c.len, unsigned(c.pos - pos));
+        }
+    }
     buf = nextbuffer(0);   // last call in case caller does buffer post-processing (such as write to file as we go)
 
     ostringstream s;
@@ -792,6 +1037,11 @@ EncryptBufferByChunks::EncryptBufferByChunks(byte* b, SymmCipher* k, chunkmac_ma
 {
 }
 
+bool EncryptBufferByChunks::buffersPersist() const
+{
+    return true;
+}
+
 byte* EncryptBufferByChunks::nextbuffer(unsigned bufsize)
 {
     byte* pos = chunkstart;
@@ -27,14 +27,188 @@
 #include "mega/logging.h"
 #include "mega/mega_utf8proc.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MEGA_JSON_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#define MEGA_JSON_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace mega {
+
+namespace {
+
+const char* jsonStringEndScalar(const char* ptr)
+{
+    bool escaped = false;
+
+    while (*ptr && (escaped || *ptr != '"'))
+    {
+        escaped = *ptr == '\\' && !escaped;
+        ptr++;
+    }
+
+    return ptr;
+}
+
+#ifdef MEGA_JSON_SSE2
+inline unsigned lowestBit(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, mask);
+    return unsigned(i);
+#else
+    return unsigned(__builtin_ctz(mask));
+#endif
+}
+
+// hit is a quote, a backslash or the NUL: the end, or where to carry on from after an escape
+inline bool jsonStringHit(const char*& ptr, const char* hit)
+{
+    if (*hit != '\\')
+    {
+        ptr = hit;
+        return true;
+    }
+
+    if (!hit[1])
+    {
+        ptr = hit + 1;
+        return true;
+    }
+
+    ptr = hit + 2;
+    return false;
+}
+#endif
+
+#ifdef MEGA_JSON_SSE2
+// 16 bytes per iteration. A load never reaches into the next page, so never into an unmapped one past the terminating NUL
+const char* jsonStringEndSSE2(const char* ptr)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i zero = _mm_setzero_si128();
+
+    for (;;)
+    {
+        // unaligned unless that would cross a page boundary: then the aligned block, ignoring the bytes before ptr
+        const char* block = (reinterpret_cast<uintptr_t>(ptr) & 4095) <= 4096 - 16
+                ? ptr : reinterpret_cast<const char*>(reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(15));
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)), _mm_cmpeq_epi8(v, zero));
+
+        unsigned mask = unsigned(_mm_movemask_epi8(hits)) & (~0u << (ptr - block));
+        if (!mask)
+        {
+            ptr = block + 16;
+        }
+        else if (jsonStringHit(ptr, block + lowestBit(mask)))
+        {
+            return ptr;
+        }
+    }
+}
+#endif
+
+#ifdef MEGA_JSON_NEON
+// skips 16 bytes at a time while none of them is special, the block with one is scanned byte by byte
+const char* jsonStringEndNEON(const char* ptr)
+{
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+
+    for (;;)
+    {
+        // scalar up to the next aligned block
+        while (reinterpret_cast<uintptr_t>(ptr) & 15)
+        {
+            if (!*ptr || *ptr == '"')
+            {
+                return ptr;
+            }
+            if (*ptr == '\\')
+            {
+                if (!*++ptr)
+                {
+                    return ptr;
+                }
+            }
+            ptr++;
+        }
+
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(ptr));
+        uint8x16_t hits = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)), vceqzq_u8(v));
+        if (!vmaxvq_u8(hits))
+        {
+            ptr += 16;
+            continue;
+        }
+
+        for (;;)
+        {
+            if (!*ptr || *ptr == '"')
+            {
+                return ptr;
+            }
+            if (*ptr == '\\')
+            {
+                if (!*++ptr)
+                {
+                    return ptr;
+                }
+                ptr++;
+                break;
+            }
+            ptr++;
+        }
+    }
+}
+#endif
+
+} // namespace
+
+std::vector<std::pair<const char*, JSONStringScanner::Function>> JSONStringScanner::implementations()
+{
+    std::vector<std::pair<const char*, Function>> result;
+    result.emplace_back("scalar", jsonStringEndScalar);
+
+#ifdef MEGA_JSON_SSE2
+    result.emplace_back("sse2", jsonStringEndSSE2);
+#endif
+
+#ifdef MEGA_JSON_NEON
+    result.emplace_back("neon", jsonStringEndNEON);
+#endif
+
+    return result;
+}
+
+const char* JSONStringScanner::end(const char* ptr)
+{
+    static const Function best = implementations().back().second;
+    return best(ptr);
+}
+
+const char* JSONStringScanner::name()
+{
+    static const char* const best = implementations().back().first;
+    return best;
+}
+
 // store array or object in string s
 // reposition after object
 bool JSON::storeobject(string* s)
 {
     int openobject[2] = { 0 };
     const char* ptr;
-    bool escaped = false;
 
     while (*(const signed char*)pos > 0 && *pos <= ' ')
     {
@@ -69,13 +243,7 @@ bool JSON::storeobject(string* s)
         }
         else if (*ptr == '"')
         {
-            ptr++;
-
-            while (*ptr && (escaped || *ptr != '"'))
-            {
-                escaped = *ptr == '\\' && !escaped;
-                ptr++;
-            }
+            ptr = JSONStringScanner::end(ptr + 1);
 
             if (!*ptr)
             {
@@ -122,6 +290,44 @@ bool JSON::storeobject(string* s)
     }
 }
 
+const char* JSON::objectend(const char* begin, const char* end)
+{
+    int depth = 0;
+
+    for (const char* ptr = begin; ptr < end; ptr++)
+    {
+        if (*ptr == '[' || *ptr == '{')
+        {
+            depth++;
+        }
+        else if (*ptr == ']' || *ptr == '}')
+        {
+            if (--depth <= 0)
+            {
+                return depth ? nullptr : ptr + 1;
+            }
+        }
+        else if (*ptr == '"')
+        {
+            // skip the string, escapes included
+            for (ptr++; ptr < end && *ptr != '"'; ptr++)
+            {
+                if (*ptr == '\\')
+                {
+                    ptr++;
+                }
+            }
+        }
+        else if (!depth)
+        {
+            // not an object or array
+            return nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
 bool JSON::skipnullvalue()
 {
     // this applies only to values, after ':'
@@ -200,13 +406,14 @@ std::string JSON::getname()
 
     if (*ptr++ == '"')
     {
-        while (*ptr && *ptr != '"')
+        const char* end = ptr;
+        while (*end && *end != '"')
         {
-            name += *ptr;
-            ptr++;
+            end++;
         }
 
-        pos = ptr + 2;
+        name.assign(ptr, end);
+        pos = end + 2;
     }
 
     return name;
@@ -224,11 +431,13 @@ std::string JSON::getnameWithoutAdvance() const
 
     if (*ptr++ == '"')
     {
-        while (*ptr && *ptr != '"')
+        const char* end = ptr;
+        while (*end && *end != '"')
         {
-            name += *ptr;
-            ptr++;
+            end++;
         }
+
+        name.assign(ptr, end);
     }
 
     return name;
@@ -334,7 +543,7 @@ bool JSON::storebinary(string* dst)
         }
 
         dst->resize((ptr - pos - 1) / 4 * 3 + 3);
-        dst->resize(Base64::atob(pos + 1, (byte*)dst->data(), int(dst->size())));
+        dst->resize(Base64::atob(pos + 1, size_t(ptr - pos - 1), (byte*)dst->data(), int(dst->size())));
 
         // skip string
         storeobject();
@@ -377,6 +586,20 @@ handle JSON::gethandle(int size)
 {
     byte buf[9] = { 0 };
 
+    // the usual case, just the handle between quotes: no second pass over the string to skip it
+    const char* ptr = pos + (*pos == ',');
+    if (*ptr == '"' && (size == 6 || size == 8 ? Base64::atohandle(ptr + 1, unsigned(size), buf)
+                                               : size <= 8 && Base64::atob(ptr + 1, buf, sizeof buf) == size))
+    {
+        const char* end = ptr + 1 + (size * 4 + 2) / 3;
+        if (*end == '"')
+        {
+            pos = end + 1;
+            return MemAccess::get<handle>((const char*)buf);
+        }
+        memset(buf, 0, sizeof buf);
+    }
+
     // no arithmetic or semantic comparisons will be performed on handles, so
     // no endianness issues
     if (storebinary(buf, sizeof buf) == size)
@@ -415,6 +638,24 @@ m_off_t JSON::getint()
         return -1;
     }
 
+    if (ptr == pos)
+    {
+        // plain integers are decoded and skipped in one pass
+        const char* p = ptr + (*ptr == '-');
+        const char* digits = p;
+        uint64_t v = 0;
+        while (*p >= '0' && *p <= '9' && p - digits < 18)
+        {
+            v = v * 10 + unsigned(*p++ - '0');
+        }
+
+        if (p > digits && (*p == ',' || *p == '}' || *p == ']' || !*p))
+        {
+            pos = p;
+            return *ptr == '-' ? -m_off_t(v) : m_off_t(v);
+        }
+    }
+
     handle r = atoll(ptr);
     storeobject();
 
@@ -591,58 +832,69 @@ bool JSON::leaveobject()
 // unescape JSON string (non-strict)
 void JSON::unescape(string* s)
 {
-    char c;
-    int l;
+    string& d = *s;
+    const size_t n = d.size();
+
+    // most strings have nothing to unescape
+    size_t i = d.find('\\');
+    if (i == string::npos)
+    {
+        return;
+    }
 
-    for (unsigned i = 0; i + 1 < s->size(); i++)
+    // one pass, writing the result over the input
+    size_t out = i;
+    while (i < n)
     {
-        if ((*s)[i] == '\\')
+        if (d[i] != '\\' || i + 1 == n)
         {
-            switch ((*s)[i + 1])
-            {
-                case 'n':
-                    c = '\n';
-                    l = 2;
-                    break;
-
-                case 'r':
-                    c = '\r';
-                    l = 2;
-                    break;
-
-                case 'b':
-                    c = '\b';
-                    l = 2;
-                    break;
-
-                case 'f':
-                    c = '\f';
-                    l = 2;
-                    break;
-
-                case 't':
-                    c = '\t';
-                    l = 2;
-                    break;
-
-                case '\\':
-                    c = '\\';
-                    l = 2;
-                    break;
-
-                case 'u':
-                    c = static_cast<char>((hexval((*s)[i + 4]) << 4) | hexval((*s)[i + 5]));
-                    l = 6;
-                    break;
-
-                default:
-                    c = (*s)[i + 1];
-                    l = 2;
-            }
+            d[out++] = d[i++];
+            continue;
+        }
+
+        char c;
+        size_t l = 2;
 
-            s->replace(i, l, &c, 1);
+        switch (d[i + 1])
+        {
+            case 'n':
+                c = '\n';
+                break;
+
+            case 'r':
+                c = '\r';
+                break;
+
+            case 'b':
+                c = '\b';
+                break;
+
+            case 'f':
+                c = '\f';
+                break;
+
+            case 't':
+                c = '\t';
+                break;
+
+            case '\\':
+                c = '\\';
+                break;
+
+            case 'u':
+                c = static_cast<char>((hexval(i + 4 < n ? d[i + 4] : 0) << 4) | hexval(i + 5 < n ? d[i + 5] : 0));
+                l = 6;
+                break;
+
+            default:
+                c = d[i + 1];
         }
+
+        d[out++] = c;
+        i = std::min(i + l, n);
     }
+
+    d.resize(out);
 }
 
 bool JSON::extractstringvalue(const string &json, const string &name, string *value)
@@ -765,11 +1017,7 @@ void JSONWriter::arg(const char* name, const char* value, int quotes)
 
 void JSONWriter::arg(const char* name, handle h, int len)
 {
-    char buf[16];
-
-    Base64::btoa((const byte*)&h, len, buf);
-
-    arg(name, buf);
+    arg(name, (const byte*)&h, len);
 }
 
 void JSONWriter::arg(const char* name, NodeHandle h)
@@ -780,13 +1028,12 @@ void JSONWriter::arg(const char* name, NodeHandle h)
 
 void JSONWriter::arg(const char* name, const byte* value, int len)
 {
-    char* buf = new char[len * 4 / 3 + 4];
-
-    Base64::btoa(value, len, buf);
-
-    arg(name, buf);
-
-    delete[] buf;
+    addcomma();
+    mJson.append("\"");
+    mJson.append(name);
+    mJson.append("\":\"");
+    appendB64(value, len);
+    mJson.append("\"");
 }
 
 void JSONWriter::arg_B64(const char* n, const string& data)
@@ -892,26 +1139,13 @@ void JSONWriter::element(int n)
 
 void JSONWriter::element(handle h, int len)
 {
-    char buf[16];
-
-    Base64::btoa((const byte*)&h, len, buf);
-
-    mJson.append(elements() ? ",\"" : "\"");
-    mJson.append(buf);
-    mJson.append("\"");
+    element((const byte*)&h, len);
 }
 
 void JSONWriter::element(const byte* data, int len)
 {
-    char* buf = new char[len * 4 / 3 + 4];
-
-    len = Base64::btoa(data, len, buf);
-
     mJson.append(elements() ? ",\"" : "\"");
-    mJson.append(buf, len);
-
-    delete[] buf;
-
+    appendB64(data, len);
     mJson.append("\"");
 }
 
@@ -957,6 +1191,14 @@ size_t JSONWriter::size() const
     return mJson.size();
 }
 
+void JSONWriter::appendB64(const byte* data, int len)
+{
+    // encoded in place: room for the characters and the NUL btoa() terminates them with
+    size_t pos = mJson.size();
+    mJson.resize(pos + size_t(len * 4 + 2) / 3 + 1);
+    mJson.resize(pos + size_t(Base64::btoa(data, len, &mJson[pos])));
+}
+
 int JSONWriter::elements()
 {
     assert(mLevel >= 0);
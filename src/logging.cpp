@@ -28,7 +28,9 @@
 
 #include "mega/logging.h"
 
+#include <cstdint>
 #include <ctime>
+#include <unordered_map>
 
 #if defined(WINDOWS_PHONE)
 #include <stdint.h>
@@ -117,4 +119,293 @@ void SimpleLogger::setAllOutputs(std::ostream *os)
 }
 #endif
 
+// single producer (the logging thread), single consumer (the AsyncLogger thread)
+struct AsyncLogger::Ring
+{
+    struct Header
+    {
+        uint32_t size;          // whole record, header included
+        int32_t level;
+        uint32_t timeLength;    // UINT32_MAX for a null time
+        uint32_t sourceLength;  // UINT32_MAX for a null source
+    };
+
+    std::unique_ptr<char[]> data;
+    size_t mask;
+    std::atomic<uint64_t> head{0};  // written by the producer
+    std::atomic<uint64_t> tail{0};  // written by the consumer
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> orphaned{false};
+
+    explicit Ring(size_t size)
+        : data(new char[size])
+        , mask(size - 1)
+    {
+        CodeCounter::accountMemory(CodeCounter::MEM_LOG_BUFFERS, int64_t(size));
+    }
+
+    ~Ring()
+    {
+        CodeCounter::accountMemory(CodeCounter::MEM_LOG_BUFFERS, -int64_t(mask + 1));
+    }
+
+    void write(uint64_t pos, const char* src, size_t len)
+    {
+        size_t offset = size_t(pos & mask);
+        size_t first = std::min(len, mask + 1 - offset);
+        memcpy(data.get() + offset, src, first);
+        memcpy(data.get(), src + first, len - first);
+    }
+
+    void read(uint64_t pos, char* dst, size_t len) const
+    {
+        size_t offset = size_t(pos & mask);
+        size_t first = std::min(len, mask + 1 - offset);
+        memcpy(dst, data.get() + offset, first);
+        memcpy(dst + first, data.get(), len - first);
+    }
+};
+
+namespace {
+std::atomic<unsigned> asyncLoggerIds{0};
+
+// the rings of the current thread, per AsyncLogger
+struct ThreadRings
+{
+    std::unordered_map<unsigned, std::shared_ptr<void>> rings;
+    std::vector<std::atomic<bool>*> orphans;
+
+    ~ThreadRings()
+    {
+        // let the consumers release them once drained
+        for (auto orphan : orphans)
+        {
+            *orphan = true;
+        }
+    }
+};
+thread_local ThreadRings threadRings;
+}
+
+AsyncLogger::AsyncLogger(Logger& target, size_t ringSize)
+    : mTarget(target)
+    , mRingSize(1024)
+    , mId(++asyncLoggerIds)
+{
+    while (mRingSize < ringSize)
+    {
+        mRingSize <<= 1;
+    }
+
+    mThread = std::thread([this]()
+    {
+        ThreadRoles::enter(ThreadRoles::LOGGER, "mega-log");
+        loop();
+    });
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        mStop = true;
+    }
+    mWakeup.notify_one();
+    mThread.join();
+}
+
+AsyncLogger::Ring& AsyncLogger::ring()
+{
+    auto it = threadRings.rings.find(mId);
+    if (it != threadRings.rings.end())
+    {
+        return *static_cast<Ring*>(it->second.get());
+    }
+
+    auto r = std::make_shared<Ring>(mRingSize);
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        mRings.push_back(r);
+    }
+    threadRings.rings[mId] = r;
+    threadRings.orphans.push_back(&r->orphaned);
+    return *r;
+}
+
+void AsyncLogger::log(const char *time, int loglevel, const char *source, const char *message
+#ifdef ENABLE_LOG_PERFORMANCE
+                      , const char **directMessages, size_t *directMessagesSizes, unsigned numberMessages
+#endif
+                      )
+{
+    size_t timeLength = time ? strlen(time) : 0;
+    size_t sourceLength = source ? strlen(source) : 0;
+    size_t messageLength = message ? strlen(message) : 0;
+    size_t size = sizeof(Ring::Header) + timeLength + sourceLength + messageLength;
+#ifdef ENABLE_LOG_PERFORMANCE
+    for (unsigned i = 0; i < numberMessages; i++)
+    {
+        size += directMessagesSizes[i];
+    }
+#endif
+
+    if (size > mRingSize)
+    {
+        mTarget.log(time, loglevel, source, message
+#ifdef ENABLE_LOG_PERFORMANCE
+                    , directMessages, directMessagesSizes, numberMessages
+#endif
+                    );
+        return;
+    }
+
+    Ring& r = ring();
+    uint64_t head = r.head.load(std::memory_order_relaxed);
+    uint64_t used = head - r.tail.load(std::memory_order_acquire);
+    if (size > mRingSize - used)
+    {
+        ++r.dropped;
+        ++mDropped;
+        return;
+    }
+
+    Ring::Header header;
+    header.size = uint32_t(size);
+    header.level = loglevel;
+    header.timeLength = time ? uint32_t(timeLength) : UINT32_MAX;
+    header.sourceLength = source ? uint32_t(sourceLength) : UINT32_MAX;
+
+    uint64_t pos = head;
+    r.write(pos, reinterpret_cast<const char*>(&header), sizeof header);
+    pos += sizeof header;
+    r.write(pos, time, timeLength);
+    pos += timeLength;
+    r.write(pos, source, sourceLength);
+    pos += sourceLength;
+    r.write(pos, message, messageLength);
+    pos += messageLength;
+#ifdef ENABLE_LOG_PERFORMANCE
+    for (unsigned i = 0; i < numberMessages; i++)
+    {
+        r.write(pos, directMessages[i], directMessagesSizes[i]);
+        pos += directMessagesSizes[i];
+    }
+#endif
+    r.head.store(pos, std::memory_order_release);
+
+    // the consumer polls anyway, only hurry it up when the ring fills
+    if (used + size > mRingSize / 2)
+    {
+        mWakeup.notify_one();
+    }
+}
+
+void AsyncLogger::flush()
+{
+    std::unique_lock<std::mutex> g(mMutex);
+    uint64_t request = ++mFlushRequests;
+    mWakeup.notify_one();
+    mFlushed.wait(g, [this, request]() { return mFlushesDone >= request || mStop; });
+}
+
+uint64_t AsyncLogger::droppedMessages() const
+{
+    return mDropped;
+}
+
+void AsyncLogger::drain(Ring& r)
+{
+    uint64_t tail = r.tail.load(std::memory_order_relaxed);
+    uint64_t head = r.head.load(std::memory_order_acquire);
+    std::string record;
+
+    while (tail != head)
+    {
+        // the drop count is taken before the records: anything dropped after them is reported next time
+        if (uint64_t dropped = r.dropped.exchange(0))
+        {
+            std::string warning = std::to_string(dropped) + " log messages dropped: logging thread ring buffer full";
+            mTarget.log(nullptr, logWarning, nullptr, warning.c_str());
+        }
+
+        Ring::Header header;
+        r.read(tail, reinterpret_cast<char*>(&header), sizeof header);
+        record.resize(header.size - sizeof header);
+        r.read(tail + sizeof header, &record[0], record.size());
+        tail += header.size;
+        r.tail.store(tail, std::memory_order_release);
+
+        // formatted here, off the logging thread
+        size_t timeLength = header.timeLength == UINT32_MAX ? 0 : header.timeLength;
+        size_t sourceLength = header.sourceLength == UINT32_MAX ? 0 : header.sourceLength;
+        std::string time = record.substr(0, timeLength);
+        std::string source = record.substr(timeLength, sourceLength);
+        std::string message = record.substr(timeLength + sourceLength);
+
+        mTarget.log(header.timeLength == UINT32_MAX ? nullptr : time.c_str(), header.level,
+                    header.sourceLength == UINT32_MAX ? nullptr : source.c_str(), message.c_str());
+
+        if (tail == head)
+        {
+            head = r.head.load(std::memory_order_acquire);
+        }
+    }
+
+    if (uint64_t dropped = r.dropped.exchange(0))
+    {
+        std::string warning = std::to_string(dropped) + " log messages dropped: logging thread ring buffer full";
+        mTarget.log(nullptr, logWarning, nullptr, warning.c_str());
+    }
+}
+
+void AsyncLogger::loop()
+{
+    for (;;)
+    {
+        std::vector<std::shared_ptr<Ring>> rings;
+        uint64_t flushRequest;
+        bool stop;
+        {
+            std::unique_lock<std::mutex> g(mMutex);
+            if (!mStop && mFlushRequests == mFlushesDone)
+            {
+                mWakeup.wait_for(g, std::chrono::milliseconds(20));
+            }
+            rings = mRings;
+            flushRequest = mFlushRequests;
+            stop = mStop;
+        }
+
+        for (auto& r : rings)
+        {
+            drain(*r);
+        }
+
+        {
+            std::lock_guard<std::mutex> g(mMutex);
+
+            // rings of finished threads can go once drained (they can't receive anything else)
+            for (auto it = mRings.begin(); it != mRings.end(); )
+            {
+                if ((*it)->orphaned && (*it)->head == (*it)->tail)
+                {
+                    it = mRings.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+
+            mFlushesDone = flushRequest;
+        }
+        mFlushed.notify_all();
+
+        if (stop)
+        {
+            break;
+        }
+    }
+}
+
 } // namespace
@@ -203,6 +203,9 @@ void MediaFileInfo::onCodecMappingsReceipt(MegaClient* client, int codecListVers
         client->json.leavearray();
         mediaCodecsReceived = true;
 
+        // the codecs tell some videos apart from their extension: index the types again when needed
+        client->mNodeTypes.clear();
+
         // update any download transfers we already processed
         for (size_t i = queuedForDownloadTranslation.size(); i--; )
         {
@@ -216,8 +219,15 @@ void MediaFileInfo::onCodecMappingsReceipt(MegaClient* client, int codecListVers
     for (std::map<UploadHandle, queuedvp>::iterator i = uploadFileAttributes.begin(); i != uploadFileAttributes.end(); )
     {
         UploadHandle th = i->second.handle.uploadHandle();
+        bool extracting = bool(i->second.extraction);
         ++i;   // the call below may remove this item from the map
 
+        if (extracting)
+        {
+            // checkUploadExtractions() releases it once its properties are ready
+            continue;
+        }
+
         // indicate that file attribute 8 can be retrieved now, allowing the transfer to complete
         client->pendingfa[pair<UploadHandle, fatype>(th, fatype(fa_media))] = pair<handle, int>(0, 0);
         client->checkfacompletion(th);
@@ -226,7 +236,68 @@ void MediaFileInfo::onCodecMappingsReceipt(MegaClient* client, int codecListVers
     client->app->mediadetection_ready();
 }
 
-unsigned MediaFileInfo::queueMediaPropertiesFileAttributesForUpload(MediaProperties& vp, uint32_t fakey[4], MegaClient* client, UploadHandle uploadHandle)
+void MediaFileInfo::startUploadExtraction(MegaClient* client, UploadHandle uploadHandle, const LocalPath& localpath, m_off_t size)
+{
+    string ext;
+    if (size < 16 || mediaCodecsFailed
+            || !client->fsaccess->getextension(localpath, ext)
+            || !MediaProperties::isMediaFilenameExt(ext))
+    {
+        return;
+    }
+
+    // the codec id mappings are fetched while the file is analysed and uploaded
+    requestCodecMappingsOneTime(client, NULL);
+
+    auto extraction = std::make_shared<Extraction>();
+    uploadExtractions[uploadHandle] = extraction;
+
+    FileSystemAccess* fsaccess = client->fsaccess;
+    LocalPath path = localpath;
+    client->mAsyncQueue.push([extraction, fsaccess, path](SymmCipher&) mutable
+    {
+        extraction->vp.extractMediaPropertyFileAttributes(path, fsaccess);
+        extraction->done = true;
+    }, false, MegaClientAsyncQueue::PRIORITY_BACKGROUND);
+}
+
+std::shared_ptr<MediaFileInfo::Extraction> MediaFileInfo::takeUploadExtraction(UploadHandle uploadHandle)
+{
+    std::shared_ptr<Extraction> extraction;
+    auto it = uploadExtractions.find(uploadHandle);
+    if (it != uploadExtractions.end())
+    {
+        extraction = std::move(it->second);
+        uploadExtractions.erase(it);
+    }
+    return extraction;
+}
+
+void MediaFileInfo::checkUploadExtractions(MegaClient* client)
+{
+    for (auto it = uploadFileAttributes.begin(); it != uploadFileAttributes.end(); )
+    {
+        queuedvp& q = it->second;
+        ++it;   // checkfacompletion() may remove the item from the map
+
+        if (q.extraction && q.extraction->done)
+        {
+            q.vp = q.extraction->vp;
+            q.extraction.reset();
+            LOG_debug << "Media attribute extracted for upload";
+
+            // (without mappings, the attribute is dropped from putnodes and the upload completes anyway)
+            if (mediaCodecsReceived || mediaCodecsFailed)
+            {
+                UploadHandle th = q.handle.uploadHandle();
+                client->pendingfa[pair<UploadHandle, fatype>(th, fatype(fa_media))] = pair<handle, int>(0, 0);
+                client->checkfacompletion(th);
+            }
+        }
+    }
+}
+
+unsigned MediaFileInfo::queueMediaPropertiesFileAttributesForUpload(MediaProperties& vp, uint32_t fakey[4], MegaClient* client, UploadHandle uploadHandle, std::shared_ptr<Extraction> extraction)
 {
     if (mediaCodecsFailed)
     {
@@ -237,10 +308,12 @@ unsigned MediaFileInfo::queueMediaPropertiesFileAttributesForUpload(MediaPropert
     q.handle = NodeOrUploadHandle(uploadHandle);
     q.vp = vp;
     memcpy(q.fakey, fakey, sizeof(q.fakey));
+    q.extraction = std::move(extraction);
+    bool extracting = bool(q.extraction);
     uploadFileAttributes[uploadHandle] = q;
     LOG_debug << "Media attribute enqueued for upload";
 
-    if (mediaCodecsReceived)
+    if (mediaCodecsReceived && !extracting)
     {
         // indicate we have this attribute ready to go. Otherwise the transfer will be put on hold till we can
         client->pendingfa[pair<UploadHandle, fatype>(uploadHandle, fatype(fa_media))] = pair<handle, int>(0, 0);
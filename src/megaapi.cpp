@@ -238,6 +238,35 @@ int MegaTransferList::size()
     return 0;
 }
 
+MegaTransferBatch::MegaTransferBatch() { }
+
+MegaTransferBatch::~MegaTransferBatch() { }
+
+MegaTransferBatch *MegaTransferBatch::createInstance()
+{
+    return new MegaTransferBatchPrivate();
+}
+
+MegaTransferBatch *MegaTransferBatch::copy() const
+{
+    return NULL;
+}
+
+void MegaTransferBatch::addUpload(const char *, MegaNode *, const char *, int64_t, const char *, bool, bool)
+{
+
+}
+
+void MegaTransferBatch::addDownload(MegaNode *, const char *, const char *, bool)
+{
+
+}
+
+int MegaTransferBatch::size() const
+{
+    return 0;
+}
+
 MegaContactRequestList::~MegaContactRequestList() { }
 
 MegaContactRequestList *MegaContactRequestList::copy()
@@ -1061,6 +1090,11 @@ MegaHandleList* MegaRequest::getMegaHandleList() const
     return nullptr;
 }
 
+unsigned long long MegaRequest::getTraceId() const
+{
+    return 0;
+}
+
 MegaTransfer::~MegaTransfer() { }
 
 MegaTransfer *MegaTransfer::copy()
@@ -1268,6 +1302,21 @@ bool MegaTransfer::getTargetOverride() const
     return false;
 }
 
+unsigned long long MegaTransfer::getTraceId() const
+{
+    return 0;
+}
+
+int64_t MegaTransfer::getStageTime(int) const
+{
+    return 0;
+}
+
+char* MegaTransfer::getTraceSpans() const
+{
+    return NULL;
+}
+
 MegaError::MegaError(int e)
 {
     errorCode = e;
@@ -1562,6 +1611,51 @@ MegaError *SynchronousRequestListener::getError() const
     return megaError;
 }
 
+MegaRequestContinuation::MegaRequestContinuation(Function function, Executor executor)
+    : mFunction(std::move(function))
+    , mExecutor(std::move(executor))
+{
+}
+
+MegaRequestListener* MegaRequestContinuation::then(Function function, Executor executor)
+{
+    return new MegaRequestContinuation(std::move(function), std::move(executor));
+}
+
+MegaRequestListener* MegaRequestContinuation::future(std::future<MegaRequestOutcome>& result)
+{
+    auto promise = std::make_shared<std::promise<MegaRequestOutcome>>();
+    result = promise->get_future();
+
+    return then([promise](MegaApi*, MegaRequest* request, MegaError* error)
+    {
+        MegaRequestOutcome outcome;
+        outcome.request.reset(request->copy());
+        outcome.error.reset(error->copy());
+        promise->set_value(std::move(outcome));
+    });
+}
+
+void MegaRequestContinuation::onRequestFinish(MegaApi* api, MegaRequest* request, MegaError* error)
+{
+    // the SDK doesn't use the listener after this
+    std::unique_ptr<MegaRequestContinuation> self(this);
+
+    if (!mExecutor)
+    {
+        mFunction(api, request, error);
+        return;
+    }
+
+    // the objects of the SDK are gone once this returns
+    std::shared_ptr<MegaRequest> requestCopy(request->copy());
+    std::shared_ptr<MegaError> errorCopy(error->copy());
+    Function function = std::move(mFunction);
+    mExecutor([function, api, requestCopy, errorCopy]()
+    {
+        function(api, requestCopy.get(), errorCopy.get());
+    });
+}
 
 //Transfer callbacks
 void MegaTransferListener::onTransferStart(MegaApi *, MegaTransfer *)
@@ -1570,8 +1664,17 @@ void MegaTransferListener::onTransferFinish(MegaApi*, MegaTransfer *, MegaError*
 { }
 void MegaTransferListener::onTransferUpdate(MegaApi *, MegaTransfer *)
 { }
+void MegaTransferListener::onTransfersUpdate(MegaApi *api, MegaTransferList *transfers)
+{
+    for (int i = 0; i < transfers->size(); i++)
+    {
+        onTransferUpdate(api, transfers->get(i));
+    }
+}
 bool MegaTransferListener::onTransferData(MegaApi *, MegaTransfer *, char *, size_t)
 { return true; }
+bool MegaTransferListener::onTransferBuffer(MegaApi *api, MegaTransfer *transfer, char *data, size_t length)
+{ return onTransferData(api, transfer, data, length); }
 void MegaTransferListener::onTransferTemporaryError(MegaApi *, MegaTransfer *, MegaError*)
 { }
 MegaTransferListener::~MegaTransferListener()
@@ -1670,6 +1773,13 @@ void MegaListener::onTransferFinish(MegaApi *, MegaTransfer *, MegaError *)
 { }
 void MegaListener::onTransferUpdate(MegaApi *, MegaTransfer *)
 { }
+void MegaListener::onTransfersUpdate(MegaApi *api, MegaTransferList *transfers)
+{
+    for (int i = 0; i < transfers->size(); i++)
+    {
+        onTransferUpdate(api, transfers->get(i));
+    }
+}
 void MegaListener::onTransferTemporaryError(MegaApi *, MegaTransfer *, MegaError *)
 { }
 void MegaListener::onUsersUpdate(MegaApi *, MegaUserList *)
@@ -1757,6 +1867,11 @@ MegaApi::~MegaApi()
     delete pImpl;
 }
 
+void MegaApi::setSharedWorkerThreads(unsigned threadCount)
+{
+    MegaApiImpl::setSharedWorkerThreads(threadCount);
+}
+
 int MegaApi::isLoggedIn()
 {
     return pImpl->isLoggedIn();
@@ -1901,6 +2016,16 @@ void MegaApi::setLogLevel(int logLevel)
     MegaApiImpl::setLogLevel(logLevel);
 }
 
+void MegaApi::setThreadSettings(int role, int priority, long long cpuMask)
+{
+    MegaApiImpl::setThreadSettings(role, priority, cpuMask);
+}
+
+void MegaApi::setPoolAllocator(void* (*allocate)(size_t), void (*release)(void*, size_t))
+{
+    MegaApiImpl::setPoolAllocator(allocate, release);
+}
+
 void MegaApi::setMaxPayloadLogSize(long long maxSize)
 {
     MegaApiImpl::setMaxPayloadLogSize(maxSize);
@@ -1911,6 +2036,31 @@ void MegaApi::setLogToConsole(bool enable)
     MegaApiImpl::setLogToConsole(enable);
 }
 
+void MegaApi::setLogAsynchronous(bool enable)
+{
+    MegaApiImpl::setLogAsynchronous(enable);
+}
+
+bool MegaApi::startTracing(const char* path, int subsystems)
+{
+    return MegaApiImpl::startTracing(path, subsystems);
+}
+
+void MegaApi::setTracedSubsystems(int subsystems)
+{
+    MegaApiImpl::setTracedSubsystems(subsystems);
+}
+
+void MegaApi::setTraceSampling(int subsystems, int oneIn)
+{
+    MegaApiImpl::setTraceSampling(subsystems, oneIn);
+}
+
+void MegaApi::stopTracing()
+{
+    MegaApiImpl::stopTracing();
+}
+
 void MegaApi::addLoggerObject(MegaLogger *megaLogger)
 {
     MegaApiImpl::addLoggerClass(megaLogger);
@@ -2640,6 +2790,16 @@ void MegaApi::fetchNodes(MegaRequestListener *listener)
     pImpl->fetchNodes(listener);
 }
 
+bool MegaApi::setLargeAccountMode(bool enable)
+{
+    return pImpl->setLargeAccountMode(enable);
+}
+
+bool MegaApi::isLargeAccountMode()
+{
+    return pImpl->isLargeAccountMode();
+}
+
 void MegaApi::getCloudStorageUsed(MegaRequestListener *listener)
 {
     pImpl->getCloudStorageUsed(listener);
@@ -3054,6 +3214,66 @@ int MegaApi::getMaxUploadSpeed()
     return pImpl->getMaxUploadSpeed();
 }
 
+void MegaApi::setAdaptiveConnections(bool enable)
+{
+    pImpl->setAdaptiveConnections(enable);
+}
+
+void MegaApi::setMaxTransferMemory(long long bytes)
+{
+    pImpl->setMaxTransferMemory(bytes);
+}
+
+void MegaApi::setTransferMemoryBudget(long long bytes)
+{
+    pImpl->setTransferMemoryBudget(bytes);
+}
+
+bool MegaApi::setHttp2(bool enable)
+{
+    return pImpl->setHttp2(enable);
+}
+
+void MegaApi::setMaxApiRequestsInFlight(unsigned count)
+{
+    pImpl->setMaxApiRequestsInFlight(count);
+}
+
+void MegaApi::setFingerprintThreads(unsigned threads, unsigned readsPerDevice)
+{
+    pImpl->setFingerprintThreads(threads, readsPerDevice);
+}
+
+void MegaApi::setUploadChunkIndexMinSize(long long minSize)
+{
+    pImpl->setUploadChunkIndexMinSize(minSize);
+}
+
+void MegaApi::setLinkBrowserMode(bool enable)
+{
+    pImpl->setLinkBrowserMode(enable);
+}
+
+char* MegaApi::getLatencyHistogram(int endpoint)
+{
+    return pImpl->getLatencyHistogram(endpoint);
+}
+
+char* MegaApi::getPerformanceMetrics()
+{
+    return pImpl->getPerformanceMetrics();
+}
+
+char* MegaApi::getStartupProfile()
+{
+    return pImpl->getStartupProfile();
+}
+
+long long MegaApi::trimMemory(int level)
+{
+    return pImpl->trimMemory(level);
+}
+
 bool MegaApi::setMaxDownloadSpeed(long long bpslimit)
 {
     return pImpl->setMaxDownloadSpeed(bpslimit);
@@ -3064,6 +3284,16 @@ bool MegaApi::setMaxUploadSpeed(long long bpslimit)
     return pImpl->setMaxUploadSpeed(bpslimit);
 }
 
+bool MegaApi::addBandwidthPolicy(int bandwidthClass, int weight, long long maxDownloadSpeed, long long maxUploadSpeed, int fromMinute, int toMinute)
+{
+    return pImpl->addBandwidthPolicy(bandwidthClass, weight, maxDownloadSpeed, maxUploadSpeed, fromMinute, toMinute);
+}
+
+void MegaApi::clearBandwidthPolicies()
+{
+    pImpl->clearBandwidthPolicies();
+}
+
 int MegaApi::getCurrentDownloadSpeed()
 {
     return pImpl->getCurrentDownloadSpeed();
@@ -3129,6 +3359,11 @@ MegaTransferList *MegaApi::getTransfers(int type)
     return pImpl->getTransfers(type);
 }
 
+MegaTransferColumns *MegaApi::getTransferColumns(int type, long long since, int offset, int limit)
+{
+    return pImpl->getTransferColumns(type, since, offset, limit);
+}
+
 MegaTransferList *MegaApi::getChildTransfers(int transferTag)
 {
     return pImpl->getChildTransfers(transferTag);
@@ -3239,6 +3474,11 @@ void MegaApi::startDownloadWithTopPriority(MegaNode *node, const char *localPath
     pImpl->startDownload(true, node, localPath, 0, appData, listener);
 }
 
+void MegaApi::startTransfers(MegaTransferBatch *transfers, MegaTransferListener *listener)
+{
+    pImpl->startTransfers(transfers, listener);
+}
+
 void MegaApi::cancelTransfer(MegaTransfer *t, MegaRequestListener *listener)
 {
     pImpl->cancelTransfer(t, listener);
@@ -3319,6 +3559,31 @@ void MegaApi::setStreamingMinimumRate(int bytesPerSecond)
     pImpl->setStreamingMinimumRate(bytesPerSecond);
 }
 
+void MegaApi::setStreamingCache(long long memoryBytes, long long readAheadBytes, const char *spillFolder, long long spillBytes)
+{
+    pImpl->setStreamingCache(memoryBytes, readAheadBytes, spillFolder, spillBytes);
+}
+
+MegaReadStream* MegaApi::createReadStream(MegaNode* node, long long bufferSize)
+{
+    return pImpl->createReadStream(node, bufferSize);
+}
+
+void MegaApi::setTransferUpdateBatching(int milliseconds)
+{
+    pImpl->setTransferUpdateBatching(milliseconds);
+}
+
+void MegaApi::setNodeUpdateBatching(int milliseconds)
+{
+    pImpl->setNodeUpdateBatching(milliseconds);
+}
+
+void MegaApi::setAsyncCallbacks(bool enable, int queueSize, int backpressure)
+{
+    pImpl->setAsyncCallbacks(enable, queueSize, backpressure);
+}
+
 #ifdef ENABLE_SYNC
 
 //Move local files inside synced folders to the "Rubbish" folder.
@@ -3477,6 +3742,11 @@ MegaSync *MegaApi::getSyncByBackupId(MegaHandle backupId)
     return pImpl->getSyncByBackupId(backupId);
 }
 
+MegaSyncStats *MegaApi::getSyncStats(MegaHandle backupId)
+{
+    return pImpl->getSyncStats(backupId);
+}
+
 MegaSync *MegaApi::getSyncByNode(MegaNode *node)
 {
     return pImpl->getSyncByNode(node);
@@ -3531,6 +3801,16 @@ void MegaApi::setExclusionUpperSizeLimit(long long limit)
 {
     pImpl->setExclusionUpperSizeLimit(limit);
 }
+
+void MegaApi::setSyncScanThreads(unsigned threads)
+{
+    pImpl->setSyncScanThreads(threads);
+}
+
+void MegaApi::setSyncResumeScan(bool enable)
+{
+    pImpl->setSyncResumeScan(enable);
+}
 #endif
 
 
@@ -3654,6 +3934,11 @@ MegaUserAlertList* MegaApi::getUserAlerts()
     return pImpl->getUserAlerts();
 }
 
+MegaUserAlertList* MegaApi::getUserAlerts(int offset, int limit)
+{
+    return pImpl->getUserAlerts(offset, limit);
+}
+
 int MegaApi::getNumUnreadUserAlerts()
 {
     return pImpl->getNumUnreadUserAlerts();
@@ -4179,11 +4464,26 @@ MegaNodeList *MegaApi::getChildren(MegaNode* p, int order)
     return pImpl->getChildren(p, order);
 }
 
+MegaNodeList *MegaApi::getChildren(MegaNode* p, int order, int offset, int limit)
+{
+    return pImpl->getChildren(p, order, offset, limit);
+}
+
 MegaNodeList *MegaApi::getChildren(MegaNodeList *parentNodes, int order)
 {
     return pImpl->getChildren(parentNodes, order);
 }
 
+MegaNodeCursor *MegaApi::getChildrenCursor(MegaNode *parent, int order)
+{
+    return pImpl->getChildrenCursor(parent, order);
+}
+
+MegaNodeColumns *MegaApi::getChildrenColumns(MegaNode *parent, int order)
+{
+    return pImpl->getChildrenColumns(parent, order);
+}
+
 MegaNodeList *MegaApi::getVersions(MegaNode *node)
 {
     return pImpl->getVersions(node);
@@ -4431,6 +4731,16 @@ bool MegaApi::httpServerIsSubtitlesSupportEnabled()
     return pImpl->httpServerIsSubtitlesSupportEnabled();
 }
 
+void MegaApi::httpServerEnableMetrics(bool enable)
+{
+    pImpl->httpServerEnableMetrics(enable);
+}
+
+bool MegaApi::httpServerIsMetricsEnabled()
+{
+    return pImpl->httpServerIsMetricsEnabled();
+}
+
 void MegaApi::httpServerAddListener(MegaTransferListener *listener)
 {
     pImpl->httpServerAddListener(listener);
@@ -4491,6 +4801,16 @@ int MegaApi::httpServerGetMaxOutputSize()
     return pImpl->httpServerGetMaxOutputSize();
 }
 
+void MegaApi::httpServerSetNumThreads(int numThreads)
+{
+    pImpl->httpServerSetNumThreads(numThreads);
+}
+
+int MegaApi::httpServerGetNumThreads()
+{
+    return pImpl->httpServerGetNumThreads();
+}
+
 //FTP Server:
 bool MegaApi::ftpServerStart(bool localOnly, int port, int dataportBegin, int dataPortEnd, bool useTLS, const char * certificatepath, const char * keypath)
 {
@@ -5956,6 +6276,74 @@ void MegaSyncList::addSync(MegaSync *sync)
 
 }
 
+MegaSyncStats::MegaSyncStats()
+{
+}
+
+MegaSyncStats::~MegaSyncStats()
+{
+}
+
+MegaSyncStats *MegaSyncStats::copy() const
+{
+    return NULL;
+}
+
+MegaHandle MegaSyncStats::getBackupId() const
+{
+    return INVALID_HANDLE;
+}
+
+long long MegaSyncStats::getQueuedNotifications() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getRetryNotifications() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getLastFullReconcile() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getScannedFiles() const
+{
+    return 0;
+}
+
+double MegaSyncStats::getScannedFilesPerSecond() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getPendingUploadBytes() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getPendingPutnodes() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getLatencySamples() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getLatencyP50() const
+{
+    return 0;
+}
+
+long long MegaSyncStats::getLatencyP99() const
+{
+    return 0;
+}
+
 #endif
 
 
@@ -6263,6 +6651,31 @@ MegaInputStream::~MegaInputStream()
 
 }
 
+MegaReadStream::MegaReadStream()
+{
+
+}
+
+long long MegaReadStream::read(long long, char*, size_t, int)
+{
+    return MegaError::API_EINTERNAL;
+}
+
+void MegaReadStream::prefetch(long long, long long)
+{
+
+}
+
+long long MegaReadStream::getSize()
+{
+    return 0;
+}
+
+MegaReadStream::~MegaReadStream()
+{
+
+}
+
 MegaApiLock::MegaApiLock(MegaApiImpl* ptr, bool lock) : api(ptr)
 {
     if (lock)
@@ -6544,6 +6957,71 @@ long long MegaTransferData::getNotificationNumber() const
     return 0;
 }
 
+MegaTransferColumns::~MegaTransferColumns()
+{
+
+}
+
+int MegaTransferColumns::size() const
+{
+    return 0;
+}
+
+const int *MegaTransferColumns::getTags() const
+{
+    return NULL;
+}
+
+const int *MegaTransferColumns::getTypes() const
+{
+    return NULL;
+}
+
+const int *MegaTransferColumns::getStates() const
+{
+    return NULL;
+}
+
+const long long *MegaTransferColumns::getTransferredBytes() const
+{
+    return NULL;
+}
+
+const long long *MegaTransferColumns::getTotalBytes() const
+{
+    return NULL;
+}
+
+const long long *MegaTransferColumns::getSpeeds() const
+{
+    return NULL;
+}
+
+const unsigned long long *MegaTransferColumns::getPriorities() const
+{
+    return NULL;
+}
+
+int MegaTransferColumns::getNumFinished() const
+{
+    return 0;
+}
+
+const int *MegaTransferColumns::getFinishedTags() const
+{
+    return NULL;
+}
+
+bool MegaTransferColumns::isComplete() const
+{
+    return true;
+}
+
+long long MegaTransferColumns::getVersion() const
+{
+    return 0;
+}
+
 MegaEvent::~MegaEvent() { }
 MegaEvent *MegaEvent::copy()
 {
@@ -6630,6 +7108,76 @@ MegaNodeList *MegaChildrenLists::getFolderList()
     return NULL;
 }
 
+MegaNodeCursor::~MegaNodeCursor()
+{
+
+}
+
+int MegaNodeCursor::size() const
+{
+    return 0;
+}
+
+MegaHandle MegaNodeCursor::getHandle(int) const
+{
+    return INVALID_HANDLE;
+}
+
+MegaNode *MegaNodeCursor::get(int)
+{
+    return NULL;
+}
+
+MegaNodeList *MegaNodeCursor::getPage(int, int)
+{
+    return NULL;
+}
+
+MegaNodeColumns::~MegaNodeColumns()
+{
+
+}
+
+int MegaNodeColumns::size() const
+{
+    return 0;
+}
+
+const MegaHandle *MegaNodeColumns::getHandles() const
+{
+    return NULL;
+}
+
+const long long *MegaNodeColumns::getSizes() const
+{
+    return NULL;
+}
+
+const long long *MegaNodeColumns::getModificationTimes() const
+{
+    return NULL;
+}
+
+const int *MegaNodeColumns::getTypes() const
+{
+    return NULL;
+}
+
+const int *MegaNodeColumns::getFlags() const
+{
+    return NULL;
+}
+
+MegaStringList *MegaNodeColumns::getNames() const
+{
+    return NULL;
+}
+
+const char *MegaNodeColumns::getName(int) const
+{
+    return NULL;
+}
+
 MegaAchievementsDetails::~MegaAchievementsDetails()
 {
 
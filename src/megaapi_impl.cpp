@@ -307,7 +307,12 @@ MegaNodePrivate::MegaNodePrivate(Node *node)
                                 byte data[SymmCipher::BLOCKSIZE] = { 0 };
                                 Base64::atob(coords.data(), data, Base64Str<SymmCipher::BLOCKSIZE>::STRLEN);
 
-                                node->client->setkey(&c, node->client->unshareablekey.data());
+                                {
+                                    // nodes are also copied by getters holding sdkMutex only shared, and the master key cipher isn't reentrant
+                                    static std::mutex masterKeyMutex;
+                                    std::lock_guard<std::mutex> g(masterKeyMutex);
+                                    node->client->setkey(&c, node->client->unshareablekey.data());
+                                }
                                 c.ctr_crypt(data, SymmCipher::BLOCKSIZE, 0, 0, NULL, false);
                                 ok = !memcmp(data, "unshare/", 8);
                                 if (ok)
@@ -955,6 +960,11 @@ int MegaNodePrivate::getChanges()
     return changed;
 }
 
+void MegaNodePrivate::addChanges(int changes)
+{
+    changed |= changes;
+}
+
 MegaHandle MegaNodePrivate::getOwner() const
 {
     return owner;
@@ -1117,11 +1127,9 @@ char *MegaBackgroundMediaUploadPrivate::encryptFile(const char* inputFilepath, i
                 {
                     SymmCipher cipher;
                     cipher.setkey(filekey);
-                    uint64_t ctriv = MemAccess::get<uint64_t>((const char*)filekey + SymmCipher::KEYLENGTH);
 
-                    EncryptFilePieceByChunks ef(fain.get(), startPos, faout.get(), 0, &cipher, &chunkmacs, ctriv);
                     string urlSuffix;
-                    if (ef.encrypt(startPos, endPos, urlSuffix))
+                    if (encryptPieces(fain.get(), faout.get(), localfilename, localencryptedfilename, startPos, endPos, urlSuffix))
                     {
                         ((int64_t*)filekey)[3] = chunkmacs.macsmac(&cipher);
                         return MegaApi::strdup(urlSuffix.c_str());
@@ -1133,6 +1141,118 @@ char *MegaBackgroundMediaUploadPrivate::encryptFile(const char* inputFilepath, i
     return nullptr;
 }
 
+bool MegaBackgroundMediaUploadPrivate::encryptPieces(FileAccess* fain, FileAccess* faout, LocalPath& inputPath, LocalPath& outputPath,
+                                                     m_off_t startPos, m_off_t endPos, string& urlSuffix)
+{
+    // pieces that start and end at chunk boundaries, so each can be encrypted apart
+    vector<std::pair<m_off_t, m_off_t>> pieces;
+    for (m_off_t pos = startPos; pos < endPos; )
+    {
+        m_off_t npos = ChunkedHash::chunkfloor(pos + ENCRYPT_PIECE);
+        if (npos <= pos || npos > endPos)
+        {
+            npos = endPos;
+        }
+        pieces.emplace_back(pos, npos);
+        pos = npos;
+    }
+
+    unsigned lanes = std::max(1u, std::min({ENCRYPT_LANES, std::thread::hardware_concurrency(), unsigned(pieces.size())}));
+
+    // the first lane takes the files already open
+    vector<std::pair<unique_ptr<FileAccess>, unique_ptr<FileAccess>>> files(lanes);
+    for (unsigned i = 1; i < files.size(); i++)
+    {
+        files[i].first = api->fsAccess->newfileaccess();
+        files[i].second = api->fsAccess->newfileaccess();
+        if (!files[i].first->fopen(inputPath, true, false) || !files[i].second->fopen(outputPath, false, true))
+        {
+            LOG_warn << "Encrypting with " << i << " threads only";
+            files.resize(i);
+            break;
+        }
+    }
+    lanes = unsigned(files.size());
+
+    const byte* key = filekey;
+    uint64_t ctriv = MemAccess::get<uint64_t>((const char*)filekey + SymmCipher::KEYLENGTH);
+    vector<chunkmac_map> laneMacs(lanes);
+    vector<std::array<byte, EncryptByChunks::CRCSIZE>> laneCrcs(lanes);
+    std::atomic<bool> failed(false);
+
+    std::mutex m;
+    std::condition_variable cv;
+    unsigned remaining = lanes;
+
+    for (unsigned lane = 0; lane < lanes; lane++)
+    {
+        FileAccess* in = lane ? files[lane].first.get() : fain;
+        FileAccess* out = lane ? files[lane].second.get() : faout;
+
+        api->client->mAsyncQueue.push([&, lane, in, out](SymmCipher& sc)
+        {
+            sc.setkey(key);
+            laneCrcs[lane].fill(0);
+
+            for (size_t i = lane; i < pieces.size() && !failed; i += lanes)
+            {
+                m_off_t pos = pieces[i].first;
+                m_off_t npos = pieces[i].second;
+
+                EncryptFilePieceByChunks ef(in, pos, out, pos - startPos, &sc, &laneMacs[lane], ctriv);
+                string pieceSuffix;
+                if (!ef.encrypt(pos, npos, pieceSuffix))
+                {
+                    failed = true;
+                    break;
+                }
+
+                // a byte at p is in the CRC at (p - pos) % CRCSIZE, and in that of the whole range at (p - startPos) % CRCSIZE
+                unsigned shift = unsigned((pos - startPos) % EncryptByChunks::CRCSIZE);
+                for (unsigned j = 0; j < EncryptByChunks::CRCSIZE; j++)
+                {
+                    laneCrcs[lane][(j + shift) % EncryptByChunks::CRCSIZE] ^= ef.getcrc()[j];
+                }
+            }
+
+            std::lock_guard<std::mutex> g(m);
+            if (!--remaining)
+            {
+                cv.notify_one();
+            }
+        }, false, MegaClientAsyncQueue::PRIORITY_INTERACTIVE);
+    }
+
+    {
+        std::unique_lock<std::mutex> g(m);
+        cv.wait(g, [&remaining]() { return !remaining; });
+    }
+
+    if (failed)
+    {
+        LOG_err << "Error encrypting file: " << startPos << " - " << endPos;
+        return false;
+    }
+
+    byte crc[EncryptByChunks::CRCSIZE] = {};
+    for (unsigned lane = 0; lane < lanes; lane++)
+    {
+        for (auto& mac : laneMacs[lane])
+        {
+            chunkmacs[mac.first] = mac.second;
+        }
+        for (unsigned j = 0; j < EncryptByChunks::CRCSIZE; j++)
+        {
+            crc[j] ^= laneCrcs[lane][j];
+        }
+    }
+
+    ostringstream suffix;
+    suffix << "/" << startPos << "?d=" << Base64Str<EncryptByChunks::CRCSIZE>(crc);
+    urlSuffix = suffix.str();
+    return true;
+}
+
 char *MegaBackgroundMediaUploadPrivate::getUploadURL()
 {
     return url.empty() ? nullptr : MegaApi::strdup(url.c_str());
@@ -1392,6 +1512,19 @@ MegaSync *MegaApiImpl::getSyncByBackupId(mega::MegaHandle backupId)
     return ret.release();
 }
 
+MegaSyncStats *MegaApiImpl::getSyncStats(mega::MegaHandle backupId)
+{
+    SdkMutexGuard g(sdkMutex);
+
+    Sync* sync = client->syncs.runningSyncByBackupId(backupId);
+    if (!sync)
+    {
+        return nullptr;
+    }
+
+    return new MegaSyncStatsPrivate(backupId, sync->stats());
+}
+
 MegaSync *MegaApiImpl::getSyncByNode(MegaNode *node)
 {
     if (!node)
@@ -2378,6 +2511,7 @@ MegaTransferPrivate::MegaTransferPrivate(const MegaTransferPrivate *transfer)
     this->setFolderTransferTag(transfer->getFolderTransferTag());
     this->setAppData(transfer->getAppData());
     this->setNotificationNumber(transfer->getNotificationNumber());
+    this->setTrace(transfer->mTraceId, transfer->mStages);
 }
 
 MegaTransfer* MegaTransferPrivate::copy()
@@ -2614,6 +2748,36 @@ bool MegaTransferPrivate::getTargetOverride() const
     return mTargetOverride;
 }
 
+void MegaTransferPrivate::setTrace(TraceId traceId, const TraceStages& stages)
+{
+    if (!mTraceId)
+    {
+        mTraceId = traceId;
+    }
+    mStages.merge(stages);
+    mStages.times[STAGE_LAST_BYTE] = std::max(mStages.times[STAGE_LAST_BYTE], stages.times[STAGE_LAST_BYTE]);
+}
+
+void MegaTransferPrivate::markStage(TraceStage stage)
+{
+    mStages.mark(stage);
+}
+
+unsigned long long MegaTransferPrivate::getTraceId() const
+{
+    return mTraceId;
+}
+
+int64_t MegaTransferPrivate::getStageTime(int stage) const
+{
+    return stage >= 0 && stage < STAGE_COUNT ? mStages.times[size_t(stage)] : 0;
+}
+
+char* MegaTransferPrivate::getTraceSpans() const
+{
+    return MegaApi::strdup(mStages.toOtlpJson(mTraceId, getTransferString()).c_str());
+}
+
 bool MegaTransferPrivate::serialize(string *d)
 {
     d->append((const char*)&type, sizeof(type));
@@ -3366,6 +3530,12 @@ MegaRequestPrivate::MegaRequestPrivate(MegaRequestPrivate *request)
     this->backgroundMediaUpload = NULL;
     this->mBannerList.reset(request->mBannerList ? request->mBannerList->copy() : nullptr);
     this->mHandleList.reset(request->mHandleList ? request->mHandleList->copy() : nullptr);
+    this->mTraceId = request->mTraceId;
+}
+
+unsigned long long MegaRequestPrivate::getTraceId() const
+{
+    return mTraceId;
 }
 
 AccountDetails *MegaRequestPrivate::getAccountDetails() const
@@ -4384,6 +4554,16 @@ MegaNodeListPrivate::MegaNodeListPrivate(Node** newlist, int size)
         list[i] = MegaNodePrivate::fromNode(newlist[i]);
 }
 
+MegaNodeListPrivate::MegaNodeListPrivate(vector<MegaNode*>&& nodes)
+{
+    list = NULL; s = static_cast<int>(nodes.size());
+    if (!s) return;
+
+    list = new MegaNode*[s];
+    std::copy(nodes.begin(), nodes.end(), list);
+    nodes.clear();
+}
+
 MegaNodeListPrivate::MegaNodeListPrivate(const MegaNodeListPrivate *nodeList, bool copyChildren)
 {
     s = nodeList->size();
@@ -4780,6 +4960,49 @@ MegaTransferListPrivate::MegaTransferListPrivate(MegaTransfer** newlist, int siz
         list[i] = newlist[i]->copy();
 }
 
+MegaTransferBatch *MegaTransferBatchPrivate::copy() const
+{
+    return new MegaTransferBatchPrivate(*this);
+}
+
+void MegaTransferBatchPrivate::addUpload(const char *localPath, MegaNode *parent, const char *fileName, int64_t mtime, const char *appData, bool isSourceTemporary, bool startFirst)
+{
+    Entry e;
+    e.type = MegaTransfer::TYPE_UPLOAD;
+    e.hasLocalPath = localPath != nullptr;
+    e.localPath = localPath ? localPath : "";
+    e.parentHandle = parent ? parent->getHandle() : INVALID_HANDLE;
+    e.hasFileName = fileName != nullptr;
+    e.fileName = fileName ? fileName : "";
+    e.mtime = mtime;
+    e.hasAppData = appData != nullptr;
+    e.appData = appData ? appData : "";
+    e.isSourceTemporary = isSourceTemporary;
+    e.startFirst = startFirst;
+    mEntries.push_back(std::move(e));
+}
+
+void MegaTransferBatchPrivate::addDownload(MegaNode *node, const char *localPath, const char *appData, bool startFirst)
+{
+    Entry e;
+    e.type = MegaTransfer::TYPE_DOWNLOAD;
+    e.hasLocalPath = localPath != nullptr;
+    e.localPath = localPath ? localPath : "";
+    if (node)
+    {
+        e.node.reset(node->copy());
+    }
+    e.hasAppData = appData != nullptr;
+    e.appData = appData ? appData : "";
+    e.startFirst = startFirst;
+    mEntries.push_back(std::move(e));
+}
+
+int MegaTransferBatchPrivate::size() const
+{
+    return int(mEntries.size());
+}
+
 MegaTransferListPrivate::~MegaTransferListPrivate()
 {
     if(!list)
@@ -5239,6 +5462,8 @@ TreeProcessor::~TreeProcessor()
 //Entry point for the blocking thread
 void *MegaApiImpl::threadEntryPoint(void *param)
 {
+    ThreadRoles::enter(ThreadRoles::SDK, "mega-sdk");
+
 #ifndef _WIN32
     struct sigaction noaction;
     memset(&noaction, 0, sizeof(noaction));
@@ -5262,6 +5487,10 @@ MegaTransferPrivate *MegaApiImpl::getMegaTransferPrivate(int tag)
 }
 
 ExternalLogger MegaApiImpl::externalLogger;
+std::unique_ptr<AsyncLogger> MegaApiImpl::asyncLogger;
+std::mutex MegaApiImpl::asyncLoggerMutex;
+std::shared_ptr<MegaClientAsyncQueue::WorkerPool> MegaApiImpl::sharedWorkerPool;
+std::mutex MegaApiImpl::sharedWorkerPoolMutex;
 
 MegaApiImpl::MegaApiImpl(MegaApi *api, const char *appKey, MegaGfxProcessor* processor, const char *basePath, const char *userAgent, unsigned workerThreadCount)
 {
@@ -5280,6 +5509,7 @@ MegaApiImpl::MegaApiImpl(MegaApi *api, const char *appKey, const char *basePath,
 
 void MegaApiImpl::init(MegaApi *api, const char *appKey, MegaGfxProcessor* processor, const char *basePath, const char *userAgent, int fseventsfd, unsigned clientWorkerThreadCount)
 {
+    auto initStart = std::chrono::high_resolution_clock::now();
     this->api = api;
 
     maxRetries = 7;
@@ -5307,11 +5537,13 @@ void MegaApiImpl::init(MegaApi *api, const char *appKey, MegaGfxProcessor* proce
     httpServer = NULL;
     httpServerMaxBufferSize = 0;
     httpServerMaxOutputSize = 0;
+    httpServerNumThreads = 0;
     httpServerEnableFiles = true;
     httpServerEnableFolders = false;
     httpServerOfflineAttributeEnabled = false;
     httpServerRestrictedMode = MegaApi::TCP_SERVER_ALLOW_CREATED_LOCAL_LINKS;
     httpServerSubtitlesSupportEnabled = false;
+    httpServerMetricsEnabled = false;
 
     ftpServer = NULL;
     ftpServerMaxBufferSize = 0;
@@ -5337,8 +5569,13 @@ void MegaApiImpl::init(MegaApi *api, const char *appKey, MegaGfxProcessor* proce
     {
         dbAccess = new MegaDbAccess(LocalPath::fromPath(basePath, *fsAccess));
         this->basePath = basePath;
+
+        LocalPath faCachePath = LocalPath::fromPath(basePath, *fsAccess);
+        faCachePath.appendWithSeparator(LocalPath::fromPath("fileattrs", *fsAccess), true);
+        fileAttributeDiskCache.reset(new FileAttributeDiskCache(*fsAccess, faCachePath, MAX_FILE_ATTRIBUTE_DISK_CACHE_SIZE));
     }
 
+    auto gfxStart = std::chrono::high_resolution_clock::now();
     gfxAccess = NULL;
     if(processor)
     {
@@ -5352,6 +5589,7 @@ void MegaApiImpl::init(MegaApi *api, const char *appKey, MegaGfxProcessor* proce
         gfxAccess = new MegaGfxProc();
         gfxAccess->startProcessingThread();
     }
+    auto gfxEnd = std::chrono::high_resolution_clock::now();
 
     if(!userAgent)
     {
@@ -5363,7 +5601,16 @@ void MegaApiImpl::init(MegaApi *api, const char *appKey, MegaGfxProcessor* proce
     {
         this->appKey = appKey;
     }
-    client = new MegaClient(this, waiter, httpio, fsAccess, dbAccess, gfxAccess, appKey, userAgent, clientWorkerThreadCount);
+    auto clientStart = std::chrono::high_resolution_clock::now();
+    std::shared_ptr<MegaClientAsyncQueue::WorkerPool> workerPool;
+    {
+        std::lock_guard<std::mutex> g(sharedWorkerPoolMutex);
+        workerPool = sharedWorkerPool;
+    }
+    client = new MegaClient(this, waiter, httpio, fsAccess, dbAccess, gfxAccess, appKey, userAgent, clientWorkerThreadCount, workerPool);
+    client->startupProfile.setOrigin(initStart);
+    client->startupProfile.record(CodeCounter::StartupProfile::PHASE_GFX_INIT, gfxStart, gfxEnd);
+    client->startupProfile.record(CodeCounter::StartupProfile::PHASE_CLIENT_INIT, clientStart, std::chrono::high_resolution_clock::now());
 
 #if defined(_WIN32) && !defined(WINDOWS_PHONE)
     httpio->unlock();
@@ -5372,6 +5619,8 @@ void MegaApiImpl::init(MegaApi *api, const char *appKey, MegaGfxProcessor* proce
     //Start blocking thread
     threadExit = 0;
     thread.start(threadEntryPoint, this);
+
+    client->startupProfile.record(CodeCounter::StartupProfile::PHASE_API_INIT, initStart, std::chrono::high_resolution_clock::now());
 }
 
 MegaApiImpl::~MegaApiImpl()
@@ -5650,6 +5899,14 @@ char *MegaApiImpl::getMyRSAPrivateKey()
     return MegaApi::strdup(client->mPrivKey.c_str());
 }
 
+void MegaApiImpl::setSharedWorkerThreads(unsigned threadCount)
+{
+    auto pool = threadCount ? MegaClientAsyncQueue::newWorkerPool(threadCount) : nullptr;
+
+    std::lock_guard<std::mutex> g(sharedWorkerPoolMutex);
+    sharedWorkerPool = std::move(pool);
+}
+
 void MegaApiImpl::setLogLevel(int logLevel)
 {
     externalLogger.setLogLevel(logLevel);
@@ -5675,6 +5932,75 @@ void MegaApiImpl::setLogToConsole(bool enable)
     externalLogger.setLogToConsole(enable);
 }
 
+void MegaApiImpl::setThreadSettings(int role, int priority, long long cpuMask)
+{
+    if (role < 0 || role >= ThreadRoles::ROLE_COUNT)
+    {
+        LOG_err << "Invalid thread role: " << role;
+        return;
+    }
+
+    ThreadRoles::configure(ThreadRoles::Role(role), priority, uint64_t(cpuMask));
+}
+
+void MegaApiImpl::setPoolAllocator(void* (*allocate)(size_t), void (*release)(void*, size_t))
+{
+    if (!allocate != !release)
+    {
+        LOG_err << "Both allocation functions are needed";
+        return;
+    }
+
+    FixedSizeAllocator::setSlabFunctions(allocate, release);
+}
+
+void MegaApiImpl::setLogAsynchronous(bool enable)
+{
+    std::lock_guard<std::mutex> g(asyncLoggerMutex);
+    if (enable)
+    {
+        if (!asyncLogger)
+        {
+            asyncLogger.reset(new AsyncLogger(externalLogger));
+        }
+        SimpleLogger::setOutputClass(asyncLogger.get());
+    }
+    else
+    {
+        SimpleLogger::setOutputClass(&externalLogger);
+        if (asyncLogger)
+        {
+            asyncLogger->flush();
+        }
+    }
+}
+
+bool MegaApiImpl::startTracing(const char* path, int subsystems)
+{
+    return path && Trace::start(path, uint32_t(subsystems));
+}
+
+void MegaApiImpl::setTracedSubsystems(int subsystems)
+{
+    Trace::setSubsystems(uint32_t(subsystems));
+}
+
+void MegaApiImpl::setTraceSampling(int subsystems, int oneIn)
+{
+    for (int i = 0; i < TRACE_NUM_SUBSYSTEMS; i++)
+    {
+        if (subsystems & (1 << i))
+        {
+            Trace::setSampling(TraceSubsystem(i), unsigned(std::max(1, oneIn)));
+        }
+    }
+}
+
+void MegaApiImpl::stopTracing()
+{
+    Trace::stop();
+}
+
 void MegaApiImpl::log(int logLevel, const char *message, const char *filename, int line)
 {
     externalLogger.postLog(logLevel, message, filename, line);
@@ -6461,10 +6787,39 @@ void MegaApiImpl::loop()
     httpio->lock();
 #endif
 
+    sdkMutex.lock();
+    sdkThreadId = std::this_thread::get_id();
+    sdkMutex.unlock();
+
     while(true)
     {
         sdkMutex.lock();
         int r = client->preparewait();
+        if (!r)
+        {
+            // wake up in time for the batched notifications
+            dstime nds = NEVER;
+            if (!pendingTransferUpdates.empty())
+            {
+                nds = pendingTransferUpdatesDs;
+            }
+            if (!pendingNodeUpdates.empty() && pendingNodeUpdatesDs < nds)
+            {
+                nds = pendingNodeUpdatesDs;
+            }
+
+            if (EVER(nds))
+            {
+                if (nds <= Waiter::ds)
+                {
+                    r = Waiter::NEEDEXEC;
+                }
+                else if (nds - Waiter::ds < client->waiter->maxds)
+                {
+                    client->waiter->maxds = nds - Waiter::ds;
+                }
+            }
+        }
         sdkMutex.unlock();
         if (!r)
         {
@@ -6491,10 +6846,23 @@ void MegaApiImpl::loop()
 
             sdkMutex.lock();
             client->exec();
+            continueFolderDownloads();
+            flushBatchedUpdates();
             sdkMutex.unlock();
         }
     }
 
+    // nothing else is going to wait for the folders being created
+    sdkMutex.lock();
+    localFolderCreator.reset();
+    sdkMutex.unlock();
+
+    // deliver the asynchronous callbacks still queued while the client is still there
+    sdkMutex.lock();
+    shared_ptr<MegaCallbackDispatcher> dispatcher = std::move(callbackDispatcher);
+    sdkMutex.unlock();
+    dispatcher.reset();
+
     sdkMutex.lock();
     delete client;
     client = nullptr;
@@ -6502,6 +6870,28 @@ void MegaApiImpl::loop()
 }
 
 
+LocalFolderCreator& MegaApiImpl::getLocalFolderCreator()
+{
+    if (!localFolderCreator)
+    {
+        localFolderCreator.reset(new LocalFolderCreator(*waiter, FOLDER_CREATION_THREADS));
+    }
+    return *localFolderCreator;
+}
+
+void MegaApiImpl::continueFolderDownloads()
+{
+    // a download may finish (and be deleted) on the way, and take others with it from the callbacks
+    vector<MegaFolderDownloadController*> downloads(plannedFolderDownloads.begin(), plannedFolderDownloads.end());
+    for (MegaFolderDownloadController* download : downloads)
+    {
+        if (plannedFolderDownloads.count(download))
+        {
+            download->continuePlan();
+        }
+    }
+}
+
 void MegaApiImpl::createFolder(const char *name, MegaNode *parent, MegaRequestListener *listener)
 {
     MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_CREATE_FOLDER, listener);
@@ -7051,6 +7441,18 @@ void MegaApiImpl::disableExport(MegaNode *node, MegaRequestListener *listener)
     waiter->notify();
 }
 
+bool MegaApiImpl::setLargeAccountMode(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->setLargeAccountMode(enable);
+}
+
+bool MegaApiImpl::isLargeAccountMode()
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->largeAccountMode();
+}
+
 void MegaApiImpl::fetchNodes(MegaRequestListener *listener)
 {
     MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_FETCH_NODES, listener);
@@ -7396,9 +7798,10 @@ bool MegaApiImpl::usingHttpsOnly()
     return client->usehttps;
 }
 
-void MegaApiImpl::getNodeAttribute(MegaNode *node, int type, const char *dstFilePath, MegaRequestListener *listener)
+void MegaApiImpl::getNodeAttribute(MegaNode *node, int type, const char *dstFilePath, MegaRequestListener *listener, bool inMemory)
 {
     MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_GET_ATTR_FILE, listener);
+    request->setFlag(inMemory);
     if(dstFilePath)
     {
         string path(dstFilePath);
@@ -7438,6 +7841,11 @@ void MegaApiImpl::getNodeAttribute(MegaNode *node, int type, const char *dstFile
     waiter->notify();
 }
 
+bool MegaApiImpl::getCachedNodeAttribute(MegaHandle h, int type, string& data)
+{
+    return fileAttributeCache.get(h, type, data);
+}
+
 void MegaApiImpl::cancelGetNodeAttribute(MegaNode *node, int type, MegaRequestListener *listener)
 {
     MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_CANCEL_ATTR_FILE, listener);
@@ -7753,6 +8161,12 @@ void MegaApiImpl::abortPendingActions(error preverror)
 
     }
 
+    // -- Batched notifications --
+    // the changes of the nodes of the account that is gone aren't notified
+    pendingTransferUpdates.clear();
+    pendingNodeUpdates.clear();
+    pendingNodeUpdatesIndex.clear();
+
     resetTotalDownloads();
     resetTotalUploads();
 }
@@ -8045,6 +8459,139 @@ int MegaApiImpl::getMaxUploadSpeed()
     return int(client->getmaxuploadspeed());
 }
 
+void MegaApiImpl::setAdaptiveConnections(bool enable)
+{
+    sdkMutex.lock();
+    client->mAdaptiveConnections = enable;
+    sdkMutex.unlock();
+}
+
+void MegaApiImpl::setMaxTransferMemory(m_off_t bytes)
+{
+    sdkMutex.lock();
+    client->mMaxTransferMemory = bytes > 0 ? bytes : 0;
+    sdkMutex.unlock();
+}
+
+void MegaApiImpl::setTransferMemoryBudget(m_off_t bytes)
+{
+    sdkMutex.lock();
+    client->mTransferBufferPool.setLimit(bytes);
+    sdkMutex.unlock();
+}
+
+bool MegaApiImpl::setHttp2(bool enable)
+{
+    sdkMutex.lock();
+    bool result = httpio->sethttp2(enable);
+    sdkMutex.unlock();
+    return result;
+}
+
+void MegaApiImpl::setMaxApiRequestsInFlight(unsigned count)
+{
+    sdkMutex.lock();
+    client->setmaxcsinflight(count);
+    sdkMutex.unlock();
+}
+
+void MegaApiImpl::setFingerprintThreads(unsigned threads, unsigned readsPerDevice)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->setfingerprintthreads(threads, readsPerDevice);
+}
+
+bool MegaApiImpl::addBandwidthPolicy(int bandwidthClass, int weight, long long maxDownloadSpeed, long long maxUploadSpeed, int fromMinute, int toMinute)
+{
+    static_assert(int(MegaApi::BANDWIDTH_CLASS_STREAMING) == int(BWCLASS_STREAMING) && int(MegaApi::BANDWIDTH_CLASS_BACKUP) == int(BWCLASS_BACKUP),
+                  "the bandwidth classes of MegaApi are those of the SDK");
+
+    if (bandwidthClass < 0 || bandwidthClass >= BWCLASS_COUNT || weight < 1
+            || fromMinute < 0 || fromMinute >= 24 * 60 || toMinute < 1 || toMinute > 24 * 60)
+    {
+        return false;
+    }
+
+    BandwidthScheduler::Policy policy;
+    policy.weight = unsigned(weight);
+    policy.fromMinute = fromMinute;
+    policy.toMinute = toMinute;
+
+    SdkMutexGuard g(sdkMutex);
+    policy.maxbps = maxDownloadSpeed > 0 ? maxDownloadSpeed : 0;
+    client->httpio->bandwidth[GET].addpolicy(bwclass_t(bandwidthClass), policy);
+    policy.maxbps = maxUploadSpeed > 0 ? maxUploadSpeed : 0;
+    client->httpio->bandwidth[PUT].addpolicy(bwclass_t(bandwidthClass), policy);
+    return true;
+}
+
+void MegaApiImpl::clearBandwidthPolicies()
+{
+    SdkMutexGuard g(sdkMutex);
+    client->httpio->bandwidth[GET].clearpolicies();
+    client->httpio->bandwidth[PUT].clearpolicies();
+}
+
+void MegaApiImpl::setUploadChunkIndexMinSize(long long minSize)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->setchunkindexminsize(minSize > 0 ? minSize : 0);
+}
+
+void MegaApiImpl::setLinkBrowserMode(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->mLinkBrowser = enable;
+}
+
+char* MegaApiImpl::getLatencyHistogram(int endpoint)
+{
+    static_assert(int(MegaApi::LATENCY_API_CS) == int(MegaClient::LATENCY_CS) && int(MegaApi::LATENCY_API_SC) == int(MegaClient::LATENCY_SC)
+                  && int(MegaApi::LATENCY_STORAGE_GET) == int(MegaClient::LATENCY_GET) && int(MegaApi::LATENCY_STORAGE_PUT) == int(MegaClient::LATENCY_PUT),
+                  "MegaApi and MegaClient latency endpoints differ");
+
+    if (endpoint < 0 || endpoint >= MegaClient::LATENCY_ENDPOINTS)
+    {
+        return NULL;
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    return MegaApi::strdup(client->mLatency[endpoint].toJson().c_str());
+}
+
+char* MegaApiImpl::getPerformanceMetrics()
+{
+    // everything it reads is atomic, so it doesn't wait behind the SDK thread
+    return MegaApi::strdup(client->performanceStats.toJson(*client).c_str());
+}
+
+char* MegaApiImpl::getStartupProfile()
+{
+    return MegaApi::strdup(client->startupProfile.toJson().c_str());
+}
+
+string MegaApiImpl::getPrometheusMetrics()
+{
+    return client->performanceStats.toPrometheus(*client);
+}
+
+long long MegaApiImpl::trimMemory(int level)
+{
+    static_assert(int(MegaApi::TRIM_MEMORY_MODERATE) == int(MegaClient::TRIM_MODERATE) && int(MegaApi::TRIM_MEMORY_CRITICAL) == int(MegaClient::TRIM_CRITICAL),
+                  "MegaApi and MegaClient trim levels differ");
+
+    if (level < MegaApi::TRIM_MEMORY_MODERATE)
+    {
+        return 0;
+    }
+
+    size_t fileAttributes = fileAttributeCache.trim(level >= MegaApi::TRIM_MEMORY_CRITICAL ? 0 : fileAttributeCache.size() / 2);
+    LOG_info << "Memory trimmed (level " << level << "): file attributes " << fileAttributes << " bytes";
+
+    SdkMutexGuard g(sdkMutex);
+    return static_cast<long long>(fileAttributes + client->trimmemory(level));
+}
+
 int MegaApiImpl::getCurrentDownloadSpeed()
 {
     return int(httpio->downloadSpeed);
@@ -8255,6 +8802,62 @@ MegaTransferList *MegaApiImpl::getTransfers(int type)
     return result;
 }
 
+MegaTransferColumns *MegaApiImpl::getTransferColumns(int type, long long since, int offset, int limit)
+{
+    MegaTransferColumnsPrivate *result = new MegaTransferColumnsPrivate();
+    if (type != MegaTransfer::TYPE_DOWNLOAD && type != MegaTransfer::TYPE_UPLOAD)
+    {
+        return result;
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    result->mVersion = notificationNumber;
+
+    int skipped = 0;
+    auto end = client->transferlist.end((direction_t)type);
+    for (auto it = client->transferlist.begin((direction_t)type); it != end; it++)
+    {
+        Transfer *t = (*it);
+        for (File* f : t->files)
+        {
+            MegaTransferPrivate* transfer = getMegaTransferPrivate(f->tag);
+            if (!transfer || transfer->getNotificationNumber() <= since)
+            {
+                continue;
+            }
+
+            if (skipped < offset)
+            {
+                skipped++;
+            }
+            else if (limit <= 0 || result->size() < limit)
+            {
+                result->add(transfer);
+            }
+        }
+    }
+
+    if (since > 0)
+    {
+        result->mComplete = since >= forgottenFinishedTransfers;
+
+        // the newest last: the first one after the version is found from the end
+        auto first = finishedTransfers.end();
+        while (first != finishedTransfers.begin() && std::prev(first)->notificationNumber > since)
+        {
+            --first;
+        }
+        for (auto it = first; it != finishedTransfers.end(); ++it)
+        {
+            if (it->type == type)
+            {
+                result->mFinishedTags.push_back(it->tag);
+            }
+        }
+    }
+    return result;
+}
+
 MegaTransferList *MegaApiImpl::getChildTransfers(int transferTag)
 {
     sdkMutex.lock();
@@ -8418,6 +9021,13 @@ void MegaApiImpl::startUpload(bool startFirst, const char *localPath, MegaNode *
         fsType = fsAccess->getlocalfstype(LocalPath::fromPath(localPath, *fsAccess));
     }
 
+    MegaTransferPrivate* transfer = createUploadTransfer(startFirst, localPath, parent ? parent->getHandle() : INVALID_HANDLE, fileName, targetUser, mtime, folderTransferTag, isBackup, appData, isSourceFileTemporary, forceNewUpload, fsType, listener);
+    transferQueue.push(transfer);
+    waiter->notify();
+}
+
+MegaTransferPrivate* MegaApiImpl::createUploadTransfer(bool startFirst, const char *localPath, MegaHandle parentHandle, const char *fileName, const char *targetUser, int64_t mtime, int folderTransferTag, bool isBackup, const char *appData, bool isSourceFileTemporary, bool forceNewUpload, FileSystemType fsType, MegaTransferListener *listener)
+{
     MegaTransferPrivate* transfer = new MegaTransferPrivate(MegaTransfer::TYPE_UPLOAD, listener);
     if(localPath)
     {
@@ -8429,9 +9039,9 @@ void MegaApiImpl::startUpload(bool startFirst, const char *localPath, MegaNode *
         transfer->setPath(path.data());
     }
 
-    if(parent)
+    if (parentHandle != INVALID_HANDLE)
     {
-        transfer->setParentHandle(parent->getHandle());
+        transfer->setParentHandle(parentHandle);
     }
 
     if (targetUser)
@@ -8464,9 +9074,7 @@ void MegaApiImpl::startUpload(bool startFirst, const char *localPath, MegaNode *
     }
 
     transfer->setForceNewUpload(forceNewUpload);
-
-    transferQueue.push(transfer);
-    waiter->notify();
+    return transfer;
 }
 
 void MegaApiImpl::startUpload(bool startFirst, const char *localPath, MegaNode *parent, const char *fileName, int64_t mtime, int folderTransferTag, bool isBackup, const char *appData, bool isSourceFileTemporary, bool forceNewUpload, FileSystemType fsType, MegaTransferListener *listener)
@@ -8487,6 +9095,12 @@ void MegaApiImpl::startUploadForSupport(const char *localPath, bool isSourceTemp
 }
 
 void MegaApiImpl::startDownload(bool startFirst, MegaNode *node, const char* localPath, int folderTransferTag, const char *appData, MegaTransferListener *listener)
+{
+    transferQueue.push(createDownloadTransfer(startFirst, node, localPath, folderTransferTag, appData, listener));
+    waiter->notify();
+}
+
+MegaTransferPrivate* MegaApiImpl::createDownloadTransfer(bool startFirst, MegaNode *node, const char* localPath, int folderTransferTag, const char *appData, MegaTransferListener *listener)
 {
     MegaTransferPrivate* transfer = new MegaTransferPrivate(MegaTransfer::TYPE_DOWNLOAD, listener);
 
@@ -8527,14 +9141,56 @@ void MegaApiImpl::startDownload(bool startFirst, MegaNode *node, const char* loc
     {
         transfer->setFolderTransferTag(folderTransferTag);
     }
-
-    transferQueue.push(transfer);
-    waiter->notify();
+    return transfer;
 }
 
 void MegaApiImpl::startDownload(MegaNode *node, const char* localFolder, MegaTransferListener *listener)
 { startDownload(false, node, localFolder, 0, NULL, listener); }
 
+void MegaApiImpl::startTransfers(MegaTransferBatch *transfers, MegaTransferListener *listener)
+{
+    MegaTransferBatchPrivate* batch = dynamic_cast<MegaTransferBatchPrivate*>(transfers);
+    if (!batch || batch->entries().empty())
+    {
+        return;
+    }
+
+    // the files of a batch tend to be in a few folders: the filesystem type is only looked up once for each
+    string lastFolder;
+    FileSystemType fsType = FS_UNKNOWN;
+
+    vector<MegaTransferPrivate*> queued;
+    queued.reserve(batch->entries().size());
+    for (const MegaTransferBatchPrivate::Entry& e : batch->entries())
+    {
+        const char* localPath = e.hasLocalPath ? e.localPath.c_str() : nullptr;
+        const char* appData = e.hasAppData ? e.appData.c_str() : nullptr;
+
+        if (e.type == MegaTransfer::TYPE_DOWNLOAD)
+        {
+            queued.push_back(createDownloadTransfer(e.startFirst, e.node.get(), localPath, 0, appData, listener));
+            continue;
+        }
+
+        if (localPath)
+        {
+            size_t sep = e.localPath.find_last_of(FileSystemAccess::getPathSeparator());
+            string folder = sep == string::npos ? string() : e.localPath.substr(0, sep);
+            if (fsType == FS_UNKNOWN || folder != lastFolder)
+            {
+                fsType = fsAccess->getlocalfstype(LocalPath::fromPath(e.localPath, *fsAccess));
+                lastFolder = folder;
+            }
+        }
+
+        queued.push_back(createUploadTransfer(e.startFirst, localPath, e.parentHandle, e.hasFileName ? e.fileName.c_str() : nullptr,
+                                              nullptr, e.mtime, 0, false, appData, e.isSourceTemporary, false, fsType, listener));
+    }
+
+    transferQueue.push(queued);
+    waiter->notify();
+}
+
 void MegaApiImpl::cancelTransfer(MegaTransfer *t, MegaRequestListener *listener)
 {
     MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_CANCEL_TRANSFER, listener);
@@ -8584,12 +9240,223 @@ void MegaApiImpl::startStreaming(MegaNode* node, m_off_t startPos, m_off_t size,
     waiter->notify();
 }
 
+MegaReadStream* MegaApiImpl::createReadStream(MegaNode* node, long long bufferSize)
+{
+    if (!node || node->getType() != MegaNode::TYPE_FILE)
+    {
+        return nullptr;
+    }
+    return new MegaReadStreamPrivate(this, node, bufferSize > 0 ? bufferSize : MegaReadStreamPrivate::DEFAULT_BUFFER_SIZE);
+}
+
+class MegaReadStreamPrivate::Fetch : public MegaTransferListener
+{
+public:
+    Fetch(std::shared_ptr<Buffer> b, unsigned g)
+        : buffer(std::move(b)), generation(g)
+    {
+    }
+
+    bool onTransferBuffer(MegaApi*, MegaTransfer*, char *data, size_t length) override
+    {
+        std::lock_guard<std::mutex> g(buffer->mutex);
+        if (generation != buffer->generation)
+        {
+            return false;
+        }
+
+        buffer->data.append(data, length);
+
+        // what was read is dropped first; past the limit, the fetch stops until the reads catch up
+        m_off_t excess = m_off_t(buffer->data.size()) - buffer->maxSize;
+        m_off_t read = buffer->consumed - buffer->start;
+        if (excess > 0 && read > 0)
+        {
+            m_off_t drop = std::min(excess, read);
+            buffer->data.erase(0, size_t(drop));
+            buffer->start += drop;
+        }
+
+        bool more = m_off_t(buffer->data.size()) < buffer->maxSize && buffer->end() < buffer->fetchEnd;
+        if (!more)
+        {
+            buffer->fetching = false;
+        }
+        buffer->delivered.notify_all();
+        return more;
+    }
+
+    void onTransferFinish(MegaApi*, MegaTransfer*, MegaError* e) override
+    {
+        {
+            std::lock_guard<std::mutex> g(buffer->mutex);
+            if (generation == buffer->generation && buffer->fetching)
+            {
+                buffer->fetching = false;
+                int code = e ? e->getErrorCode() : API_OK;
+                buffer->error = code != API_OK ? code : API_EREAD;   // ended before the data expected
+                buffer->delivered.notify_all();
+            }
+        }
+        delete this;
+    }
+
+private:
+    std::shared_ptr<Buffer> buffer;
+    unsigned generation;
+};
+
+MegaReadStreamPrivate::MegaReadStreamPrivate(MegaApiImpl* a, MegaNode* n, m_off_t bufferSize)
+    : api(a)
+    , node(n->copy())
+    , buffer(std::make_shared<Buffer>())
+{
+    buffer->maxSize = bufferSize;
+}
+
+MegaReadStreamPrivate::~MegaReadStreamPrivate()
+{
+    // the fetch in flight stops at its next callback
+    std::lock_guard<std::mutex> g(buffer->mutex);
+    buffer->generation++;
+    buffer->fetching = false;
+}
+
+long long MegaReadStreamPrivate::getSize()
+{
+    return node->getSize();
+}
+
+void MegaReadStreamPrivate::fetch(m_off_t offset, m_off_t length)
+{
+    Buffer& b = *buffer;
+    if (offset != b.end())
+    {
+        b.start = offset;
+        b.data.clear();
+    }
+
+    length = std::min<m_off_t>(length, node->getSize() - offset);
+    b.generation++;
+    b.fetching = true;
+    b.fetchEnd = offset + length;
+    b.error = API_OK;
+
+    LOG_debug << "Read stream fetching " << length << " bytes at " << offset;
+    api->startStreaming(node.get(), offset, length, new Fetch(buffer, b.generation));
+}
+
+void MegaReadStreamPrivate::prefetch(long long offset, long long length)
+{
+    if (offset < 0 || offset >= node->getSize() || length <= 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> g(buffer->mutex);
+    bool covered = offset >= buffer->start && offset < (buffer->fetching ? buffer->fetchEnd : buffer->end());
+    if (!covered)
+    {
+        fetch(offset, std::min<m_off_t>(length, buffer->maxSize));
+    }
+}
+
+long long MegaReadStreamPrivate::read(long long offset, char *output, size_t outputSize, int timeoutMs)
+{
+    if (offset < 0 || (!output && outputSize))
+    {
+        return API_EARGS;
+    }
+
+    m_off_t size = node->getSize();
+    if (offset >= size || !outputSize)
+    {
+        return 0;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::unique_lock<std::mutex> g(buffer->mutex);
+    Buffer& b = *buffer;
+
+    for (;;)
+    {
+        if (offset >= b.start && offset < b.end())
+        {
+            m_off_t n = std::min<m_off_t>(m_off_t(outputSize), b.end() - offset);
+            memcpy(output, b.data.data() + (offset - b.start), size_t(n));
+            b.consumed = offset + n;
+
+            // sequential reads: the next fetch starts once half of what is buffered ahead was read
+            if (!b.fetching && b.end() < size && b.end() - b.consumed < b.maxSize / 2)
+            {
+                fetch(b.end(), b.maxSize - (b.end() - b.consumed));
+            }
+            return n;
+        }
+
+        if (b.error != API_OK)
+        {
+            int e = b.error;
+            b.error = API_OK;
+            return e;
+        }
+
+        // unless the fetch in flight is going to deliver it, start one from there
+        b.consumed = offset;
+        if (!(b.fetching && offset >= b.start && offset < b.fetchEnd))
+        {
+            fetch(offset, b.maxSize);
+        }
+
+        if (timeoutMs < 0)
+        {
+            b.delivered.wait(g);
+        }
+        else if (b.delivered.wait_until(g, deadline) == std::cv_status::timeout
+                 && !(offset >= b.start && offset < b.end()))
+        {
+            return API_EAGAIN;
+        }
+    }
+}
+
 void MegaApiImpl::setStreamingMinimumRate(int bytesPerSecond)
 {
     SdkMutexGuard g(sdkMutex);
     client->minstreamingrate = bytesPerSecond;
 }
 
+void MegaApiImpl::setStreamingCache(long long memoryBytes, long long readAheadBytes, const char *spillFolder, long long spillBytes)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->streamingcachesize = memoryBytes > 0 ? size_t(memoryBytes) : 0;
+    client->streamingreadahead = readAheadBytes > 0 ? readAheadBytes : 0;
+    client->streamingcachefolder = spillFolder ? LocalPath::fromPath(spillFolder, *client->fsaccess) : LocalPath();
+    client->streamingcachespillsize = spillBytes > 0 ? spillBytes : 0;
+}
+
+void MegaApiImpl::setTransferUpdateBatching(int milliseconds)
+{
+    SdkMutexGuard g(sdkMutex);
+    transferUpdateBatchDs = milliseconds > 0 ? dstime((milliseconds + 99) / 100) : 0;
+    if (!transferUpdateBatchDs)
+    {
+        flushBatchedUpdates(true);
+    }
+    waiter->notify();
+}
+
+void MegaApiImpl::setNodeUpdateBatching(int milliseconds)
+{
+    SdkMutexGuard g(sdkMutex);
+    nodeUpdateBatchDs = milliseconds > 0 ? dstime((milliseconds + 99) / 100) : 0;
+    if (!nodeUpdateBatchDs)
+    {
+        flushBatchedUpdates(true);
+    }
+    waiter->notify();
+}
+
 void MegaApiImpl::retryTransfer(MegaTransfer *transfer, MegaTransferListener *listener)
 {
     MegaTransferPrivate *t = dynamic_cast<MegaTransferPrivate*>(transfer);
@@ -9051,6 +9918,18 @@ void MegaApiImpl::setExclusionUpperSizeLimit(long long limit)
     syncUpperSizeLimit = limit;
 }
 
+void MegaApiImpl::setSyncScanThreads(unsigned threads)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->mSyncScanThreads = threads;
+}
+
+void MegaApiImpl::setSyncResumeScan(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->mSyncResumeScan = enable;
+}
+
 string MegaApiImpl::getLocalPath(MegaNode *n)
 {
     if(!n) return string();
@@ -9069,6 +9948,29 @@ string MegaApiImpl::getLocalPath(MegaNode *n)
     return result;
 }
 
+string MegaApiImpl::getSyncedLocalCopy(MegaNode *n)
+{
+    if (!n || n->getType() != MegaNode::TYPE_FILE)
+    {
+        return string();
+    }
+
+    SdkMutexGuard g(sdkMutex);
+    Node *node = client->nodebyhandle(n->getHandle());
+    if (!node || !node->localnode || !node->localnode->isvalid)
+    {
+        return string();
+    }
+
+    // only a local file with the same fingerprint holds the content of the node
+    if (!(*node->localnode == *static_cast<FileFingerprint*>(node)))
+    {
+        return string();
+    }
+
+    return node->localnode->getLocalPath().toPath(*fsAccess);
+}
+
 long long MegaApiImpl::getNumLocalNodes()
 {
     return client->totalLocalNodes;
@@ -9482,11 +10384,13 @@ bool MegaApiImpl::httpServerStart(bool localOnly, int port, bool useTLS, const c
     httpServer = new MegaHTTPServer(this, basePath, useTLS, certificatepath ? certificatepath : string(), keypath ? keypath : string(), useIPv6);
     httpServer->setMaxBufferSize(httpServerMaxBufferSize);
     httpServer->setMaxOutputSize(httpServerMaxOutputSize);
+    httpServer->setNumThreads(httpServerNumThreads);
     httpServer->enableFileServer(httpServerEnableFiles);
     httpServer->enableOfflineAttribute(httpServerOfflineAttributeEnabled);
     httpServer->enableFolderServer(httpServerEnableFolders);
     httpServer->setRestrictedMode(httpServerRestrictedMode);
     httpServer->enableSubtitlesSupport(httpServerRestrictedMode);
+    httpServer->enableMetrics(httpServerMetricsEnabled);
 
     bool result = httpServer->start(port, localOnly);
     if (!result)
@@ -9708,6 +10612,57 @@ int MegaApiImpl::httpServerGetMaxOutputSize()
     return value;
 }
 
+void MegaApiImpl::httpServerSetNumThreads(int numThreads)
+{
+    sdkMutex.lock();
+    httpServerNumThreads = numThreads <= 0 ? 0 : numThreads;
+    if (httpServer)
+    {
+        httpServer->setNumThreads(httpServerNumThreads);
+    }
+    sdkMutex.unlock();
+}
+
+int MegaApiImpl::httpServerGetNumThreads()
+{
+    int value;
+    sdkMutex.lock();
+    value = httpServerNumThreads ? httpServerNumThreads : 1;
+    sdkMutex.unlock();
+    return value;
+}
+
+int MegaApiImpl::httpServerGetWebDavEntries(MegaHandle parentHandle, const string& baseURL, bool offlineAttribute, int offset, int limit, string& entries)
+{
+    SdkReadGuard g(*this);
+
+    Node *parent;
+    const node_vector* sorted = sortedChildren(parentHandle, MegaApi::ORDER_DEFAULT_ASC, g, parent);
+    if (!sorted && (!parent || parent->type == FILENODE))
+    {
+        return -1;
+    }
+
+    node_vector childrenNodes;
+    if (!sorted)
+    {
+        childrenNodes.assign(parent->children.begin(), parent->children.end());
+        std::sort(childrenNodes.begin(), childrenNodes.end(), getComparatorFunction(MegaApi::ORDER_DEFAULT_ASC, *client));
+        sorted = &childrenNodes;
+    }
+
+    size_t begin = std::min(sorted->size(), size_t(offset));
+    size_t end = std::min(sorted->size(), begin + size_t(limit));
+    for (size_t i = begin; i < end; i++)
+    {
+        Node *n = (*sorted)[i];
+        const char *name = n->displayname();
+        MegaHTTPServer::appendWebDavPropFindEntry(entries, baseURL + name, name, n->type != FILENODE, n->size,
+                                                  n->ctime, n->mtime, n->nodehandle, offlineAttribute);
+    }
+    return int(end - begin);
+}
+
 void MegaApiImpl::httpServerEnableFileServer(bool enable)
 {
     sdkMutex.lock();
@@ -9796,6 +10751,22 @@ bool MegaApiImpl::httpServerIsSubtitlesSupportEnabled()
     return httpServerSubtitlesSupportEnabled;
 }
 
+void MegaApiImpl::httpServerEnableMetrics(bool enable)
+{
+    sdkMutex.lock();
+    httpServerMetricsEnabled = enable;
+    if (httpServer)
+    {
+        httpServer->enableMetrics(enable);
+    }
+    sdkMutex.unlock();
+}
+
+bool MegaApiImpl::httpServerIsMetricsEnabled()
+{
+    return httpServerMetricsEnabled;
+}
+
 bool MegaApiImpl::httpServerIsLocalOnly()
 {
     bool localOnly = true;
@@ -10349,11 +11320,9 @@ MegaHandleList *MegaApiImpl::getAttachmentAccess(MegaHandle chatid, MegaHandle h
         attachments_map::iterator ita = itc->second->attachedNodes.find(h);
         if (ita != itc->second->attachedNodes.end())
         {
-            set<handle> userList = ita->second;
-            set<handle>::iterator ituh;
-            for (ituh = userList.begin(); ituh != userList.end(); ituh++)
+            for (handle uh : ita->second)
             {
-                uhList->addMegaHandle(*ituh);
+                uhList->addMegaHandle(uh);
             }
         }
     }
@@ -10380,8 +11349,7 @@ bool MegaApiImpl::hasAccessToAttachment(MegaHandle chatid, MegaHandle h, MegaHan
         attachments_map::iterator ita = itc->second->attachedNodes.find(h);
         if (ita != itc->second->attachedNodes.end())
         {
-            set<handle> userList = ita->second;
-            ret = (userList.find(uh) != userList.end());
+            ret = ita->second.count(uh) != 0;
         }
     }
 
@@ -10817,6 +11785,18 @@ MegaUserAlertList* MegaApiImpl::getUserAlerts()
     return alertList;
 }
 
+MegaUserAlertList* MegaApiImpl::getUserAlerts(int offset, int limit)
+{
+    SdkMutexGuard g(sdkMutex);
+
+    UserAlerts::Alerts& alerts = client->useralerts.alerts;
+    size_t first = std::min(alerts.size(), size_t(std::max(offset, 0)));
+    size_t last = std::min(alerts.size(), first + size_t(std::max(limit, 0)));
+
+    vector<UserAlert::Base*> v(alerts.begin() + ptrdiff_t(first), alerts.begin() + ptrdiff_t(last));
+    return new MegaUserAlertListPrivate(v.data(), int(v.size()), client);
+}
+
 int MegaApiImpl::getNumUnreadUserAlerts()
 {
     int result = 0;
@@ -11252,7 +12232,7 @@ bool MegaApiImpl::processMegaTree(MegaNode* n, MegaTreeProcessor* processor, boo
 
     if (node->type != FILENODE)
     {
-        for (node_list::iterator it = node->children.begin(); it != node->children.end(); )
+        for (NodeChildren::iterator it = node->children.begin(); it != node->children.end(); )
         {
             MegaNode *megaNode = MegaNodePrivate::fromNode(*it++);
             if (recursive)
@@ -11300,7 +12280,12 @@ MegaNodeList *MegaApiImpl::search(const char *searchString, MegaCancelToken *can
         return new MegaNodeListPrivate();
     }
 
-    SdkMutexGuard g(sdkMutex);
+    SdkReadGuard g(*this);
+    if (!searchIndexBuilt(searchString, type))
+    {
+        // the first search fills the index
+        g.lockExclusive();
+    }
 
     if (cancelToken && cancelToken->isCancelled())
     {
@@ -11308,31 +12293,24 @@ MegaNodeList *MegaApiImpl::search(const char *searchString, MegaCancelToken *can
     }
 
     node_vector result;
-    Node *node;
 
-    // rootnodes
-    for (unsigned int i = 0; i < (sizeof client->rootnodes / sizeof *client->rootnodes)
-          && !(cancelToken && cancelToken->isCancelled()); i++)
+    // below the rootnodes or an inshare
+    searchNodeNames(searchString, type, cancelToken, [this](Node* n)
     {
-        node = client->nodebyhandle(client->rootnodes[i]);
-        SearchTreeProcessor searchProcessor(client, searchString, type);
-        processTree(node, &searchProcessor, true, cancelToken);
-        node_vector& vNodes = searchProcessor.getResults();
-        result.insert(result.end(), vNodes.begin(), vNodes.end());
-    }
-
-    // inshares
-    unique_ptr<MegaShareList> shares(getInSharesList(MegaApi::ORDER_NONE));
-    for (int i = 0; i < shares->size() && !(cancelToken && cancelToken->isCancelled()); i++)
-    {
-        node = client->nodebyhandle(shares->get(i)->getNodeHandle());
-
-        SearchTreeProcessor searchProcessor(client, searchString, type);
-        processTree(node, &searchProcessor, true, cancelToken);
-        vector<Node *>& vNodes  = searchProcessor.getResults();
+        for (Node* p = n; p; p = p->parent)
+        {
+            if (p->inshare)
+            {
+                return true;
+            }
 
-        result.insert(result.end(), vNodes.begin(), vNodes.end());
-    }
+            if (p->type >= ROOTNODE)
+            {
+                return std::find(std::begin(client->rootnodes), std::end(client->rootnodes), p->nodehandle) != std::end(client->rootnodes);
+            }
+        }
+        return false;
+    }, result);
 
     sortByComparatorFunction(result, order, *client);
     MegaNodeList *nodeList = new MegaNodeListPrivate(result.data(), int(result.size()));
@@ -11778,7 +12756,7 @@ void MegaApiImpl::resumeActionPackets()
     sdkMutex.unlock();
 }
 
-bool MegaApiImpl::processTree(Node* node, TreeProcessor* processor, bool recursive, MegaCancelToken *cancelToken)
+bool MegaApiImpl::processTree(Node* node, TreeProcessor* processor, bool recursive, MegaCancelToken *cancelToken, bool yield)
 {
     if (!node)
     {
@@ -11795,7 +12773,7 @@ bool MegaApiImpl::processTree(Node* node, TreeProcessor* processor, bool recursi
         return 0;
     }
 
-    SdkMutexGuard g(sdkMutex);
+    SdkReadGuard g(*this);
 
     if (cancelToken && cancelToken->isCancelled()) // check before lock and after, in case it was cancelled while being locked
     {
@@ -11808,19 +12786,61 @@ bool MegaApiImpl::processTree(Node* node, TreeProcessor* processor, bool recursi
         return 1;
     }
 
-    if (recursive && node->type != FILENODE)
+    // the children before their parent, each folder's in order. By handle: the nodes may go while the lock is let go
+    struct Pending
+    {
+        handle h;
+        bool expanded;
+    };
+    vector<Pending> pending{ Pending{node->nodehandle, !recursive} };
+    node_vector children;
+
+    unsigned processed = 0;
+    auto sliceStart = std::chrono::steady_clock::now();
+
+    while (!pending.empty())
     {
-        for (node_list::iterator it = node->children.begin(); it != node->children.end(); )
+        Node* n = client->nodebyhandle(pending.back().h);
+        if (!n)
+        {
+            pending.pop_back();
+            continue;
+        }
+
+        if (!pending.back().expanded && n->type != FILENODE)
+        {
+            pending.back().expanded = true;
+            children.assign(n->children.begin(), n->children.end());
+            for (auto it = children.rbegin(); it != children.rend(); ++it)
+            {
+                pending.push_back(Pending{(*it)->nodehandle, false});
+            }
+            continue;
+        }
+
+        pending.pop_back();
+        if (!processor->processNode(n))
+        {
+            return 0;
+        }
+
+        if (!(++processed % PROCESS_TREE_SLICE_NODES))
         {
-            if (!processTree(*it++, processor, recursive, cancelToken))
+            if (cancelToken && cancelToken->isCancelled())
             {
                 return 0;
             }
+
+            if (yield && std::chrono::steady_clock::now() - sliceStart >= std::chrono::milliseconds(PROCESS_TREE_SLICE_MS))
+            {
+                // (the level of the SdkReadGuard of the search: not if the lock was held before, see yieldToWriters())
+                sdkMutex.yieldToWriters(1);
+                sliceStart = std::chrono::steady_clock::now();
+            }
         }
     }
 
-    bool result = processor->processNode(node);
-    return result;
+    return 1;
 }
 
 MegaNodeList* MegaApiImpl::search(MegaNode *n, const char* searchString, MegaCancelToken *cancelToken, bool recursive, int order, int type, int target)
@@ -11847,7 +12867,12 @@ MegaNodeList* MegaApiImpl::search(MegaNode *n, const char* searchString, MegaCan
         return new MegaNodeListPrivate();
     }
 
-    SdkMutexGuard g(sdkMutex);
+    SdkReadGuard g(*this);
+    if (!n || (recursive && !searchIndexBuilt(searchString, type)))
+    {
+        // the share lists lock it exclusively, and the first search fills the index
+        g.lockExclusive();
+    }
 
     if (cancelToken && cancelToken->isCancelled())
     {
@@ -11866,19 +12891,39 @@ MegaNodeList* MegaApiImpl::search(MegaNode *n, const char* searchString, MegaCan
 
         // searchString and nodeType (if provided), are considered in search
         SearchTreeProcessor searchProcessor(client, searchString, type);
-        for (node_list::iterator it = node->children.begin(); it != node->children.end()
-             && !(cancelToken && cancelToken->isCancelled()); )
+        node_vector vNodes;
+
+        if (recursive)
+        {
+            searchNodeNames(searchString, type, cancelToken, [node](Node* n)
+            {
+                return n != node && n->isbelow(node);
+            }, vNodes);
+        }
+        else
         {
-            processTree(*it++, &searchProcessor, recursive, cancelToken);
+            for (NodeChildren::iterator it = node->children.begin(); it != node->children.end()
+                 && !(cancelToken && cancelToken->isCancelled()); )
+            {
+                processTree(*it++, &searchProcessor, recursive, cancelToken);
+            }
+            vNodes = std::move(searchProcessor.getResults());
         }
 
-        vector<Node *>& vNodes = searchProcessor.getResults();
         sortByComparatorFunction(vNodes, order, *client);
         nodeList = new MegaNodeListPrivate(vNodes.data(), int(vNodes.size()));
     }
     else
     {
-        node_vector result;
+        // by handle until the end, as the lock is let go in between
+        handle_vector found;
+        auto keep = [&found](const node_vector& nodes)
+        {
+            for (Node* n : nodes)
+            {
+                found.push_back(n->nodehandle);
+            }
+        };
         Node *node;
 
         // Target parameter is only considered if node is not provided
@@ -11892,11 +12937,21 @@ MegaNodeList* MegaApiImpl::search(MegaNode *n, const char* searchString, MegaCan
             // Search on rootnode (cloud, excludes Inbox and Rubbish)
             node = client->nodebyhandle(client->rootnodes[0]);
 
-            SearchTreeProcessor searchProcessor(client, searchString, type);
-            processTree(node, &searchProcessor, recursive, cancelToken);
-            node_vector& vNodes = searchProcessor.getResults();
-
-            result.insert(result.end(), vNodes.begin(), vNodes.end());
+            if (recursive && node)
+            {
+                node_vector vNodes;
+                searchNodeNames(searchString, type, cancelToken, [node](Node* n)
+                {
+                    return n != node && n->isbelow(node);
+                }, vNodes);
+                keep(vNodes);
+            }
+            else
+            {
+                SearchTreeProcessor searchProcessor(client, searchString, type);
+                processTree(node, &searchProcessor, recursive, cancelToken, true);
+                keep(searchProcessor.getResults());
+            }
         }
 
         if (target == MegaApi::SEARCH_TARGET_INSHARE || target == MegaApi::SEARCH_TARGET_ALL)
@@ -11908,10 +12963,8 @@ MegaNodeList* MegaApiImpl::search(MegaNode *n, const char* searchString, MegaCan
                 node = client->nodebyhandle(shares->get(i)->getNodeHandle());
 
                 SearchTreeProcessor searchProcessor(client, searchString, type);
-                processTree(node, &searchProcessor, recursive, cancelToken);
-                vector<Node *>& vNodes  = searchProcessor.getResults();
-
-                result.insert(result.end(), vNodes.begin(), vNodes.end());
+                processTree(node, &searchProcessor, recursive, cancelToken, true);
+                keep(searchProcessor.getResults());
             }
         }
 
@@ -11932,24 +12985,35 @@ MegaNodeList* MegaApiImpl::search(MegaNode *n, const char* searchString, MegaCan
                 node = client->nodebyhandle(shares->get(i)->getNodeHandle());
 
                 SearchTreeProcessor searchProcessor(client, searchString, type);
-                processTree(node, &searchProcessor, recursive, cancelToken);
-                vector<Node *>& vNodes  = searchProcessor.getResults();
-
-                result.insert(result.end(), vNodes.begin(), vNodes.end());
+                processTree(node, &searchProcessor, recursive, cancelToken, true);
+                keep(searchProcessor.getResults());
             }
         }
 
         if (target == MegaApi::SEARCH_TARGET_PUBLICLINK)
         {
-            // Search on public links
-            for (auto it = client->mPublicLinks.begin(); it != client->mPublicLinks.end()
-                 && !(cancelToken && cancelToken->isCancelled()); it++)
+            // Search on public links (which may change while the lock is let go)
+            handle_vector links;
+            for (auto& link : client->mPublicLinks)
+            {
+                links.push_back(link.first);
+            }
+
+            for (size_t i = 0; i < links.size() && !(cancelToken && cancelToken->isCancelled()); i++)
             {
-                node = client->nodebyhandle(it->first);
+                node = client->nodebyhandle(links[i]);
                 SearchTreeProcessor searchProcessor(client, searchString, type);
-                processTree(node, &searchProcessor, true, cancelToken);
-                vector<Node *>& vNodes  = searchProcessor.getResults();
-                result.insert(result.end(), vNodes.begin(), vNodes.end());
+                processTree(node, &searchProcessor, true, cancelToken, true);
+                keep(searchProcessor.getResults());
+            }
+        }
+
+        node_vector result;
+        for (handle h : found)
+        {
+            if (Node* n = client->nodebyhandle(h))
+            {
+                result.push_back(n);
             }
         }
 
@@ -11975,19 +13039,28 @@ long long MegaApiImpl::getSize(MegaNode *n)
         return megaSizeProcessor.getTotalBytes();
     }
 
-    sdkMutex.lock();
+    SdkReadGuard g(*this);
+
+    // kept up to date for the roots and inshares
+    auto it = client->mNodeCounters.find(n->getHandle());
+    if (it != client->mNodeCounters.end())
+    {
+        return it->second.storage;
+    }
+
     Node *node = client->nodebyhandle(n->getHandle());
+    if (node && !node->descendantCountsKept())
+    {
+        // counting them the first time keeps them
+        g.lockExclusive();
+        node = client->nodebyhandle(n->getHandle());
+    }
     if(!node)
     {
-        sdkMutex.unlock();
         return 0;
     }
-    SizeProcessor sizeProcessor;
-    processTree(node, &sizeProcessor);
-    long long result = sizeProcessor.getTotalBytes();
-    sdkMutex.unlock();
 
-    return result;
+    return node->descendantCounts().storage;
 }
 
 char *MegaApiImpl::getFingerprint(const char *filePath)
@@ -12257,7 +13330,7 @@ MegaNode *MegaApiImpl::getNodeByCRC(const char *crc, MegaNode *parent)
     byte binarycrc[sizeof(node->crc)];
     Base64::atob(crc, binarycrc, sizeof(binarycrc));
 
-    for (node_list::iterator it = node->children.begin(); it != node->children.end(); it++)
+    for (NodeChildren::iterator it = node->children.begin(); it != node->children.end(); it++)
     {
         Node *child = (*it);
         if(!memcmp(child->crc.data(), binarycrc, sizeof(node->crc)))
@@ -12272,6 +13345,50 @@ MegaNode *MegaApiImpl::getNodeByCRC(const char *crc, MegaNode *parent)
     return NULL;
 }
 
+// searches by type only go through the index of types, the others through that of names
+static bool searchesTypeIndex(const char* searchString, int type)
+{
+    return (!searchString || !*searchString) && type >= MegaApi::FILE_TYPE_PHOTO && type <= MegaApi::FILE_TYPE_DOCUMENT;
+}
+
+bool MegaApiImpl::searchIndexBuilt(const char* searchString, int type)
+{
+    return searchesTypeIndex(searchString, type) ? client->mNodeTypes.built : client->mNodeNames.built;
+}
+
+void MegaApiImpl::searchNodeNames(const char* searchString, int type, MegaCancelToken* cancelToken, std::function<bool(Node*)> inScope, node_vector& result)
+{
+    vector<handle> handles;
+    if (searchesTypeIndex(searchString, type))
+    {
+        auto& nodes = client->nodeTypes().nodes(type);
+        handles.assign(nodes.begin(), nodes.end());
+    }
+    else
+    {
+        client->nodeNames().find(searchString, handles);
+    }
+
+    // the index only narrows the names down, the processor checks them (and the type) as a tree walk would
+    SearchTreeProcessor searchProcessor(client, searchString, type);
+    for (size_t i = 0; i < handles.size(); i++)
+    {
+        if (!(i % 1024) && cancelToken && cancelToken->isCancelled())
+        {
+            return;
+        }
+
+        Node* n = client->nodebyhandle(handles[i]);
+        if (n && inScope(n))
+        {
+            searchProcessor.processNode(n);
+        }
+    }
+
+    node_vector vNodes = searchProcessor.getResults();
+    result.insert(result.end(), vNodes.begin(), vNodes.end());
+}
+
 SearchTreeProcessor::SearchTreeProcessor(MegaClient *client, const char *search, int type)
 {
     mSearch = search;
@@ -12323,7 +13440,7 @@ bool SearchTreeProcessor::processNode(Node* node)
         // If no search string provided (filter by node type), or search string match with node name
         if (isValidTypeNode(node))
         {
-            mResults.push_back(node);
+            mResults.push_back(node->nodehandle);
         }
     }
 
@@ -12354,26 +13471,18 @@ bool SearchTreeProcessor::isValidTypeNode(Node *node)
     }
 }
 
-vector<Node *> &SearchTreeProcessor::getResults()
-{
-    return mResults;
-}
-
-SizeProcessor::SizeProcessor()
-{
-    totalBytes=0;
-}
-
-bool SizeProcessor::processNode(Node *node)
-{
-    if(node->type == FILENODE)
-        totalBytes += node->size;
-    return true;
-}
-
-long long SizeProcessor::getTotalBytes()
+node_vector SearchTreeProcessor::getResults()
 {
-    return totalBytes;
+    node_vector nodes;
+    nodes.reserve(mResults.size());
+    for (handle h : mResults)
+    {
+        if (Node* n = mClient->nodebyhandle(h))
+        {
+            nodes.push_back(n);
+        }
+    }
+    return nodes;
 }
 
 void MegaApiImpl::file_added(File *f)
@@ -13556,7 +14665,7 @@ void MegaApiImpl::unlink_result(handle h, error e)
     }
 
 #ifdef ENABLE_SYNC
-    client->syncdownrequired = true;
+    client->requestsyncdown();
 #endif
 
     if (request->getType() != MegaRequest::TYPE_MOVE)
@@ -13585,6 +14694,8 @@ void MegaApiImpl::unlinkversions_result(error e)
 
 void MegaApiImpl::fetchnodes_result(const Error &e)
 {
+    client->startupProfile.end(CodeCounter::StartupProfile::PHASE_FETCHNODES);
+
     MegaRequestPrivate* request = NULL;
     if (!client->restag)
     {
@@ -13776,6 +14887,8 @@ void MegaApiImpl::putnodes_result(const Error& inputErr, targettype_t t, vector<
             pendingUploads--;
         }
 
+        transfer->markStage(STAGE_PUTNODES_ACKED);
+
         //scale to get the handle of the new node
         Node *ntmp;
         if (n)
@@ -13818,7 +14931,7 @@ void MegaApiImpl::putnodes_result(const Error& inputErr, targettype_t t, vector<
                     (request->getType() != MegaRequest::TYPE_COMPLETE_BACKGROUND_UPLOAD))) return;
 
 #ifdef ENABLE_SYNC
-    client->syncdownrequired = true;
+    client->requestsyncdown();
 #endif
 
     if (request->getType() == MegaRequest::TYPE_COMPLETE_BACKGROUND_UPLOAD)
@@ -13970,9 +15083,12 @@ void MegaApiImpl::updatepcr_result(error e, ipcactions_t action)
     fireOnRequestFinish(request, make_unique<MegaErrorPrivate>(e));
 }
 
-void MegaApiImpl::fa_complete(handle, fatype, const char* data, uint32_t len)
+void MegaApiImpl::fa_complete(handle h, fatype type, const char* data, uint32_t len)
 {
+    fileAttributeCache.put(h, int(type), data, len);
+
     int tag = client->restag;
+    bool stored = false;
     while(tag)
     {
         if(requestMap.find(tag) == requestMap.end()) return;
@@ -13981,18 +15097,42 @@ void MegaApiImpl::fa_complete(handle, fatype, const char* data, uint32_t len)
 
         tag = int(request->getNumber());
 
-        auto f = client->fsaccess->newfileaccess();
-        string filePath(request->getFile());
-        auto localPath = LocalPath::fromPath(filePath, *fsAccess);
-        fsAccess->unlinklocal(localPath);
-
-        bool success = f->fopen(localPath, false, true)
-                    && f->fwrite((const byte*)data, len, 0);
+        if (!stored && fileAttributeDiskCache)
+        {
+            Node *node = client->nodebyhandle(h);
+            string fileattrstring = request->getText() ? request->getText() : (node ? node->fileattrstring : string());
+            handle fah = Node::fileattributehandle(&fileattrstring, type);
+            if (!ISUNDEF(fah))
+            {
+                fileAttributeDiskCache->put(fah, data, len);
+                stored = true;
+            }
+        }
 
-        f.reset();
+        finishNodeAttributeRequest(request, data, len);
+    }
+}
 
-        fireOnRequestFinish(request, make_unique<MegaErrorPrivate>(success ? API_OK : API_EWRITE));
+void MegaApiImpl::finishNodeAttributeRequest(MegaRequestPrivate *request, const char *data, size_t len)
+{
+    if (request->getFlag())
+    {
+        // the data is taken from the memory cache
+        fireOnRequestFinish(request, make_unique<MegaErrorPrivate>(API_OK));
+        return;
     }
+
+    auto f = client->fsaccess->newfileaccess();
+    string filePath(request->getFile());
+    auto localPath = LocalPath::fromPath(filePath, *fsAccess);
+    fsAccess->unlinklocal(localPath);
+
+    bool success = f->fopen(localPath, false, true)
+                && f->fwrite((const byte*)data, unsigned(len), 0);
+
+    f.reset();
+
+    fireOnRequestFinish(request, make_unique<MegaErrorPrivate>(success ? API_OK : API_EWRITE));
 }
 
 int MegaApiImpl::fa_failed(handle, fatype, int retries, error e)
@@ -14613,6 +15753,13 @@ void MegaApiImpl::logout_result(error e)
         delete mTimezones;
         mTimezones = NULL;
 
+        // decrypted attributes of the account aren't left behind
+        fileAttributeCache.clear();
+        if (fileAttributeDiskCache)
+        {
+            fileAttributeDiskCache->clear();
+        }
+
 #ifdef ENABLE_SYNC
         mCachedMegaSyncPrivate.reset();
 #endif
@@ -14836,17 +15983,113 @@ void MegaApiImpl::nodes_updated(Node** n, int count)
         return;
     }
 
-    MegaNodeList *nodeList = NULL;
+#ifdef HAVE_LIBUV
+    if (httpServer)
+    {
+        httpServer->clearPropFindCache();
+    }
+#endif
+
+    if (fileAttributeCache.size())
+    {
+        if (!n)
+        {
+            fileAttributeCache.clear();
+        }
+        else
+        {
+            for (int i = 0; i < count; i++)
+            {
+                if (n[i]->changed.removed || n[i]->changed.fileattrstring)
+                {
+                    fileAttributeCache.remove(n[i]->nodehandle);
+                }
+            }
+        }
+    }
+
     if (n != NULL)
     {
-        nodeList = new MegaNodeListPrivate(n, count);
-        fireOnNodesUpdate(nodeList);
+        if (nodeUpdateBatchDs)
+        {
+            queueNodesUpdate(n, count);
+            return;
+        }
+
+        // a huge change (a large folder removed, say) goes in several lists, so that the copies of all its
+        // nodes don't have to exist at the same time
+        for (int first = 0; first < count; first += NODES_UPDATE_CHUNK)
+        {
+            MegaNodeListPrivate nodeList(n + first, std::min(NODES_UPDATE_CHUNK, count - first));
+            fireOnNodesUpdate(&nodeList);
+        }
     }
     else
     {
+        // everything is reloaded: the changes waiting to be notified come first
+        flushBatchedUpdates(true);
         fireOnNodesUpdate(NULL);
     }
-    delete nodeList;
+}
+
+void MegaApiImpl::queueNodesUpdate(Node** n, int count)
+{
+    if (pendingNodeUpdates.empty())
+    {
+        pendingNodeUpdatesDs = Waiter::ds + nodeUpdateBatchDs;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        unique_ptr<MegaNodePrivate> node(static_cast<MegaNodePrivate*>(MegaNodePrivate::fromNode(n[i])));
+        auto it = pendingNodeUpdatesIndex.find(node->getHandle());
+        if (it == pendingNodeUpdatesIndex.end())
+        {
+            pendingNodeUpdatesIndex[node->getHandle()] = pendingNodeUpdates.size();
+            pendingNodeUpdates.push_back(std::move(node));
+        }
+        else
+        {
+            // the latest state of the node, with all the changes since it was queued
+            node->addChanges(pendingNodeUpdates[it->second]->getChanges());
+            pendingNodeUpdates[it->second] = std::move(node);
+        }
+    }
+}
+
+void MegaApiImpl::flushBatchedUpdates(bool force)
+{
+    if (!pendingTransferUpdates.empty() && (force || pendingTransferUpdatesDs <= Waiter::ds))
+    {
+        vector<MegaTransfer*> transfers;
+        transfers.reserve(pendingTransferUpdates.size());
+        for (int tag : pendingTransferUpdates)
+        {
+            auto it = transferMap.find(tag);
+            if (it != transferMap.end())
+            {
+                transfers.push_back(it->second);
+            }
+        }
+        pendingTransferUpdates.clear();
+
+        fireOnTransfersUpdate(transfers);
+    }
+
+    if (!pendingNodeUpdates.empty() && (force || pendingNodeUpdatesDs <= Waiter::ds))
+    {
+        vector<MegaNode*> nodes;
+        nodes.reserve(pendingNodeUpdates.size());
+        for (auto& node : pendingNodeUpdates)
+        {
+            nodes.push_back(node.release());
+        }
+        pendingNodeUpdates.clear();
+        pendingNodeUpdatesIndex.clear();
+
+        MegaNodeListPrivate nodeList(std::move(nodes));
+        fireOnNodesUpdate(&nodeList);
+    }
 }
 
 void MegaApiImpl::account_details(AccountDetails*, bool, bool, bool, bool, bool, bool)
@@ -16062,6 +17305,8 @@ void MegaApiImpl::removeListener(MegaListener* listener)
     sdkMutex.lock();
     listeners.erase(listener);
     sdkMutex.unlock();
+
+    revokeListener(listener);
 }
 
 void MegaApiImpl::removeRequestListener(MegaRequestListener* listener)
@@ -16104,6 +17349,8 @@ void MegaApiImpl::removeTransferListener(MegaTransferListener* listener)
 
     transferQueue.removeListener(listener);
     sdkMutex.unlock();
+
+    revokeListener(listener);
 }
 
 void MegaApiImpl::removeScheduledCopyListener(MegaScheduledCopyListener* listener)
@@ -16134,6 +17381,8 @@ void MegaApiImpl::removeGlobalListener(MegaGlobalListener* listener)
     sdkMutex.lock();
     globalListeners.erase(listener);
     sdkMutex.unlock();
+
+    revokeListener(listener);
 }
 
 void MegaApiImpl::cancelPendingTransfersByFolderTag(int folderTag)
@@ -16289,10 +17538,19 @@ void MegaApiImpl::fireOnRequestTemporaryError(MegaRequestPrivate *request, uniqu
 
 void MegaApiImpl::fireOnTransferStart(MegaTransferPrivate *transfer)
 {
-    activeTransfer = transfer;
     notificationNumber++;
     transfer->setNotificationNumber(notificationNumber);
 
+    if (callbackDispatcher)
+    {
+        queueTransferCallback(transfer, false,
+                              [this](MegaTransferListener* l, MegaTransfer* t) { l->onTransferStart(api, t); },
+                              [this](MegaListener* l, MegaTransfer* t) { l->onTransferStart(api, t); });
+        return;
+    }
+
+    activeTransfer = transfer;
+
     for(set<MegaTransferListener *>::iterator it = transferListeners.begin(); it != transferListeners.end() ;)
     {
         (*it++)->onTransferStart(api, transfer);
@@ -16319,6 +17577,7 @@ void MegaApiImpl::fireOnTransferFinish(MegaTransferPrivate *transfer, unique_ptr
     notificationNumber++;
     transfer->setNotificationNumber(notificationNumber);
     transfer->setLastError(e.get());
+    transfer->markStage(STAGE_CALLBACK);
 
     if(e->getErrorCode())
     {
@@ -16335,20 +17594,40 @@ void MegaApiImpl::fireOnTransferFinish(MegaTransferPrivate *transfer, unique_ptr
         LOG_info << "Transfer (" << transfer->getTransferString() << ") finished. File: " << transfer->getFileName();
     }
 
-    for(set<MegaTransferListener *>::iterator it = transferListeners.begin(); it != transferListeners.end() ;)
+    if (callbackDispatcher)
     {
-        (*it++)->onTransferFinish(api, transfer, e.get());
+        shared_ptr<MegaError> error(e->copy());
+        callbackDispatcher->endProgress(transfer->getTag());
+        queueTransferCallback(transfer, false,
+                              [this, error](MegaTransferListener* l, MegaTransfer* t) { l->onTransferFinish(api, t, error.get()); },
+                              [this, error](MegaListener* l, MegaTransfer* t) { l->onTransferFinish(api, t, error.get()); });
     }
-
-    for(set<MegaListener *>::iterator it = listeners.begin(); it != listeners.end() ;)
+    else
     {
-        (*it++)->onTransferFinish(api, transfer, e.get());
+        for(set<MegaTransferListener *>::iterator it = transferListeners.begin(); it != transferListeners.end() ;)
+        {
+            (*it++)->onTransferFinish(api, transfer, e.get());
+        }
+
+        for(set<MegaListener *>::iterator it = listeners.begin(); it != listeners.end() ;)
+        {
+            (*it++)->onTransferFinish(api, transfer, e.get());
+        }
+
+        MegaTransferListener* listener = transfer->getListener();
+        if(listener)
+        {
+            listener->onTransferFinish(api, transfer, e.get());
+        }
     }
 
-    MegaTransferListener* listener = transfer->getListener();
-    if(listener)
+    pendingTransferUpdates.erase(transfer->getTag());
+
+    finishedTransfers.push_back(FinishedTransfer{transfer->getNotificationNumber(), transfer->getTag(), transfer->getType()});
+    if (finishedTransfers.size() > MAX_FINISHED_TRANSFERS)
     {
-        listener->onTransferFinish(api, transfer, e.get());
+        forgottenFinishedTransfers = finishedTransfers.front().notificationNumber;
+        finishedTransfers.pop_front();
     }
 
     transferMap.erase(transfer->getTag());
@@ -16371,20 +17650,30 @@ void MegaApiImpl::fireOnTransferTemporaryError(MegaTransferPrivate *transfer, un
 
     transfer->setNumRetry(transfer->getNumRetry() + 1);
 
-    for(set<MegaTransferListener *>::iterator it = transferListeners.begin(); it != transferListeners.end() ;)
+    if (callbackDispatcher)
     {
-        (*it++)->onTransferTemporaryError(api, transfer, e.get());
+        shared_ptr<MegaError> error(e->copy());
+        queueTransferCallback(transfer, false,
+                              [this, error](MegaTransferListener* l, MegaTransfer* t) { l->onTransferTemporaryError(api, t, error.get()); },
+                              [this, error](MegaListener* l, MegaTransfer* t) { l->onTransferTemporaryError(api, t, error.get()); });
     }
-
-    for(set<MegaListener *>::iterator it = listeners.begin(); it != listeners.end() ;)
+    else
     {
-        (*it++)->onTransferTemporaryError(api, transfer, e.get());
-    }
+        for(set<MegaTransferListener *>::iterator it = transferListeners.begin(); it != transferListeners.end() ;)
+        {
+            (*it++)->onTransferTemporaryError(api, transfer, e.get());
+        }
 
-    MegaTransferListener* listener = transfer->getListener();
-    if(listener)
-    {
-        listener->onTransferTemporaryError(api, transfer, e.get());
+        for(set<MegaListener *>::iterator it = listeners.begin(); it != listeners.end() ;)
+        {
+            (*it++)->onTransferTemporaryError(api, transfer, e.get());
+        }
+
+        MegaTransferListener* listener = transfer->getListener();
+        if(listener)
+        {
+            listener->onTransferTemporaryError(api, transfer, e.get());
+        }
     }
 
     activeTransfer = NULL;
@@ -16398,10 +17687,25 @@ MegaClient *MegaApiImpl::getMegaClient()
 
 void MegaApiImpl::fireOnTransferUpdate(MegaTransferPrivate *transfer)
 {
-    activeTransfer = transfer;
+    if (!pendingTransferUpdates.empty())
+    {
+        // this notification supersedes the batched one
+        pendingTransferUpdates.erase(transfer->getTag());
+    }
+
     notificationNumber++;
     transfer->setNotificationNumber(notificationNumber);
 
+    if (callbackDispatcher)
+    {
+        queueTransferCallback(transfer, true,
+                              [this](MegaTransferListener* l, MegaTransfer* t) { l->onTransferUpdate(api, t); },
+                              [this](MegaListener* l, MegaTransfer* t) { l->onTransferUpdate(api, t); });
+        return;
+    }
+
+    activeTransfer = transfer;
+
     for(set<MegaTransferListener *>::iterator it = transferListeners.begin(); it != transferListeners.end() ;)
     {
         (*it++)->onTransferUpdate(api, transfer);
@@ -16421,6 +17725,217 @@ void MegaApiImpl::fireOnTransferUpdate(MegaTransferPrivate *transfer)
     activeTransfer = NULL;
 }
 
+void MegaApiImpl::fireOnTransfersUpdate(vector<MegaTransfer*>& transfers)
+{
+    if (transfers.empty())
+    {
+        return;
+    }
+
+    for (MegaTransfer* t : transfers)
+    {
+        notificationNumber++;
+        static_cast<MegaTransferPrivate*>(t)->setNotificationNumber(notificationNumber);
+    }
+
+    if (callbackDispatcher)
+    {
+        MegaCallbackDispatcher* dispatcher = callbackDispatcher.get();
+        shared_ptr<MegaTransferList> transferList(new MegaTransferListPrivate(transfers.data(), int(transfers.size())));
+        set<MegaTransferListener*> transferListenersCopy = transferListeners;
+        set<MegaListener*> listenersCopy = listeners;
+        vector<MegaTransferListener*> ownListeners;
+        vector<MegaTransferPrivate*> sdkListenerTransfers;
+        for (MegaTransfer* t : transfers)
+        {
+            MegaTransferListener* listener = static_cast<MegaTransferPrivate*>(t)->getListener();
+            if (isSdkTransferListener(listener))
+            {
+                sdkListenerTransfers.push_back(static_cast<MegaTransferPrivate*>(t));
+                listener = nullptr;
+            }
+            ownListeners.push_back(listener);
+        }
+
+        dispatcher->pushProgress(0, [this, dispatcher, transferList, transferListenersCopy, listenersCopy, ownListeners]() {
+            for (MegaTransferListener* l : transferListenersCopy)
+            {
+                dispatcher->deliver(l, [&]() { l->onTransfersUpdate(api, transferList.get()); });
+            }
+            for (MegaListener* l : listenersCopy)
+            {
+                dispatcher->deliver(l, [&]() { l->onTransfersUpdate(api, transferList.get()); });
+            }
+            for (size_t i = 0; i < ownListeners.size(); i++)
+            {
+                if (MegaTransferListener* l = ownListeners[i])
+                {
+                    dispatcher->deliver(l, [&]() { l->onTransferUpdate(api, transferList->get(int(i))); });
+                }
+            }
+        });
+
+        for (MegaTransferPrivate* transfer : sdkListenerTransfers)
+        {
+            activeTransfer = transfer;
+            transfer->getListener()->onTransferUpdate(api, transfer);
+        }
+        activeTransfer = NULL;
+        return;
+    }
+
+    MegaTransferListPrivate transferList(transfers.data(), int(transfers.size()));
+    for(set<MegaTransferListener *>::iterator it = transferListeners.begin(); it != transferListeners.end() ;)
+    {
+        (*it++)->onTransfersUpdate(api, &transferList);
+    }
+
+    for(set<MegaListener *>::iterator it = listeners.begin(); it != listeners.end() ;)
+    {
+        (*it++)->onTransfersUpdate(api, &transferList);
+    }
+
+    for (MegaTransfer* t : transfers)
+    {
+        MegaTransferPrivate* transfer = static_cast<MegaTransferPrivate*>(t);
+        MegaTransferListener* listener = transfer->getListener();
+        if (listener)
+        {
+            activeTransfer = transfer;
+            listener->onTransferUpdate(api, transfer);
+        }
+    }
+
+    activeTransfer = NULL;
+}
+
+void MegaApiImpl::queueGlobalCallback(std::function<void(MegaGlobalListener*)> globalCall, std::function<void(MegaListener*)> call)
+{
+    MegaCallbackDispatcher* dispatcher = callbackDispatcher.get();
+    set<MegaGlobalListener*> globalListenersCopy = globalListeners;
+    set<MegaListener*> listenersCopy = listeners;
+
+    dispatcher->push([dispatcher, globalListenersCopy, listenersCopy, globalCall, call]() {
+        for (MegaGlobalListener* l : globalListenersCopy)
+        {
+            dispatcher->deliver(l, [&]() { globalCall(l); });
+        }
+        for (MegaListener* l : listenersCopy)
+        {
+            dispatcher->deliver(l, [&]() { call(l); });
+        }
+    });
+}
+
+void MegaApiImpl::queueTransferCallback(MegaTransferPrivate* transfer, bool progress, std::function<void(MegaTransferListener*, MegaTransfer*)> transferCall, std::function<void(MegaListener*, MegaTransfer*)> call)
+{
+    MegaCallbackDispatcher* dispatcher = callbackDispatcher.get();
+    shared_ptr<MegaTransfer> transferCopy(transfer->copy());
+    set<MegaTransferListener*> transferListenersCopy = transferListeners;
+    set<MegaListener*> listenersCopy = listeners;
+    MegaTransferListener* ownListener = transfer->getListener();
+    MegaTransferListener* sdkListener = nullptr;
+    if (isSdkTransferListener(ownListener))
+    {
+        sdkListener = ownListener;
+        ownListener = nullptr;
+    }
+
+    MegaCallbackDispatcher::Callback callback = [dispatcher, transferCopy, transferListenersCopy, listenersCopy, ownListener, transferCall, call]() {
+        for (MegaTransferListener* l : transferListenersCopy)
+        {
+            dispatcher->deliver(l, [&]() { transferCall(l, transferCopy.get()); });
+        }
+        for (MegaListener* l : listenersCopy)
+        {
+            dispatcher->deliver(l, [&]() { call(l, transferCopy.get()); });
+        }
+        if (ownListener)
+        {
+            dispatcher->deliver(ownListener, [&]() { transferCall(ownListener, transferCopy.get()); });
+        }
+    };
+
+    if (progress)
+    {
+        dispatcher->pushProgress(transfer->getTag(), std::move(callback));
+    }
+    else
+    {
+        dispatcher->push(std::move(callback));
+    }
+
+    // after queueing, so that what the SDK listener fires in turn is delivered after this one
+    if (sdkListener)
+    {
+        MegaTransferPrivate* previousTransfer = activeTransfer;
+        activeTransfer = transfer;
+        transferCall(sdkListener, transfer);
+        activeTransfer = previousTransfer;
+    }
+}
+
+bool MegaApiImpl::isSdkTransferListener(MegaTransferListener* listener)
+{
+    // they work on the transfer itself, on the SDK thread and with the SDK lock held
+    return listener && (dynamic_cast<MegaFolderUploadController*>(listener)
+                        || dynamic_cast<MegaFolderDownloadController*>(listener)
+                        || dynamic_cast<MegaScheduledCopyController*>(listener)
+#ifdef HAVE_LIBUV
+                        || dynamic_cast<MegaTCPContext*>(listener)
+#endif
+                        );
+}
+
+void MegaApiImpl::revokeListener(void* listener)
+{
+    shared_ptr<MegaCallbackDispatcher> dispatcher;
+    {
+        SdkMutexGuard g(sdkMutex);
+        if (!callbackDispatcher)
+        {
+            return;
+        }
+        callbackDispatcher->revoke(listener);
+
+        // a listener removing itself doesn't wait for itself, nor does the SDK thread, as it
+        // holds the lock that the listener in use may be waiting for
+        if (callbackDispatcher->isDispatcherThread() || std::this_thread::get_id() == sdkThreadId)
+        {
+            return;
+        }
+        dispatcher = callbackDispatcher;
+    }
+    dispatcher->waitDelivered(listener);
+}
+
+void MegaApiImpl::setAsyncCallbacks(bool enable, int queueSize, int backpressure)
+{
+    shared_ptr<MegaCallbackDispatcher> previous;
+    {
+        SdkMutexGuard g(sdkMutex);
+        if (callbackDispatcher && callbackDispatcher->isDispatcherThread())
+        {
+            LOG_err << "Asynchronous callbacks can't be reconfigured from an asynchronous callback";
+            return;
+        }
+
+        if (backpressure < MegaApi::ASYNC_CALLBACKS_BLOCK || backpressure > MegaApi::ASYNC_CALLBACKS_DROP)
+        {
+            backpressure = MegaApi::ASYNC_CALLBACKS_COALESCE;
+        }
+
+        previous = std::move(callbackDispatcher);
+        if (enable)
+        {
+            callbackDispatcher = std::make_shared<MegaCallbackDispatcher>(queueSize > 0 ? size_t(queueSize) : 1024, backpressure);
+        }
+    }
+
+    // out of the lock, as the callbacks still queued may need it
+    previous.reset();
+}
+
 bool MegaApiImpl::fireOnTransferData(MegaTransferPrivate *transfer)
 {
     activeTransfer = transfer;
@@ -16431,7 +17946,7 @@ bool MegaApiImpl::fireOnTransferData(MegaTransferPrivate *transfer)
     MegaTransferListener* listener = transfer->getListener();
     if(listener)
     {
-        result = listener->onTransferData(api, transfer, transfer->getLastBytes(), size_t(transfer->getDeltaSize()));
+        result = listener->onTransferBuffer(api, transfer, transfer->getLastBytes(), size_t(transfer->getDeltaSize()));
     }
 
     activeTransfer = NULL;
@@ -16440,6 +17955,14 @@ bool MegaApiImpl::fireOnTransferData(MegaTransferPrivate *transfer)
 
 void MegaApiImpl::fireOnUsersUpdate(MegaUserList *users)
 {
+    if (callbackDispatcher)
+    {
+        shared_ptr<MegaUserList> userList(users ? users->copy() : nullptr);
+        queueGlobalCallback([this, userList](MegaGlobalListener* l) { l->onUsersUpdate(api, userList.get()); },
+                            [this, userList](MegaListener* l) { l->onUsersUpdate(api, userList.get()); });
+        return;
+    }
+
     activeUsers = users;
 
     for(set<MegaGlobalListener *>::iterator it = globalListeners.begin(); it != globalListeners.end() ;)
@@ -16456,6 +17979,14 @@ void MegaApiImpl::fireOnUsersUpdate(MegaUserList *users)
 
 void MegaApiImpl::fireOnUserAlertsUpdate(MegaUserAlertList *userAlerts)
 {
+    if (callbackDispatcher)
+    {
+        shared_ptr<MegaUserAlertList> alertList(userAlerts ? userAlerts->copy() : nullptr);
+        queueGlobalCallback([this, alertList](MegaGlobalListener* l) { l->onUserAlertsUpdate(api, alertList.get()); },
+                            [this, alertList](MegaListener* l) { l->onUserAlertsUpdate(api, alertList.get()); });
+        return;
+    }
+
     activeUserAlerts = userAlerts;
 
     for(set<MegaGlobalListener *>::iterator it = globalListeners.begin(); it != globalListeners.end() ;)
@@ -16472,6 +18003,14 @@ void MegaApiImpl::fireOnUserAlertsUpdate(MegaUserAlertList *userAlerts)
 
 void MegaApiImpl::fireOnContactRequestsUpdate(MegaContactRequestList *requests)
 {
+    if (callbackDispatcher)
+    {
+        shared_ptr<MegaContactRequestList> requestList(requests ? requests->copy() : nullptr);
+        queueGlobalCallback([this, requestList](MegaGlobalListener* l) { l->onContactRequestsUpdate(api, requestList.get()); },
+                            [this, requestList](MegaListener* l) { l->onContactRequestsUpdate(api, requestList.get()); });
+        return;
+    }
+
     activeContactRequests = requests;
 
     for(set<MegaGlobalListener *>::iterator it = globalListeners.begin(); it != globalListeners.end() ;)
@@ -16488,6 +18027,14 @@ void MegaApiImpl::fireOnContactRequestsUpdate(MegaContactRequestList *requests)
 
 void MegaApiImpl::fireOnNodesUpdate(MegaNodeList *nodes)
 {
+    if (callbackDispatcher)
+    {
+        shared_ptr<MegaNodeList> nodeList(nodes ? nodes->copy() : nullptr);
+        queueGlobalCallback([this, nodeList](MegaGlobalListener* l) { l->onNodesUpdate(api, nodeList.get()); },
+                            [this, nodeList](MegaListener* l) { l->onNodesUpdate(api, nodeList.get()); });
+        return;
+    }
+
     activeNodes = nodes;
 
     for(set<MegaGlobalListener *>::iterator it = globalListeners.begin(); it != globalListeners.end() ;)
@@ -16504,6 +18051,13 @@ void MegaApiImpl::fireOnNodesUpdate(MegaNodeList *nodes)
 
 void MegaApiImpl::fireOnAccountUpdate()
 {
+    if (callbackDispatcher)
+    {
+        queueGlobalCallback([this](MegaGlobalListener* l) { l->onAccountUpdate(api); },
+                            [this](MegaListener* l) { l->onAccountUpdate(api); });
+        return;
+    }
+
     for(set<MegaGlobalListener *>::iterator it = globalListeners.begin(); it != globalListeners.end() ;)
     {
         (*it++)->onAccountUpdate(api);
@@ -16516,6 +18070,13 @@ void MegaApiImpl::fireOnAccountUpdate()
 
 void MegaApiImpl::fireOnReloadNeeded()
 {
+    if (callbackDispatcher)
+    {
+        queueGlobalCallback([this](MegaGlobalListener* l) { l->onReloadNeeded(api); },
+                            [this](MegaListener* l) { l->onReloadNeeded(api); });
+        return;
+    }
+
     for(set<MegaGlobalListener *>::iterator it = globalListeners.begin(); it != globalListeners.end() ;)
     {
         (*it++)->onReloadNeeded(api);
@@ -16529,6 +18090,14 @@ void MegaApiImpl::fireOnReloadNeeded()
 
 void MegaApiImpl::fireOnEvent(MegaEventPrivate *event)
 {
+    if (callbackDispatcher)
+    {
+        shared_ptr<MegaEventPrivate> e(event);
+        queueGlobalCallback([this, e](MegaGlobalListener* l) { l->onEvent(api, e.get()); },
+                            [this, e](MegaListener* l) { l->onEvent(api, e.get()); });
+        return;
+    }
+
     for(set<MegaGlobalListener *>::iterator it = globalListeners.begin(); it != globalListeners.end() ;)
     {
         (*it++)->onEvent(api, event);
@@ -16716,6 +18285,14 @@ void MegaApiImpl::fireOnBackupUpdate(MegaScheduledCopyController *backup)
 
 void MegaApiImpl::fireOnChatsUpdate(MegaTextChatList *chats)
 {
+    if (callbackDispatcher)
+    {
+        shared_ptr<MegaTextChatList> chatList(chats ? chats->copy() : nullptr);
+        queueGlobalCallback([this, chatList](MegaGlobalListener* l) { l->onChatsUpdate(api, chatList.get()); },
+                            [this, chatList](MegaListener* l) { l->onChatsUpdate(api, chatList.get()); });
+        return;
+    }
+
     for(set<MegaGlobalListener *>::iterator it = globalListeners.begin(); it != globalListeners.end() ;)
     {
         (*it++)->onChatsUpdate(api, chats);
@@ -16730,6 +18307,7 @@ void MegaApiImpl::fireOnChatsUpdate(MegaTextChatList *chats)
 
 void MegaApiImpl::processTransferPrepare(Transfer *t, MegaTransferPrivate *transfer)
 {
+    transfer->setTrace(t->traceId, t->stages);
     transfer->setTotalBytes(t->size);
     transfer->setState(t->state);
     transfer->setPriority(t->priority);
@@ -16738,6 +18316,7 @@ void MegaApiImpl::processTransferPrepare(Transfer *t, MegaTransferPrivate *trans
 
 void MegaApiImpl::processTransferUpdate(Transfer *tr, MegaTransferPrivate *transfer)
 {
+    transfer->setTrace(tr->traceId, tr->stages);
     dstime currentTime = Waiter::ds;
     if (tr->slot)
     {
@@ -16768,11 +18347,23 @@ void MegaApiImpl::processTransferUpdate(Transfer *tr, MegaTransferPrivate *trans
     transfer->setState(tr->state);
     transfer->setPriority(tr->priority);
     transfer->setUpdateTime(currentTime);
+
+    if (transferUpdateBatchDs)
+    {
+        if (pendingTransferUpdates.empty())
+        {
+            pendingTransferUpdatesDs = currentTime + transferUpdateBatchDs;
+        }
+        pendingTransferUpdates.insert(transfer->getTag());
+        return;
+    }
+
     fireOnTransferUpdate(transfer);
 }
 
 void MegaApiImpl::processTransferComplete(Transfer *tr, MegaTransferPrivate *transfer)
 {
+    transfer->setTrace(tr->traceId, tr->stages);
     dstime currentTime = Waiter::ds;
     m_off_t deltaSize = tr->size - transfer->getTransferredBytes();
     transfer->setStartTime(currentTime);
@@ -16800,6 +18391,8 @@ void MegaApiImpl::processTransferComplete(Transfer *tr, MegaTransferPrivate *tra
     {
         totalUploadedBytes += deltaSize;
 
+        // the file sends the putnodes right after this
+        transfer->markStage(STAGE_PUTNODES_SENT);
         transfer->setState(MegaTransfer::STATE_COMPLETING);
         transfer->setTransfer(NULL);
         fireOnTransferUpdate(transfer);
@@ -16809,6 +18402,7 @@ void MegaApiImpl::processTransferComplete(Transfer *tr, MegaTransferPrivate *tra
 void MegaApiImpl::processTransferFailed(Transfer *tr, MegaTransferPrivate *transfer, const Error& e, dstime timeleft)
 {
     auto megaError = make_unique<MegaErrorPrivate>(e, timeleft / 10);
+    transfer->setTrace(tr->traceId, tr->stages);
     transfer->setStartTime(Waiter::ds);
     transfer->setUpdateTime(Waiter::ds);
     transfer->setDeltaSize(0);
@@ -16835,6 +18429,7 @@ void MegaApiImpl::processTransferFailed(Transfer *tr, MegaTransferPrivate *trans
 
 void MegaApiImpl::processTransferRemoved(Transfer *tr, MegaTransferPrivate *transfer, const Error& e)
 {
+    transfer->setTrace(tr->traceId, tr->stages);
     m_off_t deltaSize = tr->size - transfer->getTransferredBytes();
     if (tr->type == GET)
     {
@@ -17542,16 +19137,14 @@ int MegaApiImpl::getNumChildren(MegaNode* p)
         return 0;
     }
 
-    sdkMutex.lock();
+    SdkReadGuard g(*this);
     Node *parent = client->nodebyhandle(p->getHandle());
     if (!parent || parent->type == FILENODE)
     {
-        sdkMutex.unlock();
         return 0;
     }
 
     int numChildren = int(parent->children.size());
-    sdkMutex.unlock();
 
     return numChildren;
 }
@@ -17563,21 +19156,19 @@ int MegaApiImpl::getNumChildFiles(MegaNode* p)
         return 0;
     }
 
-    sdkMutex.lock();
+    SdkReadGuard g(*this);
     Node *parent = client->nodebyhandle(p->getHandle());
     if (!parent || parent->type == FILENODE)
     {
-        sdkMutex.unlock();
         return 0;
     }
 
     int numFiles = 0;
-    for (node_list::iterator it = parent->children.begin(); it != parent->children.end(); it++)
+    for (NodeChildren::iterator it = parent->children.begin(); it != parent->children.end(); it++)
     {
         if ((*it)->type == FILENODE)
             numFiles++;
     }
-    sdkMutex.unlock();
 
     return numFiles;
 }
@@ -17589,21 +19180,19 @@ int MegaApiImpl::getNumChildFolders(MegaNode* p)
         return 0;
     }
 
-    sdkMutex.lock();
+    SdkReadGuard g(*this);
     Node *parent = client->nodebyhandle(p->getHandle());
     if (!parent || parent->type == FILENODE)
     {
-        sdkMutex.unlock();
         return 0;
     }
 
     int numFolders = 0;
-    for (node_list::iterator it = parent->children.begin(); it != parent->children.end(); it++)
+    for (NodeChildren::iterator it = parent->children.begin(); it != parent->children.end(); it++)
     {
         if ((*it)->type != FILENODE)
             numFolders++;
     }
-    sdkMutex.unlock();
 
     return numFolders;
 }
@@ -17618,13 +19207,17 @@ MegaNodeList *MegaApiImpl::getChildren(MegaNode* p, int order)
 
     node_vector childrenNodes;
 
-    SdkMutexGuard guard(sdkMutex);
+    SdkReadGuard g(*this);
 
-    Node *parent = client->nodebyhandle(p->getHandle());
-    if (parent && parent->type != FILENODE)
+    Node *parent;
+    if (const node_vector* sorted = sortedChildren(p->getHandle(), order, g, parent))
+    {
+        childrenNodes = *sorted;
+    }
+    else if (parent && parent->type != FILENODE)
     {
         childrenNodes.reserve(parent->children.size());
-        for (node_list::iterator it = parent->children.begin(); it != parent->children.end(); )
+        for (NodeChildren::iterator it = parent->children.begin(); it != parent->children.end(); )
         {
             childrenNodes.push_back(*it++);
         }
@@ -17636,9 +19229,98 @@ MegaNodeList *MegaApiImpl::getChildren(MegaNode* p, int order)
     return new MegaNodeListPrivate(childrenNodes.data(), int(childrenNodes.size()));
 }
 
+MegaNodeList *MegaApiImpl::getChildren(MegaNode* p, int order, int offset, int limit)
+{
+    if (!p || p->getType() == MegaNode::TYPE_FILE || offset < 0 || limit <= 0)
+    {
+        return new MegaNodeListPrivate();
+    }
+
+    SdkReadGuard g(*this);
+
+    Node *parent;
+    const node_vector* sorted = sortedChildren(p->getHandle(), order, g, parent);
+    if (!sorted && (!parent || parent->type == FILENODE))
+    {
+        return new MegaNodeListPrivate();
+    }
+
+    node_vector childrenNodes;
+    if (!sorted)
+    {
+        // only the page itself is sorted
+        childrenNodes.assign(parent->children.begin(), parent->children.end());
+        if (std::function<bool(Node*, Node*)> comparatorFunction = getComparatorFunction(order, *client))
+        {
+            if (size_t(offset) < childrenNodes.size())
+            {
+                std::nth_element(childrenNodes.begin(), childrenNodes.begin() + offset, childrenNodes.end(), comparatorFunction);
+                auto end = childrenNodes.begin() + std::min(childrenNodes.size(), size_t(offset) + size_t(limit));
+                std::nth_element(childrenNodes.begin() + offset, end - 1, childrenNodes.end(), comparatorFunction);
+                std::sort(childrenNodes.begin() + offset, end, comparatorFunction);
+            }
+        }
+        sorted = &childrenNodes;
+    }
+
+    size_t begin = std::min(sorted->size(), size_t(offset));
+    size_t end = std::min(sorted->size(), begin + size_t(limit));
+    node_vector page(sorted->begin() + begin, sorted->begin() + end);
+    return new MegaNodeListPrivate(page);
+}
+
+const node_vector* MegaApiImpl::sortedChildren(MegaHandle h, int order, SdkReadGuard& g, Node*& parent)
+{
+    // folders with fewer children are just sorted each time
+    const size_t minChildren = 1000;
+
+    parent = client->nodebyhandle(h);
+    if (!parent || parent->type == FILENODE)
+    {
+        return nullptr;
+    }
+
+    if (order == MegaApi::ORDER_ALPHABETICAL_ASC || order == MegaApi::ORDER_ALPHABETICAL_DESC)
+    {
+        order = order == MegaApi::ORDER_ALPHABETICAL_ASC ? MegaApi::ORDER_DEFAULT_ASC : MegaApi::ORDER_DEFAULT_DESC;
+    }
+
+    // only the common orders, which depend on the attributes of the children alone
+    if (order < MegaApi::ORDER_DEFAULT_ASC || order > MegaApi::ORDER_MODIFICATION_DESC)
+    {
+        return nullptr;
+    }
+
+    if (const node_vector* sorted = parent->children.sorted(order))
+    {
+        return sorted;
+    }
+
+    if (parent->children.size() < minChildren)
+    {
+        return nullptr;
+    }
+
+    g.lockExclusive();
+
+    parent = client->nodebyhandle(h);
+    if (!parent || parent->type == FILENODE)
+    {
+        return nullptr;
+    }
+
+    if (const node_vector* sorted = parent->children.sorted(order))
+    {
+        return sorted;
+    }
+
+    LOG_debug << "Keeping " << parent->children.size() << " children sorted in order " << order;
+    return &parent->children.addSorted(order, getComparatorFunction(order, *client));
+}
+
 MegaNodeList *MegaApiImpl::getChildren(MegaNodeList *parentNodes, int order)
 {
-    SdkMutexGuard guard(sdkMutex);
+    SdkReadGuard g(*this);
 
     // prepare a vector with children of every parent node all together
     node_vector childrenNodes;
@@ -17654,7 +19336,7 @@ MegaNodeList *MegaApiImpl::getChildren(MegaNodeList *parentNodes, int order)
         if (parent && parent->type != FILENODE)
         {
             childrenNodes.reserve(childrenNodes.size() + parent->children.size());
-            for (node_list::iterator it = parent->children.begin(); it != parent->children.end(); )
+            for (NodeChildren::iterator it = parent->children.begin(); it != parent->children.end(); )
             {
                 childrenNodes.push_back(*it++);
             }
@@ -17670,6 +19352,81 @@ MegaNodeList *MegaApiImpl::getChildren(MegaNodeList *parentNodes, int order)
     return new MegaNodeListPrivate(childrenNodes.data(), int(childrenNodes.size()));
 }
 
+MegaNodeCursor *MegaApiImpl::getChildrenCursor(MegaNode* p, int order)
+{
+    vector<handle> handles;
+
+    if (p && p->getType() != MegaNode::TYPE_FILE)
+    {
+        SdkReadGuard g(*this);
+
+        Node *parent;
+        const node_vector* sorted = sortedChildren(p->getHandle(), order, g, parent);
+        if (sorted || (parent && parent->type != FILENODE))
+        {
+            node_vector childrenNodes;
+            if (sorted)
+            {
+                childrenNodes = *sorted;
+            }
+            else
+            {
+                childrenNodes.assign(parent->children.begin(), parent->children.end());
+                if (std::function<bool(Node*, Node*)> comparatorFunction = getComparatorFunction(order, *client))
+                {
+                    std::sort(childrenNodes.begin(), childrenNodes.end(), comparatorFunction);
+                }
+            }
+
+            handles.reserve(childrenNodes.size());
+            for (Node* n : childrenNodes)
+            {
+                handles.push_back(n->nodehandle);
+            }
+        }
+    }
+
+    return new MegaNodeCursorPrivate(this, move(handles));
+}
+
+MegaNodeColumns *MegaApiImpl::getChildrenColumns(MegaNode* p, int order)
+{
+    if (!p || p->getType() == MegaNode::TYPE_FILE)
+    {
+        return new MegaNodeColumnsPrivate(node_vector());
+    }
+
+    SdkReadGuard g(*this);
+
+    Node *parent;
+    if (const node_vector* sorted = sortedChildren(p->getHandle(), order, g, parent))
+    {
+        return new MegaNodeColumnsPrivate(*sorted);
+    }
+
+    node_vector childrenNodes;
+    if (parent && parent->type != FILENODE)
+    {
+        childrenNodes.assign(parent->children.begin(), parent->children.end());
+        if (std::function<bool(Node*, Node*)> comparatorFunction = getComparatorFunction(order, *client))
+        {
+            std::sort(childrenNodes.begin(), childrenNodes.end(), comparatorFunction);
+        }
+    }
+    return new MegaNodeColumnsPrivate(childrenNodes);
+}
+
+void MegaApiImpl::getNodesByHandle(const handle* handles, size_t count, vector<MegaNode*>& nodes)
+{
+    SdkReadGuard g(*this);
+
+    nodes.reserve(nodes.size() + count);
+    for (size_t i = 0; i < count; i++)
+    {
+        nodes.push_back(MegaNodePrivate::fromNode(client->nodebyhandle(handles[i])));
+    }
+}
+
 MegaNodeList *MegaApiImpl::getVersions(MegaNode *node)
 {
     if (!node || node->getType() != MegaNode::TYPE_FILE)
@@ -17715,14 +19472,8 @@ int MegaApiImpl::getNumVersions(MegaNode *node)
         return 0;
     }
 
-    int numVersions = 1;
-    while (current->children.size())
-    {
-        assert(current->children.back()->parent == current);
-        current = current->children.back();
-        assert(current->type == FILENODE);
-        numVersions++;
-    }
+    // counted without loading the older versions left in the local cache
+    int numVersions = 1 + int(current->descendantCounts().versions);
     sdkMutex.unlock();
     return numVersions;
 }
@@ -17742,11 +19493,7 @@ bool MegaApiImpl::hasVersions(MegaNode *node)
         return false;
     }
 
-    assert(!current->children.size()
-           || (current->children.back()->parent == current
-               && current->children.back()->type == FILENODE));
-
-    bool result = current->children.size() != 0;
+    bool result = current->children.any();
     sdkMutex.unlock();
     return result;
 }
@@ -17780,7 +19527,7 @@ MegaChildrenLists *MegaApiImpl::getFileFolderChildren(MegaNode *p, int order)
     node_vector files;
     node_vector folders;
 
-    for (node_list::iterator it = parent->children.begin(); it != parent->children.end(); )
+    for (NodeChildren::iterator it = parent->children.begin(); it != parent->children.end(); )
     {
         Node *n = *it++;
         if (n->type == FILENODE)
@@ -17810,16 +19557,14 @@ bool MegaApiImpl::hasChildren(MegaNode *parent)
         return false;
     }
 
-    sdkMutex.lock();
+    SdkReadGuard g(*this);
     Node *p = client->nodebyhandle(parent->getHandle());
     if (!p || p->type == FILENODE)
     {
-        sdkMutex.unlock();
         return false;
     }
 
     bool ret = p->children.size();
-    sdkMutex.unlock();
 
     return ret;
 }
@@ -17831,16 +19576,14 @@ MegaNode *MegaApiImpl::getChildNode(MegaNode *parent, const char* name)
         return NULL;
     }
 
-    sdkMutex.lock();
+    SdkReadGuard g(*this);
     Node *parentNode = client->nodebyhandle(parent->getHandle());
     if (!parentNode || parentNode->type == FILENODE)
     {
-        sdkMutex.unlock();
         return NULL;
     }
 
     MegaNode *node = MegaNodePrivate::fromNode(client->childnodebyname(parentNode, name));
-    sdkMutex.unlock();
     return node;
 }
 
@@ -17987,16 +19730,14 @@ MegaNode* MegaApiImpl::getParentNode(MegaNode* n)
 {
     if(!n) return NULL;
 
-    sdkMutex.lock();
+    SdkReadGuard g(*this);
     Node *node = client->nodebyhandle(n->getHandle());
     if(!node)
     {
-        sdkMutex.unlock();
         return NULL;
     }
 
     MegaNode *result = MegaNodePrivate::fromNode(node->parent);
-    sdkMutex.unlock();
 
     return result;
 }
@@ -18005,7 +19746,7 @@ char* MegaApiImpl::getNodePath(MegaNode *node)
 {
     if(!node) return nullptr;
 
-    SdkMutexGuard guard(sdkMutex);
+    SdkReadGuard g(*this);
     Node *n = client->nodebyhandle(node->getHandle());
     if(!n)
     {
@@ -18016,7 +19757,7 @@ char* MegaApiImpl::getNodePath(MegaNode *node)
 
 char* MegaApiImpl::getNodePathByNodeHandle(MegaHandle handle)
 {
-    SdkMutexGuard guard(sdkMutex);
+    SdkReadGuard g(*this);
     Node *n = client->nodebyhandle(handle);
     if(!n)
     {
@@ -18027,7 +19768,7 @@ char* MegaApiImpl::getNodePathByNodeHandle(MegaHandle handle)
 
 MegaNode* MegaApiImpl::getNodeByPath(const char *path, MegaNode* node)
 {
-    SdkMutexGuard guard(sdkMutex);
+    SdkReadGuard g(*this);
 
     Node* root = nullptr;
 
@@ -18048,9 +19789,8 @@ MegaNode* MegaApiImpl::getNodeByPath(const char *path, MegaNode* node)
 MegaNode* MegaApiImpl::getNodeByHandle(handle handle)
 {
     if(handle == UNDEF) return NULL;
-    sdkMutex.lock();
+    SdkReadGuard g(*this);
     MegaNode *result = MegaNodePrivate::fromNode(client->nodebyhandle(handle));
-    sdkMutex.unlock();
     return result;
 }
 
@@ -18080,7 +19820,10 @@ unsigned MegaApiImpl::sendPendingTransfers()
     SdkMutexGuard guard(sdkMutex);
     DBTableTransactionCommitter committer(client->tctable);
 
-    while(MegaTransferPrivate *transfer = transferQueue.pop())
+    // uploads are fingerprinted on the fingerprint threads while they wait, up to this many ahead
+    const size_t maxFingerprinting = 64;
+
+    while(MegaTransferPrivate *transfer = transferQueue.popReady(client->fingerprintService(), *client->fsaccess, maxFingerprinting))
     {
         error e = API_OK;
         int nextTag = client->nextreqtag();
@@ -18130,8 +19873,18 @@ unsigned MegaApiImpl::sendPendingTransfers()
                 FileFingerprint fp;
                 if (type == FILENODE)
                 {
-                    fp.genfingerprint(fa.get());
+                    // unless it changed since, or it couldn't be read there
+                    auto& job = transfer->mFingerprint;
+                    if (job && !job->failed && job->fingerprint.size == size && job->fingerprint.mtime == fa->mtime)
+                    {
+                        fp = job->fingerprint;
+                    }
+                    else
+                    {
+                        fp.genfingerprint(fa.get());
+                    }
                 }
+                transfer->mFingerprint.reset();
                 fa.reset();
 
                 if (type == FILENODE)
@@ -18188,6 +19941,7 @@ unsigned MegaApiImpl::sendPendingTransfers()
                             client->proctree(samenode, &tc, false, true);
                             tc.allocnodes();
                             client->proctree(samenode, &tc, false, true);
+                            tc.makeattrs(client);
                             tc.nn[0].parenthandle = UNDEF;
 
                             SymmCipher key;
@@ -18556,8 +20310,10 @@ unsigned MegaApiImpl::sendPendingTransfers()
             fireOnTransferFinish(transfer, make_unique<MegaErrorPrivate>(e), committer);
         }
 
-        if (++count > 100 || std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count() > 100)
+        if (++count > 1000 || std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count() > 100)
         {
+            // the rest go in the next batch, as soon as the client had its turn (not at the next network event)
+            waiter->notify();
             break;
         }
     }
@@ -18738,6 +20494,8 @@ void MegaApiImpl::sendPendingRequests()
 
     while(MegaRequestPrivate *request = requestQueue.pop())
     {
+        // the commands sent for the request belong to its trace
+        TraceScope traceScope(request->getTraceId());
 
         // also we avoid yielding for consecutive transaction cancel operations (we used to yeild every time, but we need to keep the sdkMutex lock while the database transaction is ongoing)
         if ((lastRequestType == -1 || lastRequestType == request->getType()) && lastRequestConsecutive < 1024)
@@ -19031,6 +20789,7 @@ void MegaApiImpl::sendPendingRequests()
 
                 // build new nodes array
                 client->proctree(node, &tc, ovhandle != UNDEF);
+                tc.makeattrs(client);
                 if (!nc)
                 {
                     e = API_EARGS;
@@ -19084,7 +20843,7 @@ void MegaApiImpl::sendPendingRequests()
                 [request, this](NodeHandle h, Error e)
                 {
 #ifdef ENABLE_SYNC
-                    client->syncdownrequired = true;
+                    client->requestsyncdown();
 #endif
                     request->setNodeHandle(h.as8byte());
                     fireOnRequestFinish(request, make_unique<MegaErrorPrivate>(e));
@@ -19175,6 +20934,7 @@ void MegaApiImpl::sendPendingRequests()
 
                 // build new nodes array
                 processMegaTree(megaNode, &tc);
+                tc.makeattrs();
 
                 tc.nn[0].parenthandle = UNDEF;
                 tc.nn[0].ovhandle = ovhandle;
@@ -19249,6 +21009,7 @@ void MegaApiImpl::sendPendingRequests()
 
                 // build new nodes array
                 client->proctree(node, &tc, false, ovhandle != UNDEF);
+                tc.makeattrs(client);
                 tc.nn[0].parenthandle = UNDEF;
                 tc.nn[0].ovhandle = ovhandle;
 
@@ -19702,7 +21463,7 @@ void MegaApiImpl::sendPendingRequests()
 
             Node *node = client->nodebyhandle(h);
 
-            if(!dstFilePath || (!fa && !node) || (fa && (!base64key || ISUNDEF(h))))
+            if((!dstFilePath && !request->getFlag()) || (!fa && !node) || (fa && (!base64key || ISUNDEF(h))))
             {
                 e = API_EARGS;
                 break;
@@ -19727,6 +21488,17 @@ void MegaApiImpl::sendPendingRequests()
                 }
                 key.assign((const char *)nodekey, sizeof nodekey);
             }
+            // fetched before, possibly in a previous session
+            string data;
+            handle fah = Node::fileattributehandle(&fileattrstring, (fatype) type);
+            if (fileAttributeDiskCache && !ISUNDEF(fah) && fileAttributeDiskCache->get(fah, data))
+            {
+                LOG_debug << "File attribute taken from the cache";
+                fileAttributeCache.put(h, type, data.data(), data.size());
+                finishNodeAttributeRequest(request, data.data(), data.size());
+                break;
+            }
+
             e = client->getfa(h, &fileattrstring, key, (fatype) type);
             if(e == API_EEXIST)
             {
@@ -22630,11 +24402,11 @@ void MegaApiImpl::sendPendingRequests()
                 break;
             }
 
-            TreeProcFolderInfo folderProcessor;
-            client->proctree(node, &folderProcessor, false, false);
-            MegaFolderInfo *folderInfo = folderProcessor.getResult();
-            request->setMegaFolderInfo(folderInfo);
-            delete folderInfo;
+            // (the versions are counted as files too)
+            NodeCounter nc = node->descendantCounts();
+            MegaFolderInfoPrivate folderInfo(int(nc.files - nc.versions), int(nc.folders), int(nc.versions),
+                                             nc.storage - nc.versionStorage, nc.versionStorage);
+            request->setMegaFolderInfo(&folderInfo);
 
             fireOnRequestFinish(request, make_unique<MegaErrorPrivate>(API_OK));
             break;
@@ -23183,6 +24955,40 @@ bool MegaApiImpl::tryLockMutexFor(long long time)
     }
 }
 
+MegaApiImpl::SdkReadGuard::SdkReadGuard(MegaApiImpl& api)
+    : mMutex(api.sdkMutex)
+{
+    mMutex.lock_shared();
+
+    if (api.client && api.client->mCachedNodeIndex)
+    {
+        lockExclusive();
+    }
+}
+
+MegaApiImpl::SdkReadGuard::~SdkReadGuard()
+{
+    if (mExclusive)
+    {
+        mMutex.unlock();
+    }
+    else
+    {
+        mMutex.unlock_shared();
+    }
+}
+
+void MegaApiImpl::SdkReadGuard::lockExclusive()
+{
+    if (!mExclusive)
+    {
+        // (can't be upgraded in place, so the tree may change in between: check again whatever was looked up)
+        mMutex.unlock_shared();
+        mMutex.lock();
+        mExclusive = true;
+    }
+}
+
 void MegaApiImpl::getBanners(MegaRequestListener *listener)
 {
     MegaRequestPrivate *request = new MegaRequestPrivate(MegaRequest::TYPE_GET_BANNERS, listener);
@@ -23379,16 +25185,21 @@ void MegaApiImpl::drive_presence_changed(bool appeared, const LocalPath& driveRo
 void TreeProcCopy::allocnodes()
 {
     nn.resize(nc);
+    attrjson.resize(nc);
     allocated = true;
 }
 
+void TreeProcCopy::makeattrs(MegaClient* client)
+{
+    client->makeattrs(nn, attrjson);
+    attrjson.clear();
+}
+
 // determine node tree size (nn = NULL) or write node tree to new nodes array
 void TreeProcCopy::proc(MegaClient* client, Node* n)
 {
     if (allocated)
     {
-        string attrstring;
-        SymmCipher key;
         assert(nc > 0);
         NewNode* t = &nn[--nc];
 
@@ -23410,8 +25221,6 @@ void TreeProcCopy::proc(MegaClient* client, Node* n)
         t->attrstring.reset(new string);
         if(t->nodekey.size())
         {
-            key.setkey((const byte*)t->nodekey.data(),n->type);
-
             AttrMap tattrs;
             tattrs.map = n->attrs.map;
             nameid rrname = AttrMap::string2nameid("rr");
@@ -23422,8 +25231,7 @@ void TreeProcCopy::proc(MegaClient* client, Node* n)
                 tattrs.map.erase(it);
             }
 
-            tattrs.getjson(&attrstring);
-            client->makeattr(&key, t->attrstring, attrstring.c_str());
+            tattrs.getjson(&attrjson[nc]);
         }
     }
     else nc++;
@@ -23438,48 +25246,93 @@ TransferQueue::TransferQueue()
 {
 }
 
+void TransferQueue::takeIncoming()
+{
+    incoming.drainInto(transfers);
+}
+
 void TransferQueue::push(MegaTransferPrivate *transfer)
 {
-    mutex.lock();
-    transfers.push_back(transfer);
     transfer->setPlaceInQueue(++lastPushedTransferTag);
-    mutex.unlock();
+    incoming.push(transfer);
+}
+
+void TransferQueue::push(const std::vector<MegaTransferPrivate *>& batch)
+{
+    int place = lastPushedTransferTag.fetch_add(int(batch.size()));
+    for (MegaTransferPrivate *transfer : batch)
+    {
+        transfer->setPlaceInQueue(++place);
+    }
+    incoming.push(batch.begin(), batch.end());
 }
 
 void TransferQueue::push_front(MegaTransferPrivate *transfer)
 {
-    mutex.lock();
+    std::lock_guard<std::mutex> g(mutex);
+    takeIncoming();
     transfers.push_front(transfer);
-    mutex.unlock();
 }
 
 MegaTransferPrivate *TransferQueue::pop()
 {
-    mutex.lock();
-    if(transfers.empty())
+    std::lock_guard<std::mutex> g(mutex);
+    if (transfers.empty())
     {
-        mutex.unlock();
-        return NULL;
+        takeIncoming();
+        if (transfers.empty())
+        {
+            return NULL;
+        }
     }
     MegaTransferPrivate *transfer = transfers.front();
     transfers.pop_front();
-    mutex.unlock();
     return transfer;
 }
 
-std::vector<MegaTransferPrivate *> TransferQueue::popUpTo(int lastQueuedTransfer, int direction)
+MegaTransferPrivate *TransferQueue::popReady(FingerprintService *fingerprints, const FileSystemAccess &fsaccess, size_t maxWaiting)
 {
     std::lock_guard<std::mutex> g(mutex);
-    std::vector<MegaTransferPrivate*> toret;
-    for (auto it = transfers.begin(); it != transfers.end();)
+    if (transfers.size() < maxWaiting)
+    {
+        takeIncoming();
+    }
+
+    size_t waiting = 0;
+    for (auto it = transfers.begin(); it != transfers.end(); it++)
     {
         MegaTransferPrivate *transfer = *it;
-        if (transfer->getPlaceInQueue() > lastQueuedTransfer)
+        if (fingerprints && !transfer->mFingerprint && transfer->getType() == MegaTransfer::TYPE_UPLOAD && transfer->getPath())
+        {
+            transfer->mFingerprint = fingerprints->queue(LocalPath::fromPath(transfer->getPath(), fsaccess));
+        }
+
+        if (!transfer->mFingerprint || transfer->mFingerprint->done())
+        {
+            transfers.erase(it);
+            return transfer;
+        }
+
+        if (++waiting >= maxWaiting)
         {
             break;
         }
+    }
+    return NULL;
+}
 
-        if (!transfer->isSyncTransfer() && transfer->getType() == direction)
+std::vector<MegaTransferPrivate *> TransferQueue::popUpTo(int lastQueuedTransfer, int direction)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    takeIncoming();
+
+    // concurrent pushes may be a little out of order, so look at all of them
+    std::vector<MegaTransferPrivate*> toret;
+    for (auto it = transfers.begin(); it != transfers.end();)
+    {
+        MegaTransferPrivate *transfer = *it;
+        if (transfer->getPlaceInQueue() <= lastQueuedTransfer
+                && !transfer->isSyncTransfer() && transfer->getType() == direction)
         {
             toret.push_back(transfer);
             it = transfers.erase(it);
@@ -23494,26 +25347,38 @@ std::vector<MegaTransferPrivate *> TransferQueue::popUpTo(int lastQueuedTransfer
 
 void TransferQueue::removeWithFolderTag(int folderTag, std::function<void(MegaTransferPrivate *)> callback)
 {
-    for (auto it = transfers.begin(); it != transfers.end();)
+    std::vector<MegaTransferPrivate *> removed;
     {
-        if ((*it)->getFolderTransferTag() == folderTag)
+        std::lock_guard<std::mutex> g(mutex);
+        takeIncoming();
+        for (auto it = transfers.begin(); it != transfers.end();)
         {
-            if (callback)
+            if ((*it)->getFolderTransferTag() == folderTag)
             {
-                callback(*it);
+                removed.push_back(*it);
+                it = transfers.erase(it);
+            }
+            else
+            {
+                it++;
             }
-            it = transfers.erase(it);
         }
-        else
+    }
+
+    // out of the lock, as the callback may notify the app and it may use the queue
+    if (callback)
+    {
+        for (MegaTransferPrivate *transfer : removed)
         {
-            it++;
+            callback(transfer);
         }
     }
 }
 
 void TransferQueue::removeListener(MegaTransferListener *listener)
 {
-    mutex.lock();
+    std::lock_guard<std::mutex> g(mutex);
+    takeIncoming();
 
     std::deque<MegaTransferPrivate *>::iterator it = transfers.begin();
     while(it != transfers.end())
@@ -23523,58 +25388,313 @@ void TransferQueue::removeListener(MegaTransferListener *listener)
             transfer->setListener(NULL);
         it++;
     }
+}
 
-    mutex.unlock();
+FileAttributeMemoryCache::FileAttributeMemoryCache(size_t maxSize)
+    : mMaxSize(maxSize)
+{
+}
+
+FileAttributeMemoryCache::~FileAttributeMemoryCache()
+{
+    CodeCounter::accountMemory(CodeCounter::MEM_FILE_ATTRIBUTES, -int64_t(mSize));
+}
+
+bool FileAttributeMemoryCache::get(handle h, int type, string& data)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    auto it = entries.find(Key(h, type));
+    if (it == entries.end())
+    {
+        return false;
+    }
+
+    mLru.splice(mLru.end(), mLru, it->second.lru);
+    data = it->second.data;
+    return true;
+}
+
+void FileAttributeMemoryCache::put(handle h, int type, const char *data, size_t len)
+{
+    if (len > mMaxSize)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> g(mutex);
+    Key key(h, type);
+    auto it = entries.find(key);
+    if (it != entries.end())
+    {
+        mSize -= it->second.data.size();
+        CodeCounter::accountMemory(CodeCounter::MEM_FILE_ATTRIBUTES, -int64_t(it->second.data.size()));
+        mLru.erase(it->second.lru);
+        entries.erase(it);
+    }
+
+    evict(mMaxSize - len);
+
+    Entry& entry = entries[key];
+    entry.data.assign(data, len);
+    entry.lru = mLru.insert(mLru.end(), key);
+    mSize += len;
+    CodeCounter::accountMemory(CodeCounter::MEM_FILE_ATTRIBUTES, int64_t(len));
+}
+
+void FileAttributeMemoryCache::remove(handle h)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    auto it = entries.lower_bound(Key(h, std::numeric_limits<int>::min()));
+    while (it != entries.end() && it->first.first == h)
+    {
+        mSize -= it->second.data.size();
+        CodeCounter::accountMemory(CodeCounter::MEM_FILE_ATTRIBUTES, -int64_t(it->second.data.size()));
+        mLru.erase(it->second.lru);
+        it = entries.erase(it);
+    }
+}
+
+void FileAttributeMemoryCache::clear()
+{
+    std::lock_guard<std::mutex> g(mutex);
+    CodeCounter::accountMemory(CodeCounter::MEM_FILE_ATTRIBUTES, -int64_t(mSize));
+    entries.clear();
+    mLru.clear();
+    mSize = 0;
+}
+
+size_t FileAttributeMemoryCache::size()
+{
+    std::lock_guard<std::mutex> g(mutex);
+    return mSize;
+}
+
+size_t FileAttributeMemoryCache::trim(size_t keep)
+{
+    std::lock_guard<std::mutex> g(mutex);
+    size_t before = mSize;
+    evict(keep);
+    return before - mSize;
+}
+
+void FileAttributeMemoryCache::evict(size_t maxSize)
+{
+    while (mSize > maxSize)
+    {
+        auto oldest = entries.find(mLru.front());
+        mSize -= oldest->second.data.size();
+        CodeCounter::accountMemory(CodeCounter::MEM_FILE_ATTRIBUTES, -int64_t(oldest->second.data.size()));
+        entries.erase(oldest);
+        mLru.pop_front();
+    }
+}
+
+FileAttributeDiskCache::FileAttributeDiskCache(FileSystemAccess& fsaccess, const LocalPath& folder, m_off_t maxSize)
+    : fsaccess(fsaccess), folder(folder), mMaxSize(maxSize)
+{
+}
+
+LocalPath FileAttributeDiskCache::pathFor(handle fah) const
+{
+    LocalPath path = folder;
+    path.appendWithSeparator(LocalPath::fromPath(Base64Str<sizeof(handle)>(fah).chars, fsaccess), true);
+    return path;
+}
+
+void FileAttributeDiskCache::load()
+{
+    loaded = true;
+
+    LocalPath path = folder;
+    fsaccess.mkdirlocal(path);
+
+    std::unique_ptr<DirAccess> da(fsaccess.newdiraccess());
+    if (!da->dopen(&path, NULL, false))
+    {
+        LOG_warn << "Unable to open the file attribute cache";
+        return;
+    }
+
+    // the modification time of the files keeps the order of use across sessions
+    multimap<m_time_t, pair<handle, m_off_t>> files;
+    LocalPath name;
+    nodetype_t type;
+    while (da->dnext(path, name, false, &type))
+    {
+        LocalPath filePath = folder;
+        filePath.appendWithSeparator(name, true);
+
+        handle fah = 0;
+        string leaf = name.toPath(fsaccess);
+        auto fa = fsaccess.newfileaccess();
+        if (type != FILENODE || leaf.size() != Base64Str<sizeof(handle)>::STRLEN
+                || Base64::atob(leaf.c_str(), (byte*)&fah, sizeof fah) != sizeof fah
+                || !fa->fopen(filePath, true, false))
+        {
+            continue;
+        }
+        files.emplace(fa->mtime, std::make_pair(fah, fa->size));
+    }
+
+    for (auto& f : files)
+    {
+        Entry& entry = entries[f.second.first];
+        entry.size = f.second.second;
+        entry.lru = mLru.insert(mLru.end(), f.second.first);
+        mSize += entry.size;
+    }
+
+    while (mSize > mMaxSize)
+    {
+        remove(entries.find(mLru.front()));
+    }
+
+    LOG_debug << "File attribute cache loaded: " << entries.size() << " files, " << mSize << " bytes";
+}
+
+void FileAttributeDiskCache::remove(map<handle, Entry>::iterator it)
+{
+    LocalPath path = pathFor(it->first);
+    fsaccess.unlinklocal(path);
+    mSize -= it->second.size;
+    mLru.erase(it->second.lru);
+    entries.erase(it);
+}
+
+bool FileAttributeDiskCache::get(handle fah, string& data)
+{
+    if (!loaded)
+    {
+        load();
+    }
+
+    auto it = entries.find(fah);
+    if (it == entries.end())
+    {
+        return false;
+    }
+
+    LocalPath path = pathFor(fah);
+    auto fa = fsaccess.newfileaccess();
+    if (!fa->fopen(path, true, false) || fa->size != it->second.size
+            || !fa->fread(&data, unsigned(fa->size), 0, 0))
+    {
+        LOG_warn << "Unable to read a cached file attribute";
+        fa.reset();
+        remove(it);
+        return false;
+    }
+    fa.reset();
+
+    mLru.splice(mLru.end(), mLru, it->second.lru);
+    fsaccess.setmtimelocal(path, m_time());
+    return true;
+}
+
+void FileAttributeDiskCache::put(handle fah, const char *data, size_t len)
+{
+    if (!loaded)
+    {
+        load();
+    }
+
+    // the handle identifies the content
+    if (m_off_t(len) > mMaxSize || entries.count(fah))
+    {
+        return;
+    }
+
+    LocalPath path = pathFor(fah);
+    fsaccess.unlinklocal(path);
+    auto fa = fsaccess.newfileaccess();
+    if (!fa->fopen(path, false, true) || !fa->fwrite((const byte*)data, unsigned(len), 0))
+    {
+        LOG_warn << "Unable to write a file attribute to the cache";
+        fa.reset();
+        fsaccess.unlinklocal(path);
+        return;
+    }
+    fa.reset();
+
+    Entry& entry = entries[fah];
+    entry.size = m_off_t(len);
+    entry.lru = mLru.insert(mLru.end(), fah);
+    mSize += entry.size;
+
+    while (mSize > mMaxSize)
+    {
+        remove(entries.find(mLru.front()));
+    }
+}
+
+void FileAttributeDiskCache::clear()
+{
+    if (!loaded)
+    {
+        load();
+    }
+
+    while (!entries.empty())
+    {
+        remove(entries.begin());
+    }
 }
 
 RequestQueue::RequestQueue()
 {
 }
 
+void RequestQueue::takeIncoming()
+{
+    incoming.drainInto(requests);
+}
+
 void RequestQueue::push(MegaRequestPrivate *request)
 {
-    mutex.lock();
-    requests.push_back(request);
-    mutex.unlock();
+    incoming.push(request);
 }
 
 void RequestQueue::push_front(MegaRequestPrivate *request)
 {
-    mutex.lock();
+    std::lock_guard<std::mutex> g(mutex);
+    takeIncoming();
     requests.push_front(request);
-    mutex.unlock();
 }
 
 MegaRequestPrivate *RequestQueue::pop()
 {
-    mutex.lock();
-    if(requests.empty())
+    std::lock_guard<std::mutex> g(mutex);
+    if (requests.empty())
     {
-        mutex.unlock();
-        return NULL;
+        takeIncoming();
+        if (requests.empty())
+        {
+            return NULL;
+        }
     }
     MegaRequestPrivate *request = requests.front();
     requests.pop_front();
-    mutex.unlock();
     return request;
 }
 
 MegaRequestPrivate *RequestQueue::front()
 {
-    mutex.lock();
-    if(requests.empty())
+    std::lock_guard<std::mutex> g(mutex);
+    if (requests.empty())
     {
-        mutex.unlock();
-        return NULL;
+        takeIncoming();
+        if (requests.empty())
+        {
+            return NULL;
+        }
     }
-    MegaRequestPrivate *request = requests.front();
-    mutex.unlock();
-    return request;
+    return requests.front();
 }
 
 void RequestQueue::removeListener(MegaRequestListener *listener)
 {
-    mutex.lock();
+    std::lock_guard<std::mutex> g(mutex);
+    takeIncoming();
 
     std::deque<MegaRequestPrivate *>::iterator it = requests.begin();
     while(it != requests.end())
@@ -23584,13 +25704,12 @@ void RequestQueue::removeListener(MegaRequestListener *listener)
             request->setListener(NULL);
         it++;
     }
-
-    mutex.unlock();
 }
 
 void RequestQueue::removeListener(MegaScheduledCopyListener *listener)
 {
-    mutex.lock();
+    std::lock_guard<std::mutex> g(mutex);
+    takeIncoming();
 
     std::deque<MegaRequestPrivate *>::iterator it = requests.begin();
     while(it != requests.end())
@@ -23600,8 +25719,361 @@ void RequestQueue::removeListener(MegaScheduledCopyListener *listener)
             request->setBackupListener(NULL);
         it++;
     }
+}
 
-    mutex.unlock();
+MegaCallbackDispatcher::MegaCallbackDispatcher(size_t capacity, int backpressure)
+    : mBackpressure(backpressure)
+    , mRing(std::max<size_t>(capacity, 1))
+{
+    mThread = std::thread([this]()
+    {
+        ThreadRoles::enter(ThreadRoles::SDK, "mega-callbacks");
+        loop();
+    });
+}
+
+MegaCallbackDispatcher::~MegaCallbackDispatcher()
+{
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        mExit = true;
+    }
+    mWakeup.notify_one();
+    mThread.join();
+
+    for (auto& p : mProgress)
+    {
+        delete p.second->exchange(nullptr);
+    }
+}
+
+bool MegaCallbackDispatcher::full() const
+{
+    return mTail.load(std::memory_order_relaxed) - mHead.load(std::memory_order_acquire) >= mRing.size();
+}
+
+size_t MegaCallbackDispatcher::size() const
+{
+    size_t n = mTail.load() - mHead.load();
+    if (mOverflowing)
+    {
+        std::lock_guard<std::mutex> g(mOverflowMutex);
+        n += mOverflow.size();
+    }
+    return n;
+}
+
+void MegaCallbackDispatcher::push(Callback&& callback)
+{
+    if (!mOverflowing && full())
+    {
+        // backpressure: wait for room, for a while
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(MAX_BLOCK_MS);
+        while (full() && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    enqueue(std::move(callback));
+}
+
+void MegaCallbackDispatcher::pushProgress(int key, Callback&& callback)
+{
+    if (mBackpressure == DROP && (mOverflowing || full()))
+    {
+        return;
+    }
+
+    if (mBackpressure == COALESCE && key)
+    {
+        auto& latest = mProgress[key];
+        if (!latest)
+        {
+            latest = std::make_shared<std::atomic<Callback*>>(nullptr);
+        }
+
+        if (Callback* replaced = latest->exchange(new Callback(std::move(callback))))
+        {
+            // the previous one wasn't delivered yet: this one goes in its place
+            delete replaced;
+            return;
+        }
+
+        auto queued = latest;
+        push([queued]() {
+            unique_ptr<Callback> cb(queued->exchange(nullptr));
+            if (cb)
+            {
+                (*cb)();
+            }
+        });
+        return;
+    }
+
+    push(std::move(callback));
+}
+
+void MegaCallbackDispatcher::endProgress(int key)
+{
+    mProgress.erase(key);
+}
+
+void MegaCallbackDispatcher::enqueue(Callback&& callback)
+{
+    Entry entry;
+    entry.seq = ++mPushed;
+    entry.callback = std::move(callback);
+
+    if (!mOverflowing && !full())
+    {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        mRing[tail % mRing.size()] = std::move(entry);
+        mTail.store(tail + 1);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> g(mOverflowMutex);
+        mOverflow.push_back(std::move(entry));
+        mOverflowing = true;
+    }
+
+    if (mSleeping)
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        mWakeup.notify_one();
+    }
+}
+
+bool MegaCallbackDispatcher::dequeue(Entry& entry)
+{
+    size_t head = mHead.load(std::memory_order_relaxed);
+    if (head != mTail.load())
+    {
+        entry = std::move(mRing[head % mRing.size()]);
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // the overflow only takes callbacks while the ring is full, so it goes after it
+    if (mOverflowing)
+    {
+        std::lock_guard<std::mutex> g(mOverflowMutex);
+        if (!mOverflow.empty())
+        {
+            entry = std::move(mOverflow.front());
+            mOverflow.pop_front();
+            mOverflowing = !mOverflow.empty();
+            return true;
+        }
+    }
+    return false;
+}
+
+void MegaCallbackDispatcher::loop()
+{
+    Entry entry;
+    for (;;)
+    {
+        if (!dequeue(entry))
+        {
+            std::unique_lock<std::mutex> g(mMutex);
+            mSleeping = true;
+            if (dequeue(entry))
+            {
+                mSleeping = false;
+            }
+            else
+            {
+                if (mExit)
+                {
+                    mSleeping = false;
+                    return;
+                }
+                mWakeup.wait_for(g, std::chrono::milliseconds(100));
+                mSleeping = false;
+                continue;
+            }
+        }
+
+        mCurrentSeq = entry.seq;
+        entry.callback();
+        entry.callback = nullptr;
+
+        std::lock_guard<std::mutex> g(mMutex);
+        for (auto it = mRevoked.begin(); it != mRevoked.end(); )
+        {
+            if (it->second <= mCurrentSeq)
+            {
+                it = mRevoked.erase(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+    }
+}
+
+void MegaCallbackDispatcher::deliver(void* listener, const std::function<void()>& f)
+{
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        auto it = mRevoked.find(listener);
+        if (it != mRevoked.end() && it->second >= mCurrentSeq)
+        {
+            return;
+        }
+        mInFlight = listener;
+    }
+
+    f();
+
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        mInFlight = nullptr;
+    }
+    mDelivered.notify_all();
+}
+
+void MegaCallbackDispatcher::revoke(void* listener)
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    mRevoked[listener] = mPushed;
+}
+
+void MegaCallbackDispatcher::waitDelivered(void* listener)
+{
+    if (isDispatcherThread())
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> g(mMutex);
+    mDelivered.wait(g, [this, listener]() { return mInFlight != listener; });
+}
+
+bool MegaCallbackDispatcher::isDispatcherThread() const
+{
+    return std::this_thread::get_id() == mThread.get_id();
+}
+
+LocalFolderCreator::LocalFolderCreator(Waiter& waiter, unsigned threadCount)
+    : mWaiter(waiter)
+{
+    for (unsigned i = std::max(threadCount, 1u); i--; )
+    {
+        try
+        {
+            mThreads.emplace_back([this]()
+            {
+                ThreadRoles::enter(ThreadRoles::IO, "mega-mkdir");
+                loop();
+            });
+        }
+        catch (std::system_error& e)
+        {
+            LOG_err << "Failed to start folder creation thread: " << e.what();
+            break;
+        }
+    }
+
+    LOG_debug << "Folder creation threads running: " << mThreads.size();
+}
+
+LocalFolderCreator::~LocalFolderCreator()
+{
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        mExit = true;
+    }
+    mWakeup.notify_all();
+
+    for (auto& thread : mThreads)
+    {
+        thread.join();
+    }
+
+    for (auto& job : mQueued)
+    {
+        job->result = API_EWRITE;
+        job->mDone = true;
+    }
+}
+
+std::shared_ptr<LocalFolderCreator::Job> LocalFolderCreator::queue(const LocalPath& path)
+{
+    auto job = std::make_shared<Job>(path);
+
+    if (mThreads.empty())
+    {
+        // nobody to hand it to: create it right away
+        MegaFileSystemAccess fsaccess;
+        create(fsaccess, *job);
+        job->mDone = true;
+        return job;
+    }
+
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        mQueued.push_back(job);
+    }
+    mWakeup.notify_one();
+
+    return job;
+}
+
+void LocalFolderCreator::loop()
+{
+    MegaFileSystemAccess fsaccess;
+
+    std::unique_lock<std::mutex> g(mMutex);
+
+    for (;;)
+    {
+        if (mExit)
+        {
+            return;
+        }
+
+        if (mQueued.empty())
+        {
+            mWakeup.wait(g);
+            continue;
+        }
+
+        std::shared_ptr<Job> job = std::move(mQueued.front());
+        mQueued.pop_front();
+
+        // nobody wants it any longer
+        if (job.use_count() == 1)
+        {
+            continue;
+        }
+
+        g.unlock();
+        create(fsaccess, *job);
+        job->mDone = true;
+        mWaiter.notify();
+        g.lock();
+    }
+}
+
+void LocalFolderCreator::create(FileSystemAccess& fsaccess, Job& job)
+{
+    LocalPath path = job.path;
+
+    auto da = fsaccess.newfileaccess();
+    if (!da->fopen(path, true, false))
+    {
+        if (!fsaccess.mkdirlocal(path))
+        {
+            job.result = API_EWRITE;
+        }
+    }
+    else if (da->type == FILENODE)
+    {
+        job.result = API_EEXIST;
+    }
 }
 
 MegaHashSignatureImpl::MegaHashSignatureImpl(const char *base64Key)
@@ -24527,6 +26999,72 @@ bool MegaSyncPrivate::isTemporaryDisabled() const
 }
 
 
+MegaSyncStatsPrivate::MegaSyncStatsPrivate(handle backupId, const SyncStats& stats)
+    : mBackupId(backupId)
+    , mStats(stats)
+{
+}
+
+MegaSyncStats *MegaSyncStatsPrivate::copy() const
+{
+    return new MegaSyncStatsPrivate(*this);
+}
+
+MegaHandle MegaSyncStatsPrivate::getBackupId() const
+{
+    return mBackupId;
+}
+
+long long MegaSyncStatsPrivate::getQueuedNotifications() const
+{
+    return mStats.queued[DirNotify::DIREVENTS] + mStats.queued[DirNotify::EXTRA];
+}
+
+long long MegaSyncStatsPrivate::getRetryNotifications() const
+{
+    return mStats.queued[DirNotify::RETRY];
+}
+
+long long MegaSyncStatsPrivate::getLastFullReconcile() const
+{
+    return mStats.lastFullReconcile;
+}
+
+long long MegaSyncStatsPrivate::getScannedFiles() const
+{
+    return mStats.scannedFiles;
+}
+
+double MegaSyncStatsPrivate::getScannedFilesPerSecond() const
+{
+    return mStats.scannedFilesPerSecond;
+}
+
+long long MegaSyncStatsPrivate::getPendingUploadBytes() const
+{
+    return mStats.pendingUploadBytes;
+}
+
+long long MegaSyncStatsPrivate::getPendingPutnodes() const
+{
+    return mStats.pendingPutnodes;
+}
+
+long long MegaSyncStatsPrivate::getLatencySamples() const
+{
+    return mStats.latencySamples;
+}
+
+long long MegaSyncStatsPrivate::getLatencyP50() const
+{
+    return mStats.latencyP50;
+}
+
+long long MegaSyncStatsPrivate::getLatencyP99() const
+{
+    return mStats.latencyP99;
+}
+
 MegaSyncListPrivate::MegaSyncListPrivate()
 {
     list = NULL;
@@ -24810,8 +27348,16 @@ MegaTreeProcCopy::MegaTreeProcCopy(MegaClient *client)
 void MegaTreeProcCopy::allocnodes()
 {
     nn.resize(nc);
+    attrjson.resize(nc);
     allocated = true;
 }
+
+void MegaTreeProcCopy::makeattrs()
+{
+    client->makeattrs(nn, attrjson);
+    attrjson.clear();
+}
+
 bool MegaTreeProcCopy::processMegaNode(MegaNode *n)
 {
     if (allocated)
@@ -24840,10 +27386,8 @@ bool MegaTreeProcCopy::processMegaNode(MegaNode *n)
             t->source = NEW_NODE;
         }
 
-        SymmCipher key;
         AttrMap attrs;
 
-        key.setkey((const byte*)t->nodekey.data(),n->getType());
         string sname = n->getName();
         client->fsaccess->normalize(&sname);
         attrs.map['n'] = sname;
@@ -24868,9 +27412,7 @@ bool MegaTreeProcCopy::processMegaNode(MegaNode *n)
             }
         }
 
-        string attrstring;
-        attrs.getjson(&attrstring);
-        client->makeattr(&key, t->attrstring, attrstring.c_str());
+        attrs.getjson(&attrjson[nc]);
 
         t->nodehandle = n->getHandle();
         t->type = (nodetype_t)n->getType();
@@ -24902,32 +27444,78 @@ void MegaFolderUploadController::start(MegaNode*)
     transfer->setState(MegaTransfer::STATE_QUEUED);
     megaApi->fireOnTransferStart(transfer);
 
-    const char *name = transfer->getFileName();
-    MegaNode *parent = megaApi->getNodeByHandle(transfer->getParentHandle());
-    if(!parent)
+    Node* parent = client->nodebyhandle(transfer->getParentHandle());
+    if (!parent)
     {
         transfer->setState(MegaTransfer::STATE_FAILED);
         DBTableTransactionCommitter committer(client->tctable);
         megaApi->fireOnTransferFinish(transfer, make_unique<MegaErrorPrivate>(API_EARGS), committer);
+        return;
+    }
+
+    recursive++;
+
+    // the local folder is the only subfolder of a root standing for the remote parent
+    mRoot.reset(new Folder);
+    mRoot->remote = parent->nodehandle;
+    mRoot->subfolders.emplace_back(new Folder);
+    Folder& folder = *mRoot->subfolders.back();
+    folder.localPath = LocalPath::fromPath(transfer->getPath(), *client->fsaccess);
+    folder.name = transfer->getFileName();
+    folder.parent = mRoot.get();
+
+    mFsType = client->fsaccess->getlocalfstype(folder.localPath);
+    scan(folder);
+
+    Node* child = client->childnodebyname(parent, folder.name.c_str(), false);
+    if (child && child->type == FOLDERNODE)
+    {
+        folder.remote = child->nodehandle;
+        onFolderAvailable(folder);
     }
     else
     {
-        auto localpath = LocalPath::fromPath(transfer->getPath(), *client->fsaccess);
-        MegaNode *child = megaApi->getChildNode(parent, name);
+        createSubfolders(*mRoot);
+    }
 
-        if(!child || !child->isFolder())
+    recursive--;
+    checkCompletion();
+}
+
+void MegaFolderUploadController::scan(Folder& folder)
+{
+    unique_ptr<DirAccess> da(client->fsaccess->newdiraccess());
+    LocalPath localPath = folder.localPath;
+    if (!da->dopen(&localPath, NULL, false))
+    {
+        return;
+    }
+
+    LocalPath localname;
+    nodetype_t dirEntryType;
+    while (da->dnext(localPath, localname, client->followsymlinks, &dirEntryType))
+    {
+        ScopedLengthRestore restoreLen(localPath);
+        localPath.appendWithSeparator(localname, false);
+
+        if (dirEntryType == FILENODE)
         {
-            pendingFolders.push_back(localpath);
-            megaApi->createFolder(name, parent, this);
+            folder.files.push_back(localPath);
         }
-        else
+        else if (dirEntryType == FOLDERNODE)
         {
-            pendingFolders.push_front(localpath);
-            onFolderAvailable(child->getHandle());
+            folder.subfolders.emplace_back(new Folder);
+            Folder& subfolder = *folder.subfolders.back();
+            subfolder.localPath = localPath;
+            subfolder.name = localname.toName(*client->fsaccess, mFsType);
+            subfolder.parent = &folder;
         }
+    }
+    da.reset();
 
-        delete child;
-        delete parent;
+    for (auto& subfolder : folder.subfolders)
+    {
+        scan(*subfolder);
     }
 }
 
@@ -25027,89 +27615,153 @@ void MegaFolderUploadController::cancel()
     transfer = nullptr;  // no final callback for this one since it is being destroyed now
 }
 
-void MegaFolderUploadController::onFolderAvailable(MegaHandle handle)
+void MegaFolderUploadController::onFolderAvailable(Folder& folder)
 {
-    recursive++;
-    auto localPath = pendingFolders.front();
-    pendingFolders.pop_front();
+    Node* node = client->nodebyhandle(folder.remote);
+    if (!node)
+    {
+        // removed meanwhile
+        mLastError = MegaErrorPrivate(API_ENOENT);
+        mIncompleteTransfers++;
+        return;
+    }
 
-    MegaNode *parent = megaApi->getNodeByHandle(handle);
+    recursive++;
 
-    LocalPath localname;
-    DirAccess* da;
-    da = client->fsaccess->newdiraccess();
-    if (da->dopen(&localPath, NULL, false))
+    unique_ptr<MegaNode> parent(MegaNodePrivate::fromNode(node));
+    for (const LocalPath& file : folder.files)
     {
-        FileSystemType fsType = client->fsaccess->getlocalfstype(localPath);
+        pendingTransfers++;
+        megaApi->startUpload(false, file.toPath(*client->fsaccess).c_str(), parent.get(), (const char *)NULL, -1, tag, false, NULL, false, false, mFsType, this);
+    }
 
-        nodetype_t dirEntryType;
-        while (da->dnext(localPath, localname, client->followsymlinks, &dirEntryType))
+    for (auto& subfolder : folder.subfolders)
+    {
+        if (ISUNDEF(subfolder->remote) && !subfolder->requested)
         {
-            ScopedLengthRestore restoreLen(localPath);
-            localPath.appendWithSeparator(localname, false);
-
-            string name = localname.toName(*client->fsaccess, fsType);
-            if (dirEntryType == FILENODE)
+            Node* child = client->childnodebyname(node, subfolder->name.c_str(), false);
+            if (child && child->type == FOLDERNODE)
             {
-                pendingTransfers++;
-                megaApi->startUpload(false, localPath.toPath(*client->fsaccess).c_str(), parent, (const char *)NULL, -1, tag, false, NULL, false, false, fsType, this);
-            }
-            else if (dirEntryType == FOLDERNODE)
-            {
-                MegaNode *child = megaApi->getChildNode(parent, name.c_str());
-                if(!child || !child->isFolder())
-                {
-                    pendingFolders.push_back(localPath);
-                    megaApi->createFolder(name.c_str(), parent, this);
-                }
-                else
-                {
-                    pendingFolders.push_front(localPath);
-                    onFolderAvailable(child->getHandle());
-                }
-                delete child;
+                subfolder->remote = child->nodehandle;
             }
         }
+
+        // those created along with this one are already there
+        if (!ISUNDEF(subfolder->remote))
+        {
+            onFolderAvailable(*subfolder);
+        }
     }
 
-    delete da;
-    delete parent;
-    recursive--;
+    createSubfolders(folder);
 
-    checkCompletion();
+    recursive--;
 }
 
-void MegaFolderUploadController::checkCompletion()
+void MegaFolderUploadController::createSubfolders(Folder& target)
 {
-    if (!cancelled && !recursive && !pendingFolders.size() && !pendingTransfers)
+    // breadth first, so that a batch cut at MAX_NEWNODES still creates whole levels; the rest of a subtree
+    // goes once the folders it hangs from exist
+    std::deque<Folder*> queue;
+    for (auto& subfolder : target.subfolders)
     {
-        LOG_debug << "Folder transfer finished - " << transfer->getTransferredBytes() << " of " << transfer->getTotalBytes();
-        transfer->setState(MegaTransfer::STATE_COMPLETED);
-        transfer->setLastError(&mLastError);
-        DBTableTransactionCommitter committer(client->tctable);
-        megaApi->fireOnTransferFinish(transfer, make_unique<MegaErrorPrivate>(!mIncompleteTransfers ? API_OK : API_EINCOMPLETE), committer);
+        if (ISUNDEF(subfolder->remote) && !subfolder->requested)
+        {
+            queue.push_back(subfolder.get());
+        }
+    }
+
+    while (!queue.empty())
+    {
+        vector<NewNode> newnodes;
+        vector<Folder*> folders;
+
+        while (!queue.empty() && folders.size() < size_t(MegaClient::MAX_NEWNODES))
+        {
+            Folder* folder = queue.front();
+            queue.pop_front();
+
+            newnodes.emplace_back();
+            NewNode& newnode = newnodes.back();
+            client->putnodes_prepareOneFolder(&newnode, folder->name);
+            newnode.nodehandle = folder->tempHandle = folders.size() + 1;
+            newnode.parenthandle = folder->parent == &target ? UNDEF : folder->parent->tempHandle;
+
+            folder->requested = true;
+            folders.push_back(folder);
+
+            for (auto& subfolder : folder->subfolders)
+            {
+                queue.push_back(subfolder.get());
+            }
+        }
+
+        // only the folders straight under the target can go in the next batch
+        while (!queue.empty() && queue.back()->parent != &target)
+        {
+            queue.pop_back();
+        }
+
+        mPendingBatches++;
+        std::weak_ptr<bool> alive = mAlive;
+        Folder* targetFolder = &target;
+        client->putnodes(NodeHandle().set6byte(target.remote), move(newnodes), nullptr, client->nextreqtag(),
+            [this, alive, targetFolder, folders](const Error& e, targettype_t, vector<NewNode>& nn, bool)
+            {
+                if (!alive.expired())
+                {
+                    onSubfoldersCreated(*targetFolder, folders, e, nn);
+                }
+            });
     }
 }
 
-void MegaFolderUploadController::onRequestFinish(MegaApi *, MegaRequest *request, MegaError *e)
+void MegaFolderUploadController::onSubfoldersCreated(Folder& target, const vector<Folder*>& folders, const Error& e, vector<NewNode>& nn)
 {
-    int type = request->getType();
-    int errorCode = e->getErrorCode();
+    mPendingBatches--;
+    if (cancelled)
+    {
+        return;
+    }
+
+    recursive++;
 
-    if (type == MegaRequest::TYPE_CREATE_FOLDER)
+    for (size_t i = 0; i < folders.size(); i++)
     {
-        if (!errorCode)
+        if (i < nn.size() && nn[i].added)
         {
-            onFolderAvailable(request->getNodeHandle());
+            folders[i]->remote = nn[i].mAddedHandle;
         }
         else
         {
-            pendingFolders.pop_front();
-            mLastError = *e;
+            mLastError = MegaErrorPrivate(e ? error(e) : API_EINTERNAL);
             mIncompleteTransfers++;
-            checkCompletion();
         }
     }
+
+    // the others in the batch are reached from these
+    for (Folder* folder : folders)
+    {
+        if (folder->parent == &target && !ISUNDEF(folder->remote))
+        {
+            onFolderAvailable(*folder);
+        }
+    }
+
+    recursive--;
+    checkCompletion();
+}
+
+void MegaFolderUploadController::checkCompletion()
+{
+    if (!cancelled && !recursive && !mPendingBatches && !pendingTransfers)
+    {
+        LOG_debug << "Folder transfer finished - " << transfer->getTransferredBytes() << " of " << transfer->getTotalBytes();
+        transfer->setState(MegaTransfer::STATE_COMPLETED);
+        transfer->setLastError(&mLastError);
+        DBTableTransactionCommitter committer(client->tctable);
+        megaApi->fireOnTransferFinish(transfer, make_unique<MegaErrorPrivate>(!mIncompleteTransfers ? API_OK : API_EINCOMPLETE), committer);
+    }
 }
 
 void MegaFolderUploadController::onTransferStart(MegaApi *, MegaTransfer *t)
@@ -25166,9 +27818,6 @@ void MegaFolderUploadController::onTransferFinish(MegaApi *, MegaTransfer *t, Me
 
 MegaFolderUploadController::~MegaFolderUploadController()
 {
-    //we dettach this as request listener: could be pending create folder req finish
-    megaApi->removeRequestListener(this);
-
     //we shouldn't need to dettach as transfer listener: all listened transfer should have been cancelled/completed
 }
 
@@ -25724,6 +28373,8 @@ void MegaScheduledCopyController::clearCurrentBackupData()
         delete *it;
     }
     this->failedTransfers.clear();
+    this->previousHandle = UNDEF;
+    this->pendingCopies = 0;
     this->currentHandle = UNDEF;
     this->currentBKStartTime = 0;
     this->updateTime = 0;
@@ -25780,6 +28431,27 @@ void MegaScheduledCopyController::start(bool skip)
 
         auto localpath = LocalPath::fromPath(basepath, *client->fsaccess);
 
+        int64_t previousTime = 0;
+        if (Node* parentNode = client->nodebyhandle(parenthandle))
+        {
+            for (Node* backup : parentNode->children)
+            {
+                if (backup->type != FOLDERNODE || !backup->attrs.map.count('n') || !isBackup(backup->attrs.map['n'], backupName))
+                {
+                    continue;
+                }
+
+                unique_ptr<MegaNode> backupNode(MegaNodePrivate::fromNode(backup));
+                const char* backst = backupNode->getCustomAttr("BACKST");
+                int64_t time = getTimeOfBackup(backup->attrs.map['n']);
+                if (backst && !strcmp(backst, "COMPLETE") && time > previousTime)
+                {
+                    previousTime = time;
+                    previousHandle = backup->nodehandle;
+                }
+            }
+        }
+
         MegaNode *child = megaApi->getChildNode(parent, backupname.c_str());
 
         if(!child || !child->isFolder())
@@ -25834,6 +28506,10 @@ void MegaScheduledCopyController::onFolderAvailable(MegaHandle handle)
         {
             FileSystemType fsType = client->fsaccess->getlocalfstype(localPath);
 
+            Node* previous = previousFolder(localPath);
+            vector<NewNode> copies;
+            vector<LocalPath> copiedPaths;
+
             while (da->dnext(localPath, localname, client->followsymlinks))
             {
                 ScopedLengthRestore restoreLen(localPath);
@@ -25847,9 +28523,25 @@ void MegaScheduledCopyController::onFolderAvailable(MegaHandle handle)
                     string name = localname.toName(*client->fsaccess, fsType);
                     if(fa->type == FILENODE)
                     {
-                        pendingTransfers++;
-
                         totalFiles++;
+
+                        // same size and mtime as in the last backup: copied without reading it again
+                        Node* unchanged = previous ? client->childnodebyname(previous, name.c_str(), false) : nullptr;
+                        if (unchanged && unchanged->type == FILENODE && unchanged->size == fa->size && unchanged->mtime == fa->mtime)
+                        {
+                            TreeProcCopy tc;
+                            client->proctree(unchanged, &tc, false, true);
+                            tc.allocnodes();
+                            client->proctree(unchanged, &tc, false, true);
+                            tc.makeattrs(client);
+                            tc.nn[0].parenthandle = UNDEF;
+
+                            copies.push_back(std::move(tc.nn[0]));
+                            copiedPaths.push_back(localPath);
+                            continue;
+                        }
+
+                        pendingTransfers++;
                         megaApi->startUpload(false, localPath.toPath(*client->fsaccess).c_str(), parent, (const char *)NULL, -1, folderTransferTag, true, NULL, false, false, fsType, this);
                     }
                     else
@@ -25869,6 +28561,11 @@ void MegaScheduledCopyController::onFolderAvailable(MegaHandle handle)
                     }
                 }
             }
+
+            if (!copies.empty())
+            {
+                copyUnchanged(handle, std::move(copies), std::move(copiedPaths), fsType);
+            }
         }
 
         delete da;
@@ -25888,9 +28585,68 @@ void MegaScheduledCopyController::onFolderAvailable(MegaHandle handle)
     checkCompletion();
 }
 
+// the folder of the last complete backup at the same place as this local one
+Node* MegaScheduledCopyController::previousFolder(const LocalPath& localPath)
+{
+    Node* folder = client->nodebyhandle(previousHandle);
+    size_t index = 0;
+    if (!folder || !LocalPath::fromPath(basepath, *client->fsaccess).isContainingPathOf(localPath, &index))
+    {
+        return nullptr;
+    }
+
+    LocalPath component;
+    while (folder && localPath.nextPathComponent(index, component))
+    {
+        folder = client->childnodebyname(folder, component.toName(*client->fsaccess, FS_UNKNOWN).c_str(), false);
+        if (folder && folder->type != FOLDERNODE)
+        {
+            folder = nullptr;
+        }
+    }
+    return folder;
+}
+
+void MegaScheduledCopyController::copyUnchanged(MegaHandle parent, vector<NewNode>&& copies, vector<LocalPath>&& localPaths, FileSystemType fsType)
+{
+    pendingCopies++;
+
+    std::weak_ptr<bool> alive = mAlive;
+    handle instance = currentHandle;
+    auto paths = std::make_shared<vector<LocalPath>>(std::move(localPaths));
+    client->putnodes(NodeHandle().set6byte(parent), std::move(copies), nullptr, client->nextreqtag(),
+        [this, alive, instance, paths, parent, fsType](const Error& e, targettype_t, vector<NewNode>&, bool)
+        {
+            if (alive.expired() || instance != currentHandle)
+            {
+                return;
+            }
+            pendingCopies--;
+
+            if (e)
+            {
+                // upload them after all
+                LOG_warn << "Unable to copy the unchanged files of the previous backup: " << int(error(e));
+                unique_ptr<MegaNode> parentNode(megaApi->getNodeByHandle(parent));
+                for (const LocalPath& localPath : *paths)
+                {
+                    pendingTransfers++;
+                    megaApi->startUpload(false, localPath.toPath(*client->fsaccess).c_str(), parentNode.get(), (const char *)NULL, -1, folderTransferTag, true, NULL, false, false, fsType, this);
+                }
+            }
+            else
+            {
+                numberFiles += paths->size();
+                megaApi->fireOnBackupUpdate(this);
+            }
+
+            checkCompletion();
+        });
+}
+
 bool MegaScheduledCopyController::checkCompletion()
 {
-    if(!recursive && !pendingFolders.size() && !pendingTransfers && !pendingTags)
+    if(!recursive && !pendingFolders.size() && !pendingTransfers && !pendingTags && !pendingCopies)
     {
         error e = API_OK;
         LOG_debug << "Folder transfer finished - " << this->getTransferredBytes() << " of " << this->getTotalBytes();
@@ -26331,18 +29087,31 @@ void MegaFolderDownloadController::start(MegaNode *node)
     path.ensureWinExtendedPathLenPrefix();
 
     transfer->setPath(path.toPath(*client->fsaccess).c_str());
-    downloadFolderNode(node, path, fsType);
+
+    // not complete until the whole plan is carried out
+    recursive = 1;
+    planFolder(node, path, fsType);
 
     if (deleteNode)
     {
         delete node;
     }
+
+    mFolders[0].creation = megaApi->getLocalFolderCreator().queue(mFolders[0].path);
+    mCreating.push_back(0);
+    megaApi->plannedFolderDownloads.insert(this);
 }
 
 void MegaFolderDownloadController::cancel()
 {
     cancelled = true; //we dont want to further checkcompletion, and produce multile fireOnTransferFinish -> multiple deletions
 
+    // the folders not created yet are dropped, and the files not queued yet with them
+    megaApi->plannedFolderDownloads.erase(this);
+    mCreating.clear();
+    mReady.clear();
+    mFolders.clear();
+
     //remove subtransfers from pending transferQueue
     megaApi->cancelPendingTransfersByFolderTag(tag);
 
@@ -26434,41 +29203,11 @@ void MegaFolderDownloadController::cancel()
     transfer = nullptr;  // no final callback for this one since it is being destroyed now
 }
 
-void MegaFolderDownloadController::downloadFolderNode(MegaNode *node, LocalPath& localpath, FileSystemType fsType)
+size_t MegaFolderDownloadController::planFolder(MegaNode *node, LocalPath& localpath, FileSystemType fsType)
 {
-    recursive++;
-
-    auto da = client->fsaccess->newfileaccess();
-    if (!da->fopen(localpath, true, false))
-    {
-        if (!client->fsaccess->mkdirlocal(localpath))
-        {
-            da.reset();
-            LOG_err << "Unable to create folder: " << localpath.toPath(*client->fsaccess);
-
-            recursive--;
-            mLastError = API_EWRITE;
-            mIncompleteTransfers++;
-            checkCompletion();
-            return;
-        }
-    }
-    else if (da->type != FILENODE)
-    {
-        LOG_debug << "Already existing folder detected: " << localpath.toPath(*client->fsaccess);
-    }
-    else
-    {
-        da.reset();
-        LOG_err << "Local file detected where there should be a folder: " << localpath.toPath(*client->fsaccess);
-
-        recursive--;
-        mLastError = API_EEXIST;
-        mIncompleteTransfers++;
-        checkCompletion();
-        return;
-    }
-    da.reset();
+    size_t index = mFolders.size();
+    mFolders.emplace_back();
+    mFolders[index].path = localpath;
 
     MegaNodeList *children = NULL;
     bool deleteChildren = false;
@@ -26485,11 +29224,9 @@ void MegaFolderDownloadController::downloadFolderNode(MegaNode *node, LocalPath&
     if (!children)
     {
         LOG_err << "Child nodes not found: " << localpath.toPath(*client->fsaccess);
-        recursive--;
         mLastError = API_ENOENT;
         mIncompleteTransfers++;
-        checkCompletion();
-        return;
+        return index;
     }
 
     for (int i = 0; i < children->size(); i++)
@@ -26499,25 +29236,123 @@ void MegaFolderDownloadController::downloadFolderNode(MegaNode *node, LocalPath&
         ScopedLengthRestore restoreLen(localpath);
         localpath.appendWithSeparator(LocalPath::fromName(child->getName(), *client->fsaccess, fsType), true);
 
-        string utf8path = localpath.toPath(*client->fsaccess);
-
         if (child->getType() == MegaNode::TYPE_FILE)
         {
-            pendingTransfers++;
-            megaApi->startDownload(false, child, utf8path.c_str(), tag, transfer->getAppData(), this);
+            PlannedFile file;
+            file.path = localpath.toPath(*client->fsaccess);
+            file.handle = child->getHandle();
+            if (child->isPublic() || child->isForeign())
+            {
+                file.node.reset(child->copy());
+            }
+            mFolders[index].files.push_back(std::move(file));
         }
         else
         {
-            downloadFolderNode(child, localpath, fsType);
+            size_t subfolder = planFolder(child, localpath, fsType);
+            mFolders[index].subfolders.push_back(subfolder);
         }
     }
 
-    recursive--;
-    checkCompletion();
     if (deleteChildren)
     {
         delete children;
     }
+    return index;
+}
+
+void MegaFolderDownloadController::folderCreated(size_t folder)
+{
+    PlannedFolder& f = mFolders[folder];
+    error e = f.creation->result;
+    f.creation.reset();
+
+    if (e)
+    {
+        if (e == API_EEXIST)
+        {
+            LOG_err << "Local file detected where there should be a folder: " << f.path.toPath(*client->fsaccess);
+        }
+        else
+        {
+            LOG_err << "Unable to create folder: " << f.path.toPath(*client->fsaccess);
+        }
+
+        // nothing below it is downloaded
+        mLastError = e;
+        mIncompleteTransfers++;
+        return;
+    }
+
+    LocalFolderCreator& creator = megaApi->getLocalFolderCreator();
+    for (size_t subfolder : f.subfolders)
+    {
+        mFolders[subfolder].creation = creator.queue(mFolders[subfolder].path);
+        mCreating.push_back(subfolder);
+    }
+
+    if (!f.files.empty())
+    {
+        mReady.push_back(folder);
+    }
+}
+
+void MegaFolderDownloadController::continuePlan()
+{
+    for (size_t i = 0; i < mCreating.size(); )
+    {
+        size_t folder = mCreating[i];
+        if (!mFolders[folder].creation->done())
+        {
+            i++;
+            continue;
+        }
+
+        mCreating[i] = mCreating.back();
+        mCreating.pop_back();
+        folderCreated(folder);
+    }
+
+    vector<MegaTransferPrivate*> batch;
+    while (!mReady.empty() && batch.size() < FILES_PER_BATCH)
+    {
+        vector<PlannedFile>& files = mFolders[mReady.front()].files;
+        while (mNextFile < files.size() && batch.size() < FILES_PER_BATCH)
+        {
+            PlannedFile& file = files[mNextFile++];
+            MegaTransferPrivate* subTransfer = megaApi->createDownloadTransfer(false, file.node.get(), file.path.c_str(), tag, transfer->getAppData(), this);
+            if (!file.node)
+            {
+                subTransfer->setNodeHandle(file.handle);
+            }
+            batch.push_back(subTransfer);
+        }
+
+        if (mNextFile == files.size())
+        {
+            vector<PlannedFile>().swap(files);
+            mReady.pop_front();
+            mNextFile = 0;
+        }
+    }
+
+    if (!batch.empty())
+    {
+        pendingTransfers += int(batch.size());
+        megaApi->transferQueue.push(batch);
+
+        // the rest of the ready files go next time
+        megaApi->waiter->notify();
+    }
+
+    if (mCreating.empty() && mReady.empty())
+    {
+        LOG_debug << "Folder download plan carried out: " << mFolders.size() << " folders";
+        megaApi->plannedFolderDownloads.erase(this);
+        vector<PlannedFolder>().swap(mFolders);
+        recursive = 0;
+        checkCompletion();
+    }
 }
 
 void MegaFolderDownloadController::checkCompletion()
@@ -26588,18 +29423,28 @@ void MegaFolderDownloadController::onTransferFinish(MegaApi *, MegaTransfer *t,
 StreamingBuffer::StreamingBuffer()
 {
     this->capacity = 0;
-    this->buffer = NULL;
-    this->inpos = 0;
+    this->outchunk = 0;
     this->outpos = 0;
+    this->freepos = 0;
     this->size = 0;
     this->free = 0;
     this->maxBufferSize = MAX_BUFFER_SIZE;
     this->maxOutputSize = MAX_OUTPUT_SIZE;
+    this->outputsize = MAX_OUTPUT_SIZE;
 }
 
 StreamingBuffer::~StreamingBuffer()
 {
-    delete [] buffer;
+    releaseChunks();
+}
+
+void StreamingBuffer::releaseChunks()
+{
+    for (const Chunk& chunk : chunks)
+    {
+        CodeCounter::accountMemory(CodeCounter::MEM_STREAMING_BUFFERS, -int64_t(chunk.capacity));
+    }
+    chunks.clear();
 }
 
 void StreamingBuffer::init(m_off_t capacity)
@@ -26611,16 +29456,18 @@ void StreamingBuffer::init(m_off_t capacity)
     }
 
     this->capacity = static_cast<unsigned>(capacity);
-    this->buffer = new char[this->capacity];
-    this->inpos = 0;
+    releaseChunks();
+    this->outchunk = 0;
     this->outpos = 0;
+    this->freepos = 0;
     this->size = 0;
     this->free = this->capacity;
+    this->outputsize = maxOutputSize;
 }
 
 unsigned int StreamingBuffer::append(const char *buf, unsigned int len)
 {
-    if (!buffer)
+    if (!capacity)
     {
         // initialize the buffer if it's not initialized yet
         init(len);
@@ -26633,23 +29480,29 @@ unsigned int StreamingBuffer::append(const char *buf, unsigned int len)
     }
 
     // update the internal state
-    int currentIndex = inpos;
-    inpos += len;
-    int remaining = inpos - capacity;
-    inpos %= capacity;
     size += len;
     free -= len;
 
-    // append the new data
-    if (remaining <= 0)
+    // fill the room left in the last chunk, then a new one
+    unsigned int appended = 0;
+    if (!chunks.empty())
     {
-        memcpy(buffer + currentIndex, buf, len);
+        Chunk& last = chunks.back();
+        appended = std::min(len, last.capacity - last.len);
+        memcpy(last.data.get() + last.len, buf, appended);
+        last.len += appended;
     }
-    else
+
+    if (appended < len)
     {
-        int num = len - remaining;
-        memcpy(buffer + currentIndex, buf, num);
-        memcpy(buffer, buf + num, remaining);
+        Chunk chunk;
+        unsigned int minChunkSize = MIN_CHUNK_SIZE;
+        chunk.capacity = std::max(len - appended, std::min(minChunkSize, capacity));
+        chunk.data.reset(new char[chunk.capacity]);
+        chunk.len = len - appended;
+        memcpy(chunk.data.get(), buf + appended, chunk.len);
+        CodeCounter::accountMemory(CodeCounter::MEM_STREAMING_BUFFERS, int64_t(chunk.capacity));
+        chunks.push_back(std::move(chunk));
     }
 
     return len;
@@ -26670,35 +29523,107 @@ unsigned int StreamingBuffer::availableCapacity()
     return capacity;
 }
 
-uv_buf_t StreamingBuffer::nextBuffer()
+uv_buf_t StreamingBuffer::takeBuffer(unsigned int maxLen)
 {
-    if (!size)
+    if (!size || !maxLen)
     {
         // no data available
         return uv_buf_init(NULL, 0);
     }
 
-    // prepare output buffer
-    char *outbuf = buffer + outpos;
-    int len = size < maxOutputSize ? size : maxOutputSize;
-    if (outpos + len > capacity)
+    // the rest of the current chunk
+    while (outpos == chunks[outchunk].len)
     {
-        len = capacity - outpos;
+        outchunk++;
+        outpos = 0;
     }
 
+    Chunk& chunk = chunks[outchunk];
+    char *outbuf = chunk.data.get() + outpos;
+    unsigned int len = std::min(chunk.len - outpos, maxLen);
+
     // update the internal state
     size -= len;
     outpos += len;
-    outpos %= capacity;
 
     // return the buffer
     return uv_buf_init(outbuf, len);
 }
 
+uv_buf_t StreamingBuffer::nextBuffer()
+{
+    return takeBuffer(outputsize);
+}
+
+unsigned int StreamingBuffer::nextBuffers(std::vector<uv_buf_t>& buffers)
+{
+    buffers.clear();
+
+    unsigned int total = 0;
+    while (total < outputsize)
+    {
+        uv_buf_t buffer = takeBuffer(outputsize - total);
+        if (!buffer.len)
+        {
+            break;
+        }
+        buffers.push_back(buffer);
+        total += static_cast<unsigned>(buffer.len);
+    }
+    return total;
+}
+
 void StreamingBuffer::freeData(unsigned int len)
 {
     // update the internal state
     free += len;
+
+    // release the chunks written completely
+    while (len && !chunks.empty())
+    {
+        Chunk& first = chunks.front();
+        unsigned int freed = std::min(len, first.len - freepos);
+        freepos += freed;
+        len -= freed;
+
+        // the last chunk stays while there is room in it
+        if (freepos < first.len || (chunks.size() == 1 && first.len < first.capacity))
+        {
+            break;
+        }
+
+        CodeCounter::accountMemory(CodeCounter::MEM_STREAMING_BUFFERS, -int64_t(first.capacity));
+        chunks.pop_front();
+        freepos = 0;
+        if (outchunk)
+        {
+            outchunk--;
+        }
+        else
+        {
+            outpos = 0;
+        }
+    }
+
+    if (chunks.size() == 1 && !outchunk && outpos == chunks.front().len && freepos == outpos)
+    {
+        // nothing pending: the chunk is filled again from its start
+        chunks.front().len = 0;
+        freepos = 0;
+        outpos = 0;
+    }
+}
+
+void StreamingBuffer::adaptOutputSize(bool writtenRightAway)
+{
+    if (writtenRightAway)
+    {
+        outputsize = std::max(std::min(outputsize * 2, capacity / 4), maxOutputSize);
+    }
+    else
+    {
+        outputsize = std::max(outputsize / 2, maxOutputSize);
+    }
 }
 
 void StreamingBuffer::setMaxBufferSize(unsigned int bufferSize)
@@ -26723,6 +29648,7 @@ void StreamingBuffer::setMaxOutputSize(unsigned int outputSize)
     {
         this->maxOutputSize = MAX_OUTPUT_SIZE;
     }
+    this->outputsize = this->maxOutputSize;
 }
 
 // http_parser settings
@@ -26742,16 +29668,12 @@ MegaTCPServer::MegaTCPServer(MegaApiImpl *megaApi, string basePath, bool tls, st
     this->port = 0;
     this->maxBufferSize = 0;
     this->maxOutputSize = 0;
+    this->numThreads = 0;
     this->restrictedMode = MegaApi::TCP_SERVER_ALLOW_CREATED_LOCAL_LINKS;
     this->lastHandle = INVALID_HANDLE;
-    this->remainingcloseevents = 0;
-    this->closing = false;
-    this->thread = new MegaThread();
 #ifdef ENABLE_EVT_TLS
     this->certificatepath = certificatepath;
     this->keypath = keypath;
-    this->closing = false;
-    this->remainingcloseevents = 0;
     this->evtrequirescleaning = false;
 #endif
     fsAccess = new MegaFileSystemAccess();
@@ -26766,23 +29688,23 @@ MegaTCPServer::MegaTCPServer(MegaApiImpl *megaApi, string basePath, bool tls, st
         string sBasePath = lp.toPath(*fsAccess);
         this->basePath = sBasePath;
     }
-    semaphoresdestroyed = false;
-    uv_sem_init(&semaphoreEnd, 0);
-    uv_sem_init(&semaphoreStartup, 0);
 }
 
 MegaTCPServer::~MegaTCPServer()
 {
     stop();
-    semaphoresdestroyed = true;
-    uv_sem_destroy(&semaphoreStartup);
-    uv_sem_destroy(&semaphoreEnd);
     delete fsAccess;
 
-    LOG_verbose << " MegaTCPServer::~MegaTCPServer joining uv thread";
-    thread->join();
-    LOG_verbose << " MegaTCPServer::~MegaTCPServer deleting uv thread";
-    delete thread;
+    LOG_verbose << " MegaTCPServer::~MegaTCPServer joining uv threads";
+    loops.clear();
+
+#ifdef ENABLE_EVT_TLS
+    if (evtrequirescleaning)
+    {
+        //evt_ctx_free(&evtctx); //This causes invalid free when called second time!! collides with memory allocated elsewhere (e.g: via curl_global_init!)
+        SSL_CTX_free(evtctx.ctx);
+    }
+#endif
 }
 
 bool MegaTCPServer::start(int port, bool localOnly)
@@ -26800,10 +29722,59 @@ bool MegaTCPServer::start(int port, bool localOnly)
     this->port = port;
     this->localOnly = localOnly;
 
-    thread->start(threadEntryPoint, this);
-    uv_sem_wait(&semaphoreStartup);
+    // the threads of a previous run have finished or are about to
+    loops.clear();
 
-    LOG_verbose << "MegaTCPServer::start. port = " << port << ", returning " << started;
+#ifdef ENABLE_EVT_TLS
+    if (useTLS)
+    {
+        if (evtrequirescleaning)
+        {
+            SSL_CTX_free(evtctx.ctx);
+            evtrequirescleaning = false;
+        }
+
+        if (evt_ctx_init_ex(&evtctx, certificatepath.c_str(), keypath.c_str()) != 1 )
+        {
+            LOG_err << "Unable to init evt ctx";
+            this->port = 0;
+            return false;
+        }
+        evtrequirescleaning = true;
+        evt_ctx_set_nio(&evtctx, NULL, uv_tls_writer);
+    }
+#endif
+
+    int threads = 1;
+#if defined(__linux__) && defined(SO_REUSEPORT)
+    if (port)   // a port chosen by the system can't be shared by several sockets
+    {
+        threads = numThreads ? numThreads : 1;
+    }
+#endif
+
+    for (int i = 0; i < threads; i++)
+    {
+        loops.emplace_back(new MegaTCPLoop(this));
+        loops.back()->thread.start(threadEntryPoint, loops.back().get());
+    }
+
+    bool listening = true;
+    for (auto& loop : loops)
+    {
+        uv_sem_wait(&loop->semaphoreStartup);
+        listening = listening && loop->listening;
+    }
+
+    started = true;
+    if (!listening)
+    {
+        // stop the loops that could listen
+        stop();
+        this->port = 0;
+    }
+
+    LOG_verbose << "MegaTCPServer::start. port = " << port << ", threads = " << threads << ", returning " << started;
     return started;
 }
 
@@ -26845,35 +29816,15 @@ int MegaTCPServer::uv_tls_writer(evt_tls_t *evt_tls, void *bfr, int sz)
 }
 #endif
 
-// todo: a lot of this function is the same as initializeAndStartListening, we should factor them (maybe call that one from this one?)
-void MegaTCPServer::run()
+void MegaTCPServer::run(MegaTCPLoop& loop)
 {
     LOG_debug << " Running tcp server: " << port << " TLS=" << useTLS;
 
-#ifdef ENABLE_EVT_TLS
-    if (useTLS)
-    {
-        if (evt_ctx_init_ex(&evtctx, certificatepath.c_str(), keypath.c_str()) != 1 )
-        {
-            LOG_err << "Unable to init evt ctx";
-            port = 0;
-            uv_sem_post(&semaphoreStartup);
-            uv_sem_post(&semaphoreEnd);
-            return;
-        }
-        evt_ctx_set_nio(&evtctx, NULL, uv_tls_writer);
-    }
-#endif
-
-    uv_loop_init(&uv_loop);
+    uv_loop_init(&loop.uv_loop);
+    loop.uv_loop.data = &loop;
 
-    uv_async_init(&uv_loop, &exit_handle, onCloseRequested);
-    exit_handle.data = this;
-
-    uv_tcp_init(&uv_loop, &server);
-    server.data = this;
-
-    uv_tcp_keepalive(&server, 0, 0);
+    uv_async_init(&loop.uv_loop, &loop.exit_handle, onCloseRequested);
+    loop.exit_handle.data = this;
 
     union {
         struct sockaddr_in6 ipv6;
@@ -26903,6 +29854,25 @@ void MegaTCPServer::run()
         }
     }
 
+    // the socket is created upfront so that it can be shared with the other loops before binding
+    uv_tcp_init_ex(&loop.uv_loop, &loop.server, useIPv6 ? AF_INET6 : AF_INET);
+    loop.server.data = this;
+
+    uv_tcp_keepalive(&loop.server, 0, 0);
+
+#if defined(__linux__) && defined(SO_REUSEPORT)
+    if (loops.size() > 1)
+    {
+        uv_os_fd_t fd;
+        int enable = 1;
+        if (uv_fileno((uv_handle_t*)&loop.server, &fd)
+            || setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)))
+        {
+            LOG_warn << "Unable to share port " << port << " between event loops";
+        }
+    }
+#endif
+
     uv_connection_cb onNewClientCB;
 #ifdef ENABLE_EVT_TLS
     if (useTLS)
@@ -26917,128 +29887,32 @@ void MegaTCPServer::run()
     }
 #endif
 
-    if(uv_tcp_bind(&server, (const struct sockaddr*)&address, 0)
-        || uv_listen((uv_stream_t*)&server, 32, onNewClientCB))
+    if(uv_tcp_bind(&loop.server, (const struct sockaddr*)&address, 0)
+        || uv_listen((uv_stream_t*)&loop.server, 32, onNewClientCB))
     {
         LOG_err << "TCP failed to bind/listen port = " << port;
-        port = 0;
 
-        uv_close((uv_handle_t *)&exit_handle,NULL);
-        uv_close((uv_handle_t *)&server,NULL);
-        uv_sem_post(&semaphoreStartup);
-        uv_run(&uv_loop, UV_RUN_ONCE); // so that resources are cleaned peacefully
-        uv_sem_post(&semaphoreEnd);
+        uv_close((uv_handle_t *)&loop.exit_handle,NULL);
+        uv_close((uv_handle_t *)&loop.server,NULL);
+        uv_sem_post(&loop.semaphoreStartup);
+        uv_run(&loop.uv_loop, UV_RUN_ONCE); // so that resources are cleaned peacefully
+        uv_loop_close(&loop.uv_loop);
+        uv_sem_post(&loop.semaphoreEnd);
         return;
     }
 
     LOG_info << "TCP" << (useTLS ? "(tls)" : "") << " server started on port " << port;
-    started = true;
-    uv_sem_post(&semaphoreStartup);
+    loop.listening = true;
+    uv_sem_post(&loop.semaphoreStartup);
 
     LOG_info << "Starting uv loop ...";
-    uv_run(&uv_loop, UV_RUN_DEFAULT);
+    uv_run(&loop.uv_loop, UV_RUN_DEFAULT);
 
     LOG_info << "UV loop ended";
-#ifdef ENABLE_EVT_TLS
-    if (useTLS)
-    {
-        //evt_ctx_free(&evtctx); //This causes invalid free when called second time!! collides with memory allocated elsewhere (e.g: via curl_global_init!)
-        SSL_CTX_free(evtctx.ctx);
-    }
-#endif
-    uv_loop_close(&uv_loop);
-    started = false;
-    port = 0;
+    uv_loop_close(&loop.uv_loop);
     LOG_debug << "UV loop thread exit";
 }
 
-void MegaTCPServer::initializeAndStartListening()
-{
-#ifdef ENABLE_EVT_TLS
-    if (useTLS)
-    {
-        if (evt_ctx_init_ex(&evtctx, certificatepath.c_str(), keypath.c_str()) != 1 )
-        {
-            LOG_err << "Unable to init evt ctx";
-            port = 0;
-            uv_sem_post(&semaphoreStartup);
-            uv_sem_post(&semaphoreEnd);
-            return;
-        }
-        evtrequirescleaning = true;
-        evt_ctx_set_nio(&evtctx, NULL, uv_tls_writer);
-    }
-#endif
-
-    uv_loop_init(&uv_loop);
-
-    uv_async_init(&uv_loop, &exit_handle, onCloseRequested);
-    exit_handle.data = this;
-
-    uv_tcp_init(&uv_loop, &server);
-    server.data = this;
-
-    uv_tcp_keepalive(&server, 0, 0);
-
-    union {
-        struct sockaddr_in6 ipv6;
-        struct sockaddr_in ipv4;
-    } address;
-
-    if (useIPv6)
-    {
-        if (localOnly)
-        {
-            uv_ip6_addr("::1", port, &address.ipv6);
-        }
-        else
-        {
-            uv_ip6_addr("::", port, &address.ipv6);
-        }
-    }
-    else
-    {
-        if (localOnly)
-        {
-            uv_ip4_addr("127.0.0.1", port, &address.ipv4);
-        }
-        else
-        {
-            uv_ip4_addr("0.0.0.0", port, &address.ipv4);
-        }
-    }
-
-    uv_connection_cb onNewClientCB;
-#ifdef ENABLE_EVT_TLS
-    if (useTLS)
-    {
-         onNewClientCB = onNewClient_tls;
-    }
-    else
-    {
-#endif
-        onNewClientCB = onNewClient;
-#ifdef ENABLE_EVT_TLS
-    }
-#endif
-
-    if(uv_tcp_bind(&server, (const struct sockaddr*)&address, 0)
-        || uv_listen((uv_stream_t*)&server, 32, onNewClientCB))
-    {
-        LOG_err << "TCP failed to bind/listen port = " << port;
-        port = 0;
-        uv_async_send(&exit_handle);
-        //This is required in case uv_loop was already running so as to free references to "this".
-        // a uv_sem_post will be required there, so that we can delete the server accordingly
-        return;
-    }
-
-    LOG_info << "TCP" << (useTLS ? "(tls)" : "") << " server started on port " << port;
-    started = true;
-    uv_sem_post(&semaphoreStartup);
-    LOG_debug << "UV loop already alive!";
-}
-
 void MegaTCPServer::stop(bool doNotWait)
 {
     if (!started)
@@ -27048,11 +29922,24 @@ void MegaTCPServer::stop(bool doNotWait)
     }
 
     LOG_debug << "Stopping MegaTCPServer port = " << port;
-    uv_async_send(&exit_handle);
+    for (auto& loop : loops)
+    {
+        if (loop->listening)
+        {
+            uv_async_send(&loop->exit_handle);
+        }
+    }
+
     if (!doNotWait)
     {
         LOG_verbose << "Waiting for sempahoreEnd to conclude server stop port = " << port;
-        uv_sem_wait(&semaphoreEnd); //this is signaled when closed my last connection
+        for (auto& loop : loops)
+        {
+            if (loop->listening)
+            {
+                uv_sem_wait(&loop->semaphoreEnd); //this is signaled when closed my last connection
+            }
+        }
     }
     LOG_debug << "Stopped MegaTCPServer port = " << port;
     started = false;
@@ -27078,6 +29965,16 @@ void MegaTCPServer::setMaxOutputSize(int outputSize)
     this->maxOutputSize = outputSize <= 0 ? 0 : outputSize;
 }
 
+void MegaTCPServer::setNumThreads(int threads)
+{
+    this->numThreads = threads <= 0 ? 0 : threads;
+}
+
+int MegaTCPServer::getNumThreads()
+{
+    return numThreads ? numThreads : 1;
+}
+
 int MegaTCPServer::getMaxBufferSize()
 {
     if (maxBufferSize)
@@ -27188,6 +30085,8 @@ void MegaTCPServer::removeAllowedHandle(MegaHandle handle)
 
 void *MegaTCPServer::threadEntryPoint(void *param)
 {
+    ThreadRoles::enter(ThreadRoles::SERVER, "mega-server");
+
 #ifndef _WIN32
     struct sigaction noaction;
     memset(&noaction, 0, sizeof(noaction));
@@ -27195,11 +30094,28 @@ void *MegaTCPServer::threadEntryPoint(void *param)
     ::sigaction(SIGPIPE, &noaction, 0);
 #endif
 
-    MegaTCPServer *tcpServer = (MegaTCPServer *)param;
-    tcpServer->run();
+    MegaTCPLoop *loop = (MegaTCPLoop *)param;
+    loop->tcpServer->run(*loop);
     return NULL;
 }
 
+MegaTCPLoop::MegaTCPLoop(MegaTCPServer *tcpServer)
+{
+    this->tcpServer = tcpServer;
+    this->listening = false;
+    this->closing = false;
+    this->remainingcloseevents = 0;
+    uv_sem_init(&semaphoreEnd, 0);
+    uv_sem_init(&semaphoreStartup, 0);
+}
+
+MegaTCPLoop::~MegaTCPLoop()
+{
+    thread.join();
+    uv_sem_destroy(&semaphoreStartup);
+    uv_sem_destroy(&semaphoreEnd);
+}
+
 #ifdef ENABLE_EVT_TLS
 void MegaTCPServer::evt_on_rd(evt_tls_t *evt_tls, char *bfr, int sz)
 {
@@ -27267,17 +30183,18 @@ void MegaTCPServer::onNewClient_tls(uv_stream_t *server_handle, int status)
 
     // Create an object to save context information
     MegaTCPContext* tcpctx = ((MegaTCPServer *)server_handle->data)->initializeContext(server_handle);
+    tcpctx->loop = (MegaTCPLoop *)server_handle->loop->data;
 
-    LOG_debug << "Connection received at port " << tcpctx->server->port << " ! " << tcpctx->server->connections.size();
+    LOG_debug << "Connection received at port " << tcpctx->server->port << " ! " << tcpctx->loop->connections.size();
 
     // Mutex to protect the data buffer
     uv_mutex_init(&tcpctx->mutex);
 
     // Async handle to perform writes
-    uv_async_init(&tcpctx->server->uv_loop, &tcpctx->asynchandle, onAsyncEvent);
+    uv_async_init(&tcpctx->loop->uv_loop, &tcpctx->asynchandle, onAsyncEvent);
 
     // Accept the connection
-    uv_tcp_init(&tcpctx->server->uv_loop, &tcpctx->tcphandle);
+    uv_tcp_init(&tcpctx->loop->uv_loop, &tcpctx->tcphandle);
     if (uv_accept(server_handle, (uv_stream_t*)&tcpctx->tcphandle))
     {
         LOG_err << "uv_accept failed";
@@ -27295,7 +30212,7 @@ void MegaTCPServer::onNewClient_tls(uv_stream_t *server_handle, int status)
         return;
     }
 
-    tcpctx->server->connections.push_back(tcpctx);
+    tcpctx->loop->connections.push_back(tcpctx);
 
     tcpctx->server->readData(tcpctx);
 }
@@ -27326,17 +30243,18 @@ void MegaTCPServer::onNewClient(uv_stream_t* server_handle, int status)
 
     // Create an object to save context information
     MegaTCPContext* tcpctx = ((MegaTCPServer *)server_handle->data)->initializeContext(server_handle);
+    tcpctx->loop = (MegaTCPLoop *)server_handle->loop->data;
 
-    LOG_debug << "Connection received at port " << tcpctx->server->port << "! " << tcpctx->server->connections.size() << " tcpctx = " << tcpctx;
+    LOG_debug << "Connection received at port " << tcpctx->server->port << "! " << tcpctx->loop->connections.size() << " tcpctx = " << tcpctx;
 
     // Mutex to protect the data buffer
     uv_mutex_init(&tcpctx->mutex);
 
     // Async handle to perform writes
-    uv_async_init(&tcpctx->server->uv_loop, &tcpctx->asynchandle, onAsyncEvent);
+    uv_async_init(&tcpctx->loop->uv_loop, &tcpctx->asynchandle, onAsyncEvent);
 
     // Accept the connection
-    uv_tcp_init(&tcpctx->server->uv_loop, &tcpctx->tcphandle);
+    uv_tcp_init(&tcpctx->loop->uv_loop, &tcpctx->tcphandle);
     if (uv_accept(server_handle, (uv_stream_t*)&tcpctx->tcphandle))
     {
         LOG_err << "uv_accept failed";
@@ -27344,7 +30262,7 @@ void MegaTCPServer::onNewClient(uv_stream_t* server_handle, int status)
         return;
     }
 
-    tcpctx->server->connections.push_back(tcpctx);
+    tcpctx->loop->connections.push_back(tcpctx);
     if (tcpctx->server->respondNewConnection(tcpctx))
     {
         // Start reading
@@ -27407,8 +30325,8 @@ void MegaTCPServer::onClose(uv_handle_t* handle)
     tcpctx->megaApi->removeTransferListener(tcpctx);
     tcpctx->megaApi->removeRequestListener(tcpctx);
 
-    tcpctx->server->connections.remove(tcpctx);
-    LOG_debug << "Connection closed: " << tcpctx->server->connections.size() << " port = " << tcpctx->server->port << " closing async handle";
+    tcpctx->loop->connections.remove(tcpctx);
+    LOG_debug << "Connection closed: " << tcpctx->loop->connections.size() << " port = " << tcpctx->server->port << " closing async handle";
     uv_close((uv_handle_t *)&tcpctx->asynchandle, onAsyncEventClose);
 }
 
@@ -27418,16 +30336,17 @@ void MegaTCPServer::onAsyncEventClose(uv_handle_t *handle)
     assert(!tcpctx->writePointers.size());
 
     int port = tcpctx->server->port;
+    MegaTCPLoop *loop = tcpctx->loop;
 
-    tcpctx->server->remainingcloseevents--;
+    loop->remainingcloseevents--;
     tcpctx->server->processOnAsyncEventClose(tcpctx);
 
-    LOG_verbose << "At onAsyncEventClose port = " << tcpctx->server->port << " remaining=" << tcpctx->server->remainingcloseevents;
+    LOG_verbose << "At onAsyncEventClose port = " << port << " remaining=" << loop->remainingcloseevents;
 
-    if (!tcpctx->server->remainingcloseevents && tcpctx->server->closing && !tcpctx->server->semaphoresdestroyed)
+    if (!loop->remainingcloseevents && loop->closing)
     {
-        uv_sem_post(&tcpctx->server->semaphoreStartup);
-        uv_sem_post(&tcpctx->server->semaphoreEnd);
+        uv_sem_post(&loop->semaphoreStartup);
+        uv_sem_post(&loop->semaphoreEnd);
     }
 
     uv_mutex_destroy(&tcpctx->mutex);
@@ -27519,6 +30438,7 @@ MegaTCPContext::MegaTCPContext()
     invalid = false;
 #endif
     server = NULL;
+    loop = NULL;
     megaApi = NULL;
 }
 
@@ -27550,39 +30470,41 @@ void MegaTCPServer::onAsyncEvent(uv_async_t* handle)
 void MegaTCPServer::onExitHandleClose(uv_handle_t *handle)
 {
     MegaTCPServer *tcpServer = (MegaTCPServer*) handle->data;
+    MegaTCPLoop *loop = (MegaTCPLoop*) handle->loop->data;
     assert(tcpServer != NULL);
 
-    tcpServer->remainingcloseevents--;
-    LOG_verbose << "At onExitHandleClose port = " << tcpServer->port << " remainingcloseevent = " << tcpServer->remainingcloseevents;
+    loop->remainingcloseevents--;
+    LOG_verbose << "At onExitHandleClose port = " << tcpServer->port << " remainingcloseevent = " << loop->remainingcloseevents;
 
     tcpServer->processOnExitHandleClose(tcpServer);
 
-    if (!tcpServer->remainingcloseevents && !tcpServer->semaphoresdestroyed)
+    if (!loop->remainingcloseevents)
     {
-        uv_sem_post(&tcpServer->semaphoreStartup);
-        uv_sem_post(&tcpServer->semaphoreEnd);
+        uv_sem_post(&loop->semaphoreStartup);
+        uv_sem_post(&loop->semaphoreEnd);
     }
 }
 
 void MegaTCPServer::onCloseRequested(uv_async_t *handle)
 {
     MegaTCPServer *tcpServer = (MegaTCPServer*) handle->data;
+    MegaTCPLoop *loop = (MegaTCPLoop*) handle->loop->data;
     LOG_debug << "TCP server stopping port=" << tcpServer->port;
 
-    tcpServer->closing = true;
+    loop->closing = true;
 
-    for (list<MegaTCPContext*>::iterator it = tcpServer->connections.begin(); it != tcpServer->connections.end(); it++)
+    for (list<MegaTCPContext*>::iterator it = loop->connections.begin(); it != loop->connections.end(); it++)
     {
         MegaTCPContext *tcpctx = (*it);
         closeTCPConnection(tcpctx);
     }
 
-    tcpServer->remainingcloseevents++;
-    LOG_verbose << "At onCloseRequested: closing server port = " << tcpServer->port << " remainingcloseevent = " << tcpServer->remainingcloseevents;
-    uv_close((uv_handle_t *)&tcpServer->server, onExitHandleClose);
-    tcpServer->remainingcloseevents++;
-    LOG_verbose << "At onCloseRequested: closing exit_handle port = " << tcpServer->port << " remainingcloseevent = " << tcpServer->remainingcloseevents;
-    uv_close((uv_handle_t *)&tcpServer->exit_handle, onExitHandleClose);
+    loop->remainingcloseevents++;
+    LOG_verbose << "At onCloseRequested: closing server port = " << tcpServer->port << " remainingcloseevent = " << loop->remainingcloseevents;
+    uv_close((uv_handle_t *)&loop->server, onExitHandleClose);
+    loop->remainingcloseevents++;
+    LOG_verbose << "At onCloseRequested: closing exit_handle port = " << tcpServer->port << " remainingcloseevent = " << loop->remainingcloseevents;
+    uv_close((uv_handle_t *)&loop->exit_handle, onExitHandleClose);
 }
 
 void MegaTCPServer::closeConnection(MegaTCPContext *tcpctx)
@@ -27608,8 +30530,8 @@ void MegaTCPServer::closeTCPConnection(MegaTCPContext *tcpctx)
     tcpctx->finished = true;
     if (!uv_is_closing((uv_handle_t*)&tcpctx->tcphandle))
     {
-        tcpctx->server->remainingcloseevents++;
-        LOG_verbose << "At closeTCPConnection port = " << tcpctx->server->port << " remainingcloseevent = " << tcpctx->server->remainingcloseevents;
+        tcpctx->loop->remainingcloseevents++;
+        LOG_verbose << "At closeTCPConnection port = " << tcpctx->server->port << " remainingcloseevent = " << tcpctx->loop->remainingcloseevents;
         uv_close((uv_handle_t*)&tcpctx->tcphandle, onClose);
     }
 }
@@ -27654,8 +30576,20 @@ MegaHTTPServer::MegaHTTPServer(MegaApiImpl *megaApi, string basePath, bool useTL
     this->folderServerEnabled = true;
     this->offlineAttribute = false;
     this->subtitlesSupportEnabled = false;
+    this->metricsEnabled = false;
+    this->propFindCacheSize = 0;
+    this->propFindCacheGeneration = 0;
 }
 
+namespace {
+
+// the responses that don't depend on the request
+const string HTTP_RESPONSE_403 = "HTTP/1.1 403 Forbidden\r\nConnection: close\r\n\r\n";
+const string HTTP_RESPONSE_404 = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n";
+const string HTTP_RESPONSE_405 = "HTTP/1.1 405 Method not allowed\r\nConnection: close\r\n\r\n";
+
+} // namespace
+
 MegaTCPContext * MegaHTTPServer::initializeContext(uv_stream_t *server_handle)
 {
     MegaHTTPContext* httpctx = new MegaHTTPContext();
@@ -27717,6 +30651,16 @@ void MegaHTTPServer::processWriteFinished(MegaTCPContext* tcpctx, int status)
     LOG_verbose << "Bytes written: " << httpctx->lastBufferLen << " Remaining: " << (httpctx->size - httpctx->bytesWritten);
     httpctx->lastBuffer = NULL;
 
+    if (status >= 0 && (httpctx->propFindParent != UNDEF || httpctx->propFindPending.size()))
+    {
+        // more of a PROPFIND listing, in the room left by this write
+        uv_mutex_lock(&httpctx->mutex);
+        httpctx->streamingBuffer.freeData(httpctx->lastBufferLen);
+        httpctx->lastBufferLen = 0;
+        uv_mutex_unlock(&httpctx->mutex);
+        continueWebDavPropFindResponse(httpctx);
+    }
+
     if (status < 0 || httpctx->size == httpctx->bytesWritten)
     {
         if (status < 0)
@@ -27858,6 +30802,26 @@ void MegaHTTPServer::enableSubtitlesSupport(bool enable)
     this->subtitlesSupportEnabled = enable;
 }
 
+bool MegaHTTPServer::isMetricsEnabled()
+{
+    return metricsEnabled;
+}
+
+void MegaHTTPServer::enableMetrics(bool enable)
+{
+    this->metricsEnabled = enable;
+}
+
+void MegaHTTPServer::clearPropFindCache()
+{
+    std::lock_guard<std::mutex> g(propFindCacheMutex);
+    propFindCache.clear();
+    propFindCacheSize = 0;
+
+    // responses being generated may be outdated already
+    propFindCacheGeneration++;
+}
+
 char *MegaHTTPServer::getWebDavLink(MegaNode *node)
 {
     allowedWebDavHandles.insert(node->getHandle());
@@ -27869,8 +30833,13 @@ int MegaHTTPServer::onMessageBegin(http_parser *)
     return 0;
 }
 
-int MegaHTTPServer::onHeadersComplete(http_parser *)
+int MegaHTTPServer::onHeadersComplete(http_parser *parser)
 {
+    MegaHTTPContext* httpctx = (MegaHTTPContext*) parser->data;
+    if (httpctx->headerValueStarted)
+    {
+        processHeader(httpctx);
+    }
     return 0;
 }
 
@@ -27880,6 +30849,25 @@ int MegaHTTPServer::onUrlReceived(http_parser *parser, const char *url, size_t l
     httpctx->path.assign(url, length);
     LOG_debug << "URL received: " << httpctx->path;
 
+    size_t faprefix = 0;
+    if (length >= 15 && !memcmp(url, "/thumb/", 7))
+    {
+        httpctx->fileAttributeType = MegaApi::ATTR_TYPE_THUMBNAIL;
+        faprefix = 7;
+    }
+    else if (length >= 17 && !memcmp(url, "/preview/", 9))
+    {
+        httpctx->fileAttributeType = MegaApi::ATTR_TYPE_PREVIEW;
+        faprefix = 9;
+    }
+
+    if (faprefix)
+    {
+        httpctx->nodehandle.assign(url + faprefix, 8);
+        LOG_debug << "File attribute " << httpctx->fileAttributeType << " of node: " << httpctx->nodehandle;
+        return 0;
+    }
+
     if (length < 9 || url[0] != '/' || (length >= 10 && url[9] != '/' && url[9] != '!'))
     {
         LOG_debug << "URL without node handle";
@@ -27978,70 +30966,79 @@ int MegaHTTPServer::onUrlReceived(http_parser *parser, const char *url, size_t l
 int MegaHTTPServer::onHeaderField(http_parser *parser, const char *at, size_t length)
 {
     MegaHTTPContext* httpctx = (MegaHTTPContext*) parser->data;
-    httpctx->lastheader = string(at, length);
-    tolower_string(httpctx->lastheader);
 
-    if (length == 5 && !memcmp(at, "Range", 5))
+    // a header split between reads comes in several calls: the previous one is complete once the next starts
+    if (httpctx->headerValueStarted)
     {
-        httpctx->range = true;
-        LOG_debug << "Range header detected";
+        processHeader(httpctx);
     }
 
+    httpctx->lastheader.append(at, length);
     return 0;
 }
 
 int MegaHTTPServer::onHeaderValue(http_parser *parser, const char *at, size_t length)
 {
     MegaHTTPContext* httpctx = (MegaHTTPContext*) parser->data;
-    string value(at, length);
-    size_t index;
-    char *endptr;
+    httpctx->headerValueStarted = true;
+    httpctx->headerValue.append(at, length);
+    return 0;
+}
+
+void MegaHTTPServer::processHeader(MegaHTTPContext* httpctx)
+{
+    string& name = httpctx->lastheader;
+    const string& value = httpctx->headerValue;
+    tolower_string(name);
 
-    LOG_verbose << " onHeaderValue: " << httpctx->lastheader << " = " << value;
-    if (httpctx->lastheader == "depth")
+    LOG_verbose << " Header: " << name << " = " << value;
+    if (name == "depth")
     {
-        httpctx->depth = atoi(value.c_str());
+        // "infinity" lists the children only, like a missing header: the whole subtree could be huge
+        httpctx->depth = value == "infinity" ? -1 : atoi(value.c_str());
     }
-    else if (httpctx->lastheader == "host")
+    else if (name == "host")
     {
         httpctx->host = value;
     }
-    else if (httpctx->lastheader == "destination")
+    else if (name == "destination")
     {
         httpctx->destination = value;
     }
-    else if (httpctx->lastheader == "overwrite")
+    else if (name == "overwrite")
     {
         httpctx->overwrite = (value == "T");
     }
-    else if (httpctx->range)
+    else if (name == "range")
     {
         LOG_debug << "Range header value: " << value;
-        httpctx->range = false;
-        if (length > 7 && !memcmp(at, "bytes=", 6)
+        size_t index;
+        char *endptr;
+        if (value.size() > 7 && !value.compare(0, 6, "bytes=")
                 && ((index = value.find_first_of('-')) != string::npos))
         {
             endptr = (char *)value.c_str();
             unsigned long long number = strtoull(value.c_str() + 6, &endptr, 10);
-            if (endptr == value.c_str() || *endptr != '-' || number == ULLONG_MAX)
-            {
-                return 0;
-            }
-
-            httpctx->rangeStart = number;
-            if (length > (index + 1))
+            if (endptr != value.c_str() && *endptr == '-' && number != ULLONG_MAX)
             {
-                number = strtoull(value.c_str() + index + 1, &endptr, 10);
-                if (endptr == value.c_str() || *endptr != '\0' || number == ULLONG_MAX)
+                httpctx->rangeStart = number;
+                if (value.size() > (index + 1))
                 {
-                    return 0;
+                    number = strtoull(value.c_str() + index + 1, &endptr, 10);
+                    if (endptr != value.c_str() && *endptr == '\0' && number != ULLONG_MAX)
+                    {
+                        httpctx->rangeEnd = number;
+                    }
                 }
-                httpctx->rangeEnd = number;
+                LOG_debug << "Range value parsed: " << httpctx->rangeStart << " - " << httpctx->rangeEnd;
             }
-            LOG_debug << "Range value parsed: " << httpctx->rangeStart << " - " << httpctx->rangeEnd;
         }
     }
-    return 0;
+
+    // the buffers keep their capacity for the next header
+    httpctx->lastheader.clear();
+    httpctx->headerValue.clear();
+    httpctx->headerValueStarted = false;
 }
 
 int MegaHTTPServer::onBody(http_parser *parser, const char *b, size_t n)
@@ -28095,85 +31092,208 @@ int MegaHTTPServer::onBody(http_parser *parser, const char *b, size_t n)
     return 0;
 }
 
-string MegaHTTPServer::getWebDavProfFindNodeContents(MegaNode *node, string baseURL, bool offlineAttribute)
+void MegaHTTPServer::appendWebDavPropFindEntry(string& out, const string& url, const char *name, bool folder, int64_t size,
+                                               int64_t ctime, int64_t mtime, MegaHandle h, bool offlineAttribute)
 {
-    std::ostringstream web;
-
-    web << "<d:response>\r\n"
-           "<d:href>" << webdavurlescape(baseURL) << "</d:href>\r\n"
-           "<d:propstat>\r\n"
-           "<d:status>HTTP/1.1 200 OK</d:status>\r\n"
-           "<d:prop>\r\n"
-           "<d:displayname>"<< webdavnameescape(node->getName()) << "</d:displayname>\r\n"
-
-           "<d:creationdate>" << rfc1123_datetime(node->getCreationTime()) << "</d:creationdate>"
-           "<d:getlastmodified>" << rfc1123_datetime(node->getModificationTime()) << "</d:getlastmodified>"
-           ;
+    out.append("<d:response>\r\n"
+               "<d:href>").append(webdavurlescape(url)).append("</d:href>\r\n"
+               "<d:propstat>\r\n"
+               "<d:status>HTTP/1.1 200 OK</d:status>\r\n"
+               "<d:prop>\r\n"
+               "<d:displayname>").append(webdavnameescape(name)).append("</d:displayname>\r\n"
+               "<d:creationdate>").append(rfc1123_datetime(ctime)).append("</d:creationdate>"
+               "<d:getlastmodified>").append(rfc1123_datetime(mtime)).append("</d:getlastmodified>");
 
     if (offlineAttribute)
     {
         //(perhaps this could be based on number of files / or even better: size)
-          web << "<Z:Win32FileAttributes>00001000</Z:Win32FileAttributes> \r\n"; //FILE_ATTRIBUTE_OFFLINE
-//        web << "<Z:Win32FileAttributes>00040000</Z:Win32FileAttributes> \r\n"; // FILE_ATTRIBUTE_RECALL_ON_DATA_ACCESS (no actual difference)
+          out.append("<Z:Win32FileAttributes>00001000</Z:Win32FileAttributes> \r\n"); //FILE_ATTRIBUTE_OFFLINE
+//        out.append("<Z:Win32FileAttributes>00040000</Z:Win32FileAttributes> \r\n"); // FILE_ATTRIBUTE_RECALL_ON_DATA_ACCESS (no actual difference)
     }
 
-    if (node->isFolder())
+    if (folder)
     {
-        web << "<d:resourcetype>\r\n"
-               "<d:collection />\r\n"
-               "</d:resourcetype>\r\n";
+        out.append("<d:resourcetype>\r\n"
+                   "<d:collection />\r\n"
+                   "</d:resourcetype>\r\n");
     }
     else
     {
-        web << "<d:resourcetype />\r\n";
-        web << "<d:getcontentlength>" << node->getSize() << "</d:getcontentlength>\r\n";
+        // a new version of the file is a new node, so the handle and mtime identify the content
+        out.append("<d:resourcetype />\r\n"
+                   "<d:getcontentlength>").append(std::to_string(size)).append("</d:getcontentlength>\r\n"
+                   "<d:getetag>\"").append(toNodeHandle(h)).append("-").append(std::to_string(mtime)).append("\"</d:getetag>\r\n");
     }
-    web << "</d:prop>\r\n"
-           "</d:propstat>\r\n";
-    web << "</d:response>\r\n";
-    return web.str();
+    out.append("</d:prop>\r\n"
+               "</d:propstat>\r\n"
+               "</d:response>\r\n");
 }
 
-string MegaHTTPServer::getWebDavPropFindResponseForNode(string baseURL, string subnodepath, MegaNode *node, MegaHTTPContext* httpctx)
+string MegaHTTPServer::getWebDavProfFindNodeContents(MegaNode *node, string baseURL, bool offlineAttribute)
 {
-    std::ostringstream response;
-    std::ostringstream web;
-
-    web << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
-           "<d:multistatus xmlns:d=\"DAV:\" xmlns:Z=\"urn:schemas-microsoft-com::\">\r\n";
+    string web;
+    appendWebDavPropFindEntry(web, baseURL, node->getName(), node->isFolder(), node->getSize(),
+                              node->getCreationTime(), node->getModificationTime(), node->getHandle(), offlineAttribute);
+    return web;
+}
 
+void MegaHTTPServer::sendWebDavPropFindResponse(string baseURL, string subnodepath, MegaNode *node, MegaHTTPContext* httpctx)
+{
     string subbaseURL = baseURL + subnodepath;
     if (node->isFolder() && subbaseURL.size() && subbaseURL.at(subbaseURL.size() - 1) != '/')
     {
         subbaseURL.append("/");
     }
     MegaHTTPServer* httpserver = dynamic_cast<MegaHTTPServer *>(httpctx->server);
+    bool offline = httpserver->isOfflineAttributeEnabled();
+    bool listChildren = node->isFolder() && (httpctx->depth != 0);
+    httpctx->resultCode = API_OK;
 
-    web << getWebDavProfFindNodeContents(node, subbaseURL, httpserver->isOfflineAttributeEnabled());
-    if (node->isFolder() && (httpctx->depth != 0))
+    string key = subbaseURL + (listChildren ? "\n1" : "\n0") + (offline ? "\n1" : "\n0");
+    string response;
     {
-        MegaNodeList *children = httpctx->megaApi->getChildren(node, MegaApi::ORDER_NONE);
-        for (int i = 0; i < children->size(); i++)
+        std::lock_guard<std::mutex> g(httpserver->propFindCacheMutex);
+        auto it = httpserver->propFindCache.find(key);
+        if (it != httpserver->propFindCache.end()
+                && it->second.size() < size_t(httpserver->getMaxBufferSize()) - 512)
         {
-            MegaNode *child = children->get(i);
-            string childURL = subbaseURL + child->getName();
-            web << getWebDavProfFindNodeContents(child, childURL, httpserver->isOfflineAttributeEnabled());
+            response = it->second;
         }
-        delete children;
+        httpctx->propFindGeneration = httpserver->propFindCacheGeneration;
     }
 
-    web << "</d:multistatus>"
-           "\r\n";
+    if (response.size())
+    {
+        LOG_debug << "Sending cached PROPFIND response. Size: " << response.size();
+    }
+    else
+    {
+        response = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+                   "<d:multistatus xmlns:d=\"DAV:\" xmlns:Z=\"urn:schemas-microsoft-com::\">\r\n";
+        response.append(getWebDavProfFindNodeContents(node, subbaseURL, offline));
+
+        if (listChildren)
+        {
+            // the length isn't known until the last child is written: the response ends with the connection
+            httpctx->streamingBuffer.init(httpserver->getMaxBufferSize());
+            httpctx->propFindParent = node->getHandle();
+            httpctx->propFindOffset = 0;
+            httpctx->propFindURL = subbaseURL;
+            httpctx->propFindCacheKey = key;
+            httpctx->propFindBody = response;
+            httpctx->propFindPending = "HTTP/1.1 207 Multi-Status\r\n"
+                                       "content-type: application/xml; charset=utf-8\r\n"
+                                       "server: MEGAsdk\r\n"
+                                       "connection: close\r\n"
+                                       "\r\n" + response;
+            continueWebDavPropFindResponse(httpctx);
+            sendNextBytes(httpctx);
+            return;
+        }
 
-    string sweb = web.str();
-    response << "HTTP/1.1 207 Multi-Status\r\n"
-                "content-length: " << sweb.size() << "\r\n"
-                                                     "content-type: application/xml; charset=utf-8\r\n"
-                                                     "server: MEGAsdk\r\n"
-                                                     "\r\n";
-    response << sweb;
-    httpctx->resultCode = API_OK;
-    return response.str();
+        response.append("</d:multistatus>\r\n");
+        std::lock_guard<std::mutex> g(httpserver->propFindCacheMutex);
+        if (httpctx->propFindGeneration == httpserver->propFindCacheGeneration)
+        {
+            if (httpserver->propFindCacheSize + response.size() > MAX_PROPFIND_CACHE_SIZE)
+            {
+                httpserver->propFindCache.clear();
+                httpserver->propFindCacheSize = 0;
+            }
+            string& cached = httpserver->propFindCache[key];
+            httpserver->propFindCacheSize += response.size() - cached.size();
+            cached = response;
+        }
+    }
+
+    string headers = "HTTP/1.1 207 Multi-Status\r\n"
+                     "content-length: " + std::to_string(response.size()) + "\r\n"
+                     "content-type: application/xml; charset=utf-8\r\n"
+                     "server: MEGAsdk\r\n"
+                     "\r\n";
+    headers.append(response);
+    sendHeaders(httpctx, &headers);
+}
+
+void MegaHTTPServer::continueWebDavPropFindResponse(MegaHTTPContext* httpctx)
+{
+    MegaHTTPServer* httpserver = dynamic_cast<MegaHTTPServer *>(httpctx->server);
+
+    for (;;)
+    {
+        if (httpctx->propFindPending.size())
+        {
+            uv_mutex_lock(&httpctx->mutex);
+            unsigned appended = httpctx->streamingBuffer.append(httpctx->propFindPending.data(), static_cast<unsigned>(httpctx->propFindPending.size()));
+            uv_mutex_unlock(&httpctx->mutex);
+
+            httpctx->size += appended;
+            httpctx->propFindPending.erase(0, appended);
+            if (httpctx->propFindPending.size())
+            {
+                // the buffer is full, continued when the socket drains
+                return;
+            }
+        }
+
+        if (httpctx->propFindParent == UNDEF)
+        {
+            return;
+        }
+
+        string entries;
+        int count = httpctx->megaApi->httpServerGetWebDavEntries(httpctx->propFindParent, httpctx->propFindURL,
+                                                                 httpserver->isOfflineAttributeEnabled(),
+                                                                 httpctx->propFindOffset, PROPFIND_BATCH_SIZE, entries);
+        if (count < 0)
+        {
+            LOG_warn << "Folder removed while listing it for PROPFIND";
+            string().swap(httpctx->propFindBody);
+        }
+        else
+        {
+            httpctx->propFindOffset += count;
+        }
+
+        bool last = count < PROPFIND_BATCH_SIZE;
+        if (last)
+        {
+            httpctx->propFindParent = UNDEF;
+            entries.append("</d:multistatus>\r\n");
+        }
+
+        if (httpctx->propFindBody.size())
+        {
+            if (httpctx->propFindBody.size() + entries.size() > MAX_PROPFIND_CACHED_RESPONSE)
+            {
+                // too big to be cached
+                string().swap(httpctx->propFindBody);
+            }
+            else
+            {
+                httpctx->propFindBody.append(entries);
+            }
+        }
+
+        if (last && httpctx->propFindBody.size())
+        {
+            std::lock_guard<std::mutex> g(httpserver->propFindCacheMutex);
+            if (httpctx->propFindGeneration == httpserver->propFindCacheGeneration)
+            {
+                if (httpserver->propFindCacheSize + httpctx->propFindBody.size() > MAX_PROPFIND_CACHE_SIZE)
+                {
+                    httpserver->propFindCache.clear();
+                    httpserver->propFindCacheSize = 0;
+                }
+                string& cached = httpserver->propFindCache[httpctx->propFindCacheKey];
+                httpserver->propFindCacheSize += httpctx->propFindBody.size() - cached.size();
+                cached.swap(httpctx->propFindBody);
+            }
+            string().swap(httpctx->propFindBody);
+        }
+
+        httpctx->propFindPending.swap(entries);
+    }
 }
 
 string MegaHTTPServer::getResponseForNode(MegaNode *node, MegaHTTPContext* httpctx)
@@ -28513,6 +31633,108 @@ void MegaHTTPServer::returnHttpCode(MegaHTTPContext* httpctx, int errorCode, str
     }
 }
 
+void MegaHTTPServer::sendFileAttribute(MegaHTTPContext *httpctx, int method)
+{
+    if (method != HTTP_GET && method != HTTP_HEAD)
+    {
+        returnHttpCode(httpctx, 405);
+        return;
+    }
+
+    MegaHandle h = MegaApi::base64ToHandle(httpctx->nodehandle.c_str());
+    if (!httpctx->server->isHandleAllowed(h))
+    {
+        LOG_debug << "Forbidden due to the restricted mode";
+        returnHttpCode(httpctx, 403);
+        return;
+    }
+
+    std::unique_ptr<MegaNode> node(httpctx->megaApi->getNodeByHandle(h));
+    if (!node || !(httpctx->fileAttributeType == MegaApi::ATTR_TYPE_THUMBNAIL ? node->hasThumbnail() : node->hasPreview()))
+    {
+        returnHttpCode(httpctx, 404);
+        return;
+    }
+
+    string data;
+    if (httpctx->megaApi->getCachedNodeAttribute(h, httpctx->fileAttributeType, data))
+    {
+        LOG_debug << "Sending file attribute from memory. Size: " << data.size();
+        returnFileAttribute(httpctx, data);
+        return;
+    }
+
+    // concurrent fetches are batched by the file attribute channels of the engine
+    httpctx->megaApi->getNodeAttribute(node.get(), httpctx->fileAttributeType, NULL, httpctx, true);
+}
+
+void MegaHTTPServer::returnFileAttribute(MegaHTTPContext *httpctx, const string& data, bool synchronous)
+{
+    // the whole response goes in a single buffer
+    if (data.size() + 256 > size_t(httpctx->server->getMaxBufferSize()))
+    {
+        LOG_warn << "File attribute too big for the buffer: " << data.size();
+        returnHttpCode(httpctx, 500, string(), synchronous);
+        return;
+    }
+
+    string response = "HTTP/1.1 200 OK\r\n"
+                      "content-type: image/jpeg\r\n"
+                      "content-length: " + std::to_string(data.size()) + "\r\n"
+                      "server: MEGAsdk\r\n"
+                      "connection: close\r\n"
+                      "\r\n";
+    if (httpctx->parser.method != HTTP_HEAD)
+    {
+        response.append(data);
+    }
+
+    httpctx->resultCode = API_OK;
+    if (synchronous)
+    {
+        sendHeaders(httpctx, &response);
+    }
+    else
+    {
+        uv_mutex_lock(&httpctx->mutex_responses);
+        httpctx->responses.push_back(std::move(response));
+        uv_mutex_unlock(&httpctx->mutex_responses);
+        uv_async_send(&httpctx->asynchandle);
+    }
+}
+
+void MegaHTTPServer::sendMetrics(MegaHTTPContext *httpctx, int method)
+{
+    if (method != HTTP_GET && method != HTTP_HEAD)
+    {
+        returnHttpCode(httpctx, 405);
+        return;
+    }
+
+    // the counters are atomic, so scrapes don't wait for the SDK thread
+    string body = httpctx->megaApi->getPrometheusMetrics();
+    if (body.size() + 256 > size_t(httpctx->server->getMaxBufferSize()))
+    {
+        LOG_warn << "Metrics too big for the buffer: " << body.size();
+        returnHttpCode(httpctx, 500);
+        return;
+    }
+
+    string response = "HTTP/1.1 200 OK\r\n"
+                      "content-type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                      "content-length: " + std::to_string(body.size()) + "\r\n"
+                      "server: MEGAsdk\r\n"
+                      "connection: close\r\n"
+                      "\r\n";
+    if (method != HTTP_HEAD)
+    {
+        response.append(body);
+    }
+
+    httpctx->resultCode = API_OK;
+    sendHeaders(httpctx, &response);
+}
+
 void MegaHTTPServer::returnHttpCodeAsyncBasedOnRequestError(MegaHTTPContext* httpctx, MegaError *e)
 {
     return returnHttpCodeBasedOnRequestError(httpctx, e, false);
@@ -28555,13 +31777,8 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
         break;
     default:
         LOG_debug << "Method not allowed: " << getHTTPMethodName(parser->method);
-        response << "HTTP/1.1 405 Method not allowed\r\n"
-                    "Connection: close\r\n"
-                    "\r\n";
-
         httpctx->resultCode = 405;
-        string resstr = response.str();
-        sendHeaders(httpctx, &resstr);
+        sendHeaders(httpctx, &HTTP_RESPONSE_405);
         return 0;
     }
 
@@ -28581,6 +31798,18 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
         return 0;
     }
 
+    if (httpctx->fileAttributeType >= 0)
+    {
+        sendFileAttribute(httpctx, parser->method);
+        return 0;
+    }
+
+    if (httpctx->path == "/metrics" && httpserver->isMetricsEnabled())
+    {
+        sendMetrics(httpctx, parser->method);
+        return 0;
+    }
+
     if (httpctx->path == "/")
     {
         node = httpctx->megaApi->getRootNode();
@@ -28596,12 +31825,8 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
 
     if (!httpctx->nodehandle.size())
     {
-        response << "HTTP/1.1 404 Not Found\r\n"
-                    "Connection: close\r\n"
-                  << "\r\n";
         httpctx->resultCode = 404;
-        string resstr = response.str();
-        sendHeaders(httpctx, &resstr);
+        sendHeaders(httpctx, &HTTP_RESPONSE_404);
         delete node;
         return 0;
     }
@@ -28610,13 +31835,8 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
     if (!httpctx->server->isHandleAllowed(h))
     {
         LOG_debug << "Forbidden due to the restricted mode";
-        response << "HTTP/1.1 403 Forbidden\r\n"
-                    "Connection: close\r\n"
-                  << "\r\n";
-
         httpctx->resultCode = 403;
-        string resstr = response.str();
-        sendHeaders(httpctx, &resstr);
+        sendHeaders(httpctx, &HTTP_RESPONSE_403);
         delete node;
         return 0;
     }
@@ -28663,13 +31883,8 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
         if (!httpctx->nodehandle.size() || !httpctx->nodekey.size())
         {
             LOG_warn << "URL not found: " << httpctx->path;
-            response << "HTTP/1.1 404 Not Found\r\n"
-                        "Connection: close\r\n"
-                      << "\r\n";
-
             httpctx->resultCode = 404;
-            string resstr = response.str();
-            sendHeaders(httpctx, &resstr);
+            sendHeaders(httpctx, &HTTP_RESPONSE_404);
             return 0;
         }
         else if (httpctx->nodesize >= 0)
@@ -28700,13 +31915,8 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
     {
         if (parser->method == HTTP_PROPFIND)
         {
-            response << "HTTP/1.1 404 Not Found\r\n"
-                        "Connection: close\r\n"
-                     << "\r\n";
-
             httpctx->resultCode = 404;
-            string resstr = response.str();
-            sendHeaders(httpctx, &resstr);
+            sendHeaders(httpctx, &HTTP_RESPONSE_404);
             delete node;
             return 0;
         }
@@ -28746,13 +31956,8 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
             if (!subtitles)
             {
                 LOG_warn << "Invalid name: " << httpctx->nodename << " - " << node->getName();
-                response << "HTTP/1.1 404 Not Found\r\n"
-                            "Connection: close\r\n"
-                         << "\r\n";
-
                 httpctx->resultCode = 404;
-                string resstr = response.str();
-                sendHeaders(httpctx, &resstr);
+                sendHeaders(httpctx, &HTTP_RESPONSE_404);
                 delete node;
                 return 0;
             }
@@ -28789,8 +31994,7 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
     {
         string baseURL = string("http") + (httpctx->server->useTLS ? "s" : "") + "://"
                 + httpctx->host + "/" + httpctx->nodehandle + "/" + httpctx->nodename + "/";
-        string resstr = getWebDavPropFindResponseForNode(baseURL, httpctx->subpathrelative, node, httpctx);
-        sendHeaders(httpctx, &resstr);
+        sendWebDavPropFindResponse(baseURL, httpctx->subpathrelative, node, httpctx);
         delete node;
         delete baseNode;
         return 0;
@@ -29271,13 +32475,8 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
         {
             if (!httpserver->isFolderServerEnabled())
             {
-                response << "HTTP/1.1 403 Forbidden\r\n"
-                            "Connection: close\r\n"
-                          << "\r\n";
-
                 httpctx->resultCode = 403;
-                string resstr = response.str();
-                sendHeaders(httpctx, &resstr);
+                sendHeaders(httpctx, &HTTP_RESPONSE_403);
                 delete node;
                 delete baseNode;
                 return 0;
@@ -29294,13 +32493,8 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
         //File node
         if (!httpserver->isFileServerEnabled())
         {
-            response << "HTTP/1.1 403 Forbidden\r\n"
-                        "Connection: close\r\n"
-                      << "\r\n";
-
             httpctx->resultCode = 403;
-            string resstr = response.str();
-            sendHeaders(httpctx, &resstr);
+            sendHeaders(httpctx, &HTTP_RESPONSE_403);
             delete node;
             delete baseNode;
             return 0;
@@ -29441,7 +32635,7 @@ int MegaHTTPServer::streamNode(MegaHTTPContext *httpctx)
     return 0;
 }
 
-void MegaHTTPServer::sendHeaders(MegaHTTPContext *httpctx, string *headers)
+void MegaHTTPServer::sendHeaders(MegaHTTPContext *httpctx, const string *headers)
 {
     LOG_debug << "Response headers: " << *headers;
     httpctx->streamingBuffer.append(headers->data(), static_cast<unsigned>(headers->size()));
@@ -29523,8 +32717,7 @@ void MegaHTTPServer::processAsyncEvent(MegaTCPContext* tcpctx)
             }
 
             httpctx->resultCode = 404;
-            string resstr = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n";
-            sendHeaders(httpctx, &resstr);
+            sendHeaders(httpctx, &HTTP_RESPONSE_404);
             return;
         }
 
@@ -29563,25 +32756,42 @@ void MegaHTTPServer::sendNextBytes(MegaHTTPContext *httpctx)
         return;
     }
 
-    uv_buf_t resbuf = httpctx->streamingBuffer.nextBuffer();
+    // TLS writes take a single buffer, plain ones as many as the output size allows
+    std::vector<uv_buf_t> buffers;
+    unsigned int len = 0;
+#ifdef ENABLE_EVT_TLS
+    if (httpctx->server->useTLS)
+    {
+        uv_buf_t resbuf = httpctx->streamingBuffer.nextBuffer();
+        if (resbuf.len)
+        {
+            buffers.push_back(resbuf);
+            len = static_cast<unsigned>(resbuf.len);
+        }
+    }
+    else
+#endif
+    {
+        len = httpctx->streamingBuffer.nextBuffers(buffers);
+    }
     uv_mutex_unlock(&httpctx->mutex);
 
-    if (!resbuf.len)
+    if (!len)
     {
         LOG_verbose << "Skipping write. No data available";
         return;
     }
 
-    LOG_verbose << "Writing " << resbuf.len << " bytes";
-    httpctx->rangeWritten += resbuf.len;
-    httpctx->lastBuffer = resbuf.base;
-    httpctx->lastBufferLen = resbuf.len;
+    LOG_verbose << "Writing " << len << " bytes in " << buffers.size() << " buffers";
+    httpctx->rangeWritten += len;
+    httpctx->lastBuffer = buffers[0].base;
+    httpctx->lastBufferLen = len;
 
 #ifdef ENABLE_EVT_TLS
     if (httpctx->server->useTLS)
     {
         //notice this, contrary to !useTLS is synchronous
-        int err = evt_tls_write(httpctx->evt_tls, resbuf.base, resbuf.len, onWriteFinished_tls);
+        int err = evt_tls_write(httpctx->evt_tls, buffers[0].base, buffers[0].len, onWriteFinished_tls);
         if (err <= 0)
         {
             LOG_warn << "Finishing due to an error sending the response: " << err;
@@ -29594,7 +32804,7 @@ void MegaHTTPServer::sendNextBytes(MegaHTTPContext *httpctx)
         uv_write_t *req = new uv_write_t();
         req->data = httpctx;
 
-        if (int err = uv_write(req, (uv_stream_t*)&httpctx->tcphandle, &resbuf, 1, onWriteFinished))
+        if (int err = uv_write(req, (uv_stream_t*)&httpctx->tcphandle, buffers.data(), unsigned(buffers.size()), onWriteFinished))
         {
             delete req;
             LOG_warn << "Finishing due to an error in uv_write: " << err;
@@ -29604,6 +32814,11 @@ void MegaHTTPServer::sendNextBytes(MegaHTTPContext *httpctx)
                 uv_close((uv_handle_t*)&httpctx->tcphandle, onClose);
             }
         }
+        else
+        {
+            // bigger writes while the socket takes them without queueing
+            httpctx->streamingBuffer.adaptOutputSize(!httpctx->tcphandle.write_queue_size);
+        }
 #ifdef ENABLE_EVT_TLS
     }
 #endif
@@ -29614,11 +32829,12 @@ MegaHTTPContext::MegaHTTPContext()
     rangeStart = -1;
     rangeEnd = -1;
     rangeWritten = -1;
-    range = false;
+    headerValueStarted = false;
     failed = false;
     pause = false;
     nodereceived = false;
     resultCode = API_EINTERNAL;
+    fileAttributeType = -1;
     node = NULL;
     nodesize = -1;
     messageBody = NULL;
@@ -29626,6 +32842,9 @@ MegaHTTPContext::MegaHTTPContext()
     tmpFileAccess = NULL;
     newParentNode = UNDEF;
     nodeToMove = UNDEF;
+    propFindParent = UNDEF;
+    propFindOffset = 0;
+    propFindGeneration = 0;
     depth = -1;
     overwrite = true; //GVFS-DAV via command line does not include this header (assumed true)
     lastBuffer = NULL;
@@ -29818,6 +33037,23 @@ void MegaHTTPContext::onRequestFinish(MegaApi *, MegaRequest *request, MegaError
         node = request->getPublicMegaNode();
         nodereceived = true;
     }
+    else if (request->getType() == MegaRequest::TYPE_GET_ATTR_FILE)
+    {
+        string data;
+        if (e->getErrorCode() != MegaError::API_OK)
+        {
+            httpserver->returnHttpCodeAsyncBasedOnRequestError(this, e);
+        }
+        else if (!megaApi->getCachedNodeAttribute(request->getNodeHandle(), request->getParamType(), data))
+        {
+            // too big to be kept in memory
+            httpserver->returnHttpCodeAsync(this, 500);
+        }
+        else
+        {
+            httpserver->returnFileAttribute(this, data, false);
+        }
+    }
     uv_async_send(&asynchandle);
 }
 
@@ -31728,6 +34964,13 @@ void MegaFTPDataServer::processWriteFinished(MegaTCPContext *tcpctx, int status)
             return;
         }
 
+        if (ftpdatactx->localFile >= 0)
+        {
+            ftpdatactx->lastBufferLen = 0;
+            sendLocalBytes(ftpdatactx);
+            return;
+        }
+
         uv_mutex_lock(&ftpdatactx->mutex);
         if (ftpdatactx->lastBufferLen)
         {
@@ -31761,6 +35004,8 @@ void MegaFTPDataServer::sendData()
 
     this->notifyNewConnectionRequired = true;
 
+    // data servers run a single loop
+    list<MegaTCPContext*>& connections = loops.front()->connections;
     if (connections.size())
     {
         tcpctx = connections.back(); //only interested in the last connection received (the one that needs response)
@@ -31991,10 +35236,15 @@ void MegaFTPDataServer::processAsyncEvent(MegaTCPContext *tcpctx)
 
             ftpdatactx->megaApi->fireOnFtpStreamingStart(ftpdatactx->transfer);
 
-            LOG_debug << "Requesting range. From " << start << "  size " << len;
             ftpdatactx->rangeWritten = 0;
-            if (start || len)
+            if (len && fds->openLocalCopy(ftpdatactx, nodeToDownload))
+            {
+                LOG_debug << "Serving range from the synced copy. From " << start << "  size " << len;
+                fds->sendLocalBytes(ftpdatactx);
+            }
+            else if (start || len)
             {
+                LOG_debug << "Requesting range. From " << start << "  size " << len;
                 ftpdatactx->megaApi->startStreaming(nodeToDownload, start, len, ftpdatactx);
             }
             else
@@ -32005,6 +35255,10 @@ void MegaFTPDataServer::processAsyncEvent(MegaTCPContext *tcpctx)
                 fds->processWriteFinished(ftpdatactx, 0);
             }
         }
+        else if (ftpdatactx->localFile >= 0)
+        {
+            sendLocalBytes(ftpdatactx);
+        }
         else
         {
             LOG_debug << "Calling sendNextBytes port = " << fds->port;
@@ -32025,7 +35279,7 @@ void MegaFTPDataServer::processOnAsyncEventClose(MegaTCPContext* tcpctx)
     MegaFTPDataContext* ftpdatactx = dynamic_cast<MegaFTPDataContext *>(tcpctx);
     MegaFTPDataServer *fds = ((MegaFTPDataServer *)ftpdatactx->server);
 
-    LOG_verbose << "MegaFTPDataServer::processOnAsyncEventClose. tcpctx=" << tcpctx << " port = " << fds->port << " remaining = " << fds->remainingcloseevents;
+    LOG_verbose << "MegaFTPDataServer::processOnAsyncEventClose. tcpctx=" << tcpctx << " port = " << fds->port << " remaining = " << tcpctx->loop->remainingcloseevents;
 
     fds->remotePathToUpload = "";
 
@@ -32036,7 +35290,7 @@ void MegaFTPDataServer::processOnAsyncEventClose(MegaTCPContext* tcpctx)
         ftpdatactx->transfer = NULL; // this has been deleted in fireOnStreamingFinish
     }
 
-    if (!fds->remainingcloseevents && fds->closing)
+    if (!tcpctx->loop->remainingcloseevents && tcpctx->loop->closing)
     {
         LOG_verbose << "MegaFTPDataServer::processOnAsyncEventClose stopping without waiting. port = " << fds->port;
         fds->stop(true);
@@ -32095,25 +35349,42 @@ void MegaFTPDataServer::sendNextBytes(MegaFTPDataContext *ftpdatactx)
         return;
     }
 
-    uv_buf_t resbuf = ftpdatactx->streamingBuffer.nextBuffer();
+    // TLS writes take a single buffer, plain ones as many as the output size allows
+    std::vector<uv_buf_t> buffers;
+    unsigned int len = 0;
+#ifdef ENABLE_EVT_TLS
+    if (ftpdatactx->server->useTLS)
+    {
+        uv_buf_t resbuf = ftpdatactx->streamingBuffer.nextBuffer();
+        if (resbuf.len)
+        {
+            buffers.push_back(resbuf);
+            len = static_cast<unsigned>(resbuf.len);
+        }
+    }
+    else
+#endif
+    {
+        len = ftpdatactx->streamingBuffer.nextBuffers(buffers);
+    }
     uv_mutex_unlock(&ftpdatactx->mutex);
 
-    if (!resbuf.len)
+    if (!len)
     {
         LOG_verbose << "Skipping write. No data available." << " buffered = " << ftpdatactx->streamingBuffer.availableData();
         return;
     }
 
-    LOG_verbose << "Writing " << resbuf.len << " bytes" << " buffered = " << ftpdatactx->streamingBuffer.availableData();
-    ftpdatactx->rangeWritten += resbuf.len;
-    ftpdatactx->lastBuffer = resbuf.base;
-    ftpdatactx->lastBufferLen = resbuf.len;
+    LOG_verbose << "Writing " << len << " bytes in " << buffers.size() << " buffers" << " buffered = " << ftpdatactx->streamingBuffer.availableData();
+    ftpdatactx->rangeWritten += len;
+    ftpdatactx->lastBuffer = buffers[0].base;
+    ftpdatactx->lastBufferLen = len;
 
 #ifdef ENABLE_EVT_TLS
     if (ftpdatactx->server->useTLS)
     {
         //notice this, contrary to !useTLS is synchronous
-        int err = evt_tls_write(ftpdatactx->evt_tls, resbuf.base, resbuf.len, onWriteFinished_tls);
+        int err = evt_tls_write(ftpdatactx->evt_tls, buffers[0].base, buffers[0].len, onWriteFinished_tls);
         if (err <= 0)
         {
             LOG_warn << "Finishing due to an error sending the response: " << err;
@@ -32126,17 +35397,152 @@ void MegaFTPDataServer::sendNextBytes(MegaFTPDataContext *ftpdatactx)
         uv_write_t *req = new uv_write_t();
         req->data = ftpdatactx;
 
-        if (int err = uv_write(req, (uv_stream_t*)&ftpdatactx->tcphandle, &resbuf, 1, onWriteFinished))
+        if (int err = uv_write(req, (uv_stream_t*)&ftpdatactx->tcphandle, buffers.data(), unsigned(buffers.size()), onWriteFinished))
         {
             delete req;
             LOG_warn << "Finishing due to an error in uv_write: " << err;
             closeTCPConnection(ftpdatactx);
         }
+        else
+        {
+            // bigger writes while the socket takes them without queueing
+            ftpdatactx->streamingBuffer.adaptOutputSize(!ftpdatactx->tcphandle.write_queue_size);
+        }
 #ifdef ENABLE_EVT_TLS
     }
 #endif
 }
 
+bool MegaFTPDataServer::openLocalCopy(MegaFTPDataContext *ftpdatactx, MegaNode *node)
+{
+#if defined(ENABLE_SYNC) && !defined(_WIN32)
+    if (ftpdatactx->localFile >= 0)
+    {
+        return true;
+    }
+
+    // sendfile can't go through the TLS layer
+    if (useTLS)
+    {
+        return false;
+    }
+
+    string localPath = megaApi->getSyncedLocalCopy(node);
+    if (localPath.empty())
+    {
+        return false;
+    }
+
+    uv_loop_t *loop = &ftpdatactx->loop->uv_loop;
+    uv_fs_t req;
+    uv_file fd = uv_fs_open(loop, &req, localPath.c_str(), O_RDONLY, 0, NULL);
+    uv_fs_req_cleanup(&req);
+    if (fd < 0)
+    {
+        LOG_debug << "Unable to open synced copy: " << localPath << ": " << uv_err_name(fd);
+        return false;
+    }
+
+    // the file could have changed since the sync engine last saw it
+    int err = uv_fs_fstat(loop, &req, fd, NULL);
+    m_off_t localSize = err ? -1 : m_off_t(req.statbuf.st_size);
+    uv_fs_req_cleanup(&req);
+    if (localSize != node->getSize())
+    {
+        LOG_debug << "Synced copy doesn't match the node: " << localPath;
+        uv_fs_close(loop, &req, fd, NULL);
+        uv_fs_req_cleanup(&req);
+        return false;
+    }
+
+    ftpdatactx->localFile = fd;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void MegaFTPDataServer::sendLocalBytes(MegaFTPDataContext *ftpdatactx)
+{
+    if (ftpdatactx->finished || ftpdatactx->lastBuffer)
+    {
+        return;
+    }
+
+    if (ftpdatactx->bytesWritten >= ftpdatactx->size)
+    {
+        processWriteFinished(ftpdatactx, 0);
+        return;
+    }
+
+    uv_loop_t *loop = &ftpdatactx->loop->uv_loop;
+    m_off_t offset = ftpdatactx->rangeStart + ftpdatactx->bytesWritten;
+    m_off_t remaining = ftpdatactx->size - ftpdatactx->bytesWritten;
+    int err = UV_EAGAIN;
+
+#ifndef _WIN32
+    // the kernel copies the file straight into the (non-blocking) socket
+    uv_os_fd_t socket;
+    err = uv_fileno((uv_handle_t*)&ftpdatactx->tcphandle, &socket);
+    if (!err)
+    {
+        uv_fs_t req;
+        size_t len = size_t(std::min<m_off_t>(remaining, m_off_t(LOCAL_SENDFILE_CHUNK)));
+        err = uv_fs_sendfile(loop, &req, socket, ftpdatactx->localFile, offset, len, NULL);
+        uv_fs_req_cleanup(&req);
+    }
+#endif
+
+    if (err > 0)
+    {
+        LOG_verbose << "Sent " << err << " bytes from the synced copy";
+        ftpdatactx->bytesWritten += err;
+        ftpdatactx->rangeWritten += err;
+
+        // continue from the event loop so that other connections are served too
+        uv_async_send(&ftpdatactx->asynchandle);
+        return;
+    }
+
+    if (err && err != UV_EAGAIN)
+    {
+        LOG_warn << "Finishing due to an error sending the synced copy: " << err << ": " << uv_err_name(err);
+        closeTCPConnection(ftpdatactx);
+        return;
+    }
+
+    // the socket is full: queue a regular write, whose completion tells when it drains
+    if (!ftpdatactx->localBuffer)
+    {
+        ftpdatactx->localBuffer.reset(new char[LOCAL_WRITE_CHUNK]);
+    }
+
+    uv_fs_t req;
+    uv_buf_t buf = uv_buf_init(ftpdatactx->localBuffer.get(),
+                               unsigned(std::min<m_off_t>(remaining, m_off_t(LOCAL_WRITE_CHUNK))));
+    int nread = uv_fs_read(loop, &req, ftpdatactx->localFile, &buf, 1, offset, NULL);
+    uv_fs_req_cleanup(&req);
+    if (nread <= 0)
+    {
+        LOG_warn << "Finishing due to an error reading the synced copy: " << nread;
+        closeTCPConnection(ftpdatactx);
+        return;
+    }
+
+    buf.len = nread;
+    ftpdatactx->rangeWritten += nread;
+    ftpdatactx->lastBuffer = buf.base;
+    ftpdatactx->lastBufferLen = nread;
+
+    uv_write_t *writereq = new uv_write_t();
+    writereq->data = ftpdatactx;
+    if (int werr = uv_write(writereq, (uv_stream_t*)&ftpdatactx->tcphandle, &buf, 1, onWriteFinished))
+    {
+        delete writereq;
+        LOG_warn << "Finishing due to an error in uv_write: " << werr;
+        closeTCPConnection(ftpdatactx);
+    }
+}
 
 MegaFTPDataContext::MegaFTPDataContext()
 {
@@ -32151,12 +35557,19 @@ MegaFTPDataContext::MegaFTPDataContext()
     rangeStart = 0;
     tmpFileAccess = NULL;
     tmpFileSize = 0;
+    localFile = -1;
     this->controlRespondedElsewhere = false;
     this->controlResponseCode = 426;
 }
 
 MegaFTPDataContext::~MegaFTPDataContext()
 {
+    if (localFile >= 0)
+    {
+        uv_fs_t req;
+        uv_fs_close(&loop->uv_loop, &req, localFile, NULL);
+        uv_fs_req_cleanup(&req);
+    }
     delete transfer;
     delete node;
 }
@@ -32846,6 +36259,215 @@ MegaChildrenListsPrivate::MegaChildrenListsPrivate()
 {
 }
 
+MegaNodeCursorPrivate::MegaNodeCursorPrivate(MegaApiImpl* api, vector<handle>&& handles)
+    : mApi(api)
+    , mHandles(move(handles))
+    , mNodes(mHandles.size())
+{
+}
+
+int MegaNodeCursorPrivate::size() const
+{
+    return int(mHandles.size());
+}
+
+MegaHandle MegaNodeCursorPrivate::getHandle(int i) const
+{
+    return (i < 0 || i >= size()) ? INVALID_HANDLE : mHandles[i];
+}
+
+MegaNode *MegaNodeCursorPrivate::get(int i)
+{
+    if (i < 0 || i >= size())
+    {
+        return NULL;
+    }
+
+    if (!mNodes[i])
+    {
+        mNodes[i].reset(mApi->getNodeByHandle(mHandles[i]));
+    }
+    return mNodes[i].get();
+}
+
+MegaNodeList *MegaNodeCursorPrivate::getPage(int offset, int limit)
+{
+    offset = std::max(0, std::min(offset, size()));
+    limit = std::max(0, std::min(limit, size() - offset));
+
+    // created at once under one lock, independently of the nodes get() keeps
+    vector<MegaNode*> nodes;
+    mApi->getNodesByHandle(mHandles.data() + offset, size_t(limit), nodes);
+    nodes.erase(std::remove(nodes.begin(), nodes.end(), nullptr), nodes.end());
+    return new MegaNodeListPrivate(move(nodes));
+}
+
+void MegaTransferColumnsPrivate::add(MegaTransferPrivate* transfer)
+{
+    mTags.push_back(transfer->getTag());
+    mTypes.push_back(transfer->getType());
+    mStates.push_back(transfer->getState());
+    mTransferredBytes.push_back(transfer->getTransferredBytes());
+    mTotalBytes.push_back(transfer->getTotalBytes());
+    mSpeeds.push_back(transfer->getSpeed());
+    mPriorities.push_back(transfer->getPriority());
+}
+
+int MegaTransferColumnsPrivate::size() const
+{
+    return int(mTags.size());
+}
+
+const int *MegaTransferColumnsPrivate::getTags() const
+{
+    return mTags.data();
+}
+
+const int *MegaTransferColumnsPrivate::getTypes() const
+{
+    return mTypes.data();
+}
+
+const int *MegaTransferColumnsPrivate::getStates() const
+{
+    return mStates.data();
+}
+
+const long long *MegaTransferColumnsPrivate::getTransferredBytes() const
+{
+    return mTransferredBytes.data();
+}
+
+const long long *MegaTransferColumnsPrivate::getTotalBytes() const
+{
+    return mTotalBytes.data();
+}
+
+const long long *MegaTransferColumnsPrivate::getSpeeds() const
+{
+    return mSpeeds.data();
+}
+
+const unsigned long long *MegaTransferColumnsPrivate::getPriorities() const
+{
+    return mPriorities.data();
+}
+
+int MegaTransferColumnsPrivate::getNumFinished() const
+{
+    return int(mFinishedTags.size());
+}
+
+const int *MegaTransferColumnsPrivate::getFinishedTags() const
+{
+    return mFinishedTags.data();
+}
+
+bool MegaTransferColumnsPrivate::isComplete() const
+{
+    return mComplete;
+}
+
+long long MegaTransferColumnsPrivate::getVersion() const
+{
+    return mVersion;
+}
+
+MegaNodeColumnsPrivate::MegaNodeColumnsPrivate(const node_vector& nodes)
+{
+    mHandles.reserve(nodes.size());
+    mSizes.reserve(nodes.size());
+    mModificationTimes.reserve(nodes.size());
+    mTypes.reserve(nodes.size());
+    mFlags.reserve(nodes.size());
+
+    string_vector names;
+    names.reserve(nodes.size());
+
+    static const nameid favourite = AttrMap::string2nameid("fav");
+
+    for (Node* n : nodes)
+    {
+        mHandles.push_back(n->nodehandle);
+        mSizes.push_back(n->size);
+        mModificationTimes.push_back(n->mtime);
+        mTypes.push_back(n->type);
+        names.push_back(n->displayname());
+
+        // the same as the getters of MegaNodePrivate
+        int flags = 0;
+        if (Node::hasfileattribute(&n->fileattrstring, GfxProc::THUMBNAIL))
+        {
+            flags |= FLAG_THUMBNAIL;
+        }
+        if (Node::hasfileattribute(&n->fileattrstring, GfxProc::PREVIEW))
+        {
+            flags |= FLAG_PREVIEW;
+        }
+        if (n->plink)
+        {
+            flags |= FLAG_EXPORTED | (n->plink->takendown ? FLAG_TAKEN_DOWN : 0);
+        }
+        if ((n->outshares && (n->outshares->size() > 1 || n->outshares->begin()->second->user))
+                || (n->pendingshares && !n->pendingshares->empty()))
+        {
+            flags |= FLAG_OUTSHARE;
+        }
+        auto fav = n->attrs.map.find(favourite);
+        if (fav != n->attrs.map.end() && fav->second == "1")
+        {
+            flags |= FLAG_FAVOURITE;
+        }
+        if (n->type == FILENODE && n->children.any())
+        {
+            flags |= FLAG_VERSIONS;
+        }
+        mFlags.push_back(flags);
+    }
+
+    mNames.reset(new MegaStringListPrivate(move(names)));
+}
+
+int MegaNodeColumnsPrivate::size() const
+{
+    return int(mHandles.size());
+}
+
+const MegaHandle *MegaNodeColumnsPrivate::getHandles() const
+{
+    return mHandles.data();
+}
+
+const long long *MegaNodeColumnsPrivate::getSizes() const
+{
+    return mSizes.data();
+}
+
+const long long *MegaNodeColumnsPrivate::getModificationTimes() const
+{
+    return mModificationTimes.data();
+}
+
+const int *MegaNodeColumnsPrivate::getTypes() const
+{
+    return mTypes.data();
+}
+
+const int *MegaNodeColumnsPrivate::getFlags() const
+{
+    return mFlags.data();
+}
+
+MegaStringList *MegaNodeColumnsPrivate::getNames() const
+{
+    return mNames.get();
+}
+
+const char *MegaNodeColumnsPrivate::getName(int i) const
+{
+    return mNames->get(i);
+}
+
 MegaAchievementsDetails *MegaAchievementsDetailsPrivate::fromAchievementsDetails(AchievementsDetails *details)
 {
     return new MegaAchievementsDetailsPrivate(details);
@@ -33179,41 +36801,6 @@ long long MegaFolderInfoPrivate::getVersionsSize() const
     return versionsSize;
 }
 
-TreeProcFolderInfo::TreeProcFolderInfo()
-{
-    numFiles = 0;
-    numFolders = 0;
-    numVersions = 0;
-    currentSize = 0;
-    versionsSize = 0;
-}
-
-void TreeProcFolderInfo::proc(MegaClient *, Node *node)
-{
-    if (node->parent && node->parent->type == FILENODE)
-    {
-        numVersions++;
-        versionsSize += node->size;
-    }
-    else
-    {
-        if (node->type == FILENODE)
-        {
-            numFiles++;
-            currentSize += node->size;
-        }
-        else
-        {
-            numFolders++;
-        }
-    }
-}
-
-MegaFolderInfo *TreeProcFolderInfo::getResult()
-{
-    return new MegaFolderInfoPrivate(numFiles, numFolders - 1, numVersions, currentSize, versionsSize);
-}
-
 MegaTimeZoneDetailsPrivate::MegaTimeZoneDetailsPrivate(vector<std::string> *timeZones, vector<int> *timeZoneOffsets, int defaultTimeZone)
 {
     this->timeZones = *timeZones;
@@ -60,6 +60,10 @@ const unsigned MegaClient::MAXTOTALTRANSFERS = 48;
 // maximum number of concurrent transfers (uploads or downloads)
 const unsigned MegaClient::MAXTRANSFERS = 32;
 
+// a raid download counts for six
+const unsigned MegaClient::MAXTOTALCONNECTIONS = 96;
+const unsigned MegaClient::MAXHOSTCONNECTIONS = 16;
+
 // maximum number of queued putfa before halting the upload queue
 const int MegaClient::MAXQUEUEDFA = 30;
 
@@ -586,6 +590,7 @@ void SCSN::clear()
 {
     memset(scsn, 0, sizeof(scsn));
     stopsc = false;
+    packetsapplied = 0;
 }
 
 // set server-client sequence number
@@ -606,12 +611,14 @@ bool SCSN::setScsn(JSON* j)
 void SCSN::setScsn(handle h)
 {
     Base64::btoa((byte*)&h, sizeof h, scsn);
+    packetsapplied = 0;
 }
 
 void SCSN::stopScsn()
 {
     memset(scsn, 0, sizeof(scsn));
     stopsc = true;
+    packetsapplied = 0;
 }
 
 bool SCSN::ready() const
@@ -1065,7 +1072,14 @@ Node* MegaClient::childnodebyname(Node* p, const char* name, bool skipfolders)
 
     fsaccess->normalize(&nname);
 
-    for (node_list::iterator it = p->children.begin(); it != p->children.end(); it++)
+    // big folders: the only match, if there aren't several to choose from
+    node_vector matches;
+    if (p->children.byName(nname.c_str(), matches) && matches.size() < 2)
+    {
+        return matches.empty() ? nullptr : matches.front();
+    }
+
+    for (NodeChildren::iterator it = p->children.begin(); it != p->children.end(); it++)
     {
         if (!strcmp(nname.c_str(), (*it)->displayname()))
         {
@@ -1098,6 +1112,16 @@ Node* MegaClient::childnodebynametype(Node* p, const char* name, nodetype_t must
 
     fsaccess->normalize(&nname);
 
+    node_vector matches;
+    if (p->children.byName(nname.c_str(), matches))
+    {
+        matches.erase(std::remove_if(matches.begin(), matches.end(), [mustBeType](Node* n) { return n->type != mustBeType; }), matches.end());
+        if (matches.size() < 2)
+        {
+            return matches.empty() ? nullptr : matches.front();
+        }
+    }
+
     for (auto it : p->children)
     {
         if (it->type == mustBeType &&
@@ -1146,7 +1170,18 @@ vector<Node*> MegaClient::childnodesbyname(Node* p, const char* name, bool skipf
 
     fsaccess->normalize(&nname);
 
-    for (node_list::iterator it = p->children.begin(); it != p->children.end(); it++)
+    // (several matches are listed in the order of the children)
+    if (p->children.byName(nname.c_str(), found) && found.size() < 2)
+    {
+        if (!found.empty() && found.front()->type != FILENODE && skipfolders)
+        {
+            found.clear();
+        }
+        return found;
+    }
+    found.clear();
+
+    for (NodeChildren::iterator it = p->children.begin(); it != p->children.end(); it++)
     {
         if (nname == (*it)->displayname())
         {
@@ -1169,6 +1204,8 @@ void MegaClient::init()
     totalNodes = 0;
     mAppliedKeyNodeCount = 0;
     faretrying = false;
+    pendingsharekeys.clear();
+    sharekeysinflight = false;
 
 #ifdef ENABLE_SYNC
     syncactivity = false;
@@ -1185,6 +1222,8 @@ void MegaClient::init()
     syncsup = true;
     syncdownrequired = false;
     syncuprequired = false;
+    syncdowndirtyonly = false;
+    syncupdirtyonly = false;
 
     if (syncscanstate)
     {
@@ -1229,9 +1268,10 @@ void MegaClient::init()
     mOptimizePurgeNodes = false;
 }
 
-MegaClient::MegaClient(MegaApp* a, Waiter* w, HttpIO* h, FileSystemAccess* f, DbAccess* d, GfxProc* g, const char* k, const char* u, unsigned workerThreadCount)
+MegaClient::MegaClient(MegaApp* a, Waiter* w, HttpIO* h, FileSystemAccess* f, DbAccess* d, GfxProc* g, const char* k, const char* u, unsigned workerThreadCount,
+                       std::shared_ptr<MegaClientAsyncQueue::WorkerPool> workerPool)
     : useralerts(*this), btugexpiration(rng), btcs(rng), btbadhost(rng), btworkinglock(rng), btsc(rng), btpfa(rng), btheartbeat(rng)
-    , mAsyncQueue(*w, workerThreadCount)
+    , mAsyncQueue(*w, workerPool ? std::move(workerPool) : MegaClientAsyncQueue::newWorkerPool(workerThreadCount))
 #ifdef ENABLE_SYNC
     , syncs(*this)
     , syncfslockretrybt(rng), syncdownbt(rng), syncnaglebt(rng), syncextrabt(rng), syncscanbt(rng)
@@ -1379,6 +1419,8 @@ MegaClient::MegaClient(MegaApp* a, Waiter* w, HttpIO* h, FileSystemAccess* f, Db
     h->setuseragent(&useragent);
     h->setmaxdownloadspeed(0);
     h->setmaxuploadspeed(0);
+
+    loaddnscache();
 }
 
 MegaClient::~MegaClient()
@@ -1386,6 +1428,7 @@ MegaClient::~MegaClient()
     LOG_debug << clientname << "~MegaClient running";
     destructorRunning = true;
     locallogout(false, true);
+    savednscache();
 
     delete pendingcs;
     delete badhostcs;
@@ -1476,6 +1519,7 @@ std::string MegaClient::getWritableLinkAuthKey(handle nodeHandle)
 void MegaClient::exec()
 {
     CodeCounter::ScopeTimer ccst(performanceStats.execFunction);
+    performanceStats.execPhases.beginIteration();
 
     WAIT_CLASS::bumpds();
 
@@ -1512,6 +1556,13 @@ void MegaClient::exec()
         requestLock = true;
     }
 
+    if (Waiter::ds >= mNextDnsCacheSave)
+    {
+        savednscache();
+        savetlssessions();
+        mNextDnsCacheSave = Waiter::ds + DNS_CACHE_SAVE_INTERVAL_DS;
+    }
+
     // successful network operation with a failed transfer chunk: increment error count
     // and continue transfers
     if (httpio->success && chunkfailed)
@@ -1780,6 +1831,14 @@ void MegaClient::exec()
             }
         }
 
+#ifdef USE_MEDIAINFO
+        if (mediaFileInfo.uploadFileAttributes.size())
+        {
+            // uploads that completed while their media properties were still being extracted
+            mediaFileInfo.checkUploadExtractions(this);
+        }
+#endif
+
         if (fafcs.size())
         {
             // file attribute fetching (handled in parallel on a per-cluster basis)
@@ -1791,88 +1850,93 @@ void MegaClient::exec()
             {
                 fc = cit->second;
 
-                // is this request currently in flight?
-                switch (static_cast<reqstatus_t>(fc->req.status))
+                // attributes decrypted by the worker threads since the last loop
+                fc->deliver();
+
+                for (int i = 0; i < FileAttributeFetchChannel::MAXREQS; i++)
                 {
-                    case REQ_SUCCESS:
-                        if (fc->req.contenttype.find("text/html") != string::npos
-                            && !memcmp(fc->req.posturl.c_str(), "http:", 5))
-                        {
-                            LOG_warn << "Invalid Content-Type detected downloading file attr: " << fc->req.contenttype;
-                            fc->urltime = 0;
-                            usehttps = true;
-                            app->notify_change_to_https();
+                    FileAttributeFetchChannel::Request& r = *fc->requests[i];
 
-                            sendevent(99436, "Automatic change to HTTPS", 0);
-                        }
-                        else
-                        {
-                            fc->parse(cit->first, true);
-                        }
+                    // is this request currently in flight?
+                    switch (static_cast<reqstatus_t>(r.req.status))
+                    {
+                        case REQ_SUCCESS:
+                            if (r.req.contenttype.find("text/html") != string::npos
+                                && !memcmp(r.req.posturl.c_str(), "http:", 5))
+                            {
+                                LOG_warn << "Invalid Content-Type detected downloading file attr: " << r.req.contenttype;
+                                fc->urltime = 0;
+                                usehttps = true;
+                                app->notify_change_to_https();
 
-                        // notify app in case some attributes were not returned, then redispatch
-                        fc->failed();
-                        fc->req.disconnect();
-                        fc->req.status = REQ_PREPARED;
-                        fc->timeout.reset();
-                        fc->bt.reset();
-                        break;
+                                sendevent(99436, "Automatic change to HTTPS", 0);
+                            }
+                            else
+                            {
+                                fc->parse(i, true);
+                            }
 
-                    case REQ_INFLIGHT:
-                        if (!fc->req.httpio)
-                        {
+                            // notify app in case some attributes were not returned, then redispatch
+                            fc->failed(i);
+                            r.req.disconnect();
+                            r.req.status = REQ_PREPARED;
+                            r.timeout.reset();
+                            fc->bt.reset();
                             break;
-                        }
 
-                        if (fc->inbytes != fc->req.in.size())
-                        {
-                            httpio->lock();
-                            fc->parse(cit->first, false);
-                            httpio->unlock();
+                        case REQ_INFLIGHT:
+                            if (!r.req.httpio)
+                            {
+                                break;
+                            }
 
-                            fc->timeout.backoff(100);
+                            if (r.inbytes != r.req.in.size())
+                            {
+                                httpio->lock();
+                                fc->parse(i, false);
+                                httpio->unlock();
 
-                            fc->inbytes = fc->req.in.size();
-                        }
+                                r.timeout.backoff(100);
 
-                        if (!fc->timeout.armed()) break;
+                                r.inbytes = r.req.in.size();
+                            }
 
-                        LOG_warn << "Timeout getting file attr";
-                        // timeout! fall through...
-                    case REQ_FAILURE:
-                        LOG_warn << "Error getting file attr";
+                            if (!r.timeout.armed()) break;
 
-                        if (fc->req.httpstatus && fc->req.contenttype.find("text/html") != string::npos
-                                && !memcmp(fc->req.posturl.c_str(), "http:", 5))
-                        {
-                            LOG_warn << "Invalid Content-Type detected on failed file attr: " << fc->req.contenttype;
-                            usehttps = true;
-                            app->notify_change_to_https();
+                            LOG_warn << "Timeout getting file attr";
+                            // timeout! fall through...
+                        case REQ_FAILURE:
+                            LOG_warn << "Error getting file attr";
 
-                            sendevent(99436, "Automatic change to HTTPS", 0);
-                        }
+                            if (r.req.httpstatus && r.req.contenttype.find("text/html") != string::npos
+                                    && !memcmp(r.req.posturl.c_str(), "http:", 5))
+                            {
+                                LOG_warn << "Invalid Content-Type detected on failed file attr: " << r.req.contenttype;
+                                usehttps = true;
+                                app->notify_change_to_https();
 
-                        fc->failed();
-                        fc->timeout.reset();
-                        fc->bt.backoff();
-                        fc->urltime = 0;
-                        fc->req.disconnect();
-                        fc->req.status = REQ_PREPARED;
-                    default:
-                        ;
+                                sendevent(99436, "Automatic change to HTTPS", 0);
+                            }
+
+                            fc->failed(i);
+                            r.timeout.reset();
+                            fc->bt.backoff();
+                            fc->urltime = 0;
+                            r.req.disconnect();
+                            r.req.status = REQ_PREPARED;
+                        default:
+                            ;
+                    }
                 }
 
-                if (fc->req.status != REQ_INFLIGHT && fc->bt.armed() && (fc->fafs[1].size() || fc->fafs[0].size()))
+                if (!fc->busy() && fc->bt.armed() && fc->fafs[0].size())
                 {
-                    fc->req.in.clear();
-
                     if (!fc->urltime || (Waiter::ds - fc->urltime) > 600)
                     {
                         // fetches pending for this unconnected channel - dispatch fresh connection
                         LOG_debug << "Getting fresh download URL";
-                        fc->timeout.reset();
                         reqs.add(new CommandGetFA(this, cit->first, fc->fahref));
-                        fc->req.status = REQ_INFLIGHT;
+                        fc->gettingurl = true;
                     }
                     else
                     {
@@ -1904,6 +1968,15 @@ void MegaClient::exec()
                         break;
 
                     case REQ_INFLIGHT:
+                        if (mFetchNodesStream && pendingcs->httpio
+                                && (mFetchNodesStream->state == FetchNodesStream::PENDING
+                                    || mFetchNodesStream->state == FetchNodesStream::NODES))
+                        {
+                            httpio->lock();
+                            streamfetchnodes(pendingcs, false);
+                            httpio->unlock();
+                        }
+
                         if (pendingcs->contentlength > 0)
                         {
                             if (fetchingnodes && fnstats.timeToFirstByte == NEVER
@@ -1926,8 +1999,23 @@ void MegaClient::exec()
                         abortlockrequest();
                         app->request_response_progress(pendingcs->bufpos, -1);
 
+                        if (pendingcs->includesFetchingNodes)
+                        {
+                            fnstats.responseBytes = pendingcs->bufpos;
+                            fnstats.responseWireBytes = pendingcs->wirebytes;
+                            LOG_debug << "Fetchnodes response: " << fnstats.responseBytes << " bytes, "
+                                      << fnstats.responseWireBytes << " received";
+                        }
+
+                        if (mFetchNodesStream && mFetchNodesStream->state != FetchNodesStream::DISABLED)
+                        {
+                            streamfetchnodes(pendingcs, true);
+                        }
+
                         if (pendingcs->in != "-3" && pendingcs->in != "-4")
                         {
+                            pendingcs->recordlatency(mLatency[LATENCY_CS], false);
+
                             if (*pendingcs->in.c_str() == '[')
                             {
                                 if (fetchingnodes && fnstats.timeToFirstByte == NEVER)
@@ -1944,18 +2032,23 @@ void MegaClient::exec()
 
                                 // request succeeded, process result array
                                 reqs.serverresponse(std::move(pendingcs->in), this);
+                                mFetchNodesStream.reset();
 
                                 WAIT_CLASS::bumpds();
 
+                                reqs.recyclebuffer(std::move(pendingcs->outbuf));
                                 delete pendingcs;
                                 pendingcs = NULL;
 
                                 notifypurge();
-                                if (sctable && pendingsccommit && !reqs.cmdspending())
+                                if (sctable && pendingsccommit && !reqs.cmdspending() && flushsc())
                                 {
                                     LOG_debug << "Executing postponed DB commit";
-                                    sctable->commit();
-                                    sctable->begin();
+                                    {
+                                        CodeCounter::LoopProfiler::Phase phase(performanceStats.execPhases, PerformanceStats::PHASE_DBCOMMIT);
+                                        sctable->commit();
+                                        sctable->begin();
+                                    }
                                     app->notify_dbcommit();
                                     pendingsccommit = false;
                                 }
@@ -2095,10 +2188,14 @@ void MegaClient::exec()
                         // failure, repeat with capped exponential backoff
                         app->request_response_progress(pendingcs->bufpos, -1);
 
+                        pendingcs->recordlatency(mLatency[LATENCY_CS], true);
                         delete pendingcs;
                         pendingcs = NULL;
 
-                        btcs.backoff();
+                        // nodes already streamed in are purged when the retried response arrives
+                        mFetchNodesStream.reset();
+
+                        btcs.backoff(mLatency[LATENCY_CS]);
                         app->notify_retry(btcs.retryin(), reason);
                         csretrying = true;
                         LOG_warn << "Retrying cs request in " << btcs.retryin() << " ds";
@@ -2117,43 +2214,68 @@ void MegaClient::exec()
 
             if (btcs.armed())
             {
-                if (reqs.cmdspending())
+                if (postcs())
                 {
-                    abortlockrequest();
-                    pendingcs = new HttpReq();
-                    pendingcs->protect = true;
-                    pendingcs->logname = clientname + "cs ";
-                    pendingcs_serverBusySent = false;
+                    continue;
+                }
+                btcs.reset();
+            }
+            break;
+        }
 
-                    bool suppressSID = true;
-                    reqs.serverrequest(pendingcs->out, suppressSID, pendingcs->includesFetchingNodes);
+        // order-independent batches, processed as soon as their response arrives
+        for (auto it = pendingparallelcs.begin(); it != pendingparallelcs.end(); )
+        {
+            if (it->second->status != REQ_SUCCESS && it->second->status != REQ_FAILURE)
+            {
+                ++it;
+                continue;
+            }
 
-                    pendingcs->posturl = httpio->APIURL;
+            int id = it->first;
+            std::unique_ptr<HttpReq> req = std::move(it->second);
+            pendingparallelcs.erase(it);
 
-                    pendingcs->posturl.append("cs?id=");
-                    pendingcs->posturl.append(reqid, sizeof reqid);
-                    pendingcs->posturl.append(getAuthURI(suppressSID));
-                    pendingcs->posturl.append(appkey);
+            if (req->status == REQ_SUCCESS && *req->in.c_str() == '[')
+            {
+                req->recordlatency(mLatency[LATENCY_CS], false);
+                reqs.parallelresponse(id, std::move(req->in), this);
+                notifypurge();
+            }
+            else
+            {
+                req->recordlatency(mLatency[LATENCY_CS], true);
+                LOG_warn << "Parallel cs request failed (" << req->httpstatus << " " << req->in.substr(0, 16)
+                         << "), sending it again in order";
+                reqs.parallelrequeue(id);
+            }
+            reqs.recyclebuffer(std::move(req->outbuf));
 
-                    string version = "v=2";
-                    pendingcs->posturl.append("&" + version);
-                    if (lang.size())
-                    {
-                        pendingcs->posturl.append("&");
-                        pendingcs->posturl.append(lang);
-                    }
-                    pendingcs->type = REQ_JSON;
+            // processing the response may have changed the set (eg. logout)
+            it = pendingparallelcs.begin();
+        }
 
-                    performanceStats.csRequestWaitTime.start();
-                    pendingcs->post(this);
-                    continue;
-                }
-                else
-                {
-                    btcs.reset();
-                }
+        // not while the ordered request is being retried (eg. -3, -4 or 500): that applies to these too
+        while (!csretrying && reqs.parallelready())
+        {
+            std::unique_ptr<HttpReq> req = mega::make_unique<HttpReq>();
+            req->protect = true;
+            req->logname = clientname + "cs ";
+
+            bool suppressSID = true;
+            int id = reqs.parallelrequest(req->out, suppressSID);
+
+            // each batch has an id of its own, it is never sent again with it
+            char batchid[sizeof reqid];
+            for (size_t i = sizeof batchid; i--; )
+            {
+                batchid[i] = static_cast<char>('a' + rng.genuint32(26));
             }
-            break;
+
+            req->posturl = getcsurl(batchid, sizeof batchid, suppressSID);
+            req->type = REQ_JSON;
+            req->post(this);
+            pendingparallelcs[id] = std::move(req);
         }
 
         // handle the request for the last 50 UserAlerts
@@ -2216,17 +2338,42 @@ void MegaClient::exec()
                         && pendingsc->in[0] == '0')
                 {
                     LOG_debug << "SC keep-alive received";
+                    pendingsc->recordlatency(mLatency[LATENCY_SC], false);
                     pendingsc.reset();
                     btsc.reset();
                     break;
                 }
 
+                if (mScStream == SCSTREAM_PACKETS)
+                {
+                    if (mScRecorder)
+                    {
+                        mScRecorder->append(pendingsc->data(), pendingsc->size());
+                        mScRecorder->end();
+                    }
+
+                    // the packets received earlier were processed already, procsc() carries on in the array
+                    pendingsc->recordlatency(mLatency[LATENCY_SC], false);
+                    jsonsc.begin(pendingsc->data());
+                    jsonscreceived = Waiter::ds;
+                    break;
+                }
+
                 if (*pendingsc->in.c_str() == '{')
                 {
+                    if (mScRecorder)
+                    {
+                        mScRecorder->begin(*this);
+                        mScRecorder->append(pendingsc->in.data(), pendingsc->in.size());
+                        mScRecorder->end();
+                    }
+
                     insca = false;
                     insca_notlast = false;
+                    pendingsc->recordlatency(mLatency[LATENCY_SC], false);
                     jsonsc.begin(pendingsc->in.c_str());
                     jsonsc.enterobject();
+                    jsonscreceived = Waiter::ds;
                     break;
                 }
                 else
@@ -2283,6 +2430,8 @@ void MegaClient::exec()
                 pendingscTimedOut = false;
                 if (pendingsc)
                 {
+                    pendingsc->recordlatency(mLatency[LATENCY_SC], true);
+
                     if (!statecurrent && pendingsc->httpstatus != 200)
                     {
                         if (pendingsc->httpstatus == 500)
@@ -2326,6 +2475,7 @@ void MegaClient::exec()
                 if (!pendingscTimedOut && Waiter::ds >= (pendingsc->lastdata + HttpIO::SCREQUESTTIMEOUT))
                 {
                     LOG_debug << "sc timeout expired";
+                    pendingsc->recordlatency(mLatency[LATENCY_SC], true);
                     // In almost all cases the server won't take more than SCREQUESTTIMEOUT seconds.  But if it does, break the cycle of endless requests for the same thing
                     pendingscTimedOut = true;
                     pendingsc.reset();
@@ -2369,10 +2519,17 @@ void MegaClient::exec()
 
         // do not process the SC result until all preconfigured syncs are up and running
         // except if SC packets are required to complete a fetchnodes
-        if (!scpaused && jsonsc.pos && (syncsup || !statecurrent) && !syncdownrequired && !syncdownretry)
+        bool canprocsc = !scpaused && (syncsup || !statecurrent) && !syncdownrequired && !syncdownretry;
 #else
-        if (!scpaused && jsonsc.pos)
+        bool canprocsc = !scpaused;
 #endif
+        if (canprocsc && !jsonsc.pos && pendingsc && pendingsc->status == REQ_INFLIGHT
+                && (mScStream == SCSTREAM_PENDING || mScStream == SCSTREAM_PACKETS) && !loggingout)
+        {
+            streamsc(pendingsc.get());
+        }
+
+        if (canprocsc && jsonsc.pos)
         {
             // FIXME: reload in case of bad JSON
             bool r = procsc();
@@ -2387,7 +2544,8 @@ void MegaClient::exec()
             else
             {
                 // remote changes require immediate attention of syncdown()
-                syncdownrequired = true;
+                // (notifynode() marked the folders they concern)
+                requestsyncdown(true);
                 syncactivity = true;
             }
 #endif
@@ -2428,6 +2586,13 @@ void MegaClient::exec()
                 pendingsc->posturl.append(getAuthURI());
 
                 pendingsc->type = REQ_JSON;
+                mScStream = mStreamActionPackets ? SCSTREAM_PENDING : SCSTREAM_DISABLED;
+                pendingsc->incremental = mStreamActionPackets;
+                mScSkipPackets = scsn.packetsApplied();
+                if (mScSkipPackets)
+                {
+                    LOG_debug << "Skipping the first " << mScSkipPackets << " action packets, already applied";
+                }
                 pendingsc->post(this);
             }
             jsonsc.pos = NULL;
@@ -2508,6 +2673,8 @@ void MegaClient::exec()
                 transferCount = transfers[GET].size() + transfers[PUT].size();
             } while (transferCount < lastCount);
 
+            prefetchTempUrls();
+
             // don't run this too often or it may use a lot of cpu without starting new transfers, if the list is long
             nextDispatchTransfersDs = transferCount ? Waiter::ds + 1 : 0;
         }
@@ -2521,6 +2688,7 @@ void MegaClient::exec()
 
         if (!mBlocked) // handle active unpaused transfers
         {
+            CodeCounter::LoopProfiler::Phase phase(performanceStats.execPhases, PerformanceStats::PHASE_TRANSFERSLOTS);
             DBTableTransactionCommitter committer(tctable);
 
             while (slotit != tslots.end())
@@ -2534,6 +2702,8 @@ void MegaClient::exec()
                     (*it)->doio(this, committer);
                 }
             }
+
+            flushtransferprogress(committer);
         }
         else
         {
@@ -2571,7 +2741,15 @@ void MegaClient::exec()
                     {
                         LOG_debug << "Initial delayed scan: " << syncConfig.getLocalPath().toPath(*fsaccess);
 
-                        if (sync->scan(&localPath, fa.get()))
+                        if (mSyncScanThreads && sync->localroot->children.empty())
+                        {
+                            // nothing cached to reconcile: list the folders on the scan threads
+                            sync->mWalk = scanService().walk(followsymlinks);
+                            sync->mWalk->scan(localPath);
+                            syncsup = false;
+                            sync->initializing = false;
+                        }
+                        else if (sync->scan(&localPath, fa.get()))
                         {
                             syncsup = false;
                             sync->initializing = false;
@@ -2616,7 +2794,7 @@ void MegaClient::exec()
             {
                 syncsup = true;
                 syncactivity = true;
-                syncdownrequired = true;
+                requestsyncdown();
             }
         }
 
@@ -2632,7 +2810,7 @@ void MegaClient::exec()
         if (mSyncMonitorRetry && mSyncMonitorTimer.armed())
         {
             mSyncMonitorRetry = false;
-            syncdownrequired = true;
+            requestsyncdown();
         }
 
         // sync timer: file change upload delay timeouts (Nagle algorithm)
@@ -2720,10 +2898,29 @@ void MegaClient::exec()
 
                         syncs.stopCancelledFailedDisabled();
 
-                        syncs.forEachRunningSync_shortcircuit([&](Sync* sync) {
+                        syncs.forEachRunningSync_roundrobin([&](Sync* sync) {
 
                             if (sync->state() == SYNC_ACTIVE || sync->state() == SYNC_INITIALSCAN)
                             {
+                                // folders listed by the scan threads
+                                if (q == DirNotify::DIREVENTS && sync->mWalk)
+                                {
+                                    syncops = true;
+
+                                    if (!sync->procwalk())
+                                    {
+                                        syncactivity = true;
+                                    }
+                                    else if (sync->state() == SYNC_FAILED)
+                                    {
+                                        return true; // from lambda - next sync
+                                    }
+                                    else if (!sync->mWalk)
+                                    {
+                                        requestsyncdown();
+                                    }
+                                }
+
                                 // process items from the notifyq until depleted
                                 if (sync->dirnotify->notifyq[q].size())
                                 {
@@ -2764,6 +2961,7 @@ void MegaClient::exec()
                                         if (!syncadding)
                                         {
                                             LOG_debug << "Running syncup to create missing folders";
+                                            CodeCounter::LoopProfiler::Phase phase(performanceStats.execPhases, PerformanceStats::PHASE_SYNCUP);
                                             syncup(sync->localroot.get(), &nds);
                                             sync->cachenodes();
                                         }
@@ -2774,9 +2972,10 @@ void MegaClient::exec()
                                     }
                                 }
 
-                                if (sync->state() == SYNC_INITIALSCAN && q == DirNotify::DIREVENTS && !sync->dirnotify->notifyq[q].size())
+                                if (sync->state() == SYNC_INITIALSCAN && q == DirNotify::DIREVENTS && !sync->dirnotify->notifyq[q].size() && !sync->mWalk)
                                 {
                                     sync->changestate(SYNC_ACTIVE, NO_SYNC_ERROR, true, true);
+                                    LOG_debug << "Sync active: " << sync->localroot->name << " Filesystem watches: " << sync->dirnotify->watchCount();
 
                                     // scan for items that were deleted while the sync was stopped
                                     // FIXME: defer this until RETRY queue is processed
@@ -2863,7 +3062,9 @@ void MegaClient::exec()
                 if (prevpending && !totalpending)
                 {
                     LOG_debug << "Scan queue processed, triggering a scan";
-                    syncdownrequired = true;
+
+                    // checkpath() marked the folders of the changes
+                    requestsyncdown(true);
                 }
 
                 notifypurge();
@@ -2894,6 +3095,9 @@ void MegaClient::exec()
 
                             anyqueued = true;
                         }
+
+                        // the scan threads wake us up when they have listed more
+                        anyqueued = anyqueued || sync->mWalk;
                     });
 
                     if (!anyqueued)
@@ -2923,8 +3127,8 @@ void MegaClient::exec()
                                         << syncfslockretry << synccreate.size();
                             syncops = false;
 
-                            // FIXME: only syncup for subtrees that were actually
-                            // updated to reduce CPU load
+                            // after remote or local changes only, only the subtrees
+                            // marked as changed are visited
                             bool repeatsyncup = false;
                             bool syncupdone = false;
                             syncs.forEachRunningSync([&](Sync* sync) {
@@ -2933,7 +3137,8 @@ void MegaClient::exec()
                                  && !syncadding && syncuprequired && !syncnagleretry)
                                 {
                                     LOG_debug << "Running syncup on demand";
-                                    repeatsyncup |= !syncup(sync->localroot.get(), &nds);
+                                    CodeCounter::LoopProfiler::Phase phase(performanceStats.execPhases, PerformanceStats::PHASE_SYNCUP);
+                                    repeatsyncup |= !syncup(sync->localroot.get(), &nds, syncupdirtyonly);
                                     syncupdone = true;
                                     sync->cachenodes();
                                 }
@@ -3052,15 +3257,17 @@ void MegaClient::exec()
             if (syncdownretry && syncdownbt.armed())
             {
                 syncdownretry = false;
-                syncdownrequired = true;
+                requestsyncdown();
             }
 
             if (syncdownrequired)
             {
+                bool dirtyonly = syncdowndirtyonly;
                 syncdownrequired = false;
+                syncdowndirtyonly = false;
                 if (!fetchingnodes)
                 {
-                    LOG_verbose << "Running syncdown";
+                    LOG_verbose << "Running syncdown" << (dirtyonly ? " on the changed subtrees" : "");
                     bool success = true;
                     syncs.forEachRunningSync([&](Sync* sync) {
                         // make sure that the remote synced folder still exists
@@ -3078,7 +3285,8 @@ void MegaClient::exec()
                             if (sync->state() == SYNC_ACTIVE || sync->state() == SYNC_INITIALSCAN)
                             {
                                 LOG_debug << "Running syncdown on demand";
-                                if (!syncdown(sync->localroot.get(), localpath))
+                                CodeCounter::LoopProfiler::Phase phase(performanceStats.execPhases, PerformanceStats::PHASE_SYNCDOWN);
+                                if (!syncdown(sync->localroot.get(), localpath, dirtyonly))
                                 {
                                     // a local filesystem item was locked - schedule periodic retry
                                     // and force a full rescan afterwards as the local item may
@@ -3086,6 +3294,10 @@ void MegaClient::exec()
                                     success = false;
                                     sync->dirnotify->mErrorCount = true;
                                 }
+                                else if (!dirtyonly)
+                                {
+                                    sync->mLastFullReconcile = m_time();
+                                }
 
                                 sync->cachenodes();
                             }
@@ -3095,6 +3307,7 @@ void MegaClient::exec()
                     // notify the app if a lock is being retried
                     if (success)
                     {
+                        syncupdirtyonly = dirtyonly && (!syncuprequired || syncupdirtyonly);
                         syncuprequired = true;
                         syncdownretry = false;
                         syncactivity = true;
@@ -3124,8 +3337,11 @@ void MegaClient::exec()
             }
         }
 
-        // Flush changes made to internal configs.
-        syncs.syncConfigStoreFlush();
+        // Flush changes made to internal configs, once those coming together have been made.
+        if (syncs.syncConfigStoreFlushDue() <= Waiter::ds)
+        {
+            syncs.syncConfigStoreFlush();
+        }
 #endif
 
         notifypurge();
@@ -3191,7 +3407,7 @@ void MegaClient::exec()
 
         httpio->updatedownloadspeed();
         httpio->updateuploadspeed();
-    } while (httpio->doio() || execdirectreads() || (!pendingcs && reqs.cmdspending() && btcs.armed()) || looprequested);
+    } while (httpio->doio() || execdirectreads() || (!pendingcs && (reqs.cmdspending() || !mUploadPutnodes.empty() || syncUploadPutnodesDue()) && btcs.armed()) || (!csretrying && reqs.parallelready()) || looprequested);
 
 
     NodeCounter storagesum;
@@ -3208,10 +3424,34 @@ void MegaClient::exec()
         app->storagesum_changed(mNotifiedSumSize);
     }
 
-#ifdef MEGA_MEASURE_CODE
     performanceStats.transfersActiveTime.start(!tslots.empty() && !performanceStats.transfersActiveTime.inprogress());
     performanceStats.transfersActiveTime.stop(tslots.empty() && performanceStats.transfersActiveTime.inprogress());
+    performanceStats.csQueuedBatches.set(int64_t(reqs.queuedbatches()));
+    performanceStats.transferSlots.set(int64_t(tslots.size()));
+    performanceStats.queuedTransfers.set(int64_t(transfers[GET].size() + transfers[PUT].size()));
+    performanceStats.pendingFileAttributes.set(int64_t(queuedfa.size() + activefa.size()));
+    performanceStats.downloadSpeed.set(httpio->downloadSpeed);
+    performanceStats.uploadSpeed.set(httpio->uploadSpeed);
+    performanceStats.nodes.set(int64_t(nodes.size()));
+    performanceStats.scLag.set(jsonsc.pos ? int64_t(Waiter::ds - jsonscreceived) * 100 : 0);
+#ifdef ENABLE_SYNC
+    size_t syncnotifications = 0;
+    syncs.forEachRunningSync([&](Sync* s) {
+        for (auto& q : s->dirnotify->notifyq)
+        {
+            syncnotifications += q.size();
+        }
+    });
+    performanceStats.syncQueuedNotifications.set(int64_t(syncnotifications));
+#endif
+
+    CodeCounter::LoopProfiler::Iteration iteration;
+    if (performanceStats.execPhases.endIteration(&iteration))
+    {
+        LOG_warn << clientname << "Slow exec() loop, " << performanceStats.execPhases.describe(iteration);
+    }
 
+#ifdef MEGA_MEASURE_CODE
     static auto lasttime = Waiter::ds;
     if (Waiter::ds > lasttime + 1200)
     {
@@ -3283,6 +3523,12 @@ int MegaClient::preparewait()
             nds = nextDispatchTransfersDs > Waiter::ds ? nextDispatchTransfersDs : Waiter::ds;
         }
 
+        // the end of the window of the sync uploads completed
+        if (mSyncUploadPutnodesDs && !pendingcs && mSyncUploadPutnodesDs < nds)
+        {
+            nds = mSyncUploadPutnodesDs > Waiter::ds ? mSyncUploadPutnodesDs : Waiter::ds;
+        }
+
         for (pendinghttp_map::iterator it = pendinghttp.begin(); it != pendinghttp.end(); it++)
         {
             if (it->second->isbtactive)
@@ -3333,11 +3579,15 @@ int MegaClient::preparewait()
         // retry failed file attribute gets
         for (fafc_map::iterator cit = fafcs.begin(); cit != fafcs.end(); cit++)
         {
-            if (cit->second->req.status == REQ_INFLIGHT)
+            for (auto& r : cit->second->requests)
             {
-                cit->second->timeout.update(&nds);
+                if (r->req.status == REQ_INFLIGHT)
+                {
+                    r->timeout.update(&nds);
+                }
             }
-            else if (cit->second->fafs[1].size() || cit->second->fafs[0].size())
+
+            if (!cit->second->busy() && cit->second->fafs[0].size())
             {
                 cit->second->bt.update(&nds);
             }
@@ -3401,6 +3651,13 @@ int MegaClient::preparewait()
         {
             syncextrabt.update(&nds);
         }
+
+        // flush of the changes to the sync configs
+        dstime configFlush = syncs.syncConfigStoreFlushDue();
+        if (configFlush < nds)
+        {
+            nds = std::max(configFlush, Waiter::ds);
+        }
 #endif
 
         // detect stuck network
@@ -3634,7 +3891,7 @@ bool MegaClient::abortbackoff(bool includexfers)
 
     for (fafc_map::iterator it = fafcs.begin(); it != fafcs.end(); it++)
     {
-        if (it->second->req.status != REQ_INFLIGHT && it->second->bt.arm())
+        if (!it->second->busy() && it->second->bt.arm())
         {
             r = true;
         }
@@ -3679,10 +3936,15 @@ void MegaClient::dispatchTransfers()
     };
     std::array<counter, 6> counters;
 
+    TransferConnectionBudget budget(MAXTOTALCONNECTIONS, MAXHOSTCONNECTIONS);
+
     // Determine average speed and total amount of data remaining for the given direction/size-category
     // We prepare data for put/get in index 0..1, and the put/get/big/small combinations in index 2..5
     for (TransferSlot* ts : tslots)
     {
+        budget.add(TransferConnectionBudget::connectionsof(*ts),
+                   ts->transferbuf.tempUrlVector().empty() ? ts->transfer->tempurls : ts->transferbuf.tempUrlVector());
+
         assert(ts->transfer->type == PUT || ts->transfer->type == GET);
         TransferCategory tc(ts->transfer);
         counters[tc.index()].addexisting(ts->transfer->size, ts->progressreported);
@@ -3743,6 +4005,13 @@ void MegaClient::dispatchTransfers()
         TransferCategory(GET, SMALLFILE),
     };
 
+    // the small files that are shortest first: the most of them done soonest, should the connections run out
+    for (direction_t d : { PUT, GET })
+    {
+        auto& small = nextInCategory[TransferCategory(d, SMALLFILE).index()];
+        std::stable_sort(small.begin(), small.end(), [](Transfer* a, Transfer* b) { return a->size < b->size; });
+    }
+
     DBTableTransactionCommitter committer(tctable);
 
     for (auto category : categoryOrder)
@@ -3754,6 +4023,14 @@ void MegaClient::dispatchTransfers()
                 return;
             }
 
+            // one that opens fewer connections, or to other hosts, may still fit
+            unsigned transferConnections = TransferConnectionBudget::connectionsof(*nexttransfer);
+            if (!nexttransfer->slot && !budget.fits(transferConnections, nexttransfer->tempurls))
+            {
+                LOG_verbose << "No connections available for a transfer of " << transferConnections;
+                continue;
+            }
+
             if (category.direction == PUT && queuedfa.size() > MAXQUEUEDFA)
             {
                 // file attribute jam? halt uploads.
@@ -3837,6 +4114,10 @@ void MegaClient::dispatchTransfers()
                 app->transfer_prepare(nexttransfer);
             }
 
+            // a fresh download of content that is already here completes without fetching it
+            bool localcopy = nexttransfer->type == GET && !nexttransfer->slot && nexttransfer->chunkmacs.empty()
+                             && !nexttransfer->localfilename.empty() && copyLocalDuplicate(nexttransfer);
+
             bool openok = false;
             bool openfinished = false;
 
@@ -3930,6 +4211,15 @@ void MegaClient::dispatchTransfers()
                         }
 
                         ts->updatecontiguousprogress();
+
+                        // the pieces arrive out of order: the file would otherwise grow in as many extents as writes
+                        if (nexttransfer->type == GET && !nexttransfer->pos && !localcopy
+                                && nexttransfer->size >= TransferSlot::MIN_PREALLOCATE_SIZE
+                                && !ts->fa->fpreallocate(nexttransfer->size))
+                        {
+                            LOG_debug << "Unable to preallocate " << nexttransfer->size << " bytes for the download";
+                        }
+
                         LOG_debug << "Resuming transfer at " << nexttransfer->pos
                             << " Completed: " << nexttransfer->progresscompleted
                             << " Contiguous: " << ts->progresscontiguous
@@ -3973,6 +4263,14 @@ void MegaClient::dispatchTransfers()
                                 // we want all imagery to be safely tucked away before completing the upload, so we bump minfa
                                 nexttransfer->minfa += gfx->gendimensionsputfa(ts->fa, nexttransfer->localfilename, NodeOrUploadHandle(nexttransfer->uploadhandle), nexttransfer->transfercipher(), -1);
                             }
+
+#ifdef USE_MEDIAINFO
+                            if (!gfxdisabled)
+                            {
+                                // overlap media property extraction with the data upload
+                                mediaFileInfo.startUploadExtraction(this, nexttransfer->uploadhandle, nexttransfer->localfilename, nexttransfer->size);
+                            }
+#endif
                         }
                     }
                     else
@@ -3997,7 +4295,11 @@ void MegaClient::dispatchTransfers()
                     }
 
                     // dispatch request for temporary source/target URL
-                    if (nexttransfer->tempurls.size())
+                    if (localcopy)
+                    {
+                        LOG_debug << "Download copied from a local file with the same content";
+                    }
+                    else if (nexttransfer->tempurls.size())
                     {
                         ts->transferbuf.setIsRaid(nexttransfer, nexttransfer->tempurls, nexttransfer->pos, ts->maxRequestSize);
                         app->transfer_prepare(nexttransfer);
@@ -4070,6 +4372,7 @@ void MegaClient::dispatchTransfers()
 
                     LOG_debug << "Activating transfer";
                     ts->slots_it = tslots.insert(tslots.begin(), ts);
+                    budget.add(transferConnections, nexttransfer->tempurls);
 
                     // notify the app about the starting transfer
                     for (file_list::iterator it = nexttransfer->files.begin();
@@ -4080,6 +4383,13 @@ void MegaClient::dispatchTransfers()
                     app->transfer_update(nexttransfer);
 
                     performanceStats.transferStarts += 1;
+
+                    if (localcopy)
+                    {
+                        nexttransfer->pos = nexttransfer->progresscompleted = nexttransfer->size;
+                        ts->progress();
+                        nexttransfer->complete(committer);
+                    }
                 }
                 else if (openfinished)
                 {
@@ -4110,64 +4420,202 @@ void MegaClient::dispatchTransfers()
     }
 }
 
-// do we have an upload that is still waiting for file attributes before being completed?
-void MegaClient::checkfacompletion(UploadHandle th, Transfer* t)
+void MegaClient::prefetchTempUrls()
 {
-    if (!th.isUndef())
+    if (xferpaused[GET])
     {
-        bool delayedcompletion;
-        uploadhandletransfer_map::iterator htit;
+        return;
+    }
 
-        if ((delayedcompletion = !t))
+    size_t ahead = 0;
+    auto end = transferlist.end(GET);
+    for (auto it = transferlist.begin(GET); it != end && ahead < TEMPURL_PREFETCH_AHEAD; it++)
+    {
+        Transfer* t = (*it);
+        if (t->slot || (t->state != TRANSFERSTATE_QUEUED && t->state != TRANSFERSTATE_RETRYING))
         {
-            // abort if upload still running
-            if ((htit = faputcompletion.find(th)) == faputcompletion.end())
-            {
-                LOG_debug << "Upload still running checking a file attribute - " << th;
-                return;
-            }
-
-            t = htit->second;
+            continue;
         }
+        ahead++;
 
-        int facount = 0;
+        if (t->tempurlsprefetch || !t->bt.armed())
+        {
+            continue;
+        }
 
-        // do we have the pre-set threshold number of file attributes available? complete upload.
-        for (fa_map::iterator it = pendingfa.lower_bound(pair<UploadHandle, fatype>(th, fatype(0)));
-             it != pendingfa.end() && it->first.first == th; it++)
+        if (!t->tempurls.empty())
         {
-            facount++;
+            if (!t->tempurlsprefetched || Waiter::ds - t->tempurlsprefetched < TEMPURL_PREFETCH_VALIDITY)
+            {
+                continue;
+            }
+            t->tempurls.clear();
+            t->tempurlsprefetched = 0;
         }
 
-        if (facount < t->minfa)
+        // the same source dispatchTransfers() would request them for
+        File* source = nullptr;
+        for (File* f : t->files)
         {
-            LOG_debug << "Pending file attributes for upload - " << th <<  " : " << (t->minfa < facount);
-            if (!delayedcompletion)
+            if (!f->hprivate || f->hforeign || nodeByHandle(f->h))
             {
-                // we have insufficient file attributes available: remove transfer and put on hold
-                t->faputcompletion_it = faputcompletion.insert(pair<UploadHandle, Transfer*>(th, t)).first;
+                source = f;
+                break;
+            }
+        }
+        if (!source)
+        {
+            continue;
+        }
 
-                transfers[t->type].erase(t->transfers_it);
-                t->transfers_it = transfers[t->type].end();
+        uint64_t id = ++nextTempUrlPrefetch;
+        tempUrlPrefetches[id] = t;
+        t->tempurlsprefetch = id;
 
-                delete t->slot;
-                t->slot = NULL;
+        reqs.add(new CommandGetFile(this, t->transferkey.data(), SymmCipher::KEYLENGTH,
+                                    source->h.as8byte(), source->hprivate,
+                                    source->privauth.size() ? source->privauth.c_str() : nullptr,
+                                    source->pubauth.size() ? source->pubauth.c_str() : nullptr,
+                                    source->chatauth, false,
+            [this, id](const Error&, m_off_t s, m_time_t, m_time_t, dstime, std::string* filename, std::string*, std::string*,
+                       const std::vector<std::string>& tempurls, const std::vector<std::string>&)
+        {
+            auto it = tempUrlPrefetches.find(id);
+            if (it == tempUrlPrefetches.end())
+            {
+                return true;
+            }
+            Transfer* t = it->second;
+            tempUrlPrefetches.erase(it);
+            t->tempurlsprefetch = 0;
 
-                LOG_debug << "Transfer put on hold. Total: " << faputcompletion.size();
+            // a failure, or a size to check, is left to the request of the slot
+            if (filename && !t->slot && t->tempurls.empty() && s == t->size
+                    && (tempurls.size() == 1 || tempurls.size() == RAIDPARTS))
+            {
+                t->tempurls = tempurls;
+                t->tempurlsprefetched = Waiter::ds;
             }
+            return true;
+        }));
+    }
+}
 
-            return;
-        }
+bool MegaClient::copyLocalDuplicate(Transfer* t)
+{
+    if (!t->isvalid || !t->size)
+    {
+        return false;
     }
-    else
+
+    vector<LocalPath> sources;
+    auto it = mDownloadedContent.find(ChunkIndex::key(*t));
+    if (it != mDownloadedContent.end())
     {
-        LOG_warn << "NULL file attribute handle";
+        sources.push_back(it->second);
     }
 
-    LOG_debug << "Transfer finished, sending callbacks - " << th;
-    t->state = TRANSFERSTATE_COMPLETED;
-    t->completefiles();
-    looprequested = true;
+#ifdef ENABLE_SYNC
+    unique_ptr<node_vector> nodes(nodesbyfingerprint(t));
+    for (Node* n : *nodes)
+    {
+        if (n->localnode)
+        {
+            sources.push_back(n->localnode->getLocalPath());
+        }
+    }
+#endif
+
+    auto hasContent = [this, t](LocalPath& path)
+    {
+        FileFingerprint fp;
+        auto fa = fsaccess->newfileaccess();
+        if (!fa->fopen(path, true, false))
+        {
+            return false;
+        }
+        fp.genfingerprint(fa.get());
+        return fp == *(FileFingerprint*)t;
+    };
+
+    for (LocalPath& source : sources)
+    {
+        // the file may have changed since
+        if (!hasContent(source))
+        {
+            continue;
+        }
+
+        if (fsaccess->copylocal(source, t->localfilename, t->mtime) && hasContent(t->localfilename))
+        {
+            LOG_debug << "Copying a download from " << source.toPath(*fsaccess);
+            return true;
+        }
+
+        fsaccess->unlinklocal(t->localfilename);
+    }
+
+    return false;
+}
+
+// do we have an upload that is still waiting for file attributes before being completed?
+void MegaClient::checkfacompletion(UploadHandle th, Transfer* t)
+{
+    if (!th.isUndef())
+    {
+        bool delayedcompletion;
+        uploadhandletransfer_map::iterator htit;
+
+        if ((delayedcompletion = !t))
+        {
+            // abort if upload still running
+            if ((htit = faputcompletion.find(th)) == faputcompletion.end())
+            {
+                LOG_debug << "Upload still running checking a file attribute - " << th;
+                return;
+            }
+
+            t = htit->second;
+        }
+
+        int facount = 0;
+
+        // do we have the pre-set threshold number of file attributes available? complete upload.
+        for (fa_map::iterator it = pendingfa.lower_bound(pair<UploadHandle, fatype>(th, fatype(0)));
+             it != pendingfa.end() && it->first.first == th; it++)
+        {
+            facount++;
+        }
+
+        if (facount < t->minfa)
+        {
+            LOG_debug << "Pending file attributes for upload - " << th <<  " : " << (t->minfa < facount);
+            if (!delayedcompletion)
+            {
+                // we have insufficient file attributes available: remove transfer and put on hold
+                t->faputcompletion_it = faputcompletion.insert(pair<UploadHandle, Transfer*>(th, t)).first;
+
+                transfers[t->type].erase(t->transfers_it);
+                t->transfers_it = transfers[t->type].end();
+
+                delete t->slot;
+                t->slot = NULL;
+
+                LOG_debug << "Transfer put on hold. Total: " << faputcompletion.size();
+            }
+
+            return;
+        }
+    }
+    else
+    {
+        LOG_warn << "NULL file attribute handle";
+    }
+
+    LOG_debug << "Transfer finished, sending callbacks - " << th;
+    t->state = TRANSFERSTATE_COMPLETED;
+    t->completefiles();
+    looprequested = true;
     app->transfer_complete(t);
     delete t;
 }
@@ -4183,8 +4631,7 @@ void MegaClient::freeq(direction_t d)
         delete transferPtr.second;
     }
     transfers[d].clear();
-    transferlist.transfers[GET].clear();
-    transferlist.transfers[PUT].clear();
+    transferlist.clear();
 }
 
 bool MegaClient::isFetchingNodesPendingCS()
@@ -4244,7 +4691,10 @@ void MegaClient::disconnect()
 
     for (fafc_map::iterator it = fafcs.begin(); it != fafcs.end(); it++)
     {
-        it->second->req.disconnect();
+        for (auto& r : it->second->requests)
+        {
+            r->req.disconnect();
+        }
     }
 
     for (transferslot_list::iterator it = tslots.begin(); it != tslots.end(); it++)
@@ -4263,6 +4713,110 @@ void MegaClient::disconnect()
     app->notify_disconnect();
 }
 
+static LocalPath dnsCachePath(DbAccess& dbaccess, FileSystemAccess& fsaccess)
+{
+    LocalPath path = dbaccess.rootPath();
+    path.appendWithSeparator(LocalPath::fromPath("megaclient_dns.cache", fsaccess), false);
+    return path;
+}
+
+void MegaClient::loaddnscache()
+{
+    if (!dbaccess)
+    {
+        return;
+    }
+
+    string data;
+    LocalPath path = dnsCachePath(*dbaccess, *fsaccess);
+    auto fa = fsaccess->newfileaccess(false);
+    if (fa->fopen(path, true, false)
+            && fa->fread(&data, static_cast<unsigned>(fa->size), 0, 0))
+    {
+        httpio->importdnscache(data);
+    }
+}
+
+void MegaClient::savednscache()
+{
+    string data;
+    if (!dbaccess || !httpio->exportdnscache(&data))
+    {
+        return;
+    }
+
+    LocalPath path = dnsCachePath(*dbaccess, *fsaccess);
+    auto fa = fsaccess->newfileaccess(false);
+    if (!fa->fopen(path, false, true)
+            || !fa->ftruncate()
+            || !fa->fwrite(reinterpret_cast<const byte*>(data.data()), static_cast<unsigned>(data.size()), 0))
+    {
+        LOG_warn << "Unable to save the DNS cache";
+    }
+}
+
+static LocalPath tlsSessionsPath(DbAccess& dbaccess, FileSystemAccess& fsaccess)
+{
+    LocalPath path = dbaccess.rootPath();
+    path.appendWithSeparator(LocalPath::fromPath("megaclient_tls.cache", fsaccess), false);
+    return path;
+}
+
+// the file holds an 8 byte IV, then the sessions encrypted with the master key of the account
+static const size_t TLS_SESSIONS_IV_SIZE = 8;
+
+void MegaClient::loadtlssessions()
+{
+    if (!dbaccess || sid.size() < SIDLEN)
+    {
+        return;
+    }
+
+    string data;
+    LocalPath path = tlsSessionsPath(*dbaccess, *fsaccess);
+    auto fa = fsaccess->newfileaccess(false);
+    if (!fa->fopen(path, true, false)
+            || !fa->fread(&data, static_cast<unsigned>(fa->size), 0, 0)
+            || data.size() <= TLS_SESSIONS_IV_SIZE)
+    {
+        return;
+    }
+
+    string iv = data.substr(0, TLS_SESSIONS_IV_SIZE);
+    data.erase(0, TLS_SESSIONS_IV_SIZE);
+
+    // those of another account don't decrypt
+    if (PaddedCBC::decrypt(&data, &key, &iv))
+    {
+        httpio->importtlssessions(data);
+    }
+}
+
+void MegaClient::savetlssessions()
+{
+    string data;
+    if (!dbaccess || sid.size() < SIDLEN || !httpio->exporttlssessions(&data))
+    {
+        return;
+    }
+
+    byte ivbuf[TLS_SESSIONS_IV_SIZE];
+    rng.genblock(ivbuf, sizeof ivbuf);
+    string iv(reinterpret_cast<const char*>(ivbuf), sizeof ivbuf);
+    string header = iv;
+    PaddedCBC::encrypt(rng, &data, &key, &iv);
+    data.insert(0, header);
+
+    LocalPath path = tlsSessionsPath(*dbaccess, *fsaccess);
+    auto fa = fsaccess->newfileaccess(false);
+    if (!fa->fopen(path, false, true)
+            || !fa->ftruncate()
+            || !fa->fwrite(reinterpret_cast<const byte*>(data.data()), static_cast<unsigned>(data.size()), 0))
+    {
+        LOG_warn << "Unable to save the TLS sessions";
+    }
+}
+
 // force retrieval of pending actionpackets immediately
 // by closing pending sc, reset backoff and clear waitd URL
 void MegaClient::catchup()
@@ -4317,9 +4871,16 @@ void MegaClient::locallogout(bool removecaches, bool keepSyncsConfigFile)
     {
         removeCaches(keepSyncsConfigFile);
     }
+    else
+    {
+        // while the master key is still there
+        savetlssessions();
+    }
 
     sctable.reset();
     pendingsccommit = false;
+    mNodeSnapshot.reset();
+    mScRecorder.reset();
 
     statusTable.reset();
 
@@ -4352,6 +4913,12 @@ void MegaClient::locallogout(bool removecaches, bool keepSyncsConfigFile)
     mediaFileInfo = MediaFileInfo();
 #endif
 
+    // the progress of the transfers, for them to resume where they are
+    {
+        DBTableTransactionCommitter committer(tctable);
+        flushtransferprogress(committer, true);
+    }
+
     // remove any cached transfers older than two days that have not been resumed (updates transfer list)
     purgeOrphanTransfers();
 
@@ -4366,13 +4933,21 @@ void MegaClient::locallogout(bool removecaches, bool keepSyncsConfigFile)
 
     freeq(GET);  // freeq after closetc due to optimizations
     freeq(PUT);
+    mDownloadedContent.clear();
 
     purgenodesusersabortsc(false);
 
     reqs.clear();
+    mGetUAWaiters.clear();
+    mUploadPutnodes.clear();
+    mSyncUploadPutnodes.clear();
+    mSyncUploadPutnodesDs = 0;
+    mFetchNodesStream.reset();
+    mTreeRefresh.reset();
 
     delete pendingcs;
     pendingcs = NULL;
+    pendingparallelcs.clear();
     scsn.clear();
     mBlocked = false;
     mBlockedSet = false;
@@ -4454,6 +5029,8 @@ void MegaClient::locallogout(bool removecaches, bool keepSyncsConfigFile)
     mAuthRings.clear();
     mAuthRingsTemp.clear();
     mFetchingAuthrings = false;
+    mVerifiedKeySignatures.clear();
+    mVerifiedKeySignaturesDirty = false;
 
     init();
 
@@ -4479,12 +5056,24 @@ void MegaClient::removeCaches(bool keepSyncsConfigFile)
         pendingsccommit = false;
     }
 
+    if (mNodeSnapshot)
+    {
+        mNodeSnapshot->remove();
+        mNodeSnapshot.reset();
+    }
+
     if (statusTable)
     {
         statusTable->remove();
         statusTable.reset();
     }
 
+    if (dbaccess)
+    {
+        LocalPath path = tlsSessionsPath(*dbaccess, *fsaccess);
+        fsaccess->unlinklocal(path);
+    }
+
 #ifdef ENABLE_SYNC
 
     // remove the LocalNode cache databases first, otherwise disable would cause this to be skipped
@@ -4608,6 +5197,7 @@ void MegaClient::httprequest(const char *url, int method, bool binary, const cha
 bool MegaClient::procsc()
 {
     CodeCounter::ScopeTimer ccst(performanceStats.scProcessingTime);
+    CodeCounter::LoopProfiler::Phase phase(performanceStats.execPhases, PerformanceStats::PHASE_PROCSC);
 
     nameid name;
 
@@ -4642,9 +5232,15 @@ bool MegaClient::procsc()
                     {
                         if (!pendingcs && !csretrying && !reqs.cmdspending())
                         {
-                            sctable->commit();
-                            sctable->begin();
-                            app->notify_dbcommit();
+                            if (flushsc())
+                            {
+                                {
+                                    CodeCounter::LoopProfiler::Phase phase(performanceStats.execPhases, PerformanceStats::PHASE_DBCOMMIT);
+                                    sctable->commit();
+                                    sctable->begin();
+                                }
+                                app->notify_dbcommit();
+                            }
                             pendingsccommit = false;
                         }
                         else
@@ -4662,11 +5258,15 @@ bool MegaClient::procsc()
 
                     if (!statecurrent && !insca_notlast)   // with actionpacket spoonfeeding, just finishing a batch does not mean we are up to date yet - keep going while "ir":1
                     {
+                        // a reload whose differences were queued for notifypurge() instead of a full notification
+                        bool refreshed = false;
+
                         if (fetchingnodes)
                         {
                             notifypurge();
-                            if (sctable)
+                            if (sctable && flushsc())
                             {
+                                CodeCounter::LoopProfiler::Phase phase(performanceStats.execPhases, PerformanceStats::PHASE_DBCOMMIT);
                                 sctable->commit();
                                 sctable->begin();
                                 pendingsccommit = false;
@@ -4680,6 +5280,9 @@ bool MegaClient::procsc()
                             restag = fetchnodestag;
                             fetchnodestag = 0;
 
+                            // a reload tells the app what differs from the tree it had, with the next notifypurge()
+                            refreshed = endrefresh();
+
                             if (!mBlockedSet && mCachedStatus.lookup(CacheableStatus::STATUS_BLOCKED, 0)) //block state not received in this execution, and cached says we were blocked last time
                             {
                                 LOG_debug << "cached blocked states reports blocked, and no block state has been received before, issuing whyamiblocked";
@@ -4745,16 +5348,27 @@ bool MegaClient::procsc()
 
                         sendevent(99426, report.c_str(), 0);    // Treeproc performance log
 
-                        // NULL vector: "notify all elements"
-                        app->nodes_updated(NULL, int(nodes.size()));
+                        if (refreshed)
+                        {
+                            // only the nodes that differ, and the placeholders of the removed ones deleted
+                            notifypurge();
+                        }
+                        else
+                        {
+                            // NULL vector: "notify all elements"
+                            app->nodes_updated(NULL, int(nodes.size()));
+                        }
                         app->users_updated(NULL, int(users.size()));
                         app->pcrs_updated(NULL, int(pcrindex.size()));
 #ifdef ENABLE_CHAT
                         app->chats_updated(NULL, int(chats.size()));
 #endif
-                        for (node_map::iterator it = nodes.begin(); it != nodes.end(); it++)
+                        if (!refreshed)
                         {
-                            memset(&(it->second->changed), 0, sizeof it->second->changed);
+                            for (node_map::iterator it = nodes.begin(); it != nodes.end(); it++)
+                            {
+                                memset(&(it->second->changed), 0, sizeof it->second->changed);
+                            }
                         }
 
                         if (!loggedinfolderlink())
@@ -4791,8 +5405,34 @@ bool MegaClient::procsc()
 
         if (insca)
         {
+            if (mScStreamLimit)
+            {
+                // the next packet may still be incomplete
+                const char* next = jsonsc.pos;
+                if (*next == '}')
+                {
+                    next++;
+                }
+                if (*next == ',')
+                {
+                    next++;
+                }
+                if (next >= mScStreamLimit)
+                {
+                    return true;
+                }
+            }
+
             if (jsonsc.enterobject())
             {
+                if (mScSkipPackets)
+                {
+                    mScSkipPackets--;
+                    jsonsc.leaveobject();
+                    continue;
+                }
+                scsn.packetApplied();
+
                 // the "a" attribute is guaranteed to be the first in the object
                 if (jsonsc.getnameid() == 'a')
                 {
@@ -5045,34 +5685,74 @@ void MegaClient::initsc()
         bool complete;
 
         assert(sctable->inTransaction());
+
+        // the whole cache is rewritten, and so will the snapshot
+        if (mNodeSnapshot)
+        {
+            mNodeSnapshot->remove();
+        }
+
+        // every node is rewritten below, so all of them must be in memory
+        loadAllCachedNodes();
+
+        for (Node* n : scdirty)
+        {
+            n->scdirty_it = scdirty.end();
+        }
+        scdirty.clear();
+        scremoved.clear();
+
         sctable->truncate();
 
         // 1. write current scsn
         handle tscsn = scsn.getHandle();
         complete = sctable->put(CACHEDSCSN, (char*)&tscsn, sizeof tscsn);
 
+        if (complete)
+        {
+            mVerifiedKeySignaturesDirty = true;
+            complete = putkeysignatures();
+        }
+
+        // records are written in multi-row batches
+        const size_t batchSize = 1024;
+        DbRecordBatch records;
+
         if (complete)
         {
             // 2. write all users
             for (user_map::iterator it = users.begin(); it != users.end(); it++)
             {
-                if (!(complete = sctable->put(CACHEDUSER, &it->second, &key)))
-                {
-                    break;
-                }
+                sctable->serialize(CACHEDUSER, &it->second, &key, records);
             }
+            complete = sctable->put(records);
+            records.clear();
         }
 
         if (complete)
         {
             // 3. write new or modified nodes, purge deleted nodes
+            DbNodeRecordBatch nodeRecords;
+            nodeRecords.reserve(std::min(nodes.size(), batchSize));
+
             for (node_map::iterator it = nodes.begin(); it != nodes.end(); it++)
             {
-                if (!(complete = sctable->put(CACHEDNODE, it->second, &key)))
+                sctable->serializeNode(CACHEDNODE, it->second, &key, nodeRecords);
+
+                if (nodeRecords.size() >= batchSize)
                 {
-                    break;
+                    if (!(complete = sctable->putNodes(nodeRecords)))
+                    {
+                        break;
+                    }
+                    nodeRecords.clear();
                 }
             }
+
+            if (complete)
+            {
+                complete = sctable->putNodes(nodeRecords);
+            }
         }
 
         if (complete)
@@ -5080,11 +5760,10 @@ void MegaClient::initsc()
             // 4. write new or modified pcrs, purge deleted pcrs
             for (handlepcr_map::iterator it = pcrindex.begin(); it != pcrindex.end(); it++)
             {
-                if (!(complete = sctable->put(CACHEDPCR, it->second.get(), &key)))
-                {
-                    break;
-                }
+                sctable->serialize(CACHEDPCR, it->second.get(), &key, records);
             }
+            complete = sctable->put(records);
+            records.clear();
         }
 
 #ifdef ENABLE_CHAT
@@ -5093,18 +5772,27 @@ void MegaClient::initsc()
             // 5. write new or modified chats
             for (textchat_map::iterator it = chats.begin(); it != chats.end(); it++)
             {
-                if (!(complete = sctable->put(CACHEDCHAT, it->second, &key)))
-                {
-                    break;
-                }
+                sctable->serialize(CACHEDCHAT, it->second, &key, records);
             }
+            complete = sctable->put(records);
+            records.clear();
         }
         LOG_debug << "Saving SCSN " << scsn.text() << " with " << nodes.size() << " nodes, " << users.size() << " users, " << pcrindex.size() << " pcrs and " << chats.size() << " chats to local cache (" << complete << ")";
 #else
 
         LOG_debug << "Saving SCSN " << scsn.text() << " with " << nodes.size() << " nodes and " << users.size() << " users and " << pcrindex.size() << " pcrs to local cache (" << complete << ")";
 #endif
+        if (complete)
+        {
+            unloadCachedVersions();
+        }
         finalizesc(complete);
+
+        if (complete)
+        {
+            mScLastFlush = Waiter::ds;
+            updatenodesnapshot(node_vector(), handle_vector());
+        }
     }
 }
 
@@ -5150,6 +5838,11 @@ void MegaClient::updatesc()
         handle tscsn = scsn.getHandle();
         complete = sctable->put(CACHEDSCSN, (char*)&tscsn, sizeof tscsn);
 
+        if (complete)
+        {
+            complete = putkeysignatures();
+        }
+
         if (complete)
         {
             // 2. write new or update modified users
@@ -5180,12 +5873,20 @@ void MegaClient::updatesc()
 
         if (complete)
         {
-            // 3. write new or modified nodes, purge deleted nodes
+            // 3. purge deleted nodes, and leave the new or modified ones for flushsc()
             for (node_vector::iterator it = nodenotify.begin(); it != nodenotify.end(); it++)
             {
                 char base64[12];
                 if ((*it)->changed.removed)
                 {
+                    if ((*it)->scdirty_it != scdirty.end())
+                    {
+                        scdirty.erase((*it)->scdirty_it);
+                        (*it)->scdirty_it = scdirty.end();
+                    }
+
+                    scremoved.push_back((*it)->nodehandle);
+
                     if ((*it)->dbid)
                     {
                         LOG_verbose << "Removing node from database: " << (Base64::btoa((byte*)&((*it)->nodehandle),MegaClient::NODEHANDLE,base64) ? base64 : "");
@@ -5195,13 +5896,9 @@ void MegaClient::updatesc()
                         }
                     }
                 }
-                else
+                else if ((*it)->scdirty_it == scdirty.end())
                 {
-                    LOG_verbose << "Adding node to database: " << (Base64::btoa((byte*)&((*it)->nodehandle),MegaClient::NODEHANDLE,base64) ? base64 : "");
-                    if (!(complete = sctable->put(CACHEDNODE, *it, &key)))
-                    {
-                        break;
-                    }
+                    (*it)->scdirty_it = scdirty.insert(*it).first;
                 }
             }
         }
@@ -5237,36 +5934,136 @@ void MegaClient::updatesc()
 #ifdef ENABLE_CHAT
         if (complete)
         {
-            // 5. write new or modified chats
+            // 5. write new or modified chats, unless their record is the one in the cache already
             for (textchat_map::iterator it = chatnotify.begin(); it != chatnotify.end(); it++)
             {
+                TextChat* chat = it->second;
+                string data;
+                chat->serialize(&data);
+
+                size_t dbhash = std::hash<string>()(data);
+                if (chat->dbid && chat->dbhash == dbhash)
+                {
+                    continue;
+                }
+
                 char base64[12];
-                LOG_verbose << "Adding chat to database: " << (Base64::btoa((byte*)&(it->second->id),MegaClient::CHATHANDLE,base64) ? base64 : "");
-                if (!(complete = sctable->put(CACHEDCHAT, it->second, &key)))
+                LOG_verbose << "Adding chat to database: " << (Base64::btoa((byte*)&(chat->id),MegaClient::CHATHANDLE,base64) ? base64 : "");
+                PaddedCBC::encrypt(rng, &data, &key);
+                sctable->assignid(CACHEDCHAT, chat);
+                if (!(complete = sctable->put(chat->dbid, &data)))
                 {
                     break;
                 }
+                chat->dbhash = dbhash;
             }
         }
         LOG_debug << "Saving SCSN " << scsn.text() << " with " << nodenotify.size() << " modified nodes, " << usernotify.size() << " users, " << pcrnotify.size() << " pcrs and " << chatnotify.size() << " chats to local cache (" << complete << ")";
 #else
         LOG_debug << "Saving SCSN " << scsn.text() << " with " << nodenotify.size() << " modified nodes, " << usernotify.size() << " users and " << pcrnotify.size() << " pcrs to local cache (" << complete << ")";
 #endif
+        if (complete && (scdirty.size() >= mScFlushThreshold || Waiter::ds - mScLastFlush >= mScFlushInterval))
+        {
+            complete = flushsc();
+        }
         finalizesc(complete);
     }
 }
 
-// commit or purge local state cache
-void MegaClient::finalizesc(bool complete)
+// write the digests of the verified signatures of public keys, if changed
+bool MegaClient::putkeysignatures()
 {
-    if (complete)
+    if (!mVerifiedKeySignaturesDirty)
     {
-        cachedscsn = scsn.getHandle();
+        return true;
     }
-    else
+
+    string data;
+    data.reserve(mVerifiedKeySignatures.size() * KEY_SIGNATURE_DIGEST_LENGTH);
+    for (auto& digest : mVerifiedKeySignatures)
+    {
+        data.append(digest);
+    }
+
+    mVerifiedKeySignaturesDirty = false;
+    return sctable->put(CACHEDKEYSIGNATURES, &data);
+}
+
+// write the nodes changed since the last flush, and bring the node snapshot along
+bool MegaClient::flushsc()
+{
+    if (!sctable)
+    {
+        return false;
+    }
+
+    // records are written in multi-row batches, as by initsc()
+    const size_t batchSize = 1024;
+    DbNodeRecordBatch records;
+    records.reserve(std::min(scdirty.size(), batchSize));
+
+    bool complete = true;
+    node_vector written;
+    written.reserve(scdirty.size());
+
+    for (Node* n : scdirty)
+    {
+        n->scdirty_it = scdirty.end();
+
+        if (complete)
+        {
+            sctable->serializeNode(CACHEDNODE, n, &key, records);
+            written.push_back(n);
+
+            if (records.size() >= batchSize)
+            {
+                complete = sctable->putNodes(records);
+                records.clear();
+            }
+        }
+    }
+
+    if (complete)
+    {
+        complete = sctable->putNodes(records);
+    }
+
+    LOG_debug << "Flushed " << written.size() << " modified nodes to local cache (" << complete << ")";
+    scdirty.clear();
+    mScLastFlush = Waiter::ds;
+
+    if (!complete)
+    {
+        scremoved.clear();
+        finalizesc(false);
+        return false;
+    }
+
+    updatenodesnapshot(written, scremoved);
+    scremoved.clear();
+    return true;
+}
+
+// commit or purge local state cache
+void MegaClient::finalizesc(bool complete)
+{
+    if (complete)
     {
+        cachedscsn = scsn.getHandle();
+    }
+    else
+    {
+        // the nodes still in the cache only would be lost with it
+        loadAllCachedNodes();
+
         sctable->remove();
 
+        if (mNodeSnapshot)
+        {
+            mNodeSnapshot->remove();
+            mNodeSnapshot.reset();
+        }
+
         LOG_err << "Cache update DB write error - disabling caching";
 
         sctable.reset();
@@ -5274,6 +6071,85 @@ void MegaClient::finalizesc(bool complete)
     }
 }
 
+void MegaClient::updatenodesnapshot(const node_vector& written, const handle_vector& removed)
+{
+    if (!mNodeSnapshot)
+    {
+        return;
+    }
+
+    handle current = scsn.getHandle();
+    if (mNodeSnapshot->scsn() == current && written.empty() && removed.empty())
+    {
+        return;
+    }
+
+    auto record = [](handle h, handle parent, nodetype_t type, m_off_t size, uint32_t dbid)
+    {
+        NodeSnapshot::Record r;
+        r.h = h;
+        r.parent = parent;
+        r.type = type;
+        r.size = type == FILENODE ? size : 0;
+        r.dbid = dbid;
+        return r;
+    };
+
+    // append what updatesc() just wrote, until the changes outgrow a fraction of the full list
+    if (mNodeSnapshot->scsn() != UNDEF && mNodeSnapshot->scsn() != current
+            && mNodeSnapshot->changes() <= mNodeSnapshot->records() / 4 + NODE_SNAPSHOT_MIN_CHANGES)
+    {
+        vector<NodeSnapshot::Record> updated;
+        updated.reserve(written.size());
+
+        for (Node* n : written)
+        {
+            if (n->dbid)
+            {
+                updated.push_back(record(n->nodehandle, n->parent ? n->parent->nodehandle : n->parenthandle, n->type, n->size, n->dbid));
+            }
+        }
+
+        if (mNodeSnapshot->append(current, updated, removed))
+        {
+            return;
+        }
+    }
+
+    // nodes still in the cache only are taken from mCachedNodeIndex
+    vector<NodeSnapshot::Record> records;
+    records.reserve(nodes.size() + (mCachedNodeIndex ? mCachedNodeIndex->size() - mCachedNodeIndex->loadedCount() : 0));
+
+    for (auto& e : nodes)
+    {
+        Node* n = e.second;
+        if (!n->changed.removed && n->dbid)
+        {
+            records.push_back(record(n->nodehandle, n->parent ? n->parent->nodehandle : n->parenthandle, n->type, n->size, n->dbid));
+        }
+    }
+
+    if (mCachedNodeIndex)
+    {
+        for (auto& r : *mCachedNodeIndex)
+        {
+            if (!r.loaded)
+            {
+                records.push_back(record(r.h, r.parent, r.type, r.size, r.dbid));
+            }
+        }
+    }
+
+    if (mNodeSnapshot->write(current, records))
+    {
+        LOG_debug << "Node snapshot written: " << records.size() << " records";
+    }
+    else
+    {
+        mNodeSnapshot->remove();
+    }
+}
+
 // queue node file attribute for retrieval or cancel retrieval
 error MegaClient::getfa(handle h, string *fileattrstring, const string &nodekey, fatype t, int cancel)
 {
@@ -5322,10 +6198,16 @@ error MegaClient::getfa(handle h, string *fileattrstring, const string &nodekey,
                     delete it->second;
                     cit->second->fafs[i].erase(it);
 
-                    // none left: tear down connection
-                    if (!cit->second->fafs[1].size() && cit->second->req.status == REQ_INFLIGHT)
+                    // none left: tear down connections
+                    if (!cit->second->fafs[1].size())
                     {
-                        cit->second->req.disconnect();
+                        for (auto& r : cit->second->requests)
+                        {
+                            if (r->req.status == REQ_INFLIGHT)
+                            {
+                                r->req.disconnect();
+                            }
+                        }
                     }
 
                     return API_OK;
@@ -5553,12 +6435,20 @@ void MegaClient::sc_updatenode()
                             }
                             JSON::copystring(n->attrstring.get(), a);
                             n->changed.attrs = true;
+
+                            // (its name is unknown until the new attributes are decrypted)
+                            if (n->parent)
+                            {
+                                n->parent->children.clearIndexes();
+                            }
                             notify = true;
                         }
 
                         if (ts != -1 && n->ctime != ts)
                         {
+                            mRecentFiles.remove(n);
                             n->ctime = ts;
+                            mRecentFiles.add(n);
                             n->changed.ctime = true;
                             notify = true;
                         }
@@ -7246,6 +8136,7 @@ void MegaClient::sc_ub()
 // purge removed nodes after notification
 void MegaClient::notifypurge(void)
 {
+    CodeCounter::LoopProfiler::Phase phase(performanceStats.execPhases, PerformanceStats::PHASE_NOTIFYPURGE);
     int i, t;
 
     handle tscsn = cachedscsn;
@@ -7280,6 +8171,7 @@ void MegaClient::notifypurge(void)
 
         if (!fetchingnodes)
         {
+            CodeCounter::LoopProfiler::Phase callbacks(performanceStats.execPhases, PerformanceStats::PHASE_APPCALLBACKS);
             app->nodes_updated(&nodenotify[0], t);
         }
 
@@ -7371,6 +8263,23 @@ void MegaClient::notifypurge(void)
             }
             else
             {
+                if (n->changed.attrs)
+                {
+                    indexnodename(n);
+
+                    // (attributes may also be changed directly, without Node::setattr())
+                    if (n->parent)
+                    {
+                        n->parent->children.clearIndexes();
+                    }
+                }
+
+                // (videos are also told by their media attributes)
+                if (n->changed.fileattrstring && !n->changed.attrs)
+                {
+                    indexnodetype(n);
+                }
+
                 n->notified = false;
                 memset(&(n->changed), 0, sizeof(n->changed));
                 n->tag = 0;
@@ -7378,12 +8287,21 @@ void MegaClient::notifypurge(void)
         }
 
         nodenotify.clear();
+
+        mNodeNames.compact([this](handle h, uint32_t slot)
+        {
+            if (Node* n = nodebyhandle(h))
+            {
+                n->nameslot = slot;
+            }
+        });
     }
 
     if ((t = int(pcrnotify.size())))
     {
         if (!fetchingnodes)
         {
+            CodeCounter::LoopProfiler::Phase callbacks(performanceStats.execPhases, PerformanceStats::PHASE_APPCALLBACKS);
             app->pcrs_updated(&pcrnotify[0], t);
         }
 
@@ -7411,6 +8329,7 @@ void MegaClient::notifypurge(void)
     {
         if (!fetchingnodes)
         {
+            CodeCounter::LoopProfiler::Phase callbacks(performanceStats.execPhases, PerformanceStats::PHASE_APPCALLBACKS);
             app->users_updated(&usernotify[0], t);
         }
 
@@ -7445,7 +8364,10 @@ void MegaClient::notifypurge(void)
     if ((t = int(useralerts.useralertnotify.size())))
     {
         LOG_debug << "Notifying " << t << " user alerts";
-        app->useralerts_updated(&useralerts.useralertnotify[0], t);
+        {
+            CodeCounter::LoopProfiler::Phase callbacks(performanceStats.execPhases, PerformanceStats::PHASE_APPCALLBACKS);
+            app->useralerts_updated(&useralerts.useralertnotify[0], t);
+        }
 
         for (i = 0; i < t; i++)
         {
@@ -7461,6 +8383,7 @@ void MegaClient::notifypurge(void)
     {
         if (!fetchingnodes)
         {
+            CodeCounter::LoopProfiler::Phase callbacks(performanceStats.execPhases, PerformanceStats::PHASE_APPCALLBACKS);
             app->chats_updated(&chatnotify, t);
         }
 
@@ -7478,6 +8401,10 @@ void MegaClient::notifypurge(void)
 #endif
 
     totalNodes = nodes.size();
+    if (mCachedNodeIndex)
+    {
+        totalNodes += mCachedNodeIndex->size() - mCachedNodeIndex->loadedCount();
+    }
 }
 
 // return node pointer derived from node handle
@@ -7490,7 +8417,8 @@ Node* MegaClient::nodebyhandle(handle h) const
         return it->second;
     }
 
-    return nullptr;
+    // not in memory yet?
+    return mCachedNodeIndex ? const_cast<MegaClient*>(this)->loadCachedNode(h) : nullptr;
 }
 
 Node* MegaClient::nodeByHandle(NodeHandle h) const
@@ -7498,7 +8426,12 @@ Node* MegaClient::nodeByHandle(NodeHandle h) const
     if (h.isUndef()) return nullptr;
 
     auto it = nodes.find(h);
-    return it != nodes.end() ? it->second : nullptr;
+    if (it != nodes.end())
+    {
+        return it->second;
+    }
+
+    return mCachedNodeIndex ? const_cast<MegaClient*>(this)->loadCachedNode(h.as8byte()) : nullptr;
 }
 
 Node* MegaClient::nodeByPath(const char* path, Node* node)
@@ -7681,11 +8614,22 @@ Node* MegaClient::nodeByPath(const char* path, Node* node)
                 // locate child node (explicit ambiguity resolution: not implemented)
                 if (c[l].size())
                 {
-                    nn = childnodebyname(n, c[l].c_str());
+                    string name = c[l];
+                    fsaccess->normalize(&name);
 
-                    if (!nn)
+                    // a cached child is checked to still be there under that name
+                    NodeHandle h = mPathCache.find(n->nodeHandle(), name);
+                    nn = h.isUndef() ? nullptr : nodeByHandle(h);
+                    if (!nn || nn->parent != n || name != nn->displayname())
                     {
-                        return NULL;
+                        nn = childnodebyname(n, c[l].c_str());
+
+                        if (!nn)
+                        {
+                            return NULL;
+                        }
+
+                        mPathCache.add(n->nodeHandle(), name, nn->nodeHandle());
                     }
 
                     n = nn;
@@ -7781,6 +8725,54 @@ void MegaClient::makeattr(SymmCipher* key, const std::unique_ptr<string>& attrst
     makeattr(key, attrstring.get(), json, l);
 }
 
+void MegaClient::makeattrs(vector<NewNode>& newnodes, const vector<string>& attrjson)
+{
+    assert(newnodes.size() == attrjson.size());
+
+    auto make = [this, &newnodes, &attrjson](SymmCipher& key, size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            NewNode& newnode = newnodes[i];
+            if (newnode.nodekey.size())
+            {
+                key.setkey((const byte*)newnode.nodekey.data(), newnode.type);
+                makeattr(&key, newnode.attrstring, attrjson[i].data(), int(attrjson[i].size()));
+            }
+        }
+    };
+
+    if (newnodes.size() < MAKEATTRS_PARALLEL_MIN)
+    {
+        SymmCipher key;
+        make(key, 0, newnodes.size());
+        return;
+    }
+
+    std::mutex m;
+    std::condition_variable cv;
+    size_t remaining = (newnodes.size() + MAKEATTRS_BATCH - 1) / MAKEATTRS_BATCH;
+
+    for (size_t first = 0; first < newnodes.size(); first += MAKEATTRS_BATCH)
+    {
+        size_t last = std::min(first + MAKEATTRS_BATCH, newnodes.size());
+
+        mAsyncQueue.push([&make, first, last, &m, &cv, &remaining](SymmCipher& sc)
+        {
+            make(sc, first, last);
+
+            {
+                std::lock_guard<std::mutex> g(m);
+                --remaining;
+            }
+            cv.notify_all();
+        }, false, MegaClientAsyncQueue::PRIORITY_INTERACTIVE);   // this thread waits for it
+    }
+
+    std::unique_lock<std::mutex> g(m);
+    cv.wait(g, [&remaining]() { return !remaining; });
+}
+
 // update node attributes
 // (with speculative instant completion)
 error MegaClient::setattr(Node* n, attr_map&& updates, int tag, const char *prevattr, CommandSetAttr::Completion&& c)
@@ -7803,6 +8795,10 @@ error MegaClient::setattr(Node* n, attr_map&& updates, int tag, const char *prev
     }
 
     // when we merge SIC removal, the local object won't be changed unless/until the command succeeds
+    if (n->parent)
+    {
+        n->parent->children.clearIndexes();
+    }
     n->attrs.applyUpdates(updates);
 
     n->changed.attrs = true;
@@ -7892,7 +8888,7 @@ void MegaClient::putnodes_prepareOneFolder(NewNode* newnode, std::string foldern
     // generate fresh random key for this folder node
     rng.genblock(buf, FOLDERNODEKEYLENGTH);
     newnode->nodekey.assign((char*)buf, FOLDERNODEKEYLENGTH);
-    tmpnodecipher.setkey(buf);
+    SymmCipher* cipher = getRecycledTemporaryNodeCipher(buf);
 
     // generate fresh attribute object with the folder name
     AttrMap attrs;
@@ -7906,7 +8902,7 @@ void MegaClient::putnodes_prepareOneFolder(NewNode* newnode, std::string foldern
     // JSON-encode object and encrypt attribute string
     attrs.getjson(&attrstring);
     newnode->attrstring.reset(new string);
-    makeattr(&tmpnodecipher, newnode->attrstring, attrstring.c_str());
+    makeattr(cipher, newnode->attrstring, attrstring.c_str());
 }
 
 // send new nodes to API for processing
@@ -7930,6 +8926,165 @@ void MegaClient::putnodes(const char* user, vector<NewNode>&& newnodes, int tag)
     queuepubkeyreq(user, ::mega::make_unique<PubKeyActionPutNodes>(move(newnodes), tag));
 }
 
+void MegaClient::queueUploadPutnodes(NodeHandle target, NewNode&& newnode, int tag)
+{
+    UploadPutnodes& pending = mUploadPutnodes[target];
+    pending.nodes.push_back(move(newnode));
+    pending.tags.push_back(tag);
+}
+
+#ifdef ENABLE_SYNC
+void MegaClient::queueSyncUploadPutnodes(NodeHandle target, NewNode&& newnode, int tag)
+{
+    UploadPutnodes& pending = mSyncUploadPutnodes[target];
+
+    // the sync waits for the batch of each folder like for any other putnodes of its own
+    if (pending.nodes.empty())
+    {
+        syncadding++;
+    }
+
+    pending.nodes.push_back(move(newnode));
+    pending.tags.push_back(tag);
+
+    if (!mSyncUploadPutnodesDs)
+    {
+        mSyncUploadPutnodesDs = Waiter::ds + SYNC_PUTNODES_WINDOW_DS;
+    }
+    else if (pending.nodes.size() >= MAX_NEWNODES)
+    {
+        mSyncUploadPutnodesDs = Waiter::ds;
+    }
+}
+#endif
+
+void MegaClient::mergeputnodestags(const vector<int>& tags)
+{
+    for (size_t i = 1; i < tags.size(); i++)
+    {
+        if (tags[i] == tags.front())
+        {
+            continue;
+        }
+
+        auto tcids = pendingtcids.find(tags[i]);
+        if (tcids != pendingtcids.end())
+        {
+            vector<uint32_t>& ids = pendingtcids[tags.front()];
+            ids.insert(ids.end(), tcids->second.begin(), tcids->second.end());
+            pendingtcids.erase(tcids);
+        }
+
+        auto files = pendingfiles.find(tags[i]);
+        if (files != pendingfiles.end())
+        {
+            vector<LocalPath>& paths = pendingfiles[tags.front()];
+            paths.insert(paths.end(), files->second.begin(), files->second.end());
+            pendingfiles.erase(files);
+        }
+    }
+}
+
+void MegaClient::sendUploadPutnodes()
+{
+#ifdef ENABLE_SYNC
+    if (syncUploadPutnodesDue())
+    {
+        for (auto& it : mSyncUploadPutnodes)
+        {
+            UploadPutnodes& pending = it.second;
+
+            for (size_t first = 0; first < pending.nodes.size(); first += MAX_NEWNODES)
+            {
+                size_t count = std::min<size_t>(MAX_NEWNODES, pending.nodes.size() - first);
+
+                vector<NewNode> newnodes;
+                newnodes.reserve(count);
+                for (size_t i = first; i < first + count; i++)
+                {
+                    newnodes.push_back(move(pending.nodes[i]));
+                }
+                vector<int> tags(pending.tags.begin() + first, pending.tags.begin() + first + count);
+                mergeputnodestags(tags);
+
+                // the batch was counted once
+                if (first)
+                {
+                    syncadding++;
+                }
+
+                LOG_debug << "Sending the nodes of " << count << " sync uploads to " << it.first;
+                reqs.add(new CommandPutNodes(this, it.first, NULL, move(newnodes), tags.front(), PUTNODES_SYNC, nullptr, nullptr));
+            }
+        }
+        mSyncUploadPutnodes.clear();
+        mSyncUploadPutnodesDs = 0;
+    }
+#endif
+
+    for (auto& it : mUploadPutnodes)
+    {
+        NodeHandle target = it.first;
+        UploadPutnodes& pending = it.second;
+
+        for (size_t first = 0; first < pending.nodes.size(); first += MAX_NEWNODES)
+        {
+            size_t count = std::min<size_t>(MAX_NEWNODES, pending.nodes.size() - first);
+
+            vector<NewNode> newnodes;
+            newnodes.reserve(count);
+            for (size_t i = first; i < first + count; i++)
+            {
+                newnodes.push_back(move(pending.nodes[i]));
+            }
+            vector<int> tags(pending.tags.begin() + first, pending.tags.begin() + first + count);
+
+            if (count == 1)
+            {
+                reqs.add(new CommandPutNodes(this, target, NULL, move(newnodes), tags.front(), PUTNODES_APP, nullptr, nullptr));
+                continue;
+            }
+
+            mergeputnodestags(tags);
+
+            LOG_debug << "Sending the nodes of " << count << " uploads to " << target;
+
+            reqs.add(new CommandPutNodes(this, target, NULL, move(newnodes), tags.front(), PUTNODES_APP, nullptr,
+                [this, target, tags](const Error& e, targettype_t t, vector<NewNode>& nn, bool)
+                {
+                    // report every upload on its own, as if it had its own command
+                    int creqtag = restag;
+                    for (size_t i = 0; i < nn.size() && i < tags.size(); i++)
+                    {
+                        Error ne = e;
+                        bool targetOverride = false;
+                        if (!e)
+                        {
+                            Node* n = nn[i].added ? nodebyhandle(nn[i].mAddedHandle) : nullptr;
+                            if (n)
+                            {
+                                // the API puts the nodes into the rubbish bin if the target is gone
+                                targetOverride = n->parenthandle != target.as8byte();
+                            }
+                            else
+                            {
+                                ne = API_ENOENT;
+                            }
+                        }
+
+                        vector<NewNode> single;
+                        single.push_back(move(nn[i]));
+
+                        restag = tags[i];
+                        app->putnodes_result(ne, t, single, targetOverride);
+                    }
+                    restag = creqtag;
+                }));
+        }
+    }
+    mUploadPutnodes.clear();
+}
+
 // returns 1 if node has accesslevel a or better, 0 otherwise
 int MegaClient::checkaccess(Node* n, accesslevel_t a)
 {
@@ -8344,19 +9499,17 @@ error MegaClient::pw_key(const char* utf8pw, byte* key) const
 
 SymmCipher *MegaClient::getRecycledTemporaryTransferCipher(const byte *key, int type)
 {
-    tmptransfercipher.setkey(key, type);
-    return &tmptransfercipher;
+    return tmptransferciphers.get(key, type);
 }
 
 SymmCipher *MegaClient::getRecycledTemporaryNodeCipher(const string *key)
 {
-    return tmpnodecipher.setkey(key) ? &tmpnodecipher : nullptr;
+    return tmpnodeciphers.get(key);
 }
 
 SymmCipher *MegaClient::getRecycledTemporaryNodeCipher(const byte *key)
 {
-    tmpnodecipher.setkey(key);
-    return &tmpnodecipher;
+    return tmpnodeciphers.get(key);
 }
 
 // compute generic string hash
@@ -8402,339 +9555,780 @@ int MegaClient::readnodes(JSON* j, int notify, putsource_t source, vector<NewNod
     }
 
     node_vector dp;
-    Node* n;
 
     while (j->enterobject())
     {
-        handle h = UNDEF, ph = UNDEF;
-        handle u = 0, su = UNDEF;
-        nodetype_t t = TYPE_UNKNOWN;
-        const char* a = NULL;
-        const char* k = NULL;
-        const char* fa = NULL;
-        const char *sk = NULL;
-        accesslevel_t rl = ACCESS_UNKNOWN;
-        m_off_t s = NEVER;
-        m_time_t ts = -1, sts = -1;
-        nameid name;
-        int nni = -1;
-
-        while ((name = j->getnameid()) != EOO)
+        if (!readnode(j, notify, source, nn, tag, applykeys, dp))
         {
-            switch (name)
-            {
-                case 'h':   // new node: handle
-                    h = j->gethandle();
-                    break;
+            return 0;
+        }
+    }
 
-                case 'p':   // parent node
-                    ph = j->gethandle();
-                    break;
+    setorphanparents(dp);
 
-                case 'u':   // owner user
-                    u = j->gethandle(USERHANDLE);
-                    break;
+    return j->leavearray();
+}
 
-                case 't':   // type
-                    t = (nodetype_t)j->getint();
-                    break;
+// read and add/verify a single node object (already entered)
+bool MegaClient::readnode(JSON* j, int notify, putsource_t source, vector<NewNode>* nn, int tag, bool applykeys, node_vector& dp)
+{
+    Node* n;
+    handle h = UNDEF, ph = UNDEF;
+    handle u = 0, su = UNDEF;
+    nodetype_t t = TYPE_UNKNOWN;
+    const char* a = NULL;
+    const char* k = NULL;
+    const char* fa = NULL;
+    const char *sk = NULL;
+    accesslevel_t rl = ACCESS_UNKNOWN;
+    m_off_t s = NEVER;
+    m_time_t ts = -1, sts = -1;
+    nameid name;
+    int nni = -1;
 
-                case 'a':   // attributes
-                    a = j->getvalue();
-                    break;
+    while ((name = j->getnameid()) != EOO)
+    {
+        switch (name)
+        {
+            case 'h':   // new node: handle
+                h = j->gethandle();
+                break;
 
-                case 'k':   // key(s)
-                    k = j->getvalue();
-                    break;
+            case 'p':   // parent node
+                ph = j->gethandle();
+                break;
 
-                case 's':   // file size
-                    s = j->getint();
-                    break;
+            case 'u':   // owner user
+                u = j->gethandle(USERHANDLE);
+                break;
 
-                case 'i':   // related source NewNode index
-                    nni = int(j->getint());
-                    break;
+            case 't':   // type
+                t = (nodetype_t)j->getint();
+                break;
 
-                case MAKENAMEID2('t', 's'):  // actual creation timestamp
-                    ts = j->getint();
-                    break;
+            case 'a':   // attributes
+                a = j->getvalue();
+                break;
 
-                case MAKENAMEID2('f', 'a'):  // file attributes
-                    fa = j->getvalue();
-                    break;
+            case 'k':   // key(s)
+                k = j->getvalue();
+                break;
 
-                    // inbound share attributes
-                case 'r':   // share access level
-                    rl = (accesslevel_t)j->getint();
-                    break;
+            case 's':   // file size
+                s = j->getint();
+                break;
 
-                case MAKENAMEID2('s', 'k'):  // share key
-                    sk = j->getvalue();
-                    break;
+            case 'i':   // related source NewNode index
+                nni = int(j->getint());
+                break;
 
-                case MAKENAMEID2('s', 'u'):  // sharing user
-                    su = j->gethandle(USERHANDLE);
-                    break;
+            case MAKENAMEID2('t', 's'):  // actual creation timestamp
+                ts = j->getint();
+                break;
 
-                case MAKENAMEID3('s', 't', 's'):  // share timestamp
-                    sts = j->getint();
-                    break;
+            case MAKENAMEID2('f', 'a'):  // file attributes
+                fa = j->getvalue();
+                break;
 
-                default:
-                    if (!j->storeobject())
-                    {
-                        return 0;
-                    }
-            }
+                // inbound share attributes
+            case 'r':   // share access level
+                rl = (accesslevel_t)j->getint();
+                break;
+
+            case MAKENAMEID2('s', 'k'):  // share key
+                sk = j->getvalue();
+                break;
+
+            case MAKENAMEID2('s', 'u'):  // sharing user
+                su = j->gethandle(USERHANDLE);
+                break;
+
+            case MAKENAMEID3('s', 't', 's'):  // share timestamp
+                sts = j->getint();
+                break;
+
+            default:
+                if (!j->storeobject())
+                {
+                    return false;
+                }
         }
+    }
 
-        if (ISUNDEF(h))
+    if (ISUNDEF(h))
+    {
+        warn("Missing node handle");
+    }
+    else
+    {
+        if (t == TYPE_UNKNOWN)
         {
-            warn("Missing node handle");
+            warn("Unknown node type");
         }
-        else
+        else if (t == FILENODE || t == FOLDERNODE)
         {
-            if (t == TYPE_UNKNOWN)
+            if (ISUNDEF(ph))
+            {
+                warn("Missing parent");
+            }
+            else if (!a)
             {
-                warn("Unknown node type");
+                warn("Missing node attributes");
             }
-            else if (t == FILENODE || t == FOLDERNODE)
+            else if (!k)
+            {
+                warn("Missing node key");
+            }
+
+            if (t == FILENODE && ISUNDEF(s))
             {
-                if (ISUNDEF(ph))
+                warn("File node without file size");
+            }
+        }
+    }
+
+    if (fa && t != FILENODE)
+    {
+        warn("Spurious file attributes");
+    }
+
+    if (!warnlevel())
+    {
+        if ((n = nodebyhandle(h)))
+        {
+            Node* p = NULL;
+            if (!ISUNDEF(ph))
+            {
+                p = nodebyhandle(ph);
+            }
+
+            if (n->changed.removed)
+            {
+                // node marked for deletion is being resurrected, possibly
+                // with a new parent (server-client move operation)
+                n->changed.removed = false;
+            }
+            else
+            {
+                // node already present - check for race condition
+                if ((n->parent && ph != n->parent->nodehandle && p &&  p->type != FILENODE) || n->type != t)
                 {
-                    warn("Missing parent");
+                    app->reload("Node inconsistency");
+
+                    static bool reloadnotified = false;
+                    if (!reloadnotified)
+                    {
+                        sendevent(99437, "Node inconsistency", 0);
+                        reloadnotified = true;
+                    }
                 }
-                else if (!a)
+            }
+
+            if (!ISUNDEF(ph))
+            {
+                if (p)
                 {
-                    warn("Missing node attributes");
+                    if (n->setparent(p))
+                    {
+                        n->changed.parent = true;
+                    }
                 }
-                else if (!k)
+                else
                 {
-                    warn("Missing node key");
+                    n->setparent(NULL);
+                    n->parenthandle = ph;
+                    dp.push_back(n);
                 }
+            }
 
-                if (t == FILENODE && ISUNDEF(s))
-                {
-                    warn("File node without file size");
-                }
+            if (a && k && n->attrstring)
+            {
+                LOG_warn << "Updating the key of a NO_KEY node";
+                JSON::copystring(n->attrstring.get(), a);
+                n->setkeyfromjson(k);
             }
         }
-
-        if (fa && t != FILENODE)
+        else
         {
-            warn("Spurious file attributes");
-        }
+            byte buf[SymmCipher::KEYLENGTH];
 
-        if (!warnlevel())
-        {
-            if ((n = nodebyhandle(h)))
+            if (!ISUNDEF(su))
             {
-                Node* p = NULL;
-                if (!ISUNDEF(ph))
+                if (t != FOLDERNODE)
                 {
-                    p = nodebyhandle(ph);
+                    warn("Invalid share node type");
                 }
 
-                if (n->changed.removed)
+                if (rl == ACCESS_UNKNOWN)
                 {
-                    // node marked for deletion is being resurrected, possibly
-                    // with a new parent (server-client move operation)
-                    n->changed.removed = false;
+                    warn("Missing access level");
                 }
-                else
-                {
-                    // node already present - check for race condition
-                    if ((n->parent && ph != n->parent->nodehandle && p &&  p->type != FILENODE) || n->type != t)
-                    {
-                        app->reload("Node inconsistency");
 
-                        static bool reloadnotified = false;
-                        if (!reloadnotified)
-                        {
-                            sendevent(99437, "Node inconsistency", 0);
-                            reloadnotified = true;
-                        }
-                    }
+                if (!sk)
+                {
+                    LOG_warn << "Missing share key for inbound share";
                 }
 
-                if (!ISUNDEF(ph))
+                if (warnlevel())
                 {
-                    if (p)
-                    {
-                        if (n->setparent(p))
-                        {
-                            n->changed.parent = true;
-                        }
-                    }
-                    else
+                    su = UNDEF;
+                }
+                else
+                {
+                    if (sk)
                     {
-                        n->setparent(NULL);
-                        n->parenthandle = ph;
-                        dp.push_back(n);
+                        decryptkey(sk, buf, sizeof buf, &key, 1, h);
                     }
                 }
+            }
+
+            string fas;
 
-                if (a && k && n->attrstring)
+            JSON::copystring(&fas, fa);
+
+            // fallback timestamps
+            if (!(ts + 1))
+            {
+                ts = m_time();
+            }
+
+            if (!(sts + 1))
+            {
+                sts = ts;
+            }
+
+            n = new Node(this, &dp, h, ph, t, s, u, fas.c_str(), ts);
+            n->changed.newnode = true;
+
+            n->tag = tag;
+
+            n->attrstring.reset(new string);
+            JSON::copystring(n->attrstring.get(), a);
+            n->setkeyfromjson(k);
+
+            // folder link access: first returned record defines root node and identity
+				// (this code used to be in Node::Node but is not suitable for session resume)
+            if (ISUNDEF(*rootnodes))
+            {
+                *rootnodes = h;
+
+                if (loggedIntoWritableFolder())
                 {
-                    LOG_warn << "Updating the key of a NO_KEY node";
-                    JSON::copystring(n->attrstring.get(), a);
-                    n->setkeyfromjson(k);
+                    // If logged into writable folder, we need the sharekey set in the root node
+                    // so as to include it in subsequent put nodes
+                    n->sharekey = new SymmCipher(key); //we use the "master key", in this case the secret share key
                 }
             }
-            else
+
+            if (!ISUNDEF(su))
             {
-                byte buf[SymmCipher::KEYLENGTH];
+                newshares.push_back(new NewShare(h, 0, su, rl, sts, sk ? buf : NULL));
+            }
 
-                if (!ISUNDEF(su))
-                {
-                    if (t != FOLDERNODE)
-                    {
-                        warn("Invalid share node type");
-                    }
+            if (u != me && !ISUNDEF(u) && !fetchingnodes)
+            {
+                useralerts.noteSharedNode(u, t, ts, n);
+            }
 
-                    if (rl == ACCESS_UNKNOWN)
-                    {
-                        warn("Missing access level");
-                    }
+            if (nn && nni >= 0 && nni < int(nn->size()))
+            {
+                auto& nn_nni = (*nn)[nni];
+                nn_nni.added = true;
+                nn_nni.mAddedHandle = h;
 
-                    if (!sk)
+#ifdef ENABLE_SYNC
+                if (source == PUTNODES_SYNC)
+                {
+                    if (nn_nni.localnode)
                     {
-                        LOG_warn << "Missing share key for inbound share";
-                    }
+                        // overwrites/updates: associate LocalNode with newly created Node
+                        nn_nni.localnode->setnode(n);
+                        nn_nni.localnode->treestate(TREESTATE_SYNCED);
 
-                    if (warnlevel())
-                    {
-                        su = UNDEF;
-                    }
-                    else
-                    {
-                        if (sk)
+                        // updates cache with the new node associated
+                        nn_nni.localnode->sync->statecacheadd(nn_nni.localnode);
+                        nn_nni.localnode->newnode.reset(); // localnode ptr now null also
+
+                        // scan in case we had pending moves.
+                        if (n->type == FOLDERNODE)
                         {
-                            decryptkey(sk, buf, sizeof buf, &key, 1, h);
+                            // mark this and folders below to be rescanned
+                            n->localnode->setSubtreeNeedsRescan(false);
+
+                            // queue this one to be scanned, recursion is by notify of subdirs
+                            n->localnode->sync->dirnotify->notify(DirNotify::DIREVENTS, n->localnode, LocalPath(), true);
                         }
                     }
                 }
+#endif
 
-                string fas;
+                if (nn_nni.source == NEW_UPLOAD)
+                {
+                    UploadHandle uh = nn_nni.uploadhandle;
 
-                JSON::copystring(&fas, fa);
+                    // do we have pending file attributes for this upload? set them.
+                    for (fa_map::iterator it = pendingfa.lower_bound(pair<UploadHandle, fatype>(uh, fatype(0)));
+                         it != pendingfa.end() && it->first.first == uh; )
+                    {
+                        reqs.add(new CommandAttachFA(this, h, it->first.second, it->second.first, it->second.second));
+                        pendingfa.erase(it++);
+                    }
 
-                // fallback timestamps
-                if (!(ts + 1))
-                {
-                    ts = m_time();
+                    // FIXME: only do this for in-flight FA writes
+                    uhnh.insert(pair<UploadHandle, NodeHandle>(uh, NodeHandle().set6byte(h)));
                 }
+            }
+        }
 
-                if (!(sts + 1))
-                {
-                    sts = ts;
-                }
+        if (notify)
+        {
+            notifynode(n);
+        }
 
-                n = new Node(this, &dp, h, ph, t, s, u, fas.c_str(), ts);
-                n->changed.newnode = true;
+        if (applykeys)
+        {
+            n->applykey();
+        }
+    }
 
-                n->tag = tag;
+    return true;
+}
 
-                n->attrstring.reset(new string);
-                JSON::copystring(n->attrstring.get(), a);
-                n->setkeyfromjson(k);
+// any child nodes that arrived before their parents?
+void MegaClient::setorphanparents(node_vector& dp)
+{
+    for (size_t i = dp.size(); i--; )
+    {
+        if (Node* n = nodebyhandle(dp[i]->parenthandle))
+        {
+            dp[i]->setparent(n);
+        }
+    }
+}
 
-                // folder link access: first returned record defines root node and identity
-				// (this code used to be in Node::Node but is not suitable for session resume)
-                if (ISUNDEF(*rootnodes))
-                {
-                    *rootnodes = h;
+void MegaClient::streamfetchnodes(HttpReq* req, bool final)
+{
+    FetchNodesStream& fs = *mFetchNodesStream;
+    const char* ptr = req->data();
+    const char* end = ptr + req->size();
 
-                    if (loggedIntoWritableFolder())
-                    {
-                        // If logged into writable folder, we need the sharekey set in the root node
-                        // so as to include it in subsequent put nodes
-                        n->sharekey = new SymmCipher(key); //we use the "master key", in this case the secret share key
-                    }
-                }
+    if (fs.state == FetchNodesStream::PENDING)
+    {
+        static const char prefix[] = "[{\"f\":[";
+        const size_t len = sizeof prefix - 1;
 
-                if (!ISUNDEF(su))
-                {
-                    newshares.push_back(new NewShare(h, 0, su, rl, sts, sk ? buf : NULL));
-                }
+        size_t n = std::min(len, size_t(end - ptr));
+        if (memcmp(ptr, prefix, n) || (n < len && final))
+        {
+            // error or unexpected layout: CommandFetchNodes gets the response as received
+            fs.state = FetchNodesStream::DISABLED;
+            return;
+        }
 
-                if (u != me && !ISUNDEF(u) && !fetchingnodes)
-                {
-                    useralerts.noteSharedNode(u, t, ts, n);
-                }
+        if (n < len)
+        {
+            return;
+        }
 
-                if (nn && nni >= 0 && nni < int(nn->size()))
-                {
-                    auto& nn_nni = (*nn)[nni];
-                    nn_nni.added = true;
-                    nn_nni.mAddedHandle = h;
+        // the previous tree goes now rather than once the response is complete, unless it is being refreshed: then
+        // it stays in use until then, and the node objects are spooled meanwhile
+        if (!mTreeRefresh || !mTreeRefresh->spool)
+        {
+            purgenodesusersabortsc(true);
+        }
 
-#ifdef ENABLE_SYNC
-                    if (source == PUTNODES_SYNC)
-                    {
-                        if (nn_nni.localnode)
-                        {
-                            // overwrites/updates: associate LocalNode with newly created Node
-                            nn_nni.localnode->setnode(n);
-                            nn_nni.localnode->treestate(TREESTATE_SYNCED);
+        ptr += len;
+        fs.state = FetchNodesStream::NODES;
+    }
 
-                            // updates cache with the new node associated
-                            nn_nni.localnode->sync->statecacheadd(nn_nni.localnode);
-                            nn_nni.localnode->newnode.reset(); // localnode ptr now null also
+    while (fs.state == FetchNodesStream::NODES)
+    {
+        if (ptr < end && *ptr == ',')
+        {
+            ptr++;
+        }
 
-                            // scan in case we had pending moves.
-                            if (n->type == FOLDERNODE)
-                            {
-                                // mark this and folders below to be rescanned
-                                n->localnode->setSubtreeNeedsRescan(false);
+        if (ptr == end)
+        {
+            break;
+        }
 
-                                // queue this one to be scanned, recursion is by notify of subdirs
-                                n->localnode->sync->dirnotify->notify(DirNotify::DIREVENTS, n->localnode, LocalPath(), true);
-                            }
-                        }
-                    }
-#endif
+        if (*ptr == ']')
+        {
+            ptr++;
+            setorphanparents(fs.dp);
+            fs.dp.clear();
+            fs.state = FetchNodesStream::DONE;
 
-                    if (nn_nni.source == NEW_UPLOAD)
-                    {
-                        UploadHandle uh = nn_nni.uploadhandle;
+            if (mTreeRefresh && mTreeRefresh->spool && !mTreeRefresh->flushspool())
+            {
+                LOG_err << "Unable to spool the fetchnodes node array";
+                fs.state = FetchNodesStream::FAILED;
+            }
+            break;
+        }
+
+        const char* objend = JSON::objectend(ptr, end);
+        if (!objend)
+        {
+            if (*ptr != '{')
+            {
+                LOG_err << "Parse error (fetchnodes node array)";
+                fs.state = FetchNodesStream::FAILED;
+            }
+            break;
+        }
+
+        if (mTreeRefresh && mTreeRefresh->spool)
+        {
+            // kept as received, after its length
+            uint32_t len = uint32_t(objend - ptr);
+            mTreeRefresh->spoolBuffer.append((const char*)&len, sizeof len);
+            mTreeRefresh->spoolBuffer.append(ptr, len);
+            ptr = objend;
+
+            if (mTreeRefresh->spoolBuffer.size() >= TreeRefresh::SPOOL_BLOCK && !mTreeRefresh->flushspool())
+            {
+                LOG_err << "Unable to spool the fetchnodes node array";
+                fs.state = FetchNodesStream::FAILED;
+            }
+            continue;
+        }
+
+        // the object is copied so the JSON scanner finds it terminated
+        string object(ptr, objend);
+        JSON j(object);
+        if (!j.enterobject() || !readnode(&j, 0, PUTNODES_APP, nullptr, 0, false, fs.dp))
+        {
+            LOG_err << "Parse error (fetchnodes node)";
+            fs.state = FetchNodesStream::FAILED;
+            break;
+        }
+
+        ptr = objend;
+    }
+
+    if (!final)
+    {
+        req->purge(ptr - req->data());
+        return;
+    }
+
+    if (fs.state == FetchNodesStream::NODES)
+    {
+        LOG_err << "Incomplete fetchnodes node array";
+        fs.state = FetchNodesStream::FAILED;
+    }
+
+    // leave the remainder as a response without the node array
+    string rest;
+    if (fs.state == FetchNodesStream::DONE)
+    {
+        rest.assign(ptr < end && *ptr == ',' ? ptr + 1 : ptr, end);
+    }
+    else
+    {
+        rest = "}]";
+    }
+
+    req->in = "[{" + rest;
+    req->inpurge = 0;
+}
+
+MegaClient::TreeRefresh::~TreeRefresh()
+{
+    spool.reset();
+    if (!spoolPath.empty())
+    {
+        fsaccess->unlinklocal(spoolPath);
+    }
+}
+
+bool MegaClient::TreeRefresh::flushspool()
+{
+    if (!spoolBuffer.empty())
+    {
+        if (!spool->fwrite(reinterpret_cast<const byte*>(spoolBuffer.data()), unsigned(spoolBuffer.size()), spoolSize))
+        {
+            return false;
+        }
+        spoolSize += m_off_t(spoolBuffer.size());
+        spoolBuffer.clear();
+    }
+    return true;
+}
+
+size_t MegaClient::nodedigest(const Node& n)
+{
+    size_t digest = 0;
+    hashCombine(digest, int(n.type));
+    hashCombine(digest, n.size);
+    hashCombine(digest, n.ctime);
+    hashCombine(digest, n.owner);
+    hashCombine(digest, n.nodekeyUnchecked());
+    hashCombine(digest, n.fileattrstring);
+    if (n.attrstring)
+    {
+        hashCombine(digest, *n.attrstring);
+    }
+    for (auto& a : n.attrs.map)
+    {
+        hashCombine(digest, a.first);
+        hashCombine(digest, a.second);
+    }
+    hashCombine(digest, n.inshare ? int(n.inshare->access) : -1);
+    hashCombine(digest, n.outshares ? n.outshares->size() : 0);
+    hashCombine(digest, n.pendingshares ? n.pendingshares->size() : 0);
+    hashCombine(digest, n.plink ? n.plink->ph : UNDEF);
+    return digest;
+}
+
+void MegaClient::beginrefresh()
+{
+    mTreeRefresh.reset();
+
+    if (!mRefreshOnReload || nodes.empty() || mLazyNodeLoading)
+    {
+        return;
+    }
+
+    unique_ptr<TreeRefresh> refresh(new TreeRefresh);
+    refresh->previous.reserve(nodes.size());
+    for (auto& it : nodes)
+    {
+        Node* n = it.second;
+        refresh->previous[n->nodehandle] = TreeRefresh::Previous{nodedigest(*n), n->parent ? n->parent->nodehandle : n->parenthandle, n->type};
+    }
+
+    // without a place for the spool, the previous tree goes as the response starts arriving, but the app is still
+    // told the differences only
+    if (dbaccess)
+    {
+        byte id[8];
+        rng.genblock(id, sizeof id);
+        string name;
+        Base64::btoa(string(reinterpret_cast<char*>(id), sizeof id), name);
+
+        refresh->fsaccess = fsaccess;
+        refresh->spoolPath = dbaccess->rootPath();
+        refresh->spoolPath.appendWithSeparator(LocalPath::fromPath("megaclient_refresh_" + name + ".tmp", *fsaccess), false);
+        refresh->spool = fsaccess->newfileaccess(false);
+        if (!refresh->spool->fopen(refresh->spoolPath, true, true))
+        {
+            LOG_warn << "Unable to open the spool of the reload: " << refresh->spoolPath.toPath(*fsaccess);
+            refresh->spool.reset();
+            refresh->spoolPath = LocalPath();
+        }
+    }
+
+    LOG_debug << "Refreshing a tree of " << refresh->previous.size() << " nodes";
+    mTreeRefresh = std::move(refresh);
+}
+
+bool MegaClient::readspoolednodes()
+{
+    TreeRefresh& r = *mTreeRefresh;
+    node_vector dp;
+    string data;
+    size_t used = 0;
+    m_off_t pos = 0;
+
+    for (;;)
+    {
+        // the complete records in the buffer
+        while (data.size() - used >= sizeof(uint32_t))
+        {
+            uint32_t len = MemAccess::get<uint32_t>(data.data() + used);
+            if (data.size() - used - sizeof len < len)
+            {
+                break;
+            }
+
+            string object(data, used + sizeof len, len);
+            JSON j(object);
+            if (!j.enterobject() || !readnode(&j, 0, PUTNODES_APP, nullptr, 0, false, dp))
+            {
+                LOG_err << "Parse error (spooled fetchnodes node)";
+                return false;
+            }
+            used += sizeof len + len;
+        }
+
+        if (pos == r.spoolSize)
+        {
+            break;
+        }
+
+        data.erase(0, used);
+        used = 0;
+
+        unsigned n = unsigned(std::min<m_off_t>(r.spoolSize - pos, m_off_t(TreeRefresh::SPOOL_BLOCK)));
+        size_t filled = data.size();
+        data.resize(filled + n);
+        if (!r.spool->frawread(reinterpret_cast<byte*>(&data[filled]), n, pos, true))
+        {
+            LOG_err << "Unable to read the spool of the reload";
+            return false;
+        }
+        pos += n;
+    }
+
+    setorphanparents(dp);
+
+    // the disk space is no longer needed, the digests are until the tree is current
+    r.spool.reset();
+    r.fsaccess->unlinklocal(r.spoolPath);
+    r.spoolPath = LocalPath();
+
+    return used == data.size();
+}
+
+bool MegaClient::endrefresh()
+{
+    if (!mTreeRefresh)
+    {
+        return false;
+    }
+
+    unique_ptr<TreeRefresh> refresh = std::move(mTreeRefresh);
+    size_t added = 0, updated = 0, removed = 0;
+
+    for (auto& it : nodes)
+    {
+        Node* n = it.second;
+        auto p = refresh->previous.find(n->nodehandle);
+        if (p == refresh->previous.end())
+        {
+            n->changed.newnode = true;
+            notifynode(n);
+            added++;
+            continue;
+        }
+
+        n->changed.parent = p->second.parenthandle != (n->parent ? n->parent->nodehandle : n->parenthandle);
+        n->changed.attrs = p->second.digest != nodedigest(*n);
+        if (n->changed.parent || n->changed.attrs)
+        {
+            notifynode(n);
+            updated++;
+        }
+        refresh->previous.erase(p);
+    }
+
+    // the ones gone are told as removed placeholders, deleted once notified
+    for (auto& p : refresh->previous)
+    {
+        if (p.second.type == FILENODE || p.second.type == FOLDERNODE)
+        {
+            node_vector dp;
+            Node* n = new Node(this, &dp, p.first, UNDEF, p.second.type, -1, UNDEF, nullptr, 0);
+            n->changed.removed = true;
+            notifynode(n);
+            removed++;
+        }
+    }
+
+    LOG_debug << "Tree refreshed: " << added << " new nodes, " << updated << " changed and " << removed << " removed";
+    return true;
+}
+
+void MegaClient::startScRecording(const LocalPath& path)
+{
+    LOG_info << "sc recording to " << path.toPath(*fsaccess) << " from the next response";
+    mScRecorder.reset(new ScRecorder(*fsaccess, path));
+}
+
+size_t MegaClient::stopScRecording()
+{
+    size_t responses = mScRecorder ? mScRecorder->responses() : 0;
+    mScRecorder.reset();
+    return responses;
+}
+
+void MegaClient::streamsc(HttpReq* req)
+{
+    httpio->lock();
+
+    const char* ptr = req->data();
+    const char* end = ptr + req->size();
+
+    if (mScStream == SCSTREAM_PENDING)
+    {
+        static const char prefix[] = "{\"a\":[";
+        const size_t len = sizeof prefix - 1;
+
+        size_t n = std::min(len, size_t(end - ptr));
+        if (memcmp(ptr, prefix, n))
+        {
+            // eg. an error or a keep-alive: processed once complete
+            mScStream = SCSTREAM_DISABLED;
+        }
+        else if (n == len)
+        {
+            LOG_debug << "Processing action packets while receiving them";
+            insca = true;
+            insca_notlast = false;
+            if (mScRecorder)
+            {
+                mScRecorder->begin(*this);
+                mScRecorder->append(ptr, len);
+            }
+            req->purge(len);
+            ptr += len;
+            mScStream = SCSTREAM_PACKETS;
+        }
+    }
 
-                        // do we have pending file attributes for this upload? set them.
-                        for (fa_map::iterator it = pendingfa.lower_bound(pair<UploadHandle, fatype>(uh, fatype(0)));
-                             it != pendingfa.end() && it->first.first == uh; )
-                        {
-                            reqs.add(new CommandAttachFA(this, h, it->first.second, it->second.first, it->second.second));
-                            pendingfa.erase(it++);
-                        }
+    if (mScStream == SCSTREAM_PACKETS)
+    {
+        // procsc() may have stopped at the end of the previous packet
+        const char* limit = ptr;
+        if (limit < end && *limit == '}')
+        {
+            limit++;
+        }
 
-                        // FIXME: only do this for in-flight FA writes
-                        uhnh.insert(pair<UploadHandle, NodeHandle>(uh, NodeHandle().set6byte(h)));
-                    }
-                }
+        for (;;)
+        {
+            const char* packet = limit < end && *limit == ',' ? limit + 1 : limit;
+            const char* packetend = JSON::objectend(packet, end);
+            if (!packetend || size_t(end - packetend) < SC_STREAM_LOOKAHEAD)
+            {
+                break;
             }
+            limit = packetend;
+        }
+
+        if (limit > ptr + 1)
+        {
+            jsonsc.begin(ptr);
+            mScStreamLimit = limit;
+
+            bool r = procsc();
 
-            if (notify)
+            if (mScRecorder)
             {
-                notifynode(n);
+                mScRecorder->append(ptr, size_t(jsonsc.pos - ptr));
             }
+            req->purge(size_t(jsonsc.pos - ptr));
+            jsonsc.pos = NULL;
+            mScStreamLimit = nullptr;
 
-            if (applykeys)
+#ifdef ENABLE_SYNC
+            if (!r)
             {
-                n->applykey();
+                // remote changes require immediate attention of syncdown()
+                // (notifynode() marked the folders they concern)
+                requestsyncdown(true);
+                syncactivity = true;
             }
+#else
+            (void)r;
+#endif
         }
     }
 
-    // any child nodes that arrived before their parents?
-    for (size_t i = dp.size(); i--; )
-    {
-        if ((n = nodebyhandle(dp[i]->parenthandle)))
-        {
-            dp[i]->setparent(n);
-        }
-    }
-
-    return j->leavearray();
+    httpio->unlock();
 }
 
 // decrypt and set encrypted sharekey
@@ -9187,6 +10781,22 @@ void MegaClient::procph(JSON *j)
     }
 }
 
+// length of the base64 key at k, RSA-encrypted if longer than a symmetric one
+static size_t nodekeylength(const char* k)
+{
+    const char* ptr = k;
+    while (*ptr && *ptr != '"' && *ptr != '/')
+    {
+        ptr++;
+    }
+    return size_t(ptr - k);
+}
+
+static bool isrsanodekey(const char* k)
+{
+    return nodekeylength(k) > 4 * FILENODEKEYLENGTH / 3 + 1;
+}
+
 void MegaClient::applykeys()
 {
     CodeCounter::ScopeTimer ccst(performanceStats.applyKeys);
@@ -9195,15 +10805,256 @@ void MegaClient::applykeys()
 
     if (nodes.size() > size_t(mAppliedKeyNodeCount + noKeyExpected))
     {
+        // collected first: share key lookups may load more nodes
+        node_vector pending;
+        pending.reserve(nodes.size());
         for (auto& it : nodes)
         {
-            it.second->applykey();
+            pending.push_back(it.second);
+        }
+
+        if (pending.size() < PARALLEL_APPLYKEYS_MIN)
+        {
+            // few nodes, but their RSA-encrypted keys may still be worth the worker threads
+            node_vector rsa;
+            for (Node* n : pending)
+            {
+                const char* k;
+                SymmCipher* sc;
+
+                if (n->keysource(&k, &sc) && isrsanodekey(k))
+                {
+                    rsa.push_back(n);
+                }
+                else
+                {
+                    n->applykey();
+                }
+            }
+
+            if (rsa.size() < PARALLEL_APPLYKEYS_RSA_MIN)
+            {
+                for (Node* n : rsa)
+                {
+                    n->applykey();
+                }
+            }
+            else
+            {
+                applykeysinparallel(rsa);
+            }
+        }
+        else
+        {
+            applykeysinparallel(pending);
         }
     }
 
     sendkeyrewrites();
 }
 
+// decrypt the node keys and the attributes on the worker threads, apply the results on this one, in order
+void MegaClient::applykeysinparallel(node_vector& pending)
+{
+    struct Job
+    {
+        Node* node;
+        const char* k;
+        size_t klength;
+        bool rsa;
+        byte cipherkey[SymmCipher::KEYLENGTH];
+        bool decrypted;
+        byte key[FILENODEKEYLENGTH];
+        bool attrsdecrypted;
+        attr_map attrs;
+    };
+
+    vector<Job> jobs;
+    jobs.reserve(pending.size());
+
+    for (Node* n : pending)
+    {
+        const char* k;
+        SymmCipher* sc;
+
+        if (!n->keysource(&k, &sc))
+        {
+            continue;
+        }
+
+        // oversized RSA keys are rejected by applykey()
+        size_t klength = nodekeylength(k);
+        bool rsa = isrsanodekey(k);
+        if (rsa && klength / 4 * 3 + 3 > 4096)
+        {
+            n->applykey();
+            continue;
+        }
+
+        jobs.emplace_back();
+        Job& job = jobs.back();
+        job.node = n;
+        job.k = k;
+        job.klength = klength;
+        job.rsa = rsa;
+        memcpy(job.cipherkey, sc->key, sizeof job.cipherkey);
+        job.decrypted = job.attrsdecrypted = false;
+    }
+
+    // batches of about the same cost: an RSA decryption weighs as much as many symmetric ones
+    vector<std::pair<Job*, Job*>> batches;
+    size_t weight = 0;
+    for (size_t i = 0, first = 0; i < jobs.size(); i++)
+    {
+        weight += jobs[i].rsa ? APPLYKEYS_RSA_WEIGHT : 1;
+        if (weight >= APPLYKEYS_BATCH || i + 1 == jobs.size())
+        {
+            batches.emplace_back(jobs.data() + first, jobs.data() + i + 1);
+            first = i + 1;
+            weight = 0;
+        }
+    }
+
+    std::mutex m;
+    std::condition_variable cv;
+    size_t remaining = batches.size();
+    AsymmCipher* rsakey = &asymkey;
+
+    for (auto& batch : batches)
+    {
+        Job* first = batch.first;
+        Job* last = batch.second;
+
+        mAsyncQueue.push([first, last, rsakey, &m, &cv, &remaining](SymmCipher& sc)
+        {
+            // sc decrypts the attributes, keycipher the node keys - mostly with the same (master) key
+            SymmCipher keycipher;
+            bool keyset = false;
+            vector<byte> rsabuf;
+
+            for (Job* job = first; job != last; job++)
+            {
+                int keylength = job->node->type == FILENODE ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH;
+
+                if (job->rsa)
+                {
+                    // only reads the private key, so the workers can share it
+                    rsabuf.resize(job->klength / 4 * 3 + 3);
+                    int l = Base64::atob(job->k, rsabuf.data(), int(rsabuf.size()));
+                    if (!rsakey->decrypt(rsabuf.data(), size_t(l), job->key, size_t(keylength)))
+                    {
+                        continue;
+                    }
+                }
+                else
+                {
+                    if (!keyset || memcmp(keycipher.key, job->cipherkey, sizeof job->cipherkey))
+                    {
+                        keycipher.setkey(job->cipherkey);
+                        keyset = true;
+                    }
+
+                    if (Base64::atob(job->k, job->key, keylength) != keylength)
+                    {
+                        continue;
+                    }
+
+                    keycipher.ecb_decrypt(job->key, keylength);
+                }
+                job->decrypted = true;
+
+                if (job->node->attrstring)
+                {
+                    sc.setkey(job->key, job->node->type);
+                    job->attrsdecrypted = Node::decryptattrs(&sc, *job->node->attrstring, &job->attrs);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> g(m);
+                --remaining;
+            }
+            cv.notify_all();
+        }, false, MegaClientAsyncQueue::PRIORITY_INTERACTIVE);   // this thread waits for it
+    }
+
+    {
+        std::unique_lock<std::mutex> g(m);
+        cv.wait(g, [&remaining]() { return !remaining; });
+    }
+
+    for (Job& job : jobs)
+    {
+        if (job.decrypted)
+        {
+            job.node->setdecryptedkey(job.key, job.attrsdecrypted ? &job.attrs : nullptr);
+
+            if (job.rsa)
+            {
+                // as decryptkey() does: update it on the server to save space & client CPU time
+                nodekeyrewrite.push_back(job.node->nodehandle);
+            }
+        }
+        else if (job.rsa)
+        {
+            LOG_warn << "Corrupt or invalid RSA node key";
+        }
+        else
+        {
+            LOG_warn << "Corrupt or invalid symmetric node key";
+        }
+    }
+}
+
+void MegaClient::queuesharekeys(handle share, handle_vector&& nodes)
+{
+    LOG_debug << "Sending " << nodes.size() << " more node keys for the share " << toNodeHandle(share);
+    pendingsharekeys.push_back(PendingShareKeys{ share, move(nodes), 0 });
+    sendsharekeys();
+}
+
+void MegaClient::sendsharekeys()
+{
+    while (!sharekeysinflight && !pendingsharekeys.empty())
+    {
+        PendingShareKeys& pending = pendingsharekeys.front();
+
+        // the share may be gone, and the nodes moved out of it or deleted, since
+        Node* sn = nodebyhandle(pending.share);
+        ShareNodeKeys snk;
+        bool any = false;
+
+        if (sn && sn->sharekey)
+        {
+            size_t end = std::min(pending.nodes.size(), pending.next + SHAREKEYS_BATCH);
+            for (; pending.next < end; pending.next++)
+            {
+                Node* n = nodebyhandle(pending.nodes[pending.next]);
+                if (n && n->keyApplied() && n->isbelow(sn))
+                {
+                    snk.add(n, sn, true);
+                    any = true;
+                }
+            }
+        }
+        else
+        {
+            pending.next = pending.nodes.size();
+        }
+
+        if (pending.next == pending.nodes.size())
+        {
+            pendingsharekeys.pop_front();
+        }
+
+        if (any)
+        {
+            sharekeysinflight = true;
+            reqs.add(new CommandPutShareKeys(this, snk));
+        }
+    }
+}
+
 void MegaClient::sendkeyrewrites()
 {
     if (sharekeyrewrite.size())
@@ -9788,6 +11639,29 @@ void MegaClient::killallsessions()
     reqs.add(new CommandKillSessions(this));
 }
 
+DbTable* MegaClient::openStateCacheTable(const string& name, int flags)
+{
+    if (mLinkBrowser)
+    {
+        return nullptr;
+    }
+
+    DbTable* table = dbaccess->open(rng, *fsaccess, name, flags);
+
+    if (table)
+    {
+        // timed where sqlite commits, on the writer thread if there is one
+        table->commitStats = &performanceStats.dbCommit;
+    }
+
+    if (table && mDbWriteBehind)
+    {
+        table = new AsyncDbTable(rng, DbTablePtr(table));
+    }
+
+    return table;
+}
+
 void MegaClient::opensctable()
 {
     // called from both login() and fetchnodes()
@@ -9795,6 +11669,9 @@ void MegaClient::opensctable()
     {
         string dbname;
 
+        // the master key of the session is known from here
+        loadtlssessions();
+
         if (sid.size() >= SIDLEN)
         {
             dbname.resize((SIDLEN - sizeof key.key) * 4 / 3 + 3);
@@ -9808,7 +11685,8 @@ void MegaClient::opensctable()
 
         if (dbname.size())
         {
-            sctable.reset(dbaccess->open(rng, *fsaccess, dbname));
+            CodeCounter::StartupProfile::Scope startup(startupProfile, CodeCounter::StartupProfile::PHASE_DB_OPEN);
+            sctable.reset(openStateCacheTable(dbname));
             pendingsccommit = false;
 
             if (sctable)
@@ -9817,6 +11695,16 @@ void MegaClient::opensctable()
                 // We only commit once we have an up to date SCSN and the table state matches it.
                 sctable->begin();
                 assert(sctable->inTransaction());
+
+                if (mKeepNodeSnapshot && mLazyNodeLoading)
+                {
+                    ostringstream snapshotname;
+                    snapshotname << "megaclient_nodes" << DbAccess::DB_VERSION << "_" << dbname << ".snapshot";
+
+                    LocalPath snapshotpath = dbaccess->rootPath();
+                    snapshotpath.appendWithSeparator(LocalPath::fromPath(snapshotname.str(), *fsaccess), false);
+                    mNodeSnapshot.reset(new NodeSnapshot(*fsaccess, snapshotpath));
+                }
             }
         }
     }
@@ -9847,7 +11735,7 @@ void MegaClient::doOpenStatusTable()
         {
             dbname.insert(0, "status_");
 
-            statusTable.reset(dbaccess->open(rng, *fsaccess, dbname));
+            statusTable.reset(openStateCacheTable(dbname, 0));
         }
     }
 }
@@ -10176,7 +12064,7 @@ void MegaClient::proctree(Node* n, TreeProc* tp, bool skipinshares, bool skipver
 {
     if (!skipversions || n->type != FILENODE)
     {
-        for (node_list::iterator it = n->children.begin(); it != n->children.end(); )
+        for (NodeChildren::iterator it = n->children.begin(); it != n->children.end(); )
         {
             Node *child = *it++;
             if (!(skipinshares && child->inshare))
@@ -10189,6 +12077,81 @@ void MegaClient::proctree(Node* n, TreeProc* tp, bool skipinshares, bool skipver
     tp->proc(this, n);
 }
 
+void MegaClient::proctreeParallel(Node* n, ParallelTreeProc* tp, bool skipinshares)
+{
+    // the workers must not load children from the local cache
+    loadAllCachedNodes();
+
+    NodeCounter nc = n->type == FILENODE ? NodeCounter() : n->descendantCounts();
+    if (nc.files + nc.folders + nc.versions < PROCTREE_PARALLEL_MIN)
+    {
+        proctree(n, tp, skipinshares);
+        return;
+    }
+
+    // break the biggest folders up until there are subtrees enough for the jobs to be even,
+    // the folders broken up being processed here
+    vector<Node*> subtrees(1, n);
+    for (size_t i = 0; i < subtrees.size() && subtrees.size() < PROCTREE_PARALLEL_JOBS * 4; )
+    {
+        Node* folder = subtrees[i];
+        if (folder->type == FILENODE)
+        {
+            i++;
+            continue;
+        }
+
+        subtrees.erase(subtrees.begin() + ptrdiff_t(i));
+        tp->proc(this, folder);
+        for (Node* child : folder->children)
+        {
+            if (!(skipinshares && child->inshare))
+            {
+                subtrees.push_back(child);
+            }
+        }
+    }
+
+    vector<std::unique_ptr<ParallelTreeProc>> forks;
+    size_t jobs = std::min(subtrees.size(), PROCTREE_PARALLEL_JOBS);
+    for (size_t i = 0; i < jobs; i++)
+    {
+        forks.push_back(tp->fork());
+    }
+
+    std::mutex m;
+    std::condition_variable cv;
+    size_t remaining = jobs;
+
+    for (size_t job = 0; job < jobs; job++)
+    {
+        ParallelTreeProc* fork = forks[job].get();
+        mAsyncQueue.push([this, &subtrees, job, jobs, fork, skipinshares, &m, &cv, &remaining](SymmCipher&)
+        {
+            for (size_t i = job; i < subtrees.size(); i += jobs)
+            {
+                proctree(subtrees[i], fork, skipinshares);
+            }
+
+            {
+                std::lock_guard<std::mutex> g(m);
+                --remaining;
+            }
+            cv.notify_all();
+        }, false, MegaClientAsyncQueue::PRIORITY_INTERACTIVE);   // this thread waits for it
+    }
+
+    {
+        std::unique_lock<std::mutex> g(m);
+        cv.wait(g, [&remaining]() { return !remaining; });
+    }
+
+    for (auto& fork : forks)
+    {
+        tp->merge(*fork);
+    }
+}
+
 // queue PubKeyAction request to be triggered upon availability of the user's
 // public key
 void MegaClient::queuepubkeyreq(User* u, std::unique_ptr<PubKeyAction> pka)
@@ -10591,7 +12554,7 @@ void MegaClient::getua(User* u, const attr_t at, int ctag)
                 return;
             }
         }
-        else
+        else if (!coalescegetua(u->uid, at, tag))
         {
             reqs.add(new CommandGetUA(this, u->uid.c_str(), at, NULL, tag, nullptr, nullptr, nullptr));
         }
@@ -10602,8 +12565,25 @@ void MegaClient::getua(const char *email_handle, const attr_t at, const char *ph
 {
     if (email_handle && at != ATTR_UNKNOWN)
     {
-        reqs.add(new CommandGetUA(this, email_handle, at, ph,(ctag != -1) ? ctag : reqtag, nullptr, nullptr, nullptr));
+        int tag = (ctag != -1) ? ctag : reqtag;
+        if ((ph && ph[0]) || !coalescegetua(email_handle, at, tag))
+        {
+            reqs.add(new CommandGetUA(this, email_handle, at, ph, tag, nullptr, nullptr, nullptr));
+        }
+    }
+}
+
+bool MegaClient::coalescegetua(const string& uid, attr_t at, int tag)
+{
+    auto it = mGetUAWaiters.emplace(std::make_pair(uid, at), vector<int>());
+    if (it.second)
+    {
+        return false;
     }
+
+    LOG_debug << "Retrieval of " << User::attr2string(at) << " of " << uid << " joined to the one in flight";
+    it.first->second.push_back(tag);
+    return true;
 }
 
 void MegaClient::getUserEmail(const char *uid)
@@ -10631,6 +12611,9 @@ void MegaClient::notifynode(Node* n)
 {
     n->applykey();
 
+    // paths through it may now resolve differently
+    mPathCache.invalidate(n->nodeHandle(), n->parent ? n->parent->nodeHandle() : NodeHandle(), n->displayname());
+
     if (!fetchingnodes)
     {
         if (n->tag && !n->changed.removed && n->attrstring)
@@ -10669,6 +12652,16 @@ void MegaClient::notifynode(Node* n)
         }
 
 #ifdef ENABLE_SYNC
+        // the synced folders this change concerns are due a visit from syncdown() and syncup()
+        if (n->localnode && n->localnode->parent)
+        {
+            n->localnode->parent->setsyncdirty();
+        }
+        if (n->parent && n->parent->localnode)
+        {
+            n->parent->localnode->setsyncdirty();
+        }
+
         // is this a synced node that was moved to a non-synced location? queue for
         // deletion from LocalNodes.
         if (n->localnode && n->localnode->parent && n->parent && !n->parent->localnode)
@@ -10743,13 +12736,39 @@ void MegaClient::notifynode(Node* n)
 }
 
 void MegaClient::transfercacheadd(Transfer *transfer, DBTableTransactionCommitter* committer)
+{
+    mTransferProgress.erase(transfer);
+
+    if (tctable && !transfer->skipserialization)
+    {
+        LOG_debug << "Caching transfer";
+        tctable->checkCommitter(committer);
+        tctable->put(MegaClient::CACHEDTRANSFER, transfer, &tckey);
+    }
+}
+
+void MegaClient::transfercacheprogress(Transfer* transfer)
 {
     if (tctable && !transfer->skipserialization)
     {
-        LOG_debug << "Caching transfer";
-        tctable->checkCommitter(committer);
-        tctable->put(MegaClient::CACHEDTRANSFER, transfer, &tckey);
+        mTransferProgress.insert(transfer);
+    }
+}
+
+void MegaClient::flushtransferprogress(DBTableTransactionCommitter& committer, bool force)
+{
+    if (mTransferProgress.empty() || (!force && Waiter::ds < mNextTransferProgressDs))
+    {
+        return;
+    }
+
+    set<Transfer*> transfers;
+    transfers.swap(mTransferProgress);
+    for (Transfer* t : transfers)
+    {
+        transfercacheadd(t, &committer);
     }
+    mNextTransferProgressDs = Waiter::ds + TRANSFER_PROGRESS_DS;
 }
 
 void MegaClient::transfercachedel(Transfer *transfer, DBTableTransactionCommitter* committer)
@@ -10989,6 +13008,10 @@ void MegaClient::procmcf(JSON *j)
                 {
                     j->enterarray();
 
+                    // swapped with those of the chats, so their buffers are reused from a chat to the next one
+                    string title;
+                    string unifiedKey;
+
                     while(j->enterobject())   // while there are more chats to read...
                     {
                         handle chatid = UNDEF;
@@ -10996,8 +13019,8 @@ void MegaClient::procmcf(JSON *j)
                         int shard = -1;
                         userpriv_vector *userpriv = NULL;
                         bool group = false;
-                        string title;
-                        string unifiedKey;
+                        title.clear();
+                        unifiedKey.clear();
                         m_time_t ts = -1;
                         bool publicchat = false;
                         bool meeting = false;
@@ -11053,26 +13076,27 @@ void MegaClient::procmcf(JSON *j)
                             case EOO:
                                 if (chatid != UNDEF && priv != PRIV_UNKNOWN && shard != -1)
                                 {
-                                    if (chats.find(chatid) == chats.end())
+                                    TextChat*& slot = chats[chatid];
+                                    if (!slot)
                                     {
-                                        chats[chatid] = new TextChat();
+                                        slot = new TextChat();
                                     }
 
-                                    TextChat *chat = chats[chatid];
+                                    TextChat *chat = slot;
                                     chat->id = chatid;
                                     chat->priv = priv;
                                     chat->shard = shard;
                                     chat->group = group;
-                                    chat->title = title;
+                                    chat->title.swap(title);
                                     chat->ts = (ts != -1) ? ts : 0;
                                     chat->meeting = meeting;
 
                                     if (readingPublicChats)
                                     {
                                         chat->publicchat = publicchat;  // true or false (formerly public, now private)
-                                        chat->unifiedKey = unifiedKey;
+                                        chat->unifiedKey.swap(unifiedKey);
 
-                                        if (unifiedKey.empty())
+                                        if (chat->unifiedKey.empty())
                                         {
                                             LOG_err << "Received public (or formerly public) chat without unified key";
                                         }
@@ -11221,6 +13245,9 @@ void MegaClient::procmcna(JSON *j)
 {
     if (j->enterarray())
     {
+        // the nodes come grouped by chat
+        TextChat* chat = nullptr;
+
         while(j->enterobject())   // while there are more nodes to read...
         {
             handle chatid = UNDEF;
@@ -11247,14 +13274,19 @@ void MegaClient::procmcna(JSON *j)
                 case EOO:
                     if (chatid != UNDEF && h != UNDEF && uh != UNDEF)
                     {
-                        textchat_map::iterator it = chats.find(chatid);
-                        if (it == chats.end())
+                        if (!chat || chat->id != chatid)
+                        {
+                            textchat_map::iterator it = chats.find(chatid);
+                            chat = it != chats.end() ? it->second : nullptr;
+                        }
+
+                        if (!chat)
                         {
                             LOG_err << "Unknown chat for user/node access to attachment";
                         }
                         else
                         {
-                            it->second->setNodeUserAccess(h, uh);
+                            chat->setNodeUserAccess(h, uh);
                         }
                     }
                     else
@@ -12045,6 +14077,7 @@ void MegaClient::setkeypair()
 
 bool MegaClient::fetchsc(DbTable* sctable)
 {
+    CodeCounter::StartupProfile::Scope startup(startupProfile, CodeCounter::StartupProfile::PHASE_FETCHSC);
     uint32_t id;
     string data;
     Node* n;
@@ -12054,7 +14087,20 @@ bool MegaClient::fetchsc(DbTable* sctable)
 
     LOG_info << "Loading session from local cache";
 
-    sctable->rewind();
+    mCachedNodeIndex.reset(mLazyNodeLoading ? new CachedNodeIndex : nullptr);
+
+    // with a snapshot at the SCSN of the cache, the node records don't need to be read at all
+    bool fromSnapshot = mCachedNodeIndex && mNodeSnapshot && mNodeSnapshot->read(cachedscsn, *mCachedNodeIndex);
+    if (fromSnapshot)
+    {
+        LOG_info << "Node records from snapshot: " << mCachedNodeIndex->size();
+        sctable->rewindNonNodes();
+    }
+    else
+    {
+        mCachedNodeIndex.reset(mLazyNodeLoading ? new CachedNodeIndex : nullptr);
+        sctable->rewind();
+    }
 
     bool hasNext = sctable->next(&id, &data, &key);
     WAIT_CLASS::bumpds();
@@ -12071,8 +14117,38 @@ bool MegaClient::fetchsc(DbTable* sctable)
                 }
                 break;
 
+            case CACHEDKEYSIGNATURES:
+                // verified again if it can't be read
+                if (data.size() % KEY_SIGNATURE_DIGEST_LENGTH == 0)
+                {
+                    for (size_t i = 0; i < data.size(); i += KEY_SIGNATURE_DIGEST_LENGTH)
+                    {
+                        mVerifiedKeySignatures.insert(data.substr(i, KEY_SIGNATURE_DIGEST_LENGTH));
+                    }
+                }
+                break;
+
             case CACHEDNODE:
-                if ((n = Node::unserialize(this, &data, &dp)))
+                if (fromSnapshot)
+                {
+                    // already in the index
+                }
+                else if (mCachedNodeIndex)
+                {
+                    handle h, ph;
+                    nodetype_t t;
+                    m_off_t s;
+
+                    if (!Node::unserializeHeader(&data, &h, &ph, &t, &s))
+                    {
+                        LOG_err << "Failed - node record header read error";
+                        mCachedNodeIndex.reset();
+                        return false;
+                    }
+
+                    mCachedNodeIndex->add(h, ph, t, t == FILENODE ? s : 0, id);
+                }
+                else if ((n = Node::unserialize(this, &data, &dp)))
                 {
                     n->dbid = id;
                 }
@@ -12115,6 +14191,7 @@ bool MegaClient::fetchsc(DbTable* sctable)
                     if ((chat = TextChat::unserialize(this, &data)))
                     {
                         chat->dbid = id;
+                        chat->dbhash = std::hash<string>()(data);
                     }
                     else
                     {
@@ -12128,6 +14205,32 @@ bool MegaClient::fetchsc(DbTable* sctable)
         hasNext = sctable->next(&id, &data, &key);
     }
 
+    if (mCachedNodeIndex)
+    {
+        mCachedNodeIndex->finalize();
+
+        // load the roots, inshares and any orphans now: everything else hangs off them
+        mLoadingCachedNodes = true;
+        for (auto& r : *mCachedNodeIndex)
+        {
+            if (!mCachedNodeIndex->find(r.parent) && !loadCachedRecord(r, &dp))
+            {
+                mLoadingCachedNodes = false;
+                mCachedNodeIndex.reset();
+
+                if (fromSnapshot)
+                {
+                    // out of step with the cache: don't use it again
+                    mNodeSnapshot->remove();
+                }
+                return false;
+            }
+        }
+        mLoadingCachedNodes = false;
+
+        LOG_info << "Nodes in local cache: " << mCachedNodeIndex->size() << ", loaded: " << mCachedNodeIndex->loadedCount();
+    }
+
     WAIT_CLASS::bumpds();
     fnstats.timeToLastByte = Waiter::ds - fnstats.startTime;
 
@@ -12142,7 +14245,388 @@ bool MegaClient::fetchsc(DbTable* sctable)
 
     mergenewshares(0);
 
-    return true;
+    if (mCachedNodeIndex)
+    {
+        // with the subtrees still in the cache, the counters can't build up as nodes are attached
+        for (handle rh : rootnodes)
+        {
+            if (Node* root = nodebyhandle(rh))
+            {
+                mNodeCounters[rh] = root->subnodeCounts();
+            }
+        }
+    }
+
+    return true;
+}
+
+Node* MegaClient::loadCachedRecord(CachedNodeIndex::Record& r, node_vector* dp)
+{
+    mCachedNodeIndex->markLoaded(r);
+
+    auto it = nodes.find(NodeHandle().set6byte(r.h));
+    if (it != nodes.end())
+    {
+        return it->second;
+    }
+
+    string data;
+    Node* n;
+    if (!sctable || !sctable->get(r.dbid, &data, &key) || !(n = Node::unserialize(this, &data, dp)))
+    {
+        LOG_err << "Failed - node record read error: " << toNodeHandle(r.h);
+        return nullptr;
+    }
+
+    n->dbid = r.dbid;
+    if (mCachedNodeIndex->hasChildren(n->nodehandle))
+    {
+        n->children.setPending();
+    }
+    return n;
+}
+
+void MegaClient::loadCachedChildren(Node* parent)
+{
+    if (!mCachedNodeIndex || !sctable)
+    {
+        return;
+    }
+
+    bool wasLoading = mLoadingCachedNodes;
+    mLoadingCachedNodes = true;
+
+    // shares met while loading are merged right away, without touching those still to be processed by the caller
+    newshare_list queuedshares;
+    queuedshares.swap(newshares);
+
+    node_vector dp;
+    auto range = mCachedNodeIndex->children(parent->nodehandle);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (!it->loaded)
+        {
+            loadCachedRecord(*it, &dp);
+        }
+    }
+
+    mergenewshares(0);
+    newshares.swap(queuedshares);
+
+    mLoadingCachedNodes = wasLoading;
+}
+
+Node* MegaClient::loadCachedNode(handle h)
+{
+    if (!mCachedNodeIndex || mLoadingCachedNodes || !sctable)
+    {
+        return nullptr;
+    }
+
+    CachedNodeIndex::Record* r = mCachedNodeIndex->find(h);
+    if (!r || r->loaded)
+    {
+        return nullptr;
+    }
+
+    auto resident = [this](handle nh) -> Node*
+    {
+        auto it = nodes.find(NodeHandle().set6byte(nh));
+        return it != nodes.end() ? it->second : nullptr;
+    };
+
+    // climb to the closest ancestor in memory, then load the path down from it
+    handle_vector path(1, h);
+    Node* n;
+    while (!(n = resident(r->parent)))
+    {
+        if (!(r = mCachedNodeIndex->find(r->parent)) || path.size() > mCachedNodeIndex->size())
+        {
+            return nullptr;
+        }
+        path.push_back(r->h);
+    }
+
+    while (n && !path.empty())
+    {
+        n->children.load();
+        n = resident(path.back());
+        path.pop_back();
+    }
+    return n;
+}
+
+bool MegaClient::setLargeAccountMode(bool enable)
+{
+    if (sctable)
+    {
+        LOG_warn << "The large account mode can't change with the local cache open";
+        return false;
+    }
+
+    mLazyNodeLoading = enable;
+    mKeepNodeSnapshot = enable;
+    LOG_info << "Large account mode " << (enable ? "enabled" : "disabled");
+    return true;
+}
+
+void MegaClient::loadAllCachedNodes()
+{
+    if (!mCachedNodeIndex)
+    {
+        return;
+    }
+
+    LOG_debug << "Loading all nodes from local cache: " << mCachedNodeIndex->size() - mCachedNodeIndex->loadedCount() << " pending";
+
+    node_vector pending;
+    for (auto& e : nodes)
+    {
+        if (e.second->children.pending())
+        {
+            pending.push_back(e.second);
+        }
+    }
+
+    while (!pending.empty())
+    {
+        Node* n = pending.back();
+        pending.pop_back();
+
+        for (Node* child : n->children)
+        {
+            if (child->children.pending())
+            {
+                pending.push_back(child);
+            }
+        }
+    }
+
+    mCachedNodeIndex.reset();
+}
+
+size_t MegaClient::trimmemory(int level)
+{
+    size_t streaming = 0;
+    for (auto& it : hdrns)
+    {
+        DirectReadCache& cache = it.second->cache;
+        streaming += cache.trim(level >= TRIM_CRITICAL ? 0 : cache.memoryUsed() / 2);
+    }
+
+    size_t alerts = useralerts.trim(level >= TRIM_CRITICAL ? TRIM_ALERTS_KEPT : useralerts.alerts.size() / 2);
+    size_t buffers = reqs.trimbuffers();
+
+    size_t db = 0;
+    for (DbTable* table : { sctable.get(), tctable.get(), statusTable.get() })
+    {
+        if (table)
+        {
+            db += table->releaseMemory();
+        }
+    }
+#ifdef ENABLE_SYNC
+    syncs.forEachRunningSync([&](Sync* sync)
+    {
+        if (sync->statecachetable)
+        {
+            db += sync->statecachetable->releaseMemory();
+        }
+    });
+#endif
+
+    LOG_info << "Memory trimmed (level " << level << "): streaming caches " << streaming << ", user alerts " << alerts
+             << ", response buffers " << buffers << ", databases " << db << " bytes";
+
+    return streaming + alerts + buffers + db;
+}
+
+void MegaClient::unloadCachedVersions()
+{
+    // only right after the whole tree was written, when nothing is left in the cache only
+    if (!mLazyNodeLoading || mCachedNodeIndex || !sctable)
+    {
+        return;
+    }
+
+    // versions that something still refers to stay, along with the rest of their chain
+    auto pinned = [this](Node* v)
+    {
+        return !v->dbid || v->notified || v->changed.removed || v->plink || v->appdata
+                || v->outshares || v->pendingshares || hdrns.count(v->nodehandle)
+#ifdef ENABLE_SYNC
+                || v->localnode || v->syncget
+#endif
+                ;
+    };
+
+    node_vector files;
+    for (auto& e : nodes)
+    {
+        Node* n = e.second;
+        if (n->type == FILENODE && n->children.any() && (!n->parent || n->parent->type != FILENODE))
+        {
+            files.push_back(n);
+        }
+    }
+
+    unique_ptr<CachedNodeIndex> index(new CachedNodeIndex);
+    node_vector versions;
+    size_t unloaded = 0;
+
+    for (Node* n : files)
+    {
+        // parents first
+        versions.assign(n->children.begin(), n->children.end());
+        bool keep = false;
+        for (size_t i = 0; i < versions.size() && !keep; ++i)
+        {
+            Node* v = versions[i];
+            keep = pinned(v);
+            versions.insert(versions.end(), v->children.begin(), v->children.end());
+        }
+
+        if (keep)
+        {
+            continue;
+        }
+
+        for (Node* v : versions)
+        {
+            index->add(v->nodehandle, v->parent->nodehandle, v->type, v->size, v->dbid);
+        }
+
+        // bottom up, and detached first: the counts kept by the ancestors still include them
+        for (auto it = versions.rbegin(); it != versions.rend(); ++it)
+        {
+            Node* v = *it;
+            v->parent->children.remove(v);
+            v->parent = nullptr;
+            nodes.erase(v->nodeHandle());
+            delete v;
+        }
+
+        n->children.setPending();
+        unloaded += versions.size();
+    }
+
+    if (unloaded)
+    {
+        index->finalize();
+        mCachedNodeIndex = std::move(index);
+
+        LOG_debug << "Older versions left in the local cache: " << unloaded << " of " << files.size() << " files";
+    }
+}
+
+NodeNameIndex& MegaClient::nodeNames()
+{
+    if (!mNodeNames.built)
+    {
+        loadAllCachedNodes();
+
+        LOG_debug << "Indexing the names of " << nodes.size() << " nodes";
+        mNodeNames.built = true;
+        for (auto& e : nodes)
+        {
+            indexnodename(e.second);
+        }
+    }
+
+    return mNodeNames;
+}
+
+NodeTypeIndex& MegaClient::nodeTypes()
+{
+    if (!mNodeTypes.built)
+    {
+        loadAllCachedNodes();
+
+        LOG_debug << "Indexing the types of " << nodes.size() << " nodes";
+        mNodeTypes.built = true;
+        for (auto& e : nodes)
+        {
+            indexnodetype(e.second);
+        }
+    }
+
+    return mNodeTypes;
+}
+
+void MegaClient::indexnodetype(Node* n)
+{
+    if (!mNodeTypes.built || n->type != FILENODE)
+    {
+        return;
+    }
+
+    // in the order of MegaApi::FILE_TYPE_*
+    unsigned types = 0;
+    if (!n->attrstring)
+    {
+        types |= unsigned(nodeIsPhoto(n, false)) << 1;
+        types |= unsigned(nodeIsAudio(n)) << 2;
+        types |= unsigned(nodeIsVideo(n)) << 3;
+        types |= unsigned(nodeIsDocument(n)) << 4;
+    }
+    mNodeTypes.set(n->nodehandle, types);
+}
+
+void MegaClient::indexnodename(Node* n)
+{
+    // the types follow from the name
+    indexnodetype(n);
+
+    if (!mNodeNames.built || n->type > FOLDERNODE)
+    {
+        return;
+    }
+
+    // (displayname() logs the undecryptable ones)
+    n->nameslot = mNodeNames.set(n->nameslot, n->nodehandle, n->attrstring ? "NO_KEY" : n->displayname());
+}
+
+void MegaClient::loadCachedNodesByFingerprint(const FileFingerprint& fingerprint)
+{
+    if (!mCachedNodeIndex || !fingerprint.isvalid)
+    {
+        return;
+    }
+
+    string fp;
+    fingerprint.serializefingerprint(&fp);
+
+    handle_vector handles;
+    if (!sctable || !sctable->getNodeHandlesByFingerprint(fp, fingerprint.size, &handles))
+    {
+        loadAllCachedNodes();
+        return;
+    }
+
+    for (handle h : handles)
+    {
+        nodebyhandle(h);
+    }
+}
+
+void MegaClient::loadCachedRecentFiles(m_time_t since)
+{
+    if (!mCachedNodeIndex)
+    {
+        return;
+    }
+
+    handle_vector handles;
+    if (!sctable || !sctable->getRecentFileHandles(since, &handles))
+    {
+        loadAllCachedNodes();
+        return;
+    }
+
+    for (handle h : handles)
+    {
+        nodebyhandle(h);
+    }
 }
 
 
@@ -12229,6 +14713,7 @@ void MegaClient::closetc(bool remove)
     pendingtcids.clear();
     cachedfiles.clear();
     cachedfilesdbids.clear();
+    mChunkIndexDbids.clear();
 
     if (remove && tctable)
     {
@@ -12270,7 +14755,7 @@ void MegaClient::enabletransferresumption(const char *loggedoutid)
 
     dbname.insert(0, "transfers_");
 
-    tctable.reset(dbaccess->open(rng, *fsaccess, dbname, DB_OPEN_FLAG_RECYCLE | DB_OPEN_FLAG_TRANSACTED));
+    tctable.reset(openStateCacheTable(dbname, DB_OPEN_FLAG_RECYCLE | DB_OPEN_FLAG_TRANSACTED));
     if (!tctable)
     {
         return;
@@ -12307,6 +14792,18 @@ void MegaClient::enabletransferresumption(const char *loggedoutid)
                 cachedfilesdbids.push_back(id);
                 LOG_debug << "Cached file loaded";
                 break;
+            case CACHEDCHUNKINDEX:
+                // only the key is kept, the chunks are read when needed
+                if (auto index = ChunkIndex::unserialize(data))
+                {
+                    mChunkIndexDbids[ChunkIndex::key(index->fingerprint)] = id;
+                }
+                else
+                {
+                    tctable->del(id);
+                    LOG_err << "Failed - chunk index record read error";
+                }
+                break;
         }
     }
 
@@ -12364,7 +14861,7 @@ void MegaClient::disabletransferresumption(const char *loggedoutid)
     }
     dbname.insert(0, "transfers_");
 
-    tctable.reset(dbaccess->open(rng, *fsaccess, dbname, DB_OPEN_FLAG_RECYCLE | DB_OPEN_FLAG_TRANSACTED));
+    tctable.reset(openStateCacheTable(dbname, DB_OPEN_FLAG_RECYCLE | DB_OPEN_FLAG_TRANSACTED));
     if (!tctable)
     {
         return;
@@ -12374,6 +14871,40 @@ void MegaClient::disabletransferresumption(const char *loggedoutid)
     closetc(true);
 }
 
+bool MegaClient::postcs()
+{
+    // everything completed while the previous request was in flight goes in this one
+    sendUploadPutnodes();
+
+    if (!reqs.cmdspending())
+    {
+        return false;
+    }
+
+    abortlockrequest();
+    pendingcs = new HttpReq();
+    pendingcs->protect = true;
+    pendingcs->logname = clientname + "cs ";
+    pendingcs_serverBusySent = false;
+
+    bool suppressSID = true;
+    reqs.serverrequest(pendingcs->out, suppressSID, pendingcs->includesFetchingNodes);
+
+    mFetchNodesStream.reset();
+    if (pendingcs->includesFetchingNodes && mStreamFetchNodes)
+    {
+        mFetchNodesStream = mega::make_unique<FetchNodesStream>();
+        pendingcs->incremental = true;
+    }
+
+    pendingcs->posturl = getcsurl(reqid, sizeof reqid, suppressSID);
+    pendingcs->type = REQ_JSON;
+
+    performanceStats.csRequestWaitTime.start();
+    pendingcs->post(this);
+    return true;
+}
+
 void MegaClient::fetchnodes(bool nocache)
 {
     if (fetchingnodes)
@@ -12383,6 +14914,7 @@ void MegaClient::fetchnodes(bool nocache)
 
     WAIT_CLASS::bumpds();
     fnstats.init();
+    startupProfile.begin(CodeCounter::StartupProfile::PHASE_FETCHNODES);
     if (sid.size() >= SIDLEN)
     {
         fnstats.type = FetchNodesStats::TYPE_ACCOUNT;
@@ -12397,19 +14929,47 @@ void MegaClient::fetchnodes(bool nocache)
     if (sctable && cachedscsn == UNDEF)
     {
         sctable->truncate();
+
+        if (mNodeSnapshot)
+        {
+            mNodeSnapshot->remove();
+        }
+    }
+
+    bool fromcache = (loggedin() == FULLACCOUNT || loggedIntoFolder() || loggedin() == EPHEMERALACCOUNTPLUSPLUS) &&
+            !nodes.size() && !ISUNDEF(cachedscsn) && sctable;
+
+    // Both ways need the user data.  When the cache is going to be read, the ug request goes out first, so that
+    // its round trip overlaps the load.  What follows its completion depends on whether the load succeeds.
+    auto userdataStart = std::chrono::high_resolution_clock::now();
+    std::shared_ptr<std::function<void(error)>> userdataNext;
+    if (fromcache && !loggedIntoFolder() && !loggedinfolderlink())
+    {
+        userdataNext = std::make_shared<std::function<void(error)>>();
+        getuserdata(0, [userdataNext](string*, string*, string*, error e)
+        {
+            if (*userdataNext)
+            {
+                (*userdataNext)(e);
+            }
+        });
+
+        if (!pendingcs && btcs.armed() && postcs())
+        {
+            httpio->doio();
+        }
     }
 
     // only initial load from local cache
-    if ((loggedin() == FULLACCOUNT || loggedIntoFolder() || loggedin() == EPHEMERALACCOUNTPLUSPLUS) &&
-            !nodes.size() && !ISUNDEF(cachedscsn) &&
-            sctable && fetchsc(sctable.get()))
+    if (fromcache && fetchsc(sctable.get()))
     {
         // Copy the current tag (the one from fetch nodes) so we can capture it in the lambda below.
         // ensuring no new request happens in between
         auto fetchnodesTag = reqtag;
-        auto onuserdataCompletion = [this, fetchnodesTag](string*, string*, string*, error e) {
+        auto onuserdataCompletion = [this, fetchnodesTag, userdataStart](string*, string*, string*, error e) {
 
             restag = fetchnodesTag;
+            startupProfile.record(CodeCounter::StartupProfile::PHASE_USERDATA, userdataStart, std::chrono::high_resolution_clock::now());
 
             // upon ug completion
             if (e != API_OK)
@@ -12460,7 +15020,11 @@ void MegaClient::fetchnodes(bool nocache)
         };
 
 
-        if (!loggedIntoFolder())
+        if (userdataNext)
+        {
+            *userdataNext = [onuserdataCompletion](error e) { onuserdataCompletion(nullptr, nullptr, nullptr, e); };
+        }
+        else if (!loggedIntoFolder())
         {
             getuserdata(0, onuserdataCompletion);
         }
@@ -12471,6 +15035,9 @@ void MegaClient::fetchnodes(bool nocache)
     }
     else if (!fetchingnodes)
     {
+        // a tree in memory is a reload: kept until the new one is received
+        beginrefresh();
+
         fnstats.mode = FetchNodesStats::MODE_API;
         fnstats.cache = nocache ? FetchNodesStats::API_NO_CACHE : FetchNodesStats::API_CACHE;
         fetchingnodes = true;
@@ -12504,7 +15071,7 @@ void MegaClient::fetchnodes(bool nocache)
             // Copy the current tag so we can capture it in the lambda below.
             const auto fetchtag = reqtag;
 
-            getuserdata(0, [this, fetchtag, nocache](string*, string*, string*, error e){
+            auto onuserdataCompletion = [this, fetchtag, nocache](string*, string*, string*, error e){
 
                 if (e != API_OK)
                 {
@@ -12517,7 +15084,17 @@ void MegaClient::fetchnodes(bool nocache)
                 // FetchNodes procresult() needs some data from `ug` (or it may try to make new Sync User Attributes for example)
                 // So only submit the request after `ug` completes, otherwise everything is interleaved
                 reqs.add(new CommandFetchNodes(this, fetchtag, nocache));
-            });
+            };
+
+            if (userdataNext)
+            {
+                // requested before the cache failed to load
+                *userdataNext = [onuserdataCompletion](error e) { onuserdataCompletion(nullptr, nullptr, nullptr, e); };
+            }
+            else
+            {
+                getuserdata(0, onuserdataCompletion);
+            }
 
             if (loggedin() == FULLACCOUNT
                     || loggedin() == EPHEMERALACCOUNTPLUSPLUS)  // need to create early the chat and sign keys
@@ -12630,10 +15207,7 @@ void MegaClient::initializekeys()
 
         // Verify signatures for Cu25519
         if (!sigCu255.size() ||
-                !EdDSA::verifyKey((unsigned char*) puCu255.data(),
-                                    puCu255.size(),
-                                    &sigCu255,
-                                    (unsigned char*) puEd255.data()))
+                !verifykeysignature(puCu255, sigCu255, puEd255))
         {
             LOG_warn << "Signature of public key for Cu25519 not found or mismatch";
 
@@ -12682,10 +15256,7 @@ void MegaClient::initializekeys()
                 return;
             }
 
-            if (!EdDSA::verifyKey((unsigned char*) pubkstr.data(),
-                                        pubkstr.size(),
-                                        &sigPubk,
-                                        (unsigned char*) puEd255.data()))
+            if (!verifykeysignature(pubkstr, sigPubk, puEd255))
             {
                 LOG_warn << "Verification of signature of public key for RSA failed";
 
@@ -12985,6 +15556,41 @@ error MegaClient::trackKey(attr_t keyType, handle uh, const std::string &pubKey)
     return API_OK;
 }
 
+bool MegaClient::verifykeysignature(const string& pubKey, const string& signature, const string& signingPubKey)
+{
+    if (signingPubKey.size() != EdDSA::PUBLIC_KEY_LENGTH)
+    {
+        return false;
+    }
+
+    HashSHA256 hash;
+    string digest;
+    hash.add((const byte*)signingPubKey.data(), unsigned(signingPubKey.size()));
+    hash.add((const byte*)signature.data(), unsigned(signature.size()));
+    hash.add((const byte*)pubKey.data(), unsigned(pubKey.size()));
+    hash.get(&digest);
+    digest.resize(KEY_SIGNATURE_DIGEST_LENGTH);
+
+    if (mVerifiedKeySignatures.count(digest))
+    {
+        return true;
+    }
+
+    if (!EdDSA::verifyKey((const unsigned char*)pubKey.data(), pubKey.size(), &signature, (const unsigned char*)signingPubKey.data()))
+    {
+        return false;
+    }
+
+    // those of former contacts are only dropped all at once
+    if (mVerifiedKeySignatures.size() >= MAX_VERIFIED_KEY_SIGNATURES)
+    {
+        mVerifiedKeySignatures.clear();
+    }
+    mVerifiedKeySignatures.insert(digest);
+    mVerifiedKeySignaturesDirty = true;
+    return true;
+}
+
 error MegaClient::trackSignature(attr_t signatureType, handle uh, const std::string &signature)
 {
     User *user = finduser(uh);
@@ -13072,7 +15678,7 @@ error MegaClient::trackSignature(attr_t signatureType, handle uh, const std::str
     bool keyTracked = authring->isTracked(uh);
 
     // check signature for the public key
-    bool signatureVerified = EdDSA::verifyKey((unsigned char*) pubKey->data(), pubKey->size(), (string*)&signature, (unsigned char*) signingPubKey->data());
+    bool signatureVerified = verifykeysignature(*pubKey, signature, *signingPubKey);
     if (signatureVerified)
     {
         LOG_debug << "Signature " << User::attr2string(signatureType) << " succesfully verified for user " << user->uid;
@@ -13258,12 +15864,18 @@ void MegaClient::purgenodesusersabortsc(bool keepOwnUser)
 
     mOptimizePurgeNodes = true;
     mFingerprints.clear();
+    mNodeNames.clear();
     mNodeCounters.clear();
+    mNodeTypes.clear();
+    mPathCache.clear();
+    mRecentFiles.clear();
+    mRecentFilesLoadedSince = std::numeric_limits<m_time_t>::max();
     for (node_map::iterator it = nodes.begin(); it != nodes.end(); it++)
     {
         delete it->second;
     }
     nodes.clear();
+    mCachedNodeIndex.reset();
     mOptimizePurgeNodes = false;
 
 #ifdef ENABLE_SYNC
@@ -13283,6 +15895,8 @@ void MegaClient::purgenodesusersabortsc(bool keepOwnUser)
 
             cit->second->fafs[i].clear();
         }
+
+        cit->second->decryptions.clear();
     }
 
     for (newshare_list::iterator it = newshares.begin(); it != newshares.end(); it++)
@@ -13437,7 +16051,7 @@ void MegaClient::abortreads(handle h, bool p, m_off_t offset, m_off_t count)
 
         for (dr_list::iterator it = drn->reads.begin(); it != drn->reads.end(); )
         {
-            if ((offset < 0 || offset == (*it)->offset) && (count < 0 || count == (*it)->count))
+            if (!(*it)->readahead && (offset < 0 || offset == (*it)->offset) && (count < 0 || count == (*it)->count))
             {
                 app->pread_failure(API_EINCOMPLETE, (*it)->drn->retries, (*it)->appdata, 0);
 
@@ -13459,12 +16073,30 @@ bool MegaClient::execdirectreads()
     if (drq.size() < MAXDRSLOTS)
     {
         // fill slots
-        for (dr_list::iterator it = drq.begin(); it != drq.end(); it++)
+        for (dr_list::iterator it = drq.begin(); it != drq.end(); )
         {
-            if (!(*it)->drs)
+            DirectRead* dr = *(it++);
+            if (!dr->drs)
             {
-                drs = new DirectReadSlot(*it);
-                (*it)->drs = drs;
+                if (dr->drbuf.tempUrlVector().empty())
+                {
+                    // starting: only what isn't cached is downloaded
+                    if (!dr->drn->servefromcache(dr))
+                    {
+                        r = true;
+                        continue;
+                    }
+
+                    if (!dr->readahead && dr->drn->readaheadcovers(dr->offset + dr->progress))
+                    {
+                        // the data is on its way to the cache, faster than a new request
+                        continue;
+                    }
+                    dr->drbuf.setIsRaid(dr->drn->tempurls, dr->offset + dr->progress, dr->offset + dr->count, dr->drn->size, 2097152);  // 2 MB max buffer usage approx for streaming
+                }
+
+                drs = new DirectReadSlot(dr);
+                dr->drs = drs;
                 r = true;
 
                 if (drq.size() >= MAXDRSLOTS) break;
@@ -14090,6 +16722,13 @@ void MegaClient::addchild(remotenode_map* nchildren, string* name, Node* n, list
     }
 }
 
+void MegaClient::requestsyncdown(bool dirtyonly)
+{
+    // a pending full pass stays a full pass
+    syncdowndirtyonly = dirtyonly && (!syncdownrequired || syncdowndirtyonly);
+    syncdownrequired = true;
+}
+
 // downward sync - recursively scan for tree differences and execute them locally
 // this is first called after the local node tree is complete
 // actions taken:
@@ -14099,13 +16738,16 @@ void MegaClient::addchild(remotenode_map* nchildren, string* name, Node* n, list
 // * attempt to execute renames, moves and deletions (deletions require the
 // rubbish flag to be set)
 // returns false if any local fs op failed transiently
-bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath)
+bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath, bool dirtyonly)
 {
     static const dstime MONITOR_DELAY_SEC = 5;
 
+    CodeCounter::ScopeTimer ccst(performanceStats.syncdown);
+
     SyncdownContext cxt;
 
     cxt.mActionsPerformed = false;
+    cxt.mDirtyOnly = dirtyonly;
 
     if (!syncdown(l, localpath, cxt))
     {
@@ -14158,6 +16800,13 @@ bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath, SyncdownContext& c
         return true;
     }
 
+    // nothing changed in this subtree since it was last visited
+    if (cxt.mDirtyOnly && !l->syncdowndirty)
+    {
+        return true;
+    }
+    l->syncdowndirty = false;
+
     list<string> strings;
     remotenode_map nchildren;
     remotenode_map::iterator rit;
@@ -14169,7 +16818,7 @@ bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath, SyncdownContext& c
     string localname;
 
     // build child hash - nameclash resolution: use newest/largest version
-    for (node_list::iterator it = l->node->children.begin(); it != l->node->children.end(); it++)
+    for (NodeChildren::iterator it = l->node->children.begin(); it != l->node->children.end(); it++)
     {
         attr_map::iterator ait;
 
@@ -14597,6 +17246,12 @@ bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath, SyncdownContext& c
         }
     }
 
+    // try again on the next pass
+    if (!success)
+    {
+        l->setsyncdowndirty();
+    }
+
     return success;
 }
 
@@ -14608,10 +17263,21 @@ bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath, SyncdownContext& c
 // if attached to an existing node
 // l and n are assumed to be folders and existing on both sides or scheduled
 // for creation
-bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
+bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending, bool dirtyonly)
 {
+    // nothing changed in this subtree since it was last visited
+    if (dirtyonly && !l->syncupdirty)
+    {
+        return true;
+    }
+    l->syncupdirty = false;
+
     bool insync = true;
 
+    // files waiting for their upload delay, an upload or a new node bring syncup() back here
+    bool revisit = false;
+    dstime ndsbefore = *nds;
+
     list<string> strings;
     remotenode_map nchildren;
     remotenode_map::iterator rit;
@@ -14626,7 +17292,7 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
     {
         // corresponding remote node present: build child hash - nameclash
         // resolution: use newest version
-        for (node_list::iterator it = l->node->children.begin(); it != l->node->children.end(); it++)
+        for (NodeChildren::iterator it = l->node->children.begin(); it != l->node->children.end(); it++)
         {
             // node must be alive
             if ((*it)->syncdeleted == SYNCDEL_NONE)
@@ -14899,8 +17565,9 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
                     }
 
                     // recurse into directories of equal name
-                    if (!syncup(ll, nds, numPending))
+                    if (!syncup(ll, nds, numPending, dirtyonly))
                     {
+                        l->setsyncupdirty();
                         parentPending += numPending;
                         return false;
                     }
@@ -14920,6 +17587,7 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
 
             if (ll->transfer)
             {
+                revisit = true;
                 continue;
             }
 
@@ -15124,10 +17792,12 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
             LOG_debug << "Adding local file to synccreate: " << ll->name << " " << synccreate.size();
             synccreate.push_back(ll);
             syncactivity = true;
+            revisit = true;
 
             if (synccreate.size() >= MAX_NEWNODES)
             {
                 LOG_warn << "Stopping syncup due to MAX_NEWNODES";
+                l->setsyncupdirty();
                 parentPending += numPending;
                 return false;
             }
@@ -15142,14 +17812,20 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
 
         if (ll->type == FOLDERNODE)
         {
-            if (!syncup(ll, nds, numPending))
+            if (!syncup(ll, nds, numPending, dirtyonly))
             {
+                l->setsyncupdirty();
                 parentPending += numPending;
                 return false;
             }
         }
     }
 
+    if (revisit || numPending || *nds != ndsbefore)
+    {
+        l->setsyncupdirty();
+    }
+
     if (insync && l->node && numPending == 0)
     {
         l->treestate(TREESTATE_SYNCED);
@@ -15160,11 +17836,12 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
     return true;
 }
 
-bool MegaClient::syncup(LocalNode* l, dstime* nds)
+bool MegaClient::syncup(LocalNode* l, dstime* nds, bool dirtyonly)
 {
+    CodeCounter::ScopeTimer ccst(performanceStats.syncup);
     size_t numPending = 0;
 
-    return syncup(l, nds, numPending) && numPending == 0;
+    return syncup(l, nds, numPending, dirtyonly) && numPending == 0;
 }
 
 // execute updates stored in synccreate[]
@@ -15374,6 +18051,11 @@ void MegaClient::movetosyncdebris(Node* dn, bool unlink)
     // no: enqueue this one
     if (!n)
     {
+        if (dn->type != FILENODE)
+        {
+            unqueuesyncdeletions(dn);
+        }
+
         if (unlink)
         {
             dn->tounlink_it = tounlink.insert(dn).first;
@@ -15385,6 +18067,46 @@ void MegaClient::movetosyncdebris(Node* dn, bool unlink)
     }
 }
 
+void MegaClient::unqueuesyncdeletions(Node* folder)
+{
+    node_vector pending(folder->children.begin(), folder->children.end());
+    size_t unqueued = 0;
+
+    while (!pending.empty())
+    {
+        Node* n = pending.back();
+        pending.pop_back();
+
+        // those already on their way stay, and so do the ones queued below them
+        if (n->todebris_it != todebris.end())
+        {
+            if (n->syncdeleted == SYNCDEL_DELETED)
+            {
+                todebris.erase(n->todebris_it);
+                n->todebris_it = todebris.end();
+                n->syncdeleted = SYNCDEL_NONE;
+                unqueued++;
+            }
+        }
+        else if (n->tounlink_it != tounlink.end())
+        {
+            tounlink.erase(n->tounlink_it);
+            n->tounlink_it = tounlink.end();
+            n->syncdeleted = SYNCDEL_NONE;
+            unqueued++;
+        }
+        else
+        {
+            pending.insert(pending.end(), n->children.begin(), n->children.end());
+        }
+    }
+
+    if (unqueued)
+    {
+        LOG_debug << "Sync deletions of " << unqueued << " nodes joined to their folder " << LOG_NODEHANDLE(folder->nodehandle);
+    }
+}
+
 void MegaClient::execsyncdeletions()
 {
     if (todebris.size())
@@ -15504,8 +18226,16 @@ void MegaClient::execmovetosyncdebris()
     sprintf(buf, "%04d-%02d-%02d", ptm->tm_year + 1900, ptm->tm_mon + 1, ptm->tm_mday);
     m_time_t currentminute = ts / 60;
 
+    // the folder of the day located before, if it's still there
+    Node* bin = tn;
+    if (syncdebrisdayname == buf && (n = nodeByHandle(syncdebrisday)) && n->parent && n->parent->parent == bin
+            && !strcmp(n->displayname(), buf) && !strcmp(n->parent->displayname(), SYNCDEBRISFOLDERNAME))
+    {
+        tn = n;
+        target = SYNCDEL_DEBRISDAY;
+    }
     // locate //bin/SyncDebris
-    if ((n = childnodebyname(tn, SYNCDEBRISFOLDERNAME)) && n->type == FOLDERNODE)
+    else if ((n = childnodebyname(tn, SYNCDEBRISFOLDERNAME)) && n->type == FOLDERNODE)
     {
         tn = n;
         target = SYNCDEL_DEBRIS;
@@ -15515,6 +18245,8 @@ void MegaClient::execmovetosyncdebris()
         {
             tn = n;
             target = SYNCDEL_DEBRISDAY;
+            syncdebrisday = n->nodeHandle();
+            syncdebrisdayname = buf;
         }
     }
 
@@ -15653,6 +18385,30 @@ void MegaClient::failSync(Sync* sync, SyncError syncerror)
     syncactivity = true;
 }
 
+ScanService& MegaClient::scanService()
+{
+    if (mScanService && mScanServiceThreads != mSyncScanThreads)
+    {
+        bool walking = false;
+        syncs.forEachRunningSync([&](Sync* sync) {
+            walking = walking || sync->mWalk;
+        });
+
+        if (!walking)
+        {
+            mScanService.reset();
+        }
+    }
+
+    if (!mScanService)
+    {
+        mScanService.reset(new ScanService(*waiter, mSyncScanThreads));
+        mScanServiceThreads = mSyncScanThreads;
+    }
+
+    return *mScanService;
+}
+
 void MegaClient::disableSyncContainingNode(NodeHandle nodeHandle, SyncError syncError, bool newEnabledFlag)
 {
     if (Node* n = nodeByHandle(nodeHandle))
@@ -15849,6 +18605,14 @@ bool MegaClient::startxfer(direction_t d, File* f, DBTableTransactionCommitter&
 
             t->skipserialization = donotpersist;
 
+            if (d == PUT && mChunkIndexMinSize && t->size >= mChunkIndexMinSize && !f->syncxfer && !t->chunkIndexJob)
+            {
+                if (FingerprintService* fingerprints = fingerprintService())
+                {
+                    t->chunkIndexJob = fingerprints->queue(f->localname, true);
+                }
+            }
+
             t->lastaccesstime = m_time();
             t->tag = reqtag;
             f->tag = reqtag;
@@ -15992,12 +18756,14 @@ void MegaClient::setmaxconnections(direction_t d, int num)
 
 Node* MegaClient::nodebyfingerprint(FileFingerprint* fingerprint)
 {
+    loadCachedNodesByFingerprint(*fingerprint);
     return mFingerprints.nodebyfingerprint(fingerprint);
 }
 
 #ifdef ENABLE_SYNC
 Node* MegaClient::nodebyfingerprint(LocalNode* localNode)
 {
+    loadCachedNodesByFingerprint(*localNode);
     std::unique_ptr<const node_vector>
       remoteNodes(mFingerprints.nodesbyfingerprint(localNode));
 
@@ -16055,15 +18821,10 @@ Node* MegaClient::nodebyfingerprint(LocalNode* localNode)
 
 node_vector *MegaClient::nodesbyfingerprint(FileFingerprint* fingerprint)
 {
+    loadCachedNodesByFingerprint(*fingerprint);
     return mFingerprints.nodesbyfingerprint(fingerprint);
 }
 
-static bool nodes_ctime_less(const Node* a, const Node* b)
-{
-    // heaps return the largest element
-    return a->ctime < b->ctime;
-}
-
 static bool nodes_ctime_greater(const Node* a, const Node* b)
 {
     return a->ctime > b->ctime;
@@ -16071,36 +18832,39 @@ static bool nodes_ctime_greater(const Node* a, const Node* b)
 
 node_vector MegaClient::getRecentNodes(unsigned maxcount, m_time_t since, bool includerubbishbin)
 {
-    // 1. Get nodes added/modified not older than `since`
-    node_vector v;
-    v.reserve(nodes.size());
-    for (node_map::iterator i = nodes.begin(); i != nodes.end(); ++i)
+    // the files newer than those already loaded from the local cache are in memory (and in the index once built)
+    if (since < mRecentFilesLoadedSince)
+    {
+        loadCachedRecentFiles(since);
+        mRecentFilesLoadedSince = since;
+    }
+
+    if (!mRecentFiles.built())
     {
-        if (i->second->type == FILENODE && i->second->ctime >= since &&  // recent files only
-            (!i->second->parent || i->second->parent->type != FILENODE)) // excluding versions
+        mRecentFiles.build();
+        for (auto& it : nodes)
         {
-            v.push_back(i->second);
+            mRecentFiles.add(it.second);
         }
     }
 
-    // heaps use a 'less' function, and pop_heap returns the largest item stored.
-    std::make_heap(v.begin(), v.end(), nodes_ctime_less);
-
-    // 2. Order them chronologically and restrict them to a maximum of `maxcount`
-    node_vector v2;
-    unsigned maxItems = std::min(maxcount, unsigned(v.size()));
-    v2.reserve(maxItems);
-    while (v2.size() < maxItems && !v.empty())
+    // newest first, so only the files returned and those skipped on the way are visited
+    node_vector v;
+    for (auto& it : mRecentFiles)
     {
-        std::pop_heap(v.begin(), v.end(), nodes_ctime_less);
-        Node* n = v.back();
-        v.pop_back();
-        if (includerubbishbin || n->firstancestor()->type != RUBBISHNODE)
+        if (v.size() >= maxcount || it.first < since)
+        {
+            break;
+        }
+
+        Node* n = it.second;
+        if ((!n->parent || n->parent->type != FILENODE) // excluding versions
+            && (includerubbishbin || n->firstancestor()->type != RUBBISHNODE))
         {
-            v2.push_back(n);
+            v.push_back(n);
         }
     }
-    return v2;
+    return v;
 }
 
 
@@ -16288,7 +19052,7 @@ recentactions_vector MegaClient::getRecentActions(unsigned maxcount, m_time_t si
                 ra.time = (*j)->ctime;
                 ra.user = (*j)->owner;
                 ra.parent = (*j)->parent ? (*j)->parent->nodehandle : UNDEF;
-                ra.updated = !(*j)->children.empty();   // children of files represent previous versions
+                ra.updated = (*j)->children.any();   // children of files represent previous versions
                 ra.media = nodeIsMedia(*j, nullptr, nullptr);
                 rav.push_back(ra);
             }
@@ -16315,7 +19079,7 @@ void MegaClient::nodesbyoriginalfingerprint(const char* originalfingerprint, Nod
 {
     if (parent)
     {
-        for (node_list::iterator i = parent->children.begin(); i != parent->children.end(); ++i)
+        for (NodeChildren::iterator i = parent->children.begin(); i != parent->children.end(); ++i)
         {
             if ((*i)->type == FILENODE)
             {
@@ -16333,6 +19097,8 @@ void MegaClient::nodesbyoriginalfingerprint(const char* originalfingerprint, Nod
     }
     else
     {
+        loadAllCachedNodes();
+
         for (node_map::const_iterator i = nodes.begin(); i != nodes.end(); ++i)
         {
             if (i->second->type == FILENODE)
@@ -16457,6 +19223,114 @@ std::string MegaClient::getAuthURI(bool supressSID)
     return auth;
 }
 
+string MegaClient::getcsurl(const char* id, size_t idlen, bool suppressSID)
+{
+    string url = httpio->APIURL;
+
+    url.append("cs?id=");
+    url.append(id, idlen);
+    url.append(getAuthURI(suppressSID));
+    url.append(appkey);
+
+    string version = "v=2";
+    url.append("&" + version);
+    if (lang.size())
+    {
+        url.append("&");
+        url.append(lang);
+    }
+    return url;
+}
+
+void MegaClient::setmaxcsinflight(unsigned n)
+{
+    LOG_info << "Maximum cs requests in flight: " << n;
+    reqs.setmaxinflight(n);
+}
+
+void MegaClient::setfingerprintthreads(unsigned threads, unsigned readsPerDevice)
+{
+    LOG_info << "Fingerprint threads: " << threads << ", reads per device: " << readsPerDevice;
+    mFingerprintThreads = threads;
+    mFingerprintReadsPerDevice = readsPerDevice;
+    mFingerprintService.reset();
+}
+
+FingerprintService* MegaClient::fingerprintService()
+{
+    if (!mFingerprintService && mFingerprintThreads)
+    {
+        mFingerprintService.reset(new FingerprintService(*waiter, mFingerprintThreads, mFingerprintReadsPerDevice));
+    }
+    return mFingerprintService.get();
+}
+
+void MegaClient::setchunkindexminsize(m_off_t size)
+{
+    LOG_info << "Chunks of uploads indexed from " << size << " bytes";
+    mChunkIndexMinSize = size;
+}
+
+void MegaClient::chunkindexadd(Transfer* t, DBTableTransactionCommitter& committer)
+{
+    std::shared_ptr<FingerprintService::Job> job = std::move(t->chunkIndexJob);
+    if (!job || !tctable || t->files.empty())
+    {
+        return;
+    }
+
+    if (!job->done() || !job->chunks || !(job->chunks->fingerprint == *(FileFingerprint*)t))
+    {
+        LOG_debug << "Upload without chunk index: " << t->files.front()->name;
+        return;
+    }
+
+    ChunkIndex& index = *job->chunks;
+    File* f = t->files.front();
+
+    auto drop = [this, &committer](std::map<string, uint32_t>::iterator it)
+    {
+        tctable->checkCommitter(&committer);
+        tctable->del(it->second);
+        mChunkIndexDbids.erase(it);
+    };
+
+    // the previous version is still the file of that name in the target folder
+    Node* target = nodeByHandle(f->h);
+    Node* previous = target ? childnodebyname(target, f->name.c_str(), false) : nullptr;
+    auto it = previous && previous->type == FILENODE ? mChunkIndexDbids.find(ChunkIndex::key(*previous)) : mChunkIndexDbids.end();
+    if (it != mChunkIndexDbids.end())
+    {
+        string data;
+        unique_ptr<ChunkIndex> old;
+        if (tctable->get(it->second, &data, &tckey) && (old = ChunkIndex::unserialize(data)))
+        {
+            auto ranges = index.commonRanges(*old);
+            m_off_t common = 0;
+            for (auto& r : ranges)
+            {
+                common += r.second - r.first;
+            }
+
+            LOG_info << "Upload of " << f->name << ": " << common << " of " << t->size << " bytes unchanged since the previous version, in "
+                     << ranges.size() << " ranges of " << index.chunks.size() << " chunks";
+        }
+        drop(it);
+    }
+
+    string key = ChunkIndex::key(index.fingerprint);
+    if ((it = mChunkIndexDbids.find(key)) != mChunkIndexDbids.end())
+    {
+        drop(it);
+    }
+
+    tctable->checkCommitter(&committer);
+    if (tctable->put(CACHEDCHUNKINDEX, &index, &tckey))
+    {
+        mChunkIndexDbids[key] = index.dbid;
+    }
+}
+
 void MegaClient::userfeedbackstore(const char *message)
 {
     string type = "feedback.";
@@ -16685,6 +19559,165 @@ bool MegaClient::driveMonitorEnabled()
 #endif
 }
 
+std::vector<const CodeCounter::ScopeStats*> MegaClient::PerformanceStats::scopes(const MegaClient& client) const
+{
+    std::vector<const CodeCounter::ScopeStats*> v = { &execFunction, &prepareWait, &doWait, &checkEvents, &transferslotDoio, &execdirectreads,
+                                                      &transferComplete, &dispatchTransfers, &applyKeys, &scProcessingTime, &csResponseProcessingTime, &dbCommit,
+                                                      &syncProcscanq, &syncCheckpath, &syncdown, &syncup };
+#ifdef USE_CURL
+    if (auto curlhttpio = dynamic_cast<const CurlHttpIO*>(client.httpio))
+    {
+        v.push_back(&curlhttpio->addeventsStats());
+        v.push_back(&curlhttpio->addCurlEventsStats());
+        v.push_back(&curlhttpio->processCurlEventsStats());
+#ifdef MEGA_USE_C_ARES
+        v.push_back(&curlhttpio->addAresEventsStats());
+        v.push_back(&curlhttpio->processAresEventsStats());
+#endif
+    }
+#endif
+    return v;
+}
+
+std::string MegaClient::PerformanceStats::toJson(const MegaClient& client) const
+{
+    std::ostringstream json;
+    json << "{\"timers\":{";
+    bool first = true;
+    for (auto scope : scopes(client))
+    {
+        json << (first ? "" : ",") << "\"" << scope->name << "\":" << scope->toJson();
+        first = false;
+    }
+    json << "},\"durations\":{\"csrequestwait\":" << csRequestWaitTime.milliseconds()
+         << ",\"transfersactive\":" << transfersActiveTime.milliseconds()
+         << "},\"counters\":{\"csrequestssent\":" << client.reqs.csRequestsSent
+         << ",\"csrequestscompleted\":" << client.reqs.csRequestsCompleted
+         << ",\"csbatchessent\":" << client.reqs.csBatchesSent
+         << ",\"csbatchesreceived\":" << client.reqs.csBatchesReceived
+         << ",\"transferstarts\":" << transferStarts
+         << ",\"transferfinishes\":" << transferFinishes
+         << ",\"transfertemperrors\":" << transferTempErrors
+         << ",\"transferfails\":" << transferFails
+         << ",\"prepwaitimmediate\":" << prepwaitImmediate
+         << ",\"prepwaitzero\":" << prepwaitZero
+         << ",\"prepwaithttpio\":" << prepwaitHttpio
+         << ",\"prepwaitfsaccess\":" << prepwaitFsaccess
+         << ",\"nonzerowait\":" << nonzeroWait
+         << ",\"downloadbytes\":" << transferBytes[GET]
+         << ",\"uploadbytes\":" << transferBytes[PUT]
+         << "},\"gauges\":{\"csqueuedbatches\":" << csQueuedBatches.toJson()
+         << ",\"transferslots\":" << transferSlots.toJson()
+         << ",\"queuedtransfers\":" << queuedTransfers.toJson()
+         << ",\"pendingfileattributes\":" << pendingFileAttributes.toJson()
+         << ",\"downloadspeed\":" << downloadSpeed.toJson()
+         << ",\"uploadspeed\":" << uploadSpeed.toJson()
+         << ",\"nodes\":" << nodes.toJson()
+         << ",\"syncqueuednotifications\":" << syncQueuedNotifications.toJson()
+         << ",\"sclag\":" << scLag.toJson()
+         << ",\"workerqueue\":" << client.mAsyncQueue.depth().toJson();
+    if (client.gfx)
+    {
+        json << ",\"gfxqueue\":" << client.gfx->queueDepth().toJson();
+    }
+    json << ",\"transferbuffers\":" << client.mTransferBufferPool.usage().toJson()
+         << "},\"memory\":{";
+    for (int tag = 0; tag < CodeCounter::MEM_NUM_TAGS; tag++)
+    {
+        json << (tag ? "," : "") << "\"" << CodeCounter::memoryTagName(CodeCounter::MemoryTag(tag)) << "\":"
+             << CodeCounter::memory[tag].toJson();
+    }
+    json << "},\"execphases\":" << execPhases.toJson() << "}";
+    return json.str();
+}
+
+std::string MegaClient::PerformanceStats::toPrometheus(const MegaClient& client) const
+{
+    std::ostringstream out;
+
+    auto family = [&out](const char* name, const char* type, const char* help)
+    {
+        out << "# HELP " << name << " " << help << "\n"
+            << "# TYPE " << name << " " << type << "\n";
+    };
+
+    // bucket bounds in seconds, as multiples of 100 us
+    static const unsigned bounds[] = { 1, 5, 10, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000 };
+
+    family("mega_code_duration_seconds", "histogram", "Time spent in the main parts of the SDK loop and network layer");
+    for (auto scope : scopes(client))
+    {
+        for (unsigned bound : bounds)
+        {
+            out << "mega_code_duration_seconds_bucket{scope=\"" << scope->name << "\",le=\"" << bound / 10000.0 << "\"} "
+                << scope->durations.countUpTo(uint64_t(bound) * 100) << "\n";
+        }
+        out << "mega_code_duration_seconds_bucket{scope=\"" << scope->name << "\",le=\"+Inf\"} " << scope->count.load(std::memory_order_relaxed) << "\n"
+            << "mega_code_duration_seconds_sum{scope=\"" << scope->name << "\"} "
+            << std::chrono::duration<double>(std::chrono::high_resolution_clock::duration(scope->timeSpent.load(std::memory_order_relaxed))).count() << "\n"
+            << "mega_code_duration_seconds_count{scope=\"" << scope->name << "\"} " << scope->count.load(std::memory_order_relaxed) << "\n";
+    }
+
+    family("mega_cs_requests_total", "counter", "API requests sent and completed");
+    out << "mega_cs_requests_total{state=\"sent\"} " << client.reqs.csRequestsSent << "\n"
+        << "mega_cs_requests_total{state=\"completed\"} " << client.reqs.csRequestsCompleted << "\n";
+    family("mega_cs_batches_total", "counter", "API request batches sent and received");
+    out << "mega_cs_batches_total{state=\"sent\"} " << client.reqs.csBatchesSent << "\n"
+        << "mega_cs_batches_total{state=\"received\"} " << client.reqs.csBatchesReceived << "\n";
+    family("mega_cs_queued_batches", "gauge", "API request batches waiting to be sent");
+    out << "mega_cs_queued_batches " << csQueuedBatches.value << "\n";
+    family("mega_sc_lag_seconds", "gauge", "Time since the action packets being processed arrived, 0 when there are none");
+    out << "mega_sc_lag_seconds " << scLag.value / 1000.0 << "\n";
+
+    family("mega_transfers_in_flight", "gauge", "Transfers with an active slot");
+    out << "mega_transfers_in_flight " << transferSlots.value << "\n";
+    family("mega_transfers_queued", "gauge", "Transfers queued, active or not");
+    out << "mega_transfers_queued " << queuedTransfers.value << "\n";
+    family("mega_transfer_events_total", "counter", "Transfer starts, finishes, temporary errors and failures");
+    out << "mega_transfer_events_total{event=\"start\"} " << transferStarts << "\n"
+        << "mega_transfer_events_total{event=\"finish\"} " << transferFinishes << "\n"
+        << "mega_transfer_events_total{event=\"temporary_error\"} " << transferTempErrors << "\n"
+        << "mega_transfer_events_total{event=\"failure\"} " << transferFails << "\n";
+    family("mega_transfer_bytes_total", "counter", "Bytes of the transfer chunks completed");
+    out << "mega_transfer_bytes_total{direction=\"download\"} " << transferBytes[GET] << "\n"
+        << "mega_transfer_bytes_total{direction=\"upload\"} " << transferBytes[PUT] << "\n";
+    family("mega_transfer_speed_bytes_per_second", "gauge", "Current transfer speed");
+    out << "mega_transfer_speed_bytes_per_second{direction=\"download\"} " << downloadSpeed.value << "\n"
+        << "mega_transfer_speed_bytes_per_second{direction=\"upload\"} " << uploadSpeed.value << "\n";
+    family("mega_transfer_buffer_bytes", "gauge", "Transfer data held in memory");
+    out << "mega_transfer_buffer_bytes " << client.mTransferBufferPool.usage().value << "\n";
+
+    family("mega_queued_jobs", "gauge", "Jobs waiting for a thread");
+    out << "mega_queued_jobs{queue=\"worker\"} " << client.mAsyncQueue.depth().value << "\n";
+    if (client.gfx)
+    {
+        out << "mega_queued_jobs{queue=\"gfx\"} " << client.gfx->queueDepth().value << "\n";
+    }
+    out << "mega_queued_jobs{queue=\"file_attributes\"} " << pendingFileAttributes.value << "\n";
+
+    family("mega_sync_queued_notifications", "gauge", "Filesystem notifications waiting to be processed by the syncs");
+    out << "mega_sync_queued_notifications " << syncQueuedNotifications.value << "\n";
+    family("mega_nodes", "gauge", "Nodes in memory");
+    out << "mega_nodes " << nodes.value << "\n";
+    family("mega_exec_phase_seconds_total", "counter", "Time spent in each phase of the SDK loop, exclusive of the phases nested in it");
+    for (int phase = 0; phase <= execPhases.phaseCount(); phase++)
+    {
+        int p = phase < execPhases.phaseCount() ? phase : int(CodeCounter::LoopProfiler::MAX_PHASES);
+        out << "mega_exec_phase_seconds_total{phase=\"" << execPhases.phaseName(p) << "\"} " << execPhases.totalMicroseconds(p) / 1e6 << "\n";
+    }
+    family("mega_exec_slow_loops_total", "counter", "Iterations of the SDK loop slower than the threshold");
+    out << "mega_exec_slow_loops_total " << execPhases.slowIterations() << "\n";
+
+    family("mega_memory_bytes", "gauge", "Memory held by the main owners in the SDK");
+    for (int tag = 0; tag < CodeCounter::MEM_NUM_TAGS; tag++)
+    {
+        out << "mega_memory_bytes{owner=\"" << CodeCounter::memoryTagName(CodeCounter::MemoryTag(tag)) << "\"} "
+            << CodeCounter::memory[tag].value << "\n";
+    }
+
+    return out.str();
+}
+
 #ifdef MEGA_MEASURE_CODE
 std::string MegaClient::PerformanceStats::report(bool reset, HttpIO* httpio, Waiter* waiter, const RequestDispatcher& reqs)
 {
@@ -16717,7 +19750,25 @@ std::string MegaClient::PerformanceStats::report(bool reset, HttpIO* httpio, Wai
 #ifdef MEGA_USE_C_ARES
             << curlhttpio->countProcessAresEventsCode.report(reset) << "\n"
 #endif
-            << curlhttpio->countProcessCurlEventsCode.report(reset) << "\n";
+            << curlhttpio->countProcessCurlEventsCode.report(reset) << "\n"
+            << " http requests/new connections: api: " << curlhttpio->requestsDone[API] << "/" << curlhttpio->connectionsOpened[API]
+            << " get: " << curlhttpio->requestsDone[GET] << "/" << curlhttpio->connectionsOpened[GET]
+            << " put: " << curlhttpio->requestsDone[PUT] << "/" << curlhttpio->connectionsOpened[PUT] << "\n";
+        for (auto& h : curlhttpio->tlshandshakes)
+        {
+            s << " tls handshakes " << h.first << ": " << h.second.count
+              << " avg ms: " << h.second.totalus / int64_t(h.second.count) / 1000
+              << " max ms: " << h.second.maxus / 1000 << "\n";
+        }
+        if (reset)
+        {
+            for (int d = GET; d <= API; d++)
+            {
+                curlhttpio->requestsDone[d] = 0;
+                curlhttpio->connectionsOpened[d] = 0;
+            }
+            curlhttpio->tlshandshakes.clear();
+        }
     }
 #endif
 #ifdef WIN32
@@ -16753,6 +19804,9 @@ void FetchNodesStats::init()
     e500Count = 0;
     eOthersCount = 0;
 
+    responseBytes = 0;
+    responseWireBytes = 0;
+
     startTime = Waiter::ds;
     timeToFirstByte = NEVER;
     timeToLastByte = NEVER;
@@ -16777,7 +19831,8 @@ void FetchNodesStats::toJsonArray(string *json)
         << timeToFirstByte << "," << timeToLastByte << ","
         << timeToCached << "," << timeToResult << ","
         << timeToSyncsResumed << "," << timeToCurrent << ","
-        << timeToTransfersResumed << "," << cache << "]";
+        << timeToTransfersResumed << "," << cache << ","
+        << responseBytes << "," << responseWireBytes << "]";
     json->append(oss.str());
 }
 
@@ -33,6 +33,469 @@
 
 namespace mega {
 
+void NodeChildren::loadPending() const
+{
+    mPending = false;
+    mOwner->client->loadCachedChildren(mOwner);
+}
+
+namespace {
+
+// Node::displayname(), without its logging of the nodes that have no name
+const char* indexedName(const Node* n)
+{
+    if (n->attrstring)
+    {
+        return "NO_KEY";
+    }
+
+    auto it = n->attrs.map.find('n');
+    if (it == n->attrs.map.end())
+    {
+        return "CRYPTO_ERROR";
+    }
+
+    return it->second.empty() ? "BLANK" : it->second.c_str();
+}
+
+// The getters of MegaApi search by name with the SDK lock shared, so several of them may find the index
+// of the same folder missing.  The changes to the children take the lock exclusively, so they don't need it.
+std::mutex nameIndexMutex;
+
+} // namespace
+
+size_t NodeChildren::nameHash(const char* name)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (; *name; ++name)
+    {
+        hash = (hash ^ static_cast<unsigned char>(*name)) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+void RecentFiles::add(Node* n)
+{
+    if (mBuilt && n->type == FILENODE)
+    {
+        mFiles.emplace(n->ctime, n);
+    }
+}
+
+void RecentFiles::remove(Node* n)
+{
+    if (mBuilt && n->type == FILENODE)
+    {
+        mFiles.erase(std::make_pair(n->ctime, n));
+    }
+}
+
+void RecentFiles::clear()
+{
+    mFiles.clear();
+    mBuilt = false;
+}
+
+NodeHandle NodePathCache::find(NodeHandle parent, const string& name) const
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    auto it = mChildren.find(Key{parent, name});
+    return it == mChildren.end() ? NodeHandle() : it->second;
+}
+
+void NodePathCache::add(NodeHandle parent, const string& name, NodeHandle child)
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    if (mChildren.size() >= MAX_ENTRIES)
+    {
+        mChildren.clear();
+        mKeys.clear();
+    }
+
+    Key key{parent, name};
+    auto previous = mKeys.find(child.as8byte());
+    if (previous != mKeys.end())
+    {
+        mChildren.erase(previous->second);
+    }
+
+    mChildren[key] = child;
+    mKeys[child.as8byte()] = std::move(key);
+}
+
+void NodePathCache::invalidate(NodeHandle node, NodeHandle parent, const string& name)
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    if (mChildren.empty())
+    {
+        return;
+    }
+
+    auto it = mKeys.find(node.as8byte());
+    if (it != mKeys.end())
+    {
+        mChildren.erase(it->second);
+        mKeys.erase(it);
+    }
+
+    auto sibling = mChildren.find(Key{parent, name});
+    if (sibling != mChildren.end())
+    {
+        mKeys.erase(sibling->second.as8byte());
+        mChildren.erase(sibling);
+    }
+}
+
+void NodePathCache::clear()
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    mChildren.clear();
+    mKeys.clear();
+}
+
+size_t NodePathCache::size() const
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    return mChildren.size();
+}
+
+size_t NodePathCache::KeyHash::operator()(const Key& k) const
+{
+    return std::hash<string>()(k.name) ^ std::hash<handle>()(k.parent.as8byte()) * 1099511628211ull;
+}
+
+void NodeChildren::push_back(Node* n)
+{
+    assert(!n->mPrevSibling && !n->mNextSibling);
+
+    n->mPrevSibling = mLast;
+    if (mLast)
+    {
+        mLast->mNextSibling = n;
+    }
+    else
+    {
+        mFirst = n;
+    }
+    mLast = n;
+    ++mSize;
+
+    if (mByName)
+    {
+        mByName->emplace(nameHash(indexedName(n)), n);
+    }
+
+    if (mSorted)
+    {
+        for (auto& s : *mSorted)
+        {
+            auto& v = s.second.nodes;
+            v.insert(std::upper_bound(v.begin(), v.end(), n, s.second.less), n);
+        }
+    }
+}
+
+void NodeChildren::remove(Node* n)
+{
+    assert(mSize);
+
+    (n->mPrevSibling ? n->mPrevSibling->mNextSibling : mFirst) = n->mNextSibling;
+    (n->mNextSibling ? n->mNextSibling->mPrevSibling : mLast) = n->mPrevSibling;
+    n->mPrevSibling = n->mNextSibling = nullptr;
+    --mSize;
+
+    if (mByName)
+    {
+        auto range = mByName->equal_range(nameHash(indexedName(n)));
+        auto it = std::find_if(range.first, range.second, [n](const pair<const size_t, Node*>& e) { return e.second == n; });
+        if (it != range.second)
+        {
+            mByName->erase(it);
+        }
+        else
+        {
+            // renamed without clearIndexes(): the index can't be trusted any more
+            mByName.reset();
+        }
+    }
+
+    if (mSorted)
+    {
+        for (auto& s : *mSorted)
+        {
+            // where it was inserted, unless its attributes were changed directly and the order isn't dropped yet
+            auto& v = s.second.nodes;
+            auto range = std::equal_range(v.begin(), v.end(), n, s.second.less);
+            auto it = std::find(range.first, range.second, n);
+            if (it == range.second)
+            {
+                it = std::find(v.begin(), v.end(), n);
+            }
+            if (it != v.end())
+            {
+                v.erase(it);
+            }
+        }
+    }
+}
+
+const node_vector& NodeChildren::addSorted(int order, Comparator less)
+{
+    load();
+
+    if (!mSorted)
+    {
+        mSorted.reset(new map<int, Sorted>);
+    }
+
+    Sorted& s = (*mSorted)[order];
+    s.less = std::move(less);
+    s.nodes.assign(begin(), end());
+    std::sort(s.nodes.begin(), s.nodes.end(), s.less);
+    return s.nodes;
+}
+
+const node_vector* NodeChildren::sorted(int order) const
+{
+    if (!mSorted)
+    {
+        return nullptr;
+    }
+
+    auto it = mSorted->find(order);
+    return it == mSorted->end() ? nullptr : &it->second.nodes;
+}
+
+bool NodeChildren::byName(const char* name, node_vector& matches)
+{
+    if (size() < NAME_INDEX_THRESHOLD)
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> g(nameIndexMutex);
+        if (!mByName)
+        {
+            mByName.reset(new multimap<size_t, Node*>);
+            for (Node* n = mFirst; n; n = n->mNextSibling)
+            {
+                mByName->emplace(nameHash(indexedName(n)), n);
+            }
+        }
+    }
+
+    auto range = mByName->equal_range(nameHash(name));
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (!strcmp(indexedName(it->second), name))
+        {
+            matches.push_back(it->second);
+        }
+    }
+    return true;
+}
+
+LocalNodeChildren::iterator::iterator(const LocalNodeChildren* children, size_t index)
+    : mChildren(children)
+    , mIndex(index)
+{
+    ++mChildren->mIterators;
+
+    while (!atEnd() && !mChildren->mEntries[mIndex].second)
+    {
+        ++mIndex;
+    }
+}
+
+LocalNodeChildren::iterator::iterator(const iterator& other)
+    : mChildren(other.mChildren)
+    , mIndex(other.mIndex)
+{
+    if (mChildren)
+    {
+        ++mChildren->mIterators;
+    }
+}
+
+LocalNodeChildren::iterator& LocalNodeChildren::iterator::operator=(const iterator& other)
+{
+    if (other.mChildren)
+    {
+        ++other.mChildren->mIterators;
+    }
+    if (mChildren)
+    {
+        --mChildren->mIterators;
+    }
+    mChildren = other.mChildren;
+    mIndex = other.mIndex;
+    return *this;
+}
+
+LocalNodeChildren::iterator::~iterator()
+{
+    if (mChildren)
+    {
+        --mChildren->mIterators;
+    }
+}
+
+LocalNodeChildren::iterator& LocalNodeChildren::iterator::operator++()
+{
+    do
+    {
+        ++mIndex;
+    }
+    while (!atEnd() && !mChildren->mEntries[mIndex].second);
+
+    return *this;
+}
+
+LocalNodeChildren::iterator LocalNodeChildren::find(const LocalPath* name) const
+{
+    size_t entry = findentry(name, name->hash());
+    return entry < mEntries.size() ? iterator(this, entry) : end();
+}
+
+size_t LocalNodeChildren::findentry(const LocalPath* name, size_t hash) const
+{
+    auto matches = [&](const Entry& e)
+    {
+        return e.second && e.hash == hash && *e.first == *name;
+    };
+
+    if (mIndex.empty())
+    {
+        for (size_t i = 0; i < mEntries.size(); ++i)
+        {
+            if (matches(mEntries[i]))
+            {
+                return i;
+            }
+        }
+        return mEntries.size();
+    }
+
+    size_t mask = mIndex.size() - 1;
+    for (size_t slot = hash & mask; mIndex[slot]; slot = (slot + 1) & mask)
+    {
+        size_t i = mIndex[slot] - 1;
+        if (matches(mEntries[i]))
+        {
+            return i;
+        }
+    }
+    return mEntries.size();
+}
+
+void LocalNodeChildren::set(const LocalPath* name, LocalNode* node)
+{
+    assert(node);
+
+    size_t hash = name->hash();
+    size_t entry = findentry(name, hash);
+    if (entry < mEntries.size())
+    {
+        mEntries[entry].first = name;
+        mEntries[entry].second = node;
+        return;
+    }
+
+    if (!mIterators && mErased > mEntries.size() / 2)
+    {
+        compact();
+    }
+
+    mEntries.push_back(Entry{ name, node, hash });
+
+    if (!mIndex.empty() || mEntries.size() > INDEXTHRESHOLD)
+    {
+        addindex(mEntries.size() - 1);
+    }
+}
+
+size_t LocalNodeChildren::erase(const LocalPath* name)
+{
+    size_t entry = findentry(name, name->hash());
+    if (entry == mEntries.size())
+    {
+        return 0;
+    }
+
+    mEntries[entry].second = nullptr;
+    ++mErased;
+
+    if (!mIterators && mErased > mEntries.size() / 2)
+    {
+        compact();
+    }
+    return 1;
+}
+
+void LocalNodeChildren::addindex(size_t entry)
+{
+    // keep it at most half full (holes included)
+    if (mIndex.size() < 2 * mEntries.size())
+    {
+        rebuildindex();
+        return;
+    }
+
+    size_t mask = mIndex.size() - 1;
+    size_t slot = mEntries[entry].hash & mask;
+    while (mIndex[slot])
+    {
+        slot = (slot + 1) & mask;
+    }
+    mIndex[slot] = uint32_t(entry + 1);
+}
+
+void LocalNodeChildren::rebuildindex()
+{
+    size_t slots = 2 * INDEXTHRESHOLD;
+    while (slots < 4 * mEntries.size())
+    {
+        slots *= 2;
+    }
+
+    mIndex.assign(slots, 0);
+
+    size_t mask = slots - 1;
+    for (size_t i = 0; i < mEntries.size(); ++i)
+    {
+        if (mEntries[i].second)
+        {
+            size_t slot = mEntries[i].hash & mask;
+            while (mIndex[slot])
+            {
+                slot = (slot + 1) & mask;
+            }
+            mIndex[slot] = uint32_t(i + 1);
+        }
+    }
+}
+
+void LocalNodeChildren::compact()
+{
+    assert(!mIterators);
+
+    mEntries.erase(std::remove_if(mEntries.begin(), mEntries.end(),
+                                  [](const Entry& e) { return !e.second; }),
+                   mEntries.end());
+    mErased = 0;
+
+    if (mEntries.size() > INDEXTHRESHOLD)
+    {
+        rebuildindex();
+    }
+    else
+    {
+        mIndex.clear();
+    }
+}
+
 Node::Node(MegaClient* cclient, node_vector* dp, handle h, handle ph,
            nodetype_t t, m_off_t s, handle u, const char* fa, m_time_t ts)
 {
@@ -47,6 +510,8 @@ Node::Node(MegaClient* cclient, node_vector* dp, handle h, handle ph,
 
     parent = NULL;
 
+    scdirty_it = client->scdirty.end();
+
 #ifdef ENABLE_SYNC
     syncget = NULL;
 
@@ -74,7 +539,8 @@ Node::Node(MegaClient* cclient, node_vector* dp, handle h, handle ph,
 
     Node* p;
 
-    client->nodes[NodeHandle().set6byte(h)] = this;
+    client->nodes.add(NodeHandle().set6byte(h), this);
+    client->mRecentFiles.add(this);
 
     if (t >= ROOTNODE && t <= RUBBISHNODE)
     {
@@ -91,8 +557,31 @@ Node::Node(MegaClient* cclient, node_vector* dp, handle h, handle ph,
     {
         dp->push_back(this);
     }
+}
+
+static FixedSizeAllocator& nodeAllocator()
+{
+    // intentionally never destroyed, so nodes outliving static destruction can still be freed
+    static FixedSizeAllocator* allocator = new FixedSizeAllocator(sizeof(Node), 1024, &CodeCounter::memory[CodeCounter::MEM_NODES]);
+    return *allocator;
+}
 
-    client->mFingerprints.newnode(this);
+void* Node::operator new(size_t size)
+{
+    // anything derived from Node with a different size goes to the general heap
+    return size == sizeof(Node) ? nodeAllocator().allocate() : ::operator new(size);
+}
+
+void Node::operator delete(void* p, size_t size)
+{
+    if (size == sizeof(Node))
+    {
+        nodeAllocator().deallocate(p);
+    }
+    else
+    {
+        ::operator delete(p);
+    }
 }
 
 Node::~Node()
@@ -110,6 +599,17 @@ Node::~Node()
     if (!client->mOptimizePurgeNodes)
     {
         client->mFingerprints.remove(this);
+        client->mNodeNames.remove(nameslot);
+        client->mRecentFiles.remove(this);
+        if (type == FILENODE && client->mNodeTypes.built)
+        {
+            client->mNodeTypes.remove(nodehandle);
+        }
+    }
+
+    if (scdirty_it != client->scdirty.end())
+    {
+        client->scdirty.erase(scdirty_it);
     }
 
 #ifdef ENABLE_SYNC
@@ -152,7 +652,8 @@ Node::~Node()
         // remove from parent's children
         if (parent)
         {
-            parent->children.erase(child_it);
+            updateAncestorCounts(false);
+            parent->children.remove(this);
         }
 
         const Node* fa = firstancestor();
@@ -167,11 +668,17 @@ Node::~Node()
             client->mNodeCounters.erase(nodehandle);
         }
 
+        // children still in the local cache only go away with the cache
+        assert(!children.pending());
+        children.discardPending();
+
         // delete child-parent associations (normally not used, as nodes are
         // deleted bottom-up)
-        for (node_list::iterator it = children.begin(); it != children.end(); it++)
+        children.clearIndexes();
+        while (Node* child = children.front())
         {
-            (*it)->parent = NULL;
+            children.remove(child);
+            child->parent = NULL;
         }
     }
 
@@ -231,6 +738,71 @@ void Node::setkey(const byte* newkey)
     setattr();
 }
 
+// read handle, parent, type and size of a serialized node without building it
+bool Node::unserializeHeader(const string* d, handle* h, handle* ph, nodetype_t* t, m_off_t* s)
+{
+    const char* ptr = d->data();
+
+    if (isCompactRecord(*d))
+    {
+        CacheableReader r(*d);
+        byte type, version;
+        handle owner;
+        uint64_t size = 0;
+
+        *h = *ph = 0;
+        if (!r.unserializenodehandle(*h)
+            || !r.unserializebyte(type)
+            || !r.unserializebyte(version)
+            || version != COMPACT_RECORD
+            || !r.unserializenodehandle(*ph)
+            || !r.unserializehandle(owner)
+            || (type == FILENODE && !r.unserializevarint(size)))
+        {
+            return false;
+        }
+
+        *t = nodetype_t(type);
+        *s = type == FILENODE ? m_off_t(size) : -m_off_t(type);
+        if (!*ph)
+        {
+            *ph = UNDEF;
+        }
+        return true;
+    }
+
+    if (d->size() < sizeof *s + 2 * MegaClient::NODEHANDLE)
+    {
+        return false;
+    }
+
+    *s = MemAccess::get<m_off_t>(ptr);
+    ptr += sizeof *s;
+
+    if (*s < 0 && *s >= -RUBBISHNODE)
+    {
+        *t = (nodetype_t)-*s;
+    }
+    else
+    {
+        *t = FILENODE;
+    }
+
+    *h = 0;
+    memcpy((char*)h, ptr, MegaClient::NODEHANDLE);
+    ptr += MegaClient::NODEHANDLE;
+
+    *ph = 0;
+    memcpy((char*)ph, ptr, MegaClient::NODEHANDLE);
+
+    if (!*ph)
+    {
+        *ph = UNDEF;
+    }
+
+    return true;
+}
+
 // parse serialized node and return Node object - updates nodes hash and parent
 // mismatch vector
 Node* Node::unserialize(MegaClient* client, const string* d, node_vector* dp)
@@ -251,6 +823,11 @@ Node* Node::unserialize(MegaClient* client, const string* d, node_vector* dp)
     char isExported = '\0';
     char hasLinkCreationTs = '\0';
 
+    if (isCompactRecord(*d))
+    {
+        return unserializeCompact(client, d, dp);
+    }
+
     if (ptr + sizeof s + 2 * MegaClient::NODEHANDLE + MegaClient::USERHANDLE + 2 * sizeof ts + sizeof ll > end)
     {
         return NULL;
@@ -462,6 +1039,124 @@ Node* Node::unserialize(MegaClient* client, const string* d, node_vector* dp)
     }
 }
 
+// the compact layout, written by serialize(): the strings are read in place
+Node* Node::unserializeCompact(MegaClient* client, const string* d, node_vector* dp)
+{
+    CacheableReader r(*d);
+    handle h, ph, u;
+    byte type, version, flags;
+    uint64_t size = 0, ctime;
+    const char* fa = nullptr;
+    size_t falen = 0;
+
+    if (!r.unserializenodehandle(h)
+        || !r.unserializebyte(type)
+        || !r.unserializebyte(version)
+        || version != COMPACT_RECORD
+        || !r.unserializenodehandle(ph)
+        || !r.unserializehandle(u)
+        || type > RUBBISHNODE
+        || (type == FILENODE && !r.unserializevarint(size))
+        || !r.unserializevarint(ctime))
+    {
+        return nullptr;
+    }
+
+    nodetype_t t = nodetype_t(type);
+    size_t keylen = t == FILENODE ? FILENODEKEYLENGTH : (t == FOLDERNODE ? FOLDERNODEKEYLENGTH : 0);
+    const byte* k = reinterpret_cast<const byte*>(r.ptr);
+    if (size_t(r.end - r.ptr) < keylen)
+    {
+        return nullptr;
+    }
+    r.ptr += keylen;
+
+    if ((t == FILENODE && !r.unserializevarbytes(fa, falen))
+        || !r.unserializebyte(flags))
+    {
+        return nullptr;
+    }
+
+    handle linkhandle = 0;
+    uint64_t ets = 0, cts = 0;
+    bool takendown = false;
+    const char* authKey = nullptr;
+    size_t authKeyLen = 0;
+    if ((flags & COMPACT_EXPORTED)
+        && (!r.unserializenodehandle(linkhandle)
+            || !r.unserializevarint(ets)
+            || !r.unserializebool(takendown)
+            || !r.unserializevarint(cts)
+            || !r.unserializevarbytes(authKey, authKeyLen)))
+    {
+        return nullptr;
+    }
+
+    uint64_t numshares = 1;
+    if (!(flags & COMPACT_INSHARE) && !r.unserializevarint(numshares))
+    {
+        return nullptr;
+    }
+
+    const byte* skey = nullptr;
+    if (numshares)
+    {
+        if (size_t(r.end - r.ptr) < SymmCipher::KEYLENGTH)
+        {
+            return nullptr;
+        }
+        skey = reinterpret_cast<const byte*>(r.ptr);
+        r.ptr += SymmCipher::KEYLENGTH;
+    }
+
+    Node* n = new Node(client, dp, h, ph ? ph : UNDEF, t, t == FILENODE ? m_off_t(size) : -m_off_t(t), u, nullptr, m_time_t(ctime));
+
+    if (keylen)
+    {
+        n->setkey(k);
+    }
+
+    if (fa)
+    {
+        n->fileattrstring.assign(fa, falen);
+    }
+
+    for (int direction = (flags & COMPACT_INSHARE) ? 0 : -1; numshares--; )
+    {
+        NewShare* newShare = Share::unserialize(direction, h, skey, &r.ptr, r.end);
+        if (!newShare)
+        {
+            LOG_err << "Failed to unserialize Share";
+            break;
+        }
+        client->newshares.push_back(newShare);
+    }
+
+    const char* ptr = n->attrs.unserialize(r.ptr, r.end);
+    if (ptr != r.end)
+    {
+        delete n;
+        return nullptr;
+    }
+
+    // (see unserialize())
+    attr_map::iterator it = n->attrs.map.find('n');
+    if (it != n->attrs.map.end())
+    {
+        client->fsaccess->normalize(&(it->second));
+    }
+
+    if (flags & COMPACT_EXPORTED)
+    {
+        n->plink = new PublicLink(linkhandle, m_time_t(cts), m_time_t(ets), takendown);
+        n->plink->mAuthKey.assign(authKey, authKeyLen);
+        client->mPublicLinks[n->nodehandle] = linkhandle;
+    }
+
+    n->setfingerprint();
+    return n;
+}
+
 // serialize node - nodes with pending or RSA keys are unsupported
 bool Node::serialize(string* d)
 {
@@ -504,81 +1199,53 @@ bool Node::serialize(string* d)
             }
     }
 
-    unsigned short ll;
-    short numshares;
-    m_off_t s;
-
-    s = type ? -type : size;
-
-    d->append((char*)&s, sizeof s);
-
-    d->append((char*)&nodehandle, MegaClient::NODEHANDLE);
+    // the compact layout, see COMPACT_RECORD
+    CacheableWriter w(*d);
+    w.serializenodehandle(nodehandle);
+    w.serializebyte(byte(type));
+    w.serializebyte(COMPACT_RECORD);
+    w.serializenodehandle(parent ? parent->nodehandle : 0);
+    w.serializehandle(owner);
 
-    if (parent)
-    {
-        d->append((char*)&parent->nodehandle, MegaClient::NODEHANDLE);
-    }
-    else
+    if (type == FILENODE)
     {
-        d->append("\0\0\0\0\0", MegaClient::NODEHANDLE);
+        w.serializevarint(uint64_t(size));
     }
+    w.serializevarint(uint64_t(ctime));
 
-    d->append((char*)&owner, MegaClient::USERHANDLE);
-
-    // FIXME: use Serialize64
-    time_t ts = 0;  // we don't want to break backward compatibiltiy by changing the size (where m_time_t differs)
-    d->append((char*)&ts, sizeof(ts));
-
-    ts = (time_t)ctime;
-    d->append((char*)&ts, sizeof(ts));
-
+    // (key length given by the type)
     d->append(nodekeydata);
 
     if (type == FILENODE)
     {
-        ll = static_cast<unsigned short>(fileattrstring.size() + 1);
-        d->append((char*)&ll, sizeof ll);
-        d->append(fileattrstring.c_str(), ll);
+        w.serializevarbytes(fileattrstring);
     }
 
-    char isExported = plink ? 1 : 0;
-    d->append((char*)&isExported, 1);
-
-    char hasLinkCreationTs = plink ? 1 : 0;
-    d->append((char*)&hasLinkCreationTs, 1);
+    byte flags = (plink ? COMPACT_EXPORTED : 0) | (inshare ? COMPACT_INSHARE : 0);
+    w.serializebyte(flags);
 
-    if (isExported && plink && plink->mAuthKey.size())
-    {
-        auto authKeySize = (char)plink->mAuthKey.size();
-        d->append((char*)&authKeySize, sizeof(authKeySize));
-        d->append(plink->mAuthKey.data(), authKeySize);
-    }
-    else
+    if (plink)
     {
-        d->append("", 1);
+        w.serializenodehandle(plink->ph);
+        w.serializevarint(uint64_t(plink->ets));
+        w.serializebool(plink->takendown);
+        w.serializevarint(uint64_t(plink->cts));
+        w.serializevarbytes(plink->mAuthKey);
     }
 
-    d->append("\0\0\0\0", 5); // Use these bytes for extensions
-
+    // outshares and pending shares, or the inshare
+    size_t numshares = 0;
     if (inshare)
     {
-        numshares = -1;
+        numshares = 1;
     }
     else
     {
-        numshares = 0;
-        if (outshares)
-        {
-            numshares += (short)outshares->size();
-        }
-        if (pendingshares)
-        {
-            numshares += (short)pendingshares->size();
-        }
+        numshares += outshares ? outshares->size() : 0;
+        numshares += pendingshares ? pendingshares->size() : 0;
+        w.serializevarint(numshares);
     }
 
-    d->append((char*)&numshares, sizeof numshares);
-
     if (numshares)
     {
         d->append((char*)sharekey->key, SymmCipher::KEYLENGTH);
@@ -589,18 +1256,14 @@ bool Node::serialize(string* d)
         }
         else
         {
-            if (outshares)
+            for (share_map* shares : { outshares, pendingshares })
             {
-                for (share_map::iterator it = outshares->begin(); it != outshares->end(); it++)
+                if (shares)
                 {
-                    it->second->serialize(d);
-                }
-            }
-            if (pendingshares)
-            {
-                for (share_map::iterator it = pendingshares->begin(); it != pendingshares->end(); it++)
-                {
-                    it->second->serialize(d);
+                    for (auto& share : *shares)
+                    {
+                        share.second->serialize(d);
+                    }
                 }
             }
         }
@@ -608,17 +1271,6 @@ bool Node::serialize(string* d)
 
     attrs.serialize(d);
 
-    if (isExported)
-    {
-        d->append((char*) &plink->ph, MegaClient::NODEHANDLE);
-        d->append((char*) &plink->ets, sizeof(plink->ets));
-        d->append((char*) &plink->takendown, sizeof(plink->takendown));
-        if (hasLinkCreationTs)
-        {
-            d->append((char*) &plink->cts, sizeof(plink->cts));
-        }
-    }
-
     return true;
 }
 
@@ -702,34 +1354,50 @@ SymmCipher* Node::nodecipher()
 // decrypt attributes and build attribute hash
 void Node::setattr()
 {
-    byte* buf;
     SymmCipher* cipher;
 
-    if (attrstring && (cipher = nodecipher()) && (buf = decryptattr(cipher, attrstring->c_str(), attrstring->size())))
+    if (attrstring && (cipher = nodecipher()) && decryptattrs(cipher, *attrstring, &attrs.map))
     {
-        JSON json;
-        nameid name;
-        string* t;
+        setfingerprint();
 
-        attrs.map.clear();
-        json.begin((char*)buf + 5);
+        attrstring.reset();
+        client->indexnodename(this);
 
-        while ((name = json.getnameid()) != EOO && json.storeobject((t = &attrs.map[name])))
+        if (parent)
         {
-            JSON::unescape(t);
-
-            if (name == 'n')
-            {
-                client->fsaccess->normalize(t);
-            }
+            parent->children.clearIndexes();
         }
+    }
+}
+
+bool Node::decryptattrs(SymmCipher* cipher, const string& attrstring, attr_map* attrs)
+{
+    byte* buf = decryptattr(cipher, attrstring.c_str(), attrstring.size());
+
+    if (!buf)
+    {
+        return false;
+    }
+
+    JSON json;
+    nameid name;
+    string* t;
 
-        setfingerprint();
+    attrs->clear();
+    json.begin((char*)buf + 5);
 
-        delete[] buf;
+    while ((name = json.getnameid()) != EOO && json.storeobject((t = &(*attrs)[name])))
+    {
+        JSON::unescape(t);
 
-        attrstring.reset();
+        if (name == 'n')
+        {
+            FileSystemAccess::normalize(t);
+        }
     }
+
+    delete[] buf;
+    return true;
 }
 
 // if present, configure FileFingerprint from attributes
@@ -758,7 +1426,10 @@ void Node::setfingerprint()
             mtime = ctime;
         }
 
-        client->mFingerprints.add(this);
+        if (!client->mLinkBrowser)
+        {
+            client->mFingerprints.add(this);
+        }
     }
 }
 
@@ -873,8 +1544,43 @@ int Node::hasfileattribute(const string *fileattrstring, fatype t)
     return static_cast<int>(fileattrstring->find(buf) + 1);
 }
 
+handle Node::fileattributehandle(const string *fileattrstring, fatype t)
+{
+    handle fah = UNDEF;
+    int p = hasfileattribute(fileattrstring, t);
+    if (!p || Base64::atob(strchr(fileattrstring->c_str() + p, '*') + 1, (byte*)&fah, sizeof(fah)) != sizeof(fah))
+    {
+        return UNDEF;
+    }
+    return fah;
+}
+
 // attempt to apply node key - sets nodekey to a raw key if successful
 bool Node::applykey()
+{
+    const char* k;
+    SymmCipher* sc;
+
+    if (!keysource(&k, &sc))
+    {
+        return false;
+    }
+
+    byte key[FILENODEKEYLENGTH];
+    unsigned keylength = (type == FILENODE) ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH;
+
+    if (client->decryptkey(k, key, keylength, sc, 0, nodehandle))
+    {
+        client->mAppliedKeyNodeCount++;
+        nodekeydata.assign((const char*)key, keylength);
+        setattr();
+    }
+
+    assert(keyApplied());
+    return true;
+}
+
+bool Node::keysource(const char** kp, SymmCipher** scp)
 {
     if (type > FOLDERNODE)
     {
@@ -949,27 +1655,90 @@ bool Node::applykey()
         }
     }
 
-    byte key[FILENODEKEYLENGTH];
-    unsigned keylength = (type == FILENODE) ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH;
+    *kp = k;
+    *scp = sc;
+    return true;
+}
 
-    if (client->decryptkey(k, key, keylength, sc, 0, nodehandle))
+void Node::setdecryptedkey(const byte* key, attr_map* decryptedattrs)
+{
+    client->mAppliedKeyNodeCount++;
+    nodekeydata.assign((const char*)key, (type == FILENODE) ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH);
+
+    if (decryptedattrs && attrstring)
     {
-        client->mAppliedKeyNodeCount++;
-        nodekeydata.assign((const char*)key, keylength);
-        setattr();
+        attrs.map.swap(*decryptedattrs);
+        setfingerprint();
+        attrstring.reset();
+        client->indexnodename(this);
+
+        if (parent)
+        {
+            parent->children.clearIndexes();
+        }
     }
+}
 
-    assert(keyApplied());
-    return true;
+NodeCounter Node::descendantCounts() const
+{
+    if (mDescendantCounts)
+    {
+        return *mDescendantCounts;
+    }
+
+    NodeCounter nc;
+    if (children.pending())
+    {
+        // no need to load the subtree just to count it
+        nc = client->mCachedNodeIndex->descendantCounts(nodehandle, type);
+    }
+    else if (children.empty())
+    {
+        return nc;
+    }
+    else
+    {
+        for (Node *child : children)
+        {
+            nc += child->subnodeCounts();
+        }
+    }
+
+    mDescendantCounts.reset(new NodeCounter(nc));
+    return nc;
 }
 
-NodeCounter Node::subnodeCounts() const
+void Node::updateAncestorCounts(bool add)
 {
     NodeCounter nc;
-    for (Node *child : children)
+    bool gotnc = false;
+
+    // those without counts yet will count everything when asked
+    for (Node* p = parent; p; p = p->parent)
     {
-        nc += child->subnodeCounts();
+        if (p->mDescendantCounts)
+        {
+            if (!gotnc)
+            {
+                nc = subnodeCounts();
+                gotnc = true;
+            }
+
+            if (add)
+            {
+                *p->mDescendantCounts += nc;
+            }
+            else
+            {
+                *p->mDescendantCounts -= nc;
+            }
+        }
     }
+}
+
+NodeCounter Node::subnodeCounts() const
+{
+    NodeCounter nc = descendantCounts();
     if (type == FILENODE)
     {
         nc.files += 1;
@@ -998,9 +1767,12 @@ bool Node::setparent(Node* p)
     NodeCounter nc;
     bool gotnc = false;
 
+    // nodes loaded from the local cache are already included in the counters
+    bool counted = !client->mLoadingCachedNodes;
+
     const Node *originalancestor = firstancestor();
     handle oah = originalancestor->nodehandle;
-    if (oah == client->rootnodes[0] || oah == client->rootnodes[1] || oah == client->rootnodes[2] || originalancestor->inshare)
+    if (counted && (oah == client->rootnodes[0] || oah == client->rootnodes[1] || oah == client->rootnodes[2] || originalancestor->inshare))
     {
         nc = subnodeCounts();
         gotnc = true;
@@ -1011,7 +1783,11 @@ bool Node::setparent(Node* p)
 
     if (parent)
     {
-        parent->children.erase(child_it);
+        if (counted)
+        {
+            updateAncestorCounts(false);
+        }
+        parent->children.remove(this);
     }
 
 #ifdef ENABLE_SYNC
@@ -1022,12 +1798,16 @@ bool Node::setparent(Node* p)
 
     if (parent)
     {
-        child_it = parent->children.insert(parent->children.end(), this);
+        parent->children.push_back(this);
+        if (counted)
+        {
+            updateAncestorCounts(true);
+        }
     }
 
     const Node* newancestor = firstancestor();
     handle nah = newancestor->nodehandle;
-    if (nah == client->rootnodes[0] || nah == client->rootnodes[1] || nah == client->rootnodes[2] || newancestor->inshare)
+    if (counted && (nah == client->rootnodes[0] || nah == client->rootnodes[1] || nah == client->rootnodes[2] || newancestor->inshare))
     {
         if (!gotnc)
         {
@@ -1191,6 +1971,7 @@ void LocalNode::setnameparent(LocalNode* newparent, const LocalPath* newlocalpat
     if (parent)
     {
         // remove existing child linkage
+        parent->setsyncdirty();
         parent->children.erase(&localname);
 
         if (slocalname)
@@ -1280,12 +2061,13 @@ void LocalNode::setnameparent(LocalNode* newparent, const LocalPath* newlocalpat
         }
 
         // (we don't construct a UTF-8 or sname for the root path)
-        parent->children[&localname] = this;
+        parent->children.set(&localname, this);
+        parent->setsyncdirty();
 
         if (newshortname && *newshortname != localname)
         {
-            slocalname = std::move(newshortname);
-            parent->schildren[slocalname.get()] = this;
+            slocalname = sync->client->pathcomponents.intern(*newshortname);
+            parent->schildren.set(slocalname.get(), this);
         }
         else
         {
@@ -1336,6 +2118,11 @@ void LocalNode::bumpnagleds()
     }
 
     nagleds = sync->client->waiter->ds + 11;
+
+    if (!changeds && sync->state() == SYNC_ACTIVE)
+    {
+        changeds = sync->client->waiter->ds;
+    }
 }
 
 LocalNode::LocalNode()
@@ -1344,7 +2131,29 @@ LocalNode::LocalNode()
 , reported{false}
 , checked{false}
 , needsRescan(false)
-{}
+, syncdowndirty(true)
+, syncupdirty(true)
+{
+    CodeCounter::accountMemory(CodeCounter::MEM_LOCALNODES, sizeof(LocalNode));
+}
+
+void LocalNode::setsyncdowndirty()
+{
+    // all the way up: a folder skipped by a pass (not linked to its node yet) keeps its flag
+    // while its parent was cleared
+    for (LocalNode* l = this; l; l = l->parent)
+    {
+        l->syncdowndirty = true;
+    }
+}
+
+void LocalNode::setsyncupdirty()
+{
+    for (LocalNode* l = this; l; l = l->parent)
+    {
+        l->syncupdirty = true;
+    }
+}
 
 // initialize fresh LocalNode object - must be called exactly once
 void LocalNode::init(Sync* csync, nodetype_t ctype, LocalNode* cparent, const LocalPath& cfullpath, std::unique_ptr<LocalPath> shortname)
@@ -1360,7 +2169,7 @@ void LocalNode::init(Sync* csync, nodetype_t ctype, LocalNode* cparent, const Lo
     syncxfer = true;
     newnode.reset();
     parent_dbid = 0;
-    slocalname = NULL;
+    slocalname.reset();
 
     ts = TREESTATE_NONE;
     dts = TREESTATE_NONE;
@@ -1377,14 +2186,17 @@ void LocalNode::init(Sync* csync, nodetype_t ctype, LocalNode* cparent, const Lo
     else
     {
         localname = cfullpath;
-        slocalname.reset(shortname && *shortname != localname ? shortname.release() : nullptr);
+        if (shortname && *shortname != localname)
+        {
+            slocalname = sync->client->pathcomponents.intern(*shortname);
+        }
         name = localname.toPath(*sync->client->fsaccess);
     }
 
     scanseqno = sync->scanseqno;
 
     // mark fsid as not valid
-    fsid_it = sync->client->fsidnode.end();
+    fsid_indexed = false;
 
     // enable folder notification
     if (type == FOLDERNODE && sync->dirnotify)
@@ -1471,6 +2283,12 @@ void LocalNode::setnode(Node* cnode)
     {
         cnode->localnode.reset();
         node.crossref(cnode, this);
+
+        if (changeds && type == FILENODE && *static_cast<FileFingerprint*>(cnode) == *this)
+        {
+            sync->addLatency(sync->client->waiter->ds - changeds);
+            changeds = 0;
+        }
     }
 }
 
@@ -1514,32 +2332,34 @@ void LocalNode::setfsid(handle newfsid, handlelocalnode_map& fsidnodes)
         return;
     }
 
-    if (fsid_it != fsidnodes.end())
+    if (fsid_indexed)
     {
         if (newfsid == fsid)
         {
             return;
         }
 
-        fsidnodes.erase(fsid_it);
+        fsidnodes.erase(fsid);
     }
 
     fsid = newfsid;
 
     pair<handlelocalnode_map::iterator, bool> r = fsidnodes.insert(std::make_pair(fsid, this));
 
-    fsid_it = r.first;
+    fsid_indexed = true;
 
     if (!r.second)
     {
         // remove previous fsid assignment (the node is likely about to be deleted)
-        fsid_it->second->fsid_it = fsidnodes.end();
-        fsid_it->second = this;
+        r.first->second->fsid_indexed = false;
+        r.first->second = this;
     }
 }
 
 LocalNode::~LocalNode()
 {
+    CodeCounter::accountMemory(CodeCounter::MEM_LOCALNODES, -int64_t(sizeof(LocalNode)));
+
     if (!sync)
     {
         LOG_err << "LocalNode::init() was never called";
@@ -1576,9 +2396,9 @@ LocalNode::~LocalNode()
     }
 
     // remove from fsidnode map, if present
-    if (fsid_it != sync->client->fsidnode.end())
+    if (fsid_indexed)
     {
-        sync->client->fsidnode.erase(fsid_it);
+        sync->client->fsidnode.erase(fsid);
     }
 
     sync->client->totalLocalNodes--;
@@ -1664,15 +2484,30 @@ void LocalNode::getlocalpath(LocalPath& path) const
         return;
     }
 
-    path.erase();
-
+    // sync root has absolute path, the rest are just their leafname.  Joined in one go, into the path's buffer
+    size_t depth = 0;
     for (const LocalNode* l = this; l != nullptr; l = l->parent)
     {
         assert(!l->parent || l->parent->sync == sync);
+        depth++;
+    }
+
+    const LocalPath* stacknames[64];
+    vector<const LocalPath*> heapnames;
+    const LocalPath** names = stacknames;
+    if (depth > sizeof stacknames / sizeof *stacknames)
+    {
+        heapnames.resize(depth);
+        names = heapnames.data();
+    }
 
-        // sync root has absolute path, the rest are just their leafname
-        path.prependWithSeparator(l->localname);
+    size_t i = 0;
+    for (const LocalNode* l = this; l != nullptr; l = l->parent)
+    {
+        names[i++] = &l->localname;
     }
+
+    path.assignFromLeaf(names, depth);
 }
 
 string LocalNode::localnodedisplaypath(FileSystemAccess& fsa) const
@@ -1746,27 +2581,44 @@ void LocalNode::completed(Transfer* t, LocalNode*)
 // - fingerprint crc/mtime (filenodes only)
 bool LocalNode::serialize(string* d)
 {
+    // the compact layout, see COMPACT_RECORD.  The short name is stored even if it's the same: storing it is much,
+    // much faster than looking it up on startup.
+    byte flags = (slocalname ? COMPACT_SHORTNAME : 0) | (scanmtime ? COMPACT_SCANMTIME : 0);
+
     CacheableWriter w(*d);
-    w.serializei64(type ? -type : size);
-    w.serializehandle(fsid);
     w.serializeu32(parent ? parent->dbid : 0);
+    w.serializebyte(byte(type));
+    w.serializebyte(mSyncable);
+    w.serializebyte(flags);
+    w.serializebyte(COMPACT_RECORD);
+    w.serializevarint(fsid);
     w.serializenodehandle(node ? node->nodehandle : UNDEF);
-    w.serializestring(localname.platformEncoded());
+    w.serializevarbytes(localname.platformEncoded());
     if (type == FILENODE)
     {
         w.serializebinary((byte*)crc.data(), sizeof(crc));
-        w.serializecompressed64(mtime);
+        w.serializevarint(uint64_t(size));
+        w.serializevarint(uint64_t(mtime));
+    }
+    if (slocalname)
+    {
+        w.serializevarbytes(slocalname->platformEncoded());
+    }
+    if (scanmtime)
+    {
+        w.serializevarint(uint64_t(scanmtime));
     }
-    w.serializebyte(mSyncable);
-    w.serializeexpansionflags(1);  // first flag indicates we are storing slocalname.  Storing it is much, much faster than looking it up on startup.
-    auto tmpstr = slocalname ? slocalname->platformEncoded() : string();
-    w.serializepstr(slocalname ? &tmpstr : nullptr);
 
     return true;
 }
 
 LocalNode* LocalNode::unserialize(Sync* sync, const string* d)
 {
+    if (d->size() >= 8 && byte((*d)[7]) == COMPACT_RECORD)
+    {
+        return unserializeCompact(sync, d);
+    }
+
     if (d->size() < sizeof(m_off_t)         // type/size combo
                   + sizeof(handle)          // fsid
                   + sizeof(uint32_t)        // parent dbid
@@ -1800,6 +2652,7 @@ LocalNode* LocalNode::unserialize(Sync* sync, const string* d)
     handle h = 0;
     string localname, shortname;
     uint64_t mtime = 0;
+    uint64_t scanmtime = 0;
     int32_t crc[4];
     memset(crc, 0, sizeof crc);
     byte syncable = 1;
@@ -1812,8 +2665,9 @@ LocalNode* LocalNode::unserialize(Sync* sync, const string* d)
         (type == FILENODE && !r.unserializebinary((byte*)crc, sizeof(crc))) ||
         (type == FILENODE && !r.unserializecompressed64(mtime)) ||
         (r.hasdataleft() && !r.unserializebyte(syncable)) ||
-        (r.hasdataleft() && !r.unserializeexpansionflags(expansionflags, 1)) ||
-        (expansionflags[0] && !r.unserializecstr(shortname, false)))
+        (r.hasdataleft() && !r.unserializeexpansionflags(expansionflags, 2)) ||
+        (expansionflags[0] && !r.unserializecstr(shortname, false)) ||
+        (expansionflags[1] && !r.unserializecompressed64(scanmtime)))
     {
         LOG_err << "LocalNode unserialization failed at field " << r.fieldnum;
         return nullptr;
@@ -1828,15 +2682,19 @@ LocalNode* LocalNode::unserialize(Sync* sync, const string* d)
     l->parent_dbid = parent_dbid;
 
     l->fsid = fsid;
-    l->fsid_it = sync->client->fsidnode.end();
+    l->fsid_indexed = false;
 
     l->localname = LocalPath::fromPlatformEncoded(localname);
-    l->slocalname.reset(shortname.empty() ? nullptr : new LocalPath(LocalPath::fromPlatformEncoded(shortname)));
+    if (!shortname.empty())
+    {
+        l->slocalname = sync->client->pathcomponents.intern(LocalPath::fromPlatformEncoded(shortname));
+    }
     l->slocalname_in_db = 0 != expansionflags[0];
     l->name = l->localname.toName(*sync->client->fsaccess, sync->mFilesystemType);
 
     memcpy(l->crc.data(), crc, sizeof crc);
     l->mtime = mtime;
+    l->scanmtime = scanmtime;
     l->isvalid = true;
 
     l->node.store_unchecked(sync->client->nodebyhandle(h));
@@ -1853,38 +2711,170 @@ LocalNode* LocalNode::unserialize(Sync* sync, const string* d)
     return l;
 }
 
+// the compact layout, written by serialize(): the names are read in place
+LocalNode* LocalNode::unserializeCompact(Sync* sync, const string* d)
+{
+    CacheableReader r(*d);
+    uint32_t parent_dbid;
+    byte type, syncable, flags, version;
+    uint64_t fsid, size = 0, mtime = 0, scanmtime = 0;
+    handle h;
+    const char* name;
+    const char* shortname = nullptr;
+    size_t namelen, shortnamelen = 0;
+    int32_t crc[4] = { 0 };
+
+    if (!r.unserializeu32(parent_dbid) ||
+        !r.unserializebyte(type) ||
+        !r.unserializebyte(syncable) ||
+        !r.unserializebyte(flags) ||
+        !r.unserializebyte(version) ||
+        version != COMPACT_RECORD ||
+        (type != FILENODE && type != FOLDERNODE) ||
+        !r.unserializevarint(fsid) ||
+        !r.unserializenodehandle(h) ||
+        !r.unserializevarbytes(name, namelen) ||
+        (type == FILENODE && !r.unserializebinary((byte*)crc, sizeof(crc))) ||
+        (type == FILENODE && !r.unserializevarint(size)) ||
+        (type == FILENODE && !r.unserializevarint(mtime)) ||
+        ((flags & COMPACT_SHORTNAME) && !r.unserializevarbytes(shortname, shortnamelen)) ||
+        ((flags & COMPACT_SCANMTIME) && !r.unserializevarint(scanmtime)) ||
+        r.hasdataleft())
+    {
+        LOG_err << "LocalNode unserialization failed at field " << r.fieldnum;
+        return nullptr;
+    }
+
+    LocalNode* l = new LocalNode();
+
+    l->type = nodetype_t(type);
+    l->size = m_off_t(size);
+
+    l->parent_dbid = parent_dbid;
+
+    l->fsid = fsid;
+    l->fsid_indexed = false;
+
+    l->localname = LocalPath::fromPlatformEncoded(string(name, namelen));
+    if (shortname)
+    {
+        l->slocalname = sync->client->pathcomponents.intern(LocalPath::fromPlatformEncoded(string(shortname, shortnamelen)));
+    }
+    l->slocalname_in_db = true;
+    l->name = l->localname.toName(*sync->client->fsaccess, sync->mFilesystemType);
+
+    memcpy(l->crc.data(), crc, sizeof crc);
+    l->mtime = m_time_t(mtime);
+    l->scanmtime = m_time_t(scanmtime);
+    l->isvalid = true;
+
+    l->node.store_unchecked(sync->client->nodebyhandle(h));
+    l->parent = nullptr;
+    l->sync = sync;
+    l->mSyncable = syncable == 1;
+
+    l->created = false;
+    l->reported = false;
+    l->checked = h != UNDEF;
+    l->needsRescan = false;
+
+    return l;
+}
+
 #endif
 
-void Fingerprints::newnode(Node* n)
+size_t Fingerprints::hashOf(const FileFingerprint& fp)
+{
+    size_t h = 0;
+    hashCombine(h, fp.size);
+    hashCombine(h, fp.mtime);
+    for (int32_t c : fp.crc)
+    {
+        hashCombine(h, c);
+    }
+    return h;
+}
+
+size_t Fingerprints::hashOf(m_off_t size)
+{
+    uint64_t x = static_cast<uint64_t>(size);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return static_cast<size_t>(x);
+}
+
+Node** Fingerprints::bucket(const FileFingerprint& fp)
 {
-    if (n->type == FILENODE)
+    return &mBuckets[hashOf(fp) & (mBuckets.size() - 1)];
+}
+
+void Fingerprints::link(Node* n)
+{
+    Node** head = bucket(*n);
+    n->fingerprint_next = *head;
+    n->fingerprint_pprev = head;
+    if (*head)
     {
-        n->fingerprint_it = mFingerprints.end();
+        (*head)->fingerprint_pprev = &n->fingerprint_next;
     }
+    *head = n;
 }
 
 void Fingerprints::add(Node* n)
 {
-    if (n->type == FILENODE)
+    if (n->type == FILENODE && !n->fingerprint_pprev)
     {
-        n->fingerprint_it = mFingerprints.insert(n);
+        // keep chains at about one node on average
+        if (mCount >= mBuckets.size())
+        {
+            rehash(std::max<size_t>(64, mBuckets.size() * 2));
+        }
+
+        link(n);
+        ++mCount;
+        addSize(n->size);
         mSumSizes += n->size;
     }
 }
 
 void Fingerprints::remove(Node* n)
 {
-    if (n->type == FILENODE && n->fingerprint_it != mFingerprints.end())
+    if (n->type == FILENODE && n->fingerprint_pprev)
     {
+        *n->fingerprint_pprev = n->fingerprint_next;
+        if (n->fingerprint_next)
+        {
+            n->fingerprint_next->fingerprint_pprev = n->fingerprint_pprev;
+        }
+
+        --mCount;
+        removeSize(n->size);
         mSumSizes -= n->size;
-        mFingerprints.erase(n->fingerprint_it);
-        n->fingerprint_it = mFingerprints.end();
+
+        n->fingerprint_next = nullptr;
+        n->fingerprint_pprev = nullptr;
     }
 }
 
 void Fingerprints::clear()
 {
-    mFingerprints.clear();
+    // the nodes may outlive the table
+    for (Node* n : mBuckets)
+    {
+        while (n)
+        {
+            Node* next = n->fingerprint_next;
+            n->fingerprint_next = nullptr;
+            n->fingerprint_pprev = nullptr;
+            n = next;
+        }
+    }
+
+    vector<Node*>().swap(mBuckets);
+    mCount = 0;
+    vector<pair<m_off_t, size_t>>().swap(mSizes);
+    mDistinctSizes = 0;
     mSumSizes = 0;
 }
 
@@ -1893,21 +2883,132 @@ m_off_t Fingerprints::getSumSizes()
     return mSumSizes;
 }
 
+void Fingerprints::rehash(size_t buckets)
+{
+    assert(!(buckets & (buckets - 1)));
+
+    vector<Node*> old(buckets);
+    old.swap(mBuckets);
+
+    for (Node* n : old)
+    {
+        while (n)
+        {
+            Node* next = n->fingerprint_next;
+            link(n);
+            n = next;
+        }
+    }
+}
+
 Node* Fingerprints::nodebyfingerprint(FileFingerprint* fingerprint)
 {
-    fingerprint_set::iterator it = mFingerprints.find(fingerprint);
-    return it == mFingerprints.end() ? nullptr : static_cast<Node*>(*it);
+    if (!mCount)
+    {
+        return nullptr;
+    }
+
+    for (Node* n = *bucket(*fingerprint); n; n = n->fingerprint_next)
+    {
+        if (!FileFingerprintCmp()(n, fingerprint) && !FileFingerprintCmp()(fingerprint, n))
+        {
+            return n;
+        }
+    }
+    return nullptr;
 }
 
 node_vector *Fingerprints::nodesbyfingerprint(FileFingerprint* fingerprint)
 {
     node_vector *nodes = new node_vector();
-    auto p = mFingerprints.equal_range(fingerprint);
-    for (iterator it = p.first; it != p.second; ++it)
+    if (mCount)
     {
-        nodes->push_back(static_cast<Node*>(*it));
+        for (Node* n = *bucket(*fingerprint); n; n = n->fingerprint_next)
+        {
+            if (!FileFingerprintCmp()(n, fingerprint) && !FileFingerprintCmp()(fingerprint, n))
+            {
+                nodes->push_back(n);
+            }
+        }
     }
     return nodes;
 }
 
+bool Fingerprints::hasSize(m_off_t size) const
+{
+    return mDistinctSizes && mSizes[probeSize(size)].second;
+}
+
+size_t Fingerprints::probeSize(m_off_t size) const
+{
+    assert(!mSizes.empty());
+
+    size_t mask = mSizes.size() - 1;
+    size_t i = hashOf(size) & mask;
+    while (mSizes[i].second && mSizes[i].first != size)
+    {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void Fingerprints::addSize(m_off_t size)
+{
+    // keep the load factor at or below 3/4
+    if ((mDistinctSizes + 1) * 4 > mSizes.size() * 3)
+    {
+        vector<pair<m_off_t, size_t>> old(std::max<size_t>(16, mSizes.size() * 2));
+        old.swap(mSizes);
+
+        for (auto& e : old)
+        {
+            if (e.second)
+            {
+                mSizes[probeSize(e.first)] = e;
+            }
+        }
+    }
+
+    auto& e = mSizes[probeSize(size)];
+    if (!e.second++)
+    {
+        e.first = size;
+        ++mDistinctSizes;
+    }
+}
+
+void Fingerprints::removeSize(m_off_t size)
+{
+    size_t i = probeSize(size);
+    assert(mSizes[i].second);
+
+    if (--mSizes[i].second)
+    {
+        return;
+    }
+
+    // backward-shift deletion, as in NodeStore::erase()
+    size_t mask = mSizes.size() - 1;
+    size_t j = i;
+    for (;;)
+    {
+        j = (j + 1) & mask;
+        if (!mSizes[j].second)
+        {
+            break;
+        }
+
+        size_t home = hashOf(mSizes[j].first) & mask;
+        bool inRun = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!inRun)
+        {
+            mSizes[i] = mSizes[j];
+            i = j;
+        }
+    }
+
+    mSizes[i] = pair<m_off_t, size_t>();
+    --mDistinctSizes;
+}
+
 } // namespace
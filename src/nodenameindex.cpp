@@ -0,0 +1,186 @@
+/**
+ * @file nodenameindex.cpp
+ * @brief Flat index of node names for substring searches, and index of the file nodes by type
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include "mega/nodenameindex.h"
+
+namespace mega {
+
+static char lowercase(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+}
+
+uint32_t NodeNameIndex::set(uint32_t slot, handle h, const char* name)
+{
+    remove(slot);
+
+    if (mEntries.size() >= NONE || mNames.size() + strlen(name) + 1 > NONE)
+    {
+        return NONE;
+    }
+
+    Entry e;
+    e.h = h;
+    e.offset = uint32_t(mNames.size());
+
+    for (const char* c = name; *c; c++)
+    {
+        mNames.push_back(lowercase(*c));
+    }
+    mNames.push_back(0);
+
+    e.length = uint32_t(mNames.size() - e.offset - 1);
+    mEntries.push_back(e);
+
+    return uint32_t(mEntries.size() - 1);
+}
+
+void NodeNameIndex::remove(uint32_t slot)
+{
+    if (slot < mEntries.size() && mEntries[slot].h != UNDEF)
+    {
+        mEntries[slot].h = UNDEF;
+        mRemoved++;
+        mRemovedBytes += mEntries[slot].length + 1;
+    }
+}
+
+void NodeNameIndex::find(const char* substring, vector<handle>& results) const
+{
+    string needle;
+    for (const char* c = substring; c && *c; c++)
+    {
+        needle.push_back(lowercase(*c));
+    }
+
+    if (needle.empty())
+    {
+        for (auto& e : mEntries)
+        {
+            if (e.h != UNDEF)
+            {
+                results.push_back(e.h);
+            }
+        }
+        return;
+    }
+
+    const char* begin = mNames.data();
+    const char* end = begin + mNames.size();
+    const char* p = begin;
+    auto entry = mEntries.begin();
+
+    while (end - p >= ptrdiff_t(needle.size()))
+    {
+        p = static_cast<const char*>(memchr(p, needle[0], size_t(end - p) - needle.size() + 1));
+        if (!p)
+        {
+            break;
+        }
+
+        if (memcmp(p + 1, needle.data() + 1, needle.size() - 1))
+        {
+            p++;
+            continue;
+        }
+
+        // the name it's in (the matches come in order)
+        uint32_t offset = uint32_t(p - begin);
+        entry = std::upper_bound(entry, mEntries.end(), offset, [](uint32_t o, const Entry& e) { return o < e.offset; }) - 1;
+
+        if (entry->h != UNDEF)
+        {
+            results.push_back(entry->h);
+        }
+
+        // one match per name
+        p = begin + entry->offset + entry->length + 1;
+    }
+}
+
+void NodeNameIndex::compact(std::function<void(handle, uint32_t)> moved)
+{
+    if (mRemovedBytes < mNames.size() / 2)
+    {
+        return;
+    }
+
+    string names;
+    names.reserve(mNames.size() - mRemovedBytes);
+
+    size_t slot = 0;
+    for (auto& e : mEntries)
+    {
+        if (e.h == UNDEF)
+        {
+            continue;
+        }
+
+        Entry n = e;
+        n.offset = uint32_t(names.size());
+        names.append(mNames, e.offset, e.length + 1);
+
+        mEntries[slot] = n;
+        moved(n.h, uint32_t(slot++));
+    }
+
+    mEntries.resize(slot);
+    mNames.swap(names);
+    mRemoved = 0;
+    mRemovedBytes = 0;
+}
+
+void NodeNameIndex::clear()
+{
+    mNames.clear();
+    mNames.shrink_to_fit();
+    mEntries.clear();
+    mEntries.shrink_to_fit();
+    mRemoved = 0;
+    mRemovedBytes = 0;
+    built = false;
+}
+
+void NodeTypeIndex::set(handle h, unsigned types)
+{
+    for (int t = 1; t <= TYPES; t++)
+    {
+        if (types & (1u << t))
+        {
+            mNodes[t].insert(h);
+        }
+        else
+        {
+            mNodes[t].erase(h);
+        }
+    }
+}
+
+void NodeTypeIndex::clear()
+{
+    for (auto& n : mNodes)
+    {
+        n.clear();
+    }
+    built = false;
+}
+
+} // namespace
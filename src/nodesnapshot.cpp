@@ -0,0 +1,298 @@
+/**
+ * @file nodesnapshot.cpp
+ * @brief Snapshot of the node records of the local cache
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include "mega/nodesnapshot.h"
+#include "mega/logging.h"
+#include "mega/utils.h"
+
+namespace mega {
+
+namespace {
+
+enum BlockType : byte { BLOCK_FULL = 1, BLOCK_CHANGES = 2 };
+
+// length prefix of every block
+const size_t BLOCK_HEADER = sizeof(uint32_t);
+
+void serializeRecord(CacheableWriter& w, const NodeSnapshot::Record& r)
+{
+    w.serializenodehandle(r.h);
+    w.serializehandle(r.parent);
+    w.serializei64(r.size);
+    w.serializeu32(r.dbid);
+    w.serializebyte(static_cast<byte>(r.type));
+}
+
+bool unserializeRecord(CacheableReader& r, NodeSnapshot::Record& record)
+{
+    int64_t size;
+    byte type;
+
+    if (!r.unserializenodehandle(record.h)
+            || !r.unserializehandle(record.parent)
+            || !r.unserializei64(size)
+            || !r.unserializeu32(record.dbid)
+            || !r.unserializebyte(type))
+    {
+        return false;
+    }
+
+    record.size = size;
+    record.type = static_cast<nodetype_t>(static_cast<signed char>(type));
+    return true;
+}
+
+// start a block, its length is filled in by endBlock()
+void beginBlock(string& d, BlockType type)
+{
+    d.assign(BLOCK_HEADER, '\0');
+    d.push_back(static_cast<char>(type));
+}
+
+void endBlock(string& d)
+{
+    uint32_t length = static_cast<uint32_t>(d.size() - BLOCK_HEADER);
+    memcpy(&d[0], &length, sizeof length);
+}
+
+} // namespace
+
+NodeSnapshot::NodeSnapshot(FileSystemAccess& fsAccess, const LocalPath& path)
+    : mFsAccess(fsAccess)
+    , mPath(path)
+{
+}
+
+bool NodeSnapshot::write(handle scsn, const vector<Record>& records)
+{
+    string d;
+    d.reserve(BLOCK_HEADER + 32 * (records.size() + 1));
+    beginBlock(d, BLOCK_FULL);
+
+    CacheableWriter w(d);
+    w.serializehandle(scsn);
+    w.serializeu32(static_cast<uint32_t>(records.size()));
+    for (const Record& r : records)
+    {
+        serializeRecord(w, r);
+    }
+    endBlock(d);
+
+    mScsn = UNDEF;
+    if (!store(d, 0, true))
+    {
+        return false;
+    }
+
+    mScsn = scsn;
+    mEnd = m_off_t(d.size());
+    mRecords = records.size();
+    mChanges = 0;
+    return true;
+}
+
+bool NodeSnapshot::append(handle scsn, const vector<Record>& updated, const handle_vector& removed)
+{
+    if (mScsn == UNDEF)
+    {
+        return false;
+    }
+
+    string d;
+    beginBlock(d, BLOCK_CHANGES);
+
+    CacheableWriter w(d);
+    w.serializehandle(mScsn);
+    w.serializehandle(scsn);
+    w.serializeu32(static_cast<uint32_t>(updated.size()));
+    for (const Record& r : updated)
+    {
+        serializeRecord(w, r);
+    }
+    w.serializeu32(static_cast<uint32_t>(removed.size()));
+    for (handle h : removed)
+    {
+        w.serializenodehandle(h);
+    }
+    endBlock(d);
+
+    // anything after mEnd (eg. changes beyond the SCSN of the database, after a crash) is overwritten
+    if (!store(d, mEnd, false))
+    {
+        mScsn = UNDEF;
+        return false;
+    }
+
+    mScsn = scsn;
+    mEnd += m_off_t(d.size());
+    mChanges += updated.size() + removed.size();
+    return true;
+}
+
+bool NodeSnapshot::read(handle scsn, CachedNodeIndex& index)
+{
+    mScsn = UNDEF;
+
+    auto fa = mFsAccess.newfileaccess(false);
+    string d;
+    if (!fa->fopen(mPath, true, false) || !fa->fread(&d, static_cast<unsigned>(fa->size), 0, 0))
+    {
+        return false;
+    }
+    fa.reset();
+
+    vector<Record> records;
+
+    // latest change of each node: false if it was removed
+    map<handle, pair<bool, Record>> changes;
+
+    handle current = UNDEF;
+    size_t offset = 0;
+
+    // blocks are applied until the file is at the requested SCSN: later ones may be from writes the database lost
+    while (current != scsn)
+    {
+        uint32_t length;
+        if (d.size() - offset < BLOCK_HEADER + 1)
+        {
+            return false;
+        }
+        memcpy(&length, d.data() + offset, sizeof length);
+        if (!length || d.size() - offset - BLOCK_HEADER < length)
+        {
+            return false;
+        }
+
+        CacheableReader r(d);
+        r.ptr = d.data() + offset + BLOCK_HEADER;
+        r.end = r.ptr + length;
+
+        byte type;
+        handle from = UNDEF;
+        handle previous = current;
+        uint32_t count;
+        Record record;
+
+        if (!r.unserializebyte(type)
+                || (type == BLOCK_CHANGES && !r.unserializehandle(from))
+                || !r.unserializehandle(current)
+                || !r.unserializeu32(count))
+        {
+            return false;
+        }
+
+        if (type == BLOCK_FULL && !offset)
+        {
+            records.reserve(count);
+            while (count--)
+            {
+                if (!unserializeRecord(r, record))
+                {
+                    return false;
+                }
+                records.push_back(record);
+            }
+        }
+        else if (type == BLOCK_CHANGES && offset && from == previous)
+        {
+            while (count--)
+            {
+                if (!unserializeRecord(r, record))
+                {
+                    return false;
+                }
+                changes[record.h] = std::make_pair(true, record);
+            }
+
+            if (!r.unserializeu32(count))
+            {
+                return false;
+            }
+
+            while (count--)
+            {
+                if (!r.unserializenodehandle(record.h))
+                {
+                    return false;
+                }
+                changes[record.h].first = false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+
+        if (r.hasdataleft())
+        {
+            return false;
+        }
+
+        offset += BLOCK_HEADER + length;
+    }
+
+    size_t changed = 0;
+    for (const Record& r : records)
+    {
+        if (changes.find(r.h) == changes.end())
+        {
+            index.add(r.h, r.parent, r.type, r.size, r.dbid);
+        }
+    }
+    for (auto& c : changes)
+    {
+        if (c.second.first)
+        {
+            const Record& r = c.second.second;
+            index.add(r.h, r.parent, r.type, r.size, r.dbid);
+        }
+        ++changed;
+    }
+
+    LOG_debug << "Node snapshot read: " << records.size() << " records, " << changed << " changes";
+
+    mScsn = scsn;
+    mEnd = m_off_t(offset);
+    mRecords = records.size();
+    mChanges = changed;
+    return true;
+}
+
+void NodeSnapshot::remove()
+{
+    mScsn = UNDEF;
+    mFsAccess.unlinklocal(mPath);
+}
+
+bool NodeSnapshot::store(const string& block, m_off_t offset, bool truncate)
+{
+    auto fa = mFsAccess.newfileaccess(false);
+    if (!fa->fopen(mPath, false, true)
+            || (truncate && !fa->ftruncate())
+            || !fa->fwrite(reinterpret_cast<const byte*>(block.data()), static_cast<unsigned>(block.size()), offset))
+    {
+        LOG_err << "Unable to write node snapshot: " << mPath.toPath(mFsAccess);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
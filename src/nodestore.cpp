@@ -0,0 +1,411 @@
+/**
+ * @file nodestore.cpp
+ * @brief Hashed storage of the in-memory node tree
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include "mega/nodestore.h"
+
+namespace mega {
+
+namespace {
+
+// keep blocks suitably aligned for any object type
+size_t roundUpToAlignment(size_t n)
+{
+    const size_t a = alignof(std::max_align_t);
+    n = std::max(n, sizeof(void*));
+    return (n + a - 1) / a * a;
+}
+
+void* defaultAllocateSlab(size_t size)
+{
+    return ::operator new(size);
+}
+
+void defaultReleaseSlab(void* p, size_t)
+{
+    ::operator delete(p);
+}
+
+std::atomic<FixedSizeAllocator::AllocateFunction> allocateSlab(defaultAllocateSlab);
+std::atomic<FixedSizeAllocator::ReleaseFunction> releaseSlab(defaultReleaseSlab);
+
+} // namespace
+
+void FixedSizeAllocator::setSlabFunctions(AllocateFunction allocate, ReleaseFunction release)
+{
+    assert(!allocate == !release);
+    allocateSlab = allocate ? allocate : defaultAllocateSlab;
+    releaseSlab = release ? release : defaultReleaseSlab;
+}
+
+FixedSizeAllocator::FixedSizeAllocator(size_t objectSize, size_t objectsPerSlab, CodeCounter::Gauge* account, bool keepOneSlab)
+    : mObjectSize(roundUpToAlignment(objectSize))
+    , mObjectsPerSlab(std::max<size_t>(objectsPerSlab, 1))
+    , mAccount(account)
+    , mKeepOneSlab(keepOneSlab)
+{
+}
+
+FixedSizeAllocator::~FixedSizeAllocator()
+{
+    assert(!mLive);
+    releaseSlabs(false);
+}
+
+void* FixedSizeAllocator::allocate()
+{
+    lock_guard<mutex> g(mMutex);
+
+    void* p;
+    if (mFreeList)
+    {
+        p = mFreeList;
+        mFreeList = mFreeList->next;
+    }
+    else
+    {
+        if (mBump == mBumpEnd)
+        {
+            mBump = static_cast<char*>(allocateSlab.load()(mObjectSize * mObjectsPerSlab));
+            mBumpEnd = mBump + mObjectSize * mObjectsPerSlab;
+            mSlabs.push_back(mBump);
+
+            if (mAccount)
+            {
+                mAccount->add(int64_t(mObjectSize * mObjectsPerSlab));
+            }
+        }
+
+        p = mBump;
+        mBump += mObjectSize;
+    }
+
+    ++mLive;
+    return p;
+}
+
+void FixedSizeAllocator::deallocate(void* p)
+{
+    if (!p)
+    {
+        return;
+    }
+
+    lock_guard<mutex> g(mMutex);
+
+    assert(mLive);
+    FreeBlock* b = static_cast<FreeBlock*>(p);
+    b->next = mFreeList;
+    mFreeList = b;
+
+    if (!--mLive)
+    {
+        // eg. after purgenodes(): give the memory back rather than keeping a free list of millions of blocks
+        releaseSlabs(mKeepOneSlab);
+    }
+}
+
+size_t FixedSizeAllocator::liveObjects() const
+{
+    lock_guard<mutex> g(mMutex);
+    return mLive;
+}
+
+size_t FixedSizeAllocator::slabs() const
+{
+    lock_guard<mutex> g(mMutex);
+    return mSlabs.size();
+}
+
+void FixedSizeAllocator::releaseSlabs(bool keepOne)
+{
+    size_t kept = keepOne && !mSlabs.empty() ? 1 : 0;
+    size_t slabSize = mObjectSize * mObjectsPerSlab;
+
+    if (mAccount)
+    {
+        mAccount->add(-int64_t(slabSize * (mSlabs.size() - kept)));
+    }
+
+    for (size_t i = kept; i < mSlabs.size(); ++i)
+    {
+        releaseSlab.load()(mSlabs[i], slabSize);
+    }
+    mSlabs.resize(kept);
+    mFreeList = nullptr;
+
+    // all the blocks of the one kept are free again
+    mBump = kept ? static_cast<char*>(mSlabs[0]) : nullptr;
+    mBumpEnd = kept ? mBump + slabSize : nullptr;
+}
+
+size_t NodeStore::hashOf(NodeHandle h)
+{
+    // handles are mostly random already, but mix so that sequential ones (eg. in tests) spread too
+    uint64_t x = h.as8byte();
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return static_cast<size_t>(x);
+}
+
+size_t NodeStore::probe(NodeHandle h) const
+{
+    assert(!mSlots.empty());
+
+    size_t i = hashOf(h) & mask();
+    while (mSlots[i].second && mSlots[i].first != h)
+    {
+        i = (i + 1) & mask();
+    }
+    return i;
+}
+
+void NodeStore::add(NodeHandle h, Node* n)
+{
+    assert(n);
+    assert(!h.isUndef());
+
+    // keep the load factor at or below 3/4
+    if ((mCount + 1) * 4 > mSlots.size() * 3)
+    {
+        rehash(std::max<size_t>(16, mSlots.size() * 2));
+    }
+
+    size_t i = probe(h);
+    if (!mSlots[i].second)
+    {
+        ++mCount;
+    }
+    mSlots[i].first = h;
+    mSlots[i].second = n;
+}
+
+size_t NodeStore::erase(NodeHandle h)
+{
+    if (!mCount)
+    {
+        return 0;
+    }
+
+    size_t i = probe(h);
+    if (!mSlots[i].second)
+    {
+        return 0;
+    }
+
+    // backward-shift deletion: pull later members of the probe run into the hole so no tombstones are needed
+    size_t j = i;
+    for (;;)
+    {
+        j = (j + 1) & mask();
+        if (!mSlots[j].second)
+        {
+            break;
+        }
+
+        size_t home = hashOf(mSlots[j].first) & mask();
+
+        // leave the entry where it is if its home lies cyclically within (i, j]
+        bool inRun = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!inRun)
+        {
+            mSlots[i] = mSlots[j];
+            i = j;
+        }
+    }
+
+    mSlots[i] = value_type();
+    --mCount;
+    return 1;
+}
+
+NodeStore::iterator NodeStore::find(NodeHandle h)
+{
+    if (!mCount)
+    {
+        return end();
+    }
+
+    size_t i = probe(h);
+    return mSlots[i].second ? iterator(&mSlots[i], slotsEnd()) : end();
+}
+
+NodeStore::const_iterator NodeStore::find(NodeHandle h) const
+{
+    if (!mCount)
+    {
+        return end();
+    }
+
+    size_t i = probe(h);
+    return mSlots[i].second ? const_iterator(&mSlots[i], slotsEnd()) : end();
+}
+
+NodeStore::~NodeStore()
+{
+    clear();
+}
+
+void NodeStore::clear()
+{
+    CodeCounter::accountMemory(CodeCounter::MEM_NODES, -int64_t(mSlots.size() * sizeof(value_type)));
+    vector<value_type>().swap(mSlots);
+    mCount = 0;
+}
+
+void NodeStore::reserve(size_t n)
+{
+    size_t capacity = 16;
+    while (n * 4 > capacity * 3)
+    {
+        capacity *= 2;
+    }
+
+    if (capacity > mSlots.size())
+    {
+        rehash(capacity);
+    }
+}
+
+void NodeStore::rehash(size_t capacity)
+{
+    assert(!(capacity & (capacity - 1)));
+
+    CodeCounter::accountMemory(CodeCounter::MEM_NODES, int64_t(capacity * sizeof(value_type)) - int64_t(mSlots.size() * sizeof(value_type)));
+
+    vector<value_type> old(capacity);
+    old.swap(mSlots);
+
+    for (auto& e : old)
+    {
+        if (e.second)
+        {
+            mSlots[probe(e.first)] = e;
+        }
+    }
+}
+
+void CachedNodeIndex::add(handle h, handle parent, nodetype_t type, m_off_t size, uint32_t dbid)
+{
+    assert(mByHandle.empty());
+    mByParent.push_back(Record{h, parent, size, dbid, type, false});
+}
+
+void CachedNodeIndex::finalize()
+{
+    std::sort(mByParent.begin(), mByParent.end(), [](const Record& a, const Record& b)
+    {
+        return a.parent < b.parent;
+    });
+
+    mByHandle.resize(mByParent.size());
+    for (size_t i = mByHandle.size(); i--; )
+    {
+        mByHandle[i] = static_cast<uint32_t>(i);
+    }
+
+    std::sort(mByHandle.begin(), mByHandle.end(), [this](uint32_t a, uint32_t b)
+    {
+        return mByParent[a].h < mByParent[b].h;
+    });
+}
+
+CachedNodeIndex::Record* CachedNodeIndex::find(handle h)
+{
+    auto it = std::lower_bound(mByHandle.begin(), mByHandle.end(), h, [this](uint32_t i, handle v)
+    {
+        return mByParent[i].h < v;
+    });
+
+    return it != mByHandle.end() && mByParent[*it].h == h ? &mByParent[*it] : nullptr;
+}
+
+std::pair<CachedNodeIndex::iterator, CachedNodeIndex::iterator> CachedNodeIndex::children(handle parent)
+{
+    auto cmp = [](const Record& r, handle v) { return r.parent < v; };
+    auto first = std::lower_bound(mByParent.begin(), mByParent.end(), parent, cmp);
+
+    auto last = first;
+    while (last != mByParent.end() && last->parent == parent)
+    {
+        ++last;
+    }
+    return std::make_pair(first, last);
+}
+
+bool CachedNodeIndex::hasChildren(handle parent) const
+{
+    auto it = std::lower_bound(mByParent.begin(), mByParent.end(), parent, [](const Record& r, handle v)
+    {
+        return r.parent < v;
+    });
+    return it != mByParent.end() && it->parent == parent;
+}
+
+NodeCounter CachedNodeIndex::descendantCounts(handle h, nodetype_t type) const
+{
+    NodeCounter nc;
+
+    // iterative, so deep trees don't exhaust the stack
+    vector<pair<handle, nodetype_t>> pending(1, std::make_pair(h, type));
+    auto cmp = [](const Record& r, handle v) { return r.parent < v; };
+
+    while (!pending.empty())
+    {
+        handle ph = pending.back().first;
+        nodetype_t pt = pending.back().second;
+        pending.pop_back();
+
+        for (auto it = std::lower_bound(mByParent.begin(), mByParent.end(), ph, cmp);
+             it != mByParent.end() && it->parent == ph; ++it)
+        {
+            if (it->type == FILENODE)
+            {
+                nc.files += 1;
+                nc.storage += it->size;
+                if (pt == FILENODE)
+                {
+                    nc.versions += 1;
+                    nc.versionStorage += it->size;
+                }
+            }
+            else if (it->type == FOLDERNODE)
+            {
+                nc.folders += 1;
+            }
+
+            pending.push_back(std::make_pair(it->h, it->type));
+        }
+    }
+
+    return nc;
+}
+
+void CachedNodeIndex::markLoaded(Record& r)
+{
+    if (!r.loaded)
+    {
+        r.loaded = true;
+        ++mLoaded;
+    }
+}
+
+} // namespace
@@ -26,6 +26,11 @@
 #include "mega.h"
 #include <sys/utsname.h>
 #include <sys/ioctl.h>
+#if defined(HAVE_AIO_RT) && defined(HAVE_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
 #ifdef TARGET_OS_MAC
 #include "mega/osx/osxutils.h"
 #endif
@@ -79,9 +84,14 @@ extern JavaVM *MEGAjvm;
 #define XFS_SUPER_MAGIC 0x58465342
 #endif /* ! XFS_SUPER_MAGIC */
 
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif /* ! FICLONE */
+
 #endif /* __linux__ */
 
 #if defined(__APPLE__) || defined(USE_IOS)
+#include <sys/clonefile.h>
 #include <sys/mount.h>
 #include <sys/param.h>
 #endif /* __APPLE__ || USE_IOS */
@@ -175,7 +185,13 @@ PosixAsyncIOContext::~PosixAsyncIOContext()
 
 void PosixAsyncIOContext::finish()
 {
-    if (aiocb)
+#ifdef HAVE_IO_URING
+    bool started = aiocb || mIoUring;
+#else
+    bool started = aiocb;
+#endif
+
+    if (started)
     {
         if (!finished)
         {
@@ -184,9 +200,302 @@ void PosixAsyncIOContext::finish()
         }
         delete aiocb;
         aiocb = NULL;
+#ifdef HAVE_IO_URING
+        mIoUring = false;
+#endif
     }
     assert(finished);
 }
+
+#ifdef HAVE_IO_URING
+// One io_uring for the async reads and writes of all file accesses.  Requests are queued to its
+// submission ring, and a single thread reaps the completions in batches, instead of the helper
+// threads glibc starts to deliver every SIGEV_THREAD notification of POSIX aio.
+// The syscalls are made directly: only the kernel header is needed.
+class PosixIoUring
+{
+public:
+    // null if the kernel doesn't support io_uring, or it is disabled
+    static std::shared_ptr<PosixIoUring> get();
+
+    ~PosixIoUring();
+
+    // false if the request could not be queued (eg. too many in flight), for the caller to use POSIX aio
+    bool submit(PosixAsyncIOContext* context, int fd);
+
+private:
+    PosixIoUring() = default;
+
+    bool init(unsigned entries);
+
+    // completion thread
+    void reap();
+    static void complete(PosixAsyncIOContext* context, int result);
+
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+    bool push(unsigned char opcode, int fd, PosixAsyncIOContext* context);
+
+    int mRingFd = -1;
+
+    void* mSqRing = MAP_FAILED;
+    size_t mSqRingSize = 0;
+    void* mCqRing = MAP_FAILED;
+    size_t mCqRingSize = 0;
+    io_uring_sqe* mSqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t mSqesSize = 0;
+
+    unsigned* mSqHead = nullptr;
+    unsigned* mSqTail = nullptr;
+    unsigned* mSqArray = nullptr;
+    unsigned mSqMask = 0;
+    unsigned* mCqHead = nullptr;
+    unsigned* mCqTail = nullptr;
+    io_uring_cqe* mCqes = nullptr;
+    unsigned mCqMask = 0;
+
+    // requests not completed yet, kept below the ring size so the completion ring can't overflow
+    // (one entry is left for the request that stops the completion thread)
+    unsigned mInFlight = 0;
+    unsigned mMaxInFlight = 0;
+
+    std::mutex mSubmitMutex;
+    std::thread mThread;
+};
+
+std::shared_ptr<PosixIoUring> PosixIoUring::get()
+{
+    static std::mutex m;
+    static std::weak_ptr<PosixIoUring> instance;
+    static bool unavailable = false;
+
+    std::lock_guard<std::mutex> g(m);
+
+    std::shared_ptr<PosixIoUring> ring = instance.lock();
+    if (!ring && !unavailable)
+    {
+        ring.reset(new PosixIoUring());
+        if (ring->init(256))
+        {
+            LOG_debug << "Using io_uring for async file access";
+            instance = ring;
+        }
+        else
+        {
+            LOG_warn << "io_uring not available, using POSIX aio: " << errno;
+            ring.reset();
+            unavailable = true;
+        }
+    }
+    return ring;
+}
+
+bool PosixIoUring::init(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+
+    mRingFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (mRingFd < 0)
+    {
+        return false;
+    }
+
+    mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    mSqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQ_RING);
+    mCqRing = mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_CQ_RING);
+    mSqes = static_cast<io_uring_sqe*>(mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQES));
+    if (mSqRing == MAP_FAILED || mCqRing == MAP_FAILED || mSqes == MAP_FAILED)
+    {
+        return false;
+    }
+
+    char* sq = static_cast<char*>(mSqRing);
+    mSqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    mSqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    mSqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    mSqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+
+    char* cq = static_cast<char*>(mCqRing);
+    mCqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    mCqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    mCqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    mCqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+
+    mMaxInFlight = std::min(params.sq_entries, params.cq_entries) - 1;
+
+    mThread = std::thread([this]()
+    {
+        ThreadRoles::enter(ThreadRoles::IO, "mega-aio");
+        reap();
+    });
+    return true;
+}
+
+PosixIoUring::~PosixIoUring()
+{
+    if (mThread.joinable())
+    {
+        assert(mThread.get_id() != std::this_thread::get_id());
+
+        // a request without context stops the completion thread, once the others are done
+        bool stopping;
+        {
+            std::lock_guard<std::mutex> g(mSubmitMutex);
+            stopping = push(IORING_OP_NOP, -1, nullptr);
+        }
+
+        if (!stopping)
+        {
+            // the thread can't be stopped: leave it the rings
+            LOG_err << "Unable to stop the io_uring thread: " << errno;
+            mThread.detach();
+            return;
+        }
+        mThread.join();
+    }
+
+    if (mSqes != MAP_FAILED) munmap(mSqes, mSqesSize);
+    if (mCqRing != MAP_FAILED) munmap(mCqRing, mCqRingSize);
+    if (mSqRing != MAP_FAILED) munmap(mSqRing, mSqRingSize);
+    if (mRingFd >= 0) close(mRingFd);
+}
+
+int PosixIoUring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, mRingFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+// with mSubmitMutex locked
+bool PosixIoUring::push(unsigned char opcode, int fd, PosixAsyncIOContext* context)
+{
+    unsigned tail = *mSqTail;
+    unsigned index = tail & mSqMask;
+
+    io_uring_sqe& sqe = mSqes[index];
+    memset(&sqe, 0, sizeof sqe);
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.user_data = reinterpret_cast<uintptr_t>(context);
+    if (context)
+    {
+        sqe.addr = reinterpret_cast<uintptr_t>(&context->mIov);
+        sqe.len = 1;
+        sqe.off = static_cast<uint64_t>(context->posOfBuffer);
+    }
+
+    mSqArray[index] = index;
+    __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+
+    while (enter(1, 0, 0) < 0 && errno == EINTR);
+
+    if (__atomic_load_n(mSqHead, __ATOMIC_ACQUIRE) != tail + 1)
+    {
+        // not taken by the kernel: withdraw it
+        __atomic_store_n(mSqTail, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+    return true;
+}
+
+bool PosixIoUring::submit(PosixAsyncIOContext* context, int fd)
+{
+    context->mIov.iov_base = context->dataBuffer;
+    context->mIov.iov_len = context->dataBufferLen;
+    context->mIoUring = true;
+
+    std::lock_guard<std::mutex> g(mSubmitMutex);
+
+    if (mInFlight < mMaxInFlight
+            && push(context->op == AsyncIOContext::READ ? IORING_OP_READV : IORING_OP_WRITEV, fd, context))
+    {
+        ++mInFlight;
+        return true;
+    }
+
+    context->mIoUring = false;
+    return false;
+}
+
+void PosixIoUring::reap()
+{
+    bool stop = false;
+    for (;;)
+    {
+        unsigned head = *mCqHead;
+        unsigned tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+
+        if (head == tail)
+        {
+            if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            {
+                LOG_err << "io_uring wait failed: " << errno;
+                return;
+            }
+            continue;
+        }
+
+        unsigned completed = 0;
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& cqe = mCqes[head & mCqMask];
+            if (auto context = reinterpret_cast<PosixAsyncIOContext*>(static_cast<uintptr_t>(cqe.user_data)))
+            {
+                complete(context, cqe.res);
+                ++completed;
+            }
+            else
+            {
+                stop = true;
+            }
+        }
+        __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+
+        {
+            std::lock_guard<std::mutex> g(mSubmitMutex);
+            mInFlight -= completed;
+            if (stop && !mInFlight)
+            {
+                return;
+            }
+        }
+    }
+}
+
+void PosixIoUring::complete(PosixAsyncIOContext* context, int result)
+{
+    context->retry = (result == -EAGAIN);
+    context->failed = result < 0 || static_cast<unsigned>(result) != context->dataBufferLen;
+    if (!context->failed)
+    {
+        if (context->op == AsyncIOContext::READ && context->pad)
+        {
+            memset(context->dataBuffer + context->dataBufferLen, 0, context->pad);
+            LOG_verbose << "Async read finished OK";
+        }
+        else
+        {
+            LOG_verbose << "Async write finished OK";
+        }
+    }
+    else
+    {
+        LOG_warn << "Async operation finished with error: " << result;
+    }
+
+    // the context may be deleted as soon as it is finished
+    asyncfscallback userCallback = context->userCallback;
+    void *userData = context->userData;
+    context->finished = true;
+    if (userCallback)
+    {
+        userCallback(userData);
+    }
+}
+#endif
 #endif
 
 PosixFileAccess::PosixFileAccess(Waiter *w, int defaultfilepermissions, bool followSymLinks) : FileAccess(w)
@@ -375,6 +684,18 @@ void PosixFileAccess::asyncsysread(AsyncIOContext *context)
         return;
     }
 
+#ifdef HAVE_IO_URING
+    if (!mIoUring)
+    {
+        mIoUring = PosixIoUring::get();
+    }
+
+    if (mIoUring && mIoUring->submit(posixContext, fd))
+    {
+        return;
+    }
+#endif
+
     struct aiocb *aiocbp = new struct aiocb;
     memset(aiocbp, 0, sizeof (struct aiocb));
 
@@ -424,6 +745,18 @@ void PosixFileAccess::asyncsyswrite(AsyncIOContext *context)
         return;
     }
 
+#ifdef HAVE_IO_URING
+    if (!mIoUring)
+    {
+        mIoUring = PosixIoUring::get();
+    }
+
+    if (mIoUring && mIoUring->submit(posixContext, fd))
+    {
+        return;
+    }
+#endif
+
     struct aiocb *aiocbp = new struct aiocb;
     memset(aiocbp, 0, sizeof (struct aiocb));
 
@@ -499,6 +832,27 @@ bool PosixFileAccess::ftruncate()
     return false;
 }
 
+bool PosixFileAccess::fpreallocate(m_off_t size)
+{
+    retry = false;
+
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    return !fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size);
+#elif defined(__APPLE__) && defined(F_PREALLOCATE)
+    // contiguous if possible, else in as many extents as needed
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, size, 0 };
+    if (fcntl(fd, F_PREALLOCATE, &store) == -1)
+    {
+        store.fst_flags = F_ALLOCATEALL;
+        return fcntl(fd, F_PREALLOCATE, &store) != -1;
+    }
+    return true;
+#else
+    (void)size;
+    return false;
+#endif
+}
+
 int PosixFileAccess::stealFileDescriptor()
 {
     int toret = fd;
@@ -794,6 +1148,13 @@ PosixFileSystemAccess::~PosixFileSystemAccess()
     {
         close(notifyfd);
     }
+
+#if defined(USE_INOTIFY) && defined(HAVE_FANOTIFY)
+    if (fanotifyfd >= 0)
+    {
+        close(fanotifyfd);
+    }
+#endif
 }
 
 bool PosixFileSystemAccess::cwd(LocalPath& path) const
@@ -829,7 +1190,115 @@ void PosixFileSystemAccess::addevents(Waiter* w, int /*flags*/)
 
         pw->bumpmaxfd(notifyfd);
     }
+
+#if defined(USE_INOTIFY) && defined(HAVE_FANOTIFY)
+    if (fanotifyfd >= 0)
+    {
+        PosixWaiter* pw = (PosixWaiter*)w;
+
+        MEGA_FD_SET(fanotifyfd, &pw->rfds);
+        MEGA_FD_SET(fanotifyfd, &pw->ignorefds);
+
+        pw->bumpmaxfd(fanotifyfd);
+    }
+#endif
+}
+
+#if defined(ENABLE_SYNC) && defined(USE_INOTIFY) && defined(HAVE_FANOTIFY)
+// events on the folders of the syncs (the folder and the name are reported, like inotify does)
+static const uint64_t FANOTIFY_EVENTS = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO
+                                      | FAN_CLOSE_WRITE | FAN_ONDIR;
+
+static string fanotifyhandlekey(const file_handle* fh)
+{
+    string key(reinterpret_cast<const char*>(&fh->handle_type), sizeof fh->handle_type);
+    key.append(reinterpret_cast<const char*>(fh->f_handle), fh->handle_bytes);
+    return key;
+}
+
+bool PosixFileSystemAccess::fanotifyhandle(const LocalPath& path, string& handle, int& mountid) const
+{
+    alignas(file_handle) char buf[sizeof(file_handle) + MAX_HANDLE_SZ];
+    file_handle* fh = reinterpret_cast<file_handle*>(buf);
+    fh->handle_bytes = MAX_HANDLE_SZ;
+
+    if (name_to_handle_at(AT_FDCWD, path.localpath.c_str(), fh, &mountid, 0))
+    {
+        return false;
+    }
+
+    handle = fanotifyhandlekey(fh);
+    return true;
+}
+
+bool PosixFileSystemAccess::fanotifyadd(PosixDirNotify& dirnotify)
+{
+    const LocalPath& path = dirnotify.localbasepath;
+    struct stat statbuf;
+    struct statfs statfsbuf;
+    string handle;
+    int mountid;
+
+    if (stat(path.localpath.c_str(), &statbuf)
+     || statfs(path.localpath.c_str(), &statfsbuf)
+     || !fanotifyhandle(path, handle, mountid))
+    {
+        return false;
+    }
+
+    if (fanotifyfd < 0)
+    {
+        if (fanotifytried)
+        {
+            return false;
+        }
+        fanotifytried = true;
+
+        fanotifyfd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC,
+                                   O_RDONLY | O_LARGEFILE);
+        if (fanotifyfd < 0)
+        {
+            LOG_debug << "fanotify not available, syncs use inotify. Error code: " << errno;
+            return false;
+        }
+    }
+
+    FanotifyMark& mark = fanotifymarks[statbuf.st_dev];
+    if (!mark.syncs)
+    {
+        if (fanotify_mark(fanotifyfd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FANOTIFY_EVENTS,
+                          AT_FDCWD, path.localpath.c_str()))
+        {
+            LOG_debug << "Unable to mark the filesystem of " << path.toPath() << " for fanotify, using inotify. Error code: " << errno;
+            fanotifymarks.erase(statbuf.st_dev);
+            return false;
+        }
+        mark.path = path;
+    }
+    ++mark.syncs;
+
+    static_assert(sizeof statfsbuf.f_fsid == sizeof(decltype(fanotify_event_info_fid::fsid)), "fsid sizes differ");
+
+    dirnotify.mFanotifyDevice = statbuf.st_dev;
+    dirnotify.mFanotifyMount = mountid;
+    dirnotify.mFanotifyFsid.assign(reinterpret_cast<const char*>(&statfsbuf.f_fsid), sizeof statfsbuf.f_fsid);
+    return true;
+}
+
+void PosixFileSystemAccess::fanotifyremove(dev_t device)
+{
+    auto it = fanotifymarks.find(device);
+    if (it == fanotifymarks.end() || --it->second.syncs)
+    {
+        return;
+    }
+
+    // if the path is gone, the mark stays until the descriptor is closed, its events are dropped
+    fanotify_mark(fanotifyfd, FAN_MARK_REMOVE | FAN_MARK_FILESYSTEM, FANOTIFY_EVENTS,
+                  AT_FDCWD, it->second.path.localpath.c_str());
+    fanotifymarks.erase(it);
 }
+#endif
 
 // read all pending inotify events and queue them for processing
 int PosixFileSystemAccess::checkevents(Waiter* w)
@@ -950,6 +1419,63 @@ int PosixFileSystemAccess::checkevents(Waiter* w)
             lastcookie = 0;
         }
     }
+
+#ifdef HAVE_FANOTIFY
+    if (fanotifyfd >= 0 && MEGA_FD_ISSET(fanotifyfd, &pw->rfds))
+    {
+        alignas(fanotify_event_metadata) char buf[8192];
+        ssize_t l;
+
+        while ((l = read(fanotifyfd, buf, sizeof buf)) > 0)
+        {
+            for (auto m = reinterpret_cast<fanotify_event_metadata*>(buf); FAN_EVENT_OK(m, l); m = FAN_EVENT_NEXT(m, l))
+            {
+                if (m->mask & FAN_Q_OVERFLOW)
+                {
+                    notifyerr = true;
+                    continue;
+                }
+
+                auto info = reinterpret_cast<fanotify_event_info_fid*>(m + 1);
+                if (m->event_len < sizeof *m + sizeof *info
+                 || info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+                {
+                    continue;
+                }
+
+                // the marks are filesystem-wide, most events are for folders outside the syncs
+                auto fh = reinterpret_cast<file_handle*>(info->handle);
+                string key(reinterpret_cast<const char*>(&info->fsid), sizeof info->fsid);
+                key.append(fanotifyhandlekey(fh));
+
+                auto it = fhnodes.find(key);
+                if (it == fhnodes.end())
+                {
+                    continue;
+                }
+
+                // no cookies pair the two halves of a move: both names are notified, the removal of
+                // the source is deferred until the notifications are processed, so the move is still found
+                const char* name = reinterpret_cast<const char*>(fh->f_handle + fh->handle_bytes);
+                size_t namesize = strlen(name);
+                ignore = &it->second->sync->dirnotify->ignore.localpath;
+
+                if (namesize < ignore->size()
+                 || memcmp(name, ignore->data(), ignore->size())
+                 || (namesize > ignore->size()
+                  && name[ignore->size()] != LocalPath::localPathSeparator))
+                {
+                    LOG_debug << "Filesystem notification. Root: " << it->second->name << "   Path: " << name;
+                    it->second->sync->dirnotify->notify(DirNotify::DIREVENTS,
+                                                        it->second,
+                                                        LocalPath::fromPlatformEncoded(std::string(name, namesize)));
+
+                    r |= Waiter::NEEDEXEC;
+                }
+            }
+        }
+    }
+#endif
 #endif
 
 #ifdef __MACH__
@@ -1016,6 +1542,9 @@ int PosixFileSystemAccess::checkevents(Waiter* w)
             break;
         }
 
+        // a busy file shows up in many events of the same read: it is checked once anyway, notify it once
+        std::set<std::pair<Sync*, std::string>> notified;
+
         for (pos = 0; pos < avail; )
         {
             kfse = (kfs_event*)(buffer + pos);
@@ -1108,7 +1637,7 @@ int PosixFileSystemAccess::checkevents(Waiter* w)
 
             for (i = n; i--; )
             {
-                if (paths[i])
+                if (paths[i] && notified.emplace(pathsync[i], paths[i]).second)
                 {
                     LOG_debug << "Filesystem notification. Root: " << pathsync[i]->localroot->name << "   Path: " << paths[i];
                     pathsync[i]->dirnotify->notify(DirNotify::DIREVENTS,
@@ -1187,6 +1716,37 @@ bool PosixFileSystemAccess::renamelocal(LocalPath& oldname, LocalPath& newname,
     return false;
 }
 
+// Copy-on-write clone of a file (btrfs and xfs with FICLONE, APFS with clonefile()): the copy shares the data of the
+// original until either changes, so it takes no time nor space.  False where the filesystem can't, to copy the data instead.
+static bool clonelocal(const string& oldname, const string& newname, int permissions)
+{
+#if defined(__APPLE__) || defined(USE_IOS)
+    // clonefile() won't replace an existing target
+    unlink(newname.c_str());
+    return !clonefile(oldname.c_str(), newname.c_str(), 0);
+#elif defined(__linux__)
+    int sfd = open(oldname.c_str(), O_RDONLY);
+    if (sfd < 0)
+    {
+        return false;
+    }
+
+    mode_t mode = umask(0);
+    int tfd = open(newname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, permissions);
+    umask(mode);
+
+    bool cloned = tfd >= 0 && !ioctl(tfd, FICLONE, sfd);
+    if (tfd >= 0)
+    {
+        close(tfd);
+    }
+    close(sfd);
+    return cloned;
+#else
+    return false;
+#endif
+}
+
 bool PosixFileSystemAccess::copylocal(LocalPath& oldname, LocalPath& newname, m_time_t mtime)
 {
 #ifdef USE_IOS
@@ -1200,10 +1760,18 @@ bool PosixFileSystemAccess::copylocal(LocalPath& oldname, LocalPath& newname, m_
 
     int sfd, tfd;
     ssize_t t = -1;
+#ifndef HAVE_SENDFILE
+    char buf[16384];
+#endif
 
+    if (clonelocal(oldnamestr, newnamestr, defaultfilepermissions))
+    {
+        LOG_verbose << "Copied via clone";
+        t = 0;
+    }
 #ifdef HAVE_SENDFILE
     // Linux-specific - kernel 2.6.33+ required
-    if ((sfd = open(oldnamestr.c_str(), O_RDONLY | O_DIRECT)) >= 0)
+    else if ((sfd = open(oldnamestr.c_str(), O_RDONLY | O_DIRECT)) >= 0)
     {
         LOG_verbose << "Copying via sendfile";
         mode_t mode = umask(0);
@@ -1212,9 +1780,7 @@ bool PosixFileSystemAccess::copylocal(LocalPath& oldname, LocalPath& newname, m_
             umask(mode);
             while ((t = sendfile(tfd, sfd, NULL, 1024 * 1024 * 1024)) > 0);
 #else
-    char buf[16384];
-
-    if ((sfd = open(oldnamestr.c_str(), O_RDONLY)) >= 0)
+    else if ((sfd = open(oldnamestr.c_str(), O_RDONLY)) >= 0)
     {
         LOG_verbose << "Copying via read/write";
         mode_t mode = umask(0);
@@ -1829,9 +2395,40 @@ PosixDirNotify::PosixDirNotify(const LocalPath& localbasepath, const LocalPath&
     fsaccess = NULL;
 }
 
+PosixDirNotify::~PosixDirNotify()
+{
+#if defined(USE_INOTIFY) && defined(HAVE_FANOTIFY)
+    if (mFanotify)
+    {
+        for (auto& h : mHandles)
+        {
+            fsaccess->fhnodes.erase(h.second);
+        }
+        fsaccess->fanotifyremove(mFanotifyDevice);
+    }
+#endif
+}
+
 void PosixDirNotify::addnotify(LocalNode* l, const LocalPath& path)
 {
 #ifdef USE_INOTIFY
+#ifdef HAVE_FANOTIFY
+    if (mFanotify)
+    {
+        string handle;
+        int mountid;
+
+        // folders on other mounts aren't covered by the mark of this filesystem
+        if (fsaccess->fanotifyhandle(path, handle, mountid) && mountid == mFanotifyMount)
+        {
+            handle.insert(0, mFanotifyFsid);
+            fsaccess->fhnodes[handle] = l;
+            mHandles[l] = std::move(handle);
+            return;
+        }
+    }
+#endif
+
     int wd;
 
     wd = inotify_add_watch(fsaccess->notifyfd, path.localpath.c_str(),
@@ -1841,7 +2438,14 @@ void PosixDirNotify::addnotify(LocalNode* l, const LocalPath& path)
     if (wd >= 0)
     {
         l->dirnotifytag = (handle)wd;
-        fsaccess->wdnodes[wd] = l;
+        if (fsaccess->wdnodes.insert(std::make_pair(wd, l)).second)
+        {
+            ++mWatches;
+        }
+        else
+        {
+            fsaccess->wdnodes[wd] = l;
+        }
     }
     else
     {
@@ -1853,13 +2457,37 @@ void PosixDirNotify::addnotify(LocalNode* l, const LocalPath& path)
 void PosixDirNotify::delnotify(LocalNode* l)
 {
 #ifdef USE_INOTIFY
+#ifdef HAVE_FANOTIFY
+    auto it = mHandles.find(l);
+    if (it != mHandles.end())
+    {
+        fsaccess->fhnodes.erase(it->second);
+        mHandles.erase(it);
+        return;
+    }
+#endif
+
     if (fsaccess->wdnodes.erase((int)(long)l->dirnotifytag))
     {
         inotify_rm_watch(fsaccess->notifyfd, (int)l->dirnotifytag);
+        --mWatches;
     }
 #endif
 }
 
+size_t PosixDirNotify::watchCount() const
+{
+#ifdef USE_INOTIFY
+#ifdef HAVE_FANOTIFY
+    return mWatches + mFanotify;
+#else
+    return mWatches;
+#endif
+#else
+    return 0;
+#endif
+}
+
 fsfp_t PosixDirNotify::fsfingerprint() const
 {
     struct statfs statfsbuf;
@@ -1912,6 +2540,10 @@ DirNotify* PosixFileSystemAccess::newdirnotify(const LocalPath& localpath, const
 
     dirnotify->fsaccess = this;
 
+#if defined(USE_INOTIFY) && defined(HAVE_FANOTIFY)
+    dirnotify->mFanotify = fanotifyadd(*dirnotify);
+#endif
+
     return dirnotify;
 }
 #endif
@@ -1999,6 +2631,19 @@ bool PosixFileSystemAccess::getlocalfstype(const LocalPath& path, FileSystemType
     return false;
 }
 
+bool PosixFileSystemAccess::getdeviceid(const LocalPath& path, uint64_t& id) const
+{
+    struct stat statbuf;
+
+    if (stat(adjustBasePath(path).c_str(), &statbuf))
+    {
+        return false;
+    }
+
+    id = uint64_t(statbuf.st_dev);
+    return true;
+}
+
 bool PosixDirAccess::dopen(LocalPath* path, FileAccess* f, bool doglob)
 {
     if (doglob)
@@ -23,6 +23,12 @@
 #include "mega/posix/meganet.h"
 #include "mega/logging.h"
 
+#if defined(USE_EPOLL)
+#include <sys/epoll.h>
+#elif defined(USE_KQUEUE)
+#include <sys/event.h>
+#endif
+
 #if defined(__ANDROID__) && ARES_VERSION >= 0x010F00
 #include <jni.h>
 extern JavaVM *MEGAjvm;
@@ -32,6 +38,7 @@ extern JavaVM *MEGAjvm;
 #define DNS_CACHE_TIMEOUT_DS 18000
 #define DNS_CACHE_EXPIRES 0
 #define MAX_SPEED_CONTROL_TIMEOUT_MS 500
+#define MAX_READY_SOCKETS 128
 
 namespace mega {
 
@@ -314,6 +321,12 @@ CurlHttpIO::CurlHttpIO()
     numconnections[PUT] = 0;
     curlsocketsprocessed = true;
 
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    socketnotifier[API] = opensocketnotifier();
+    socketnotifier[GET] = opensocketnotifier();
+    socketnotifier[PUT] = opensocketnotifier();
+#endif
+
 #ifdef MEGA_USE_C_ARES
     struct ares_options options;
     options.tries = 2;
@@ -357,6 +370,13 @@ CurlHttpIO::CurlHttpIO()
     curl_share_setopt(curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
     curl_share_setopt(curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
 
+    curlshproxy = curl_share_init();
+    curl_share_setopt(curlshproxy, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(curlshproxy, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900 // At least cURL 7.57.0
+    curl_share_setopt(curlshproxy, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+
     contenttypejson = curl_slist_append(NULL, "Content-Type: application/json");
     contenttypejson = curl_slist_append(contenttypejson, "Expect:");
 
@@ -581,6 +601,10 @@ void CurlHttpIO::addcurlevents(Waiter *waiter, direction_t d)
     bool anyWriters = false;
 #endif
 
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    MEGA_FD_SET(socketnotifier[d], &((PosixWaiter *)waiter)->rfds);
+    ((PosixWaiter *)waiter)->bumpmaxfd(socketnotifier[d]);
+#else
     SockInfoMap &socketmap = curlsockets[d];
     for (SockInfoMap::iterator it = socketmap.begin(); it != socketmap.end(); it++)
     {
@@ -609,6 +633,7 @@ void CurlHttpIO::addcurlevents(Waiter *waiter, direction_t d)
         }
 #endif
    }
+#endif
 
 #if defined(_WIN32)
     if (anyWriters)
@@ -648,6 +673,11 @@ void CurlHttpIO::closecurlevents(direction_t d)
     {
         it->second.closeEvent(false);
     }
+#endif
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    // the sockets go with their multi handle, start with an empty set
+    close(socketnotifier[d]);
+    socketnotifier[d] = opensocketnotifier();
 #endif
     socketmap.clear();
 }
@@ -694,19 +724,124 @@ void CurlHttpIO::processaresevents()
 }
 #endif
 
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+int CurlHttpIO::opensocketnotifier()
+{
+#if defined(USE_EPOLL)
+    int fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    int fd = kqueue();
+#endif
+    if (fd < 0)
+    {
+        LOG_fatal << "Error creating the socket notifier: " << errno;
+        throw std::runtime_error("Error creating the socket notifier");
+    }
+    return fd;
+}
+
+// keep the interest set in line with what cURL wants to know about the socket
+void CurlHttpIO::watchsocket(direction_t d, curl_socket_t s, int oldmode, int newmode)
+{
+    if (oldmode == newmode)
+    {
+        return;
+    }
+
+#if defined(USE_EPOLL)
+    int result;
+    if (!newmode)
+    {
+        result = epoll_ctl(socketnotifier[d], EPOLL_CTL_DEL, s, nullptr);
+    }
+    else
+    {
+        epoll_event ev = {};
+        ev.events = ((newmode & SockInfo::READ) ? EPOLLIN : 0) | ((newmode & SockInfo::WRITE) ? EPOLLOUT : 0);
+        ev.data.fd = s;
+        result = epoll_ctl(socketnotifier[d], oldmode ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, s, &ev);
+    }
+#else
+    struct kevent changes[2];
+    struct kevent receipts[2];
+    EV_SET(&changes[0], s, EVFILT_READ, ((newmode & SockInfo::READ) ? EV_ADD : EV_DELETE) | EV_RECEIPT, 0, 0, nullptr);
+    EV_SET(&changes[1], s, EVFILT_WRITE, ((newmode & SockInfo::WRITE) ? EV_ADD : EV_DELETE) | EV_RECEIPT, 0, 0, nullptr);
+
+    // deleting a filter that wasn't set reports ENOENT, which is fine
+    int result = kevent(socketnotifier[d], changes, 2, receipts, 2, nullptr) < 0 ? -1 : 0;
+    for (int i = 0; !result && i < 2; i++)
+    {
+        if (receipts[i].data && receipts[i].data != ENOENT)
+        {
+            errno = int(receipts[i].data);
+            result = -1;
+        }
+    }
+#endif
+
+    if (result < 0)
+    {
+        LOG_err << "Unable to update the socket notifier for socket " << s << ": " << errno;
+    }
+}
+#endif
+
 void CurlHttpIO::processcurlevents(direction_t d)
 {
     CodeCounter::ScopeTimer ccst(countProcessCurlEventsCode);
 
 #ifndef _WIN32
     auto *rfds = &((PosixWaiter *)waiter)->rfds;
+#if !defined(USE_EPOLL) && !defined(USE_KQUEUE)
     auto *wfds = &((PosixWaiter *)waiter)->wfds;
+#endif
 #endif
 
     int dummy = 0;
     SockInfoMap *socketmap = &curlsockets[d];
     bool *paused = &arerequestspaused[d];
 
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    if (MEGA_FD_ISSET(socketnotifier[d], rfds))
+    {
+        // level-triggered: sockets left unprocessed (eg. paused transfers) are reported again
+        curl_socket_t ready[MAX_READY_SOCKETS];
+        int events[MAX_READY_SOCKETS];
+        int numready = 0;
+
+#if defined(USE_EPOLL)
+        epoll_event notified[MAX_READY_SOCKETS];
+        int n = epoll_wait(socketnotifier[d], notified, MAX_READY_SOCKETS, 0);
+        for (int i = 0; i < n; i++)
+        {
+            ready[numready] = notified[i].data.fd;
+            events[numready++] = ((notified[i].events & (EPOLLIN | EPOLLHUP)) ? CURL_CSELECT_IN : 0)
+                               | ((notified[i].events & EPOLLOUT) ? CURL_CSELECT_OUT : 0)
+                               | ((notified[i].events & EPOLLERR) ? CURL_CSELECT_ERR : 0);
+        }
+#else
+        struct kevent notified[MAX_READY_SOCKETS];
+        struct timespec notimeout = { 0, 0 };
+        int n = kevent(socketnotifier[d], nullptr, 0, notified, MAX_READY_SOCKETS, &notimeout);
+        for (int i = 0; i < n; i++)
+        {
+            ready[numready] = curl_socket_t(notified[i].ident);
+            events[numready++] = (notified[i].filter == EVFILT_READ ? CURL_CSELECT_IN : CURL_CSELECT_OUT)
+                               | ((notified[i].flags & EV_ERROR) ? CURL_CSELECT_ERR : 0);
+        }
+#endif
+
+        for (int i = 0; !(*paused) && i < numready; i++)
+        {
+            // skip sockets that cURL has stopped watching while processing the previous ones
+            auto it = socketmap->find(ready[i]);
+            if (it != socketmap->end() && it->second.mode)
+            {
+                curl_multi_socket_action(curlm[d], ready[i], events[i], &dummy);
+            }
+        }
+    }
+#else
     for (SockInfoMap::iterator it = socketmap->begin(); !(*paused) && it != socketmap->end();)
     {
         SockInfo &info = (it++)->second;
@@ -733,6 +868,7 @@ void CurlHttpIO::processcurlevents(direction_t d)
         }
 #endif
     }
+#endif
 
     if (curltimeoutreset[d] >= 0 && curltimeoutreset[d] <= Waiter::ds)
     {
@@ -765,6 +901,7 @@ CurlHttpIO::~CurlHttpIO()
     curl_multi_cleanup(curlm[GET]);
     curl_multi_cleanup(curlm[PUT]);
     curl_share_cleanup(curlsh);
+    curl_share_cleanup(curlshproxy);
 
 #ifdef MEGA_USE_C_ARES
     closearesevents();
@@ -773,6 +910,12 @@ CurlHttpIO::~CurlHttpIO()
     closecurlevents(GET);
     closecurlevents(PUT);
 
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    close(socketnotifier[API]);
+    close(socketnotifier[GET]);
+    close(socketnotifier[PUT]);
+#endif
+
 #ifdef WIN32
     WSACloseEvent(mSocketsWaitEvent);
 #endif
@@ -817,6 +960,39 @@ void CurlHttpIO::setdnsservers(const char* servers)
 }
 #endif
 
+const long CurlHttpIO::HTTP2_MAX_STREAMS = 32;
+
+bool CurlHttpIO::sethttp2(bool enable)
+{
+#if LIBCURL_VERSION_NUM >= 0x072b00 // At least cURL 7.43.0
+    if (enable && !(curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2))
+    {
+        LOG_warn << "HTTP/2 not supported by this cURL library";
+        return false;
+    }
+
+    LOG_debug << "HTTP/2 multiplexing " << (enable ? "enabled" : "disabled");
+    http2 = enable;
+    sethttp2options();
+    return true;
+#else
+    return !enable;
+#endif
+}
+
+void CurlHttpIO::sethttp2options()
+{
+#if LIBCURL_VERSION_NUM >= 0x072b00 // At least cURL 7.43.0
+    for (int d = GET; d <= API; d++)
+    {
+        curl_multi_setopt(curlm[d], CURLMOPT_PIPELINING, http2 ? long(CURLPIPE_MULTIPLEX) : long(CURLPIPE_NOTHING));
+#if LIBCURL_VERSION_NUM >= 0x074300 // At least cURL 7.67.0
+        curl_multi_setopt(curlm[d], CURLMOPT_MAX_CONCURRENT_STREAMS, HTTP2_MAX_STREAMS);
+#endif
+    }
+#endif
+}
+
 void CurlHttpIO::disconnect()
 {
     LOG_debug << "Reinitializing the network layer";
@@ -896,6 +1072,11 @@ void CurlHttpIO::disconnect()
     curltimeoutreset[PUT] = -1;
     arerequestspaused[PUT] = false;
 
+    if (http2)
+    {
+        sethttp2options();
+    }
+
     disconnecting = false;
 #ifdef MEGA_USE_C_ARES
     if (dnsservers.size())
@@ -919,12 +1100,14 @@ void CurlHttpIO::disconnect()
 bool CurlHttpIO::setmaxdownloadspeed(m_off_t bpslimit)
 {
     maxspeed[GET] = bpslimit;
+    bandwidth[GET].setlimit(bpslimit);
     return true;
 }
 
 bool CurlHttpIO::setmaxuploadspeed(m_off_t bpslimit)
 {
     maxspeed[PUT] = bpslimit;
+    bandwidth[PUT].setlimit(bpslimit);
     return true;
 }
 
@@ -965,7 +1148,200 @@ bool CurlHttpIO::cacheresolvedurls(const std::vector<string>& urls, std::vector<
         dnsEntry.mNeedsResolvingAgain = false;
     }
 
+    dnscachechanged = true;
+    return true;
+}
+
+const m_time_t CurlHttpIO::DNS_CACHE_IMPORT_TTL = 86400;
+
+bool CurlHttpIO::exportdnscache(string* data)
+{
+    if (!dnscachechanged)
+    {
+        return false;
+    }
+
+    // dstime is relative to this run: store when the addresses were resolved as wall clock time
+    m_time_t now = m_time();
+    auto resolvedtime = [now](const string& ip, dstime timestamp)
+    {
+        return ip.empty() ? m_time_t(0) : now - m_time_t(Waiter::ds - timestamp) / 10;
+    };
+
+    data->clear();
+    CacheableWriter w(*data);
+    w.serializeu32(uint32_t(dnscache.size()));
+    for (auto& entry : dnscache)
+    {
+        w.serializestring(entry.first);
+        w.serializestring(entry.second.ipv4);
+        w.serializei64(resolvedtime(entry.second.ipv4, entry.second.ipv4timestamp));
+        w.serializestring(entry.second.ipv6);
+        w.serializei64(resolvedtime(entry.second.ipv6, entry.second.ipv6timestamp));
+    }
+
+    dnscachechanged = false;
+    return true;
+}
+
+void CurlHttpIO::importdnscache(const string& data)
+{
+    CacheableReader r(data);
+    uint32_t count;
+    if (!r.unserializeu32(count))
+    {
+        return;
+    }
+
+    m_time_t now = m_time();
+    unsigned imported = 0;
+    while (count--)
+    {
+        string host, ipv4, ipv6;
+        int64_t ipv4time, ipv6time;
+        if (!r.unserializestring(host) || !r.unserializestring(ipv4) || !r.unserializei64(ipv4time)
+                || !r.unserializestring(ipv6) || !r.unserializei64(ipv6time))
+        {
+            LOG_warn << "Invalid DNS cache data";
+            return;
+        }
+
+        if (now - ipv4time > DNS_CACHE_IMPORT_TTL)
+        {
+            ipv4.clear();
+        }
+        if (now - ipv6time > DNS_CACHE_IMPORT_TTL)
+        {
+            ipv6.clear();
+        }
+
+        // addresses resolved in this run are more recent
+        if ((ipv4.empty() && ipv6.empty()) || dnscache.find(host) != dnscache.end())
+        {
+            continue;
+        }
+
+        // keep their age, so they aren't exported again as if just resolved
+        auto timestamp = [now](int64_t resolvedtime)
+        {
+            return Waiter::ds - std::min<dstime>(Waiter::ds, dstime(std::max<m_time_t>(now - resolvedtime, 0) * 10));
+        };
+
+        // used right away, and resolved again while the first connection is made
+        CurlDNSEntry& dnsEntry = dnscache[host];
+        dnsEntry.ipv4timestamp = ipv4.empty() ? 0 : timestamp(ipv4time);
+        dnsEntry.ipv4 = move(ipv4);
+        dnsEntry.ipv6timestamp = ipv6.empty() ? 0 : timestamp(ipv6time);
+        dnsEntry.ipv6 = move(ipv6);
+        dnsEntry.mNeedsResolvingAgain = true;
+        imported++;
+    }
+
+    LOG_debug << "Imported the addresses of " << imported << " hosts into the DNS cache";
+}
+
+#if LIBCURL_VERSION_NUM >= 0x080c00 // At least cURL 8.12.0
+struct TlsSessionExport
+{
+    string sessions;
+    uint32_t count = 0;
+    curl_off_t now = 0;
+};
+
+static CURLcode exporttlssession(CURL*, void* userptr, const char* sessionkey,
+                                 const unsigned char* shmac, size_t shmaclen,
+                                 const unsigned char* sdata, size_t sdatalen,
+                                 curl_off_t validuntil, int, const char*, size_t)
+{
+    auto e = static_cast<TlsSessionExport*>(userptr);
+    if (validuntil > e->now)
+    {
+        CacheableWriter w(e->sessions);
+        w.serializestring(sessionkey);
+        w.serializestring(string(reinterpret_cast<const char*>(shmac), shmaclen));
+        w.serializestring(string(reinterpret_cast<const char*>(sdata), sdatalen));
+        w.serializei64(validuntil);
+        e->count++;
+    }
+    return CURLE_OK;
+}
+#endif
+
+bool CurlHttpIO::exporttlssessions(string* data)
+{
+#if LIBCURL_VERSION_NUM >= 0x080c00 // At least cURL 8.12.0
+    // the sessions are in the share, reached through any handle attached to it
+    CURL* curl = curl_easy_init();
+    if (!curl)
+    {
+        return false;
+    }
+
+    TlsSessionExport e;
+    e.now = curl_off_t(m_time());
+    curl_easy_setopt(curl, CURLOPT_SHARE, curlsh);
+    CURLcode result = curl_easy_ssls_export(curl, exporttlssession, &e);
+    curl_easy_cleanup(curl);
+
+    if (result != CURLE_OK || !e.count)
+    {
+        return false;
+    }
+
+    data->clear();
+    CacheableWriter w(*data);
+    w.serializeu32(e.count);
+    data->append(e.sessions);
     return true;
+#else
+    return HttpIO::exporttlssessions(data);
+#endif
+}
+
+void CurlHttpIO::importtlssessions(const string& data)
+{
+#if LIBCURL_VERSION_NUM >= 0x080c00 // At least cURL 8.12.0
+    CacheableReader r(data);
+    uint32_t count;
+    if (!r.unserializeu32(count))
+    {
+        return;
+    }
+
+    CURL* curl = curl_easy_init();
+    if (!curl)
+    {
+        return;
+    }
+    curl_easy_setopt(curl, CURLOPT_SHARE, curlsh);
+
+    m_time_t now = m_time();
+    unsigned imported = 0;
+    while (count--)
+    {
+        string sessionkey, shmac, sdata;
+        int64_t validuntil;
+        if (!r.unserializestring(sessionkey) || !r.unserializestring(shmac)
+                || !r.unserializestring(sdata) || !r.unserializei64(validuntil))
+        {
+            LOG_warn << "Invalid TLS session data";
+            break;
+        }
+
+        if (validuntil > now
+                && curl_easy_ssls_import(curl, sessionkey.c_str(),
+                                         reinterpret_cast<const unsigned char*>(shmac.data()), shmac.size(),
+                                         reinterpret_cast<const unsigned char*>(sdata.data()), sdata.size()) == CURLE_OK)
+        {
+            imported++;
+        }
+    }
+    curl_easy_cleanup(curl);
+
+    LOG_debug << "Imported " << imported << " TLS sessions";
+#else
+    HttpIO::importtlssessions(data);
+#endif
 }
 
 // wake up from cURL I/O
@@ -1268,6 +1644,7 @@ void CurlHttpIO::ares_completed_callback(void* arg, int status, int, struct host
             }
             dnsEntry.ipv4timestamp = Waiter::ds;
         }
+        httpio->dnscachechanged = true;
 
         // IPv6 takes precedence over IPv4
         if (!httpctx->hostip.size() || (host->h_addrtype == PF_INET6 && !httpctx->curl))
@@ -1458,9 +1835,31 @@ void CurlHttpIO::send_request(CurlHttpContext* httpctx)
     }
     else if(httpctx->hostip.size())
     {
-        LOG_debug << "Using the IP of the hostname: " << httpctx->hostip;
-        httpctx->posturl.replace(httpctx->posturl.find(httpctx->hostname), httpctx->hostname.size(), httpctx->hostip);
-        httpctx->headers = curl_slist_append(httpctx->headers, httpctx->hostheader.c_str());
+        curl_slist_free_all(httpctx->resolve);
+        httpctx->resolve = NULL;
+
+#if LIBCURL_VERSION_NUM >= 0x073b00 // At least cURL 7.59.0 (several addresses per CURLOPT_RESOLVE entry)
+        auto it = httpio->dnscache.find(httpctx->hostname);
+        if (httpctx->isIPv6 && req->method != METHOD_NONE && it != httpio->dnscache.end()
+                && it->second.ipv4.size() && !it->second.isIPv4Expired())
+        {
+            // let cURL race both addresses (happy eyeballs) instead of waiting for IPv6 to time out before trying IPv4
+            std::ostringstream hostport;
+            hostport << httpctx->hostname << ":" << httpctx->port;
+            httpctx->resolve = curl_slist_append(NULL, ("-" + hostport.str()).c_str());
+            httpctx->resolve = curl_slist_append(httpctx->resolve, (hostport.str() + ":" + httpctx->hostip + "," + it->second.ipv4).c_str());
+            LOG_debug << "Racing the IPv6 and IPv4 addresses of the hostname: " << httpctx->hostip << " " << it->second.ipv4;
+
+            // both were tried already if it fails
+            httpctx->isIPv6 = false;
+        }
+        else
+#endif
+        {
+            LOG_debug << "Using the IP of the hostname: " << httpctx->hostip;
+            httpctx->posturl.replace(httpctx->posturl.find(httpctx->hostname), httpctx->hostname.size(), httpctx->hostip);
+            httpctx->headers = curl_slist_append(httpctx->headers, httpctx->hostheader.c_str());
+        }
     }
     else
     {
@@ -1502,6 +1901,10 @@ void CurlHttpIO::send_request(CurlHttpContext* httpctx)
         }
 
         curl_easy_setopt(curl, CURLOPT_URL, httpctx->posturl.c_str());
+        if (httpctx->resolve)
+        {
+            curl_easy_setopt(curl, CURLOPT_RESOLVE, httpctx->resolve);
+        }
         curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_data);
         curl_easy_setopt(curl, CURLOPT_READDATA, (void*)req);
         curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, seek_data);
@@ -1533,6 +1936,24 @@ void CurlHttpIO::send_request(CurlHttpContext* httpctx)
             curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, 4096L);
         }
 
+#if LIBCURL_VERSION_NUM >= 0x072b00 // At least cURL 7.43.0
+        if (httpio->http2 && !memcmp(httpctx->posturl.c_str(), "https:", 6))
+        {
+            // wait for a connection to the server that can take another stream, rather than opening a new one
+            curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, long(CURL_HTTP_VERSION_2TLS));
+            curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+        }
+#endif
+
+#if LIBCURL_VERSION_NUM >= 0x073e00 // At least cURL 7.62.0
+        // transfer uploads are fed from the request buffer: let cURL take it in large pieces
+        // (fewer read_data() calls and socket writes), unless the upload speed is limited
+        if (req->type == REQ_BINARY && !data && req->out->size() > 65536 && !httpio->bandwidth[PUT].active())
+        {
+            curl_easy_setopt(curl, CURLOPT_UPLOAD_BUFFERSIZE, 524288L);
+        }
+#endif
+
         if (req->minspeed)
         {
             curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 60L);
@@ -1606,6 +2027,7 @@ void CurlHttpIO::send_request(CurlHttpContext* httpctx)
 
             curl_easy_setopt(curl, CURLOPT_PROXY, httpio->proxyip.c_str());
             curl_easy_setopt(curl, CURLOPT_PROXYAUTH, CURLAUTH_ANY);
+            curl_easy_setopt(curl, CURLOPT_SHARE, httpio->curlshproxy);
 
             if (httpio->proxyusername.size())
             {
@@ -2129,8 +2551,13 @@ bool CurlHttpIO::doio()
     processcurlevents(API);
     result |= multidoio(curlm[API]);
 
+    struct tm now;
+    m_localtime(m_time(), &now);
+
     for (int d = GET; d == GET || d == PUT; d += PUT - GET)
     {
+        bandwidth[d].tick(Waiter::ds, now.tm_hour * 60 + now.tm_min);
+
         partialdata[d] = 0;
         if (arerequestspaused[d])
         {
@@ -2243,6 +2670,37 @@ bool CurlHttpIO::multidoio(CURLM *curlmhandle)
                 curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &httpstatus);
                 req->httpstatus = int(httpstatus);
 
+                double wirebytes = 0;
+                if (curl_easy_getinfo(msg->easy_handle, CURLINFO_SIZE_DOWNLOAD, &wirebytes) == CURLE_OK)
+                {
+                    req->wirebytes = m_off_t(wirebytes);
+                }
+
+                if (req->httpiohandle)
+                {
+                    long connects = 0;
+                    direction_t d = ((CurlHttpContext*)req->httpiohandle)->d;
+                    curl_easy_getinfo(msg->easy_handle, CURLINFO_NUM_CONNECTS, &connects);
+                    requestsDone[d]++;
+                    connectionsOpened[d] += uint64_t(connects);
+
+#if LIBCURL_VERSION_NUM >= 0x073d00 // At least cURL 7.61.0
+                    // from the TCP connection to the end of the TLS handshake (0 for plain HTTP)
+                    curl_off_t connecttime = 0, appconnecttime = 0;
+                    if (connects > 0
+                            && curl_easy_getinfo(msg->easy_handle, CURLINFO_CONNECT_TIME_T, &connecttime) == CURLE_OK
+                            && curl_easy_getinfo(msg->easy_handle, CURLINFO_APPCONNECT_TIME_T, &appconnecttime) == CURLE_OK
+                            && appconnecttime > connecttime)
+                    {
+                        TlsHandshakes& h = tlshandshakes[((CurlHttpContext*)req->httpiohandle)->hostname];
+                        int64_t us = int64_t(appconnecttime - connecttime);
+                        h.count++;
+                        h.totalus += us;
+                        h.maxus = std::max(h.maxus, us);
+                    }
+#endif
+                }
+
                 LOG_debug << "CURLMSG_DONE with HTTP status: " << req->httpstatus << " from "
                           << (req->httpiohandle ? (((CurlHttpContext*)req->httpiohandle)->hostname + " - " + ((CurlHttpContext*)req->httpiohandle)->hostip) : "(unknown) ");
                 if (req->httpstatus)
@@ -2312,6 +2770,9 @@ bool CurlHttpIO::multidoio(CURLM *curlmhandle)
                 req->status = REQ_FAILURE;
             }
 
+            TRACE_EVENT(TRACE_HTTP, req->status == REQ_SUCCESS ? TRACE_HTTP_REQUEST : TRACE_HTTP_FAILURE, req->traceId ? req->traceId : UNDEF,
+                        uint64_t((req->out ? req->out->size() : 0) + (req->buf ? size_t(req->bufpos) : req->in.size())), req->started);
+
             statechange = true;
 
             if (req->status == REQ_FAILURE && !req->httpstatus)
@@ -2497,12 +2958,12 @@ size_t CurlHttpIO::read_data(void* ptr, size_t size, size_t nmemb, void* source)
 
     req->lastdata = Waiter::ds;
 
-    if (httpio->maxspeed[PUT])
+    if (httpio->bandwidth[PUT].active())
     {
         bool isApi = (req->type == REQ_JSON);
         if (!isApi)
         {
-            long maxbytes = long( (httpio->maxspeed[PUT] - httpio->uploadSpeed) * (SpeedController::SPEED_MEAN_MAX_INTERVAL_DS / 10) - httpio->partialdata[PUT] );
+            m_off_t maxbytes = httpio->bandwidth[PUT].grant(req->bwclass, m_off_t(nread));
             if (maxbytes <= 0)
             {
                 httpio->pausedrequests[PUT].insert(httpctx->curl);
@@ -2510,10 +2971,7 @@ size_t CurlHttpIO::read_data(void* ptr, size_t size, size_t nmemb, void* source)
                 return CURL_READFUNC_PAUSE;
             }
 
-            if (nread > (size_t)maxbytes)
-            {
-                nread = maxbytes;
-            }
+            nread = size_t(maxbytes);
             httpio->partialdata[PUT] += nread;
         }
     }
@@ -2531,14 +2989,14 @@ size_t CurlHttpIO::write_data(void* ptr, size_t size, size_t nmemb, void* target
     CurlHttpIO* httpio = (CurlHttpIO*)req->httpio;
     if (httpio)
     {
-        if (httpio->maxspeed[GET])
+        if (httpio->bandwidth[GET].active())
         {
             CurlHttpContext* httpctx = (CurlHttpContext*)req->httpiohandle;
             bool isUpload = httpctx->data ? httpctx->len : req->out->size();
             bool isApi = (req->type == REQ_JSON);
             if (!isApi && !isUpload)
             {
-                if ((httpio->downloadSpeed + 10 * (httpio->partialdata[GET] + len) / SpeedController::SPEED_MEAN_MAX_INTERVAL_DS) > httpio->maxspeed[GET])
+                if (!httpio->bandwidth[GET].admit(req->bwclass, len))
                 {
                     CurlHttpContext* httpctx = (CurlHttpContext*)req->httpiohandle;
                     httpio->pausedrequests[GET].insert(httpctx->curl);
@@ -2674,6 +3132,9 @@ int CurlHttpIO::socket_callback(CURL *, curl_socket_t s, int what, void *userp,
 
 #if defined(_WIN32)
             it->second.closeEvent();
+#endif
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+            httpio->watchsocket(d, s, it->second.mode, SockInfo::NONE);
 #endif
             it->second.mode = 0;
         }
@@ -2698,6 +3159,9 @@ int CurlHttpIO::socket_callback(CURL *, curl_socket_t s, int what, void *userp,
         }
 
         auto& info = it->second;
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+        httpio->watchsocket(d, s, info.mode, what);
+#endif
         info.fd = s;
         info.mode = what;
 #if defined(_WIN32)
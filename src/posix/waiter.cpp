@@ -67,6 +67,11 @@ void PosixWaiter::init(dstime ds)
 // update monotonously increasing timestamp in deciseconds
 void Waiter::bumpds()
 {
+    if (manualclock)
+    {
+        return;
+    }
+
     timespec ts;
 
     m_clock_getmonotonictime(&ts);
@@ -25,6 +25,22 @@
 #include "mega/testhooks.h"
 #include "mega.h" // for thread definitions
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MEGA_RAID_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// AVX2 is not assumed by the build: that version is compiled for it on its own and picked at runtime
+#if defined(MEGA_RAID_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MEGA_RAID_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MEGA_RAID_NEON 1
+#include <arm_neon.h>
+#endif
+
 #undef min //avoids issues with std::min
 
 namespace mega
@@ -114,7 +130,7 @@ RaidBufferManager::FilePiece::FilePiece()
 
 RaidBufferManager::FilePiece::FilePiece(m_off_t p, size_t len)
     : pos(p)
-    , buf(new byte[len + std::min<size_t>(SymmCipher::BLOCKSIZE, RAIDSECTOR)], 0, len)   // SymmCipher::ctr_crypt requirement: decryption: data must be padded to BLOCKSIZE.  Also make sure we can xor up to RAIDSECTOR more for convenience
+    , buf(new byte[len + std::min<size_t>(SymmCipher::BLOCKSIZE, RAIDSECTOR)], 0, len, len + std::min<size_t>(SymmCipher::BLOCKSIZE, RAIDSECTOR))   // SymmCipher::ctr_crypt requirement: decryption: data must be padded to BLOCKSIZE.  Also make sure we can xor up to RAIDSECTOR more for convenience
 {
 }
 
@@ -458,6 +474,18 @@ void RaidBufferManager::combineRaidParts(unsigned connectionNum)
 
     assert(!partslen || !processToEnd || sumdatalen - partslen * (RAIDPARTS - 1) <= RAIDLINE);
 
+    if (!processToEnd)
+    {
+        // only combine the lines up to the last chunk boundary the data reaches (and the one across it):
+        // the rest stays in the input parts, rather than being copied out to leftoverchunk and back
+        m_off_t boundary = calcOutputChunkPos(newdatafilepos + partslen * (RAIDPARTS - 1));
+        if (boundary > newdatafilepos)
+        {
+            size_t lines = size_t((boundary - newdatafilepos + RAIDLINE - 1) / RAIDLINE);
+            partslen = std::min<size_t>(partslen, lines * RAIDSECTOR);
+        }
+    }
+
     if (partslen > 0 || processToEnd)
     {
         m_off_t macchunkpos = calcOutputChunkPos(newdatafilepos + partslen * (RAIDPARTS - 1));
@@ -535,7 +563,7 @@ RaidBufferManager::FilePiece* RaidBufferManager::combineRaidParts(size_t partsle
     // usual case, for simple and fast processing: all input buffers are the same size, and aligned, and a multiple of raidsector
     if (partslen > 0)
     {
-        byte* inputbufs[RAIDPARTS];
+        const byte* inputbufs[RAIDPARTS];
         for (unsigned i = RAIDPARTS; i--; )
         {
             FilePiece* inputPiece = raidinputparts[i].front();
@@ -543,51 +571,12 @@ RaidBufferManager::FilePiece* RaidBufferManager::combineRaidParts(size_t partsle
         }
 
         byte* b = result->buf.datastart() + prevleftoverchunk.buf.datalen();
-        byte* endpos = b + partslen * (RAIDPARTS-1);
-
-        for (unsigned i = 0; b < endpos; i += RAIDSECTOR)
-        {
-            for (unsigned j = 1; j < RAIDPARTS; ++j)
-            {
-                assert(b + RAIDSECTOR <= result->buf.datastart() + result->buf.datalen());
-                if (inputbufs[j])
-                {
-                    memcpy(b, inputbufs[j] + i, RAIDSECTOR);
-                }
-                else
-                {
-                    recoverSectorFromParity(b, inputbufs, i);
-                }
-                b += RAIDSECTOR;
-            }
-        }
-        assert(b == endpos);
+        assert(b + partslen * (RAIDPARTS - 1) <= result->buf.datastart() + result->buf.datalen());
+        RaidLineCombiner::combine(b, inputbufs, partslen / RAIDSECTOR);
     }
     return result;
 }
 
-void RaidBufferManager::recoverSectorFromParity(byte* dest, byte* inputbufs[], unsigned offset)
-{
-    assert(sizeof(m_off_t)*2 == RAIDSECTOR);
-    bool set = false;
-    for (unsigned i = RAIDPARTS; i--; )
-    {
-        if (inputbufs[i])
-        {
-            if (!set)
-            {
-                memcpy(dest, inputbufs[i] + offset, RAIDSECTOR);
-                set = true;
-            }
-            else
-            {
-                *(m_off_t*)dest ^= *(m_off_t*)(inputbufs[i] + offset);
-                *(m_off_t*)(dest + sizeof(m_off_t)) ^= *(m_off_t*)(inputbufs[i] + offset + sizeof(m_off_t));
-            }
-        }
-    }
-}
-
 void RaidBufferManager::combineLastRaidLine(byte* dest, size_t remainingbytes)
 {
     // we have to be careful to use the right number of bytes from each sector
@@ -664,37 +653,54 @@ bool RaidBufferManager::FilePiece::finalize(bool parallel, m_off_t filesize, int
     m_off_t endpos = ChunkedHash::chunkceil(startpos, finalpos);
     unsigned chunksize = static_cast<unsigned>(endpos - startpos);
 
+    // the chunks completed by this piece are independent, so they are decrypted and mac'd together
+    vector<SymmCipher::CtrChunk> batch;
+    vector<ChunkMAC*> batchmacs;
+
+    // chunks that were already verified (eg. raid lines fetched again after a resume) are decrypted but keep their MAC
+    byte discardedmac[SymmCipher::BLOCKSIZE];
+
     while (chunksize)
     {
         m_off_t chunkid = ChunkedHash::chunkfloor(startpos);
         ChunkMAC &chunkmac = chunkmacs[chunkid];
-        if (!chunkmac.finished)
+        if (source_chunkmacs && !chunkmac.finished)
         {
-            if (source_chunkmacs)
+            if (chunkid < source_chunkmacs->foldedEnd())
+            {
+                // folded, so verified already
+                chunkmac.finished = true;
+            }
+            else
             {
                 chunkmac = (*source_chunkmacs)[chunkid];
             }
-            if (endpos == ChunkedHash::chunkceil(chunkid, filesize))
+        }
+
+        bool verified = chunkmac.finished;
+        byte* mac = verified ? discardedmac : chunkmac.mac;
+
+        if (endpos == ChunkedHash::chunkceil(chunkid, filesize))
+        {
+            if (parallel)
             {
-                if (parallel)
-                {
-                    // these parts can be done on a thread - they are independent chunks, or the earlier part of the chunk is already done.
-                    cipher->ctr_crypt(chunkstart, chunksize, startpos, ctriv, chunkmac.mac, false, !chunkmac.finished && !chunkmac.offset);
-                    LOG_debug << "Finished chunk: " << startpos << " - " << endpos << "   Size: " << chunksize;
-                    chunkmac.finished = true;
-                    chunkmac.offset = 0;
-                }
-                else
-                {
-                    queueParallel = true;
-                }
+                // these parts can be done on a thread - they are independent chunks, or the earlier part of the chunk is already done.
+                SymmCipher::CtrChunk c = { chunkstart, chunksize, startpos, mac, verified || !chunkmac.offset };
+                batch.push_back(c);
+                batchmacs.push_back(verified ? nullptr : &chunkmac);
             }
-            else if (!parallel)
+            else
+            {
+                queueParallel = true;
+            }
+        }
+        else if (!parallel)
+        {
+            // these part chunks must be done serially (and first), since later parts of a chunk need the mac of earlier parts as input.
+            cipher->ctr_crypt(chunkstart, chunksize, startpos, ctriv, mac, false, verified || !chunkmac.offset);
+            LOG_debug << "Decrypted partial chunk: " << startpos << " - " << endpos << "   Size: " << chunksize;
+            if (!verified)
             {
-                // these part chunks must be done serially (and first), since later parts of a chunk need the mac of earlier parts as input.
-                cipher->ctr_crypt(chunkstart, chunksize, startpos, ctriv, chunkmac.mac, false, !chunkmac.finished && !chunkmac.offset);
-                LOG_debug << "Decrypted partial chunk: " << startpos << " - " << endpos << "   Size: " << chunksize;
-                chunkmac.finished = false;
                 chunkmac.offset += chunksize;
             }
         }
@@ -704,6 +710,21 @@ bool RaidBufferManager::FilePiece::finalize(bool parallel, m_off_t filesize, int
         chunksize = static_cast<unsigned>(endpos - startpos);
     }
 
+    if (!batch.empty())
+    {
+        cipher->ctr_crypt(batch.data(), batch.size(), ctriv, false);
+
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            LOG_debug << "Finished chunk: " << batch[i].pos << " - " << batch[i].pos + batch[i].len << "   Size: " << batch[i].len;
+            if (batchmacs[i])
+            {
+                batchmacs[i]->finished = true;
+                batchmacs[i]->offset = 0;
+            }
+        }
+    }
+
     finalized = !queueParallel;
     if (finalized)
         finalizedCV.notify_one();
@@ -809,6 +830,54 @@ m_off_t RaidBufferManager::progress() const
     return reportPos;
 }
 
+m_off_t RaidBufferManager::bufferedBytes() const
+{
+    m_off_t bytes = 0;
+
+    for (unsigned j = RAIDPARTS; j--; )
+    {
+        for (FilePiece* p : raidinputparts[j])
+        {
+            bytes += m_off_t(p->buf.isNull() ? 0 : p->buf.datalen());
+        }
+    }
+
+    for (auto& p : asyncoutputbuffers)
+    {
+        if (p.second && !p.second->buf.isNull())
+        {
+            bytes += m_off_t(p.second->buf.datalen());
+        }
+    }
+
+    return bytes + m_off_t(leftoverchunk.buf.isNull() ? 0 : leftoverchunk.buf.datalen());
+}
+
+bool RaidBufferManager::isRaidPartBehind(unsigned connectionNum) const
+{
+    if (!isRaid() || connectionNum == unusedRaidConnection)
+    {
+        return false;
+    }
+
+    // combining is limited by the part with the least data
+    auto partEnd = [this](unsigned j)
+    {
+        const std::deque<FilePiece*>& pieces = raidinputparts[j];
+        return pieces.empty() ? raidpartspos : pieces.back()->pos + m_off_t(pieces.back()->buf.datalen());
+    };
+
+    m_off_t end = partEnd(connectionNum);
+    for (unsigned j = RAIDPARTS; j--; )
+    {
+        if (j != unusedRaidConnection && partEnd(j) < end)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 
 TransferBufferManager::TransferBufferManager()
     : transfer(NULL)
@@ -854,13 +923,13 @@ std::pair<m_off_t, m_off_t> TransferBufferManager::nextNPosForConnection(unsigne
 
             // choose upload chunks that are big enough to saturate the connection, so we don't start HTTP PUT request too frequently
             // make them smaller at the end of the file so we still have the last parts delivered in parallel
-            m_off_t maxsize = 32 * 1024 * 1024;
+            m_off_t maxsize = maxRequestSize;
             if (npos + 2 * maxsize > transfer->size) maxsize /= 2;
             if (npos + maxsize > transfer->size) maxsize /= 2;
             if (npos + maxsize > transfer->size) maxsize /= 2;
             m_off_t speedsize = std::min<m_off_t>(maxsize, uploadSpeed * 2 / 3);    // two seconds of data over 3 connections
             m_off_t sizesize = transfer->size > 32 * 1024 * 1024 ? 8 * 1024 * 1024 : 0;  // start with large-ish portions for large files.
-            m_off_t targetsize = std::max<m_off_t>(sizesize, speedsize);
+            m_off_t targetsize = std::min<m_off_t>(std::max<m_off_t>(sizesize, speedsize), maxRequestSize);
 
             while (npos < transfer->pos + targetsize && npos < transfer->size)
             {
@@ -901,11 +970,7 @@ std::pair<m_off_t, m_off_t> TransferBufferManager::nextNPosForConnection(unsigne
 
 void TransferBufferManager::bufferWriteCompletedAction(FilePiece& r)
 {
-    for (chunkmac_map::iterator it = r.chunkmacs.begin(); it != r.chunkmacs.end(); it++)
-    {
-        transfer->chunkmacs[it->first] = it->second;
-    }
-
+    transfer->chunkmacs.finishedDownloadPiece(r.chunkmacs);
     r.chunkmacs.clear();
     transfer->progresscompleted += r.buf.datalen();
     LOG_debug << "Cached data at: " << r.pos << "   Size: " << r.buf.datalen();
@@ -961,4 +1026,194 @@ void DirectReadBufferManager::finalize(FilePiece& fp)
     }
 }
 
+namespace {
+
+// index of the missing data part, or 0 if they are all present
+unsigned missingRaidPart(const byte* const inputs[RAIDPARTS])
+{
+    for (unsigned j = 1; j < RAIDPARTS; ++j)
+    {
+        if (!inputs[j])
+        {
+            assert(inputs[0]);
+            return j;
+        }
+    }
+    return 0;
+}
+
+// a sector at a time, recovering missing ones from the parity two m_off_t at a time
+void combineRaidLinesScalar(byte* dest, const byte* const inputs[RAIDPARTS], size_t lines)
+{
+    static_assert(sizeof(m_off_t) * 2 == RAIDSECTOR, "parity is recovered in two halves");
+
+    for (size_t i = 0; i < lines * RAIDSECTOR; i += RAIDSECTOR)
+    {
+        for (unsigned j = 1; j < RAIDPARTS; ++j, dest += RAIDSECTOR)
+        {
+            if (inputs[j])
+            {
+                memcpy(dest, inputs[j] + i, RAIDSECTOR);
+                continue;
+            }
+
+            bool set = false;
+            for (unsigned k = RAIDPARTS; k--; )
+            {
+                if (inputs[k])
+                {
+                    if (!set)
+                    {
+                        memcpy(dest, inputs[k] + i, RAIDSECTOR);
+                        set = true;
+                    }
+                    else
+                    {
+                        *(m_off_t*)dest ^= *(const m_off_t*)(inputs[k] + i);
+                        *(m_off_t*)(dest + sizeof(m_off_t)) ^= *(const m_off_t*)(inputs[k] + i + sizeof(m_off_t));
+                    }
+                }
+            }
+        }
+    }
+}
+
+#ifdef MEGA_RAID_SSE2
+// a raid line per iteration, held in registers: the missing sector is the xor of the five others
+void combineRaidLinesSSE2(byte* dest, const byte* const inputs[RAIDPARTS], size_t lines)
+{
+    unsigned missing = missingRaidPart(inputs);
+    __m128i* out = reinterpret_cast<__m128i*>(dest);
+
+    for (size_t i = 0; i < lines * RAIDSECTOR; i += RAIDSECTOR)
+    {
+        __m128i v[RAIDPARTS];
+        __m128i x = _mm_setzero_si128();
+        for (unsigned j = 0; j < RAIDPARTS; ++j)
+        {
+            if (j != missing && (j || missing))
+            {
+                v[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inputs[j] + i));
+                x = _mm_xor_si128(x, v[j]);
+            }
+        }
+        v[missing] = x;
+
+        for (unsigned j = 1; j < RAIDPARTS; ++j)
+        {
+            _mm_storeu_si128(out++, v[j]);
+        }
+    }
+}
+#endif
+
+#ifdef MEGA_RAID_AVX2
+// two raid lines per iteration, the sectors of each part being regrouped across the 128-bit lanes
+__attribute__((target("avx2")))
+void combineRaidLinesAVX2(byte* dest, const byte* const inputs[RAIDPARTS], size_t lines)
+{
+    unsigned missing = missingRaidPart(inputs);
+    size_t i = 0;
+
+    for (; i + 2 <= lines; i += 2)
+    {
+        size_t offset = i * RAIDSECTOR;
+
+        __m256i v[RAIDPARTS];
+        __m256i x = _mm256_setzero_si256();
+        for (unsigned j = 0; j < RAIDPARTS; ++j)
+        {
+            if (j != missing && (j || missing))
+            {
+                v[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(inputs[j] + offset));
+                x = _mm256_xor_si256(x, v[j]);
+            }
+        }
+        v[missing] = x;
+
+        // v[j] holds sector j of both lines: output is 1a 2a | 3a 4a | 5a 1b | 2b 3b | 4b 5b
+        __m256i* out = reinterpret_cast<__m256i*>(dest + i * RAIDLINE);
+        _mm256_storeu_si256(out, _mm256_permute2x128_si256(v[1], v[2], 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(v[3], v[4], 0x20));
+        _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(v[5], v[1], 0x30));
+        _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(v[2], v[3], 0x31));
+        _mm256_storeu_si256(out + 4, _mm256_permute2x128_si256(v[4], v[5], 0x31));
+    }
+
+    if (i < lines)
+    {
+        const byte* rest[RAIDPARTS];
+        for (unsigned j = 0; j < RAIDPARTS; ++j)
+        {
+            rest[j] = inputs[j] ? inputs[j] + i * RAIDSECTOR : nullptr;
+        }
+        combineRaidLinesSSE2(dest + i * RAIDLINE, rest, lines - i);
+    }
+}
+#endif
+
+#ifdef MEGA_RAID_NEON
+void combineRaidLinesNEON(byte* dest, const byte* const inputs[RAIDPARTS], size_t lines)
+{
+    unsigned missing = missingRaidPart(inputs);
+
+    for (size_t i = 0; i < lines * RAIDSECTOR; i += RAIDSECTOR)
+    {
+        uint8x16_t v[RAIDPARTS];
+        uint8x16_t x = vdupq_n_u8(0);
+        for (unsigned j = 0; j < RAIDPARTS; ++j)
+        {
+            if (j != missing && (j || missing))
+            {
+                v[j] = vld1q_u8(inputs[j] + i);
+                x = veorq_u8(x, v[j]);
+            }
+        }
+        v[missing] = x;
+
+        for (unsigned j = 1; j < RAIDPARTS; ++j, dest += RAIDSECTOR)
+        {
+            vst1q_u8(dest, v[j]);
+        }
+    }
+}
+#endif
+
+} // namespace
+
+std::vector<std::pair<const char*, RaidLineCombiner::Function>> RaidLineCombiner::implementations()
+{
+    std::vector<std::pair<const char*, Function>> result;
+    result.emplace_back("scalar", combineRaidLinesScalar);
+
+#ifdef MEGA_RAID_SSE2
+    result.emplace_back("sse2", combineRaidLinesSSE2);
+#endif
+
+#ifdef MEGA_RAID_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        result.emplace_back("avx2", combineRaidLinesAVX2);
+    }
+#endif
+
+#ifdef MEGA_RAID_NEON
+    result.emplace_back("neon", combineRaidLinesNEON);
+#endif
+
+    return result;
+}
+
+void RaidLineCombiner::combine(byte* dest, const byte* const inputs[RAIDPARTS], size_t lines)
+{
+    static const Function best = implementations().back().second;
+    best(dest, inputs, lines);
+}
+
+const char* RaidLineCombiner::name()
+{
+    static const char* const best = implementations().back().first;
+    return best;
+}
+
 }; // namespace
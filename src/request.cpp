@@ -36,6 +36,30 @@ void Request::add(Command* c)
     cmds.push_back(c);
 }
 
+bool Request::coalesce(Command* c)
+{
+    for (size_t i = cmds.size(), scanned = 0; i-- && scanned++ < MAX_COALESCE_SCAN; )
+    {
+        switch (c->coalescing(*cmds[i]))
+        {
+            case Command::COALESCE_NONE:
+                return false;
+
+            case Command::COALESCE_PASS:
+                break;
+
+            case Command::COALESCE_REPLACE:
+                c->coalesced = std::move(cmds[i]->coalesced);
+                cmds[i]->coalesced.clear();
+                c->coalesced.push_back(cmds[i]);
+                cmds.erase(cmds.begin() + static_cast<ptrdiff_t>(i));
+                cmds.push_back(c);
+                return true;
+        }
+    }
+    return false;
+}
+
 size_t Request::size() const
 {
     return cmds.size();
@@ -44,6 +68,13 @@ size_t Request::size() const
 void Request::get(string* req, bool& suppressSID) const
 {
     // concatenate all command objects, resulting in an API request
+    size_t total = 2;
+    for (const Command* c : cmds)
+    {
+        total += c->size() + 3;
+    }
+    req->reserve(total);
+
     *req = "[";
 
     suppressSID = true; // only if all commands in batch are suppressSID
@@ -95,6 +126,7 @@ void Request::process(MegaClient* client)
         Command* cmd = cmds[processindex];
 
         client->restag = cmd->tag;
+        TraceScope traceScope(cmd->traceId);
 
         cmd->client = client;
 
@@ -102,7 +134,18 @@ void Request::process(MegaClient* client)
         bool parsedOk = true;
 
         Error e;
-        if (cmd->checkError(e, client->json))
+        bool isError = cmd->checkError(e, client->json);
+
+        // the commands this one replaced get its result first, as they were queued first
+        for (Command* c : cmd->coalesced)
+        {
+            client->restag = c->tag;
+            c->client = client;
+            c->procresult(Command::Result(Command::CmdError, isError ? e : Error(API_OK)));
+        }
+        client->restag = cmd->tag;
+
+        if (isError)
         {
             parsedOk = cmd->procresult(Command::Result(Command::CmdError, e));
         }
@@ -201,6 +244,7 @@ void Request::swap(Request& r)
 RequestDispatcher::RequestDispatcher()
 {
     nextreqs.push_back(Request());
+    backgroundreqs.push_back(Request());
 }
 
 #ifdef MEGA_MEASURE_CODE
@@ -224,11 +268,35 @@ void RequestDispatcher::add(Command *c)
     }
 #endif
 
+    if (c->orderIndependent && maxinflight > 1 && parallelnext.size() < MAX_COMMANDS)
+    {
+        parallelnext.add(c);
+        return;
+    }
+
+    if (c->background && !c->batchSeparately)
+    {
+        if (backgroundreqs.back().size() >= MAX_COMMANDS)
+        {
+            backgroundreqs.push_back(Request());
+        }
+        if (!backgroundreqs.back().coalesce(c))
+        {
+            backgroundreqs.back().add(c);
+        }
+        return;
+    }
+
     if (nextreqs.back().size() >= MAX_COMMANDS)
     {
         LOG_debug << "Starting an additional Request due to MAX_COMMANDS";
         nextreqs.push_back(Request());
     }
+    if (!c->batchSeparately && nextreqs.back().coalesce(c))
+    {
+        return;
+    }
+
     if (c->batchSeparately && !nextreqs.back().empty())
     {
         LOG_debug << "Starting an additional Request for a batch-separately command";
@@ -244,31 +312,35 @@ void RequestDispatcher::add(Command *c)
 
 bool RequestDispatcher::cmdspending() const
 {
-    return !nextreqs.front().empty();
+    return !nextreqs.front().empty() || !backgroundreqs.front().empty();
+}
+
+size_t RequestDispatcher::queuedbatches() const
+{
+    return nextreqs.size() - (nextreqs.back().empty() ? 1 : 0)
+         + backgroundreqs.size() - (backgroundreqs.back().empty() ? 1 : 0);
 }
 
 void RequestDispatcher::serverrequest(string *out, bool& suppressSID, bool &includesFetchingNodes)
 {
     assert(inflightreq.empty());
-    inflightreq.swap(nextreqs.front());
-    nextreqs.pop_front();
-    if (nextreqs.empty())
+    deque<Request>& queue = nextreqs.front().empty() ? backgroundreqs : nextreqs;
+    inflightreq.swap(queue.front());
+    queue.pop_front();
+    if (queue.empty())
     {
-        nextreqs.push_back(Request());
+        queue.push_back(Request());
     }
+    takebuffer(out);
     inflightreq.get(out, suppressSID);
     includesFetchingNodes = inflightreq.isFetchNodes();
-#ifdef MEGA_MEASURE_CODE
     csRequestsSent += inflightreq.size();
     csBatchesSent += 1;
-#endif
 }
 
 void RequestDispatcher::requeuerequest()
 {
-#ifdef MEGA_MEASURE_CODE
     csBatchesReceived += 1;
-#endif
     assert(!inflightreq.empty());
     if (!nextreqs.front().empty())
     {
@@ -280,11 +352,10 @@ void RequestDispatcher::requeuerequest()
 void RequestDispatcher::serverresponse(std::string&& movestring, MegaClient *client)
 {
     CodeCounter::ScopeTimer ccst(client->performanceStats.csResponseProcessingTime);
+    CodeCounter::LoopProfiler::Phase phase(client->performanceStats.execPhases, MegaClient::PerformanceStats::PHASE_CSRESPONSE);
 
-#ifdef MEGA_MEASURE_CODE
     csBatchesReceived += 1;
     csRequestsCompleted += inflightreq.size();
-#endif
     processing = true;
     inflightreq.serverresponse(std::move(movestring), client);
     inflightreq.process(client);
@@ -318,19 +389,143 @@ void RequestDispatcher::clear()
         // we are being called from a command that is in progress (eg. logout) - delay wiping the data structure until that call ends.
         clearWhenSafe = true;
         inflightreq.stopProcessing = true;
+        for (auto& r : parallelinflight)
+        {
+            r.second.stopProcessing = true;
+        }
     }
     else
     {
         inflightreq.clear();
+        parallelnext.clear();
+        for (auto& r : parallelinflight)
+        {
+            r.second.clear();
+        }
+        parallelinflight.clear();
+        sparebuffers.clear();
         for (auto& r : nextreqs)
         {
             r.clear();
         }
         nextreqs.clear();
         nextreqs.push_back(Request());
+        for (auto& r : backgroundreqs)
+        {
+            r.clear();
+        }
+        backgroundreqs.clear();
+        backgroundreqs.push_back(Request());
         processing = false;
         clearWhenSafe = false;
     }
 }
 
+void RequestDispatcher::recyclebuffer(string&& buffer)
+{
+    if (sparebuffers.size() < MAX_SPARE_BUFFERS && buffer.capacity())
+    {
+        sparebuffers.push_back(std::move(buffer));
+    }
+}
+
+size_t RequestDispatcher::trimbuffers()
+{
+    size_t released = 0;
+    for (auto& b : sparebuffers)
+    {
+        released += b.capacity();
+    }
+    sparebuffers.clear();
+    return released;
+}
+
+void RequestDispatcher::takebuffer(string* out)
+{
+    if (!sparebuffers.empty() && sparebuffers.back().capacity() > out->capacity())
+    {
+        out->swap(sparebuffers.back());
+        sparebuffers.pop_back();
+    }
+    out->clear();
+}
+
+void RequestDispatcher::setmaxinflight(unsigned n)
+{
+    maxinflight = std::max(n, 1u);
+    if (maxinflight == 1 && !parallelnext.empty())
+    {
+        // no more parallel batches: the waiting commands go to the ordered queue
+        if (!nextreqs.back().empty())
+        {
+            nextreqs.push_back(Request());
+        }
+        nextreqs.back().swap(parallelnext);
+    }
+}
+
+bool RequestDispatcher::parallelready() const
+{
+    return !parallelnext.empty() && parallelinflight.size() + 1 < maxinflight;
+}
+
+int RequestDispatcher::parallelrequest(string* out, bool& suppressSID)
+{
+    assert(parallelready());
+    int id = ++nextparallelid;
+    Request& r = parallelinflight[id];
+    r.swap(parallelnext);
+    takebuffer(out);
+    r.get(out, suppressSID);
+    csRequestsSent += r.size();
+    csBatchesSent += 1;
+    return id;
+}
+
+void RequestDispatcher::parallelresponse(int id, std::string&& movestring, MegaClient* client)
+{
+    auto it = parallelinflight.find(id);
+    if (it == parallelinflight.end())
+    {
+        // cleared (eg. logout) while in flight
+        return;
+    }
+
+    CodeCounter::ScopeTimer ccst(client->performanceStats.csResponseProcessingTime);
+    CodeCounter::LoopProfiler::Phase phase(client->performanceStats.execPhases, MegaClient::PerformanceStats::PHASE_CSRESPONSE);
+
+    csBatchesReceived += 1;
+    csRequestsCompleted += it->second.size();
+    processing = true;
+    it->second.serverresponse(std::move(movestring), client);
+    it->second.process(client);
+    assert(it->second.empty());
+    processing = false;
+    if (clearWhenSafe)
+    {
+        clear();
+    }
+    else
+    {
+        parallelinflight.erase(it);
+    }
+}
+
+void RequestDispatcher::parallelrequeue(int id)
+{
+    auto it = parallelinflight.find(id);
+    if (it == parallelinflight.end())
+    {
+        return;
+    }
+
+    // retries and errors are dealt with by the ordered queue, which gets the same response
+    if (!nextreqs.back().empty())
+    {
+        nextreqs.push_back(Request());
+    }
+    nextreqs.back().swap(it->second);
+    parallelinflight.erase(it);
+}
+
 } // namespace
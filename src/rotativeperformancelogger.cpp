@@ -154,6 +154,7 @@ public:
         if (!mLogThread)
         {
             mLogThread.reset(new std::thread([this, logsPath, fileName]() {
+                ThreadRoles::enter(ThreadRoles::LOGGER, "mega-perflog");
                 logThreadFunction(logsPath, fileName);
             }));
         }
@@ -442,6 +443,7 @@ private:
                 mFsAccess->renamelocal(fileNameFullPath, newNameZipping, true);
 
                 std::thread t([=]() {
+                    ThreadRoles::enter(ThreadRoles::LOGGER, "mega-logzip");
                     std::lock_guard<std::mutex> g(mLogRotationMutex); // prevent another rotation while we work on this file
                     gzipCompressOnRotate(newNameZipping, newNameDone);
                 });
@@ -0,0 +1,267 @@
+/**
+ * @file scanservice.cpp
+ * @brief Lists local folders on a pool of threads
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#ifdef ENABLE_SYNC
+
+#include "mega/scanservice.h"
+#include "mega/logging.h"
+#include "megafs.h"
+
+namespace mega {
+
+ScanService::Walk::Walk(ScanService& service, bool followSymlinks)
+    : mService(service)
+    , mFollowSymlinks(followSymlinks)
+    , mCancelled(false)
+{
+}
+
+void ScanService::Walk::scan(const LocalPath& path)
+{
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        ++mPending;
+    }
+
+    Task task;
+    task.walk = shared_from_this();
+    task.path = path;
+    mService.queue(std::move(task));
+}
+
+bool ScanService::Walk::next(Batch& batch)
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    if (mBatches.empty())
+    {
+        return false;
+    }
+
+    batch = std::move(mBatches.front());
+    mBatches.pop_front();
+    return true;
+}
+
+bool ScanService::Walk::done()
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    return !mPending && mBatches.empty();
+}
+
+void ScanService::Walk::cancel()
+{
+    mCancelled = true;
+
+    std::lock_guard<std::mutex> g(mMutex);
+    mBatches.clear();
+}
+
+std::shared_ptr<ScanService::Walk> ScanService::walk(bool followSymlinks)
+{
+    return std::make_shared<Walk>(*this, followSymlinks);
+}
+
+ScanService::ScanService(Waiter& waiter, unsigned threadCount)
+    : mWaiter(waiter)
+{
+    // all the workers exist before the threads start, which look at each other's queues
+    for (unsigned i = 0; i < std::max(threadCount, 1u); ++i)
+    {
+        mWorkers.emplace_back(new Worker);
+    }
+
+    size_t started = 0;
+    for (; started < mWorkers.size(); ++started)
+    {
+        try
+        {
+            mWorkers[started]->mThread = std::thread([this, started]()
+            {
+                ThreadRoles::enter(ThreadRoles::IO, "mega-scan");
+                loop(started);
+            });
+        }
+        catch (std::system_error& e)
+        {
+            LOG_err << "Failed to start scan thread: " << e.what();
+            break;
+        }
+    }
+    mRunning = started;
+
+    LOG_debug << "Scan threads running: " << started;
+}
+
+ScanService::~ScanService()
+{
+    {
+        std::lock_guard<std::mutex> g(mIdleMutex);
+        mExit = true;
+    }
+    mIdle.notify_all();
+
+    for (auto& worker : mWorkers)
+    {
+        if (worker->mThread.joinable())
+        {
+            worker->mThread.join();
+        }
+    }
+}
+
+void ScanService::queue(Task&& task)
+{
+    if (!mRunning)
+    {
+        LOG_err << "No scan threads, folder not listed: " << task.path.toPath();
+
+        Batch batch;
+        batch.path = std::move(task.path);
+        batch.failed = true;
+
+        std::lock_guard<std::mutex> g(task.walk->mMutex);
+        task.walk->mBatches.push_back(std::move(batch));
+        --task.walk->mPending;
+        return;
+    }
+
+    Worker& worker = *mWorkers[mNextWorker++ % mRunning];
+    {
+        std::lock_guard<std::mutex> g(worker.mMutex);
+        worker.mTasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> g(mIdleMutex);
+        ++mQueued;
+    }
+    mIdle.notify_one();
+}
+
+bool ScanService::take(size_t self, Task& task)
+{
+    for (size_t i = 0; i < mRunning; ++i)
+    {
+        Worker& worker = *mWorkers[(self + i) % mRunning];
+        std::lock_guard<std::mutex> g(worker.mMutex);
+
+        if (!worker.mTasks.empty())
+        {
+            if (!i)
+            {
+                task = std::move(worker.mTasks.back());
+                worker.mTasks.pop_back();
+            }
+            else
+            {
+                task = std::move(worker.mTasks.front());
+                worker.mTasks.pop_front();
+            }
+
+            std::lock_guard<std::mutex> q(mIdleMutex);
+            --mQueued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ScanService::loop(size_t self)
+{
+    FSACCESS_CLASS fsaccess;
+
+    for (;;)
+    {
+        Task task;
+        if (take(self, task))
+        {
+            list(fsaccess, task);
+            mWaiter.notify();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> g(mIdleMutex);
+        mIdle.wait(g, [this]() { return mExit || mQueued; });
+        if (mExit)
+        {
+            return;
+        }
+    }
+}
+
+void ScanService::list(FileSystemAccess& fsaccess, Task& task)
+{
+    Walk& walk = *task.walk;
+
+    Batch batch;
+    batch.path = task.path;
+
+    if (!walk.mCancelled)
+    {
+        LocalPath path = task.path;
+        LocalPath name;
+        unique_ptr<DirAccess> da(fsaccess.newdiraccess());
+
+        if (da->dopen(&path, nullptr, false))
+        {
+            while (!walk.mCancelled && da->dnext(path, name, walk.mFollowSymlinks))
+            {
+                ScopedLengthRestore restoreLen(path);
+                path.appendWithSeparator(name, false);
+
+                FSNode entry;
+                entry.localname = std::move(name);
+
+                auto fa = fsaccess.newfileaccess(false);
+                if (fa->fopen(path, true, false, da.get()))
+                {
+                    entry.type = fa->type;
+                    entry.fsid = fa->fsid;
+                    entry.fsidvalid = fa->fsidvalid;
+                    entry.isSymlink = fa->mIsSymLink;
+                    entry.shortname = fsaccess.fsShortname(path);
+                }
+                else
+                {
+                    entry.failed = true;
+                }
+
+                batch.entries.push_back(std::move(entry));
+                name.clear();
+            }
+        }
+        else
+        {
+            LOG_warn << "Unable to list folder: " << path.toPath();
+            batch.failed = true;
+        }
+    }
+
+    std::lock_guard<std::mutex> g(walk.mMutex);
+    if (!walk.mCancelled)
+    {
+        walk.mBatches.push_back(std::move(batch));
+    }
+    --walk.mPending;
+}
+
+} // namespace
+
+#endif
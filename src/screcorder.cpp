@@ -0,0 +1,154 @@
+/**
+ * @file screcorder.cpp
+ * @brief Recording of the action packets received, to replay them offline
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include "mega/screcorder.h"
+#include "mega/base64.h"
+#include "mega/logging.h"
+#include "mega/megaclient.h"
+
+namespace mega {
+
+const char* const ScRecorder::HEADER = "mega-sc-recording 1";
+
+ScRecorder::ScRecorder(FileSystemAccess& fsAccess, const LocalPath& path)
+    : mFsAccess(fsAccess)
+    , mPath(path)
+{
+}
+
+void ScRecorder::begin(MegaClient& client)
+{
+    if (mFailed)
+    {
+        return;
+    }
+
+    if (!mFile)
+    {
+        if (client.scsn.packetsApplied())
+        {
+            // part of this response is in the state already: the recording starts with the next one
+            mInResponse = false;
+            return;
+        }
+
+        mFile = mFsAccess.newfileaccess(false);
+        if (!mFile->fopen(mPath, false, true) || !mFile->ftruncate())
+        {
+            LOG_err << "Unable to open the sc recording: " << mPath.toPath(mFsAccess);
+            mFailed = true;
+            return;
+        }
+        writeState(client);
+    }
+
+    mInResponse = true;
+    mResponse.assign("sc:");
+}
+
+void ScRecorder::append(const char* data, size_t size)
+{
+    if (mInResponse)
+    {
+        mResponse.append(data, size);
+    }
+}
+
+void ScRecorder::end()
+{
+    if (!mInResponse)
+    {
+        return;
+    }
+
+    mInResponse = false;
+    mResponse.push_back('\n');
+    if (write(mResponse))
+    {
+        mResponses++;
+    }
+    mResponse.clear();
+}
+
+bool ScRecorder::write(const string& data)
+{
+    if (mFailed || !mFile->fwrite(reinterpret_cast<const byte*>(data.data()), static_cast<unsigned>(data.size()), mEnd))
+    {
+        if (!mFailed)
+        {
+            LOG_err << "Unable to write the sc recording: " << mPath.toPath(mFsAccess);
+            mFailed = true;
+        }
+        return false;
+    }
+    mEnd += m_off_t(data.size());
+    return true;
+}
+
+void ScRecorder::writeState(MegaClient& client)
+{
+    // every node is written, so all of them must be in memory
+    client.loadAllCachedNodes();
+
+    string state(HEADER);
+    state.append("\nme:").append(Base64Str<MegaClient::USERHANDLE>(client.me));
+    state.append("\nk:").append(Base64::btoa(string(reinterpret_cast<const char*>(client.key.key), SymmCipher::KEYLENGTH)));
+    state.append("\nsn:").append(client.scsn.text());
+    state.push_back('\n');
+
+    string record;
+    auto line = [&state, &record](const char* type)
+    {
+        state.append(type).append(Base64::btoa(record)).push_back('\n');
+    };
+
+    for (auto& u : client.users)
+    {
+        if (u.second.serialize(&record))
+        {
+            line("u:");
+        }
+        record.clear();
+    }
+
+    for (auto& n : client.nodes)
+    {
+        if (n.second->serialize(&record))
+        {
+            line("n:");
+        }
+        record.clear();
+    }
+
+    for (auto& p : client.pcrindex)
+    {
+        if (p.second->serialize(&record))
+        {
+            line("p:");
+        }
+        record.clear();
+    }
+
+    LOG_info << "sc recording started at " << client.scsn << ": " << client.users.size() << " users, " << client.nodes.size() << " nodes";
+    write(state);
+}
+
+} // namespace
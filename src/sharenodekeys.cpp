@@ -97,6 +97,16 @@ void ShareNodeKeys::get(Command* c, bool skiphandles)
 {
     if (keys.size())
     {
+        size_t estimate = c->size() + keys.size() + shares.size() * 12 + 32;
+        if (!skiphandles)
+        {
+            for (const string& item : items)
+            {
+                estimate += item.size() * 4 / 3 + 6;
+            }
+        }
+        c->reserve(estimate);
+
         c->beginarray("cr");
 
         // emit share node handles
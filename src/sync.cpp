@@ -36,6 +36,7 @@ namespace mega {
 
 const int Sync::SCANNING_DELAY_DS = 5;
 const int Sync::EXTRA_SCANNING_DELAY_DS = 150;
+const int Sync::SCANNING_BUDGET_MS = 100;
 const int Sync::FILE_UPDATE_DELAY_DS = 30;
 const int Sync::FILE_UPDATE_MAX_DELAY_SECS = 60;
 const dstime Sync::RECENT_VERSION_INTERVAL_SECS = 10800;
@@ -234,12 +235,12 @@ void collectAllLocalNodes(FingerprintCache& fingerprints, FingerprintLocalNodeMa
                           LocalNode& l, handlelocalnode_map& fsidnodes)
 {
     // invalidate fsid of `l`
-    l.fsid = mega::UNDEF;
-    if (l.fsid_it != fsidnodes.end())
+    if (l.fsid_indexed)
     {
-        fsidnodes.erase(l.fsid_it);
-        l.fsid_it = fsidnodes.end();
+        fsidnodes.erase(l.fsid);
+        l.fsid_indexed = false;
     }
+    l.fsid = mega::UNDEF;
     // collect fingerprint
     LightFileFingerprint ffp;
     if (computeFingerprint(ffp, l))
@@ -913,7 +914,7 @@ Sync::Sync(UnifiedSync& us, const char* cdebris,
             dbname.resize(sizeof tableid * 4 / 3 + 3);
             dbname.resize(Base64::btoa((byte*)tableid, sizeof tableid, (char*)dbname.c_str()));
 
-            statecachetable = client->dbaccess->open(client->rng, *client->fsaccess, dbname);
+            statecachetable = client->openStateCacheTable(dbname);
 
             readstatecache();
         }
@@ -925,6 +926,11 @@ Sync::~Sync()
     // must be set to prevent remote mass deletion while rootlocal destructor runs
     mDestructorRunning = true;
 
+    if (mWalk)
+    {
+        mWalk->cancel();
+    }
+
     // unlock tmp lock
     tmpfa.reset();
 
@@ -993,15 +999,18 @@ bool Sync::active() const
 
 void Sync::addstatecachechildren(uint32_t parent_dbid, idlocalnode_map* tmap, LocalPath& localpath, LocalNode *p, int maxdepth)
 {
-    auto range = tmap->equal_range(parent_dbid);
+    auto children = tmap->find(parent_dbid);
+    if (children == tmap->end())
+    {
+        return;
+    }
 
-    for (auto it = range.first; it != range.second; it++)
+    for (LocalNode* l : children->second)
     {
         ScopedLengthRestore restoreLen(localpath);
 
-        localpath.appendWithSeparator(it->second->localname, true);
+        localpath.appendWithSeparator(l->localname, true);
 
-        LocalNode* l = it->second;
         Node* node = l->node.release_unchecked();
         handle fsid = l->fsid;
         m_off_t size = l->size;
@@ -1014,7 +1023,11 @@ void Sync::addstatecachechildren(uint32_t parent_dbid, idlocalnode_map* tmap, Lo
         if (l->slocalname_in_db)
         {
             // null if there is no shortname, or the shortname matches the localname.
-            shortname.reset(l->slocalname.release());
+            if (l->slocalname)
+            {
+                shortname.reset(new LocalPath(*l->slocalname));
+                l->slocalname.reset();
+            }
         }
         else
         {
@@ -1072,7 +1085,7 @@ bool Sync::readstatecache()
             if ((l = LocalNode::unserialize(this, &cachedata)))
             {
                 l->dbid = cid;
-                tmap.insert(pair<int32_t,LocalNode*>(l->parent_dbid,l));
+                tmap[l->parent_dbid].push_back(l);
             }
         }
 
@@ -1162,6 +1175,8 @@ void Sync::cachenodes()
         deleteq.clear();
 
         // additions - we iterate until completion or until we get stuck
+        // (the dbids are assigned first, children store the one of their parent)
+        vector<Cacheable*> records;
         bool added;
 
         do {
@@ -1171,7 +1186,8 @@ void Sync::cachenodes()
             {
                 if ((*it)->parent->dbid || (*it)->parent == localroot.get())
                 {
-                    statecachetable->put(MegaClient::CACHEDLOCALNODE, *it, &client->key);
+                    statecachetable->assignid(MegaClient::CACHEDLOCALNODE, *it);
+                    records.push_back(*it);
                     insertq.erase(it++);
                     added = true;
                 }
@@ -1179,6 +1195,11 @@ void Sync::cachenodes()
             }
         } while (added);
 
+        // serialized and encrypted in parallel, written in multi-row batches
+        DbRecordBatch batch;
+        statecachetable->serialize(records, &client->key, client->mAsyncQueue, batch);
+        statecachetable->put(batch);
+
         statecachetable->commit();
 
         if (insertq.size())
@@ -1306,7 +1327,7 @@ bool Sync::assignfsids()
 
 // scan localpath, add or update child nodes, call recursively for folder nodes
 // localpath must be prefixed with Sync
-bool Sync::scan(LocalPath* localpath, FileAccess* fa)
+bool Sync::scan(LocalPath* localpath, FileAccess* fa, LocalNode* folder)
 {
     if (fa)
     {
@@ -1318,6 +1339,8 @@ bool Sync::scan(LocalPath* localpath, FileAccess* fa)
         LocalPath localname;
         string name;
         bool success;
+        bool queued = false;
+        size_t matched = 0;
 
         if (SimpleLogger::logCurrentLevel >= logDebug)
         {
@@ -1353,6 +1376,11 @@ bool Sync::scan(LocalPath* localpath, FileAccess* fa)
                         {
                             // new record: place in notification queue
                             dirnotify->notify(DirNotify::DIREVENTS, NULL, LocalPath(*localpath));
+                            queued = true;
+                        }
+                        else
+                        {
+                            matched++;
                         }
                     }
                 }
@@ -1365,11 +1393,244 @@ bool Sync::scan(LocalPath* localpath, FileAccess* fa)
 
         delete da;
 
+        if (folder && fa && initializing)
+        {
+            // only trusted while every entry is a cached child and vice versa, and if the folder
+            // didn't change in the last seconds (it could change again within the same mtime)
+            m_time_t scanmtime = 0;
+            if (success && !queued && matched == folder->children.size() && fa->mtime < m_time() - 2)
+            {
+                scanmtime = std::max<m_time_t>(fa->mtime, 0);
+            }
+
+            if (folder->scanmtime != scanmtime)
+            {
+                folder->scanmtime = scanmtime;
+                statecacheadd(folder);
+            }
+        }
+
         return success;
     }
     else return false;
 }
 
+bool Sync::resumescan(LocalNode* folder, LocalPath& localpath, FileAccess* fa)
+{
+    // entries that are added, removed or renamed change the mtime of the folder
+    // (but not on FAT, whose folder mtimes aren't reliable either)
+    if (!initializing || !client->mSyncResumeScan || !fsstableids
+     || !folder->scanmtime || folder->scanmtime != fa->mtime)
+    {
+        return false;
+    }
+
+    LOG_verbose << "Folder unchanged since the last scan: " << localpath.toPath(*client->fsaccess);
+
+    // the children still need checking, file contents change without touching the folder
+    // (while initializing, checkpath() doesn't delete or replace LocalNodes)
+    vector<LocalNode*> children;
+    children.reserve(folder->children.size());
+    for (auto& child : folder->children)
+    {
+        children.push_back(child.second);
+    }
+
+    for (LocalNode* child : children)
+    {
+        ScopedLengthRestore restoreLen(localpath);
+        localpath.appendWithSeparator(child->localname, false);
+
+        if (client->app->sync_syncable(this, child->name.c_str(), localpath))
+        {
+            LocalNode* l = checkpath(NULL, &localpath, nullptr, nullptr, false, nullptr);
+
+            if (!l || l == (LocalNode*)~0)
+            {
+                dirnotify->notify(DirNotify::DIREVENTS, NULL, LocalPath(localpath));
+            }
+        }
+        else
+        {
+            LOG_debug << "Excluded: " << child->name;
+        }
+    }
+
+    return true;
+}
+
+bool Sync::procwalk()
+{
+    // leave the SDK thread to other work now and then, the scan threads keep listing meanwhile
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::milliseconds(100);
+
+    ScanService::Batch batch;
+    while (mWalk->next(batch))
+    {
+        LocalNode* parent = localnodebypath(NULL, batch.path);
+
+        if (!parent || parent->type != FOLDERNODE)
+        {
+            // gone (or replaced) since it was queued, the notifications take care of it
+            LOG_debug << "Listed folder no longer known: " << batch.path.toPath(*client->fsaccess);
+        }
+        else if (batch.failed)
+        {
+            if (parent == localroot.get())
+            {
+                LOG_err << "Initial scan failed";
+                mWalk->cancel();
+                mWalk.reset();
+                mFingerprints.clear();
+                client->failSync(this, INITIAL_SCAN_FAILED);
+                return true;
+            }
+
+            // try again on the SDK thread
+            parent->needsRescan = true;
+            dirnotify->notify(DirNotify::DIREVENTS, parent, LocalPath(), true);
+        }
+        else
+        {
+            LocalPath path = batch.path;
+
+            for (auto& entry : batch.entries)
+            {
+                ScopedLengthRestore restoreLen(path);
+                path.appendWithSeparator(entry.localname, false);
+
+                string name = entry.localname.toName(*client->fsaccess, mFilesystemType);
+                if (!client->app->sync_syncable(this, name.c_str(), path))
+                {
+                    LOG_debug << "Excluded: " << name;
+                    continue;
+                }
+
+                if (localdebris.isContainingPathOf(path))
+                {
+                    continue;
+                }
+
+                // anything unusual (moves, locked files, symlinks, changes since it was listed) goes through checkpath()
+                if (entry.failed || entry.isSymlink || entry.type == TYPE_UNKNOWN
+                 || parent->childbyname(&entry.localname)
+                 || (entry.fsidvalid && client->fsidnode.find(entry.fsid) != client->fsidnode.end()))
+                {
+                    dirnotify->notify(DirNotify::DIREVENTS, NULL, LocalPath(path));
+                    continue;
+                }
+
+                if (entry.type == FILENODE)
+                {
+                    // its LocalNode is made once it's read
+                    if (FingerprintService* fingerprints = client->fingerprintService())
+                    {
+                        mFingerprints.push_back(fingerprints->queue(path));
+                    }
+                    else
+                    {
+                        dirnotify->notify(DirNotify::DIREVENTS, NULL, LocalPath(path));
+                    }
+                    continue;
+                }
+
+                LocalNode* l = new LocalNode;
+                l->init(this, entry.type, parent, path, std::move(entry.shortname));
+
+                if (entry.fsidvalid)
+                {
+                    l->setfsid(entry.fsid, client->fsidnode);
+                }
+
+                mWalk->scan(path);
+                statecacheadd(l);
+            }
+
+            client->syncactivity = true;
+        }
+
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            mScanTime += std::chrono::steady_clock::now() - start;
+            return false;
+        }
+    }
+
+    for (auto it = mFingerprints.begin(); it != mFingerprints.end(); )
+    {
+        if (!(*it)->done())
+        {
+            ++it;
+            continue;
+        }
+
+        auto job = std::move(*it);
+        it = mFingerprints.erase(it);
+
+        LocalNode* parent = nullptr;
+        LocalPath remainder;
+        size_t index = 0;
+
+        // already known (eg. through a notification), or its folder is gone
+        if (localnodebypath(NULL, job->path, &parent, &remainder)
+         || !parent || remainder.empty() || remainder.findNextSeparator(index))
+        {
+            continue;
+        }
+
+        if (job->failed || job->type != FILENODE || job->isSymlink
+         || (job->fsidvalid && client->fsidnode.find(job->fsid) != client->fsidnode.end()))
+        {
+            dirnotify->notify(DirNotify::DIREVENTS, NULL, LocalPath(job->path));
+            continue;
+        }
+
+        LocalNode* l = new LocalNode;
+        l->init(this, FILENODE, parent, job->path, client->fsaccess->fsShortname(job->path));
+
+        if (job->fsidvalid)
+        {
+            l->setfsid(job->fsid, client->fsidnode);
+        }
+
+        static_cast<FileFingerprint&>(*l) = job->fingerprint;
+
+        if (l->size > 0)
+        {
+            localbytes += l->size;
+        }
+
+        l->bumpnagleds();
+
+        if (isnetwork)
+        {
+            LOG_debug << "Queueing extra fs notification for new file";
+            dirnotify->notify(DirNotify::EXTRA, NULL, LocalPath(job->path));
+        }
+
+        statecacheadd(l);
+        client->syncactivity = true;
+        mScannedFiles++;
+
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            mScanTime += std::chrono::steady_clock::now() - start;
+            return false;
+        }
+    }
+
+    if (mWalk->done() && mFingerprints.empty())
+    {
+        LOG_debug << "Initial scan listed. New / modified files: " << dirnotify->notifyq[DirNotify::DIREVENTS].size();
+        mWalk.reset();
+        client->syncactivity = true;
+    }
+
+    mScanTime += std::chrono::steady_clock::now() - start;
+    return true;
+}
+
 // check local path - if !localname, localpath is relative to l, with l == NULL
 // being the root of the sync
 // if localname is set, localpath is absolute and localname its last component
@@ -1428,6 +1689,16 @@ LocalNode* Sync::checkpath(LocalNode* l, LocalPath* input_localpath, string* con
         LocalNode *tmp = localnodebypath(l, *input_localpath, &parent, &newname);
         size_t index = 0;
 
+        // the folders of the change are due a visit from syncdown() and syncup()
+        if (tmp)
+        {
+            (tmp->type == FOLDERNODE || !tmp->parent ? tmp : tmp->parent)->setsyncdirty();
+        }
+        else if (parent)
+        {
+            parent->setsyncdirty();
+        }
+
         if (newname.findNextSeparator(index))
         {
             LOG_warn << "Parent not detected yet. Remainder: " << newname.toPath(*client->fsaccess);
@@ -1499,7 +1770,10 @@ LocalNode* Sync::checkpath(LocalNode* l, LocalPath* input_localpath, string* con
 
                     if (l->type == FOLDERNODE)
                     {
-                        scan(localpathNew, fa.get());
+                        if (!resumescan(l, *localpathNew, fa.get()))
+                        {
+                            scan(localpathNew, fa.get(), l);
+                        }
                     }
                     else
                     {
@@ -2094,9 +2368,14 @@ bool Sync::checkValidNotification(int q, Notification& notification)
 // until a retry should be made (500 ms minimum latency).
 dstime Sync::procscanq(int q)
 {
+    CodeCounter::ScopeTimer ccst(client->performanceStats.syncProcscanq);
     dstime dsmin = Waiter::ds - SCANNING_DELAY_DS;
     LocalNode* l;
 
+    // a long queue of folders yields to the other syncs too
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::milliseconds(SCANNING_BUDGET_MS);
+
     Notification notification;
     while (dirnotify->notifyq[q].popFront(notification))
     {
@@ -2111,6 +2390,7 @@ dstime Sync::procscanq(int q)
         {
             LOG_verbose << "Scanning postponed. Modification too recent";
             dirnotify->notifyq[q].unpopFront(notification);
+            mScanTime += std::chrono::steady_clock::now() - start;
             return notification.timestamp - dsmin;
         }
 
@@ -2119,12 +2399,16 @@ dstime Sync::procscanq(int q)
             dstime backoffds = 0;
             LOG_verbose << "Checkpath: " << notification.path.toPath(*client->fsaccess);
 
-            l = checkpath(l, &notification.path, NULL, &backoffds, false, nullptr);
+            {
+                CodeCounter::ScopeTimer checkpathTimer(client->performanceStats.syncCheckpath);
+                l = checkpath(l, &notification.path, NULL, &backoffds, false, nullptr);
+            }
             if (backoffds)
             {
                 LOG_verbose << "Scanning deferred during " << backoffds << " ds";
                 notification.timestamp = Waiter::ds + backoffds - SCANNING_DELAY_DS;
                 dirnotify->notifyq[q].unpopFront(notification);
+                mScanTime += std::chrono::steady_clock::now() - start;
                 return backoffds;
             }
             updatedfilesize = ~0;
@@ -2136,6 +2420,7 @@ dstime Sync::procscanq(int q)
             {
                 LOG_verbose << "Scanning deferred";
                 dirnotify->notifyq[q].unpopFront(notification);
+                mScanTime += std::chrono::steady_clock::now() - start;
                 return 0;
             }
         }
@@ -2149,17 +2434,33 @@ dstime Sync::procscanq(int q)
         // (in order to avoid lengthy blocking episodes due to multiple
         // consecutive fingerprint calculations)
         // or if new nodes are being added due to a copy/delete operation
-        if ((l && l != (LocalNode*)~0 && l->type == FILENODE) || client->syncadding)
+        if (l && l != (LocalNode*)~0 && l->type == FILENODE)
+        {
+            mScannedFiles++;
+        }
+
+        if ((l && l != (LocalNode*)~0 && l->type == FILENODE) || client->syncadding
+            || std::chrono::steady_clock::now() > deadline)
         {
             break;
         }
     }
 
+    mScanTime += std::chrono::steady_clock::now() - start;
+
     if (dirnotify->notifyq[q].empty())
     {
         if (q == DirNotify::DIREVENTS)
         {
             client->syncactivity = true;
+
+            uint64_t raw, coalesced;
+            dirnotify->notifyq[q].counts(raw, coalesced);
+            if (raw != mLoggedNotifications)
+            {
+                LOG_debug << "Filesystem notifications received: " << raw << " coalesced: " << coalesced;
+                mLoggedNotifications = raw;
+            }
         }
     }
     else if (dirnotify->notifyq[!q].empty())
@@ -2285,6 +2586,70 @@ m_off_t Sync::getInflightProgress()
     return progressSum;
 }
 
+SyncStats Sync::stats()
+{
+    SyncStats stats;
+
+    for (int q = 0; q < DirNotify::NUMQUEUES; q++)
+    {
+        stats.queued[q] = dirnotify->notifyq[q].size();
+    }
+
+    stats.lastFullReconcile = mLastFullReconcile;
+    stats.scannedFiles = mScannedFiles;
+
+    double seconds = std::chrono::duration<double>(mScanTime).count();
+    if (seconds > 0)
+    {
+        stats.scannedFilesPerSecond = double(mScannedFiles) / seconds;
+    }
+
+    for (auto& t : client->transfers[PUT])
+    {
+        for (auto file : t.second->files)
+        {
+            auto ln = dynamic_cast<LocalNode*>(file);
+            if (ln && ln->sync == this)
+            {
+                stats.pendingUploadBytes += t.second->size - t.second->progresscompleted;
+                break;
+            }
+        }
+    }
+
+    for (auto ln : client->synccreate)
+    {
+        if (ln->sync == this)
+        {
+            stats.pendingPutnodes++;
+        }
+    }
+
+    if ((stats.latencySamples = mLatencies.size()))
+    {
+        vector<dstime> sorted = mLatencies;
+        std::sort(sorted.begin(), sorted.end());
+        stats.latencyP50 = m_time_t(sorted[sorted.size() / 2]) * 100;
+        stats.latencyP99 = m_time_t(sorted[sorted.size() * 99 / 100]) * 100;
+    }
+
+    return stats;
+}
+
+void Sync::addLatency(dstime latency)
+{
+    // the latest changes only
+    static const size_t MAX_LATENCIES = 1024;
+
+    if (mLatencies.size() < MAX_LATENCIES)
+    {
+        mLatencies.push_back(latency);
+    }
+    else
+    {
+        mLatencies[mNextLatency++ % MAX_LATENCIES] = latency;
+    }
+}
 
 UnifiedSync::UnifiedSync(MegaClient& mc, const SyncConfig& c)
     : mClient(mc), mConfig(c)
@@ -2732,6 +3097,11 @@ bool Syncs::syncConfigStoreDirty()
     return mSyncConfigStore && mSyncConfigStore->dirty();
 }
 
+dstime Syncs::syncConfigStoreFlushDue()
+{
+    return mSyncConfigStore ? mSyncConfigStore->flushDue() : NEVER;
+}
+
 bool Syncs::syncConfigStoreFlush()
 {
     // No need to flush if the store's not dirty.
@@ -3455,6 +3825,24 @@ bool Syncs::forEachRunningSync_shortcircuit(std::function<bool(Sync* s)> f)
     return true;
 }
 
+bool Syncs::forEachRunningSync_roundrobin(std::function<bool(Sync* s)> f)
+{
+    size_t first = mSyncVec.empty() ? 0 : mNextRoundRobin++ % mSyncVec.size();
+
+    for (size_t i = 0; i < mSyncVec.size(); ++i)
+    {
+        auto& s = mSyncVec[(first + i) % mSyncVec.size()];
+        if (s->mSync)
+        {
+            if (!f(s->mSync.get()))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 void Syncs::forEachSyncConfig(std::function<void(const SyncConfig&)> f)
 {
     for (auto& s : mSyncVec)
@@ -3738,6 +4126,8 @@ void Syncs::resumeResumableSyncsOnStartup()
 {
     if (mClient.loggedin() != FULLACCOUNT) return;
 
+    CodeCounter::StartupProfile::Scope startup(mClient.startupProfile, CodeCounter::StartupProfile::PHASE_SYNC_RESUME);
+
     SyncConfigVector configs;
 
     if (syncConfigStoreLoad(configs) != API_OK)
@@ -3830,9 +4220,19 @@ void SyncConfigStore::markDriveDirty(const LocalPath& drivePath)
     // Drive should be known.
     assert(mKnownDrives.count(drivePath));
 
+    if (!dirty())
+    {
+        mDirtySince = Waiter::ds;
+    }
+
     mKnownDrives[drivePath].dirty = true;
 }
 
+dstime SyncConfigStore::flushDue() const
+{
+    return dirty() ? mDirtySince + FLUSH_DELAY : NEVER;
+}
+
 bool SyncConfigStore::equal(const LocalPath& lhs, const LocalPath& rhs) const
 {
     return platformCompareUtf(lhs, false, rhs, false) == 0;
@@ -3934,6 +4334,8 @@ error SyncConfigStore::write(const LocalPath& drivePath, const SyncConfigVector&
 
     if (configs.empty())
     {
+        drive.written.clear();
+
         error e = mIOContext.remove(drive.dbPath);
         if (e)
         {
@@ -3947,6 +4349,14 @@ error SyncConfigStore::write(const LocalPath& drivePath, const SyncConfigVector&
         JSONWriter writer;
         mIOContext.serialize(configs, writer);
 
+        if (writer.getstring() == drive.written)
+        {
+            LOG_debug << "Sync configs unchanged at: " << drivePath.toPath();
+            return API_OK;
+        }
+
+        drive.written.clear();
+
         error e = mIOContext.write(drive.dbPath,
             writer.getstring(),
             drive.slot);
@@ -3959,6 +4369,8 @@ error SyncConfigStore::write(const LocalPath& drivePath, const SyncConfigVector&
             return API_EWRITE;
         }
 
+        drive.written = writer.getstring();
+
         // start using a different slot (a different file)
         drive.slot = (drive.slot + 1) % NUM_CONFIG_SLOTS;
 
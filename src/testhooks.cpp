@@ -33,4 +33,70 @@ namespace mega
     {
     }
 #endif
+
+    ScriptedHttpIO::ScriptedHttpIO(Responder responder)
+        : mResponder(std::move(responder))
+    {
+    }
+
+    void ScriptedHttpIO::post(HttpReq* req, const char* data, unsigned len)
+    {
+        req->in.clear();
+        req->status = REQ_INFLIGHT;
+        req->httpiohandle = this;
+        mPending.push_back(Request{req, data ? string(data, len) : (req->out ? *req->out : string())});
+    }
+
+    void ScriptedHttpIO::cancel(HttpReq* req)
+    {
+        for (auto it = mPending.begin(); it != mPending.end(); ++it)
+        {
+            if (it->req == req)
+            {
+                mPending.erase(it);
+                req->httpstatus = 0;
+                req->status = REQ_FAILURE;
+                break;
+            }
+        }
+        req->httpiohandle = NULL;
+    }
+
+    m_off_t ScriptedHttpIO::postpos(void*)
+    {
+        return 0;
+    }
+
+    bool ScriptedHttpIO::doio()
+    {
+        // the requests posted while answering these wait for the next call, as they would for the network
+        bool done = false;
+        for (size_t i = mPending.size(); i--; )
+        {
+            Request request = std::move(mPending.front());
+            mPending.pop_front();
+
+            string response;
+            int httpstatus = mResponder(*request.req, request.body, response);
+            if (!httpstatus)
+            {
+                mPending.push_back(std::move(request));
+                continue;
+            }
+
+            HttpReq* req = request.req;
+            req->httpiohandle = NULL;
+            req->httpstatus = httpstatus;
+            req->contentlength = m_off_t(response.size());
+            req->put(const_cast<char*>(response.data()), unsigned(response.size()));
+            req->lastdata = Waiter::ds;
+            req->status = httpstatus == 200 ? REQ_SUCCESS : REQ_FAILURE;
+
+            lastdata = Waiter::ds;
+            success = true;
+            mAnswered++;
+            done = true;
+        }
+        return done;
+    }
 }
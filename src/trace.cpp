@@ -0,0 +1,284 @@
+/**
+ * @file trace.cpp
+ * @brief Compact binary trace of timed events
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include "mega/trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <sstream>
+
+namespace mega {
+
+const char Trace::TRACE_MAGIC[8] = { 'M', 'E', 'G', 'A', 'T', 'R', 'C', '1' };
+
+std::atomic<uint32_t> Trace::mSubsystems{0};
+std::atomic<unsigned> Trace::mSampling[TRACE_NUM_SUBSYSTEMS];  // 0 or 1: every event
+std::atomic<unsigned> Trace::mSampleCounters[TRACE_NUM_SUBSYSTEMS];
+
+namespace {
+
+// records are written once this many are buffered
+const size_t TRACE_BATCH = 1024;
+
+std::mutex traceMutex;
+FILE* traceFile = nullptr;
+std::vector<TraceRecord> traceBuffer;
+std::chrono::steady_clock::time_point traceStart;
+
+std::atomic<uint16_t> traceThreads{0};
+thread_local uint16_t traceThread = 0;
+
+thread_local TraceId traceScope = 0;
+
+int64_t microsecondsSinceEpoch()
+{
+    return int64_t(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+string hex(uint64_t v, int digits)
+{
+    std::ostringstream s;
+    s << std::hex << std::setfill('0') << std::setw(digits) << v;
+    return s.str();
+}
+
+void writeBuffer()
+{
+    if (traceFile && !traceBuffer.empty())
+    {
+        fwrite(traceBuffer.data(), sizeof(TraceRecord), traceBuffer.size(), traceFile);
+    }
+    traceBuffer.clear();
+}
+
+}
+
+bool Trace::start(const string& path, uint32_t subsystems)
+{
+    stop();
+
+    std::lock_guard<std::mutex> g(traceMutex);
+    if (!(traceFile = fopen(path.c_str(), "wb")))
+    {
+        return false;
+    }
+
+    traceStart = std::chrono::steady_clock::now();
+    uint64_t epoch = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    fwrite(TRACE_MAGIC, sizeof TRACE_MAGIC, 1, traceFile);
+    fwrite(&epoch, sizeof epoch, 1, traceFile);
+
+    traceBuffer.reserve(TRACE_BATCH);
+    mSubsystems = subsystems;
+    return true;
+}
+
+void Trace::stop()
+{
+    mSubsystems = 0;
+
+    std::lock_guard<std::mutex> g(traceMutex);
+    writeBuffer();
+    if (traceFile)
+    {
+        fclose(traceFile);
+        traceFile = nullptr;
+    }
+}
+
+void Trace::setSubsystems(uint32_t subsystems)
+{
+    std::lock_guard<std::mutex> g(traceMutex);
+    if (traceFile)
+    {
+        mSubsystems = subsystems;
+    }
+}
+
+void Trace::setSampling(TraceSubsystem subsystem, unsigned oneIn)
+{
+    mSampling[subsystem] = std::max(1u, oneIn);
+}
+
+void Trace::record(TraceEventId event, handle h, uint64_t size, std::chrono::steady_clock::time_point started)
+{
+    unsigned subsystem = event >> 8;
+    assert(subsystem < TRACE_NUM_SUBSYSTEMS);
+
+    unsigned sampling = mSampling[subsystem].load(std::memory_order_relaxed);
+    if (sampling > 1 && mSampleCounters[subsystem].fetch_add(1, std::memory_order_relaxed) % sampling)
+    {
+        return;
+    }
+
+    if (!traceThread)
+    {
+        traceThread = ++traceThreads;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(now - started).count();
+
+    TraceRecord r;
+    r.handle = h;
+    r.size = size;
+    r.duration = uint32_t(std::min<int64_t>(std::max<int64_t>(duration, 0), UINT32_MAX));
+    r.event = event;
+    r.thread = traceThread;
+
+    std::lock_guard<std::mutex> g(traceMutex);
+    if (!traceFile)
+    {
+        return;
+    }
+
+    r.timestamp = uint64_t(std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - traceStart).count(), 0));
+    traceBuffer.push_back(r);
+    if (traceBuffer.size() >= TRACE_BATCH)
+    {
+        writeBuffer();
+    }
+}
+
+TraceId newTraceId()
+{
+    // splitmix64 over a counter that starts at a random point: unique in the process, unrelated across processes
+    static std::atomic<uint64_t> next{ (uint64_t(std::random_device()()) << 32) ^ uint64_t(microsecondsSinceEpoch()) };
+
+    for (;;)
+    {
+        uint64_t z = next.fetch_add(0x9e3779b97f4a7c15ull, std::memory_order_relaxed);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+        if (z)
+        {
+            return z;
+        }
+    }
+}
+
+TraceScope::TraceScope(TraceId id)
+    : mPrevious(traceScope)
+{
+    traceScope = id;
+}
+
+TraceScope::~TraceScope()
+{
+    traceScope = mPrevious;
+}
+
+TraceId TraceScope::current()
+{
+    return traceScope;
+}
+
+void TraceStages::mark(TraceStage stage)
+{
+    if (!times[stage])
+    {
+        times[stage] = microsecondsSinceEpoch();
+    }
+}
+
+void TraceStages::update(TraceStage stage)
+{
+    times[stage] = microsecondsSinceEpoch();
+}
+
+void TraceStages::merge(const TraceStages& other)
+{
+    for (size_t i = 0; i < times.size(); i++)
+    {
+        if (!times[i])
+        {
+            times[i] = other.times[i];
+        }
+    }
+}
+
+const char* TraceStages::name(TraceStage stage)
+{
+    switch (stage)
+    {
+        case STAGE_QUEUED:          return "queued";
+        case STAGE_SLOT_ACQUIRED:   return "slot_acquired";
+        case STAGE_FIRST_BYTE:      return "first_byte";
+        case STAGE_LAST_BYTE:       return "last_byte";
+        case STAGE_MAC_VERIFIED:    return "mac_verified";
+        case STAGE_PUTNODES_SENT:   return "putnodes_sent";
+        case STAGE_PUTNODES_ACKED:  return "putnodes_acked";
+        case STAGE_CALLBACK:        return "callback";
+        case STAGE_COUNT:           break;
+    }
+    return "unknown";
+}
+
+string TraceStages::toOtlpJson(TraceId id, const string& rootName) const
+{
+    // reached stages in order of their times, so one reached out of the usual order doesn't make a negative span
+    vector<int> reached;
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        if (times[size_t(i)])
+        {
+            reached.push_back(i);
+        }
+    }
+    std::stable_sort(reached.begin(), reached.end(), [this](int a, int b) { return times[size_t(a)] < times[size_t(b)]; });
+
+    // 128-bit trace id and 64-bit span ids in hex, as OTLP/JSON expects: the root span reuses the id
+    string traceId = hex(0, 16) + hex(id, 16);
+    string rootId = hex(id, 16);
+
+    auto span = [&](std::ostringstream& json, const string& spanId, const string& parentId, const string& spanName, int64_t start, int64_t end)
+    {
+        json << "{\"traceId\":\"" << traceId << "\",\"spanId\":\"" << spanId << "\"";
+        if (!parentId.empty())
+        {
+            json << ",\"parentSpanId\":\"" << parentId << "\"";
+        }
+        json << ",\"name\":\"" << spanName << "\",\"kind\":1"
+             << ",\"startTimeUnixNano\":\"" << start * 1000 << "\",\"endTimeUnixNano\":\"" << end * 1000 << "\"}";
+    };
+
+    std::ostringstream json;
+    json << "{\"resourceSpans\":[{\"resource\":{\"attributes\":[{\"key\":\"service.name\",\"value\":{\"stringValue\":\"mega-sdk\"}}]},"
+         << "\"scopeSpans\":[{\"scope\":{\"name\":\"mega.transfers\"},\"spans\":[";
+    if (!reached.empty())
+    {
+        span(json, rootId, "", rootName, times[size_t(reached.front())], times[size_t(reached.back())]);
+        for (size_t i = 0; i + 1 < reached.size(); i++)
+        {
+            json << ",";
+            span(json, hex(id ^ (i + 1) * 0x9e3779b97f4a7c15ull, 16), rootId, name(TraceStage(reached[i])),
+                 times[size_t(reached[i])], times[size_t(reached[i + 1])]);
+        }
+    }
+    json << "]}]}]}";
+    return json.str();
+}
+
+} // namespace
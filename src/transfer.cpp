@@ -81,6 +81,9 @@ Transfer::Transfer(MegaClient* cclient, direction_t ctype)
 
     skipserialization = false;
 
+    traceId = newTraceId();
+    stages.mark(STAGE_QUEUED);
+
     faputcompletion_it = client->faputcompletion.end();
     transfers_it = client->transfers[type].end();
 }
@@ -88,11 +91,25 @@ Transfer::Transfer(MegaClient* cclient, direction_t ctype)
 // delete transfer with underlying slot, notify files
 Transfer::~Transfer()
 {
+#ifdef USE_MEDIAINFO
+    if (type == PUT && !uploadhandle.isUndef())
+    {
+        client->mediaFileInfo.uploadExtractions.erase(uploadhandle);
+    }
+#endif
+
     if (faputcompletion_it != client->faputcompletion.end())
     {
         client->faputcompletion.erase(faputcompletion_it);
     }
 
+    client->mTransferProgress.erase(this);
+
+    if (tempurlsprefetch)
+    {
+        client->tempUrlPrefetches.erase(tempurlsprefetch);
+    }
+
     for (file_list::iterator it = files.begin(); it != files.end(); it++)
     {
         if (finished)
@@ -259,26 +276,14 @@ Transfer *Transfer::unserialize(MegaClient *client, string *d, transfer_map* tra
         return NULL;
     }
 
-    d->erase(0, ptr - d->data());
-
-    FileFingerprint *fp = FileFingerprint::unserialize(d);
-    if (!fp)
+    // the record is read in place, without copying what follows the chunkmacs
+    if (!t->FileFingerprint::unserialize(ptr, end) || !t->badfp.unserialize(ptr, end))
     {
         LOG_err << "Error unserializing Transfer: Unable to unserialize FileFingerprint";
         delete t;
         return NULL;
     }
 
-    *(FileFingerprint *)t = *(FileFingerprint *)fp;
-    delete fp;
-
-    fp = FileFingerprint::unserialize(d);
-    t->badfp = *fp;
-    delete fp;
-
-    ptr = d->data();
-    end = ptr + d->size();
-
     if (ptr + sizeof(m_time_t) + sizeof(char) > end)
     {
         LOG_err << "Transfer unserialization failed - fingerprint too long";
@@ -319,14 +324,16 @@ Transfer *Transfer::unserialize(MegaClient *client, string *d, transfer_map* tra
         return NULL;
     }
 
-    std::string combinedUrls;
-    combinedUrls.assign(ptr, ll);
-    for (size_t p = 0; p < ll; )
+    for (const char* url = ptr; url < ptr + ll; )
     {
-        size_t n = combinedUrls.find('\0');
-        t->tempurls.push_back(combinedUrls.substr(p, n));
+        const char* urlEnd = static_cast<const char*>(memchr(url, '\0', size_t(ptr + ll - url)));
+        if (!urlEnd)
+        {
+            urlEnd = ptr + ll;
+        }
+        t->tempurls.emplace_back(url, urlEnd);
         assert(!t->tempurls.back().empty());
-        p += (n == std::string::npos) ? ll : (n + 1);
+        url = urlEnd + 1;
     }
     if (!t->tempurls.empty() && t->tempurls.size() != 1 && t->tempurls.size() != RAIDPARTS)
     {
@@ -526,7 +533,7 @@ void Transfer::failed(const Error& e, DBTableTransactionCommitter& committer, ds
                 && e != API_EOVERQUOTA
                 && e != API_EPAYWALL)
             {
-                client->syncdownrequired = true;
+                client->requestsyncdown();
             }
 
             if (e == API_EBUSINESSPASTDUE && !alreadyDisabled)
@@ -571,13 +578,28 @@ void Transfer::addAnyMissingMediaFileAttributes(Node* node, /*const*/ LocalPath&
             // if we don't have the codec id mappings yet, send the request
             client->mediaFileInfo.requestCodecMappingsOneTime(client, NULL);
 
+            // uploads normally had their properties extracted on the worker threads while the data was sent
+            std::shared_ptr<MediaFileInfo::Extraction> extraction;
+            if (type == PUT)
+            {
+                extraction = client->mediaFileInfo.takeUploadExtraction(uploadhandle);
+            }
+
             // always get the attribute string; it may indicate this version of the mediaInfo library was unable to interpret the file
             MediaProperties vp;
-            vp.extractMediaPropertyFileAttributes(localpath, client->fsaccess);
+            if (extraction && extraction->done)
+            {
+                vp = extraction->vp;
+                extraction.reset();
+            }
+            else if (!extraction)
+            {
+                vp.extractMediaPropertyFileAttributes(localpath, client->fsaccess);
+            }
 
             if (type == PUT)
             {
-                minfa += client->mediaFileInfo.queueMediaPropertiesFileAttributesForUpload(vp, attrKey, client, uploadhandle);
+                minfa += client->mediaFileInfo.queueMediaPropertiesFileAttributesForUpload(vp, attrKey, client, uploadhandle, std::move(extraction));
             }
             else
             {
@@ -903,6 +925,16 @@ void Transfer::complete(DBTableTransactionCommitter& committer)
 
                     if (success)
                     {
+                        // the next downloads of this content may copy this file
+                        if (isvalid)
+                        {
+                            if (client->mDownloadedContent.size() >= MegaClient::MAX_DOWNLOADED_CONTENT)
+                            {
+                                client->mDownloadedContent.clear();
+                            }
+                            client->mDownloadedContent[ChunkIndex::key(*this)] = (*it)->localname;
+                        }
+
                         // prevent deletion of associated Transfer object in completed()
                         client->filecachedel(*it, &committer);
                         client->app->file_complete(*it);
@@ -921,7 +953,7 @@ void Transfer::complete(DBTableTransactionCommitter& committer)
 #ifdef ENABLE_SYNC
                             if (f->syncxfer)
                             {
-                                client->syncdownrequired = true;
+                                client->requestsyncdown();
                             }
 #endif
                             client->app->file_removed(f, API_EWRITE);
@@ -1045,7 +1077,7 @@ void Transfer::complete(DBTableTransactionCommitter& committer)
 #ifdef ENABLE_SYNC
                 if (f->syncxfer)
                 {
-                    client->syncdownrequired = true;
+                    client->requestsyncdown();
                 }
 #endif
                 it++; // the next line will remove the current item and invalidate that iterator
@@ -1069,14 +1101,34 @@ void Transfer::complete(DBTableTransactionCommitter& committer)
             addAnyMissingMediaFileAttributes(NULL, localfilename);
         }
 
+        client->chunkindexadd(this, committer);
+
         // if this transfer is put on hold, do not complete
         client->checkfacompletion(uploadhandle, this);
         return;
     }
 }
 
+bwclass_t Transfer::bandwidthclass() const
+{
+#ifdef ENABLE_SYNC
+    for (File* f : files)
+    {
+        if (f->syncxfer)
+        {
+            LocalNode* l = dynamic_cast<LocalNode*>(f);
+            return l && l->sync && l->sync->isBackup() ? BWCLASS_BACKUP : BWCLASS_SYNC;
+        }
+    }
+#endif
+    return BWCLASS_FOREGROUND;
+}
+
 void Transfer::completefiles()
 {
+    // the putnodes of the uploads belong to this transfer's trace
+    TraceScope traceScope(traceId);
+
     // notify all files and give them an opportunity to self-destruct
     vector<uint32_t> &ids = client->pendingtcids[tag];
     vector<LocalPath> *pfs = NULL;
@@ -1179,6 +1231,16 @@ void DirectReadNode::dispatch()
 // abort all active reads, remove pending reads and reschedule with app-supplied backoff
 void DirectReadNode::retry(const Error& e, dstime timeleft)
 {
+    // reads ahead aren't worth retrying
+    for (dr_list::iterator it = reads.begin(); it != reads.end(); )
+    {
+        DirectRead* dr = *(it++);
+        if (dr->readahead)
+        {
+            delete dr;
+        }
+    }
+
     if (reads.empty())
     {
         LOG_warn << "Removing DirectReadNode. No reads to retry.";
@@ -1255,18 +1317,25 @@ void DirectReadNode::cmdresult(const Error &e, dstime timeleft)
 
     if (e == API_OK)
     {
+        if (!cache.configured())
+        {
+            LocalPath spillpath;
+            if (!client->streamingcachefolder.empty())
+            {
+                spillpath = client->streamingcachefolder;
+                spillpath.appendWithSeparator(LocalPath::tmpNameLocal(*client->fsaccess), true);
+            }
+            cache.configure(size, client->streamingcachesize, client->fsaccess, spillpath, client->streamingcachespillsize);
+        }
+
         // feed all pending reads to the global read queue
         for (dr_list::iterator it = reads.begin(); it != reads.end(); it++)
         {
             DirectRead* dr = *it;
             assert(dr->drq_it == client->drq.end());
 
-            if (dr->drbuf.tempUrlVector().empty())
-            {
-                // DirectRead starting
-                dr->drbuf.setIsRaid(dr->drn->tempurls, dr->offset, dr->offset + dr->count, dr->drn->size, 2097152);  // 2 MB max buffer usage approx for streaming
-            }
-            else
+            // the reads starting are set up when they get their slot, after what is cached (see MegaClient::execdirectreads())
+            if (!dr->drbuf.tempUrlVector().empty())
             {
                 // URLs have been re-requested, eg. due to temp URL expiry.  Keep any parts downloaded already
                 dr->drbuf.updateUrlsAndResetPos(dr->drn->tempurls);
@@ -1306,6 +1375,142 @@ void DirectReadNode::enqueue(m_off_t offset, m_off_t count, int reqtag, void* ap
     new DirectRead(this, count, offset, reqtag, appdata);
 }
 
+bool DirectReadNode::servefromcache(DirectRead* dr)
+{
+    if (dr->readahead)
+    {
+        // just the part not cached yet
+        dr->progress += cache.cached(dr->offset + dr->progress, dr->count - dr->progress);
+    }
+    else
+    {
+        string data;
+        while (dr->progress < dr->count && cache.load(dr->offset + dr->progress, dr->count - dr->progress, data))
+        {
+            m_off_t pos = dr->offset + dr->progress;
+            consumption.calculateSpeed(m_off_t(data.size()));
+            if (!client->app->pread_data((byte*)&data[0], m_off_t(data.size()), pos, 0, 0, dr->appdata))
+            {
+                // app-requested abort
+                finishread(dr, pos);
+                return false;
+            }
+            dr->progress += m_off_t(data.size());
+        }
+
+        if (dr->progress < dr->count)
+        {
+            // keep the window ahead of the app filled, it may be about to wait for it
+            readahead(dr->offset + dr->progress);
+        }
+    }
+
+    if (dr->progress >= dr->count)
+    {
+        LOG_debug << "Streaming read served from the cache: " << dr->offset << " - " << dr->offset + dr->count;
+        finishread(dr, dr->offset + dr->count);
+        return false;
+    }
+    return true;
+}
+
+void DirectReadNode::finishread(DirectRead* dr, m_off_t stoppedat)
+{
+    bool sequential = false;
+    if (!dr->readahead)
+    {
+        // the app continues from where its last read stopped, or stopped this one to resume it later (eg. its buffer is full)
+        sequential = dr->offset == lastreadend || stoppedat < dr->offset + dr->count;
+        lastreadend = stoppedat;
+    }
+
+    delete dr;
+
+    if (sequential)
+    {
+        readahead(stoppedat);
+    }
+
+    if (reads.empty())
+    {
+        // keep the URLs and the cache for the next reads for a while
+        schedule(DirectReadSlot::TEMPURL_TIMEOUT_DS);
+    }
+}
+
+void DirectReadNode::readahead(m_off_t pos)
+{
+    m_off_t window = readaheadwindow();
+    if (!cache.configured() || window <= 0 || tempurls.empty())
+    {
+        return;
+    }
+
+    // the cache is filled block by block, so the reads ahead start and end at block boundaries
+    m_off_t blocksize = DirectReadCache::BLOCK_SIZE;
+    m_off_t end = std::min((pos + window + blocksize - 1) / blocksize * blocksize, size);
+    m_off_t chunk = (window / MAX_READAHEADS + blocksize - 1) / blocksize * blocksize;
+
+    // continue after the one already filling the window
+    unsigned inflight = 0;
+    for (dr_list::iterator it = reads.begin(); it != reads.end(); it++)
+    {
+        DirectRead* dr = *it;
+        if (dr->readahead)
+        {
+            inflight++;
+            if (dr->offset <= pos && pos < dr->offset + dr->count)
+            {
+                pos = dr->offset + dr->count;
+            }
+        }
+    }
+
+    while (inflight < MAX_READAHEADS && pos < end)
+    {
+        pos -= pos % blocksize;
+        pos += cache.cached(pos, end - pos);
+        if (pos >= end)
+        {
+            return;
+        }
+
+        m_off_t readend = std::min(pos + chunk, end);
+        LOG_debug << "Streaming read ahead: " << pos << " - " << readend << " Window: " << window << " RTT (ds): " << rtt;
+        DirectRead* dr = new DirectRead(this, readend - pos, pos, 0, nullptr);
+        dr->readahead = true;
+
+        inflight++;
+        pos = readend;
+    }
+}
+
+m_off_t DirectReadNode::readaheadwindow()
+{
+    m_off_t bitrate = consumption.calculateSpeed();
+    m_off_t latency = std::max<dstime>(rtt, 1);
+    m_off_t window = std::max(bitrate * (2 * latency + READAHEAD_LEAD_DS) / 10, client->streamingreadahead);
+    return std::min(window, cache.capacity());
+}
+
+bool DirectReadNode::readaheadcovers(m_off_t pos) const
+{
+    for (dr_list::const_iterator it = reads.begin(); it != reads.end(); it++)
+    {
+        const DirectRead* dr = *it;
+        if (dr->readahead && dr->offset + dr->progress <= pos && pos < dr->offset + dr->count)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DirectReadNode::updatertt(dstime elapsed)
+{
+    rtt = rtt ? (3 * rtt + elapsed) / 4 : std::max<dstime>(elapsed, 1);
+}
+
 bool DirectReadSlot::processAnyOutputPieces()
 {
     bool continueDirectRead = true;
@@ -1316,7 +1521,12 @@ bool DirectReadSlot::processAnyOutputPieces()
         speed = speedController.calculateSpeed();
         meanSpeed = speedController.getMeanSpeed();
         dr->drn->client->httpio->updatedownloadspeed(len);
-        continueDirectRead = dr->drn->client->app->pread_data(outputPiece->buf.datastart(), len, pos, speed, meanSpeed, dr->appdata);
+        dr->drn->cache.store(pos, outputPiece->buf.datastart(), len);
+        if (!dr->readahead)
+        {
+            dr->drn->consumption.calculateSpeed(m_off_t(len));
+            continueDirectRead = dr->drn->client->app->pread_data(outputPiece->buf.datastart(), len, pos, speed, meanSpeed, dr->appdata);
+        }
 
         dr->drbuf.bufferWriteCompleted(0, true);
 
@@ -1350,6 +1560,11 @@ bool DirectReadSlot::doio()
 
                 if (n)
                 {
+                    if (rttstart)
+                    {
+                        dr->drn->updatertt(Waiter::ds - rttstart);
+                        rttstart = 0;
+                    }
 
                     RaidBufferManager::FilePiece* np = new RaidBufferManager::FilePiece(req->pos, n);
                     memcpy(np->buf.datastart(), req->in.data(), n);
@@ -1373,7 +1588,7 @@ bool DirectReadSlot::doio()
                     if (!processAnyOutputPieces())
                     {
                         // app-requested abort
-                        delete dr;
+                        dr->drn->finishread(dr, pos);
                         return true;
                     }
                 }
@@ -1408,10 +1623,8 @@ bool DirectReadSlot::doio()
                     }
                     if (allDone)
                     {
-                        dr->drn->schedule(DirectReadSlot::TEMPURL_TIMEOUT_DS);
-
                         // remove and delete completed read request, then remove slot
-                        delete dr;
+                        dr->drn->finishread(dr, dr->offset + dr->count);
                         return true;
                     }
                 }
@@ -1527,8 +1740,7 @@ DirectRead::DirectRead(DirectReadNode* cdrn, m_off_t ccount, m_off_t coffset, in
 
     if (!drn->tempurls.empty())
     {
-        // we already have tempurl(s): queue for immediate fetching
-        drbuf.setIsRaid(drn->tempurls, offset, offset + count, drn->size, 2097152);  // 2 MB max buffer usage approx
+        // we already have tempurl(s): queue for immediate fetching (set up when it gets its slot)
         drq_it = drn->client->drq.insert(drn->client->drq.end(), this);
     }
     else
@@ -1587,6 +1799,7 @@ DirectReadSlot::DirectReadSlot(DirectRead* cdr)
     dr->nextrequestpos = pos;
 
     speed = meanSpeed = 0;
+    rttstart = Waiter::ds;
 
     assert(reqs.empty());
     for (size_t i = dr->drbuf.tempUrlVector().size(); i--; )
@@ -1594,6 +1807,7 @@ DirectReadSlot::DirectReadSlot(DirectRead* cdr)
         reqs.push_back(new HttpReq(true));
         reqs.back()->status = REQ_READY;
         reqs.back()->type = REQ_BINARY;
+        reqs.back()->bwclass = BWCLASS_STREAMING;
     }
 
     drs_it = dr->drn->client->drss.insert(dr->drn->client->drss.end(), this);
@@ -1613,6 +1827,200 @@ DirectReadSlot::~DirectReadSlot()
     }
 }
 
+void DirectReadCache::configure(m_off_t fileSize, size_t maxMemory, FileSystemAccess* fsaccess, const LocalPath& spillPath, m_off_t maxSpill)
+{
+    mFileSize = fileSize;
+    mMaxMemory = maxMemory;
+    mFsAccess = fsaccess;
+    mSpillPath = spillPath;
+    mMaxSpill = spillPath.empty() ? 0 : maxSpill;
+}
+
+DirectReadCache::~DirectReadCache()
+{
+    CodeCounter::accountMemory(CodeCounter::MEM_STREAMING_CACHE, -int64_t(mMemoryUsed));
+
+    if (mSpill)
+    {
+        mSpill.reset();
+        mFsAccess->unlinklocal(mSpillPath);
+    }
+}
+
+m_off_t DirectReadCache::blockEnd(m_off_t start) const
+{
+    return std::min(start + BLOCK_SIZE, mFileSize);
+}
+
+void DirectReadCache::store(m_off_t pos, const byte* data, size_t len)
+{
+    if (!mMaxMemory)
+    {
+        return;
+    }
+
+    while (len)
+    {
+        m_off_t start = pos - pos % BLOCK_SIZE;
+        size_t n = size_t(std::min<m_off_t>(m_off_t(len), blockEnd(start) - pos));
+
+        auto it = mBlocks.find(start);
+        if (it == mBlocks.end() && pos == start)
+        {
+            it = mBlocks.emplace(start, Block()).first;
+            it->second.lru = mLru.insert(mLru.end(), start);
+        }
+
+        if (it != mBlocks.end() && !it->second.complete)
+        {
+            // only what follows the data of the block without a gap
+            Block& b = it->second;
+            m_off_t filled = start + m_off_t(b.data.size());
+            if (pos <= filled && filled < pos + m_off_t(n))
+            {
+                size_t skip = size_t(filled - pos);
+                b.data.append(reinterpret_cast<const char*>(data) + skip, n - skip);
+                mMemoryUsed += n - skip;
+                CodeCounter::accountMemory(CodeCounter::MEM_STREAMING_CACHE, int64_t(n - skip));
+                b.complete = start + m_off_t(b.data.size()) == blockEnd(start);
+            }
+            mLru.splice(mLru.end(), mLru, b.lru);
+        }
+
+        pos += m_off_t(n);
+        data += n;
+        len -= n;
+
+        evict(mMaxMemory);
+    }
+}
+
+bool DirectReadCache::load(m_off_t pos, m_off_t maxLen, string& data)
+{
+    m_off_t start = pos - pos % BLOCK_SIZE;
+    auto it = mBlocks.find(start);
+    if (it == mBlocks.end())
+    {
+        return false;
+    }
+
+    Block& b = it->second;
+    m_off_t end = b.complete ? blockEnd(start) : start + m_off_t(b.data.size());
+    if (pos >= end)
+    {
+        return false;
+    }
+    end = std::min(end, pos + maxLen);
+
+    if (!b.spilled)
+    {
+        data.assign(b.data, size_t(pos - start), size_t(end - pos));
+        mLru.splice(mLru.end(), mLru, b.lru);
+        return true;
+    }
+
+    data.resize(size_t(end - pos));
+    if (!mSpill->frawread(reinterpret_cast<byte*>(&data[0]), unsigned(data.size()), pos, true))
+    {
+        LOG_warn << "Unable to read streaming cache block at " << start;
+        mSpillUsed -= blockEnd(start) - start;
+        mBlocks.erase(it);
+        return false;
+    }
+    return true;
+}
+
+m_off_t DirectReadCache::cached(m_off_t pos, m_off_t maxLen) const
+{
+    m_off_t from = pos;
+    m_off_t to = std::min(pos + maxLen, mFileSize);
+
+    while (pos < to)
+    {
+        m_off_t start = pos - pos % BLOCK_SIZE;
+        auto it = mBlocks.find(start);
+        if (it == mBlocks.end())
+        {
+            break;
+        }
+
+        const Block& b = it->second;
+        if (!b.complete)
+        {
+            pos = std::max(pos, start + m_off_t(b.data.size()));
+            break;
+        }
+        pos = blockEnd(start);
+    }
+
+    return std::max<m_off_t>(std::min(pos, to) - from, 0);
+}
+
+size_t DirectReadCache::trim(size_t keep)
+{
+    size_t before = mMemoryUsed;
+    evict(keep);
+    return before - mMemoryUsed;
+}
+
+void DirectReadCache::evict(size_t maxMemory)
+{
+    while (mMemoryUsed > maxMemory && !mLru.empty())
+    {
+        m_off_t start = mLru.front();
+        mLru.pop_front();
+
+        Block& b = mBlocks[start];
+        mMemoryUsed -= b.data.size();
+        CodeCounter::accountMemory(CodeCounter::MEM_STREAMING_CACHE, -int64_t(b.data.size()));
+
+        if (b.complete && spill(start, b))
+        {
+            string().swap(b.data);
+            b.spilled = true;
+        }
+        else
+        {
+            mBlocks.erase(start);
+        }
+    }
+}
+
+bool DirectReadCache::spill(m_off_t start, Block& b)
+{
+    if (mSpillUsed + m_off_t(b.data.size()) > mMaxSpill)
+    {
+        return false;
+    }
+
+    if (!mSpill)
+    {
+        // created first, then opened for reading too
+        LocalPath path = mSpillPath;
+        auto fa = mFsAccess->newfileaccess(false);
+        if (fa->fopen(path, false, true))
+        {
+            fa = mFsAccess->newfileaccess(false);
+        }
+        if (!fa->fopen(path, true, true))
+        {
+            LOG_warn << "Unable to create the streaming cache file: " << mSpillPath.toPath(*mFsAccess);
+            mMaxSpill = 0;
+            return false;
+        }
+        mSpill = std::move(fa);
+    }
+
+    if (!mSpill->fwrite(reinterpret_cast<const byte*>(b.data.data()), unsigned(b.data.size()), start))
+    {
+        LOG_warn << "Unable to write to the streaming cache file";
+        return false;
+    }
+
+    mSpillUsed += m_off_t(b.data.size());
+    return true;
+}
+
 bool priority_comparator(const LazyEraseTransferPtr& i, const LazyEraseTransferPtr& j)
 {
     return (i.transfer ? i.transfer->priority : i.preErasurePriority) < (j.transfer ? j.transfer->priority : j.preErasurePriority);
@@ -1640,6 +2048,7 @@ void TransferList::addtransfer(Transfer *transfer, DBTableTransactionCommitter&
             transfer->priority = dstit->transfer->priority - PRIORITY_STEP;
             prepareIncreasePriority(transfer, transfers[transfer->type].end(), dstit, committer);
             transfers[transfer->type].push_front(transfer);
+            index(transfer);
         }
         else
         {
@@ -1647,6 +2056,7 @@ void TransferList::addtransfer(Transfer *transfer, DBTableTransactionCommitter&
             transfer->priority = currentpriority;
             assert(!transfers[transfer->type].size() || transfers[transfer->type][transfers[transfer->type].size() - 1]->priority < transfer->priority);
             transfers[transfer->type].push_back(transfer);
+            index(transfer);
         }
 
         client->transfercacheadd(transfer, &committer);
@@ -1656,6 +2066,7 @@ void TransferList::addtransfer(Transfer *transfer, DBTableTransactionCommitter&
         transfer_list::iterator it = std::lower_bound(transfers[transfer->type].begin(), transfers[transfer->type].end(), LazyEraseTransferPtr(transfer), priority_comparator);
         assert(it == transfers[transfer->type].end() || it->transfer->priority != transfer->priority);
         transfers[transfer->type].insert(it, transfer);
+        index(transfer);
     }
 }
 
@@ -1666,6 +2077,7 @@ void TransferList::removetransfer(Transfer *transfer)
     {
         transfers[transfer->type].erase(it);
     }
+    unindex(transfer);
 }
 
 void TransferList::movetransfer(Transfer *transfer, Transfer *prevTransfer, DBTableTransactionCommitter& committer)
@@ -1727,10 +2139,12 @@ void TransferList::movetransfer(transfer_list::iterator it, transfer_list::itera
         prepareDecreasePriority(transfer, it, dstit);
 
         transfers[transfer->type].erase(it);
+        unindex(transfer);
         currentpriority += PRIORITY_STEP;
         transfer->priority = currentpriority;
         assert(!transfers[transfer->type].size() || transfers[transfer->type][transfers[transfer->type].size() - 1]->priority < transfer->priority);
         transfers[transfer->type].push_back(transfer);
+        index(transfer);
         client->transfercacheadd(transfer, &committer);
         client->app->transfer_update(transfer);
         return;
@@ -1765,7 +2179,9 @@ void TransferList::movetransfer(transfer_list::iterator it, transfer_list::itera
         {
             Transfer *t = transfers[transfer->type][i];
             LOG_debug << "Adjusting priority of transfer " << i << " to " << fixedPriority;
+            unindex(t);
             t->priority = fixedPriority;
+            index(t);
             client->transfercacheadd(t, &committer);
             client->app->transfer_update(t);
             fixedPriority += PRIORITY_STEP;
@@ -1774,7 +2190,9 @@ void TransferList::movetransfer(transfer_list::iterator it, transfer_list::itera
         LOG_debug << "Fixed priority: " << fixedPriority;
     }
 
+    unindex(transfer);
     transfer->priority = newpriority;
+    index(transfer);
     if (srcindex > dstindex)
     {
         prepareIncreasePriority(transfer, it, dstit, committer);
@@ -1962,39 +2380,47 @@ std::array<vector<Transfer*>, 6> TransferList::nexttransfers(std::function<bool(
 
     for (direction_t direction : putget)
     {
-        for (Transfer *transfer : transfers[direction])
+        // the large and the small files in priority order, leaving out a category once it is full
+        TransferCategory large(direction, LARGEFILE);
+        TransferCategory small(direction, SMALLFILE);
+        auto& largeTransfers = mByCategory[large.index()];
+        auto& smallTransfers = mByCategory[small.index()];
+        auto largeIt = largeTransfers.begin();
+        auto smallIt = smallTransfers.begin();
+
+        bool continueLarge = true;
+        bool continueSmall = true;
+
+        for (;;)
         {
+            bool largeNext = continueLarge && largeIt != largeTransfers.end();
+            bool smallNext = continueSmall && smallIt != smallTransfers.end();
+            if (largeNext && smallNext)
+            {
+                largeNext = largeIt->first < smallIt->first;
+                smallNext = !largeNext;
+            }
+
+            if (!largeNext && !smallNext)
+            {
+                break;
+            }
+
             // don't traverse the whole list if we already have as many as we are going to get
             if (!directionContinuefunction(direction)) break;
 
-            bool continueLarge = true;
-            bool continueSmall = true;
+            Transfer *transfer = largeNext ? (largeIt++)->second : (smallIt++)->second;
 
             if ((!transfer->slot && isReady(transfer))
                 || (transfer->asyncopencontext
                     && transfer->asyncopencontext->finished))
             {
-                TransferCategory tc(transfer);
-
-                if (tc.sizetype == LARGEFILE && continueLarge)
-                {
-                    continueLarge = continuefunction(transfer);
-                    if (continueLarge)
-                    {
-                        chosenTransfers[tc.index()].push_back(transfer);
-                    }
-                }
-                else if (tc.sizetype == SMALLFILE && continueSmall)
-                {
-                    continueSmall = continuefunction(transfer);
-                    if (continueSmall)
-                    {
-                        chosenTransfers[tc.index()].push_back(transfer);
-                    }
-                }
-                if (!continueLarge && !continueSmall)
+                // a category that refuses one refuses the rest, as it only changes when it takes one
+                bool& continueCategory = largeNext ? continueLarge : continueSmall;
+                continueCategory = continuefunction(transfer);
+                if (continueCategory)
                 {
-                    break;
+                    chosenTransfers[(largeNext ? large : small).index()].push_back(transfer);
                 }
             }
         }
@@ -2079,6 +2505,35 @@ void TransferList::prepareDecreasePriority(Transfer *transfer, transfer_list::it
     }
 }
 
+void TransferList::clear()
+{
+    transfers[GET].clear();
+    transfers[PUT].clear();
+    for (auto& category : mByCategory)
+    {
+        category.clear();
+    }
+}
+
+void TransferList::index(Transfer *transfer)
+{
+    mByCategory[TransferCategory(transfer).index()][transfer->priority] = transfer;
+}
+
+void TransferList::unindex(Transfer *transfer)
+{
+    // by both size categories, in case the size changed since it was indexed
+    for (filesizetype_t sizetype : { LARGEFILE, SMALLFILE })
+    {
+        auto& category = mByCategory[TransferCategory(transfer->type, sizetype).index()];
+        auto it = category.find(transfer->priority);
+        if (it != category.end() && it->second == transfer)
+        {
+            category.erase(it);
+        }
+    }
+}
+
 bool TransferList::isReady(Transfer *transfer)
 {
     return ((transfer->state == TRANSFERSTATE_QUEUED || transfer->state == TRANSFERSTATE_RETRYING)
@@ -29,6 +29,7 @@
 #include "mega/utils.h"
 #include "mega/logging.h"
 #include "mega/raid.h"
+#include "mega/trace.h"
 
 namespace mega {
 
@@ -68,12 +69,210 @@ const dstime TransferSlot::PROGRESSTIMEOUT = 10;
     const m_off_t TransferSlot::MAX_REQ_SIZE = 4194304; // 4 MB
 #endif
 
+const m_off_t TransferSlot::MAX_UPLOAD_REQ_SIZE = 32 * 1024 * 1024; // 32 MB
+
 const m_off_t TransferSlot::MAX_GAP_SIZE = 256 * 1024 * 1024; // 256 MB
 
+// smaller ones are written in a few requests, so they don't fragment much
+const m_off_t TransferSlot::MIN_PREALLOCATE_SIZE = 64 * 1024 * 1024; // 64 MB
+
+const unsigned TransferSlot::MAX_HEDGED_REQS = 8;
+
+const size_t TransferSlot::HEDGE_SPEED_HISTORY = 20;
+
+const unsigned TransferSlot::READ_AHEAD_RATIO = 8;
+
+const dstime TransferConnectionControl::PERIOD_DS = 30;
+const int TransferConnectionControl::MIN_GAIN_PERCENT = 10;
+const int TransferConnectionControl::REQUEST_SECONDS = 4;
+const m_off_t TransferConnectionControl::MIN_REQ_SIZE = 1048576; // 1 MB
+const unsigned TransferConnectionControl::MAX_HOLD_PERIODS = 32;
+
+TransferConnectionBudget::TransferConnectionBudget(unsigned maxConnections, unsigned maxHostConnections)
+    : mMaxConnections(maxConnections)
+    , mMaxHostConnections(maxHostConnections)
+{
+}
+
+unsigned TransferConnectionBudget::connectionsof(const TransferSlot& ts)
+{
+    if (ts.connections)
+    {
+        return ts.transferbuf.isRaid() ? unsigned(RAIDPARTS) : ts.mConnectionControl.connections();
+    }
+    return connectionsof(*ts.transfer);
+}
+
+unsigned TransferConnectionBudget::connectionsof(const Transfer& t)
+{
+    if (t.size <= 131072)
+    {
+        return 1;
+    }
+
+    if (t.tempurls.size() == RAIDPARTS || (t.type == GET && t.tempurls.empty()))
+    {
+        return RAIDPARTS;
+    }
+    return t.client->connections[t.type];
+}
+
+string TransferConnectionBudget::host(const string& url)
+{
+    size_t start = url.find("://");
+    start = start == string::npos ? 0 : start + 3;
+    size_t end = url.find_first_of(":/", start);
+    return url.substr(start, end == string::npos ? string::npos : end - start);
+}
+
+unsigned TransferConnectionBudget::perurl(unsigned connections, const vector<string>& urls)
+{
+    return urls.size() > 1 ? 1 : connections;
+}
+
+bool TransferConnectionBudget::fits(unsigned connections, const vector<string>& urls) const
+{
+    // a transfer that is alone can always start, however many connections it takes
+    if (mUsed && mUsed + connections > mMaxConnections)
+    {
+        return false;
+    }
+
+    unsigned each = perurl(connections, urls);
+    for (auto& url : urls)
+    {
+        auto it = mHosts.find(host(url));
+        if (it != mHosts.end() && it->second + each > mMaxHostConnections)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TransferConnectionBudget::add(unsigned connections, const vector<string>& urls)
+{
+    mUsed += connections;
+
+    unsigned each = perurl(connections, urls);
+    for (auto& url : urls)
+    {
+        mHosts[host(url)] += each;
+    }
+}
+
+void TransferConnectionControl::init(unsigned initialConnections, unsigned maxConnections, m_off_t maxRequestSize,
+                                     m_off_t memoryLimit, bool adaptive, dstime now)
+{
+    mMaxConnections = std::max(1u, maxConnections);
+    mConnections = std::max(1u, std::min(initialConnections, mMaxConnections));
+    mMaxRequestSize = mRequestSize = maxRequestSize;
+    mMemoryLimit = memoryLimit;
+    mAdaptive = adaptive;
+
+    mPeriodStart = now;
+    mPeriodBytes = 0;
+    mBaseline = 0;
+    mProbe = 0;
+    mNextProbe = 1;
+    mHold = mHoldBackoff = 1;
+
+    applyMemoryLimit();
+}
+
+void TransferConnectionControl::applyMemoryLimit()
+{
+    if (!mMemoryLimit)
+    {
+        return;
+    }
+
+    // fewer connections only when even the smallest requests don't fit
+    if (m_off_t(mConnections) * MIN_REQ_SIZE > mMemoryLimit)
+    {
+        mConnections = std::max<unsigned>(1, unsigned(mMemoryLimit / MIN_REQ_SIZE));
+    }
+
+    mRequestSize = std::min(mRequestSize, std::max(MIN_REQ_SIZE, mMemoryLimit / mConnections));
+}
+
+bool TransferConnectionControl::update(dstime now)
+{
+    if (!mAdaptive || now - mPeriodStart < PERIOD_DS)
+    {
+        return false;
+    }
+
+    m_off_t throughput = mPeriodBytes * PERIOD_DS / (now - mPeriodStart);
+    mPeriodStart = now;
+    mPeriodBytes = 0;
+
+    if (!throughput)
+    {
+        // nothing moved (eg. waiting for file reads or a retry): nothing to learn
+        return false;
+    }
+
+    unsigned connections = mConnections;
+    m_off_t requestSize = mRequestSize;
+
+    if (mProbe)
+    {
+        // keep the change if it paid off: the throughput grew enough with one more, or didn't drop much with one fewer
+        bool kept = mProbe > 0 ? throughput * 100 >= mBaseline * (100 + MIN_GAIN_PERCENT)
+                               : throughput * 100 >= mBaseline * (100 - MIN_GAIN_PERCENT);
+        if (kept)
+        {
+            mHold = 1;
+            mHoldBackoff = 1;
+        }
+        else
+        {
+            mConnections -= mProbe;
+            mNextProbe = -mProbe;
+            mHold = mHoldBackoff;
+            mHoldBackoff = std::min(mHoldBackoff * 2, MAX_HOLD_PERIODS);
+        }
+        mProbe = 0;
+    }
+    else if (mHold)
+    {
+        --mHold;
+    }
+
+    if (!mProbe && !mHold)
+    {
+        if (mNextProbe > 0 && mConnections >= mMaxConnections)
+        {
+            mNextProbe = -1;
+        }
+        else if (mNextProbe < 0 && mConnections <= 1)
+        {
+            mNextProbe = 1;
+        }
+
+        if ((mNextProbe > 0 && mConnections < mMaxConnections) || (mNextProbe < 0 && mConnections > 1))
+        {
+            mProbe = mNextProbe;
+            mConnections += mProbe;
+            mBaseline = throughput;
+        }
+    }
+
+    // a few seconds of data per connection, so the latency of starting a request doesn't matter
+    m_off_t perSecond = throughput * 10 / PERIOD_DS / connections;
+    mRequestSize = std::max(MIN_REQ_SIZE, std::min(mMaxRequestSize, perSecond * REQUEST_SECONDS));
+    applyMemoryLimit();
+
+    return connections != mConnections || requestSize != mRequestSize;
+}
+
 TransferSlot::TransferSlot(Transfer* ctransfer)
     : fa(ctransfer->client->fsaccess->newfileaccess(), ctransfer)
     , retrybt(ctransfer->client->rng, ctransfer->client->transferSlotsBackoff)
 {
+    ctransfer->stages.mark(STAGE_SLOT_ACQUIRED);
+
     starttime = 0;
     lastprogressreport = 0;
     progressreported = 0;
@@ -138,6 +337,46 @@ TransferSlot::TransferSlot(Transfer* ctransfer)
 #endif
 }
 
+void TransferSlot::updateBufferPool()
+{
+    m_off_t held = transferbuf.bufferedBytes();
+
+    for (int i = connections; i--; )
+    {
+        if (!reqs[i])
+        {
+            continue;
+        }
+
+        switch (static_cast<reqstatus_t>(reqs[i]->status))
+        {
+            case REQ_READY:
+            case REQ_DONE:
+            case REQ_FAILURE:
+                break;
+
+            case REQ_ASYNCIO:
+                // file reads for uploads; the data of downloads being written is in transferbuf
+                if (transfer->type == PUT && asyncIO[i])
+                {
+                    held += asyncIO[i]->dataBufferLen;
+                }
+                break;
+
+            default:
+                held += reqs[i]->size;
+        }
+    }
+
+    for (m_off_t bytes : mReadAheadBytes)
+    {
+        held += bytes;
+    }
+
+    transfer->client->mTransferBufferPool.adjust(held - mPoolHeld);
+    mPoolHeld = held;
+}
+
 bool TransferSlot::createconnectionsonce()
 {
     // delay creating these until we know if it's raid or non-raid
@@ -148,10 +387,22 @@ bool TransferSlot::createconnectionsonce()
             return false;   // too soon, we don't know raid / non-raid yet
         }
 
-        connections = transferbuf.isRaid() ? RAIDPARTS : (transfer->size > 131072 ? transfer->client->connections[transfer->type] : 1);
-        LOG_debug << "Populating transfer slot with " << connections << " connections, max request size of " << maxRequestSize << " bytes";
+        MegaClient* client = transfer->client;
+        unsigned configured = transferbuf.isRaid() ? RAIDPARTS : (transfer->size > 131072 ? client->connections[transfer->type] : 1);
+
+        // raid downloads need one connection per part; with adaptation, the others may go up to the maximum
+        bool adaptive = client->mAdaptiveConnections && !transferbuf.isRaid() && configured > 1;
+        connections = adaptive ? int(MegaClient::MAX_NUM_CONNECTIONS) : int(configured);
+        mConnectionControl.init(configured, connections, transfer->type == PUT ? MAX_UPLOAD_REQ_SIZE : maxRequestSize,
+                                transferbuf.isRaid() ? 0 : client->mMaxTransferMemory, adaptive, Waiter::ds);
+
+        LOG_debug << "Populating transfer slot with " << connections << " connections (" << mConnectionControl.connections()
+                  << " in use), max request size of " << mConnectionControl.requestSize() << " bytes";
         reqs.resize(connections);
         mReqSpeeds.resize(connections);
+        mReadAhead.resize(connections);
+        mReadAheadBytes.resize(connections);
+        mReadStarted.resize(connections);
         asyncIO = new AsyncIOContext*[connections]();
     }
     return true;
@@ -161,6 +412,9 @@ bool TransferSlot::createconnectionsonce()
 // reused on a new slot)
 TransferSlot::~TransferSlot()
 {
+    transfer->client->mTransferBufferPool.adjust(-mPoolHeld);
+    mPoolHeld = 0;
+
     if (transfer->type == GET && !transfer->finished
             && transfer->progresscompleted != transfer->size
             && !transfer->asyncopencontext)
@@ -307,6 +561,23 @@ TransferSlot::~TransferSlot()
     delete[] asyncIO;
 }
 
+LatencyHistogram& TransferSlot::latency()
+{
+    return transfer->client->mLatency[transfer->type == GET ? MegaClient::LATENCY_GET : MegaClient::LATENCY_PUT];
+}
+
+MegaClientAsyncQueue::Priority TransferSlot::workerPriority() const
+{
+    for (File* f : transfer->files)
+    {
+        if (!f->syncxfer)
+        {
+            return MegaClientAsyncQueue::PRIORITY_NORMAL;
+        }
+    }
+    return MegaClientAsyncQueue::PRIORITY_BACKGROUND;
+}
+
 void TransferSlot::toggleport(HttpReqXfer *req)
 {
     if (!memcmp(req->posturl.c_str(), "http:", 5))
@@ -340,6 +611,8 @@ void TransferSlot::disconnect()
             reqs[i]->disconnect();
         }
     }
+
+    mHedgeReq.reset();
 }
 
 int64_t TransferSlot::macsmac(chunkmac_map* m)
@@ -361,16 +634,19 @@ bool TransferSlot::checkMetaMacWithMissingLateEntries()
     // Here we check if the MAC is one of those with a missing entry (or a few if the connection had multiple chunks)
 
     // last 3 connections, up to 32MB (ie chunks) each, up to two completing after the one that delivered the ultoken
-    size_t end = transfer->chunkmacs.size();
+    size_t end = transfer->chunkmacs.chunkCount();
     size_t finalN = std::min<size_t>(32 * 3, end);
 
+    // all the gaps tried are among the last finalN entries: the ones before are folded just once
+    chunkmac_map::TailGaps tailGaps(transfer->chunkmacs, transfer->transfercipher(), end - finalN);
+
     // first check for the most likely - a single connection gap (or two but completely consecutive making a single gap)
     for (size_t countBack = 1; countBack <= finalN; ++countBack)
     {
         size_t start1 = end - countBack;
         for (size_t len1 = 1; len1 <= 64 && start1 + len1 <= end; ++len1)
         {
-            if (transfer->metamac == macsmac_gaps(&transfer->chunkmacs, start1, start1 + len1, end, end))
+            if (transfer->metamac == tailGaps.macsmac_gaps(start1, start1 + len1, end, end))
             {
                 LOG_warn << "Found mac gaps were at " << start1 << " " << len1 << " from " << end;
                 auto correctMac = macsmac(&transfer->chunkmacs);
@@ -384,16 +660,16 @@ bool TransferSlot::checkMetaMacWithMissingLateEntries()
     // now check for two separate pieces missing (much less likely)
     // limit to checking up to 16Mb pieces wtih up to 8Mb between to avoid excessive CPU
     // takes about 1 second on a fairly modest laptop for a 100Mb file (in a release build)
-    finalN = std::min<size_t>(16 * 2 + 8, transfer->chunkmacs.size());
+    finalN = std::min<size_t>(16 * 2 + 8, end);
     for (size_t start1 = end - finalN; start1 < end; ++start1)
     {
         for (size_t len1 = 1; len1 <= 16 && start1 + len1 <= end; ++len1)
         {
-            for (size_t start2 = start1 + len1 + 1; start2 < transfer->chunkmacs.size(); ++start2)
+            for (size_t start2 = start1 + len1 + 1; start2 < end; ++start2)
             {
                 for (size_t len2 = 1; len2 <= 16 && start2 + len2 <= end; ++len2)
                 {
-                    if (transfer->metamac == macsmac_gaps(&transfer->chunkmacs, start1, start1 + len1, start2, start2 + len2))
+                    if (transfer->metamac == tailGaps.macsmac_gaps(start1, start1 + len1, start2, start2 + len2))
                     {
                         LOG_warn << "Found mac gaps were at " << start1 << " " << len1 << " " << start2 << " " << len2 << " from " << end;
                         auto correctMac = macsmac(&transfer->chunkmacs);
@@ -417,6 +693,7 @@ bool TransferSlot::checkDownloadTransferFinished(DBTableTransactionCommitter& co
             || (macsmac(&transfer->chunkmacs) == transfer->metamac)
             || checkMetaMacWithMissingLateEntries())
         {
+            transfer->stages.mark(STAGE_MAC_VERIFIED);
             client->transfercacheadd(transfer, &committer);
             if (transfer->progresscompleted != progressreported)
             {
@@ -495,10 +772,168 @@ bool TransferSlot::testForSlowRaidConnection(unsigned connectionNum, bool& incre
     return false;
 }
 
+void TransferSlot::hedgeSlowRequest(MegaClient* client)
+{
+    if (mHedgeReq)
+    {
+        auto& original = reqs[mHedgedConnection];
+        if (!original || original->status != REQ_INFLIGHT || static_cast<HttpReqDL*>(original.get())->dlpos != mHedgedPos)
+        {
+            LOG_debug << "Original request at " << mHedgedPos << " finished first, dropping its duplicate";
+            mHedgeReq.reset();
+        }
+        else if (mHedgeReq->status == REQ_SUCCESS && mHedgeReq->bufpos == mHedgeReq->size)
+        {
+            // the duplicate takes the place of the original, and gets processed as its response
+            LOG_debug << "Duplicate request at " << mHedgedPos << " finished first, replacing connection " << mHedgedConnection;
+            original = std::move(mHedgeReq);
+        }
+        else if (mHedgeReq->status == REQ_SUCCESS || mHedgeReq->status == REQ_FAILURE)
+        {
+            LOG_debug << "Duplicate request at " << mHedgedPos << " failed, HTTP status: " << mHedgeReq->httpstatus;
+            mHedgeReq.reset();
+        }
+        else if (EVER(mHedgeReq->lastdata) && mHedgeReq->lastdata > lastdata)
+        {
+            lastdata = mHedgeReq->lastdata;
+        }
+        return;
+    }
+
+    if (mHedgedReqs >= MAX_HEDGED_REQS || mRecentReqSpeeds.size() < HEDGE_SPEED_HISTORY / 4)
+    {
+        return;
+    }
+
+    // 90% of the recent requests were faster than this
+    vector<m_off_t> speeds(mRecentReqSpeeds.begin(), mRecentReqSpeeds.end());
+    auto slow = speeds.begin() + speeds.size() / 10;
+    std::nth_element(speeds.begin(), slow, speeds.end());
+    if (*slow <= 0)
+    {
+        return;
+    }
+
+    for (int i = connections; i--; )
+    {
+        HttpReqDL* downloadRequest = static_cast<HttpReqDL*>(reqs[i].get());
+        if (!downloadRequest || downloadRequest->status != REQ_INFLIGHT || downloadRequest->dlpos == mHedgedPos)
+        {
+            continue;
+        }
+
+        // allow it more time than those requests needed for its size, and a few seconds in any case
+        dstime elapsed = mReqSpeeds[i].requestElapsedDs();
+        if (elapsed < 50 || elapsed <= dstime(downloadRequest->size * 10 / *slow))
+        {
+            continue;
+        }
+
+        LOG_warn << "Request at " << downloadRequest->dlpos << " on connection " << i << " is slow: " << downloadRequest->bufpos
+                 << " of " << downloadRequest->size << " bytes in " << elapsed << " ds. Duplicating it";
+
+        mHedgeReq.reset(new HttpReqDL());
+        mHedgeReq->logname = client->clientname + "D" + std::to_string(++client->transferHttpCounter) + " ";
+        mHedgeReq->bwclass = downloadRequest->bwclass;
+        mHedgeReq->prepare(transferbuf.tempURL(i).c_str(), transfer->transfercipher(), transfer->ctriv,
+                           downloadRequest->dlpos, downloadRequest->dlpos + downloadRequest->size);
+        mHedgeReq->posturl = downloadRequest->posturl;
+        mHedgeReq->pos = downloadRequest->pos;
+        mHedgeReq->minspeed = true;
+        mHedgeReq->post(client);
+
+        mHedgedConnection = i;
+        mHedgedPos = downloadRequest->dlpos;
+        ++mHedgedReqs;
+        return;
+    }
+}
+
+void TransferSlot::readAhead(MegaClient* client, int i)
+{
+    if (mReadAhead[i] || !mPostMs || mReadMs * READ_AHEAD_RATIO < mPostMs || client->mTransferBufferPool.exhausted())
+    {
+        return;
+    }
+
+    bool newInputBufferSupplied = false;
+    bool pauseConnectionInputForRaid = false;
+    std::pair<m_off_t, m_off_t> posrange = transferbuf.nextNPosForConnection(i, mConnectionControl.requestSize(), mConnectionControl.connections(), newInputBufferSupplied, pauseConnectionInputForRaid, client->httpio->uploadSpeed);
+    if (posrange.second <= posrange.first)
+    {
+        return;
+    }
+
+    if (!mReadAheadFile)
+    {
+        auto file = std::make_shared<ReadAheadFile>();
+        file->fa = client->fsaccess->newfileaccess();
+        if (!file->fa->fopen(transfer->localfilename, true, false))
+        {
+            LOG_warn << "Unable to open the file to read ahead";
+            return;
+        }
+
+        LOG_debug << "Reading ahead: reads take " << mReadMs << " ms, requests " << mPostMs << " ms";
+        mReadAheadFile = std::move(file);
+    }
+
+    string finaltempurl = transferbuf.tempURL(i);
+    if (client->usealtupport && !memcmp(finaltempurl.c_str(), "http:", 5))
+    {
+        size_t index = finaltempurl.find("/", 8);
+        if (index != string::npos && finaltempurl.find(":", 8) == string::npos)
+        {
+            finaltempurl.insert(index, ":8080");
+        }
+    }
+
+    std::shared_ptr<HttpReqXfer> req(new HttpReqUL());
+    req->logname = client->clientname + "U" + std::to_string(++client->transferHttpCounter) + " ";
+    req->bwclass = transfer->bandwidthclass();
+    req->pos = posrange.first;
+    req->status = REQ_ENCRYPTING;
+
+    auto file = mReadAheadFile;
+    auto transferkey = transfer->transferkey;
+    auto ctriv = transfer->ctriv;
+    m_off_t pos = posrange.first;
+    m_off_t npos = posrange.second;
+
+    client->mAsyncQueue.push([req, file, transferkey, ctriv, finaltempurl, pos, npos](SymmCipher& sc)
+        {
+            unsigned size = unsigned(npos - pos);
+            auto started = std::chrono::steady_clock::now();
+            bool read;
+            {
+                std::lock_guard<std::mutex> g(file->mutex);
+                read = file->fa->fread(req->out, size, (-(int)size) & (SymmCipher::BLOCKSIZE - 1), pos);
+            }
+
+            if (!read)
+            {
+                req->status = REQ_FAILURE;
+                return;
+            }
+            file->readMs = unsigned(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count());
+
+            sc.setkey(transferkey.data());
+            req->prepare(finaltempurl.c_str(), &sc, ctriv, pos, npos);
+            req->status = REQ_PREPARED;
+        }, true,    // discardable - if the transfer or client are being destroyed, we won't be sending that data.
+        workerPriority(), uint64_t(uintptr_t(transfer)));
+
+    mReadAhead[i] = std::move(req);
+    mReadAheadBytes[i] = npos - pos;
+    transferbuf.transferPos(i) = std::max<m_off_t>(transferbuf.transferPos(i), npos);
+    updateBufferPool();
+}
+
 // file transfer state machine
 void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committer)
 {
     CodeCounter::ScopeTimer pbt(client->performanceStats.transferslotDoio);
+    TraceScope traceScope(transfer->traceId);
 
     if (!fa || (transfer->size && transfer->progresscompleted == transfer->size)
             || (transfer->type == PUT && transfer->ultoken))
@@ -511,6 +946,7 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                 // verify meta MAC
                 if (macsmac(&transfer->chunkmacs) == transfer->metamac)
                 {
+                    transfer->stages.mark(STAGE_MAC_VERIFIED);
                     return transfer->complete(committer);
                 }
                 else
@@ -549,12 +985,20 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
     m_off_t p = 0;
     bool earliestUploadCompleted = false;
 
+    TransferBufferPool& bufferPool = client->mTransferBufferPool;
+    updateBufferPool();
+
     if (errorcount > 4)
     {
         LOG_warn << "Failed transfer: too many errors";
         return transfer->failed(lasterror, committer);
     }
 
+    if (transfer->type == GET && !transferbuf.isRaid())
+    {
+        hedgeSlowRequest(client);
+    }
+
     // main loop over connections
     for (int i = connections; i--; )
     {
@@ -617,6 +1061,14 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
 
                 case REQ_SUCCESS:
                 {
+                    if (transfer->type == PUT && reqs[i]->started != std::chrono::steady_clock::time_point())
+                    {
+                        auto postMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - reqs[i]->started);
+                        mPostMs = (mPostMs * 3 + unsigned(postMs.count())) / 4;
+                    }
+
+                    reqs[i]->recordlatency(latency(), false);
+
                     m_off_t delta = mReqSpeeds[i].requestProgressed(reqs[i]->size);
                     mTransferSpeed.calculateSpeed(delta);
 
@@ -630,6 +1082,13 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                     lastdata = Waiter::ds;
                     transfer->lastaccesstime = m_time();
 
+                    TRACE_EVENT(TRACE_TRANSFER, transfer->type == PUT ? TRACE_TRANSFER_UPLOAD_CHUNK : TRACE_TRANSFER_DOWNLOAD_CHUNK,
+                                transfer->type == PUT ? transfer->uploadhandle.h : (transfer->files.size() ? transfer->files.front()->h.as8byte() : UNDEF),
+                                uint64_t(reqs[i]->size), reqs[i]->started);
+                    client->performanceStats.transferBytes[transfer->type].fetch_add(uint64_t(reqs[i]->size), std::memory_order_relaxed);
+                    transfer->stages.mark(STAGE_FIRST_BYTE);
+                    transfer->stages.update(STAGE_LAST_BYTE);
+
                     if (!transferbuf.isRaid())
                     {
                         LOG_debug << "Transfer request finished (" << transfer->type << ") Position: " << transferbuf.transferPos(i) << " (" << transfer->pos << ") Size: " << reqs[i]->size
@@ -747,7 +1206,7 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
 
                         errorcount = 0;
                         transfer->failcount = 0;
-                        client->transfercacheadd(transfer, &committer);
+                        client->transfercacheprogress(transfer);
                         reqs[i]->status = REQ_READY;
 
                         // If this upload is the earliest (lowest pos), then release the ones that were waiting
@@ -777,6 +1236,15 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
 
                             if (!downloadRequest->buffer_released)
                             {
+                                if (!transferbuf.isRaid())
+                                {
+                                    mRecentReqSpeeds.push_back(mReqSpeeds[i].lastRequestSpeed());
+                                    if (mRecentReqSpeeds.size() > HEDGE_SPEED_HISTORY)
+                                    {
+                                        mRecentReqSpeeds.pop_front();
+                                    }
+                                }
+
                                 transferbuf.submitBuffer(i, new TransferBufferManager::FilePiece(downloadRequest->dlpos, downloadRequest->release_buf())); // resets size & bufpos.  finalize() is taken care of in the transferbuf
                                 downloadRequest->buffer_released = true;
                             }
@@ -801,7 +1269,8 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                                         sc.setkey(transferkey.data());
                                         outputPiece->finalize(true, filesize, ctriv, &sc, nullptr);
                                         req->status = REQ_DECRYPTED;
-                                    }, false);  // not discardable:  if we downloaded the data, don't waste it - decrypt and write as much as we can to file
+                                    }, false,  // not discardable:  if we downloaded the data, don't waste it - decrypt and write as much as we can to file
+                                    workerPriority(), uint64_t(uintptr_t(transfer)));
                                 }
                                 else
                                 {
@@ -897,7 +1366,7 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                                 return;
                             }
 
-                            client->transfercacheadd(transfer, &committer);
+                            client->transfercacheprogress(transfer);
                             reqs[i]->status = REQ_READY;
                         }
                     }
@@ -912,6 +1381,9 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                             if (transfer->type == PUT)
                             {
                                 LOG_verbose << "Async read succeeded";
+                                auto readMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - mReadStarted[i]);
+                                mReadMs = (mReadMs * 3 + unsigned(readMs.count())) / 4;
+
                                 m_off_t npos = asyncIO[i]->posOfBuffer + asyncIO[i]->dataBufferLen;
                                 string finaltempurl = transferbuf.tempURL(i);
                                 if (client->usealtupport && !memcmp(finaltempurl.c_str(), "http:", 5))
@@ -935,7 +1407,8 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                                         sc.setkey(transferkey.data());
                                         req->prepare(finaltempurl.c_str(), &sc, ctriv, pos, npos);
                                         req->status = REQ_PREPARED;
-                                    }, true);   // discardable - if the transfer or client are being destroyed, we won't be sending that data.
+                                    }, true,    // discardable - if the transfer or client are being destroyed, we won't be sending that data.
+                                    workerPriority(), uint64_t(uintptr_t(transfer)));
                             }
                             else
                             {
@@ -951,7 +1424,7 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                                     return;
                                 }
 
-                                client->transfercacheadd(transfer, &committer);
+                                client->transfercacheprogress(transfer);
                                 reqs[i]->status = REQ_READY;
 
                                 if (client->orderdownloadedchunks && !transferbuf.isRaid())
@@ -999,6 +1472,7 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
 
                 case REQ_FAILURE:
                     LOG_warn << "Failed chunk. HTTP status: " << reqs[i]->httpstatus << " on channel " << i;
+                    reqs[i]->recordlatency(latency(), true);
                     if (reqs[i]->httpstatus && reqs[i]->contenttype.find("text/html") != string::npos
                             && !memcmp(reqs[i]->posturl.c_str(), "http:", 5))
                     {
@@ -1097,11 +1571,46 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
 
         if (!failure)
         {
-            if (!reqs[i] || (reqs[i]->status == REQ_READY))
+            // connections beyond those in use finish their requests, but don't start new ones (failed reads are still retried)
+            bool inUse = unsigned(i) < mConnectionControl.connections() || (transfer->type == PUT && (asyncIO[i] || mReadAhead[i]));
+
+            // while the client's transfer buffers are used up, only slots holding nothing start requests,
+            // and raid parts that the others are waiting for (so their data can be combined and released)
+            bool pausedForMemory = bufferPool.exhausted() && mPoolHeld && !transferbuf.isRaidPartBehind(i)
+                                   && !(transfer->type == PUT && (asyncIO[i] || mReadAhead[i]));
+
+            if ((!reqs[i] || (reqs[i]->status == REQ_READY)) && inUse && pausedForMemory != mPausedForMemory)
+            {
+                mPausedForMemory = pausedForMemory;
+                LOG_debug << "Transfer " << (pausedForMemory ? "paused" : "resumed") << ": transfer buffers hold " << bufferPool.used()
+                          << " of " << bufferPool.limit() << " bytes";
+            }
+
+            if ((!reqs[i] || (reqs[i]->status == REQ_READY)) && inUse && !pausedForMemory && mReadAhead[i])
+            {
+                // the connection posts the request read ahead for it, once encrypted
+                if (mReadAhead[i]->status == REQ_FAILURE)
+                {
+                    LOG_warn << "Error reading ahead";
+                    mReadAhead[i].reset();
+                    mReadAheadBytes[i] = 0;
+                    updateBufferPool();
+                    return transfer->failed(API_EREAD, committer);
+                }
+
+                if (mReadAhead[i]->status == REQ_PREPARED)
+                {
+                    mReadMs = (mReadMs * 3 + mReadAheadFile->readMs) / 4;
+                    reqs[i] = std::move(mReadAhead[i]);
+                    mReadAheadBytes[i] = 0;
+                    updateBufferPool();
+                }
+            }
+            else if ((!reqs[i] || (reqs[i]->status == REQ_READY)) && inUse && !pausedForMemory)
             {
                 bool newInputBufferSupplied = false;
                 bool pauseConnectionInputForRaid = false;
-                std::pair<m_off_t, m_off_t> posrange = transferbuf.nextNPosForConnection(i, maxRequestSize, connections, newInputBufferSupplied, pauseConnectionInputForRaid, client->httpio->uploadSpeed);
+                std::pair<m_off_t, m_off_t> posrange = transferbuf.nextNPosForConnection(i, mConnectionControl.requestSize(), mConnectionControl.connections(), newInputBufferSupplied, pauseConnectionInputForRaid, client->httpio->uploadSpeed);
 
                 // we might have a raid-reassembled block to write, or a previously loaded block, or a skip block to process.
                 bool newOutputBufferSupplied = false;
@@ -1126,6 +1635,7 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                     {
                         reqs[i].reset(transfer->type == PUT ? (HttpReqXfer*)new HttpReqUL() : (HttpReqXfer*)new HttpReqDL());
                         reqs[i]->logname = client->clientname + (transfer->type == PUT ? "U" : "D") + std::to_string(++client->transferHttpCounter) + " ";
+                        reqs[i]->bwclass = transfer->bandwidthclass();
                     }
 
                     bool prepare = true;
@@ -1150,13 +1660,19 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                                 asyncIO[i] = NULL;
                             }
 
+                            mReadStarted[i] = std::chrono::steady_clock::now();
                             asyncIO[i] = fa->asyncfread(reqs[i]->out, size, (-(int)size) & (SymmCipher::BLOCKSIZE - 1), pos);
                             reqs[i]->status = REQ_ASYNCIO;
                             prepare = false;
                         }
                         else
                         {
-                            if (!fa->fread(reqs[i]->out, size, (-(int)size) & (SymmCipher::BLOCKSIZE - 1), transfer->pos))
+                            auto readStarted = std::chrono::steady_clock::now();
+                            bool read = fa->fread(reqs[i]->out, size, (-(int)size) & (SymmCipher::BLOCKSIZE - 1), transfer->pos);
+                            auto readMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - readStarted);
+                            mReadMs = (mReadMs * 3 + unsigned(readMs.count())) / 4;
+
+                            if (!read)
                             {
                                 LOG_warn << "Error preparing transfer: " << fa->retry;
                                 if (!fa->retry)
@@ -1203,6 +1719,14 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
                     }
 
                     transferbuf.transferPos(i) = std::max<m_off_t>(transferbuf.transferPos(i), posrange.second);
+
+                    // for the next connections to see it
+                    updateBufferPool();
+
+                    if (transfer->type == PUT && posrange.second > posrange.first)
+                    {
+                        readAhead(client, i);
+                    }
                 }
                 else if (reqs[i])
                 {
@@ -1281,6 +1805,12 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
         // for Raid, additionally we need the raid data that's waiting to be recombined
         p += transferbuf.progress();
     }
+
+    if (p)
+    {
+        // data of the requests in flight
+        transfer->stages.mark(STAGE_FIRST_BYTE);
+    }
     p += transfer->progresscompleted;
 
     if (p != progressreported || (Waiter::ds - lastprogressreport) > PROGRESSTIMEOUT)
@@ -1288,6 +1818,7 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
         if (p != progressreported)
         {
             m_off_t diff = std::max<m_off_t>(0, p - progressreported);
+            mConnectionControl.transferred(diff);
             speed = speedController.calculateSpeed(diff);
             meanSpeed = speedController.getMeanSpeed();
             if (transfer->type == PUT)
@@ -1307,6 +1838,12 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
         progress();
     }
 
+    if (mConnectionControl.update(Waiter::ds))
+    {
+        LOG_debug << "Transfer now using " << mConnectionControl.connections() << " connections, max request size of "
+                  << mConnectionControl.requestSize() << " bytes. Speed: " << speed;
+    }
+
     assert(lastdata != NEVER);
     if (Waiter::ds - lastdata >= XFERTIMEOUT && !failure)
     {
@@ -1333,6 +1870,7 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
             if (reqs[i] && reqs[i]->status == REQ_INFLIGHT)
             {
                 chunkfailed = true;
+                reqs[i]->recordlatency(latency(), true);
                 client->setchunkfailed(&reqs[i]->posturl);
                 reqs[i]->disconnect();
 
@@ -1360,7 +1898,7 @@ void TransferSlot::doio(MegaClient* client, DBTableTransactionCommitter& committ
 
     if (!failure && backoff > 0)
     {
-        retrybt.backoff(backoff);
+        retrybt.backoff(backoff, latency());
         retrying = true;  // we don't bother checking the `retrybt` before calling `doio` unless `retrying` is set.
     }
 }
@@ -1405,10 +1943,14 @@ void TransferSlot::progress()
 
 void TransferSlot::updatecontiguousprogress()
 {
-    chunkmac_map::iterator pcit;
     chunkmac_map &pcchunkmacs = transfer->chunkmacs;
-    while ((pcit = pcchunkmacs.find(progresscontiguous)) != pcchunkmacs.end()
-           && pcit->second.finished)
+    pcchunkmacs.foldFinished(transfer->transfercipher(), transfer->size);
+    progresscontiguous = std::max(progresscontiguous, pcchunkmacs.foldedEnd());
+
+    // one lookup, then along the finished chunks that follow
+    for (chunkmac_map::iterator pcit = pcchunkmacs.find(progresscontiguous);
+         pcit != pcchunkmacs.end() && pcit->first == progresscontiguous && pcit->second.finished;
+         ++pcit)
     {
         progresscontiguous = ChunkedHash::chunkceil(progresscontiguous, transfer->size);
     }
@@ -25,14 +25,23 @@
 
 namespace mega {
 // create share keys
-TreeProcShareKeys::TreeProcShareKeys(Node* n)
+TreeProcShareKeys::TreeProcShareKeys(Node* n, size_t l)
 {
     sn = n;
+    limit = l;
 }
 
 void TreeProcShareKeys::proc(MegaClient*, Node* n)
 {
-    snk.add(n, sn, sn != NULL);
+    if (added < limit)
+    {
+        snk.add(n, sn, sn != NULL);
+        added++;
+    }
+    else
+    {
+        remaining.push_back(n->nodehandle);
+    }
 }
 
 void TreeProcShareKeys::get(Command* c)
@@ -71,6 +80,19 @@ void TreeProcDU::proc(MegaClient*, Node* n)
     }
 }
 
+std::unique_ptr<ParallelTreeProc> TreeProcDU::fork() const
+{
+    return std::unique_ptr<ParallelTreeProc>(new TreeProcDU);
+}
+
+void TreeProcDU::merge(const ParallelTreeProc& other)
+{
+    auto& du = static_cast<const TreeProcDU&>(other);
+    numbytes += du.numbytes;
+    numfiles += du.numfiles;
+    numfolders += du.numfolders;
+}
+
 // mark node as removed and notify
 void TreeProcDel::proc(MegaClient* client, Node* n)
 {
@@ -878,14 +878,18 @@ void UserAlerts::add(UserAlert::Base* unb)
     if (!alerts.empty() && unb->type == UserAlert::type_psts && static_cast<UserAlert::Payment*>(unb)->success)
     {
         // if a successful payment is made then hide/remove any reminders received
-        for (Alerts::iterator i = alerts.begin(); i != alerts.end(); ++i)
+        auto reminders = alertsByType.find(UserAlert::type_pses);
+        if (reminders != alertsByType.end())
         {
-            if ((*i)->type == UserAlert::type_pses && (*i)->relevant)
+            for (UserAlert::Base* reminder : reminders->second)
             {
-                (*i)->relevant = false;
-                if (catchupdone)
+                if (reminder->relevant)
                 {
-                    useralertnotify.push_back(*i);
+                    reminder->relevant = false;
+                    if (catchupdone)
+                    {
+                        useralertnotify.push_back(reminder);
+                    }
                 }
             }
         }
@@ -893,8 +897,17 @@ void UserAlerts::add(UserAlert::Base* unb)
 
     unb->updateEmail(&mc);
     alerts.push_back(unb);
+    alertsByType[unb->type].push_back(unb);
+    int64_t bytes = int64_t(sizeof(UserAlert::Base) + unb->userEmail.capacity());
+    CodeCounter::accountMemory(CodeCounter::MEM_USER_ALERTS, bytes);
+    accountedmemory += bytes;
     LOG_debug << "Added user alert, type " << alerts.back()->type << " ts " << alerts.back()->timestamp;
 
+    while (alerts.size() > MAXALERTS)
+    {
+        dropOldest();
+    }
+
     if (catchupdone)
     {
         unb->tag = 0;
@@ -903,6 +916,39 @@ void UserAlerts::add(UserAlert::Base* unb)
     }
 }
 
+void UserAlerts::dropOldest()
+{
+    UserAlert::Base* oldest = alerts.front();
+    alerts.pop_front();
+
+    auto byType = alertsByType.find(oldest->type);
+    assert(byType != alertsByType.end() && byType->second.front() == oldest);
+    byType->second.pop_front();
+    if (byType->second.empty())
+    {
+        alertsByType.erase(byType);
+    }
+
+    // the app won't hear about it
+    useralertnotify.erase(std::remove(useralertnotify.begin(), useralertnotify.end(), oldest), useralertnotify.end());
+
+    int64_t bytes = std::min(accountedmemory, int64_t(sizeof(UserAlert::Base) + oldest->userEmail.capacity()));
+    CodeCounter::accountMemory(CodeCounter::MEM_USER_ALERTS, -bytes);
+    accountedmemory -= bytes;
+
+    delete oldest;
+}
+
+size_t UserAlerts::trim(size_t keep)
+{
+    int64_t before = accountedmemory;
+    while (alerts.size() > keep)
+    {
+        dropOldest();
+    }
+    return size_t(before - accountedmemory);
+}
+
 void UserAlerts::startprovisional()
 {
     provisionalmode = true;
@@ -1183,6 +1229,9 @@ void UserAlerts::clear()
         delete *i;
     }
     alerts.clear();
+    alertsByType.clear();
+    CodeCounter::accountMemory(CodeCounter::MEM_USER_ALERTS, -accountedmemory);
+    accountedmemory = 0;
     useralertnotify.clear();
     begincatchup = false;
     catchupdone = false;
@@ -26,6 +26,7 @@
 #include "mega/serialize64.h"
 #include "mega/filesystem.h"
 
+#include <cmath>
 #include <iomanip>
 
 #if defined(_WIN32) && defined(_MSC_VER)
@@ -34,6 +35,15 @@
 
 #ifdef __APPLE__
 #include <sys/sysctl.h>
+#include <pthread.h>
+#endif
+
+#if defined(__linux__) || defined(__ANDROID__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #endif
 
 namespace mega {
@@ -41,7 +51,7 @@ namespace mega {
 string toNodeHandle(handle nodeHandle)
 {
     char base64Handle[12];
-    Base64::btoa((byte*)&(nodeHandle), MegaClient::NODEHANDLE, base64Handle);
+    Base64::handletoa((byte*)&(nodeHandle), MegaClient::NODEHANDLE, base64Handle);
     return string(base64Handle);
 }
 
@@ -53,7 +63,7 @@ string toNodeHandle(NodeHandle nodeHandle)
 string toHandle(handle h)
 {
     char base64Handle[14];
-    Base64::btoa((byte*)&(h), sizeof h, base64Handle);
+    Base64::handletoa((byte*)&(h), sizeof h, base64Handle);
     return string(base64Handle);
 }
 
@@ -209,6 +219,25 @@ void CacheableWriter::serializedouble(double field)
     dest.append((char*)&field, sizeof(field));
 }
 
+void CacheableWriter::serializevarint(uint64_t field)
+{
+    char buf[10];
+    size_t n = 0;
+    while (field >= 0x80)
+    {
+        buf[n++] = static_cast<char>(field | 0x80);
+        field >>= 7;
+    }
+    buf[n++] = static_cast<char>(field);
+    dest.append(buf, n);
+}
+
+void CacheableWriter::serializevarbytes(const char* data, size_t len)
+{
+    serializevarint(len);
+    dest.append(data, len);
+}
+
 void CacheableWriter::serializeexpansionflags(bool b0, bool b1, bool b2, bool b3, bool b4, bool b5, bool b6, bool b7)
 {
     unsigned char b[8];
@@ -300,10 +329,34 @@ bool CacheableReader::unserializebinary(byte* data, size_t len)
 }
 
 
+// chunk counts that don't fit the original 16-bit field (files over 64 GB) follow this value as 32 bits
+static const unsigned short CHUNKMACS_LONG_COUNT = 0xFFFF;
+
 void chunkmac_map::serialize(string& d) const
 {
-    unsigned short ll = (unsigned short)size();
+    // the folded chunks are one more entry, at minus their end, with their count as offset
+    size_t entries = size() + (mFoldedCount ? 1 : 0);
+
+    unsigned short ll = entries < CHUNKMACS_LONG_COUNT ? (unsigned short)entries : CHUNKMACS_LONG_COUNT;
     d.append((char*)&ll, sizeof(ll));
+    if (ll == CHUNKMACS_LONG_COUNT)
+    {
+        uint32_t count = uint32_t(entries);
+        d.append((char*)&count, sizeof(count));
+    }
+
+    if (mFoldedCount)
+    {
+        m_off_t pos = -mFoldedEnd;
+        ChunkMAC folded;
+        memcpy(folded.mac, mFoldedMac, sizeof folded.mac);
+        folded.offset = unsigned(mFoldedCount);
+        folded.finished = true;
+
+        d.append((char*)&pos, sizeof(pos));
+        d.append((char*)&folded, sizeof(folded));
+    }
+
     for (const_iterator it = begin(); it != end(); it++)
     {
         d.append((char*)&it->first, sizeof(it->first));
@@ -314,19 +367,49 @@ void chunkmac_map::serialize(string& d) const
 bool chunkmac_map::unserialize(const char*& ptr, const char* end)
 {
     unsigned short ll;
-    if ((ptr + sizeof(ll) > end) || ptr + (ll = MemAccess::get<unsigned short>(ptr)) * (sizeof(m_off_t) + sizeof(ChunkMAC)) + sizeof(ll) > end)
+    if (ptr + sizeof(ll) > end)
+    {
+        return false;
+    }
+
+    ll = MemAccess::get<unsigned short>(ptr);
+    const char* p = ptr + sizeof(ll);
+
+    size_t count = ll;
+    if (ll == CHUNKMACS_LONG_COUNT)
+    {
+        if (p + sizeof(uint32_t) > end)
+        {
+            return false;
+        }
+        count = MemAccess::get<uint32_t>(p);
+        p += sizeof(uint32_t);
+    }
+
+    if (size_t(end - p) / (sizeof(m_off_t) + sizeof(ChunkMAC)) < count)
     {
         return false;
     }
 
-    ptr += sizeof(ll);
+    ptr = p;
 
-    for (int i = 0; i < ll; i++)
+    for (size_t i = 0; i < count; i++)
     {
         m_off_t pos = MemAccess::get<m_off_t>(ptr);
         ptr += sizeof(m_off_t);
 
-        memcpy(&((*this)[pos]), ptr, sizeof(ChunkMAC));
+        if (pos < 0)
+        {
+            ChunkMAC folded;
+            memcpy(&folded, ptr, sizeof(ChunkMAC));
+            memcpy(mFoldedMac, folded.mac, sizeof mFoldedMac);
+            mFoldedEnd = -pos;
+            mFoldedCount = folded.offset;
+        }
+        else
+        {
+            memcpy(&((*this)[pos]), ptr, sizeof(ChunkMAC));
+        }
         ptr += sizeof(ChunkMAC);
     }
     return true;
@@ -334,8 +417,8 @@ bool chunkmac_map::unserialize(const char*& ptr, const char* end)
 
 void chunkmac_map::calcprogress(m_off_t size, m_off_t& chunkpos, m_off_t& progresscompleted, m_off_t* lastblockprogress)
 {
-    chunkpos = 0;
-    progresscompleted = 0;
+    chunkpos = mFoldedEnd;
+    progresscompleted = mFoldedEnd;
 
     for (chunkmac_map::iterator it = begin(); it != end(); ++it)
     {
@@ -364,9 +447,12 @@ void chunkmac_map::calcprogress(m_off_t size, m_off_t& chunkpos, m_off_t& progre
 
 m_off_t chunkmac_map::nextUnprocessedPosFrom(m_off_t pos)
 {
+    pos = std::max(pos, mFoldedEnd);
+
+    // the chunks are consecutive keys: step through them instead of looking each one up
     for (const_iterator it = find(ChunkedHash::chunkfloor(pos));
-        it != end();
-        it = find(ChunkedHash::chunkfloor(pos)))
+        it != end() && it->first == ChunkedHash::chunkfloor(pos);
+        ++it)
     {
         if (it->second.finished)
         {
@@ -383,11 +469,19 @@ m_off_t chunkmac_map::nextUnprocessedPosFrom(m_off_t pos)
 
 m_off_t chunkmac_map::expandUnprocessedPiece(m_off_t pos, m_off_t npos, m_off_t fileSize, m_off_t maxReqSize)
 {
-    for (iterator it = find(npos);
-        npos < fileSize && (npos - pos) <= maxReqSize && (it == end() || (!it->second.finished && !it->second.offset));
-        it = find(npos))
+    for (iterator it = lower_bound(npos);
+        npos < fileSize && (npos - pos) <= maxReqSize;
+        npos = ChunkedHash::chunkceil(npos, fileSize))
     {
-        npos = ChunkedHash::chunkceil(npos, fileSize);
+        while (it != end() && it->first < npos)
+        {
+            ++it;
+        }
+
+        if (it != end() && it->first == npos && (it->second.finished || it->second.offset))
+        {
+            break;
+        }
     }
     return npos;
 }
@@ -397,15 +491,76 @@ void chunkmac_map::finishedUploadChunks(chunkmac_map& macs)
     for (auto& m : macs)
     {
         m.second.finished = true;
+        if (m.first < mFoldedEnd)
+        {
+            continue;
+        }
         (*this)[m.first] = m.second;
         LOG_verbose << "Upload chunk completed: " << m.first;
     }
 }
 
+void chunkmac_map::finishedDownloadPiece(const chunkmac_map& macs)
+{
+    for (auto& m : macs)
+    {
+        if (m.first >= mFoldedEnd)
+        {
+            (*this)[m.first] = m.second;
+        }
+    }
+}
+
+void chunkmac_map::foldFinished(SymmCipher* cipher, m_off_t fileSize)
+{
+    // the MAC of the file takes the chunks in order: only those up to the first gap can be folded
+    for (iterator it = begin(); it != end() && it->first == mFoldedEnd && it->second.finished; it = erase(it))
+    {
+        m_off_t chunkceil = ChunkedHash::chunkceil(it->first);
+        if (chunkceil > fileSize - UNFOLDED_TAIL)
+        {
+            break;
+        }
+
+        SymmCipher::xorblock(it->second.mac, mFoldedMac);
+        cipher->ecb_encrypt(mFoldedMac);
+        mFoldedEnd = chunkceil;
+        mFoldedCount++;
+    }
+}
+
+void chunkmac_map::clear()
+{
+    map::clear();
+    memset(mFoldedMac, 0, sizeof mFoldedMac);
+    mFoldedEnd = 0;
+    mFoldedCount = 0;
+}
+
+void chunkmac_map::swap(chunkmac_map& other)
+{
+    map::swap(other);
+    std::swap(mFoldedMac, other.mFoldedMac);
+    std::swap(mFoldedEnd, other.mFoldedEnd);
+    std::swap(mFoldedCount, other.mFoldedCount);
+}
+
+// the meta MAC from the folded chunk MACs
+static int64_t condensemac(byte* mac)
+{
+    uint32_t* m = (uint32_t*)mac;
+
+    m[0] ^= m[1];
+    m[1] = m[2] ^ m[3];
+
+    return MemAccess::get<int64_t>((const char*)mac);
+}
+
 // coalesce block macs into file mac
 int64_t chunkmac_map::macsmac(SymmCipher *cipher)
 {
-    byte mac[SymmCipher::BLOCKSIZE] = { 0 };
+    byte mac[SymmCipher::BLOCKSIZE];
+    memcpy(mac, mFoldedMac, sizeof mac);
 
     for (chunkmac_map::iterator it = begin(); it != end(); it++)
     {
@@ -415,20 +570,18 @@ int64_t chunkmac_map::macsmac(SymmCipher *cipher)
         cipher->ecb_encrypt(mac);
     }
 
-    uint32_t* m = (uint32_t*)mac;
-
-    m[0] ^= m[1];
-    m[1] = m[2] ^ m[3];
-
     // LOG_debug << "macsmac final: " << Base64Str<sizeof int64_t>(mac);
-    return MemAccess::get<int64_t>((const char*)mac);
+    return condensemac(mac);
 }
 
 int64_t chunkmac_map::macsmac_gaps(SymmCipher *cipher, size_t g1, size_t g2, size_t g3, size_t g4)
 {
-    byte mac[SymmCipher::BLOCKSIZE] = { 0 };
+    assert(g1 >= mFoldedCount && g3 >= mFoldedCount);
+
+    byte mac[SymmCipher::BLOCKSIZE];
+    memcpy(mac, mFoldedMac, sizeof mac);
 
-    int n = 0;
+    size_t n = mFoldedCount;
     for (chunkmac_map::iterator it = begin(); it != end(); it++, n++)
     {
         if ((n >= g1 && n < g2) || (n >= g3 && n < g4)) continue;
@@ -438,12 +591,48 @@ int64_t chunkmac_map::macsmac_gaps(SymmCipher *cipher, size_t g1, size_t g2, siz
         cipher->ecb_encrypt(mac);
     }
 
-    uint32_t* m = (uint32_t*)mac;
+    return condensemac(mac);
+}
 
-    m[0] ^= m[1];
-    m[1] = m[2] ^ m[3];
+chunkmac_map::TailGaps::TailGaps(chunkmac_map& macs, SymmCipher* cipher, size_t from)
+    : mCipher(cipher)
+    , mFrom(std::min(std::max(from, macs.mFoldedCount), macs.chunkCount()))
+{
+    memcpy(mPrefixMac, macs.mFoldedMac, sizeof mPrefixMac);
+    mTailMacs.reserve(macs.chunkCount() - mFrom);
 
-    return MemAccess::get<int64_t>((const char*)mac);
+    size_t n = macs.mFoldedCount;
+    for (auto& it : macs)
+    {
+        if (n++ < mFrom)
+        {
+            SymmCipher::xorblock(it.second.mac, mPrefixMac);
+            mCipher->ecb_encrypt(mPrefixMac);
+        }
+        else
+        {
+            mTailMacs.push_back(it.second.mac);
+        }
+    }
+}
+
+int64_t chunkmac_map::TailGaps::macsmac_gaps(size_t g1, size_t g2, size_t g3, size_t g4)
+{
+    assert(g1 >= mFrom && g3 >= mFrom);
+
+    byte mac[SymmCipher::BLOCKSIZE];
+    memcpy(mac, mPrefixMac, sizeof mac);
+
+    for (size_t i = 0; i < mTailMacs.size(); i++)
+    {
+        size_t n = mFrom + i;
+        if ((n >= g1 && n < g2) || (n >= g3 && n < g4)) continue;
+
+        SymmCipher::xorblock(mTailMacs[i], mac);
+        mCipher->ecb_encrypt(mac);
+    }
+
+    return condensemac(mac);
 }
 
 bool CacheableReader::unserializechunkmacs(chunkmac_map& m)
@@ -495,6 +684,37 @@ bool CacheableReader::unserializeu32(uint32_t& field)
     return true;
 }
 
+bool CacheableReader::unserializevarint(uint64_t& field)
+{
+    uint64_t value = 0;
+    for (unsigned shift = 0; ptr < end && shift < 64; shift += 7)
+    {
+        byte b = static_cast<byte>(*ptr++);
+        value |= uint64_t(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            field = value;
+            fieldnum += 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CacheableReader::unserializevarbytes(const char*& data, size_t& len)
+{
+    uint64_t l;
+    if (!unserializevarint(l) || l > uint64_t(end - ptr))
+    {
+        return false;
+    }
+
+    data = ptr;
+    len = size_t(l);
+    ptr += len;
+    return true;
+}
+
 bool CacheableReader::unserializehandle(handle& field)
 {
     if (ptr + sizeof(handle) > end)
@@ -674,7 +894,7 @@ bool TextChat::serialize(string *d)
 
             ll = (unsigned short)it->second.size(); // number of users with granted access to the node
             d->append((char*)&ll, sizeof ll);
-            for (set<handle>::iterator ituh = it->second.begin(); ituh != it->second.end(); ituh++)
+            for (compact_handle_set::const_iterator ituh = it->second.begin(); ituh != it->second.end(); ituh++)
             {
                 d->append((char*)&(*ituh), sizeof *ituh);   // userhandle
             }
@@ -847,12 +1067,14 @@ TextChat* TextChat::unserialize(class MegaClient *client, string *d)
                 return NULL;
             }
 
+            compact_handle_set& users = attachedNodes[h];
+            users.reserve(numUsers);
             for (int j = 0; j < numUsers; j++)
             {
                 uh = MemAccess::get<handle>(ptr);
                 ptr += sizeof uh;
 
-                attachedNodes[h].insert(uh);
+                users.insert(uh);
             }
         }
     }
@@ -904,7 +1126,7 @@ TextChat* TextChat::unserialize(class MegaClient *client, string *d)
     chat->resetTag();
     chat->ts = ts;
     chat->flags = flags;
-    chat->attachedNodes = attachedNodes;
+    chat->attachedNodes = std::move(attachedNodes);
     chat->publicchat = publicchat;
     chat->unifiedKey = unifiedKey;
     chat->meeting = meetingRoom;
@@ -932,6 +1154,34 @@ void TextChat::resetTag()
     tag = -1;
 }
 
+bool compact_handle_set::insert(handle h)
+{
+    auto it = std::lower_bound(mHandles.begin(), mHandles.end(), h);
+    if (it != mHandles.end() && *it == h)
+    {
+        return false;
+    }
+    mHandles.insert(it, h);
+    return true;
+}
+
+size_t compact_handle_set::erase(handle h)
+{
+    auto it = std::lower_bound(mHandles.begin(), mHandles.end(), h);
+    if (it == mHandles.end() || *it != h)
+    {
+        return 0;
+    }
+    mHandles.erase(it);
+    return 1;
+}
+
+compact_handle_set::const_iterator compact_handle_set::find(handle h) const
+{
+    auto it = std::lower_bound(mHandles.begin(), mHandles.end(), h);
+    return it != mHandles.end() && *it == h ? it : mHandles.end();
+}
+
 bool TextChat::setNodeUserAccess(handle h, handle uh, bool revoke)
 {
     if (revoke)
@@ -1755,6 +2005,51 @@ std::string Utils::hexToString(const std::string &input)
     return output;
 }
 
+bool Utils::isAscii(const char* data, size_t size)
+{
+    // eight bytes at a time, four words per iteration: compilers turn this into vector code
+    const uint64_t high = 0x8080808080808080ull;
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32)
+    {
+        uint64_t w[4];
+        memcpy(w, data + i, sizeof w);
+        if ((w[0] | w[1] | w[2] | w[3]) & high)
+        {
+            return false;
+        }
+    }
+
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, data + i, sizeof w);
+        if (w & high)
+        {
+            return false;
+        }
+    }
+
+    unsigned char bits = 0;
+    for (; i < size; ++i)
+    {
+        bits |= static_cast<unsigned char>(data[i]);
+    }
+    return bits < 0x80;
+}
+
+bool Utils::isAscii(const wchar_t* data, size_t size)
+{
+    // wchar_t may be signed: negative units are not ASCII either
+    uint32_t bits = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        bits |= static_cast<uint32_t>(data[i]);
+    }
+    return bits < 0x80;
+}
+
 int Utils::icasecmp(const std::string& lhs,
                     const std::string& rhs,
                     const size_t length)
@@ -2421,35 +2716,69 @@ std::pair<bool, int64_t> generateMetaMac(SymmCipher &cipher, InputStreamAccess &
     return std::make_pair(true, chunkMacs.macsmac(&cipher));
 }
 
-void MegaClientAsyncQueue::push(std::function<void(SymmCipher&)> f, bool discardable)
+const std::chrono::milliseconds MegaClientAsyncQueue::NOTIFY_INTERVAL(1);
+
+class MegaClientAsyncQueue::WorkerPool
 {
-    if (mThreads.empty())
+public:
+    explicit WorkerPool(unsigned threadCount);
+    ~WorkerPool();
+
+    bool empty() const { return mThreads.empty(); }
+
+    void push(MegaClientAsyncQueue* owner, std::function<void(SymmCipher&)>&& f, bool discardable, Priority priority, uint64_t affinity);
+
+    // returns how many were dropped
+    int64_t clearDiscardable(const MegaClientAsyncQueue* owner);
+
+private:
+    struct Entry
     {
-        if (f)
-        {
-            f(mZeroThreadsCipher);
-        }
-    }
-    else
+        MegaClientAsyncQueue* owner = nullptr;
+        bool discardable = false;
+        std::function<void(SymmCipher&)> f;
+        Entry(MegaClientAsyncQueue* o, bool disc, std::function<void(SymmCipher&)>&& func)
+             : owner(o), discardable(disc), f(func)
+        {}
+    };
+
+    struct Worker
     {
-        {
-            std::lock_guard<std::mutex> g(mMutex);
-            mQueue.emplace_back(discardable, std::move(f));
-        }
-        mConditionVariable.notify_one();
-    }
-}
+        std::mutex mutex;
+        std::deque<Entry> queues[PRIORITIES];
+    };
 
-MegaClientAsyncQueue::MegaClientAsyncQueue(Waiter& w, unsigned threadCount)
-    : mWaiter(w)
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::atomic<unsigned> mNextWorker{0};
+
+    // jobs queued, and workers asleep waiting for one
+    std::atomic<int64_t> mPending{0};
+    std::atomic<unsigned> mIdle{0};
+    bool mExit = false;
+    std::mutex mSleepMutex;
+    std::condition_variable mConditionVariable;
+
+    std::vector<std::thread> mThreads;
+
+    bool take(size_t self, Entry& entry, Priority& priority);
+    void asyncThreadLoop(size_t self);
+};
+
+MegaClientAsyncQueue::WorkerPool::WorkerPool(unsigned threadCount)
 {
-    for (int i = threadCount; i--; )
+    for (unsigned i = threadCount; i--; )
+    {
+        mWorkers.emplace_back(new Worker);
+    }
+
+    for (size_t i = 0; i < mWorkers.size(); ++i)
     {
         try
         {
-            mThreads.emplace_back([this]()
+            mThreads.emplace_back([this, i]()
             {
-                asyncThreadLoop();
+                ThreadRoles::enter(ThreadRoles::WORKER, "mega-worker");
+                asyncThreadLoop(i);
             });
         }
         catch (std::system_error& e)
@@ -2458,13 +2787,19 @@ MegaClientAsyncQueue::MegaClientAsyncQueue(Waiter& w, unsigned threadCount)
             break;
         }
     }
+
+    // jobs are only queued for the workers that run
+    mWorkers.resize(mThreads.size());
     LOG_debug << "MegaClient Worker threads running: " << mThreads.size();
 }
 
-MegaClientAsyncQueue::~MegaClientAsyncQueue()
+MegaClientAsyncQueue::WorkerPool::~WorkerPool()
 {
-    clearDiscardable();
-    push(nullptr, false);
+    {
+        // the workers run what is left before exiting
+        std::lock_guard<std::mutex> g(mSleepMutex);
+        mExit = true;
+    }
     mConditionVariable.notify_all();
     LOG_warn << "~MegaClientAsyncQueue() joining threads";
     for (auto& t : mThreads)
@@ -2474,72 +2809,487 @@ MegaClientAsyncQueue::~MegaClientAsyncQueue()
     LOG_warn << "~MegaClientAsyncQueue() ends";
 }
 
-void MegaClientAsyncQueue::clearDiscardable()
+void MegaClientAsyncQueue::WorkerPool::push(MegaClientAsyncQueue* owner, std::function<void(SymmCipher&)>&& f, bool discardable, Priority priority, uint64_t affinity)
 {
-    std::lock_guard<std::mutex> g(mMutex);
-    auto newEnd = std::remove_if(mQueue.begin(), mQueue.end(), [](Entry& entry){ return entry.discardable; });
-    mQueue.erase(newEnd, mQueue.end());
+    // pointers are aligned, so spread them before picking the worker
+    uint64_t slot = affinity ? (affinity * 0x9E3779B97F4A7C15ull) >> 32 : mNextWorker++;
+    Worker& worker = *mWorkers[size_t(slot % mWorkers.size())];
+    {
+        std::lock_guard<std::mutex> g(worker.mutex);
+        worker.queues[priority].emplace_back(owner, discardable, std::move(f));
+    }
+    owner->mDepth.add(1);
+
+    // pairs with the increment of mIdle before a worker checks mPending: one of them sees the other
+    mPending++;
+    if (mIdle > 0)
+    {
+        std::lock_guard<std::mutex> g(mSleepMutex);
+        mConditionVariable.notify_one();
+    }
 }
 
-void MegaClientAsyncQueue::asyncThreadLoop()
+int64_t MegaClientAsyncQueue::WorkerPool::clearDiscardable(const MegaClientAsyncQueue* owner)
 {
-    SymmCipher cipher;
-    for (;;)
+    int64_t total = 0;
+    for (auto& worker : mWorkers)
     {
-        std::function<void(SymmCipher&)> f;
+        std::lock_guard<std::mutex> g(worker->mutex);
+        for (auto& queue : worker->queues)
         {
-            std::unique_lock<std::mutex> g(mMutex);
-            mConditionVariable.wait(g, [this]() { return !mQueue.empty(); });
-            f = std::move(mQueue.front().f);
-            if (!f) return;   // nullptr is not popped, and causes all the threads to exit
-            mQueue.pop_front();
+            auto newEnd = std::remove_if(queue.begin(), queue.end(), [owner](Entry& entry){ return entry.discardable && entry.owner == owner; });
+            auto removed = int64_t(queue.end() - newEnd);
+            queue.erase(newEnd, queue.end());
+            mPending -= removed;
+            total += removed;
         }
-        f(cipher);
-        mWaiter.notify();
     }
+    return total;
 }
 
-bool islchex(const int c)
-{
-    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
-}
-
-std::string getSafeUrl(const std::string &posturl)
+bool MegaClientAsyncQueue::WorkerPool::take(size_t self, Entry& entry, Priority& priority)
 {
-    string safeurl = posturl;
-    size_t sid = safeurl.find("sid=");
-    if (sid != string::npos)
+    // the most urgent job first: from the front of our own queue, else from the back of another worker's,
+    // which leaves the jobs of that worker's transfers in order
+    for (int p = 0; p < PRIORITIES; ++p)
     {
-        sid += 4;
-        size_t end = safeurl.find("&", sid);
-        if (end == string::npos)
+        for (size_t i = 0; i < mWorkers.size(); ++i)
         {
-            end = safeurl.size();
+            Worker& worker = *mWorkers[(self + i) % mWorkers.size()];
+            std::lock_guard<std::mutex> g(worker.mutex);
+            auto& queue = worker.queues[p];
+            if (!queue.empty())
+            {
+                if (i)
+                {
+                    entry = std::move(queue.back());
+                    queue.pop_back();
+                }
+                else
+                {
+                    entry = std::move(queue.front());
+                    queue.pop_front();
+                }
+                priority = Priority(p);
+                mPending--;
+                entry.owner->mDepth.add(-1);
+                return true;
+            }
         }
-        memset((char *)safeurl.data() + sid, 'X', end - sid);
     }
-    size_t authKey = safeurl.find("n=");
-    if (authKey != string::npos)
+    return false;
+}
+
+void MegaClientAsyncQueue::WorkerPool::asyncThreadLoop(size_t self)
+{
+    SymmCipher cipher;
+    Entry entry(nullptr, false, nullptr);
+    Priority priority;
+    for (;;)
     {
-        authKey += 2/*n=*/ + 8/*public handle*/;
-        size_t end = safeurl.find("&", authKey);
-        if (end == string::npos)
+        if (!take(self, entry, priority))
         {
-            end = safeurl.size();
+            std::unique_lock<std::mutex> g(mSleepMutex);
+            if (mExit && mPending <= 0)
+            {
+                return;
+            }
+
+            mIdle++;
+            mConditionVariable.wait(g, [this]() { return mPending > 0 || mExit; });
+            mIdle--;
+            continue;
         }
-        memset((char *)safeurl.data() + authKey, 'X', end - authKey);
+
+        entry.f(cipher);
+        entry.f = nullptr;
+        entry.owner->completed(priority, mPending > 0);
     }
-    return safeurl;
 }
 
-UploadHandle UploadHandle::next()
+std::shared_ptr<MegaClientAsyncQueue::WorkerPool> MegaClientAsyncQueue::newWorkerPool(unsigned threadCount)
 {
-    do
-    {
-        // Since we start with UNDEF, the first update would overwrite the whole handle and at least 1 byte further, causing data corruption
-        if (h == UNDEF) h = 0;
-
-        byte* ptr = (byte*)(&h + 1);
+    return std::make_shared<WorkerPool>(threadCount);
+}
+
+MegaClientAsyncQueue::MegaClientAsyncQueue(Waiter& w, unsigned threadCount)
+    : MegaClientAsyncQueue(w, newWorkerPool(threadCount))
+{
+}
+
+MegaClientAsyncQueue::MegaClientAsyncQueue(Waiter& w, std::shared_ptr<WorkerPool> pool)
+    : mWaiter(w)
+    , mPool(std::move(pool))
+{
+}
+
+MegaClientAsyncQueue::~MegaClientAsyncQueue()
+{
+    clearDiscardable();
+
+    // the rest runs, as it refers to the client; the pool exits with its last queue
+    std::unique_lock<std::mutex> g(mOutstandingMutex);
+    mOutstandingCondition.wait(g, [this]() { return mOutstanding <= 0; });
+}
+
+void MegaClientAsyncQueue::push(std::function<void(SymmCipher&)> f, bool discardable)
+{
+    push(std::move(f), discardable, PRIORITY_NORMAL);
+}
+
+void MegaClientAsyncQueue::push(std::function<void(SymmCipher&)> f, bool discardable, Priority priority, uint64_t affinity)
+{
+    if (mPool->empty())
+    {
+        if (f)
+        {
+            f(mZeroThreadsCipher);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> g(mOutstandingMutex);
+        mOutstanding++;
+    }
+    mPool->push(this, std::move(f), discardable, priority, affinity);
+}
+
+void MegaClientAsyncQueue::clearDiscardable()
+{
+    discarded(mPool->clearDiscardable(this));
+}
+
+void MegaClientAsyncQueue::completed(Priority priority, bool moreQueued)
+{
+    // completions are batched: the client is woken right away for urgent ones, and else once
+    // the queues run dry or the last notification is NOTIFY_INTERVAL old
+    int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+    int64_t interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(NOTIFY_INTERVAL).count();
+    if (priority == PRIORITY_INTERACTIVE || !moreQueued || now - mLastNotify >= interval)
+    {
+        mLastNotify = now;
+        mWaiter.notify();
+    }
+
+    finished(1);
+}
+
+void MegaClientAsyncQueue::discarded(int64_t count)
+{
+    if (count)
+    {
+        mDepth.add(-count);
+        finished(count);
+    }
+}
+
+void MegaClientAsyncQueue::finished(int64_t count)
+{
+    std::lock_guard<std::mutex> g(mOutstandingMutex);
+    mOutstanding -= count;
+    if (mOutstanding <= 0)
+    {
+        mOutstandingCondition.notify_all();
+    }
+}
+
+void SharedRecursiveMutex::lock()
+{
+    lockUntil(std::chrono::steady_clock::time_point::max());
+}
+
+bool SharedRecursiveMutex::try_lock()
+{
+    return lockUntil(std::chrono::steady_clock::time_point::min());
+}
+
+bool SharedRecursiveMutex::lockUntil(std::chrono::steady_clock::time_point deadline)
+{
+    std::unique_lock<std::mutex> g(mMutex);
+    auto self = std::this_thread::get_id();
+
+    if (mOwnerCount && mOwner == self)
+    {
+        mOwnerCount++;
+        return true;
+    }
+
+    assert(mReaders.find(self) == mReaders.end());
+
+    auto available = [this]() { return !mOwnerCount && mReaders.empty(); };
+    if (!available())
+    {
+        mOwnersWaiting++;
+        bool locked = deadline == std::chrono::steady_clock::time_point::max()
+                    ? (mCondition.wait(g, available), true)
+                    : mCondition.wait_until(g, deadline, available);
+        mOwnersWaiting--;
+
+        if (!locked)
+        {
+            // the readers held back for us can go on
+            mCondition.notify_all();
+            return false;
+        }
+    }
+
+    mOwner = self;
+    mOwnerCount = 1;
+    mOwnerships++;
+    return true;
+}
+
+void SharedRecursiveMutex::unlock()
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    assert(mOwnerCount && mOwner == std::this_thread::get_id());
+
+    if (!--mOwnerCount)
+    {
+        mOwner = std::thread::id();
+        mCondition.notify_all();
+    }
+}
+
+void SharedRecursiveMutex::lock_shared()
+{
+    std::unique_lock<std::mutex> g(mMutex);
+    auto self = std::this_thread::get_id();
+
+    if (mOwnerCount && mOwner == self)
+    {
+        mOwnerCount++;
+        return;
+    }
+
+    auto it = mReaders.find(self);
+    if (it != mReaders.end())
+    {
+        // already a reader: waiting behind an exclusive lock that waits for us would deadlock
+        it->second++;
+        return;
+    }
+
+    mCondition.wait(g, [this]() { return !mOwnerCount && !mOwnersWaiting; });
+    mReaders[self] = 1;
+}
+
+void SharedRecursiveMutex::unlock_shared()
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    auto self = std::this_thread::get_id();
+
+    if (mOwnerCount && mOwner == self)
+    {
+        if (!--mOwnerCount)
+        {
+            mOwner = std::thread::id();
+            mCondition.notify_all();
+        }
+        return;
+    }
+
+    auto it = mReaders.find(self);
+    assert(it != mReaders.end());
+
+    if (!--it->second)
+    {
+        mReaders.erase(it);
+        if (mReaders.empty())
+        {
+            mCondition.notify_all();
+        }
+    }
+}
+
+bool SharedRecursiveMutex::yieldToWriters(unsigned levels)
+{
+    std::unique_lock<std::mutex> g(mMutex);
+    auto self = std::this_thread::get_id();
+
+    if (!mOwnersWaiting)
+    {
+        return false;
+    }
+
+    if (mOwnerCount && mOwner == self)
+    {
+        if (mOwnerCount != levels)
+        {
+            return false;
+        }
+
+        unsigned count = mOwnerCount;
+        uint64_t ownerships = mOwnerships;
+
+        mOwner = std::thread::id();
+        mOwnerCount = 0;
+        mCondition.notify_all();
+
+        // back once one of them has had it (or given up waiting), ahead of the readers
+        mOwnersWaiting++;
+        mCondition.wait(g, [&]() { return !mOwnerCount && mReaders.empty() && (mOwnerships != ownerships || mOwnersWaiting == 1); });
+        mOwnersWaiting--;
+
+        mOwner = self;
+        mOwnerCount = count;
+        mOwnerships++;
+        return true;
+    }
+
+    auto it = mReaders.find(self);
+    if (it == mReaders.end() || it->second != levels)
+    {
+        return false;
+    }
+
+    unsigned count = it->second;
+    mReaders.erase(it);
+    if (mReaders.empty())
+    {
+        mCondition.notify_all();
+    }
+
+    mCondition.wait(g, [this]() { return !mOwnerCount && !mOwnersWaiting; });
+    mReaders[self] = count;
+    return true;
+}
+
+std::mutex ThreadRoles::sMutex;
+ThreadRoles::Settings ThreadRoles::sSettings[ThreadRoles::ROLE_COUNT];
+
+void ThreadRoles::configure(Role role, int priority, uint64_t cpus)
+{
+    std::lock_guard<std::mutex> g(sMutex);
+    sSettings[role].priority = std::max(-20, std::min(19, priority));
+    sSettings[role].cpus = cpus;
+}
+
+void ThreadRoles::enter(Role role, const char* name)
+{
+    Settings settings;
+    {
+        std::lock_guard<std::mutex> g(sMutex);
+        settings = sSettings[role];
+    }
+
+#if defined(__linux__) || defined(__ANDROID__)
+    // 15 characters at most
+    pthread_setname_np(pthread_self(), string(name).substr(0, 15).c_str());
+
+    if (settings.priority)
+    {
+        // the nice value is per thread on Linux
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), settings.priority))
+        {
+            LOG_warn << "Unable to set the priority of " << name << " to " << settings.priority << ": " << errno;
+        }
+    }
+
+    if (settings.cpus)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (unsigned cpu = 0; cpu < 64; ++cpu)
+        {
+            if (settings.cpus >> cpu & 1)
+            {
+                CPU_SET(cpu, &set);
+            }
+        }
+
+        if (sched_setaffinity(0, sizeof set, &set))
+        {
+            LOG_warn << "Unable to set the CPUs of " << name << ": " << errno;
+        }
+    }
+#elif defined(__APPLE__)
+    pthread_setname_np(name);
+
+    if (settings.priority)
+    {
+        qos_class_t qos = settings.priority >= 10 ? QOS_CLASS_BACKGROUND
+                        : settings.priority > 0 ? QOS_CLASS_UTILITY
+                        : QOS_CLASS_USER_INITIATED;
+        pthread_set_qos_class_self_np(qos, 0);
+    }
+
+    if (settings.cpus)
+    {
+        LOG_warn << "The CPUs of a thread can't be chosen on this platform: " << name;
+    }
+#elif defined(_WIN32) && !defined(WINDOWS_PHONE)
+    // SetThreadDescription is only there since Windows 10 1607
+    typedef HRESULT (WINAPI *SetThreadDescriptionFunc)(HANDLE, PCWSTR);
+    static auto setThreadDescription = reinterpret_cast<SetThreadDescriptionFunc>(
+                GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription"));
+    if (setThreadDescription)
+    {
+        std::wstring wname(name, name + strlen(name));
+        setThreadDescription(GetCurrentThread(), wname.c_str());
+    }
+
+    if (settings.priority)
+    {
+        int priority = settings.priority >= 10 ? THREAD_PRIORITY_LOWEST
+                     : settings.priority > 0 ? THREAD_PRIORITY_BELOW_NORMAL
+                     : settings.priority > -10 ? THREAD_PRIORITY_ABOVE_NORMAL
+                     : THREAD_PRIORITY_HIGHEST;
+        SetThreadPriority(GetCurrentThread(), priority);
+    }
+
+    if (settings.cpus && !SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(settings.cpus)))
+    {
+        LOG_warn << "Unable to set the CPUs of " << name << ": " << GetLastError();
+    }
+#else
+    (void)name;
+    (void)settings;
+#endif
+}
+
+bool islchex(const int c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+}
+
+std::string getSafeUrl(const std::string &posturl)
+{
+    string safeurl = posturl;
+    size_t sid = safeurl.find("sid=");
+    if (sid != string::npos)
+    {
+        sid += 4;
+        size_t end = safeurl.find("&", sid);
+        if (end == string::npos)
+        {
+            end = safeurl.size();
+        }
+        memset((char *)safeurl.data() + sid, 'X', end - sid);
+    }
+    size_t authKey = safeurl.find("n=");
+    if (authKey != string::npos)
+    {
+        authKey += 2/*n=*/ + 8/*public handle*/;
+        size_t end = safeurl.find("&", authKey);
+        if (end == string::npos)
+        {
+            end = safeurl.size();
+        }
+        memset((char *)safeurl.data() + authKey, 'X', end - authKey);
+    }
+    return safeurl;
+}
+
+UploadHandle UploadHandle::next()
+{
+    do
+    {
+        // Since we start with UNDEF, the first update would overwrite the whole handle and at least 1 byte further, causing data corruption
+        if (h == UNDEF) h = 0;
+
+        byte* ptr = (byte*)(&h + 1);
 
         while (!++*--ptr);
     }
@@ -2550,5 +3300,410 @@ UploadHandle UploadHandle::next()
     return *this;
 }
 
+namespace CodeCounter
+{
+int Histogram::bucketOf(uint64_t us)
+{
+    if (us < (uint64_t(1) << SUB_BITS))
+    {
+        return int(us);
+    }
+    if (us >= (uint64_t(1) << MAX_BITS))
+    {
+        return BUCKETS - 1;
+    }
+
+    int msb = SUB_BITS;
+    while (us >> (msb + 1))
+    {
+        ++msb;
+    }
+    return ((msb - SUB_BITS + 1) << SUB_BITS) | int((us >> (msb - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+}
+
+uint64_t Histogram::lowerBound(int bucket)
+{
+    if (bucket < (2 << SUB_BITS))
+    {
+        return uint64_t(bucket);
+    }
+    int msb = (bucket >> SUB_BITS) + SUB_BITS - 1;
+    return (uint64_t((1 << SUB_BITS) | (bucket & ((1 << SUB_BITS) - 1)))) << (msb - SUB_BITS);
+}
+
+uint64_t Histogram::count() const
+{
+    uint64_t total = 0;
+    for (auto& b : mBuckets)
+    {
+        total += b.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t Histogram::percentile(double fraction) const
+{
+    uint64_t counts[BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        total += counts[i] = mBuckets[i].load(std::memory_order_relaxed);
+    }
+    if (!total)
+    {
+        return 0;
+    }
+
+    uint64_t target = uint64_t(std::ceil(fraction * double(total)));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS - 1; ++i)
+    {
+        seen += counts[i];
+        if (seen >= target && seen)
+        {
+            return std::min(lowerBound(i + 1) - 1, max());
+        }
+    }
+    return max();
+}
+
+uint64_t Histogram::countUpTo(uint64_t us) const
+{
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKETS - 1 && lowerBound(i + 1) - 1 <= us; ++i)
+    {
+        total += mBuckets[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+string Histogram::toJson() const
+{
+    std::ostringstream json;
+    json << "{\"count\":" << count()
+         << ",\"p50\":" << percentile(0.5)
+         << ",\"p90\":" << percentile(0.9)
+         << ",\"p99\":" << percentile(0.99)
+         << ",\"max\":" << max()
+         << ",\"buckets\":[";
+    bool first = true;
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        if (uint64_t n = mBuckets[i].load(std::memory_order_relaxed))
+        {
+            json << (first ? "" : ",") << "[" << lowerBound(i) << "," << n << "]";
+            first = false;
+        }
+    }
+    json << "]}";
+    return json.str();
+}
+
+void Histogram::reset()
+{
+    for (auto& b : mBuckets)
+    {
+        b.store(0, std::memory_order_relaxed);
+    }
+    mMax.store(0, std::memory_order_relaxed);
+}
+
+string ScopeStats::toJson() const
+{
+    uint64_t started = starts.load(std::memory_order_relaxed);
+    uint64_t finished = finishes.load(std::memory_order_relaxed);
+
+    std::ostringstream json;
+    json << "{\"count\":" << count.load(std::memory_order_relaxed)
+         << ",\"inprogress\":" << (started > finished ? started - finished : 0)
+         << ",\"ms\":" << duration_cast<milliseconds>(high_resolution_clock::duration(timeSpent.load(std::memory_order_relaxed))).count()
+         << ",\"us\":" << durations.toJson() << "}";
+    return json.str();
+}
+
+Gauge memory[MEM_NUM_TAGS];
+
+const char* memoryTagName(MemoryTag tag)
+{
+    switch (tag)
+    {
+        case MEM_NODES: return "nodes";
+        case MEM_LOCALNODES: return "localnodes";
+        case MEM_HTTP_BUFFERS: return "http_buffers";
+        case MEM_RAID_BUFFERS: return "raid_buffers";
+        case MEM_STREAMING_BUFFERS: return "streaming_buffers";
+        case MEM_STREAMING_CACHE: return "streaming_cache";
+        case MEM_FILE_ATTRIBUTES: return "file_attributes";
+        case MEM_USER_ALERTS: return "user_alerts";
+        case MEM_LOG_BUFFERS: return "log_buffers";
+        case MEM_NUM_TAGS: break;
+    }
+    return "unknown";
+}
+
+string Gauge::toJson() const
+{
+    return "{\"value\":" + std::to_string(value.load(std::memory_order_relaxed))
+         + ",\"peak\":" + std::to_string(peak.load(std::memory_order_relaxed)) + "}";
+}
+uint32_t LoopProfiler::Iteration::other() const
+{
+    uint64_t phased = 0;
+    for (uint32_t p : phases)
+    {
+        phased += p;
+    }
+    return phased < total ? uint32_t(total - phased) : 0;
+}
+
+LoopProfiler::LoopProfiler(std::vector<const char*> phaseNames, milliseconds slowThreshold)
+    : mNames(std::move(phaseNames))
+    , mCreated(high_resolution_clock::now())
+    , mSlowThreshold(duration_cast<microseconds>(slowThreshold).count())
+{
+    assert(mNames.size() <= MAX_PHASES);
+    mHistory.reserve(HISTORY);
+}
+
+void LoopProfiler::beginIteration()
+{
+    mIterationStart = mSince = high_resolution_clock::now();
+    mIteration = Iteration();
+    mIteration.started = uint64_t(duration_cast<microseconds>(mIterationStart - mCreated).count());
+    mCurrent = -1;
+    mInIteration = true;
+}
+
+void LoopProfiler::charge(high_resolution_clock::time_point now)
+{
+    if (mCurrent >= 0)
+    {
+        auto us = duration_cast<microseconds>(now - mSince).count();
+        mIteration.phases[mCurrent] += uint32_t(us);
+        mTotals[mCurrent].fetch_add(uint64_t(us), std::memory_order_relaxed);
+    }
+    mSince = now;
+}
+
+bool LoopProfiler::endIteration(Iteration* finished)
+{
+    if (!mInIteration)
+    {
+        return false;
+    }
+
+    auto now = high_resolution_clock::now();
+    charge(now);
+    mInIteration = false;
+    mCurrent = -1;
+
+    auto total = duration_cast<microseconds>(now - mIterationStart).count();
+    mIteration.total = uint32_t(std::min<int64_t>(total, UINT32_MAX));
+    mTotals[MAX_PHASES].fetch_add(mIteration.other(), std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> g(mHistoryMutex);
+        if (mHistory.size() < HISTORY)
+        {
+            mHistory.push_back(mIteration);
+        }
+        else
+        {
+            mHistory[mNext] = mIteration;
+        }
+        mNext = (mNext + 1) % HISTORY;
+    }
+
+    if (finished)
+    {
+        *finished = mIteration;
+    }
+
+    if (total <= mSlowThreshold.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+
+    mSlowIterations.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+LoopProfiler::Phase::Phase(LoopProfiler& profiler, int phase)
+    : mProfiler(profiler)
+    , mPrevious(profiler.mCurrent)
+    , mActive(profiler.mInIteration)
+{
+    assert(phase >= 0 && phase < profiler.phaseCount());
+    if (mActive)
+    {
+        mProfiler.charge(high_resolution_clock::now());
+        mProfiler.mCurrent = phase;
+    }
+}
+
+LoopProfiler::Phase::~Phase()
+{
+    if (mActive && mProfiler.mInIteration)
+    {
+        mProfiler.charge(high_resolution_clock::now());
+        mProfiler.mCurrent = mPrevious;
+    }
+}
+
+void LoopProfiler::setSlowThreshold(milliseconds threshold)
+{
+    mSlowThreshold.store(duration_cast<microseconds>(threshold).count(), std::memory_order_relaxed);
+}
+
+string LoopProfiler::describe(const Iteration& iteration) const
+{
+    std::vector<std::pair<uint32_t, int>> spent;
+    for (int p = 0; p < phaseCount(); p++)
+    {
+        spent.emplace_back(iteration.phases[p], p);
+    }
+    spent.emplace_back(iteration.other(), int(MAX_PHASES));
+    std::sort(spent.begin(), spent.end(), [](const std::pair<uint32_t, int>& a, const std::pair<uint32_t, int>& b)
+    {
+        return a.first > b.first;
+    });
+
+    std::ostringstream s;
+    s << iteration.total / 1000 << " ms:";
+    const char* separator = " ";
+    for (auto& p : spent)
+    {
+        if (p.first)
+        {
+            s << separator << phaseName(p.second) << " " << p.first / 1000.0 << " ms";
+            separator = ", ";
+        }
+    }
+    return s.str();
+}
+
+string LoopProfiler::toJson() const
+{
+    std::ostringstream json;
+    json << "{\"slowthresholdms\":" << mSlowThreshold.load(std::memory_order_relaxed) / 1000
+         << ",\"slowiterations\":" << slowIterations()
+         << ",\"totals\":{";
+    for (int p = 0; p <= phaseCount(); p++)
+    {
+        int phase = p < phaseCount() ? p : int(MAX_PHASES);
+        json << (p ? "," : "") << "\"" << phaseName(phase) << "\":" << totalMicroseconds(phase);
+    }
+    json << "},\"last\":[";
+
+    std::vector<Iteration> history;
+    size_t next;
+    {
+        std::lock_guard<std::mutex> g(mHistoryMutex);
+        history = mHistory;
+        next = mNext;
+    }
+
+    for (size_t i = 0; i < history.size(); i++)
+    {
+        const Iteration& it = history[history.size() < HISTORY ? i : (next + i) % HISTORY];
+        json << (i ? "," : "") << "{\"started\":" << it.started << ",\"total\":" << it.total;
+        for (int p = 0; p < phaseCount(); p++)
+        {
+            json << ",\"" << phaseName(p) << "\":" << it.phases[p];
+        }
+        json << ",\"other\":" << it.other() << "}";
+    }
+    json << "]}";
+    return json.str();
+}
+
+StartupProfile::StartupProfile()
+    : mOrigin(high_resolution_clock::now())
+{
+}
+
+void StartupProfile::setOrigin(high_resolution_clock::time_point origin)
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    mOrigin = origin;
+}
+
+void StartupProfile::record(Phase phase, high_resolution_clock::time_point begin, high_resolution_clock::time_point end)
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    Timing& timing = mTimings[phase];
+    if (!timing.ended)
+    {
+        timing.begin = begin;
+        timing.end = end;
+        timing.began = timing.ended = true;
+    }
+}
+
+void StartupProfile::begin(Phase phase)
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    Timing& timing = mTimings[phase];
+    if (!timing.began)
+    {
+        timing.begin = high_resolution_clock::now();
+        timing.began = true;
+    }
+}
+
+void StartupProfile::end(Phase phase)
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    Timing& timing = mTimings[phase];
+    if (timing.began && !timing.ended)
+    {
+        timing.end = high_resolution_clock::now();
+        timing.ended = true;
+    }
+}
+
+StartupProfile::Scope::Scope(StartupProfile& profile, Phase phase)
+    : mProfile(profile)
+    , mPhase(phase)
+    , mBegin(high_resolution_clock::now())
+{
+}
+
+StartupProfile::Scope::~Scope()
+{
+    mProfile.record(mPhase, mBegin, high_resolution_clock::now());
+}
+
+const char* StartupProfile::phaseName(int phase)
+{
+    static const char* const names[PHASES] = { "api_init", "gfx_init", "client_init", "db_open", "fetchsc", "userdata",
+                                               "sync_resume", "fetchnodes" };
+    return phase >= 0 && phase < PHASES ? names[phase] : "";
+}
+
+string StartupProfile::toJson() const
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    auto ms = [](high_resolution_clock::duration d) { return duration_cast<microseconds>(d).count() / 1000.0; };
+
+    std::ostringstream json;
+    json << '{';
+    const char* separator = "";
+    for (int p = 0; p < PHASES; p++)
+    {
+        const Timing& timing = mTimings[p];
+        if (timing.ended)
+        {
+            json << separator << "\"" << phaseName(p) << "\":{\"startms\":" << ms(timing.begin - mOrigin)
+                 << ",\"ms\":" << ms(timing.end - timing.begin) << '}';
+            separator = ",";
+        }
+    }
+    json << '}';
+    return json.str();
+}
+
+} // namespace CodeCounter
+
 } // namespace
 
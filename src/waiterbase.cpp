@@ -22,6 +22,14 @@
 #include "mega/waiter.h"
 
 namespace mega {
+bool Waiter::manualclock = false;
+
+void Waiter::advanceds(dstime delta)
+{
+    assert(manualclock);
+    ds += delta;
+}
+
 void Waiter::init(dstime ds)
 {
     maxds = ds;
@@ -28,6 +28,7 @@
 #if defined(_WIN32) || defined(WINDOWS_PHONE)
 #include <winsock2.h>
 #include <Windows.h>
+#include <winioctl.h>
 #endif
 
 namespace mega {
@@ -200,6 +201,21 @@ bool WinFileAccess::ftruncate()
     return false;
 }
 
+bool WinFileAccess::fpreallocate(m_off_t size)
+{
+    // the allocation size doesn't move the end of the file
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = size;
+
+    if (SetFileInformationByHandle(hFile, FileAllocationInfo, &info, sizeof(info)))
+    {
+        return true;
+    }
+
+    retry = WinFileSystemAccess::istransient(GetLastError());
+    return false;
+}
+
 m_time_t FileTime_to_POSIX(FILETIME* ft)
 {
     LARGE_INTEGER date;
@@ -1381,8 +1397,30 @@ void WinDirNotify::process(DWORD dwBytes)
         int errCount = ++mErrorCount;
         LOG_err << "Empty filesystem notification: " << (localrootnode ? localrootnode->name.c_str() : "NULL")
                 << " errors: " << errCount;
+
+        LONGLONG lostFrom = mReadIssuedUsn;
         readchanges();
-        notify(DIREVENTS, localrootnode, LocalPath());
+
+        // the folders changed meanwhile, if the change journal tells them, otherwise the whole sync
+        vector<LocalPath> folders;
+        if (mJournal && mJournal->changes(lostFrom, folders))
+        {
+            LOG_debug << "Lost notifications recovered from the change journal: " << folders.size() << " folders";
+            for (LocalPath& folder : folders)
+            {
+                const std::wstring& path = folder.localpath;
+                if (ignore.localpath.empty()
+                        || path.compare(0, ignore.localpath.size(), ignore.localpath)
+                        || (path.size() > ignore.localpath.size() && path[ignore.localpath.size()] != L'\\'))
+                {
+                    notify(DIREVENTS, localrootnode, std::move(folder));
+                }
+            }
+        }
+        else
+        {
+            notify(DIREVENTS, localrootnode, LocalPath());
+        }
 #endif
     }
     else
@@ -1484,6 +1522,13 @@ void WinDirNotify::readchanges()
         // monitoring a directory over the network. This is due to a packet size limitation with the underlying file sharing protocols.
         notifybuf.resize(65534);
     }
+
+    if (mJournal && !mJournal->position(mReadIssuedUsn))
+    {
+        LOG_warn << "Change journal no longer usable for " << (localrootnode ? localrootnode->name.c_str() : "NULL");
+        mJournal.reset();
+    }
+
     auto readRet = ReadDirectoryChangesW(hDirectory, (LPVOID)notifybuf.data(),
                               (DWORD)notifybuf.size(), TRUE,
                               FILE_NOTIFY_CHANGE_FILE_NAME
@@ -1518,6 +1563,185 @@ void WinDirNotify::readchanges()
 #endif
 }
 
+namespace {
+
+// the path of an open file, with the form the change journal paths are compared in
+std::wstring finalpath(HANDLE h)
+{
+    std::wstring path(MAX_PATH, L'\0');
+    for (;;)
+    {
+        DWORD length = GetFinalPathNameByHandleW(h, const_cast<wchar_t*>(path.data()), DWORD(path.size()), FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+        if (!length)
+        {
+            return std::wstring();
+        }
+        if (length < path.size())
+        {
+            path.resize(length);
+            return path;
+        }
+        path.resize(length);
+    }
+}
+
+} // namespace
+
+WinUsnJournal::WinUsnJournal(const std::wstring& root)
+{
+    // drive letters only: "\\?\C:\" -> "\\.\C:"
+    wchar_t volume[MAX_PATH + 1];
+    if (!GetVolumePathNameW(root.c_str(), volume, MAX_PATH + 1))
+    {
+        return;
+    }
+    std::wstring drive(volume);
+    if (!drive.compare(0, 4, L"\\\\?\\"))
+    {
+        drive.erase(0, 4);
+    }
+    if (drive.size() != 3 || drive[1] != L':')
+    {
+        return;
+    }
+
+    hVolume = CreateFileW((L"\\\\.\\" + drive.substr(0, 2)).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                          NULL, OPEN_EXISTING, 0, NULL);
+    if (hVolume == INVALID_HANDLE_VALUE)
+    {
+        LOG_debug << "Change journal not available for " << char(drive[0]) << ": " << GetLastError();
+        return;
+    }
+
+    HANDLE h = CreateFileW(root.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (h != INVALID_HANDLE_VALUE)
+    {
+        mRoot = finalpath(h);
+        CloseHandle(h);
+    }
+
+    LONGLONG usn;
+    if (mRoot.empty() || !position(usn))
+    {
+        CloseHandle(hVolume);
+        hVolume = INVALID_HANDLE_VALUE;
+    }
+}
+
+WinUsnJournal::~WinUsnJournal()
+{
+    if (hVolume != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hVolume);
+    }
+}
+
+bool WinUsnJournal::position(LONGLONG& usn)
+{
+    USN_JOURNAL_DATA_V0 data;
+    DWORD bytes;
+    if (!DeviceIoControl(hVolume, FSCTL_QUERY_USN_JOURNAL, NULL, 0, &data, sizeof data, &bytes, NULL))
+    {
+        return false;
+    }
+
+    if (mJournalId && mJournalId != data.UsnJournalID)
+    {
+        return false;
+    }
+
+    mJournalId = data.UsnJournalID;
+    usn = data.NextUsn;
+    return true;
+}
+
+bool WinUsnJournal::changes(LONGLONG from, vector<LocalPath>& folders)
+{
+    // up to now only: a busy volume would keep it reading
+    LONGLONG until;
+    if (!position(until))
+    {
+        return false;
+    }
+
+    READ_USN_JOURNAL_DATA_V0 read = {};
+    read.StartUsn = from;
+    read.ReasonMask = 0xFFFFFFFF;
+    read.UsnJournalID = mJournalId;
+
+    // a change is seen through the folder that holds the item
+    std::set<DWORDLONG> parents;
+    vector<LONGLONG> buffer(BUFFER_SIZE / sizeof(LONGLONG));
+    while (read.StartUsn < until)
+    {
+        DWORD bytes;
+        if (!DeviceIoControl(hVolume, FSCTL_READ_USN_JOURNAL, &read, sizeof read, buffer.data(), DWORD(buffer.size() * sizeof(LONGLONG)), &bytes, NULL))
+        {
+            // ERROR_JOURNAL_ENTRY_DELETED: the journal has wrapped since
+            LOG_warn << "Unable to read the change journal: " << GetLastError();
+            return false;
+        }
+
+        if (bytes <= sizeof(USN))
+        {
+            break;
+        }
+
+        const char* entry = reinterpret_cast<const char*>(buffer.data()) + sizeof(USN);
+        const char* end = reinterpret_cast<const char*>(buffer.data()) + bytes;
+        while (entry < end)
+        {
+            const USN_RECORD_V2* record = reinterpret_cast<const USN_RECORD_V2*>(entry);
+            if (record->MajorVersion != 2)
+            {
+                // 128-bit file ids (ReFS), not handled
+                return false;
+            }
+            parents.insert(record->ParentFileReferenceNumber);
+            entry += record->RecordLength;
+        }
+
+        if (parents.size() > MAX_FOLDERS)
+        {
+            return false;
+        }
+
+        read.StartUsn = *reinterpret_cast<USN*>(buffer.data());
+    }
+
+    for (DWORDLONG parent : parents)
+    {
+        FILE_ID_DESCRIPTOR descriptor = {};
+        descriptor.dwSize = sizeof descriptor;
+        descriptor.Type = FileIdType;
+        descriptor.FileId.QuadPart = LONGLONG(parent);
+
+        HANDLE h = OpenFileById(hVolume, &descriptor, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL, FILE_FLAG_BACKUP_SEMANTICS);
+        if (h == INVALID_HANDLE_VALUE)
+        {
+            // removed since: its own parent has a record too
+            continue;
+        }
+        std::wstring path = finalpath(h);
+        CloseHandle(h);
+
+        if (path.size() >= mRoot.size() && !path.compare(0, mRoot.size(), mRoot))
+        {
+            if (path.size() == mRoot.size())
+            {
+                folders.emplace_back();
+            }
+            else if (path[mRoot.size()] == L'\\')
+            {
+                folders.push_back(LocalPath::fromPlatformEncoded(path.substr(mRoot.size() + 1)));
+            }
+        }
+    }
+    return true;
+}
+
 std::mutex WinDirNotify::smNotifyMutex;
 std::atomic<unsigned> WinDirNotify::smNotifierCount{0};
 HANDLE WinDirNotify::smEventHandle = NULL;
@@ -1609,6 +1833,12 @@ WinDirNotify::WinDirNotify(const LocalPath& localbasepathParam, const LocalPath&
     {
         setFailed(0, "");
 
+        mJournal.reset(new WinUsnJournal(longname));
+        if (!mJournal->valid())
+        {
+            mJournal.reset();
+        }
+
         {
             std::lock_guard<std::mutex> g(smNotifyMutex);
             smQueue.push_back([this](){ readchanges(); });
@@ -1723,6 +1953,23 @@ bool WinFileSystemAccess::getlocalfstype(const LocalPath& path, FileSystemType&
     return type = FS_UNKNOWN, false;
 }
 
+bool WinFileSystemAccess::getdeviceid(const LocalPath& path, uint64_t& id) const
+{
+    std::wstring mountPoint(MAX_PATH + 1, L'\0');
+    DWORD serialNumber = 0;
+
+    if (!GetVolumePathNameW(path.localpath.c_str(),
+                            const_cast<wchar_t*>(mountPoint.data()),
+                            MAX_PATH + 1)
+        || !GetVolumeInformationW(mountPoint.c_str(), nullptr, 0, &serialNumber, nullptr, nullptr, nullptr, 0))
+    {
+        return false;
+    }
+
+    id = serialNumber;
+    return true;
+}
+
 DirAccess* WinFileSystemAccess::newdiraccess()
 {
     return new WinDirAccess();
@@ -1805,6 +2052,14 @@ bool WinDirAccess::dopen(LocalPath* nameArg, FileAccess* f, bool glob)
     }
     else
     {
+#ifndef WINDOWS_PHONE
+        if (!glob && bulkopen(nameArg->localpath))
+        {
+            ffdvalid = true;
+            return true;
+        }
+#endif
+
         std::wstring name = nameArg->localpath;
         if (!glob)
         {
@@ -1874,17 +2129,107 @@ bool WinDirAccess::dnext(LocalPath& /*path*/, LocalPath& nameArg, bool /*follows
             }
         }
 
-        if (!(ffdvalid = FindNextFileW(hFind, &ffd) != 0))
+#ifndef WINDOWS_PHONE
+        if (hDirectory != INVALID_HANDLE_VALUE)
+        {
+            ffdvalid = bulknext();
+        }
+        else
+#endif
+        {
+            ffdvalid = FindNextFileW(hFind, &ffd) != 0;
+        }
+
+        if (!ffdvalid)
         {
             return false;
         }
     }
 }
 
+#ifndef WINDOWS_PHONE
+bool WinDirAccess::bulkopen(const std::wstring& name)
+{
+    hDirectory = CreateFileW(name.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (hDirectory == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    bulkbuffer.resize(BULK_BUFFER_SIZE / sizeof(LONGLONG));
+    bulkentry = nullptr;
+
+    // a directory lists "." at least: failing here means the filesystem doesn't support it, FindFirstFileW() does
+    if (!bulknext())
+    {
+        CloseHandle(hDirectory);
+        hDirectory = INVALID_HANDLE_VALUE;
+        return false;
+    }
+    return true;
+}
+
+// fills ffd with the next entry, like FindNextFileW(), reading another buffer of them when this one is done
+bool WinDirAccess::bulknext()
+{
+    if (bulkentry && bulkentry->NextEntryOffset)
+    {
+        bulkentry = reinterpret_cast<FILE_ID_BOTH_DIR_INFO*>(reinterpret_cast<char*>(bulkentry) + bulkentry->NextEntryOffset);
+    }
+    else if (GetFileInformationByHandleEx(hDirectory, FileIdBothDirectoryInfo, bulkbuffer.data(), DWORD(bulkbuffer.size() * sizeof(LONGLONG))))
+    {
+        bulkentry = reinterpret_cast<FILE_ID_BOTH_DIR_INFO*>(bulkbuffer.data());
+    }
+    else
+    {
+        bulkentry = nullptr;
+        return false;
+    }
+
+    const FILE_ID_BOTH_DIR_INFO& entry = *bulkentry;
+
+    ffd.dwFileAttributes = entry.FileAttributes;
+    ffd.ftCreationTime.dwLowDateTime = entry.CreationTime.LowPart;
+    ffd.ftCreationTime.dwHighDateTime = DWORD(entry.CreationTime.HighPart);
+    ffd.ftLastAccessTime.dwLowDateTime = entry.LastAccessTime.LowPart;
+    ffd.ftLastAccessTime.dwHighDateTime = DWORD(entry.LastAccessTime.HighPart);
+    ffd.ftLastWriteTime.dwLowDateTime = entry.LastWriteTime.LowPart;
+    ffd.ftLastWriteTime.dwHighDateTime = DWORD(entry.LastWriteTime.HighPart);
+    ffd.nFileSizeHigh = DWORD(entry.EndOfFile.HighPart);
+    ffd.nFileSizeLow = entry.EndOfFile.LowPart;
+
+    // as FindFirstFileW() reports it: the reparse tag comes where the EA size would be
+    ffd.dwReserved0 = (entry.FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ? entry.EaSize : 0;
+    ffd.dwReserved1 = 0;
+
+    size_t length = entry.FileNameLength / sizeof(WCHAR);
+    if (length > MAX_PATH - 1)
+    {
+        length = MAX_PATH - 1;
+    }
+    wmemcpy(ffd.cFileName, entry.FileName, length);
+    ffd.cFileName[length] = 0;
+
+    length = entry.ShortNameLength / sizeof(WCHAR);
+    if (length > sizeof ffd.cAlternateFileName / sizeof(WCHAR) - 1)
+    {
+        length = sizeof ffd.cAlternateFileName / sizeof(WCHAR) - 1;
+    }
+    wmemcpy(ffd.cAlternateFileName, entry.ShortName, length);
+    ffd.cAlternateFileName[length] = 0;
+
+    return true;
+}
+#endif
+
 WinDirAccess::WinDirAccess()
 {
     ffdvalid = false;
     hFind = INVALID_HANDLE_VALUE;
+#ifndef WINDOWS_PHONE
+    hDirectory = INVALID_HANDLE_VALUE;
+#endif
 }
 
 WinDirAccess::~WinDirAccess()
@@ -1893,6 +2238,12 @@ WinDirAccess::~WinDirAccess()
     {
         FindClose(hFind);
     }
+#ifndef WINDOWS_PHONE
+    if (hDirectory != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hDirectory);
+    }
+#endif
 }
 
 bool isReservedName(const string& name, nodetype_t type)
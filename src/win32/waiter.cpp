@@ -44,6 +44,11 @@ WinWaiter::~WinWaiter()
 // FIXME: restore thread safety for applications using multiple MegaClient objects
 void Waiter::bumpds()
 {
+    if (manualclock)
+    {
+        return;
+    }
+
 	ds = dstime(GetTickCount64() / 100);
 }
 
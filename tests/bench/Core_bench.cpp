@@ -0,0 +1,588 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <mega.h>
+#include <mega/base64.h>
+#include <mega/filefingerprint.h>
+#include <mega/json.h>
+#include <mega/raid.h>
+#include <mega/testhooks.h>
+
+#include "bench.h"
+
+using mt::bench::doNotOptimize;
+
+namespace {
+
+using mega::RAIDPARTS;
+using mega::RAIDSECTOR;
+using mega::RAIDLINE;
+
+// the same bytes on every run, so that results can be compared across builds
+std::string syntheticData(size_t size)
+{
+    std::string data(size, '\0');
+    unsigned x = 12345;
+    for (char& c : data)
+    {
+        x = x * 1103515245 + 12345;
+        c = static_cast<char>(x >> 16);
+    }
+    return data;
+}
+
+// a fetchnodes response of the given number of nodes, shaped like the real ones
+std::string fetchnodesResponse(size_t nodes)
+{
+    std::string json = R"([{"f":[)";
+    for (size_t i = 0; i < nodes; ++i)
+    {
+        mega::handle h = i * 2654435761u;
+        std::string handle = mega::Base64Str<6>(reinterpret_cast<const mega::byte*>(&h)).chars;
+        json.append(i ? "," : "");
+        json.append(R"({"h":")" + handle + R"(","p":"AAAAAAAA","u":"AAAAAAAAAAA","t":0,"a":")" + std::string(96, 'a')
+                    + R"(","k":"AAAAAAAAAAA:)" + std::string(43, 'k') + R"(","s":)" + std::to_string(i * 977)
+                    + R"(,"fa":"123:0*AAAAAAAAAAA/456:1*AAAAAAAAAAA","ts":1600000000})");
+    }
+    json.append(R"(],"sn":"AAAAAAAAAAA"}])");
+    return json;
+}
+
+// a stream over a buffer, as FileFingerprint reads uploads from apps
+class BufferInputStream : public mega::InputStreamAccess
+{
+public:
+    explicit BufferInputStream(const std::string& data)
+      : mData(data)
+    {
+    }
+
+    m_off_t size() override
+    {
+        return m_off_t(mData.size());
+    }
+
+    bool read(mega::byte* buffer, unsigned size) override
+    {
+        if (mPos + size > mData.size())
+        {
+            return false;
+        }
+        if (buffer)
+        {
+            memcpy(buffer, mData.data() + mPos, size);
+        }
+        mPos += size;
+        return true;
+    }
+
+private:
+    const std::string& mData;
+    size_t mPos = 0;
+};
+
+// combines the parts without decryption, cutting the output at chunk boundaries as a transfer does
+class PlainRaidBufferManager : public mega::RaidBufferManager
+{
+    void finalize(FilePiece&) override { }
+    m_off_t calcOutputChunkPos(m_off_t acquiredpos) override { return mega::ChunkedHash::chunkfloor(acquiredpos); }
+};
+
+struct HttpIo : mega::HttpIO
+{
+    void addevents(mega::Waiter*, int) override {}
+    void post(struct mega::HttpReq*, const char* = NULL, unsigned = 0) override {}
+    void cancel(mega::HttpReq*) override {}
+    m_off_t postpos(void*) override { return {}; }
+    bool doio(void) override { return {}; }
+    void setuseragent(std::string*) override {}
+};
+
+} // namespace
+
+MEGA_BENCHMARK(JSON_fetchnodes)
+{
+    const std::string response = fetchnodesResponse(10000);
+    std::string attrs;
+
+    while (state.keepRunning())
+    {
+        // as MegaClient::readnodes() walks the nodes
+        mega::JSON json(response);
+        m_off_t sum = 0;
+        json.enterarray();
+        json.enterobject();
+        json.getnameid();
+        json.enterarray();
+        while (json.enterobject())
+        {
+            for (mega::nameid name; (name = json.getnameid()) != EOO; )
+            {
+                switch (name)
+                {
+                    case 'h':
+                    case 'p':
+                        json.gethandle(6);
+                        break;
+                    case 'u':
+                        json.gethandle(8);
+                        break;
+                    case 's':
+                        sum += json.getint();
+                        break;
+                    case 'a':
+                        json.storeobject(&attrs);
+                        break;
+                    default:
+                        json.storeobject();
+                }
+            }
+            json.leaveobject();
+        }
+        doNotOptimize(sum);
+    }
+    state.setBytesProcessed(response.size());
+    state.setItemsProcessed(10000);
+}
+
+namespace {
+
+// the strings of a fetchnodes response found with the scanner given
+void scanJsonStrings(mt::bench::State& state, mega::JSONStringScanner::Function end)
+{
+    const std::string response = fetchnodesResponse(10000);
+
+    // where the strings start, so only the scanning is timed
+    std::vector<const char*> strings;
+    for (const char* ptr = response.data(); (ptr = strchr(ptr, '"')); ptr++)
+    {
+        strings.push_back(ptr + 1);
+        ptr = mega::JSONStringScanner::end(ptr + 1);
+    }
+
+    size_t bytes = 0;
+    while (state.keepRunning())
+    {
+        bytes = 0;
+        for (const char* ptr : strings)
+        {
+            bytes += size_t(end(ptr) - ptr);
+        }
+        doNotOptimize(bytes);
+    }
+    state.setBytesProcessed(bytes);
+    state.setItemsProcessed(strings.size());
+}
+
+} // namespace
+
+MEGA_BENCHMARK(JSONStringScanner_scalar)
+{
+    scanJsonStrings(state, mega::JSONStringScanner::implementations().front().second);
+}
+
+MEGA_BENCHMARK(JSONStringScanner_default)
+{
+    scanJsonStrings(state, mega::JSONStringScanner::end);
+}
+
+MEGA_BENCHMARK(Base64_btoa)
+{
+    const std::string data = syntheticData(1 << 20);
+    std::string encoded;
+
+    while (state.keepRunning())
+    {
+        encoded.clear();
+        mega::Base64::btoa(data, encoded);
+        doNotOptimize(encoded);
+    }
+    state.setBytesProcessed(data.size());
+}
+
+MEGA_BENCHMARK(Base64_atob)
+{
+    const std::string encoded = mega::Base64::btoa(syntheticData(1 << 20));
+    std::string data;
+
+    while (state.keepRunning())
+    {
+        data.clear();
+        mega::Base64::atob(encoded, data);
+        doNotOptimize(data);
+    }
+    state.setBytesProcessed(encoded.size());
+}
+
+MEGA_BENCHMARK(SymmCipher_ctr_crypt)
+{
+    std::string data = syntheticData(1 << 20);
+    mega::SymmCipher cipher;
+    mega::byte key[mega::SymmCipher::KEYLENGTH] = { 1, 2, 3 };
+    cipher.setkey(key);
+    mega::byte mac[mega::SymmCipher::BLOCKSIZE];
+
+    while (state.keepRunning())
+    {
+        // a chunk of a download: decryption and its chunk MAC
+        cipher.ctr_crypt(reinterpret_cast<mega::byte*>(&data[0]), unsigned(data.size()), 0, 0x1234, mac, false);
+        doNotOptimize(mac);
+    }
+    state.setBytesProcessed(data.size());
+}
+
+MEGA_BENCHMARK(RaidBufferManager_combineRaidParts)
+{
+    const std::string data = syntheticData((4 << 20) / RAIDLINE * RAIDLINE);
+    const m_off_t size = m_off_t(data.size());
+    const size_t lines = data.size() / RAIDLINE;
+
+    // the six parts, parity first
+    std::vector<std::string> parts(RAIDPARTS, std::string(lines * RAIDSECTOR, '\0'));
+    for (size_t i = 0; i < lines; ++i)
+    {
+        for (unsigned j = 1; j < RAIDPARTS; ++j)
+        {
+            for (unsigned k = 0; k < RAIDSECTOR; ++k)
+            {
+                char c = data[i * RAIDLINE + (j - 1) * RAIDSECTOR + k];
+                parts[j][i * RAIDSECTOR + k] = c;
+                parts[0][i * RAIDSECTOR + k] ^= c;
+            }
+        }
+    }
+
+    const size_t pieceSize = 128 << 10;
+
+    while (state.keepRunning())
+    {
+        PlainRaidBufferManager manager;
+        manager.setIsRaid(std::vector<std::string>(RAIDPARTS, "http://127.0.0.1/x"), 0, size, size, 1 << 20);
+
+        for (size_t offset = 0; offset < parts[0].size(); offset += pieceSize)
+        {
+            size_t n = std::min(pieceSize, parts[0].size() - offset);
+            for (unsigned j = 0; j < RAIDPARTS; ++j)
+            {
+                auto piece = new mega::RaidBufferManager::FilePiece(m_off_t(offset), n);
+                memcpy(piece->buf.datastart(), parts[j].data() + offset, n);
+                manager.submitBuffer(j, piece);
+
+                while (auto out = manager.getAsyncOutputBufferPointer(j))
+                {
+                    doNotOptimize(out->buf.datastart());
+                    manager.bufferWriteCompleted(j, true);
+                }
+            }
+        }
+
+        while (auto out = manager.getAsyncOutputBufferPointer(0))
+        {
+            doNotOptimize(out->buf.datastart());
+            manager.bufferWriteCompleted(0, true);
+        }
+    }
+    state.setBytesProcessed(data.size());
+}
+
+namespace {
+
+// the lines of the raid parts combined, with all parts or with the one missing rebuilt from parity
+void combineRaidLines(mt::bench::State& state, mega::RaidLineCombiner::Function combine, unsigned missing)
+{
+    const size_t lines = (8 << 20) / RAIDLINE;
+    const std::string data = syntheticData(lines * RAIDLINE);
+
+    std::vector<std::string> parts(RAIDPARTS, std::string(lines * RAIDSECTOR, '\0'));
+    for (size_t i = 0; i < lines; ++i)
+    {
+        for (unsigned j = 1; j < RAIDPARTS; ++j)
+        {
+            for (unsigned k = 0; k < RAIDSECTOR; ++k)
+            {
+                char c = data[i * RAIDLINE + (j - 1) * RAIDSECTOR + k];
+                parts[j][i * RAIDSECTOR + k] = c;
+                parts[0][i * RAIDSECTOR + k] ^= c;
+            }
+        }
+    }
+
+    const mega::byte* inputs[RAIDPARTS];
+    for (unsigned j = 0; j < RAIDPARTS; ++j)
+    {
+        inputs[j] = j == missing && missing ? nullptr : reinterpret_cast<const mega::byte*>(parts[j].data());
+    }
+
+    std::string out(data.size(), '\0');
+    while (state.keepRunning())
+    {
+        combine(reinterpret_cast<mega::byte*>(&out[0]), inputs, lines);
+        doNotOptimize(out);
+    }
+    state.setBytesProcessed(out.size());
+}
+
+} // namespace
+
+MEGA_BENCHMARK(RaidLineCombiner_scalar)
+{
+    combineRaidLines(state, mega::RaidLineCombiner::implementations().front().second, 0);
+}
+
+MEGA_BENCHMARK(RaidLineCombiner_default)
+{
+    combineRaidLines(state, mega::RaidLineCombiner::combine, 0);
+}
+
+MEGA_BENCHMARK(RaidLineCombiner_default_recover)
+{
+    combineRaidLines(state, mega::RaidLineCombiner::combine, 3);
+}
+
+MEGA_BENCHMARK(FileFingerprint_genfingerprint_small)
+{
+    const std::string data = syntheticData(8000);
+
+    while (state.keepRunning())
+    {
+        BufferInputStream is(data);
+        mega::FileFingerprint ffp;
+        ffp.genfingerprint(&is, 1600000000);
+        doNotOptimize(ffp.crc);
+    }
+    state.setBytesProcessed(data.size());
+}
+
+MEGA_BENCHMARK(FileFingerprint_genfingerprint_large)
+{
+    // sparse: only 8 KB of it are read
+    const std::string data = syntheticData(64 << 20);
+
+    while (state.keepRunning())
+    {
+        BufferInputStream is(data);
+        mega::FileFingerprint ffp;
+        ffp.genfingerprint(&is, 1600000000);
+        doNotOptimize(ffp.crc);
+    }
+    state.setItemsProcessed(1);
+}
+
+MEGA_BENCHMARK(Node_unserialize)
+{
+    mega::MegaApp app;
+    mega::FSACCESS_CLASS fsaccess;
+    HttpIo httpio;
+    mega::MegaClient client(&app, nullptr, &httpio, &fsaccess, nullptr, nullptr, "XXX", "bench", 0);
+
+    // a file with the usual attributes and file attributes
+    std::string serialized;
+    {
+        mega::node_vector dp;
+        auto n = new mega::Node(&client, &dp, 0x123456789ABC, mega::UNDEF, mega::FILENODE, 12345678, 0x1122334455667788, "123:0*AAAAAAAAAAA/456:1*AAAAAAAAAAA", 1600000000);
+        n->setkey(reinterpret_cast<const mega::byte*>(std::string(mega::FILENODEKEYLENGTH, 'X').c_str()));
+        n->attrs.map['n'] = "IMG_20210101_123456.jpg";
+        n->attrs.map['c'] = "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA";
+        n->serialize(&serialized);
+        client.nodes.erase(n->nodeHandle());
+        delete n;
+    }
+
+    mega::node_vector dp;
+    while (state.keepRunning())
+    {
+        mega::Node* n = mega::Node::unserialize(&client, &serialized, &dp);
+        doNotOptimize(n);
+        client.nodes.erase(n->nodeHandle());
+        delete n;
+        dp.clear();
+    }
+    state.setBytesProcessed(serialized.size());
+    state.setItemsProcessed(1);
+}
+
+// a tree of 100K nodes built and torn down, with the memory held per node while it exists
+MEGA_BENCHMARK(NodeStore_tree)
+{
+    const size_t folders = 100, filesPerFolder = 999;
+    size_t nodes = 0;
+    int64_t bytes = 0;
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    auto heapInUse = []() { struct mallinfo2 mi = mallinfo2(); return int64_t(mi.uordblks + mi.hblkhd); };
+#else
+    auto heapInUse = []() { return int64_t(0); };
+#endif
+
+    while (state.keepRunning())
+    {
+        mega::MegaApp app;
+        mega::FSACCESS_CLASS fsaccess;
+        HttpIo httpio;
+        mega::MegaClient client(&app, nullptr, &httpio, &fsaccess, nullptr, nullptr, "XXX", "bench", 0);
+        const int64_t before = heapInUse();
+
+        mega::handle h = 1;
+        mega::node_vector dp;
+        auto root = new mega::Node(&client, &dp, h++, mega::UNDEF, mega::ROOTNODE, -1, 1, nullptr, 0);
+        for (size_t i = 0; i < folders; i++)
+        {
+            auto folder = new mega::Node(&client, &dp, h++, root->nodehandle, mega::FOLDERNODE, -1, 1, nullptr, 0);
+            folder->attrs.map['n'] = "folder " + std::to_string(i);
+
+            for (size_t j = 0; j < filesPerFolder; j++)
+            {
+                auto file = new mega::Node(&client, &dp, h++, folder->nodehandle, mega::FILENODE, 1000, 1,
+                                           "100:0*AAAAAAAAAAA/101:1*BBBBBBBBBBB", 1600000000);
+                file->attrs.map['n'] = "IMG_" + std::to_string(j) + ".jpg";
+                file->attrs.map['c'] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdef";
+            }
+        }
+
+        nodes = client.nodes.size();
+        bytes = heapInUse() - before;
+    }
+    state.setItemsProcessed(nodes);
+    if (bytes > 0)
+    {
+        state.setCounter("bytes_per_node", double(bytes) / double(nodes));
+    }
+}
+
+namespace {
+
+// paths as a sync compares them, with shared prefixes and mixed case
+std::vector<mega::LocalPath> syntheticPaths(size_t count)
+{
+    mega::FSACCESS_CLASS fsaccess;
+    std::vector<mega::LocalPath> paths;
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::string path = "/home/user/MEGA/Photos/" + std::to_string(2000 + i % 21) + "/Album " + std::to_string(i % 97)
+                           + ((i & 1) ? "/IMG_" : "/img_") + std::to_string(i * 7919 % 100000) + ".JPG";
+        paths.push_back(mega::LocalPath::fromPath(path, fsaccess));
+    }
+    return paths;
+}
+
+} // namespace
+
+MEGA_BENCHMARK(LocalPath_less)
+{
+    const auto paths = syntheticPaths(1000);
+
+    while (state.keepRunning())
+    {
+        int less = 0;
+        for (size_t i = 1; i < paths.size(); ++i)
+        {
+            less += paths[i - 1] < paths[i];
+        }
+        doNotOptimize(less);
+    }
+    state.setItemsProcessed(paths.size() - 1);
+}
+
+MEGA_BENCHMARK(LocalPath_compareUtfCaseInsensitive)
+{
+    const auto paths = syntheticPaths(1000);
+
+    while (state.keepRunning())
+    {
+        int sum = 0;
+        for (size_t i = 1; i < paths.size(); ++i)
+        {
+            sum += mega::compareUtf(paths[i - 1], false, paths[i], false, true);
+        }
+        doNotOptimize(sum);
+    }
+    state.setItemsProcessed(paths.size() - 1);
+}
+
+namespace {
+
+// a client stepped by hand: the clock only moves when told to and the API answers every request at once
+struct SteppedClient
+{
+    struct App : mega::MegaApp
+    {
+        void sendevent_result(mega::error e) override { results += e == mega::API_OK; }
+        size_t results = 0;
+    };
+
+    SteppedClient()
+    {
+        mega::Waiter::manualclock = true;
+    }
+
+    ~SteppedClient()
+    {
+        mega::Waiter::manualclock = false;
+    }
+
+    App app;
+    mega::FSACCESS_CLASS fsaccess;
+    mega::ScriptedHttpIO httpio{[](const mega::HttpReq&, const std::string&, std::string& response)
+    {
+        response = "[0]";
+        return 200;
+    }};
+    mega::MegaClient client{&app, nullptr, &httpio, &fsaccess, nullptr, nullptr, "XXX", "bench", 0};
+};
+
+} // namespace
+
+// the cost of an iteration of the engine with nothing to do
+MEGA_BENCHMARK(MegaClient_exec_idle)
+{
+    SteppedClient stepped;
+    stepped.client.exec();
+
+    while (state.keepRunning())
+    {
+        mega::Waiter::advanceds(1);
+        stepped.client.exec();
+    }
+    state.setItemsProcessed(1);
+}
+
+// an iteration that sends a command and processes its response
+MEGA_BENCHMARK(MegaClient_exec_command)
+{
+    SteppedClient stepped;
+    stepped.client.exec();
+
+    while (state.keepRunning())
+    {
+        stepped.client.sendevent(99999, "bench");
+        mega::Waiter::advanceds(1);
+        stepped.client.exec();
+    }
+    doNotOptimize(stepped.app.results);
+    state.setItemsProcessed(1);
+}
@@ -0,0 +1,109 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mt {
+namespace bench {
+
+// Passed to each benchmark, which does its setup and then runs the measured code once per keepRunning():
+//
+//     MEGA_BENCHMARK(Base64_btoa)
+//     {
+//         std::string data = ...;
+//         while (state.keepRunning())
+//         {
+//             doNotOptimize(mega::Base64::btoa(data));
+//         }
+//         state.setBytesProcessed(data.size());
+//     }
+class State
+{
+public:
+    explicit State(uint64_t iterations)
+      : mIterations(iterations)
+      , mRemaining(iterations)
+    {
+    }
+
+    bool keepRunning()
+    {
+        if (mRemaining == mIterations)
+        {
+            mStarted = std::chrono::steady_clock::now();
+        }
+        if (mRemaining--)
+        {
+            return true;
+        }
+        mElapsed = std::chrono::steady_clock::now() - mStarted;
+        return false;
+    }
+
+    // per iteration, for the throughput
+    void setBytesProcessed(uint64_t bytes) { mBytes = bytes; }
+    void setItemsProcessed(uint64_t items) { mItems = items; }
+
+    // a figure other than time, reported as is (eg. the memory held per item)
+    void setCounter(const char* name, double value) { mCounters.emplace_back(name, value); }
+
+    uint64_t iterations() const { return mIterations; }
+    uint64_t bytesProcessed() const { return mBytes; }
+    uint64_t itemsProcessed() const { return mItems; }
+    std::chrono::duration<double> elapsed() const { return mElapsed; }
+    const std::vector<std::pair<std::string, double>>& counters() const { return mCounters; }
+
+private:
+    uint64_t mIterations;
+    uint64_t mRemaining;
+    uint64_t mBytes = 0;
+    uint64_t mItems = 0;
+    std::chrono::steady_clock::time_point mStarted;
+    std::chrono::duration<double> mElapsed{0};
+    std::vector<std::pair<std::string, double>> mCounters;
+};
+
+typedef void (*Function)(State&);
+
+struct Registrar
+{
+    Registrar(const char* name, Function function);
+};
+
+// out of line, so that the compiler can't drop the computation of the value
+void doNotOptimize(const void* value);
+
+template<typename T>
+void doNotOptimize(const T& value)
+{
+    doNotOptimize(static_cast<const void*>(&value));
+}
+
+} // bench
+} // mt
+
+#define MEGA_BENCHMARK(name) \
+    static void name(::mt::bench::State& state); \
+    static ::mt::bench::Registrar name##Registrar(#name, name); \
+    static void name(::mt::bench::State& state)
@@ -0,0 +1,236 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// Microbenchmarks of the hot paths of the SDK, on fixed synthetic inputs.
+// The results are written as JSON (to stdout or --out=<file>) to be compared across releases,
+// and as a table to stderr. Options:
+//   --filter=<substring>   only the benchmarks whose name contains it
+//   --min_time=<seconds>   minimum duration of each repetition (default 0.5)
+//   --repetitions=<n>      the median of n repetitions is reported (default 5)
+//   --out=<file>           write the JSON there instead of stdout
+// Benchmarks may also report figures other than time (see State::setCounter()), as "counters".
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mega.h>
+#include <mega/json.h>
+#include <mega/raid.h>
+#include <mega/version.h>
+
+#include "bench.h"
+
+namespace mt {
+namespace bench {
+
+namespace {
+
+const void* volatile gSink;
+
+std::vector<std::pair<const char*, Function>>& registry()
+{
+    static std::vector<std::pair<const char*, Function>> benchmarks;
+    return benchmarks;
+}
+
+struct Result
+{
+    std::string name;
+    uint64_t iterations = 0;
+    double nsPerIteration = 0;      // median of the repetitions
+    double minNsPerIteration = 0;
+    double bytesPerSecond = 0;
+    double itemsPerSecond = 0;
+    std::vector<std::pair<std::string, double>> counters;
+};
+
+State runOnce(Function function, uint64_t iterations)
+{
+    State state(iterations);
+    function(state);
+    return state;
+}
+
+Result run(const char* name, Function function, double minTime, int repetitions)
+{
+    // grow the iterations until a run takes a tenth of minTime, then scale to minTime
+    uint64_t iterations = 1;
+    for (;;)
+    {
+        double elapsed = runOnce(function, iterations).elapsed().count();
+        if (elapsed >= minTime / 10 || iterations >= (uint64_t(1) << 40))
+        {
+            iterations = std::max<uint64_t>(1, uint64_t(double(iterations) * minTime / std::max(elapsed, 1e-9)));
+            break;
+        }
+        iterations *= elapsed > 0 ? std::min<uint64_t>(10, std::max<uint64_t>(2, uint64_t(minTime / 10 / elapsed))) : 10;
+    }
+
+    std::vector<double> times;
+    State last(0);
+    for (int i = 0; i < repetitions; ++i)
+    {
+        last = runOnce(function, iterations);
+        times.push_back(last.elapsed().count() * 1e9 / double(iterations));
+    }
+    std::sort(times.begin(), times.end());
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerIteration = times[times.size() / 2];
+    result.minNsPerIteration = times.front();
+    result.bytesPerSecond = double(last.bytesProcessed()) * 1e9 / result.nsPerIteration;
+    result.itemsPerSecond = double(last.itemsProcessed()) * 1e9 / result.nsPerIteration;
+    result.counters = last.counters();
+    return result;
+}
+
+std::string toJson(const std::vector<Result>& results)
+{
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(1);
+    json << "{\"context\":{\"sdk\":\"" << MEGA_MAJOR_VERSION << '.' << MEGA_MINOR_VERSION << '.' << MEGA_MICRO_VERSION << '"'
+         << ",\"date\":" << mega::m_time(nullptr)
+         << ",\"raidcombiner\":\"" << mega::RaidLineCombiner::name() << '"'
+         << ",\"jsonscanner\":\"" << mega::JSONStringScanner::name() << '"'
+         << ",\"base64\":\"" << mega::Base64Kernels::best().name << '"'
+         << "},\"benchmarks\":[";
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        json << (i ? "," : "")
+             << "{\"name\":\"" << r.name << '"'
+             << ",\"iterations\":" << r.iterations
+             << ",\"ns_per_iteration\":" << r.nsPerIteration
+             << ",\"min_ns_per_iteration\":" << r.minNsPerIteration
+             << ",\"bytes_per_second\":" << r.bytesPerSecond
+             << ",\"items_per_second\":" << r.itemsPerSecond;
+
+        if (!r.counters.empty())
+        {
+            json << ",\"counters\":{";
+            for (size_t j = 0; j < r.counters.size(); ++j)
+            {
+                json << (j ? "," : "") << '"' << r.counters[j].first << "\":" << r.counters[j].second;
+            }
+            json << '}';
+        }
+        json << '}';
+    }
+    json << "]}\n";
+    return json.str();
+}
+
+} // namespace
+
+Registrar::Registrar(const char* name, Function function)
+{
+    registry().emplace_back(name, function);
+}
+
+void doNotOptimize(const void* value)
+{
+    gSink = value;
+}
+
+} // bench
+} // mt
+
+int main(int argc, char* argv[])
+{
+    using namespace mt::bench;
+
+    std::string filter;
+    std::string out;
+    double minTime = 0.5;
+    int repetitions = 5;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto value = [&arg](const char* option) -> const char*
+        {
+            size_t n = strlen(option);
+            return arg.compare(0, n, option) ? nullptr : arg.c_str() + n;
+        };
+
+        if (auto v = value("--filter="))            filter = v;
+        else if (auto v = value("--out="))          out = v;
+        else if (auto v = value("--min_time="))     minTime = atof(v);
+        else if (auto v = value("--repetitions="))  repetitions = std::max(1, atoi(v));
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--filter=<substring>] [--min_time=<seconds>] [--repetitions=<n>] [--out=<file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    auto benchmarks = registry();
+    std::sort(benchmarks.begin(), benchmarks.end(), [](const std::pair<const char*, Function>& a, const std::pair<const char*, Function>& b)
+    {
+        return strcmp(a.first, b.first) < 0;
+    });
+
+    std::vector<Result> results;
+    for (auto& b : benchmarks)
+    {
+        if (std::string(b.first).find(filter) == std::string::npos)
+        {
+            continue;
+        }
+
+        results.push_back(run(b.first, b.second, minTime, repetitions));
+
+        const Result& r = results.back();
+        std::cerr << std::left << std::setw(40) << r.name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << r.nsPerIteration << " ns"
+                  << std::setw(14) << (r.bytesPerSecond ? std::to_string(int64_t(r.bytesPerSecond / (1 << 20))) + " MB/s" : "")
+                  << std::setw(20) << (r.itemsPerSecond ? std::to_string(int64_t(r.itemsPerSecond)) + " items/s" : "");
+        for (auto& c : r.counters)
+        {
+            std::cerr << "  " << c.first << ": " << c.second;
+        }
+        std::cerr << std::endl;
+    }
+
+    std::string json = toJson(results);
+    if (out.empty())
+    {
+        std::cout << json;
+    }
+    else
+    {
+        std::ofstream file(out);
+        file << json;
+        if (!file)
+        {
+            std::cerr << "Unable to write " << out << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -4735,6 +4735,74 @@ TEST_F(SdkTest, SdkCloudraidStreamingSoakTest)
 #endif
 }
 
+/**
+* @brief TEST_F SdkReadStreamTest
+*
+* Read the well-known raid file through a MegaReadStream: sequentially, at random places, and with a prefetch
+*
+*/
+TEST_F(SdkTest, SdkReadStreamTest)
+{
+    LOG_info << "___TEST SdkReadStreamTest";
+    ASSERT_NO_FATAL_FAILURE(getAccountsForTest(1));
+
+    ASSERT_NO_FATAL_FAILURE(importPublicLink(0, MegaClient::MEGAURL+"/#!zAJnUTYD!8YE5dXrnIEJ47NdDfFEvqtOefhuDMphyae0KY5zrhns", std::unique_ptr<MegaNode>{megaApi[0]->getRootNode()}.get()));
+    std::unique_ptr<MegaNode> file(megaApi[0]->getNodeByHandle(mApi[0].h));
+    ASSERT_TRUE(file);
+
+    string filename = DOTSLASH + DOWNFILE;
+    deleteFile(filename);
+    mApi[0].transferFlags[MegaTransfer::TYPE_DOWNLOAD] = false;
+    megaApi[0]->startDownload(file.get(), filename.c_str());
+    ASSERT_TRUE(waitForResponse(&mApi[0].transferFlags[MegaTransfer::TYPE_DOWNLOAD])) << "Download failed after " << maxTimeout << " seconds";
+    ASSERT_EQ(MegaError::API_OK, mApi[0].lastError) << "Cannot download the file (error: " << mApi[0].lastError << ")";
+
+    int64_t filesize = getFilesize(filename);
+    std::ifstream localFile(filename.c_str(), ios::binary);
+    std::vector<char> expected(static_cast<size_t>(filesize));
+    localFile.read(expected.data(), filesize);
+
+    std::unique_ptr<MegaReadStream> stream(megaApi[0]->createReadStream(file.get(), 1024 * 1024));
+    ASSERT_TRUE(stream);
+    ASSERT_EQ(filesize, stream->getSize());
+
+    auto readAt = [&](m_off_t offset, size_t length)
+    {
+        std::vector<char> data(length);
+        size_t got = 0;
+        while (got < length)
+        {
+            long long n = stream->read(offset + m_off_t(got), data.data() + got, length - got, int(maxTimeout * 1000));
+            ASSERT_GT(n, 0) << "Read failed at " << offset + m_off_t(got) << " (error: " << n << ")";
+            got += size_t(n);
+        }
+        ASSERT_EQ(0, memcmp(data.data(), expected.data() + offset, length)) << "Wrong data at " << offset;
+    };
+
+    // sequential reads, through several fetches
+    for (m_off_t offset = 0; offset < 3 * 1024 * 1024; offset += 100000)
+    {
+        ASSERT_NO_FATAL_FAILURE(readAt(offset, 100000));
+    }
+
+    srand(unsigned(m_time()));
+    for (int i = 0; i < 10; ++i)
+    {
+        m_off_t offset = rand() % (filesize - 65536);
+        ASSERT_NO_FATAL_FAILURE(readAt(offset, size_t(rand() % 65536 + 1)));
+    }
+
+    stream->prefetch(filesize - 100, 100);
+    ASSERT_NO_FATAL_FAILURE(readAt(filesize - 100, 100));
+
+    char last;
+    ASSERT_EQ(0, stream->read(filesize, &last, 1, 0));
+    ASSERT_EQ(MegaError::API_EARGS, stream->read(-1, &last, 1, 0));
+
+    stream.reset();
+    deleteFile(filename);
+}
+
 TEST_F(SdkTest, SdkRecentsTest)
 {
     LOG_info << "___TEST SdkRecentsTest___";
@@ -1101,6 +1101,7 @@ struct StandardClient : public MegaApp
                 client.proctree(n1, &tc, false, true);
                 tc.allocnodes();
                 client.proctree(n1, &tc, false, true);
+                tc.makeattrs(&client);
                 tc.nn[0].parenthandle = UNDEF;
 
                 SymmCipher key;
@@ -7356,6 +7357,7 @@ struct TwoWaySyncSymmetryCase
         changeClient().client.proctree(n1, &tc, false, true);
         tc.allocnodes();
         changeClient().client.proctree(n1, &tc, false, true);
+        tc.makeattrs(&changeClient().client);
         tc.nn[0].parenthandle = UNDEF;
 
         SymmCipher key;
@@ -7389,6 +7391,7 @@ struct TwoWaySyncSymmetryCase
         changeClient().client.proctree(n1, &tc, false, true);
         tc.allocnodes();
         changeClient().client.proctree(n1, &tc, false, true);
+        tc.makeattrs(&changeClient().client);
         tc.nn[0].parenthandle = UNDEF;
 
         SymmCipher key;
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+
+# Performance regression gate: runs the microbenchmarks (test_bench) and the offline benchmark tools
+# (tool_synthetic_account, tool_sync_stress, and tool_sc_replay given a recording), and compares their
+# figures with the baseline of this platform, tests/perf/baselines/<platform>.json.  Fails if any of them
+# is worse than its baseline by more than the threshold.  Built as `make perfcheck` (autotools or CMake).
+#
+# usage: perfcheck.py --bindir=<dir with the binaries> [--threshold=0.15] [--runs=3] [--filter=<substring>]
+#                     [--recording=<sc recording>] [--baseline=<file>] [--update] [--out=<results json>]
+#
+# --update writes the figures as the new baseline instead: run it on an idle machine, on a release build,
+# and commit the file.  Each figure is the best of --runs runs, which is what a slowdown moves reliably.
+
+from __future__ import print_function
+
+import argparse, json, os, platform, shutil, subprocess, sys, tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# figures below these are too small for their relative change to mean anything
+FLOORS = {
+    'ns_per_iteration': 5.0,
+    'seconds': 0.05,
+    'peak_rss_kb': 4096,
+}
+
+
+def platform_name():
+    return '%s-%s' % (sys.platform, platform.machine().lower())
+
+
+def binary(bindir, name):
+    path = os.path.join(bindir, name + ('.exe' if sys.platform == 'win32' else ''))
+    if not os.path.exists(path):
+        sys.exit('perfcheck: %s not found, build it first' % path)
+    return path
+
+
+def run_json(command):
+    print('perfcheck: ' + ' '.join(command), file=sys.stderr)
+    output = subprocess.check_output(command)
+    return json.loads(output.decode('utf-8'))
+
+
+def phase_figures(prefix, result, figures):
+    for phase in result['phases']:
+        name = '%s.%s' % (prefix, phase['name'])
+        figures[name + '.seconds'] = phase['seconds']
+        if phase.get('peak_rss_kb', -1) >= 0:
+            figures[name + '.peak_rss_kb'] = phase['peak_rss_kb']
+
+
+def measure(args):
+    figures = {}
+
+    bench = run_json([binary(args.bindir, 'test_bench'), '--filter=' + args.filter])
+    for b in bench['benchmarks']:
+        figures['bench.%s.ns_per_iteration' % b['name']] = b['ns_per_iteration']
+
+    if args.filter in 'synthetic_account':
+        workdir = tempfile.mkdtemp(prefix='perfcheck')
+        try:
+            tool = binary(args.bindir, 'tool_synthetic_account')
+            run_json([tool, 'generate', workdir, '--nodes=200000'])
+            phase_figures('synthetic_account', run_json([tool, 'replay', workdir]), figures)
+        finally:
+            shutil.rmtree(workdir, ignore_errors=True)
+
+    if args.filter in 'sync_stress':
+        phase_figures('sync_stress', run_json([binary(args.bindir, 'tool_sync_stress'), '--files=50000']), figures)
+
+    if args.recording:
+        result = run_json([binary(args.bindir, 'tool_sc_replay'), args.recording])
+        phase_figures('sc_replay', result, figures)
+
+    return figures
+
+
+def best(runs):
+    figures = {}
+    for run in runs:
+        for name, value in run.items():
+            figures[name] = min(value, figures.get(name, value))
+    return figures
+
+
+def compare(figures, baseline, threshold):
+    regressions = []
+    for name in sorted(baseline):
+        if name not in figures:
+            print('  missing   %s' % name)
+            continue
+
+        old, new = baseline[name], figures[name]
+        floor = FLOORS[name.rsplit('.', 1)[1]]
+        change = (new - old) / old if old else 0.0
+        if change > threshold and new - old > floor:
+            regressions.append(name)
+            status = 'REGRESSED'
+        elif change < -threshold and old - new > floor:
+            status = 'improved'
+        else:
+            status = 'ok'
+        print('  %-9s %-70s %14.3f -> %14.3f  %+6.1f%%' % (status, name, old, new, change * 100))
+
+    for name in sorted(set(figures) - set(baseline)):
+        print('  new       %-70s %14.3f' % (name, figures[name]))
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compares the benchmarks with the baseline of this platform')
+    parser.add_argument('--bindir', required=True)
+    parser.add_argument('--threshold', type=float, default=0.15, help='relative slowdown that fails the check')
+    parser.add_argument('--runs', type=int, default=3)
+    parser.add_argument('--filter', default='', help='only the benchmarks and tools whose name contains it')
+    parser.add_argument('--recording', help='sc recording for tool_sc_replay')
+    parser.add_argument('--baseline', default=os.path.join(HERE, 'baselines', platform_name() + '.json'))
+    parser.add_argument('--update', action='store_true', help='write the figures as the baseline')
+    parser.add_argument('--out', help='also write the figures there')
+    args = parser.parse_args()
+
+    figures = best([measure(args) for _ in range(max(1, args.runs))])
+
+    if args.out:
+        with open(args.out, 'w') as f:
+            json.dump({'platform': platform_name(), 'figures': figures}, f, indent=1, sort_keys=True)
+
+    if args.update:
+        with open(args.baseline, 'w') as f:
+            json.dump({'platform': platform_name(), 'figures': figures}, f, indent=1, sort_keys=True)
+            f.write('\n')
+        print('perfcheck: baseline written to %s' % args.baseline)
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print('perfcheck: no baseline for %s (%s), record one with --update' % (platform_name(), args.baseline))
+        return 1
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)['figures']
+    if args.filter:
+        baseline = dict((k, v) for k, v in baseline.items() if args.filter in k)
+
+    regressions = compare(figures, baseline, args.threshold)
+    if regressions:
+        print('perfcheck: %d figure(s) regressed by more than %d%%' % (len(regressions), args.threshold * 100))
+        return 1
+
+    print('perfcheck: no regressions')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
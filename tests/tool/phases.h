@@ -0,0 +1,169 @@
+/**
+ * @file tests/tool/phases.h
+ * @brief Time and resident memory of the phases of the offline benchmark tools
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace mt {
+
+// Resident memory in kB, -1 where unknown. On Linux the peak is reset before each phase, elsewhere it is the
+// peak of the process so far, so a phase only shows how much it raised it.
+#ifdef __linux__
+inline int64_t procStatusKb(const char* field)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (!line.compare(0, strlen(field), field))
+        {
+            return atoll(line.c_str() + strlen(field));
+        }
+    }
+    return -1;
+}
+
+inline void resetPeakRss()
+{
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+inline int64_t currentRssKb()
+{
+    return procStatusKb("VmRSS:");
+}
+
+inline int64_t peakRssKb()
+{
+    return procStatusKb("VmHWM:");
+}
+#else
+inline void resetPeakRss()
+{
+}
+
+inline int64_t currentRssKb()
+{
+    return -1;
+}
+
+inline int64_t peakRssKb()
+{
+#ifndef _WIN32
+    rusage usage;
+    if (!getrusage(RUSAGE_SELF, &usage))
+    {
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return -1;
+}
+#endif
+
+class Phases
+{
+public:
+    // f returns a short description of what was done, or an empty string if it failed
+    bool run(const char* name, std::function<std::string()> f)
+    {
+        resetPeakRss();
+        auto start = std::chrono::steady_clock::now();
+        std::string detail = f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        Phase phase{name, elapsed.count(), peakRssKb(), currentRssKb(), detail.empty() ? "FAILED" : detail, {}};
+        mPhases.push_back(phase);
+
+        std::cerr << std::left << std::setw(16) << phase.name << std::right << std::fixed
+                  << std::setw(10) << std::setprecision(3) << phase.seconds << " s"
+                  << std::setw(10) << phase.peakRssKb / 1024 << " MB peak"
+                  << std::setw(10) << phase.rssKb / 1024 << " MB"
+                  << "   " << phase.detail << std::endl;
+
+        return !detail.empty();
+    }
+
+    // adds "key":json to the JSON of the last phase
+    void annotate(const std::string& key, const std::string& json)
+    {
+        if (!mPhases.empty())
+        {
+            mPhases.back().extra.emplace_back(key, json);
+        }
+    }
+
+    std::string toJson() const
+    {
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(6) << "{\"phases\":[";
+        for (size_t i = 0; i < mPhases.size(); ++i)
+        {
+            const Phase& p = mPhases[i];
+            json << (i ? "," : "")
+                 << "{\"name\":\"" << p.name << '"'
+                 << ",\"seconds\":" << p.seconds
+                 << ",\"peak_rss_kb\":" << p.peakRssKb
+                 << ",\"rss_kb\":" << p.rssKb
+                 << ",\"detail\":\"" << p.detail << '"';
+            for (auto& e : p.extra)
+            {
+                json << ",\"" << e.first << "\":" << e.second;
+            }
+            json << '}';
+        }
+        json << "]}\n";
+        return json.str();
+    }
+
+private:
+    struct Phase
+    {
+        std::string name;
+        double seconds;
+        int64_t peakRssKb;
+        int64_t rssKb;
+        std::string detail;
+        std::vector<std::pair<std::string, std::string>> extra;
+    };
+    std::vector<Phase> mPhases;
+};
+
+} // mt
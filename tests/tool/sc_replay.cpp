@@ -0,0 +1,340 @@
+/**
+ * @file tests/tool/sc_replay.cpp
+ * @brief Replay of recorded action packets at full speed
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// Loads a recording of the sc channel (see ScRecorder, and the `screcord` command of megacli) into a client that
+// is never connected, and feeds it the recorded responses one after the other, as fast as they are processed:
+// MegaClient::procsc(), notifypurge() and, in place of MegaApiImpl::nodes_updated(), the MegaNodeList that it
+// builds for its listeners. Reports the action packets per second and the percentiles of the time taken by a
+// response, as a table on stderr and as JSON on stdout.
+
+#include "mega.h"
+#include "megaapi_impl.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "phases.h"
+
+using namespace mega;
+
+namespace {
+
+const char* const USAGE =
+    "usage: tool_sc_replay <recording> [--threads=N] [--no-nodelist]\n";
+
+struct Options
+{
+    unsigned threads = 4;           // worker threads of the client
+    bool nodeList = true;           // build the MegaNodeList of MegaApiImpl::nodes_updated()
+};
+
+struct Recording
+{
+    handle me = UNDEF;
+    string key;
+    handle scsn = UNDEF;
+    vector<string> users, nodes, pcrs;
+    vector<string> responses;
+};
+
+struct HttpIo : HttpIO
+{
+    void addevents(Waiter*, int) override {}
+    void post(struct HttpReq*, const char* = NULL, unsigned = 0) override {}
+    void cancel(HttpReq*) override {}
+    m_off_t postpos(void*) override { return {}; }
+    bool doio(void) override { return {}; }
+    void setuseragent(string*) override {}
+};
+
+class App : public MegaApp
+{
+public:
+    explicit App(const Options& options)
+      : mOptions(options)
+    {
+    }
+
+    void nodes_updated(Node** n, int count) override
+    {
+        // what MegaApiImpl does for its listeners, minus the listeners
+        if (n && count)
+        {
+            calls++;
+            nodes += size_t(count);
+            if (mOptions.nodeList)
+            {
+                MegaNodeListPrivate list(n, count);
+            }
+        }
+    }
+
+    size_t calls = 0;
+    size_t nodes = 0;
+
+private:
+    const Options& mOptions;
+};
+
+bool readRecording(const string& path, Recording& recording)
+{
+    std::ifstream in(path, std::ios::binary);
+    string line;
+    if (!std::getline(in, line) || line != ScRecorder::HEADER)
+    {
+        return false;
+    }
+
+    while (std::getline(in, line))
+    {
+        size_t colon = line.find(':');
+        if (colon == string::npos)
+        {
+            return false;
+        }
+
+        string type = line.substr(0, colon);
+        if (type == "sc")
+        {
+            recording.responses.push_back(line.substr(colon + 1));
+            continue;
+        }
+
+        string value = Base64::atob(line.substr(colon + 1));
+        if (type == "u")         recording.users.push_back(value);
+        else if (type == "n")    recording.nodes.push_back(value);
+        else if (type == "p")    recording.pcrs.push_back(value);
+        else if (type == "k")    recording.key = value;
+        else if (type == "me" && value.size() == MegaClient::USERHANDLE)
+        {
+            recording.me = 0;
+            memcpy(&recording.me, value.data(), value.size());
+        }
+        else if (type == "sn" && value.size() == sizeof recording.scsn)
+        {
+            memcpy(&recording.scsn, value.data(), value.size());
+        }
+    }
+
+    return recording.key.size() == SymmCipher::KEYLENGTH && !ISUNDEF(recording.me) && !ISUNDEF(recording.scsn);
+}
+
+// the state the responses apply to, as fetchsc() loads it
+string load(MegaClient& client, const Recording& recording)
+{
+    client.key.setkey(reinterpret_cast<const byte*>(recording.key.data()));
+    client.me = recording.me;
+
+    for (auto& data : recording.users)
+    {
+        string record = data;
+        if (!User::unserialize(&client, &record))
+        {
+            return string();
+        }
+    }
+
+    node_vector dp;
+    for (auto& data : recording.nodes)
+    {
+        if (!Node::unserialize(&client, &data, &dp))
+        {
+            return string();
+        }
+    }
+
+    for (size_t i = dp.size(); i--; )
+    {
+        if (Node* n = client.nodebyhandle(dp[i]->parenthandle))
+        {
+            dp[i]->setparent(n);
+        }
+    }
+
+    for (auto& data : recording.pcrs)
+    {
+        string record = data;
+        if (PendingContactRequest* pcr = PendingContactRequest::unserialize(&record))
+        {
+            client.mappcr(pcr->id, unique_ptr<PendingContactRequest>(pcr));
+        }
+    }
+
+    client.mergenewshares(0);
+    client.scsn.setScsn(recording.scsn);
+    client.statecurrent = true;
+    client.fetchingnodes = false;
+    client.notifypurge();
+
+    return std::to_string(client.users.size()) + " users, " + std::to_string(client.nodes.size()) + " nodes";
+}
+
+size_t countPackets(const string& response)
+{
+    JSON json(response);
+    if (!json.enterobject())
+    {
+        return 0;
+    }
+
+    for (nameid name; (name = json.getnameid()) != EOO; )
+    {
+        if (name == 'a' && json.enterarray())
+        {
+            size_t packets = 0;
+            while (json.storeobject())
+            {
+                packets++;
+            }
+            return packets;
+        }
+
+        if (!json.storeobject())
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+// time to process a response, in microseconds
+uint64_t replay(MegaClient& client, const string& response)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    client.insca = false;
+    client.insca_notlast = false;
+    client.jsonsc.begin(response.c_str());
+    client.jsonsc.enterobject();
+
+    // false: exec() would let syncdown() run before going on
+    while (!client.procsc())
+    {
+    }
+    client.jsonsc.pos = NULL;
+
+    return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 2; i < argc; ++i)
+    {
+        string arg = argv[i];
+        auto value = [&arg](const char* option) -> const char*
+        {
+            size_t n = strlen(option);
+            return arg.compare(0, n, option) ? nullptr : arg.c_str() + n;
+        };
+
+        if (auto v = value("--threads="))       options.threads = unsigned(atoi(v));
+        else if (arg == "--no-nodelist")        options.nodeList = false;
+        else return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (argc < 2 || !parseOptions(argc, argv, options))
+    {
+        std::cerr << USAGE;
+        return 1;
+    }
+
+    mt::Phases phases;
+    Recording recording;
+
+    bool ok = phases.run("read", [&]()
+    {
+        return readRecording(argv[1], recording) ? std::to_string(recording.responses.size()) + " responses" : string();
+    });
+
+    if (!ok)
+    {
+        std::cerr << "Unable to read the recording " << argv[1] << std::endl;
+        return 1;
+    }
+
+    App app(options);
+    FSACCESS_CLASS fsAccess;
+    HttpIo httpIo;
+    MegaClient client(&app, nullptr, &httpIo, &fsAccess, nullptr, nullptr, "screplay", "sc_replay", options.threads);
+
+    ok = phases.run("load", [&]() { return load(client, recording); });
+
+    size_t packets = 0;
+    for (auto& response : recording.responses)
+    {
+        packets += countPackets(response);
+    }
+
+    vector<uint64_t> durations;
+    app.calls = app.nodes = 0;
+    client.performanceStats.scProcessingTime.report(true);
+
+    ok = ok && phases.run("replay", [&]()
+    {
+        for (auto& response : recording.responses)
+        {
+            durations.push_back(replay(client, response));
+        }
+        return std::to_string(packets) + " packets, " + std::to_string(app.nodes) + " nodes updated";
+    });
+
+    if (ok)
+    {
+        uint64_t total = 0;
+        for (uint64_t d : durations)
+        {
+            total += d;
+        }
+        std::sort(durations.begin(), durations.end());
+
+        auto percentile = [&durations](double fraction)
+        {
+            return durations.empty() ? 0 : durations[std::min(durations.size() - 1, size_t(fraction * double(durations.size())))];
+        };
+
+        std::ostringstream latency;
+        latency << "{\"p50\":" << percentile(0.5) << ",\"p90\":" << percentile(0.9) << ",\"p99\":" << percentile(0.99)
+                << ",\"max\":" << (durations.empty() ? 0 : durations.back()) << '}';
+
+        double seconds = double(total) / 1e6;
+        double rate = seconds > 0 ? double(packets) / seconds : 0;
+
+        phases.annotate("responses", std::to_string(durations.size()));
+        phases.annotate("packets", std::to_string(packets));
+        phases.annotate("packets_per_second", std::to_string(uint64_t(rate)));
+        phases.annotate("response_us", latency.str());
+        phases.annotate("nodes_updated", "{\"calls\":" + std::to_string(app.calls) + ",\"nodes\":" + std::to_string(app.nodes) + "}");
+        phases.annotate("procsc", client.performanceStats.scProcessingTime.toJson());
+
+        std::cerr << uint64_t(rate) << " packets/s, response p50 " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us" << std::endl;
+    }
+
+    std::cout << phases.toJson();
+    return ok ? 0 : 1;
+}
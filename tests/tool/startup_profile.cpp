@@ -0,0 +1,225 @@
+/**
+ * @file tests/tool/startup_profile.cpp
+ * @brief Distribution of the startup phases over repeated cold starts
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// Starts a MegaApi against the cached account in <dir> --runs times: creation, fastLogin() with the saved session and
+// fetchNodes() from the local cache, then MegaApi::getStartupProfile().  Reports the distribution of each phase over
+// the runs, as a table on stderr and as JSON on stdout.  The first time, it logs into the account in MEGA_EMAIL and
+// MEGA_PWD to fill the cache and saves the session to <dir>/session (keep it private).
+
+#include "mega.h"
+#include "megaapi.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+using namespace mega;
+
+namespace {
+
+const char* const USAGE =
+    "usage: tool_startup_profile <dir> [--runs=N]\n";
+
+const char* const APP_KEY = "V8ZGDDBA";
+
+// startms and ms of each run of a phase
+struct PhaseSamples
+{
+    vector<double> start, duration;
+};
+
+bool request(MegaApi& api, const std::function<void(MegaRequestListener*)>& call, const char* what)
+{
+    SynchronousRequestListener listener;
+    call(&listener);
+    listener.wait();
+    if (listener.getError()->getErrorCode() != MegaError::API_OK)
+    {
+        std::cerr << what << " failed: " << listener.getError()->getErrorString() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// logs in with the credentials of the environment to fill the cache, and returns the session
+string prepare(const string& dir)
+{
+    const char* email = getenv("MEGA_EMAIL");
+    const char* password = getenv("MEGA_PWD");
+    if (!email || !password)
+    {
+        std::cerr << "No session in " << dir << " yet: set MEGA_EMAIL and MEGA_PWD to log in" << std::endl;
+        return string();
+    }
+
+    MegaApi api(APP_KEY, dir.c_str(), "startup_profile");
+    if (!request(api, [&](MegaRequestListener* l) { api.login(email, password, l); }, "login")
+            || !request(api, [&](MegaRequestListener* l) { api.fetchNodes(l); }, "fetchnodes"))
+    {
+        return string();
+    }
+
+    std::unique_ptr<char[]> session(api.dumpSession());
+    // let the cache be committed before the MegaApi goes
+    request(api, [&](MegaRequestListener* l) { api.localLogout(l); }, "local logout");
+    return session ? string(session.get()) : string();
+}
+
+void parseProfile(const string& profile, std::map<string, PhaseSamples>& phases)
+{
+    JSON json(profile);
+    if (!json.enterobject())
+    {
+        return;
+    }
+
+    for (string name; !(name = json.getname()).empty(); )
+    {
+        if (!json.enterobject())
+        {
+            return;
+        }
+
+        for (nameid id; (id = json.getnameid()) != EOO; )
+        {
+            if (id == MAKENAMEID7('s', 't', 'a', 'r', 't', 'm', 's'))
+            {
+                phases[name].start.push_back(json.getfloat());
+            }
+            else if (id == MAKENAMEID2('m', 's'))
+            {
+                phases[name].duration.push_back(json.getfloat());
+            }
+            else if (!json.storeobject())
+            {
+                return;
+            }
+        }
+        json.leaveobject();
+    }
+}
+
+// of sorted values
+double percentile(const vector<double>& values, double fraction)
+{
+    return values.empty() ? 0 : values[std::min(values.size() - 1, size_t(fraction * double(values.size())))];
+}
+
+// {"count":..,"p50":..,"p90":..,"max":..} of sorted values
+string distribution(const vector<double>& values)
+{
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3) << "{\"count\":" << values.size() << ",\"p50\":" << percentile(values, 0.5)
+         << ",\"p90\":" << percentile(values, 0.9) << ",\"max\":" << percentile(values, 1) << '}';
+    return json.str();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << USAGE;
+        return 1;
+    }
+
+    string dir = argv[1];
+    unsigned runs = 10;
+    for (int i = 2; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (!arg.compare(0, 7, "--runs="))
+        {
+            runs = unsigned(atoi(arg.c_str() + 7));
+        }
+        else
+        {
+            std::cerr << USAGE;
+            return 1;
+        }
+    }
+
+    string sessionPath = dir + "/session";
+    string session;
+    std::ifstream(sessionPath) >> session;
+    if (session.empty())
+    {
+        session = prepare(dir);
+        if (session.empty())
+        {
+            return 1;
+        }
+        std::ofstream(sessionPath) << session;
+    }
+
+    std::map<string, PhaseSamples> phases;
+    for (unsigned run = 0; run < runs; ++run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<MegaApi> api(new MegaApi(APP_KEY, dir.c_str(), "startup_profile"));
+
+        if (!request(*api, [&](MegaRequestListener* l) { api->fastLogin(session.c_str(), l); }, "fastlogin")
+                || !request(*api, [&](MegaRequestListener* l) { api->fetchNodes(l); }, "fetchnodes"))
+        {
+            return 1;
+        }
+
+        double total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::unique_ptr<char[]> profile(api->getStartupProfile());
+        parseProfile(profile.get(), phases);
+        phases["total"].start.push_back(0);
+        phases["total"].duration.push_back(total);
+
+        // keep the cache for the next run
+        request(*api, [&](MegaRequestListener* l) { api->localLogout(l); }, "local logout");
+        std::cerr << "run " << run + 1 << ": " << std::fixed << std::setprecision(1) << total << " ms" << std::endl;
+    }
+
+    std::cerr << std::left << std::setw(14) << "phase" << std::right << std::setw(12) << "start p50" << std::setw(12) << "ms p50"
+              << std::setw(12) << "ms p90" << std::setw(12) << "ms max" << std::endl;
+
+    std::ostringstream json;
+    json << "{\"runs\":" << runs << ",\"phases\":{";
+    const char* separator = "";
+    for (auto& phase : phases)
+    {
+        vector<double>& start = phase.second.start;
+        vector<double>& duration = phase.second.duration;
+        std::sort(start.begin(), start.end());
+        std::sort(duration.begin(), duration.end());
+
+        std::cerr << std::left << std::setw(14) << phase.first << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << percentile(start, 0.5) << std::setw(12) << percentile(duration, 0.5)
+                  << std::setw(12) << percentile(duration, 0.9) << std::setw(12) << percentile(duration, 1) << std::endl;
+
+        json << separator << '"' << phase.first << "\":{\"startms\":" << distribution(start)
+             << ",\"ms\":" << distribution(duration) << '}';
+        separator = ",";
+    }
+    json << "}}\n";
+
+    std::cout << json.str();
+    return 0;
+}
@@ -0,0 +1,818 @@
+/**
+ * @file tests/tool/sync_stress.cpp
+ * @brief Stress benchmark of the sync engine over a simulated filesystem
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// Runs a sync of an in-memory filesystem tree in a client that is never connected, driving Sync::procscanq(),
+// MegaClient::syncdown() and MegaClient::syncup() the way exec() does, with a simulated clock:
+//
+//   build     the tree: --files in folders of --per-folder files, --fanout subfolders each
+//   scan      the initial scan, as for a new sync
+//   mirror    an identical cloud tree, as if the initial sync had completed
+//   link      a full syncdown(), that pairs the LocalNodes with those cloud nodes
+//   syncup    a full syncup(), with nothing to upload
+//
+// and then these storms of filesystem notifications, each followed by the syncdown() and syncup() of the
+// changed subtrees (of the whole tree with --full):
+//
+//   rename    --renames files renamed in their folder
+//   save      --saves files saved by an editor: written to a temporary file that is renamed over them
+//   dirs      --dirs folders right below the root renamed, with everything in them
+//
+// The time and resident memory of each phase go to stderr as a table and to stdout as JSON, along with the
+// counts and the distribution of the durations of procscanq(), checkpath() (per notification), syncdown() and
+// syncup() during the phase.
+
+#include "mega.h"
+#include "mega/heartbeats.h"
+
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <map>
+#include <random>
+
+#include "../unit/DefaultedDirAccess.h"
+#include "../unit/DefaultedFileAccess.h"
+#include "../unit/DefaultedFileSystemAccess.h"
+#include "phases.h"
+
+#if defined(ENABLE_SYNC) && !defined(_WIN32)
+
+using namespace mega;
+using mt::Phases;
+
+namespace {
+
+const char* const USAGE =
+    "usage: tool_sync_stress [--files=N] [--per-folder=N] [--fanout=N] [--max-size=bytes]\n"
+    "                        [--renames=N] [--saves=N] [--dirs=N] [--full] [--seed=N]\n";
+
+struct Options
+{
+    size_t files = 100000;
+    unsigned perFolder = 32;        // files per folder
+    unsigned fanout = 8;            // subfolders per folder
+    m_off_t maxSize = 1 << 20;      // only up to 8 KB of each file are read, for its fingerprint
+    size_t renames = 10000;
+    size_t saves = 1000;
+    unsigned dirs = 4;
+    bool full = false;              // syncdown() and syncup() of the whole tree after the storms
+    uint64_t seed = 1;
+};
+
+// a file or folder of the simulated filesystem, the contents of files are generated from their seed
+struct SimNode
+{
+    nodetype_t type = FOLDERNODE;
+    handle fsid = 0;
+    m_off_t size = 0;
+    m_time_t mtime = 0;
+    uint32_t seed = 0;
+    std::map<string, unique_ptr<SimNode>> children;
+};
+
+// in-memory tree below an absolute root path, addressed by platform encoded paths
+class SimFileSystem
+{
+public:
+    explicit SimFileSystem(const string& rootPath)
+      : root(rootPath)
+    {
+        mRoot.fsid = mNextFsid++;
+        mRoot.mtime = m_time();
+    }
+
+    const string root;
+
+    SimNode* find(const string& path)
+    {
+        if (path.compare(0, root.size(), root) || (path.size() > root.size() && path[root.size()] != '/'))
+        {
+            return nullptr;
+        }
+
+        SimNode* node = &mRoot;
+        for (size_t pos = root.size(); node && pos < path.size(); )
+        {
+            size_t end = std::min(path.find('/', pos + 1), path.size());
+            auto it = node->children.find(path.substr(pos + 1, end - pos - 1));
+            node = it == node->children.end() ? nullptr : it->second.get();
+            pos = end;
+        }
+        return node;
+    }
+
+    // nullptr if the parent folder doesn't exist or the name is taken
+    SimNode* add(const string& path, nodetype_t type, m_off_t size, m_time_t mtime)
+    {
+        SimNode* parent;
+        string name;
+        if (!split(path, parent, name) || parent->children.count(name))
+        {
+            return nullptr;
+        }
+
+        unique_ptr<SimNode> node(new SimNode);
+        node->type = type;
+        node->fsid = mNextFsid++;
+        node->size = type == FILENODE ? size : 0;
+        node->mtime = mtime;
+        node->seed = mNextSeed++;
+
+        SimNode* added = node.get();
+        parent->children[name] = std::move(node);
+        parent->mtime = mtime;
+        return added;
+    }
+
+    // as rename(2): a file at the target is replaced, the mtime of what is renamed doesn't change
+    bool rename(const string& from, const string& to, m_time_t now)
+    {
+        SimNode* fromParent;
+        SimNode* toParent;
+        string fromName, toName;
+        if (!split(from, fromParent, fromName) || !split(to, toParent, toName))
+        {
+            return false;
+        }
+
+        auto it = fromParent->children.find(fromName);
+        if (it == fromParent->children.end())
+        {
+            return false;
+        }
+
+        unique_ptr<SimNode> node = std::move(it->second);
+        fromParent->children.erase(it);
+        toParent->children[toName] = std::move(node);
+        fromParent->mtime = toParent->mtime = now;
+        return true;
+    }
+
+private:
+    bool split(const string& path, SimNode*& parent, string& name)
+    {
+        size_t slash = path.rfind('/');
+        if (slash == string::npos || slash + 1 == path.size())
+        {
+            return false;
+        }
+
+        parent = find(path.substr(0, slash));
+        name = path.substr(slash + 1);
+        return parent && parent->type == FOLDERNODE;
+    }
+
+    SimNode mRoot;
+    handle mNextFsid = 1;
+    uint32_t mNextSeed = 1;
+};
+
+class SimFileAccess : public mt::DefaultedFileAccess
+{
+public:
+    explicit SimFileAccess(SimFileSystem& fs)
+      : mFs(fs)
+    {
+    }
+
+    bool fopen(LocalPath& path, bool, bool, DirAccess* = nullptr, bool = false) override
+    {
+        retry = false;
+
+        SimNode* node = mFs.find(path.platformEncoded());
+        if (!node)
+        {
+            return false;
+        }
+
+        type = node->type;
+        size = node->size;
+        mtime = node->mtime;
+        fsid = node->fsid;
+        fsidvalid = true;
+        mSeed = node->seed;
+        return true;
+    }
+
+    void updatelocalname(const LocalPath&, bool) override
+    {
+    }
+
+    bool sysread(byte* buffer, unsigned length, m_off_t offset) override
+    {
+        if (type != FILENODE || offset < 0 || offset + length > size)
+        {
+            return false;
+        }
+
+        for (unsigned i = 0; i < length; ++i)
+        {
+            uint64_t pos = uint64_t(offset) + i;
+            uint32_t word = (mSeed ^ uint32_t(pos >> 2)) * 2654435761u;
+            buffer[i] = byte(word >> (8 * (pos & 3)));
+        }
+        return true;
+    }
+
+    bool sysstat(m_time_t* curr_mtime, m_off_t* curr_size) override
+    {
+        *curr_mtime = mtime;
+        *curr_size = size;
+        return true;
+    }
+
+    bool sysopen(bool = false) override
+    {
+        return true;
+    }
+
+    void sysclose() override
+    {
+    }
+
+private:
+    SimFileSystem& mFs;
+    uint32_t mSeed = 0;
+};
+
+class SimDirAccess : public mt::DefaultedDirAccess
+{
+public:
+    explicit SimDirAccess(SimFileSystem& fs)
+      : mFs(fs)
+    {
+    }
+
+    // lists the folder when opened, as readdir() would see it
+    bool dopen(LocalPath* path, FileAccess*, bool) override
+    {
+        mEntries.clear();
+        mNext = 0;
+
+        SimNode* node = mFs.find(path->platformEncoded());
+        if (!node || node->type != FOLDERNODE)
+        {
+            return false;
+        }
+
+        mEntries.reserve(node->children.size());
+        for (auto& child : node->children)
+        {
+            mEntries.emplace_back(child.first, child.second->type);
+        }
+        return true;
+    }
+
+    bool dnext(LocalPath&, LocalPath& name, bool = true, nodetype_t* type = NULL) override
+    {
+        if (mNext == mEntries.size())
+        {
+            return false;
+        }
+
+        name = LocalPath::fromPlatformEncoded(mEntries[mNext].first);
+        if (type)
+        {
+            *type = mEntries[mNext].second;
+        }
+        ++mNext;
+        return true;
+    }
+
+private:
+    SimFileSystem& mFs;
+    vector<std::pair<string, nodetype_t>> mEntries;
+    size_t mNext = 0;
+};
+
+class SimFileSystemAccess : public mt::DefaultedFileSystemAccess
+{
+public:
+    explicit SimFileSystemAccess(SimFileSystem& fs)
+      : mFs(fs)
+    {
+        // notifications are reliable here: no periodic rescans
+        notifyerr = false;
+        notifyfailed = false;
+    }
+
+    std::unique_ptr<FileAccess> newfileaccess(bool = true) override
+    {
+        return std::unique_ptr<FileAccess>(new SimFileAccess(mFs));
+    }
+
+    DirAccess* newdiraccess() override
+    {
+        return new SimDirAccess(mFs);
+    }
+
+    void local2path(const string* local, string* path) const override
+    {
+        *path = *local;
+    }
+
+    void path2local(const string* path, string* local) const override
+    {
+        *local = *path;
+    }
+
+    bool getsname(const LocalPath&, LocalPath&) const override
+    {
+        return false;
+    }
+
+    bool getextension(const LocalPath& path, string& extension) const override
+    {
+        string name = path.leafName().platformEncoded();
+        size_t dot = name.rfind('.');
+        if (dot == string::npos)
+        {
+            return false;
+        }
+
+        extension = name.substr(dot);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        return true;
+    }
+
+private:
+    SimFileSystem& mFs;
+};
+
+struct HttpIo : HttpIO
+{
+    void addevents(Waiter*, int) override {}
+    void post(struct HttpReq*, const char* = NULL, unsigned = 0) override {}
+    void cancel(HttpReq*) override {}
+    m_off_t postpos(void*) override { return {}; }
+    bool doio(void) override { return {}; }
+    void setuseragent(string*) override {}
+};
+
+// a sync of the simulated filesystem to a cloud folder, in a client that is never connected
+class Engine
+{
+public:
+    // time that passes before each syncdown() and syncup(), beyond the upload delay of changed files
+    static const dstime QUIET_DS = 100;
+
+    explicit Engine(SimFileSystem& fs)
+      : mFsAccess(fs)
+    {
+        client.reset(new MegaClient(&mApp, &mWaiter, &mHttpIo, &mFsAccess, nullptr, nullptr, "stress", "sync_stress", 0));
+        client->mSyncScanThreads = 0;
+
+        // logged in, so that the renames reach the cloud nodes
+        byte key[SymmCipher::KEYLENGTH] = { 1 };
+        client->key.setkey(key);
+        client->me = 0x5354524553;
+
+        Node* drive = newNode(ROOTNODE, UNDEF, string(), -1);
+        remoteRoot = newNode(FOLDERNODE, drive->nodehandle, "MEGA", -1);
+
+        LocalPath rootPath = LocalPath::fromPath(fs.root, mFsAccess);
+        LocalPath debris = LocalPath::fromPath(fs.root + "/.debris", mFsAccess);
+        SyncConfig config(rootPath, "stress", remoteRoot->nodeHandle(), string(), 0, LocalPath());
+
+        mUnifiedSync.reset(new UnifiedSync(*client, config));
+        mUnifiedSync->mSync.reset(new Sync(*mUnifiedSync, nullptr, &debris, remoteRoot, false));
+        sync = mUnifiedSync->mSync.get();
+    }
+
+    ~Engine()
+    {
+        // before the client, and that before the objects it uses
+        mUnifiedSync.reset();
+        client.reset();
+    }
+
+    // the initial scan of a new sync, as exec() does it without scan threads
+    bool scan()
+    {
+        LocalPath rootPath = sync->getConfig().getLocalPath();
+        auto fa = mFsAccess.newfileaccess(false);
+        if (!fa->fopen(rootPath, true, false) || !sync->scan(&rootPath, fa.get()))
+        {
+            return false;
+        }
+        sync->initializing = false;
+
+        if (!drain())
+        {
+            return false;
+        }
+
+        // as changestate() does, without telling the app
+        sync->state() = SYNC_ACTIVE;
+        sync->fullscan = false;
+        return true;
+    }
+
+    // processes the queued notifications as exec() does, moving the clock past the delays procscanq() asks for
+    bool drain()
+    {
+        auto& queue = sync->dirnotify->notifyq[DirNotify::DIREVENTS];
+        while (!queue.empty())
+        {
+            dstime delay = sync->procscanq(DirNotify::DIREVENTS);
+            if (!delay)
+            {
+                std::cerr << queue.size() << " notifications waiting for cloud nodes" << std::endl;
+                return false;
+            }
+            if (EVER(delay))
+            {
+                Waiter::ds += delay;
+            }
+        }
+        return true;
+    }
+
+    void notify(const string& path)
+    {
+        sync->dirnotify->notify(DirNotify::DIREVENTS, nullptr, LocalPath::fromPlatformEncoded(path));
+    }
+
+    // gives the local tree an identical cloud tree, returns the number of nodes
+    size_t mirror()
+    {
+        size_t count = 0;
+        vector<std::pair<LocalNode*, Node*>> folders{{ sync->localroot.get(), remoteRoot }};
+        while (!folders.empty())
+        {
+            auto folder = folders.back();
+            folders.pop_back();
+
+            for (auto& child : folder.first->children)
+            {
+                LocalNode* l = child.second;
+                Node* n = newNode(l->type, folder.second->nodehandle, l->name, l->type == FILENODE ? l->size : -1);
+                if (l->type == FILENODE)
+                {
+                    static_cast<FileFingerprint&>(*n) = *l;
+                    n->ctime = l->mtime;
+                }
+                else
+                {
+                    folders.emplace_back(l, n);
+                }
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    // LocalNodes paired with a cloud node
+    size_t linked() const
+    {
+        size_t count = 0;
+        vector<LocalNode*> folders{ sync->localroot.get() };
+        while (!folders.empty())
+        {
+            LocalNode* folder = folders.back();
+            folders.pop_back();
+
+            for (auto& child : folder->children)
+            {
+                count += child.second->node != nullptr;
+                if (child.second->type == FOLDERNODE)
+                {
+                    folders.push_back(child.second);
+                }
+            }
+        }
+        return count;
+    }
+
+    bool syncdown(bool dirtyonly)
+    {
+        Waiter::ds += QUIET_DS;
+        LocalPath localpath = sync->localroot->localname;
+        return client->syncdown(sync->localroot.get(), localpath, dirtyonly);
+    }
+
+    // returns the number of files and folders queued for upload or creation
+    size_t syncup(bool dirtyonly)
+    {
+        Waiter::ds += QUIET_DS;
+        dstime nds = NEVER;
+        client->syncup(sync->localroot.get(), &nds, dirtyonly);
+        return client->synccreate.size();
+    }
+
+    // as if the queued uploads had completed (there are no new folders in the storms)
+    void settle()
+    {
+        for (LocalNode* l : client->synccreate)
+        {
+            if (l->node && l->type == FILENODE)
+            {
+                static_cast<FileFingerprint&>(*l->node) = *l;
+            }
+            l->created = false;
+        }
+        client->synccreate.clear();
+    }
+
+    unique_ptr<MegaClient> client;
+    Sync* sync = nullptr;
+    Node* remoteRoot = nullptr;
+
+private:
+    Node* newNode(nodetype_t type, handle parent, const string& name, m_off_t size)
+    {
+        static const byte key[FILENODEKEYLENGTH] = { 2 };
+
+        node_vector dp;
+        Node* n = new Node(client.get(), &dp, ++mLastHandle, parent, type, size, client->me, nullptr, m_time());
+        n->setkey(key);
+        if (!name.empty())
+        {
+            n->attrs.map['n'] = name;
+        }
+        return n;
+    }
+
+    MegaApp mApp;
+    WAIT_CLASS mWaiter;
+    HttpIo mHttpIo;
+    SimFileSystemAccess mFsAccess;
+    unique_ptr<UnifiedSync> mUnifiedSync;
+    handle mLastHandle = 0;
+};
+
+// the files are spread round robin over the folders, so that file i is folders[i % folders.size()]/fileName(i)
+string fileName(size_t i, const char* suffix = "")
+{
+    return "IMG_" + std::to_string(i) + suffix + ".jpg";
+}
+
+vector<string> generate(SimFileSystem& fs, const Options& options)
+{
+    std::mt19937_64 rng(options.seed);
+    const m_time_t now = m_time();
+    const size_t needed = std::max<size_t>(1, (options.files + options.perFolder - 1) / std::max(1u, options.perFolder));
+
+    // breadth first, so that the first ones are right below the root
+    vector<string> folders;
+    std::deque<string> parents{ fs.root };
+    while (folders.size() < needed)
+    {
+        string parent = parents.front();
+        parents.pop_front();
+
+        for (unsigned i = 0; i < options.fanout && folders.size() < needed; ++i)
+        {
+            string path = parent + "/dir" + std::to_string(i);
+            fs.add(path, FOLDERNODE, 0, now - 86400);
+            folders.push_back(path);
+            parents.push_back(path);
+        }
+    }
+
+    for (size_t i = 0; i < options.files; ++i)
+    {
+        m_off_t size = 1 + m_off_t(rng() % uint64_t(options.maxSize));
+        m_time_t mtime = now - 86400 - m_time_t(rng() % (365 * 86400));
+        fs.add(folders[i % folders.size()] + '/' + fileName(i), FILENODE, size, mtime);
+    }
+    return folders;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        auto value = [&arg](const char* option) -> const char*
+        {
+            size_t n = strlen(option);
+            return arg.compare(0, n, option) ? nullptr : arg.c_str() + n;
+        };
+
+        if (auto v = value("--files="))             options.files = size_t(atoll(v));
+        else if (auto v = value("--per-folder="))   options.perFolder = unsigned(std::max(1, atoi(v)));
+        else if (auto v = value("--fanout="))       options.fanout = unsigned(std::max(1, atoi(v)));
+        else if (auto v = value("--max-size="))     options.maxSize = std::max<m_off_t>(1, atoll(v));
+        else if (auto v = value("--renames="))      options.renames = size_t(atoll(v));
+        else if (auto v = value("--saves="))        options.saves = size_t(atoll(v));
+        else if (auto v = value("--dirs="))         options.dirs = unsigned(atoi(v));
+        else if (auto v = value("--seed="))         options.seed = uint64_t(atoll(v));
+        else if (arg == "--full")                   options.full = true;
+        else return false;
+    }
+    return true;
+}
+
+string notificationCounts(Engine& engine, uint64_t& lastRaw, uint64_t& lastCoalesced)
+{
+    uint64_t raw, coalesced;
+    engine.sync->dirnotify->notifyq[DirNotify::DIREVENTS].counts(raw, coalesced);
+    string counts = std::to_string(raw - lastRaw) + " notifications, " + std::to_string(coalesced - lastCoalesced) + " coalesced";
+    lastRaw = raw;
+    lastCoalesced = coalesced;
+    return counts;
+}
+
+int run(const Options& options)
+{
+    Waiter::bumpds();
+
+    Phases phases;
+    SimFileSystem fs("/sim/MEGA");
+    vector<string> folders;
+
+    bool ok = phases.run("build", [&]()
+    {
+        folders = generate(fs, options);
+        return std::to_string(options.files) + " files in " + std::to_string(folders.size()) + " folders";
+    });
+
+    Engine engine(fs);
+    auto& stats = engine.client->performanceStats;
+    CodeCounter::ScopeStats* scopes[] = { &stats.syncProcscanq, &stats.syncCheckpath, &stats.syncdown, &stats.syncup };
+
+    // with the figures of the engine's timers during the phase
+    auto measure = [&](const char* name, std::function<string()> f)
+    {
+        for (auto scope : scopes)
+        {
+            scope->report(true);
+        }
+
+        bool success = phases.run(name, std::move(f));
+
+        for (auto scope : scopes)
+        {
+            if (scope->count)
+            {
+                phases.annotate(scope->name, scope->toJson());
+            }
+        }
+        return success;
+    };
+
+    uint64_t raw = 0, coalesced = 0;
+    size_t cloudNodes = 0;
+
+    ok = ok && measure("scan", [&]() -> string
+    {
+        if (!engine.scan())
+        {
+            return string();
+        }
+        return std::to_string(engine.sync->localnodes[FILENODE]) + " files, " + std::to_string(engine.sync->localnodes[FOLDERNODE])
+               + " folders, " + notificationCounts(engine, raw, coalesced);
+    });
+
+    ok = ok && measure("mirror", [&]()
+    {
+        cloudNodes = engine.mirror();
+        return std::to_string(cloudNodes) + " cloud nodes";
+    });
+
+    ok = ok && measure("link", [&]() { return engine.syncdown(false) ? string("full syncdown") : string(); });
+
+    if (ok && engine.linked() != cloudNodes)
+    {
+        std::cerr << "Only " << engine.linked() << " of " << cloudNodes << " LocalNodes were paired with their cloud node" << std::endl;
+        ok = false;
+    }
+
+    ok = ok && measure("syncup", [&]()
+    {
+        size_t queued = engine.syncup(false);
+        return queued ? string() : string("full syncup, in sync");
+    });
+
+    // the rest of the phases of a storm, once its notifications are queued
+    auto storm = [&](const string& name, size_t changes)
+    {
+        bool success = measure(name.c_str(), [&]() -> string
+        {
+            return engine.drain() ? std::to_string(changes) + " changes, " + notificationCounts(engine, raw, coalesced) : string();
+        });
+
+        success = success && measure((name + ".down").c_str(), [&]()
+        {
+            return engine.syncdown(!options.full) ? string(options.full ? "full" : "changed subtrees") : string();
+        });
+
+        success = success && measure((name + ".up").c_str(), [&]()
+        {
+            return std::to_string(engine.syncup(!options.full)) + " queued";
+        });
+
+        engine.settle();
+        return success;
+    };
+
+    const m_time_t now = m_time();
+
+    // renames in place, which keep the fsid
+    const size_t renames = std::min(options.renames, options.files / 2);
+    const size_t renameStride = renames ? options.files / renames : 0;
+    if (ok && renames)
+    {
+        for (size_t k = 0; k < renames; ++k)
+        {
+            size_t i = k * renameStride;
+            const string& folder = folders[i % folders.size()];
+            fs.rename(folder + '/' + fileName(i), folder + '/' + fileName(i, " renamed"), now);
+            engine.notify(folder + '/' + fileName(i));
+            engine.notify(folder + '/' + fileName(i, " renamed"));
+        }
+        ok = storm("rename", renames);
+    }
+
+    // editor saves: new contents in a temporary file, renamed over the original (other files than the renamed ones)
+    const size_t saves = std::min(options.saves, options.files / 2);
+    const size_t saveStride = saves ? options.files / saves : 0;
+    if (ok && saves)
+    {
+        std::mt19937_64 rng(options.seed + 1);
+        for (size_t k = 0; k < saves; ++k)
+        {
+            size_t i = k * saveStride + saveStride / 2;
+            const string& folder = folders[i % folders.size()];
+            string target = folder + '/' + fileName(i);
+            string temporary = folder + "/." + fileName(i) + ".tmp";
+
+            fs.add(temporary, FILENODE, 1 + m_off_t(rng() % uint64_t(options.maxSize)), now - 60);
+            engine.notify(temporary);   // created
+            engine.notify(temporary);   // written
+            fs.rename(temporary, target, now - 60);
+            engine.notify(temporary);
+            engine.notify(target);
+        }
+        ok = storm("save", saves);
+    }
+
+    // folders right below the root renamed (last, the paths of the folders change)
+    const unsigned dirs = std::min<unsigned>(options.dirs, unsigned(std::min<size_t>(options.fanout, folders.size())));
+    if (ok && dirs)
+    {
+        for (unsigned k = 0; k < dirs; ++k)
+        {
+            string path = fs.root + "/dir" + std::to_string(k);
+            fs.rename(path, path + " renamed", now);
+            engine.notify(path);
+            engine.notify(path + " renamed");
+        }
+        ok = storm("dirs", dirs);
+    }
+
+    std::cout << phases.toJson();
+    return ok ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::cerr << USAGE;
+        return 1;
+    }
+
+    try
+    {
+        return run(options);
+    }
+    catch (const mt::NotImplemented& e)
+    {
+        // the engine used something the simulated filesystem doesn't provide
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+#else
+
+int main()
+{
+    std::cerr << "tool_sync_stress needs a build with ENABLE_SYNC, and doesn't run on Windows" << std::endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,719 @@
+/**
+ * @file tests/tool/synthetic_account.cpp
+ * @brief Synthetic large accounts, to benchmark fetchnodes and the local cache offline
+ *
+ * (c) 2013-2021 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// generate <dir>: writes <dir>/fetchnodes.json, the response to the "f" command for a synthetic account, with the
+// node keys and attributes encrypted as the API sends them, <dir>/account.json with the credentials to decrypt it,
+// and the statecache database the SDK keeps after fetching it.
+//
+// replay <dir>: loads them into a MegaClient without any network, the way fetchnodes and a session resume do,
+// and reports the time and the peak resident memory of each phase: as a table on stderr and as JSON on stdout.
+
+#include "mega.h"
+
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#ifdef USE_SQLITE
+#include "mega/db/sqlite.h"
+#endif
+
+#include "phases.h"
+
+using namespace mega;
+
+namespace {
+
+const char* const USAGE =
+    "usage: tool_synthetic_account generate <dir> [--nodes=N] [--depth=N] [--fanout=N] [--folders=F]\n"
+    "                                             [--outshares=N] [--inshares=N] [--inshared=F] [--seed=N]\n"
+    "       tool_synthetic_account replay <dir> [--chunk=bytes] [--lazy] [--large-account] [--threads=N]\n"
+    "                                           [--search=text]\n";
+
+struct Options
+{
+    // generate
+    size_t nodes = 100000;
+    unsigned depth = 8;             // levels of folders below the root
+    unsigned fanout = 16;           // children per folder
+    double folders = 0.15;          // fraction of those that are folders
+    unsigned outshares = 4;         // folders right below the root shared with contacts
+    unsigned inshares = 4;          // folders shared by contacts
+    double inshared = 0.1;          // fraction of the nodes in those
+    uint64_t seed = 1;
+
+    // replay
+    size_t chunk = 1 << 20;         // bytes of the response at a time, as they arrive from the network
+    bool lazy = false;              // load the cached nodes on demand (MegaClient::mLazyNodeLoading)
+    bool largeAccount = false;      // MegaClient::setLargeAccountMode(), from the fetchnodes on
+    unsigned threads = 4;           // worker threads of the client
+    string search = "img_1";
+};
+
+struct Account
+{
+    byte key[SymmCipher::KEYLENGTH];
+    handle me = UNDEF;
+    string sid;
+};
+
+struct HttpIo : HttpIO
+{
+    void addevents(Waiter*, int) override {}
+    void post(struct HttpReq*, const char* = NULL, unsigned = 0) override {}
+    void cancel(HttpReq*) override {}
+    m_off_t postpos(void*) override { return {}; }
+    bool doio(void) override { return {}; }
+    void setuseragent(string*) override {}
+};
+
+// a client that is never connected, with the statecache in dir
+class OfflineClient
+{
+public:
+    OfflineClient(const Account& account, const string& dir, unsigned threads)
+    {
+        DbAccess* dbaccess = nullptr;
+#ifdef USE_SQLITE
+        dbaccess = new SqliteDbAccess(LocalPath::fromPath(dir, mFsAccess));
+#endif
+        // owns dbaccess
+        client.reset(new MegaClient(&mApp, nullptr, &mHttpIo, &mFsAccess, dbaccess, nullptr, "synthetic", "synthetic_account", threads));
+        client->key.setkey(account.key);
+        client->me = account.me;
+        client->sid = account.sid;
+    }
+
+    ~OfflineClient()
+    {
+        // before the objects it uses
+        client.reset();
+    }
+
+    unique_ptr<MegaClient> client;
+
+private:
+    MegaApp mApp;
+    FSACCESS_CLASS mFsAccess;
+    HttpIo mHttpIo;
+};
+
+using mt::Phases;
+
+// Writes the response to "f" for a tree of the given shape, breadth first from the root (so parents come before
+// their children, as the API sends them). Once the depth is exhausted, the folders get more files until the
+// number of nodes is reached.
+class Generator
+{
+public:
+    Generator(MegaClient& client, const Options& options, std::ostream& out)
+      : mClient(client)
+      , mOptions(options)
+      , mOut(out)
+      , mRng(options.seed)
+    {
+    }
+
+    size_t run()
+    {
+        handle root = nextHandle();
+
+        mOut << "[{\"f\":[";
+        writeRoot(root, ROOTNODE);
+        writeRoot(nextHandle(), INCOMINGNODE);
+        writeRoot(nextHandle(), RUBBISHNODE);
+
+        // a few contacts for the outbound shares (each inbound share gets its own sharing user)
+        for (int i = 0; i < 3; ++i)
+        {
+            mContacts.push_back(randomUserHandle());
+        }
+
+        size_t inshared = mOptions.inshares ? size_t(double(mOptions.nodes) * mOptions.inshared) : 0;
+        size_t own = mOptions.nodes > inshared + mWritten ? mOptions.nodes - inshared - mWritten : 0;
+
+        tree(root, -1, own);
+
+        for (unsigned i = 0; i < mOptions.inshares; ++i)
+        {
+            size_t budget = inshared / mOptions.inshares + (i < inshared % mOptions.inshares);
+            if (!budget)
+            {
+                continue;
+            }
+
+            handle h = nextHandle();
+            int share = newShare(h, randomUserHandle());
+            writeNode(h, nextHandle(), FOLDERNODE, share, true);
+            tree(h, share, budget - 1);
+        }
+
+        mOut << "],\"ok\":[";
+        bool first = true;
+        for (const Share& s : mShares)
+        {
+            if (ISUNDEF(s.owner))
+            {
+                byte auth[SymmCipher::BLOCKSIZE];
+                mClient.handleauth(s.h, auth);
+                mOut << (first ? "" : ",") << "{\"h\":\"" << Base64Str<MegaClient::NODEHANDLE>(s.h) << "\",\"k\":\""
+                     << encryptKey(mClient.key, s.key, SymmCipher::KEYLENGTH) << "\",\"ha\":\""
+                     << Base64::btoa(string(reinterpret_cast<char*>(auth), sizeof auth)) << "\"}";
+                first = false;
+            }
+        }
+
+        mOut << "],\"s\":[";
+        first = true;
+        for (size_t i = 0; i < mShares.size(); ++i)
+        {
+            if (ISUNDEF(mShares[i].owner))
+            {
+                mOut << (first ? "" : ",") << "{\"h\":\"" << Base64Str<MegaClient::NODEHANDLE>(mShares[i].h)
+                     << "\",\"u\":\"" << Base64Str<MegaClient::USERHANDLE>(mContacts[i % mContacts.size()])
+                     << "\",\"r\":1,\"ts\":" << TIMESTAMP << "}";
+                first = false;
+            }
+        }
+
+        handle scsn;
+        randomBytes(reinterpret_cast<byte*>(&scsn), sizeof scsn);
+        mOut << "],\"sn\":\"" << Base64Str<sizeof scsn>(scsn) << "\"}]";
+
+        return mWritten;
+    }
+
+private:
+    static const m_time_t TIMESTAMP = 1600000000;
+
+    struct Folder
+    {
+        handle h;
+        unsigned depth;
+        int share;      // index in mShares, -1 if none
+    };
+
+    struct Share
+    {
+        handle h;
+        handle owner;   // UNDEF for outbound shares
+        byte key[SymmCipher::KEYLENGTH];
+        unique_ptr<SymmCipher> cipher;
+    };
+
+    void tree(handle root, int share, size_t budget)
+    {
+        std::deque<Folder> queue{{root, 0, share}};
+        vector<Folder> folders{queue.front()};
+        const unsigned subfolders = mOptions.folders > 0 ? std::max(1u, unsigned(mOptions.fanout * mOptions.folders + 0.5)) : 0;
+        size_t written = 0;
+
+        while (written < budget)
+        {
+            if (queue.empty())
+            {
+                queue.assign(folders.begin(), folders.end());
+            }
+
+            Folder parent = queue.front();
+            queue.pop_front();
+
+            for (unsigned i = 0; i < mOptions.fanout && written < budget; ++i, ++written)
+            {
+                handle h = nextHandle();
+                bool isFolder = i < subfolders && parent.depth < mOptions.depth;
+                int childShare = parent.share;
+
+                if (isFolder && share < 0 && !parent.depth && outboundShares() < mOptions.outshares)
+                {
+                    childShare = newShare(h, UNDEF);
+                }
+
+                writeNode(h, parent.h, isFolder ? FOLDERNODE : FILENODE, childShare, false);
+
+                if (isFolder)
+                {
+                    queue.push_back({h, parent.depth + 1, childShare});
+                    folders.push_back(queue.back());
+                }
+            }
+        }
+    }
+
+    void writeRoot(handle h, nodetype_t type)
+    {
+        mOut << (mWritten++ ? "," : "") << "{\"h\":\"" << Base64Str<MegaClient::NODEHANDLE>(h)
+             << "\",\"p\":\"\",\"u\":\"" << Base64Str<MegaClient::USERHANDLE>(mClient.me)
+             << "\",\"t\":" << type << ",\"a\":\"\",\"k\":\"\",\"ts\":" << TIMESTAMP << "}";
+    }
+
+    void writeNode(handle h, handle parent, nodetype_t type, int share, bool inshareRoot)
+    {
+        const Share* s = share < 0 ? nullptr : &mShares[size_t(share)];
+        const bool inbound = s && !ISUNDEF(s->owner);
+        const m_time_t ts = TIMESTAMP + m_time_t(mWritten);
+
+        byte key[FILENODEKEYLENGTH];
+        const int keylength = type == FILENODE ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH;
+        randomBytes(key, size_t(keylength));
+
+        // the attributes, encrypted with the node key
+        std::ostringstream attrs;
+        m_off_t size = 0;
+        unsigned n = unsigned(mWritten);
+        if (type == FOLDERNODE)
+        {
+            static const char* const names[] = { "Folder ", "Photos ", "Projects ", "Backup " };
+            attrs << "\"n\":\"" << names[n % 4] << n << '"';
+        }
+        else
+        {
+            static const char* const names[] = { "IMG_", "Document ", "notes-", "VID_" };
+            static const char* const extensions[] = { ".jpg", ".pdf", ".txt", ".mp4" };
+
+            size = m_off_t(mRng() % (uint64_t(1) << (10 + mRng() % 17)));
+
+            FileFingerprint ffp;
+            ffp.size = size;
+            ffp.mtime = ts;
+            randomBytes(reinterpret_cast<byte*>(ffp.crc.data()), sizeof ffp.crc);
+            ffp.isvalid = true;
+            string fingerprint;
+            ffp.serializefingerprint(&fingerprint);
+
+            attrs << "\"n\":\"" << names[n % 4] << std::setw(5) << std::setfill('0') << n << extensions[n % 4]
+                  << "\",\"c\":\"" << fingerprint << '"';
+        }
+
+        SymmCipher nodecipher;
+        nodecipher.setkey(key, type);
+        string attrstring;
+        mClient.makeattr(&nodecipher, &attrstring, attrs.str().c_str());
+
+        // the key, encrypted with the master key and/or the key of the share it is in
+        string k;
+        if (!inbound)
+        {
+            k = string(Base64Str<MegaClient::USERHANDLE>(mClient.me)) + ":" + encryptKey(mClient.key, key, size_t(keylength));
+        }
+        if (s && (inbound || s->h != h))
+        {
+            k += (k.empty() ? "" : "/") + string(Base64Str<MegaClient::NODEHANDLE>(s->h)) + ":" + encryptKey(*s->cipher, key, size_t(keylength));
+        }
+
+        mOut << (mWritten++ ? "," : "") << "{\"h\":\"" << Base64Str<MegaClient::NODEHANDLE>(h)
+             << "\",\"p\":\"" << Base64Str<MegaClient::NODEHANDLE>(parent)
+             << "\",\"u\":\"" << Base64Str<MegaClient::USERHANDLE>(inbound ? s->owner : mClient.me)
+             << "\",\"t\":" << type
+             << ",\"a\":\"" << Base64::btoa(attrstring)
+             << "\",\"k\":\"" << k << '"';
+
+        if (type == FILENODE)
+        {
+            mOut << ",\"s\":" << size;
+            if (n % 4 == 0)
+            {
+                mOut << ",\"fa\":\"" << n % 1000 << ":0*" << Base64Str<8>(h) << '/' << n % 1000 << ":1*" << Base64Str<8>(~h) << '"';
+            }
+        }
+
+        if (inshareRoot)
+        {
+            mOut << ",\"su\":\"" << Base64Str<MegaClient::USERHANDLE>(s->owner)
+                 << "\",\"sk\":\"" << encryptKey(mClient.key, s->key, SymmCipher::KEYLENGTH)
+                 << "\",\"r\":1,\"sts\":" << ts;
+        }
+
+        mOut << ",\"ts\":" << ts << "}";
+    }
+
+    int newShare(handle h, handle owner)
+    {
+        Share s;
+        s.h = h;
+        s.owner = owner;
+        randomBytes(s.key, sizeof s.key);
+        s.cipher.reset(new SymmCipher(s.key));
+        mShares.push_back(std::move(s));
+        return int(mShares.size() - 1);
+    }
+
+    unsigned outboundShares() const
+    {
+        return unsigned(std::count_if(mShares.begin(), mShares.end(), [](const Share& s) { return ISUNDEF(s.owner); }));
+    }
+
+    static string encryptKey(SymmCipher& cipher, const byte* key, size_t length)
+    {
+        byte buf[FILENODEKEYLENGTH];
+        memcpy(buf, key, length);
+        cipher.ecb_encrypt(buf, nullptr, length);
+        return Base64::btoa(string(reinterpret_cast<char*>(buf), length));
+    }
+
+    // distinct and never 0: the multiplier is odd, so this is a bijection of the low 48 bits
+    handle nextHandle()
+    {
+        return (++mHandles * 0x9E3779B97F4A7C15ull) & 0xFFFFFFFFFFFFull;
+    }
+
+    handle randomUserHandle()
+    {
+        handle h;
+        randomBytes(reinterpret_cast<byte*>(&h), sizeof h);
+        return h;
+    }
+
+    void randomBytes(byte* data, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            data[i] = byte(mRng());
+        }
+    }
+
+    MegaClient& mClient;
+    const Options& mOptions;
+    std::ostream& mOut;
+    std::mt19937_64 mRng;
+    uint64_t mHandles = 0;
+    size_t mWritten = 0;
+    vector<Share> mShares;
+    vector<handle> mContacts;
+};
+
+string joinPath(const string& dir, const char* name)
+{
+    return dir + "/" + name;
+}
+
+bool writeAccount(const string& dir, const Account& account, size_t nodes)
+{
+    std::ofstream out(joinPath(dir, "account.json"));
+    out << "{\"me\":\"" << Base64Str<MegaClient::USERHANDLE>(account.me)
+        << "\",\"k\":\"" << Base64::btoa(string(reinterpret_cast<const char*>(account.key), sizeof account.key))
+        << "\",\"sid\":\"" << Base64::btoa(account.sid)
+        << "\",\"nodes\":" << nodes << "}\n";
+    return bool(out);
+}
+
+bool readAccount(const string& dir, Account& account)
+{
+    std::ifstream in(joinPath(dir, "account.json"));
+    string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    JSON json(data);
+    if (!json.enterobject())
+    {
+        return false;
+    }
+
+    for (;;)
+    {
+        switch (json.getnameid())
+        {
+            case MAKENAMEID2('m', 'e'):
+                account.me = json.gethandle(MegaClient::USERHANDLE);
+                break;
+
+            case 'k':
+                if (json.storebinary(account.key, sizeof account.key) != int(sizeof account.key))
+                {
+                    return false;
+                }
+                break;
+
+            case MAKENAMEID3('s', 'i', 'd'):
+                json.storebinary(&account.sid);
+                break;
+
+            case EOO:
+                return !ISUNDEF(account.me) && account.sid.size() >= MegaClient::SIDLEN;
+
+            default:
+                if (!json.storeobject())
+                {
+                    return false;
+                }
+        }
+    }
+}
+
+// feeds the response to the client as it would arrive from the network, then reads the rest of it as
+// CommandFetchNodes does
+string fetchnodes(MegaClient& client, const string& path, size_t chunk)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return string();
+    }
+
+    client.mFetchNodesStream.reset(new MegaClient::FetchNodesStream);
+
+    HttpReq req;
+    vector<char> buf(chunk);
+    while (file.read(buf.data(), std::streamsize(buf.size())) || file.gcount())
+    {
+        req.put(buf.data(), unsigned(file.gcount()), true);
+        client.streamfetchnodes(&req, false);
+    }
+    client.streamfetchnodes(&req, true);
+
+    if (client.mFetchNodesStream->state != MegaClient::FetchNodesStream::DONE)
+    {
+        return string();
+    }
+
+    JSON json(req.in);
+    if (!json.enterarray() || !json.enterobject())
+    {
+        return string();
+    }
+
+    for (;;)
+    {
+        switch (json.getnameid())
+        {
+            case MAKENAMEID2('o', 'k'):
+                client.readok(&json);
+                break;
+
+            case 's':
+                client.readoutshares(&json);
+                break;
+
+            case MAKENAMEID2('s', 'n'):
+                if (!client.scsn.setScsn(&json))
+                {
+                    return string();
+                }
+                break;
+
+            case EOO:
+                client.mergenewshares(0);
+                return client.scsn.ready() ? std::to_string(client.nodes.size()) + " nodes" : string();
+
+            default:
+                if (!json.storeobject())
+                {
+                    return string();
+                }
+        }
+    }
+}
+
+string applykeys(MegaClient& client)
+{
+    client.applykeys();
+    return std::to_string(client.mAppliedKeyNodeCount) + " keys applied";
+}
+
+// writes the whole tree to the statecache, as at the end of fetchnodes
+string savesc(MegaClient& client)
+{
+    client.opensctable();
+    if (!client.sctable)
+    {
+        return string();
+    }
+
+    client.initsc();
+    if (!client.sctable)
+    {
+        return string();
+    }
+
+    client.sctable->commit();
+    client.sctable->begin();
+    return std::to_string(client.nodes.size()) + " nodes";
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 3; i < argc; ++i)
+    {
+        string arg = argv[i];
+        auto value = [&arg](const char* option) -> const char*
+        {
+            size_t n = strlen(option);
+            return arg.compare(0, n, option) ? nullptr : arg.c_str() + n;
+        };
+
+        if (auto v = value("--nodes="))             options.nodes = size_t(atoll(v));
+        else if (auto v = value("--depth="))        options.depth = unsigned(atoi(v));
+        else if (auto v = value("--fanout="))       options.fanout = unsigned(std::max(1, atoi(v)));
+        else if (auto v = value("--folders="))      options.folders = atof(v);
+        else if (auto v = value("--outshares="))    options.outshares = unsigned(atoi(v));
+        else if (auto v = value("--inshares="))     options.inshares = unsigned(atoi(v));
+        else if (auto v = value("--inshared="))     options.inshared = atof(v);
+        else if (auto v = value("--seed="))         options.seed = uint64_t(atoll(v));
+        else if (auto v = value("--chunk="))        options.chunk = size_t(std::max(1ll, atoll(v)));
+        else if (auto v = value("--threads="))      options.threads = unsigned(atoi(v));
+        else if (auto v = value("--search="))       options.search = v;
+        else if (arg == "--lazy")                   options.lazy = true;
+        else if (arg == "--large-account")          options.largeAccount = true;
+        else return false;
+    }
+    return true;
+}
+
+int generate(const string& dir, const Options& options)
+{
+    Account account;
+    std::mt19937_64 rng(options.seed ^ 0x5eed);
+    for (byte& b : account.key)
+    {
+        b = byte(rng());
+    }
+    account.me = rng();
+    for (unsigned i = 0; i < MegaClient::SIDLEN; ++i)
+    {
+        account.sid.push_back(char(rng()));
+    }
+
+    OfflineClient offline(account, dir, options.threads);
+    MegaClient& client = *offline.client;
+    Phases phases;
+
+    const string response = joinPath(dir, "fetchnodes.json");
+    bool ok = phases.run("generate", [&]()
+    {
+        std::ofstream out(response, std::ios::binary);
+        size_t nodes = Generator(client, options, out).run();
+        out.close();
+        return out && writeAccount(dir, account, nodes) ? std::to_string(nodes) + " nodes" : string();
+    });
+
+    ok = ok && phases.run("fetchnodes", [&]() { return fetchnodes(client, response, options.chunk); });
+    ok = ok && phases.run("applykeys", [&]() { return applykeys(client); });
+    ok = ok && phases.run("savesc", [&]() { return savesc(client); });
+
+    std::cout << phases.toJson();
+    return ok ? 0 : 1;
+}
+
+int replay(const string& dir, const Options& options)
+{
+    Account account;
+    if (!readAccount(dir, account))
+    {
+        std::cerr << "Unable to read " << joinPath(dir, "account.json") << std::endl;
+        return 1;
+    }
+
+    Phases phases;
+    bool ok;
+
+    {
+        OfflineClient offline(account, dir, options.threads);
+        MegaClient& client = *offline.client;
+        client.setLargeAccountMode(options.largeAccount);
+
+        ok = phases.run("fetchnodes", [&]() { return fetchnodes(client, joinPath(dir, "fetchnodes.json"), options.chunk); });
+        ok = ok && phases.run("applykeys", [&]() { return applykeys(client); });
+        ok = ok && phases.run("savesc", [&]() { return savesc(client); });
+        ok = ok && phases.run("logout", [&]()
+        {
+            offline.client.reset();
+            return string("done");
+        });
+    }
+
+    if (ok)
+    {
+        OfflineClient offline(account, dir, options.threads);
+        MegaClient& client = *offline.client;
+        client.setLargeAccountMode(options.largeAccount);
+        client.mLazyNodeLoading = options.lazy || options.largeAccount;
+
+        ok = phases.run("fetchsc", [&]() -> string
+        {
+            client.checkForResumeableSCDatabase();
+            if (!client.sctable || ISUNDEF(client.cachedscsn) || !client.fetchsc(client.sctable.get()))
+            {
+                return string();
+            }
+            return std::to_string(client.nodes.size()) + " nodes loaded";
+        });
+        ok = ok && phases.run("browse", [&]() -> string
+        {
+            // what an app shows first: the root and the folders right below it
+            Node* root = client.nodebyhandle(client.rootnodes[0]);
+            if (!root)
+            {
+                return string();
+            }
+
+            size_t listed = root->children.size();
+            for (Node* child : root->children)
+            {
+                if (child->type == FOLDERNODE)
+                {
+                    listed += child->children.size();
+                }
+            }
+            return std::to_string(listed) + " nodes listed, " + std::to_string(client.nodes.size()) + " loaded";
+        });
+        ok = ok && phases.run("loadall", [&]()
+        {
+            client.loadAllCachedNodes();
+            return std::to_string(client.nodes.size()) + " nodes";
+        });
+        ok = ok && phases.run("search", [&]()
+        {
+            vector<handle> results;
+            client.nodeNames().find(options.search.c_str(), results);
+            return std::to_string(results.size()) + " matches";
+        });
+    }
+
+    std::cout << phases.toJson();
+    return ok ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (argc < 3 || !parseOptions(argc, argv, options))
+    {
+        std::cerr << USAGE;
+        return 1;
+    }
+
+    string command = argv[1];
+    if (command == "generate")
+    {
+        return generate(argv[2], options);
+    }
+    if (command == "replay")
+    {
+        return replay(argv[2], options);
+    }
+
+    std::cerr << USAGE;
+    return 1;
+}
@@ -20,10 +20,13 @@
  */
 
 #include <asio.hpp>
+#include <cstring>
 #include <fstream>
 #include <thread>
 #include <chrono>
 #include <deque>
+#include <future>
+#include <map>
 #include <vector>
 #include <mutex>
 #include "tcprelay.h"
@@ -31,8 +34,10 @@
 #include <mega.h>
 #include <mega/autocomplete.h>
 #include <mega/logging.h>
+#include <mega/testhooks.h>
 #include <iomanip>
 #include <regex>
+#include <sstream>
 
 #ifndef NO_READLINE
 #include <readline/readline.h>
@@ -47,6 +52,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <sys/resource.h>
 #endif /* ! _WIN32 */
 
 using namespace std;
@@ -75,6 +81,7 @@ struct RelayRunner
     asio::io_service asio_service;											// a single service object so all socket callbacks are serviced by just one thread
     std::unique_ptr<asio::io_service::work> asio_dont_exit;
     asio::steady_timer logTimer;
+    bool logging = true;
     bool stopped = false;
     asio::steady_timer send_rate_timer;
 
@@ -82,6 +89,10 @@ struct RelayRunner
     vector<unique_ptr<TcpRelayAcceptor>> relayacceptors;
     vector<unique_ptr<TcpRelay>> acceptedrelays;
 
+    // for the acceptors added from now on
+    NetworkConditions conditions;
+    size_t bytespersec = 0;
+
     RelayRunner()
         : asio_dont_exit(std::make_unique<asio::io_service::work>(asio_service))
         , logTimer(asio_service)
@@ -91,7 +102,7 @@ struct RelayRunner
         QueueRateTimer();
     }
 
-    void AddAcceptor(const string& name, uint16_t port, asio::ip::address_v6 targetAddress, bool start)
+    TcpRelayAcceptor* AddAcceptor(const string& name, uint16_t port, asio::ip::address_v6 targetAddress, bool start)
     {
         lock_guard<mutex> g(relaycollectionmutex);
         relayacceptors.emplace_back(new TcpRelayAcceptor(asio_service, name, port, asio::ip::tcp::endpoint(targetAddress, 80),
@@ -104,10 +115,14 @@ struct RelayRunner
 
         cout << "Acceptor active on " << port << ", relaying to " << name << endl;
 
+        if (bytespersec > 0) relayacceptors.back()->SetBytesPerSecond(bytespersec);
+        relayacceptors.back()->SetNetworkConditions(conditions);
+
         if (start)
         {
             relayacceptors.back()->Start();
         }
+        return relayacceptors.back().get();
     }
 
     void RunRelays()
@@ -130,6 +145,7 @@ struct RelayRunner
 
     void Log()
     {
+        if (!logging) return StartLogTimer();
         lock_guard<mutex> g(relaycollectionmutex);
         size_t eversent = 0, everreceived = 0;
         size_t sendRate = 0, receiveRate = 0;
@@ -178,12 +194,36 @@ struct RelayRunner
         QueueRateTimer();
     }
 
+    // the CPU time of the relays, so it can be told apart from that of the program under test
+    double CpuSeconds()
+    {
+        promise<double> p;
+        asio_service.post([&p]() { p.set_value(ThreadCpuSeconds()); });
+        return p.get_future().get();
+    }
+
+    static double ThreadCpuSeconds()
+    {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+        return (ULARGE_INTEGER{ { kernel.dwLowDateTime, kernel.dwHighDateTime } }.QuadPart +
+                ULARGE_INTEGER{ { user.dwLowDateTime, user.dwHighDateTime } }.QuadPart) / 1e7;
+#elif defined(RUSAGE_THREAD)
+        struct rusage usage;
+        getrusage(RUSAGE_THREAD, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#else
+        return 0;
+#endif
+    }
+
 };
 
 RelayRunner g_relays;
 
 
-void addRelay(const string& server, uint16_t port)
+TcpRelayAcceptor* addRelay(const string& server, uint16_t port)
 {
     using asio::ip::make_address_v4;
     using asio::ip::make_address_v6;
@@ -205,7 +245,7 @@ void addRelay(const string& server, uint16_t port)
     if (getaddrinfo(server.c_str(), nullptr, &hints, &result) != 0)
     {
         cout << "dns error" << endl;
-        return;
+        return nullptr;
     }
 
     // Construct a v4-mapped IPv6 address.
@@ -220,7 +260,7 @@ void addRelay(const string& server, uint16_t port)
     freeaddrinfo(result);
 
     // Add the relay.
-    g_relays.AddAcceptor(server, port, address, true);
+    return g_relays.AddAcceptor(server, port, address, true);
 }
 
 
@@ -568,6 +608,34 @@ void exec_acceptorspeed(ac::ACState& ac)
     }
 }
 
+void exec_netem(ac::ACState& ac)
+{
+    bool all = ac.words[1].s == "all";
+    regex specific_re(ac.words[1].s);
+    NetworkConditions c;
+    c.latencyMs = unsigned(atoi(ac.words[2].s.c_str()));
+    c.jitterMs = unsigned(atoi(ac.words[3].s.c_str()));
+    c.lossPercent = atof(ac.words[4].s.c_str());
+    lock_guard<mutex> g(g_relays.relaycollectionmutex);
+    for (auto& r : g_relays.relayacceptors)
+    {
+        if (all || std::regex_match(r->reporting_name, specific_re))
+        {
+            r->SetNetworkConditions(c);
+        }
+    }
+    for (auto& r : g_relays.acceptedrelays)
+    {
+        if (!r->stopped && (all || std::regex_match(r->reporting_name, specific_re)))
+        {
+            g_relays.asio_service.post([p = r.get(), c]() { p->SetNetworkConditions(c); });
+        }
+    }
+    if (all)
+    {
+        g_relays.conditions = c;
+    }
+}
 
 void exec_report(ac::ACState& ac)
 {
@@ -615,6 +683,7 @@ ac::ACN autocompleteSyntax()
     p->Add(exec_addbulkrelays, sequence(text("addbulkrelays")));
     
     p->Add(exec_acceptorspeed, sequence(text("acceptorspeed"), either(text("all"), param("id")), param("bytespersec")));
+    p->Add(exec_netem, sequence(text("netem"), either(text("all"), param("id")), param("latency-ms"), param("jitter-ms"), param("loss-percent")));
     p->Add(exec_getjavascript, sequence(text("getjavascript")));
     p->Add(exec_getcpp, sequence(text("getc++")));
 
@@ -736,6 +805,344 @@ void store_line(char* l)
 
 #endif /* ! NO_READLINE */
 
+#ifdef MEGASDK_DEBUG_TEST_HOOKS_ENABLED
+
+// Transfer benchmark: MegaApi uploads and downloads, with the storage servers reached through relays that emulate a network.
+// Run as: tool_tcprelay bench --upload=<file> | --download=<cloud path> [options], with the account in MEGA_EMAIL / MEGA_PWD.
+// The results are written as JSON to --out=<file> (default transferbench.json) and as a table to stderr.
+namespace transferbench {
+
+struct Scenario
+{
+    const char* name;
+    size_t bytespersec;         // per connection, 0 for unlimited
+    NetworkConditions conditions;
+    size_t slowbytespersec;     // of one storage server of the first download, 0 for none
+};
+
+const Scenario scenarios[] = {
+    { "none",      0,          { 0, 0, 0 },    0 },
+    { "lan",       0,          { 1, 0, 0 },    0 },
+    { "broadband", 2 << 20,    { 20, 5, 0 },   0 },
+    { "mobile",    512 << 10,  { 60, 20, 0.5 }, 0 },
+    { "lossy",     1 << 20,    { 40, 10, 2 },  0 },
+    { "slowraid",  2 << 20,    { 20, 5, 0 },   64 << 10 },
+};
+
+struct Options
+{
+    Scenario scenario = scenarios[0];
+    string upload;
+    string download;
+    string target = ".";
+    string out = "transferbench.json";
+    int repetitions = 3;
+};
+
+Options options;
+
+mutex relayportsmutex;
+map<string, uint16_t> relayports;
+bool slowassigned = false;
+
+uint16_t relayPort(const string& host, bool download)
+{
+    lock_guard<mutex> g(relayportsmutex);
+    auto it = relayports.find(host);
+    if (it != relayports.end())
+    {
+        return it->second;
+    }
+
+    auto acceptor = addRelay(host, g_nextPort);
+    if (!acceptor)
+    {
+        return 0;
+    }
+    if (download && options.scenario.slowbytespersec && !slowassigned)
+    {
+        // a raid download asks for its parts in order, so this one serves the first part
+        acceptor->SetBytesPerSecond(options.scenario.slowbytespersec);
+        slowassigned = true;
+        cerr << "slow server: " << host << endl;
+    }
+    return relayports[host] = g_nextPort++;
+}
+
+// the storage servers are reached through relays, added as their hosts are met; the API is reached directly
+bool onHttpReqPost(HttpReq* req)
+{
+    string& url = req->posturl;
+    auto hoststart = url.find("://");
+    if (hoststart == string::npos)
+    {
+        return false;
+    }
+    hoststart += 3;
+    auto hostend = url.find_first_of(":/", hoststart);
+    string host = url.substr(hoststart, hostend == string::npos ? string::npos : hostend - hoststart);
+    if (host.find("userstorage") == string::npos)
+    {
+        return false;
+    }
+
+    if (auto port = relayPort(host, dynamic_cast<HttpReqDL*>(req) != nullptr))
+    {
+        auto pathstart = url.find('/', hoststart);
+        url = "http://localhost:" + to_string(port) + (pathstart == string::npos ? string("/") : url.substr(pathstart));
+    }
+    return false;  // post it, through the relay
+}
+
+double processCpuSeconds()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    return (ULARGE_INTEGER{ { kernel.dwLowDateTime, kernel.dwHighDateTime } }.QuadPart +
+            ULARGE_INTEGER{ { user.dwLowDateTime, user.dwHighDateTime } }.QuadPart) / 1e7;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+// the CPU of the process, less that of the relays
+double sdkCpuSeconds()
+{
+    return processCpuSeconds() - g_relays.CpuSeconds();
+}
+
+class TimedTransferListener : public SynchronousTransferListener
+{
+public:
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    chrono::steady_clock::time_point firstbyte;
+    double startcpu = sdkCpuSeconds();
+
+    void onTransferUpdate(MegaApi*, MegaTransfer* transfer) override
+    {
+        if (firstbyte == chrono::steady_clock::time_point() && transfer->getTransferredBytes() > 0)
+        {
+            firstbyte = chrono::steady_clock::now();
+        }
+    }
+};
+
+struct Result
+{
+    string direction;
+    int repetition = 0;
+    int error = 0;
+    long long bytes = 0;
+    double seconds = 0;
+    double ttfbms = 0;
+    double cpuseconds = 0;
+
+    double bytesPerSecond() const { return seconds > 0 ? bytes / seconds : 0; }
+    double cpuSecondsPerGB() const { return bytes > 0 ? cpuseconds * (1 << 30) / bytes : 0; }
+};
+
+Result finish(const char* direction, int repetition, TimedTransferListener& listener)
+{
+    listener.wait();
+    auto now = chrono::steady_clock::now();
+
+    Result r;
+    r.direction = direction;
+    r.repetition = repetition;
+    r.error = listener.getError()->getErrorCode();
+    r.bytes = listener.getTransfer()->getTotalBytes();
+    r.seconds = chrono::duration<double>(now - listener.started).count();
+    r.ttfbms = listener.firstbyte == chrono::steady_clock::time_point() ? 0 :
+               chrono::duration<double, milli>(listener.firstbyte - listener.started).count();
+    r.cpuseconds = sdkCpuSeconds() - listener.startcpu;
+
+    cerr << left << setw(10) << r.direction << right << setw(4) << r.repetition << fixed << setprecision(1)
+         << setw(10) << r.bytesPerSecond() / (1 << 20) << " MB/s"
+         << setw(10) << r.ttfbms << " ms ttfb"
+         << setw(10) << setprecision(2) << r.cpuSecondsPerGB() << " cpu s/GB"
+         << (r.error ? string("  error ") + listener.getError()->getErrorString() : string()) << endl;
+    return r;
+}
+
+string toJson(const vector<Result>& results)
+{
+    const Scenario& s = options.scenario;
+    ostringstream json;
+    json << fixed << setprecision(3);
+    json << "{\"context\":{\"scenario\":\"" << s.name << '"'
+         << ",\"date\":" << m_time(nullptr)
+         << ",\"bytes_per_second\":" << s.bytespersec
+         << ",\"latency_ms\":" << s.conditions.latencyMs
+         << ",\"jitter_ms\":" << s.conditions.jitterMs
+         << ",\"loss_percent\":" << s.conditions.lossPercent
+         << ",\"slow_server_bytes_per_second\":" << s.slowbytespersec
+         << "},\"transfers\":[";
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        json << (i ? "," : "")
+             << "{\"direction\":\"" << r.direction << '"'
+             << ",\"repetition\":" << r.repetition
+             << ",\"error\":" << r.error
+             << ",\"bytes\":" << r.bytes
+             << ",\"seconds\":" << r.seconds
+             << ",\"bytes_per_second\":" << r.bytesPerSecond()
+             << ",\"ttfb_ms\":" << r.ttfbms
+             << ",\"cpu_seconds_per_gb\":" << r.cpuSecondsPerGB()
+             << '}';
+    }
+    json << "]}\n";
+    return json.str();
+}
+
+bool parse(int argc, char* argv[])
+{
+    for (int i = 2; i < argc; ++i)
+    {
+        string arg = argv[i];
+        auto value = [&arg](const char* option) -> const char*
+        {
+            size_t n = strlen(option);
+            return arg.compare(0, n, option) ? nullptr : arg.c_str() + n;
+        };
+
+        if (auto v = value("--scenario="))
+        {
+            auto it = find_if(begin(scenarios), end(scenarios), [v](const Scenario& s) { return !strcmp(s.name, v); });
+            if (it == end(scenarios)) return false;
+            options.scenario = *it;
+        }
+        else if (auto v = value("--bandwidth="))     options.scenario.bytespersec = size_t(atoll(v));
+        else if (auto v = value("--latency="))       options.scenario.conditions.latencyMs = unsigned(atoi(v));
+        else if (auto v = value("--jitter="))        options.scenario.conditions.jitterMs = unsigned(atoi(v));
+        else if (auto v = value("--loss="))          options.scenario.conditions.lossPercent = atof(v);
+        else if (auto v = value("--slowserver="))    options.scenario.slowbytespersec = size_t(atoll(v));
+        else if (auto v = value("--upload="))        options.upload = v;
+        else if (auto v = value("--download="))      options.download = v;
+        else if (auto v = value("--target="))        options.target = v;
+        else if (auto v = value("--out="))           options.out = v;
+        else if (auto v = value("--repetitions="))   options.repetitions = max(1, atoi(v));
+        else return false;
+    }
+    return !options.upload.empty() || !options.download.empty();
+}
+
+int run(int argc, char* argv[])
+{
+    if (!parse(argc, argv))
+    {
+        cerr << "usage: " << argv[0] << " bench --upload=<file> | --download=<cloud path> [--scenario=none|lan|broadband|mobile|lossy|slowraid]" << endl
+             << "       [--bandwidth=<bytes/s per connection>] [--latency=<ms>] [--jitter=<ms>] [--loss=<percent>] [--slowserver=<bytes/s>]" << endl
+             << "       [--target=<download folder>] [--repetitions=<n>] [--out=<file>]" << endl;
+        return 1;
+    }
+
+    const char* email = getenv("MEGA_EMAIL");
+    const char* password = getenv("MEGA_PWD");
+    if (!email || !password)
+    {
+        cerr << "MEGA_EMAIL and MEGA_PWD must be set" << endl;
+        return 1;
+    }
+
+    g_showrequest = false;
+    g_relays.logging = false;
+    g_relays.bytespersec = options.scenario.bytespersec;
+    g_relays.conditions = options.scenario.conditions;
+    globalMegaTestHooks.onHttpReqPost = onHttpReqPost;
+
+    std::thread relayRunnerThread([&]() { g_relays.RunRelays(); });
+
+    vector<Result> results;
+    {
+        MegaApi api("8QxzVRxD", (const char*)nullptr, "tcprelay transfer bench");
+
+        SynchronousRequestListener login;
+        api.login(email, password, &login);
+        login.wait();
+        SynchronousRequestListener fetchnodes;
+        if (login.getError()->getErrorCode() == API_OK)
+        {
+            api.fetchNodes(&fetchnodes);
+            fetchnodes.wait();
+        }
+        if (login.getError()->getErrorCode() != API_OK || fetchnodes.getError()->getErrorCode() != API_OK)
+        {
+            cerr << "login failed" << endl;
+            g_relays.Stop();
+            relayRunnerThread.join();
+            return 1;
+        }
+
+        unique_ptr<MegaNode> root(api.getRootNode());
+        for (int i = 0; i < options.repetitions; ++i)
+        {
+            unique_ptr<MegaNode> node;
+            if (!options.upload.empty())
+            {
+                // a name of its own for each repetition, and the node is removed afterwards, so that it's uploaded rather than copied
+                string name = "transferbench-" + to_string(m_time(nullptr)) + "-" + to_string(i);
+                TimedTransferListener upload;
+                api.startUpload(options.upload.c_str(), root.get(), name.c_str(), &upload);
+                results.push_back(finish("upload", i, upload));
+                if (!results.back().error)
+                {
+                    node.reset(api.getNodeByHandle(upload.getTransfer()->getNodeHandle()));
+                }
+            }
+            else
+            {
+                node.reset(api.getNodeByPath(options.download.c_str()));
+            }
+
+            if (node)
+            {
+                string localpath = options.target + "/transferbench-download";
+                TimedTransferListener download;
+                api.startDownload(node.get(), localpath.c_str(), &download);
+                results.push_back(finish("download", i, download));
+                std::remove(localpath.c_str());
+            }
+            else if (options.upload.empty())
+            {
+                cerr << "not found: " << options.download << endl;
+            }
+
+            if (node && !options.upload.empty())
+            {
+                SynchronousRequestListener removal;
+                api.remove(node.get(), &removal);
+                removal.wait();
+            }
+        }
+
+        SynchronousRequestListener logout;
+        api.localLogout(&logout);
+        logout.wait();
+    }
+
+    globalMegaTestHooks.onHttpReqPost = nullptr;
+    g_relays.Stop();
+    relayRunnerThread.join();
+
+    ofstream file(options.out);
+    file << toJson(results);
+    if (!file)
+    {
+        cerr << "Unable to write " << options.out << endl;
+        return 1;
+    }
+    return 0;
+}
+
+} // transferbench
+
+#endif
+
 #ifndef _WIN32
 
 void Sleep(unsigned int ms)
@@ -745,7 +1152,7 @@ void Sleep(unsigned int ms)
 
 #endif /* ! _WIN32 */
 
-int main()
+int main(int argc, char* argv[])
 {
     ofstream mylog("tcprelaylog.txt");
     logstream = &mylog;
@@ -755,6 +1162,16 @@ int main()
 #endif
     SimpleLogger::setOutputClass(&logger);
 
+    if (argc > 1 && !strcmp(argv[1], "bench"))
+    {
+#ifdef MEGASDK_DEBUG_TEST_HOOKS_ENABLED
+        return transferbench::run(argc, argv);
+#else
+        cerr << "The transfer benchmark needs a DEBUG build of the SDK, for its test hooks" << endl;
+        return 1;
+#endif
+    }
+
     console = new CONSOLE_CLASS;
 
 #ifdef HAVE_AUTOCOMPLETE
@@ -23,6 +23,7 @@
 #include <functional>
 #include <regex>
 #include <iostream>
+#include <cmath>
 #include <sys/timeb.h>
 
 using namespace std;
@@ -67,6 +68,7 @@ TcpRelay::TcpRelay(asio::io_service& as, const std::string& name, asio::ip::tcp:
     , asio_service(as)
     , connect_address(connect_endpoint)
     , send_rate_timer(as)
+    , random(static_cast<std::minstd_rand::result_type>(std::hash<std::string>()(name)))
     , accept_to_connect_circular_buf(new CircularBuffer<BufSize>)
     , connect_to_accept_circular_buf(new CircularBuffer<BufSize>)
     , acceptor_side(as)
@@ -91,6 +93,11 @@ void TcpRelay::SetBytesPerSecond(size_t n)
     //acceptor_side.asio_socket.set_option(asio::ip::tcp::no_delay(true));
 }
 
+void TcpRelay::SetNetworkConditions(const NetworkConditions& c)
+{
+    conditions = c;  // on the asio thread, as the handlers use them
+}
+
 void TcpRelay::Stop()
 {
     if (stopped) return;
@@ -143,6 +150,17 @@ void TcpRelay::StopNow()
 }
 
 void TcpRelay::StartConnecting()
+{
+    if (stopped) return;
+    if (conditions.latencyMs)
+    {
+        // the handshake is a round trip of the emulated path, before that of the real one
+        return DelayAndDo(std::chrono::milliseconds(2 * conditions.latencyMs), [this]() { Connect(); }, asio_service);
+    }
+    Connect();
+}
+
+void TcpRelay::Connect()
 {
     if (stopped) return;
     //LOGF("%s attempting connect to %s~%d", reporting_name.c_str(), connect_address.address().to_string().c_str(), (int)connect_address.port());
@@ -183,7 +201,12 @@ void TcpRelay::ReceiveHandler(Direction& d, const asio::error_code& ec, std::siz
     if (stopped) return;
     assert(d.incoming.receive_in_progress);
     d.incoming.receive_in_progress = false;
-    if (ec)
+    if (ec == asio::error::eof && d.circular_buf.StoredByteCount())
+    {
+        // the bytes still crossing the emulated network are delivered before the close
+        d.ended = true;
+    }
+    else if (ec)
     {
         cout << reporting_name << " " << d.directionName << " error receiving: " << ec.message() << endl;
         StopNow();
@@ -255,6 +278,7 @@ void TcpRelay::ReceiveHandler(Direction& d, const asio::error_code& ec, std::siz
             }
             //LOGF("received %d bytes, passing them on", (int)bytes_received);
         }
+        RecordArrival(d, bytes_received);
         d.circular_buf.CommitNewHeadBytes(bytes_received);
         if (!d.outgoing.send_in_progress)
             StartSending(d);
@@ -303,7 +327,16 @@ void TcpRelay::StartSending(Direction& d, bool restarted)
         sendrate = min<unsigned>(sendrate, unsigned(g_overallspeed / Side::s_activesenders));
     }
 
-    auto range = d.circular_buf.PeekTailBytes(sendrate / 5 /*ReadSize*/);   // 10 shots per second so we can catch up when needed, on average we send / skip / send / skip
+    std::chrono::steady_clock::time_point next_arrival;
+    auto arrived = ArrivedBytes(d, next_arrival);
+    if (!arrived && next_arrival != std::chrono::steady_clock::time_point())
+    {
+        d.outgoing.send_timer.expires_at(next_arrival);
+        d.outgoing.send_timer.async_wait([this, &d](const asio::error_code& ec) { RestartSending(d, ec); });
+        return;   // still crossing the emulated network
+    }
+
+    auto range = d.circular_buf.PeekTailBytes(min<size_t>(sendrate / 5 /*ReadSize*/, arrived));   // 10 shots per second so we can catch up when needed, on average we send / skip / send / skip
 
     if (range.len > 0)
     {
@@ -353,13 +386,67 @@ void TcpRelay::SendHandler(Direction& d, const asio::error_code& ec, std::size_t
         s_send_rate_all_buckets.AddToCurrentBucket(bytes_sent);
 
         d.circular_buf.RecycleTailBytes(bytes_sent);
+        for (auto n = bytes_sent; n; )
+        {
+            auto& front = d.arrivals.front();
+            auto consumed = min(n, front.first);
+            front.first -= consumed;
+            n -= consumed;
+            if (!front.first) d.arrivals.pop_front();
+        }
+        if (d.ended && !d.circular_buf.StoredByteCount())
+            return StopNow();
+
         StartSending(d);  // if any more data has arrived in the meantime, send it now
 
-        if (!d.incoming.receive_in_progress)
+        if (!d.incoming.receive_in_progress && !d.ended)
             StartReceiving(d);  // restart receiving if we needed to back off for a bit
     }
 }
 
+void TcpRelay::RecordArrival(Direction& d, size_t bytes_received)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto arrival = now + std::chrono::milliseconds(conditions.latencyMs);
+    if (conditions.jitterMs)
+    {
+        arrival += std::chrono::milliseconds(std::uniform_int_distribution<unsigned>(0, conditions.jitterMs)(random));
+    }
+    if (conditions.lossPercent > 0)
+    {
+        // the chance that any of the segments carrying these bytes was lost
+        auto segments = double((bytes_received + 1459) / 1460);
+        auto p = 1 - std::pow(1 - std::min(conditions.lossPercent, 100.0) / 100, segments);
+        if (std::uniform_real_distribution<double>(0, 1)(random) < p)
+        {
+            arrival += conditions.RetransmissionTimeout();
+        }
+    }
+
+    // TCP delivers in order, so later bytes wait for earlier ones
+    if (!d.arrivals.empty() && arrival < d.arrivals.back().second)
+    {
+        arrival = d.arrivals.back().second;
+    }
+    d.arrivals.emplace_back(bytes_received, arrival);
+}
+
+size_t TcpRelay::ArrivedBytes(Direction& d, std::chrono::steady_clock::time_point& next_arrival)
+{
+    auto now = std::chrono::steady_clock::now();
+    size_t arrived = 0;
+    for (auto& a : d.arrivals)
+    {
+        if (a.second > now)
+        {
+            next_arrival = a.second;
+            break;
+        }
+        arrived += a.first;
+    }
+    return arrived;
+}
+
 void TcpRelay::Pause(bool b)
 {
     paused = b;
@@ -385,6 +472,13 @@ void TcpRelayAcceptor::SetBytesPerSecond(size_t n)
     bytespersec = n;
 }
 
+void TcpRelayAcceptor::SetNetworkConditions(const NetworkConditions& c)
+{
+    asio_service.post([this, c]() {
+        conditions = c;
+    });
+}
+
 void TcpRelayAcceptor::Stop()
 {
     asio_service.post([this]() {
@@ -428,6 +522,7 @@ void TcpRelayAcceptor::AcceptHandler(const asio::error_code& ec)
         // we have received an incoming socket connection.  So now make the corresponding connection to the remote side that we will forward all data to
         //LOGF("%s accepted a connection: %s", reporting_name.c_str(), nextRelay->reporting_name.c_str());
         if (bytespersec > 0) nextRelay->SetBytesPerSecond(bytespersec);
+        nextRelay->SetNetworkConditions(conditions);
         nextRelay->StartConnecting();
         onAccepted(move(nextRelay));
         nextRelay.reset(new TcpRelay(asio_service, reporting_name + "-" + to_string(++relayCount), connect_address));
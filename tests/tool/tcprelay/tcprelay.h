@@ -21,6 +21,7 @@
 
 #pragma once
 #include <asio.hpp>
+#include <algorithm>
 #include <deque>
 #include <atomic>
 #include <chrono>
@@ -28,6 +29,7 @@
 #include <string>
 #include <iostream>
 #include <atomic>
+#include <random>
 
 extern std::ostream* logstream;
 extern bool g_showreplyheaders;
@@ -197,6 +199,21 @@ public:
     }
 };
 
+// Conditions of an emulated network path, applied to both directions of a relayed connection.
+// TCP never loses bytes, so a lost segment is emulated as the stall of the stream until its retransmission.
+struct NetworkConditions
+{
+    unsigned latencyMs = 0;     // one way
+    unsigned jitterMs = 0;      // extra one way delay, uniformly distributed; the order of the bytes is kept
+    double lossPercent = 0;     // of 1460 byte segments
+
+    // the delay of a retransmission, at least the 200ms minimum RTO of most stacks
+    std::chrono::milliseconds RetransmissionTimeout() const
+    {
+        return std::chrono::milliseconds(std::max<unsigned>(200, 2 * (latencyMs + jitterMs)));
+    }
+};
+
 struct DelayAndDoRecord {
     asio::steady_timer timer;
     std::function<void()> action;
@@ -219,6 +236,7 @@ public:
     TcpRelay(asio::io_service& as, const std::string& name, asio::ip::tcp::endpoint connect_endpoint);
 
     void SetBytesPerSecond(size_t);
+    void SetNetworkConditions(const NetworkConditions&);
     void Stop();
 
     void OutputDebugState(std::stringstream& s);
@@ -241,6 +259,9 @@ private:
     asio::ip::tcp::endpoint connect_address;
     asio::steady_timer send_rate_timer;
 
+    NetworkConditions conditions;
+    std::minstd_rand random;
+
     std::unique_ptr<CircularBuffer<BufSize>> accept_to_connect_circular_buf;  // keep this on the heap as it may be large
     std::unique_ptr<CircularBuffer<BufSize>> connect_to_accept_circular_buf;  // keep this on the heap as it may be large
 
@@ -287,6 +308,11 @@ public:
         Side& incoming;
         Side& outgoing;
         CircularBuffer<BufSize>& circular_buf;
+
+        // the bytes of each receive, in order, and when the emulated network delivers them
+        std::deque<std::pair<size_t, std::chrono::steady_clock::time_point>> arrivals;
+        bool ended = false;
+
         Direction(const std::string& n, Side& a, Side& b, CircularBuffer<BufSize>& buf) : directionName(n), incoming(a), outgoing(b), circular_buf(buf) {}
     };
 
@@ -297,11 +323,14 @@ public:
     void RollBucket(Direction& d);
     void StopNow();
     void StartConnecting();
+    void Connect();
     void ConnectHandler(const asio::error_code& ec);
     void StartReceiving(Direction& d);
     void ReceiveHandler(Direction& d, const asio::error_code& ec, std::size_t bytes_received);
     void RestartSending(Direction& d, const asio::error_code& ec);
     void StartSending(Direction& d, bool restarted = false);
+    void RecordArrival(Direction& d, size_t bytes_received);
+    size_t ArrivedBytes(Direction& d, std::chrono::steady_clock::time_point& next_arrival);
     void SendHandler(Direction& d, const asio::error_code& ec, std::size_t bytes_sent, int id);
     void Pause(bool b);
 };
@@ -328,12 +357,14 @@ private:
     onAcceptedFn onAccepted;
 
     size_t bytespersec;
+    NetworkConditions conditions;
 
 public:
 
     TcpRelayAcceptor(asio::io_service& as, const std::string& name, uint16_t port, asio::ip::tcp::endpoint connect_endpoint, onAcceptedFn f);
 
     void SetBytesPerSecond(size_t);
+    void SetNetworkConditions(const NetworkConditions&);
     void Stop();
     void Start();
 
@@ -0,0 +1,166 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <gtest/gtest.h>
+
+#include <mega.h>
+#include <mega/heartbeats.h>
+
+#include "AllocationCounter.h"
+#include "utils.h"
+
+// Upper bounds on the allocations of hot paths, so a change that allocates per item where it
+// didn't shows up as a failing test.  Budgets are per item, with a little headroom for the
+// containers that grow along the way.
+
+namespace {
+
+constexpr int ITEMS = 1000;
+
+// Node::unserialize(): the Node is pooled, but its key, attributes and fingerprint aren't
+constexpr std::size_t NODE_UNSERIALIZE_BUDGET = 16;
+
+// an "u" action packet changing the creation time of a node, through procsc() and notifypurge()
+constexpr std::size_t ACTION_PACKET_BUDGET = 4;
+
+#ifdef ENABLE_SYNC
+// LocalNode::serialize() into a reused buffer: at most the copy of the name
+constexpr std::size_t LOCALNODE_SERIALIZE_BUDGET = 1;
+#endif
+
+struct Client
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    std::shared_ptr<mega::MegaClient> client = mt::makeClient(app, fsaccess);
+};
+
+void makeFiles(mega::MegaClient& client, mega::Node& parent)
+{
+    for (int i = 0; i < ITEMS; ++i)
+    {
+        auto& n = mt::makeNode(client, mega::FILENODE, mega::handle(100 + i), &parent);
+        n.size = 1000 + i;
+        n.ctime = 1600000000;
+        n.attrs.map['n'] = "file_" + std::to_string(i) + ".jpg";
+    }
+}
+
+} // anonymous
+
+TEST(AllocationBudget, Node_unserialize)
+{
+    Client source;
+    auto& root = mt::makeNode(*source.client, mega::ROOTNODE, 1);
+    makeFiles(*source.client, root);
+
+    std::vector<std::string> records;
+    for (auto& n : source.client->nodes)
+    {
+        records.emplace_back();
+        ASSERT_TRUE(n.second->serialize(&records.back()));
+    }
+
+    Client target;
+    mega::node_vector dp;
+    dp.reserve(records.size());
+    std::size_t allocations = 0;
+    std::size_t nodes = 0;
+    {
+        mt::AllocationCounter counter;
+        for (auto& record : records)
+        {
+            nodes += mega::Node::unserialize(target.client.get(), &record, &dp) != nullptr;
+        }
+        allocations = counter.allocations();
+    }
+
+    ASSERT_EQ(records.size(), nodes);
+    EXPECT_LE(allocations, NODE_UNSERIALIZE_BUDGET * records.size());
+}
+
+TEST(AllocationBudget, actionPackets)
+{
+    Client c;
+    auto& client = *c.client;
+    auto& root = mt::makeNode(client, mega::ROOTNODE, 1);
+    makeFiles(client, root);
+    client.fetchingnodes = false;
+    client.statecurrent = true;
+
+    std::string response = "{\"a\":[";
+    for (int i = 0; i < ITEMS; ++i)
+    {
+        response.append(i ? ",{" : "{")
+                .append("\"a\":\"u\",\"n\":\"").append(mega::Base64Str<mega::MegaClient::NODEHANDLE>(mega::handle(100 + i)))
+                .append("\",\"ts\":").append(std::to_string(1700000000 + i)).append("}");
+    }
+    response.append("],\"sn\":\"AAAAAAAAAAA\"}");
+
+    std::size_t allocations = 0;
+    {
+        mt::AllocationCounter counter;
+        client.insca = false;
+        client.insca_notlast = false;
+        client.jsonsc.begin(response.c_str());
+        client.jsonsc.enterobject();
+        while (!client.procsc())
+        {
+        }
+        client.jsonsc.pos = nullptr;
+        allocations = counter.allocations();
+    }
+
+    ASSERT_EQ(1700000000 + ITEMS - 1, client.nodebyhandle(mega::handle(100 + ITEMS - 1))->ctime);
+    EXPECT_LE(allocations, ACTION_PACKET_BUDGET * ITEMS);
+}
+
+#ifdef ENABLE_SYNC
+TEST(AllocationBudget, LocalNode_serialize)
+{
+    Client c;
+    auto us = mt::makeSync(*c.client, "budget");
+    auto& sync = us->mSync;
+
+    std::vector<std::unique_ptr<mega::LocalNode>> localNodes;
+    for (int i = 0; i < ITEMS; ++i)
+    {
+        localNodes.push_back(mt::makeLocalNode(*sync, *sync->localroot, mega::FILENODE, "f" + std::to_string(i) + ".jpg"));
+        localNodes.back()->size = i;
+        localNodes.back()->mtime = 1600000000;
+    }
+
+    std::string data;
+    data.reserve(1024);
+    std::size_t allocations = 0;
+    std::size_t bytes = 0;
+    {
+        mt::AllocationCounter counter;
+        for (auto& l : localNodes)
+        {
+            data.clear();
+            l->serialize(&data);
+            bytes += data.size();
+        }
+        allocations = counter.allocations();
+    }
+
+    ASSERT_GT(bytes, 0u);
+    EXPECT_LE(allocations, LOCALNODE_SERIALIZE_BUDGET * ITEMS);
+}
+#endif
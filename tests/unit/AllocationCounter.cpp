@@ -0,0 +1,75 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.h"
+
+namespace {
+
+// plain thread_locals: usable from operator new at any point of the life of a thread
+thread_local std::size_t tAllocations = 0;
+thread_local std::size_t tBytes = 0;
+
+} // anonymous
+
+// The replacements of the global operator new and delete for the whole test binary.  The array and
+// nothrow forms default to these.
+void* operator new(std::size_t size)
+{
+    tAllocations++;
+    tBytes += size;
+
+    if (void* p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+// (replaced as well, or the compiler warns that it would bypass the one above)
+void operator delete(void* p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+namespace mt {
+
+AllocationCounter::AllocationCounter()
+    : mAllocations(tAllocations)
+    , mBytes(tBytes)
+{
+}
+
+std::size_t AllocationCounter::allocations() const
+{
+    return tAllocations - mAllocations;
+}
+
+std::size_t AllocationCounter::bytes() const
+{
+    return tBytes - mBytes;
+}
+
+} // mt
@@ -0,0 +1,45 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include <mega/types.h>
+
+namespace mt {
+
+// Counts the allocations made by the current thread through the global operator new, which test_unit
+// replaces (see AllocationCounter.cpp), from its construction on.  Other threads, such as the workers
+// of a client, are not counted.
+class AllocationCounter
+{
+public:
+    AllocationCounter();
+
+    MEGA_DISABLE_COPY_MOVE(AllocationCounter)
+
+    std::size_t allocations() const;
+    std::size_t bytes() const;
+
+private:
+    std::size_t mAllocations;
+    std::size_t mBytes;
+};
+
+} // mt
@@ -0,0 +1,241 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <gtest/gtest.h>
+
+#include <mega/asyncdbtable.h>
+
+#include "DefaultedDbTable.h"
+
+namespace {
+
+// In-memory table whose writes can be held back, to observe what is still queued
+class MockDbTable : public mt::DefaultedDbTable
+{
+public:
+    using DefaultedDbTable::DefaultedDbTable;
+
+    bool get(uint32_t index, std::string* data) override
+    {
+        auto it = records.find(index);
+        if (it == records.end())
+        {
+            return false;
+        }
+        *data = it->second;
+        return true;
+    }
+
+    bool put(uint32_t index, char* data, unsigned len) override
+    {
+        wait();
+        records[index].assign(data, len);
+        return true;
+    }
+
+    using mega::DbTable::put;
+
+    bool put(const mega::DbRecordBatch& batch) override
+    {
+        log.push_back("batch " + std::to_string(batch.size()));
+        return mega::DbTable::put(batch);
+    }
+
+    bool putNodes(const mega::DbNodeRecordBatch& batch) override
+    {
+        log.push_back("nodes " + std::to_string(batch.size()));
+        return mega::DbTable::putNodes(batch);
+    }
+
+    bool del(uint32_t index) override
+    {
+        wait();
+        records.erase(index);
+        return true;
+    }
+
+    void truncate() override
+    {
+        wait();
+        records.clear();
+    }
+
+    void begin() override
+    {
+        log.push_back("begin");
+    }
+
+    void commit() override
+    {
+        log.push_back("commit " + std::to_string(records.size()));
+    }
+
+    bool inTransaction() const override
+    {
+        return false;
+    }
+
+    void hold()
+    {
+        std::lock_guard<std::mutex> g(mutex);
+        held = true;
+    }
+
+    void release()
+    {
+        {
+            std::lock_guard<std::mutex> g(mutex);
+            held = false;
+        }
+        cv.notify_all();
+    }
+
+    std::map<uint32_t, std::string> records;
+    std::vector<std::string> log;
+
+private:
+    void wait()
+    {
+        std::unique_lock<std::mutex> g(mutex);
+        cv.wait(g, [this]() { return !held; });
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool held = false;
+};
+
+std::string get(mega::DbTable& table, uint32_t index)
+{
+    std::string data;
+    return table.get(index, &data) ? data : "<none>";
+}
+
+bool put(mega::DbTable& table, uint32_t index, std::string data)
+{
+    return table.put(index, &data);
+}
+
+} // namespace
+
+TEST(AsyncDbTable, readsSeeQueuedWrites)
+{
+    mega::PrnGen rng;
+    auto mock = new MockDbTable(rng, false);
+    mega::AsyncDbTable table(rng, mega::DbTablePtr(mock));
+
+    EXPECT_TRUE(put(table, 1, "one"));
+    table.flush();
+    EXPECT_EQ("one", mock->records[1]);
+
+    // nothing reaches the mock while it is held, but reads must still see the writes
+    mock->hold();
+    EXPECT_TRUE(put(table, 2, "two"));
+    EXPECT_TRUE(put(table, 1, "uno"));
+    EXPECT_TRUE(table.del(2));
+    EXPECT_TRUE(put(table, 3, "three"));
+
+    EXPECT_EQ("uno", get(table, 1));
+    EXPECT_EQ("<none>", get(table, 2));
+    EXPECT_EQ("three", get(table, 3));
+    EXPECT_LT(0u, table.pending());
+
+    mock->release();
+    table.flush();
+
+    EXPECT_EQ(0u, table.pending());
+    EXPECT_EQ((std::map<uint32_t, std::string>{{1, "uno"}, {3, "three"}}), mock->records);
+    EXPECT_EQ("uno", get(table, 1));
+    EXPECT_EQ("<none>", get(table, 2));
+}
+
+TEST(AsyncDbTable, truncateHidesStoredRecords)
+{
+    mega::PrnGen rng;
+    auto mock = new MockDbTable(rng, false);
+    mega::AsyncDbTable table(rng, mega::DbTablePtr(mock));
+
+    EXPECT_TRUE(put(table, 1, "one"));
+    table.flush();
+
+    mock->hold();
+    table.truncate();
+    EXPECT_TRUE(put(table, 2, "two"));
+
+    EXPECT_EQ("<none>", get(table, 1));
+    EXPECT_EQ("two", get(table, 2));
+
+    mock->release();
+    table.flush();
+
+    EXPECT_EQ((std::map<uint32_t, std::string>{{2, "two"}}), mock->records);
+}
+
+TEST(AsyncDbTable, transactionsAreAppliedInOrder)
+{
+    mega::PrnGen rng;
+    auto mock = new MockDbTable(rng, false);
+    mega::AsyncDbTable table(rng, mega::DbTablePtr(mock));
+
+    mock->hold();
+
+    table.begin();
+    EXPECT_TRUE(table.inTransaction());
+    EXPECT_TRUE(put(table, 1, "one"));
+    table.commit();
+    EXPECT_FALSE(table.inTransaction());
+
+    table.begin();
+    EXPECT_TRUE(put(table, 2, "two"));
+    EXPECT_TRUE(put(table, 3, "three"));
+    table.commit();
+
+    // commit() doesn't wait for the writer
+    EXPECT_LT(0u, table.pending());
+
+    mock->release();
+    table.flush();
+
+    EXPECT_EQ((std::vector<std::string>{"begin", "commit 1", "begin", "commit 3"}), mock->log);
+}
+
+TEST(AsyncDbTable, batchesAreForwarded)
+{
+    mega::PrnGen rng;
+    auto mock = new MockDbTable(rng, false);
+    mega::AsyncDbTable table(rng, mega::DbTablePtr(mock));
+
+    mock->hold();
+
+    EXPECT_TRUE(table.put(mega::DbRecordBatch{{1, "one"}, {2, "two"}}));
+
+    mega::DbNodeRecordBatch nodes(1);
+    nodes[0].id = 3;
+    nodes[0].data = "three";
+    EXPECT_TRUE(table.putNodes(nodes));
+
+    EXPECT_EQ("one", get(table, 1));
+    EXPECT_EQ("two", get(table, 2));
+    EXPECT_EQ("three", get(table, 3));
+
+    mock->release();
+    table.flush();
+
+    EXPECT_EQ((std::vector<std::string>{"batch 2", "nodes 1"}), mock->log);
+    EXPECT_EQ((std::map<uint32_t, std::string>{{1, "one"}, {2, "two"}, {3, "three"}}), mock->records);
+}
@@ -60,4 +60,33 @@ TEST(AttrMap, unserialize_32bit)
 
     ASSERT_EQ(expMap.map, newMap.map);
 }
-#endif
\ No newline at end of file
+#endif
+
+TEST(AttrMap, lookupsAndUpdates)
+{
+    const mega::nameid lbl = mega::AttrMap::string2nameid("lbl");
+
+    mega::AttrMap map;
+    map.map['n'] = "name";
+    map.map['c'] = "fingerprint";
+    map.map[lbl] = "1";
+
+    // kept sorted by name whatever the insertion order
+    std::vector<mega::nameid> names;
+    for (auto& a : map.map)
+    {
+        names.push_back(a.first);
+    }
+    ASSERT_EQ((std::vector<mega::nameid>{'c', 'n', lbl}), names);
+
+    ASSERT_EQ("name", map.map.find('n')->second);
+    ASSERT_EQ(map.map.end(), map.map.find('t'));
+    ASSERT_FALSE(map.map.insert(std::make_pair(mega::nameid('n'), std::string("other"))).second);
+
+    map.applyUpdates(mega::attr_map(std::map<mega::nameid, std::string>{{'n', ""}, {'t', "time"}}));
+    ASSERT_EQ(0u, map.map.count('n'));
+    ASSERT_EQ("time", map.map['t']);
+    ASSERT_EQ(3u, map.map.size());
+    ASSERT_EQ(1u, map.map.erase('c'));
+    ASSERT_EQ(0u, map.map.erase('c'));
+}
@@ -0,0 +1,182 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <gtest/gtest.h>
+
+#include <mega/backofftimer.h>
+#include <mega/waiter.h>
+
+#include "mega.h"
+
+TEST(LatencyHistogram, percentilesAndErrorRate)
+{
+    mega::LatencyHistogram histogram;
+    ASSERT_EQ(0u, histogram.percentile(0.5));
+
+    // 90 fast responses, 10 slow ones
+    for (int i = 0; i < 90; ++i)
+    {
+        histogram.record(std::chrono::milliseconds(100));
+    }
+    for (int i = 0; i < 10; ++i)
+    {
+        histogram.record(std::chrono::milliseconds(3000));
+    }
+
+    ASSERT_EQ(100u, histogram.responses());
+    ASSERT_EQ(128u, histogram.percentile(0.5));
+    ASSERT_EQ(128u, histogram.percentile(0.9));
+    ASSERT_EQ(4096u, histogram.percentile(0.99));
+    ASSERT_EQ(0, histogram.recentErrorRate());
+
+    for (int i = 0; i < 20; ++i)
+    {
+        histogram.recordError();
+    }
+    ASSERT_EQ(20u, histogram.errors());
+    ASSERT_GT(histogram.recentErrorRate(), 0.5);
+
+    ASSERT_EQ(0u, histogram.toJson().find(R"({"responses":100,"errors":20,)"));
+}
+
+TEST(BackoffTimer, adaptiveBackoffFollowsTheEndpoint)
+{
+    mega::PrnGen rng;
+    mega::Waiter::ds = 1000;
+
+    // a slow endpoint that mostly answers: not sooner than its usual latency, and not longer than 30 seconds
+    mega::LatencyHistogram slow;
+    for (int i = 0; i < 100; ++i)
+    {
+        slow.record(std::chrono::milliseconds(1500));
+    }
+
+    mega::BackoffTimer bt(rng);
+    bt.backoff(slow);
+    ASSERT_EQ(21u, bt.retryin());   // 2048 ms
+    for (int i = 0; i < 20; ++i)
+    {
+        bt.backoff(slow);
+        ASSERT_LE(bt.retryin(), 300u);
+    }
+
+    // mostly failing: the usual exponential growth up to 10 minutes
+    for (int i = 0; i < 100; ++i)
+    {
+        slow.recordError();
+    }
+    for (int i = 0; i < 20; ++i)
+    {
+        bt.backoff(slow);
+    }
+    ASSERT_GT(bt.retryin(), 3000u);
+    ASSERT_LE(bt.retryin(), 9000u);
+
+    // a fixed delay is kept above the usual latency, with up to 50% jitter
+    mega::LatencyHistogram fast;
+    fast.record(std::chrono::milliseconds(50));
+    bt.backoff(2, fast);
+    ASSERT_GE(bt.retryin(), 2u);
+    ASSERT_LE(bt.retryin(), 3u);
+
+    bt.backoff(2, slow);
+    ASSERT_GE(bt.retryin(), 21u);
+    ASSERT_LE(bt.retryin(), 31u);
+}
+
+TEST(TimerWheel, expiresInOrderAndFindsTheNextWakeup)
+{
+    mega::TimerWheel wheel;
+    wheel.advance(1000);
+    ASSERT_EQ(~mega::dstime(0), wheel.next());
+
+    std::vector<mega::TimerWheel::Entry> entries(5);
+    const mega::dstime times[] = { 1005, 1060, 5000, 900000, 1000 };
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        wheel.insert(entries[i], times[i]);
+        ASSERT_TRUE(entries[i].scheduled());
+    }
+    ASSERT_EQ(5u, wheel.size());
+
+    // due already
+    std::vector<mega::TimerWheel::Entry*> expired;
+    wheel.expired(expired);
+    ASSERT_EQ(1u, expired.size());
+    ASSERT_EQ(&entries[4], expired[0]);
+    wheel.remove(entries[4]);
+    ASSERT_FALSE(entries[4].scheduled());
+
+    ASSERT_EQ(1005u, wheel.next());
+
+    // never later than the soonest entry, and exact when it is close
+    mega::dstime now = 1000;
+    size_t wakeups = 0;
+    std::vector<mega::dstime> order;
+    while (wheel.size())
+    {
+        mega::dstime next = wheel.next();
+        ASSERT_GT(next, now);
+        for (auto& e : entries)
+        {
+            if (e.scheduled())
+            {
+                ASSERT_LE(next, e.when());
+            }
+        }
+
+        now = next;
+        wheel.advance(now);
+        wakeups++;
+
+        expired.clear();
+        wheel.expired(expired);
+        for (auto e : expired)
+        {
+            ASSERT_LE(e->when(), now);
+            order.push_back(e->when());
+            wheel.remove(*e);
+        }
+    }
+
+    ASSERT_EQ((std::vector<mega::dstime>{ 1005, 1060, 5000, 900000 }), order);
+    ASSERT_LT(wakeups, 4u * mega::TimerWheel::LEVELS);
+}
+
+TEST(TimerWheel, removesFromAnyLevel)
+{
+    mega::TimerWheel wheel;
+    mega::TimerWheel::Entry near, far;
+    wheel.insert(near, 10);
+    wheel.insert(far, 100000);
+    wheel.remove(near);
+    ASSERT_EQ(1u, wheel.size());
+    ASSERT_LE(wheel.next(), 100000u);
+
+    wheel.remove(far);
+    ASSERT_EQ(~mega::dstime(0), wheel.next());
+
+    // a long jump expires everything on the way
+    wheel.insert(near, 10);
+    wheel.insert(far, 100000);
+    wheel.advance(200000);
+    std::vector<mega::TimerWheel::Entry*> expired;
+    wheel.expired(expired);
+    ASSERT_EQ(2u, expired.size());
+    ASSERT_EQ(~mega::dstime(0), wheel.next());
+}
@@ -0,0 +1,154 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <cstring>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include <mega/base64.h>
+
+namespace {
+
+std::string randomData(std::mt19937& rng, size_t size)
+{
+    std::string data(size, '\0');
+    for (auto& c : data)
+    {
+        c = char(rng());
+    }
+    return data;
+}
+
+} // namespace
+
+TEST(Base64Kernels, allImplementationsAgree)
+{
+    auto implementations = mega::Base64Kernels::implementations();
+    ASSERT_STREQ("scalar", implementations.front().name);
+
+    std::mt19937 rng(42);
+    for (size_t size = 0; size < 200; ++size)
+    {
+        std::string data = randomData(rng, size);
+        std::string expected(size / 3 * 4, '\0');
+        size_t consumed = implementations.front().encode(reinterpret_cast<const mega::byte*>(data.data()), size, &expected[0]);
+        ASSERT_EQ(size / 3 * 3, consumed);
+
+        for (auto& impl : implementations)
+        {
+            std::string encoded(size / 3 * 4 + 1, 'X');
+            consumed = impl.encode(reinterpret_cast<const mega::byte*>(data.data()), size, &encoded[0]);
+            ASSERT_EQ(0u, consumed % 3) << impl.name;
+            ASSERT_EQ(expected.substr(0, consumed / 3 * 4), encoded.substr(0, consumed / 3 * 4)) << impl.name << ", size: " << size;
+            ASSERT_EQ('X', encoded.back()) << impl.name;
+
+            // the decoders stop before the group of the first invalid character
+            for (size_t bad : {expected.size(), size_t(rng() % (expected.size() + 1))})
+            {
+                std::string chars = expected;
+                if (bad < chars.size())
+                {
+                    chars[bad] = "=.\"\x80"[rng() % 4];
+                }
+
+                std::string decoded(size + 1, 'X');
+                consumed = impl.decode(chars.data(), chars.size(), reinterpret_cast<mega::byte*>(&decoded[0]), size);
+                ASSERT_EQ(0u, consumed % 4) << impl.name;
+                ASSERT_LE(consumed, bad / 4 * 4) << impl.name;
+                ASSERT_EQ(data.substr(0, consumed / 4 * 3), decoded.substr(0, consumed / 4 * 3)) << impl.name << ", size: " << size;
+                ASSERT_EQ('X', decoded.back()) << impl.name;
+            }
+        }
+    }
+}
+
+TEST(Base64, roundTripsWithBothAlphabets)
+{
+    std::mt19937 rng(7);
+    for (size_t size = 0; size < 300; ++size)
+    {
+        std::string data = randomData(rng, size);
+        std::string encoded = mega::Base64::btoa(data);
+        ASSERT_EQ((size * 4 + 2) / 3, encoded.size());
+        ASSERT_EQ(std::string::npos, encoded.find_first_of("+/="));
+        ASSERT_EQ(data, mega::Base64::atob(encoded));
+
+        for (auto& c : encoded)
+        {
+            c = c == '-' ? '+' : c == '_' ? '/' : c;
+        }
+        ASSERT_EQ(data, mega::Base64::atob(encoded));
+    }
+}
+
+TEST(Base64, decodingStopsAtTheFirstInvalidCharacter)
+{
+    std::mt19937 rng(3);
+    std::string encoded = mega::Base64::btoa(randomData(rng, 150));
+
+    // a lone character still makes a byte
+    auto decodedSize = [](size_t chars)
+    {
+        const int partial[] = { 0, 1, 1, 2 };
+        return int(chars / 4 * 3) + partial[chars % 4];
+    };
+
+    for (size_t bad = 0; bad < encoded.size(); ++bad)
+    {
+        std::string chars = encoded;
+        chars[bad] = '"';
+
+        std::string expected(encoded.size(), '\0'), actual(encoded.size(), '\0');
+        int n = mega::Base64::atob(chars.c_str(), reinterpret_cast<mega::byte*>(&expected[0]), int(expected.size()));
+        ASSERT_EQ(decodedSize(bad), n);
+
+        // and at the length, or at the size of the output
+        ASSERT_EQ(n, mega::Base64::atob(chars.data(), chars.size(), reinterpret_cast<mega::byte*>(&actual[0]), int(actual.size())));
+        ASSERT_EQ(expected, actual);
+        ASSERT_EQ(decodedSize(bad / 2), mega::Base64::atob(chars.data(), bad / 2, reinterpret_cast<mega::byte*>(&actual[0]), int(actual.size())));
+        ASSERT_EQ(std::min(n, 5), mega::Base64::atob(chars.data(), chars.size(), reinterpret_cast<mega::byte*>(&actual[0]), 5));
+    }
+}
+
+TEST(Base64, handlesMatchTheGeneralEncoding)
+{
+    std::mt19937 rng(11);
+    for (int i = 0; i < 1000; ++i)
+    {
+        for (unsigned size : {6u, 8u})
+        {
+            mega::handle h = mega::handle(rng()) << 32 | rng();
+            const mega::byte* bytes = reinterpret_cast<const mega::byte*>(&h);
+
+            char expected[12], actual[12];
+            mega::Base64::btoa(bytes, int(size), expected);
+            mega::Base64::handletoa(bytes, size, actual);
+            ASSERT_STREQ(expected, actual);
+
+            mega::byte decoded[8] = {};
+            ASSERT_TRUE(mega::Base64::atohandle(actual, size, decoded));
+            ASSERT_EQ(0, memcmp(bytes, decoded, size));
+
+            actual[rng() % strlen(actual)] = '"';
+            ASSERT_FALSE(mega::Base64::atohandle(actual, size, decoded));
+        }
+    }
+
+    ASSERT_STREQ("AAAAAAAB", mega::Base64Str<6>(reinterpret_cast<const mega::byte*>("\0\0\0\0\0\x01")));
+}
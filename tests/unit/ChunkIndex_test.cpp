@@ -0,0 +1,129 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <gtest/gtest.h>
+
+#include "mega.h"
+
+using namespace mega;
+
+namespace {
+
+string randomData(size_t size, uint32_t seed)
+{
+    string data(size, '\0');
+    for (auto& c : data)
+    {
+        seed = seed * 1103515245 + 12345;
+        c = static_cast<char>(seed >> 24);
+    }
+    return data;
+}
+
+class ChunkIndexTest : public ::testing::Test
+{
+public:
+    void TearDown() override
+    {
+        fsAccess.unlinklocal(path);
+    }
+
+    unique_ptr<ChunkIndex> index(const string& data)
+    {
+        auto fa = fsAccess.newfileaccess(false);
+        EXPECT_TRUE(fa->fopen(path, false, true));
+        EXPECT_TRUE(fa->ftruncate());
+        EXPECT_TRUE(fa->fwrite(reinterpret_cast<const byte*>(data.data()), unsigned(data.size()), 0));
+        fa.reset();
+
+        fa = fsAccess.newfileaccess(false);
+        EXPECT_TRUE(fa->fopen(path, true, false));
+
+        unique_ptr<ChunkIndex> result(new ChunkIndex);
+        EXPECT_TRUE(result->compute(*fa, []() { return false; }));
+        return result;
+    }
+
+    ::mega::FSACCESS_CLASS fsAccess;
+    LocalPath path = LocalPath::fromPath("chunkindex_test.bin", fsAccess);
+};
+
+} // namespace
+
+TEST_F(ChunkIndexTest, anInsertionChangesTheChunkItFallsInOnly)
+{
+    string data = randomData(12 << 20, 1);
+    auto before = index(data);
+
+    m_off_t offset = 0;
+    for (auto& c : before->chunks)
+    {
+        ASSERT_EQ(offset, c.offset);
+        ASSERT_LE(c.size, ChunkIndex::MAX_CHUNK);
+        ASSERT_TRUE(c.size >= ChunkIndex::MIN_CHUNK || offset + c.size == m_off_t(data.size()));
+        offset += c.size;
+    }
+    ASSERT_EQ(m_off_t(data.size()), offset);
+    ASSERT_GT(before->chunks.size(), 4u);
+
+    // the chunks of the same content are the same
+    auto ranges = index(data)->commonRanges(*before);
+    ASSERT_EQ(1u, ranges.size());
+    ASSERT_EQ(0, ranges[0].first);
+    ASSERT_EQ(m_off_t(data.size()), ranges[0].second);
+
+    const size_t at = 5 << 20;
+    data.insert(at, randomData(1000, 2));
+    auto after = index(data);
+
+    ranges = after->commonRanges(*before);
+    ASSERT_EQ(2u, ranges.size());
+    ASSERT_EQ(0, ranges[0].first);
+    ASSERT_LE(ranges[0].second, m_off_t(at));
+    ASSERT_GT(ranges[1].first, m_off_t(at));
+    ASSERT_EQ(m_off_t(data.size()), ranges[1].second);
+
+    m_off_t common = ranges[0].second - ranges[0].first + ranges[1].second - ranges[1].first;
+    ASSERT_GE(common, m_off_t(data.size()) - 2 * m_off_t(ChunkIndex::MAX_CHUNK));
+}
+
+TEST_F(ChunkIndexTest, serializes)
+{
+    auto original = index(randomData(3 << 20, 3));
+    original->fingerprint.size = 3 << 20;
+    original->fingerprint.mtime = 1234;
+    original->fingerprint.isvalid = true;
+
+    string data;
+    ASSERT_TRUE(original->serialize(&data));
+
+    auto copy = ChunkIndex::unserialize(data);
+    ASSERT_NE(nullptr, copy);
+    ASSERT_TRUE(copy->fingerprint == original->fingerprint);
+    ASSERT_EQ(ChunkIndex::key(original->fingerprint), ChunkIndex::key(copy->fingerprint));
+    ASSERT_EQ(original->chunks.size(), copy->chunks.size());
+    for (size_t i = 0; i < copy->chunks.size(); ++i)
+    {
+        ASSERT_EQ(original->chunks[i].offset, copy->chunks[i].offset);
+        ASSERT_EQ(original->chunks[i].size, copy->chunks[i].size);
+        ASSERT_EQ(original->chunks[i].hash, copy->chunks[i].hash);
+    }
+
+    data.resize(data.size() - 3);
+    ASSERT_EQ(nullptr, ChunkIndex::unserialize(data));
+}
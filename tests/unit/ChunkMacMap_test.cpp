@@ -89,3 +89,144 @@ TEST(ChunkMacMap, unserialize_32bit)
     ASSERT_TRUE(newMap.unserialize(data, d.c_str() + d.size()));
     EXPECT_EQ(map, newMap);
 }
+
+TEST(ChunkMacMap, serialize_unserialize_moreThan65535Chunks)
+{
+    mega::chunkmac_map map;
+    for (m_off_t i = 0; i < 70000; ++i)
+    {
+        mega::ChunkMAC& chunkMac = map[i * 1048576];
+        std::fill(chunkMac.mac, chunkMac.mac + mega::SymmCipher::BLOCKSIZE, static_cast<mega::byte>(i));
+        chunkMac.finished = i % 3 != 0;
+        chunkMac.offset = chunkMac.finished ? 0 : 4096;
+    }
+
+    std::string d;
+    map.serialize(d);
+    d.append("next field");
+
+    mega::chunkmac_map newMap;
+    auto data = d.c_str();
+    ASSERT_TRUE(newMap.unserialize(data, d.c_str() + d.size()));
+    EXPECT_EQ(map, newMap);
+    EXPECT_EQ(std::string("next field"), data);
+
+    // truncated
+    mega::chunkmac_map truncatedMap;
+    data = d.c_str();
+    ASSERT_FALSE(truncatedMap.unserialize(data, d.c_str() + d.size() - 100));
+}
+
+TEST(ChunkMacMap, tailGapsMatchMacsmacGaps)
+{
+    mega::chunkmac_map map;
+    m_off_t pos = 0;
+    for (m_off_t i = 0; i < 200; ++i, pos = mega::ChunkedHash::chunkceil(pos))
+    {
+        mega::ChunkMAC& chunkMac = map[pos];
+        std::fill(chunkMac.mac, chunkMac.mac + mega::SymmCipher::BLOCKSIZE, static_cast<mega::byte>(i * 7));
+        chunkMac.finished = true;
+    }
+
+    mega::SymmCipher cipher;
+    mega::byte key[mega::SymmCipher::KEYLENGTH] = { 7 };
+    cipher.setkey(key);
+
+    mega::chunkmac_map::TailGaps tailGaps(map, &cipher, 150);
+    EXPECT_EQ(map.macsmac(&cipher), tailGaps.macsmac_gaps(200, 200, 200, 200));
+    EXPECT_EQ(map.macsmac_gaps(&cipher, 150, 151, 200, 200), tailGaps.macsmac_gaps(150, 151, 200, 200));
+    EXPECT_EQ(map.macsmac_gaps(&cipher, 170, 180, 190, 199), tailGaps.macsmac_gaps(170, 180, 190, 199));
+    EXPECT_NE(map.macsmac(&cipher), tailGaps.macsmac_gaps(199, 200, 200, 200));
+}
+
+TEST(ChunkMacMap, theUnprocessedPositionsSkipTheFinishedChunks)
+{
+    const m_off_t size = 10 << 20;
+    std::vector<m_off_t> starts;
+    for (m_off_t pos = 0; pos < size; pos = mega::ChunkedHash::chunkceil(pos, size))
+    {
+        starts.push_back(pos);
+    }
+    ASSERT_GT(starts.size(), 8u);
+
+    mega::chunkmac_map map;
+    map[starts[0]].finished = true;
+    map[starts[1]].finished = true;
+    map[starts[2]].finished = true;
+    map[starts[3]].offset = 1000;
+    map[starts[5]].finished = true;
+
+    EXPECT_EQ(starts[3] + 1000, map.nextUnprocessedPosFrom(0));
+    EXPECT_EQ(starts[3] + 1000, map.nextUnprocessedPosFrom(starts[1] + 5));
+    EXPECT_EQ(starts[4], map.nextUnprocessedPosFrom(starts[4]));
+    EXPECT_EQ(starts[6], map.nextUnprocessedPosFrom(starts[5]));
+
+    // a piece stops at a chunk already started, at the end of the file, or at the size of a request
+    EXPECT_EQ(starts[5], map.expandUnprocessedPiece(starts[4], starts[5], size, size));
+    EXPECT_EQ(size, map.expandUnprocessedPiece(starts[6], starts[7], size, size));
+    EXPECT_EQ(starts[7], map.expandUnprocessedPiece(starts[6], starts[7], size, 0));
+}
+
+TEST(ChunkMacMap, theLeadingFinishedChunksAreFolded)
+{
+    const m_off_t size = 200 << 20;
+    mega::SymmCipher cipher;
+    mega::byte key[mega::SymmCipher::KEYLENGTH] = { 9 };
+    cipher.setkey(&key[0]);
+
+    // all the chunks but the third, then with it
+    mega::chunkmac_map whole;
+    mega::chunkmac_map folded;
+    size_t n = 0;
+    m_off_t third = 0;
+    for (m_off_t pos = 0; pos < size; pos = mega::ChunkedHash::chunkceil(pos, size), ++n)
+    {
+        mega::ChunkMAC chunkMac;
+        std::fill(chunkMac.mac, chunkMac.mac + mega::SymmCipher::BLOCKSIZE, static_cast<mega::byte>(n * 3));
+        chunkMac.finished = true;
+        whole[pos] = chunkMac;
+        if (n == 2)
+        {
+            third = pos;
+        }
+        else
+        {
+            folded[pos] = chunkMac;
+        }
+    }
+
+    folded.foldFinished(&cipher, size);
+    EXPECT_EQ(third, folded.foldedEnd());
+
+    folded[third] = whole[third];
+    folded.foldFinished(&cipher, size);
+    EXPECT_LE(folded.foldedEnd(), size - mega::chunkmac_map::UNFOLDED_TAIL);
+    EXPECT_GT(folded.foldedEnd(), size - mega::chunkmac_map::UNFOLDED_TAIL - (1 << 20));
+    EXPECT_EQ(whole.size(), folded.chunkCount());
+    EXPECT_EQ(whole.macsmac(&cipher), folded.macsmac(&cipher));
+
+    // the late gaps are still looked for among the last entries
+    mega::chunkmac_map::TailGaps wholeGaps(whole, &cipher, n - 96);
+    mega::chunkmac_map::TailGaps foldedGaps(folded, &cipher, n - 96);
+    EXPECT_EQ(wholeGaps.macsmac_gaps(n - 10, n - 5, n, n), foldedGaps.macsmac_gaps(n - 10, n - 5, n, n));
+
+    m_off_t chunkpos, progress;
+    folded.calcprogress(size, chunkpos, progress);
+    EXPECT_EQ(size, chunkpos);
+    EXPECT_EQ(size, progress);
+    EXPECT_LE(size, folded.nextUnprocessedPosFrom(0));
+
+    std::string d;
+    folded.serialize(d);
+
+    mega::chunkmac_map restored;
+    auto data = d.c_str();
+    ASSERT_TRUE(restored.unserialize(data, d.c_str() + d.size()));
+    EXPECT_EQ(folded.foldedEnd(), restored.foldedEnd());
+    EXPECT_EQ(folded.chunkCount(), restored.chunkCount());
+    EXPECT_EQ(whole.macsmac(&cipher), restored.macsmac(&cipher));
+
+    restored.clear();
+    EXPECT_TRUE(restored.empty());
+    EXPECT_EQ(0, restored.foldedEnd());
+}
@@ -26,6 +26,9 @@
 #include <mega/megaclient.h>
 #include <mega/types.h>
 
+#include "utils.h"
+#include "mega.h"
+
 using namespace std;
 using namespace mega;
 
@@ -315,3 +318,368 @@ public:
     }
 };
 
+
+TEST(Commands, CommandFetchNodes_nodesAreReadWhileDownloading)
+{
+    MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    const string response = R"([{"f":[{"h":"AAAAAAAA","t":2},)"
+                            R"({"h":"CCCCCCCC","p":"BBBBBBBB","u":"AAAAAAAAAAA","t":0,"s":5,"a":"x","k":"AAAAAAAAAAA:x","ts":1},)"
+                            R"({"h":"BBBBBBBB","p":"AAAAAAAA","u":"AAAAAAAAAAA","t":1,"a":"x","k":"AAAAAAAAAAA:x","ts":1}],)"
+                            R"("sn":"AAAAAAAAAAA"}])";
+
+    client->mFetchNodesStream = mega::make_unique<MegaClient::FetchNodesStream>();
+
+    HttpReq req;
+    size_t chunks[] = { 4, 30, 120, response.size() };
+    size_t sent = 0;
+    for (size_t chunk : chunks)
+    {
+        size_t len = std::min(chunk, response.size() - sent);
+        req.put((void*)(response.data() + sent), unsigned(len), true);
+        sent += len;
+        client->streamfetchnodes(&req, false);
+
+        // only an incomplete node object is kept
+        EXPECT_GT(size_t(120), req.size());
+    }
+
+    EXPECT_EQ(MegaClient::FetchNodesStream::DONE, client->mFetchNodesStream->state);
+    client->streamfetchnodes(&req, true);
+
+    EXPECT_EQ(R"([{"sn":"AAAAAAAAAAA"}])", req.in);
+    ASSERT_EQ(3u, client->nodes.size());
+
+    // the file arrived before its parent folder
+    handle fileHandle = 0, folderHandle = 0;
+    Base64::atob("CCCCCCCC", (byte*)&fileHandle, MegaClient::NODEHANDLE);
+    Base64::atob("BBBBBBBB", (byte*)&folderHandle, MegaClient::NODEHANDLE);
+
+    Node* file = client->nodebyhandle(fileHandle);
+    ASSERT_NE(nullptr, file);
+    EXPECT_EQ(client->nodebyhandle(folderHandle), file->parent);
+}
+
+TEST(Commands, CommandFetchNodes_aReloadNotifiesTheNodesThatDiffer)
+{
+    MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    auto& root = mt::makeNode(*client, ROOTNODE, 1);
+    mt::makeNode(*client, FOLDERNODE, 2, &root);
+    mt::makeNode(*client, FILENODE, 3, &root);
+
+    client->beginrefresh();
+    ASSERT_NE(nullptr, client->mTreeRefresh);
+
+    // the new tree: the folder is gone, the file moved to a new one
+    client->purgenodesusersabortsc(true);
+    auto& newRoot = mt::makeNode(*client, ROOTNODE, 1);
+    auto& folder = mt::makeNode(*client, FOLDERNODE, 4, &newRoot);
+    auto& file = mt::makeNode(*client, FILENODE, 3, &folder);
+
+    client->endrefresh();
+    ASSERT_EQ(nullptr, client->mTreeRefresh);
+    ASSERT_EQ(3u, client->nodenotify.size());
+
+    EXPECT_TRUE(folder.notified && folder.changed.newnode);
+    EXPECT_TRUE(file.notified && file.changed.parent && !file.changed.attrs);
+    EXPECT_FALSE(newRoot.notified);
+
+    // the placeholder of the folder is told last
+    Node* removed = client->nodenotify.back();
+    EXPECT_EQ(handle(2), removed->nodehandle);
+    EXPECT_TRUE(removed->changed.removed);
+}
+
+namespace {
+
+class MockCommand : public Command
+{
+public:
+    MockCommand(const char* name, bool independent, int& processed)
+        : mProcessed(processed)
+    {
+        cmd(name);
+        orderIndependent = independent;
+    }
+
+    bool procresult(Result r) override
+    {
+        ++mProcessed;
+        return r.wasErrorOrOK();
+    }
+
+    int& mProcessed;
+};
+
+} // anonymous
+
+TEST(Commands, RequestDispatcher_orderIndependentCommandsGoInParallelBatches)
+{
+    MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    int processed = 0;
+    RequestDispatcher reqs;
+    reqs.setmaxinflight(2);
+    reqs.add(new MockCommand("a", false, processed));
+    reqs.add(new MockCommand("g", true, processed));
+    reqs.add(new MockCommand("b", false, processed));
+
+    string out;
+    bool suppressSID, fetchingNodes;
+    ASSERT_TRUE(reqs.parallelready());
+    int first = reqs.parallelrequest(&out, suppressSID);
+    EXPECT_EQ(R"([{"a":"g"}])", out);
+    EXPECT_FALSE(reqs.parallelready());
+
+    reqs.serverrequest(&out, suppressSID, fetchingNodes);
+    EXPECT_EQ(R"([{"a":"a"},{"a":"b"}])", out);
+    EXPECT_FALSE(reqs.cmdspending());
+
+    // responses of parallel batches are processed as they arrive
+    reqs.parallelresponse(first, "[0]", client.get());
+    EXPECT_EQ(1, processed);
+
+    // a failed parallel batch is sent again in the ordered queue
+    reqs.add(new MockCommand("g", true, processed));
+    int second = reqs.parallelrequest(&out, suppressSID);
+    reqs.parallelrequeue(second);
+    EXPECT_FALSE(reqs.parallelready());
+    ASSERT_TRUE(reqs.cmdspending());
+
+    reqs.serverresponse("[0,0]", client.get());
+    EXPECT_EQ(3, processed);
+
+    reqs.serverrequest(&out, suppressSID, fetchingNodes);
+    EXPECT_EQ(R"([{"a":"g"}])", out);
+    reqs.serverresponse("[0]", client.get());
+    EXPECT_EQ(4, processed);
+}
+
+TEST(Commands, RequestDispatcher_batchBuffersAreReused)
+{
+    MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    int processed = 0;
+    RequestDispatcher reqs;
+    for (int i = 0; i < 100; ++i)
+    {
+        reqs.add(new MockCommand("a", false, processed));
+    }
+
+    string out;
+    bool suppressSID, fetchingNodes;
+    reqs.serverrequest(&out, suppressSID, fetchingNodes);
+    string response = "[0";
+    for (int i = 1; i < 100; ++i)
+    {
+        response += ",0";
+    }
+    reqs.serverresponse(response + "]", client.get());
+    EXPECT_EQ(100, processed);
+
+    // the next batch is serialized into the buffer of the previous one
+    const char* buffer = out.data();
+    reqs.recyclebuffer(std::move(out));
+
+    reqs.add(new MockCommand("b", false, processed));
+    string next;
+    reqs.serverrequest(&next, suppressSID, fetchingNodes);
+    EXPECT_EQ(R"([{"a":"b"}])", next);
+    EXPECT_EQ(buffer, next.data());
+}
+
+TEST(Commands, RequestDispatcher_backgroundCommandsWaitForTheOthers)
+{
+    MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    int processed = 0;
+    RequestDispatcher reqs;
+    auto background = [&](const char* name)
+    {
+        auto c = new MockCommand(name, false, processed);
+        c->background = true;
+        reqs.add(c);
+    };
+    reqs.add(new MockCommand("a", false, processed));
+    background("x");
+    background("y");
+
+    string out;
+    bool suppressSID, fetchingNodes;
+    reqs.serverrequest(&out, suppressSID, fetchingNodes);
+    EXPECT_EQ(R"([{"a":"a"}])", out);
+    EXPECT_EQ(1u, reqs.queuedbatches());
+
+    // a command added afterwards goes ahead of the background ones
+    reqs.add(new MockCommand("b", false, processed));
+    reqs.serverresponse("[0]", client.get());
+    reqs.serverrequest(&out, suppressSID, fetchingNodes);
+    EXPECT_EQ(R"([{"a":"b"}])", out);
+
+    reqs.serverresponse("[0]", client.get());
+    ASSERT_TRUE(reqs.cmdspending());
+    reqs.serverrequest(&out, suppressSID, fetchingNodes);
+    EXPECT_EQ(R"([{"a":"x"},{"a":"y"}])", out);
+    EXPECT_FALSE(reqs.cmdspending());
+
+    reqs.serverresponse("[0,0]", client.get());
+    EXPECT_EQ(4, processed);
+}
+
+namespace {
+
+// replaces earlier ones with the same key, other keys are independent of it
+class MockCoalescingCommand : public Command
+{
+public:
+    MockCoalescingCommand(const char* key, vector<pair<string, error>>& results)
+        : mKey(key)
+        , mResults(results)
+    {
+        cmd("a");
+        arg("n", key);
+    }
+
+    Coalescing coalescing(const Command& earlier) const override
+    {
+        auto c = dynamic_cast<const MockCoalescingCommand*>(&earlier);
+        return !c ? COALESCE_NONE : c->mKey == mKey ? COALESCE_REPLACE : COALESCE_PASS;
+    }
+
+    bool procresult(Result r) override
+    {
+        mResults.emplace_back(mKey + std::to_string(tag), error(r.errorOrOK()));
+        return r.wasErrorOrOK();
+    }
+
+    string mKey;
+    vector<pair<string, error>>& mResults;
+};
+
+} // anonymous
+
+TEST(Commands, RequestDispatcher_redundantCommandsAreCoalesced)
+{
+    MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    int processed = 0;
+    vector<pair<string, error>> results;
+    RequestDispatcher reqs;
+    auto add = [&](Command* c, int tag)
+    {
+        c->tag = tag;
+        reqs.add(c);
+    };
+    add(new MockCoalescingCommand("x", results), 1);
+    add(new MockCoalescingCommand("y", results), 2);
+    add(new MockCoalescingCommand("x", results), 3);
+    add(new MockCommand("b", false, processed), 4);
+    add(new MockCoalescingCommand("x", results), 5);
+
+    string out;
+    bool suppressSID, fetchingNodes;
+    reqs.serverrequest(&out, suppressSID, fetchingNodes);
+    EXPECT_EQ(R"([{"a":"a","n":"y"},{"a":"a","n":"x"},{"a":"b"},{"a":"a","n":"x"}])", out);
+
+    // every replaced command gets the result of the one sent
+    reqs.serverresponse("[0,-9,0,0]", client.get());
+    EXPECT_EQ(1, processed);
+    EXPECT_EQ((vector<pair<string, error>>{{"y2", API_OK}, {"x1", API_ENOENT}, {"x3", API_ENOENT}, {"x5", API_OK}}), results);
+}
+
+TEST(Commands, ActionPackets_processedWhileDownloading)
+{
+    MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    const string packet = R"({"a":"zz","x":")" + string(100, 'x') + R"("})";
+    const string response = R"({"a":[)" + packet + "," + packet + "," + packet + "]}";
+
+    HttpReq req;
+    client->mScStream = MegaClient::SCSTREAM_PENDING;
+
+    auto receive = [&](size_t from, size_t to)
+    {
+        req.put((void*)(response.data() + from), unsigned(to - from), true);
+        client->streamsc(&req);
+    };
+
+    // the first two packets, the third being incomplete
+    receive(0, 4);
+    EXPECT_EQ(MegaClient::SCSTREAM_PENDING, client->mScStream);
+    receive(4, 6 + 2 * (packet.size() + 1) + 70);
+    EXPECT_EQ(MegaClient::SCSTREAM_PACKETS, client->mScStream);
+    EXPECT_EQ(2u, client->scsn.packetsApplied());
+    EXPECT_EQ(2, client->fnstats.actionPackets);
+    EXPECT_GT(packet.size(), req.size());
+
+    // the connection drops: the same packets arrive again in full, those processed already are skipped
+    string retried = response;
+    client->mScSkipPackets = client->scsn.packetsApplied();
+    client->insca = false;
+    client->jsonsc.begin(retried.c_str());
+    client->jsonsc.enterobject();
+    EXPECT_TRUE(client->procsc());
+
+    EXPECT_EQ(3u, client->scsn.packetsApplied());
+    EXPECT_EQ(3, client->fnstats.actionPackets);
+    EXPECT_EQ(0u, client->mScSkipPackets);
+}
+
+namespace {
+
+class MockApp_getua : public MegaApp
+{
+public:
+    MegaClient* client = nullptr;
+    vector<pair<int, string>> results;
+
+    void getua_result(byte* data, unsigned len, attr_t) override
+    {
+        results.emplace_back(client->restag, string(reinterpret_cast<char*>(data), len));
+    }
+};
+
+} // anonymous
+
+TEST(Commands, CommandGetUA_retrievalsOfTheSameAttributeAreJoined)
+{
+    MockApp_getua app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+    app.client = client.get();
+
+    client->getua("foo@mega.co.nz", ATTR_FIRSTNAME, nullptr, 1);
+    client->getua("foo@mega.co.nz", ATTR_FIRSTNAME, nullptr, 2);
+    client->getua("foo@mega.co.nz", ATTR_LASTNAME, nullptr, 3);
+
+    string out;
+    bool suppressSID, fetchingNodes;
+    client->reqs.serverrequest(&out, suppressSID, fetchingNodes);
+    EXPECT_EQ(R"([{"a":"uga","u":"foo@mega.co.nz","ua":"firstname","v":1},{"a":"uga","u":"foo@mega.co.nz","ua":"lastname","v":1}])", out);
+
+    // while in flight too
+    client->getua("foo@mega.co.nz", ATTR_FIRSTNAME, nullptr, 4);
+    EXPECT_FALSE(client->reqs.cmdspending());
+
+    client->reqs.serverresponse(R"([{"av":"Rm9v","v":"a"},{"av":"QmFy","v":"b"}])", client.get());
+    EXPECT_EQ((vector<pair<int, string>>{{1, "Foo"}, {2, "Foo"}, {4, "Foo"}, {3, "Bar"}}), app.results);
+
+    // once answered, it's retrieved again
+    client->getua("foo@mega.co.nz", ATTR_FIRSTNAME, nullptr, 5);
+    EXPECT_TRUE(client->reqs.cmdspending());
+}
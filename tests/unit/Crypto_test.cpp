@@ -18,6 +18,7 @@
 
 #include "mega.h"
 #include "../src/crypto/sodium.cpp"
+#include <array>
 #include <math.h>
 #include "gtest/gtest.h"
 
@@ -160,6 +161,124 @@ TEST(Crypto, AES_CCM)
     ASSERT_STREQ(result.data(), plainText.data()) << "CCM decryption: plain text doesn't match the expected value";
 }
 
+// The batch ctr_crypt() must match ctr_crypt() of every piece on its own
+TEST(Crypto, AES_CTR_batch)
+{
+    byte key[SymmCipher::KEYLENGTH];
+    for (unsigned i = 0; i < sizeof key; ++i) key[i] = byte(i * 7 + 1);
+    SymmCipher cipher(key);
+    int64_t ctriv = 0x0123456789abcdefLL;
+
+    // full chunks, partial blocks and a single block; the last one has no mac
+    const unsigned lengths[] = { 131072, 262144, 100, 16, 131072 + 5, 33, 4096 };
+    const size_t count = sizeof lengths / sizeof *lengths;
+
+    for (bool encrypt : { true, false })
+    {
+        vector<string> single(count), batch(count);
+        vector<std::array<byte, SymmCipher::BLOCKSIZE>> singlemacs(count), batchmacs(count);
+        vector<SymmCipher::CtrChunk> chunks;
+        m_off_t pos = 0;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            // like transfer buffers, the data is padded to a whole block
+            single[i].assign((lengths[i] + SymmCipher::BLOCKSIZE - 1) & -SymmCipher::BLOCKSIZE, '\0');
+            for (unsigned j = 0; j < lengths[i]; ++j) single[i][j] = char(j * 31 + i);
+            batch[i] = single[i];
+
+            // odd pieces continue a mac that was already started
+            bool initmac = !(i & 1);
+            for (unsigned j = 0; j < SymmCipher::BLOCKSIZE; ++j) singlemacs[i][j] = batchmacs[i][j] = byte(i + j);
+            byte* mac = i + 1 < count ? batchmacs[i].data() : nullptr;
+
+            cipher.ctr_crypt((byte*)&single[i][0], lengths[i], pos, ctriv, mac ? singlemacs[i].data() : nullptr, encrypt, initmac);
+
+            SymmCipher::CtrChunk c = { (byte*)&batch[i][0], lengths[i], pos, mac, initmac };
+            chunks.push_back(c);
+            pos += single[i].size();
+        }
+
+        cipher.ctr_crypt(chunks.data(), chunks.size(), ctriv, encrypt);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            ASSERT_EQ(single[i], batch[i]) << "piece " << i << (encrypt ? " encrypt" : " decrypt");
+            ASSERT_EQ(singlemacs[i], batchmacs[i]) << "piece " << i << (encrypt ? " encrypt" : " decrypt");
+        }
+    }
+}
+
+TEST(Crypto, SymmCipherCache)
+{
+    SymmCipherCache cache;
+    byte keys[SymmCipherCache::CAPACITY + 1][FILENODEKEYLENGTH];
+    for (unsigned i = 0; i < SymmCipherCache::CAPACITY + 1; ++i)
+        for (unsigned j = 0; j < FILENODEKEYLENGTH; ++j) keys[i][j] = byte(i * 37 + j * 13 + 5);
+
+    // a file key is folded like setkey() does it
+    SymmCipher expected;
+    expected.setkey(keys[0], FILENODE);
+    SymmCipher* first = cache.get(keys[0], FILENODE);
+    ASSERT_EQ(0, memcmp(expected.key, first->key, sizeof expected.key));
+
+    byte block[SymmCipher::BLOCKSIZE] = { 1, 2, 3 }, check[SymmCipher::BLOCKSIZE] = { 1, 2, 3 };
+    expected.ecb_encrypt(check);
+    first->ecb_encrypt(block);
+    ASSERT_EQ(0, memcmp(check, block, sizeof block));
+
+    string filekey((const char*)keys[0], FILENODEKEYLENGTH);
+    ASSERT_EQ(first, cache.get(&filekey));
+    string shortkey = "short";
+    ASSERT_EQ(nullptr, cache.get(&shortkey));
+    ASSERT_EQ(1u, cache.misses);
+    ASSERT_EQ(1u, cache.hits);
+
+    // the least recently used key goes first
+    for (size_t i = 1; i < SymmCipherCache::CAPACITY; ++i)
+    {
+        cache.get(keys[i]);
+    }
+    ASSERT_EQ(first, cache.get(keys[0], FILENODE));
+    cache.get(keys[SymmCipherCache::CAPACITY]);
+    ASSERT_EQ(first, cache.get(keys[0], FILENODE));
+    ASSERT_EQ(SymmCipherCache::CAPACITY + 1, cache.misses);
+
+    cache.get(keys[1]);
+    ASSERT_EQ(SymmCipherCache::CAPACITY + 2, cache.misses);
+}
+
+TEST(Crypto, SymmCipher_rekeyedModes)
+{
+    byte key1[SymmCipher::KEYLENGTH] = { 1 }, key2[SymmCipher::KEYLENGTH] = { 2 };
+    byte iv[12] = { 3 };
+    byte plain[SymmCipher::BLOCKSIZE * 2] = { 4, 5, 6 };
+
+    // the modes keyed on first use follow a later setkey()
+    SymmCipher cipher(key1);
+    byte data[sizeof plain];
+    memcpy(data, plain, sizeof data);
+    cipher.cbc_encrypt(data, sizeof data);
+    string text((const char*)plain, sizeof plain), sealed, opened;
+    cipher.gcm_encrypt(&text, iv, sizeof iv, 16, &sealed);
+
+    cipher.setkey(key2);
+    SymmCipher reference(key2);
+
+    byte expected[sizeof plain];
+    memcpy(data, plain, sizeof data);
+    memcpy(expected, plain, sizeof expected);
+    cipher.cbc_encrypt(data, sizeof data);
+    reference.cbc_encrypt(expected, sizeof expected);
+    ASSERT_EQ(0, memcmp(expected, data, sizeof data));
+
+    ASSERT_FALSE(cipher.gcm_decrypt(&sealed, iv, sizeof iv, 16, &opened));
+
+    SymmCipher copy(cipher);
+    copy.cbc_decrypt(data, sizeof data);
+    ASSERT_EQ(0, memcmp(plain, data, sizeof data));
+}
+
 #ifdef ENABLE_CHAT
 // Test functions of Ed25519:
 // - Binary & Hex fingerprints of public key
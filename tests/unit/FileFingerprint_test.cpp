@@ -61,6 +61,7 @@ public:
             return false;
         }
         assert(static_cast<unsigned>(offset) + size <= mContent.size());
+        ++mReads;
         std::copy(mContent.begin() + static_cast<unsigned>(offset), mContent.begin() + static_cast<unsigned>(offset) + size, buffer);
         return true;
     }
@@ -73,6 +74,8 @@ public:
         return mReadFails;
     }
 
+    unsigned mReads = 0;
+
 private:
     const std::vector<mega::byte> mContent;
     const bool mReadFails = false;
@@ -443,6 +446,25 @@ TEST(FileFingerprint, genfingerprint_FileAccess_forLargeFile_butReadFails)
     ASSERT_EQ(false, ffp.isvalid);
 }
 
+TEST(FileFingerprint, frawreadsparse_readsNearbyBlocksTogether)
+{
+    std::vector<mega::byte> content(300000);
+    std::iota(content.begin(), content.end(), mega::byte{0});
+    MockFileAccess fa{1, content};
+
+    // two runs within a span, then one on its own
+    const m_off_t positions[] = {0, 1000, 60000, 100000, 100064, 299990};
+    std::vector<mega::byte> blocks(10 * 6);
+    ASSERT_TRUE(fa.frawreadsparse(blocks.data(), 10, positions, 6));
+    ASSERT_EQ(3u, fa.mReads);
+
+    for (size_t i = 0; i < 6; ++i)
+    {
+        const auto at = content.begin() + static_cast<size_t>(positions[i]);
+        ASSERT_TRUE(std::equal(at, at + 10, blocks.begin() + i * 10)) << i;
+    }
+}
+
 TEST(FileFingerprint, genfingerprint_InputStreamAccess_forTinyFile)
 {
     mega::FileFingerprint ffp;
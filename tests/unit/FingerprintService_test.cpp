@@ -0,0 +1,161 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "mega.h"
+
+using namespace mega;
+
+namespace {
+
+class FingerprintServiceTest : public ::testing::Test
+{
+public:
+    FingerprintServiceTest()
+    {
+        bool result = fsAccess.cwd(rootPath);
+        assert(result);
+
+        rootPath.appendWithSeparator(LocalPath::fromPath("fingerprintservice", fsAccess), false);
+
+        fsAccess.emptydirlocal(rootPath);
+        fsAccess.rmdirlocal(rootPath);
+
+        result = fsAccess.mkdirlocal(rootPath, false);
+        assert(result);
+        (void)result;
+    }
+
+    ~FingerprintServiceTest()
+    {
+        fsAccess.emptydirlocal(rootPath);
+        fsAccess.rmdirlocal(rootPath);
+    }
+
+    LocalPath makeFile(const string& name, size_t size)
+    {
+        LocalPath path = rootPath;
+        path.appendWithSeparator(LocalPath::fromPath(name, fsAccess), false);
+
+        auto fa = fsAccess.newfileaccess(false);
+        EXPECT_TRUE(fa->fopen(path, false, true));
+
+        string data(size, '\0');
+        for (size_t i = 0; i < size; ++i)
+        {
+            data[i] = static_cast<char>(i * 31 + size);
+        }
+        EXPECT_TRUE(fa->fwrite(reinterpret_cast<const byte*>(data.data()), unsigned(data.size()), 0));
+        return path;
+    }
+
+    bool waitFor(const std::vector<std::shared_ptr<FingerprintService::Job>>& jobs)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            if (std::all_of(jobs.begin(), jobs.end(), [](const std::shared_ptr<FingerprintService::Job>& j) { return j->done(); }))
+            {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return false;
+    }
+
+    FSACCESS_CLASS fsAccess;
+    LocalPath rootPath;
+};
+
+} // namespace
+
+TEST_F(FingerprintServiceTest, FingerprintsAreTheSameAsOnTheSdkThread)
+{
+    std::vector<LocalPath> paths;
+    for (size_t size : { 0, 1, 8192, 100000, 1 << 20 })
+    {
+        paths.push_back(makeFile("f" + std::to_string(size), size));
+    }
+
+    for (unsigned readsPerDevice : { 1, 2, 8 })
+    {
+        WAIT_CLASS waiter;
+        FingerprintService service(waiter, 3, readsPerDevice);
+
+        std::vector<std::shared_ptr<FingerprintService::Job>> jobs;
+        for (auto& path : paths)
+        {
+            jobs.push_back(service.queue(path));
+        }
+
+        ASSERT_TRUE(waitFor(jobs));
+
+        for (auto& job : jobs)
+        {
+            FileFingerprint expected;
+            LocalPath path = job->path;
+            auto fa = fsAccess.newfileaccess(false);
+            ASSERT_TRUE(fa->fopen(path, true, false));
+            expected.genfingerprint(fa.get());
+
+            ASSERT_FALSE(job->failed);
+            ASSERT_EQ(FILENODE, job->type);
+            ASSERT_TRUE(job->fsidvalid);
+            ASSERT_TRUE(expected == job->fingerprint) << job->path.toPath(fsAccess);
+        }
+    }
+}
+
+TEST_F(FingerprintServiceTest, MissingFileFails)
+{
+    WAIT_CLASS waiter;
+    FingerprintService service(waiter, 1, 1);
+
+    LocalPath path = rootPath;
+    path.appendWithSeparator(LocalPath::fromPath("missing", fsAccess), false);
+
+    auto job = service.queue(path);
+    ASSERT_TRUE(waitFor({ job }));
+    ASSERT_TRUE(job->failed);
+    ASSERT_FALSE(job->fingerprint.isvalid);
+}
+
+TEST_F(FingerprintServiceTest, JobsNotStartedFailWhenTheServiceGoesAway)
+{
+    auto path = makeFile("f", 100000);
+
+    std::vector<std::shared_ptr<FingerprintService::Job>> jobs;
+    {
+        WAIT_CLASS waiter;
+        FingerprintService service(waiter, 1, 1);
+        for (int i = 100; i--; )
+        {
+            jobs.push_back(service.queue(path));
+        }
+    }
+
+    for (auto& job : jobs)
+    {
+        ASSERT_TRUE(job->done());
+        ASSERT_TRUE(job->failed || job->fingerprint.isvalid);
+    }
+}
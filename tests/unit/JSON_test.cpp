@@ -0,0 +1,187 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <gtest/gtest.h>
+
+#include <mega/base64.h>
+#include <mega/json.h>
+
+namespace {
+
+// a fetchnodes response of the given number of nodes, shaped like the real ones
+std::string fetchnodesResponse(size_t nodes)
+{
+    std::string json = R"([{"f":[)";
+    for (size_t i = 0; i < nodes; ++i)
+    {
+        mega::handle h = i * 2654435761u;
+        std::string handle = mega::Base64Str<6>(reinterpret_cast<const mega::byte*>(&h)).chars;
+        json.append(i ? "," : "");
+        json.append(R"({"h":")" + handle + R"(","p":"AAAAAAAA","u":"AAAAAAAAAAA","t":0,"a":")" + std::string(96, 'a')
+                    + R"(","k":"AAAAAAAAAAA:)" + std::string(43, 'k') + R"(","s":)" + std::to_string(i * 977)
+                    + R"(,"fa":"123:0*AAAAAAAAAAA/456:1*AAAAAAAAAAA","ts":1600000000})");
+    }
+    json.append(R"(],"sn":"AAAAAAAAAAA"}])");
+    return json;
+}
+
+// reads the nodes as MegaClient::readnode() does, returns the sum of their sizes
+m_off_t readNodes(const std::string& response)
+{
+    mega::JSON json(response);
+    m_off_t sum = 0;
+    std::string attrs;
+
+    json.enterarray();
+    json.enterobject();
+    json.getnameid();
+    json.enterarray();
+    while (json.enterobject())
+    {
+        for (mega::nameid name; (name = json.getnameid()) != EOO; )
+        {
+            switch (name)
+            {
+                case 'h':
+                case 'p':
+                    json.gethandle(6);
+                    break;
+                case 'u':
+                    json.gethandle(8);
+                    break;
+                case 's':
+                    sum += json.getint();
+                    break;
+                case 'a':
+                    json.storeobject(&attrs);
+                    break;
+                default:
+                    json.storeobject();
+            }
+        }
+        json.leaveobject();
+    }
+    return sum;
+}
+
+} // namespace
+
+TEST(JSONStringScanner, allImplementationsFindTheEnd)
+{
+    auto implementations = mega::JSONStringScanner::implementations();
+    ASSERT_STREQ("scalar", implementations.front().first);
+
+    unsigned x = 12345;
+    for (size_t length = 0; length < 100; ++length)
+    {
+        // mostly plain characters, with escapes and quotes here and there
+        std::string data(length + 64, '\0');
+        for (size_t i = 0; i < length; ++i)
+        {
+            x = x * 1103515245 + 12345;
+            unsigned r = (x >> 16) % 16;
+            data[i] = r == 0 ? '"' : r == 1 ? '\\' : char('a' + r);
+        }
+
+        // every alignment of the start
+        for (size_t offset = 0; offset < std::min<size_t>(length + 1, 40); ++offset)
+        {
+            const char* expected = implementations.front().second(data.data() + offset);
+            for (auto& impl : implementations)
+            {
+                ASSERT_EQ(expected, impl.second(data.data() + offset)) << impl.first << ", length: " << length << ", offset: " << offset;
+            }
+        }
+    }
+}
+
+TEST(JSON, getname)
+{
+    mega::JSON json(R"({"firstname":"a","b":1})");
+    json.enterobject();
+
+    ASSERT_EQ("firstname", json.getnameWithoutAdvance());
+    ASSERT_EQ("firstname", json.getname());
+    json.storeobject();
+    ASSERT_EQ("b", json.getname());
+    ASSERT_EQ(1, json.getint());
+}
+
+TEST(JSON, unescape)
+{
+    std::string s = R"(a\"b\\c\ndAe\/f\)";
+    mega::JSON::unescape(&s);
+    ASSERT_EQ("a\"b\\c\ndAe/f\\", s);
+
+    s = "nothing to unescape";
+    mega::JSON::unescape(&s);
+    ASSERT_EQ("nothing to unescape", s);
+
+    s = R"(\u00)";
+    mega::JSON::unescape(&s);
+    ASSERT_EQ(1u, s.size());
+}
+
+TEST(JSON, handlesAndIntegersAreSkipped)
+{
+    mega::JSON json(R"("AAAAAAAB","AAAAAAAAAAE",-42,"7",12345678901234567890,"AAAAAAAAAAE",1.5,8})");
+
+    mega::handle h = 0;
+    mega::Base64::atob("AAAAAAAB", reinterpret_cast<mega::byte*>(&h), 6);
+    ASSERT_EQ(h, json.gethandle(6));
+
+    mega::Base64::atob("AAAAAAAAAAE", reinterpret_cast<mega::byte*>(&h), 8);
+    ASSERT_EQ(h, json.gethandle(8));
+
+    ASSERT_EQ(-42, json.getint());
+    ASSERT_EQ(7, json.getint());
+    json.getint(); // too long for the fast path, same as before
+    ASSERT_EQ(mega::UNDEF, json.gethandle(6));
+    ASSERT_EQ(1, json.getint());
+    ASSERT_EQ(8, json.getint());
+    ASSERT_EQ('}', *json.pos);
+}
+
+TEST(JSONWriter, binaryValuesAreWrittenAsBase64)
+{
+    std::string data = "arbitrary binary \x01\x02\xff data";
+    mega::handle h = 0x123456789abcull;
+
+    mega::JSONWriter writer;
+    writer.arg("h", h, 6);
+    writer.arg_B64("d", data);
+    writer.beginarray("e");
+    writer.element(h, 6);
+    writer.element_B64(data);
+    writer.endarray();
+
+    std::string b64 = mega::Base64::btoa(data);
+    std::string b64h = mega::Base64Str<6>(reinterpret_cast<const mega::byte*>(&h)).chars;
+    ASSERT_EQ("\"h\":\"" + b64h + "\",\"d\":\"" + b64 + "\",\"e\":[\"" + b64h + "\",\"" + b64 + "\"]", writer.getstring());
+}
+
+TEST(JSON, fetchnodesResponseIsRead)
+{
+    size_t nodes = 1000;
+    m_off_t expected = 0;
+    for (size_t i = 0; i < nodes; ++i)
+    {
+        expected += m_off_t(i * 977);
+    }
+    ASSERT_EQ(expected, readNodes(fetchnodesResponse(nodes)));
+}
@@ -509,3 +509,113 @@ TEST(Logging, macroFatal)
 }
 
 #endif
+
+namespace {
+
+class RecordingLogger : public mega::Logger
+{
+public:
+    void log(const char *time, int loglevel, const char *source, const char *message
+#ifdef ENABLE_LOG_PERFORMANCE
+             , const char **directMessages, size_t *directMessagesSizes, unsigned numberMessages
+#endif
+             ) override
+    {
+        std::string m = message;
+#ifdef ENABLE_LOG_PERFORMANCE
+        for (unsigned i = 0; i < numberMessages; i++)
+        {
+            m.append(directMessages[i], directMessagesSizes[i]);
+        }
+#endif
+        std::lock_guard<std::mutex> g(mMutex);
+        mTimes.push_back(time ? time : "(null)");
+        mSources.push_back(source ? source : "(null)");
+        mLevels.push_back(loglevel);
+        mMessages.push_back(m);
+    }
+
+    std::mutex mMutex;
+    std::vector<std::string> mTimes;
+    std::vector<std::string> mSources;
+    std::vector<int> mLevels;
+    std::vector<std::string> mMessages;
+};
+
+}
+
+TEST(Logging, asyncLogger_deliversEachThreadInOrder)
+{
+    RecordingLogger target;
+    {
+        mega::AsyncLogger logger(target);
+        logger.log("12:00:00", mega::logInfo, "file.cpp:1", "first");
+        logger.log(nullptr, mega::logDebug, nullptr, "second");
+
+        std::thread other([&logger]()
+        {
+            for (int i = 0; i < 100; i++)
+            {
+                logger.log(nullptr, mega::logMax, nullptr, std::to_string(i).c_str());
+            }
+        });
+        other.join();
+        logger.flush();
+
+        std::lock_guard<std::mutex> g(target.mMutex);
+        ASSERT_EQ(102u, target.mMessages.size());
+        ASSERT_EQ(0u, logger.droppedMessages());
+        EXPECT_EQ("first", target.mMessages[0]);
+        EXPECT_EQ("12:00:00", target.mTimes[0]);
+        EXPECT_EQ("file.cpp:1", target.mSources[0]);
+        EXPECT_EQ(mega::logInfo, target.mLevels[0]);
+        EXPECT_EQ("second", target.mMessages[1]);
+        EXPECT_EQ("(null)", target.mTimes[1]);
+
+        int next = 0;
+        for (size_t i = 2; i < target.mMessages.size(); i++)
+        {
+            EXPECT_EQ(std::to_string(next++), target.mMessages[i]);
+        }
+    }
+}
+
+TEST(Logging, asyncLogger_countsAndReportsDroppedMessages)
+{
+    RecordingLogger target;
+    size_t delivered = 0;
+    uint64_t dropped = 0;
+    {
+        // a minimal ring fills up long before the consumer gets to it
+        mega::AsyncLogger logger(target, 1024);
+        const std::string message(200, 'x');
+        for (int i = 0; i < 1000; i++)
+        {
+            logger.log(nullptr, mega::logInfo, nullptr, message.c_str());
+        }
+        logger.flush();
+        dropped = logger.droppedMessages();
+
+        // larger than the ring: delivered synchronously
+        const std::string huge(4096, 'y');
+        logger.log(nullptr, mega::logInfo, nullptr, huge.c_str());
+        logger.flush();
+    }
+
+    EXPECT_GT(dropped, 0u);
+    uint64_t reported = 0;
+    for (size_t i = 0; i < target.mMessages.size(); i++)
+    {
+        if (target.mLevels[i] == mega::logWarning)
+        {
+            reported += std::stoull(target.mMessages[i]);
+        }
+        else
+        {
+            delivered++;
+        }
+    }
+    EXPECT_EQ(dropped, reported);
+    EXPECT_EQ(1001u, delivered + dropped);
+    EXPECT_EQ(std::string(4096, 'y'), target.mMessages.back());
+}
@@ -17,7 +17,9 @@
  */
 
 #include <atomic>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <thread>
 
 #include <gtest/gtest.h>
@@ -192,6 +194,34 @@ TEST(MegaApi, MegaStringTable_copy_emptyStringTable)
     ASSERT_EQ(nullptr, copiedStringTable->get(0));
 }
 
+TEST(MegaApi, MegaTransferBatch_add_and_copy)
+{
+    auto batch = unique_ptr<MegaTransferBatch>{MegaTransferBatch::createInstance()};
+    ASSERT_EQ(0, batch->size());
+
+    batch->addUpload("/tmp/a.txt", nullptr, "b.txt", 1000, "data", true, true);
+    batch->addDownload(nullptr, "/tmp/");
+    ASSERT_EQ(2, batch->size());
+
+    auto copied = unique_ptr<MegaTransferBatch>{batch->copy()};
+    batch->addUpload("/tmp/c.txt", nullptr);
+    ASSERT_EQ(3, batch->size());
+    ASSERT_EQ(2, copied->size());
+
+    const auto& entries = static_cast<MegaTransferBatchPrivate*>(copied.get())->entries();
+    ASSERT_EQ(MegaTransfer::TYPE_UPLOAD, entries[0].type);
+    ASSERT_EQ("/tmp/a.txt", entries[0].localPath);
+    ASSERT_EQ("b.txt", entries[0].fileName);
+    ASSERT_EQ(1000, entries[0].mtime);
+    ASSERT_EQ("data", entries[0].appData);
+    ASSERT_TRUE(entries[0].isSourceTemporary);
+    ASSERT_TRUE(entries[0].startFirst);
+    ASSERT_EQ(MegaTransfer::TYPE_DOWNLOAD, entries[1].type);
+    ASSERT_EQ("/tmp/", entries[1].localPath);
+    ASSERT_FALSE(entries[1].hasAppData);
+    ASSERT_FALSE(entries[1].node);
+}
+
 TEST(MegaApi, getMimeType)
 {
     vector<thread> threads;
@@ -218,3 +248,311 @@ TEST(MegaApi, getMimeType)
 
     ASSERT_EQ(600, successCount);
 }
+
+TEST(MegaCallbackDispatcher, deliversInOrderFromItsOwnThread)
+{
+    vector<int> delivered;
+    bool otherThread = true;
+    {
+        MegaCallbackDispatcher dispatcher(4, MegaCallbackDispatcher::BLOCK);
+        for (int i = 0; i < 100; ++i)
+        {
+            dispatcher.push([&delivered, &dispatcher, &otherThread, i]()
+            {
+                otherThread = otherThread && dispatcher.isDispatcherThread();
+                delivered.push_back(i);
+            });
+        }
+    }   // the destructor delivers what is left
+
+    ASSERT_EQ(100u, delivered.size());
+    for (int i = 0; i < 100; ++i)
+    {
+        ASSERT_EQ(i, delivered[i]);
+    }
+    ASSERT_TRUE(otherThread);
+}
+
+TEST(MegaCallbackDispatcher, progressIsCoalesced)
+{
+    std::mutex gate;
+    gate.lock();
+    vector<int> delivered;
+    {
+        MegaCallbackDispatcher dispatcher(16, MegaCallbackDispatcher::COALESCE);
+
+        // keep the dispatcher busy while the updates are queued
+        dispatcher.push([&gate]() { gate.lock(); gate.unlock(); });
+        for (int i = 0; i < 10; ++i)
+        {
+            dispatcher.pushProgress(1, [&delivered, i]() { delivered.push_back(i); });
+        }
+        dispatcher.push([&delivered]() { delivered.push_back(-1); });
+        gate.unlock();
+    }
+
+    ASSERT_EQ((vector<int>{9, -1}), delivered);
+}
+
+TEST(MegaCallbackDispatcher, progressIsDroppedWhenFull)
+{
+    std::mutex gate;
+    gate.lock();
+    vector<int> delivered;
+    {
+        MegaCallbackDispatcher dispatcher(2, MegaCallbackDispatcher::DROP);
+
+        dispatcher.push([&gate]() { gate.lock(); gate.unlock(); });
+        // wait for the dispatcher to be blocked in it, so the queue is empty
+        while (dispatcher.size())
+        {
+            std::this_thread::yield();
+        }
+
+        for (int i = 0; i < 5; ++i)
+        {
+            dispatcher.pushProgress(1, [&delivered, i]() { delivered.push_back(i); });
+        }
+        gate.unlock();
+        dispatcher.push([&delivered]() { delivered.push_back(-1); });
+    }
+
+    ASSERT_EQ((vector<int>{0, 1, -1}), delivered);
+}
+
+TEST(MegaCallbackDispatcher, revokedListenersDontGetQueuedCallbacks)
+{
+    std::mutex gate;
+    gate.lock();
+    int a = 0, b = 0;
+    int calledA = 0, calledB = 0;
+    {
+        MegaCallbackDispatcher dispatcher(16, MegaCallbackDispatcher::BLOCK);
+        MegaCallbackDispatcher* d = &dispatcher;
+
+        dispatcher.push([&gate]() { gate.lock(); gate.unlock(); });
+        dispatcher.push([d, &a, &b, &calledA, &calledB]()
+        {
+            d->deliver(&a, [&calledA]() { ++calledA; });
+            d->deliver(&b, [&calledB]() { ++calledB; });
+        });
+        dispatcher.revoke(&a);
+
+        // queued after the revocation: delivered again
+        dispatcher.push([d, &a, &calledA]() { d->deliver(&a, [&calledA]() { ++calledA; }); });
+        gate.unlock();
+    }
+
+    ASSERT_EQ(1, calledA);
+    ASSERT_EQ(1, calledB);
+}
+
+TEST(MegaCallbackDispatcher, overflowsInsteadOfBlockingForever)
+{
+    std::mutex gate;
+    gate.lock();
+    vector<int> delivered;
+    {
+        MegaCallbackDispatcher dispatcher(1, MegaCallbackDispatcher::BLOCK);
+
+        // as a listener waiting for the SDK lock, held by the producer
+        dispatcher.push([&gate]() { gate.lock(); gate.unlock(); });
+        for (int i = 0; i < 3; ++i)
+        {
+            dispatcher.push([&delivered, i]() { delivered.push_back(i); });
+        }
+        gate.unlock();
+    }
+
+    ASSERT_EQ((vector<int>{0, 1, 2}), delivered);
+}
+
+#ifdef HAVE_LIBUV
+TEST(StreamingBuffer, handsOutTheChunksInOrderWithoutCopies)
+{
+    StreamingBuffer buffer;
+    buffer.setMaxOutputSize(8);
+    buffer.init(100);
+
+    ASSERT_EQ(10u, buffer.append("0123456789", 10));
+    ASSERT_EQ(90u, buffer.availableSpace());
+
+    // a single write, as big as the output size
+    vector<uv_buf_t> buffers;
+    ASSERT_EQ(8u, buffer.nextBuffers(buffers));
+    ASSERT_EQ(1u, buffers.size());
+    ASSERT_EQ("01234567", string(buffers[0].base, buffers[0].len));
+
+    // the rest goes in the next ones, after what's appended meanwhile
+    ASSERT_EQ(90u, buffer.append(string(100, 'x').data(), 100));
+    ASSERT_EQ(0u, buffer.availableSpace());
+    ASSERT_EQ(92u, buffer.availableData());
+    buffer.freeData(8);
+    ASSERT_EQ(8u, buffer.availableSpace());
+
+    ASSERT_EQ(8u, buffer.nextBuffers(buffers));
+    string data;
+    for (auto& b : buffers)
+    {
+        data.append(b.base, b.len);
+    }
+    ASSERT_EQ("89xxxxxx", data);
+    buffer.freeData(8);
+
+    // it grows while the writes go through, up to a quarter of the capacity
+    buffer.adaptOutputSize(true);
+    ASSERT_EQ(16u, buffer.outputSize());
+    buffer.adaptOutputSize(true);
+    ASSERT_EQ(25u, buffer.outputSize());
+    buffer.adaptOutputSize(false);
+    ASSERT_EQ(12u, buffer.outputSize());
+    buffer.adaptOutputSize(false);
+    ASSERT_EQ(8u, buffer.outputSize());
+
+    unsigned written = 0;
+    while (unsigned len = buffer.nextBuffers(buffers))
+    {
+        written += len;
+        buffer.freeData(len);
+    }
+    ASSERT_EQ(84u, written);
+    ASSERT_EQ(100u, buffer.availableSpace());
+
+    // and starts over
+    ASSERT_EQ(3u, buffer.append("abc", 3));
+    ASSERT_EQ(3u, buffer.nextBuffers(buffers));
+    ASSERT_EQ("abc", string(buffers[0].base, buffers[0].len));
+}
+
+namespace {
+
+struct HTTPServerCallbacks : public MegaHTTPServer
+{
+    using MegaHTTPServer::onHeaderField;
+    using MegaHTTPServer::onHeaderValue;
+    using MegaHTTPServer::onHeadersComplete;
+};
+
+} // namespace
+
+TEST(MegaHTTPServer, headersSplitBetweenReadsAreParsedWhole)
+{
+    http_parser_settings settings;
+    memset(&settings, 0, sizeof settings);
+    settings.on_header_field = HTTPServerCallbacks::onHeaderField;
+    settings.on_header_value = HTTPServerCallbacks::onHeaderValue;
+    settings.on_headers_complete = HTTPServerCallbacks::onHeadersComplete;
+
+    MegaHTTPContext httpctx;
+    http_parser_init(&httpctx.parser, HTTP_REQUEST);
+    httpctx.parser.data = &httpctx;
+
+    const string request = "GET /file HTTP/1.1\r\n"
+                           "Host: 127.0.0.1:4443\r\n"
+                           "X-Empty:\r\n"
+                           "range: bytes=10-20\r\n"
+                           "Depth: 1\r\n"
+                           "\r\n";
+
+    // cut in the middle of a name and of a value
+    const size_t cuts[] = { request.find("ange") + 2, request.find("-20") + 2, request.size() };
+    size_t start = 0;
+    for (size_t cut : cuts)
+    {
+        ASSERT_EQ(cut - start, http_parser_execute(&httpctx.parser, &settings, request.data() + start, cut - start));
+        start = cut;
+    }
+
+    ASSERT_EQ("127.0.0.1:4443", httpctx.host);
+    ASSERT_EQ(10, httpctx.rangeStart);
+    ASSERT_EQ(20, httpctx.rangeEnd);
+    ASSERT_EQ(1, httpctx.depth);
+}
+#endif
+
+TEST(FileAttributeMemoryCache, dropsTheLeastRecentlyUsedFirst)
+{
+    FileAttributeMemoryCache cache(10);
+    cache.put(1, 0, "aaaa", 4);
+    cache.put(1, 1, "bbbb", 4);
+
+    // a hit makes it the most recently used one
+    string data;
+    ASSERT_TRUE(cache.get(1, 0, data));
+    ASSERT_EQ("aaaa", data);
+
+    cache.put(2, 0, "cccc", 4);
+    ASSERT_EQ(8u, cache.size());
+    ASSERT_FALSE(cache.get(1, 1, data));
+    ASSERT_TRUE(cache.get(1, 0, data));
+    ASSERT_TRUE(cache.get(2, 0, data));
+
+    // replacing an attribute doesn't count it twice
+    cache.put(2, 0, "dd", 2);
+    ASSERT_EQ(6u, cache.size());
+    ASSERT_TRUE(cache.get(2, 0, data));
+    ASSERT_EQ("dd", data);
+
+    // what doesn't fit isn't kept
+    cache.put(3, 0, string(11, 'x').data(), 11);
+    ASSERT_FALSE(cache.get(3, 0, data));
+
+    cache.put(1, 1, "bb", 2);
+    cache.remove(1);
+    ASSERT_FALSE(cache.get(1, 0, data));
+    ASSERT_FALSE(cache.get(1, 1, data));
+    ASSERT_EQ(2u, cache.size());
+
+    cache.clear();
+    ASSERT_EQ(0u, cache.size());
+    ASSERT_FALSE(cache.get(2, 0, data));
+}
+
+TEST(MegaRequestContinuation, continuesOnTheExecutorWithCopies)
+{
+    vector<function<void()>> queued;
+    int received = -1;
+    string link;
+
+    MegaRequestListener* listener = MegaRequestContinuation::then(
+        [&](MegaApi*, MegaRequest* request, MegaError* error)
+        {
+            received = error->getErrorCode();
+            link = request->getLink();
+        },
+        [&](function<void()> f) { queued.push_back(move(f)); });
+
+    {
+        MegaRequestPrivate request(MegaRequest::TYPE_EXPORT);
+        request.setLink("https://mega.nz/file/abc");
+        MegaErrorPrivate error(API_EEXIST);
+        listener->onRequestFinish(nullptr, &request, &error);
+    }
+
+    // nothing ran in the callback, and the listener is gone
+    ASSERT_EQ(1u, queued.size());
+    ASSERT_EQ(-1, received);
+
+    queued.front()();
+    ASSERT_EQ(API_EEXIST, received);
+    ASSERT_EQ("https://mega.nz/file/abc", link);
+}
+
+TEST(MegaRequestContinuation, makesTheFutureReady)
+{
+    future<MegaRequestOutcome> result;
+    MegaRequestListener* listener = MegaRequestContinuation::future(result);
+    ASSERT_EQ(future_status::timeout, result.wait_for(chrono::seconds(0)));
+
+    {
+        MegaRequestPrivate request(MegaRequest::TYPE_CREATE_FOLDER);
+        request.setNodeHandle(42);
+        MegaErrorPrivate error(API_OK);
+        listener->onRequestFinish(nullptr, &request, &error);
+    }
+
+    MegaRequestOutcome outcome = result.get();
+    ASSERT_EQ(MegaRequest::TYPE_CREATE_FOLDER, outcome.request->getType());
+    ASSERT_EQ(MegaHandle(42), outcome.request->getNodeHandle());
+    ASSERT_EQ(API_OK, outcome.error->getErrorCode());
+}
@@ -0,0 +1,144 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <gtest/gtest.h>
+
+#include <mega/nodenameindex.h>
+
+#include "mega.h"
+#include "utils.h"
+
+namespace {
+
+std::set<mega::handle> find(const mega::NodeNameIndex& index, const char* substring)
+{
+    std::vector<mega::handle> results;
+    index.find(substring, results);
+
+    std::set<mega::handle> found(results.begin(), results.end());
+    EXPECT_EQ(results.size(), found.size());
+    return found;
+}
+
+} // anonymous
+
+TEST(NodeNameIndex, findMatchesSubstringsCaseInsensitively)
+{
+    mega::NodeNameIndex index;
+    uint32_t a = index.set(mega::NodeNameIndex::NONE, 1, "Holiday Photos");
+    index.set(mega::NodeNameIndex::NONE, 2, "photo.JPG");
+    index.set(mega::NodeNameIndex::NONE, 3, "notes.txt");
+
+    ASSERT_EQ((std::set<mega::handle>{ 1, 2 }), find(index, "PHOTO"));
+    ASSERT_EQ((std::set<mega::handle>{ 2 }), find(index, ".jpg"));
+    ASSERT_EQ((std::set<mega::handle>{ 1, 2, 3 }), find(index, ""));
+
+    // matches don't span two names
+    ASSERT_TRUE(find(index, "jpgnotes").empty());
+    ASSERT_TRUE(find(index, "photos.").empty());
+
+    // a renamed node only matches its new name
+    a = index.set(a, 1, "Trip");
+    ASSERT_EQ((std::set<mega::handle>{ 2 }), find(index, "photo"));
+    ASSERT_EQ((std::set<mega::handle>{ 1 }), find(index, "trip"));
+    ASSERT_EQ(3u, index.size());
+
+    index.remove(a);
+    ASSERT_TRUE(find(index, "trip").empty());
+    ASSERT_EQ(2u, index.size());
+}
+
+TEST(NodeNameIndex, compactionMovesTheSlots)
+{
+    mega::NodeNameIndex index;
+    std::map<mega::handle, uint32_t> slots;
+
+    for (mega::handle h = 0; h < 100; h++)
+    {
+        slots[h] = index.set(mega::NodeNameIndex::NONE, h, ("name" + std::to_string(h)).c_str());
+    }
+
+    for (mega::handle h = 0; h < 100; h += 4)
+    {
+        index.remove(slots[h]);
+        slots.erase(h);
+    }
+
+    // under half of the buffer is empty yet
+    index.compact([](mega::handle, uint32_t) { FAIL(); });
+
+    for (mega::handle h = 1; h < 60; h += 2)
+    {
+        index.remove(slots[h]);
+        slots.erase(h);
+    }
+
+    size_t moved = 0;
+    index.compact([&](mega::handle h, uint32_t slot)
+    {
+        slots[h] = slot;
+        moved++;
+    });
+    ASSERT_EQ(slots.size(), moved);
+    ASSERT_EQ(slots.size(), index.size());
+
+    ASSERT_EQ((std::set<mega::handle>{ 42, 46 }), find(index, "name4"));
+
+    // the slots are still the right ones
+    index.remove(slots[42]);
+    ASSERT_EQ((std::set<mega::handle>{ 46 }), find(index, "name4"));
+    ASSERT_EQ((std::set<mega::handle>{ 2, 22, 26 }), find(index, "name2"));
+}
+
+TEST(NodeTypeIndex, filesAreIndexedByTheTypesOfTheirNames)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+    auto add = [&](mega::nodetype_t type, mega::handle h, const std::string& name) -> mega::Node&
+    {
+        auto& n = mt::makeNode(*client, type, h, &root);
+        n.attrs.map['n'] = name;
+        return n;
+    };
+
+    add(mega::FILENODE, 2, "beach.jpg");
+    add(mega::FILENODE, 3, "song.mp3");
+    auto& movie = add(mega::FILENODE, 4, "movie.mkv");
+    add(mega::FILENODE, 5, "notes.txt");
+    add(mega::FOLDERNODE, 6, "folder.jpg");
+
+    auto& types = client->nodeTypes();
+    ASSERT_TRUE(types.built);
+    ASSERT_EQ((std::set<mega::handle>{ 2 }), types.nodes(1));
+    ASSERT_EQ((std::set<mega::handle>{ 3 }), types.nodes(2));
+    ASSERT_EQ((std::set<mega::handle>{ 4 }), types.nodes(3));
+    ASSERT_EQ((std::set<mega::handle>{ 5 }), types.nodes(4));
+
+    // renamed and deleted
+    movie.attrs.map['n'] = "movie.png";
+    client->indexnodename(&movie);
+    ASSERT_EQ((std::set<mega::handle>{ 2, 4 }), types.nodes(1));
+    ASSERT_TRUE(types.nodes(3).empty());
+
+    client->nodes.erase(movie.nodeHandle());
+    delete &movie;
+    ASSERT_EQ((std::set<mega::handle>{ 2 }), types.nodes(1));
+}
@@ -0,0 +1,142 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <gtest/gtest.h>
+
+#include <mega/nodesnapshot.h>
+
+#include "mega.h"
+
+namespace {
+
+mega::NodeSnapshot::Record record(mega::handle h, mega::handle parent, mega::nodetype_t type, m_off_t size, uint32_t dbid)
+{
+    mega::NodeSnapshot::Record r;
+    r.h = h;
+    r.parent = parent;
+    r.type = type;
+    r.size = size;
+    r.dbid = dbid;
+    return r;
+}
+
+// handle -> parent of the records of the snapshot as of scsn, empty if it isn't available
+std::map<mega::handle, mega::handle> parents(mega::NodeSnapshot& snapshot, mega::handle scsn)
+{
+    mega::CachedNodeIndex index;
+    std::map<mega::handle, mega::handle> result;
+    if (snapshot.read(scsn, index))
+    {
+        index.finalize();
+        for (auto& r : index)
+        {
+            result[r.h] = r.parent;
+        }
+    }
+    return result;
+}
+
+class NodeSnapshotTest : public ::testing::Test
+{
+public:
+    void TearDown() override
+    {
+        fsaccess.unlinklocal(path);
+    }
+
+    ::mega::FSACCESS_CLASS fsaccess;
+    mega::LocalPath path = mega::LocalPath::fromPath("nodesnapshot_test.snapshot", fsaccess);
+};
+
+} // namespace
+
+TEST_F(NodeSnapshotTest, changesAreAppliedUpToTheRequestedScsn)
+{
+    mega::NodeSnapshot snapshot(fsaccess, path);
+
+    ASSERT_TRUE(snapshot.write(100, {record(1, mega::UNDEF, mega::ROOTNODE, 0, 16),
+                                     record(2, 1, mega::FOLDERNODE, 0, 32),
+                                     record(3, 2, mega::FILENODE, 1234, 48)}));
+    ASSERT_EQ(100u, snapshot.scsn());
+
+    // 3 moves to the root, 4 is added
+    ASSERT_TRUE(snapshot.append(101, {record(3, 1, mega::FILENODE, 1234, 48), record(4, 2, mega::FILENODE, 5, 64)}, {}));
+
+    // 2 is removed
+    ASSERT_TRUE(snapshot.append(102, {}, {2}));
+    ASSERT_EQ(3u, snapshot.changes());
+
+    mega::NodeSnapshot reader(fsaccess, path);
+    ASSERT_EQ((std::map<mega::handle, mega::handle>{{1, mega::UNDEF}, {2, 1}, {3, 2}}), parents(reader, 100));
+    ASSERT_EQ((std::map<mega::handle, mega::handle>{{1, mega::UNDEF}, {2, 1}, {3, 1}, {4, 2}}), parents(reader, 101));
+    ASSERT_EQ((std::map<mega::handle, mega::handle>{{1, mega::UNDEF}, {3, 1}, {4, 2}}), parents(reader, 102));
+    ASSERT_TRUE(parents(reader, 103).empty());
+    ASSERT_EQ(mega::UNDEF, reader.scsn());
+
+    mega::CachedNodeIndex index;
+    ASSERT_TRUE(reader.read(102, index));
+    index.finalize();
+    ASSERT_EQ(1234, index.find(3)->size);
+    ASSERT_EQ(64u, index.find(4)->dbid);
+}
+
+TEST_F(NodeSnapshotTest, appendingAfterAnOlderScsnDropsLaterChanges)
+{
+    mega::NodeSnapshot snapshot(fsaccess, path);
+    ASSERT_TRUE(snapshot.write(100, {record(1, mega::UNDEF, mega::ROOTNODE, 0, 16)}));
+    ASSERT_TRUE(snapshot.append(101, {record(2, 1, mega::FOLDERNODE, 0, 32)}, {}));
+    ASSERT_TRUE(snapshot.append(102, {record(3, 1, mega::FOLDERNODE, 0, 48)}, {}));
+
+    // eg. the database only got to 101 before a crash
+    mega::NodeSnapshot resumed(fsaccess, path);
+    ASSERT_FALSE(parents(resumed, 101).empty());
+    ASSERT_EQ(101u, resumed.scsn());
+    ASSERT_TRUE(resumed.append(202, {record(4, 1, mega::FOLDERNODE, 0, 64)}, {}));
+
+    mega::NodeSnapshot reader(fsaccess, path);
+    ASSERT_EQ((std::map<mega::handle, mega::handle>{{1, mega::UNDEF}, {2, 1}, {4, 1}}), parents(reader, 202));
+    ASSERT_TRUE(parents(reader, 102).empty());
+}
+
+TEST_F(NodeSnapshotTest, tornWritesAreRejected)
+{
+    mega::NodeSnapshot snapshot(fsaccess, path);
+    ASSERT_TRUE(snapshot.write(100, {record(1, mega::UNDEF, mega::ROOTNODE, 0, 16), record(2, 1, mega::FOLDERNODE, 0, 32)}));
+    ASSERT_TRUE(snapshot.append(101, {record(3, 1, mega::FOLDERNODE, 0, 48)}, {}));
+
+    // cut the last block short
+    std::string data;
+    {
+        auto fa = fsaccess.newfileaccess(false);
+        ASSERT_TRUE(fa->fopen(path, true, false));
+        ASSERT_TRUE(fa->fread(&data, static_cast<unsigned>(fa->size), 0, 0));
+    }
+    {
+        auto fa = fsaccess.newfileaccess(false);
+        ASSERT_TRUE(fa->fopen(path, false, true));
+        ASSERT_TRUE(fa->ftruncate());
+        ASSERT_TRUE(fa->fwrite(reinterpret_cast<const mega::byte*>(data.data()), static_cast<unsigned>(data.size() - 3), 0));
+    }
+
+    mega::NodeSnapshot reader(fsaccess, path);
+    ASSERT_TRUE(parents(reader, 101).empty());
+    ASSERT_EQ(2u, parents(reader, 100).size());
+
+    reader.remove();
+    ASSERT_TRUE(parents(reader, 100).empty());
+}
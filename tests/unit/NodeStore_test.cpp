@@ -0,0 +1,744 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <gtest/gtest.h>
+
+#include <mega/megaclient.h>
+#include <mega/megaapp.h>
+#include <mega/nodestore.h>
+
+#include "DefaultedDbTable.h"
+#include "utils.h"
+#include "mega.h"
+
+namespace {
+
+// the store never dereferences its values, so any distinct non-null pointer will do
+mega::Node* fakeNode(uint64_t n)
+{
+    return reinterpret_cast<mega::Node*>(static_cast<uintptr_t>(n * 16 + 16));
+}
+
+mega::NodeHandle nh(uint64_t h)
+{
+    return mega::NodeHandle().set6byte(h);
+}
+
+} // namespace
+
+TEST(NodeStore, addFindErase)
+{
+    mega::NodeStore store;
+    ASSERT_TRUE(store.empty());
+    ASSERT_TRUE(store.find(nh(1)) == store.end());
+    ASSERT_EQ(0u, store.erase(nh(1)));
+
+    for (uint64_t i = 1; i <= 1000; ++i)
+    {
+        store.add(nh(i), fakeNode(i));
+    }
+    ASSERT_EQ(1000u, store.size());
+
+    for (uint64_t i = 1; i <= 1000; ++i)
+    {
+        auto it = store.find(nh(i));
+        ASSERT_TRUE(it != store.end());
+        ASSERT_EQ(fakeNode(i), it->second);
+        ASSERT_TRUE(it->first == nh(i));
+    }
+    ASSERT_TRUE(store.find(nh(1001)) == store.end());
+
+    // replacing keeps the count
+    store.add(nh(5), fakeNode(5000));
+    ASSERT_EQ(1000u, store.size());
+    ASSERT_EQ(fakeNode(5000), store.find(nh(5))->second);
+
+    // remove every other entry, the rest must stay reachable across the shifted probe runs
+    for (uint64_t i = 1; i <= 1000; i += 2)
+    {
+        ASSERT_EQ(1u, store.erase(nh(i)));
+    }
+    ASSERT_EQ(500u, store.size());
+
+    for (uint64_t i = 1; i <= 1000; ++i)
+    {
+        ASSERT_EQ(i % 2 == 0, store.find(nh(i)) != store.end());
+    }
+}
+
+TEST(NodeStore, iterationVisitsEachEntryOnce)
+{
+    mega::NodeStore store;
+    store.reserve(300);
+
+    std::set<mega::Node*> expected;
+    for (uint64_t i = 0; i < 300; ++i)
+    {
+        store.add(nh(i * 0x10001), fakeNode(i));
+        expected.insert(fakeNode(i));
+    }
+
+    std::set<mega::Node*> seen;
+    for (auto& entry : store)
+    {
+        ASSERT_TRUE(seen.insert(entry.second).second);
+    }
+    ASSERT_EQ(expected, seen);
+
+    const mega::NodeStore& cstore = store;
+    size_t n = 0;
+    for (mega::node_map::const_iterator it = cstore.begin(); it != cstore.end(); ++it)
+    {
+        ++n;
+    }
+    ASSERT_EQ(300u, n);
+
+    store.clear();
+    ASSERT_TRUE(store.empty());
+    ASSERT_TRUE(store.begin() == store.end());
+}
+
+TEST(FixedSizeAllocator, reusesBlocksAndReleasesSlabs)
+{
+    mega::FixedSizeAllocator allocator(40, 4);
+
+    std::vector<void*> blocks;
+    for (int i = 0; i < 10; ++i)
+    {
+        blocks.push_back(allocator.allocate());
+    }
+    ASSERT_EQ(10u, allocator.liveObjects());
+    ASSERT_EQ(3u, allocator.slabs());
+    ASSERT_EQ(10u, std::set<void*>(blocks.begin(), blocks.end()).size());
+
+    void* freed = blocks.back();
+    blocks.pop_back();
+    allocator.deallocate(freed);
+    ASSERT_EQ(freed, allocator.allocate());
+    blocks.push_back(freed);
+
+    for (void* p : blocks)
+    {
+        allocator.deallocate(p);
+    }
+    ASSERT_EQ(0u, allocator.liveObjects());
+    ASSERT_EQ(0u, allocator.slabs());
+}
+
+TEST(FixedSizeAllocator, accountsTheSlabs)
+{
+    mega::CodeCounter::Gauge account;
+    mega::FixedSizeAllocator allocator(64, 4, &account);
+
+    std::vector<void*> blocks;
+    blocks.push_back(allocator.allocate());
+    ASSERT_EQ(256, account.value);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        blocks.push_back(allocator.allocate());
+    }
+    ASSERT_EQ(512, account.value);
+
+    for (void* p : blocks)
+    {
+        allocator.deallocate(p);
+    }
+    ASSERT_EQ(0, account.value);
+    ASSERT_EQ(512, account.peak);
+}
+
+namespace {
+
+size_t slabBytes = 0;
+
+void* countedAllocate(size_t size)
+{
+    slabBytes += size;
+    return ::operator new(size);
+}
+
+void countedRelease(void* p, size_t size)
+{
+    slabBytes -= size;
+    ::operator delete(p);
+}
+
+} // namespace
+
+TEST(FixedSizeAllocator, keepsOneSlabFromTheSlabFunctions)
+{
+    mega::FixedSizeAllocator::setSlabFunctions(countedAllocate, countedRelease);
+    {
+        mega::FixedSizeAllocator allocator(64, 4, nullptr, true);
+
+        std::vector<void*> blocks;
+        for (int i = 0; i < 6; ++i)
+        {
+            blocks.push_back(allocator.allocate());
+        }
+        ASSERT_EQ(512u, slabBytes);
+
+        for (void* p : blocks)
+        {
+            allocator.deallocate(p);
+        }
+        ASSERT_EQ(1u, allocator.slabs());
+        ASSERT_EQ(256u, slabBytes);
+
+        // the kept slab is handed out again from its start
+        void* first = allocator.allocate();
+        ASSERT_EQ(256u, slabBytes);
+        allocator.deallocate(first);
+    }
+    ASSERT_EQ(0u, slabBytes);
+    mega::FixedSizeAllocator::setSlabFunctions(nullptr, nullptr);
+}
+
+TEST(NodeStore, accountsItsTable)
+{
+    auto& nodes = mega::CodeCounter::memory[mega::CodeCounter::MEM_NODES];
+    int64_t before = nodes.value;
+    {
+        mega::NodeStore store;
+        for (uint64_t i = 1; i <= 100; ++i)
+        {
+            store.add(nh(i), fakeNode(i));
+        }
+        ASSERT_GE(nodes.value - before, int64_t(100 * sizeof(std::pair<mega::NodeHandle, mega::Node*>)));
+    }
+    ASSERT_EQ(before, nodes.value);
+}
+
+TEST(CachedNodeIndex, childrenAndDescendantCounts)
+{
+    // root(1) -> folder(2) -> file(3) -> version(4)
+    //         -> file(5)
+    mega::CachedNodeIndex index;
+    index.add(3, 2, mega::FILENODE, 100, 30);
+    index.add(1, mega::UNDEF, mega::ROOTNODE, 0, 10);
+    index.add(5, 1, mega::FILENODE, 7, 50);
+    index.add(4, 3, mega::FILENODE, 60, 40);
+    index.add(2, 1, mega::FOLDERNODE, 0, 20);
+    index.finalize();
+
+    ASSERT_EQ(5u, index.size());
+    ASSERT_EQ(nullptr, index.find(6));
+    ASSERT_EQ(40u, index.find(4)->dbid);
+
+    auto range = index.children(1);
+    std::set<mega::handle> children;
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        children.insert(it->h);
+    }
+    ASSERT_EQ((std::set<mega::handle>{2, 5}), children);
+    ASSERT_TRUE(index.hasChildren(3));
+    ASSERT_FALSE(index.hasChildren(5));
+
+    mega::NodeCounter nc = index.descendantCounts(1, mega::ROOTNODE);
+    ASSERT_EQ(3u, nc.files);
+    ASSERT_EQ(1u, nc.folders);
+    ASSERT_EQ(1u, nc.versions);
+    ASSERT_EQ(167, nc.storage);
+    ASSERT_EQ(60, nc.versionStorage);
+
+    nc = index.descendantCounts(3, mega::FILENODE);
+    ASSERT_EQ(1u, nc.files);
+    ASSERT_EQ(1u, nc.versions);
+
+    index.markLoaded(*index.find(2));
+    index.markLoaded(*index.find(2));
+    ASSERT_EQ(1u, index.loadedCount());
+}
+
+TEST(Fingerprints, notIndexedWhenBrowsingLinks)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+    client->mLinkBrowser = true;
+
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+    auto& file = mt::makeNode(*client, mega::FILENODE, 2, &root);
+    file.setfingerprint();
+    ASSERT_EQ(0u, client->mFingerprints.size());
+
+    // no local database either
+    ASSERT_EQ(nullptr, client->openStateCacheTable("links"));
+}
+
+TEST(Fingerprints, lookupsBySizeAndFingerprint)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+    auto& index = client->mFingerprints;
+
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+
+    // enough files to make the table grow a few times
+    std::vector<mega::Node*> files;
+    for (mega::handle h = 2; h < 1002; h++)
+    {
+        auto& n = mt::makeNode(*client, mega::FILENODE, h, &root);
+        n.size = static_cast<m_off_t>(h % 100);
+        n.mtime = 1600000000 + h % 10;
+        n.crc.fill(static_cast<int32_t>(h % 50));
+        index.add(&n);
+        files.push_back(&n);
+    }
+
+    ASSERT_EQ(files.size(), index.size());
+    ASSERT_TRUE(index.hasSize(42));
+    ASSERT_FALSE(index.hasSize(100));
+
+    // size 42, mtime +2 and crc 42: the (h % 100, h % 10, h % 50) triple repeats every 100 handles
+    mega::FileFingerprint fp;
+    fp.size = 42;
+    fp.mtime = 1600000002;
+    fp.crc.fill(42);
+
+    std::unique_ptr<mega::node_vector> matches(index.nodesbyfingerprint(&fp));
+    ASSERT_EQ(10u, matches->size());
+    for (mega::Node* n : *matches)
+    {
+        ASSERT_EQ(42u, n->nodehandle % 100);
+    }
+    ASSERT_NE(nullptr, index.nodebyfingerprint(&fp));
+
+    fp.mtime += 1;
+    ASSERT_EQ(nullptr, index.nodebyfingerprint(&fp));
+
+    // removing, also by deleting the node
+    for (mega::Node* n : *matches)
+    {
+        if (n->nodehandle % 200 == 42)
+        {
+            index.remove(n);
+        }
+        else
+        {
+            client->nodes.erase(n->nodeHandle());
+            delete n;
+        }
+    }
+
+    fp.mtime -= 1;
+    ASSERT_EQ(nullptr, index.nodebyfingerprint(&fp));
+    ASSERT_FALSE(index.hasSize(42));
+    ASSERT_TRUE(index.hasSize(43));
+    ASSERT_EQ(files.size() - 10, index.size());
+
+    index.clear();
+    ASSERT_EQ(0u, index.size());
+    ASSERT_EQ(0, index.getSumSizes());
+    ASSERT_FALSE(index.hasSize(43));
+
+    // nodes outliving clear() can be indexed again
+    index.add(files[0]);
+    ASSERT_EQ(files[0], index.nodebyfingerprint(files[0]));
+}
+
+TEST(NodeChildren, siblingLinks)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+    auto& a = mt::makeNode(*client, mega::FOLDERNODE, 2, &root);
+    auto& b = mt::makeNode(*client, mega::FILENODE, 3, &root);
+    auto& c = mt::makeNode(*client, mega::FILENODE, 4, &root);
+
+    auto children = [](mega::Node& n)
+    {
+        return std::vector<mega::Node*>(n.children.begin(), n.children.end());
+    };
+
+    ASSERT_EQ((std::vector<mega::Node*>{&a, &b, &c}), children(root));
+
+    // removing the current child while iterating, as proctree() allows
+    for (auto it = root.children.begin(); it != root.children.end(); )
+    {
+        mega::Node* n = *it++;
+        if (n == &b)
+        {
+            n->setparent(&a);
+        }
+    }
+
+    ASSERT_EQ((std::vector<mega::Node*>{&a, &c}), children(root));
+    ASSERT_EQ((std::vector<mega::Node*>{&b}), children(a));
+    ASSERT_EQ(&c, root.children.back());
+    ASSERT_EQ(2u, root.children.size());
+
+    c.setparent(&a);
+    ASSERT_EQ((std::vector<mega::Node*>{&a}), children(root));
+    ASSERT_EQ((std::vector<mega::Node*>{&b, &c}), children(a));
+}
+
+TEST(Node, descendantCountsAreKeptUpToDate)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+    auto& a = mt::makeNode(*client, mega::FOLDERNODE, 2, &root);
+    auto& b = mt::makeNode(*client, mega::FOLDERNODE, 3, &root);
+    auto& file = mt::makeNode(*client, mega::FILENODE, 4, &a);
+    mt::makeNode(*client, mega::FILENODE, 5, &a);
+
+    auto check = [](mega::Node& n, size_t files, size_t folders, size_t versions)
+    {
+        mega::NodeCounter nc = n.descendantCounts();
+        EXPECT_EQ(files, nc.files);
+        EXPECT_EQ(folders, nc.folders);
+        EXPECT_EQ(versions, nc.versions);
+    };
+
+    ASSERT_FALSE(root.descendantCountsKept());
+    check(root, 2, 2, 0);
+    ASSERT_TRUE(root.descendantCountsKept());
+    ASSERT_TRUE(a.descendantCountsKept());
+
+    // attached, moved and deleted below the counted folders
+    mt::makeNode(*client, mega::FILENODE, 6, &b);
+    auto& version = mt::makeNode(*client, mega::FILENODE, 7, &file);
+    check(root, 4, 2, 1);
+    check(a, 3, 0, 1);
+
+    a.setparent(&b);
+    check(root, 4, 2, 1);
+    check(b, 4, 1, 1);
+
+    client->nodes.erase(version.nodeHandle());
+    delete &version;
+    check(root, 3, 2, 0);
+    check(b, 3, 1, 0);
+    check(a, 2, 0, 0);
+}
+
+TEST(NodeChildren, sortedOrdersFollowTheChildren)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+    auto& other = mt::makeNode(*client, mega::FOLDERNODE, 2, &root);
+    std::vector<mega::Node*> files;
+    for (mega::handle h : { 30, 10, 20 })
+    {
+        files.push_back(&mt::makeNode(*client, mega::FILENODE, h, &root));
+    }
+
+    auto byHandle = [](mega::Node* a, mega::Node* b) { return a->nodehandle < b->nodehandle; };
+    auto byHandleDesc = [](mega::Node* a, mega::Node* b) { return a->nodehandle > b->nodehandle; };
+
+    ASSERT_EQ(nullptr, root.children.sorted(1));
+    ASSERT_EQ((mega::node_vector{ &other, files[1], files[2], files[0] }), root.children.addSorted(1, byHandle));
+    root.children.addSorted(2, byHandleDesc);
+
+    // added and removed children keep their places
+    auto& file = mt::makeNode(*client, mega::FILENODE, 15, &root);
+    files[2]->setparent(&other);
+    ASSERT_EQ((mega::node_vector{ &other, files[1], &file, files[0] }), *root.children.sorted(1));
+    ASSERT_EQ((mega::node_vector{ files[0], &file, files[1], &other }), *root.children.sorted(2));
+    ASSERT_EQ(nullptr, other.children.sorted(1));
+
+    root.children.clearIndexes();
+    ASSERT_EQ(nullptr, root.children.sorted(1));
+}
+
+TEST(NodeChildren, nameIndexFollowsTheChildren)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+    auto& small = mt::makeNode(*client, mega::FOLDERNODE, 2, &root);
+    auto& big = mt::makeNode(*client, mega::FOLDERNODE, 3, &root);
+
+    auto add = [&](mega::Node& parent, mega::nodetype_t type, mega::handle h, const std::string& name) -> mega::Node&
+    {
+        // named before it's attached, as decrypted nodes are
+        auto& n = mt::makeNode(*client, type, h);
+        n.attrs.map['n'] = name;
+        n.setparent(&parent);
+        return n;
+    };
+
+    mega::handle h = 10;
+    add(small, mega::FILENODE, h++, "a");
+    for (size_t i = 0; i < mega::NodeChildren::NAME_INDEX_THRESHOLD; i++)
+    {
+        add(big, mega::FILENODE, h++, "file " + std::to_string(i));
+    }
+
+    mega::node_vector matches;
+    ASSERT_FALSE(small.children.byName("a", matches));
+    ASSERT_EQ(small.children.front(), client->childnodebyname(&small, "a"));
+
+    ASSERT_TRUE(big.children.byName("file 7", matches));
+    ASSERT_EQ(1u, matches.size());
+    ASSERT_EQ(client->nodebyhandle(18), matches[0]);
+    ASSERT_EQ(matches[0], client->childnodebyname(&big, "file 7"));
+    ASSERT_EQ(nullptr, client->childnodebyname(&big, "file"));
+
+    // added, moved and renamed children
+    auto& folder = add(big, mega::FOLDERNODE, h++, "file 7");
+    auto& moved = add(small, mega::FILENODE, h++, "moved");
+    moved.setparent(&big);
+    ASSERT_EQ(&moved, client->childnodebyname(&big, "moved"));
+    ASSERT_EQ(&folder, client->childnodebyname(&big, "file 7"));
+    ASSERT_EQ(&folder, client->childnodebynametype(&big, "file 7", mega::FOLDERNODE));
+    ASSERT_EQ(matches[0], client->childnodebynametype(&big, "file 7", mega::FILENODE));
+    ASSERT_EQ(2u, client->childnodesbyname(&big, "file 7", false).size());
+
+    big.children.clearIndexes();
+    moved.attrs.map['n'] = "renamed";
+    ASSERT_EQ(nullptr, client->childnodebyname(&big, "moved"));
+    ASSERT_EQ(&moved, client->childnodebyname(&big, "renamed"));
+
+    // a child renamed behind the index's back only costs the index
+    moved.attrs.map['n'] = "renamed again";
+    moved.setparent(&small);
+    ASSERT_EQ(nullptr, client->childnodebyname(&big, "renamed"));
+    ASSERT_EQ(&moved, client->childnodebyname(&small, "renamed again"));
+}
+
+TEST(NodePathCache, pathsResolveThroughTheCacheAsTheTreeChanges)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+
+    auto add = [&](mega::Node& parent, mega::nodetype_t type, mega::handle h, const std::string& name) -> mega::Node&
+    {
+        auto& n = mt::makeNode(*client, type, h);
+        n.attrs.map['n'] = name;
+        n.setparent(&parent);
+        return n;
+    };
+
+    auto& docs = add(root, mega::FOLDERNODE, 2, "docs");
+    auto& deep = add(docs, mega::FOLDERNODE, 3, "deep");
+    auto& file = add(deep, mega::FILENODE, 4, "f.txt");
+    add(deep, mega::FILENODE, 5, "x");
+
+    ASSERT_EQ(&file, client->nodeByPath("docs/deep/f.txt", &root));
+    ASSERT_EQ(3u, client->mPathCache.size());
+    ASSERT_EQ(&file, client->nodeByPath("docs/deep/f.txt", &root));
+    ASSERT_EQ(3u, client->mPathCache.size());
+
+    // a child renamed or moved without notification isn't found by its old path
+    file.attrs.map['n'] = "g.txt";
+    ASSERT_EQ(nullptr, client->nodeByPath("docs/deep/f.txt", &root));
+    ASSERT_EQ(&file, client->nodeByPath("docs/deep/g.txt", &root));
+    file.setparent(&docs);
+    ASSERT_EQ(nullptr, client->nodeByPath("docs/deep/g.txt", &root));
+    ASSERT_EQ(&file, client->nodeByPath("docs/g.txt", &root));
+
+    // a new folder takes precedence over the cached file of the same name once notified
+    ASSERT_EQ(client->nodebyhandle(5), client->nodeByPath("docs/deep/x", &root));
+    auto& folder = add(deep, mega::FOLDERNODE, 6, "x");
+    client->notifynode(&folder);
+    ASSERT_EQ(&folder, client->nodeByPath("docs/deep/x", &root));
+
+    client->mPathCache.clear();
+    ASSERT_EQ(&folder, client->nodeByPath("docs/deep/x", &root));
+}
+
+TEST(RecentFiles, newestFilesFollowTheTree)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+    auto& rubbish = mt::makeNode(*client, mega::RUBBISHNODE, 2);
+
+    auto file = [&](mega::handle h, mega::Node& parent, mega::m_time_t ctime) -> mega::Node&
+    {
+        mega::node_vector dp;
+        return *new mega::Node{client.get(), &dp, h, parent.nodehandle, mega::FILENODE, 1, mega::UNDEF, nullptr, ctime};
+    };
+
+    auto& a = file(10, root, 100);
+    auto& b = file(11, root, 300);
+    auto& c = file(12, root, 200);
+    auto& d = file(13, rubbish, 400);
+    file(14, b, 500); // a version of b
+
+    ASSERT_FALSE(client->mRecentFiles.built());
+    ASSERT_EQ((mega::node_vector{&b, &c, &a}), client->getRecentNodes(10, 0, false));
+    ASSERT_TRUE(client->mRecentFiles.built());
+    ASSERT_EQ((mega::node_vector{&d, &b, &c, &a}), client->getRecentNodes(10, 0, true));
+    ASSERT_EQ((mega::node_vector{&b, &c}), client->getRecentNodes(2, 0, false));
+    ASSERT_EQ((mega::node_vector{&b, &c}), client->getRecentNodes(10, 150, false));
+
+    // added and deleted once built
+    auto& e = file(15, root, 600);
+    client->nodes.erase(c.nodeHandle());
+    delete &c;
+    ASSERT_EQ((mega::node_vector{&e, &b, &a}), client->getRecentNodes(10, 0, false));
+
+    // b has a version: updated rather than added
+    auto actions = client->getRecentActions(10, 0);
+    ASSERT_EQ(2u, actions.size());
+    ASSERT_EQ((mega::node_vector{&e, &a}), actions[0].nodes);
+    ASSERT_EQ((mega::node_vector{&b}), actions[1].nodes);
+}
+
+TEST(TreeProc, parallelWalkAddsUpTheSame)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+    mega::handle h = 2;
+    for (int i = 0; i < 3; i++)
+    {
+        auto& folder = mt::makeNode(*client, mega::FOLDERNODE, h++, &root);
+        auto& sub = mt::makeNode(*client, mega::FOLDERNODE, h++, &folder);
+        for (int j = 0; j < 2000; j++)
+        {
+            mt::makeNode(*client, mega::FILENODE, h++, j % 2 ? &folder : &sub);
+        }
+    }
+    mt::makeNode(*client, mega::FILENODE, h++, &root);
+
+    mega::TreeProcDU serial;
+    client->proctree(&root, &serial);
+
+    mega::TreeProcDU parallel;
+    client->proctreeParallel(&root, &parallel);
+
+    ASSERT_EQ(6001, serial.numfiles);
+    ASSERT_EQ(7, serial.numfolders);
+    ASSERT_EQ(serial.numfiles, parallel.numfiles);
+    ASSERT_EQ(serial.numfolders, parallel.numfolders);
+    ASSERT_EQ(serial.numbytes, parallel.numbytes);
+
+    // small trees are walked here
+    mega::TreeProcDU small;
+    client->proctreeParallel(client->nodebyhandle(3), &small);
+    ASSERT_EQ(2000, small.numfiles);
+    ASSERT_EQ(2, small.numfolders);
+}
+
+namespace {
+
+// counts the node records written, with an SCSN for updatesc() to go on
+class NodeRecordCountingDbTable : public mt::DefaultedDbTable
+{
+public:
+    using DefaultedDbTable::DefaultedDbTable;
+
+    bool get(uint32_t index, std::string* data) override
+    {
+        if (index != mega::MegaClient::CACHEDSCSN)
+        {
+            return false;
+        }
+        data->assign(sizeof(mega::handle), '\0');
+        return true;
+    }
+
+    bool put(uint32_t index, char*, unsigned) override
+    {
+        if ((index & 15) == mega::MegaClient::CACHEDNODE)
+        {
+            ++nodePuts;
+        }
+        return true;
+    }
+
+    bool del(uint32_t) override
+    {
+        ++dels;
+        return true;
+    }
+
+    bool inTransaction() const override
+    {
+        return true;
+    }
+
+    int nodePuts = 0;
+    int dels = 0;
+};
+
+} // namespace
+
+TEST(StateCache, aNodeChangedManyTimesIsWrittenOnceByTheFlush)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+    auto table = new NodeRecordCountingDbTable(client->rng, false);
+    client->sctable.reset(table);
+    client->scsn.setScsn(1);
+    client->mScFlushInterval = ~mega::dstime(0);
+
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+    auto& folder = mt::makeNode(*client, mega::FOLDERNODE, 2, &root);
+    auto& other = mt::makeNode(*client, mega::FOLDERNODE, 3, &root);
+
+    auto update = [&client](mega::Node& n)
+    {
+        client->nodenotify.push_back(&n);
+        client->updatesc();
+        client->nodenotify.clear();
+    };
+
+    for (int i = 0; i < 20; i++)
+    {
+        update(folder);
+    }
+    ASSERT_EQ(0, table->nodePuts);
+    ASSERT_EQ(1u, client->scdirty.size());
+
+    // as before a commit
+    ASSERT_TRUE(client->flushsc());
+    ASSERT_EQ(1, table->nodePuts);
+    ASSERT_TRUE(client->scdirty.empty());
+    ASSERT_NE(0u, folder.dbid);
+
+    // up to the threshold
+    client->mScFlushThreshold = 2;
+    update(folder);
+    ASSERT_EQ(1, table->nodePuts);
+    update(other);
+    ASSERT_EQ(3, table->nodePuts);
+
+    // a removed node is deleted at once, and no longer written
+    update(folder);
+    folder.changed.removed = true;
+    update(folder);
+    ASSERT_EQ(1, table->dels);
+    ASSERT_TRUE(client->scdirty.empty());
+    ASSERT_TRUE(client->flushsc());
+    ASSERT_EQ(3, table->nodePuts);
+}
@@ -0,0 +1,189 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <gtest/gtest.h>
+
+#include <mega/raid.h>
+#include <mega/utils.h>
+
+namespace {
+
+using mega::RAIDPARTS;
+using mega::RAIDSECTOR;
+using mega::RAIDLINE;
+
+// the six parts of a raid file of the given number of full lines, parity included
+std::vector<std::string> makeParts(const std::string& data)
+{
+    size_t lines = data.size() / RAIDLINE;
+    std::vector<std::string> parts(RAIDPARTS, std::string(lines * RAIDSECTOR, '\0'));
+
+    for (size_t i = 0; i < lines; ++i)
+    {
+        for (unsigned j = 1; j < RAIDPARTS; ++j)
+        {
+            for (unsigned k = 0; k < RAIDSECTOR; ++k)
+            {
+                char c = data[i * RAIDLINE + (j - 1) * RAIDSECTOR + k];
+                parts[j][i * RAIDSECTOR + k] = c;
+                parts[0][i * RAIDSECTOR + k] ^= c;
+            }
+        }
+    }
+    return parts;
+}
+
+std::string randomData(size_t lines)
+{
+    std::string data(lines * RAIDLINE, '\0');
+    unsigned x = 12345;
+    for (char& c : data)
+    {
+        x = x * 1103515245 + 12345;
+        c = static_cast<char>(x >> 16);
+    }
+    return data;
+}
+
+} // namespace
+
+TEST(RaidLineCombiner, allImplementationsRebuildTheFile)
+{
+    auto implementations = mega::RaidLineCombiner::implementations();
+    ASSERT_STREQ("scalar", implementations.front().first);
+
+    for (size_t lines : {0, 1, 2, 3, 7, 64})
+    {
+        std::string data = randomData(lines);
+        auto parts = makeParts(data);
+
+        // 0: all six parts, otherwise that one is not downloaded
+        for (unsigned missing = 0; missing < RAIDPARTS; ++missing)
+        {
+            const mega::byte* inputs[RAIDPARTS];
+            for (unsigned j = 0; j < RAIDPARTS; ++j)
+            {
+                inputs[j] = j == missing && missing ? nullptr : reinterpret_cast<const mega::byte*>(parts[j].data());
+            }
+
+            for (auto& impl : implementations)
+            {
+                std::string out(data.size() + 1, 'X');
+                impl.second(reinterpret_cast<mega::byte*>(&out[0]), inputs, lines);
+
+                ASSERT_EQ(data, out.substr(0, data.size())) << impl.first << ", lines: " << lines << ", missing: " << missing;
+                ASSERT_EQ('X', out.back()) << impl.first;
+            }
+        }
+    }
+}
+
+TEST(RaidBufferManager, piecesKeepTheMacsOfChunksVerifiedBefore)
+{
+    // two chunks: a piece fetched again after a resume, the first chunk of which was already written and verified
+    const m_off_t firstChunk = 131072;
+    const m_off_t size = firstChunk + 262144;
+    std::string plain = randomData(size / RAIDLINE + 1).substr(0, size);
+
+    mega::SymmCipher cipher;
+    mega::byte key[mega::SymmCipher::KEYLENGTH] = { 1, 2, 3 };
+    cipher.setkey(key);
+    const int64_t ctriv = 0x1234;
+
+    std::string encrypted = plain;
+    mega::byte mac1[mega::SymmCipher::BLOCKSIZE];
+    mega::byte mac2[mega::SymmCipher::BLOCKSIZE];
+    cipher.ctr_crypt(reinterpret_cast<mega::byte*>(&encrypted[0]), unsigned(firstChunk), 0, ctriv, mac1, true);
+    cipher.ctr_crypt(reinterpret_cast<mega::byte*>(&encrypted[firstChunk]), unsigned(size - firstChunk), firstChunk, ctriv, mac2, true);
+
+    mega::chunkmac_map source;
+    std::fill(source[0].mac, source[0].mac + mega::SymmCipher::BLOCKSIZE, 'Z');
+    source[0].finished = true;
+
+    mega::RaidBufferManager::FilePiece piece(0, size_t(size));
+    memcpy(piece.buf.datastart(), encrypted.data(), encrypted.size());
+
+    ASSERT_TRUE(piece.finalize(false, size, ctriv, &cipher, &source));
+    ASSERT_FALSE(piece.finalize(true, size, ctriv, &cipher, nullptr));
+
+    ASSERT_EQ(plain, std::string(reinterpret_cast<char*>(piece.buf.datastart()), piece.buf.datalen()));
+    ASSERT_TRUE(piece.chunkmacs[0].finished);
+    ASSERT_EQ(std::string(mega::SymmCipher::BLOCKSIZE, 'Z'), std::string(reinterpret_cast<char*>(piece.chunkmacs[0].mac), mega::SymmCipher::BLOCKSIZE));
+    ASSERT_TRUE(piece.chunkmacs[firstChunk].finished);
+    ASSERT_TRUE(std::equal(mac2, mac2 + mega::SymmCipher::BLOCKSIZE, piece.chunkmacs[firstChunk].mac));
+}
+
+namespace {
+
+// combines the parts as a transfer does (output cut at chunk boundaries), without decryption
+class ChunkedRaidBufferManager : public mega::RaidBufferManager
+{
+    void finalize(FilePiece&) override { }
+    m_off_t calcOutputChunkPos(m_off_t acquiredpos) override { return mega::ChunkedHash::chunkfloor(acquiredpos); }
+};
+
+} // namespace
+
+TEST(RaidBufferManager, combinedPiecesEndAtChunkBoundaries)
+{
+    std::string data = randomData(40000);
+    auto parts = makeParts(data);
+    const m_off_t size = m_off_t(data.size());
+
+    ChunkedRaidBufferManager manager;
+    manager.setIsRaid(std::vector<std::string>(RAIDPARTS, "http://127.0.0.1/x"), 0, size, size, 1 << 20);
+
+    std::string output;
+    std::vector<size_t> offsets(RAIDPARTS, 0);
+    const size_t pieceSizes[RAIDPARTS] = { 49152, 16384, 65536, 32768, 81920, 48000 };
+
+    for (bool more = true; more; )
+    {
+        more = false;
+        for (unsigned j = 0; j < RAIDPARTS; ++j)
+        {
+            size_t n = std::min(pieceSizes[j], parts[j].size() - offsets[j]);
+            if (n)
+            {
+                auto piece = new mega::RaidBufferManager::FilePiece(m_off_t(offsets[j]), n);
+                memcpy(piece->buf.datastart(), parts[j].data() + offsets[j], n);
+                manager.submitBuffer(j, piece);
+                offsets[j] += n;
+                more = true;
+            }
+
+            if (auto out = manager.getAsyncOutputBufferPointer(j))
+            {
+                ASSERT_EQ(m_off_t(output.size()), out->pos);
+                output.append(reinterpret_cast<char*>(out->buf.datastart()), out->buf.datalen());
+                ASSERT_TRUE(output.size() == data.size() || mega::ChunkedHash::chunkfloor(m_off_t(output.size())) == m_off_t(output.size()));
+                manager.bufferWriteCompleted(j, true);
+            }
+        }
+    }
+
+    while (auto out = manager.getAsyncOutputBufferPointer(0))
+    {
+        ASSERT_EQ(m_off_t(output.size()), out->pos);
+        output.append(reinterpret_cast<char*>(out->buf.datastart()), out->buf.datalen());
+        manager.bufferWriteCompleted(0, true);
+    }
+
+    ASSERT_EQ(data, output);
+    ASSERT_EQ(0, manager.bufferedBytes());
+}
@@ -0,0 +1,102 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include <mega/screcorder.h>
+
+#include "mega.h"
+#include "utils.h"
+
+namespace {
+
+std::vector<std::string> lines(const std::string& path)
+{
+    std::ifstream in(path);
+    std::vector<std::string> result;
+    for (std::string line; std::getline(in, line); )
+    {
+        result.push_back(line);
+    }
+    return result;
+}
+
+class ScRecorderTest : public ::testing::Test
+{
+public:
+    void TearDown() override
+    {
+        fsaccess.unlinklocal(path);
+    }
+
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    mega::LocalPath path = mega::LocalPath::fromPath("screcorder_test.recording", fsaccess);
+};
+
+} // namespace
+
+TEST_F(ScRecorderTest, stateIsWrittenBeforeTheCompleteResponses)
+{
+    auto client = mt::makeClient(app, fsaccess);
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+    mt::makeNode(*client, mega::FOLDERNODE, 2, &root);
+    client->scsn.setScsn(0x1234);
+
+    mega::ScRecorder recorder(fsaccess, path);
+    auto append = [&recorder](const std::string& data) { recorder.append(data.data(), data.size()); };
+
+    recorder.begin(*client);
+    append("{\"a\":[");
+    append("{\"a\":\"d\",\"n\":\"AAAAAAAA\"}],\"sn\":\"AAAAAAAAAAA\"}");
+    recorder.end();
+
+    // an interrupted response is dropped, its retry is kept
+    recorder.begin(*client);
+    append("{\"a\":[{\"a\":");
+    recorder.begin(*client);
+    append("{\"a\":[],\"sn\":\"AAAAAAAAAAA\"}");
+    recorder.end();
+
+    ASSERT_FALSE(recorder.failed());
+    ASSERT_EQ(2u, recorder.responses());
+
+    auto recorded = lines(path.toPath(fsaccess));
+    ASSERT_EQ(8u, recorded.size());
+    ASSERT_EQ(mega::ScRecorder::HEADER, recorded[0]);
+    ASSERT_EQ(0u, recorded[1].find("me:"));
+    ASSERT_EQ(0u, recorded[2].find("k:"));
+    ASSERT_EQ(std::string("sn:") + client->scsn.text(), recorded[3]);
+    ASSERT_EQ(0u, recorded[4].find("n:"));
+    ASSERT_EQ(0u, recorded[5].find("n:"));
+    ASSERT_EQ("sc:{\"a\":[{\"a\":\"d\",\"n\":\"AAAAAAAA\"}],\"sn\":\"AAAAAAAAAAA\"}", recorded[6]);
+    ASSERT_EQ("sc:{\"a\":[],\"sn\":\"AAAAAAAAAAA\"}", recorded[7]);
+
+    // the node records are those of the cache
+    auto replay = mt::makeClient(app, fsaccess);
+    mega::node_vector dp;
+    for (size_t i : {4, 5})
+    {
+        std::string record = mega::Base64::atob(recorded[i].substr(2));
+        ASSERT_NE(nullptr, mega::Node::unserialize(replay.get(), &record, &dp));
+    }
+    ASSERT_NE(nullptr, replay->nodebyhandle(1));
+    ASSERT_NE(nullptr, replay->nodebyhandle(2));
+}
@@ -0,0 +1,207 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <chrono>
+#include <map>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "mega.h"
+
+#ifdef ENABLE_SYNC
+
+using namespace mega;
+
+namespace {
+
+class ScanServiceTest : public ::testing::Test
+{
+public:
+    ScanServiceTest()
+    {
+        bool result = fsAccess.cwd(rootPath);
+        assert(result);
+
+        rootPath.appendWithSeparator(LocalPath::fromPath("scanservice", fsAccess), false);
+
+        fsAccess.emptydirlocal(rootPath);
+        fsAccess.rmdirlocal(rootPath);
+
+        result = fsAccess.mkdirlocal(rootPath, false);
+        assert(result);
+        (void)result;
+    }
+
+    ~ScanServiceTest()
+    {
+        fsAccess.emptydirlocal(rootPath);
+        fsAccess.rmdirlocal(rootPath);
+    }
+
+    LocalPath path(const string& relative)
+    {
+        LocalPath p = rootPath;
+        p.appendWithSeparator(LocalPath::fromPath(relative, fsAccess), false);
+        return p;
+    }
+
+    void makeFolder(const string& relative)
+    {
+        auto p = path(relative);
+        ASSERT_TRUE(fsAccess.mkdirlocal(p, false));
+    }
+
+    void makeFile(const string& relative, size_t size)
+    {
+        auto p = path(relative);
+        auto fa = fsAccess.newfileaccess(false);
+        ASSERT_TRUE(fa->fopen(p, false, true));
+
+        string data(size, 'x');
+        ASSERT_TRUE(fa->fwrite(reinterpret_cast<const byte*>(data.data()), unsigned(data.size()), 0));
+    }
+
+    // walks the tree like a new sync does, returns the entries found by their path relative to the root
+    std::map<string, ScanService::FSNode> walk(unsigned threads, size_t& batches)
+    {
+        WAIT_CLASS waiter;
+        ScanService service(waiter, threads);
+        EXPECT_EQ(threads, service.threads());
+
+        auto walk = service.walk(false);
+        walk->scan(rootPath);
+
+        std::map<string, ScanService::FSNode> entries;
+        batches = 0;
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (!walk->done() && std::chrono::steady_clock::now() < deadline)
+        {
+            ScanService::Batch batch;
+            if (!walk->next(batch))
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            ++batches;
+            EXPECT_FALSE(batch.failed);
+
+            for (auto& entry : batch.entries)
+            {
+                LocalPath full = batch.path;
+                full.appendWithSeparator(entry.localname, false);
+
+                if (entry.type == FOLDERNODE)
+                {
+                    walk->scan(full);
+                }
+
+                size_t index = 0;
+                rootPath.isContainingPathOf(full, &index);
+                entries[full.subpathFrom(index).toPath(fsAccess)] = std::move(entry);
+            }
+        }
+
+        EXPECT_TRUE(walk->done());
+        return entries;
+    }
+
+    FSACCESS_CLASS fsAccess;
+    LocalPath rootPath;
+};
+
+} // namespace
+
+TEST_F(ScanServiceTest, WalkListsTheTree)
+{
+    auto sep = string(1, static_cast<char>(LocalPath::localPathSeparator));
+
+    makeFile("a", 10);
+    makeFolder("b");
+    makeFile("b" + sep + "c", 20000);
+    makeFolder("b" + sep + "d");
+    makeFile("b" + sep + "d" + sep + "e", 0);
+    makeFolder("f");
+
+    for (unsigned threads : { 1, 2, 8 })
+    {
+        size_t batches;
+        auto entries = walk(threads, batches);
+
+        // the root and the three folders
+        ASSERT_EQ(4u, batches);
+        ASSERT_EQ(6u, entries.size());
+
+        for (const string& name : { string("b"), "b" + sep + "d", string("f") })
+        {
+            ASSERT_EQ(FOLDERNODE, entries[name].type) << name;
+        }
+
+        for (const string& name : { string("a"), "b" + sep + "c", "b" + sep + "d" + sep + "e" })
+        {
+            ASSERT_EQ(FILENODE, entries[name].type) << name;
+            ASSERT_FALSE(entries[name].failed) << name;
+        }
+    }
+}
+
+TEST_F(ScanServiceTest, CancelledWalkReturnsNothing)
+{
+    makeFolder("a");
+
+    WAIT_CLASS waiter;
+    ScanService service(waiter, 2);
+
+    auto walk = service.walk(false);
+    walk->scan(rootPath);
+    walk->cancel();
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!walk->done() && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    ScanService::Batch batch;
+    ASSERT_TRUE(walk->done());
+    ASSERT_FALSE(walk->next(batch));
+}
+
+TEST_F(ScanServiceTest, MissingFolderIsReportedAsFailed)
+{
+    WAIT_CLASS waiter;
+    ScanService service(waiter, 1);
+
+    auto walk = service.walk(false);
+    walk->scan(path("missing"));
+
+    ScanService::Batch batch;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!walk->next(batch) && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    ASSERT_TRUE(batch.failed);
+    ASSERT_TRUE(batch.entries.empty());
+    ASSERT_TRUE(walk->done());
+}
+
+#endif
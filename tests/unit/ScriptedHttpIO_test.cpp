@@ -0,0 +1,142 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <gtest/gtest.h>
+
+#include <mega.h>
+#include <mega/testhooks.h>
+
+namespace {
+
+class ScriptedHttpIOTest : public ::testing::Test
+{
+public:
+    struct App : mega::MegaApp
+    {
+        void sendevent_result(mega::error e) override { results.push_back(e); }
+        std::vector<mega::error> results;
+    };
+
+    void SetUp() override
+    {
+        mega::Waiter::manualclock = true;
+        mega::Waiter::ds = 1000;
+    }
+
+    void TearDown() override
+    {
+        mega::Waiter::manualclock = false;
+    }
+
+    App app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    std::vector<std::string> bodies;
+    bool answer = true;
+    mega::ScriptedHttpIO httpio{[this](const mega::HttpReq&, const std::string& body, std::string& response)
+    {
+        if (!answer)
+        {
+            return 0;
+        }
+        bodies.push_back(body);
+        response = "[0]";
+        return 200;
+    }};
+    mega::MegaClient client{&app, nullptr, &httpio, &fsaccess, nullptr, nullptr, "XXX", "unit_test", 0};
+};
+
+} // anonymous
+
+TEST_F(ScriptedHttpIOTest, clockOnlyMovesWhenAdvanced)
+{
+    mega::Waiter::bumpds();
+    ASSERT_EQ(1000u, mega::Waiter::ds);
+
+    client.exec();
+    ASSERT_EQ(1000u, mega::Waiter::ds);
+
+    mega::Waiter::advanceds(5);
+    mega::Waiter::bumpds();
+    ASSERT_EQ(1005u, mega::Waiter::ds);
+}
+
+TEST_F(ScriptedHttpIOTest, commandIsAnsweredWithinAnExec)
+{
+    client.sendevent(99999, "test");
+    client.exec();
+
+    ASSERT_EQ(1u, httpio.answered());
+    ASSERT_EQ(1u, bodies.size());
+    ASSERT_NE(std::string::npos, bodies[0].find("99999"));
+    ASSERT_EQ(std::vector<mega::error>{mega::API_OK}, app.results);
+}
+
+TEST_F(ScriptedHttpIOTest, pendingRequestWaitsForItsAnswer)
+{
+    answer = false;
+    client.sendevent(99999, "test");
+    client.exec();
+
+    ASSERT_EQ(1u, httpio.pending());
+    ASSERT_TRUE(app.results.empty());
+
+    answer = true;
+    mega::Waiter::advanceds(1);
+    client.exec();
+
+    ASSERT_EQ(0u, httpio.pending());
+    ASSERT_EQ(std::vector<mega::error>{mega::API_OK}, app.results);
+}
+
+TEST_F(ScriptedHttpIOTest, autodetectedProxyIsReusedUntilItExpires)
+{
+    struct AutoProxyHttpIO : mega::ScriptedHttpIO
+    {
+        using ScriptedHttpIO::ScriptedHttpIO;
+
+        mega::Proxy* detectautoproxy() override
+        {
+            ++detections;
+            auto proxy = new mega::Proxy;
+            std::string url = "proxy" + std::to_string(detections) + ":8080";
+            proxy->setProxyType(mega::Proxy::CUSTOM);
+            proxy->setProxyURL(&url);
+            return proxy;
+        }
+
+        int detections = 0;
+    };
+
+    AutoProxyHttpIO proxyio{[](const mega::HttpReq&, const std::string&, std::string&) { return 0; }};
+
+    std::unique_ptr<mega::Proxy> proxy(proxyio.getautoproxy());
+    ASSERT_EQ(1, proxyio.detections);
+    ASSERT_EQ("proxy1:8080", proxy->getProxyURL());
+
+    mega::Waiter::advanceds(mega::HttpIO::AUTOPROXY_TTL - 1);
+    mega::Waiter::bumpds();
+    proxy.reset(proxyio.getautoproxy());
+    ASSERT_EQ(1, proxyio.detections);
+    ASSERT_EQ("proxy1:8080", proxy->getProxyURL());
+
+    mega::Waiter::advanceds(1);
+    mega::Waiter::bumpds();
+    proxy.reset(proxyio.getautoproxy());
+    ASSERT_EQ(2, proxyio.detections);
+    ASSERT_EQ("proxy2:8080", proxy->getProxyURL());
+}
@@ -311,6 +311,45 @@ TEST(Serialization, CacheableReaderWriter_fsfp_t)
     ASSERT_EQ(42, fsfp);
 }
 
+TEST(Serialization, CacheableReaderWriter_varint)
+{
+    std::string data;
+    {
+        mega::CacheableWriter writer{data};
+        writer.serializevarint(0);
+        writer.serializevarint(127);
+        writer.serializevarint(128);
+        writer.serializevarint(std::numeric_limits<uint64_t>::max());
+        writer.serializevarbytes(std::string("blah"));
+        writer.serializevarbytes(std::string());
+    }
+    ASSERT_EQ(1u + 1 + 2 + 10 + 5 + 1, data.size());
+
+    mega::CacheableReader reader{data};
+    uint64_t value;
+    ASSERT_TRUE(reader.unserializevarint(value));
+    ASSERT_EQ(0u, value);
+    ASSERT_TRUE(reader.unserializevarint(value));
+    ASSERT_EQ(127u, value);
+    ASSERT_TRUE(reader.unserializevarint(value));
+    ASSERT_EQ(128u, value);
+    ASSERT_TRUE(reader.unserializevarint(value));
+    ASSERT_EQ(std::numeric_limits<uint64_t>::max(), value);
+
+    const char* bytes;
+    size_t len;
+    ASSERT_TRUE(reader.unserializevarbytes(bytes, len));
+    ASSERT_EQ("blah", std::string(bytes, len));
+    ASSERT_TRUE(reader.unserializevarbytes(bytes, len));
+    ASSERT_EQ(0u, len);
+    ASSERT_EQ(reader.ptr, data.c_str() + data.size());
+
+    // a truncated varint is rejected
+    std::string truncated("\x80", 1);
+    mega::CacheableReader truncatedReader{truncated};
+    ASSERT_FALSE(truncatedReader.unserializevarint(value));
+}
+
 namespace {
 
 //struct MockFileSystemAccess : mt::DefaultedFileSystemAccess
@@ -346,10 +385,11 @@ void checkDeserializedLocalNode(const mega::LocalNode& dl, const mega::LocalNode
     ASSERT_EQ(ref.parent_dbid, dl.parent_dbid);
     ASSERT_EQ(ref.fsid, dl.fsid);
     ASSERT_EQ(ref.localname, dl.localname);
-    ASSERT_EQ(nullptr, dl.slocalname);
+    ASSERT_EQ(nullptr, dl.slocalname.get());
     ASSERT_EQ(ref.name, dl.name);
     ASSERT_EQ(ref.crc, dl.crc);
     ASSERT_EQ(ref.mtime, dl.mtime);
+    ASSERT_EQ(ref.scanmtime, dl.scanmtime);
     ASSERT_EQ(true, dl.isvalid);
     ASSERT_EQ(nullptr, dl.parent);
     ASSERT_EQ(ref.sync, dl.sync);
@@ -384,7 +424,7 @@ TEST(Serialization, LocalNode_forFolder_withoutParent_withoutNode)
     std::string data;
     ASSERT_TRUE(l.serialize(&data));
 #ifndef WIN32
-    ASSERT_EQ(45u, data.size());
+    ASSERT_EQ(22u, data.size());
 #endif
     std::unique_ptr<mega::LocalNode> dl{mega::LocalNode::unserialize(sync.get(), &data)};
     dl->node.store_unchecked(nullptr); // deserialize breaks the crossref_ptr rules
@@ -407,7 +447,7 @@ TEST(Serialization, LocalNode_forFile_withoutNode)
     std::string data;
     ASSERT_TRUE(l->serialize(&data));
 #ifndef WIN32
-    ASSERT_EQ(65u, data.size());
+    ASSERT_EQ(42u, data.size());
 #endif
     std::unique_ptr<mega::LocalNode> dl{mega::LocalNode::unserialize(sync.get(), &data)};
     dl->node.store_unchecked(nullptr); // deserialize breaks the crossref_ptr rules
@@ -429,7 +469,7 @@ TEST(Serialization, LocalNode_forFile_withoutNode_withMaxMtime)
     std::string data;
     ASSERT_TRUE(l->serialize(&data));
 #ifndef WIN32
-    ASSERT_EQ(69u, data.size());
+    ASSERT_EQ(47u, data.size());
 #endif
     std::unique_ptr<mega::LocalNode> dl{mega::LocalNode::unserialize(sync.get(), &data)};
     dl->node.store_unchecked(nullptr); // deserialize breaks the crossref_ptr rules
@@ -446,7 +486,7 @@ TEST(Serialization, LocalNode_forFolder_withoutParent)
     std::string data;
     ASSERT_TRUE(l.serialize(&data));
 #ifndef WIN32
-    ASSERT_EQ(45u, data.size());
+    ASSERT_EQ(22u, data.size());
 #endif
     std::unique_ptr<mega::LocalNode> dl{mega::LocalNode::unserialize(sync.get(), &data)};
     dl->node.store_unchecked(nullptr); // deserialize breaks the crossref_ptr rules
@@ -468,13 +508,33 @@ TEST(Serialization, LocalNode_forFolder)
     std::string data;
     ASSERT_TRUE(l->serialize(&data));
 #ifndef WIN32
-    ASSERT_EQ(44u, data.size());
+    ASSERT_EQ(21u, data.size());
 #endif
     std::unique_ptr<mega::LocalNode> dl{mega::LocalNode::unserialize(sync.get(), &data)};
     dl->node.store_unchecked(nullptr); // deserialize breaks the crossref_ptr rules
     checkDeserializedLocalNode(*dl, *l);
 }
 
+TEST(Serialization, LocalNode_forFolder_withScanMtime)
+{
+    MockClient client;
+    auto us = mt::makeSync(*client.cli, "wicked");
+    auto& sync = us->mSync;
+    auto l = mt::makeLocalNode(*sync, *sync->localroot, mega::FOLDERNODE, "sweet");
+    l->parent->dbid = 13;
+    l->parent_dbid = l->parent->dbid;
+    l->scanmtime = 1600000000;
+    auto& n = mt::makeNode(*client.cli, mega::FOLDERNODE, 42);
+    l->setfsid(10, client.cli->fsidnode);
+    l->setnode(&n);
+    std::string data;
+    ASSERT_TRUE(l->serialize(&data));
+    std::unique_ptr<mega::LocalNode> dl{mega::LocalNode::unserialize(sync.get(), &data)};
+    ASSERT_NE(nullptr, dl);
+    dl->node.store_unchecked(nullptr); // deserialize breaks the crossref_ptr rules
+    checkDeserializedLocalNode(*dl, *l);
+}
+
 #ifndef WIN32
 TEST(Serialization, LocalNode_forFolder_32bit)
 {
@@ -549,7 +609,7 @@ TEST(Serialization, LocalNode_forFile)
     std::iota(l->crc.begin(), l->crc.end(), 1);
     std::string data;
     ASSERT_TRUE(l->serialize(&data));
-    ASSERT_EQ(61u, data.size());
+    ASSERT_EQ(39u, data.size());
     std::unique_ptr<mega::LocalNode> dl{mega::LocalNode::unserialize(sync.get(), &data)};
     dl->node.store_unchecked(nullptr); // deserialize breaks the crossref_ptr rules
     checkDeserializedLocalNode(*dl, *l);
@@ -671,7 +731,7 @@ TEST(Serialization, Node_forFile_withoutParent_withoutShares_withoutAttrs_withou
     n->ctime = 44;
     std::string data;
     ASSERT_TRUE(n->serialize(&data));
-    ASSERT_EQ(90u, data.size());
+    ASSERT_EQ(69u, data.size());
     mega::node_vector dp;
     auto dn = mega::Node::unserialize(client.cli.get(), &data, &dp);
     checkDeserializedNode(*dn, *n);
@@ -686,7 +746,7 @@ TEST(Serialization, Node_forFolder_withoutParent_withoutShares_withoutAttrs_with
     n->ctime = 44;
     std::string data;
     ASSERT_TRUE(n->serialize(&data));
-    ASSERT_EQ(71u, data.size());
+    ASSERT_EQ(42u, data.size());
     mega::node_vector dp;
     auto dn = mega::Node::unserialize(client.cli.get(), &data, &dp);
     checkDeserializedNode(*dn, *n);
@@ -702,7 +762,7 @@ TEST(Serialization, Node_forFile_withoutShares_withoutAttrs_withoutFileAttrStrin
     n->ctime = 44;
     std::string data;
     ASSERT_TRUE(n->serialize(&data));
-    ASSERT_EQ(90u, data.size());
+    ASSERT_EQ(69u, data.size());
     mega::node_vector dp;
     auto dn = mega::Node::unserialize(client.cli.get(), &data, &dp);
     checkDeserializedNode(*dn, *n);
@@ -722,7 +782,7 @@ TEST(Serialization, Node_forFile_withoutShares_withoutFileAttrString_withoutPlin
     };
     std::string data;
     ASSERT_TRUE(n->serialize(&data));
-    ASSERT_EQ(104u, data.size());
+    ASSERT_EQ(83u, data.size());
     mega::node_vector dp;
     auto dn = mega::Node::unserialize(client.cli.get(), &data, &dp);
     checkDeserializedNode(*dn, *n);
@@ -743,7 +803,7 @@ TEST(Serialization, Node_forFile_withoutShares_withoutPlink)
     n->fileattrstring = "blah";
     std::string data;
     ASSERT_TRUE(n->serialize(&data));
-    ASSERT_EQ(108u, data.size());
+    ASSERT_EQ(87u, data.size());
     mega::node_vector dp;
     auto dn = mega::Node::unserialize(client.cli.get(), &data, &dp);
     checkDeserializedNode(*dn, *n);
@@ -765,7 +825,7 @@ TEST(Serialization, Node_forFile_withoutShares)
     n->plink = new mega::PublicLink{n->nodehandle, 1, 2, false};
     std::string data;
     ASSERT_TRUE(n->serialize(&data));
-    ASSERT_EQ(131u, data.size());
+    ASSERT_EQ(97u, data.size());
     mega::node_vector dp;
     auto dn = mega::Node::unserialize(client.cli.get(), &data, &dp);
     checkDeserializedNode(*dn, *n);
@@ -788,7 +848,7 @@ TEST(Serialization, Node_forFile_withoutShares_withAuthKey)
     n->plink = new mega::PublicLink{n->nodehandle, 1, 2, false, "someAuthKey"};
     std::string data;
     ASSERT_TRUE(n->serialize(&data));
-    ASSERT_EQ(142u, data.size());
+    ASSERT_EQ(108u, data.size());
     mega::node_vector dp;
     auto dn = mega::Node::unserialize(client.cli.get(), &data, &dp);
     checkDeserializedNode(*dn, *n);
@@ -840,7 +900,7 @@ TEST(Serialization, Node_forFolder_withoutShares_withoutAttrs_withoutFileAttrStr
     n->ctime = 44;
     std::string data;
     ASSERT_TRUE(n->serialize(&data));
-    ASSERT_EQ(71u, data.size());
+    ASSERT_EQ(42u, data.size());
     mega::node_vector dp;
     auto dn = mega::Node::unserialize(client.cli.get(), &data, &dp);
     checkDeserializedNode(*dn, *n);
@@ -860,7 +920,7 @@ TEST(Serialization, Node_forFolder_withoutShares_withoutFileAttrString_withoutPl
     };
     std::string data;
     ASSERT_TRUE(n->serialize(&data));
-    ASSERT_EQ(85u, data.size());
+    ASSERT_EQ(56u, data.size());
     mega::node_vector dp;
     auto dn = mega::Node::unserialize(client.cli.get(), &data, &dp);
     checkDeserializedNode(*dn, *n);
@@ -881,7 +941,7 @@ TEST(Serialization, Node_forFolder_withoutShares_withoutPlink)
     n->fileattrstring = "blah";
     std::string data;
     ASSERT_TRUE(n->serialize(&data));
-    ASSERT_EQ(85u, data.size());
+    ASSERT_EQ(56u, data.size());
     mega::node_vector dp;
     auto dn = mega::Node::unserialize(client.cli.get(), &data, &dp);
     checkDeserializedNode(*dn, *n, true);
@@ -904,7 +964,7 @@ TEST(Serialization, Node_forFolder_withoutShares)
     std::string data;
     ASSERT_TRUE(n->serialize(&data));
 
-    ASSERT_EQ(108u, data.size());
+    ASSERT_EQ(66u, data.size());
     mega::node_vector dp;
     auto dn = mega::Node::unserialize(client.cli.get(), &data, &dp);
     checkDeserializedNode(*dn, *n, true);
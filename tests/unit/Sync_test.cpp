@@ -251,12 +251,12 @@ struct Fixture
 
     bool iteratorsCorrect(mega::LocalNode& l) const
     {
-        if (l.fsid_it == mLocalNodes.end())
+        if (!l.fsid_indexed)
         {
             return false;
         }
         auto localNodePair = mLocalNodes.find(l.fsid);
-        if (l.fsid_it != localNodePair)
+        if (localNodePair == mLocalNodes.end())
         {
             return false;
         }
@@ -2307,7 +2307,230 @@ TEST_F(SyncConfigStoreTest, Write)
     EXPECT_FALSE(store.dirty());
 }
 
+TEST_F(SyncConfigStoreTest, WriteUnchanged)
+{
+    Directory db(fsAccess(), Utilities::randomPath());
+
+    SyncConfigStore store(db, ioContext());
+
+    SyncConfigVector configs;
+
+    // Read empty so that the drive is known.
+    EXPECT_EQ(store.read(LocalPath(), configs), API_ENOENT);
+    EXPECT_EQ(store.flushDue(), NEVER);
+
+    {
+        SyncConfig config;
+
+        config.mBackupId = 2;
+        config.mLocalPath = Utilities::randomPath();
+        config.mRemoteNode.set6byte(3);
+
+        configs.emplace_back(config);
+    }
+
+    // Changes are flushed a while after the first of them.
+    store.markDriveDirty(LocalPath());
+    EXPECT_EQ(store.flushDue(), Waiter::ds + SyncConfigStore::FLUSH_DELAY);
+
+    // Only the first write reaches the disk.
+    EXPECT_CALL(ioContext(), write(Eq(db.path()), _, Eq(0u)))
+      .WillOnce(Return(API_OK));
+
+    EXPECT_TRUE(store.writeDirtyDrives(configs).empty());
+    EXPECT_EQ(store.flushDue(), NEVER);
+
+    // Changes that cancel out aren't written.
+    store.markDriveDirty(LocalPath());
+    EXPECT_TRUE(store.writeDirtyDrives(configs).empty());
+    EXPECT_FALSE(store.dirty());
+
+    // Real changes are.
+    configs.back().mEnabled = !configs.back().mEnabled;
+
+    EXPECT_CALL(ioContext(), write(Eq(db.path()), _, Eq(1u)))
+      .WillOnce(Return(API_OK));
+
+    store.markDriveDirty(LocalPath());
+    EXPECT_TRUE(store.writeDirtyDrives(configs).empty());
+}
+
 } // SyncConfigTests
 
+TEST(LocalNodeChildren, lookupsAndIterationSurviveErasure)
+{
+    // the container never dereferences the nodes
+    std::vector<char> nodes(100);
+    auto node = [&](size_t i) { return reinterpret_cast<mega::LocalNode*>(&nodes[i]); };
+    auto index = [&](const mega::LocalNode* n) { return size_t(reinterpret_cast<const char*>(n) - nodes.data()); };
+
+    std::vector<mega::LocalPath> names;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        names.push_back(mega::LocalPath::fromPlatformEncoded("name" + std::to_string(i)));
+    }
+
+    mega::LocalNodeChildren children;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        children.set(&names[i], node(i));
+    }
+    ASSERT_EQ(nodes.size(), children.size());
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        auto it = children.find(&names[i]);
+        ASSERT_NE(children.end(), it);
+        ASSERT_EQ(node(i), it->second);
+    }
+
+    // erase the current entry after advancing, as the deletion of LocalNodes does
+    size_t visited = 0;
+    for (auto it = children.begin(); it != children.end(); ++visited)
+    {
+        size_t i = index(it++->second);
+        if (!(i % 2))
+        {
+            ASSERT_EQ(1u, children.erase(&names[i]));
+        }
+    }
+    ASSERT_EQ(nodes.size(), visited);
+    ASSERT_EQ(nodes.size() / 2, children.size());
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        ASSERT_EQ(!(i % 2), children.find(&names[i]) == children.end()) << i;
+    }
+
+    // adding another one compacts the holes of the erased ones
+    mega::LocalPath extra = mega::LocalPath::fromPlatformEncoded("extra");
+    children.set(&extra, node(0));
+    children.set(&names[1], node(2));
+    ASSERT_EQ(nodes.size() / 2 + 1, children.size());
+    ASSERT_EQ(node(0), children.find(&extra)->second);
+    ASSERT_EQ(node(2), children.find(&names[1])->second);
+
+    visited = 0;
+    for (auto& entry : children)
+    {
+        ASSERT_NE(nullptr, entry.second);
+        ++visited;
+    }
+    ASSERT_EQ(children.size(), visited);
+}
+
+TEST(NotificationDeque, repeatedPathsAreCoalescedWithinTheWindow)
+{
+    mega::NotificationDeque q;
+    auto a = mega::LocalPath::fromPlatformEncoded("a");
+    auto b = mega::LocalPath::fromPlatformEncoded("b");
+
+    mega::Waiter::ds = 100;
+    q.pushBack(mega::Notification(100, a, nullptr));
+    q.pushBack(mega::Notification(100, b, nullptr));
+    q.pushBack(mega::Notification(105, a, nullptr));
+    ASSERT_EQ(2u, q.size());
+
+    // too late to be folded into the first one
+    mega::Waiter::ds += mega::NotificationDeque::COALESCE_DS;
+    q.pushBack(mega::Notification(mega::Waiter::ds, a, nullptr));
+    ASSERT_EQ(3u, q.size());
+
+    uint64_t raw, coalesced;
+    q.counts(raw, coalesced);
+    ASSERT_EQ(4u, raw);
+    ASSERT_EQ(1u, coalesced);
+
+    // the first one keeps its place with the newest timestamp
+    mega::Notification n;
+    ASSERT_TRUE(q.popFront(n));
+    ASSERT_EQ(a, n.path);
+    ASSERT_EQ(105, n.timestamp);
+
+    // once put back it isn't folded into any longer, the newest one is
+    q.unpopFront(n);
+    q.pushBack(mega::Notification(0, a, nullptr));
+    ASSERT_EQ(3u, q.size());
+
+    ASSERT_TRUE(q.popFront(n));
+    ASSERT_TRUE(q.popFront(n));
+    ASSERT_EQ(b, n.path);
+    ASSERT_TRUE(q.popFront(n));
+    ASSERT_EQ(a, n.path);
+    ASSERT_EQ(0, n.timestamp);
+    ASSERT_FALSE(q.popFront(n));
+}
+
+TEST(NotificationDeque, pushesFromOtherThreadsArriveInTheirOrder)
+{
+    mega::NotificationDeque q;
+    const int threads = 4;
+    const int perThread = 2000;
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; ++t)
+    {
+        producers.emplace_back([&q, t]()
+        {
+            for (int i = 0; i < perThread; ++i)
+            {
+                // only told apart, never used
+                auto id = reinterpret_cast<mega::LocalNode*>(uintptr_t(t * perThread + i + 1));
+                q.pushBack(mega::Notification(0, mega::LocalPath(), id));
+            }
+        });
+    }
+
+    // taken out while they are pushed
+    std::vector<int> next(threads, 0);
+    int received = 0;
+    mega::Notification n;
+    while (received < threads * perThread)
+    {
+        if (q.popFront(n))
+        {
+            auto id = int(reinterpret_cast<uintptr_t>(n.localnode) - 1);
+            ASSERT_EQ(next[id / perThread]++, id % perThread);
+            ++received;
+        }
+    }
+
+    for (auto& p : producers)
+    {
+        p.join();
+    }
+    ASSERT_TRUE(q.empty());
+}
+
+TEST(Sync, aFolderDeletedAfterItsContentTakesItsPlaceInTheQueue)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    auto& root = mt::makeNode(*client, mega::ROOTNODE, 1);
+    auto& folder = mt::makeNode(*client, mega::FOLDERNODE, 2, &root);
+    auto& subfolder = mt::makeNode(*client, mega::FOLDERNODE, 3, &folder);
+    auto& file = mt::makeNode(*client, mega::FILENODE, 4, &subfolder);
+    auto& sibling = mt::makeNode(*client, mega::FILENODE, 5, &root);
+
+    // the local tree goes bottom up
+    client->movetosyncdebris(&file, false);
+    client->movetosyncdebris(&subfolder, false);
+    ASSERT_EQ(mega::node_set{&subfolder}, client->todebris);
+
+    client->movetosyncdebris(&folder, false);
+    client->movetosyncdebris(&sibling, false);
+    ASSERT_EQ((mega::node_set{&folder, &sibling}), client->todebris);
+    ASSERT_EQ(mega::SYNCDEL_NONE, file.syncdeleted);
+    ASSERT_EQ(mega::SYNCDEL_NONE, subfolder.syncdeleted);
+    ASSERT_EQ(client->todebris.end(), subfolder.todebris_it);
+
+    // those under a folder on its way aren't queued at all
+    auto& late = mt::makeNode(*client, mega::FILENODE, 6, &subfolder);
+    client->movetosyncdebris(&late, false);
+    ASSERT_EQ(2u, client->todebris.size());
+}
+
 #endif
 
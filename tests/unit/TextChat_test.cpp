@@ -126,4 +126,26 @@ TEST(TextChat, unserialize_32bit)
     auto newTc = mega::TextChat::unserialize(client.get(), &d);
     checkTextChats(tc, *newTc);
 }
+TEST(TextChat, attachmentUsersStaySortedAndUnique)
+{
+    mega::TextChat tc;
+    ASSERT_TRUE(tc.setNodeUserAccess(7, 30));
+    ASSERT_TRUE(tc.setNodeUserAccess(7, 10));
+    ASSERT_TRUE(tc.setNodeUserAccess(7, 20));
+    ASSERT_TRUE(tc.setNodeUserAccess(7, 10));
+
+    const mega::compact_handle_set& users = tc.attachedNodes[7];
+    ASSERT_EQ(std::vector<mega::handle>({10, 20, 30}), std::vector<mega::handle>(users.begin(), users.end()));
+    ASSERT_EQ(1u, users.count(20));
+    ASSERT_EQ(0u, users.count(25));
+
+    ASSERT_TRUE(tc.setNodeUserAccess(7, 20, true));
+    ASSERT_EQ(std::vector<mega::handle>({10, 30}), std::vector<mega::handle>(users.begin(), users.end()));
+
+    // the node goes once its last user does
+    ASSERT_TRUE(tc.setNodeUserAccess(7, 10, true));
+    ASSERT_TRUE(tc.setNodeUserAccess(7, 30, true));
+    ASSERT_TRUE(tc.attachedNodes.empty());
+    ASSERT_FALSE(tc.setNodeUserAccess(7, 30, true));
+}
 #endif
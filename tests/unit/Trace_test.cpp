@@ -0,0 +1,138 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include <mega/trace.h>
+
+#include "mega.h"
+
+namespace {
+
+std::vector<mega::TraceRecord> readTrace(const std::string& path)
+{
+    std::ifstream f(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    EXPECT_GE(data.size(), 16u);
+    EXPECT_EQ(0, memcmp(data.data(), mega::Trace::TRACE_MAGIC, sizeof mega::Trace::TRACE_MAGIC));
+    EXPECT_EQ(0u, (data.size() - 16) % sizeof(mega::TraceRecord));
+
+    std::vector<mega::TraceRecord> records((data.size() - 16) / sizeof(mega::TraceRecord));
+    memcpy(records.data(), data.data() + 16, records.size() * sizeof(mega::TraceRecord));
+    return records;
+}
+
+} // anonymous
+
+TEST(Trace, recordsEnabledSubsystemsOnly)
+{
+    const std::string path = "trace_test.bin";
+    ASSERT_TRUE(mega::Trace::start(path, 1u << mega::TRACE_TRANSFER));
+
+    auto started = std::chrono::steady_clock::now() - std::chrono::milliseconds(5);
+    TRACE_EVENT(mega::TRACE_TRANSFER, mega::TRACE_TRANSFER_UPLOAD_CHUNK, 0x1234, 1048576, started);
+    TRACE_EVENT(mega::TRACE_HTTP, mega::TRACE_HTTP_REQUEST, mega::UNDEF, 100, started);
+    mega::Trace::stop();
+
+    // nothing is recorded after the trace is stopped
+    TRACE_EVENT(mega::TRACE_TRANSFER, mega::TRACE_TRANSFER_UPLOAD_CHUNK, 0x1234, 1048576, started);
+
+    auto records = readTrace(path);
+    ASSERT_EQ(1u, records.size());
+    EXPECT_EQ(mega::TRACE_TRANSFER_UPLOAD_CHUNK, records[0].event);
+    EXPECT_EQ(0x1234u, records[0].handle);
+    EXPECT_EQ(1048576u, records[0].size);
+    EXPECT_GE(records[0].duration, 5000u);
+    EXPECT_NE(0u, records[0].thread);
+
+    std::remove(path.c_str());
+}
+
+TEST(Trace, samplesOneEventInN)
+{
+    const std::string path = "trace_test.bin";
+    mega::Trace::setSampling(mega::TRACE_GFX, 10);
+    ASSERT_TRUE(mega::Trace::start(path, 1u << mega::TRACE_GFX));
+
+    auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < 100; i++)
+    {
+        TRACE_EVENT(mega::TRACE_GFX, mega::TRACE_GFX_JOB, mega::handle(i), 0, started);
+    }
+    mega::Trace::stop();
+    mega::Trace::setSampling(mega::TRACE_GFX, 1);
+
+    auto records = readTrace(path);
+    EXPECT_EQ(10u, records.size());
+    for (size_t i = 1; i < records.size(); i++)
+    {
+        EXPECT_LE(records[i - 1].timestamp, records[i].timestamp);
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(Trace, scopesNestPerThread)
+{
+    ASSERT_EQ(0u, mega::TraceScope::current());
+
+    mega::TraceId outer = mega::newTraceId(), inner = mega::newTraceId();
+    ASSERT_NE(0u, outer);
+    ASSERT_NE(outer, inner);
+    {
+        mega::TraceScope o(outer);
+        {
+            mega::TraceScope i(inner);
+            EXPECT_EQ(inner, mega::TraceScope::current());
+        }
+        EXPECT_EQ(outer, mega::TraceScope::current());
+
+        std::thread([]() { EXPECT_EQ(0u, mega::TraceScope::current()); }).join();
+    }
+    EXPECT_EQ(0u, mega::TraceScope::current());
+}
+
+TEST(Trace, stagesExportAsSpans)
+{
+    mega::TraceStages stages;
+    stages.times[mega::STAGE_QUEUED] = 1000;
+    stages.times[mega::STAGE_SLOT_ACQUIRED] = 3000;
+    stages.mark(mega::STAGE_SLOT_ACQUIRED);     // reached already: kept
+    EXPECT_EQ(3000, stages.times[mega::STAGE_SLOT_ACQUIRED]);
+
+    mega::TraceStages engine;
+    engine.times[mega::STAGE_QUEUED] = 500;
+    engine.times[mega::STAGE_LAST_BYTE] = 7000;
+    stages.merge(engine);
+    EXPECT_EQ(1000, stages.times[mega::STAGE_QUEUED]);
+    EXPECT_EQ(7000, stages.times[mega::STAGE_LAST_BYTE]);
+
+    std::string json = stages.toOtlpJson(0xabc, "DOWNLOAD");
+    EXPECT_NE(std::string::npos, json.find("{\"traceId\":\"00000000000000000000000000000abc\",\"spanId\":\"0000000000000abc\",\"name\":\"DOWNLOAD\",\"kind\":1,"
+                                           "\"startTimeUnixNano\":\"1000000\",\"endTimeUnixNano\":\"7000000\"}"));
+    EXPECT_NE(std::string::npos, json.find("\"parentSpanId\":\"0000000000000abc\",\"name\":\"queued\",\"kind\":1,"
+                                           "\"startTimeUnixNano\":\"1000000\",\"endTimeUnixNano\":\"3000000\"}"));
+    EXPECT_NE(std::string::npos, json.find("\"name\":\"slot_acquired\",\"kind\":1,\"startTimeUnixNano\":\"3000000\",\"endTimeUnixNano\":\"7000000\"}"));
+    EXPECT_EQ(std::string::npos, json.find("\"name\":\"last_byte\""));
+}
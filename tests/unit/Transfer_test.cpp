@@ -21,7 +21,9 @@
 #include <mega/megaclient.h>
 #include <mega/megaapp.h>
 #include <mega/transfer.h>
+#include <mega/transferslot.h>
 
+#include "DefaultedDbTable.h"
 #include "DefaultedFileSystemAccess.h"
 #include "utils.h"
 #include "mega.h"
@@ -46,6 +48,27 @@ void checkTransfers(const mega::Transfer& exp, const mega::Transfer& act)
     ASSERT_EQ(exp.priority, act.priority);
 }
 
+mega::NewNode uploadNode()
+{
+    mega::NewNode newnode;
+    newnode.source = mega::NEW_UPLOAD;
+    newnode.type = mega::FILENODE;
+    newnode.nodekey.assign(mega::FILENODEKEYLENGTH, 'k');
+    newnode.attrstring.reset(new std::string("attrs"));
+    return newnode;
+}
+
+class PutnodesRecordingApp : public mega::MegaApp
+{
+public:
+    void putnodes_result(const mega::Error& e, mega::targettype_t, std::vector<mega::NewNode>& nn, bool) override
+    {
+        results.emplace_back(client->restag, mega::error(e), nn.size());
+    }
+
+    std::vector<std::tuple<int, mega::error, size_t>> results;
+};
+
 }
 
 TEST(Transfer, serialize_unserialize)
@@ -152,3 +175,471 @@ TEST(Transfer, unserialize_32bit)
     checkTransfers(tf, *newTf);
 }
 #endif
+
+TEST(TransferConnectionControl, adaptsConnectionsToThroughput)
+{
+    mega::TransferConnectionControl control;
+    mega::dstime now = 1000;
+    control.init(2, 6, 16 << 20, 0, true, now);
+    ASSERT_EQ(2u, control.connections());
+
+    // a link where each connection gets 1 MB/s, but only 3 of them fit
+    auto run = [&](int periods)
+    {
+        std::set<unsigned> seen;
+        for (int i = periods; i--; )
+        {
+            control.transferred(std::min(control.connections(), 3u) * 3 * 1048576);
+            now += mega::TransferConnectionControl::PERIOD_DS;
+            control.update(now);
+            seen.insert(control.connections());
+        }
+        return seen;
+    };
+
+    run(10);
+    ASSERT_EQ(3u, control.connections());
+
+    // it keeps probing, but doesn't stray far for long
+    std::set<unsigned> seen = run(200);
+    ASSERT_EQ(0u, seen.count(1));
+    ASSERT_EQ(0u, seen.count(5));
+    ASSERT_EQ(0u, seen.count(6));
+
+    // requests of 4 seconds of data per connection
+    ASSERT_EQ(4 * 1048576, control.requestSize());
+}
+
+TEST(TransferConnectionControl, limitsMemory)
+{
+    mega::TransferConnectionControl control;
+    control.init(4, 4, 16 << 20, 5 << 19, false, 0);
+    ASSERT_EQ(2u, control.connections());
+    ASSERT_EQ(5 << 18, control.requestSize());
+
+    // without adaptation nothing else changes
+    control.transferred(100 << 20);
+    ASSERT_FALSE(control.update(1000));
+    ASSERT_EQ(2u, control.connections());
+
+    control.init(3, 3, 16 << 20, 0, false, 0);
+    ASSERT_EQ(3u, control.connections());
+    ASSERT_EQ(16 << 20, control.requestSize());
+}
+
+TEST(TransferConnectionBudget, admitsByConnectionsAndHosts)
+{
+    mega::TransferConnectionBudget budget(10, 4);
+    ASSERT_EQ("gfs1.userstorage.mega.co.nz", mega::TransferConnectionBudget::host("https://gfs1.userstorage.mega.co.nz:8080/dl/abc"));
+
+    std::vector<std::string> raid;
+    for (int i = 0; i < 6; ++i)
+    {
+        raid.push_back("http://gfs" + std::to_string(i) + ".userstorage.mega.co.nz/dl/x");
+    }
+
+    // alone, anything goes
+    ASSERT_TRUE(budget.fits(20, {}));
+
+    budget.add(6, raid);
+    ASSERT_TRUE(budget.fits(4, {}));
+    ASSERT_FALSE(budget.fits(6, {}));
+
+    // a single connection to a raid host fits, until that host has its limit
+    std::vector<std::string> single{ "http://gfs0.userstorage.mega.co.nz/ul/y" };
+    ASSERT_TRUE(budget.fits(3, single));
+    ASSERT_FALSE(budget.fits(4, single));
+    ASSERT_TRUE(budget.fits(4, { "http://gfs9.userstorage.mega.co.nz/ul/y" }));
+
+    budget.add(3, single);
+    ASSERT_EQ(9u, budget.used());
+    ASSERT_FALSE(budget.fits(1, single));
+    ASSERT_TRUE(budget.fits(1, {}));
+}
+
+TEST(Transfer, uploadPutnodesAreBatchedByTarget)
+{
+    PutnodesRecordingApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    mega::NodeHandle folder1, folder2;
+    folder1.set6byte(1);
+    folder2.set6byte(2);
+
+    client->queueUploadPutnodes(folder1, uploadNode(), 1);
+    client->queueUploadPutnodes(folder1, uploadNode(), 2);
+    client->queueUploadPutnodes(folder2, uploadNode(), 3);
+    client->queueUploadPutnodes(folder1, uploadNode(), 4);
+    client->pendingtcids[2] = {20};
+    client->pendingtcids[4] = {40};
+
+    client->sendUploadPutnodes();
+    ASSERT_TRUE(client->mUploadPutnodes.empty());
+
+    // the batch cleans up after all its transfers
+    ASSERT_EQ(1u, client->pendingtcids.size());
+    ASSERT_EQ((std::vector<uint32_t>{20, 40}), client->pendingtcids[1]);
+
+    std::string out;
+    bool suppressSID, includesFetchingNodes;
+    client->reqs.serverrequest(&out, suppressSID, includesFetchingNodes);
+
+    size_t commands = 0;
+    for (size_t pos = 0; (pos = out.find("\"a\":\"p\"", pos)) != std::string::npos; ++pos)
+    {
+        ++commands;
+    }
+    ASSERT_EQ(2u, commands);
+
+    // each upload gets its own result
+    client->reqs.serverresponse("[-9,-9]", client.get());
+    using Result = std::tuple<int, mega::error, size_t>;
+    ASSERT_EQ((std::vector<Result>{Result(1, mega::API_ENOENT, 1),
+                                   Result(2, mega::API_ENOENT, 1),
+                                   Result(4, mega::API_ENOENT, 1),
+                                   Result(3, mega::API_ENOENT, 1)}), app.results);
+    ASSERT_TRUE(client->pendingtcids.empty());
+}
+
+#ifdef ENABLE_SYNC
+TEST(Transfer, syncUploadPutnodesWaitForTheirWindow)
+{
+    PutnodesRecordingApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    mega::NodeHandle folder1, folder2;
+    folder1.set6byte(1);
+    folder2.set6byte(2);
+
+    client->queueSyncUploadPutnodes(folder1, uploadNode(), 1);
+    client->queueSyncUploadPutnodes(folder2, uploadNode(), 2);
+    client->queueSyncUploadPutnodes(folder1, uploadNode(), 3);
+    client->pendingtcids[3] = {30};
+    ASSERT_EQ(2, client->syncadding);
+
+    client->sendUploadPutnodes();
+    ASSERT_FALSE(client->reqs.cmdspending());
+
+    mega::Waiter::ds += mega::MegaClient::SYNC_PUTNODES_WINDOW_DS;
+    client->sendUploadPutnodes();
+    ASSERT_TRUE(client->mSyncUploadPutnodes.empty());
+    ASSERT_EQ((std::vector<uint32_t>{30}), client->pendingtcids[1]);
+
+    std::string out;
+    bool suppressSID, includesFetchingNodes;
+    client->reqs.serverrequest(&out, suppressSID, includesFetchingNodes);
+
+    size_t commands = 0;
+    for (size_t pos = 0; (pos = out.find("\"a\":\"p\"", pos)) != std::string::npos; ++pos)
+    {
+        ++commands;
+    }
+    ASSERT_EQ(2u, commands);
+
+    client->reqs.serverresponse("[-9,-9]", client.get());
+    ASSERT_EQ(0, client->syncadding);
+}
+#endif
+
+TEST(BandwidthScheduler, sharesTheLimitByWeight)
+{
+    mega::BandwidthScheduler scheduler;
+    scheduler.setlimit(12000);
+    scheduler.tick(100, 0);
+
+    // both want data, so the next second is shared
+    ASSERT_EQ(1, scheduler.grant(mega::BWCLASS_STREAMING, 1));
+    ASSERT_EQ(1, scheduler.grant(mega::BWCLASS_BACKUP, 1));
+    scheduler.tick(110, 0);
+
+    m_off_t backup = scheduler.grant(mega::BWCLASS_BACKUP, 100000);
+    m_off_t streaming = scheduler.grant(mega::BWCLASS_STREAMING, 100000);
+    ASSERT_LE(backup, 12000 / 9 + 1);
+    ASSERT_GE(streaming, 12000 * 8 / 9 - 1);
+    ASSERT_EQ(0, scheduler.grant(mega::BWCLASS_BACKUP, 100000));
+    ASSERT_FALSE(scheduler.admit(mega::BWCLASS_STREAMING, 1));
+
+    // alone, a class takes all of it
+    scheduler.tick(200, 0);
+    ASSERT_EQ(12000, scheduler.grant(mega::BWCLASS_BACKUP, 100000));
+}
+
+TEST(BandwidthScheduler, appliesThePolicyOfTheTimeOfDay)
+{
+    mega::BandwidthScheduler scheduler;
+
+    mega::BandwidthScheduler::Policy night;
+    night.maxbps = 1000;
+    night.fromMinute = 22 * 60;
+    night.toMinute = 6 * 60;
+    scheduler.addpolicy(mega::BWCLASS_BACKUP, night);
+
+    scheduler.tick(10, 12 * 60);
+    ASSERT_FALSE(scheduler.active());
+
+    scheduler.tick(20, 23 * 60);
+    ASSERT_TRUE(scheduler.active());
+    ASSERT_EQ(1000, scheduler.grant(mega::BWCLASS_BACKUP, 5000));
+    ASSERT_EQ(0, scheduler.grant(mega::BWCLASS_BACKUP, 5000));
+    ASSERT_EQ(5000, scheduler.grant(mega::BWCLASS_FOREGROUND, 5000));
+
+    // data that can't be split overdraws the bucket, and waits for it to refill
+    scheduler.tick(25, 23 * 60);
+    ASSERT_TRUE(scheduler.admit(mega::BWCLASS_BACKUP, 1500));
+    scheduler.tick(30, 23 * 60);
+    ASSERT_FALSE(scheduler.admit(mega::BWCLASS_BACKUP, 1));
+
+    scheduler.clearpolicies();
+    ASSERT_FALSE(scheduler.active());
+}
+
+TEST(TransferList, nexttransfersTakesEachCategoryInPriorityOrder)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+    mega::DBTableTransactionCommitter committer(client->tctable);
+
+    // large and small downloads, interleaved
+    std::vector<std::unique_ptr<mega::Transfer>> transfers;
+    for (int i = 0; i < 6; ++i)
+    {
+        transfers.emplace_back(new mega::Transfer(client.get(), mega::GET));
+        transfers.back()->size = i % 2 ? 1000 : 1000000;
+        client->transferlist.addtransfer(transfers.back().get(), committer);
+    }
+
+    // the last large one goes first, the first small one can't start
+    client->transferlist.movetofirst(transfers[4].get(), committer);
+    transfers[1]->state = mega::TRANSFERSTATE_PAUSED;
+
+    // two of each size at most
+    std::map<mega::filesizetype_t, int> taken;
+    std::vector<mega::Transfer*> asked;
+    std::function<bool(mega::Transfer*)> continueCategory = [&](mega::Transfer* t)
+    {
+        asked.push_back(t);
+        auto sizetype = mega::TransferCategory(t).sizetype;
+        return ++taken[sizetype] <= 2;
+    };
+    std::function<bool(mega::direction_t)> continueDirection = [](mega::direction_t) { return true; };
+
+    auto chosen = client->transferlist.nexttransfers(continueCategory, continueDirection);
+
+    mega::TransferCategory large(mega::GET, mega::LARGEFILE), small(mega::GET, mega::SMALLFILE);
+    ASSERT_EQ((std::vector<mega::Transfer*>{transfers[4].get(), transfers[0].get()}), chosen[large.index()]);
+    ASSERT_EQ((std::vector<mega::Transfer*>{transfers[3].get(), transfers[5].get()}), chosen[small.index()]);
+
+    // a full category is not asked again
+    ASSERT_EQ((std::vector<mega::Transfer*>{transfers[4].get(), transfers[0].get(), transfers[2].get(),
+                                            transfers[3].get(), transfers[5].get()}), asked);
+
+    client->transferlist.removetransfer(transfers[0].get());
+    taken.clear();
+    chosen = client->transferlist.nexttransfers(continueCategory, continueDirection);
+    ASSERT_EQ((std::vector<mega::Transfer*>{transfers[4].get(), transfers[2].get()}), chosen[large.index()]);
+}
+
+namespace
+{
+
+// counts the records written
+class CountingDbTable : public mt::DefaultedDbTable
+{
+public:
+    using DefaultedDbTable::DefaultedDbTable;
+
+    bool put(uint32_t, char*, unsigned) override
+    {
+        ++puts;
+        return true;
+    }
+
+    bool del(uint32_t) override
+    {
+        return true;
+    }
+
+    bool inTransaction() const override
+    {
+        return false;
+    }
+
+    int puts = 0;
+};
+
+}
+
+TEST(Transfer, progressIsCachedOncePerInterval)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+    auto table = new CountingDbTable(client->rng, false);
+    client->tctable.reset(table);
+
+    mega::Transfer first(client.get(), mega::GET);
+    mega::Transfer second(client.get(), mega::GET);
+
+    // each chunk done
+    for (int i = 0; i < 100; ++i)
+    {
+        client->transfercacheprogress(&first);
+        client->transfercacheprogress(&second);
+    }
+    ASSERT_EQ(0, table->puts);
+
+    {
+        mega::DBTableTransactionCommitter committer(client->tctable);
+        client->flushtransferprogress(committer, true);
+    }
+    ASSERT_EQ(2, table->puts);
+
+    // not again before the interval is over
+    client->transfercacheprogress(&first);
+    {
+        mega::DBTableTransactionCommitter committer(client->tctable);
+        client->flushtransferprogress(committer);
+    }
+    ASSERT_EQ(2, table->puts);
+
+    // a full update includes the progress
+    {
+        mega::DBTableTransactionCommitter committer(client->tctable);
+        client->transfercacheadd(&first, &committer);
+    }
+    ASSERT_EQ(3, table->puts);
+    ASSERT_TRUE(client->mTransferProgress.empty());
+
+    // and is dropped with the transfer
+    client->transfercacheprogress(&second);
+}
+
+namespace
+{
+
+std::string streamData(size_t size)
+{
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i)
+    {
+        data[i] = static_cast<char>(i * 7 + i / 251);
+    }
+    return data;
+}
+
+}
+
+TEST(DirectReadCache, servesTheBlocksStoredWithoutGaps)
+{
+    const m_off_t block = mega::DirectReadCache::BLOCK_SIZE;
+    const std::string file = streamData(size_t(block * 3 + 1000));
+
+    mega::DirectReadCache cache;
+    cache.configure(m_off_t(file.size()), 16 << 20, nullptr, mega::LocalPath(), 0);
+
+    // a read starting in the middle of a block doesn't fill it
+    cache.store(100, reinterpret_cast<const mega::byte*>(file.data()) + 100, size_t(block));
+    ASSERT_EQ(0, cache.cached(100, block));
+    ASSERT_EQ(100, cache.cached(block, block));
+
+    // the one that reads the start of it does, and overlaps
+    cache.store(0, reinterpret_cast<const mega::byte*>(file.data()), size_t(block + 500));
+    ASSERT_EQ(block + 400, cache.cached(100, block * 3));
+
+    std::string data;
+    ASSERT_TRUE(cache.load(100, block * 3, data));
+    ASSERT_EQ(file.substr(100, size_t(block - 100)), data);
+    ASSERT_TRUE(cache.load(block + 10, 20, data));
+    ASSERT_EQ(file.substr(size_t(block + 10), 20), data);
+    ASSERT_FALSE(cache.load(block + 500, 20, data));
+
+    // the last block is shorter
+    cache.store(block * 3, reinterpret_cast<const mega::byte*>(file.data()) + block * 3, 1000);
+    ASSERT_EQ(1000, cache.cached(block * 3, block));
+    ASSERT_TRUE(cache.load(block * 3 + 500, block, data));
+    ASSERT_EQ(file.substr(size_t(block * 3 + 500)), data);
+}
+
+TEST(DirectReadCache, dropsTheLeastRecentlyUsedBlocks)
+{
+    const m_off_t block = mega::DirectReadCache::BLOCK_SIZE;
+    const std::string file = streamData(size_t(block * 4));
+
+    mega::DirectReadCache cache;
+    cache.configure(m_off_t(file.size()), size_t(block * 2), nullptr, mega::LocalPath(), 0);
+
+    cache.store(0, reinterpret_cast<const mega::byte*>(file.data()), size_t(block * 2));
+
+    std::string data;
+    ASSERT_TRUE(cache.load(0, 10, data));
+
+    cache.store(block * 2, reinterpret_cast<const mega::byte*>(file.data()) + block * 2, size_t(block));
+    ASSERT_EQ(size_t(block * 2), cache.memoryUsed());
+    ASSERT_EQ(block, cache.cached(0, block * 4));
+    ASSERT_EQ(0, cache.cached(block, block));
+    ASSERT_EQ(block, cache.cached(block * 2, block * 2));
+}
+
+TEST(DirectReadCache, trimsTheLeastRecentlyUsedBlocks)
+{
+    const m_off_t block = mega::DirectReadCache::BLOCK_SIZE;
+    const std::string file = streamData(size_t(block * 4));
+
+    mega::DirectReadCache cache;
+    cache.configure(m_off_t(file.size()), size_t(block * 4), nullptr, mega::LocalPath(), 0);
+
+    cache.store(0, reinterpret_cast<const mega::byte*>(file.data()), file.size());
+    ASSERT_EQ(size_t(block * 4), cache.memoryUsed());
+
+    std::string data;
+    ASSERT_TRUE(cache.load(0, 10, data));
+
+    ASSERT_EQ(size_t(block * 2), cache.trim(size_t(block * 2)));
+    ASSERT_EQ(size_t(block * 2), cache.memoryUsed());
+    ASSERT_EQ(block, cache.cached(0, block * 4));
+    ASSERT_EQ(0, cache.cached(block, block * 2));
+    ASSERT_EQ(block, cache.cached(block * 3, block));
+
+    ASSERT_EQ(size_t(block * 2), cache.trim(0));
+    ASSERT_EQ(0u, cache.memoryUsed());
+    ASSERT_EQ(0, cache.cached(0, block * 4));
+}
+
+TEST(DirectReadCache, spillsToAFile)
+{
+    const m_off_t block = mega::DirectReadCache::BLOCK_SIZE;
+    const std::string file = streamData(size_t(block * 4));
+
+    ::mega::FSACCESS_CLASS fsaccess;
+    mega::LocalPath path;
+    ASSERT_TRUE(fsaccess.cwd(path));
+    path.appendWithSeparator(mega::LocalPath::fromPath("streamingcache", fsaccess), false);
+
+    auto exists = [&fsaccess](const mega::LocalPath& p)
+    {
+        return fsaccess.newfileaccess(false)->fopen(p);
+    };
+
+    {
+        mega::DirectReadCache cache;
+        cache.configure(m_off_t(file.size()), size_t(block), &fsaccess, path, block * 2);
+
+        cache.store(0, reinterpret_cast<const mega::byte*>(file.data()), file.size());
+        ASSERT_EQ(size_t(block), cache.memoryUsed());
+        ASSERT_EQ(block * 2, cache.spillUsed());
+        ASSERT_TRUE(exists(path));
+
+        // the third block didn't fit anywhere
+        ASSERT_EQ(block * 2, cache.cached(0, block * 4));
+        ASSERT_EQ(block, cache.cached(block * 3, block));
+
+        std::string data;
+        ASSERT_TRUE(cache.load(block + 5, block, data));
+        ASSERT_EQ(file.substr(size_t(block + 5), size_t(block - 5)), data);
+    }
+
+    ASSERT_FALSE(exists(path));
+}
@@ -0,0 +1,85 @@
+/**
+ * (c) 2021 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <gtest/gtest.h>
+
+#include "mega.h"
+#include "utils.h"
+
+namespace {
+
+mega::UserAlert::Base* takedown(mega::UserAlerts& alerts, mega::m_time_t timestamp)
+{
+    return new mega::UserAlert::Takedown(true, false, mega::FILENODE, 1, timestamp, alerts.nextId());
+}
+
+} // namespace
+
+TEST(UserAlerts, theOldestAreDroppedBeyondTheLimit)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+    mega::UserAlerts& useralerts = client->useralerts;
+
+    const size_t extra = 5;
+    for (size_t i = 0; i < mega::UserAlerts::MAXALERTS + extra; ++i)
+    {
+        useralerts.add(takedown(useralerts, mega::m_time_t(i)));
+    }
+
+    ASSERT_EQ(mega::UserAlerts::MAXALERTS, useralerts.alerts.size());
+    ASSERT_EQ(extra, useralerts.alerts.front()->id);
+    ASSERT_EQ(1u, useralerts.alertsByType.size());
+    ASSERT_EQ(useralerts.alerts, useralerts.alertsByType[mega::UserAlert::type_ph]);
+
+    // once dropped, they are no longer to be notified either
+    useralerts.catchupdone = true;
+    mega::m_time_t timestamp = mega::m_time_t(mega::UserAlerts::MAXALERTS + extra);
+    useralerts.add(takedown(useralerts, timestamp++));
+    mega::UserAlert::Base* first = useralerts.alerts.back();
+
+    for (size_t i = 0; i < mega::UserAlerts::MAXALERTS; ++i)
+    {
+        useralerts.add(takedown(useralerts, timestamp++));
+    }
+
+    ASSERT_EQ(mega::UserAlerts::MAXALERTS, useralerts.useralertnotify.size());
+    ASSERT_EQ(useralerts.alerts.front(), useralerts.useralertnotify.front());
+    ASSERT_NE(first, useralerts.useralertnotify.front());
+}
+
+TEST(UserAlerts, aPaymentHidesTheRemindersOnly)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+    mega::UserAlerts& useralerts = client->useralerts;
+
+    useralerts.add(new mega::UserAlert::PaymentReminder(1, useralerts.nextId()));
+    useralerts.add(takedown(useralerts, 2));
+    useralerts.add(new mega::UserAlert::PaymentReminder(3, useralerts.nextId()));
+    useralerts.add(new mega::UserAlert::Payment(true, 1, 4, useralerts.nextId()));
+
+    ASSERT_EQ(4u, useralerts.alerts.size());
+    ASSERT_EQ(2u, useralerts.alertsByType[mega::UserAlert::type_pses].size());
+    for (mega::UserAlert::Base* alert : useralerts.alerts)
+    {
+        ASSERT_EQ(alert->type != mega::UserAlert::type_pses, alert->relevant);
+    }
+}
@@ -119,3 +119,30 @@ TEST(User, unserialize_32bit)
     auto newUser = mega::User::unserialize(client.get(), &d);
     checkUsers(user, *newUser);
 }
+
+TEST(User, verifiedKeySignaturesAreRemembered)
+{
+    mega::MegaApp app;
+    ::mega::FSACCESS_CLASS fsaccess;
+    auto client = mt::makeClient(app, fsaccess);
+
+    mega::EdDSA signkey(client->rng);
+    std::string signingPubKey(reinterpret_cast<const char*>(signkey.pubKey), mega::EdDSA::PUBLIC_KEY_LENGTH);
+    std::string pubKey(32, 'k');
+    std::string signature;
+    signkey.signKey(reinterpret_cast<const unsigned char*>(pubKey.data()), pubKey.size(), &signature);
+
+    ASSERT_TRUE(client->verifykeysignature(pubKey, signature, signingPubKey));
+    ASSERT_EQ(1u, client->mVerifiedKeySignatures.size());
+    ASSERT_TRUE(client->mVerifiedKeySignaturesDirty);
+
+    // the second time, it is not verified again
+    client->mVerifiedKeySignaturesDirty = false;
+    ASSERT_TRUE(client->verifykeysignature(pubKey, signature, signingPubKey));
+    ASSERT_FALSE(client->mVerifiedKeySignaturesDirty);
+
+    // another key with the same signature isn't
+    std::string otherKey(32, 'o');
+    ASSERT_FALSE(client->verifykeysignature(otherKey, signature, signingPubKey));
+    ASSERT_EQ(1u, client->mVerifiedKeySignatures.size());
+}
@@ -17,6 +17,8 @@
  */
 
 #include <array>
+#include <atomic>
+#include <future>
 #include <tuple>
 
 #include <gtest/gtest.h>
@@ -380,6 +382,67 @@ TEST_F(ComparatorTest, CompareLocalPathAgainstString)
     }
 }
 
+TEST_F(ComparatorTest, AsciiAndUnicodeOrderAgree)
+{
+    // ASCII strings, and the same with a non-ASCII codepoint that takes the full comparison
+    EXPECT_LT(compare(string("abc"), string("abd")), 0);
+    EXPECT_LT(compare(string("abc\xc3\xa9"), string("abd\xc3\xa9")), 0);
+    EXPECT_GT(compare(string("abd"), string("abc")), 0);
+    EXPECT_GT(compare(string("abd\xc3\xa9"), string("abc\xc3\xa9")), 0);
+
+    // the shorter one is first, whatever follows in the longer one
+    EXPECT_EQ(compare(string("ab"), string("abc")), -1);
+    EXPECT_EQ(compare(string("ab"), string("ab\xc3\xa9")), -1);
+    EXPECT_EQ(compare(string("abc"), string("ab")), 1);
+
+    // ASCII letters are folded, the others compare by codepoint
+    EXPECT_EQ(ciCompare(string("Name.TXT"), string("name.txt")), 0);
+    EXPECT_EQ(ciCompare(string("N\xc3\xa9.TXT"), string("n\xc3\x89.txt")), 0);
+    EXPECT_EQ(ciCompare(string("a_"), string("A_")), 0);
+    EXPECT_GT(ciCompare(string("["), string("a")), 0);
+    EXPECT_LT(ciCompare(string("A"), string("\xc3\xa9")), 0);
+
+    // escapes are decoded wherever they are
+    EXPECT_EQ(compare(fromPath("abc%64"), string("abcd")), 0);
+}
+
+TEST(Utils, isAscii)
+{
+    string s(100, 'a');
+    EXPECT_TRUE(Utils::isAscii(s.data(), s.size()));
+    EXPECT_TRUE(Utils::isAscii(s.data(), 0));
+
+    // wherever the non-ASCII byte is: in the wide loop, the word loop or the tail
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        string t = s;
+        t[i] = '\xc3';
+        EXPECT_FALSE(Utils::isAscii(t.data(), t.size())) << i;
+        EXPECT_TRUE(Utils::isAscii(t.data(), i)) << i;
+    }
+
+    wstring w(L"ascii");
+    EXPECT_TRUE(Utils::isAscii(w.data(), w.size()));
+    w += wchar_t(0xe9);
+    EXPECT_FALSE(Utils::isAscii(w.data(), w.size()));
+}
+
+TEST(Filesystem, NormalizeKeepsAscii)
+{
+    string name("ascii name.txt");
+    name.append(1, '\0');
+    name.append("more");
+    string expected = name;
+
+    FileSystemAccess::normalize(&name);
+    EXPECT_EQ(expected, name);
+
+    // decomposed e + acute accent is composed
+    name = "e\xcc\x81";
+    FileSystemAccess::normalize(&name);
+    EXPECT_EQ("\xc3\xa9", name);
+}
+
 TEST(Conversion, HexVal)
 {
     // Decimal [0-9]
@@ -513,6 +576,98 @@ TEST(Filesystem, isContainingPathOf)
 #undef SEP
 }
 
+TEST(Filesystem, PathComponentTableSharesIdenticalNames)
+{
+    using namespace mega;
+
+    FSACCESS_CLASS fsAccess;
+    PathComponentTable table;
+
+    auto a = table.intern(LocalPath::fromPath("a", fsAccess));
+    auto b = table.intern(LocalPath::fromPath("b", fsAccess));
+    auto a2 = table.intern(LocalPath::fromPath("a", fsAccess));
+
+    EXPECT_EQ(2u, table.size());
+    EXPECT_EQ(a.get(), a2.get());
+    EXPECT_NE(a.get(), b.get());
+    EXPECT_EQ(a->toPath(fsAccess), "a");
+    EXPECT_EQ(a.hash(), LocalPath::fromPath("a", fsAccess).hash());
+
+    // the entry stays while one reference is left
+    a.reset();
+    EXPECT_EQ(2u, table.size());
+    EXPECT_EQ(a2->toPath(fsAccess), "a");
+
+    InternedPath copy = a2;
+    a2.reset();
+    EXPECT_EQ(2u, table.size());
+    copy.reset();
+    EXPECT_EQ(1u, table.size());
+
+    // the slot is reused, and the name can be found again
+    auto c = table.intern(LocalPath::fromPath("c", fsAccess));
+    EXPECT_EQ(2u, table.size());
+    EXPECT_EQ(c.get(), table.intern(LocalPath::fromPath("c", fsAccess)).get());
+
+    // growth keeps the references valid
+    vector<InternedPath> many;
+    for (int i = 0; i < 1000; ++i)
+    {
+        many.push_back(table.intern(LocalPath::fromPath(std::to_string(i), fsAccess)));
+    }
+    EXPECT_EQ(1002u, table.size());
+    EXPECT_EQ(b->toPath(fsAccess), "b");
+    EXPECT_EQ(many[500].get(), table.intern(LocalPath::fromPath("500", fsAccess)).get());
+
+    many.clear();
+    EXPECT_EQ(2u, table.size());
+}
+
+TEST(Filesystem, assignFromLeafMatchesPrependWithSeparator)
+{
+    using namespace mega;
+
+#ifdef _WIN32
+#define SEP "\\"
+#else // _WIN32
+#define SEP "/"
+#endif // ! _WIN32
+
+    FSACCESS_CLASS fsAccess;
+
+    vector<vector<string>> cases = {
+        {},
+        {"a"},
+        {"c", "b", "a"},
+        {"b", SEP "a" SEP},
+        {"b", SEP},
+        {"c", "", "a"},
+    };
+
+    for (auto& names : cases)
+    {
+        vector<LocalPath> paths;
+        vector<const LocalPath*> pointers;
+        LocalPath expected;
+
+        for (auto& name : names)
+        {
+            paths.push_back(LocalPath::fromPath(name, fsAccess));
+        }
+        for (auto& path : paths)
+        {
+            pointers.push_back(&path);
+            expected.prependWithSeparator(path);
+        }
+
+        LocalPath path = LocalPath::fromPath("stale" SEP "content", fsAccess);
+        path.assignFromLeaf(pointers.data(), pointers.size());
+        EXPECT_EQ(expected.toPath(fsAccess), path.toPath(fsAccess));
+    }
+
+#undef SEP
+}
+
 #ifdef _WIN32
 
 TEST(Filesystem, NormalizeAbsoluteAddDriveSeparator)
@@ -999,6 +1154,148 @@ TEST_F(SqliteDBTest, RemoveLegacy)
     EXPECT_FALSE(fileAccess->isfile(legacyPath));
 }
 
+TEST_F(SqliteDBTest, RemoveWithoutNodeTable)
+{
+    LocalPath outdatedPath;
+
+    // Create a dummy database.
+    {
+        SqliteDbAccess dbAccess(rootPath);
+
+        unique_ptr<SqliteDbTable> dbTable(dbAccess.open(rng, fsAccess, name));
+        ASSERT_TRUE(!!dbTable);
+
+        auto from = dbTable->dbFile();
+        dbTable.reset();
+
+        outdatedPath =
+          dbAccess.databasePath(fsAccess,
+                                name,
+                                DbAccess::LAST_DB_VERSION_WITHOUT_NODES);
+
+        EXPECT_TRUE(fsAccess.renamelocal(from, outdatedPath, false));
+    }
+
+    SqliteDbAccess dbAccess(rootPath);
+
+    unique_ptr<SqliteDbTable> dbTable(dbAccess.open(rng, fsAccess, name));
+    ASSERT_TRUE(!!dbTable);
+
+    EXPECT_EQ(dbAccess.currentDbVersion, DbAccess::DB_VERSION);
+
+    // Its node records can't be used, so the old database must be gone.
+    auto fileAccess = fsAccess.newfileaccess(false);
+    EXPECT_FALSE(fileAccess->isfile(outdatedPath));
+}
+
+TEST_F(SqliteDBTest, NodeRecords)
+{
+    SqliteDbAccess dbAccess(rootPath);
+
+    unique_ptr<SqliteDbTable> dbTable(dbAccess.open(rng, fsAccess, name));
+    ASSERT_TRUE(!!dbTable);
+
+    auto putNode = [&](uint32_t id, handle h, m_off_t size, const string& fingerprint, m_time_t ctime)
+    {
+        NodeRecordInfo info;
+        info.h = h;
+        info.parent = 1;
+        info.type = FILENODE;
+        info.size = size;
+        info.fingerprint = fingerprint;
+        info.ctime = ctime;
+
+        string content = "node" + std::to_string(id);
+        return dbTable->putNode(id, info, (char*)content.data(), unsigned(content.size()));
+    };
+
+    string user = "user";
+    EXPECT_TRUE(dbTable->put(18, (char*)user.data(), unsigned(user.size())));
+    EXPECT_TRUE(putNode(33, 100, 10, "fp1", 1000));
+    EXPECT_TRUE(putNode(49, 101, 10, "fp2", 2000));
+    EXPECT_TRUE(putNode(65, 102, 20, "fp1", 3000));
+
+    // Both kinds of records are visible through the generic interface.
+    string data;
+    EXPECT_TRUE(dbTable->get(18, &data));
+    EXPECT_EQ(data, user);
+    EXPECT_TRUE(dbTable->get(49, &data));
+    EXPECT_EQ(data, "node49");
+
+    size_t count = 0;
+    uint32_t id;
+    dbTable->rewind();
+    while (dbTable->next(&id, &data))
+    {
+        ++count;
+    }
+    EXPECT_EQ(count, 4u);
+
+    handle_vector handles;
+    EXPECT_TRUE(dbTable->getNodeHandlesByFingerprint("fp1", 10, &handles));
+    EXPECT_EQ(handles, handle_vector{100});
+
+    handles.clear();
+    EXPECT_TRUE(dbTable->getRecentFileHandles(2000, &handles));
+    EXPECT_EQ(handles, (handle_vector{102, 101}));
+
+    EXPECT_TRUE(dbTable->del(65));
+    EXPECT_FALSE(dbTable->get(65, &data));
+
+    handles.clear();
+    EXPECT_TRUE(dbTable->getRecentFileHandles(2000, &handles));
+    EXPECT_EQ(handles, handle_vector{101});
+}
+
+TEST_F(SqliteDBTest, BatchedPuts)
+{
+    SqliteDbAccess dbAccess(rootPath);
+
+    unique_ptr<SqliteDbTable> dbTable(dbAccess.open(rng, fsAccess, name));
+    ASSERT_TRUE(!!dbTable);
+
+    // Enough records for several full multi-row statements and a remainder.
+    DbRecordBatch records;
+    DbNodeRecordBatch nodeRecords;
+    for (uint32_t i = 0; i < 150; ++i)
+    {
+        records.emplace_back(i * 16 + 2, "record" + std::to_string(i));
+
+        nodeRecords.emplace_back();
+        nodeRecords.back().id = i * 16 + 1;
+        nodeRecords.back().info.h = 1000 + i;
+        nodeRecords.back().info.type = FILENODE;
+        nodeRecords.back().info.size = i % 2;
+        nodeRecords.back().info.fingerprint = "fp";
+        nodeRecords.back().data = "node" + std::to_string(i);
+    }
+
+    EXPECT_TRUE(dbTable->put(records));
+    EXPECT_TRUE(dbTable->putNodes(nodeRecords));
+
+    // Rewriting records replaces them.
+    EXPECT_TRUE(dbTable->put(records));
+
+    size_t count = 0;
+    uint32_t id;
+    string data;
+    dbTable->rewind();
+    while (dbTable->next(&id, &data))
+    {
+        ++count;
+    }
+    EXPECT_EQ(count, 300u);
+
+    EXPECT_TRUE(dbTable->get(149 * 16 + 2, &data));
+    EXPECT_EQ(data, "record149");
+    EXPECT_TRUE(dbTable->get(130 * 16 + 1, &data));
+    EXPECT_EQ(data, "node130");
+
+    handle_vector handles;
+    EXPECT_TRUE(dbTable->getNodeHandlesByFingerprint("fp", 1, &handles));
+    EXPECT_EQ(handles.size(), 75u);
+}
+
 TEST_F(SqliteDBTest, RootPath)
 {
     SqliteDbAccess dbAccess(rootPath);
@@ -1106,3 +1403,503 @@ TEST(JSON, NullValue)
     EXPECT_EQ(0, strcmp(j.pos, "\"json\"}remainder"));
 }
 
+
+TEST(JSON, ObjectEnd)
+{
+    string s = "{\"a\":\"}\\\"]\",\"b\":[1,{\"c\":2}]},{\"d\"";
+    const char* begin = s.c_str();
+    const char* end = begin + s.size();
+
+    const char* first = JSON::objectend(begin, end);
+    ASSERT_NE(nullptr, first);
+    EXPECT_EQ("{\"a\":\"}\\\"]\",\"b\":[1,{\"c\":2}]}", string(begin, first));
+
+    // incomplete, or not an object
+    EXPECT_EQ(nullptr, JSON::objectend(first + 1, end));
+    EXPECT_EQ(nullptr, JSON::objectend(first, end));
+    EXPECT_EQ(nullptr, JSON::objectend(begin, first - 1));
+}
+
+TEST(SharedRecursiveMutex, ReadersShareIt)
+{
+    SharedRecursiveMutex m;
+    m.lock_shared();
+    m.lock_shared();
+
+    std::atomic<bool> locked(false);
+    std::thread reader([&]()
+    {
+        m.lock_shared();
+        locked = true;
+        m.unlock_shared();
+    });
+    reader.join();
+    EXPECT_TRUE(locked);
+
+    // not while any reader holds it
+    std::thread owner([&]() { locked = m.try_lock_for(std::chrono::milliseconds(10)); });
+    owner.join();
+    EXPECT_FALSE(locked);
+
+    m.unlock_shared();
+    m.unlock_shared();
+
+    owner = std::thread([&]()
+    {
+        locked = m.try_lock();
+        m.unlock();
+    });
+    owner.join();
+    EXPECT_TRUE(locked);
+}
+
+TEST(SharedRecursiveMutex, OwnerCanReadAndWaitingOwnersGoFirst)
+{
+    SharedRecursiveMutex m;
+    m.lock();
+    m.lock();
+    m.lock_shared();
+    m.unlock_shared();
+    m.unlock();
+
+    std::atomic<bool> locked(false);
+    std::thread reader([&]() { m.lock_shared(); locked = true; m.unlock_shared(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_FALSE(locked);
+
+    m.unlock();
+    reader.join();
+    EXPECT_TRUE(locked);
+
+    // a reader arriving while an owner waits queues behind it
+    m.lock_shared();
+    std::atomic<int> order(0);
+    std::atomic<int> ownerOrder(0), readerOrder(0);
+    std::thread owner([&]() { m.lock(); ownerOrder = ++order; m.unlock(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    reader = std::thread([&]() { m.lock_shared(); readerOrder = ++order; m.unlock_shared(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(0, order);
+
+    m.unlock_shared();
+    owner.join();
+    reader.join();
+    EXPECT_EQ(1, ownerOrder);
+    EXPECT_EQ(2, readerOrder);
+}
+
+TEST(SharedRecursiveMutex, YieldingLetsAWaitingOwnerIn)
+{
+    SharedRecursiveMutex m;
+
+    // nobody waiting
+    m.lock();
+    m.lock();
+    EXPECT_FALSE(m.yieldToWriters(2));
+
+    std::atomic<bool> locked(false);
+    std::thread owner([&]() { m.lock(); locked = true; m.unlock(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_FALSE(locked);
+
+    // all the levels are let go, and taken back once the other one has had it
+    EXPECT_TRUE(m.yieldToWriters(2));
+    EXPECT_TRUE(locked);
+    owner.join();
+    m.unlock();
+    m.unlock();
+
+    // the same for a reader
+    m.lock_shared();
+    locked = false;
+    owner = std::thread([&]() { m.lock(); locked = true; m.unlock(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_FALSE(locked);
+    EXPECT_TRUE(m.yieldToWriters(1));
+    owner.join();
+    EXPECT_TRUE(locked);
+    m.unlock_shared();
+
+    owner = std::thread([&]() { locked = m.try_lock(); m.unlock(); });
+    owner.join();
+    EXPECT_TRUE(locked);
+}
+
+TEST(SharedRecursiveMutex, YieldingKeepsTheLevelsOfTheCallersUpTheStack)
+{
+    SharedRecursiveMutex m;
+
+    // a yielding call, taking its own level
+    auto yieldingCall = [&m](bool shared)
+    {
+        shared ? m.lock_shared() : m.lock();
+        bool yielded = m.yieldToWriters(1);
+        shared ? m.unlock_shared() : m.unlock();
+        return yielded;
+    };
+
+    for (bool shared : {false, true})
+    {
+        // the caller holds it exclusively: nobody else may get it in the middle
+        m.lock();
+        std::atomic<bool> locked(false);
+        std::thread owner([&]() { m.lock(); locked = true; m.unlock(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        EXPECT_FALSE(yieldingCall(shared));
+        EXPECT_FALSE(locked);
+
+        m.unlock();
+        owner.join();
+        EXPECT_TRUE(locked);
+    }
+
+    // the caller holds it shared
+    m.lock_shared();
+    std::atomic<bool> locked(false);
+    std::thread owner([&]() { m.lock(); locked = true; m.unlock(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    EXPECT_FALSE(yieldingCall(true));
+    EXPECT_FALSE(locked);
+
+    m.unlock_shared();
+    owner.join();
+    EXPECT_TRUE(locked);
+}
+
+TEST(MpscQueue, KeepsTheOrderOfEachProducer)
+{
+    MpscQueue<int> q;
+    std::vector<int> drained;
+    EXPECT_TRUE(q.empty());
+    EXPECT_EQ(0u, q.drainInto(drained));
+
+    const int producers = 4, perProducer = 10000;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&q, p]()
+        {
+            for (int i = 0; i < perProducer; i += 2)
+            {
+                if (i % 4)
+                {
+                    q.push(p * perProducer + i);
+                    q.push(p * perProducer + i + 1);
+                }
+                else
+                {
+                    // both at once: they stay together
+                    int two[] = { p * perProducer + i, p * perProducer + i + 1 };
+                    q.push(std::begin(two), std::end(two));
+                }
+            }
+        });
+    }
+
+    while (drained.size() < size_t(producers * perProducer))
+    {
+        q.drainInto(drained);
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    EXPECT_TRUE(q.empty());
+
+    std::vector<int> next(producers);
+    for (size_t i = 0; i < drained.size(); ++i)
+    {
+        int p = drained[i] / perProducer;
+        int n = drained[i] % perProducer;
+        ASSERT_EQ(next[p], n);
+        next[p] = n + 1;
+
+        if (n % 4 == 0)
+        {
+            ASSERT_LT(i + 1, drained.size());
+            ASSERT_EQ(drained[i] + 1, drained[i + 1]);
+        }
+    }
+}
+
+TEST(MegaClientAsyncQueue, RunsTheMostUrgentJobsFirst)
+{
+    using Queue = mega::MegaClientAsyncQueue;
+    WAIT_CLASS waiter;
+    std::mutex m;
+    std::vector<int> order;
+    std::promise<void> release;
+    std::shared_future<void> released(release.get_future());
+
+    {
+        Queue queue(waiter, 1);
+
+        // the worker waits in the first job while the others are queued
+        std::promise<void> started;
+        queue.push([&](mega::SymmCipher&) { started.set_value(); released.wait(); }, false);
+        started.get_future().wait();
+
+        auto job = [&](int n) { return [&, n](mega::SymmCipher&) { std::lock_guard<std::mutex> g(m); order.push_back(n); }; };
+        queue.push(job(1), false, Queue::PRIORITY_BACKGROUND);
+        queue.push(job(2), false);
+        queue.push(job(3), true, Queue::PRIORITY_INTERACTIVE);
+        queue.push(job(4), false, Queue::PRIORITY_INTERACTIVE, 1234);
+        queue.push(job(5), false, Queue::PRIORITY_BACKGROUND);
+        queue.clearDiscardable();
+        EXPECT_EQ(4, queue.depth().value);
+
+        release.set_value();
+        // the destructor lets the workers finish the queued jobs
+    }
+
+    EXPECT_EQ((std::vector<int>{4, 2, 1, 5}), order);
+}
+
+TEST(MegaClientAsyncQueue, IdleWorkersTakeTheJobsOfBusyOnes)
+{
+    using Queue = mega::MegaClientAsyncQueue;
+    WAIT_CLASS waiter;
+    std::promise<void> release;
+    std::shared_future<void> released(release.get_future());
+    std::atomic<int> done{0};
+
+    Queue queue(waiter, 4);
+
+    // all for the same worker, which is kept busy: the others have to steal them
+    std::promise<void> started;
+    queue.push([&](mega::SymmCipher&) { started.set_value(); released.wait(); }, false, Queue::PRIORITY_NORMAL, 42);
+    started.get_future().wait();
+    for (int i = 0; i < 100; ++i)
+    {
+        queue.push([&](mega::SymmCipher&) { done++; }, false, Queue::PRIORITY_NORMAL, 42);
+    }
+
+    for (int i = 0; i < 1000 && done < 100; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_EQ(100, done);
+    EXPECT_EQ(0, queue.depth().value);
+    release.set_value();
+}
+
+TEST(MegaClientAsyncQueue, QueuesSharingAPoolKeepTheirJobsApart)
+{
+    using Queue = mega::MegaClientAsyncQueue;
+    WAIT_CLASS waiterA, waiterB;
+    std::mutex m;
+    std::vector<int> ran;
+    std::promise<void> release;
+    std::shared_future<void> released(release.get_future());
+
+    auto pool = Queue::newWorkerPool(1);
+    std::unique_ptr<Queue> a(new Queue(waiterA, pool));
+    Queue b(waiterB, pool);
+
+    std::promise<void> started;
+    b.push([&](mega::SymmCipher&) { started.set_value(); released.wait(); }, false);
+    started.get_future().wait();
+
+    auto job = [&](int n) { return [&, n](mega::SymmCipher&) { std::lock_guard<std::mutex> g(m); ran.push_back(n); }; };
+    a->push(job(1), true);
+    a->push(job(2), false);
+    b.push(job(3), true);
+    a->clearDiscardable();
+    EXPECT_EQ(1, a->depth().value);
+    EXPECT_EQ(1, b.depth().value);
+
+    // a queue waits for its own jobs only
+    release.set_value();
+    a.reset();
+    {
+        std::lock_guard<std::mutex> g(m);
+        EXPECT_NE(ran.end(), std::find(ran.begin(), ran.end(), 2));
+        EXPECT_EQ(ran.end(), std::find(ran.begin(), ran.end(), 1));
+    }
+
+    b.push(job(4), false);
+    for (int i = 0; i < 1000 && b.depth().value; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_EQ(0, b.depth().value);
+}
+
+TEST(CodeCounter, HistogramBucketsStayWithinAnEighth)
+{
+    using mega::CodeCounter::Histogram;
+
+    // exact below 16 us, contiguous and ordered after that
+    for (uint64_t us = 0; us < 16; ++us)
+    {
+        EXPECT_EQ(int(us), Histogram::bucketOf(us));
+    }
+    for (int b = 1; b < Histogram::BUCKETS; ++b)
+    {
+        ASSERT_LT(Histogram::lowerBound(b - 1), Histogram::lowerBound(b));
+        ASSERT_EQ(b, Histogram::bucketOf(Histogram::lowerBound(b)));
+        ASSERT_EQ(b - 1, Histogram::bucketOf(Histogram::lowerBound(b) - 1));
+    }
+    for (uint64_t us = 16; us < (uint64_t(1) << 30); us = us * 3 / 2 + 1)
+    {
+        uint64_t lower = Histogram::lowerBound(Histogram::bucketOf(us));
+        EXPECT_LE(lower, us);
+        EXPECT_LE(us - lower, lower / 8);
+    }
+    EXPECT_EQ(Histogram::BUCKETS - 1, Histogram::bucketOf(~uint64_t(0)));
+
+    Histogram h;
+    EXPECT_EQ(0u, h.percentile(0.5));
+    for (uint64_t us = 1; us <= 1000; ++us)
+    {
+        h.record(us);
+    }
+    EXPECT_EQ(1000u, h.count());
+    EXPECT_EQ(1000u, h.max());
+    EXPECT_NEAR(500.0, double(h.percentile(0.5)), 500 / 8.0);
+    EXPECT_NEAR(990.0, double(h.percentile(0.99)), 990 / 8.0);
+    EXPECT_EQ(1000u, h.percentile(1));
+    EXPECT_EQ(15u, h.countUpTo(15));
+    EXPECT_EQ(959u, h.countUpTo(999));  // 960 to 1023 share a bucket
+    EXPECT_EQ(1000u, h.countUpTo(1023));
+
+    h.reset();
+    EXPECT_EQ(0u, h.count());
+    EXPECT_EQ("{\"count\":0,\"p50\":0,\"p90\":0,\"p99\":0,\"max\":0,\"buckets\":[]}", h.toJson());
+    h.record(3);
+    h.record(3);
+    EXPECT_EQ("{\"count\":2,\"p50\":3,\"p90\":3,\"p99\":3,\"max\":3,\"buckets\":[[3,2]]}", h.toJson());
+}
+
+TEST(CodeCounter, CountsFromSeveralThreads)
+{
+    mega::CodeCounter::ScopeStats stats("test");
+    mega::CodeCounter::Gauge gauge;
+
+    const int threadCount = 4, perThread = 10000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&]()
+        {
+            for (int i = 0; i < perThread; ++i)
+            {
+                gauge.add(1);
+                mega::CodeCounter::ScopeTimer timer(stats);
+                gauge.add(-1);
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    EXPECT_EQ(uint64_t(threadCount * perThread), stats.count.load());
+    EXPECT_EQ(uint64_t(threadCount * perThread), stats.durations.count());
+    EXPECT_EQ(0, gauge.value.load());
+    EXPECT_GE(gauge.peak.load(), 1);
+    EXPECT_LE(gauge.peak.load(), threadCount);
+    EXPECT_EQ(0u, stats.toJson().find("{\"count\":40000,\"inprogress\":0,"));
+}
+
+TEST(CodeCounter, LoopProfilerTimesNestedPhasesExclusively)
+{
+    mega::CodeCounter::LoopProfiler profiler({ "outer", "inner" }, std::chrono::milliseconds(25));
+    auto sleepMs = [](int ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); };
+
+    // not in an iteration: nothing is timed
+    {
+        mega::CodeCounter::LoopProfiler::Phase phase(profiler, 0);
+        sleepMs(1);
+    }
+    EXPECT_EQ(0u, profiler.totalMicroseconds(0));
+
+    mega::CodeCounter::LoopProfiler::Iteration iteration;
+    profiler.beginIteration();
+    {
+        mega::CodeCounter::LoopProfiler::Phase outer(profiler, 0);
+        sleepMs(10);
+        {
+            mega::CodeCounter::LoopProfiler::Phase inner(profiler, 1);
+            sleepMs(20);
+        }
+    }
+    sleepMs(5);
+    EXPECT_TRUE(profiler.endIteration(&iteration));
+
+    EXPECT_GE(iteration.phases[0], 10000u);
+    EXPECT_LT(iteration.phases[0], 20000u);
+    EXPECT_GE(iteration.phases[1], 20000u);
+    EXPECT_GE(iteration.other(), 5000u);
+    EXPECT_EQ(iteration.total, iteration.phases[0] + iteration.phases[1] + iteration.other());
+    EXPECT_EQ(1u, profiler.slowIterations());
+    EXPECT_EQ(0u, profiler.describe(iteration).find(std::to_string(iteration.total / 1000) + " ms: inner "));
+
+    profiler.beginIteration();
+    EXPECT_FALSE(profiler.endIteration());
+    EXPECT_EQ(1u, profiler.slowIterations());
+
+    std::string json = profiler.toJson();
+    EXPECT_EQ(0u, json.find("{\"slowthresholdms\":25,\"slowiterations\":1,\"totals\":{\"outer\":"));
+    EXPECT_NE(std::string::npos, json.find("\"last\":[{\"started\":"));
+}
+
+TEST(CodeCounter, StartupProfileKeepsTheFirstRunOfEachPhase)
+{
+    using mega::CodeCounter::StartupProfile;
+    StartupProfile profile;
+    EXPECT_EQ("{}", profile.toJson());
+
+    auto origin = std::chrono::high_resolution_clock::now();
+    profile.setOrigin(origin);
+    profile.record(StartupProfile::PHASE_CLIENT_INIT, origin + std::chrono::milliseconds(5), origin + std::chrono::milliseconds(15));
+    profile.record(StartupProfile::PHASE_CLIENT_INIT, origin, origin + std::chrono::milliseconds(100));
+
+    profile.begin(StartupProfile::PHASE_FETCHNODES);
+    {
+        StartupProfile::Scope scope(profile, StartupProfile::PHASE_FETCHSC);
+    }
+    profile.end(StartupProfile::PHASE_FETCHNODES);
+    profile.end(StartupProfile::PHASE_SYNC_RESUME);     // never began
+
+    std::string json = profile.toJson();
+    EXPECT_EQ(0u, json.find("{\"client_init\":{\"startms\":5,\"ms\":10},\"fetchsc\":{\"startms\":"));
+    EXPECT_NE(std::string::npos, json.find(",\"fetchnodes\":{\"startms\":"));
+    EXPECT_EQ(std::string::npos, json.find("sync_resume"));
+}
+
+#ifdef __linux__
+TEST(ThreadRoles, aThreadTakesTheSettingsOfItsRole)
+{
+    cpu_set_t allowed;
+    ASSERT_EQ(0, sched_getaffinity(0, sizeof allowed, &allowed));
+    unsigned cpu = 0;
+    while (cpu < 64 && !CPU_ISSET(cpu, &allowed))
+    {
+        ++cpu;
+    }
+    ASSERT_LT(cpu, 64u);
+
+    mega::ThreadRoles::configure(mega::ThreadRoles::GFX, 0, uint64_t(1) << cpu);
+
+    char name[16] = {};
+    cpu_set_t set;
+    std::thread t([&]()
+    {
+        mega::ThreadRoles::enter(mega::ThreadRoles::GFX, "mega-test-thread");
+        pthread_getname_np(pthread_self(), name, sizeof name);
+        sched_getaffinity(0, sizeof set, &set);
+    });
+    t.join();
+
+    mega::ThreadRoles::configure(mega::ThreadRoles::GFX, 0, 0);
+
+    // cut to what the platform takes
+    EXPECT_STREQ("mega-test-threa", name);
+    EXPECT_EQ(1, CPU_COUNT(&set));
+    EXPECT_TRUE(CPU_ISSET(cpu, &set));
+}
+#endif